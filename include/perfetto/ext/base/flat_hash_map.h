@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_EXT_BASE_FLAT_HASH_MAP_H_
+#define INCLUDE_PERFETTO_EXT_BASE_FLAT_HASH_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+
+// A hash map with open addressing, which stores its keys and values in flat
+// arrays rather than in heap-allocated nodes like std::unordered_map. This
+// makes lookups and insertions cache friendly and avoids one allocation per
+// entry. It is meant for maps looked up in hot paths which don't need to be
+// iterated in key order (for which std::map is still the right choice).
+//
+// Differences from std::unordered_map:
+// - Insertions and erasures invalidate the pointers to the values and the
+//   iterators, as the table can be rehashed.
+// - Erased entries leave a tombstone behind. Tombstones are reused by
+//   insertions and dropped when the table is rehashed.
+// - Key and Value must be movable. Value needs to be default constructible
+//   only for operator[].
+// - The iteration order is unspecified.
+//
+// Usage:
+//   FlatHashMap<uint32_t, int> map;
+//   map.Insert(1, 42);
+//   if (int* value = map.Find(1)) ...
+//   for (auto it = map.GetIterator(); it; ++it) { it.key(); it.value(); }
+//
+// See flat_hash_map_benchmark.cc for a comparison with the STL maps.
+
+namespace perfetto {
+namespace base {
+
+// Probing strategies for FlatHashMap. |step| is the number of the probe,
+// starting from 0. Both visit all the slots of a power-of-two table.
+
+// Consecutive probes hit the same cache lines. Best for keys which hash well.
+struct LinearProbe {
+  static inline size_t Calc(size_t key_hash, size_t step, size_t mask) {
+    return (key_hash + step) & mask;
+  }
+};
+
+// Less sensitive than linear probing to clusters of keys which hash close to
+// each other. Uses the triangular numbers.
+struct QuadraticProbe {
+  static inline size_t Calc(size_t key_hash, size_t step, size_t mask) {
+    return (key_hash + (step * (step + 1)) / 2) & mask;
+  }
+};
+
+template <typename Key,
+          typename Value,
+          typename Hasher = std::hash<Key>,
+          typename Probe = QuadraticProbe>
+class FlatHashMap {
+ public:
+  // Usage: for (auto it = map.GetIterator(); it; ++it) { it.key() ... }
+  class Iterator {
+   public:
+    const Key& key() const { return map_->keys_.get()[idx_]; }
+    Value& value() const { return map_->values_.get()[idx_]; }
+
+    explicit operator bool() const { return idx_ < map_->capacity_; }
+
+    // This is for ++it. it++ is deliberately not supported.
+    Iterator& operator++() {
+      PERFETTO_DCHECK(idx_ < map_->capacity_);
+      ++idx_;
+      SkipFreeSlots();
+      return *this;
+    }
+
+   private:
+    friend class FlatHashMap;
+    explicit Iterator(FlatHashMap* map) : map_(map) { SkipFreeSlots(); }
+
+    void SkipFreeSlots() {
+      while (idx_ < map_->capacity_ && map_->tags_[idx_] <= kTombstone)
+        ++idx_;
+    }
+
+    FlatHashMap* map_;
+    size_t idx_ = 0;
+  };
+
+  static constexpr int kDefaultLoadLimitPct = 75;
+
+  // |load_limit_pct| is the maximum percentage of the slots, including the
+  // tombstones, which can be taken before the table is grown or rehashed.
+  explicit FlatHashMap(size_t initial_capacity = 0,
+                       int load_limit_pct = kDefaultLoadLimitPct)
+      : load_limit_pct_(load_limit_pct) {
+    PERFETTO_CHECK(load_limit_pct > 0 && load_limit_pct < 100);
+    if (initial_capacity > 0)
+      Reserve(initial_capacity);
+  }
+
+  ~FlatHashMap() { Clear(); }
+
+  FlatHashMap(FlatHashMap&& other) noexcept
+      : capacity_(other.capacity_),
+        size_(other.size_),
+        taken_slots_(other.taken_slots_),
+        max_probe_length_(other.max_probe_length_),
+        load_limit_(other.load_limit_),
+        load_limit_pct_(other.load_limit_pct_),
+        tags_(std::move(other.tags_)),
+        keys_(std::move(other.keys_)),
+        values_(std::move(other.values_)) {
+    other.capacity_ = 0;
+    other.size_ = 0;
+    other.taken_slots_ = 0;
+    other.max_probe_length_ = 0;
+    other.load_limit_ = 0;
+  }
+
+  FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+    if (this != &other) {
+      this->~FlatHashMap();
+      new (this) FlatHashMap(std::move(other));
+    }
+    return *this;
+  }
+
+  FlatHashMap(const FlatHashMap&) = delete;
+  FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+  // Inserts |key| with |value| if |key| isn't in the map yet. Returns the
+  // value in the map for |key| and true if it has been inserted, or false if
+  // |key| was already there (in which case |value| is discarded).
+  std::pair<Value*, bool> Insert(Key key, Value value) {
+    const size_t key_hash = HashKey(key);
+    const uint8_t tag = HashToTag(key_hash);
+    size_t slot;
+    size_t probe_len;
+
+    // At most two attempts: the second one happens only if the first one
+    // would bring the table beyond its load limit. The table can't be grown
+    // upfront, as inserting a key which is already there must not invalidate
+    // the iterators.
+    for (;;) {
+      slot = kNotFound;
+      for (probe_len = 0; probe_len < capacity_;) {
+        const size_t idx = Probe::Calc(key_hash, probe_len, capacity_ - 1);
+        const uint8_t slot_tag = tags_[idx];
+        ++probe_len;
+        if (slot_tag == kFreeSlot) {
+          // A free slot ends the chain of the keys with the same hash. Reuse
+          // the first tombstone found along the chain, if any.
+          if (slot == kNotFound)
+            slot = idx;
+          break;
+        }
+        if (slot_tag == kTombstone) {
+          if (slot == kNotFound)
+            slot = idx;
+          continue;
+        }
+        if (slot_tag == tag && keys_.get()[idx] == key)
+          return std::make_pair(&values_.get()[idx], false);
+      }
+      if (PERFETTO_LIKELY(slot != kNotFound &&
+                          (tags_[slot] == kTombstone ||
+                           taken_slots_ < load_limit_))) {
+        break;
+      }
+      GrowOrRehash();
+    }
+
+    new (&keys_.get()[slot]) Key(std::move(key));
+    new (&values_.get()[slot]) Value(std::move(value));
+    if (tags_[slot] == kFreeSlot)
+      taken_slots_++;
+    tags_[slot] = tag;
+    max_probe_length_ = std::max(max_probe_length_, probe_len);
+    size_++;
+    return std::make_pair(&values_.get()[slot], true);
+  }
+
+  // Returns the value for |key|, or nullptr if |key| isn't in the map. The
+  // pointer is valid until the next insertion or erasure.
+  Value* Find(const Key& key) const {
+    const size_t idx = FindSlot(key);
+    return idx == kNotFound ? nullptr : &values_.get()[idx];
+  }
+
+  // Returns true if |key| was in the map.
+  bool Erase(const Key& key) {
+    const size_t idx = FindSlot(key);
+    if (idx == kNotFound)
+      return false;
+    DestroySlot(idx);
+    tags_[idx] = kTombstone;
+    size_--;
+    return true;
+  }
+
+  // Removes all the entries. Keeps the capacity.
+  void Clear() {
+    for (size_t i = 0; i < capacity_; i++) {
+      if (tags_[i] > kTombstone)
+        DestroySlot(i);
+    }
+    if (capacity_)
+      memset(tags_.get(), kFreeSlot, capacity_);
+    size_ = 0;
+    taken_slots_ = 0;
+    max_probe_length_ = 0;
+  }
+
+  // Inserts a default-constructed value for |key| if |key| isn't in the map.
+  Value& operator[](Key key) { return *Insert(std::move(key), Value()).first; }
+
+  // Ensures that |n| entries can be inserted without rehashing.
+  void Reserve(size_t n) {
+    const size_t min_capacity =
+        n * 100 / static_cast<size_t>(load_limit_pct_) + 1;
+    if (min_capacity > capacity_)
+      Rehash(min_capacity);
+  }
+
+  Iterator GetIterator() { return Iterator(this); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  // Tags of the slots: the top bits of the hash for the taken ones, which
+  // allows to skip most key comparisons, or one of these.
+  static constexpr uint8_t kFreeSlot = 0;
+  static constexpr uint8_t kTombstone = 1;
+  static constexpr size_t kMinCapacity = 16;
+  static constexpr size_t kNotFound = std::numeric_limits<size_t>::max();
+
+  // Allocates memory for the keys and values without constructing them.
+  struct RawDeleter {
+    void operator()(void* p) const { ::operator delete(p); }
+  };
+  template <typename T>
+  using RawArray = std::unique_ptr<T, RawDeleter>;
+  template <typename T>
+  static RawArray<T> AllocRawArray(size_t n) {
+    return RawArray<T>(static_cast<T*>(::operator new(n * sizeof(T))));
+  }
+
+  size_t FindSlot(const Key& key) const {
+    const size_t key_hash = HashKey(key);
+    const uint8_t tag = HashToTag(key_hash);
+    for (size_t i = 0; i < max_probe_length_; ++i) {
+      const size_t idx = Probe::Calc(key_hash, i, capacity_ - 1);
+      const uint8_t slot_tag = tags_[idx];
+      if (slot_tag == kFreeSlot)
+        return kNotFound;
+      // Tombstones never match |tag|, as HashToTag() never returns them.
+      if (slot_tag == tag && keys_.get()[idx] == key)
+        return idx;
+    }
+    return kNotFound;
+  }
+
+  void DestroySlot(size_t idx) {
+    keys_.get()[idx].~Key();
+    values_.get()[idx].~Value();
+  }
+
+  PERFETTO_NO_INLINE void GrowOrRehash() {
+    // If at least half of the taken slots are tombstones, rehashing at the
+    // same capacity is enough to make room.
+    if (capacity_ > 0 && size_ * 2 <= taken_slots_)
+      Rehash(capacity_);
+    else
+      Rehash(std::max(capacity_ * 2, kMinCapacity));
+  }
+
+  // Moves all the entries into a new table of at least |min_capacity| slots.
+  PERFETTO_NO_INLINE void Rehash(size_t min_capacity) {
+    size_t new_capacity = kMinCapacity;
+    while (new_capacity < min_capacity)
+      new_capacity <<= 1;
+    PERFETTO_CHECK(new_capacity >= min_capacity);
+
+    std::unique_ptr<uint8_t[]> old_tags(std::move(tags_));
+    RawArray<Key> old_keys(std::move(keys_));
+    RawArray<Value> old_values(std::move(values_));
+    const size_t old_capacity = capacity_;
+
+    capacity_ = new_capacity;
+    size_ = 0;
+    taken_slots_ = 0;
+    max_probe_length_ = 0;
+    load_limit_ = new_capacity * static_cast<size_t>(load_limit_pct_) / 100;
+    tags_.reset(new uint8_t[new_capacity]);
+    memset(tags_.get(), kFreeSlot, new_capacity);
+    keys_ = AllocRawArray<Key>(new_capacity);
+    values_ = AllocRawArray<Value>(new_capacity);
+
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old_tags[i] <= kTombstone)
+        continue;
+      Key& key = old_keys.get()[i];
+      Value& value = old_values.get()[i];
+      Insert(std::move(key), std::move(value));
+      key.~Key();
+      value.~Value();
+    }
+  }
+
+  static inline size_t HashKey(const Key& key) {
+    // Mixes the bits of the hash (with the finalizer of MurmurHash3): the
+    // std::hash<> of integers is the identity on most STL implementations,
+    // which would make the keys with the same low bits collide.
+    uint64_t h = static_cast<uint64_t>(Hasher()(key));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+  }
+
+  static inline uint8_t HashToTag(size_t key_hash) {
+    // The top bits, as the low bits pick the slot.
+    const auto tag = static_cast<uint8_t>(key_hash >> (sizeof(size_t) * 8 - 8));
+    return tag > kTombstone ? tag : static_cast<uint8_t>(tag + 2);
+  }
+
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t taken_slots_ = 0;  // Entries + tombstones.
+  size_t max_probe_length_ = 0;
+  size_t load_limit_ = 0;  // Max |taken_slots_|, updated with |capacity_|.
+  int load_limit_pct_ = kDefaultLoadLimitPct;
+
+  // All of size |capacity_|. Only the slots with a tag > kTombstone hold a
+  // constructed key and value.
+  std::unique_ptr<uint8_t[]> tags_;
+  RawArray<Key> keys_;
+  RawArray<Value> values_;
+};
+
+template <typename K, typename V, typename H, typename P>
+constexpr int FlatHashMap<K, V, H, P>::kDefaultLoadLimitPct;
+template <typename K, typename V, typename H, typename P>
+constexpr uint8_t FlatHashMap<K, V, H, P>::kFreeSlot;
+template <typename K, typename V, typename H, typename P>
+constexpr uint8_t FlatHashMap<K, V, H, P>::kTombstone;
+template <typename K, typename V, typename H, typename P>
+constexpr size_t FlatHashMap<K, V, H, P>::kMinCapacity;
+template <typename K, typename V, typename H, typename P>
+constexpr size_t FlatHashMap<K, V, H, P>::kNotFound;
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_EXT_BASE_FLAT_HASH_MAP_H_
@@ -19,6 +19,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <type_traits>
 
 namespace perfetto {
@@ -26,7 +27,9 @@ namespace base {
 
 // A helper class which computes a 64-bit hash of the input data.
 // The algorithm used is FNV-1a as it is fast and easy to implement and has
-// relatively few collisions.
+// relatively few collisions. Its digests are stable and can be persisted.
+// For in-memory hash tables of long byte strings, prefer the faster
+// Hash::Bulk().
 // WARNING: This hash function should not be used for any cryptographic purpose.
 class Hash {
  public:
@@ -51,10 +54,89 @@ class Hash {
 
   uint64_t digest() { return result_; }
 
+  // Hashes |data| in one go with xxHash64, which consumes 8 bytes per step
+  // rather than one: several times faster than Update() for strings longer
+  // than a few tens of bytes. The result differs from the FNV-1a digest and
+  // may change across versions, so it must not be persisted.
+  static uint64_t Bulk(const char* data, size_t size) {
+    const char* const end = data + size;
+    uint64_t h;
+    if (size >= 32) {
+      uint64_t v1 = kXxPrime1 + kXxPrime2;
+      uint64_t v2 = kXxPrime2;
+      uint64_t v3 = 0;
+      uint64_t v4 = static_cast<uint64_t>(0) - kXxPrime1;
+      for (; data + 32 <= end; data += 32) {
+        v1 = XxRound(v1, Load64(data));
+        v2 = XxRound(v2, Load64(data + 8));
+        v3 = XxRound(v3, Load64(data + 16));
+        v4 = XxRound(v4, Load64(data + 24));
+      }
+      h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+      h = XxMergeRound(h, v1);
+      h = XxMergeRound(h, v2);
+      h = XxMergeRound(h, v3);
+      h = XxMergeRound(h, v4);
+    } else {
+      h = kXxPrime5;
+    }
+    h += static_cast<uint64_t>(size);
+
+    for (; data + 8 <= end; data += 8) {
+      h ^= XxRound(0, Load64(data));
+      h = Rotl(h, 27) * kXxPrime1 + kXxPrime4;
+    }
+    if (data + 4 <= end) {
+      uint32_t k;
+      memcpy(&k, data, sizeof(k));
+      h ^= static_cast<uint64_t>(k) * kXxPrime1;
+      h = Rotl(h, 23) * kXxPrime2 + kXxPrime3;
+      data += 4;
+    }
+    for (; data < end; data++) {
+      h ^= static_cast<uint8_t>(*data) * kXxPrime5;
+      h = Rotl(h, 11) * kXxPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kXxPrime2;
+    h ^= h >> 29;
+    h *= kXxPrime3;
+    h ^= h >> 32;
+    return h;
+  }
+
  private:
   static constexpr uint64_t kFnv1a64OffsetBasis = 0xcbf29ce484222325;
   static constexpr uint64_t kFnv1a64Prime = 0x100000001b3;
 
+  static constexpr uint64_t kXxPrime1 = 0x9e3779b185ebca87;
+  static constexpr uint64_t kXxPrime2 = 0xc2b2ae3d27d4eb4f;
+  static constexpr uint64_t kXxPrime3 = 0x165667b19e3779f9;
+  static constexpr uint64_t kXxPrime4 = 0x85ebca77c2b2ae63;
+  static constexpr uint64_t kXxPrime5 = 0x27d4eb2f165667c5;
+
+  static inline uint64_t Rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  // Unaligned load. All the supported archs are little endian.
+  static inline uint64_t Load64(const char* p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+  }
+
+  static inline uint64_t XxRound(uint64_t acc, uint64_t input) {
+    acc += input * kXxPrime2;
+    return Rotl(acc, 31) * kXxPrime1;
+  }
+
+  static inline uint64_t XxMergeRound(uint64_t acc, uint64_t val) {
+    acc ^= XxRound(0, val);
+    return acc * kXxPrime1 + kXxPrime4;
+  }
+
   uint64_t result_ = kFnv1a64OffsetBasis;
 };
 
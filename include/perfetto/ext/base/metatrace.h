@@ -17,9 +17,9 @@
 #ifndef INCLUDE_PERFETTO_EXT_BASE_METATRACE_H_
 #define INCLUDE_PERFETTO_EXT_BASE_METATRACE_H_
 
-#include <array>
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <string>
 
 #include "perfetto/base/logging.h"
@@ -31,15 +31,15 @@
 // A facility to trace execution of the perfetto codebase itself.
 // The meta-tracing framework is organized into three layers:
 //
-// 1. A static ring-buffer in base/ (this file) that supports concurrent writes
-//    and a single reader.
+// 1. A set of per-thread ring-buffers in base/ (this file). Each thread that
+//    records an event gets its own ring, so writers never contend with each
+//    other, and a single reader drains all of them.
 //    The responsibility of this layer is to store events and counters as
 //    efficiently as possible without re-entering any tracing code.
-//    This is really a static-storage-based ring-buffer based on a POD array.
 //    This layer does NOT deal with serializing the meta-trace buffer.
-//    It posts a task when it's half full and expects something outside of
-//    base/ to drain the ring-buffer and serialize it, eventually writing it
-//    into the trace itself, before it gets 100% full.
+//    It posts a task when a ring is half full and expects something outside
+//    of base/ to drain the ring-buffers and serialize them, eventually writing
+//    them into the trace itself, before they get 100% full.
 //
 // 2. A class in tracing/core which takes care of serializing the meta-trace
 //    buffer into the trace using a TraceWriter. See metatrace_writer.h .
@@ -66,15 +66,23 @@ extern std::atomic<uint32_t> g_enabled_tags;
 // in Record.
 extern std::atomic<uint64_t> g_enabled_timestamp;
 
+// 4096 * 16 bytes = 64K per thread.
+constexpr size_t kDefaultThreadRingCapacity = 4096;
+
 // Enables meta-tracing for one or more tags. Once enabled it will discard any
 // further Enable() calls and return false until disabled,
-// |read_task| is a closure that will be called enqueued |task_runner| when the
+// |read_task| is a closure that will be called enqueued |task_runner| when a
 // meta-tracing ring buffer is half full. The task is expected to read the ring
-// buffer using RingBuffer::GetReadIterator() and serialize the contents onto a
-// file or into the trace itself.
+// buffers using RingBuffer::GetReadIterator() and serialize the contents onto
+// a file or into the trace itself.
+// |thread_ring_capacity| is the number of records that each thread can hold
+// before the reader drains them. It is rounded up to a power of two.
 // Must be called on the |task_runner| passed.
 // |task_runner| must have static lifetime.
-bool Enable(std::function<void()> read_task, base::TaskRunner*, uint32_t tags);
+bool Enable(std::function<void()> read_task,
+            base::TaskRunner*,
+            uint32_t tags,
+            size_t thread_ring_capacity = kDefaultThreadRingCapacity);
 
 // Disables meta-tracing.
 // Must be called on the same |task_runner| as Enable().
@@ -143,116 +151,106 @@ struct Record {
   };
 };
 
-// Hold the meta-tracing data into a statically allocated array.
-// This class uses static storage (as opposite to being a singleton) to:
+// The records written by one thread. Only the thread that owns the ring writes
+// into it and only the reader, on the task runner passed to Enable(), reads
+// from it. Rings are never freed: when a thread exits, its ring is released
+// and taken by the next thread that starts recording.
+struct ThreadRing {
+  explicit ThreadRing(size_t capacity);
+
+  Record* At(uint64_t index) const {
+    // The capacity is a power of two, so this is a bitwise AND.
+    return &records[index & (capacity - 1)];
+  }
+
+  const size_t capacity;
+  std::unique_ptr<Record[]> records;
+  std::atomic<uint64_t> wr_index{0};
+  std::atomic<uint64_t> rd_index{0};
+
+  // Set while a thread owns the ring.
+  std::atomic<bool> in_use{true};
+
+  // Rings form a list that only ever grows. Immutable once published.
+  ThreadRing* next = nullptr;
+};
+
+// Holds the meta-tracing data of all the threads. This class uses static
+// storage (as opposite to being a singleton) to:
 // - Have the guarantee of always valid storage, so that meta-tracing can be
 //   safely used in any part of the codebase, including base/ itself.
 // - Avoid barriers that thread-safe static locals would require.
 class RingBuffer {
  public:
-  static constexpr size_t kCapacity = 4096;  // 4096 * 16 bytes = 64K.
-
-  // This iterator is not idempotent and will bump the read index in the buffer
-  // at the end of the reads. There can be only one reader at any time.
+  // This iterator is not idempotent and will bump the read index in the rings
+  // as it goes through them. There can be only one reader at any time.
+  // It returns only the records that have been fully written. It moves to the
+  // next ring at the first record not fully written of a ring.
   // Usage: for (auto it = RingBuffer::GetReadIterator(); it; ++it) { it->... }
   class ReadIterator {
    public:
-    ReadIterator(ReadIterator&& other) {
-      PERFETTO_DCHECK(other.valid_);
-      cur_ = other.cur_;
-      end_ = other.end_;
-      valid_ = other.valid_;
-      other.valid_ = false;
-    }
-
-    ~ReadIterator() {
-      if (!valid_)
-        return;
-      PERFETTO_DCHECK(cur_ >= RingBuffer::rd_index_);
-      PERFETTO_DCHECK(cur_ <= RingBuffer::wr_index_);
-      RingBuffer::rd_index_.store(cur_, std::memory_order_release);
-    }
-
-    explicit operator bool() const { return cur_ < end_; }
-    const Record* operator->() const { return RingBuffer::At(cur_); }
+    ReadIterator(ReadIterator&& other);
+    ~ReadIterator();
+
+    explicit operator bool() const { return ring_ != nullptr; }
+    const Record* operator->() const { return ring_->At(cur_); }
     const Record& operator*() const { return *operator->(); }
 
     // This is for ++it. it++ is deliberately not supported.
-    ReadIterator& operator++() {
-      PERFETTO_DCHECK(cur_ < end_);
-      // Once a record has been read, mark it as free clearing its type_and_id,
-      // so if we encounter it in another read iteration while being written
-      // we know it's not fully written yet.
-      // The memory_order_relaxed below is enough because:
-      // - The reader is single-threaded and doesn't re-read the same records.
-      // - Before starting a read batch, the reader has an acquire barrier on
-      //   |rd_index_|.
-      // - After terminating a read batch, the ~ReadIterator dtor updates the
-      //   |rd_index_| with a release-store.
-      // - Reader and writer are typically kCapacity/2 apart. So unless an
-      //   overrun happens a writer won't reuse a newly released record any time
-      //   soon. If an overrun happens, everything is busted regardless.
-      At(cur_)->type_and_id.store(0, std::memory_order_relaxed);
-      ++cur_;
-      return *this;
-    }
+    ReadIterator& operator++();
 
    private:
     friend class RingBuffer;
-    ReadIterator(uint64_t begin, uint64_t end)
-        : cur_(begin), end_(end), valid_(true) {}
+    explicit ReadIterator(ThreadRing* first_ring);
     ReadIterator& operator=(const ReadIterator&) = delete;
     ReadIterator(const ReadIterator&) = delete;
 
-    uint64_t cur_;
-    uint64_t end_;
-    bool valid_;
-  };
+    // Moves to |ring| (if not null) and skips to its first readable record.
+    void EnterRing(ThreadRing* ring);
 
-  static Record* At(uint64_t index) {
-    // Doesn't really have to be pow2, but if not the compiler will emit
-    // arithmetic operations to compute the modulo instead of a bitwise AND.
-    static_assert(!(kCapacity & (kCapacity - 1)), "kCapacity must be pow2");
-    PERFETTO_DCHECK(index >= rd_index_);
-    PERFETTO_DCHECK(index <= wr_index_);
-    return &records_[index % kCapacity];
-  }
+    // Skips to the first readable record, moving to the next rings if needed.
+    void SkipToReadableRecord();
+
+    ThreadRing* ring_ = nullptr;
+    uint64_t cur_ = 0;
+    uint64_t end_ = 0;
+  };
 
   // Must be called on the same task runner passed to Enable()
   static ReadIterator GetReadIterator() {
     PERFETTO_DCHECK(RingBuffer::IsOnValidTaskRunner());
-    return ReadIterator(rd_index_.load(std::memory_order_acquire),
-                        wr_index_.load(std::memory_order_acquire));
+    return ReadIterator(rings_.load(std::memory_order_acquire));
   }
 
+  // Returns a record in the ring of the calling thread. The caller must fill
+  // it and then set its |type_and_id| with a release-store.
   static Record* AppendNewRecord();
-  static void Reset();
+  static void Reset(size_t thread_ring_capacity);
 
   static bool has_overruns() {
     return has_overruns_.load(std::memory_order_acquire);
   }
 
-  // Can temporarily return a value >= kCapacity but is eventually consistent.
-  // This would happen in case of overruns until threads hit the --wr_index_
-  // in AppendNewRecord().
-  static uint64_t GetSizeForTesting() {
-    auto wr_index = wr_index_.load(std::memory_order_relaxed);
-    auto rd_index = rd_index_.load(std::memory_order_relaxed);
-    PERFETTO_DCHECK(wr_index >= rd_index);
-    return wr_index - rd_index;
+  static size_t thread_ring_capacity() {
+    return thread_ring_capacity_.load(std::memory_order_relaxed);
   }
 
+  // The total number of records, of all the threads, not read yet.
+  static uint64_t GetSizeForTesting();
+
  private:
   friend class ReadIterator;
 
+  // Returns the ring of the calling thread, taking one if needed.
+  static ThreadRing* GetRingForCurrentThread();
+
   // Returns true if the caller is on the task runner passed to Enable().
   // Used only for DCHECKs.
   static bool IsOnValidTaskRunner();
 
-  static std::array<Record, kCapacity> records_;
+  static std::atomic<ThreadRing*> rings_;
+  static std::atomic<size_t> thread_ring_capacity_;
   static std::atomic<bool> read_task_queued_;
-  static std::atomic<uint64_t> wr_index_;
-  static std::atomic<uint64_t> rd_index_;
   static std::atomic<bool> has_overruns_;
   static Record bankruptcy_record_;  // Used in case of overruns.
 };
@@ -70,7 +70,8 @@ enum Tags : uint32_t {
   F(PROFILER_UNWIND_ATTEMPT), \
   F(PROFILER_MAPS_PARSE), \
   F(PROFILER_MAPS_REPARSE), \
-  F(PROFILER_UNWIND_CACHE_CLEAR)
+  F(PROFILER_UNWIND_CACHE_CLEAR), \
+  F(READ_SYS_COUNTERS)
 
 // Append only, see above.
 //
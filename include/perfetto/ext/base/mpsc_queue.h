@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_EXT_BASE_MPSC_QUEUE_H_
+#define INCLUDE_PERFETTO_EXT_BASE_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+namespace perfetto {
+namespace base {
+
+// A lock-free, unbounded, multiple-producer single-consumer FIFO queue.
+// Push() can be called from any thread. Pop() and empty() must be called only
+// from the consumer thread.
+//
+// Implementation details:
+// Producers push nodes onto an intrusive lock-free stack (|pushed_|) with a
+// CAS loop. The consumer never pops one node at a time from it (which would be
+// subject to the ABA problem). Instead, when it runs out of nodes, it takes the
+// whole stack with a single atomic exchange and reverses it into a private
+// FIFO list (|popping_|). Hence each element costs one CAS for the producer and
+// an amortized O(1), uncontended, work for the consumer.
+template <typename T>
+class MpscQueue {
+ public:
+  MpscQueue() = default;
+  ~MpscQueue() {
+    DeleteList(popping_);
+    DeleteList(pushed_.load(std::memory_order_acquire));
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Returns true if the consumer might have observed the queue as empty before
+  // this call, i.e. if the consumer might need to be woken up. This can only
+  // return true once per batch of elements taken by the consumer, unlike
+  // checking empty() before pushing, which would be racy.
+  bool Push(T value) {
+    Node* node = new Node(std::move(value));
+    Node* head = pushed_.load(std::memory_order_relaxed);
+    do {
+      node->next = head;
+    } while (!pushed_.compare_exchange_weak(head, node,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed));
+    return head == nullptr;
+  }
+
+  // Moves the oldest element into |value|. Returns false if the queue is empty.
+  bool Pop(T* value) {
+    if (!popping_ && !TakePushed())
+      return false;
+    Node* node = popping_;
+    popping_ = node->next;
+    *value = std::move(node->value);
+    delete node;
+    return true;
+  }
+
+  bool empty() const {
+    return !popping_ && !pushed_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Node {
+    explicit Node(T v) : value(std::move(v)) {}
+    Node* next = nullptr;
+    T value;
+  };
+
+  // Moves all the pushed nodes, in FIFO order, into |popping_|.
+  bool TakePushed() {
+    Node* node = pushed_.exchange(nullptr, std::memory_order_acquire);
+    if (!node)
+      return false;
+    Node* reversed = nullptr;
+    while (node) {
+      Node* next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+    }
+    popping_ = reversed;
+    return true;
+  }
+
+  static void DeleteList(Node* node) {
+    while (node) {
+      Node* next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+
+  // The nodes pushed by the producers, in LIFO order.
+  std::atomic<Node*> pushed_{nullptr};
+
+  // The nodes taken by the consumer, in FIFO order. Accessed only by the
+  // consumer.
+  Node* popping_ = nullptr;
+};
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_EXT_BASE_MPSC_QUEUE_H_
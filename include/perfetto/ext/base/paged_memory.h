@@ -53,6 +53,13 @@ class PagedMemory {
     // reserved and the user should call EnsureCommitted() before writing to
     // memory addresses.
     kDontCommit = 1 << 1,
+
+    // Asks the kernel to back the memory with transparent huge pages, to
+    // reduce TLB misses when accessing large buffers. The region is aligned
+    // to the huge page size. This is only a hint: if the kernel doesn't
+    // support them (or they are disabled) the memory is backed by regular
+    // pages. Ignored on non-Linux platforms.
+    kHugePages = 1 << 2,
   };
 
   // Allocates |size| bytes using mmap(MAP_ANONYMOUS). The returned memory is
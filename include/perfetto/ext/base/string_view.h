@@ -122,11 +122,8 @@ class StringView {
     return data_ == nullptr ? "" : std::string(data_, size_);
   }
 
-  uint64_t Hash() const {
-    base::Hash hasher;
-    hasher.Update(data_, size_);
-    return hasher.digest();
-  }
+  // Not stable across versions: don't persist it.
+  uint64_t Hash() const { return base::Hash::Bulk(data_, size_); }
 
  private:
   const char* data_ = nullptr;
@@ -22,16 +22,29 @@
 #include "perfetto/base/thread_utils.h"
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/event_fd.h"
+#include "perfetto/ext/base/mpsc_queue.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/thread_checker.h"
 
 #include <chrono>
-#include <deque>
 #include <map>
 #include <mutex>
+#include <tuple>
 #include <vector>
 
-#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+// On Linux and Android file descriptor watches are backed by epoll(7), so the
+// cost of each iteration of the run loop doesn't depend on the number of
+// watched fds. The other platforms use poll(2) / WaitForMultipleObjects().
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#define PERFETTO_TASK_RUNNER_USE_EPOLL() 1
+#else
+#define PERFETTO_TASK_RUNNER_USE_EPOLL() 0
+#endif
+
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+#include <sys/epoll.h>
+#elif !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 #include <poll.h>
 #endif
 
@@ -86,18 +99,40 @@ class UnixTaskRunner : public TaskRunner {
   void UpdateWatchTasksLocked();
   int GetDelayMsToNextTaskLocked() const;
   void RunImmediateAndDelayedTask();
-  void PostFileDescriptorWatches(uint64_t windows_wait_result);
+  void PostFileDescriptorWatches(uint64_t wait_result);
   void RunFileDescriptorWatch(PlatformHandle);
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  struct WatchTask;
+  void EnsureEpollInstanceLocked();
+  void AddEpollWatchLocked(PlatformHandle, WatchTask*);
+  void RearmEpollWatchLocked(PlatformHandle, WatchTask*);
+#endif
 
   ThreadChecker thread_checker_;
   PlatformThreadId created_thread_id_ = GetThreadId();
 
   EventFd event_;
 
-// The array of fds/handles passed to poll(2) / WaitForMultipleObjects().
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  // All the watched fds are registered in the epoll instance as soon as they
+  // are added. Unlike |poll_fds_| below, this doesn't need to be rebuilt.
+  ScopedFile epoll_fd_;
+
+  // The events returned by epoll_wait(), one per ready fd.
+  std::vector<struct epoll_event> epoll_events_;
+
+  // The |always_ready| watches (see WatchTask) whose task must be posted by the
+  // next PostFileDescriptorWatches(). Accessed only on the task runner thread.
+  std::vector<PlatformHandle> always_ready_fds_;
+
+  // The epoll instance is shared with the child process after a fork(), so it
+  // is re-created when a fork is detected. See EnsureEpollInstanceLocked().
+  uint32_t epoll_fork_generation_ = 0;
+#elif PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // The array of handles passed to WaitForMultipleObjects().
   std::vector<PlatformHandle> poll_fds_;
 #else
+  // The array of fds passed to poll(2).
   std::vector<struct pollfd> poll_fds_;
 #endif
 
@@ -105,13 +140,32 @@ class UnixTaskRunner : public TaskRunner {
 
   std::mutex lock_;
 
-  std::deque<std::function<void()>> immediate_tasks_;
-  std::multimap<TimeMillis, std::function<void()>> delayed_tasks_;
+  // A min-heap ordered by (time, seq). |seq| keeps tasks posted with the same
+  // deadline in FIFO order.
+  struct DelayedTask {
+    TimeMillis time;
+    uint64_t seq;
+    std::function<void()> task;
+
+    bool operator>(const DelayedTask& other) const {
+      return std::tie(time, seq) > std::tie(other.time, other.seq);
+    }
+  };
+  std::vector<DelayedTask> delayed_tasks_;
+  uint64_t last_delayed_task_seq_ = 0;
   bool quit_ = false;
 
   struct WatchTask {
     std::function<void()> callback;
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    // Fds are registered with EPOLLONESHOT, so epoll(7) stops reporting them
+    // until the queued task runs and re-arms them. The exception are the fds
+    // that epoll(7) doesn't support (e.g. regular files or /dev/null), which
+    // are always considered readable, as poll(2) does. For those we keep track
+    // of the outstanding tasks here.
+    bool always_ready = false;
+    bool pending = false;
+#elif PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     // On UNIX systems we make the FD number negative in |poll_fds_| to avoid
     // polling it again until the queued task runs. On Windows we can't do that.
     // Instead we keep track of its state here.
@@ -123,8 +177,16 @@ class UnixTaskRunner : public TaskRunner {
 
   std::map<PlatformHandle, WatchTask> watch_tasks_;
   bool watch_tasks_changed_ = false;
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  size_t num_always_ready_watches_ = 0;
+#endif
 
   // --- End lock-protected members ---
+
+  // Immediate tasks don't need |lock_|: posting them from other threads (e.g.
+  // by the SDK's tracing muxer) is the hot path and shouldn't contend with the
+  // run loop. Popped only on the task runner thread.
+  MpscQueue<std::function<void()>> immediate_tasks_;
 };
 
 }  // namespace base
@@ -19,6 +19,9 @@
 #ifndef INCLUDE_PERFETTO_EXT_IPC_CODEGEN_HELPERS_H_
 #define INCLUDE_PERFETTO_EXT_IPC_CODEGEN_HELPERS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <memory>
 
 #include "perfetto/ext/ipc/basic_types.h"
@@ -28,9 +31,10 @@
 // A templated protobuf message decoder. Returns nullptr in case of failure.
 template <typename T>
 ::std::unique_ptr<::perfetto::ipc::ProtoMessage> _IPC_Decoder(
-    const std::string& proto_data) {
+    const uint8_t* data,
+    size_t size) {
   ::std::unique_ptr<::perfetto::ipc::ProtoMessage> msg(new T());
-  if (msg->ParseFromString(proto_data))
+  if (msg->ParseFromArray(data, size))
     return msg;
   return nullptr;
 }
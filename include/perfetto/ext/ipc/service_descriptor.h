@@ -40,9 +40,12 @@ class ServiceDescriptor {
   struct Method {
     const char* name;
 
-    // DecoderFunc is pointer to a function that takes a string in input
+    // DecoderFunc is pointer to a function that takes a buffer in input
     // containing protobuf encoded data and returns a decoded protobuf message.
-    using DecoderFunc = std::unique_ptr<ProtoMessage> (*)(const std::string&);
+    // The buffer is typically a view into the IPC receive buffer, which allows
+    // to decode the request without copying it first.
+    using DecoderFunc = std::unique_ptr<ProtoMessage> (*)(const uint8_t* data,
+                                                          size_t size);
 
     // Function pointer to decode the request argument of the method.
     DecoderFunc request_proto_decoder;
@@ -22,8 +22,8 @@
 #include <forward_list>
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "perfetto/base/export.h"
@@ -240,7 +240,7 @@ class PERFETTO_EXPORT GlobalNodeGraph {
 
    private:
     std::vector<Node*> to_visit_;
-    std::set<const Node*> visited_;
+    std::unordered_set<const Node*> visited_;
   };
 
   // An iterator-esque class which yields nodes in a depth-first post order.
@@ -255,7 +255,7 @@ class PERFETTO_EXPORT GlobalNodeGraph {
 
    private:
     std::vector<Node*> to_visit_;
-    std::set<Node*> visited_;
+    std::unordered_set<Node*> visited_;
     std::vector<Node*> path_;
   };
 
@@ -21,8 +21,8 @@
 
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
+#include <unordered_set>
 
 #include "perfetto/base/proc_utils.h"
 #include "perfetto/ext/trace_processor/importers/memory_tracker/graph.h"
@@ -63,7 +63,7 @@ class PERFETTO_EXPORT GraphProcessor {
 
   static void MarkWeakOwnersAndChildrenRecursively(
       GlobalNodeGraph::Node* node,
-      std::set<const GlobalNodeGraph::Node*>* nodes);
+      std::unordered_set<const GlobalNodeGraph::Node*>* nodes);
 
   static void RemoveWeakNodesRecursively(GlobalNodeGraph::Node* parent);
 
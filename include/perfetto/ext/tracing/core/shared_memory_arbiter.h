@@ -129,6 +129,11 @@ class PERFETTO_EXPORT SharedMemoryArbiter {
   // duration, the new duration will take effect after the scheduled flush
   // occurs.
   //
+  // The period is shortened in proportion to the fraction of the SMB which is
+  // in use when it starts, and commits aren't batched when the SMB is nearly
+  // full. The accumulated commits are also sent immediately once they cover
+  // half of the SMB.
+  //
   // If |batch_commits_duration_ms| is non-zero, batched data that hasn't been
   // sent could be lost at the end of a tracing session. To avoid this,
   // producers should make sure that FlushPendingCommitDataRequests is called
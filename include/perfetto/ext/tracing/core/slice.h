@@ -34,6 +34,7 @@ struct Slice {
   Slice() : start(nullptr), size(0) {}
   Slice(const void* st, size_t sz) : start(st), size(sz) {}
   Slice(Slice&& other) noexcept = default;
+  Slice& operator=(Slice&& other) noexcept = default;
 
   // Create a Slice which owns |size| bytes of memory.
   static Slice Allocate(size_t size) {
@@ -65,6 +65,18 @@ class PERFETTO_EXPORT TraceWriter : public TraceWriterBase {
   // details on buffer size choices: https://perfetto.dev/docs/concepts/buffers.
   TracePacketHandle NewTracePacket() override = 0;
 
+  // As NewTracePacket(), for callers which know upfront that the packet will
+  // take about |size_hint| bytes (e.g. large heap graph or perf sample
+  // packets). If the packet doesn't fit in what is left of the current chunk
+  // but fits in an empty one, it is started in a new chunk rather than being
+  // fragmented across two. The chunks of the packet are picked large enough
+  // to hold it, or as large as the SMB pages allow, even while the SMB is
+  // under pressure and other writers get smaller chunks. This avoids having
+  // to patch the size fields of its nested messages out of band and keeps
+  // the number of fragments of packets larger than a page to a minimum. By
+  // default the hint is ignored.
+  virtual TracePacketHandle NewTracePacketWithSizeHint(size_t size_hint);
+
   // Commits the data pending for the current chunk into the shared memory
   // buffer and sends a CommitDataRequest() to the service. This can be called
   // only if the handle returned by NewTracePacket() has been destroyed (i.e. we
@@ -239,6 +239,22 @@ class PERFETTO_EXPORT ConsumerEndpoint {
   using SaveTraceForBugreportCallback =
       std::function<void(bool /*success*/, const std::string& /*msg*/)>;
   virtual void SaveTraceForBugreport(SaveTraceForBugreportCallback) = 0;
+
+  // Creates a new tracing session for this consumer, with a read-only copy of
+  // the buffers of the running session with the given
+  // TraceConfig.unique_session_name, once its data sources have been flushed.
+  // The copy can then be read with ReadBuffers() and released with
+  // FreeBuffers(), while the original session keeps recording. This allows to
+  // snapshot long ring-buffer sessions without stopping them.
+  // The session must have been started by the same uid and must not be a
+  // write_into_file session. The consumer must not have a session already.
+  // Args:
+  // - success: if true, the session has been cloned.
+  // - error: human readable diagnostic message in case of failure.
+  using CloneSessionCallback =
+      std::function<void(bool /*success*/, const std::string& /*error*/)>;
+  virtual void CloneSession(const std::string& unique_session_name,
+                            CloneSessionCallback) = 0;
 };  // class ConsumerEndpoint.
 
 // The public API of the tracing Service business logic.
@@ -335,8 +351,16 @@ class PERFETTO_EXPORT TracingService {
   // as the returned ConsumerEndpoint is alive.
   // To disconnect just destroy the returned ConsumerEndpoint object. It is safe
   // to destroy the Consumer once the Consumer::OnDisconnect() has been invoked.
-  virtual std::unique_ptr<ConsumerEndpoint> ConnectConsumer(Consumer*,
-                                                            uid_t) = 0;
+  //
+  // |in_process| tells the service that the Consumer lives in the same process
+  // and consumes the packets passed to Consumer::OnTraceData() before
+  // returning. The service then reads the buffers in larger batches, as there
+  // is no IPC channel to keep responsive, and doesn't allocate memory for each
+  // packet it reads.
+  virtual std::unique_ptr<ConsumerEndpoint> ConnectConsumer(
+      Consumer*,
+      uid_t,
+      bool in_process = false) = 0;
 
   // Enable/disable scraping of chunks in the shared memory buffer. If enabled,
   // the service will copy uncommitted but non-empty chunks from the SMB when
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <iterator>
 #include <list>
 #include <type_traits>
 
@@ -36,6 +37,10 @@ class Message;
 // allocator in most cases, by reusing the same block, and falls back on
 // allocating new blocks only when using deeply nested messages (which are
 // extremely rare).
+// Blocks which are not needed anymore are not freed but kept in a freelist
+// until the arena is destroyed. As the arena of a RootMessage is reused across
+// messages (e.g., the TracePacket(s) written by a TraceWriter), the allocator
+// is hit only until the deepest nesting level is reached the first time.
 // This is used by RootMessage<T> to handle the storage for root-level messages.
 class PERFETTO_EXPORT MessageArena {
  public:
@@ -60,20 +65,29 @@ class PERFETTO_EXPORT MessageArena {
     DeleteLastMessageInternal();
   }
 
-  // Resets the state of the arena, clearing up all but one block. This is used
+  // Resets the state of the arena, releasing all but one block. This is used
   // to avoid leaking outstanding unfinished sub-messages while recycling the
   // RootMessage object (this is extremely rare due to the RAII scoped handles
   // but could happen if some client does some overly clever std::move() trick).
   void Reset() {
     PERFETTO_DCHECK(!blocks_.empty());
-    blocks_.resize(1);
+    free_blocks_.splice(free_blocks_.end(), blocks_, std::next(blocks_.begin()),
+                        blocks_.end());
     auto& block = blocks_.back();
     block.entries = 0;
     PERFETTO_ASAN_POISON(block.storage, sizeof(block.storage));
   }
 
+  // Returns the number of blocks allocated so far by all the arenas of the
+  // process. Blocks are allocated only when the nesting depth of the messages
+  // of an arena exceeds the one seen so far by it. Hence this is expected to
+  // stay constant in steady state (e.g., when writing TracePacket(s) of the
+  // same shape over and over again).
+  static uint64_t num_blocks_allocated();
+
  private:
   void DeleteLastMessageInternal();
+  void AllocateFreeBlock() PERFETTO_NO_INLINE;
 
   struct Block {
     static constexpr size_t kCapacity = 16;
@@ -86,8 +100,13 @@ class PERFETTO_EXPORT MessageArena {
   };
 
   // blocks are used to hand out pointers and must not be moved. Hence why
-  // std::list rather than std::vector.
+  // std::list rather than std::vector. This also allows to move blocks to and
+  // from |free_blocks_| via splice(), without allocations.
   std::list<Block> blocks_;
+
+  // The blocks released by DeleteLastMessage() and Reset(), reused by
+  // NewMessage() before allocating new ones.
+  std::list<Block> free_blocks_;
 };
 
 }  // namespace protozero
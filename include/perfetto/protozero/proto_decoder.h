@@ -267,6 +267,18 @@ class PackedRepeatedFieldIterator {
   bool* const parse_error_;
 };
 
+// Decodes all the varints of the payload [|begin|, |end|) of a packed repeated
+// field in one go, which is faster than iterating over them with
+// PackedRepeatedFieldIterator. |out| must have room for |end| - |begin|
+// values, the maximum number of varints the payload can hold. Returns the
+// number of values written to |out|. If the payload ends in the middle of a
+// varint, sets |*parse_error| to true and returns the number of values before
+// it.
+PERFETTO_EXPORT size_t DecodePackedVarInts(const uint8_t* begin,
+                                           const uint8_t* end,
+                                           uint64_t* out,
+                                           bool* parse_error);
+
 // This decoder loads all fields upfront, without recursing in nested messages.
 // It is used as a base class for typed decoders generated by the pbzero plugin.
 // The split between TypedProtoDecoderBase and TypedProtoDecoder<> is to have
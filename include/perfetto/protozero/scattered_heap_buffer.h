@@ -65,8 +65,52 @@ class PERFETTO_EXPORT ScatteredHeapBuffer
     size_t unused_bytes_;
   };
 
+  // A cache of the slices released by ScatteredHeapBuffers. Buffers which are
+  // created and destroyed often (e.g. short-lived HeapBuffered messages) can
+  // share a pool to reuse their slices rather than allocating and freeing new
+  // ones every time. A slice is only reused for a request of the same size,
+  // which is the common case as buffers of the same kind grow through the
+  // same sequence of slice sizes.
+  // Not thread safe: all the buffers using a pool must be on the same thread.
+  // The pool must outlive them.
+  class PERFETTO_EXPORT SlicePool {
+   public:
+    static constexpr size_t kDefaultMaxCachedBytes = 1024 * 1024;
+
+    explicit SlicePool(size_t max_cached_bytes = kDefaultMaxCachedBytes);
+    ~SlicePool();
+
+    // Returns a cleared slice of |size| bytes, reusing a cached one if any.
+    Slice Take(size_t size);
+
+    // Caches |slice| for a later Take() of the same size. The slice is freed
+    // instead if the pool already holds |max_cached_bytes|.
+    void Give(Slice slice);
+
+    size_t cached_bytes() const { return cached_bytes_; }
+
+   private:
+    struct Bucket {
+      size_t slice_size;
+      std::vector<Slice> slices;
+    };
+
+    SlicePool(const SlicePool&) = delete;
+    SlicePool& operator=(const SlicePool&) = delete;
+
+    const size_t max_cached_bytes_;
+    size_t cached_bytes_ = 0;
+
+    // One bucket for each slice size. There are only a handful of them, as
+    // slice sizes double from the initial to the maximum size.
+    std::vector<Bucket> buckets_;
+  };
+
+  // If |slice_pool| is not null, the slices are taken from and given back to
+  // it rather than being allocated and freed.
   ScatteredHeapBuffer(size_t initial_slice_size_bytes = 128,
-                      size_t maximum_slice_size_bytes = 128 * 1024);
+                      size_t maximum_slice_size_bytes = 128 * 1024,
+                      SlicePool* slice_pool = nullptr);
   ~ScatteredHeapBuffer() override;
 
   // protozero::ScatteredStreamWriter::Delegate implementation.
@@ -105,6 +149,7 @@ class PERFETTO_EXPORT ScatteredHeapBuffer
   size_t next_slice_size_;
   const size_t maximum_slice_size_;
   protozero::ScatteredStreamWriter* writer_ = nullptr;
+  SlicePool* const slice_pool_;
   std::vector<Slice> slices_;
 
   // Used to keep an allocated slice around after this buffer is reset.
@@ -128,8 +173,12 @@ template <typename T = ::protozero::Message>
 class HeapBuffered {
  public:
   HeapBuffered() : HeapBuffered(4096, 4096) {}
-  HeapBuffered(size_t initial_slice_size_bytes, size_t maximum_slice_size_bytes)
-      : shb_(initial_slice_size_bytes, maximum_slice_size_bytes),
+  explicit HeapBuffered(ScatteredHeapBuffer::SlicePool* slice_pool)
+      : HeapBuffered(4096, 4096, slice_pool) {}
+  HeapBuffered(size_t initial_slice_size_bytes,
+               size_t maximum_slice_size_bytes,
+               ScatteredHeapBuffer::SlicePool* slice_pool = nullptr)
+      : shb_(initial_slice_size_bytes, maximum_slice_size_bytes, slice_pool),
         writer_(&shb_) {
     shb_.set_writer(&writer_);
     msg_.Reset(&writer_);
@@ -118,6 +118,23 @@ Handle Create(const void* config_proto,
               OnStateChangedCb callback,
               void* callback_arg);
 
+// Like Create(), but the traced daemon writes the trace straight into
+// |trace_fd| (e.g. a file or a memfd owned by the caller) rather than into a
+// buffer owned by the library. The trace is never mapped or copied by the
+// library, which makes this preferable for large traces. The fd is dup()-ed
+// internally and can be closed by the caller as soon as this call returns.
+// Once the session reaches the kTraceEnded state, the trace can be read back
+// from |trace_fd|, starting from the file offset it had when this was called.
+// ReadTrace() always returns a null buffer for the sessions created this way.
+// Return value:
+//    Returns a handle as Create() does, or kInvalidHandle if |trace_fd| is
+//    invalid.
+Handle CreateWithFd(const void* config_proto,
+                    size_t config_len,
+                    int trace_fd,
+                    OnStateChangedCb callback,
+                    void* callback_arg);
+
 // Starts recording the trace. Can be used only when setting the
 // |deferred_start| flag in the trace config passed to Create().
 // If the session is in the kConfigured state it transitions it to the kTracing
@@ -143,6 +160,8 @@ struct TraceBuffer {
 //   Destroy() call.
 //   If called before the session reaches the kTraceEnded state, a null buffer
 //   is returned.
+//   A null buffer is also returned for the sessions created via
+//   CreateWithFd(), the trace being in the caller's fd in that case.
 TraceBuffer ReadTrace(Handle);
 
 // Destroys all the resources associated to the tracing session (connection to
@@ -23,6 +23,7 @@
 #include <stdint.h>
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/export.h"
 #include "perfetto/base/logging.h"
@@ -61,7 +62,18 @@ enum class SortingMode {
   //
   // If a |flush_period_ms| is not specified in the TraceConfig, this mode will
   // act the same as |SortingMode::kDefaultHeuristics|.
-  kForceFlushPeriodWindowedSort = 2
+  kForceFlushPeriodWindowedSort = 2,
+
+  // This option makes trace processor measure how far back in time packets
+  // arrive out of order and shrink the sorting window to match; sorted data is
+  // then parsed (and its memory released) sooner than with the other modes.
+  // The window is only shrunk after a few tens of seconds of trace data have
+  // been seen, so this mode behaves like |SortingMode::kDefaultHeuristics| on
+  // short traces. Packets which arrive later than previously seen are parsed
+  // out of order; this is recorded in the stats table.
+  //
+  // Only used for proto traces.
+  kAdaptiveWindowedSort = 3
 };
 
 // Enum which encodes which event (if any) should be used to drop ftrace data
@@ -106,6 +118,100 @@ struct PERFETTO_EXPORT Config {
   // the trace before that event. See the ennu documenetation for more details.
   DropFtraceDataBefore drop_ftrace_data_before =
       DropFtraceDataBefore::kTracingStarted;
+
+  // The names of the proto importer modules which should not be used for this
+  // instance. The trace packets which would have been imported by these
+  // modules (and by no other module) are dropped straight after being
+  // tokenized, so none of the tables filled by them are populated. This saves
+  // both time and memory when the data of these modules is not needed.
+  //
+  // The valid names are: "android_probes", "chrome_system_probes", "ftrace",
+  // "graphics_event", "heap_graph", "memory_tracker_snapshot", "metadata",
+  // "profile", "system_probes" and "track_event".
+  //
+  // Only used for proto traces.
+  std::vector<std::string> skipped_importers;
+
+  // The maximum amount of memory (in bytes) used to cache the results of
+  // filtering and sorting tables across queries. The least recently used
+  // results are evicted when this is exceeded. Setting this to 0 disables
+  // caching of results.
+  uint64_t query_cache_max_bytes = 64 * 1024 * 1024;
+
+  // The maximum number of prepared statements kept by ExecuteQuery for reuse
+  // by later calls with the same SQL. The least recently used statements are
+  // finalized when this is exceeded. Setting this to 0 disables caching of
+  // statements.
+  uint32_t statement_cache_size = 64;
+
+  // When set to true, Parse() hands each chunk of the trace over to a
+  // dedicated ingestion thread and returns as soon as the chunk is queued;
+  // this allows the caller to read (and e.g. decompress) the next chunk while
+  // the previous one is being tokenized, sorted and parsed. Parse() blocks if
+  // too much data is queued and returns errors which happened while parsing
+  // earlier chunks.
+  //
+  // Note: no queries can be run until NotifyEndOfFile() has returned when this
+  // option is enabled. This option is ignored on platforms without threads.
+  bool ingest_on_separate_thread = false;
+
+  // The maximum number of events buffered for sorting (see |sorting_mode|).
+  // When this is exceeded, the oldest half of the buffered events are parsed
+  // straight away, regardless of the sorting window. This bounds the memory
+  // used to import traces which would otherwise be sorted as a whole (e.g.
+  // proto traces without a flush period), at the cost of parsing events
+  // which arrive even later out of order. Setting this to 0 disables the
+  // limit.
+  //
+  // Only used for proto traces.
+  uint64_t sorter_max_buffered_events = 0;
+
+  // The maximum wall time (in milliseconds) a query can run for. Queries which
+  // take longer fail with an error returned by Iterator::Status(). Setting
+  // this to 0 disables the limit.
+  uint64_t query_max_duration_ms = 0;
+
+  // The maximum amount of memory (in bytes) a query can use, measured as the
+  // growth of the resident memory of the process since the query started.
+  // Queries which use more fail with an error returned by Iterator::Status().
+  // Setting this to 0 disables the limit.
+  //
+  // Note: this option is only supported on Linux and Android.
+  uint64_t query_max_memory_bytes = 0;
+
+  // The maximum number of threads used by ComputeMetric() to compute the
+  // requested metrics. The metrics are split between the threads, each of
+  // them using its own SQLite connection to the tables of the trace, with the
+  // metrics sharing files run by RUN_METRIC preferably computed by the same
+  // thread. Setting this to 0 or 1 computes all the metrics on the calling
+  // thread.
+  //
+  // Note: when more than one thread is used, the metrics only see the tables
+  // of the trace, not the tables and views created by ExecuteQuery(), and the
+  // tables and views created by the metrics are not visible to later calls to
+  // ExecuteQuery(). Metrics are only computed concurrently after
+  // NotifyEndOfFile() and when metatracing is disabled. This option is ignored
+  // on platforms without threads.
+  uint32_t metric_threads = 0;
+
+  // When set to true, the time spent by each query in each of the tables it
+  // reads is recorded: the time spent planning the query (xBestIndex),
+  // filtering, sorting or computing the rows of the table (xFilter) and
+  // iterating them (xNext), the number of rows before and after filtering
+  // and the number of results reused from earlier queries. The profiles of
+  // the last 100 queries can be read from the __intrinsic_query_profile
+  // table. This adds a small overhead to every row read by the queries.
+  bool enable_query_profiling = false;
+
+  // When set to true, the number and size of the trace packets and the CPU
+  // time spent tokenizing and parsing them are recorded in the stats table
+  // (importer_* stats), indexed by the TracePacket field handled by their
+  // importer module. How many events the sorter buffers and how long
+  // extracting them takes are also recorded (sorter_* stats). This adds a
+  // small overhead to every trace packet.
+  //
+  // Only used for proto traces.
+  bool enable_importer_profiling = false;
 };
 
 // Represents a dynamically typed value returned by SQL.
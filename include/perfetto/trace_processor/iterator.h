@@ -64,6 +64,16 @@ class PERFETTO_EXPORT Iterator {
   // Returns the status of the iterator.
   util::Status Status();
 
+  // Binds |value| to the parameter with index |index| of the query (i.e. the
+  // "?NNN" parameter where NNN = |index|; the leftmost "?" has index 1).
+  // Strings and bytes are copied. Must be called before the first call to
+  // |Next()|. Parameters which are not bound are NULL.
+  //
+  // Prefer binding parameters to formatting values into the query: this
+  // allows TraceProcessor to reuse the prepared statement across calls to
+  // |ExecuteQuery| with the same SQL.
+  util::Status Bind(uint32_t index, const SqlValue& value);
+
  private:
   friend class QueryResultSerializer;
 
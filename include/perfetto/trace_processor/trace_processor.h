@@ -86,6 +86,19 @@ class PERFETTO_EXPORT TraceProcessor : public TraceProcessorStorage {
   // by the ingestion process. Returns the number of table/views deleted.
   virtual size_t RestoreInitialTables() = 0;
 
+  // Writes a snapshot of all the tables of the loaded trace to the file at
+  // |path|. Loading the snapshot with |LoadSnapshot| is much faster than
+  // parsing the trace again. Should only be called once the trace has been
+  // fully loaded (i.e. after NotifyEndOfFile()).
+  virtual util::Status SaveSnapshot(const std::string& path) = 0;
+
+  // Loads the tables from the snapshot at |path| written by |SaveSnapshot|
+  // instead of parsing a trace. Must be called before any data is passed to
+  // Parse(). Snapshots can only be loaded by the same version of trace
+  // processor which wrote them. Once loaded, queries can be run as if the
+  // trace had been parsed and NotifyEndOfFile() called.
+  virtual util::Status LoadSnapshot(const std::string& path) = 0;
+
   // Sets/returns the name of the currently loaded trace or an empty string if
   // no trace is fully loaded yet. This has no effect on the Trace Processor
   // functionality and is used for UI purposes only.
@@ -45,6 +45,14 @@ class PERFETTO_EXPORT TraceProcessorStorage {
   // floor and return errors forever.
   virtual util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
 
+  // Same as Parse() but for data which the caller shares with trace
+  // processor rather than handing over (e.g. a memory-mapped trace file).
+  // Where possible, the data is referenced in place rather than copied:
+  // |data| is kept alive for as long as any of the |size| bytes it points to
+  // are still needed, so the memory it points to must not be modified.
+  virtual util::Status ParseShared(std::shared_ptr<const uint8_t> data,
+                                   size_t size);
+
   // When parsing a bounded file (as opposite to streaming from a device) this
   // function should be called when the last chunk of the file has been passed
   // into Parse(). This allows to flush the events queued in the ordering stage,
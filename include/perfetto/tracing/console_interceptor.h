@@ -26,6 +26,7 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
@@ -71,54 +72,72 @@ class PERFETTO_EXPORT ConsoleInterceptor
   void OnStart(const StartArgs&) override;
   void OnStop(const StopArgs&) override;
 
-  struct ThreadLocalState : public InterceptorBase::ThreadLocalState {
-    ThreadLocalState(ThreadLocalStateArgs&);
-    ~ThreadLocalState() override;
+  class PacketRing;
 
+  // The formatting state of one output stream.
+  struct PrintState {
     // Destination file. Assumed to stay valid until the program ends (i.e., is
     // stderr or stdout).
     int fd{};
     bool use_colors{};
+    uint64_t start_time_ns{};
 
-    // Messages up to this length are buffered and written atomically. If a
-    // message is longer, it will be printed with multiple writes.
-    std::array<char, 1024> message_buffer{};
+    // Messages up to the size of this buffer are buffered and written
+    // atomically. If a message is longer, it will be printed with multiple
+    // writes.
+    std::vector<char> message_buffer;
     size_t buffer_pos{};
+  };
+
+  struct ThreadLocalState : public InterceptorBase::ThreadLocalState {
+    ThreadLocalState(ThreadLocalStateArgs&);
+    ~ThreadLocalState() override;
+
+    PrintState print_state;
 
     // We only support a single trace writer sequence per thread, so the
     // sequence state is stored in TLS.
     TrackEventStateTracker::SequenceState sequence_state;
-    uint64_t start_time_ns{};
+
+    // With ConsoleConfig.enable_async_output, packets are only copied into
+    // this ring on the calling thread, and are formatted and written by a
+    // background thread instead.
+    std::shared_ptr<PacketRing> packet_ring;
   };
 
  private:
+  class AsyncOutput;
   class Delegate;
 
-  // Appends a formatted message to |message_buffer_| or directly to the output
+  // Appends a formatted message to |message_buffer| or directly to the output
   // file if the buffer is full.
-  static void Printf(InterceptorContext& context,
-                     const char* format,
-                     ...) PERFETTO_PRINTF_ATTR;
-  static void Flush(InterceptorContext& context);
-  static void SetColor(InterceptorContext& context, const ConsoleColor&);
-  static void SetColor(InterceptorContext& context, const char*);
-
-  static void PrintDebugAnnotations(InterceptorContext&,
-                                    const protos::pbzero::TrackEvent_Decoder&,
-                                    const ConsoleColor& slice_color,
-                                    const ConsoleColor& highlight_color);
+  static void Printf(PrintState&, const char* format, ...) PERFETTO_PRINTF_ATTR;
+  static void Flush(PrintState&);
+  static void SetColor(PrintState&, const ConsoleColor&);
+  static void SetColor(PrintState&, const char*);
+
+  static void PrintDebugAnnotations(
+      PrintState&,
+      TrackEventStateTracker::SequenceState&,
+      const protos::pbzero::TrackEvent_Decoder&,
+      const ConsoleColor& slice_color,
+      const ConsoleColor& highlight_color);
   static void PrintDebugAnnotationName(
-      InterceptorContext&,
+      PrintState&,
+      TrackEventStateTracker::SequenceState&,
       const perfetto::protos::pbzero::DebugAnnotation_Decoder& annotation);
   static void PrintDebugAnnotationValue(
-      InterceptorContext&,
+      PrintState&,
+      TrackEventStateTracker::SequenceState&,
       const perfetto::protos::pbzero::DebugAnnotation_Decoder& annotation);
 
   int fd_ = STDOUT_FILENO;
   bool use_colors_ = true;
+  bool use_async_output_ = false;
 
   TrackEventStateTracker::SessionState session_state_;
   uint64_t start_time_ns_{};
+  std::unique_ptr<AsyncOutput> async_output_;
 };
 
 }  // namespace perfetto
@@ -257,8 +257,10 @@ class DataSource : public DataSourceBase {
   // The lambda can be called more than once per Trace() call, in the case of
   // concurrent tracing sessions (or even if the data source is instantiated
   // twice within the same trace config).
+  // The enabled check is always inlined in the caller, so that a disabled data
+  // source only costs a relaxed load of its |valid_instances| bitmap.
   template <typename Lambda>
-  static void Trace(Lambda tracing_fn) {
+  static void Trace(Lambda tracing_fn) PERFETTO_ALWAYS_INLINE {
     CallIfEnabled<DefaultTracePointTraits>([&tracing_fn](uint32_t instances) {
       TraceWithInstances<DefaultTracePointTraits>(instances,
                                                   std::move(tracing_fn));
@@ -378,29 +380,10 @@ class DataSource : public DataSourceBase {
       // handshaking to make this extremely unrealistic.
 
       auto& tls_inst = tls_state_->per_instance[i];
-      if (PERFETTO_UNLIKELY(!tls_inst.trace_writer)) {
-        // Here we need an acquire barrier, which matches the release-store made
-        // by TracingMuxerImpl::SetupDataSource(), to ensure that the backend_id
-        // and buffer_id are consistent.
-        instances = Traits::GetActiveInstances(trace_point_data)
-                        ->load(std::memory_order_acquire);
-        instance_state = static_state_.TryGetCached(instances, i);
-        if (!instance_state || !instance_state->trace_lambda_enabled)
-          continue;
-        tls_inst.backend_id = instance_state->backend_id;
-        tls_inst.backend_connection_id = instance_state->backend_connection_id;
-        tls_inst.buffer_id = instance_state->buffer_id;
-        tls_inst.data_source_instance_id =
-            instance_state->data_source_instance_id;
-        tls_inst.is_intercepted = instance_state->interceptor_id != 0;
-        tls_inst.trace_writer = tracing_impl->CreateTraceWriter(
-            &static_state_, i, instance_state,
-            DataSourceType::kBufferExhaustedPolicy);
-        CreateIncrementalState(&tls_inst);
-
-        // Even in the case of out-of-IDs, SharedMemoryArbiterImpl returns a
-        // NullTraceWriter. The returned pointer should never be null.
-        assert(tls_inst.trace_writer);
+      if (PERFETTO_UNLIKELY(!tls_inst.trace_writer) &&
+          !CreateTraceWriterForInstance<Traits>(&instances, i,
+                                                trace_point_data)) {
+        continue;
       }
 
       tracing_fn(TraceContext(&tls_inst, i));
@@ -455,6 +438,41 @@ class DataSource : public DataSourceBase {
     }
   };
 
+  // Creates the trace writer of the |i|-th instance for the current thread.
+  // Returns false if the instance has been stopped in the meantime. This only
+  // runs for the first trace point of each thread in each session, so it's
+  // kept out of line to leave the trace points small.
+  template <typename Traits>
+  static bool CreateTraceWriterForInstance(
+      uint32_t* instances,
+      uint32_t i,
+      typename Traits::TracePointData trace_point_data) PERFETTO_NO_INLINE {
+    // Here we need an acquire barrier, which matches the release-store made
+    // by TracingMuxerImpl::SetupDataSource(), to ensure that the backend_id
+    // and buffer_id are consistent.
+    *instances = Traits::GetActiveInstances(trace_point_data)
+                     ->load(std::memory_order_acquire);
+    internal::DataSourceState* instance_state =
+        static_state_.TryGetCached(*instances, i);
+    if (!instance_state || !instance_state->trace_lambda_enabled)
+      return false;
+    auto& tls_inst = tls_state_->per_instance[i];
+    tls_inst.backend_id = instance_state->backend_id;
+    tls_inst.backend_connection_id = instance_state->backend_connection_id;
+    tls_inst.buffer_id = instance_state->buffer_id;
+    tls_inst.data_source_instance_id = instance_state->data_source_instance_id;
+    tls_inst.is_intercepted = instance_state->interceptor_id != 0;
+    tls_inst.trace_writer = internal::TracingMuxer::Get()->CreateTraceWriter(
+        &static_state_, i, instance_state,
+        DataSourceType::kBufferExhaustedPolicy);
+    CreateIncrementalState(&tls_inst);
+
+    // Even in the case of out-of-IDs, SharedMemoryArbiterImpl returns a
+    // NullTraceWriter. The returned pointer should never be null.
+    assert(tls_inst.trace_writer);
+    return true;
+  }
+
   // Create the user provided incremental state in the given thread-local
   // storage. Note: The second parameter here is used to specialize the case
   // where there is no incremental state type.
@@ -486,7 +504,7 @@ class DataSource : public DataSourceBase {
   // Note that the returned object is one per-thread per-data-source-type, NOT
   // per data-source *instance*.
   static internal::DataSourceThreadLocalState* GetOrCreateDataSourceTLS(
-      internal::DataSourceStaticState* static_state) {
+      internal::DataSourceStaticState* static_state) PERFETTO_NO_INLINE {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_IOS)
     PERFETTO_FATAL("Data source TLS not supported on iOS, see b/158814068");
 #endif
@@ -35,11 +35,6 @@
 
 namespace perfetto {
 
-struct TraceTimestamp {
-  protos::pbzero::BuiltinClock clock_id;
-  uint64_t nanoseconds;
-};
-
 // This template provides a way to convert an abstract timestamp into the trace
 // clock timebase in nanoseconds. By specialising this template and defining
 // static ConvertTimestampToTraceTimeNs function in it the user can register
@@ -60,6 +55,16 @@ struct TraceTimestampTraits<uint64_t> {
   }
 };
 
+// A pass-through implementation for timestamps which already specify their
+// clock, e.g., the ones returned by TrackEventInternal::GetTraceTime().
+template <>
+struct TraceTimestampTraits<TraceTimestamp> {
+  static inline TraceTimestamp ConvertTimestampToTraceTimeNs(
+      const TraceTimestamp& timestamp) {
+    return timestamp;
+  }
+};
+
 namespace internal {
 namespace {
 
@@ -173,7 +178,7 @@ class TrackEventDataSource
   }
 
   void OnStop(const DataSourceBase::StopArgs& args) override {
-    TrackEventInternal::DisableTracing(*Registry, args);
+    TrackEventInternal::DisableTracing(*Registry, config_, args);
   }
 
   static void Flush() {
@@ -235,7 +240,7 @@ class TrackEventDataSource
                                Arguments&&... args) PERFETTO_NO_INLINE {
     TraceForCategoryImpl(instances, category, event_name, type,
                          TrackEventInternal::kDefaultTrack,
-                         TrackEventInternal::GetTimeNs(),
+                         TrackEventInternal::GetTraceTime(),
                          std::forward<Arguments>(args)...);
   }
 
@@ -257,7 +262,7 @@ class TrackEventDataSource
                                Arguments&&... args) PERFETTO_NO_INLINE {
     TraceForCategoryImpl(
         instances, category, event_name, type, std::forward<TrackType>(track),
-        TrackEventInternal::GetTimeNs(), std::forward<Arguments>(args)...);
+        TrackEventInternal::GetTraceTime(), std::forward<Arguments>(args)...);
   }
 
   // Trace point which takes a timestamp, but not track.
@@ -310,7 +315,7 @@ class TrackEventDataSource
                                ValueType value) PERFETTO_ALWAYS_INLINE {
     PERFETTO_DCHECK(type == perfetto::protos::pbzero::TrackEvent::TYPE_COUNTER);
     TraceForCategory(instances, category, /*name=*/nullptr, type, track,
-                     TrackEventInternal::GetTimeNs(), value);
+                     TrackEventInternal::GetTraceTime(), value);
   }
 
   // Trace point with with a timestamp and a counter sample.
@@ -431,6 +436,10 @@ class TrackEventDataSource
     using CatTraits = CategoryTraits<CategoryType>;
     const Category* static_category =
         CatTraits::GetStaticCategory(Registry, category);
+    // The timestamp is the same for all the instances (i.e. concurrent
+    // sessions) the event is written to, so convert it only once.
+    const TraceTimestamp trace_timestamp = ::perfetto::TraceTimestampTraits<
+        TimestampType>::ConvertTimestampToTraceTimeNs(timestamp);
     TraceWithInstances(
         instances, category, [&](typename Base::TraceContext ctx) {
           // If this category is dynamic, first check whether it's enabled.
@@ -440,19 +449,20 @@ class TrackEventDataSource
             return;
           }
 
-          // TODO(skyostil): Support additional clock ids.
-          TraceTimestamp trace_timestamp = ::perfetto::TraceTimestampTraits<
-              TimestampType>::ConvertTimestampToTraceTimeNs(timestamp);
-          PERFETTO_DCHECK(trace_timestamp.clock_id ==
-                          TrackEventInternal::GetClockId());
-
           // Make sure incremental state is valid.
           TraceWriterBase* trace_writer = ctx.tls_inst_->trace_writer.get();
           TrackEventIncrementalState* incr_state = ctx.GetIncrementalState();
           if (incr_state->was_cleared) {
             incr_state->was_cleared = false;
-            TrackEventInternal::ResetIncrementalState(
-                trace_writer, trace_timestamp.nanoseconds);
+            {
+              // The config can only be read under the data source lock, so
+              // cache the bits needed by each event in the incremental state.
+              auto ds = ctx.GetDataSourceLocked();
+              incr_state->use_incremental_timestamps =
+                  ds && ds->config_.enable_incremental_timestamps();
+            }
+            TrackEventInternal::ResetIncrementalState(trace_writer, incr_state,
+                                                      trace_timestamp);
           }
 
           // Write the track descriptor before any event on the track.
@@ -465,7 +475,7 @@ class TrackEventDataSource
           {
             auto event_ctx = TrackEventInternal::WriteEvent(
                 trace_writer, incr_state, static_category, event_name, type,
-                trace_timestamp.nanoseconds);
+                trace_timestamp);
             // Write dynamic categories (except for events that don't require
             // categories). For counter events, the counter name (and optional
             // category) is stored as part of the track descriptor instead being
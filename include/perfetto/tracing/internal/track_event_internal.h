@@ -29,6 +29,10 @@
 #include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
 #include "protos/perfetto/trace/track_event/track_event.pbzero.h"
 
+#include <string.h>
+
+#include <string>
+#include <type_traits>
 #include <unordered_map>
 
 namespace perfetto {
@@ -44,6 +48,14 @@ class DebugAnnotation;
 }  // namespace pbzero
 }  // namespace protos
 
+// A timestamp in nanoseconds on a given clock. Besides the builtin clocks, this
+// can be a sequence-scoped clock defined by a ClockSnapshot on the sequence
+// (see TrackEventInternal::kClockIdCycleCounter).
+struct TraceTimestamp {
+  protos::pbzero::BuiltinClock clock_id;
+  uint64_t nanoseconds;
+};
+
 // A callback interface for observing track event tracing sessions starting and
 // stopping. See TrackEvent::{Add,Remove}SessionObserver. Note that all methods
 // will be called on an internal Perfetto thread.
@@ -109,8 +121,85 @@ struct TrackEventIncrementalState {
   // this tracing session. The value in the map indicates whether the category
   // is enabled or disabled.
   std::unordered_map<std::string, bool> dynamic_categories;
+
+  // Whether events are timestamped with the delta from the previous event (see
+  // TrackEventConfig.enable_incremental_timestamps). If so, |last_timestamp_ns|
+  // is the absolute timestamp the next delta is relative to.
+  bool use_incremental_timestamps = false;
+  uint64_t last_timestamp_ns = 0;
+
+  // The clock which the incremental clock of the sequence is based on.
+  uint32_t incremental_clock_base_id = 0;
+
+  // The cycle counter clock timestamp of the last ClockSnapshot relating it to
+  // the trace clock on this sequence, or 0 if there was none yet.
+  uint64_t last_cycle_counter_snapshot_ns = 0;
 };
 
+// The DebugAnnotation field storing values of type T, for the types which
+// TrackEventInternal::AddDebugAnnotation() writes without going through a
+// TracedValue. Zero for all the other types.
+template <typename T, typename = void>
+struct DebugAnnotationValueField : std::integral_constant<uint32_t, 0> {};
+
+template <>
+struct DebugAnnotationValueField<bool>
+    : std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kBoolValueFieldNumber> {};
+
+template <typename T>
+struct DebugAnnotationValueField<
+    T,
+    typename std::enable_if<std::is_integral<T>::value &&
+                            !std::is_same<T, bool>::value &&
+                            std::is_unsigned<T>::value>::type>
+    : std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kUintValueFieldNumber> {};
+
+template <typename T>
+struct DebugAnnotationValueField<
+    T,
+    typename std::enable_if<std::is_integral<T>::value &&
+                            !std::is_same<T, bool>::value &&
+                            std::is_signed<T>::value>::type>
+    : std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kIntValueFieldNumber> {};
+
+template <typename T>
+struct DebugAnnotationValueField<
+    T,
+    typename std::enable_if<std::is_floating_point<T>::value>::type>
+    : std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kDoubleValueFieldNumber> {};
+
+template <typename T>
+struct DebugAnnotationValueField<
+    T,
+    typename std::enable_if<std::is_same<T, const char*>::value ||
+                            std::is_same<T, char[]>::value ||
+                            std::is_same<T, std::string>::value>::type>
+    : std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kStringValueFieldNumber> {};
+
+template <size_t N>
+struct DebugAnnotationValueField<char[N]>
+    : DebugAnnotationValueField<const char*> {};
+
+template <typename T>
+struct DebugAnnotationValueField<
+    T,
+    typename std::enable_if<std::is_same<T, void*>::value ||
+                            std::is_same<T, const void*>::value ||
+                            std::is_same<T, std::nullptr_t>::value>::type>
+    : std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kPointerValueFieldNumber> {};
+
 // The backend portion of the track event trace point implemention. Outlined to
 // a separate .cc file so it can be shared by different track event category
 // namespaces.
@@ -128,6 +217,7 @@ class PERFETTO_EXPORT TrackEventInternal {
                             const DataSourceBase::SetupArgs&);
   static void OnStart(const DataSourceBase::StartArgs&);
   static void DisableTracing(const TrackEventCategoryRegistry& registry,
+                             const protos::gen::TrackEventConfig& config,
                              const DataSourceBase::StopArgs&);
   static bool IsCategoryEnabled(const TrackEventCategoryRegistry& registry,
                                 const protos::gen::TrackEventConfig& config,
@@ -139,17 +229,22 @@ class PERFETTO_EXPORT TrackEventInternal {
       const Category* category,
       const char* name,
       perfetto::protos::pbzero::TrackEvent::Type,
-      uint64_t timestamp = GetTimeNs());
+      const TraceTimestamp& timestamp = GetTraceTime());
 
-  static void ResetIncrementalState(TraceWriterBase*, uint64_t timestamp);
+  static void ResetIncrementalState(TraceWriterBase*,
+                                    TrackEventIncrementalState*,
+                                    const TraceTimestamp& timestamp);
 
+  // Scalars and strings are written straight into the event as one run of
+  // bytes, skipping the TracedValue and nested message bookkeeping of the
+  // generic path.
   template <typename T>
   static void AddDebugAnnotation(perfetto::EventContext* event_ctx,
                                  const char* name,
                                  T&& value) {
-    auto annotation = AddDebugAnnotation(event_ctx, name);
-    WriteIntoTracedValue(internal::CreateTracedValueFromProto(annotation),
-                         std::forward<T>(value));
+    using ValueField = DebugAnnotationValueField<base::remove_cvref_t<T>>;
+    AddDebugAnnotation(event_ctx, name, std::forward<T>(value),
+                       std::integral_constant<uint32_t, ValueField::value>());
   }
 
   // If the given track hasn't been seen by the trace writer yet, write a
@@ -171,12 +266,17 @@ class PERFETTO_EXPORT TrackEventInternal {
   static void WriteTrackDescriptor(const TrackType& track,
                                    TraceWriterBase* trace_writer) {
     TrackRegistry::Get()->SerializeTrack(
-        track, NewTracePacket(trace_writer, GetTimeNs()));
+        track, NewTracePacket(trace_writer, {GetClockId(), GetTimeNs()}));
   }
 
   // Get the current time in nanoseconds in the trace clock timebase.
   static uint64_t GetTimeNs();
 
+  // Get the current time for a track event. This is the same as GetTimeNs(),
+  // unless a session enabled TrackEventConfig.use_cycle_counter_clock, in
+  // which case it's read from the CPU cycle counter instead.
+  static TraceTimestamp GetTraceTime();
+
   // Get the clock used by GetTimeNs().
   static constexpr protos::pbzero::BuiltinClock GetClockId() {
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE) && \
@@ -192,16 +292,141 @@ class PERFETTO_EXPORT TrackEventInternal {
   // Represents the default track for the calling thread.
   static const Track kDefaultTrack;
 
+  // The sequence-scoped clocks used for incremental timestamps and for
+  // timestamps read from the cycle counter.
+  static constexpr uint32_t kClockIdIncremental = 64;
+  static constexpr uint32_t kClockIdCycleCounter = 65;
+
+  // Returns the process-wide interning id of |value|, which must have static
+  // lifetime, in [1, kMaxGlobalInternedIds]. Returns 0 if the value can't be
+  // given an id (e.g., the table of ids is full). See
+  // GlobalInternedDataTraits.
+  static size_t GetGlobalInternedId(const void* value);
+  static constexpr size_t kMaxGlobalInternedIds = 4096;
+
  private:
   static protozero::MessageHandle<protos::pbzero::TracePacket> NewTracePacket(
       TraceWriterBase*,
-      uint64_t timestamp,
+      const TraceTimestamp& timestamp,
       uint32_t seq_flags =
           protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
+  static protozero::MessageHandle<protos::pbzero::TracePacket> NewEventPacket(
+      TraceWriterBase*,
+      TrackEventIncrementalState*,
+      const TraceTimestamp& timestamp);
+  static void WriteCycleCounterSnapshotIfNeeded(TraceWriterBase*,
+                                                TrackEventIncrementalState*,
+                                                const TraceTimestamp&);
   static protos::pbzero::DebugAnnotation* AddDebugAnnotation(
       perfetto::EventContext*,
       const char* name);
 
+  template <typename T>
+  static void AddDebugAnnotation(perfetto::EventContext* event_ctx,
+                                 const char* name,
+                                 T&& value,
+                                 std::integral_constant<uint32_t, 0>) {
+    auto annotation = AddDebugAnnotation(event_ctx, name);
+    WriteIntoTracedValue(internal::CreateTracedValueFromProto(annotation),
+                         std::forward<T>(value));
+  }
+
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      bool value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kBoolValueFieldNumber>) {
+    AddVarIntDebugAnnotation(
+        event_ctx, name, protos::pbzero::DebugAnnotation::kBoolValueFieldNumber,
+        value);
+  }
+
+  template <typename T>
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      T value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kUintValueFieldNumber>) {
+    AddVarIntDebugAnnotation(
+        event_ctx, name, protos::pbzero::DebugAnnotation::kUintValueFieldNumber,
+        static_cast<uint64_t>(value));
+  }
+
+  template <typename T>
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      T value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kIntValueFieldNumber>) {
+    // Negative values are sign-extended to 64 bits, as for int64 fields.
+    AddVarIntDebugAnnotation(
+        event_ctx, name, protos::pbzero::DebugAnnotation::kIntValueFieldNumber,
+        static_cast<uint64_t>(static_cast<int64_t>(value)));
+  }
+
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      double value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kDoubleValueFieldNumber>) {
+    AddDoubleDebugAnnotation(event_ctx, name, value);
+  }
+
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      const char* value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kStringValueFieldNumber>) {
+    AddStringDebugAnnotation(event_ctx, name, value, strlen(value));
+  }
+
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      const std::string& value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kStringValueFieldNumber>) {
+    AddStringDebugAnnotation(event_ctx, name, value.data(), value.size());
+  }
+
+  static void AddDebugAnnotation(
+      perfetto::EventContext* event_ctx,
+      const char* name,
+      const void* value,
+      std::integral_constant<
+          uint32_t,
+          protos::pbzero::DebugAnnotation::kPointerValueFieldNumber>) {
+    AddVarIntDebugAnnotation(
+        event_ctx, name,
+        protos::pbzero::DebugAnnotation::kPointerValueFieldNumber,
+        reinterpret_cast<uint64_t>(value));
+  }
+
+  // Write a debug annotation with a single varint, double or string value
+  // field into the event.
+  static void AddVarIntDebugAnnotation(perfetto::EventContext*,
+                                       const char* name,
+                                       uint32_t field_id,
+                                       uint64_t value);
+  static void AddDoubleDebugAnnotation(perfetto::EventContext*,
+                                       const char* name,
+                                       double value);
+  static void AddStringDebugAnnotation(perfetto::EventContext*,
+                                       const char* name,
+                                       const char* value,
+                                       size_t size);
+
   static std::atomic<int> session_count_;
 };
 
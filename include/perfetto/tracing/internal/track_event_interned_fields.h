@@ -32,7 +32,7 @@ struct PERFETTO_EXPORT InternedEventCategory
           InternedEventCategory,
           perfetto::protos::pbzero::InternedData::kEventCategoriesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          GlobalInternedDataTraits> {
   ~InternedEventCategory() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
@@ -46,7 +46,7 @@ struct PERFETTO_EXPORT InternedEventName
           InternedEventName,
           perfetto::protos::pbzero::InternedData::kEventNamesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          GlobalInternedDataTraits> {
   ~InternedEventName() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
@@ -60,7 +60,7 @@ struct PERFETTO_EXPORT InternedDebugAnnotationName
           perfetto::protos::pbzero::InternedData::
               kDebugAnnotationNamesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          GlobalInternedDataTraits> {
   ~InternedDebugAnnotationName() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
@@ -40,14 +40,19 @@
 //   byte 0                      byte 1
 //   (inst0, inst1, ..., inst7), (inst0, inst1, ..., inst7)
 //
+// The storage is aligned to a cache line, so that the states of up to 64
+// categories live in a single line: checking whether a disabled trace point is
+// enabled costs one load (which likely hits the cache) and one branch.
+//
 #define PERFETTO_INTERNAL_DECLARE_CATEGORIES(...)                             \
   namespace internal {                                                        \
   constexpr ::perfetto::Category kCategories[] = {__VA_ARGS__};               \
   constexpr size_t kCategoryCount =                                           \
       sizeof(kCategories) / sizeof(kCategories[0]);                           \
   /* The per-instance enable/disable state per category */                    \
-  PERFETTO_COMPONENT_EXPORT extern std::atomic<uint8_t>                       \
-      g_category_state_storage[kCategoryCount];                               \
+  alignas(::perfetto::internal::kCategoryStateAlignment)                      \
+      PERFETTO_COMPONENT_EXPORT extern std::atomic<uint8_t>                   \
+          g_category_state_storage[kCategoryCount];                           \
   /* The category registry which mediates access to the above structures. */  \
   /* The registry is used for two purposes: */                                \
   /**/                                                                        \
@@ -73,8 +78,9 @@
 // In a .cc file, declares storage for each category's runtime state.
 #define PERFETTO_INTERNAL_CATEGORY_STORAGE()             \
   namespace internal {                                   \
-  PERFETTO_COMPONENT_EXPORT std::atomic<uint8_t>         \
-      g_category_state_storage[kCategoryCount];          \
+  alignas(::perfetto::internal::kCategoryStateAlignment) \
+      PERFETTO_COMPONENT_EXPORT std::atomic<uint8_t>     \
+          g_category_state_storage[kCategoryCount];      \
   PERFETTO_COMPONENT_EXPORT const ::perfetto::internal:: \
       TrackEventCategoryRegistry kCategoryRegistry(      \
           kCategoryCount,                                \
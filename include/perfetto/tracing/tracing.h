@@ -115,6 +115,15 @@ struct TracingInitArgs {
   // callback instead of being logged directly.
   LogMessageCallback log_message_callback = nullptr;
 
+  // [Optional] If set, and the PERFETTO_STARTUP_TRACE_CONFIG environment
+  // variable contains the path of a binary-encoded TraceConfig, Initialize()
+  // starts a tracing session with that config on the in-process backend and
+  // only returns once it has started. Afterwards, registering a data source
+  // also blocks until the data source has been started for that session, so
+  // that events written right after process start are not dropped. The config
+  // must set write_into_file and output_path.
+  bool enable_startup_tracing = false;
+
  protected:
   friend class Tracing;
   friend class internal::TracingMuxerImpl;
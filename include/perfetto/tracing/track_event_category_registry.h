@@ -188,6 +188,10 @@ constexpr bool IsStringInPrefixList(const char* str,
          IsStringInPrefixList(str, std::forward<Args>(args)...);
 }
 
+// The alignment of the category state storage (see
+// PERFETTO_INTERNAL_DECLARE_CATEGORIES), i.e. the size of a cache line.
+constexpr size_t kCategoryStateAlignment = 64;
+
 // Holds all the registered categories for one category namespace. See
 // PERFETTO_DEFINE_CATEGORIES for building the registry.
 class PERFETTO_EXPORT TrackEventCategoryRegistry {
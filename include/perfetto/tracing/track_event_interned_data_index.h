@@ -25,6 +25,7 @@
 #include <map>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 // This file has templates for defining your own interned data types to be used
 // with track event. Interned data can be useful for avoiding repeating the same
@@ -143,6 +144,46 @@ struct HashedInternedDataTraits {
   };
 };
 
+// This type of interning index is for pointers to data with static lifetime,
+// e.g., event names. The interning ids come from a process-wide table shared by
+// all sequences, so each sequence only needs to remember which ids it has
+// already emitted, in a bitmap. This keeps the cost of a new thread or of a
+// cleared incremental state low, which matters with many short-lived threads.
+// Once the process-wide table is full, new values get per-sequence ids instead.
+struct GlobalInternedDataTraits {
+  template <typename ValueType>
+  class Index {
+   public:
+    static_assert(std::is_pointer<ValueType>::value,
+                  "GlobalInternedDataTraits only support pointer values");
+
+    bool LookUpOrInsert(size_t* iid, const ValueType& value) {
+      size_t global_iid = internal::TrackEventInternal::GetGlobalInternedId(
+          reinterpret_cast<const void*>(value));
+      if (PERFETTO_UNLIKELY(!global_iid)) {
+        // Ids past the range of the process-wide table can't collide with it.
+        bool found = fallback_index_.LookUpOrInsert(iid, value);
+        *iid += internal::TrackEventInternal::kMaxGlobalInternedIds;
+        return found;
+      }
+      *iid = global_iid;
+      size_t word = global_iid / 64;
+      uint64_t bit = uint64_t(1) << (global_iid % 64);
+      if (PERFETTO_UNLIKELY(word >= emitted_.size()))
+        emitted_.resize(word + 1);
+      if (PERFETTO_LIKELY(emitted_[word] & bit))
+        return true;
+      emitted_[word] |= bit;
+      return false;
+    }
+
+   private:
+    // A bit for each process-wide id which was emitted on this sequence.
+    std::vector<uint64_t> emitted_;
+    SmallInternedDataTraits::Index<ValueType> fallback_index_;
+  };
+};
+
 // A templated base class for an interned data type which corresponds to a field
 // in interned_data.proto.
 //
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+
+namespace {
+
+using perfetto::base::FlatHashMap;
+using perfetto::base::LinearProbe;
+using perfetto::base::QuadraticProbe;
+
+std::vector<uint32_t> GetRandData(size_t num_keys) {
+  std::vector<uint32_t> rnd_data;
+  std::minstd_rand0 rng(0);
+  for (size_t i = 0; i < num_keys; i++)
+    rnd_data.push_back(static_cast<uint32_t>(rng()));
+  return rnd_data;
+}
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(64);
+  } else {
+    b->RangeMultiplier(8)->Range(64, 1024 * 1024);
+  }
+}
+
+// Adapts the STL maps to the FlatHashMap interface.
+template <typename MapType>
+struct StlMap : public MapType {
+  void Insert(uint32_t key, uint32_t value) { this->emplace(key, value); }
+
+  uint32_t* Find(uint32_t key) {
+    auto it = this->find(key);
+    return it == this->end() ? nullptr : &it->second;
+  }
+};
+
+using Ours = FlatHashMap<uint32_t, uint32_t>;
+using OursLinear =
+    FlatHashMap<uint32_t, uint32_t, std::hash<uint32_t>, LinearProbe>;
+using StdMap = StlMap<std::map<uint32_t, uint32_t>>;
+using StdUnorderedMap = StlMap<std::unordered_map<uint32_t, uint32_t>>;
+
+}  // namespace
+
+template <typename MapType>
+static void BM_HashMapInsert(benchmark::State& state) {
+  std::vector<uint32_t> keys = GetRandData(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    MapType map;
+    for (const uint32_t key : keys)
+      map.Insert(key, key);
+    benchmark::DoNotOptimize(map);
+    benchmark::ClobberMemory();
+  }
+  state.counters["insertions"] = benchmark::Counter(
+      static_cast<double>(keys.size()),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Looks up the keys in a random order, half of which are not in the map.
+template <typename MapType>
+static void BM_HashMapLookup(benchmark::State& state) {
+  const size_t num_keys = static_cast<size_t>(state.range(0));
+  std::vector<uint32_t> keys = GetRandData(num_keys * 2);
+  MapType map;
+  for (size_t i = 0; i < num_keys; i++)
+    map.Insert(keys[i], keys[i]);
+  std::shuffle(keys.begin(), keys.end(), std::minstd_rand0(1));
+
+  for (auto _ : state) {
+    uint32_t total = 0;
+    for (const uint32_t key : keys) {
+      uint32_t* value = map.Find(key);
+      total += value ? *value : 0;
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.counters["lookups"] = benchmark::Counter(
+      static_cast<double>(keys.size()),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK_TEMPLATE(BM_HashMapInsert, Ours)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_HashMapInsert, OursLinear)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_HashMapInsert, StdMap)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_HashMapInsert, StdUnorderedMap)->Apply(BenchmarkArgs);
+
+BENCHMARK_TEMPLATE(BM_HashMapLookup, Ours)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_HashMapLookup, OursLinear)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_HashMapLookup, StdMap)->Apply(BenchmarkArgs);
+BENCHMARK_TEMPLATE(BM_HashMapLookup, StdUnorderedMap)->Apply(BenchmarkArgs);
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/flat_hash_map.h"
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "src/base/test/gtest_test_suite.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+using ::testing::Types;
+
+struct CollidingHasher {
+  size_t operator()(int n) const { return static_cast<size_t>(n % 1000); }
+};
+
+template <typename T>
+class FlatHashMapTest : public testing::Test {
+ public:
+  using Probe = T;
+};
+
+using ProbeTypes = Types<LinearProbe, QuadraticProbe>;
+TYPED_TEST_SUITE(FlatHashMapTest, ProbeTypes, /* trailing ',' for GCC*/);
+
+TYPED_TEST(FlatHashMapTest, InsertFindErase) {
+  FlatHashMap<std::string, int, std::hash<std::string>, TypeParam> fmap;
+  EXPECT_TRUE(fmap.empty());
+  EXPECT_EQ(fmap.Find("foo"), nullptr);
+
+  auto res = fmap.Insert("foo", 1);
+  EXPECT_TRUE(res.second);
+  EXPECT_EQ(*res.first, 1);
+  res = fmap.Insert("bar", 2);
+  EXPECT_TRUE(res.second);
+
+  // Inserting an existing key doesn't replace its value.
+  res = fmap.Insert("foo", 3);
+  EXPECT_FALSE(res.second);
+  EXPECT_EQ(*res.first, 1);
+  EXPECT_EQ(fmap.size(), 2u);
+
+  ASSERT_NE(fmap.Find("bar"), nullptr);
+  EXPECT_EQ(*fmap.Find("bar"), 2);
+
+  EXPECT_TRUE(fmap.Erase("foo"));
+  EXPECT_FALSE(fmap.Erase("foo"));
+  EXPECT_EQ(fmap.Find("foo"), nullptr);
+  EXPECT_EQ(fmap.size(), 1u);
+
+  fmap["baz"] = 4;
+  fmap["baz"]++;
+  EXPECT_EQ(*fmap.Find("baz"), 5);
+
+  fmap.Clear();
+  EXPECT_TRUE(fmap.empty());
+  EXPECT_EQ(fmap.Find("bar"), nullptr);
+  EXPECT_EQ(fmap.Find("baz"), nullptr);
+}
+
+TYPED_TEST(FlatHashMapTest, MoveOnlyValues) {
+  FlatHashMap<int, std::unique_ptr<int>, std::hash<int>, TypeParam> fmap;
+  for (int i = 0; i < 1000; i++)
+    fmap.Insert(i, std::unique_ptr<int>(new int(i)));
+  for (int i = 0; i < 1000; i += 2)
+    ASSERT_TRUE(fmap.Erase(i));
+  for (int i = 0; i < 1000; i++) {
+    std::unique_ptr<int>* value = fmap.Find(i);
+    if (i % 2) {
+      ASSERT_NE(value, nullptr);
+      ASSERT_EQ(**value, i);
+    } else {
+      ASSERT_EQ(value, nullptr);
+    }
+  }
+
+  FlatHashMap<int, std::unique_ptr<int>, std::hash<int>, TypeParam> moved(
+      std::move(fmap));
+  EXPECT_EQ(moved.size(), 500u);
+  EXPECT_EQ(fmap.size(), 0u);
+  EXPECT_EQ(fmap.Find(1), nullptr);
+  ASSERT_NE(moved.Find(1), nullptr);
+  EXPECT_EQ(**moved.Find(1), 1);
+}
+
+TYPED_TEST(FlatHashMapTest, Iterator) {
+  FlatHashMap<int, int, std::hash<int>, TypeParam> fmap;
+  EXPECT_FALSE(fmap.GetIterator());
+  for (int i = 0; i < 100; i++)
+    fmap.Insert(i, i * 10);
+  for (int i = 0; i < 100; i += 3)
+    fmap.Erase(i);
+
+  std::map<int, int> seen;
+  for (auto it = fmap.GetIterator(); it; ++it) {
+    EXPECT_EQ(it.value(), it.key() * 10);
+    it.value()++;
+    seen[it.key()]++;
+  }
+  EXPECT_EQ(seen.size(), fmap.size());
+  for (const auto& kv : seen) {
+    EXPECT_NE(kv.first % 3, 0);
+    EXPECT_EQ(kv.second, 1);
+    EXPECT_EQ(*fmap.Find(kv.first), kv.first * 10 + 1);
+  }
+}
+
+// All the keys with the same value modulo 1000 collide.
+TYPED_TEST(FlatHashMapTest, Collisions) {
+  FlatHashMap<int, int, CollidingHasher, TypeParam> fmap;
+  for (int i = 0; i < 20; i++)
+    ASSERT_TRUE(fmap.Insert(i * 1000, i).second);
+  for (int i = 0; i < 20; i += 2)
+    ASSERT_TRUE(fmap.Erase(i * 1000));
+
+  // The erased keys leave tombstones in the chain, which must not hide the
+  // keys after them.
+  for (int i = 0; i < 20; i++) {
+    int* value = fmap.Find(i * 1000);
+    if (i % 2) {
+      ASSERT_NE(value, nullptr);
+      ASSERT_EQ(*value, i);
+    } else {
+      ASSERT_EQ(value, nullptr);
+    }
+  }
+
+  // Re-inserting a key in the chain doesn't duplicate it.
+  ASSERT_TRUE(fmap.Insert(0, 42).second);
+  ASSERT_FALSE(fmap.Insert(1000, 42).second);
+  EXPECT_EQ(fmap.size(), 11u);
+}
+
+// Inserting and erasing keys all the time fills the table with tombstones:
+// it must be rehashed rather than growing forever.
+TYPED_TEST(FlatHashMapTest, TombstonesDontGrowTheTable) {
+  FlatHashMap<int, int, std::hash<int>, TypeParam> fmap;
+  for (int i = 0; i < 100000; i++) {
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+    if (i >= 10)
+      ASSERT_TRUE(fmap.Erase(i - 10));
+  }
+  EXPECT_EQ(fmap.size(), 10u);
+  EXPECT_LE(fmap.capacity(), 64u);
+}
+
+TYPED_TEST(FlatHashMapTest, Reserve) {
+  FlatHashMap<int, int, std::hash<int>, TypeParam> fmap;
+  fmap.Reserve(1000);
+  const size_t capacity = fmap.capacity();
+  const size_t load_limit_pct = FlatHashMap<int, int>::kDefaultLoadLimitPct;
+  EXPECT_GE(capacity * load_limit_pct / 100, 1000u);
+  for (int i = 0; i < 1000; i++)
+    fmap.Insert(i, i);
+  EXPECT_EQ(fmap.capacity(), capacity);
+}
+
+// Checks random operations against std::unordered_map.
+TYPED_TEST(FlatHashMapTest, RandomOperations) {
+  FlatHashMap<uint64_t, uint64_t, std::hash<uint64_t>, TypeParam> fmap;
+  std::unordered_map<uint64_t, uint64_t> ref;
+  std::minstd_rand0 rng(42);
+  for (int i = 0; i < 200000; i++) {
+    // Keys in a small range to have both hits and misses.
+    const uint64_t key = rng() % 5000;
+    switch (rng() % 3) {
+      case 0: {
+        const uint64_t value = rng();
+        auto res = fmap.Insert(key, value);
+        auto ref_res = ref.emplace(key, value);
+        ASSERT_EQ(res.second, ref_res.second);
+        ASSERT_EQ(*res.first, ref_res.first->second);
+        break;
+      }
+      case 1:
+        ASSERT_EQ(fmap.Erase(key), ref.erase(key) == 1);
+        break;
+      case 2: {
+        uint64_t* value = fmap.Find(key);
+        auto ref_it = ref.find(key);
+        ASSERT_EQ(value != nullptr, ref_it != ref.end());
+        if (value)
+          ASSERT_EQ(*value, ref_it->second);
+        break;
+      }
+    }
+    ASSERT_EQ(fmap.size(), ref.size());
+  }
+
+  size_t num_iterated = 0;
+  for (auto it = fmap.GetIterator(); it; ++it, ++num_iterated)
+    ASSERT_EQ(ref.at(it.key()), it.value());
+  EXPECT_EQ(num_iterated, ref.size());
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
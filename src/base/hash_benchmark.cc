@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/hash.h"
+
+namespace {
+
+using perfetto::base::Hash;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(16);
+  } else {
+    b->RangeMultiplier(4)->Range(4, 4096);
+  }
+}
+
+std::string GetRandString(size_t size) {
+  std::string str;
+  std::minstd_rand0 rng(0);
+  for (size_t i = 0; i < size; i++)
+    str.push_back(static_cast<char>('a' + rng() % 26));
+  return str;
+}
+
+}  // namespace
+
+static void BM_HashFnv(benchmark::State& state) {
+  const std::string str = GetRandString(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    Hash hash;
+    hash.Update(str.data(), str.size());
+    benchmark::DoNotOptimize(hash.digest());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+BENCHMARK(BM_HashFnv)->Apply(BenchmarkArgs);
+
+static void BM_HashBulk(benchmark::State& state) {
+  const std::string str = GetRandString(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(str.data());
+    benchmark::DoNotOptimize(Hash::Bulk(str.data(), str.size()));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+BENCHMARK(BM_HashBulk)->Apply(BenchmarkArgs);
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/hash.h"
+
+#include <string.h>
+
+#include <string>
+#include <unordered_set>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+uint64_t Fnv(const std::string& str) {
+  Hash hash;
+  hash.Update(str.data(), str.size());
+  return hash.digest();
+}
+
+uint64_t Bulk(const std::string& str) {
+  return Hash::Bulk(str.data(), str.size());
+}
+
+// The FNV-1a digests are persisted, they must never change.
+TEST(HashTest, FnvIsStable) {
+  EXPECT_EQ(Fnv(""), 0xcbf29ce484222325u);
+  EXPECT_EQ(Fnv("a"), 0xaf63dc4c8601ec8cu);
+  EXPECT_EQ(Fnv("foobar"), 0x85944171f73967e8u);
+}
+
+// Checks the reference xxHash64 digests (with seed 0), for all the paths:
+// less than 4 bytes, less than 32 bytes and more than 32 bytes.
+TEST(HashTest, BulkMatchesXxHash64) {
+  EXPECT_EQ(Bulk(""), 0xef46db3751d8e999u);
+  EXPECT_EQ(Bulk("a"), 0xd24ec4f1a98c6e5bu);
+  EXPECT_EQ(Bulk("abc"), 0x44bc2cf5ad770999u);
+  EXPECT_EQ(Bulk("Nobody inspects the spammish repetition"),
+            0xfbcea83c8a378bf1u);
+
+  std::string bytes;
+  for (int i = 0; i < 1024; i++)
+    bytes.push_back(static_cast<char>(i));
+  EXPECT_EQ(Bulk(bytes), 0x6f3914f18fe4df57u);
+}
+
+TEST(HashTest, BulkDoesntDependOnAlignment) {
+  const std::string str = "012345678901234567890123456789012345678901234567";
+  const uint64_t expected = Bulk(str.substr(1, 40));
+  alignas(8) char buf[64];
+  for (size_t offset = 0; offset < 8; offset++) {
+    memcpy(buf + offset, str.data() + 1, 40);
+    EXPECT_EQ(Hash::Bulk(buf + offset, 40), expected);
+  }
+}
+
+TEST(HashTest, BulkFewCollisions) {
+  std::unordered_set<uint64_t> hashes;
+  std::string str;
+  for (int i = 0; i < 10000; i++) {
+    str = "/system/lib64/libfoo" + std::to_string(i) + ".so";
+    hashes.insert(Bulk(str));
+    // Strings differing only by their length.
+    hashes.insert(Bulk(std::string(static_cast<size_t>(i % 100), '\0') +
+                       std::to_string(i / 100)));
+  }
+  EXPECT_EQ(hashes.size(), 20000u);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
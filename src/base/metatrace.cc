@@ -29,11 +29,10 @@ std::atomic<uint32_t> g_enabled_tags{0};
 std::atomic<uint64_t> g_enabled_timestamp{0};
 
 // static members
-constexpr size_t RingBuffer::kCapacity;
-std::array<Record, RingBuffer::kCapacity> RingBuffer::records_;
+std::atomic<ThreadRing*> RingBuffer::rings_;
+std::atomic<size_t> RingBuffer::thread_ring_capacity_{
+    kDefaultThreadRingCapacity};
 std::atomic<bool> RingBuffer::read_task_queued_;
-std::atomic<uint64_t> RingBuffer::wr_index_;
-std::atomic<uint64_t> RingBuffer::rd_index_;
 std::atomic<bool> RingBuffer::has_overruns_;
 Record RingBuffer::bankruptcy_record_;
 
@@ -55,20 +54,40 @@ struct Delegate {
   std::function<void()> read_task;
 };
 
+// Releases the ring of a thread when it exits.
+struct ThreadRingHolder {
+  ~ThreadRingHolder() {
+    if (ring)
+      ring->in_use.store(false, std::memory_order_release);
+  }
+  ThreadRing* ring = nullptr;
+};
+
+PERFETTO_THREAD_LOCAL ThreadRingHolder g_thread_ring;
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t res = 1;
+  while (res < n)
+    res <<= 1;
+  return res;
+}
+
 }  // namespace
 
 bool Enable(std::function<void()> read_task,
             base::TaskRunner* task_runner,
-            uint32_t tags) {
+            uint32_t tags,
+            size_t thread_ring_capacity) {
   PERFETTO_DCHECK(read_task);
   PERFETTO_DCHECK(task_runner->RunsTasksOnCurrentThread());
+  PERFETTO_DCHECK(thread_ring_capacity > 0);
   if (g_enabled_tags.load(std::memory_order_acquire))
     return false;
 
   Delegate* dg = Delegate::GetInstance();
   dg->task_runner = task_runner;
   dg->read_task = std::move(read_task);
-  RingBuffer::Reset();
+  RingBuffer::Reset(RoundUpToPowerOfTwo(thread_ring_capacity));
   g_enabled_timestamp.store(TraceTimeNowNs(), std::memory_order_relaxed);
   g_enabled_tags.store(tags, std::memory_order_release);
   return true;
@@ -83,57 +102,159 @@ void Disable() {
   dg->read_task = nullptr;
 }
 
+ThreadRing::ThreadRing(size_t cap) : capacity(cap), records(new Record[cap]) {
+  PERFETTO_DCHECK(cap && !(cap & (cap - 1)));
+}
+
+RingBuffer::ReadIterator::ReadIterator(ThreadRing* first_ring) {
+  EnterRing(first_ring);
+}
+
+RingBuffer::ReadIterator::ReadIterator(ReadIterator&& other)
+    : ring_(other.ring_), cur_(other.cur_), end_(other.end_) {
+  other.ring_ = nullptr;
+}
+
+RingBuffer::ReadIterator::~ReadIterator() {
+  if (ring_)
+    ring_->rd_index.store(cur_, std::memory_order_release);
+}
+
+RingBuffer::ReadIterator& RingBuffer::ReadIterator::operator++() {
+  PERFETTO_DCHECK(ring_ && cur_ < end_);
+  // Once a record has been read, mark it as free clearing its type_and_id,
+  // so if we encounter it in another read iteration while being written
+  // we know it's not fully written yet. The writer doesn't reuse the record
+  // before the |rd_index| release-store that follows this.
+  ring_->At(cur_)->type_and_id.store(0, std::memory_order_relaxed);
+  ++cur_;
+  SkipToReadableRecord();
+  return *this;
+}
+
+void RingBuffer::ReadIterator::EnterRing(ThreadRing* ring) {
+  ring_ = ring;
+  if (!ring_)
+    return;
+  cur_ = ring_->rd_index.load(std::memory_order_relaxed);
+  end_ = ring_->wr_index.load(std::memory_order_acquire);
+  SkipToReadableRecord();
+}
+
+void RingBuffer::ReadIterator::SkipToReadableRecord() {
+  if (cur_ < end_ &&
+      ring_->At(cur_)->type_and_id.load(std::memory_order_acquire) != 0) {
+    return;
+  }
+  // Either the ring is drained or the thread is still writing the record (e.g.
+  // a ScopedEvent that is still in scope): move to the next ring.
+  ring_->rd_index.store(cur_, std::memory_order_release);
+  EnterRing(ring_->next);
+}
+
 // static
-void RingBuffer::Reset() {
+void RingBuffer::Reset(size_t thread_ring_capacity) {
   bankruptcy_record_.clear();
-  for (Record& record : records_)
-    record.clear();
-  wr_index_ = 0;
-  rd_index_ = 0;
+  for (ThreadRing* ring = rings_.load(std::memory_order_acquire); ring;
+       ring = ring->next) {
+    for (size_t i = 0; i < ring->capacity; i++)
+      ring->records[i].clear();
+    ring->wr_index = 0;
+    ring->rd_index = 0;
+  }
+  thread_ring_capacity_ = thread_ring_capacity;
   has_overruns_ = false;
   read_task_queued_ = false;
 }
 
+// static
+ThreadRing* RingBuffer::GetRingForCurrentThread() {
+  const size_t capacity = thread_ring_capacity();
+  ThreadRing* ring = g_thread_ring.ring;
+  if (PERFETTO_LIKELY(ring && ring->capacity == capacity))
+    return ring;
+
+  // Either the thread has never recorded anything or the capacity has changed
+  // since it did. Take a released ring of the right capacity, if any, or add a
+  // new one to the list.
+  if (ring)
+    ring->in_use.store(false, std::memory_order_release);
+  ThreadRing* head = rings_.load(std::memory_order_acquire);
+  for (ring = head; ring; ring = ring->next) {
+    bool expected = false;
+    if (ring->capacity == capacity &&
+        !ring->in_use.load(std::memory_order_relaxed) &&
+        ring->in_use.compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+      g_thread_ring.ring = ring;
+      return ring;
+    }
+  }
+  ring = new ThreadRing(capacity);
+  do {
+    ring->next = head;
+  } while (!rings_.compare_exchange_weak(head, ring, std::memory_order_release,
+                                         std::memory_order_acquire));
+  g_thread_ring.ring = ring;
+  return ring;
+}
+
 // static
 Record* RingBuffer::AppendNewRecord() {
-  auto wr_index = wr_index_.fetch_add(1, std::memory_order_acq_rel);
+  ThreadRing* ring = GetRingForCurrentThread();
 
-  // rd_index can only monotonically increase, we don't care if we read an
-  // older value, we'll just hit the slow-path a bit earlier if it happens.
-  auto rd_index = rd_index_.load(std::memory_order_relaxed);
+  // Only this thread writes |wr_index|. The acquire-load of |rd_index| pairs
+  // with the release-store of the reader: the records before it have been
+  // read and cleared and can be reused.
+  auto wr_index = ring->wr_index.load(std::memory_order_relaxed);
+  auto rd_index = ring->rd_index.load(std::memory_order_acquire);
 
   PERFETTO_DCHECK(wr_index >= rd_index);
   auto size = wr_index - rd_index;
-  if (PERFETTO_LIKELY(size < kCapacity / 2))
-    return At(wr_index);
-
-  // Slow-path: Enqueue the read task and handle overruns.
-  bool expected = false;
-  if (RingBuffer::read_task_queued_.compare_exchange_strong(expected, true)) {
-    Delegate* dg = Delegate::GetInstance();
-    if (dg->task_runner) {
-      dg->task_runner->PostTask([] {
-        // Meta-tracing might have been disabled in the meantime.
-        auto read_task = Delegate::GetInstance()->read_task;
-        if (read_task)
-          read_task();
-        RingBuffer::read_task_queued_ = false;
-      });
+  if (PERFETTO_UNLIKELY(size >= ring->capacity / 2)) {
+    // Slow-path: Enqueue the read task and handle overruns.
+    bool expected = false;
+    if (RingBuffer::read_task_queued_.compare_exchange_strong(expected,
+                                                              true)) {
+      Delegate* dg = Delegate::GetInstance();
+      if (dg->task_runner) {
+        dg->task_runner->PostTask([] {
+          // Meta-tracing might have been disabled in the meantime.
+          auto read_task = Delegate::GetInstance()->read_task;
+          if (read_task)
+            read_task();
+          RingBuffer::read_task_queued_ = false;
+        });
+      }
     }
-  }
 
-  if (PERFETTO_LIKELY(size < kCapacity))
-    return At(wr_index);
+    if (size >= ring->capacity) {
+      has_overruns_.store(true, std::memory_order_release);
+
+      // In the case of overflows, threads will race writing on the same
+      // memory location and TSan will rightly complain. This is fine though
+      // because nobody will read the bankruptcy record and it's designed to
+      // contain garbage.
+      PERFETTO_ANNOTATE_BENIGN_RACE_SIZED(&bankruptcy_record_, sizeof(Record),
+                                          "nothing reads bankruptcy_record_")
+      return &bankruptcy_record_;
+    }
+  }
 
-  has_overruns_.store(true, std::memory_order_release);
-  wr_index_.fetch_sub(1, std::memory_order_acq_rel);
+  Record* record = ring->At(wr_index);
+  ring->wr_index.store(wr_index + 1, std::memory_order_release);
+  return record;
+}
 
-  // In the case of overflows, threads will race writing on the same memory
-  // location and TSan will rightly complain. This is fine though because nobody
-  // will read the bankruptcy record and it's designed to contain garbage.
-  PERFETTO_ANNOTATE_BENIGN_RACE_SIZED(&bankruptcy_record_, sizeof(Record),
-                                      "nothing reads bankruptcy_record_")
-  return &bankruptcy_record_;
+// static
+uint64_t RingBuffer::GetSizeForTesting() {
+  uint64_t size = 0;
+  for (ThreadRing* ring = rings_.load(std::memory_order_acquire); ring;
+       ring = ring->next) {
+    size += ring->wr_index.load(std::memory_order_relaxed) -
+            ring->rd_index.load(std::memory_order_relaxed);
+  }
+  return size;
 }
 
 // static
@@ -40,8 +40,9 @@ class MetatraceTest : public ::testing::Test {
     m::Disable();
   }
 
-  void Enable(uint32_t tags) {
-    m::Enable([this] { ReadCallback(); }, &task_runner_, tags);
+  void Enable(uint32_t tags,
+              size_t capacity = m::kDefaultThreadRingCapacity) {
+    m::Enable([this] { ReadCallback(); }, &task_runner_, tags, capacity);
   }
 
   MOCK_METHOD0(ReadCallback, void());
@@ -132,6 +133,7 @@ TEST_F(MetatraceTest, TagEnablingLogic) {
 // Test that overruns are handled properly and that the writer re-synchronizes
 // after the reader catches up.
 TEST_F(MetatraceTest, HandleOverruns) {
+  const size_t kCapacity = m::kDefaultThreadRingCapacity;
   int cnt = 0;
   int exp_cnt = 0;
   for (size_t iteration = 0; iteration < 3; iteration++) {
@@ -140,16 +142,16 @@ TEST_F(MetatraceTest, HandleOverruns) {
     auto checkpoint = task_runner_.CreateCheckpoint(checkpoint_name);
     EXPECT_CALL(*this, ReadCallback()).WillOnce(Invoke(checkpoint));
 
-    for (size_t i = 0; i < m::RingBuffer::kCapacity; i++)
+    for (size_t i = 0; i < kCapacity; i++)
       m::TraceCounter(/*tag=*/1, /*id=*/42, /*value=*/cnt++);
-    ASSERT_EQ(m::RingBuffer::GetSizeForTesting(), m::RingBuffer::kCapacity);
+    ASSERT_EQ(m::RingBuffer::GetSizeForTesting(), kCapacity);
     ASSERT_FALSE(m::RingBuffer::has_overruns());
 
     for (int n = 0; n < 3; n++)
       m::TraceCounter(/*tag=*/1, /*id=*/42, /*value=*/-1);  // Will overrun.
 
     ASSERT_TRUE(m::RingBuffer::has_overruns());
-    ASSERT_EQ(m::RingBuffer::GetSizeForTesting(), m::RingBuffer::kCapacity);
+    ASSERT_EQ(m::RingBuffer::GetSizeForTesting(), kCapacity);
 
     for (auto it = m::RingBuffer::GetReadIterator(); it; ++it)
       ASSERT_EQ(it->counter_value, exp_cnt++);
@@ -166,7 +168,7 @@ TEST_F(MetatraceTest, HandleOverruns) {
 // consistently without gaps.
 TEST_F(MetatraceTest, InterleavedReadWrites) {
   Enable(m::TAG_ANY);
-  constexpr int kMaxValue = m::RingBuffer::kCapacity * 3;
+  constexpr int kMaxValue = m::kDefaultThreadRingCapacity * 3;
 
   std::atomic<int> last_value_read{-1};
   auto read_task = [&last_value_read] {
@@ -195,7 +197,7 @@ TEST_F(MetatraceTest, InterleavedReadWrites) {
   std::thread writer_thread([this, &writer_done, &last_value_read] {
     for (int i = 0; i < kMaxValue; i++) {
       m::TraceCounter(/*tag=*/1, /*id=*/1, i);
-      const int kCapacity = static_cast<int>(m::RingBuffer::kCapacity);
+      const int kCapacity = static_cast<int>(m::kDefaultThreadRingCapacity);
 
       // Wait for the reader to avoid overruns.
       // Using memory_order_relaxed because the QEMU arm emulator seems to incur
@@ -219,7 +221,7 @@ TEST_F(MetatraceTest, InterleavedReadWrites) {
 
 // Try to hit potential thread races:
 // - Test that the read callback is posted only once per cycle.
-// - Test that the final size of the ring buffeer is sane.
+// - Test that the final size of the ring buffers is sane.
 // - Test that event records are consistent within each thread's event stream.
 TEST_F(MetatraceTest, ThreadRaces) {
   for (size_t iteration = 0; iteration < 10; iteration++) {
@@ -230,7 +232,7 @@ TEST_F(MetatraceTest, ThreadRaces) {
     EXPECT_CALL(*this, ReadCallback()).WillOnce(Invoke(checkpoint));
 
     auto thread_main = [](uint16_t thd_idx) {
-      for (size_t i = 0; i < m::RingBuffer::kCapacity + 500; i++)
+      for (size_t i = 0; i < m::kDefaultThreadRingCapacity + 500; i++)
         m::TraceCounter(/*tag=*/1, thd_idx, static_cast<int>(i));
     };
 
@@ -242,8 +244,14 @@ TEST_F(MetatraceTest, ThreadRaces) {
     for (auto& t : threads)
       t.join();
 
+    // Each thread overruns its own ring. A thread that starts after another
+    // one has exited can reuse its (full) ring.
     task_runner_.RunUntilCheckpoint(checkpoint_name);
-    ASSERT_EQ(m::RingBuffer::GetSizeForTesting(), m::RingBuffer::kCapacity);
+    ASSERT_TRUE(m::RingBuffer::has_overruns());
+    ASSERT_GE(m::RingBuffer::GetSizeForTesting(),
+              m::kDefaultThreadRingCapacity);
+    ASSERT_LE(m::RingBuffer::GetSizeForTesting(),
+              kNumThreads * m::kDefaultThreadRingCapacity);
 
     std::array<int, kNumThreads> last_val{};  // Last value for each thread.
     for (auto it = m::RingBuffer::GetReadIterator(); it; ++it) {
@@ -260,5 +268,51 @@ TEST_F(MetatraceTest, ThreadRaces) {
   }
 }
 
+// Tests that each thread gets its own ring, of the capacity passed to Enable().
+TEST_F(MetatraceTest, PerThreadRings) {
+  EXPECT_CALL(*this, ReadCallback()).Times(testing::AtLeast(1));
+  Enable(m::TAG_ANY, /*capacity=*/100);
+  ASSERT_EQ(m::RingBuffer::thread_ring_capacity(), 128u);
+
+  auto fill_ring = [] {
+    for (int i = 0; i < 128; i++)
+      m::TraceCounter(/*tag=*/1, /*id=*/1, i);
+  };
+  fill_ring();
+  std::thread other_thread(fill_ring);
+  other_thread.join();
+  EXPECT_EQ(m::RingBuffer::GetSizeForTesting(), 256u);
+  EXPECT_FALSE(m::RingBuffer::has_overruns());
+
+  size_t num_read = 0;
+  for (auto it = m::RingBuffer::GetReadIterator(); it; ++it)
+    num_read++;
+  EXPECT_EQ(num_read, 256u);
+  EXPECT_EQ(m::RingBuffer::GetSizeForTesting(), 0u);
+}
+
+// Tests that an event still in scope on a thread doesn't prevent reading the
+// records of the other threads.
+TEST_F(MetatraceTest, IncompleteRecordsDontBlockOtherThreads) {
+  EXPECT_CALL(*this, ReadCallback()).Times(0);
+  Enable(m::TAG_ANY);
+  {
+    m::ScopedEvent evt(m::TAG_ANY, /*id=*/7);
+    std::thread other_thread(
+        [] { m::TraceCounter(m::TAG_ANY, /*id=*/1, /*value=*/42); });
+    other_thread.join();
+
+    auto it = m::RingBuffer::GetReadIterator();
+    ASSERT_TRUE(it);
+    ASSERT_EQ(it->counter_value, 42);
+    ASSERT_FALSE(++it);
+  }
+
+  auto it = m::RingBuffer::GetReadIterator();
+  ASSERT_TRUE(it);
+  ASSERT_EQ(it->type_and_id, 7);
+  ASSERT_FALSE(++it);
+}
+
 }  // namespace
 }  // namespace perfetto
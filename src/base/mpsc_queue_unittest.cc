@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/mpsc_queue.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+TEST(MpscQueueTest, Fifo) {
+  MpscQueue<int> queue;
+  int value = 0;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.Pop(&value));
+
+  EXPECT_TRUE(queue.Push(1));
+  EXPECT_FALSE(queue.Push(2));
+  EXPECT_FALSE(queue.Push(3));
+  EXPECT_FALSE(queue.empty());
+
+  ASSERT_TRUE(queue.Pop(&value));
+  EXPECT_EQ(value, 1);
+
+  // The consumer has taken all the elements pushed so far, so the next push
+  // must tell the producer to wake it up, even if the queue isn't empty.
+  EXPECT_TRUE(queue.Push(4));
+  for (int expected = 2; expected <= 4; expected++) {
+    ASSERT_TRUE(queue.Pop(&value));
+    EXPECT_EQ(value, expected);
+  }
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.Pop(&value));
+  EXPECT_TRUE(queue.Push(5));
+}
+
+TEST(MpscQueueTest, MoveOnlyAndDestruction) {
+  auto shared = std::make_shared<int>(42);
+  {
+    MpscQueue<std::unique_ptr<std::shared_ptr<int>>> queue;
+    for (int i = 0; i < 10; i++)
+      queue.Push(std::unique_ptr<std::shared_ptr<int>>(
+          new std::shared_ptr<int>(shared)));
+    std::unique_ptr<std::shared_ptr<int>> value;
+    ASSERT_TRUE(queue.Pop(&value));
+    EXPECT_EQ(**value, 42);
+    EXPECT_EQ(shared.use_count(), 11);
+  }
+  // The elements left in the queue are destroyed with it.
+  EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST(MpscQueueTest, MultipleProducers) {
+  static constexpr int kNumProducers = 4;
+  static constexpr int kNumPerProducer = 10000;
+  MpscQueue<std::pair<int, int>> queue;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kNumProducers; p++) {
+    producers.emplace_back([&queue, p] {
+      for (int i = 0; i < kNumPerProducer; i++)
+        queue.Push(std::make_pair(p, i));
+    });
+  }
+
+  // Each producer's elements must be popped in the order they were pushed.
+  std::vector<int> next(kNumProducers, 0);
+  for (int popped = 0; popped < kNumProducers * kNumPerProducer;) {
+    std::pair<int, int> value;
+    if (!queue.Pop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(value.second, next[static_cast<size_t>(value.first)]++);
+    popped++;
+  }
+  for (auto& producer : producers)
+    producer.join();
+  EXPECT_TRUE(queue.empty());
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
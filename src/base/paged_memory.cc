@@ -47,6 +47,47 @@ size_t GuardSize() {
   return GetSysPageSize();
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+// The size of a transparent huge page on x86_64 and arm64 (with 4K pages).
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+// Maps |outer_size| bytes, with the part after the first guard page aligned to
+// the huge page size, and flags that part for transparent huge pages. Returns
+// nullptr if the mmap fails.
+void* MapForHugePages(size_t outer_size) {
+  const size_t map_size = outer_size + kHugePageSize;
+  char* map = static_cast<char*>(mmap(nullptr, map_size,
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (map == MAP_FAILED)
+    return nullptr;
+  const uintptr_t usable = reinterpret_cast<uintptr_t>(map) + GuardSize();
+  const uintptr_t aligned =
+      (usable + kHugePageSize - 1) & ~(uintptr_t(kHugePageSize) - 1);
+  char* start = map + (aligned - usable);
+
+  // Give back the excess before and after the aligned region.
+  int res = 0;
+  if (start > map)
+    res |= munmap(map, static_cast<size_t>(start - map));
+  if (map + map_size > start + outer_size)
+    res |= munmap(start + outer_size,
+                  static_cast<size_t>(map + map_size - (start + outer_size)));
+  PERFETTO_CHECK(res == 0);
+
+#if defined(MADV_HUGEPAGE)
+  // Fails with EINVAL if the kernel doesn't support transparent huge pages.
+  // This is fine: the memory is then backed by regular pages.
+  if (madvise(start + GuardSize(), outer_size - GuardSize() * 2,
+              MADV_HUGEPAGE) != 0) {
+    PERFETTO_DLOG("madvise(MADV_HUGEPAGE) failed");
+  }
+#endif
+  return start;
+}
+#endif
+
 }  // namespace
 
 // static
@@ -61,8 +102,16 @@ PagedMemory PagedMemory::Allocate(size_t req_size, int flags) {
   PERFETTO_CHECK(ptr);
   char* usable_region = reinterpret_cast<char*>(ptr) + GuardSize();
 #else   // PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
-  void* ptr = mmap(nullptr, outer_size, PROT_READ | PROT_WRITE,
-                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  void* ptr = nullptr;
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  if (flags & kHugePages)
+    ptr = MapForHugePages(outer_size);
+#endif
+  if (!ptr) {  // Also the fallback if the mmap for huge pages fails.
+    ptr = mmap(nullptr, outer_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
   if (ptr == MAP_FAILED && (flags & kMayFail))
     return PagedMemory();
   PERFETTO_CHECK(ptr && ptr != MAP_FAILED);
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/paged_memory.h"
+
+namespace {
+
+using perfetto::base::PagedMemory;
+
+// The size of the SharedMemoryABI chunks that the service copies into (and
+// reads back from) a TraceBuffer.
+constexpr size_t kChunkSize = 4096;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"huge_pages"});
+  b->Arg(0)->Arg(1);
+}
+
+// Allocates and faults in the buffer, so that the benchmark doesn't measure
+// the page faults.
+PagedMemory AllocateBuffer(size_t size, bool huge_pages) {
+  PagedMemory mem =
+      PagedMemory::Allocate(size, huge_pages ? PagedMemory::kHugePages : 0);
+  memset(mem.Get(), 1, size);
+  return mem;
+}
+
+// Returns the offsets of the chunks, in a random order, to defeat the caches
+// and the prefetchers like the reads of the interleaved sequences of a
+// TraceBuffer do.
+std::vector<size_t> ShuffledChunkOffsets(size_t buf_size) {
+  std::vector<size_t> offsets;
+  for (size_t off = 0; off + kChunkSize <= buf_size; off += kChunkSize)
+    offsets.push_back(off);
+  std::minstd_rand0 rnd(0);
+  std::shuffle(offsets.begin(), offsets.end(), rnd);
+  return offsets;
+}
+
+size_t BufferSize() {
+  return IsBenchmarkFunctionalOnly() ? 8 * 1024 * 1024 : 1024 * 1024 * 1024;
+}
+
+}  // namespace
+
+// Measures the throughput of copying chunks into a large buffer, at random
+// positions, with and without huge pages (state.range(0)).
+static void BM_PagedMemory_CopyIntoBuffer(benchmark::State& state) {
+  const size_t buf_size = BufferSize();
+  PagedMemory mem = AllocateBuffer(buf_size, state.range(0) != 0);
+  char* buf = static_cast<char*>(mem.Get());
+  const std::vector<size_t> offsets = ShuffledChunkOffsets(buf_size);
+  char chunk[kChunkSize];
+  memset(chunk, 2, sizeof(chunk));
+
+  size_t i = 0;
+  for (auto _ : state) {
+    memcpy(buf + offsets[i++ % offsets.size()], chunk, kChunkSize);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kChunkSize));
+}
+
+BENCHMARK(BM_PagedMemory_CopyIntoBuffer)->Apply(BenchmarkArgs);
+
+// As above, but for reading chunks back from the buffer.
+static void BM_PagedMemory_CopyFromBuffer(benchmark::State& state) {
+  const size_t buf_size = BufferSize();
+  PagedMemory mem = AllocateBuffer(buf_size, state.range(0) != 0);
+  const char* buf = static_cast<const char*>(mem.Get());
+  const std::vector<size_t> offsets = ShuffledChunkOffsets(buf_size);
+  char chunk[kChunkSize];
+
+  size_t i = 0;
+  for (auto _ : state) {
+    memcpy(chunk, buf + offsets[i++ % offsets.size()], kChunkSize);
+    benchmark::DoNotOptimize(chunk);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kChunkSize));
+}
+
+BENCHMARK(BM_PagedMemory_CopyFromBuffer)->Apply(BenchmarkArgs);
@@ -172,6 +172,23 @@ TEST(PagedMemoryTest, GuardRegions) {
   EXPECT_DEATH_IF_SUPPORTED({ raw[kSize] = 'x'; }, ".*");
 }
 
+TEST(PagedMemoryTest, HugePages) {
+  const size_t kSize = 4 * 1024 * 1024 + GetSysPageSize();
+  PagedMemory mem = PagedMemory::Allocate(kSize, PagedMemory::kHugePages);
+  ASSERT_TRUE(mem.IsValid());
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(mem.Get()) % (2 * 1024 * 1024));
+#endif
+  volatile char* raw = reinterpret_cast<char*>(mem.Get());
+  for (size_t i = 0; i < kSize; i += GetSysPageSize()) {
+    ASSERT_EQ(0, raw[i]);
+    raw[i] = 'x';
+  }
+  EXPECT_DEATH_IF_SUPPORTED({ raw[-1] = 'x'; }, ".*");
+  EXPECT_DEATH_IF_SUPPORTED({ raw[kSize + GetSysPageSize()] = 'x'; }, ".*");
+}
+
 // Disable this on:
 // MacOS: because it doesn't seem to have an equivalent rlimit to bound mmap().
 // Fuchsia: doesn't support rlimit.
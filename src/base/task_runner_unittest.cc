@@ -19,6 +19,7 @@
 #include "perfetto/ext/base/unix_task_runner.h"
 
 #include <thread>
+#include <vector>
 
 #include "perfetto/ext/base/event_fd.h"
 #include "perfetto/ext/base/file_utils.h"
@@ -385,6 +386,55 @@ TEST_F(TaskRunnerTest, FileDescriptorClosedEvent) {
   task_runner.Run();
 }
 
+// Files which don't support polling (e.g. /dev/null) are always readable, as
+// per poll(2) semantics.
+TEST_F(TaskRunnerTest, FileDescriptorWatchUnpollableFile) {
+  auto& task_runner = this->task_runner;
+  ScopedFile dev_null = OpenFile("/dev/null", O_RDONLY);
+  ASSERT_TRUE(dev_null);
+  int num_callbacks = 0;
+  int fd = *dev_null;
+  task_runner.AddFileDescriptorWatch(fd, [&task_runner, &num_callbacks, fd] {
+    if (++num_callbacks < 3)
+      return;
+    task_runner.RemoveFileDescriptorWatch(fd);
+    task_runner.Quit();
+  });
+  task_runner.Run();
+  EXPECT_EQ(num_callbacks, 3);
+}
+
+TEST_F(TaskRunnerTest, ManyFileDescriptorWatches) {
+  auto& task_runner = this->task_runner;
+  static constexpr size_t kNumWatches = 200;
+  static constexpr size_t kNumReadable = (kNumWatches + 6) / 7;
+  std::vector<Pipe> pipes(kNumWatches);
+  std::vector<int> num_callbacks(kNumWatches);
+  size_t total_callbacks = 0;
+  for (size_t i = 0; i < kNumWatches; i++) {
+    pipes[i] = Pipe::Create();
+    int fd = *pipes[i].rd;
+    task_runner.AddFileDescriptorWatch(
+        fd, [&task_runner, &num_callbacks, &total_callbacks, i, fd] {
+          char buf;
+          ASSERT_EQ(1, base::Read(fd, &buf, 1));
+          num_callbacks[i]++;
+          if (++total_callbacks == kNumReadable)
+            task_runner.Quit();
+        });
+  }
+
+  // Only the watches of the fds that are readable run.
+  for (size_t i = 0; i < kNumWatches; i += 7)
+    ASSERT_EQ(1, base::WriteAll(*pipes[i].wr, "x", 1));
+  task_runner.Run();
+  for (size_t i = 0; i < kNumWatches; i++)
+    EXPECT_EQ(num_callbacks[i], i % 7 == 0 ? 1 : 0);
+
+  for (const Pipe& pipe : pipes)
+    task_runner.RemoveFileDescriptorWatch(*pipe.rd);
+}
+
 #endif
 
 }  // namespace
@@ -25,10 +25,13 @@
 #include <Windows.h>
 #include <synchapi.h>
 #else
+#include <pthread.h>
 #include <unistd.h>
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <limits>
 
 #include "perfetto/ext/base/watchdog.h"
@@ -36,7 +39,31 @@
 namespace perfetto {
 namespace base {
 
+namespace {
+
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+// The max number of ready fds returned by each epoll_wait() call. The ones
+// beyond that are returned by the next calls.
+constexpr size_t kMaxEpollEvents = 64;
+
+// Incremented in the child process after each fork().
+std::atomic<uint32_t> g_fork_generation{};
+
+void OnForkChild() {
+  g_fork_generation.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+}  // namespace
+
 UnixTaskRunner::UnixTaskRunner() {
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  static bool fork_handler_registered =
+      pthread_atfork(nullptr, nullptr, &OnForkChild) == 0;
+  base::ignore_result(fork_handler_registered);
+  EnsureEpollInstanceLocked();
+  epoll_events_.resize(kMaxEpollEvents);
+#endif
   AddFileDescriptorWatch(event_.fd(), [] {
     // Not reached -- see PostFileDescriptorWatches().
     PERFETTO_DFATAL("Should be unreachable.");
@@ -61,6 +88,10 @@ void UnixTaskRunner::Run() {
         return;
       poll_timeout_ms = GetDelayMsToNextTaskLocked();
       UpdateWatchTasksLocked();
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+      if (!always_ready_fds_.empty())
+        poll_timeout_ms = 0;
+#endif
     }
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
@@ -76,6 +107,12 @@ void UnixTaskRunner::Run() {
     // WaitForSingleObject() for the one handle that WaitForMultipleObject()
     // returned.
     PostFileDescriptorWatches(ret);
+#elif PERFETTO_TASK_RUNNER_USE_EPOLL()
+    int ret = PERFETTO_EINTR(
+        epoll_wait(*epoll_fd_, &epoll_events_[0],
+                   static_cast<int>(epoll_events_.size()), poll_timeout_ms));
+    PERFETTO_CHECK(ret >= 0);
+    PostFileDescriptorWatches(static_cast<uint64_t>(ret));
 #else
     int ret = PERFETTO_EINTR(poll(
         &poll_fds_[0], static_cast<nfds_t>(poll_fds_.size()), poll_timeout_ms));
@@ -101,12 +138,26 @@ bool UnixTaskRunner::QuitCalled() {
 }
 
 bool UnixTaskRunner::IsIdleForTesting() {
-  std::lock_guard<std::mutex> lock(lock_);
+  PERFETTO_DCHECK_THREAD(thread_checker_);
   return immediate_tasks_.empty();
 }
 
 void UnixTaskRunner::UpdateWatchTasksLocked() {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  // The epoll set is updated directly by {Add,Remove}FileDescriptorWatch().
+  // The only thing left is to deal with the fds which epoll doesn't support.
+  EnsureEpollInstanceLocked();
+  if (PERFETTO_LIKELY(num_always_ready_watches_ == 0))
+    return;
+  for (auto& it : watch_tasks_) {
+    WatchTask& watch_task = it.second;
+    if (watch_task.always_ready && !watch_task.pending) {
+      watch_task.pending = true;
+      always_ready_fds_.push_back(it.first);
+    }
+  }
+#else
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   if (!watch_tasks_changed_)
     return;
@@ -124,25 +175,21 @@ void UnixTaskRunner::UpdateWatchTasksLocked() {
     poll_fds_.push_back({handle, POLLIN | POLLHUP, 0});
 #endif
   }
+#endif  // PERFETTO_TASK_RUNNER_USE_EPOLL()
 }
 
 void UnixTaskRunner::RunImmediateAndDelayedTask() {
-  // If locking overhead becomes an issue, add a separate work queue.
   std::function<void()> immediate_task;
   std::function<void()> delayed_task;
+  immediate_tasks_.Pop(&immediate_task);
   TimeMillis now = GetWallTimeMs();
   {
     std::lock_guard<std::mutex> lock(lock_);
-    if (!immediate_tasks_.empty()) {
-      immediate_task = std::move(immediate_tasks_.front());
-      immediate_tasks_.pop_front();
-    }
-    if (!delayed_tasks_.empty()) {
-      auto it = delayed_tasks_.begin();
-      if (now >= it->first) {
-        delayed_task = std::move(it->second);
-        delayed_tasks_.erase(it);
-      }
+    if (!delayed_tasks_.empty() && now >= delayed_tasks_.front().time) {
+      std::pop_heap(delayed_tasks_.begin(), delayed_tasks_.end(),
+                    std::greater<DelayedTask>());
+      delayed_task = std::move(delayed_tasks_.back().task);
+      delayed_tasks_.pop_back();
     }
   }
 
@@ -154,25 +201,36 @@ void UnixTaskRunner::RunImmediateAndDelayedTask() {
     RunTaskWithWatchdogGuard(delayed_task);
 }
 
-void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
+void UnixTaskRunner::PostFileDescriptorWatches(uint64_t wait_result) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  // |wait_result| is the number of events returned by epoll_wait(). Only the
+  // fds that are ready are visited, regardless of how many are watched.
+  PERFETTO_DCHECK(wait_result <= epoll_events_.size());
+  for (size_t i = 0; i < wait_result + always_ready_fds_.size(); i++) {
+    // Any event (including EPOLLERR) causes the task to run. The callback is
+    // expected to find out what happened via read() or similar.
+    const PlatformHandle handle =
+        i < wait_result ? epoll_events_[i].data.fd
+                        : always_ready_fds_[i - wait_result];
+#else
   for (size_t i = 0; i < poll_fds_.size(); i++) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     const PlatformHandle handle = poll_fds_[i];
-    // |windows_wait_result| is the result of WaitForMultipleObjects() call. If
-    // one of the objects was signalled, it will have a value between
+    // |wait_result| is the result of WaitForMultipleObjects() call. If one of
+    // the objects was signalled, it will have a value between
     // [0, poll_fds_.size()].
-    if (i != windows_wait_result &&
-        WaitForSingleObject(handle, 0) != WAIT_OBJECT_0) {
+    if (i != wait_result && WaitForSingleObject(handle, 0) != WAIT_OBJECT_0) {
       continue;
     }
 #else
-    base::ignore_result(windows_wait_result);
+    base::ignore_result(wait_result);
     const PlatformHandle handle = poll_fds_[i].fd;
     if (!(poll_fds_[i].revents & (POLLIN | POLLHUP)))
       continue;
     poll_fds_[i].revents = 0;
 #endif
+#endif  // PERFETTO_TASK_RUNNER_USE_EPOLL()
 
     // The wake-up event is handled inline to avoid an infinite recursion of
     // posted tasks.
@@ -186,7 +244,10 @@ void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
     PostTask(std::bind(&UnixTaskRunner::RunFileDescriptorWatch, this, handle));
 
     // Flag the task as pending.
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    // With epoll this is implicit: EPOLLONESHOT has already disabled the fd
+    // (or UpdateWatchTasksLocked() has marked it as pending).
+#elif PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     // On Windows this is done by marking the WatchTask entry as pending. This
     // is more expensive than Linux as requires rebuilding the |poll_fds_|
     // vector on each call. There doesn't seem to be a good alternative though.
@@ -201,6 +262,9 @@ void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
     poll_fds_[i].fd = -poll_fds_[i].fd;
 #endif
   }
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  always_ready_fds_.clear();
+#endif
 }
 
 void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
@@ -212,6 +276,10 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
       return;
     WatchTask& watch_task = it->second;
 
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    // Other fds are re-armed only after the task has run, see below.
+    watch_task.pending = false;
+#else
     // Make poll(2) pay attention to the fd again. Since another thread may have
     // updated this watch we need to refresh the set first.
     UpdateWatchTasksLocked();
@@ -228,10 +296,22 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
     PERFETTO_DCHECK(::abs(poll_fds_[fd_index].fd) == fd);
     poll_fds_[fd_index].fd = fd;
 #endif
+#endif  // PERFETTO_TASK_RUNNER_USE_EPOLL()
     task = watch_task.callback;
   }
   errno = 0;
   RunTaskWithWatchdogGuard(task);
+
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+  // Re-arm the fd, which has been disabled by EPOLLONESHOT when its event was
+  // reported. This happens after the task has run because the task might have
+  // replaced the file behind |fd| (e.g. via dup2()). Unlike poll(2), epoll(7)
+  // wouldn't notice that otherwise.
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = watch_tasks_.find(fd);
+  if (it != watch_tasks_.end() && !it->second.always_ready)
+    RearmEpollWatchLocked(fd, &it->second);
+#endif
 }
 
 int UnixTaskRunner::GetDelayMsToNextTaskLocked() const {
@@ -239,20 +319,14 @@ int UnixTaskRunner::GetDelayMsToNextTaskLocked() const {
   if (!immediate_tasks_.empty())
     return 0;
   if (!delayed_tasks_.empty()) {
-    TimeMillis diff = delayed_tasks_.begin()->first - GetWallTimeMs();
+    TimeMillis diff = delayed_tasks_.front().time - GetWallTimeMs();
     return std::max(0, static_cast<int>(diff.count()));
   }
   return -1;
 }
 
 void UnixTaskRunner::PostTask(std::function<void()> task) {
-  bool was_empty;
-  {
-    std::lock_guard<std::mutex> lock(lock_);
-    was_empty = immediate_tasks_.empty();
-    immediate_tasks_.push_back(std::move(task));
-  }
-  if (was_empty)
+  if (immediate_tasks_.Push(std::move(task)))
     WakeUp();
 }
 
@@ -261,7 +335,10 @@ void UnixTaskRunner::PostDelayedTask(std::function<void()> task,
   TimeMillis runtime = GetWallTimeMs() + TimeMillis(delay_ms);
   {
     std::lock_guard<std::mutex> lock(lock_);
-    delayed_tasks_.insert(std::make_pair(runtime, std::move(task)));
+    delayed_tasks_.push_back(
+        DelayedTask{runtime, ++last_delayed_task_seq_, std::move(task)});
+    std::push_heap(delayed_tasks_.begin(), delayed_tasks_.end(),
+                   std::greater<DelayedTask>());
   }
   WakeUp();
 }
@@ -272,9 +349,16 @@ void UnixTaskRunner::AddFileDescriptorWatch(PlatformHandle fd,
   {
     std::lock_guard<std::mutex> lock(lock_);
     PERFETTO_DCHECK(!watch_tasks_.count(fd));
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    // This must happen before adding |fd| to |watch_tasks_|, otherwise a new
+    // epoll instance would get it twice.
+    EnsureEpollInstanceLocked();
+#endif
     WatchTask& watch_task = watch_tasks_[fd];
     watch_task.callback = std::move(task);
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    AddEpollWatchLocked(fd, &watch_task);
+#elif PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     watch_task.pending = false;
 #else
     watch_task.poll_fd_index = SIZE_MAX;
@@ -289,12 +373,81 @@ void UnixTaskRunner::RemoveFileDescriptorWatch(PlatformHandle fd) {
   {
     std::lock_guard<std::mutex> lock(lock_);
     PERFETTO_DCHECK(watch_tasks_.count(fd));
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    auto it = watch_tasks_.find(fd);
+    if (it != watch_tasks_.end() && it->second.always_ready)
+      --num_always_ready_watches_;
+#endif
     watch_tasks_.erase(fd);
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+    // This fails if the fd has been already closed, which removes it from the
+    // epoll set anyways.
+    EnsureEpollInstanceLocked();
+    epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
     watch_tasks_changed_ = true;
   }
   // No need to schedule a wake-up for this.
 }
 
+#if PERFETTO_TASK_RUNNER_USE_EPOLL()
+void UnixTaskRunner::EnsureEpollInstanceLocked() {
+  // After a fork() the child process shares the epoll instance, and hence the
+  // set of watched fds, with the parent. Use a new one in the child, or the
+  // two processes would steal each other's events.
+  uint32_t fork_generation = g_fork_generation.load(std::memory_order_relaxed);
+  if (PERFETTO_LIKELY(epoll_fd_ && fork_generation == epoll_fork_generation_))
+    return;
+  epoll_fork_generation_ = fork_generation;
+  epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+  PERFETTO_CHECK(epoll_fd_);
+  for (auto& it : watch_tasks_) {
+    if (!it.second.always_ready)
+      AddEpollWatchLocked(it.first, &it.second);
+  }
+}
+
+void UnixTaskRunner::AddEpollWatchLocked(PlatformHandle fd,
+                                         WatchTask* watch_task) {
+  // The wake-up event is cleared inline by PostFileDescriptorWatches(), so it
+  // doesn't need to be disabled while being handled.
+  struct epoll_event event {};
+  event.events = EPOLLIN;
+  if (fd != event_.fd())
+    event.events |= EPOLLONESHOT;
+  event.data.fd = fd;
+  if (epoll_ctl(*epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0)
+    return;
+  if (errno == EPERM) {
+    // The fd doesn't support polling (e.g. regular files or /dev/null).
+    // poll(2) reports these as always readable, do the same.
+    watch_task->always_ready = true;
+    ++num_always_ready_watches_;
+    return;
+  }
+  PERFETTO_DFATAL_OR_ELOG("epoll_ctl(EPOLL_CTL_ADD) failed for fd %d (%d)",
+                          fd, errno);
+}
+
+void UnixTaskRunner::RearmEpollWatchLocked(PlatformHandle fd,
+                                           WatchTask* watch_task) {
+  EnsureEpollInstanceLocked();
+  struct epoll_event event {};
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.fd = fd;
+  if (epoll_ctl(*epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0)
+    return;
+  if (errno == ENOENT || errno == EPERM) {
+    // The file behind |fd| has been replaced and closed since it was added
+    // (e.g. another fd has been dup2()-ed over it). Watch the new one. EPERM
+    // means that the new one doesn't support polling.
+    AddEpollWatchLocked(fd, watch_task);
+    return;
+  }
+  PERFETTO_DPLOG("epoll_ctl(EPOLL_CTL_MOD) failed for fd %d", fd);
+}
+#endif  // PERFETTO_TASK_RUNNER_USE_EPOLL()
+
 bool UnixTaskRunner::RunsTasksOnCurrentThread() const {
   return GetThreadId() == created_thread_id_;
 }
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/event_fd.h"
+#include "perfetto/ext/base/unix_task_runner.h"
+
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(10);
+  } else {
+    b->Arg(10)->Arg(100)->Arg(1000);
+  }
+}
+
+void ThreadArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1);
+  } else {
+    b->Arg(1)->Arg(2)->Arg(4);
+  }
+}
+
+}  // namespace
+
+// Measures the cost of one iteration of the run loop which dispatches a single
+// ready fd, when |state.range(0)| fds are watched (e.g. the producer sockets
+// connected to traced).
+static void BM_UnixTaskRunner_FileDescriptorWatch(benchmark::State& state) {
+  using perfetto::base::EventFd;
+  const size_t num_fds = static_cast<size_t>(state.range(0));
+  perfetto::base::UnixTaskRunner task_runner;
+  std::vector<EventFd> events(num_fds);
+  for (EventFd& event : events) {
+    EventFd* evt = &event;
+    task_runner.AddFileDescriptorWatch(evt->fd(), [&task_runner, evt] {
+      evt->Clear();
+      task_runner.Quit();
+    });
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    events[i++ % num_fds].Notify();
+    task_runner.Run();
+  }
+
+  for (EventFd& event : events)
+    task_runner.RemoveFileDescriptorWatch(event.fd());
+}
+
+BENCHMARK(BM_UnixTaskRunner_FileDescriptorWatch)->Apply(BenchmarkArgs);
+
+// Measures the cost of posting tasks from |state.range(0)| other threads (e.g.
+// the SDK's muxer, which moves all the work onto its own thread) and running
+// them on the task runner thread.
+static void BM_UnixTaskRunner_PostTaskFromOtherThreads(
+    benchmark::State& state) {
+  static constexpr int kTasksPerThread = 10000;
+  const int num_threads = static_cast<int>(state.range(0));
+  perfetto::base::UnixTaskRunner task_runner;
+  for (auto _ : state) {
+    std::atomic<int> tasks_left{num_threads * kTasksPerThread};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&task_runner, &tasks_left] {
+        for (int i = 0; i < kTasksPerThread; i++) {
+          task_runner.PostTask([&task_runner, &tasks_left] {
+            if (tasks_left.fetch_sub(1, std::memory_order_relaxed) == 1)
+              task_runner.Quit();
+          });
+        }
+      });
+    }
+    task_runner.Run();
+    for (auto& thread : threads)
+      thread.join();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_threads * kTasksPerThread);
+}
+
+BENCHMARK(BM_UnixTaskRunner_PostTaskFromOtherThreads)
+    ->Apply(ThreadArgs)
+    ->UseRealTime();
@@ -22,6 +22,7 @@
 #include <type_traits>
 #include <utility>
 
+#include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
 
@@ -60,16 +61,16 @@ BufferedFrameDeserializer::BeginReceive() {
     buf_.AdviseDontNeed(buf() + page_size, capacity_ - page_size);
   }
 
+  CompactBuffer();
   PERFETTO_CHECK(capacity_ > size_);
   return ReceiveBuffer{buf() + size_, capacity_ - size_};
 }
 
 bool BufferedFrameDeserializer::EndReceive(size_t recv_size) {
-  const auto page_size = base::GetSysPageSize();
   PERFETTO_CHECK(recv_size + size_ <= capacity_);
   size_ += recv_size;
 
-  // At this point the contents buf_ can contain:
+  // At this point the contents buf_ after |frames_end_| can contain:
   // A) Only a fragment of the header (the size of the frame). E.g.,
   //    03 00 00 (the header is 4 bytes, one is missing).
   //
@@ -85,18 +86,18 @@ bool BufferedFrameDeserializer::EndReceive(size_t recv_size) {
   //
   // C Is the more likely case and the one we are optimizing for. A, B, D can
   // happen because of the streaming nature of the socket.
-  // The invariant of this function is that, when it returns, buf_ is either
-  // empty (we drained all the complete frames) or starts with the header of the
-  // next, still incomplete, frame.
+  // This function only tokenizes the frames: they are decoded (if at all) when
+  // popped, straight from |buf_|. The invariant of this function is that, when
+  // it returns, |frames_end_| is the end of the last complete frame. The frames
+  // are shifted out of |buf_| by the next BeginReceive().
 
-  size_t consumed_size = 0;
   for (;;) {
-    if (size_ < consumed_size + kHeaderSize)
+    if (size_ < frames_end_ + kHeaderSize)
       break;  // Case A, not enough data to read even the header.
 
     // Read the header into |payload_size|.
     uint32_t payload_size = 0;
-    const char* rd_ptr = buf() + consumed_size;
+    const char* rd_ptr = buf() + frames_end_;
     memcpy(base::AssumeLittleEndian(&payload_size), rd_ptr, kHeaderSize);
 
     // Saturate the |payload_size| to prevent overflows. The > capacity_ check
@@ -104,9 +105,8 @@ bool BufferedFrameDeserializer::EndReceive(size_t recv_size) {
     size_t next_frame_size =
         std::min(static_cast<size_t>(payload_size), capacity_);
     next_frame_size += kHeaderSize;
-    rd_ptr += kHeaderSize;
 
-    if (size_ < consumed_size + next_frame_size) {
+    if (size_ < frames_end_ + next_frame_size) {
       // Case B. We got the header but not the whole frame.
       if (next_frame_size > capacity_) {
         // The caller is expected to shut down the socket and give up at this
@@ -119,57 +119,95 @@ bool BufferedFrameDeserializer::EndReceive(size_t recv_size) {
     }
 
     // Case C. We got at least one header and whole frame.
-    DecodeFrame(rd_ptr, payload_size);
-    consumed_size += next_frame_size;
+    frames_end_ += next_frame_size;
   }
+  PERFETTO_DCHECK(frames_end_ <= size_);
+  return true;
+}
 
-  PERFETTO_DCHECK(consumed_size <= size_);
-  if (consumed_size > 0) {
-    // Shift out the consumed data from the buffer. In the typical case (C)
-    // there is nothing to shift really, just setting size_ = 0 is enough.
-    // Shifting is only for the (unlikely) case D.
-    size_ -= consumed_size;
-    if (size_ > 0) {
-      // Case D. We consumed some frames but there is a leftover at the end of
-      // the buffer. Shift out the consumed bytes, so that on the next round
-      // |buf_| starts with the header of the next unconsumed frame.
-      const char* move_begin = buf() + consumed_size;
-      PERFETTO_CHECK(move_begin > buf());
-      PERFETTO_CHECK(move_begin + size_ <= buf() + capacity_);
-      memmove(buf(), move_begin, size_);
-    }
-    // If we just finished decoding a large frame that used more than one page,
-    // release the extra memory in the buffer. Large frames should be quite
-    // rare.
-    if (consumed_size > page_size) {
-      size_t size_rounded_up = (size_ / page_size + 1) * page_size;
-      if (size_rounded_up < capacity_) {
-        char* madvise_begin = buf() + size_rounded_up;
-        const size_t madvise_size = capacity_ - size_rounded_up;
-        PERFETTO_CHECK(madvise_begin > buf() + size_);
-        PERFETTO_CHECK(madvise_begin + madvise_size <= buf() + capacity_);
-        buf_.AdviseDontNeed(madvise_begin, madvise_size);
-      }
+void BufferedFrameDeserializer::CompactBuffer() {
+  // Normally the caller pops all the frames after each EndReceive(). If it
+  // didn't, copy the frames left, as the memmove below would overwrite them.
+  for (protozero::ConstBytes frame = PopFrameFromBuffer(); frame.data;
+       frame = PopFrameFromBuffer()) {
+    saved_frames_.emplace_back(reinterpret_cast<const char*>(frame.data),
+                               frame.size);
+  }
+  PERFETTO_DCHECK(rd_offset_ == frames_end_);
+
+  const size_t consumed_size = frames_end_;
+  if (consumed_size == 0)
+    return;
+
+  // Shift out the consumed data from the buffer. In the typical case (C)
+  // there is nothing to shift really, just setting size_ = 0 is enough.
+  // Shifting is only for the (unlikely) case D.
+  size_ -= consumed_size;
+  rd_offset_ = frames_end_ = 0;
+  if (size_ > 0) {
+    // Case D. We consumed some frames but there is a leftover at the end of
+    // the buffer. Shift out the consumed bytes, so that |buf_| starts with the
+    // header of the next unconsumed frame.
+    const char* move_begin = buf() + consumed_size;
+    PERFETTO_CHECK(move_begin > buf());
+    PERFETTO_CHECK(move_begin + size_ <= buf() + capacity_);
+    memmove(buf(), move_begin, size_);
+  }
+  // If we just finished decoding a large frame that used more than one page,
+  // release the extra memory in the buffer. Large frames should be quite
+  // rare.
+  const auto page_size = base::GetSysPageSize();
+  if (consumed_size > page_size) {
+    size_t size_rounded_up = (size_ / page_size + 1) * page_size;
+    if (size_rounded_up < capacity_) {
+      char* madvise_begin = buf() + size_rounded_up;
+      const size_t madvise_size = capacity_ - size_rounded_up;
+      PERFETTO_CHECK(madvise_begin > buf() + size_);
+      PERFETTO_CHECK(madvise_begin + madvise_size <= buf() + capacity_);
+      buf_.AdviseDontNeed(madvise_begin, madvise_size);
     }
   }
   // At this point |size_| == 0 for case C, > 0 for cases A, B, D.
-  return true;
 }
 
 std::unique_ptr<Frame> BufferedFrameDeserializer::PopNextFrame() {
-  if (decoded_frames_.empty())
-    return nullptr;
-  std::unique_ptr<Frame> frame = std::move(decoded_frames_.front());
-  decoded_frames_.pop_front();
-  return frame;
+  for (;;) {
+    protozero::ConstBytes encoded_frame = PopNextEncodedFrame();
+    if (!encoded_frame.data)
+      return nullptr;
+    std::unique_ptr<Frame> frame(new Frame);
+    if (frame->ParseFromArray(encoded_frame.data, encoded_frame.size))
+      return frame;
+  }
 }
 
-void BufferedFrameDeserializer::DecodeFrame(const char* data, size_t size) {
-  if (size == 0)
-    return;
-  std::unique_ptr<Frame> frame(new Frame);
-  if (frame->ParseFromArray(data, size))
-    decoded_frames_.push_back(std::move(frame));
+protozero::ConstBytes BufferedFrameDeserializer::PopNextEncodedFrame() {
+  if (PERFETTO_UNLIKELY(!saved_frames_.empty())) {
+    popped_frame_ = std::move(saved_frames_.front());
+    saved_frames_.pop_front();
+    return protozero::ConstBytes{
+        reinterpret_cast<const uint8_t*>(popped_frame_.data()),
+        popped_frame_.size()};
+  }
+  return PopFrameFromBuffer();
+}
+
+protozero::ConstBytes BufferedFrameDeserializer::PopFrameFromBuffer() {
+  while (rd_offset_ < frames_end_) {
+    uint32_t payload_size = 0;
+    const char* rd_ptr = buf() + rd_offset_;
+    memcpy(base::AssumeLittleEndian(&payload_size), rd_ptr, kHeaderSize);
+    rd_offset_ += kHeaderSize + payload_size;
+    PERFETTO_DCHECK(rd_offset_ <= frames_end_);
+
+    // Frames with an empty payload are skipped.
+    if (payload_size > 0) {
+      return protozero::ConstBytes{
+          reinterpret_cast<const uint8_t*>(rd_ptr + kHeaderSize),
+          payload_size};
+    }
+  }
+  return protozero::ConstBytes{nullptr, 0};
 }
 
 // static
@@ -21,10 +21,12 @@
 
 #include <list>
 #include <memory>
+#include <string>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/basic_types.h"
+#include "perfetto/protozero/field.h"
 
 namespace perfetto {
 
@@ -69,10 +71,16 @@ using Frame = ::perfetto::protos::gen::IPCFrame;
 //   ... process |frame|
 // }
 //
+// Alternatively, PopNextEncodedFrame() returns the frames without decoding them
+// into a Frame object, so they can be decoded in place, e.g. with protozero.
+// Popping all the frames before the next BeginReceive() is cheaper: the frames
+// are kept in the receive buffer until then, at which point the ones not popped
+// are copied out, to make room for the next recv().
+//
 // Design goals:
 // -------------
 // - Optimize for the realistic case of each recv() receiving one or more
-//   whole frames. In this case no memmove is performed.
+//   whole frames. In this case no memmove nor copy is performed.
 // - Guarantee that frames lay in a virtually contiguous memory area.
 //   This allows to use the protobuf-lite deserialization API (scattered
 //   deserialization is supported only by libprotobuf-full).
@@ -109,19 +117,32 @@ class BufferedFrameDeserializer {
   bool EndReceive(size_t recv_size) PERFETTO_WARN_UNUSED_RESULT;
 
   // Decodes and returns the next decoded frame in the buffer if any, nullptr
-  // if no further frames have been decoded.
+  // if no further frames have been decoded. Frames that fail to decode are
+  // skipped.
   std::unique_ptr<Frame> PopNextFrame();
 
+  // Returns the proto-encoded bytes of the next frame, if any, without decoding
+  // them. Returns a ConstBytes with |data| == nullptr if there are no further
+  // frames. The bytes are valid until the next call to any other method of this
+  // class.
+  protozero::ConstBytes PopNextEncodedFrame();
+
   size_t capacity() const { return capacity_; }
-  size_t size() const { return size_; }
+
+  // The number of bytes received and not popped yet.
+  size_t size() const { return size_ - rd_offset_; }
 
  private:
   BufferedFrameDeserializer(const BufferedFrameDeserializer&) = delete;
   BufferedFrameDeserializer& operator=(const BufferedFrameDeserializer&) =
       delete;
 
-  // If a valid frame is decoded it is added to |decoded_frames_|.
-  void DecodeFrame(const char*, size_t);
+  // Shifts out the frames already popped from the buffer, moving the ones not
+  // popped yet into |saved_frames_|.
+  void CompactBuffer();
+
+  // Pops the next frame from |buf_|, ignoring |saved_frames_|.
+  protozero::ConstBytes PopFrameFromBuffer();
 
   char* buf() { return reinterpret_cast<char*>(buf_.Get()); }
 
@@ -132,7 +153,19 @@ class BufferedFrameDeserializer {
   // EndReceive()). This is always <= |capacity_|.
   size_t size_ = 0;
 
-  std::list<std::unique_ptr<Frame>> decoded_frames_;
+  // [|rd_offset_|, |frames_end_|) contains the complete frames (including
+  // their header) that have not been popped yet. [|frames_end_|, |size_|)
+  // contains the header and/or payload of the next, still incomplete, frame.
+  size_t rd_offset_ = 0;
+  size_t frames_end_ = 0;
+
+  // The payloads of the complete frames that were still in |buf_| when it was
+  // compacted by BeginReceive(). They are popped before the ones in |buf_|.
+  std::list<std::string> saved_frames_;
+
+  // The last frame popped from |saved_frames_|, which must outlive its
+  // PopNextEncodedFrame() call.
+  std::string popped_frame_;
 };
 
 }  // namespace ipc
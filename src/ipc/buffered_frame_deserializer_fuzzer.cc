@@ -32,6 +32,9 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
     memcpy(rbuf.data, data, chunk_size);
     if (!bfd.EndReceive(chunk_size))
       break;
+    // Frames are decoded only when popped.
+    while (bfd.PopNextFrame()) {
+    }
     write_offset += chunk_size;
   }
   return 0;
@@ -377,6 +377,68 @@ TEST(BufferedFrameDeserializerTest, FillCapacity) {
   }
 }
 
+// Tests that PopNextEncodedFrame() returns the frames in place, without
+// copying them out of the receive buffer.
+TEST(BufferedFrameDeserializerTest, EncodedFramesPointIntoReceiveBuffer) {
+  BufferedFrameDeserializer bfd;
+  std::vector<char> frame1 = GetSimpleFrame(100);
+  std::vector<char> frame2 = GetSimpleFrame(200);
+  BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+  CheckedMemcpy(rbuf, frame1);
+  CheckedMemcpy(rbuf, frame2, frame1.size());
+  ASSERT_TRUE(bfd.EndReceive(frame1.size() + frame2.size()));
+
+  protozero::ConstBytes encoded = bfd.PopNextEncodedFrame();
+  EXPECT_EQ(reinterpret_cast<const char*>(encoded.data),
+            rbuf.data + kHeaderSize);
+  EXPECT_EQ(encoded.size, frame1.size() - kHeaderSize);
+
+  encoded = bfd.PopNextEncodedFrame();
+  EXPECT_EQ(reinterpret_cast<const char*>(encoded.data),
+            rbuf.data + frame1.size() + kHeaderSize);
+  EXPECT_EQ(encoded.size, frame2.size() - kHeaderSize);
+
+  EXPECT_FALSE(bfd.PopNextEncodedFrame().data);
+  EXPECT_EQ(0u, bfd.size());
+}
+
+// Tests that the frames not popped before the next BeginReceive() are kept
+// when the receive buffer is compacted, also when mixing PopNextFrame() and
+// PopNextEncodedFrame().
+TEST(BufferedFrameDeserializerTest, FramesNotPoppedSurviveBeginReceive) {
+  BufferedFrameDeserializer bfd;
+  std::vector<char> frame1 = GetSimpleFrame(100);
+  std::vector<char> frame2 = GetSimpleFrame(50);
+  std::vector<char> frame3 = GetSimpleFrame(300);
+  std::vector<char> frame3_chunk1(frame3.begin(), frame3.begin() + 10);
+  std::vector<char> frame3_chunk2(frame3.begin() + 10, frame3.end());
+
+  BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+  CheckedMemcpy(rbuf, frame1);
+  CheckedMemcpy(rbuf, frame2, frame1.size());
+  CheckedMemcpy(rbuf, frame3_chunk1, frame1.size() + frame2.size());
+  ASSERT_TRUE(
+      bfd.EndReceive(frame1.size() + frame2.size() + frame3_chunk1.size()));
+
+  rbuf = bfd.BeginReceive();
+  CheckedMemcpy(rbuf, frame3_chunk2);
+  ASSERT_TRUE(bfd.EndReceive(frame3_chunk2.size()));
+
+  std::unique_ptr<Frame> decoded_frame = bfd.PopNextFrame();
+  ASSERT_TRUE(decoded_frame);
+  ASSERT_TRUE(FrameEq(frame1, *decoded_frame));
+
+  for (const auto& expected_frame : {frame2, frame3}) {
+    protozero::ConstBytes encoded = bfd.PopNextEncodedFrame();
+    ASSERT_TRUE(encoded.data);
+    ASSERT_EQ(encoded.size, expected_frame.size() - kHeaderSize);
+    EXPECT_EQ(0, memcmp(encoded.data, expected_frame.data() + kHeaderSize,
+                        encoded.size));
+  }
+  EXPECT_FALSE(bfd.PopNextEncodedFrame().data);
+  ASSERT_FALSE(bfd.PopNextFrame());
+}
+
 }  // namespace
 }  // namespace ipc
 }  // namespace perfetto
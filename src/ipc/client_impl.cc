@@ -39,6 +39,9 @@ namespace ipc {
 namespace {
 constexpr base::SockFamily kClientSockFamily =
     kUseTCPSocket ? base::SockFamily::kInet : base::SockFamily::kUnix;
+
+// Frames sent within a task are coalesced up to this size.
+constexpr size_t kMaxTxBatchSize = 64 * 1024;
 }  // namespace
 
 // static
@@ -69,6 +72,7 @@ ClientImpl::ClientImpl(ConnArgs conn_args, base::TaskRunner* task_runner)
 ClientImpl::~ClientImpl() {
   // Ensure we are not destroyed in the middle of invoking a reply.
   PERFETTO_DCHECK(!invoking_method_reply_);
+  FlushTxBuffer();
   OnDisconnect(
       nullptr);  // The base::UnixSocket* ptr is not used in OnDisconnect().
 }
@@ -139,9 +143,39 @@ RequestID ClientImpl::BeginInvoke(ServiceID service_id,
 }
 
 bool ClientImpl::SendFrame(const Frame& frame, int fd) {
+  if (!sock_->is_connected())
+    return false;
+
   // Serialize the frame into protobuf, add the size header, and send it.
   std::string buf = BufferedFrameDeserializer::Serialize(frame);
 
+  // Like in HostImpl::SendFrame(), the frames sent within the same task (e.g.
+  // the CommitData() and NotifyDataSourceStopped() of a producer stopping its
+  // data sources) are sent with a single Send() from a task posted after the
+  // first one. Frames with a FD are sent on their own.
+  if (fd == -1 && tx_buf_.size() + buf.size() <= kMaxTxBatchSize) {
+    if (tx_buf_.empty()) {
+      auto weak_this = weak_ptr_factory_.GetWeakPtr();
+      task_runner_->PostTask([weak_this] {
+        if (weak_this)
+          static_cast<ClientImpl&>(*weak_this).FlushTxBuffer();
+      });
+    }
+    tx_buf_.append(buf);
+    return true;
+  }
+  FlushTxBuffer();
+  return SendBuffer(buf, fd);
+}
+
+void ClientImpl::FlushTxBuffer() {
+  if (tx_buf_.empty())
+    return;
+  SendBuffer(tx_buf_, /*fd=*/-1);
+  tx_buf_.clear();
+}
+
+bool ClientImpl::SendBuffer(const std::string& buf, int fd) {
   // TODO(primiano): this should do non-blocking I/O. But then what if the
   // socket buffer is full? We might want to either drop the request or throttle
   // the send and PostTask the reply later? Right now we are making Send()
@@ -193,6 +227,7 @@ void ClientImpl::OnDisconnect(base::UnixSocket*) {
   }
   service_bindings_.clear();
   queued_bindings_.clear();
+  tx_buf_.clear();
 }
 
 void ClientImpl::OnDataAvailable(base::UnixSocket*) {
@@ -216,10 +251,12 @@ void ClientImpl::OnDataAvailable(base::UnixSocket*) {
       return sock_->Shutdown(true);  // In turn will trigger an OnDisconnect().
       // TODO(fmayer): check this.
     }
-  } while (rsize > 0);
 
-  while (std::unique_ptr<Frame> frame = frame_deserializer_.PopNextFrame())
-    OnFrameReceived(*frame);
+    // Pop the frames before the next BeginReceive(), which would otherwise
+    // have to copy them out of the receive buffer.
+    while (std::unique_ptr<Frame> frame = frame_deserializer_.PopNextFrame())
+      OnFrameReceived(*frame);
+  } while (rsize > 0);
 }
 
 void ClientImpl::OnFrameReceived(const Frame& frame) {
@@ -297,7 +334,10 @@ void ClientImpl::OnInvokeMethodReply(QueuedRequest req,
     // If this becomes a hotspot, optimize by maintaining a dedicated hashtable.
     for (const auto& method : service_proxy->GetDescriptor().methods) {
       if (req.method_name == method.name) {
-        decoded_reply = method.reply_proto_decoder(reply.reply_proto());
+        const std::string& reply_proto = reply.reply_proto();
+        decoded_reply = method.reply_proto_decoder(
+            reinterpret_cast<const uint8_t*>(reply_proto.data()),
+            reply_proto.size());
         break;
       }
     }
@@ -20,6 +20,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <string>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -85,6 +86,8 @@ class ClientImpl : public Client, public base::UnixSocket::EventListener {
 
   void TryConnect();
   bool SendFrame(const Frame&, int fd = -1);
+  void FlushTxBuffer();
+  bool SendBuffer(const std::string&, int fd);
   void OnFrameReceived(const Frame&);
   void OnBindServiceReply(QueuedRequest,
                           const protos::gen::IPCFrame_BindServiceReply&);
@@ -100,6 +103,10 @@ class ClientImpl : public Client, public base::UnixSocket::EventListener {
   RequestID last_request_id_ = 0;
   BufferedFrameDeserializer frame_deserializer_;
   base::ScopedFile received_fd_;
+
+  // The frames queued by SendFrame() during the current task, sent together
+  // by FlushTxBuffer().
+  std::string tx_buf_;
   std::map<RequestID, QueuedRequest> queued_requests_;
   std::map<ServiceID, base::WeakPtr<ServiceProxy>> service_bindings_;
 
@@ -25,6 +25,7 @@
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/service.h"
 #include "perfetto/ext/ipc/service_descriptor.h"
+#include "perfetto/protozero/proto_decoder.h"
 
 #include "protos/perfetto/ipc/wire_protocol.gen.h"
 
@@ -38,6 +39,9 @@ namespace {
 constexpr base::SockFamily kHostSockFamily =
     kUseTCPSocket ? base::SockFamily::kInet : base::SockFamily::kUnix;
 
+// Frames sent to the same client within a task are coalesced up to this size.
+constexpr size_t kMaxTxBatchSize = 64 * 1024;
+
 uid_t GetPosixPeerUid(base::UnixSocket* sock) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   base::ignore_result(sock);
@@ -135,26 +139,59 @@ void HostImpl::OnDataAvailable(base::UnixSocket* sock) {
     }
     if (!frame_deserializer.EndReceive(rsize))
       return OnDisconnect(client->sock.get());
-  } while (rsize > 0);
 
-  for (;;) {
-    std::unique_ptr<Frame> frame = frame_deserializer.PopNextFrame();
-    if (!frame)
-      break;
-    OnReceivedFrame(client, *frame);
-  }
+    // Handle the frames while they are still in the receive buffer, i.e.
+    // before the next BeginReceive().
+    for (;;) {
+      protozero::ConstBytes frame = frame_deserializer.PopNextEncodedFrame();
+      if (!frame.data)
+        break;
+      OnReceivedFrame(client, frame);
+    }
+  } while (rsize > 0);
 }
 
 void HostImpl::OnReceivedFrame(ClientConnection* client,
-                               const Frame& req_frame) {
-  if (req_frame.has_msg_bind_service())
-    return OnBindService(client, req_frame);
-  if (req_frame.has_msg_invoke_method())
-    return OnInvokeMethod(client, req_frame);
+                               protozero::ConstBytes encoded_frame) {
+  // The frame is decoded in place, rather than into a Frame object, because
+  // InvokeMethod frames (e.g. CommitData requests) are the hot path. Their
+  // arguments are decoded straight from the receive buffer.
+  protozero::ProtoDecoder decoder(encoded_frame.data, encoded_frame.size);
+  RequestID request_id = 0;
+  bool has_bind_service = false;
+  bool has_invoke_method = false;
+  protozero::ConstBytes invoke_method{nullptr, 0};
+  for (auto field = decoder.ReadField(); field.valid();
+       field = decoder.ReadField()) {
+    switch (field.id()) {
+      case Frame::kRequestIdFieldNumber:
+        request_id = field.as_uint64();
+        break;
+      case Frame::kMsgBindServiceFieldNumber:
+        has_bind_service = true;
+        break;
+      case Frame::kMsgInvokeMethodFieldNumber:
+        has_invoke_method = true;
+        invoke_method = field.as_bytes();
+        break;
+    }
+  }
+  if (decoder.bytes_left() != 0)
+    return;  // Drop malformed frames, like PopNextFrame() does.
+
+  if (has_bind_service) {
+    // Binding services is rare. Just decode the whole frame.
+    Frame req_frame;
+    if (req_frame.ParseFromArray(encoded_frame.data, encoded_frame.size))
+      OnBindService(client, req_frame);
+    return;
+  }
+  if (has_invoke_method)
+    return OnInvokeMethod(client, request_id, invoke_method);
 
   PERFETTO_DLOG("Received invalid RPC frame from client %" PRIu64, client->id);
   Frame reply_frame;
-  reply_frame.set_request_id(req_frame.request_id());
+  reply_frame.set_request_id(request_id);
   reply_frame.mutable_msg_request_error()->set_error("unknown request");
   SendFrame(client, reply_frame);
 }
@@ -181,26 +218,47 @@ void HostImpl::OnBindService(ClientConnection* client, const Frame& req_frame) {
 }
 
 void HostImpl::OnInvokeMethod(ClientConnection* client,
-                              const Frame& req_frame) {
-  const Frame::InvokeMethod& req = req_frame.msg_invoke_method();
+                              RequestID request_id,
+                              protozero::ConstBytes invoke_method) {
+  ServiceID service_id = 0;
+  MethodID method_id = 0;
+  protozero::ConstBytes args_proto{nullptr, 0};
+  bool drop_reply = false;
+  protozero::ProtoDecoder decoder(invoke_method.data, invoke_method.size);
+  for (auto field = decoder.ReadField(); field.valid();
+       field = decoder.ReadField()) {
+    switch (field.id()) {
+      case Frame::InvokeMethod::kServiceIdFieldNumber:
+        service_id = field.as_uint32();
+        break;
+      case Frame::InvokeMethod::kMethodIdFieldNumber:
+        method_id = field.as_uint32();
+        break;
+      case Frame::InvokeMethod::kArgsProtoFieldNumber:
+        args_proto = field.as_bytes();
+        break;
+      case Frame::InvokeMethod::kDropReplyFieldNumber:
+        drop_reply = field.as_bool();
+        break;
+    }
+  }
+
   Frame reply_frame;
-  RequestID request_id = req_frame.request_id();
   reply_frame.set_request_id(request_id);
   reply_frame.mutable_msg_invoke_method_reply()->set_success(false);
-  auto svc_it = services_.find(req.service_id());
+  auto svc_it = services_.find(service_id);
   if (svc_it == services_.end())
     return SendFrame(client, reply_frame);  // |success| == false by default.
 
   Service* service = svc_it->second.instance.get();
   const ServiceDescriptor& svc = service->GetDescriptor();
   const auto& methods = svc.methods;
-  const uint32_t method_id = req.method_id();
   if (method_id == 0 || method_id > methods.size())
     return SendFrame(client, reply_frame);
 
   const ServiceDescriptor::Method& method = methods[method_id - 1];
   std::unique_ptr<ProtoMessage> decoded_req_args(
-      method.request_proto_decoder(req.args_proto()));
+      method.request_proto_decoder(args_proto.data, args_proto.size));
   if (!decoded_req_args)
     return SendFrame(client, reply_frame);
 
@@ -208,7 +266,7 @@ void HostImpl::OnInvokeMethod(ClientConnection* client,
   base::WeakPtr<HostImpl> host_weak_ptr = weak_ptr_factory_.GetWeakPtr();
   ClientID client_id = client->id;
 
-  if (!req.drop_reply()) {
+  if (!drop_reply) {
     deferred_reply.Bind([host_weak_ptr, client_id,
                          request_id](AsyncResult<ProtoMessage> reply) {
       if (!host_weak_ptr)
@@ -250,10 +308,46 @@ void HostImpl::ReplyToMethodInvocation(ClientID client_id,
   SendFrame(client, reply_frame, reply.fd());
 }
 
-// static
 void HostImpl::SendFrame(ClientConnection* client, const Frame& frame, int fd) {
   std::string buf = BufferedFrameDeserializer::Serialize(frame);
 
+  // The frames sent to a client within the same task (e.g. the service sending
+  // a command to many data sources of the same producer, or streaming the
+  // replies of ReadBuffers()) are queued and sent with a single Send() from a
+  // task posted after the first one.
+  // A frame with a FD is instead sent on its own, after the queued frames: the
+  // receiver gets the FD together with all the bytes of the same message and
+  // has no way to tell to which of the frames it belongs.
+  if (fd == -1 && client->tx_buf.size() + buf.size() <= kMaxTxBatchSize) {
+    if (client->tx_buf.empty()) {
+      auto weak_this = weak_ptr_factory_.GetWeakPtr();
+      ClientID client_id = client->id;
+      task_runner_->PostTask([weak_this, client_id] {
+        if (!weak_this)
+          return;
+        auto it = weak_this->clients_.find(client_id);
+        if (it != weak_this->clients_.end())
+          weak_this->FlushTxBuffer(it->second.get());
+      });
+    }
+    client->tx_buf.append(buf);
+    return;
+  }
+  FlushTxBuffer(client);
+  SendBuffer(client, buf, fd);
+}
+
+void HostImpl::FlushTxBuffer(ClientConnection* client) {
+  if (client->tx_buf.empty())
+    return;
+  SendBuffer(client, client->tx_buf, /*fd=*/-1);
+  client->tx_buf.clear();
+}
+
+// static
+void HostImpl::SendBuffer(ClientConnection* client,
+                          const std::string& buf,
+                          int fd) {
   // When a new Client connects in OnNewClientConnection we set a timeout on
   // Send (see call to SetTxTimeout).
   //
@@ -307,7 +401,11 @@ HostImpl::ExposedService& HostImpl::ExposedService::operator=(
     HostImpl::ExposedService&&) = default;
 HostImpl::ExposedService::~ExposedService() = default;
 
-HostImpl::ClientConnection::~ClientConnection() = default;
+HostImpl::ClientConnection::~ClientConnection() {
+  // Don't drop the frames queued in the task that destroys the host.
+  if (!tx_buf.empty() && sock->is_connected())
+    sock->Send(tx_buf.data(), tx_buf.size());
+}
 
 }  // namespace ipc
 }  // namespace perfetto
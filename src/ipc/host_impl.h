@@ -27,6 +27,7 @@
 #include "perfetto/ext/base/unix_socket.h"
 #include "perfetto/ext/ipc/deferred.h"
 #include "perfetto/ext/ipc/host.h"
+#include "perfetto/protozero/field.h"
 #include "src/ipc/buffered_frame_deserializer.h"
 
 namespace perfetto {
@@ -57,6 +58,10 @@ class HostImpl : public Host, public base::UnixSocket::EventListener {
     std::unique_ptr<base::UnixSocket> sock;
     BufferedFrameDeserializer frame_deserializer;
     base::ScopedFile received_fd;
+
+    // The frames queued by SendFrame() during the current task, sent together
+    // by FlushTxBuffer().
+    std::string tx_buf;
   };
   struct ExposedService {
     ExposedService(ServiceID, const std::string&, std::unique_ptr<Service>);
@@ -73,13 +78,17 @@ class HostImpl : public Host, public base::UnixSocket::EventListener {
   HostImpl& operator=(const HostImpl&) = delete;
 
   bool Initialize(const char* socket_name);
-  void OnReceivedFrame(ClientConnection*, const Frame&);
+  void OnReceivedFrame(ClientConnection*, protozero::ConstBytes);
   void OnBindService(ClientConnection*, const Frame&);
-  void OnInvokeMethod(ClientConnection*, const Frame&);
+  void OnInvokeMethod(ClientConnection*,
+                      RequestID,
+                      protozero::ConstBytes invoke_method);
   void ReplyToMethodInvocation(ClientID, RequestID, AsyncResult<ProtoMessage>);
   const ExposedService* GetServiceByName(const std::string&);
 
-  static void SendFrame(ClientConnection*, const Frame&, int fd = -1);
+  void SendFrame(ClientConnection*, const Frame&, int fd = -1);
+  void FlushTxBuffer(ClientConnection*);
+  static void SendBuffer(ClientConnection*, const std::string&, int fd);
 
   base::TaskRunner* const task_runner_;
   std::map<ServiceID, ExposedService> services_;
@@ -59,10 +59,10 @@ class FakeService : public Service {
         static_cast<const RequestProto&>(req), &deferred_reply);
   }
 
-  static std::unique_ptr<ProtoMessage> RequestDecoder(
-      const std::string& proto) {
+  static std::unique_ptr<ProtoMessage> RequestDecoder(const uint8_t* data,
+                                                      size_t size) {
     std::unique_ptr<ProtoMessage> reply(new RequestProto());
-    EXPECT_TRUE(reply->ParseFromString(proto));
+    EXPECT_TRUE(reply->ParseFromArray(data, size));
     return reply;
   }
 
@@ -136,6 +136,8 @@ class FakeClient : public base::UnixSocket::EventListener {
     base::ScopedFile fd;
     size_t rsize = sock->Receive(buf.data, buf.size, &fd);
     ASSERT_TRUE(frame_deserializer_.EndReceive(rsize));
+    if (rsize > 0)
+      num_receives_++;
     if (fd)
       OnFileDescriptorReceived(*fd);
     while (std::unique_ptr<Frame> frame = frame_deserializer_.PopNextFrame()) {
@@ -144,13 +146,14 @@ class FakeClient : public base::UnixSocket::EventListener {
       if (frame->has_msg_bind_service_reply()) {
         if (frame->msg_bind_service_reply().success())
           last_bound_service_id_ = frame->msg_bind_service_reply().service_id();
-        return OnServiceBound(frame->msg_bind_service_reply());
+        OnServiceBound(frame->msg_bind_service_reply());
+      } else if (frame->has_msg_invoke_method_reply()) {
+        OnInvokeMethodReply(frame->msg_invoke_method_reply());
+      } else if (frame->has_msg_request_error()) {
+        OnRequestError();
+      } else {
+        FAIL() << "Unexpected frame received from host";
       }
-      if (frame->has_msg_invoke_method_reply())
-        return OnInvokeMethodReply(frame->msg_invoke_method_reply());
-      if (frame->has_msg_request_error())
-        return OnRequestError();
-      FAIL() << "Unexpected frame received from host";
     }
   }
 
@@ -163,6 +166,7 @@ class FakeClient : public base::UnixSocket::EventListener {
   std::unique_ptr<base::UnixSocket> sock_;
   std::map<uint64_t /* request_id */, int /* num_replies_received */> requests_;
   ServiceID last_bound_service_id_;
+  int num_receives_ = 0;
 };
 
 class HostImplTest : public ::testing::Test {
@@ -278,6 +282,44 @@ TEST_F(HostImplTest, InvokeMethod) {
   task_runner_->RunUntilCheckpoint("on_reply_received");
 }
 
+// Replies sent within the same task should reach the client with a single
+// message.
+TEST_F(HostImplTest, BatchRepliesSentInTheSameTask) {
+  FakeService* fake_service = new FakeService("FakeService");
+  ASSERT_TRUE(host_->ExposeService(std::unique_ptr<Service>(fake_service)));
+  auto on_bind = task_runner_->CreateCheckpoint("on_bind");
+  cli_->BindService("FakeService");
+  EXPECT_CALL(*cli_, OnServiceBound(_)).WillOnce(InvokeWithoutArgs(on_bind));
+  task_runner_->RunUntilCheckpoint("on_bind");
+
+  // The first invocation is replied only when the second one is received.
+  RequestProto req_args;
+  cli_->InvokeMethod(cli_->last_bound_service_id_, 1, req_args);
+  cli_->InvokeMethod(cli_->last_bound_service_id_, 1, req_args);
+  DeferredBase first_reply;
+  EXPECT_CALL(*fake_service, OnFakeMethod1(_, _))
+      .WillOnce(
+          Invoke([&first_reply](const RequestProto&, DeferredBase* reply) {
+            first_reply = std::move(*reply);
+          }))
+      .WillOnce(
+          Invoke([&first_reply](const RequestProto&, DeferredBase* reply) {
+            first_reply.Resolve(AsyncResult<ProtoMessage>(
+                std::unique_ptr<ProtoMessage>(new ReplyProto())));
+            reply->Resolve(AsyncResult<ProtoMessage>(
+                std::unique_ptr<ProtoMessage>(new ReplyProto())));
+          }));
+
+  const int num_receives = cli_->num_receives_;
+  auto on_replies_received =
+      task_runner_->CreateCheckpoint("on_replies_received");
+  EXPECT_CALL(*cli_, OnInvokeMethodReply(_))
+      .WillOnce(Return())
+      .WillOnce(InvokeWithoutArgs(on_replies_received));
+  task_runner_->RunUntilCheckpoint("on_replies_received");
+  EXPECT_EQ(num_receives + 1, cli_->num_receives_);
+}
+
 TEST_F(HostImplTest, InvokeMethodDropReply) {
   FakeService* fake_service = new FakeService("FakeService");
   ASSERT_TRUE(host_->ExposeService(std::unique_ptr<Service>(fake_service)));
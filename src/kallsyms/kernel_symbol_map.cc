@@ -28,6 +28,7 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <algorithm>
 #include <functional>
@@ -168,6 +169,68 @@ void Tokenize(const char* name, Lambda fn) {
   }
 }
 
+using IndexEntry = std::pair<uint32_t /*rel_addr*/, uint32_t /*offset*/>;
+
+// Fills |out| (1-based) with the |n| entries of |sorted| in Eytzinger order,
+// i.e. the breadth-first order of the implicit binary search tree that has
+// the children of node k in 2k and 2k + 1. |next| is the next entry of
+// |sorted| to place, the recursion visits the tree in-order.
+void EytzingerLayout(const IndexEntry* sorted,
+                     size_t n,
+                     size_t k,
+                     size_t* next,
+                     IndexEntry* out) {
+  if (k > n)
+    return;
+  EytzingerLayout(sorted, n, 2 * k, next, out);
+  out[k] = sorted[(*next)++];
+  EytzingerLayout(sorted, n, 2 * k + 1, next, out);
+}
+
+// Header of the blob written by KernelSymbolMap::Serialize(). It's followed
+// by the token buffer, the token index, the symbol buffer and the symbol
+// index, in this order. The blob never leaves the device that created it, so
+// it's stored in native endianness.
+struct SerializedHeader {
+  static constexpr uint32_t kMagic = 0x4d59534b;  // "KSYM".
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sym_index_sampling;
+  uint32_t token_index_sampling;
+  uint64_t base_addr;
+  uint64_t num_syms;
+  uint32_t num_tokens;
+  uint32_t token_buf_size;
+  uint32_t token_index_size;
+  uint32_t sym_buf_size;
+  uint32_t sym_index_size;
+  uint32_t reserved;
+};
+static_assert(sizeof(SerializedHeader) == 56, "SerializedHeader layout");
+
+template <typename T>
+void AppendVector(const std::vector<T>& v, std::string* out) {
+  out->append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+}
+
+// Reads |count| elements into |v|. Returns false if the blob is too short.
+template <typename T>
+bool ReadVector(const uint8_t** rdptr,
+                const uint8_t* end,
+                size_t count,
+                std::vector<T>* v) {
+  const size_t size = count * sizeof(T);
+  if (static_cast<size_t>(end - *rdptr) < size)
+    return false;
+  v->resize(count);
+  if (size)
+    memcpy(static_cast<void*>(v->data()), *rdptr, size);
+  *rdptr += size;
+  return true;
+}
+
 }  // namespace
 
 KernelSymbolMap::TokenTable::TokenTable() {
@@ -179,6 +242,9 @@ KernelSymbolMap::TokenTable::TokenTable() {
 }
 
 KernelSymbolMap::TokenTable::~TokenTable() = default;
+KernelSymbolMap::TokenTable::TokenTable(TokenTable&&) noexcept = default;
+KernelSymbolMap::TokenTable& KernelSymbolMap::TokenTable::operator=(
+    TokenTable&&) noexcept = default;
 
 // Adds a new token to the db. Does not dedupe identical token (with the
 // exception of the empty string). The caller has to deal with that.
@@ -360,6 +426,15 @@ size_t KernelSymbolMap::Parse(const std::string& kallsyms_path) {
 
   buf_.resize(static_cast<size_t>(wptr - buf_.data()));
   buf_.shrink_to_fit();
+
+  // Rearrange the (sorted) index in Eytzinger order for Lookup().
+  if (!index_.empty()) {
+    std::vector<IndexEntry> sorted(std::move(index_));
+    index_.clear();
+    index_.resize(sorted.size() + 1);
+    size_t next = 0;
+    EytzingerLayout(sorted.data(), sorted.size(), 1, &next, index_.data());
+  }
   base::MaybeReleaseAllocatorMemToOS();  // For Scudo, b/170217718.
 
   if (num_syms_ == 0) {
@@ -377,22 +452,99 @@ size_t KernelSymbolMap::Parse(const std::string& kallsyms_path) {
   return num_syms_;
 }
 
+std::string KernelSymbolMap::Serialize() const {
+  SerializedHeader hdr{};
+  hdr.magic = SerializedHeader::kMagic;
+  hdr.version = SerializedHeader::kVersion;
+  hdr.sym_index_sampling = static_cast<uint32_t>(kSymIndexSampling);
+  hdr.token_index_sampling = static_cast<uint32_t>(kTokenIndexSampling);
+  hdr.base_addr = base_addr_;
+  hdr.num_syms = num_syms_;
+  hdr.num_tokens = tokens_.num_tokens_;
+  hdr.token_buf_size = static_cast<uint32_t>(tokens_.buf_.size());
+  hdr.token_index_size = static_cast<uint32_t>(tokens_.index_.size());
+  hdr.sym_buf_size = static_cast<uint32_t>(buf_.size());
+  hdr.sym_index_size = static_cast<uint32_t>(index_.size());
+
+  std::string blob;
+  blob.reserve(sizeof(hdr) + size_bytes());
+  blob.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+  AppendVector(tokens_.buf_, &blob);
+  AppendVector(tokens_.index_, &blob);
+  AppendVector(buf_, &blob);
+  AppendVector(index_, &blob);
+  return blob;
+}
+
+bool KernelSymbolMap::Deserialize(const void* data, size_t size) {
+  const uint8_t* rdptr = static_cast<const uint8_t*>(data);
+  const uint8_t* const end = rdptr + size;
+
+  SerializedHeader hdr;
+  if (size < sizeof(hdr))
+    return false;
+  memcpy(&hdr, rdptr, sizeof(hdr));
+  rdptr += sizeof(hdr);
+  if (hdr.magic != SerializedHeader::kMagic ||
+      hdr.version != SerializedHeader::kVersion ||
+      hdr.sym_index_sampling != kSymIndexSampling ||
+      hdr.token_index_sampling != kTokenIndexSampling) {
+    return false;
+  }
+
+  KernelSymbolMap map;
+  map.base_addr_ = hdr.base_addr;
+  map.num_syms_ = static_cast<size_t>(hdr.num_syms);
+  map.tokens_.num_tokens_ = hdr.num_tokens;
+  bool ok =
+      ReadVector(&rdptr, end, hdr.token_buf_size, &map.tokens_.buf_) &&
+      ReadVector(&rdptr, end, hdr.token_index_size, &map.tokens_.index_) &&
+      ReadVector(&rdptr, end, hdr.sym_buf_size, &map.buf_) &&
+      ReadVector(&rdptr, end, hdr.sym_index_size, &map.index_) && rdptr == end;
+  if (!ok)
+    return false;
+
+  // Lookup() trusts the offsets in the indexes, check them once here.
+  if (map.tokens_.index_.size() !=
+      (map.tokens_.num_tokens_ + kTokenIndexSampling - 1) /
+          kTokenIndexSampling) {
+    return false;
+  }
+  for (uint32_t off : map.tokens_.index_) {
+    if (off >= map.tokens_.buf_.size())
+      return false;
+  }
+  for (size_t i = 1; i < map.index_.size(); i++) {
+    if (map.index_[i].second >= map.buf_.size())
+      return false;
+  }
+
+  *this = std::move(map);
+  return true;
+}
+
 std::string KernelSymbolMap::Lookup(uint64_t sym_addr) {
   if (index_.empty() || sym_addr < base_addr_)
     return "";
 
   // First find the highest symbol address <= sym_addr.
-  // Start with a binary search using the sparse index.
-
+  // Start with a binary search using the sparse index. Each step descends
+  // to the left (0) or right (1) child without branching on the comparison.
   const uint32_t sym_rel_addr = static_cast<uint32_t>(sym_addr - base_addr_);
-  auto it = std::upper_bound(index_.cbegin(), index_.cend(),
-                             std::make_pair(sym_rel_addr, 0u));
-  if (it != index_.cbegin())
-    --it;
+  const size_t index_size = index_.size() - 1;
+  size_t k = 1;
+  while (k <= index_size)
+    k = 2 * k + static_cast<size_t>(index_[k].first <= sym_rel_addr);
+
+  // The bits of |k| are the path taken. The last right turn happened at the
+  // last entry <= sym_rel_addr: drop the trailing left turns and that turn.
+  k >>= __builtin_ctzll(static_cast<unsigned long long>(k)) + 1;
+  if (k == 0)
+    return "";
 
   // Then continue with a linear scan (of at most kSymIndexSampling steps).
-  uint32_t addr = it->first;
-  uint32_t off = it->second;
+  uint32_t addr = index_[k].first;
+  uint32_t off = index_[k].second;
   const uint8_t* rdptr = &buf_[off];
   const uint8_t* const buf_end = &buf_[buf_.size()];
   bool parsing_addr = true;
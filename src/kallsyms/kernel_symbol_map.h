@@ -107,7 +107,9 @@ class StringView;
 // offset of one every kSymIndexSamplinig addresses.
 // The Lookup(ADDR) function operates as follows:
 // 1. Performs a logarithmic binary search in the symbols index, finding the
-//    offset of the closest addres <= ADDR.
+//    offset of the closest addres <= ADDR. The index is stored in Eytzinger
+//    (breadth-first) order, so the search is branch-free and the first
+//    levels of the implicit tree share the same cache lines.
 // 2. Skip over at most kSymIndexSamplinig until the symbol is found.
 // 3. For each token index, lookup the corresponding token string and
 //    concatenate them to build the symbol name.
@@ -131,6 +133,17 @@ class KernelSymbolMap {
   // if the passed |addr| is < min(addr)).
   std::string Lookup(uint64_t addr);
 
+  // Serializes the parsed tables (and their indexes) into a blob that can be
+  // restored by Deserialize() without re-parsing kallsyms. The blob contains
+  // raw kernel addresses and is valid only for the kernel and boot it was
+  // created on (see LazyKernelSymbolizer).
+  std::string Serialize() const;
+
+  // Restores the map from a blob created by Serialize(). Returns false and
+  // leaves the map empty if the blob is malformed or was created with
+  // different index samplings.
+  bool Deserialize(const void* data, size_t size);
+
   // Returns the numberr of valid symbols decoded.
   size_t num_syms() const { return num_syms_; }
 
@@ -147,6 +160,8 @@ class KernelSymbolMap {
     using TokenId = uint32_t;
     TokenTable();
     ~TokenTable();
+    TokenTable(TokenTable&&) noexcept;
+    TokenTable& operator=(TokenTable&&) noexcept;
     TokenId Add(const std::string&);
     base::StringView Lookup(TokenId);
     size_t size_bytes() const { return buf_.size() + index_.size() * 4; }
@@ -157,6 +172,8 @@ class KernelSymbolMap {
     }
 
    private:
+    friend class KernelSymbolMap;  // For Serialize() / Deserialize().
+
     TokenId num_tokens_ = 0;
 
     std::vector<char> buf_;  // Token buffer.
@@ -176,6 +193,9 @@ class KernelSymbolMap {
   // The key is (address - base_addr_), the value is the byte offset in |buf_|
   // where the symbol entry starts (i.e. the start of the varint that tells the
   // delta from the previous symbol).
+  // The entries are laid out as an implicit binary search tree in Eytzinger
+  // order: |index_[0]| is unused and the children of |index_[k]| are
+  // |index_[2k]| and |index_[2k + 1]|.
   std::vector<std::pair<uint32_t /*rel_addr*/, uint32_t /*offset*/>> index_;
 };
 
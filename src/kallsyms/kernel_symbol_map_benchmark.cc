@@ -14,6 +14,7 @@
 
 #include <random>
 #include <set>
+#include <string>
 #include <unordered_set>
 
 #include <benchmark/benchmark.h>
@@ -114,3 +115,42 @@ static void BM_KallSyms(benchmark::State& state) {
 }
 
 BENCHMARK(BM_KallSyms)->Apply(BenchmarkArgs);
+
+// Measures restoring the map from the blob that LazyKernelSymbolizer caches
+// on disk, compared to parsing kallsyms (see BM_KallSymsParse).
+static void BM_KallSymsDeserialize(benchmark::State& state) {
+  perfetto::KernelSymbolMap::kTokenIndexSampling = 4;
+  perfetto::KernelSymbolMap::kSymIndexSampling = 16;
+  const bool skip = IsBenchmarkFunctionalOnly();
+  std::string blob;
+  if (!skip) {
+    perfetto::KernelSymbolMap kallsyms;
+    kallsyms.Parse(perfetto::base::GetTestDataPath("test/data/kallsyms.txt"));
+    blob = kallsyms.Serialize();
+  }
+
+  for (auto _ : state) {
+    perfetto::KernelSymbolMap kallsyms;
+    PERFETTO_CHECK(skip || kallsyms.Deserialize(blob.data(), blob.size()));
+    benchmark::DoNotOptimize(kallsyms.num_syms());
+  }
+  state.counters["blob"] = static_cast<double>(blob.size());
+}
+
+static void BM_KallSymsParse(benchmark::State& state) {
+  perfetto::KernelSymbolMap::kTokenIndexSampling = 4;
+  perfetto::KernelSymbolMap::kSymIndexSampling = 16;
+  const bool skip = IsBenchmarkFunctionalOnly();
+  const std::string path =
+      perfetto::base::GetTestDataPath("test/data/kallsyms.txt");
+
+  for (auto _ : state) {
+    perfetto::KernelSymbolMap kallsyms;
+    if (!skip)
+      kallsyms.Parse(path);
+    benchmark::DoNotOptimize(kallsyms.num_syms());
+  }
+}
+
+BENCHMARK(BM_KallSymsDeserialize);
+BENCHMARK(BM_KallSymsParse);
@@ -161,5 +161,42 @@ TEST(KernelSymbolMapTest, GoldenTest) {
   }
 }
 
+TEST(KernelSymbolMapTest, SerializeAndDeserialize) {
+  base::TempFile tmp = base::TempFile::Create();
+  static const char kContents[] = R"(ffffff8f73e2fa10 t one
+ffffff8f73e2fa20 t two_
+ffffff8f73e2fa30 t _three
+ffffff8f73e2fa40 t _fo_ur_
+ffffff8f73e2fa50 t five
+)";
+  base::WriteAll(tmp.fd(), kContents, sizeof(kContents));
+  base::FlushFile(tmp.fd());
+
+  KernelSymbolMap kallsyms;
+  kallsyms.Parse(tmp.path().c_str());
+  ASSERT_EQ(kallsyms.num_syms(), 5u);
+  const std::string blob = kallsyms.Serialize();
+
+  KernelSymbolMap restored;
+  ASSERT_TRUE(restored.Deserialize(blob.data(), blob.size()));
+  EXPECT_EQ(restored.num_syms(), 5u);
+  EXPECT_EQ(restored.size_bytes(), kallsyms.size_bytes());
+  EXPECT_EQ(restored.Lookup(0xffffff8f73e2fa00ULL), "");
+  EXPECT_EQ(restored.Lookup(0xffffff8f73e2fa10ULL), "one");
+  EXPECT_EQ(restored.Lookup(0xffffff8f73e2fa2fULL), "two_");
+  EXPECT_EQ(restored.Lookup(0xffffff8f73e2fa30ULL), "_three");
+  EXPECT_EQ(restored.Lookup(0xffffff8f73e2fa41ULL), "_fo_ur_");
+  EXPECT_EQ(restored.Lookup(0xffffff8f73e2fa50ULL), "five");
+
+  // Truncated or corrupted blobs are rejected.
+  KernelSymbolMap truncated;
+  EXPECT_FALSE(truncated.Deserialize(blob.data(), blob.size() - 1));
+  EXPECT_EQ(truncated.num_syms(), 0u);
+  EXPECT_EQ(truncated.Lookup(0xffffff8f73e2fa10ULL), "");
+  std::string corrupted = blob;
+  corrupted[0] = static_cast<char>(corrupted[0] ^ 0x55);
+  EXPECT_FALSE(truncated.Deserialize(corrupted.data(), corrupted.size()));
+}
+
 }  // namespace
 }  // namespace perfetto
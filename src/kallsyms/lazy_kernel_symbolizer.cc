@@ -18,12 +18,16 @@
 
 #include <string>
 
+#include <fcntl.h>
+#include <stdio.h>
 #include <unistd.h>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/compiler.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/kallsyms/kernel_symbol_map.h"
 
@@ -38,6 +42,29 @@ namespace {
 const char kKallsymsPath[] = "/proc/kallsyms";
 const char kPtrRestrictPath[] = "/proc/sys/kernel/kptr_restrict";
 const char kLowerPtrRestrictAndroidProp[] = "security.lower_kptr_restrict";
+const char kBootIdPath[] = "/proc/sys/kernel/random/boot_id";
+const char kModulesPath[] = "/proc/modules";
+
+// Returns the key that identifies the kallsyms of the running kernel for the
+// symbol map cache, or an empty string if it can't be determined.
+// kallsyms changes on every boot (KASLR) and whenever a module is loaded or
+// unloaded. The boot id captures the former, the names and sizes of the
+// loaded modules the latter (the other columns of /proc/modules are either
+// refcounts or addresses that might be masked).
+std::string GetCacheKey() {
+  std::string boot_id;
+  if (!base::ReadFile(kBootIdPath, &boot_id) || boot_id.empty())
+    return "";
+  std::string modules;
+  base::ReadFile(kModulesPath, &modules);
+  base::Hash hasher;
+  for (base::StringSplitter lines(std::move(modules), '\n'); lines.Next();) {
+    base::StringSplitter cols(&lines, ' ');
+    for (int i = 0; i < 2 && cols.Next(); i++)
+      hasher.Update(cols.cur_token(), cols.cur_token_size());
+  }
+  return boot_id + std::to_string(hasher.digest());
+}
 
 // This class takes care of temporarily lowering kptr_restrict and putting it
 // back to the original value if necessary. It solves the following problem:
@@ -150,19 +177,74 @@ LazyKernelSymbolizer::LazyKernelSymbolizer() = default;
 LazyKernelSymbolizer::~LazyKernelSymbolizer() = default;
 
 KernelSymbolMap* LazyKernelSymbolizer::GetOrCreateKernelSymbolMap() {
-  PERFETTO_DCHECK_THREAD(thread_checker_);
+  // Getting an existing map is allowed on other threads (see the header).
   if (symbol_map_)
     return symbol_map_.get();
 
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+
   symbol_map_.reset(new KernelSymbolMap());
 
-  // If kptr_restrict is set, try temporarily lifting it (it works only if
-  // traced_probes is run as a privileged user).
-  ScopedKptrUnrestrict kptr_unrestrict;
-  symbol_map_->Parse(kKallsymsPath);
+  const std::string cache_key = cache_path_.empty() ? "" : GetCacheKey();
+  if (!cache_key.empty() && LoadFromCache(cache_key))
+    return symbol_map_.get();
+
+  {
+    // If kptr_restrict is set, try temporarily lifting it (it works only if
+    // traced_probes is run as a privileged user).
+    ScopedKptrUnrestrict kptr_unrestrict;
+    symbol_map_->Parse(kKallsymsPath);
+  }
+
+  if (!cache_key.empty() && symbol_map_->num_syms() > 0)
+    WriteCache(cache_key);
   return symbol_map_.get();
 }
 
+// The cache file contains the key, a NUL terminator and the serialized map.
+bool LazyKernelSymbolizer::LoadFromCache(const std::string& key) {
+  std::string contents;
+  if (!base::ReadFile(cache_path_, &contents))
+    return false;
+  if (contents.size() <= key.size() ||
+      contents.compare(0, key.size(), key) != 0 ||
+      contents[key.size()] != '\0') {
+    PERFETTO_DLOG("Ignoring stale kallsyms cache %s", cache_path_.c_str());
+    return false;
+  }
+  const size_t blob_off = key.size() + 1;
+  if (!symbol_map_->Deserialize(contents.data() + blob_off,
+                                contents.size() - blob_off)) {
+    PERFETTO_ELOG("Failed to restore kallsyms from %s", cache_path_.c_str());
+    return false;
+  }
+  PERFETTO_DLOG("Restored %zu kallsyms entries from %s",
+                symbol_map_->num_syms(), cache_path_.c_str());
+  return true;
+}
+
+void LazyKernelSymbolizer::WriteCache(const std::string& key) {
+  // Write to a temporary file and rename it, so a concurrent or interrupted
+  // write never leaves a truncated cache behind.
+  const std::string tmp_path = cache_path_ + ".tmp";
+  base::ScopedFile fd =
+      base::OpenFile(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (!fd) {
+    PERFETTO_PLOG("Failed to create %s", tmp_path.c_str());
+    return;
+  }
+  const std::string blob = symbol_map_->Serialize();
+  bool ok = base::WriteAll(*fd, key.c_str(), key.size() + 1) ==
+                static_cast<ssize_t>(key.size() + 1) &&
+            base::WriteAll(*fd, blob.data(), blob.size()) ==
+                static_cast<ssize_t>(blob.size());
+  fd.reset();
+  if (!ok || rename(tmp_path.c_str(), cache_path_.c_str()) != 0) {
+    PERFETTO_PLOG("Failed to write %s", cache_path_.c_str());
+    unlink(tmp_path.c_str());
+  }
+}
+
 void LazyKernelSymbolizer::Destroy() {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   symbol_map_.reset();
@@ -18,6 +18,7 @@
 #define SRC_KALLSYMS_LAZY_KERNEL_SYMBOLIZER_H_
 
 #include <memory>
+#include <string>
 
 #include "perfetto/ext/base/thread_checker.h"
 
@@ -44,10 +45,22 @@ class LazyKernelSymbolizer {
   ~LazyKernelSymbolizer();
 
   // Returns |instance_|, creating it if doesn't exist or was destroyed.
+  // Creating the map must happen on the thread which owns this object. Once
+  // created, other threads can get and look up the map too, as long as it
+  // isn't destroyed concurrently (FtraceController's reader threads).
   KernelSymbolMap* GetOrCreateKernelSymbolMap();
 
   bool is_valid() const { return !!symbol_map_; }
 
+  // Sets the path of a file where the parsed map is persisted. When set,
+  // GetOrCreateKernelSymbolMap() restores the map from it, if the file was
+  // written during the current boot with the same set of kernel modules, and
+  // writes it after parsing kallsyms otherwise. Empty (the default) disables
+  // the cache. The file contains unmasked kernel addresses: it's created with
+  // 0600 permissions and should be placed in a directory private to the
+  // process.
+  void set_cache_path(const std::string& path) { cache_path_ = path; }
+
   // Destroys the |symbol_map_| freeing up memory. A further call to
   // GetOrCreateKernelSymbolMap() will create it again.
   void Destroy();
@@ -57,7 +70,11 @@ class LazyKernelSymbolizer {
       const char* ksyms_path_for_testing = nullptr);
 
  private:
+  bool LoadFromCache(const std::string& key);
+  void WriteCache(const std::string& key);
+
   std::unique_ptr<KernelSymbolMap> symbol_map_;
+  std::string cache_path_;
   PERFETTO_THREAD_CHECKER(thread_checker_)
 };
 
@@ -16,9 +16,11 @@
 
 #include "src/perfetto_cmd/packet_writer.h"
 
+#include <algorithm>
 #include <array>
 
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sys/stat.h>
@@ -30,6 +32,11 @@
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/protozero/proto_utils.h"
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 #include <zlib.h>
 #endif
@@ -78,9 +85,16 @@ class FilePacketWriter : public PacketWriter {
  public:
   FilePacketWriter(FILE* fd);
   ~FilePacketWriter() override;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  bool WritePackets(const std::vector<TracePacket>& packets) override;
+#endif
   bool WritePacket(const TracePacket& packet) override;
 
  private:
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  bool WriteIovecs(struct iovec* iovecs, size_t num_iovecs);
+#endif
+
   FILE* fd_;
 };
 
@@ -105,6 +119,60 @@ bool FilePacketWriter::WritePacket(const TracePacket& packet) {
   return true;
 }
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+// Writes the whole batch with a few writev() calls rather than one fwrite()
+// per slice, skipping the copy into the stdio buffer.
+bool FilePacketWriter::WritePackets(const std::vector<TracePacket>& packets) {
+  size_t max_iovecs = 0;
+  for (const TracePacket& packet : packets)
+    max_iovecs += packet.slices().size() + 1;
+
+  std::vector<Preamble> preambles(packets.size());
+  std::vector<struct iovec> iovecs;
+  iovecs.reserve(max_iovecs);
+  for (size_t i = 0; i < packets.size(); i++) {
+    const TracePacket& packet = packets[i];
+    size_t size = GetPreamble<kPacketId>(packet.size(), &preambles[i]);
+    iovecs.push_back({preambles[i].data(), size});
+    for (const Slice& slice : packet.slices()) {
+      // struct iovec takes a non-const ptr because it's the same struct used
+      // by readv(), but writev() doesn't change the data.
+      iovecs.push_back({const_cast<void*>(slice.start), slice.size});
+    }
+  }
+
+  // Anything written through WritePacket() must hit the file first.
+  if (fflush(fd_) != 0)
+    return false;
+  return WriteIovecs(iovecs.data(), iovecs.size());
+}
+
+bool FilePacketWriter::WriteIovecs(struct iovec* iovecs, size_t num_iovecs) {
+  int fd = fileno(fd_);
+  constexpr size_t kIOVMax = IOV_MAX;
+  size_t i = 0;
+  while (i < num_iovecs) {
+    int batch_size = static_cast<int>(std::min(num_iovecs - i, kIOVMax));
+    ssize_t wr_size = PERFETTO_EINTR(writev(fd, &iovecs[i], batch_size));
+    if (wr_size <= 0)
+      return false;
+
+    // Skip whatever was written, which for pipes might be a partial batch
+    // ending in the middle of an iovec.
+    size_t written = static_cast<size_t>(wr_size);
+    while (i < num_iovecs && written >= iovecs[i].iov_len) {
+      written -= iovecs[i].iov_len;
+      i++;
+    }
+    if (written > 0) {
+      iovecs[i].iov_base = static_cast<char*>(iovecs[i].iov_base) + written;
+      iovecs[i].iov_len -= written;
+    }
+  }
+  return true;
+}
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
 class ZipPacketWriter : public PacketWriter {
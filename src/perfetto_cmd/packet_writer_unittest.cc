@@ -117,6 +117,40 @@ TEST(PacketWriterTest, FilePacketWriter) {
   EXPECT_EQ(trace.packet()[0].for_testing().str(), "abc");
 }
 
+TEST(PacketWriterTest, FilePacketWriter_ManyPackets) {
+  base::TempFile tmp = base::TempFile::CreateUnlinked();
+  base::ScopedResource<FILE*, fclose, nullptr> f(
+      fdopen(tmp.ReleaseFD().release(), "wb"));
+
+  // More slices than a single writev() can take.
+  std::vector<perfetto::TracePacket> packets;
+  for (size_t i = 0; i < 3000; i++) {
+    packets.push_back(CreateTracePacket([i](TracePacketProto* msg) {
+      msg->mutable_for_testing()->set_str(std::to_string(i));
+    }));
+  }
+
+  {
+    std::unique_ptr<PacketWriter> writer = CreateFilePacketWriter(*f);
+    TracePacket first = CreateTracePacket([](TracePacketProto* msg) {
+      msg->mutable_for_testing()->set_str("first");
+    });
+    EXPECT_TRUE(writer->WritePacket(first));
+    EXPECT_TRUE(writer->WritePackets(std::move(packets)));
+  }
+
+  fseek(*f, 0, SEEK_SET);
+  std::string s;
+  EXPECT_TRUE(base::ReadFileStream(*f, &s));
+
+  protos::gen::Trace trace;
+  EXPECT_TRUE(trace.ParseFromString(s));
+  ASSERT_EQ(trace.packet().size(), 3001u);
+  EXPECT_EQ(trace.packet()[0].for_testing().str(), "first");
+  for (size_t i = 0; i < 3000; i++)
+    EXPECT_EQ(trace.packet()[i + 1].for_testing().str(), std::to_string(i));
+}
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
 TEST(PacketWriterTest, ZipPacketWriter) {
@@ -691,17 +691,15 @@ int PerfettoCmd::Main(int argc, char** argv) {
     return 1;  // We can legitimately get here if the service disconnects.
   }
 
+  // When tracing directly to file the packets are compressed by the service.
   if (trace_config_->compression_type() ==
-      TraceConfig::COMPRESSION_TYPE_DEFLATE) {
-    if (packet_writer_) {
+          TraceConfig::COMPRESSION_TYPE_DEFLATE &&
+      packet_writer_) {
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
-      packet_writer_ = CreateZipPacketWriter(std::move(packet_writer_));
+    packet_writer_ = CreateZipPacketWriter(std::move(packet_writer_));
 #else
-      PERFETTO_ELOG("Cannot compress. Zlib not enabled in the build config");
+    PERFETTO_ELOG("Cannot compress. Zlib not enabled in the build config");
 #endif
-    } else {
-      PERFETTO_ELOG("Cannot compress when tracing directly to file.");
-    }
   }
 
   RateLimiter::Args args{};
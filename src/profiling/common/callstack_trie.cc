@@ -16,6 +16,10 @@
 
 #include "src/profiling/common/callstack_trie.h"
 
+#include <stdint.h>
+
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include "perfetto/ext/base/string_splitter.h"
@@ -27,13 +31,23 @@ namespace profiling {
 
 GlobalCallstackTrie::Node* GlobalCallstackTrie::GetOrCreateChild(
     Node* self,
-    const Interned<Frame>& loc) {
+    const Interned<Frame>& loc,
+    bool take_reference) {
+  std::lock_guard<std::mutex> lock(ChildrenLock(self));
   Node* child = self->GetChild(loc);
   if (!child)
     child = self->AddChild(loc, ++next_callstack_id_, self);
+  if (take_reference)
+    child->ref_count_.fetch_add(1, std::memory_order_relaxed);
   return child;
 }
 
+std::mutex& GlobalCallstackTrie::ChildrenLock(const Node* node) {
+  // Nodes are heap allocated, the lowest bits are the same for all of them.
+  uintptr_t addr = reinterpret_cast<uintptr_t>(node);
+  return children_locks_[(addr >> 4) % kChildrenLockShards];
+}
+
 std::vector<Interned<Frame>> GlobalCallstackTrie::BuildInverseCallstack(
     const Node* node) const {
   std::vector<Interned<Frame>> res;
@@ -57,7 +71,8 @@ GlobalCallstackTrie::Node* GlobalCallstackTrie::CreateCallsite(
        ++callstack_it, ++build_id_it) {
     const unwindstack::FrameData& loc = *callstack_it;
     const std::string& build_id = *build_id_it;
-    node = GetOrCreateChild(node, InternCodeLocation(loc, build_id));
+    node = GetOrCreateChild(node, InternCodeLocation(loc, build_id),
+                            /*take_reference=*/false);
   }
   return node;
 }
@@ -69,14 +84,27 @@ GlobalCallstackTrie::Node* GlobalCallstackTrie::CreateCallsite(
   // emit as bottom first.
   for (auto it = callstack.crbegin(); it != callstack.crend(); ++it) {
     const Interned<Frame>& loc = *it;
-    node = GetOrCreateChild(node, loc);
+    node = GetOrCreateChild(node, loc, /*take_reference=*/false);
+  }
+  return node;
+}
+
+GlobalCallstackTrie::Node* GlobalCallstackTrie::CreateReferencedCallsite(
+    const std::vector<Interned<Frame>>& callstack) {
+  // Each node is referenced before moving on to its child, so that the path
+  // cannot be deleted by a concurrent DecrementNode while it is walked.
+  root_.ref_count_.fetch_add(1, std::memory_order_relaxed);
+  Node* node = &root_;
+  for (auto it = callstack.crbegin(); it != callstack.crend(); ++it) {
+    const Interned<Frame>& loc = *it;
+    node = GetOrCreateChild(node, loc, /*take_reference=*/true);
   }
   return node;
 }
 
 void GlobalCallstackTrie::IncrementNode(Node* node) {
   while (node != nullptr) {
-    node->ref_count_ += 1;
+    node->ref_count_.fetch_add(1, std::memory_order_relaxed);
     node = node->parent_;
   }
 }
@@ -84,16 +112,23 @@ void GlobalCallstackTrie::IncrementNode(Node* node) {
 void GlobalCallstackTrie::DecrementNode(Node* node) {
   PERFETTO_DCHECK(node->ref_count_ >= 1);
 
-  bool delete_prev = false;
-  Node* prev = nullptr;
-  while (node != nullptr) {
-    if (delete_prev)
-      node->RemoveChild(prev);
-    node->ref_count_ -= 1;
-    delete_prev = node->ref_count_ == 0;
-    prev = node;
-    node = node->parent_;
+  while (node->parent_ != nullptr) {
+    Node* parent = node->parent_;
+    uint64_t ref_count = node->ref_count_.load(std::memory_order_relaxed);
+    while (ref_count > 1 &&
+           !node->ref_count_.compare_exchange_weak(ref_count, ref_count - 1)) {
+    }
+    if (ref_count <= 1) {
+      // Dropping the last reference is serialized with GetOrCreateChild,
+      // which can take a new one, by the children lock of the parent.
+      std::lock_guard<std::mutex> lock(ChildrenLock(parent));
+      if (--node->ref_count_ == 0)
+        parent->RemoveChild(node);
+    }
+    node = parent;
   }
+  // The root is never deleted.
+  node->ref_count_--;
 }
 
 Interned<Frame> GlobalCallstackTrie::InternCodeLocation(
@@ -128,25 +163,21 @@ GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::AddChild(
     const Interned<Frame>& loc,
     uint64_t callstack_id,
     Node* parent) {
-  auto it = children_.emplace(loc, callstack_id, parent);
-  return const_cast<Node*>(&(*it.first));
+  auto it = children_.emplace(std::piecewise_construct,
+                              std::forward_as_tuple(loc),
+                              std::forward_as_tuple(loc, callstack_id, parent));
+  return &it.first->second;
 }
 void GlobalCallstackTrie::Node::RemoveChild(Node* node) {
-  children_.erase(*node);
+  children_.erase(node->location_);
 }
 
 GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
     const Interned<Frame>& loc) {
-  // This will be nicer with C++14 transparent comparators.
-  // Then we will be able to look up by just the key using a sutiable
-  // comparator.
-  //
-  // For now we need to allow to construct Node from the key.
-  Node node(loc);
-  auto it = children_.find(node);
+  auto it = children_.find(loc);
   if (it == children_.end())
     return nullptr;
-  return const_cast<Node*>(&(*it));
+  return &it->second;
 }
 
 }  // namespace profiling
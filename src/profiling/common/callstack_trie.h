@@ -17,7 +17,10 @@
 #ifndef SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 #define SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 
-#include <set>
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <string>
 #include <typeindex>
 #include <vector>
@@ -95,6 +98,12 @@ struct Frame {
 //                   libc_init
 //                       |
 //                    [root_]
+//
+// The trie can be used from multiple threads: the children of each node are
+// guarded by one of a fixed set of sharded locks, chosen by the address of the
+// node, so that concurrent insertions into different parts of the trie rarely
+// contend. Callers that use the trie concurrently with DecrementNode must
+// hold a reference to the nodes they use, see CreateReferencedCallsite.
 class GlobalCallstackTrie {
  public:
   // Optionally, Nodes can be externally refcounted via |IncrementNode| and
@@ -105,11 +114,6 @@ class GlobalCallstackTrie {
     // This is opaque except to GlobalCallstackTrie.
     friend class GlobalCallstackTrie;
 
-    // Allow building a node out of a frame for GetChild.
-    explicit Node(Interned<Frame> frame) : Node(frame, 0, nullptr) {}
-    Node(const Node&) = default;
-    Node(Node&&) = default;
-
     Node(Interned<Frame> frame, uint64_t id)
         : Node(std::move(frame), id, nullptr) {}
     Node(Interned<Frame> frame, uint64_t id, Node* parent)
@@ -124,24 +128,21 @@ class GlobalCallstackTrie {
     // Deletes all descendant nodes, regardless of |ref_count_|.
     void DeleteChildren() { children_.clear(); }
 
-    uint64_t ref_count_ = 0;
+    // Only drops to zero with the children lock of |parent_| held.
+    std::atomic<uint64_t> ref_count_{0};
     uint64_t id_;
     Node* const parent_;
     const Interned<Frame> location_;
 
-    class NodeComparator {
-     public:
-      bool operator()(const Node& one, const Node& other) const {
-        return one.location_ < other.location_;
-      }
-    };
     Node* AddChild(const Interned<Frame>& loc,
                    uint64_t next_callstack_id_,
                    Node* parent);
     void RemoveChild(Node* node);
     Node* GetChild(const Interned<Frame>& loc);
 
-    std::set<Node, NodeComparator> children_;
+    // Keyed by the location of the child, so that it can be looked up without
+    // copying the Interned<Frame>.
+    std::map<Interned<Frame>, Node> children_;
   };
 
   GlobalCallstackTrie() = default;
@@ -156,25 +157,42 @@ class GlobalCallstackTrie {
   Interned<Frame> InternCodeLocation(const unwindstack::FrameData& loc,
                                      const std::string& build_id);
 
+  // Returns the node for |callstack|, creating it if needed. Can be called
+  // concurrently with other CreateCallsite or CreateReferencedCallsite calls,
+  // but not with DecrementNode, as the nodes it walks are not referenced.
   Node* CreateCallsite(const std::vector<unwindstack::FrameData>& callstack,
                        const std::vector<std::string>& build_ids);
   Node* CreateCallsite(const std::vector<Interned<Frame>>& callstack);
 
+  // Same as CreateCallsite, but the returned node holds a reference owned by
+  // the caller, to be released with DecrementNode. The references are taken
+  // atomically with the lookups, so this is safe to call concurrently with
+  // DecrementNode.
+  Node* CreateReferencedCallsite(const std::vector<Interned<Frame>>& callstack);
+
+  // |node| must be referenced by the caller, or the trie not be used
+  // concurrently.
   static void IncrementNode(Node* node);
-  static void DecrementNode(Node* node);
+  void DecrementNode(Node* node);
 
   std::vector<Interned<Frame>> BuildInverseCallstack(const Node* node) const;
 
   // Purges all interned callstacks (and the associated internings), without
   // restarting any interning sequences. Incompatible with external refcounting
-  // of nodes (Node.ref_count_).
+  // of nodes (Node.ref_count_), and with concurrent use of the trie.
   void ClearTrie() {
     PERFETTO_DLOG("Clearing trie");
     root_.DeleteChildren();
   }
 
  private:
-  Node* GetOrCreateChild(Node* self, const Interned<Frame>& loc);
+  static constexpr size_t kChildrenLockShards = 64;
+
+  // Returns the child of |self| for |loc|, creating it if needed.
+  Node* GetOrCreateChild(Node* self,
+                         const Interned<Frame>& loc,
+                         bool take_reference);
+  std::mutex& ChildrenLock(const Node* node);
 
   Interned<Frame> MakeRootFrame();
 
@@ -182,7 +200,8 @@ class GlobalCallstackTrie {
   Interner<Mapping> mapping_interner_;
   Interner<Frame> frame_interner_;
 
-  uint64_t next_callstack_id_ = 0;
+  std::array<std::mutex, kChildrenLockShards> children_locks_;
+  std::atomic<uint64_t> next_callstack_id_{0};
 
   Node root_{MakeRootFrame(), ++next_callstack_id_};
 };
@@ -19,7 +19,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <atomic>
 #include <functional>
+#include <mutex>
 #include <unordered_set>
 
 #include "perfetto/base/logging.h"
@@ -30,6 +32,9 @@ namespace profiling {
 using InternID = uint32_t;
 
 // Interner that hands out refcounted references.
+//
+// Thread-safe: Interned references can be created, copied and destroyed
+// concurrently from different threads.
 template <typename T>
 class Interner {
  private:
@@ -37,6 +42,11 @@ class Interner {
     template <typename... U>
     Entry(Interner<T>* in, InternID i, U... args)
         : data(std::forward<U...>(args...)), id(i), interner(in) {}
+    Entry(Entry&& other)
+        : data(std::move(other.data)),
+          id(other.id),
+          ref_count(other.ref_count.load()),
+          interner(other.interner) {}
 
     bool operator<(const Entry& other) const { return data < other.data; }
     bool operator==(const Entry& other) const { return data == other.data; }
@@ -49,7 +59,7 @@ class Interner {
 
     const T data;
     InternID id;
-    size_t ref_count = 0;
+    std::atomic<size_t> ref_count{0};
     Interner<T>* interner;
   };
 
@@ -60,7 +70,7 @@ class Interner {
     explicit Interned(Entry* entry) : entry_(entry) {}
     Interned(const Interned& other) : entry_(other.entry_) {
       if (entry_ != nullptr)
-        entry_->ref_count++;
+        entry_->ref_count.fetch_add(1, std::memory_order_relaxed);
     }
 
     Interned(Interned&& other) noexcept : entry_(other.entry_) {
@@ -98,6 +108,7 @@ class Interner {
 
   template <typename... U>
   Interned Intern(U... args) {
+    std::lock_guard<std::mutex> lock(mutex_);
     Entry item(this, next_id, std::forward<U...>(args...));
     auto it = entries_.find(item);
     if (it == entries_.cend()) {
@@ -115,14 +126,27 @@ class Interner {
 
   ~Interner() { PERFETTO_DCHECK(entries_.empty()); }
 
-  size_t entry_count_for_testing() { return entries_.size(); }
+  size_t entry_count_for_testing() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
 
  private:
   void Return(Entry* entry) {
+    // Copying an Interned only increments the count of an entry that is
+    // already referenced, so needs no lock. Only the last reference needs to
+    // be dropped with the lock held, as Intern can concurrently revive it.
+    size_t ref_count = entry->ref_count.load(std::memory_order_relaxed);
+    while (ref_count > 1) {
+      if (entry->ref_count.compare_exchange_weak(ref_count, ref_count - 1))
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
     if (--entry->ref_count == 0)
       entries_.erase(*entry);
   }
 
+  std::mutex mutex_;
   InternID next_id = 1;
   std::unordered_set<Entry, typename Entry::Hash> entries_;
   static_assert(sizeof(Interned) == sizeof(void*),
@@ -16,6 +16,9 @@
 
 #include "src/profiling/common/interner.h"
 
+#include <thread>
+#include <vector>
+
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -128,6 +131,27 @@ TEST(InternerStringTest, IdsConsecutive) {
   ASSERT_EQ(interner.entry_count_for_testing(), 0u);
 }
 
+TEST(InternerStringTest, Concurrent) {
+  Interner<std::string> interner;
+  Interned<std::string> shared = interner.Intern("shared");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&interner, &shared, t] {
+      for (int i = 0; i < 1000; ++i) {
+        Interned<std::string> copy = shared;
+        Interned<std::string> same = interner.Intern("shared");
+        Interned<std::string> own =
+            interner.Intern("thread" + std::to_string(t));
+        EXPECT_EQ(copy.id(), same.id());
+        EXPECT_NE(own.id(), same.id());
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  EXPECT_EQ(interner.entry_count_for_testing(), 1u);
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
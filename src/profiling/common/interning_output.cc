@@ -59,8 +59,7 @@ void InterningOutputTracker::WriteFixedInterningsPacket(
 
 void InterningOutputTracker::WriteMap(const Interned<Mapping> map,
                                       protos::pbzero::InternedData* out) {
-  auto map_it_and_inserted = dumped_mappings_.emplace(map.id());
-  if (map_it_and_inserted.second) {
+  if (dumped_mappings_.Insert(map.id(), true).second) {
     for (const Interned<std::string>& str : map->path_components)
       WriteMappingPathString(str, out);
 
@@ -81,75 +80,71 @@ void InterningOutputTracker::WriteMap(const Interned<Mapping> map,
 
 void InterningOutputTracker::WriteFrame(Interned<Frame> frame,
                                         protos::pbzero::InternedData* out) {
+  // A frame is only marked as dumped after its mapping and function name, so
+  // there is nothing else to check for the frames seen before.
+  if (dumped_frames_.Find(frame.id()))
+    return;
   // Trace processor depends on the map being written before the
   // frame. See StackProfileTracker::AddFrame.
   WriteMap(frame->mapping, out);
   WriteFunctionNameString(frame->function_name, out);
-  bool inserted;
-  std::tie(std::ignore, inserted) = dumped_frames_.emplace(frame.id());
-  if (inserted) {
-    protos::pbzero::Frame* frame_proto = out->add_frames();
-    frame_proto->set_iid(frame.id());
-    frame_proto->set_function_name_id(frame->function_name.id());
-    frame_proto->set_mapping_id(frame->mapping.id());
-    frame_proto->set_rel_pc(frame->rel_pc);
-  }
+  dumped_frames_.Insert(frame.id(), true);
+  protos::pbzero::Frame* frame_proto = out->add_frames();
+  frame_proto->set_iid(frame.id());
+  frame_proto->set_function_name_id(frame->function_name.id());
+  frame_proto->set_mapping_id(frame->mapping.id());
+  frame_proto->set_rel_pc(frame->rel_pc);
 }
 
 void InterningOutputTracker::WriteBuildIDString(
     const Interned<std::string>& str,
     protos::pbzero::InternedData* out) {
-  auto it_and_inserted = dumped_strings_.emplace(str.id(), 0);
-  auto it = it_and_inserted.first;
+  int* dumped_as = dumped_strings_.Insert(str.id(), 0).first;
   // This is for the rare case that the same string is used as two different
   // types (e.g. a function name that matches a path segment). In that case
   // we need to emit the string as all of its types.
-  if ((it->second & kDumpedBuildID) == 0) {
+  if ((*dumped_as & kDumpedBuildID) == 0) {
     protos::pbzero::InternedString* interned_string = out->add_build_ids();
     interned_string->set_iid(str.id());
     interned_string->set_str(str.data());
-    it->second |= kDumpedBuildID;
+    *dumped_as |= kDumpedBuildID;
   }
 }
 
 void InterningOutputTracker::WriteMappingPathString(
     const Interned<std::string>& str,
     protos::pbzero::InternedData* out) {
-  auto it_and_inserted = dumped_strings_.emplace(str.id(), 0);
-  auto it = it_and_inserted.first;
+  int* dumped_as = dumped_strings_.Insert(str.id(), 0).first;
   // This is for the rare case that the same string is used as two different
   // types (e.g. a function name that matches a path segment). In that case
   // we need to emit the string as all of its types.
-  if ((it->second & kDumpedMappingPath) == 0) {
+  if ((*dumped_as & kDumpedMappingPath) == 0) {
     protos::pbzero::InternedString* interned_string = out->add_mapping_paths();
     interned_string->set_iid(str.id());
     interned_string->set_str(str.data());
-    it->second |= kDumpedMappingPath;
+    *dumped_as |= kDumpedMappingPath;
   }
 }
 
 void InterningOutputTracker::WriteFunctionNameString(
     const Interned<std::string>& str,
     protos::pbzero::InternedData* out) {
-  auto it_and_inserted = dumped_strings_.emplace(str.id(), 0);
-  auto it = it_and_inserted.first;
+  int* dumped_as = dumped_strings_.Insert(str.id(), 0).first;
   // This is for the rare case that the same string is used as two different
   // types (e.g. a function name that matches a path segment). In that case
   // we need to emit the string as all of its types.
-  if ((it->second & kDumpedFunctionName) == 0) {
+  if ((*dumped_as & kDumpedFunctionName) == 0) {
     protos::pbzero::InternedString* interned_string = out->add_function_names();
     interned_string->set_iid(str.id());
     interned_string->set_str(str.data());
-    it->second |= kDumpedFunctionName;
+    *dumped_as |= kDumpedFunctionName;
   }
 }
 
 void InterningOutputTracker::WriteCallstack(GlobalCallstackTrie::Node* node,
                                             GlobalCallstackTrie* trie,
                                             protos::pbzero::InternedData* out) {
-  bool inserted;
-  std::tie(std::ignore, inserted) = dumped_callstacks_.emplace(node->id());
-  if (inserted) {
+  if (dumped_callstacks_.Insert(node->id(), true).second) {
     // There need to be two separate loops over built_callstack because
     // protozero cannot interleave different messages.
     auto built_callstack = trie->BuildInverseCallstack(node);
@@ -167,10 +162,10 @@ void InterningOutputTracker::WriteCallstack(GlobalCallstackTrie::Node* node,
 }
 
 void InterningOutputTracker::ClearHistory() {
-  dumped_strings_.clear();
-  dumped_frames_.clear();
-  dumped_mappings_.clear();
-  dumped_callstacks_.clear();
+  dumped_strings_.Clear();
+  dumped_frames_.Clear();
+  dumped_mappings_.Clear();
+  dumped_callstacks_.Clear();
 }
 
 }  // namespace profiling
@@ -17,11 +17,9 @@
 #ifndef SRC_PROFILING_COMMON_INTERNING_OUTPUT_H_
 #define SRC_PROFILING_COMMON_INTERNING_OUTPUT_H_
 
-#include <map>
-#include <set>
-
 #include <stdint.h>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "src/profiling/common/callstack_trie.h"
 #include "src/profiling/common/interner.h"
@@ -51,9 +49,11 @@ class InterningOutputTracker {
                       protos::pbzero::InternedData* out);
 
   bool IsCallstackNew(uint64_t callstack_id) {
-    return dumped_callstacks_.find(callstack_id) == dumped_callstacks_.end();
+    return !dumped_callstacks_.Find(callstack_id);
   }
 
+  // Keeps the capacity of the tables, as the same amount of internings is
+  // likely to be emitted again.
   void ClearHistory();
 
   // TODO(rsavitski): move elsewhere, used in heapprofd for orthogonal
@@ -62,12 +62,16 @@ class InterningOutputTracker {
   uint64_t* HeapprofdNextIndexMutable() { return &next_index_; }
 
  private:
+  // These are looked up for every frame of every new callstack. The values
+  // of the sets are unused.
+  //
   // Map value is a bitfield distinguishing the distinct string fields
   // the string can be emitted as, e.g. kDumpedBuildID.
-  std::map<InternID, int> dumped_strings_;
-  std::set<InternID> dumped_frames_;
-  std::set<InternID> dumped_mappings_;
-  std::set<uint64_t> dumped_callstacks_;  // uses callstack trie's node ids
+  base::FlatHashMap<InternID, int> dumped_strings_;
+  base::FlatHashMap<InternID, bool> dumped_frames_;
+  base::FlatHashMap<InternID, bool> dumped_mappings_;
+  // Uses callstack trie's node ids.
+  base::FlatHashMap<uint64_t, bool> dumped_callstacks_;
 
   uint64_t next_index_ = 0;
 };
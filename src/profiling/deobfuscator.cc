@@ -16,8 +16,9 @@
 
 #include "src/profiling/deobfuscator.h"
 
+#include <stdio.h>
+
 #include "perfetto/base/status.h"
-#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 
@@ -162,6 +163,8 @@ base::Status ProguardParser::AddLine(std::string line) {
   if (line.length() == 0 || line[0] == '#')
     return base::Status();
   bool is_member = line[0] == ' ';
+  if (is_member && skipping_class_)
+    return base::Status();
   if (is_member && !current_class_) {
     return base::Status(
         "Failed to parse proguard map. Saw member before class.");
@@ -170,6 +173,12 @@ base::Status ProguardParser::AddLine(std::string line) {
     auto opt_cls = ParseClass(std::move(line));
     if (!opt_cls)
       return base::Status("Class not found.");
+    skipping_class_ =
+        class_filter_ && !class_filter_(opt_cls->obfuscated_name);
+    if (skipping_class_) {
+      current_class_ = nullptr;
+      return base::Status();
+    }
     auto p = mapping_.emplace(std::move(opt_cls->obfuscated_name),
                               std::move(opt_cls->deobfuscated_name));
     if (!p.second) {
@@ -252,7 +261,8 @@ void MakeDeobfuscationPackets(
 
 bool ReadProguardMapsToDeobfuscationPackets(
     const std::vector<ProguardMap>& maps,
-    std::function<void(std::string)> fn) {
+    std::function<void(std::string)> fn,
+    ProguardClassFilter class_filter) {
   for (const ProguardMap& map : maps) {
     const char* filename = map.filename.c_str();
     base::ScopedFstream f(fopen(filename, "re"));
@@ -260,19 +270,39 @@ bool ReadProguardMapsToDeobfuscationPackets(
       PERFETTO_ELOG("Failed to open %s", filename);
       return false;
     }
-    profiling::ProguardParser parser;
-    std::string contents;
-    PERFETTO_CHECK(base::ReadFileStream(*f, &contents));
-    if (!parser.AddLines(std::move(contents))) {
-      PERFETTO_ELOG("Failed to parse %s", filename);
+    profiling::ProguardParser parser(class_filter);
+
+    // Parse line by line rather than reading the whole file first, maps of
+    // large apps can be hundreds of MB.
+    std::string line;
+    char buf[4096];
+    size_t lineno = 1;
+    bool eof = false;
+    while (!eof) {
+      eof = !fgets(buf, sizeof(buf), *f);
+      if (!eof) {
+        line.append(buf);
+        if (line.back() != '\n')
+          continue;  // longer than the buffer, or last line
+        line.pop_back();
+      } else if (line.empty()) {
+        break;
+      }
+      base::Status status = parser.AddLine(std::move(line));
+      if (!status.ok()) {
+        PERFETTO_ELOG("Failed to parse %s (line %zu): %s", filename, lineno,
+                      status.c_message());
+        return false;
+      }
+      line.clear();
+      lineno++;
+    }
+    if (ferror(*f)) {
+      PERFETTO_PLOG("Failed to read %s", filename);
       return false;
     }
     std::map<std::string, profiling::ObfuscatedClass> obfuscation_map =
         parser.ConsumeMapping();
-
-    // TODO(fmayer): right now, we don't use the profile we are given. We can
-    // filter the output to only contain the classes actually seen in the
-    // profile.
     MakeDeobfuscationPackets(map.package, obfuscation_map, fn);
   }
   return true;
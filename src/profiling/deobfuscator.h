@@ -87,8 +87,18 @@ class ObfuscatedClass {
   bool redefined_methods_ = false;
 };
 
+// Returns whether the class with the given obfuscated name should be kept.
+using ProguardClassFilter =
+    std::function<bool(const std::string& obfuscated_name)>;
+
 class ProguardParser {
  public:
+  ProguardParser() = default;
+  // Only the classes accepted by |class_filter| (and their members) are kept,
+  // which bounds the memory use for large maps.
+  explicit ProguardParser(ProguardClassFilter class_filter)
+      : class_filter_(std::move(class_filter)) {}
+
   // A return value of false means this line failed to parse. This leaves the
   // parser in an undefined state and it should no longer be used.
   base::Status AddLine(std::string line);
@@ -101,6 +111,9 @@ class ProguardParser {
  private:
   std::map<std::string, ObfuscatedClass> mapping_;
   ObfuscatedClass* current_class_ = nullptr;
+  ProguardClassFilter class_filter_;
+  // Set while parsing the members of a class rejected by |class_filter_|.
+  bool skipping_class_ = false;
 };
 
 struct ProguardMap {
@@ -115,9 +128,12 @@ void MakeDeobfuscationPackets(
 
 std::vector<ProguardMap> GetPerfettoProguardMapPath();
 
+// The maps are read line by line. If |class_filter| is set, only the classes
+// it accepts are emitted.
 bool ReadProguardMapsToDeobfuscationPackets(
     const std::vector<ProguardMap>& maps,
-    std::function<void(std::string)> fn);
+    std::function<void(std::string)> fn,
+    ProguardClassFilter class_filter = nullptr);
 
 }  // namespace profiling
 }  // namespace perfetto
@@ -224,6 +224,30 @@ TEST(ProguardParserTest, DuplicateFieldSame) {
           .ok());
 }
 
+TEST(ProguardParserTest, ClassFilter) {
+  ProguardParser p([](const std::string& obfuscated_name) {
+    return obfuscated_name == "android.arch.a.a.b";
+  });
+  ASSERT_TRUE(
+      p.AddLine(
+           "android.arch.core.executor.ArchTaskExecutor -> android.arch.a.a.a:")
+          .ok());
+  ASSERT_TRUE(
+      p.AddLine("    android.arch.core.executor.TaskExecutor mDelegate -> b")
+          .ok());
+  ASSERT_TRUE(
+      p.AddLine(
+           "android.arch.core.executor.TaskExecutor -> android.arch.a.a.b:")
+          .ok());
+  ASSERT_TRUE(p.AddLine("    15:15:boolean isMainThread():116:116 -> b").ok());
+  auto mapping = p.ConsumeMapping();
+  ASSERT_THAT(mapping, ElementsAre(Pair("android.arch.a.a.b", _)));
+  EXPECT_THAT(
+      mapping.find("android.arch.a.a.b")->second.deobfuscated_methods(),
+      ElementsAre(Pair(
+          "b", "android.arch.core.executor.TaskExecutor.isMainThread")));
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
@@ -29,6 +29,42 @@
 namespace perfetto {
 namespace profiling {
 
+HeapTracker::~HeapTracker() {
+  for (const CallstackAllocations& csa : callstack_allocations_) {
+    if (csa.node)
+      callsites_->DecrementNode(csa.node);
+  }
+}
+
+uint32_t HeapTracker::MaybeCreateCallstackAllocations(
+    GlobalCallstackTrie::Node* node) {
+  if (uint32_t* idx = callstack_idx_.Find(node)) {
+    // Already referenced by the CallstackAllocations.
+    callsites_->DecrementNode(node);
+    return *idx;
+  }
+  uint32_t idx;
+  if (!free_callstack_allocations_.empty()) {
+    idx = free_callstack_allocations_.back();
+    free_callstack_allocations_.pop_back();
+    callstack_allocations_[idx] = CallstackAllocations(node);
+  } else {
+    idx = static_cast<uint32_t>(callstack_allocations_.size());
+    callstack_allocations_.emplace_back(node);
+  }
+  callstack_idx_.Insert(node, idx);
+  return idx;
+}
+
+void HeapTracker::ReleaseCallstackAllocations(uint32_t idx) {
+  CallstackAllocations& csa = callstack_allocations_[idx];
+  PERFETTO_DCHECK(csa.node && csa.allocs == 0);
+  callstack_idx_.Erase(csa.node);
+  callsites_->DecrementNode(csa.node);
+  csa = CallstackAllocations(nullptr);
+  free_callstack_allocations_.push_back(idx);
+}
+
 void HeapTracker::RecordMalloc(
     const std::vector<unwindstack::FrameData>& callstack,
     const std::vector<std::string>& build_ids,
@@ -52,9 +88,8 @@ void HeapTracker::RecordMalloc(
     }
   }
 
-  auto it = allocations_.find(address);
-  if (it != allocations_.end()) {
-    Allocation& alloc = it->second;
+  if (Allocation* existing = allocations_.Find(address)) {
+    Allocation& alloc = *existing;
     PERFETTO_DCHECK(alloc.sequence_number != sequence_number);
     if (alloc.sequence_number < sequence_number) {
       // As we are overwriting the previous allocation, the previous allocation
@@ -72,17 +107,21 @@ void HeapTracker::RecordMalloc(
       }
 
       SubtractFromCallstackAllocations(alloc);
-      GlobalCallstackTrie::Node* node = callsites_->CreateCallsite(frames);
+      GlobalCallstackTrie::Node* node =
+          callsites_->CreateReferencedCallsite(frames);
       alloc.sample_size = sample_size;
       alloc.alloc_size = alloc_size;
       alloc.sequence_number = sequence_number;
-      alloc.SetCallstackAllocations(MaybeCreateCallstackAllocations(node));
+      SetCallstackAllocations(&alloc, MaybeCreateCallstackAllocations(node));
     }
   } else {
-    GlobalCallstackTrie::Node* node = callsites_->CreateCallsite(frames);
-    allocations_.emplace(address,
-                         Allocation(sample_size, alloc_size, sequence_number,
-                                    MaybeCreateCallstackAllocations(node)));
+    GlobalCallstackTrie::Node* node =
+        callsites_->CreateReferencedCallsite(frames);
+    uint32_t idx = MaybeCreateCallstackAllocations(node);
+    callstack_allocations_[idx].allocs++;
+    allocations_.Insert(address,
+                        Allocation{sample_size, alloc_size, sequence_number,
+                                   idx});
   }
 
   RecordOperation(sequence_number, {address, timestamp});
@@ -116,16 +155,17 @@ void HeapTracker::CommitOperation(uint64_t sequence_number,
   uint64_t address = operation.allocation_address;
 
   // We will see many frees for addresses we do not know about.
-  auto leaf_it = allocations_.find(address);
-  if (leaf_it == allocations_.end())
+  Allocation* leaf = allocations_.Find(address);
+  if (!leaf)
     return;
 
-  Allocation& value = leaf_it->second;
+  Allocation& value = *leaf;
   if (value.sequence_number == sequence_number) {
     AddToCallstackAllocations(operation.timestamp, value);
   } else if (value.sequence_number < sequence_number) {
     SubtractFromCallstackAllocations(value);
-    allocations_.erase(leaf_it);
+    callstack_allocations(value).allocs--;
+    allocations_.Erase(address);
   }
   // else (value.sequence_number > sequence_number:
   //  This allocation has been replaced by a newer one in RecordMalloc.
@@ -144,12 +184,12 @@ uint64_t HeapTracker::GetSizeForTesting(
   // Hack to make it go away again if it wasn't used before.
   // This is only good because this is used for testing only.
   GlobalCallstackTrie::IncrementNode(node);
-  GlobalCallstackTrie::DecrementNode(node);
-  auto it = callstack_allocations_.find(node);
-  if (it == callstack_allocations_.end()) {
+  callsites_->DecrementNode(node);
+  uint32_t* idx = callstack_idx_.Find(node);
+  if (!idx) {
     return 0;
   }
-  const CallstackAllocations& alloc = it->second;
+  const CallstackAllocations& alloc = callstack_allocations_[*idx];
   return alloc.value.totals.allocated - alloc.value.totals.freed;
 }
 
@@ -162,12 +202,12 @@ uint64_t HeapTracker::GetMaxForTesting(
   // Hack to make it go away again if it wasn't used before.
   // This is only good because this is used for testing only.
   GlobalCallstackTrie::IncrementNode(node);
-  GlobalCallstackTrie::DecrementNode(node);
-  auto it = callstack_allocations_.find(node);
-  if (it == callstack_allocations_.end()) {
+  callsites_->DecrementNode(node);
+  uint32_t* idx = callstack_idx_.Find(node);
+  if (!idx) {
     return 0;
   }
-  const CallstackAllocations& alloc = it->second;
+  const CallstackAllocations& alloc = callstack_allocations_[*idx];
   return alloc.value.retain_max.max;
 }
 
@@ -180,12 +220,12 @@ uint64_t HeapTracker::GetMaxCountForTesting(
   // Hack to make it go away again if it wasn't used before.
   // This is only good because this is used for testing only.
   GlobalCallstackTrie::IncrementNode(node);
-  GlobalCallstackTrie::DecrementNode(node);
-  auto it = callstack_allocations_.find(node);
-  if (it == callstack_allocations_.end()) {
+  callsites_->DecrementNode(node);
+  uint32_t* idx = callstack_idx_.Find(node);
+  if (!idx) {
     return 0;
   }
-  const CallstackAllocations& alloc = it->second;
+  const CallstackAllocations& alloc = callstack_allocations_[*idx];
   return alloc.value.retain_max.max_count;
 }
 
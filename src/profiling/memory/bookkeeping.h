@@ -18,9 +18,11 @@
 #define SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/profiling/common/callstack_trie.h"
 #include "src/profiling/common/interner.h"
 #include "src/profiling/memory/unwound_messages.h"
@@ -107,6 +109,9 @@ class HeapTracker {
   };
 
   // Sum of all the allocations for a given callstack.
+  //
+  // These live in a flat table of HeapTracker, which holds a reference to
+  // |node| while it is not null. A null |node| is a free slot of the table.
   struct CallstackAllocations {
     explicit CallstackAllocations(GlobalCallstackTrie::Node* n) : node(n) {}
 
@@ -117,19 +122,22 @@ class HeapTracker {
       CallstackTotalAllocations totals;
     } value = {};
 
-    GlobalCallstackTrie::Node* const node;
-
-    ~CallstackAllocations() { GlobalCallstackTrie::DecrementNode(node); }
+    GlobalCallstackTrie::Node* node;
 
-    bool operator<(const CallstackAllocations& other) const {
-      return node < other.node;
-    }
+    // Whether |value| changed since the last GetCallstackAllocations. In
+    // dump_at_max_mode, only changes of the max are tracked.
+    bool changed = false;
   };
 
   // Caller needs to ensure that callsites outlives the HeapTracker.
   explicit HeapTracker(GlobalCallstackTrie* callsites, bool dump_at_max_mode)
       : callsites_(callsites), dump_at_max_mode_(dump_at_max_mode) {}
 
+  ~HeapTracker();
+
+  HeapTracker(const HeapTracker&) = delete;
+  HeapTracker& operator=(const HeapTracker&) = delete;
+
   void RecordMalloc(const std::vector<unwindstack::FrameData>& callstack,
                     const std::vector<std::string>& build_ids,
                     uint64_t address,
@@ -145,10 +153,10 @@ class HeapTracker {
     // * We need to remove them after the callstacks were dumped, which
     //   currently happens after the allocations are dumped.
     // * This way, we do not destroy and recreate callstacks as frequently.
-    for (auto it_and_alloc : dead_callstack_allocations_) {
-      auto& it = it_and_alloc.first;
-      uint64_t allocated = it_and_alloc.second;
-      const CallstackAllocations& alloc = it->second;
+    for (const auto& idx_and_alloc : dead_callstack_allocations_) {
+      uint32_t idx = idx_and_alloc.first;
+      uint64_t allocated = idx_and_alloc.second;
+      const CallstackAllocations& alloc = callstack_allocations_[idx];
       // For non-dump-at-max, we need to check, even if there are still no
       // allocations referencing this callstack, whether there were any
       // allocations that happened but were freed again. If that was the case,
@@ -160,28 +168,30 @@ class HeapTracker {
         // TODO(fmayer): We could probably be smarter than throw away
         // our whole frames cache.
         ClearFrameCache();
-        callstack_allocations_.erase(it);
+        ReleaseCallstackAllocations(idx);
       }
     }
     dead_callstack_allocations_.clear();
 
-    for (auto it = callstack_allocations_.begin();
-         it != callstack_allocations_.end(); ++it) {
-      const CallstackAllocations& alloc = it->second;
-      fn(alloc);
+    for (uint32_t idx = 0; idx < callstack_allocations_.size(); ++idx) {
+      CallstackAllocations& alloc = callstack_allocations_[idx];
+      if (!alloc.node)
+        continue;
+      fn(static_cast<const CallstackAllocations&>(alloc));
+      alloc.changed = false;
 
       if (alloc.allocs == 0)
         dead_callstack_allocations_.emplace_back(
-            it, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
+            idx, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
     }
   }
 
   template <typename F>
   void GetAllocations(F fn) {
-    for (const auto& addr_and_allocation : allocations_) {
-      const Allocation& alloc = addr_and_allocation.second;
-      fn(addr_and_allocation.first, alloc.sample_size, alloc.alloc_size,
-         alloc.callstack_allocations()->node->id());
+    for (auto it = allocations_.GetIterator(); it; ++it) {
+      const Allocation& alloc = it.value();
+      fn(it.key(), alloc.sample_size, alloc.alloc_size,
+         callstack_allocations_[alloc.callstack_idx].node->id());
     }
   }
 
@@ -207,45 +217,13 @@ class HeapTracker {
   uint64_t GetTimestampForTesting() { return committed_timestamp_; }
 
  private:
+  // 32 bytes, rather than the ~80 of a std::map node holding one.
   struct Allocation {
-    Allocation(uint64_t size,
-               uint64_t asize,
-               uint64_t seq,
-               CallstackAllocations* csa)
-        : sample_size(size), alloc_size(asize), sequence_number(seq) {
-      SetCallstackAllocations(csa);
-    }
-
-    Allocation() = default;
-    Allocation(const Allocation&) = delete;
-    Allocation(Allocation&& other) noexcept {
-      sample_size = other.sample_size;
-      alloc_size = other.alloc_size;
-      sequence_number = other.sequence_number;
-      callstack_allocations_ = other.callstack_allocations_;
-      other.callstack_allocations_ = nullptr;
-    }
-
-    ~Allocation() { SetCallstackAllocations(nullptr); }
-
-    void SetCallstackAllocations(CallstackAllocations* callstack_allocations) {
-      if (callstack_allocations_)
-        callstack_allocations_->allocs--;
-      callstack_allocations_ = callstack_allocations;
-      if (callstack_allocations_)
-        callstack_allocations_->allocs++;
-    }
-
-    CallstackAllocations* callstack_allocations() const {
-      return callstack_allocations_;
-    }
-
     uint64_t sample_size;
     uint64_t alloc_size;
     uint64_t sequence_number;
-
-   private:
-    CallstackAllocations* callstack_allocations_ = nullptr;
+    // Index in |callstack_allocations_|, whose allocs count this.
+    uint32_t callstack_idx;
   };
 
   struct PendingOperation {
@@ -253,17 +231,18 @@ class HeapTracker {
     uint64_t timestamp;
   };
 
-  CallstackAllocations* MaybeCreateCallstackAllocations(
-      GlobalCallstackTrie::Node* node) {
-    auto callstack_allocations_it = callstack_allocations_.find(node);
-    if (callstack_allocations_it == callstack_allocations_.end()) {
-      GlobalCallstackTrie::IncrementNode(node);
-      bool inserted;
-      std::tie(callstack_allocations_it, inserted) =
-          callstack_allocations_.emplace(node, node);
-      PERFETTO_DCHECK(inserted);
-    }
-    return &callstack_allocations_it->second;
+  // Takes over the reference to |node| held by the caller.
+  uint32_t MaybeCreateCallstackAllocations(GlobalCallstackTrie::Node* node);
+  void ReleaseCallstackAllocations(uint32_t idx);
+
+  CallstackAllocations& callstack_allocations(const Allocation& alloc) {
+    return callstack_allocations_[alloc.callstack_idx];
+  }
+
+  void SetCallstackAllocations(Allocation* alloc, uint32_t idx) {
+    callstack_allocations_[alloc->callstack_idx].allocs--;
+    alloc->callstack_idx = idx;
+    callstack_allocations_[idx].allocs++;
   }
 
   void RecordOperation(uint64_t sequence_number,
@@ -283,8 +262,8 @@ class HeapTracker {
   void AddToCallstackAllocations(uint64_t ts, const Allocation& alloc) {
     if (dump_at_max_mode_) {
       current_unfreed_ += alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur += alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur_count++;
+      callstack_allocations(alloc).value.retain_max.cur += alloc.sample_size;
+      callstack_allocations(alloc).value.retain_max.cur_count++;
 
       if (current_unfreed_ <= max_unfreed_)
         return;
@@ -292,16 +271,21 @@ class HeapTracker {
       if (max_sequence_number_ == alloc.sequence_number - 1) {
         // We know the only CallstackAllocation that has max != cur is the
         // one we just updated.
-        alloc.callstack_allocations()->value.retain_max.max =
-            alloc.callstack_allocations()->value.retain_max.cur;
-        alloc.callstack_allocations()->value.retain_max.max_count =
-            alloc.callstack_allocations()->value.retain_max.cur_count;
+        callstack_allocations(alloc).value.retain_max.max =
+            callstack_allocations(alloc).value.retain_max.cur;
+        callstack_allocations(alloc).value.retain_max.max_count =
+            callstack_allocations(alloc).value.retain_max.cur_count;
+        callstack_allocations(alloc).changed = true;
       } else {
-        for (auto& p : callstack_allocations_) {
+        for (CallstackAllocations& csa : callstack_allocations_) {
           // We need to reset max = cur for every CallstackAllocation, as we
           // do not know which ones have changed since the last max.
           // TODO(fmayer): Add an index to speed this up
-          CallstackAllocations& csa = p.second;
+          if (csa.value.retain_max.max != csa.value.retain_max.cur ||
+              csa.value.retain_max.max_count !=
+                  csa.value.retain_max.cur_count) {
+            csa.changed = true;
+          }
           csa.value.retain_max.max = csa.value.retain_max.cur;
           csa.value.retain_max.max_count = csa.value.retain_max.cur_count;
         }
@@ -310,33 +294,39 @@ class HeapTracker {
       max_unfreed_ = current_unfreed_;
       max_timestamp_ = ts;
     } else {
-      alloc.callstack_allocations()->value.totals.allocated +=
+      callstack_allocations(alloc).value.totals.allocated +=
           alloc.sample_size;
-      alloc.callstack_allocations()->value.totals.allocation_count++;
+      callstack_allocations(alloc).value.totals.allocation_count++;
+      callstack_allocations(alloc).changed = true;
     }
   }
 
   void SubtractFromCallstackAllocations(const Allocation& alloc) {
     if (dump_at_max_mode_) {
       current_unfreed_ -= alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur -= alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur_count--;
+      callstack_allocations(alloc).value.retain_max.cur -= alloc.sample_size;
+      callstack_allocations(alloc).value.retain_max.cur_count--;
     } else {
-      alloc.callstack_allocations()->value.totals.freed += alloc.sample_size;
-      alloc.callstack_allocations()->value.totals.free_count++;
+      callstack_allocations(alloc).value.totals.freed += alloc.sample_size;
+      callstack_allocations(alloc).value.totals.free_count++;
+      callstack_allocations(alloc).changed = true;
     }
   }
 
   // We cannot use an interner here, because after the last allocation goes
   // away, we still need to keep the CallstackAllocations around until the next
   // dump.
-  std::map<GlobalCallstackTrie::Node*, CallstackAllocations>
-      callstack_allocations_;
+  //
+  // Flat table, so that the Allocations can refer to their entry with a 32-bit
+  // index that stays valid when it grows. The free slots are reused.
+  std::vector<CallstackAllocations> callstack_allocations_;
+  std::vector<uint32_t> free_callstack_allocations_;
+  base::FlatHashMap<GlobalCallstackTrie::Node*, uint32_t> callstack_idx_;
 
-  std::vector<std::pair<decltype(callstack_allocations_)::iterator, uint64_t>>
+  std::vector<std::pair<uint32_t /* idx */, uint64_t>>
       dead_callstack_allocations_;
 
-  std::map<uint64_t /* allocation address */, Allocation> allocations_;
+  base::FlatHashMap<uint64_t /* allocation address */, Allocation> allocations_;
 
   // An operation is either a commit of an allocation or freeing of an
   // allocation. An operation is a free if its seq_id is larger than
@@ -0,0 +1,145 @@
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+
+#include "src/profiling/memory/bookkeeping.h"
+
+namespace perfetto {
+namespace profiling {
+
+namespace {
+
+constexpr uint64_t kNumCallstacks = 64;
+
+std::vector<std::vector<unwindstack::FrameData>> MakeCallstacks() {
+  std::vector<std::vector<unwindstack::FrameData>> res;
+  for (uint64_t i = 0; i < kNumCallstacks; ++i) {
+    std::vector<unwindstack::FrameData> callstack;
+    for (uint64_t depth = 0; depth < 8; ++depth) {
+      unwindstack::FrameData data{};
+      data.function_name = "fun" + std::to_string(depth);
+      data.map_name = "map" + std::to_string(depth);
+      // Share the outer frames, like real callstacks do.
+      data.pc = depth < 4 ? depth : i * 8 + depth;
+      callstack.emplace_back(std::move(data));
+    }
+    res.emplace_back(std::move(callstack));
+  }
+  return res;
+}
+
+}  // namespace
+
+// Steady state of state.range(0) live allocations: every iteration frees the
+// oldest one and replaces it with a new allocation.
+static void BM_HeapTrackerMallocFree(benchmark::State& state) {
+  const uint64_t live = static_cast<uint64_t>(state.range(0));
+  auto callstacks = MakeCallstacks();
+  std::vector<std::string> build_ids(callstacks[0].size());
+  GlobalCallstackTrie callsites;
+  HeapTracker hd(&callsites, false);
+
+  uint64_t sequence_number = 1;
+  uint64_t next = 0;
+  for (; next < live; ++next) {
+    hd.RecordMalloc(callstacks[next % kNumCallstacks], build_ids,
+                    0x1000 + next * 16, 32, 32, sequence_number,
+                    sequence_number);
+    sequence_number++;
+  }
+
+  for (auto _ : state) {
+    hd.RecordFree(0x1000 + (next - live) * 16, sequence_number,
+                  sequence_number);
+    sequence_number++;
+    hd.RecordMalloc(callstacks[next % kNumCallstacks], build_ids,
+                    0x1000 + next * 16, 32, 32, sequence_number,
+                    sequence_number);
+    sequence_number++;
+    next++;
+  }
+}
+
+BENCHMARK(BM_HeapTrackerMallocFree)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+// Cost of walking the state of a HeapTracker with state.range(0) live
+// allocations, as done by a dump.
+static void BM_HeapTrackerDump(benchmark::State& state) {
+  const uint64_t live = static_cast<uint64_t>(state.range(0));
+  auto callstacks = MakeCallstacks();
+  std::vector<std::string> build_ids(callstacks[0].size());
+  GlobalCallstackTrie callsites;
+  HeapTracker hd(&callsites, false);
+
+  for (uint64_t i = 0; i < live; ++i) {
+    hd.RecordMalloc(callstacks[i % kNumCallstacks], build_ids, 0x1000 + i * 16,
+                    32, 32, i + 1, i + 1);
+  }
+
+  for (auto _ : state) {
+    uint64_t total = 0;
+    hd.GetCallstackAllocations(
+        [&total](const HeapTracker::CallstackAllocations& alloc) {
+          total += alloc.value.totals.allocated;
+        });
+    hd.GetAllocations([&total](uint64_t addr, uint64_t, uint64_t, uint64_t) {
+      total += addr;
+    });
+    benchmark::DoNotOptimize(total);
+  }
+}
+
+BENCHMARK(BM_HeapTrackerDump)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+// Contention of looking up callstacks in a GlobalCallstackTrie shared by
+// state.threads threads, as done by the bookkeeping of concurrently unwound
+// samples. Each thread references and releases callstacks that are also
+// referenced elsewhere, like the outstanding allocations of a HeapTracker.
+static void BM_CallstackTrieConcurrentCreateCallsite(benchmark::State& state) {
+  struct SharedTrie {
+    SharedTrie() {
+      for (const auto& callstack : MakeCallstacks()) {
+        std::vector<Interned<Frame>> frames;
+        for (const unwindstack::FrameData& loc : callstack)
+          frames.emplace_back(trie.InternCodeLocation(loc, ""));
+        // Never released, like long-lived allocations.
+        trie.CreateReferencedCallsite(frames);
+        callstacks.emplace_back(std::move(frames));
+      }
+    }
+    GlobalCallstackTrie trie;
+    std::vector<std::vector<Interned<Frame>>> callstacks;
+    std::atomic<uint64_t> next_thread{0};
+  };
+  // Shared by all the threads and runs of the benchmark, and leaked.
+  static SharedTrie* shared = new SharedTrie();
+
+  uint64_t i = shared->next_thread++;
+  for (auto _ : state) {
+    GlobalCallstackTrie::Node* node = shared->trie.CreateReferencedCallsite(
+        shared->callstacks[i++ % kNumCallstacks]);
+    benchmark::DoNotOptimize(node->id());
+    shared->trie.DecrementNode(node);
+  }
+}
+
+BENCHMARK(BM_CallstackTrieConcurrentCreateCallsite)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+}  // namespace profiling
+}  // namespace perfetto
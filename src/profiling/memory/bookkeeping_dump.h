@@ -58,6 +58,9 @@ class DumpState {
 
   void WriteAllocation(const HeapTracker::CallstackAllocations& alloc,
                        bool dump_at_max_mode);
+  // Makes sure the ProcessHeapSamples of this process are written, even if
+  // there are no allocations to write.
+  void WriteProcessHeader() { GetCurrentProcessHeapSamples(); }
   void DumpCallstacks(GlobalCallstackTrie* callsites);
 
  private:
@@ -16,6 +16,9 @@
 
 #include "src/profiling/memory/bookkeeping.h"
 
+#include <algorithm>
+#include <thread>
+
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -23,6 +26,7 @@ namespace profiling {
 namespace {
 
 using ::testing::AnyOf;
+using ::testing::ElementsAre;
 using ::testing::Eq;
 
 std::vector<unwindstack::FrameData> stack() {
@@ -128,6 +132,41 @@ TEST(BookkeepingTest, Basic) {
   ASSERT_EQ(hd.GetTimestampForTesting(), 100 * (sequence_number - 1));
 }
 
+TEST(BookkeepingTest, Changed) {
+  uint64_t sequence_number = 1;
+  GlobalCallstackTrie c;
+  HeapTracker hd(&c, false);
+
+  auto changed_sizes = [&hd] {
+    std::vector<uint64_t> sizes;
+    hd.GetCallstackAllocations(
+        [&sizes](const HeapTracker::CallstackAllocations& alloc) {
+          if (alloc.changed)
+            sizes.push_back(alloc.value.totals.allocated);
+        });
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+  };
+
+  hd.RecordMalloc(stack(), DummyBuildIds(stack().size()), 0x1, 5, 5,
+                  sequence_number, 100 * sequence_number);
+  sequence_number++;
+  hd.RecordMalloc(stack2(), DummyBuildIds(stack2().size()), 0x2, 2, 2,
+                  sequence_number, 100 * sequence_number);
+  sequence_number++;
+  EXPECT_THAT(changed_sizes(), ElementsAre(2u, 5u));
+  EXPECT_THAT(changed_sizes(), ElementsAre());
+
+  hd.RecordFree(0x2, sequence_number, 100 * sequence_number);
+  sequence_number++;
+  EXPECT_THAT(changed_sizes(), ElementsAre(2u));
+
+  hd.RecordMalloc(stack(), DummyBuildIds(stack().size()), 0x3, 1, 1,
+                  sequence_number, 100 * sequence_number);
+  sequence_number++;
+  EXPECT_THAT(changed_sizes(), ElementsAre(6u));
+}
+
 TEST(BookkeepingTest, Max) {
   uint64_t sequence_number = 1;
   GlobalCallstackTrie c;
@@ -312,6 +351,38 @@ TEST(BookkeepingTest, ArbitraryOrder) {
   } while (std::next_permutation(std::begin(operations), std::end(operations)));
 }
 
+TEST(GlobalCallstackTrieTest, ConcurrentCreateAndDecrement) {
+  GlobalCallstackTrie c;
+  std::vector<std::vector<Interned<Frame>>> callstacks;
+  for (const auto& s : {stack(), stack2(), stack3()}) {
+    std::vector<Interned<Frame>> frames;
+    for (const unwindstack::FrameData& loc : s)
+      frames.emplace_back(c.InternCodeLocation(loc, "dummy_buildid"));
+    callstacks.emplace_back(std::move(frames));
+  }
+  GlobalCallstackTrie::Node* held =
+      c.CreateReferencedCallsite(callstacks[0]);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&c, &callstacks, held, t] {
+      for (size_t i = 0; i < 1000; ++i) {
+        GlobalCallstackTrie::Node* node =
+            c.CreateReferencedCallsite(callstacks[(t + i) % callstacks.size()]);
+        if (node->id() != held->id())
+          EXPECT_EQ(c.BuildInverseCallstack(node).size(), 2u);
+        c.DecrementNode(node);
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  // Still the same node, as it was referenced throughout.
+  EXPECT_EQ(c.CreateCallsite(callstacks[0]), held);
+  c.DecrementNode(held);
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
@@ -56,6 +56,24 @@ namespace {
 const char kSingleByte[1] = {'x'};
 constexpr auto kResendBackoffUs = 100;
 
+// 1 KiB on the stack of RecordMalloc, and in the shared memory buffer.
+constexpr size_t kMaxFramePointerPcs = 128;
+
+// The frame records are (saved frame pointer, return address) on both.
+#if defined(__aarch64__) || defined(__x86_64__)
+constexpr bool kFramePointerUnwindingSupported = true;
+#else
+constexpr bool kFramePointerUnwindingSupported = false;
+#endif
+
+#if defined(__aarch64__)
+// Strips the pointer authentication code of the return addresses signed with
+// -mbranch-protection, which lives in the bits above the virtual address.
+constexpr uint64_t kReturnAddressMask = (1ull << 48) - 1;
+#else
+constexpr uint64_t kReturnAddressMask = ~0ull;
+#endif
+
 inline bool IsMainThread() {
   return getpid() == base::GetThreadId();
 }
@@ -80,6 +98,36 @@ uint64_t GetMaxTries(const ClientConfiguration& client_config) {
       1ul, client_config.block_client_timeout_us / kResendBackoffUs);
 }
 
+size_t WalkFramePointers(const char* fp,
+                         const char* stackend,
+                         uint64_t* pcs,
+                         size_t max_pcs) {
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(fp);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(stackend);
+  uintptr_t cur = begin;
+  size_t num_pcs = 0;
+  while (num_pcs < max_pcs) {
+    if (cur % sizeof(uintptr_t) != 0 || cur > end ||
+        end - cur < 2 * sizeof(uintptr_t)) {
+      return 0;
+    }
+    const uintptr_t* record = reinterpret_cast<const uintptr_t*>(cur);
+    uintptr_t next = record[0];
+    uint64_t pc = record[1] & kReturnAddressMask;
+    if (pc == 0)
+      break;
+    pcs[num_pcs++] = pc;
+    // The outermost frame (e.g. _start or the start routine of clone) has a
+    // null frame pointer.
+    if (next == 0)
+      break;
+    if (next <= cur)
+      return 0;
+    cur = next;
+  }
+  return num_pcs;
+}
+
 StackRange GetThreadStackRange() {
   pthread_attr_t attr;
   if (pthread_getattr_np(pthread_self(), &attr) != 0)
@@ -365,6 +413,9 @@ bool Client::RecordMalloc(uint32_t heap_id,
     return postfork_return_value_;
   }
 
+  // Before the allocation is handed to the program, so before it can be freed.
+  sampled_addresses_.Add(heap_id, alloc_address);
+
   AllocMetadata metadata;
   const char* stackptr = reinterpret_cast<char*>(__builtin_frame_address(0));
   unwindstack::AsmGetRegs(metadata.register_data);
@@ -395,8 +446,34 @@ bool Client::RecordMalloc(uint32_t heap_id,
   WireMessage msg{};
   msg.record_type = RecordType::Malloc;
   msg.alloc_header = &metadata;
-  msg.payload = const_cast<char*>(stackptr);
-  msg.payload_size = static_cast<size_t>(stack_size);
+
+  // stackptr is the frame pointer of this function, so this walks from the
+  // return address into the caller of malloc.
+  uint64_t pcs[kMaxFramePointerPcs];
+  size_t num_pcs = 0;
+  if (kFramePointerUnwindingSupported &&
+      client_config_.frame_pointer_unwinding) {
+    num_pcs = WalkFramePointers(stackptr, stackend, pcs, kMaxFramePointerPcs);
+  }
+  metadata.frame_pointer_pcs = num_pcs > 0;
+  metadata.interned_callstack = false;
+  uint64_t fingerprint = 0;
+  if (metadata.frame_pointer_pcs) {
+    msg.payload = reinterpret_cast<char*>(pcs);
+    msg.payload_size = num_pcs * sizeof(uint64_t);
+    // Skip the return addresses if heapprofd already symbolized them.
+    fingerprint = FingerprintFramePointerPcs(msg.payload, msg.payload_size);
+    if (shmem_.IsCallstackInterned(fingerprint)) {
+      metadata.interned_callstack = true;
+      msg.payload = reinterpret_cast<char*>(&fingerprint);
+      msg.payload_size = sizeof(fingerprint);
+    }
+  } else {
+    // Also the fallback for the stacks going through code built without frame
+    // pointers: heapprofd unwinds them with the DWARF info.
+    msg.payload = const_cast<char*>(stackptr);
+    msg.payload_size = static_cast<size_t>(stack_size);
+  }
 
   if (SendWireMessageWithRetriesIfBlocking(msg) == -1)
     return false;
@@ -432,6 +509,11 @@ bool Client::RecordFree(uint32_t heap_id, const uint64_t alloc_address) {
     return postfork_return_value_;
   }
 
+  // Only consume a sequence number for the frees that get sent: heapprofd
+  // expects them to be contiguous.
+  if (!sampled_addresses_.Remove(heap_id, alloc_address))
+    return true;
+
   FreeEntry current_entry;
   current_entry.sequence_number =
       1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
@@ -27,6 +27,7 @@
 
 #include "perfetto/base/compiler.h"
 #include "perfetto/ext/base/unix_socket.h"
+#include "src/profiling/memory/sampled_address_set.h"
 #include "src/profiling/memory/sampler.h"
 #include "src/profiling/memory/shared_ring_buffer.h"
 #include "src/profiling/memory/unhooked_allocator.h"
@@ -50,6 +51,16 @@ constexpr uint32_t kClientSockTimeoutMs = 1000;
 
 uint64_t GetMaxTries(const ClientConfiguration& client_config);
 
+// Follows the chain of frame records (saved frame pointer, return address)
+// starting from the one at |fp|, and stores up to |max_pcs| return addresses
+// into |pcs|. Returns their number, or 0 if the chain is broken before its end
+// (a frame pointer that is misaligned, outside of [fp, stackend) or that does
+// not move towards |stackend|).
+size_t WalkFramePointers(const char* fp,
+                         const char* stackend,
+                         uint64_t* pcs,
+                         size_t max_pcs);
+
 // Profiling client, used to sample and record the malloc/free family of calls,
 // and communicate the necessary state to a separate profiling daemon process.
 //
@@ -131,6 +142,8 @@ class Client {
   std::atomic<uint64_t>
       sequence_number_[base::ArraySize(ClientConfiguration{}.heaps)] = {};
   SharedRingBuffer shmem_;
+  // The frees of the other allocations are not sent.
+  SampledAddressSet sampled_addresses_;
 
   // Used to detect (during the slow path) the situation where the process has
   // forked during profiling, and is performing malloc operations in the child.
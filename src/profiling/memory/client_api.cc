@@ -537,7 +537,7 @@ __attribute__((visibility("default"))) bool AHeapProfile_initSession(
     }
 
     // This needs to happen under the lock for mutual exclusion regarding the
-    // random engine.
+    // samplers.
     for (uint32_t i = kMinHeapId; i < max_heap; ++i) {
       AHeapInfo& heap = GetHeap(i);
       if (heap_intervals[i]) {
@@ -19,6 +19,7 @@
 
 #include "src/profiling/memory/client.h"
 #include "src/profiling/memory/client_api_factory.h"
+#include "src/profiling/memory/sampler.h"
 
 namespace perfetto {
 namespace profiling {
@@ -227,5 +228,17 @@ static void BM_ClientApiMallocFree(benchmark::State& state) {
 
 BENCHMARK(BM_ClientApiMallocFree);
 
+// Cost of the sampling decision for 32 byte allocations with a sampling
+// interval of state.range(0) bytes.
+static void BM_ClientApiSampler(benchmark::State& state) {
+  Sampler sampler;
+  sampler.SetSamplingInterval(static_cast<uint64_t>(state.range(0)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sampler.SampleSize(32));
+  }
+}
+
+BENCHMARK(BM_ClientApiSampler)->Arg(1)->Arg(8)->Arg(64)->Arg(512)->Arg(4096);
+
 }  // namespace profiling
 }  // namespace perfetto
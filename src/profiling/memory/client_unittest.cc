@@ -142,6 +142,51 @@ TEST(ClientTest, GetMaxTriesNoBlock) {
   EXPECT_EQ(GetMaxTries(cfg), 1u);
 }
 
+// Builds a fake stack of frame records {next fp, return address} at the even
+// indices of |stack|.
+TEST(ClientTest, WalkFramePointers) {
+  uintptr_t stack[8] = {};
+  stack[0] = reinterpret_cast<uintptr_t>(&stack[2]);
+  stack[1] = 0x1000;
+  stack[2] = reinterpret_cast<uintptr_t>(&stack[6]);
+  stack[3] = 0x2000;
+  stack[6] = 0;
+  stack[7] = 0x3000;
+  const char* fp = reinterpret_cast<char*>(&stack[0]);
+  const char* stackend = reinterpret_cast<char*>(&stack[8]);
+  uint64_t pcs[8];
+  ASSERT_EQ(WalkFramePointers(fp, stackend, pcs, 8), 3u);
+  EXPECT_EQ(pcs[0], 0x1000u);
+  EXPECT_EQ(pcs[1], 0x2000u);
+  EXPECT_EQ(pcs[2], 0x3000u);
+
+  EXPECT_EQ(WalkFramePointers(fp, stackend, pcs, 2), 2u);
+}
+
+TEST(ClientTest, WalkFramePointersOutOfBounds) {
+  uintptr_t stack[8] = {};
+  stack[0] = reinterpret_cast<uintptr_t>(&stack[2]);
+  stack[1] = 0x1000;
+  stack[2] = reinterpret_cast<uintptr_t>(&stack[8]);
+  stack[3] = 0x2000;
+  uint64_t pcs[8];
+  EXPECT_EQ(WalkFramePointers(reinterpret_cast<char*>(&stack[0]),
+                              reinterpret_cast<char*>(&stack[8]), pcs, 8),
+            0u);
+}
+
+TEST(ClientTest, WalkFramePointersBackwards) {
+  uintptr_t stack[8] = {};
+  stack[2] = reinterpret_cast<uintptr_t>(&stack[0]);
+  stack[3] = 0x1000;
+  stack[0] = reinterpret_cast<uintptr_t>(&stack[2]);
+  stack[1] = 0x2000;
+  uint64_t pcs[8];
+  EXPECT_EQ(WalkFramePointers(reinterpret_cast<char*>(&stack[2]),
+                              reinterpret_cast<char*>(&stack[8]), pcs, 8),
+            0u);
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
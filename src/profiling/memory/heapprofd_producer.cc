@@ -19,6 +19,8 @@
 #include <algorithm>
 #include <functional>
 #include <string>
+#include <thread>
+#include <tuple>
 
 #include <inttypes.h>
 #include <signal.h>
@@ -57,7 +59,8 @@ namespace {
 using ::perfetto::protos::pbzero::ProfilePacket;
 
 constexpr char kHeapprofdDataSource[] = "android.heapprofd";
-constexpr size_t kUnwinderThreads = 5;
+constexpr size_t kMinUnwinderThreads = 2;
+constexpr size_t kMaxUnwinderThreads = 16;
 
 constexpr uint32_t kInitialConnectionBackoffMs = 100;
 constexpr uint32_t kMaxConnectionBackoffMs = 30 * 1000;
@@ -72,6 +75,15 @@ constexpr uint64_t kMaxShmemSize = 500 * 1048576;    // ~500 MB
 constexpr int kProfilingSignal = __SIGRTMIN + 4;
 constexpr int kHeapprofdSignalValue = 0;
 
+// A child heapprofd only ever unwinds its parent process, the central one
+// gets a thread per core.
+size_t NumUnwinderThreads(HeapprofdMode mode) {
+  if (mode == HeapprofdMode::kChild)
+    return 1;
+  size_t cores = std::thread::hardware_concurrency();
+  return std::min(std::max(cores, kMinUnwinderThreads), kMaxUnwinderThreads);
+}
+
 std::vector<UnwindingWorker> MakeUnwindingWorkers(HeapprofdProducer* delegate,
                                                   size_t n) {
   std::vector<UnwindingWorker> ret;
@@ -144,6 +156,8 @@ bool HeapprofdConfigToClientConfiguration(
   cli_config->block_client_timeout_us =
       heapprofd_config.block_client_timeout_us();
   cli_config->all_heaps = heapprofd_config.all_heaps();
+  cli_config->frame_pointer_unwinding =
+      heapprofd_config.frame_pointer_unwinding();
   cli_config->adaptive_sampling_shmem_threshold =
       heapprofd_config.adaptive_sampling_shmem_threshold();
   cli_config->adaptive_sampling_max_sampling_interval_bytes =
@@ -204,15 +218,27 @@ bool HeapprofdConfigToClientConfiguration(
   return true;
 }
 
-// We create kUnwinderThreads unwinding threads. Bookkeeping is done on the main
-// thread.
+size_t LeastLoadedUnwinder(const std::vector<UnwinderLoad>& unwinders) {
+  PERFETTO_CHECK(!unwinders.empty());
+  auto it = std::min_element(
+      unwinders.begin(), unwinders.end(),
+      [](const UnwinderLoad& a, const UnwinderLoad& b) {
+        return std::tie(a.num_processes, a.unwinding_time_us) <
+               std::tie(b.num_processes, b.unwinding_time_us);
+      });
+  return static_cast<size_t>(it - unwinders.begin());
+}
+
+// We create NumUnwinderThreads() unwinding threads. Bookkeeping is done on the
+// main thread.
 HeapprofdProducer::HeapprofdProducer(HeapprofdMode mode,
                                      base::TaskRunner* task_runner,
                                      bool exit_when_done)
     : task_runner_(task_runner),
       mode_(mode),
       exit_when_done_(exit_when_done),
-      unwinding_workers_(MakeUnwindingWorkers(this, kUnwinderThreads)),
+      unwinding_workers_(MakeUnwindingWorkers(this, NumUnwinderThreads(mode))),
+      unwinder_loads_(unwinding_workers_.size()),
       socket_delegate_(this),
       weak_factory_(this) {
   CheckDataSourceCpuTask();
@@ -584,8 +610,41 @@ void HeapprofdProducer::StartDataSource(DataSourceInstanceID id,
   PERFETTO_DLOG("Started DataSource");
 }
 
-UnwindingWorker& HeapprofdProducer::UnwinderForPID(pid_t pid) {
-  return unwinding_workers_[static_cast<uint64_t>(pid) % kUnwinderThreads];
+UnwindingWorker* HeapprofdProducer::UnwinderForPID(pid_t pid) {
+  auto it = unwinder_for_pid_.find(pid);
+  if (it == unwinder_for_pid_.end())
+    return nullptr;
+  return &unwinding_workers_[it->second];
+}
+
+// Rather than sharding the processes by pid, which can leave a worker with
+// all the allocation-heavy ones while the others are idle, hand each one off
+// to the least loaded worker. The records of one process can't be spread
+// across workers: its UnwindingMetadata (maps, memory, caches) is only safe to
+// use from one thread, and the order of its records must be preserved.
+UnwindingWorker& HeapprofdProducer::AssignUnwinder(pid_t pid) {
+  size_t idx = LeastLoadedUnwinder(unwinder_loads_);
+  auto it_and_inserted = unwinder_for_pid_.emplace(pid, idx);
+  if (!it_and_inserted.second) {
+    // The previous process with this pid has not been released yet.
+    unwinder_loads_[it_and_inserted.first->second].num_processes--;
+    it_and_inserted.first->second = idx;
+  }
+  unwinder_loads_[idx].num_processes++;
+  return unwinding_workers_[idx];
+}
+
+void HeapprofdProducer::ReleaseUnwinder(UnwindingWorker* worker, pid_t pid) {
+  auto it = unwinder_for_pid_.find(pid);
+  // The pid might have been reused and handed off to another worker already.
+  if (it == unwinder_for_pid_.end() || it->second != UnwinderIndex(worker))
+    return;
+  unwinder_loads_[it->second].num_processes--;
+  unwinder_for_pid_.erase(it);
+}
+
+size_t HeapprofdProducer::UnwinderIndex(const UnwindingWorker* worker) const {
+  return static_cast<size_t>(worker - unwinding_workers_.data());
 }
 
 void HeapprofdProducer::StopDataSource(DataSourceInstanceID id) {
@@ -630,7 +689,9 @@ void HeapprofdProducer::ShutdownDataSource(DataSource* data_source) {
 
   for (const auto& pid_and_process_state : data_source->process_states) {
     pid_t pid = pid_and_process_state.first;
-    UnwinderForPID(pid).PostDisconnectSocket(pid);
+    UnwindingWorker* worker = UnwinderForPID(pid);
+    if (worker)
+      worker->PostDisconnectSocket(pid);
   }
 
   auto id = data_source->id;
@@ -710,11 +771,12 @@ void HeapprofdProducer::DumpProcessState(DataSource* data_source,
       heap_name = heap_info.heap_name.c_str();
     uint64_t sampling_interval = heap_info.sampling_interval;
     uint64_t orig_sampling_interval = heap_info.orig_sampling_interval;
+    bool incremental = data_source->config.incremental_dumps();
 
     auto new_heapsamples =
         [pid, from_startup, dump_timestamp, process_state, data_source,
-         heap_name, sampling_interval,
-         orig_sampling_interval](ProfilePacket::ProcessHeapSamples* proto) {
+         heap_name, sampling_interval, orig_sampling_interval,
+         incremental](ProfilePacket::ProcessHeapSamples* proto) {
           proto->set_pid(static_cast<uint64_t>(pid));
           proto->set_timestamp(dump_timestamp);
           proto->set_from_startup(from_startup);
@@ -729,6 +791,8 @@ void HeapprofdProducer::DumpProcessState(DataSource* data_source,
             proto->set_heap_name(heap_name);
           proto->set_sampling_interval_bytes(sampling_interval);
           proto->set_orig_sampling_interval_bytes(orig_sampling_interval);
+          if (incremental)
+            proto->set_incremental(true);
           auto* stats = proto->set_stats();
           SetStats(stats, *process_state);
         };
@@ -738,10 +802,16 @@ void HeapprofdProducer::DumpProcessState(DataSource* data_source,
                          &data_source->intern_state);
 
     heap_info.heap_tracker.GetCallstackAllocations(
-        [&dump_state,
-         &data_source](const HeapTracker::CallstackAllocations& alloc) {
+        [&dump_state, &data_source,
+         incremental](const HeapTracker::CallstackAllocations& alloc) {
+          if (incremental && !alloc.changed)
+            return;
           dump_state.WriteAllocation(alloc, data_source->config.dump_at_max());
         });
+    // Even if no callsite changed, the stats and the state of the process
+    // need to be in every dump.
+    if (incremental)
+      dump_state.WriteProcessHeader();
     dump_state.DumpCallstacks(&callsites_);
   }
 }
@@ -903,7 +973,7 @@ void HeapprofdProducer::SocketDelegate::OnDataAvailable(
     handoff_data.client_config = data_source.client_configuration;
     handoff_data.stream_allocations = data_source.config.stream_allocations();
 
-    producer_->UnwinderForPID(self->peer_pid_linux())
+    producer_->AssignUnwinder(self->peer_pid_linux())
         .PostHandoffSocket(std::move(handoff_data));
     producer_->pending_processes_.erase(it);
   } else if (fds[kHandshakeMaps] || fds[kHandshakeMem]) {
@@ -994,6 +1064,8 @@ void HeapprofdProducer::PostAllocRecord(
     std::unique_ptr<AllocRecord> unique_alloc_ref =
         std::unique_ptr<AllocRecord>(raw_alloc_rec);
     if (weak_this) {
+      weak_this->unwinder_loads_[weak_this->UnwinderIndex(worker)]
+          .unwinding_time_us += unique_alloc_ref->unwinding_time_us;
       weak_this->HandleAllocRecord(unique_alloc_ref.get());
       worker->ReturnAllocRecord(std::move(unique_alloc_ref));
     }
@@ -1024,14 +1096,16 @@ void HeapprofdProducer::PostHeapNameRecord(UnwindingWorker*,
   });
 }
 
-void HeapprofdProducer::PostSocketDisconnected(UnwindingWorker*,
+void HeapprofdProducer::PostSocketDisconnected(UnwindingWorker* worker,
                                                DataSourceInstanceID ds_id,
                                                pid_t pid,
                                                SharedRingBuffer::Stats stats) {
   auto weak_this = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_this, ds_id, pid, stats] {
-    if (weak_this)
-      weak_this->HandleSocketDisconnected(ds_id, pid, stats);
+  task_runner_->PostTask([weak_this, worker, ds_id, pid, stats] {
+    if (!weak_this)
+      return;
+    weak_this->ReleaseUnwinder(worker, pid);
+    weak_this->HandleSocketDisconnected(ds_id, pid, stats);
   });
 }
 
@@ -20,6 +20,7 @@
 #include <array>
 #include <functional>
 #include <map>
+#include <set>
 #include <vector>
 
 #include <inttypes.h>
@@ -68,6 +69,17 @@ bool HeapprofdConfigToClientConfiguration(
     const HeapprofdConfig& heapprofd_config,
     ClientConfiguration* cli_config);
 
+// The load of an UnwindingWorker, as tracked by the main thread.
+struct UnwinderLoad {
+  size_t num_processes = 0;
+  uint64_t unwinding_time_us = 0;
+};
+
+// Returns the index of the least loaded of |unwinders|: the one with the
+// fewest processes and, among those, the one that spent the least time
+// unwinding so far.
+size_t LeastLoadedUnwinder(const std::vector<UnwinderLoad>& unwinders);
+
 // Heap profiling producer. Can be instantiated in two modes, central and
 // child (also referred to as fork mode).
 //
@@ -267,7 +279,11 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   void DoContinuousDump(DataSourceInstanceID id, uint32_t dump_interval);
 
-  UnwindingWorker& UnwinderForPID(pid_t);
+  // Returns the worker |pid| was handed off to, or nullptr.
+  UnwindingWorker* UnwinderForPID(pid_t);
+  UnwindingWorker& AssignUnwinder(pid_t);
+  void ReleaseUnwinder(UnwindingWorker*, pid_t);
+  size_t UnwinderIndex(const UnwindingWorker*) const;
   bool IsPidProfiled(pid_t);
   DataSource* GetDataSourceForProcess(const Process& proc);
   void RecordOtherSourcesAsRejected(DataSource* active_ds, const Process& proc);
@@ -319,6 +335,12 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
   std::map<FlushRequestID, size_t> flushes_in_progress_;
   std::map<DataSourceInstanceID, DataSource> data_sources_;
   std::vector<UnwindingWorker> unwinding_workers_;
+  // Same size as |unwinding_workers_|.
+  std::vector<UnwinderLoad> unwinder_loads_;
+  // Index in |unwinding_workers_| of the worker each process was handed off
+  // to. A process stays on its worker until it disconnects, so that its
+  // records are unwound and posted in order.
+  std::map<pid_t, size_t> unwinder_for_pid_;
 
   // Specific to mode_ == kChild
   Process target_process_{base::kInvalidPid, ""};
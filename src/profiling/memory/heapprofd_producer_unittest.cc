@@ -68,6 +68,25 @@ TEST(LogHistogramTest, Overflow) {
   EXPECT_THAT(h.GetData(), Contains(Pair(LogHistogram::kMaxBucket, 1)));
 }
 
+TEST(LeastLoadedUnwinderTest, FewestProcesses) {
+  std::vector<UnwinderLoad> loads(3);
+  loads[0].num_processes = 1;
+  loads[1].num_processes = 2;
+  loads[2].num_processes = 0;
+  loads[2].unwinding_time_us = 1000;
+  EXPECT_EQ(LeastLoadedUnwinder(loads), 2u);
+}
+
+TEST(LeastLoadedUnwinderTest, LeastUnwindingTime) {
+  std::vector<UnwinderLoad> loads(3);
+  for (UnwinderLoad& load : loads)
+    load.num_processes = 1;
+  loads[0].unwinding_time_us = 5000;
+  loads[1].unwinding_time_us = 10;
+  loads[2].unwinding_time_us = 100;
+  EXPECT_EQ(LeastLoadedUnwinder(loads), 1u);
+}
+
 TEST(HeapprofdProducerTest, ExposesDataSource) {
   base::TestTaskRunner task_runner;
   HeapprofdProducer producer(HeapprofdMode::kCentral, &task_runner,
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/profiling/memory/sampled_address_set.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+uint64_t Digest(uint32_t heap_id, uint64_t addr) {
+  uint64_t key = addr ^ (static_cast<uint64_t>(heap_id) * 0x9E3779B97F4A7C15u);
+  // Keep clear of the values that mark free slots. This is one more collision,
+  // which is harmless.
+  return key > 1 ? key : 2;
+}
+
+// Finalizer of MurmurHash3, so that the addresses of consecutive allocations
+// do not end up in consecutive slots.
+size_t SlotIndex(uint64_t digest) {
+  digest ^= digest >> 33;
+  digest *= 0xff51afd7ed558ccdu;
+  digest ^= digest >> 33;
+  digest *= 0xc4ceb9fe1a85ec53u;
+  digest ^= digest >> 33;
+  return static_cast<size_t>(digest);
+}
+
+}  // namespace
+
+SampledAddressSet::SampledAddressSet()
+    : mem_(base::PagedMemory::Allocate(kNumSlots * sizeof(uint64_t),
+                                       base::PagedMemory::kMayFail)) {
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                "std::atomic<uint64_t> needs to be usable in place.");
+  if (!mem_.IsValid()) {
+    // Fall back to sending all the frees.
+    overflowed_.store(true, std::memory_order_relaxed);
+    return;
+  }
+  // The mapping is zeroed, i.e. all slots are kEmpty.
+  slots_ = reinterpret_cast<std::atomic<uint64_t>*>(mem_.Get());
+}
+
+void SampledAddressSet::Add(uint32_t heap_id, uint64_t addr) {
+  if (overflowed())
+    return;
+  const uint64_t digest = Digest(heap_id, addr);
+  const size_t start = SlotIndex(digest);
+  for (size_t i = 0; i < kMaxProbes; ++i) {
+    std::atomic<uint64_t>* s = slot(start + i);
+    uint64_t cur = s->load(std::memory_order_relaxed);
+    while (cur == kEmpty || cur == kTombstone) {
+      if (s->compare_exchange_weak(cur, digest, std::memory_order_relaxed))
+        return;
+    }
+  }
+  overflowed_.store(true, std::memory_order_release);
+}
+
+bool SampledAddressSet::Remove(uint32_t heap_id, uint64_t addr) {
+  if (!slots_)
+    return true;
+  const uint64_t digest = Digest(heap_id, addr);
+  const size_t start = SlotIndex(digest);
+  for (size_t i = 0; i < kMaxProbes; ++i) {
+    std::atomic<uint64_t>* s = slot(start + i);
+    uint64_t cur = s->load(std::memory_order_relaxed);
+    // Slots never become empty again, so the digest cannot be further.
+    if (cur == kEmpty)
+      break;
+    if (cur == digest &&
+        s->compare_exchange_strong(cur, kTombstone,
+                                   std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return overflowed();
+}
+
+}  // namespace profiling
+}  // namespace perfetto
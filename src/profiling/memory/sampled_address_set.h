@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_PROFILING_MEMORY_SAMPLED_ADDRESS_SET_H_
+#define SRC_PROFILING_MEMORY_SAMPLED_ADDRESS_SET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "perfetto/ext/base/paged_memory.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Lock-free set of the sampled allocations of a client, so that it only sends
+// the frees of those: heapprofd ignores the others after looking them up.
+//
+// This is an open addressing hash table over a fixed mmap-ed region, as it is
+// used from within the malloc hooks. The entries are digests of the heap id and
+// address; a collision of two live digests only makes a free be sent that
+// heapprofd will ignore. Removed entries become tombstones, which get reused
+// by later insertions.
+//
+// If an allocation does not fit within kMaxProbes slots of its hash, the set
+// becomes overflowed, and from then on all frees have to be sent.
+//
+// Relies on the free of an allocation being reported before the memory is
+// released, so that its removal cannot race with the insertion of a new
+// allocation at the same address.
+class SampledAddressSet {
+ public:
+  static constexpr size_t kNumSlots = 1 << 17;  // 1 MiB.
+  static constexpr size_t kMaxProbes = 64;
+
+  SampledAddressSet();
+
+  // Thread-safe.
+  void Add(uint32_t heap_id, uint64_t addr);
+  // Thread-safe. Returns whether |addr| needs to be reported as freed, i.e. if
+  // it was in the set or if the set has overflowed.
+  bool Remove(uint32_t heap_id, uint64_t addr);
+
+  bool overflowed() const {
+    return overflowed_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr uint64_t kEmpty = 0;
+  static constexpr uint64_t kTombstone = 1;
+
+  std::atomic<uint64_t>* slot(size_t i) {
+    return &slots_[i & (kNumSlots - 1)];
+  }
+
+  base::PagedMemory mem_;
+  std::atomic<uint64_t>* slots_ = nullptr;
+  // Matched by the acquire in overflowed(), so that a free reported after its
+  // allocation failed to be added is sent.
+  std::atomic<bool> overflowed_{false};
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_MEMORY_SAMPLED_ADDRESS_SET_H_
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/profiling/memory/sampled_address_set.h"
+
+#include <thread>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+TEST(SampledAddressSetTest, AddRemove) {
+  SampledAddressSet set;
+  set.Add(0, 0x1000);
+  set.Add(1, 0x2000);
+  EXPECT_FALSE(set.Remove(0, 0x3000));
+  // The heap is part of the key.
+  EXPECT_FALSE(set.Remove(1, 0x1000));
+  EXPECT_TRUE(set.Remove(0, 0x1000));
+  EXPECT_FALSE(set.Remove(0, 0x1000));
+  EXPECT_TRUE(set.Remove(1, 0x2000));
+  EXPECT_FALSE(set.overflowed());
+}
+
+TEST(SampledAddressSetTest, ReuseAfterRemove) {
+  SampledAddressSet set;
+  for (int round = 0; round < 4; ++round) {
+    for (uint64_t i = 0; i < SampledAddressSet::kNumSlots / 2; ++i)
+      set.Add(0, 0x10000 + i * 16);
+    for (uint64_t i = 0; i < SampledAddressSet::kNumSlots / 2; ++i)
+      ASSERT_TRUE(set.Remove(0, 0x10000 + i * 16));
+  }
+  EXPECT_FALSE(set.overflowed());
+  EXPECT_FALSE(set.Remove(0, 0x10000));
+}
+
+TEST(SampledAddressSetTest, Overflow) {
+  SampledAddressSet set;
+  for (uint64_t i = 0; i < SampledAddressSet::kNumSlots; ++i)
+    set.Add(0, 0x10000 + i * 16);
+  ASSERT_TRUE(set.overflowed());
+  // All frees have to be sent once an allocation might be missing.
+  EXPECT_TRUE(set.Remove(0, 0x1));
+}
+
+TEST(SampledAddressSetTest, MultiThreaded) {
+  SampledAddressSet set;
+  constexpr uint64_t kNumThreads = 4;
+  constexpr uint64_t kNumAddrs = 10000;
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&set, t] {
+      for (uint64_t i = 0; i < kNumAddrs; ++i) {
+        uint64_t addr = (t * kNumAddrs + i) * 16;
+        set.Add(0, addr);
+        EXPECT_TRUE(set.Remove(0, addr));
+        EXPECT_FALSE(set.Remove(0, addr + 8));
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  EXPECT_FALSE(set.overflowed());
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -16,6 +16,8 @@
 
 #include "src/profiling/memory/sampler.h"
 
+#include <cmath>
+
 namespace perfetto {
 namespace profiling {
 
@@ -35,15 +37,9 @@ uint64_t GetPassthroughThreshold(uint64_t interval) {
   return 1 + uint64_t(log(kPassthroughError) / log(1.0 - 1 / double(interval)));
 }
 
-std::default_random_engine& GetGlobalRandomEngineLocked() {
-  static std::default_random_engine engine;
-  return engine;
-}
-
 void Sampler::SetSamplingInterval(uint64_t sampling_interval) {
   sampling_interval_ = sampling_interval;
   passthrough_threshold_ = GetPassthroughThreshold(sampling_interval_);
-  sampling_rate_ = 1.0 / static_cast<double>(sampling_interval_);
   interval_to_next_sample_ = NextSampleInterval();
 }
 
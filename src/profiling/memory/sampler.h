@@ -18,20 +18,35 @@
 #define SRC_PROFILING_MEMORY_SAMPLER_H_
 
 #include <stdint.h>
-
-#include <atomic>
-#include <random>
+#include <string.h>
 
 #include "perfetto/ext/base/utils.h"
 
 namespace perfetto {
 namespace profiling {
 
-constexpr uint64_t kSamplerSeed = 1;
+constexpr uint64_t kSamplerSeed = 0x9e3779b97f4a7c15;
 
 uint64_t GetPassthroughThreshold(uint64_t interval);
 
-std::default_random_engine& GetGlobalRandomEngineLocked();
+// Approximation of log2(x) for finite x > 0, with an absolute error below
+// 1.2e-4. This is much cheaper than std::log2.
+inline double FastLog2(double x) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  int64_t exponent = static_cast<int64_t>((bits >> 52) & 0x7ff) - 1023;
+  // Set the exponent to 0, so m is the mantissa in [1, 2).
+  bits = (bits & ((uint64_t(1) << 52) - 1)) | (uint64_t(1023) << 52);
+  double m;
+  memcpy(&m, &bits, sizeof(m));
+  // Least squares fit of log2(1 + t) for t in [0, 1).
+  double t = m - 1.0;
+  double log2_m =
+      t * (1.438638025890075 +
+           t * (-0.677743266550244 +
+                t * (0.32187970686382905 + t * -0.08286069822542842)));
+  return static_cast<double>(exponent) + log2_m;
+}
 
 // Poisson sampler for memory allocations. We apply sampling individually to
 // each byte. The whole allocation gets accounted as often as the number of
@@ -41,11 +56,16 @@ std::default_random_engine& GetGlobalRandomEngineLocked();
 // https://cs.chromium.org/search/?q=f:cc+symbol:AllocatorShimLogAlloc+package:%5Echromium$&type=cs
 // Googlers: see go/chrome-shp for more details.
 //
+// Every Sampler has its own pseudo-random number generator, so sampling does
+// not contend with other heaps.
+//
 // NB: not thread-safe, requires external synchronization.
 class Sampler {
  public:
   void SetSamplingInterval(uint64_t sampling_interval);
 
+  void SetSeedForTesting(uint64_t seed) { rnd_state_ = seed; }
+
   // Returns number of bytes that should be be attributed to the sample.
   // If returned size is 0, the allocation should not be sampled.
   //
@@ -60,9 +80,24 @@ class Sampler {
   uint64_t sampling_interval() const { return sampling_interval_; }
 
  private:
+  // xorshift64*. Period 2^64 - 1, the state must not be 0.
+  uint64_t NextRandom() {
+    rnd_state_ ^= rnd_state_ >> 12;
+    rnd_state_ ^= rnd_state_ << 25;
+    rnd_state_ ^= rnd_state_ >> 27;
+    return rnd_state_ * 2685821657736338717ull;
+  }
+
   int64_t NextSampleInterval() {
-    std::exponential_distribution<double> dist(sampling_rate_);
-    int64_t next = static_cast<int64_t>(dist(GetGlobalRandomEngineLocked()));
+    // Draw from the exponential distribution with the mean sampling_interval_
+    // by applying its inverse CDF, -ln(u) * sampling_interval_, to u uniformly
+    // distributed in (0, 1]. u = q / 2^32 for q in [1, 2^32], so
+    // -ln(u) = (32 - log2(q)) * ln(2). This caps the interval at ~22 times
+    // the mean, which only cuts off a probability of e^-22.
+    double q = static_cast<double>(NextRandom() >> 32) + 1.0;
+    double interval = (32.0 - FastLog2(q)) * 0.6931471805599453 *
+                      static_cast<double>(sampling_interval_);
+    int64_t next = static_cast<int64_t>(interval);
     // We approximate the geometric distribution using an exponential
     // distribution.
     // We need to add 1 because that gives us the number of failures before
@@ -84,8 +119,8 @@ class Sampler {
 
   uint64_t sampling_interval_;
   uint64_t passthrough_threshold_;
-  double sampling_rate_;
   int64_t interval_to_next_sample_;
+  uint64_t rnd_state_ = kSamplerSeed;
 };
 
 }  // namespace profiling
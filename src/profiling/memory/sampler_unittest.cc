@@ -16,6 +16,7 @@
 
 #include "src/profiling/memory/sampler.h"
 
+#include <cmath>
 #include <thread>
 
 #include "test/gtest_and_gmock.h"
@@ -25,21 +26,19 @@ namespace profiling {
 namespace {
 
 TEST(SamplerTest, TestLarge) {
-  GetGlobalRandomEngineLocked().seed(1);
   Sampler sampler;
   sampler.SetSamplingInterval(32768);
   EXPECT_EQ(sampler.SampleSize(160000u), 160000u);
 }
 
 TEST(SamplerTest, TestSmall) {
-  GetGlobalRandomEngineLocked().seed(1);
   Sampler sampler;
+  sampler.SetSeedForTesting(2);
   sampler.SetSamplingInterval(512);
   EXPECT_EQ(sampler.SampleSize(511), 512u);
 }
 
 TEST(SamplerTest, TestSequence) {
-  GetGlobalRandomEngineLocked().seed(1);
   Sampler sampler;
   sampler.SetSamplingInterval(1);
   EXPECT_EQ(sampler.SampleSize(3), 3u);
@@ -47,6 +46,20 @@ TEST(SamplerTest, TestSequence) {
   EXPECT_EQ(sampler.SampleSize(5), 5u);
 }
 
+TEST(SamplerTest, TestMean) {
+  Sampler sampler;
+  sampler.SetSamplingInterval(4096);
+  uint64_t total = 0;
+  for (size_t i = 0; i < 1000000; ++i)
+    total += sampler.SampleSize(64);
+  EXPECT_NEAR(static_cast<double>(total), 64e6, 64e6 * 0.02);
+}
+
+TEST(SamplerTest, TestFastLog2) {
+  for (double x = 1; x < 1e10; x *= 1.01)
+    EXPECT_NEAR(FastLog2(x), std::log2(x), 1.2e-4);
+}
+
 TEST(SamplerTest, TestGetPassthroughThreshold) {
   EXPECT_EQ(GetPassthroughThreshold(32768u), 150900u);
   EXPECT_EQ(GetPassthroughThreshold(1u), 1u);
@@ -17,6 +17,7 @@
 #include "src/profiling/memory/shared_ring_buffer.h"
 
 #include <atomic>
+#include <limits>
 #include <type_traits>
 
 #include <errno.h>
@@ -45,6 +46,13 @@ constexpr auto kMetaPageSize = base::kPageSize;
 constexpr auto kAlignment = 8;  // 64 bits to use aligned memcpy().
 constexpr auto kHeaderSize = kAlignment;
 constexpr auto kGuardSize = base::kPageSize * 1024 * 16;  // 64 MB.
+
+// The header of a record holds its size in the low 32 bits (the first four
+// bytes) and a tag derived from its position in the high 32 bits.
+inline uint64_t MakeHeader(uint64_t pos, size_t size) {
+  uint64_t tag = static_cast<uint32_t>(pos / kAlignment);
+  return (tag << 32) | static_cast<uint32_t>(size);
+}
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
 constexpr auto kFDSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
 #endif
@@ -100,6 +108,8 @@ SharedRingBuffer::~SharedRingBuffer() {
                 "MetadataPage must be trivially constructible");
   static_assert(std::is_trivially_destructible<MetadataPage>::value,
                 "MetadataPage must be trivially destructible");
+  static_assert(sizeof(MetadataPage) <= kMetaPageSize,
+                "MetadataPage must fit in the metadata page");
 
   if (is_valid()) {
     size_t outer_size = kMetaPageSize + size_ * 2 + kGuardSize;
@@ -181,52 +191,48 @@ void SharedRingBuffer::Initialize(base::ScopedFile mem_fd) {
   mem_fd_ = std::move(mem_fd);
 }
 
-SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(
-    const ScopedSpinlock& spinlock,
-    size_t size) {
-  PERFETTO_DCHECK(spinlock.locked());
+SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(size_t size) {
   Buffer result;
 
-  base::Optional<PointerPositions> opt_pos = GetPointerPositions();
-  if (!opt_pos) {
-    meta_->stats.num_writes_corrupt++;
-    errno = EBADF;
-    return result;
-  }
-  auto pos = opt_pos.value();
-
   const uint64_t size_with_header =
       base::AlignUp<kAlignment>(size + kHeaderSize);
 
-  // size_with_header < size is for catching overflow of size_with_header.
-  if (PERFETTO_UNLIKELY(size_with_header < size)) {
+  // size_with_header < size is for catching overflow of size_with_header. The
+  // size also has to fit in the header.
+  if (PERFETTO_UNLIKELY(size_with_header < size ||
+                        size > std::numeric_limits<uint32_t>::max())) {
     errno = EINVAL;
     return result;
   }
 
-  if (size_with_header > write_avail(pos)) {
-    meta_->stats.num_writes_overflow++;
-    errno = EAGAIN;
-    return result;
-  }
-
-  uint8_t* wr_ptr = at(pos.write_pos);
+  PointerPositions pos;
+  pos.write_pos = meta_->write_pos.load(std::memory_order_relaxed);
+  do {
+    // This needs to acquire, so the data the reader consumed before advancing
+    // read_pos does not get overwritten before it is done with it. This is
+    // matched by the release in EndRead.
+    pos.read_pos = meta_->read_pos.load(std::memory_order_acquire);
+    if (IsCorrupt(pos)) {
+      WriteStat(&meta_->stats.num_writes_corrupt)->fetch_add(1);
+      errno = EBADF;
+      return result;
+    }
+    if (size_with_header > write_avail(pos)) {
+      WriteStat(&meta_->stats.num_writes_overflow)->fetch_add(1);
+      errno = EAGAIN;
+      return result;
+    }
+    // On failure, this reloads write_pos, which another writer advanced.
+  } while (!meta_->write_pos.compare_exchange_weak(
+      pos.write_pos, pos.write_pos + size_with_header,
+      std::memory_order_relaxed));
 
   result.size = size;
-  result.data = wr_ptr + kHeaderSize;
+  result.data = at(pos.write_pos) + kHeaderSize;
   result.bytes_free = write_avail(pos);
-  meta_->stats.bytes_written += size;
-  meta_->stats.num_writes_succeeded++;
-
-  // We can make this a relaxed store, as this gets picked up by the acquire
-  // load in GetPointerPositions (and the release store below).
-  reinterpret_cast<std::atomic<uint32_t>*>(wr_ptr)->store(
-      0, std::memory_order_relaxed);
-
-  // This needs to happen after the store above, so the reader never observes an
-  // incorrect byte count. This is matched by the acquire load in
-  // GetPointerPositions.
-  meta_->write_pos.fetch_add(size_with_header, std::memory_order_release);
+  result.pos = pos.write_pos;
+  WriteStat(&meta_->stats.bytes_written)->fetch_add(size);
+  WriteStat(&meta_->stats.num_writes_succeeded)->fetch_add(1);
   return result;
 }
 
@@ -240,9 +246,9 @@ void SharedRingBuffer::EndWrite(Buffer buf) {
   // between the BeginWrite and EndWrite calls.
   //
   // This is matched by the acquire load in BeginRead where it reads the
-  // record's size.
-  reinterpret_cast<std::atomic<uint32_t>*>(wr_ptr)->store(
-      static_cast<uint32_t>(buf.size), std::memory_order_release);
+  // record's header.
+  reinterpret_cast<std::atomic<uint64_t>*>(wr_ptr)->store(
+      MakeHeader(buf.pos, buf.size), std::memory_order_release);
 }
 
 SharedRingBuffer::Buffer SharedRingBuffer::BeginRead() {
@@ -264,9 +270,12 @@ SharedRingBuffer::Buffer SharedRingBuffer::BeginRead() {
 
   uint8_t* rd_ptr = at(pos.read_pos);
   PERFETTO_DCHECK(reinterpret_cast<uintptr_t>(rd_ptr) % kAlignment == 0);
-  const size_t size = reinterpret_cast<std::atomic<uint32_t>*>(rd_ptr)->load(
-      std::memory_order_acquire);
-  if (size == 0) {
+  const uint64_t header =
+      reinterpret_cast<std::atomic<uint64_t>*>(rd_ptr)->load(
+          std::memory_order_acquire);
+  const size_t size = static_cast<uint32_t>(header);
+  // The record was reserved, but its writer has not called EndWrite yet.
+  if (size == 0 || header != MakeHeader(pos.read_pos, size)) {
     meta_->stats.num_reads_nodata++;
     errno = EAGAIN;
     return Buffer();
@@ -292,7 +301,11 @@ void SharedRingBuffer::EndRead(Buffer buf) {
   if (!buf)
     return;
   size_t size_with_header = base::AlignUp<kAlignment>(buf.size + kHeaderSize);
-  meta_->read_pos.fetch_add(size_with_header, std::memory_order_relaxed);
+  // Clear the header, so it cannot be taken for the one of a later record at
+  // the same offset.
+  reinterpret_cast<std::atomic<uint64_t>*>(buf.data - kHeaderSize)
+      ->store(0, std::memory_order_relaxed);
+  meta_->read_pos.fetch_add(size_with_header, std::memory_order_release);
   meta_->stats.num_reads_succeeded++;
 }
 
@@ -44,12 +44,18 @@ namespace profiling {
 // - Reads are atomic, no fragmentation.
 // - The reader sees writes in write order (% discarding).
 //
+// Writers do not take a lock: BeginWrite reserves the space of a record by
+// advancing the write pointer with a compare-and-swap, and EndWrite commits it
+// by storing its header. The header holds the size of the record and a tag
+// derived from its position, so that the reader can tell a committed record
+// from a stale header of a previous lap of the buffer. The reader stops at the
+// first record that is reserved but not committed yet.
+//
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 // *IMPORTANT*: The ring buffer must be written under the assumption that the
-// other end modifies arbitrary shared memory without holding the spin-lock.
-// This means we must make local copies of read and write pointers for doing
-// bounds checks followed by reads / writes, as they might change in the
-// meantime.
+// other end modifies arbitrary shared memory at any time. This means we must
+// make local copies of read and write pointers for doing bounds checks
+// followed by reads / writes, as they might change in the meantime.
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 //
 // TODO:
@@ -73,6 +79,8 @@ class SharedRingBuffer {
     uint8_t* data = nullptr;
     size_t size = 0;
     uint64_t bytes_free = 0;
+    // Position of the record in the buffer, set by BeginWrite.
+    uint64_t pos = 0;
   };
 
   enum ErrorState : uint64_t {
@@ -92,6 +100,7 @@ class SharedRingBuffer {
     PERFETTO_CROSS_ABI_ALIGNED(uint64_t) num_reads_nodata;
 
     // Fields below get set by GetStats as copies of atomics in MetadataPage.
+    // No longer incremented, as the writers do not take the spinlock.
     PERFETTO_CROSS_ABI_ALIGNED(uint64_t) failed_spinlocks;
     PERFETTO_CROSS_ABI_ALIGNED(uint64_t) client_spinlock_blocked_us;
     PERFETTO_CROSS_ABI_ALIGNED(ErrorState) error_state;
@@ -116,15 +125,23 @@ class SharedRingBuffer {
     return write_avail(*pos);
   }
 
-  Buffer BeginWrite(const ScopedSpinlock& spinlock, size_t size);
+  // Thread-safe, can be called concurrently by any number of writers.
+  Buffer BeginWrite(size_t size);
   void EndWrite(Buffer buf);
 
   Buffer BeginRead();
   void EndRead(Buffer);
 
-  Stats GetStats(ScopedSpinlock& spinlock) {
-    PERFETTO_DCHECK(spinlock.locked());
+  Stats GetStats() {
     Stats stats = meta_->stats;
+    // The write stats are incremented concurrently by the writers.
+    stats.bytes_written = WriteStat(&meta_->stats.bytes_written)->load();
+    stats.num_writes_succeeded =
+        WriteStat(&meta_->stats.num_writes_succeeded)->load();
+    stats.num_writes_corrupt =
+        WriteStat(&meta_->stats.num_writes_corrupt)->load();
+    stats.num_writes_overflow =
+        WriteStat(&meta_->stats.num_writes_overflow)->load();
     stats.failed_spinlocks =
         meta_->failed_spinlocks.load(std::memory_order_relaxed);
     stats.error_state = meta_->error_state.load(std::memory_order_relaxed);
@@ -135,16 +152,6 @@ class SharedRingBuffer {
 
   void SetErrorState(ErrorState error) { meta_->error_state.store(error); }
 
-  // This is used by the caller to be able to hold the SpinLock after
-  // BeginWrite has returned. This is so that additional bookkeeping can be
-  // done under the lock. This will be used to increment the sequence_number.
-  ScopedSpinlock AcquireLock(ScopedSpinlock::Mode mode) {
-    auto lock = ScopedSpinlock(&meta_->spinlock, mode);
-    if (PERFETTO_UNLIKELY(!lock.locked()))
-      meta_->failed_spinlocks.fetch_add(1, std::memory_order_relaxed);
-    return lock;
-  }
-
   void AddClientSpinlockBlockedUs(size_t n) {
     meta_->client_spinlock_blocked_us.fetch_add(n, std::memory_order_relaxed);
   }
@@ -169,6 +176,26 @@ class SharedRingBuffer {
     return meta_->reader_paused.exchange(false, std::memory_order_relaxed);
   }
 
+  // Fingerprints of the callstacks the reader can resolve without their
+  // payload, in a direct-mapped table the writers can check without locking.
+  // Only the reader changes the table.
+  static constexpr size_t kInternedCallstackSlots = 256;
+
+  bool IsCallstackInterned(uint64_t fingerprint) {
+    return meta_->interned_callstacks[fingerprint % kInternedCallstackSlots]
+               .load(std::memory_order_relaxed) == fingerprint;
+  }
+
+  void SetCallstackInterned(uint64_t fingerprint) {
+    meta_->interned_callstacks[fingerprint % kInternedCallstackSlots].store(
+        fingerprint, std::memory_order_relaxed);
+  }
+
+  void ClearInternedCallstacks() {
+    for (std::atomic<uint64_t>& slot : meta_->interned_callstacks)
+      slot.store(0, std::memory_order_relaxed);
+  }
+
   void InfiniteBufferForTesting() {
     // Pretend this buffer is really large, while keeping size_mask_ as
     // original so it keeps wrapping in circles.
@@ -179,6 +206,7 @@ class SharedRingBuffer {
   struct MetadataPage {
     static_assert(std::is_trivially_constructible<Spinlock>::value,
                   "Spinlock needs to be trivially constructible.");
+    // Unused since the writers are lock-free. Kept for the layout of the page.
     alignas(8) Spinlock spinlock;
     PERFETTO_CROSS_ABI_ALIGNED(std::atomic<uint64_t>) read_pos;
     PERFETTO_CROSS_ABI_ALIGNED(std::atomic<uint64_t>) write_pos;
@@ -189,16 +217,19 @@ class SharedRingBuffer {
     PERFETTO_CROSS_ABI_ALIGNED(std::atomic<ErrorState>) error_state;
     alignas(sizeof(uint64_t)) std::atomic<bool> shutting_down;
     alignas(sizeof(uint64_t)) std::atomic<bool> reader_paused;
-    // For stats that are only accessed by a single thread or under the
-    // spinlock, members of this struct are directly modified. Other stats use
-    // the atomics above this struct.
+    // For stats that are only accessed by the reader, members of this struct
+    // are directly modified. The write stats are modified atomically through
+    // WriteStat. Other stats use the atomics above this struct.
     //
     // When the user requests stats, the atomics above get copied into this
     // struct, which is then returned.
     alignas(sizeof(uint64_t)) Stats stats;
+    // 0 is never a valid fingerprint, so the zeroed table is empty.
+    PERFETTO_CROSS_ABI_ALIGNED(std::atomic<uint64_t>)
+    interned_callstacks[kInternedCallstackSlots];
   };
 
-  static_assert(sizeof(MetadataPage) == 144,
+  static_assert(sizeof(MetadataPage) == 144 + 8 * kInternedCallstackSlots,
                 "metadata page size needs to be ABI independent");
 
  private:
@@ -219,14 +250,17 @@ class SharedRingBuffer {
   void Initialize(base::ScopedFile mem_fd);
   bool IsCorrupt(const PointerPositions& pos);
 
+  static std::atomic<uint64_t>* WriteStat(uint64_t* stat) {
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                  "std::atomic<uint64_t> needs to be usable in place.");
+    return reinterpret_cast<std::atomic<uint64_t>*>(stat);
+  }
+
   inline base::Optional<PointerPositions> GetPointerPositions() {
     PointerPositions pos;
-    // We need to acquire load the write_pos to make sure we observe a
-    // consistent ring buffer in BeginRead, otherwise it is possible that we
-    // observe the write_pos increment, but not the size field write of the
-    // payload.
-    //
-    // This is matched by a release at the end of BeginWrite.
+    // Whether the records up to write_pos are complete is only known from
+    // their headers, which BeginRead loads with acquire semantics to match the
+    // release store in EndWrite.
     pos.write_pos = meta_->write_pos.load(std::memory_order_acquire);
     pos.read_pos = meta_->read_pos.load(std::memory_order_relaxed);
 
@@ -18,6 +18,9 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <deque>
+#include <vector>
+
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "src/profiling/memory/shared_ring_buffer.h"
@@ -42,7 +45,75 @@ size_t RoundToPow2(size_t v) {
   return static_cast<size_t>(x);
 }
 
+// Interprets the input as a sequence of operations of concurrent writers on a
+// valid buffer: reserving a record, committing one of the reserved records in
+// any order, or reading. Checks that the reader gets the committed records in
+// the order they were reserved.
+void FuzzRingBufferProtocol(const uint8_t* data, size_t size) {
+  constexpr size_t kMaxPending = 16;
+  auto buf = SharedRingBuffer::Create(base::kPageSize);
+  PERFETTO_CHECK(buf);
+
+  struct Pending {
+    SharedRingBuffer::Buffer buf;
+    uint8_t fill;
+    bool committed;
+  };
+  std::deque<Pending> pending;
+  uint8_t next_fill = 0;
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    uint8_t op = data[i];
+    uint8_t arg = data[i + 1];
+    switch (op % 3) {
+      case 0: {
+        if (pending.size() == kMaxPending)
+          break;
+        SharedRingBuffer::Buffer wr = buf->BeginWrite(1 + 16u * arg);
+        if (!wr)
+          break;
+        uint8_t fill = ++next_fill;
+        memset(wr.data, fill, wr.size);
+        pending.push_back({std::move(wr), fill, false});
+        break;
+      }
+      case 1: {
+        std::vector<Pending*> uncommitted;
+        for (Pending& p : pending) {
+          if (!p.committed)
+            uncommitted.push_back(&p);
+        }
+        if (uncommitted.empty())
+          break;
+        Pending* p = uncommitted[arg % uncommitted.size()];
+        // EndWrite takes the Buffer, keep a copy to check the read.
+        SharedRingBuffer::Buffer copy(p->buf.data, p->buf.size,
+                                      p->buf.bytes_free);
+        copy.pos = p->buf.pos;
+        buf->EndWrite(std::move(copy));
+        p->committed = true;
+        break;
+      }
+      case 2: {
+        auto read_buf = buf->BeginRead();
+        bool expect_read = !pending.empty() && pending.front().committed;
+        PERFETTO_CHECK(bool(read_buf) == expect_read);
+        if (!read_buf)
+          break;
+        const Pending& expected = pending.front();
+        PERFETTO_CHECK(read_buf.size == expected.buf.size);
+        for (size_t j = 0; j < read_buf.size; ++j)
+          PERFETTO_CHECK(read_buf.data[j] == expected.fill);
+        buf->EndRead(std::move(read_buf));
+        pending.pop_front();
+        break;
+      }
+    }
+  }
+}
+
 int FuzzRingBuffer(const uint8_t* data, size_t size) {
+  FuzzRingBufferProtocol(data, size);
+
   if (size <= sizeof(SharedRingBuffer::MetadataPage))
     return 0;
 
@@ -35,13 +35,7 @@ std::string ToString(const SharedRingBuffer::Buffer& buf_and_size) {
 }
 
 bool TryWrite(SharedRingBuffer* wr, const char* src, size_t size) {
-  SharedRingBuffer::Buffer buf;
-  {
-    auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
-    if (!lock.locked())
-      return false;
-    buf = wr->BeginWrite(lock, size);
-  }
+  SharedRingBuffer::Buffer buf = wr->BeginWrite(size);
   if (!buf)
     return false;
   memcpy(buf.data, src, size);
@@ -162,11 +156,7 @@ TEST(SharedRingBufferTest, WriteShutdown) {
   ASSERT_TRUE(rd);
   SharedRingBuffer wr =
       *SharedRingBuffer::Attach(base::ScopedFile(dup(rd->fd())));
-  SharedRingBuffer::Buffer buf;
-  {
-    auto lock = wr.AcquireLock(ScopedSpinlock::Mode::Blocking);
-    buf = wr.BeginWrite(lock, 10);
-  }
+  SharedRingBuffer::Buffer buf = wr.BeginWrite(10);
   rd = base::nullopt;
   memset(buf.data, 0, buf.size);
   wr.EndWrite(std::move(buf));
@@ -254,6 +244,46 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   reader_thread.join();
 }
 
+TEST(SharedRingBufferTest, OutOfOrderCommit) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  base::Optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
+  ASSERT_TRUE(wr);
+  SharedRingBuffer rd =
+      *SharedRingBuffer::Attach(base::ScopedFile(dup(wr->fd())));
+
+  SharedRingBuffer::Buffer first = wr->BeginWrite(4);
+  SharedRingBuffer::Buffer second = wr->BeginWrite(4);
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  memcpy(first.data, "foo", 4);
+  memcpy(second.data, "bar", 4);
+
+  // The reader has to wait for the first record, even if the second one is
+  // complete.
+  wr->EndWrite(std::move(second));
+  EXPECT_FALSE(rd.BeginRead());
+
+  wr->EndWrite(std::move(first));
+  {
+    auto buf_and_size = rd.BeginRead();
+    ASSERT_TRUE(buf_and_size);
+    EXPECT_EQ(ToString(buf_and_size), std::string("foo", 4));
+    rd.EndRead(std::move(buf_and_size));
+  }
+  {
+    auto buf_and_size = rd.BeginRead();
+    ASSERT_TRUE(buf_and_size);
+    EXPECT_EQ(ToString(buf_and_size), std::string("bar", 4));
+    rd.EndRead(std::move(buf_and_size));
+  }
+  EXPECT_FALSE(rd.BeginRead());
+
+  SharedRingBuffer::Stats stats = rd.GetStats();
+  EXPECT_EQ(stats.num_writes_succeeded, 2u);
+  EXPECT_EQ(stats.bytes_written, 8u);
+  EXPECT_EQ(stats.num_reads_succeeded, 2u);
+}
+
 TEST(SharedRingBufferTest, InvalidSize) {
   constexpr auto kBufSize = base::kPageSize * 4 + 1;
   base::Optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
@@ -264,12 +294,7 @@ TEST(SharedRingBufferTest, EmptyWrite) {
   constexpr auto kBufSize = base::kPageSize * 4;
   base::Optional<SharedRingBuffer> wr = SharedRingBuffer::Create(kBufSize);
   ASSERT_TRUE(wr);
-  SharedRingBuffer::Buffer buf;
-  {
-    auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
-    ASSERT_TRUE(lock.locked());
-    buf = wr->BeginWrite(lock, 0);
-  }
+  SharedRingBuffer::Buffer buf = wr->BeginWrite(0);
   EXPECT_TRUE(buf);
   wr->EndWrite(std::move(buf));
 }
@@ -16,9 +16,12 @@
 
 #include "src/profiling/memory/unwinding.h"
 
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/MachineArm64.h>
 #include <unwindstack/MachineRiscv64.h>
@@ -50,6 +53,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/thread_task_runner.h"
@@ -91,6 +95,91 @@ void ReadFromRawData(unwindstack::Regs* regs, void* raw_data) {
   memcpy(regs->RawData(), raw_data, GetRegsSize(regs));
 }
 
+bool IsSkippedMap(const std::string& map_name) {
+  size_t slash = map_name.rfind('/');
+  std::string basename =
+      slash == std::string::npos ? map_name : map_name.substr(slash + 1);
+  return std::find(kSkipMaps.begin(), kSkipMaps.end(), basename) !=
+         kSkipMaps.end();
+}
+
+bool IsExecutableMapping(unwindstack::MapInfo* map_info) {
+  return map_info && (map_info->flags() & PROT_EXEC);
+}
+
+// The frames of JIT and interpreted code can change for the same native stack.
+bool HasOnlyFileBackedFrames(
+    const std::vector<unwindstack::FrameData>& frames) {
+  for (const unwindstack::FrameData& frame : frames) {
+    const std::string& map_name = frame.map_name;
+    if ((frame.map_flags & PROT_EXEC) == 0 || map_name.empty() ||
+        map_name[0] != '/' || base::StartsWith(map_name, "/memfd:")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReparseMapsRateLimited(UnwindingMetadata* metadata) {
+  if (metadata->last_maps_reparse_time + kMapsReparseInterval >
+      base::GetWallTimeMs()) {
+    PERFETTO_DLOG("Skipping reparse due to rate limit.");
+    return false;
+  }
+  PERFETTO_DLOG("Reparsing maps");
+  metadata->ReparseMaps();
+  metadata->last_maps_reparse_time = base::GetWallTimeMs();
+  return true;
+}
+
+// The client already walked the frame pointers, so this only has to map the
+// return addresses to their functions.
+void SymbolizeFramePointerPcs(WireMessage* msg,
+                              UnwindingMetadata* metadata,
+                              unwindstack::Regs* regs,
+                              AllocRecord* out) {
+  // Like libunwindstack does for the non-leaf frames, point into the call
+  // instruction rather than to the one after it.
+  const uint64_t pc_adjustment =
+      regs->Arch() == unwindstack::ARCH_ARM64 ? 4 : 1;
+  size_t num_pcs = msg->payload_size / sizeof(uint64_t);
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (attempt > 0) {
+      if (!ReparseMapsRateLimited(metadata))
+        break;
+      out->reparsed_map = true;
+    }
+    unwindstack::Unwinder unwinder(kMaxFrames, &metadata->fd_maps, regs,
+                                   metadata->fd_mem);
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+    unwinder.SetJitDebug(metadata->GetJitDebug(regs->Arch()));
+    unwinder.SetDexFiles(metadata->GetDexFiles(regs->Arch()));
+#endif
+    out->frames.clear();
+    bool all_mapped = true;
+    for (size_t i = 0; i < num_pcs && out->frames.size() < kMaxFrames; ++i) {
+      uint64_t pc;
+      memcpy(&pc, msg->payload + i * sizeof(uint64_t), sizeof(pc));
+      pc -= pc_adjustment;
+      if (metadata->fd_maps.Find(pc) == nullptr)
+        all_mapped = false;
+      unwindstack::FrameData frame = unwinder.BuildFrameFromPcOnly(pc);
+      // Leave out the frames of the client library itself, like the DWARF
+      // unwind does.
+      if (out->frames.empty() && IsSkippedMap(frame.map_name))
+        continue;
+      frame.num = out->frames.size();
+      out->frames.emplace_back(std::move(frame));
+    }
+    if (all_mapped)
+      break;
+  }
+  out->build_ids.resize(out->frames.size());
+  for (size_t i = 0; i < out->frames.size(); ++i) {
+    out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
+  }
+}
+
 }  // namespace
 
 std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
@@ -127,7 +216,142 @@ std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
   return ret;
 }
 
-bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
+bool UnwindingCache::Find(WireMessage* msg,
+                          UnwindingMetadata* metadata,
+                          AllocRecord* out) {
+  if (reparses_ != metadata->reparses) {
+    // The same addresses can now belong to different libraries.
+    entries_.clear();
+    reparses_ = metadata->reparses;
+  }
+
+  AllocMetadata* alloc_metadata = msg->alloc_header;
+  std::unique_ptr<unwindstack::Regs> regs(CreateRegsFromRawData(
+      alloc_metadata->arch, alloc_metadata->register_data));
+  pending_ = false;
+  if (!regs)
+    return false;
+
+  base::Hash hash;
+  hash.Update(regs->pc());
+  hash.Update(static_cast<uint64_t>(msg->payload_size));
+  const size_t word_size = regs->Is32Bit() ? sizeof(uint32_t) : sizeof(uint64_t);
+  for (size_t off = 0; off + word_size <= msg->payload_size; off += word_size) {
+    uint64_t word = 0;
+    // Little endian, so this reads the 32-bit words correctly too.
+    memcpy(&word, msg->payload + off, word_size);
+    if (IsExecutableMapping(metadata->fd_maps.Find(word)))
+      hash.Update(word);
+  }
+  pending_fingerprint_ = hash.digest();
+  pending_pc_ = regs->pc();
+  pending_stack_size_ = msg->payload_size;
+  pending_ = true;
+
+  auto it = entries_.find(pending_fingerprint_);
+  if (it == entries_.end() || it->second.pc != pending_pc_ ||
+      it->second.stack_size != pending_stack_size_) {
+    return false;
+  }
+  out->frames = it->second.frames;
+  out->build_ids = it->second.build_ids;
+  pending_ = false;
+  return true;
+}
+
+void UnwindingCache::Insert(const AllocRecord& rec) {
+  if (!pending_ || rec.error || rec.frames.empty())
+    return;
+  pending_ = false;
+  if (!HasOnlyFileBackedFrames(rec.frames))
+    return;
+  if (entries_.size() >= kMaxEntries)
+    entries_.clear();
+  Entry& entry = entries_[pending_fingerprint_];
+  entry.pc = pending_pc_;
+  entry.stack_size = pending_stack_size_;
+  entry.frames = rec.frames;
+  entry.build_ids = rec.build_ids;
+}
+
+bool UnwindingCache::FindInterned(uint64_t fingerprint,
+                                  AllocRecord* out) const {
+  auto it = interned_.find(fingerprint);
+  if (it == interned_.end())
+    return false;
+  out->frames = it->second.frames;
+  out->build_ids = it->second.build_ids;
+  return true;
+}
+
+void UnwindingCache::Intern(uint64_t fingerprint,
+                            const AllocRecord& rec,
+                            SharedRingBuffer* shmem) {
+  if (rec.error || rec.frames.empty() || !HasOnlyFileBackedFrames(rec.frames))
+    return;
+  // The table is writable by the client, so the state of the slots is tracked
+  // here rather than read back from it.
+  size_t slot = fingerprint % SharedRingBuffer::kInternedCallstackSlots;
+  if (current_interned_[slot] != fingerprint) {
+    uint64_t evicted = previous_interned_[slot];
+    if (evicted != 0 && evicted != fingerprint)
+      interned_.erase(evicted);
+    previous_interned_[slot] = current_interned_[slot];
+    current_interned_[slot] = fingerprint;
+    Entry& entry = interned_[fingerprint];
+    entry.frames = rec.frames;
+    entry.build_ids = rec.build_ids;
+  }
+  shmem->SetCallstackInterned(fingerprint);
+}
+
+void UnwindingCache::ClearInterned(SharedRingBuffer* shmem) {
+  // The records already written with an interned callstack get an error
+  // frame.
+  shmem->ClearInternedCallstacks();
+  interned_.clear();
+  current_interned_.fill(0);
+  previous_interned_.fill(0);
+}
+
+bool DoUnwind(WireMessage* msg,
+              UnwindingMetadata* metadata,
+              AllocRecord* out,
+              UnwindingCache* cache) {
+  if (msg->alloc_header->interned_callstack) {
+    out->error = false;
+    out->reparsed_map = false;
+    uint64_t fingerprint;
+    if (cache && msg->payload_size == sizeof(fingerprint)) {
+      memcpy(&fingerprint, msg->payload, sizeof(fingerprint));
+      if (cache->FindInterned(fingerprint, out))
+        return true;
+    }
+    PERFETTO_DLOG("Unknown interned callstack");
+    unwindstack::FrameData frame_data{};
+    frame_data.function_name = "ERROR UNKNOWN INTERNED CALLSTACK";
+    frame_data.map_name = "ERROR";
+
+    out->frames.clear();
+    out->build_ids.clear();
+    out->frames.emplace_back(std::move(frame_data));
+    out->build_ids.emplace_back("");
+    out->error = true;
+    return false;
+  }
+  if (cache && !msg->alloc_header->frame_pointer_pcs) {
+    // |out| can be reused from an AllocRecordArena.
+    out->error = false;
+    out->reparsed_map = false;
+    if (cache->Find(msg, metadata, out))
+      return true;
+    bool success = DoUnwind(msg, metadata, out);
+    // A reparse happened while unwinding: the fingerprint was computed with
+    // the old maps.
+    if (success && !out->reparsed_map)
+      cache->Insert(*out);
+    return success;
+  }
   AllocMetadata* alloc_metadata = msg->alloc_header;
   std::unique_ptr<unwindstack::Regs> regs(CreateRegsFromRawData(
       alloc_metadata->arch, alloc_metadata->register_data));
@@ -144,6 +368,10 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
     out->error = true;
     return false;
   }
+  if (alloc_metadata->frame_pointer_pcs) {
+    SymbolizeFramePointerPcs(msg, metadata, regs.get(), out);
+    return true;
+  }
   uint8_t* stack = reinterpret_cast<uint8_t*>(msg->payload);
   std::shared_ptr<unwindstack::Memory> mems =
       std::make_shared<StackOverlayMemory>(metadata->fd_mem,
@@ -161,14 +389,8 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
   unwindstack::ErrorCode error_code = unwindstack::ERROR_NONE;
   for (int attempt = 0; attempt < 2; ++attempt) {
     if (attempt > 0) {
-      if (metadata->last_maps_reparse_time + kMapsReparseInterval >
-          base::GetWallTimeMs()) {
-        PERFETTO_DLOG("Skipping reparse due to rate limit.");
+      if (!ReparseMapsRateLimited(metadata))
         break;
-      }
-      PERFETTO_DLOG("Reparsing maps");
-      metadata->ReparseMaps();
-      metadata->last_maps_reparse_time = base::GetWallTimeMs();
       // Regs got invalidated by libuwindstack's speculative jump.
       // Reset.
       ReadFromRawData(regs.get(), alloc_metadata->register_data);
@@ -223,14 +445,7 @@ void UnwindingWorker::OnDisconnect(base::UnixSocket* self) {
     client_data.free_records.clear();
   }
 
-  SharedRingBuffer::Stats stats = {};
-  {
-    auto lock = shmem.AcquireLock(ScopedSpinlock::Mode::Try);
-    if (lock.locked())
-      stats = shmem.GetStats(lock);
-    else
-      PERFETTO_ELOG("Failed to log shmem to get stats.");
-  }
+  SharedRingBuffer::Stats stats = shmem.GetStats();
   DataSourceInstanceID ds_id = client_data.data_source_instance_id;
 
   client_data_.erase(it);
@@ -344,8 +559,19 @@ void UnwindingWorker::HandleBuffer(UnwindingWorker* self,
     rec->pid = peer_pid;
     rec->data_source_instance_id = data_source_instance_id;
     auto start_time_us = base::GetWallTimeNs() / 1000;
-    if (!client_data->stream_allocations)
-      DoUnwind(&msg, unwinding_metadata, rec.get());
+    if (!client_data->stream_allocations) {
+      UnwindingCache* cache = &client_data->unwinding_cache;
+      uint64_t reparses_before = unwinding_metadata->reparses;
+      DoUnwind(&msg, unwinding_metadata, rec.get(), cache);
+      // The same addresses can now belong to different libraries.
+      if (unwinding_metadata->reparses != reparses_before)
+        cache->ClearInterned(&client_data->shmem);
+      if (msg.alloc_header->frame_pointer_pcs &&
+          !msg.alloc_header->interned_callstack) {
+        cache->Intern(FingerprintFramePointerPcs(msg.payload, msg.payload_size),
+                      *rec, &client_data->shmem);
+      }
+    }
     rec->unwinding_time_us = static_cast<uint64_t>(
         ((base::GetWallTimeNs() / 1000) - start_time_us).count());
     delegate->PostAllocRecord(self, std::move(rec));
@@ -402,6 +628,7 @@ void UnwindingWorker::HandleHandoffSocket(HandoffData handoff_data) {
       std::move(handoff_data.client_config),
       handoff_data.stream_allocations,
       {},
+      {},
   };
   client_data.free_records.reserve(kRecordBatchSize);
   client_data.shmem.SetReaderPaused();
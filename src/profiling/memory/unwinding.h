@@ -19,6 +19,10 @@
 
 #include <unwindstack/Regs.h>
 
+#include <array>
+#include <unordered_map>
+#include <vector>
+
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/thread_task_runner.h"
@@ -35,7 +39,66 @@ std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
     unwindstack::ArchEnum arch,
     void* raw_data);
 
-bool DoUnwind(WireMessage*, UnwindingMetadata* metadata, AllocRecord* out);
+// Remembers the callstacks unwound for one process, as a few hundred callsites
+// usually account for most of the samples.
+//
+// The samples are matched on their pc, the depth of their stack and all the
+// words of their stack that point into an executable mapping, which include
+// the return addresses. Only the callstacks made of frames of executable files
+// are cached, as the JIT and interpreted frames can differ with the same
+// native stack.
+class UnwindingCache {
+ public:
+  static constexpr size_t kMaxEntries = 512;
+
+  // Returns false if there is no callstack for |msg|, in which case it has to
+  // be passed to Insert after unwinding it.
+  bool Find(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out);
+  void Insert(const AllocRecord& rec);
+
+  // Frame pointer callstacks the client sends as their
+  // FingerprintFramePointerPcs, once they are published in the table of its
+  // SharedRingBuffer. The callstack a slot of the table held last is kept too,
+  // for the records the client wrote before the slot got replaced.
+  bool FindInterned(uint64_t fingerprint, AllocRecord* out) const;
+  void Intern(uint64_t fingerprint,
+              const AllocRecord& rec,
+              SharedRingBuffer* shmem);
+  void ClearInterned(SharedRingBuffer* shmem);
+
+  size_t size() const { return entries_.size(); }
+  size_t interned_size() const { return interned_.size(); }
+
+ private:
+  struct Entry {
+    uint64_t pc;
+    uint64_t stack_size;
+    std::vector<unwindstack::FrameData> frames;
+    std::vector<std::string> build_ids;
+  };
+
+  // The state of the sample looked up last, which Insert refers to.
+  uint64_t pending_fingerprint_ = 0;
+  uint64_t pending_pc_ = 0;
+  uint64_t pending_stack_size_ = 0;
+  bool pending_ = false;
+
+  // Value of UnwindingMetadata::reparses the entries were unwound with.
+  uint64_t reparses_ = 0;
+  std::unordered_map<uint64_t, Entry> entries_;
+
+  std::unordered_map<uint64_t, Entry> interned_;
+  std::array<uint64_t, SharedRingBuffer::kInternedCallstackSlots>
+      current_interned_{};
+  std::array<uint64_t, SharedRingBuffer::kInternedCallstackSlots>
+      previous_interned_{};
+};
+
+// If |cache| is not null, it is checked before unwinding and updated after.
+bool DoUnwind(WireMessage*,
+              UnwindingMetadata* metadata,
+              AllocRecord* out,
+              UnwindingCache* cache = nullptr);
 
 // AllocRecords are expensive to construct and destruct. We have seen up to
 // 10 % of total CPU of heapprofd being used to destruct them. That is why
@@ -111,6 +174,7 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
     ClientConfiguration client_config;
     bool stream_allocations;
     std::vector<FreeRecord> free_records;
+    UnwindingCache unwinding_cache;
   };
 
   // public for testing/fuzzing
@@ -18,6 +18,7 @@
 
 #include <cxxabi.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unwindstack/RegsGetLocal.h>
@@ -177,6 +178,123 @@ TEST(UnwindingTest, DoUnwindReparse) {
                "namespace)::GetRecord(perfetto::profiling::WireMessage*)");
 }
 
+TEST(UnwindingTest, DoUnwindCached) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  base::ScopedFile proc_mem(base::OpenFile("/proc/self/mem", O_RDONLY));
+  UnwindingMetadata metadata(std::move(proc_maps), std::move(proc_mem));
+  UnwindingCache cache;
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  AllocRecord unwound;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &unwound, &cache));
+  ASSERT_GT(unwound.frames.size(), 0u);
+  ASSERT_EQ(cache.size(), 1u);
+
+  AllocRecord cached;
+  ASSERT_TRUE(cache.Find(&msg, &metadata, &cached));
+  ASSERT_EQ(cached.frames.size(), unwound.frames.size());
+  for (size_t i = 0; i < cached.frames.size(); ++i) {
+    EXPECT_EQ(cached.frames[i].pc, unwound.frames[i].pc);
+    EXPECT_EQ(cached.frames[i].function_name, unwound.frames[i].function_name);
+  }
+  EXPECT_EQ(cached.build_ids, unwound.build_ids);
+
+  // The addresses could now belong to other libraries.
+  metadata.ReparseMaps();
+  AllocRecord after_reparse;
+  EXPECT_FALSE(cache.Find(&msg, &metadata, &after_reparse));
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+AllocRecord MakeFramePointerRecord(uint64_t pc) {
+  AllocRecord rec;
+  unwindstack::FrameData frame{};
+  frame.pc = pc;
+  frame.function_name = "fun";
+  frame.map_name = "/system/lib64/libfoo.so";
+  frame.map_flags = PROT_READ | PROT_EXEC;
+  rec.frames.emplace_back(std::move(frame));
+  rec.build_ids.emplace_back("");
+  return rec;
+}
+
+TEST(UnwindingTest, DoUnwindInterned) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  base::ScopedFile proc_mem(base::OpenFile("/proc/self/mem", O_RDONLY));
+  UnwindingMetadata metadata(std::move(proc_maps), std::move(proc_mem));
+  auto shmem = SharedRingBuffer::Create(8 * base::kPageSize);
+  ASSERT_TRUE(shmem);
+  UnwindingCache cache;
+
+  constexpr uint64_t kSlots = SharedRingBuffer::kInternedCallstackSlots;
+  const uint64_t fingerprint = 7;
+  EXPECT_FALSE(shmem->IsCallstackInterned(fingerprint));
+  cache.Intern(fingerprint, MakeFramePointerRecord(0x1000), &*shmem);
+  EXPECT_TRUE(shmem->IsCallstackInterned(fingerprint));
+
+  AllocMetadata alloc_metadata = {};
+  alloc_metadata.frame_pointer_pcs = true;
+  alloc_metadata.interned_callstack = true;
+  uint64_t payload = fingerprint;
+  WireMessage msg = {};
+  msg.record_type = RecordType::Malloc;
+  msg.alloc_header = &alloc_metadata;
+  msg.payload = reinterpret_cast<char*>(&payload);
+  msg.payload_size = sizeof(payload);
+
+  AllocRecord out;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &out, &cache));
+  EXPECT_FALSE(out.error);
+  ASSERT_EQ(out.frames.size(), 1u);
+  EXPECT_EQ(out.frames[0].pc, 0x1000u);
+
+  // The records written before the slot got replaced still find their
+  // callstack, until it is replaced again.
+  cache.Intern(fingerprint + kSlots, MakeFramePointerRecord(0x2000), &*shmem);
+  EXPECT_FALSE(shmem->IsCallstackInterned(fingerprint));
+  EXPECT_TRUE(shmem->IsCallstackInterned(fingerprint + kSlots));
+  EXPECT_TRUE(cache.FindInterned(fingerprint, &out));
+  cache.Intern(fingerprint + 2 * kSlots, MakeFramePointerRecord(0x3000),
+               &*shmem);
+  EXPECT_FALSE(cache.FindInterned(fingerprint, &out));
+  ASSERT_TRUE(cache.FindInterned(fingerprint + kSlots, &out));
+  EXPECT_EQ(out.frames[0].pc, 0x2000u);
+  EXPECT_EQ(cache.interned_size(), 2u);
+
+  EXPECT_FALSE(DoUnwind(&msg, &metadata, &out, &cache));
+  EXPECT_TRUE(out.error);
+
+  cache.ClearInterned(&*shmem);
+  EXPECT_FALSE(shmem->IsCallstackInterned(fingerprint + 2 * kSlots));
+  EXPECT_EQ(cache.interned_size(), 0u);
+}
+
+TEST(UnwindingTest, InternOnlyFileBackedCallstacks) {
+  auto shmem = SharedRingBuffer::Create(8 * base::kPageSize);
+  ASSERT_TRUE(shmem);
+  UnwindingCache cache;
+  AllocRecord rec = MakeFramePointerRecord(0x1000);
+  rec.frames[0].map_name = "/memfd:jit-cache";
+  cache.Intern(1, rec, &*shmem);
+  EXPECT_FALSE(shmem->IsCallstackInterned(1));
+  EXPECT_EQ(cache.interned_size(), 0u);
+}
+
+TEST(UnwindingTest, FingerprintFramePointerPcs) {
+  uint64_t pcs[] = {0x1000, 0x2000, 0x3000};
+  uint64_t swapped[] = {0x2000, 0x1000, 0x3000};
+  uint64_t fingerprint =
+      FingerprintFramePointerPcs(reinterpret_cast<char*>(pcs), sizeof(pcs));
+  EXPECT_NE(fingerprint, 0u);
+  EXPECT_EQ(fingerprint, FingerprintFramePointerPcs(
+                             reinterpret_cast<char*>(pcs), sizeof(pcs)));
+  EXPECT_NE(fingerprint, FingerprintFramePointerPcs(
+                             reinterpret_cast<char*>(swapped), sizeof(pcs)));
+  EXPECT_NE(fingerprint,
+            FingerprintFramePointerPcs(reinterpret_cast<char*>(pcs),
+                                       2 * sizeof(uint64_t)));
+}
+
 TEST(AllocRecordArenaTest, Smoke) {
   AllocRecordArena a;
   auto borrowed = a.BorrowAllocRecord();
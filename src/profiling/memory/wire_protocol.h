@@ -21,6 +21,7 @@
 #define SRC_PROFILING_MEMORY_WIRE_PROTOCOL_H_
 
 #include <inttypes.h>
+#include <string.h>
 #include <unwindstack/Elf.h>
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/MachineArm64.h>
@@ -66,7 +67,9 @@ constexpr size_t kMaxRegisterDataSize =
 // Types needed for the wire format used for communication between the client
 // and heapprofd. The basic format of a record sent by the client is
 // record size (uint64_t) | record type (RecordType = uint64_t) | record
-// If record type is Malloc, the record format is AllocMetdata | raw stack.
+// If record type is Malloc, the record format is AllocMetdata | raw stack, or
+// AllocMetadata | return addresses if AllocMetadata.frame_pointer_pcs is set,
+// or AllocMetadata | fingerprint if AllocMetadata.interned_callstack is set.
 // If the record type is Free, the record is a FreeEntry.
 // If record type is HeapName, the record is a HeapName.
 // On connect, heapprofd sends one ClientConfiguration struct over the control
@@ -95,6 +98,7 @@ struct ClientConfiguration {
   PERFETTO_CROSS_ABI_ALIGNED(bool) disable_fork_teardown;
   PERFETTO_CROSS_ABI_ALIGNED(bool) disable_vfork_detection;
   PERFETTO_CROSS_ABI_ALIGNED(bool) all_heaps;
+  PERFETTO_CROSS_ABI_ALIGNED(bool) frame_pointer_unwinding;
   // Just double check that the array sizes are in correct order.
 };
 
@@ -122,6 +126,15 @@ struct alignas(8) AllocMetadata {
   PERFETTO_CROSS_ABI_ALIGNED(uint32_t) heap_id;
   // CPU architecture of the client.
   PERFETTO_CROSS_ABI_ALIGNED(unwindstack::ArchEnum) arch;
+  // If set, the payload is not a copy of the stack but the uint64_t return
+  // addresses found by following the frame pointers of the client, starting
+  // from the caller of the frame at |stack_pointer|. See
+  // ClientConfiguration.frame_pointer_unwinding.
+  PERFETTO_CROSS_ABI_ALIGNED(bool) frame_pointer_pcs;
+  // If set, the payload is the uint64_t FingerprintFramePointerPcs of the
+  // return addresses instead, which heapprofd published with
+  // SharedRingBuffer::SetCallstackInterned. Implies frame_pointer_pcs.
+  PERFETTO_CROSS_ABI_ALIGNED(bool) interned_callstack;
 };
 
 struct FreeEntry {
@@ -165,6 +178,23 @@ struct WireMessage {
 
 int64_t SendWireMessage(SharedRingBuffer* buf, const WireMessage& msg);
 
+// Identifies the frame pointer callstack of |size| bytes of return addresses
+// at |pcs|. Never 0.
+inline uint64_t FingerprintFramePointerPcs(const char* pcs, size_t size) {
+  uint64_t h = 0xcbf29ce484222325ull ^ size;
+  for (size_t off = 0; off + sizeof(uint64_t) <= size;
+       off += sizeof(uint64_t)) {
+    uint64_t pc;
+    memcpy(&pc, pcs + off, sizeof(pc));
+    h = (h ^ pc) * 0x100000001b3ull;
+  }
+  // Mix the high bits into the low ones, which select the interning slot.
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h ? h : 1;
+}
+
 // Parse message received over the wire.
 // |buf| has to outlive |out|.
 // If buf is not a valid message, return false.
@@ -56,6 +56,9 @@ struct ParsedSample {
   std::vector<char> stack;
   bool stack_maxed = false;
   std::vector<uint64_t> kernel_ips;
+  // Userspace return addresses collected by the kernel by walking the frame
+  // pointers, innermost first. Only set for frame pointer unwinding.
+  std::vector<uint64_t> user_ips;
 };
 
 // Entry in an unwinding queue. Either a sample that requires unwinding, or a
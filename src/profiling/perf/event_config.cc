@@ -260,6 +260,7 @@ base::Optional<EventConfig> EventConfig::Create(
   // Callstack sampling.
   bool sample_callstacks = false;
   bool kernel_frames = false;
+  bool frame_pointer_unwinding = false;
   TargetFilter target_filter;
   bool legacy_config = pb_config.all_cpus();  // all_cpus was mandatory before
   if (pb_config.has_callstack_sampling() || legacy_config) {
@@ -278,6 +279,11 @@ base::Optional<EventConfig> EventConfig::Create(
     // Inclusion of kernel callchains.
     kernel_frames = pb_config.callstack_sampling().kernel_frames() ||
                     pb_config.kernel_frames();
+
+    // Userspace unwinding method.
+    frame_pointer_unwinding =
+        pb_config.callstack_sampling().user_frames() ==
+        protos::gen::PerfEventConfig::CallstackSampling::UNWIND_FRAME_POINTER;
   }
 
   // Ring buffer options.
@@ -349,7 +355,23 @@ base::Optional<EventConfig> EventConfig::Create(
   pe.clockid = CLOCK_MONOTONIC_RAW;
   pe.use_clockid = true;
 
-  if (sample_callstacks) {
+  // Make the event fd readable once the ring buffer is half full, so that busy
+  // cpus get drained ahead of the next read tick.
+  pe.watermark = true;
+  pe.wakeup_watermark =
+      static_cast<uint32_t>(*ring_buffer_pages * base::kPageSize / 2);
+
+  if (sample_callstacks && frame_pointer_unwinding) {
+    // PERF_SAMPLE_CALLCHAIN:
+    // The kernel walks the userspace frame pointers, and optionally unwinds
+    // the kernel stack.
+    pe.sample_type |= PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_REGS_USER;
+    pe.exclude_callchain_kernel = !kernel_frames;
+    // PERF_SAMPLE_REGS_USER:
+    // Not needed for the unwinding, but tells apart the kernel threads.
+    pe.sample_regs_user =
+        PerfUserRegsMaskForArch(unwindstack::Regs::CurrentArch());
+  } else if (sample_callstacks) {
     pe.sample_type |= PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER;
     // PERF_SAMPLE_STACK_USER:
     // Needs to be < ((u16)(~0u)), and have bottom 8 bits clear.
@@ -370,7 +392,8 @@ base::Optional<EventConfig> EventConfig::Create(
 
   return EventConfig(
       raw_ds_config, pe, timebase_event, sample_callstacks,
-      std::move(target_filter), kernel_frames, ring_buffer_pages.value(),
+      std::move(target_filter), kernel_frames, frame_pointer_unwinding,
+      ring_buffer_pages.value(),
       read_tick_period_ms, samples_per_tick_limit, remote_descriptor_timeout_ms,
       pb_config.unwind_state_clear_period_ms(), max_enqueued_footprint_bytes,
       pb_config.target_installed_by());
@@ -382,6 +405,7 @@ EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
                          bool sample_callstacks,
                          TargetFilter target_filter,
                          bool kernel_frames,
+                         bool frame_pointer_unwinding,
                          uint32_t ring_buffer_pages,
                          uint32_t read_tick_period_ms,
                          uint64_t samples_per_tick_limit,
@@ -394,6 +418,7 @@ EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
       sample_callstacks_(sample_callstacks),
       target_filter_(std::move(target_filter)),
       kernel_frames_(kernel_frames),
+      frame_pointer_unwinding_(frame_pointer_unwinding),
       ring_buffer_pages_(ring_buffer_pages),
       read_tick_period_ms_(read_tick_period_ms),
       samples_per_tick_limit_(samples_per_tick_limit),
@@ -21,6 +21,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/utils.h"
 #include "test/gtest_and_gmock.h"
 
 #include "protos/perfetto/common/perf_events.gen.h"
@@ -53,6 +54,18 @@ TEST(EventConfigTest, AttrStructConstructed) {
   ASSERT_TRUE(event_config->perf_attr() != nullptr);
 }
 
+TEST(EventConfigTest, WakeupWatermarkIsHalfTheRingBuffer) {
+  protos::gen::PerfEventConfig cfg;
+  cfg.set_ring_buffer_pages(16);
+  base::Optional<EventConfig> event_config =
+      EventConfig::Create(AsDataSourceConfig(cfg));
+
+  ASSERT_TRUE(event_config.has_value());
+  EXPECT_TRUE(event_config->perf_attr()->watermark);
+  EXPECT_EQ(event_config->perf_attr()->wakeup_watermark,
+            8 * base::kPageSize);
+}
+
 TEST(EventConfigTest, RingBufferPagesValidated) {
   {  // if unset, a default is used
     protos::gen::PerfEventConfig cfg;
@@ -327,6 +340,49 @@ TEST(EventConfigTest, CallstackSamplingModeDetection) {
   }
 }
 
+TEST(EventConfigTest, FramePointerUnwinding) {
+  {  // kernel walks the userspace frame pointers, no stack copy
+    protos::gen::PerfEventConfig cfg;
+    cfg.mutable_callstack_sampling()->set_user_frames(
+        protos::gen::PerfEventConfig::CallstackSampling::UNWIND_FRAME_POINTER);
+
+    base::Optional<EventConfig> event_config =
+        EventConfig::Create(AsDataSourceConfig(cfg));
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_TRUE(event_config->frame_pointer_unwinding());
+    EXPECT_EQ(event_config->perf_attr()->sample_type &
+                  (PERF_SAMPLE_STACK_USER | PERF_SAMPLE_CALLCHAIN),
+              PERF_SAMPLE_CALLCHAIN);
+    EXPECT_FALSE(event_config->perf_attr()->exclude_callchain_user);
+    EXPECT_TRUE(event_config->perf_attr()->exclude_callchain_kernel);
+    EXPECT_EQ(event_config->perf_attr()->sample_stack_user, 0u);
+  }
+  {  // with kernel frames
+    protos::gen::PerfEventConfig cfg;
+    cfg.mutable_callstack_sampling()->set_kernel_frames(true);
+    cfg.mutable_callstack_sampling()->set_user_frames(
+        protos::gen::PerfEventConfig::CallstackSampling::UNWIND_FRAME_POINTER);
+
+    base::Optional<EventConfig> event_config =
+        EventConfig::Create(AsDataSourceConfig(cfg));
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_TRUE(event_config->frame_pointer_unwinding());
+    EXPECT_FALSE(event_config->perf_attr()->exclude_callchain_kernel);
+  }
+  {  // default is dwarf unwinding
+    protos::gen::PerfEventConfig cfg;
+    cfg.mutable_callstack_sampling();
+
+    base::Optional<EventConfig> event_config =
+        EventConfig::Create(AsDataSourceConfig(cfg));
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_FALSE(event_config->frame_pointer_unwinding());
+  }
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
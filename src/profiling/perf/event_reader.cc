@@ -16,6 +16,8 @@
 
 #include "src/profiling/perf/event_reader.h"
 
+#include <algorithm>
+
 #include <linux/perf_event.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -32,16 +34,19 @@ namespace profiling {
 namespace {
 
 template <typename T>
-const char* ReadValue(T* value_out, const char* ptr) {
-  memcpy(value_out, reinterpret_cast<const void*>(ptr), sizeof(T));
-  return ptr + sizeof(T);
+size_t ReadValue(T* value_out, const PerfRecord& record, size_t offset) {
+  record.Read(offset, value_out, sizeof(T));
+  return offset + sizeof(T);
 }
 
 template <typename T>
-const char* ReadValues(T* out, const char* ptr, size_t num_values) {
+size_t ReadValues(T* out,
+                  const PerfRecord& record,
+                  size_t offset,
+                  size_t num_values) {
   size_t sz = sizeof(T) * num_values;
-  memcpy(out, reinterpret_cast<const void*>(ptr), sz);
-  return ptr + sz;
+  record.Read(offset, out, sz);
+  return offset + sz;
 }
 
 bool IsPowerOfTwo(size_t v) {
@@ -81,6 +86,19 @@ bool MaybeApplyTracepointFilter(int fd, const PerfCounter& event) {
 
 }  // namespace
 
+void PerfRecord::Read(size_t offset, void* out, size_t size) const {
+  char* dst = reinterpret_cast<char*>(out);
+  if (offset < first_size_) {
+    size_t n = std::min(size, first_size_ - offset);
+    memcpy(dst, first_ + offset, n);
+    dst += n;
+    size -= n;
+    offset = first_size_;
+  }
+  if (size > 0)
+    memcpy(dst, second_ + (offset - first_size_), size);
+}
+
 PerfRingBuffer::PerfRingBuffer(PerfRingBuffer&& other) noexcept
     : metadata_page_(other.metadata_page_),
       mmap_sz_(other.mmap_sz_),
@@ -144,7 +162,7 @@ base::Optional<PerfRingBuffer> PerfRingBuffer::Allocate(
 // TODO(rsavitski): is there false sharing between |data_tail| and |data_head|?
 // Is there an argument for maintaining our own copy of |data_tail| instead of
 // reloading it?
-char* PerfRingBuffer::ReadRecordNonconsuming() {
+PerfRecord PerfRingBuffer::ReadRecordNonconsuming() {
   static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "");
 
   PERFETTO_DCHECK(valid());
@@ -161,7 +179,7 @@ char* PerfRingBuffer::ReadRecordNonconsuming() {
 
   PERFETTO_DCHECK(read_offset <= write_offset);
   if (write_offset == read_offset)
-    return nullptr;  // no new data
+    return PerfRecord();  // no new data
 
   size_t read_pos = static_cast<size_t>(read_offset & (data_buf_sz_ - 1));
 
@@ -174,23 +192,20 @@ char* PerfRingBuffer::ReadRecordNonconsuming() {
       reinterpret_cast<perf_event_header*>(data_buf_ + read_pos);
   uint16_t evt_size = evt_header->size;
 
-  // event wrapped - reconstruct it, and return a pointer to the buffer
+  // event wrapped - the rest of it is at the start of the buffer
   if (read_pos + evt_size > data_buf_sz_) {
     PERFETTO_DCHECK(read_pos + evt_size !=
                     ((read_pos + evt_size) & (data_buf_sz_ - 1)));
-    PERFETTO_DLOG("PerfRingBuffer: returning reconstructed event");
+    PERFETTO_DLOG("PerfRingBuffer: returning wrapped event");
 
-    size_t prefix_sz = data_buf_sz_ - read_pos;
-    memcpy(&reconstructed_record_[0], data_buf_ + read_pos, prefix_sz);
-    memcpy(&reconstructed_record_[0] + prefix_sz, data_buf_,
-           evt_size - prefix_sz);
-    return &reconstructed_record_[0];
+    return PerfRecord(data_buf_ + read_pos, data_buf_sz_ - read_pos,
+                      data_buf_);
   } else {
     // usual case - contiguous sample
     PERFETTO_DCHECK(read_pos + evt_size ==
                     ((read_pos + evt_size) & (data_buf_sz_ - 1)));
 
-    return data_buf_ + read_pos;
+    return PerfRecord(data_buf_ + read_pos, evt_size, data_buf_);
   }
 }
 
@@ -250,11 +265,11 @@ base::Optional<EventReader> EventReader::ConfigureEvents(
 base::Optional<ParsedSample> EventReader::ReadUntilSample(
     std::function<void(uint64_t)> records_lost_callback) {
   for (;;) {
-    char* event = ring_buffer_.ReadRecordNonconsuming();
-    if (!event)
+    PerfRecord event = ring_buffer_.ReadRecordNonconsuming();
+    if (!event.valid())
       return base::nullopt;  // caught up with the writer
 
-    auto* event_hdr = reinterpret_cast<const perf_event_header*>(event);
+    const perf_event_header* event_hdr = event.header();
 
     if (event_hdr->type == PERF_RECORD_SAMPLE) {
       ParsedSample sample = ParseSampleRecord(cpu_, event);
@@ -271,8 +286,9 @@ base::Optional<ParsedSample> EventReader::ReadUntilSample(
        *   struct sample_id sample_id;
        * };
        */
-      uint64_t records_lost = *reinterpret_cast<const uint64_t*>(
-          event + sizeof(perf_event_header) + sizeof(uint64_t));
+      uint64_t records_lost = 0;
+      ReadValue(&records_lost, event,
+                sizeof(perf_event_header) + sizeof(uint64_t));
 
       records_lost_callback(records_lost);
       ring_buffer_.Consume(event_hdr->size);
@@ -296,7 +312,7 @@ base::Optional<ParsedSample> EventReader::ReadUntilSample(
 // PERF_SAMPLE_CPU). However, this producer uses only cpu-scoped events,
 // therefore it is already known.
 ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
-                                            const char* record_start) {
+                                            const PerfRecord& record) {
   if (event_attr_.sample_type &
       (~uint64_t(PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_STACK_USER |
                  PERF_SAMPLE_REGS_USER | PERF_SAMPLE_CALLCHAIN |
@@ -304,7 +320,7 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
     PERFETTO_FATAL("Unsupported sampling option");
   }
 
-  auto* event_hdr = reinterpret_cast<const perf_event_header*>(record_start);
+  const perf_event_header* event_hdr = record.header();
   size_t sample_size = event_hdr->size;
 
   ParsedSample sample = {};
@@ -313,36 +329,68 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
 
   // Parse the payload, which consists of concatenated data for each
   // |attr.sample_type| flag.
-  const char* parse_pos = record_start + sizeof(perf_event_header);
+  size_t parse_pos = sizeof(perf_event_header);
 
   if (event_attr_.sample_type & PERF_SAMPLE_TID) {
     uint32_t pid = 0;
     uint32_t tid = 0;
-    parse_pos = ReadValue(&pid, parse_pos);
-    parse_pos = ReadValue(&tid, parse_pos);
+    parse_pos = ReadValue(&pid, record, parse_pos);
+    parse_pos = ReadValue(&tid, record, parse_pos);
     sample.common.pid = static_cast<pid_t>(pid);
     sample.common.tid = static_cast<pid_t>(tid);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_TIME) {
-    parse_pos = ReadValue(&sample.common.timestamp, parse_pos);
+    parse_pos = ReadValue(&sample.common.timestamp, record, parse_pos);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_READ) {
-    parse_pos = ReadValue(&sample.common.timebase_count, parse_pos);
+    parse_pos = ReadValue(&sample.common.timebase_count, record, parse_pos);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_CALLCHAIN) {
     uint64_t chain_len = 0;
-    parse_pos = ReadValue(&chain_len, parse_pos);
-    sample.kernel_ips.resize(static_cast<size_t>(chain_len));
-    parse_pos = ReadValues<uint64_t>(sample.kernel_ips.data(), parse_pos,
+    parse_pos = ReadValue(&chain_len, record, parse_pos);
+    std::vector<uint64_t> ips(static_cast<size_t>(chain_len));
+    parse_pos = ReadValues<uint64_t>(ips.data(), record, parse_pos,
                                      static_cast<size_t>(chain_len));
+
+    // The kernel part of the callchain (starting with PERF_CONTEXT_KERNEL) is
+    // kept as-is. The userspace part follows the PERF_CONTEXT_USER marker, and
+    // is only present if the kernel was asked to walk the frame pointers.
+    auto user_it = std::find(ips.begin(), ips.end(),
+                             static_cast<uint64_t>(PERF_CONTEXT_USER));
+    for (auto it = user_it == ips.end() ? user_it : user_it + 1;
+         it != ips.end(); ++it) {
+      if (*it >= static_cast<uint64_t>(PERF_CONTEXT_MAX))
+        continue;  // other context markers
+      sample.user_ips.push_back(*it);
+    }
+    ips.erase(user_it, ips.end());
+    sample.kernel_ips = std::move(ips);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_REGS_USER) {
     // Can be empty, e.g. if we sampled a kernel thread.
-    sample.regs = ReadPerfUserRegsData(&parse_pos);
+    uint64_t sampled_abi;
+    ReadValue(&sampled_abi, record, parse_pos);
+    size_t regs_size = sizeof(uint64_t);
+    if (sampled_abi != PERF_SAMPLE_REGS_ABI_NONE)
+      regs_size += sizeof(uint64_t) * static_cast<size_t>(__builtin_popcountll(
+                                          event_attr_.sample_regs_user));
+
+    // The register block is small, copy it out only if it wraps.
+    uint64_t regs_data[1 + 64];
+    PERFETTO_CHECK(regs_size <= sizeof(regs_data));
+    const char* regs_pos = record.Contiguous(parse_pos, regs_size);
+    if (!regs_pos) {
+      record.Read(parse_pos, regs_data, regs_size);
+      regs_pos = reinterpret_cast<const char*>(regs_data);
+    }
+    const char* regs_end = regs_pos + regs_size;
+    sample.regs = ReadPerfUserRegsData(&regs_pos);
+    PERFETTO_CHECK(regs_pos == regs_end);
+    parse_pos += regs_size;
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_STACK_USER) {
@@ -350,30 +398,31 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
     // the requested size if there wasn't enough room in the sample (which is
     // limited to 64k).
     uint64_t max_stack_size;
-    parse_pos = ReadValue(&max_stack_size, parse_pos);
+    parse_pos = ReadValue(&max_stack_size, record, parse_pos);
 
-    const char* stack_start = parse_pos;
-    parse_pos += max_stack_size;  // skip to dyn_size
+    size_t stack_start = parse_pos;
+    parse_pos += static_cast<size_t>(max_stack_size);  // skip to dyn_size
 
     // Payload written conditionally, e.g. kernel threads don't have a
     // user stack.
     if (max_stack_size > 0) {
       uint64_t filled_stack_size;
-      parse_pos = ReadValue(&filled_stack_size, parse_pos);
+      parse_pos = ReadValue(&filled_stack_size, record, parse_pos);
       PERFETTO_DLOG("sampled stack size: %" PRIu64 " / %" PRIu64 "",
                     filled_stack_size, max_stack_size);
 
-      // copy stack bytes into a vector
+      // Copy the stack bytes straight out of the ring buffer, as the sample
+      // outlives the record (unwinding is asynchronous).
       size_t payload_sz = static_cast<size_t>(filled_stack_size);
       sample.stack.resize(payload_sz);
-      memcpy(sample.stack.data(), stack_start, payload_sz);
+      record.Read(stack_start, sample.stack.data(), payload_sz);
 
       // remember whether the stack sample is (most likely) truncated
       sample.stack_maxed = (filled_stack_size == max_stack_size);
     }
   }
 
-  PERFETTO_CHECK(parse_pos == record_start + sample_size);
+  PERFETTO_CHECK(parse_pos == sample_size);
   return sample;
 }
 
@@ -31,6 +31,38 @@
 namespace perfetto {
 namespace profiling {
 
+// A record in the perf ring buffer, which is parsed in place rather than copied
+// out. A record that wraps around the end of the buffer is split into two
+// contiguous parts. The record header is always contiguous.
+class PerfRecord {
+ public:
+  PerfRecord() = default;
+  PerfRecord(const char* first, size_t first_size, const char* second)
+      : first_(first), first_size_(first_size), second_(second) {}
+
+  bool valid() const { return first_ != nullptr; }
+
+  const perf_event_header* header() const {
+    return reinterpret_cast<const perf_event_header*>(first_);
+  }
+  size_t size() const { return header()->size; }
+
+  // Copies |size| bytes, starting at |offset| into the record, to |out|.
+  void Read(size_t offset, void* out, size_t size) const;
+
+  // Returns a pointer to the |size| bytes starting at |offset| into the record
+  // if they are contiguous, nullptr otherwise.
+  const char* Contiguous(size_t offset, size_t size) const {
+    return offset + size <= first_size_ ? first_ + offset : nullptr;
+  }
+
+ private:
+  const char* first_ = nullptr;
+  size_t first_size_ = 0;
+  // Start of the ring buffer, where the rest of a wrapped record is.
+  const char* second_ = nullptr;
+};
+
 class PerfRingBuffer {
  public:
   static base::Optional<PerfRingBuffer> Allocate(int perf_fd,
@@ -44,7 +76,10 @@ class PerfRingBuffer {
   PerfRingBuffer(PerfRingBuffer&& other) noexcept;
   PerfRingBuffer& operator=(PerfRingBuffer&& other) noexcept;
 
-  char* ReadRecordNonconsuming();
+  // Returns the oldest unconsumed record, or an invalid record if there is no
+  // new data. The record points into the ring buffer, and is valid until it is
+  // consumed.
+  PerfRecord ReadRecordNonconsuming();
   void Consume(size_t bytes);
 
  private:
@@ -61,12 +96,6 @@ class PerfRingBuffer {
   // mmap'd ring buffer
   char* data_buf_ = nullptr;
   size_t data_buf_sz_ = 0;
-
-  // When a record wraps around the ring buffer boundary, it is reconstructed in
-  // a contiguous form in this buffer. This allows us to always return a pointer
-  // to a contiguous record.
-  constexpr static size_t kMaxPerfRecordSize = 1 << 16;  // max size 64k
-  alignas(uint64_t) char reconstructed_record_[kMaxPerfRecordSize];
 };
 
 class EventReader {
@@ -90,6 +119,8 @@ class EventReader {
   void DisableEvents();
 
   uint32_t cpu() const { return cpu_; }
+  // Becomes readable when the ring buffer fills past its wakeup watermark.
+  int fd() const { return perf_fd_.get(); }
 
   ~EventReader() = default;
 
@@ -105,7 +136,7 @@ class EventReader {
               base::ScopedFile perf_fd,
               PerfRingBuffer ring_buffer);
 
-  ParsedSample ParseSampleRecord(uint32_t cpu, const char* record_start);
+  ParsedSample ParseSampleRecord(uint32_t cpu, const PerfRecord& record);
 
   // All events are cpu-bound (thread-scoped events not supported).
   const uint32_t cpu_;
@@ -16,6 +16,7 @@
 
 #include "src/profiling/perf/perf_producer.h"
 
+#include <algorithm>
 #include <random>
 #include <utility>
 
@@ -70,6 +71,10 @@ constexpr uint32_t kProcDescriptorsAndroidDelayMs = 50;
 
 constexpr uint32_t kMemoryLimitCheckPeriodMs = 5 * 1000;
 
+// A cpu that keeps filling its buffer faster than it is read gets its read
+// budget doubled, up to this multiple of the configured per-tick limit.
+constexpr uint64_t kMaxReadBudgetMultiplier = 8;
+
 constexpr uint32_t kInitialConnectionBackoffMs = 100;
 constexpr uint32_t kMaxConnectionBackoffMs = 30 * 1000;
 
@@ -242,14 +247,25 @@ protos::pbzero::Profiling::StackUnwindError ToProtoEnum(
 }  // namespace
 
 PerfProducer::PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-                           base::TaskRunner* task_runner)
+                           base::TaskRunner* task_runner,
+                           size_t num_unwinders)
     : task_runner_(task_runner),
       proc_fd_getter_(proc_fd_getter),
-      unwinding_worker_(this),
       weak_factory_(this) {
+  PERFETTO_CHECK(num_unwinders > 0);
+  for (size_t i = 0; i < num_unwinders; i++)
+    unwinding_workers_.emplace_back(new UnwinderHandle(this));
   proc_fd_getter->SetDelegate(this);
 }
 
+PerfProducer::~PerfProducer() {
+  // The readers' fds are about to be closed.
+  for (auto& id_and_ds : data_sources_) {
+    if (id_and_ds.second.status == DataSourceState::Status::kActive)
+      RemoveBufferWakeupWatches(&id_and_ds.second);
+  }
+}
+
 void PerfProducer::SetupDataSource(DataSourceInstanceID,
                                    const DataSourceConfig&) {}
 
@@ -315,11 +331,14 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
                             std::move(per_cpu_readers)));
   PERFETTO_CHECK(inserted);
   DataSourceState& ds = ds_it->second;
+  ds.per_cpu_read_budget.assign(ds.per_cpu_readers.size(),
+                                ds.event_config.samples_per_tick_limit());
 
   // Start the configured events.
   for (auto& per_cpu_reader : ds.per_cpu_readers) {
     per_cpu_reader.EnableEvents();
   }
+  AddBufferWakeupWatches(ds_id, &ds);
 
   WritePerfEventDefaultsPacket(ds.event_config, ds.trace_writer.get());
 
@@ -327,13 +346,15 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
       ds_it->second.trace_writer.get(),
       protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
 
-  // Inform unwinder of the new data source instance, and optionally start a
-  // periodic task to clear its cached state.
-  unwinding_worker_->PostStartDataSource(ds_id,
-                                         ds.event_config.kernel_frames());
-  if (ds.event_config.unwind_state_clear_period_ms()) {
-    unwinding_worker_->PostClearCachedStatePeriodic(
-        ds_id, ds.event_config.unwind_state_clear_period_ms());
+  // Inform the unwinders of the new data source instance, and optionally start
+  // a periodic task to clear their cached state.
+  for (auto& unwinder : unwinding_workers_) {
+    (*unwinder)->PostStartDataSource(ds_id, ds.event_config.kernel_frames(),
+                                     ds.event_config.frame_pointer_unwinding());
+    if (ds.event_config.unwind_state_clear_period_ms()) {
+      (*unwinder)->PostClearCachedStatePeriodic(
+          ds_id, ds.event_config.unwind_state_clear_period_ms());
+    }
   }
 
   // Kick off periodic read task.
@@ -483,20 +504,22 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
   PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_READ_TICK);
 
   // Make a pass over all per-cpu readers.
-  uint64_t max_samples = ds.event_config.samples_per_tick_limit();
   bool more_records_available = false;
-  for (EventReader& reader : ds.per_cpu_readers) {
-    if (ReadAndParsePerCpuBuffer(&reader, max_samples, ds_id, &ds)) {
+  for (size_t cpu = 0; cpu < ds.per_cpu_readers.size(); cpu++) {
+    if (ReadPerCpuBuffer(ds_id, &ds, cpu)) {
       more_records_available = true;
     }
   }
 
-  // Wake up the unwinder as we've (likely) pushed samples into its queue.
-  unwinding_worker_->PostProcessQueue();
+  // Wake up the unwinders as we've (likely) pushed samples into their queues.
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
 
   if (PERFETTO_UNLIKELY(ds.status == DataSourceState::Status::kShuttingDown) &&
       !more_records_available) {
-    unwinding_worker_->PostInitiateDataSourceStop(ds_id);
+    ds.unwinders_stopping = unwinding_workers_.size();
+    for (auto& unwinder : unwinding_workers_)
+      (*unwinder)->PostInitiateDataSourceStop(ds_id);
   } else {
     // otherwise, keep reading
     auto tick_period_ms = it->second.event_config.read_tick_period_ms();
@@ -510,10 +533,63 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
   }
 }
 
+void PerfProducer::OnPerCpuBufferWakeup(DataSourceInstanceID ds_id,
+                                        size_t cpu) {
+  auto it = data_sources_.find(ds_id);
+  if (it == data_sources_.end())
+    return;
+  DataSourceState& ds = it->second;
+  if (ds.status != DataSourceState::Status::kActive)
+    return;  // the read ticks drain the buffers while stopping
+
+  ReadPerCpuBuffer(ds_id, &ds, cpu);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
+}
+
+bool PerfProducer::ReadPerCpuBuffer(DataSourceInstanceID ds_id,
+                                    DataSourceState* ds,
+                                    size_t cpu) {
+  uint64_t& budget = ds->per_cpu_read_budget[cpu];
+  uint64_t samples_read = 0;
+  bool more_records_available = ReadAndParsePerCpuBuffer(
+      &ds->per_cpu_readers[cpu], budget, ds_id, ds, &samples_read);
+
+  // Follow the observed rate of the cpu: grow the budget while it's not
+  // enough to catch up with the writer, and shrink it back towards twice the
+  // read amount otherwise. Never go below the configured limit.
+  uint64_t min_budget = ds->event_config.samples_per_tick_limit();
+  if (more_records_available) {
+    budget = std::min(2 * budget, kMaxReadBudgetMultiplier * min_budget);
+  } else {
+    budget = std::max(min_budget, std::min(budget, 2 * samples_read));
+  }
+  return more_records_available;
+}
+
+void PerfProducer::AddBufferWakeupWatches(DataSourceInstanceID ds_id,
+                                          DataSourceState* ds) {
+  for (size_t cpu = 0; cpu < ds->per_cpu_readers.size(); cpu++) {
+    auto weak_this = weak_factory_.GetWeakPtr();
+    task_runner_->AddFileDescriptorWatch(
+        ds->per_cpu_readers[cpu].fd(), [weak_this, ds_id, cpu] {
+          if (weak_this)
+            weak_this->OnPerCpuBufferWakeup(ds_id, cpu);
+        });
+  }
+}
+
+// Must be called before the readers' fds are closed.
+void PerfProducer::RemoveBufferWakeupWatches(DataSourceState* ds) {
+  for (EventReader& reader : ds->per_cpu_readers)
+    task_runner_->RemoveFileDescriptorWatch(reader.fd());
+}
+
 bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
                                             uint64_t max_samples,
                                             DataSourceInstanceID ds_id,
-                                            DataSourceState* ds) {
+                                            DataSourceState* ds,
+                                            uint64_t* samples_read) {
   PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_READ_CPU);
 
   // If the kernel ring buffer dropped data, record it in the trace.
@@ -526,12 +602,14 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     });
   };
 
+  *samples_read = 0;
   for (uint64_t i = 0; i < max_samples; i++) {
     base::Optional<ParsedSample> sample =
         reader->ReadUntilSample(records_lost_callback);
     if (!sample) {
       return false;  // caught up to the writer
     }
+    (*samples_read)++;
 
     // Counter-only mode: skip the unwinding stage, enqueue the sample for
     // output immediately.
@@ -594,7 +672,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
         ds->event_config.max_enqueued_footprint_bytes();
     uint64_t sample_stack_size = sample->stack.size();
     if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+      uint64_t footprint_bytes = GetEnqueuedFootprint();
       if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
         PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
         EmitSkippedSample(ds_id, std::move(sample.value()),
@@ -604,13 +682,14 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     }
 
     // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
+    UnwinderHandle& unwinder = UnwinderForPid(pid);
+    auto& queue = unwinder->unwind_queue();
     WriteView write_view = queue.BeginWrite();
     if (write_view.valid) {
       queue.at(write_view.write_pos) =
           UnwindEntry{ds_id, std::move(sample.value())};
       queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+      unwinder->IncrementEnqueuedFootprint(sample_stack_size);
     } else {
       PERFETTO_DLOG("Unwinder queue full, skipping sample");
       EmitSkippedSample(ds_id, std::move(sample.value()),
@@ -654,7 +733,7 @@ void PerfProducer::OnProcDescriptors(pid_t pid,
                     static_cast<int>(pid), static_cast<size_t>(it.first));
 
       proc_status_it->second = ProcessTrackingStatus::kResolved;
-      unwinding_worker_->PostAdoptProcDescriptors(
+      UnwinderForPid(pid)->PostAdoptProcDescriptors(
           it.first, pid, std::move(maps_fd), std::move(mem_fd));
       return;  // done
     }
@@ -717,7 +796,7 @@ void PerfProducer::EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id,
     proc_status_it->second = ProcessTrackingStatus::kExpired;
     // Also inform the unwinder of the state change (so that it can discard any
     // of the already-enqueued samples).
-    unwinding_worker_->PostRecordTimedOutProcDescriptors(ds_id, pid);
+    UnwinderForPid(pid)->PostRecordTimedOutProcDescriptors(ds_id, pid);
   }
 }
 
@@ -850,11 +929,19 @@ void PerfProducer::EmitSkippedSample(DataSourceInstanceID ds_id,
   }
 }
 
+uint64_t PerfProducer::GetEnqueuedFootprint() {
+  uint64_t footprint_bytes = 0;
+  for (auto& unwinder : unwinding_workers_)
+    footprint_bytes += (*unwinder)->GetEnqueuedFootprint();
+  return footprint_bytes;
+}
+
 void PerfProducer::InitiateReaderStop(DataSourceState* ds) {
   PERFETTO_DLOG("InitiateReaderStop");
   PERFETTO_CHECK(ds->status != DataSourceState::Status::kShuttingDown);
 
   ds->status = DataSourceState::Status::kShuttingDown;
+  RemoveBufferWakeupWatches(ds);
   for (auto& event_reader : ds->per_cpu_readers) {
     event_reader.DisableEvents();
   }
@@ -879,6 +966,11 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   DataSourceState& ds = ds_it->second;
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
 
+  // Wait for all the unwinders to be done with the source.
+  PERFETTO_CHECK(ds.unwinders_stopping > 0);
+  if (--ds.unwinders_stopping > 0)
+    return;
+
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
 
@@ -909,7 +1001,8 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   PERFETTO_LOG("Stopping DataSource(%zu) prematurely",
                static_cast<size_t>(ds_id));
 
-  unwinding_worker_->PostPurgeDataSource(ds_id);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostPurgeDataSource(ds_id);
 
   // Write a packet indicating the abrupt stop.
   {
@@ -923,6 +1016,8 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
         protos::pbzero::PerfSample::ProducerEvent::PROFILER_STOP_GUARDRAIL);
   }
 
+  if (ds.status == DataSourceState::Status::kActive)
+    RemoveBufferWakeupWatches(&ds);
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
 
@@ -1023,10 +1118,11 @@ void PerfProducer::Restart() {
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = producer_socket_name_;
   ProcDescriptorGetter* proc_fd_getter = proc_fd_getter_;
+  size_t num_unwinders = unwinding_workers_.size();
 
   // Invoke destructor and then the constructor again.
   this->~PerfProducer();
-  new (this) PerfProducer(proc_fd_getter, task_runner);
+  new (this) PerfProducer(proc_fd_getter, task_runner, num_unwinders);
 
   ConnectWithRetries(socket_name);
 }
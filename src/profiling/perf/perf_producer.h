@@ -20,6 +20,7 @@
 #include <deque>
 #include <map>
 #include <queue>
+#include <vector>
 
 #include <unistd.h>
 
@@ -54,14 +55,15 @@ namespace profiling {
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
 // samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// is done by a pool of |Unwinder|s, each on a dedicated thread.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
  public:
   PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-               base::TaskRunner* task_runner);
-  ~PerfProducer() override = default;
+               base::TaskRunner* task_runner,
+               size_t num_unwinders = 1);
+  ~PerfProducer() override;
 
   PerfProducer(const PerfProducer&) = delete;
   PerfProducer& operator=(const PerfProducer&) = delete;
@@ -134,6 +136,9 @@ class PerfProducer : public Producer,
     std::unique_ptr<TraceWriter> trace_writer;
     // Indexed by cpu, vector never resized.
     std::vector<EventReader> per_cpu_readers;
+    // Indexed by cpu, like |per_cpu_readers|. Cap on the samples parsed per
+    // pass over the cpu's buffer, adapted to the observed sample rate.
+    std::vector<uint64_t> per_cpu_read_budget;
     // Tracks the incremental state for interned entries.
     InterningOutputTracker interning_output;
     // Producer thread's view of sampled processes. This is the primary tracking
@@ -145,6 +150,8 @@ class PerfProducer : public Producer,
     // Command lines we have decided to unwind, up to a total of
     // additional_cmdline_count values.
     base::FlatSet<std::string> additional_cmdlines;
+    // Number of unwinders that are yet to finish their part of the stop.
+    size_t unwinders_stopping = 0;
   };
 
   // For |EmitSkippedSample|.
@@ -162,15 +169,27 @@ class PerfProducer : public Producer,
   // Periodic read task which reads a batch of samples from all kernel ring
   // buffers associated with the given data source.
   void TickDataSourceRead(DataSourceInstanceID ds_id);
+  // Reads a single cpu's buffer after it filled past its wakeup watermark,
+  // without waiting for the next read tick.
+  void OnPerCpuBufferWakeup(DataSourceInstanceID ds_id, size_t cpu);
+  // Reads a batch of samples from the given cpu's buffer, and adjusts the
+  // cpu's read budget. Returns the result of |ReadAndParsePerCpuBuffer|.
+  bool ReadPerCpuBuffer(DataSourceInstanceID ds_id,
+                        DataSourceState* ds,
+                        size_t cpu);
   // Returns *false* if the reader has caught up with the writer position, true
   // otherwise. Return value is only useful if the underlying perf_event has
   // been paused (to identify when the buffer is empty). |max_samples| is a cap
   // on the amount of samples that will be parsed, which might be more than the
   // number of underlying records (as there might be non-sample records).
+  // |samples_read| is set to the number of samples parsed.
   bool ReadAndParsePerCpuBuffer(EventReader* reader,
                                 uint64_t max_samples,
                                 DataSourceInstanceID ds_id,
-                                DataSourceState* ds);
+                                DataSourceState* ds,
+                                uint64_t* samples_read);
+  void AddBufferWakeupWatches(DataSourceInstanceID ds_id, DataSourceState* ds);
+  void RemoveBufferWakeupWatches(DataSourceState* ds);
 
   void InitiateDescriptorLookup(DataSourceInstanceID ds_id,
                                 pid_t pid,
@@ -217,6 +236,13 @@ class PerfProducer : public Producer,
 
   void StartMetatraceSource(DataSourceInstanceID ds_id, BufferID target_buffer);
 
+  // All the samples of a process are unwound by the same unwinder.
+  UnwinderHandle& UnwinderForPid(pid_t pid) {
+    return *unwinding_workers_[static_cast<size_t>(pid) %
+                               unwinding_workers_.size()];
+  }
+  uint64_t GetEnqueuedFootprint();
+
   // Task runner owned by the main thread.
   base::TaskRunner* const task_runner_;
   State state_ = kNotStarted;
@@ -246,8 +272,8 @@ class PerfProducer : public Producer,
   // State associated with perf-sampling data sources.
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
 
-  // Unwinding stage, running on a dedicated thread.
-  UnwinderHandle unwinding_worker_;
+  // Unwinding stage, running on dedicated threads.
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinding_workers_;
 
   // Used for tracepoint name -> id lookups. Initialized lazily, and in general
   // best effort - can be null if tracefs isn't accessible.
@@ -15,6 +15,8 @@
  */
 
 #include "src/profiling/perf/traced_perf.h"
+#include "perfetto/ext/base/getopt.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/tracing/ipc/default_socket.h"
 #include "src/profiling/perf/perf_producer.h"
@@ -40,7 +42,39 @@ int GetRawInheritedListeningSocket() {
 }  // namespace
 
 // TODO(rsavitski): watchdog.
-int TracedPerfMain(int, char**) {
+int TracedPerfMain(int argc, char** argv) {
+  enum LongOption {
+    OPT_UNWINDER_THREADS = 1000,
+  };
+
+  // On machines with many cpus, a single unwinder cannot keep up with the
+  // samples of all of them.
+  uint32_t unwinder_threads = 1;
+
+  static const option long_options[] = {
+      {"unwinder-threads", required_argument, nullptr, OPT_UNWINDER_THREADS},
+      {nullptr, 0, nullptr, 0}};
+
+  for (;;) {
+    int option = getopt_long(argc, argv, "", long_options, nullptr);
+    if (option == -1)
+      break;
+    switch (option) {
+      case OPT_UNWINDER_THREADS: {
+        base::Optional<uint32_t> threads = base::CStringToUInt32(optarg);
+        if (!threads || *threads == 0) {
+          PERFETTO_ELOG("Invalid --unwinder-threads: %s", optarg);
+          return 1;
+        }
+        unwinder_threads = *threads;
+        break;
+      }
+      default:
+        PERFETTO_ELOG("Usage: %s [--unwinder-threads=N]", argv[0]);
+        return 1;
+    }
+  }
+
   base::UnixTaskRunner task_runner;
 
 // TODO(rsavitski): support standalone --root or similar on android.
@@ -51,7 +85,8 @@ int TracedPerfMain(int, char**) {
   DirectDescriptorGetter proc_fd_getter;
 #endif
 
-  profiling::PerfProducer producer(&proc_fd_getter, &task_runner);
+  profiling::PerfProducer producer(&proc_fd_getter, &task_runner,
+                                   unwinder_threads);
   producer.ConnectWithRetries(GetProducerSocket());
   task_runner.Run();
   return 0;
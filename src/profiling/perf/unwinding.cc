@@ -16,6 +16,7 @@
 
 #include "src/profiling/perf/unwinding.h"
 
+#include <condition_variable>
 #include <mutex>
 
 #include <inttypes.h>
@@ -33,6 +34,51 @@ constexpr uint32_t kDataSourceShutdownRetryDelayMs = 400;
 
 namespace perfetto {
 namespace profiling {
+namespace {
+
+// Libunwindstack's Elf cache is process-wide, and toggling it is not
+// synchronized with its use. As there can be multiple |Unwinder| threads,
+// unwinds hold this lock as readers, and cache resets as the writer. Pending
+// resets take priority over new unwinds.
+class UnwindstackCacheLock {
+ public:
+  static UnwindstackCacheLock* Get() {
+    static UnwindstackCacheLock* instance = new UnwindstackCacheLock();
+    return instance;
+  }
+
+  void LockUnwind() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !reset_pending_; });
+    active_unwinds_++;
+  }
+
+  void UnlockUnwind() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PERFETTO_DCHECK(active_unwinds_ > 0);
+    if (--active_unwinds_ == 0)
+      cv_.notify_all();
+  }
+
+  template <typename F>
+  void RunExclusively(F fn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !reset_pending_; });
+    reset_pending_ = true;
+    cv_.wait(lock, [this] { return active_unwinds_ == 0; });
+    fn();
+    reset_pending_ = false;
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  uint32_t active_unwinds_ = 0;
+  bool reset_pending_ = false;
+};
+
+}  // namespace
 
 Unwinder::Delegate::~Delegate() = default;
 
@@ -43,19 +89,26 @@ Unwinder::Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner)
 }
 
 void Unwinder::PostStartDataSource(DataSourceInstanceID ds_id,
-                                   bool kernel_frames) {
+                                   bool kernel_frames,
+                                   bool frame_pointer_unwinding) {
   // No need for a weak pointer as the associated task runner quits (stops
   // running tasks) strictly before the Unwinder's destruction.
   task_runner_->PostTask(
-      [this, ds_id, kernel_frames] { StartDataSource(ds_id, kernel_frames); });
+      [this, ds_id, kernel_frames, frame_pointer_unwinding] {
+        StartDataSource(ds_id, kernel_frames, frame_pointer_unwinding);
+      });
 }
 
-void Unwinder::StartDataSource(DataSourceInstanceID ds_id, bool kernel_frames) {
+void Unwinder::StartDataSource(DataSourceInstanceID ds_id,
+                               bool kernel_frames,
+                               bool frame_pointer_unwinding) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DLOG("Unwinder::StartDataSource(%zu)", static_cast<size_t>(ds_id));
 
   auto it_and_inserted = data_sources_.emplace(ds_id, DataSourceState{});
   PERFETTO_DCHECK(it_and_inserted.second);
+  it_and_inserted.first->second.frame_pointer_unwinding =
+      frame_pointer_unwinding;
 
   if (kernel_frames) {
     kernel_symbolizer_.GetOrCreateKernelSymbolMap();
@@ -260,9 +313,12 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
                                  static_cast<int32_t>(pid));
 
       PERFETTO_CHECK(proc_state.unwind_state.has_value());
+      UnwindstackCacheLock::Get()->LockUnwind();
       CompletedSample unwound_sample =
           UnwindSample(entry.sample, &proc_state.unwind_state.value(),
-                       proc_state.attempted_unwinding);
+                       proc_state.attempted_unwinding,
+                       ds.frame_pointer_unwinding);
+      UnwindstackCacheLock::Get()->UnlockUnwind();
       proc_state.attempted_unwinding = true;
 
       PERFETTO_METATRACE_COUNTER(TAG_PRODUCER, PROFILER_UNWIND_CURRENT_PID, 0);
@@ -298,7 +354,8 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
 
 CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
                                        UnwindingMetadata* unwind_state,
-                                       bool pid_unwound_before) {
+                                       bool pid_unwound_before,
+                                       bool frame_pointer_unwinding) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DCHECK(unwind_state);
 
@@ -348,8 +405,47 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
             unwinder.ConsumeFrames()};
   };
 
+  // The kernel already walked the frame pointers, so only the return addresses
+  // need to be mapped to their functions. Reports ERROR_INVALID_MAP if any of
+  // the addresses is outside of the parsed mappings.
+  auto attempt_symbolize = [&sample, unwind_state,
+                            pid_unwound_before]() -> UnwindResult {
+    metatrace::ScopedEvent m(metatrace::TAG_PRODUCER,
+                             pid_unwound_before
+                                 ? metatrace::PROFILER_UNWIND_ATTEMPT
+                                 : metatrace::PROFILER_UNWIND_INITIAL_ATTEMPT);
+
+    unwindstack::Unwinder unwinder(kUnwindingMaxFrames, &unwind_state->fd_maps,
+                                   sample.regs.get(), unwind_state->fd_mem);
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+    unwinder.SetJitDebug(unwind_state->GetJitDebug(sample.regs->Arch()));
+    unwinder.SetDexFiles(unwind_state->GetDexFiles(sample.regs->Arch()));
+#endif
+    // The first address is the sampled pc. The others are return addresses,
+    // which are adjusted to point into the call instruction, like
+    // libunwindstack does for the non-leaf frames.
+    const uint64_t pc_adjustment =
+        sample.regs->Arch() == unwindstack::ARCH_ARM64 ? 4 : 1;
+    unwindstack::ErrorCode error_code = unwindstack::ERROR_NONE;
+    std::vector<unwindstack::FrameData> frames;
+    frames.reserve(sample.user_ips.size());
+    for (size_t i = 0;
+         i < sample.user_ips.size() && frames.size() < kUnwindingMaxFrames;
+         ++i) {
+      uint64_t pc = i == 0 ? sample.user_ips[i]
+                           : sample.user_ips[i] - pc_adjustment;
+      if (unwind_state->fd_maps.Find(pc) == nullptr)
+        error_code = unwindstack::ERROR_INVALID_MAP;
+      unwindstack::FrameData frame = unwinder.BuildFrameFromPcOnly(pc);
+      frame.num = frames.size();
+      frames.emplace_back(std::move(frame));
+    }
+    return {error_code, 0, std::move(frames)};
+  };
+
   // first unwind attempt
-  UnwindResult unwind = attempt_unwind();
+  UnwindResult unwind =
+      frame_pointer_unwinding ? attempt_symbolize() : attempt_unwind();
 
   bool should_retry = unwind.error_code == unwindstack::ERROR_INVALID_MAP ||
                       unwind.warnings & unwindstack::WARNING_DEX_PC_NOT_IN_MAP;
@@ -374,7 +470,7 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
       unwind_state->ReparseMaps();
     }
     // reunwind attempt
-    unwind = attempt_unwind();
+    unwind = frame_pointer_unwinding ? attempt_symbolize() : attempt_unwind();
   }
 
   // Symbolize kernel-unwound kernel frames (if any).
@@ -424,7 +520,7 @@ std::vector<unwindstack::FrameData> Unwinder::SymbolizeKernelCallchain(
   // The list of addresses contains special context marker values (inserted by
   // the kernel's unwinding) to indicate which section of the callchain belongs
   // to the kernel/user mode (if the kernel can successfully unwind user
-  // stacks). In our case, we request only the kernel frames.
+  // stacks). The event reader keeps only the kernel section here.
   if (sample.kernel_ips[0] != PERF_CONTEXT_KERNEL) {
     PERFETTO_DFATAL_OR_ELOG(
         "Unexpected: 0th frame of callchain is not PERF_CONTEXT_KERNEL.");
@@ -552,15 +648,14 @@ void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
 void Unwinder::ResetAndEnableUnwindstackCache() {
   PERFETTO_DLOG("Resetting unwindstack cache");
   // Libunwindstack uses an unsynchronized variable for setting/checking whether
-  // the cache is enabled. Therefore unwinding and cache toggling should stay on
-  // the same thread, but we might be moving unwinding across threads if we're
-  // recreating |Unwinder| instances (during a reconnect to traced). Therefore,
-  // use our own static lock to synchronize the cache toggling.
+  // the cache is enabled. Therefore cache toggling must not overlap with the
+  // unwinds of the other |Unwinder| threads, nor with the toggling done by the
+  // |Unwinder| instances being recreated during a reconnect to traced.
   // TODO(rsavitski): consider fixing this in libunwindstack itself.
-  static std::mutex* lock = new std::mutex{};
-  std::lock_guard<std::mutex> guard{*lock};
-  unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
-  unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
+  UnwindstackCacheLock::Get()->RunExclusively([] {
+    unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
+    unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
+  });
 }
 
 }  // namespace profiling
@@ -45,7 +45,9 @@ constexpr static uint32_t kUnwindQueueCapacity = 1024;
 
 // Unwinds callstacks based on the sampled stack and register state (see
 // |ParsedSample|). Has a single unwinding ring queue, shared across
-// all data sources.
+// all data sources. The producer can run several unwinders, in which case the
+// samples of a given process always go to the same one, so that its parsed
+// maps stay warm.
 //
 // Samples cannot be unwound without having /proc/<pid>/{maps,mem} file
 // descriptors for that process. This lookup can be asynchronous (e.g. on
@@ -88,7 +90,9 @@ class Unwinder {
 
   ~Unwinder() { PERFETTO_DCHECK_THREAD(thread_checker_); }
 
-  void PostStartDataSource(DataSourceInstanceID ds_id, bool kernel_frames);
+  void PostStartDataSource(DataSourceInstanceID ds_id,
+                           bool kernel_frames,
+                           bool frame_pointer_unwinding);
   void PostAdoptProcDescriptors(DataSourceInstanceID ds_id,
                                 pid_t pid,
                                 base::ScopedFile maps_fd,
@@ -141,6 +145,9 @@ class Unwinder {
     enum class Status { kActive, kShuttingDown };
 
     Status status = Status::kActive;
+    // If true, the userspace callstacks were unwound by the kernel, and only
+    // need to be symbolized.
+    bool frame_pointer_unwinding = false;
     std::map<pid_t, ProcessState> process_states;
   };
 
@@ -158,7 +165,9 @@ class Unwinder {
 
   // Marks the data source as valid and active at the unwinding stage.
   // Initializes kernel address symbolization if needed.
-  void StartDataSource(DataSourceInstanceID ds_id, bool kernel_frames);
+  void StartDataSource(DataSourceInstanceID ds_id,
+                       bool kernel_frames,
+                       bool frame_pointer_unwinding);
 
   void AdoptProcDescriptors(DataSourceInstanceID ds_id,
                             pid_t pid,
@@ -177,7 +186,8 @@ class Unwinder {
 
   CompletedSample UnwindSample(const ParsedSample& sample,
                                UnwindingMetadata* unwind_state,
-                               bool pid_unwound_before);
+                               bool pid_unwound_before,
+                               bool frame_pointer_unwinding);
 
   // Returns a list of symbolized kernel frames in the sample (if any).
   std::vector<unwindstack::FrameData> SymbolizeKernelCallchain(
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/caching_symbolizer.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// Cache file format, one line per address:
+// load_bias<TAB>address[<TAB>function<TAB>file<TAB>line]...
+// with the numbers in hex, and one function/file/line triple per frame.
+constexpr char kFieldSeparator = '\t';
+
+// Unlike base::SplitString, keeps the empty fields.
+std::vector<std::string> SplitFields(const std::string& line) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (;;) {
+    size_t end = line.find(kFieldSeparator, start);
+    if (end == std::string::npos) {
+      fields.emplace_back(line.substr(start));
+      return fields;
+    }
+    fields.emplace_back(line.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+bool IsSerializable(const std::string& field) {
+  return field.find_first_of("\t\n") == std::string::npos;
+}
+
+}  // namespace
+
+std::string SerializeCacheEntry(uint64_t load_bias,
+                                uint64_t address,
+                                const std::vector<SymbolizedFrame>& frames) {
+  std::string line = base::Uint64ToHexStringNoPrefix(load_bias) +
+                     kFieldSeparator +
+                     base::Uint64ToHexStringNoPrefix(address);
+  for (const SymbolizedFrame& frame : frames) {
+    if (!IsSerializable(frame.function_name) ||
+        !IsSerializable(frame.file_name)) {
+      return "";
+    }
+    line += kFieldSeparator + frame.function_name + kFieldSeparator +
+            frame.file_name + kFieldSeparator +
+            base::Uint64ToHexStringNoPrefix(frame.line);
+  }
+  return line;
+}
+
+bool ParseCacheEntry(const std::string& line,
+                     uint64_t* load_bias,
+                     uint64_t* address,
+                     std::vector<SymbolizedFrame>* frames) {
+  std::vector<std::string> fields = SplitFields(line);
+  if (fields.size() < 2 || (fields.size() - 2) % 3 != 0)
+    return false;
+  base::Optional<uint64_t> parsed_load_bias =
+      base::StringToUInt64(fields[0], 16);
+  base::Optional<uint64_t> parsed_address = base::StringToUInt64(fields[1], 16);
+  if (!parsed_load_bias || !parsed_address)
+    return false;
+
+  frames->clear();
+  for (size_t i = 2; i < fields.size(); i += 3) {
+    base::Optional<uint32_t> line_no = base::StringToUInt32(fields[i + 2], 16);
+    if (!line_no)
+      return false;
+    frames->emplace_back(
+        SymbolizedFrame{std::move(fields[i]), std::move(fields[i + 1]),
+                        *line_no});
+  }
+  *load_bias = *parsed_load_bias;
+  *address = *parsed_address;
+  return true;
+}
+
+CachingSymbolizer::CachingSymbolizer(std::string cache_dir,
+                                     std::unique_ptr<Symbolizer> symbolizer)
+    : cache_dir_(std::move(cache_dir)), symbolizer_(std::move(symbolizer)) {
+  // Might already exist.
+  base::Mkdir(cache_dir_);
+}
+
+std::vector<std::vector<SymbolizedFrame>> CachingSymbolizer::Symbolize(
+    const std::string& mapping_name,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses) {
+  if (build_id.empty())
+    return symbolizer_->Symbolize(mapping_name, build_id, load_bias, addresses);
+
+  CacheEntries* entries = GetOrLoadEntries(build_id);
+  std::vector<std::vector<SymbolizedFrame>> result(addresses.size());
+  std::vector<uint64_t> missing;
+  std::vector<size_t> missing_idx;
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    auto it = entries->find(std::make_pair(load_bias, addresses[i]));
+    if (it != entries->end()) {
+      result[i] = it->second;
+    } else {
+      missing.push_back(addresses[i]);
+      missing_idx.push_back(i);
+    }
+  }
+  if (missing.empty())
+    return result;
+
+  std::vector<std::vector<SymbolizedFrame>> symbolized =
+      symbolizer_->Symbolize(mapping_name, build_id, load_bias, missing);
+  // Failure to symbolize the mapping as a whole, e.g. binary not found.
+  if (symbolized.size() != missing.size())
+    return missing.size() == addresses.size() ? symbolized : result;
+
+  std::string new_lines;
+  for (size_t i = 0; i < missing.size(); ++i) {
+    if (!symbolized[i].empty()) {
+      std::string line =
+          SerializeCacheEntry(load_bias, missing[i], symbolized[i]);
+      if (!line.empty())
+        new_lines += line + "\n";
+      (*entries)[std::make_pair(load_bias, missing[i])] = symbolized[i];
+    }
+    result[missing_idx[i]] = std::move(symbolized[i]);
+  }
+
+  // A single append per call keeps concurrent writers from interleaving
+  // partial lines.
+  if (!new_lines.empty()) {
+    base::ScopedFile fd = base::OpenFile(CacheFilePath(build_id),
+                                         O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (!fd || base::WriteAll(*fd, new_lines.data(), new_lines.size()) !=
+                   static_cast<ssize_t>(new_lines.size())) {
+      PERFETTO_PLOG("Failed to update symbolization cache for %s",
+                    base::ToHex(build_id).c_str());
+    }
+  }
+  return result;
+}
+
+std::string CachingSymbolizer::CacheFilePath(
+    const std::string& build_id) const {
+  return cache_dir_ + "/" + base::ToHex(build_id);
+}
+
+CachingSymbolizer::CacheEntries* CachingSymbolizer::GetOrLoadEntries(
+    const std::string& build_id) {
+  auto it_and_inserted = entries_.emplace(build_id, CacheEntries());
+  CacheEntries* entries = &it_and_inserted.first->second;
+  if (!it_and_inserted.second)
+    return entries;
+
+  std::string contents;
+  if (!base::ReadFile(CacheFilePath(build_id), &contents))
+    return entries;  // nothing cached yet
+
+  for (const std::string& line : base::SplitString(contents, "\n")) {
+    uint64_t load_bias;
+    uint64_t address;
+    std::vector<SymbolizedFrame> frames;
+    if (!ParseCacheEntry(line, &load_bias, &address, &frames)) {
+      PERFETTO_ELOG("Skipping invalid symbolization cache line for %s",
+                    base::ToHex(build_id).c_str());
+      continue;
+    }
+    (*entries)[std::make_pair(load_bias, address)] = std::move(frames);
+  }
+  return entries;
+}
+
+CachingSymbolizer::~CachingSymbolizer() = default;
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_CACHING_SYMBOLIZER_H_
+#define SRC_PROFILING_SYMBOLIZER_CACHING_SYMBOLIZER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/profiling/symbolizer/symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Wraps another Symbolizer, and persists the symbolized addresses of every
+// build id in a file in |cache_dir|. The cache can be shared by multiple tools
+// and runs: the files are only ever appended to, one line per address.
+//
+// Mappings without a build id are passed through. Addresses that could not be
+// symbolized are not cached, so that they are retried with better binaries.
+class CachingSymbolizer : public Symbolizer {
+ public:
+  CachingSymbolizer(std::string cache_dir,
+                    std::unique_ptr<Symbolizer> symbolizer);
+
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string& build_id,
+      uint64_t load_bias,
+      const std::vector<uint64_t>& address) override;
+
+  ~CachingSymbolizer() override;
+
+ private:
+  // (load_bias, address) -> frames.
+  using CacheEntries =
+      std::map<std::pair<uint64_t, uint64_t>, std::vector<SymbolizedFrame>>;
+
+  std::string CacheFilePath(const std::string& build_id) const;
+  CacheEntries* GetOrLoadEntries(const std::string& build_id);
+
+  const std::string cache_dir_;
+  std::unique_ptr<Symbolizer> symbolizer_;
+  // Keyed by build id.
+  std::map<std::string, CacheEntries> entries_;
+};
+
+// Exposed for testing.
+std::string SerializeCacheEntry(uint64_t load_bias,
+                                uint64_t address,
+                                const std::vector<SymbolizedFrame>& frames);
+bool ParseCacheEntry(const std::string& line,
+                     uint64_t* load_bias,
+                     uint64_t* address,
+                     std::vector<SymbolizedFrame>* frames);
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_CACHING_SYMBOLIZER_H_
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/caching_symbolizer.h"
+
+#include <stdio.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+
+bool operator==(const SymbolizedFrame& a, const SymbolizedFrame& b) {
+  return a.function_name == b.function_name && a.file_name == b.file_name &&
+         a.line == b.line;
+}
+
+namespace {
+
+class FakeSymbolizer : public Symbolizer {
+ public:
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string&,
+      const std::string&,
+      uint64_t,
+      const std::vector<uint64_t>& addresses) override {
+    std::vector<std::vector<SymbolizedFrame>> result;
+    for (uint64_t address : addresses) {
+      requested.push_back(address);
+      if (address == kUnknownAddress) {
+        result.emplace_back();
+        continue;
+      }
+      result.push_back({{"fn" + std::to_string(address), "file.cc", 1},
+                        {"inlined", "", 2}});
+    }
+    return result;
+  }
+
+  static constexpr uint64_t kUnknownAddress = 0xdead;
+  std::vector<uint64_t> requested;
+};
+
+constexpr uint64_t FakeSymbolizer::kUnknownAddress;
+
+TEST(CachingSymbolizerTest, SerializeAndParse) {
+  std::vector<SymbolizedFrame> frames = {{"foo(int)", "foo.cc", 12},
+                                         {"bar", "", 0}};
+  std::string line = SerializeCacheEntry(0x1000, 0x1234, frames);
+
+  uint64_t load_bias;
+  uint64_t address;
+  std::vector<SymbolizedFrame> parsed;
+  ASSERT_TRUE(ParseCacheEntry(line, &load_bias, &address, &parsed));
+  EXPECT_EQ(load_bias, 0x1000u);
+  EXPECT_EQ(address, 0x1234u);
+  EXPECT_TRUE(parsed == frames);
+
+  EXPECT_FALSE(ParseCacheEntry("1000\t1234\tfoo", &load_bias, &address,
+                               &parsed));
+  EXPECT_EQ(SerializeCacheEntry(0, 0, {{"a\tb", "", 0}}), "");
+}
+
+TEST(CachingSymbolizerTest, PersistsAcrossInstances) {
+  base::TempDir tmp = base::TempDir::Create();
+  std::string cache_dir = tmp.path() + "/cache";
+  std::string build_id = "\x01\x02";
+
+  std::vector<std::vector<SymbolizedFrame>> first_result;
+  {
+    FakeSymbolizer* fake = new FakeSymbolizer();
+    CachingSymbolizer symbolizer(cache_dir,
+                                 std::unique_ptr<Symbolizer>(fake));
+    first_result = symbolizer.Symbolize("libfoo.so", build_id, 0,
+                                        {1, 2, FakeSymbolizer::kUnknownAddress});
+    EXPECT_THAT(fake->requested,
+                testing::ElementsAre(1, 2, FakeSymbolizer::kUnknownAddress));
+    ASSERT_EQ(first_result.size(), 3u);
+    EXPECT_TRUE(first_result[2].empty());
+
+    // Served from memory.
+    fake->requested.clear();
+    symbolizer.Symbolize("libfoo.so", build_id, 0, {2});
+    EXPECT_TRUE(fake->requested.empty());
+  }
+
+  FakeSymbolizer* fake = new FakeSymbolizer();
+  CachingSymbolizer symbolizer(cache_dir, std::unique_ptr<Symbolizer>(fake));
+  std::vector<std::vector<SymbolizedFrame>> result = symbolizer.Symbolize(
+      "libfoo.so", build_id, 0, {1, 2, FakeSymbolizer::kUnknownAddress, 3});
+  // Only the unknown and new addresses are symbolized again.
+  EXPECT_THAT(fake->requested,
+              testing::ElementsAre(FakeSymbolizer::kUnknownAddress, 3));
+  ASSERT_EQ(result.size(), 4u);
+  EXPECT_TRUE(result[0] == first_result[0]);
+  EXPECT_TRUE(result[1] == first_result[1]);
+  EXPECT_EQ(result[3][0].function_name, "fn3");
+
+  // A different load bias is a different entry.
+  fake->requested.clear();
+  symbolizer.Symbolize("libfoo.so", build_id, 0x1000, {1});
+  EXPECT_THAT(fake->requested, testing::ElementsAre(1));
+
+  remove((cache_dir + "/" + base::ToHex(build_id)).c_str());
+  base::Rmdir(cache_dir);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
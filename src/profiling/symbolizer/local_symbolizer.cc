@@ -17,6 +17,7 @@
 #include "src/profiling/symbolizer/local_symbolizer.h"
 
 #include <fcntl.h>
+#include <stdlib.h>
 
 #include <memory>
 #include <sstream>
@@ -30,6 +31,7 @@
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "src/profiling/symbolizer/caching_symbolizer.h"
 #include "src/profiling/symbolizer/filesystem.h"
 #include "src/profiling/symbolizer/scoped_read_mmap.h"
 
@@ -53,6 +55,14 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     else
       PERFETTO_FATAL("Invalid symbolizer mode [find | index]: %s", mode);
     symbolizer.reset(new LocalSymbolizer(std::move(finder)));
+
+    // Optionally persist the results, which makes repeated symbolization of
+    // the same binaries much faster.
+    const char* cache_dir = getenv("PERFETTO_SYMBOLIZER_CACHE_DIR");
+    if (cache_dir && *cache_dir) {
+      symbolizer.reset(
+          new CachingSymbolizer(cache_dir, std::move(symbolizer)));
+    }
 #else
     base::ignore_result(mode);
     PERFETTO_FATAL("This build does not support local symbolization.");
@@ -61,6 +71,21 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
   return symbolizer;
 }
 
+std::vector<std::unique_ptr<Symbolizer>> LocalSymbolizersOrDie(
+    const std::vector<std::string>& binary_path,
+    const char* mode,
+    size_t count) {
+  std::vector<std::unique_ptr<Symbolizer>> symbolizers;
+  for (size_t i = 0; i < count; ++i) {
+    std::unique_ptr<Symbolizer> symbolizer =
+        LocalSymbolizerOrDie(binary_path, mode);
+    if (!symbolizer)
+      break;
+    symbolizers.emplace_back(std::move(symbolizer));
+  }
+  return symbolizers;
+}
+
 }  // namespace profiling
 }  // namespace perfetto
 
@@ -443,11 +468,17 @@ bool ParseLlvmSymbolizerLine(const std::string& line,
 BinaryFinder::~BinaryFinder() = default;
 
 LocalBinaryIndexer::LocalBinaryIndexer(std::vector<std::string> roots)
-    : buildid_to_file_(BuildIdIndex(std::move(roots))) {}
+    : roots_(std::move(roots)) {}
 
 base::Optional<FoundBinary> LocalBinaryIndexer::FindBinary(
     const std::string& abspath,
     const std::string& build_id) {
+  // Index lazily, as all the lookups might be answered by the
+  // CachingSymbolizer.
+  if (!indexed_) {
+    buildid_to_file_ = BuildIdIndex(std::move(roots_));
+    indexed_ = true;
+  }
   auto it = buildid_to_file_.find(build_id);
   if (it != buildid_to_file_.end())
     return it->second;
@@ -58,6 +58,8 @@ class LocalBinaryIndexer : public BinaryFinder {
   ~LocalBinaryIndexer() override;
 
  private:
+  std::vector<std::string> roots_;
+  bool indexed_ = false;
   std::map<std::string, FoundBinary> buildid_to_file_;
 };
 
@@ -118,6 +120,13 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     std::vector<std::string> binary_path,
     const char* mode);
 
+// Returns |count| independent symbolizers, to be used on different threads, or
+// none if no binary path is given.
+std::vector<std::unique_ptr<Symbolizer>> LocalSymbolizersOrDie(
+    const std::vector<std::string>& binary_path,
+    const char* mode,
+    size_t count);
+
 }  // namespace profiling
 }  // namespace perfetto
 
@@ -16,7 +16,10 @@
 
 #include "src/profiling/symbolizer/symbolize_database.h"
 
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -42,6 +45,10 @@ constexpr const char* kQueryUnsymbolized =
     "on spf.mapping = spm.id "
     "where spm.build_id != '' and spf.symbol_set_id IS NULL";
 
+constexpr const char* kQueryJavaClassNames =
+    "select distinct name from heap_graph_class "
+    "union select distinct name from stack_profile_frame";
+
 using NameAndBuildIdPair = std::pair<std::string, std::string>;
 
 struct UnsymbolizedMapping {
@@ -100,6 +107,36 @@ std::map<UnsymbolizedMapping, std::vector<uint64_t>> GetUnsymbolizedFrames(
   }
   return res;
 }
+
+// Returns the serialized ModuleSymbols packet for the mapping, or an empty
+// string if it could not be symbolized.
+std::string SymbolizeMapping(Symbolizer* symbolizer,
+                             const UnsymbolizedMapping& unsymbolized_mapping,
+                             const std::vector<uint64_t>& rel_pcs) {
+  auto res = symbolizer->Symbolize(unsymbolized_mapping.name,
+                                   unsymbolized_mapping.build_id,
+                                   unsymbolized_mapping.load_bias, rel_pcs);
+  if (res.empty())
+    return "";
+
+  protozero::HeapBuffered<perfetto::protos::pbzero::Trace> trace;
+  auto* packet = trace->add_packet();
+  auto* module_symbols = packet->set_module_symbols();
+  module_symbols->set_path(unsymbolized_mapping.name);
+  module_symbols->set_build_id(unsymbolized_mapping.build_id);
+  PERFETTO_DCHECK(res.size() == rel_pcs.size());
+  for (size_t i = 0; i < res.size(); ++i) {
+    auto* address_symbols = module_symbols->add_address_symbols();
+    address_symbols->set_address(rel_pcs[i]);
+    for (const SymbolizedFrame& frame : res[i]) {
+      auto* line = address_symbols->add_lines();
+      line->set_function_name(frame.function_name);
+      line->set_source_file_name(frame.file_name);
+      line->set_line_number(frame.line);
+    }
+  }
+  return trace.SerializeAsString();
+}
 }  // namespace
 
 void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
@@ -108,32 +145,84 @@ void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
   PERFETTO_CHECK(symbolizer);
   auto unsymbolized = GetUnsymbolizedFrames(tp);
   for (auto it = unsymbolized.cbegin(); it != unsymbolized.cend(); ++it) {
-    const auto& unsymbolized_mapping = it->first;
-    const std::vector<uint64_t>& rel_pcs = it->second;
-    auto res = symbolizer->Symbolize(unsymbolized_mapping.name,
-                                     unsymbolized_mapping.build_id,
-                                     unsymbolized_mapping.load_bias, rel_pcs);
-    if (res.empty())
-      continue;
+    std::string packet = SymbolizeMapping(symbolizer, it->first, it->second);
+    if (!packet.empty())
+      callback(packet);
+  }
+}
+
+void SymbolizeDatabase(
+    trace_processor::TraceProcessor* tp,
+    const std::vector<std::unique_ptr<Symbolizer>>& symbolizers,
+    std::function<void(const std::string&)> callback) {
+  PERFETTO_CHECK(!symbolizers.empty());
+  if (symbolizers.size() == 1) {
+    SymbolizeDatabase(tp, symbolizers[0].get(), std::move(callback));
+    return;
+  }
 
-    protozero::HeapBuffered<perfetto::protos::pbzero::Trace> trace;
-    auto* packet = trace->add_packet();
-    auto* module_symbols = packet->set_module_symbols();
-    module_symbols->set_path(unsymbolized_mapping.name);
-    module_symbols->set_build_id(unsymbolized_mapping.build_id);
-    PERFETTO_DCHECK(res.size() == rel_pcs.size());
-    for (size_t i = 0; i < res.size(); ++i) {
-      auto* address_symbols = module_symbols->add_address_symbols();
-      address_symbols->set_address(rel_pcs[i]);
-      for (const SymbolizedFrame& frame : res[i]) {
-        auto* line = address_symbols->add_lines();
-        line->set_function_name(frame.function_name);
-        line->set_source_file_name(frame.file_name);
-        line->set_line_number(frame.line);
+  auto unsymbolized = GetUnsymbolizedFrames(tp);
+  std::vector<decltype(unsymbolized)::const_iterator> mappings;
+  for (auto it = unsymbolized.cbegin(); it != unsymbolized.cend(); ++it)
+    mappings.push_back(it);
+
+  // Symbolizers are not thread-safe, so each thread owns one, and takes the
+  // next mapping when done with the previous one. The results are kept in the
+  // order of the mappings, so the output doesn't depend on the scheduling.
+  std::vector<std::string> packets(mappings.size());
+  std::atomic<size_t> next_mapping{0};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < symbolizers.size() && i < mappings.size(); ++i) {
+    Symbolizer* symbolizer = symbolizers[i].get();
+    threads.emplace_back([symbolizer, &mappings, &packets, &next_mapping] {
+      for (size_t idx = next_mapping++; idx < mappings.size();
+           idx = next_mapping++) {
+        packets[idx] = SymbolizeMapping(symbolizer, mappings[idx]->first,
+                                        mappings[idx]->second);
       }
-    }
-    callback(trace.SerializeAsString());
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  for (const std::string& packet : packets) {
+    if (!packet.empty())
+      callback(packet);
+  }
+}
+
+std::set<std::string> GetJavaClassNames(trace_processor::TraceProcessor* tp) {
+  std::set<std::string> res;
+  Iterator it = tp->ExecuteQuery(kQueryJavaClassNames);
+  while (it.Next()) {
+    if (it.Get(0).is_null())
+      continue;
+    std::string name = it.Get(0).AsString();
+    // Heap graph classes: "a.b.c" or arrays of them, "a.b.c[]".
+    while (base::EndsWith(name, "[]"))
+      name.resize(name.size() - 2);
+    res.insert(name);
+    // Java frames: "a.b.c.method".
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos)
+      res.insert(name.substr(0, dot));
+  }
+  if (!it.Status().ok()) {
+    PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
+                            it.Status().message().c_str());
+  }
+  return res;
+}
+
+size_t GetSymbolizerThreadCount() {
+  const char* threads = getenv("PERFETTO_SYMBOLIZER_THREADS");
+  if (threads != nullptr) {
+    base::Optional<uint32_t> count = base::CStringToUInt32(threads);
+    if (count && *count > 0)
+      return *count;
+    PERFETTO_ELOG("Invalid PERFETTO_SYMBOLIZER_THREADS: %s", threads);
   }
+  return std::max(1u, std::thread::hardware_concurrency());
 }
 
 std::vector<std::string> GetPerfettoBinaryPath() {
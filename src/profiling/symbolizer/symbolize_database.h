@@ -20,6 +20,8 @@
 #include "src/profiling/symbolizer/symbolizer.h"
 
 #include <functional>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -29,11 +31,25 @@ class TraceProcessor;
 }
 namespace profiling {
 std::vector<std::string> GetPerfettoBinaryPath();
+// Returns the names of the Java classes referenced by the heap graphs and
+// callstacks in the database, as they appear in the trace (possibly
+// obfuscated). Used to parse only the relevant parts of ProGuard maps.
+std::set<std::string> GetJavaClassNames(trace_processor::TraceProcessor* tp);
+// Number of symbolizers to use concurrently, from PERFETTO_SYMBOLIZER_THREADS
+// or the number of cores.
+size_t GetSymbolizerThreadCount();
 // Generate ModuleSymbol protos for all unsymbolized frames in the database.
 // Wrap them in proto-encoded TracePackets messages and call callback.
 void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
                        Symbolizer* symbolizer,
                        std::function<void(const std::string&)> callback);
+// Same as above, but the mappings are spread over |symbolizers|, each used on
+// its own thread. |callback| is still called on the calling thread, in the
+// same order as with a single symbolizer.
+void SymbolizeDatabase(
+    trace_processor::TraceProcessor* tp,
+    const std::vector<std::unique_ptr<Symbolizer>>& symbolizers,
+    std::function<void(const std::string&)> callback);
 }  // namespace profiling
 }  // namespace perfetto
 
@@ -186,9 +186,9 @@ bool FilterBytecodeParser::LoadInternal(const uint8_t* bytecode_data,
   return true;
 }
 
-FilterBytecodeParser::QueryResult FilterBytecodeParser::Query(
+FilterBytecodeParser::QueryResult FilterBytecodeParser::QuerySlowPath(
     uint32_t msg_index,
-    uint32_t field_id) {
+    uint32_t field_id) const {
   FilterBytecodeParser::QueryResult res{false, 0u};
   if (static_cast<uint64_t>(msg_index) + 1 >=
       static_cast<uint64_t>(message_offset_.size())) {
@@ -222,8 +222,7 @@ FilterBytecodeParser::QueryResult FilterBytecodeParser::Query(
     }  // for (word in ranges)
   }    // if (field_id >= num_directly_indexed)
 
-  res.allowed = (field_state & kAllowed) != 0;
-  res.nested_msg_index = field_state & ~kAllowed;
+  res = ToQueryResult(field_state);
   PERFETTO_DCHECK(res.simple_field() ||
                   res.nested_msg_index < message_offset_.size() - 1);
   return res;
@@ -22,6 +22,8 @@
 
 #include <vector>
 
+#include "perfetto/base/compiler.h"
+
 namespace protozero {
 
 // Loads the proto-encoded bytecode in memory and allows fast lookups for tuples
@@ -64,7 +66,19 @@ class FilterBytecodeParser {
   // Checks wheter a given field is allowed or not.
   // msg_index = 0 is the index of the root message, where all queries should
   // start from (typically perfetto.protos.Trace).
-  QueryResult Query(uint32_t msg_index, uint32_t field_id);
+  // This is inline as it is called for each field of the filtered messages:
+  // directly indexed fields are looked up without any call, only the others
+  // go through the search of the field id ranges in QuerySlowPath().
+  QueryResult Query(uint32_t msg_index, uint32_t field_id) const {
+    if (PERFETTO_LIKELY(static_cast<uint64_t>(msg_index) + 1 <
+                        static_cast<uint64_t>(message_offset_.size()))) {
+      const uint32_t* word = &words_[message_offset_[msg_index]];
+      const uint32_t num_directly_indexed = *(word++);
+      if (PERFETTO_LIKELY(field_id < num_directly_indexed))
+        return ToQueryResult(word[field_id]);
+    }
+    return QuerySlowPath(msg_index, field_id);
+  }
 
   void Reset();
   void set_suppress_logs_for_fuzzer(bool x) { suppress_logs_for_fuzzer_ = x; }
@@ -76,6 +90,13 @@ class FilterBytecodeParser {
 
   bool LoadInternal(const uint8_t* filter_data, size_t len);
 
+  QueryResult QuerySlowPath(uint32_t msg_index, uint32_t field_id) const;
+
+  // Decodes a "field state" word of |words_| (see below).
+  static QueryResult ToQueryResult(uint32_t field_state) {
+    return QueryResult{(field_state & kAllowed) != 0, field_state & ~kAllowed};
+  }
+
   // The state of all fields for all messages is stored in one contiguous array.
   // This is to avoid memory fragmentation and allocator overhead.
   // We expect a high number of messages (hundreds), but each message is small.
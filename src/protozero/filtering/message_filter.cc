@@ -16,6 +16,10 @@
 
 #include "src/protozero/filtering/message_filter.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_utils.h"
 
@@ -66,6 +70,18 @@ inline std::pair<uint8_t*, uint32_t> AppendLenDelim(uint32_t field_id,
   const size_t size_field_len = static_cast<size_t>(*out - size_field_start);
   return std::make_pair(size_field_start, size_field_len);
 }
+
+// Decodes a varint of a field preamble. Tags, lengths and most of the varint
+// values of the trace protos take a single byte, hence the fast path.
+inline const uint8_t* ParsePreambleVarInt(const uint8_t* pos,
+                                          const uint8_t* end,
+                                          uint64_t* value) {
+  if (PERFETTO_LIKELY(pos < end && *pos < 0x80)) {
+    *value = *pos;
+    return pos + 1;
+  }
+  return proto_utils::ParseVarInt(pos, end, value);
+}
 }  // namespace
 
 MessageFilter::MessageFilter() {
@@ -102,8 +118,57 @@ MessageFilter::FilteredMessage MessageFilter::FilterMessageFragments(
   for (size_t i = 0; i < num_slices; ++i)
     total_len += slices[i].len;
   out_buf_.reset(new uint8_t[total_len]);
-  out_ = out_buf_.get();
-  out_end_ = out_ + total_len;
+
+  bool error = false;
+  size_t used_size =
+      FilterMessageInto(slices, num_slices, out_buf_.get(), &error);
+  FilteredMessage res{std::move(out_buf_), used_size};
+  res.error = error;
+  return res;
+}
+
+void MessageFilter::FilterMessageBatch(const InputSlice* slices,
+                                       const BatchInput* messages,
+                                       size_t num_messages,
+                                       std::vector<BatchOutput>* out) {
+  // The output of each message is <= its input, so the input size of the
+  // whole batch is an upper bound for the arena.
+  size_t total_len = 0;
+  const InputSlice* slice = slices;
+  for (size_t i = 0; i < num_messages; ++i) {
+    for (size_t j = 0; j < messages[i].num_slices; ++j)
+      total_len += (slice++)->len;
+  }
+  if (total_len > batch_arena_size_) {
+    batch_arena_.reset(new uint8_t[total_len]);
+    batch_arena_size_ = total_len;
+  }
+
+  out->reserve(out->size() + num_messages);
+  uint8_t* wptr = batch_arena_.get();
+  slice = slices;
+  for (size_t i = 0; i < num_messages; ++i) {
+    const size_t num_slices = messages[i].num_slices;
+    bool error = false;
+    size_t size = FilterMessageInto(slice, num_slices, wptr, &error);
+    if (error)
+      size = 0;
+    out->push_back(BatchOutput{wptr, size, error});
+    wptr += size;
+    slice += num_slices;
+  }
+}
+
+size_t MessageFilter::FilterMessageInto(const InputSlice* slices,
+                                        size_t num_slices,
+                                        uint8_t* out,
+                                        bool* error) {
+  uint32_t total_len = 0;
+  for (size_t i = 0; i < num_slices; ++i)
+    total_len += slices[i].len;
+  out_start_ = out;
+  out_ = out;
+  out_end_ = out + total_len;
 
   // Reset the parser state.
   tokenizer_ = MessageTokenizer();
@@ -123,118 +188,209 @@ MessageFilter::FilteredMessage MessageFilter::FilterMessageFragments(
   for (size_t slice_idx = 0; slice_idx < num_slices; ++slice_idx) {
     const InputSlice& slice = slices[slice_idx];
     const uint8_t* data = static_cast<const uint8_t*>(slice.data);
-    for (size_t i = 0; i < slice.len; ++i)
-      FilterOneByte(data[i]);
+    for (size_t i = 0; i < slice.len;) {
+      size_t eaten = EatBytesInBulk(&data[i], slice.len - i);
+      if (!eaten)
+        eaten = FilterFieldPreamble(&data[i], slice.len - i);
+      if (eaten) {
+        i += eaten;
+        continue;
+      }
+      FilterOneByte(data[i++]);
+    }
   }
 
-  // Construct the output object.
-  PERFETTO_CHECK(out_ >= out_buf_.get() && out_ <= out_end_);
-  auto used_size = static_cast<size_t>(out_ - out_buf_.get());
-  FilteredMessage res{std::move(out_buf_), used_size};
-  res.error = error_;
-  if (stack_.size() != 1 || !tokenizer_.idle() ||
-      stack_[0].in_bytes != total_len) {
-    res.error = true;
+  PERFETTO_CHECK(out_ >= out_start_ && out_ <= out_end_);
+  *error = error_ || stack_.size() != 1 || !tokenizer_.idle() ||
+           stack_[0].in_bytes != total_len;
+  return static_cast<size_t>(out_ - out_start_);
+}
+
+size_t MessageFilter::EatBytesInBulk(const uint8_t* data, size_t len) {
+  StackState* state = &stack_.back();
+  if (state->eat_next_bytes == 0)
+    return 0;
+
+  // The span of a string/bytes field or of a dropped submessage doesn't need
+  // to be tokenized: it is either copied or skipped as a whole. This is also
+  // what swallows the input after an error.
+  const uint32_t n =
+      static_cast<uint32_t>(std::min<size_t>(state->eat_next_bytes, len));
+  if (state->passthrough_eaten_bytes) {
+    memcpy(out_, data, n);
+    out_ += n;
   }
-  return res;
+  state->eat_next_bytes -= n;
+  state->in_bytes += n;
+  if (state->in_bytes >= state->in_bytes_limit)
+    PopCompletedMessages();
+  return n;
+}
+
+size_t MessageFilter::FilterFieldPreamble(const uint8_t* data, size_t len) {
+  // Only whole preambles which lie within both the current slice and the
+  // current message are decoded here. Everything else (preambles split across
+  // slices, malformed fields, messages ending in the middle of a field) goes
+  // through the MessageTokenizer byte by byte.
+  if (!tokenizer_.idle())
+    return 0;
+  StackState* state = &stack_.back();
+  const uint8_t* const end =
+      data + std::min<size_t>(len, state->in_bytes_limit - state->in_bytes);
+
+  uint64_t tag = 0;
+  const uint8_t* pos = ParsePreambleVarInt(data, end, &tag);
+  if (pos == data)
+    return 0;
+  MessageTokenizer::Token token{};
+  token.field_id = static_cast<uint32_t>(tag >> 3);
+  if (PERFETTO_UNLIKELY(!token.valid()))
+    return 0;
+
+  using proto_utils::ProtoWireType;
+  token.type = static_cast<ProtoWireType>(tag & 7u);
+  switch (token.type) {
+    case ProtoWireType::kVarInt:
+    case ProtoWireType::kLengthDelimited: {
+      const uint8_t* value_start = pos;
+      pos = ParsePreambleVarInt(value_start, end, &token.value);
+      if (pos == value_start)
+        return 0;
+      if (token.type == ProtoWireType::kLengthDelimited &&
+          token.value > proto_utils::kMaxMessageLength) {
+        return 0;
+      }
+      break;
+    }
+    case ProtoWireType::kFixed32:
+    case ProtoWireType::kFixed64: {
+      const size_t size =
+          token.type == ProtoWireType::kFixed32 ? sizeof(uint32_t)
+                                                : sizeof(uint64_t);
+      if (static_cast<size_t>(end - pos) < size)
+        return 0;
+      // The values are little endian, as when decoded by the tokenizer.
+      memcpy(&token.value, pos, size);
+      pos += size;
+      break;
+    }
+    default:
+      return 0;
+  }
+
+  // FilterField() accounts for the last byte of the preamble.
+  const size_t preamble_len = static_cast<size_t>(pos - data);
+  state->in_bytes += static_cast<uint32_t>(preamble_len - 1);
+  FilterField(token);
+  return preamble_len;
 }
 
 void MessageFilter::FilterOneByte(uint8_t octet) {
   PERFETTO_DCHECK(!stack_.empty());
 
+  // The bytes of string/bytes fields and of dropped submessages are consumed
+  // by EatBytesInBulk(), so here we are always at the start (or in the
+  // middle) of a field preamble.
+  PERFETTO_DCHECK(stack_.back().eat_next_bytes == 0);
+  MessageTokenizer::Token token = tokenizer_.Push(octet);
+  // |token| will not be valid() in most cases and this is WAI. When pushing
+  // a varint field, only the last byte yields a token, all the other bytes
+  // return an invalid token, they just update the internal tokenizer state.
+  if (token.valid())
+    return FilterField(token);
+
   auto* state = &stack_.back();
-  StackState next_state{};
-  bool push_next_state = false;
-
-  if (state->eat_next_bytes > 0) {
-    // This is the case where the previous tokenizer_.Push() call returned a
-    // length delimited message which is NOT a submessage (a string or a bytes
-    // field). We just want to consume it, and pass it through in output
-    // if the field was allowed.
-    --state->eat_next_bytes;
-    if (state->passthrough_eaten_bytes)
-      *(out_++) = octet;
-  } else {
-    MessageTokenizer::Token token = tokenizer_.Push(octet);
-    // |token| will not be valid() in most cases and this is WAI. When pushing
-    // a varint field, only the last byte yields a token, all the other bytes
-    // return an invalid token, they just update the internal tokenizer state.
-    if (token.valid()) {
-      auto filter = filter_.Query(state->msg_index, token.field_id);
-      switch (token.type) {
-        case proto_utils::ProtoWireType::kVarInt:
-          if (filter.allowed && filter.simple_field())
-            AppendVarInt(token.field_id, token.value, &out_);
-          break;
-        case proto_utils::ProtoWireType::kFixed32:
-          if (filter.allowed && filter.simple_field())
-            AppendFixed(token.field_id, static_cast<uint32_t>(token.value),
-                        &out_);
-          break;
-        case proto_utils::ProtoWireType::kFixed64:
-          if (filter.allowed && filter.simple_field())
-            AppendFixed(token.field_id, static_cast<uint64_t>(token.value),
-                        &out_);
-          break;
-        case proto_utils::ProtoWireType::kLengthDelimited:
-          // Here we have two cases:
-          // A. A simple string/bytes field: we just want to consume the next
-          //    bytes (the string payload), optionally passing them through in
-          //    output if the field is allowed.
-          // B. This is a nested submessage. In this case we want to recurse and
-          //    push a new state on the stack.
-          // Note that we can't tell the difference between a
-          // "non-allowed string" and a "non-allowed submessage". But it doesn't
-          // matter because in both cases we just want to skip the next N bytes.
-          const auto submessage_len = static_cast<uint32_t>(token.value);
-          auto in_bytes_left = state->in_bytes_limit - state->in_bytes - 1;
-          if (PERFETTO_UNLIKELY(submessage_len > in_bytes_left)) {
-            // This is a malicious / malformed string/bytes/submessage that
-            // claims to be larger than the outer message that contains it.
-            return SetUnrecoverableErrorState();
-          }
-
-          if (filter.allowed && !filter.simple_field() && submessage_len > 0) {
-            // submessage_len == 0 is the edge case of a message with a 0-len
-            // (but present) submessage. In this case, if allowed, we don't want
-            // to push any further state (doing so would desync the FSM) but we
-            // still want to emit it.
-            // At this point |submessage_len| is only an upper bound. The
-            // final message written in output can be <= the one in input,
-            // only some of its fields might be allowed (also remember that
-            // this class implicitly removes redundancy varint encoding of
-            // len-delimited field lengths). The final length varint (the
-            // return value of AppendLenDelim()) will be filled when popping
-            // from |stack_|.
-            auto size_field =
-                AppendLenDelim(token.field_id, submessage_len, &out_);
-            push_next_state = true;
-            next_state.field_id = token.field_id;
-            next_state.msg_index = filter.nested_msg_index;
-            next_state.in_bytes_limit = submessage_len;
-            next_state.size_field = size_field.first;
-            next_state.size_field_len = size_field.second;
-            next_state.out_bytes_written_at_start = out_written();
-          } else {
-            // A string or bytes field, or a 0 length submessage.
-            state->eat_next_bytes = submessage_len;
-            state->passthrough_eaten_bytes = filter.allowed;
-            if (filter.allowed)
-              AppendLenDelim(token.field_id, submessage_len, &out_);
-          }
-          break;
-      }  // switch(type)
-
-      if (PERFETTO_UNLIKELY(track_field_usage_)) {
-        IncrementCurrentFieldUsage(token.field_id, filter.allowed);
+  ++state->in_bytes;
+  if (state->in_bytes >= state->in_bytes_limit)
+    PopCompletedMessages();
+}
+
+void MessageFilter::FilterField(const MessageTokenizer::Token& token) {
+  auto* state = &stack_.back();
+  auto filter = filter_.Query(state->msg_index, token.field_id);
+  switch (token.type) {
+    case proto_utils::ProtoWireType::kVarInt:
+      if (filter.allowed && filter.simple_field())
+        AppendVarInt(token.field_id, token.value, &out_);
+      break;
+    case proto_utils::ProtoWireType::kFixed32:
+      if (filter.allowed && filter.simple_field())
+        AppendFixed(token.field_id, static_cast<uint32_t>(token.value), &out_);
+      break;
+    case proto_utils::ProtoWireType::kFixed64:
+      if (filter.allowed && filter.simple_field())
+        AppendFixed(token.field_id, static_cast<uint64_t>(token.value), &out_);
+      break;
+    case proto_utils::ProtoWireType::kLengthDelimited:
+      // Here we have two cases:
+      // A. A simple string/bytes field: we just want to consume the next
+      //    bytes (the string payload), optionally passing them through in
+      //    output if the field is allowed.
+      // B. This is a nested submessage. In this case we want to recurse and
+      //    push a new state on the stack.
+      // Note that we can't tell the difference between a
+      // "non-allowed string" and a "non-allowed submessage". But it doesn't
+      // matter because in both cases we just want to skip the next N bytes.
+      const auto submessage_len = static_cast<uint32_t>(token.value);
+      auto in_bytes_left = state->in_bytes_limit - state->in_bytes - 1;
+      if (PERFETTO_UNLIKELY(submessage_len > in_bytes_left)) {
+        // This is a malicious / malformed string/bytes/submessage that
+        // claims to be larger than the outer message that contains it.
+        return SetUnrecoverableErrorState();
+      }
+
+      if (filter.allowed && !filter.simple_field() && submessage_len > 0) {
+        // submessage_len == 0 is the edge case of a message with a 0-len
+        // (but present) submessage. In this case, if allowed, we don't want
+        // to push any further state (doing so would desync the FSM) but we
+        // still want to emit it.
+        // At this point |submessage_len| is only an upper bound. The
+        // final message written in output can be <= the one in input,
+        // only some of its fields might be allowed (also remember that
+        // this class implicitly removes redundancy varint encoding of
+        // len-delimited field lengths). The final length varint (the
+        // return value of AppendLenDelim()) will be filled when popping
+        // from |stack_|.
+        auto size_field = AppendLenDelim(token.field_id, submessage_len, &out_);
+        if (PERFETTO_UNLIKELY(track_field_usage_))
+          IncrementCurrentFieldUsage(token.field_id, filter.allowed);
+
+        // The submessage can't end the current message, as it is not empty.
+        ++state->in_bytes;
+        PERFETTO_DCHECK(state->in_bytes < state->in_bytes_limit);
+        PERFETTO_DCHECK(tokenizer_.idle());
+        stack_.emplace_back();
+        StackState* next_state = &stack_.back();
+        next_state->field_id = token.field_id;
+        next_state->msg_index = filter.nested_msg_index;
+        next_state->in_bytes_limit = submessage_len;
+        next_state->size_field = size_field.first;
+        next_state->size_field_len = size_field.second;
+        next_state->out_bytes_written_at_start = out_written();
+        return;
+      } else {
+        // A string or bytes field, or a 0 length submessage.
+        state->eat_next_bytes = submessage_len;
+        state->passthrough_eaten_bytes = filter.allowed;
+        if (filter.allowed)
+          AppendLenDelim(token.field_id, submessage_len, &out_);
       }
-    }  // if (token.valid)
-  }    // if (eat_next_bytes == 0)
+      break;
+  }  // switch(type)
+
+  if (PERFETTO_UNLIKELY(track_field_usage_)) {
+    IncrementCurrentFieldUsage(token.field_id, filter.allowed);
+  }
 
   ++state->in_bytes;
+  if (state->in_bytes >= state->in_bytes_limit)
+    PopCompletedMessages();
+}
+
+void MessageFilter::PopCompletedMessages() {
+  auto* state = &stack_.back();
   while (state->in_bytes >= state->in_bytes_limit) {
     PERFETTO_DCHECK(state->in_bytes == state->in_bytes_limit);
-    push_next_state = false;
 
     // We can't possibly write more than we read.
     const uint32_t msg_bytes_written = static_cast<uint32_t>(
@@ -257,12 +413,6 @@ void MessageFilter::FilterOneByte(uint8_t octet) {
       return SetUnrecoverableErrorState();
     }
   }
-
-  if (push_next_state) {
-    PERFETTO_DCHECK(tokenizer_.idle());
-    stack_.emplace_back(std::move(next_state));
-    state = &stack_.back();
-  }
 }
 
 void MessageFilter::SetUnrecoverableErrorState() {
@@ -273,7 +423,7 @@ void MessageFilter::SetUnrecoverableErrorState() {
   state.eat_next_bytes = UINT32_MAX;
   state.in_bytes_limit = UINT32_MAX;
   state.passthrough_eaten_bytes = false;
-  out_ = out_buf_.get();  // Reset the write pointer.
+  out_ = out_start_;  // Reset the write pointer.
 }
 
 void MessageFilter::IncrementCurrentFieldUsage(uint32_t field_id,
@@ -22,6 +22,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "src/protozero/filtering/filter_bytecode_parser.h"
 #include "src/protozero/filtering/message_tokenizer.h"
@@ -98,6 +99,32 @@ class MessageFilter {
     return FilterMessageFragments(&slice, 1);
   }
 
+  // A message of a batch, made of |num_slices| consecutive entries of the
+  // InputSlice array passed to FilterMessageBatch().
+  struct BatchInput {
+    size_t num_slices;
+  };
+
+  struct BatchOutput {
+    const uint8_t* data;
+    size_t size;
+    bool error;
+  };
+
+  // Filters a batch of |num_messages| messages, each one fragmented in
+  // arbitrary slices, and appends one entry to |out| for each of them (in the
+  // same order). Unlike FilterMessageFragments(), which allocates a buffer for
+  // each message, the output of the whole batch is written into an arena owned
+  // by the filter which is allocated once for the largest batch seen so far.
+  // The BatchOutput.data pointers are valid until the next call to
+  // FilterMessageBatch() or the destruction of the filter.
+  // In the error case the BatchOutput.size is 0 and the other messages of the
+  // batch are not affected.
+  void FilterMessageBatch(const InputSlice* slices,
+                          const BatchInput* messages,
+                          size_t num_messages,
+                          std::vector<BatchOutput>* out);
+
   // When enabled returns a map of "field path" to "usage counter".
   // The key (std::string) is a binary buffer (i.e. NOT an ASCII/UTF-8 string)
   // which contains a varint for each field. Consider the following:
@@ -123,6 +150,38 @@ class MessageFilter {
   // It gives a 20-25% speedup (265ms vs 215ms for a 25MB trace).
   void FilterOneByte(uint8_t octet) PERFETTO_ALWAYS_INLINE;
 
+  // Filters one message into |out|, which must have room for at least the sum
+  // of the input slice lengths. Returns the number of bytes of output, or
+  // sets |*error| if the message is malformed.
+  size_t FilterMessageInto(const InputSlice*,
+                           size_t num_slices,
+                           uint8_t* out,
+                           bool* error);
+
+  // Consumes the first |len| bytes of |data| if they are part of a
+  // string/bytes field, or of a submessage which is not allowed, copying them
+  // as-is in output or dropping them in one go rather than byte by byte.
+  // Returns the number of bytes consumed, which is 0 when the filter is not in
+  // the middle of such a field.
+  size_t EatBytesInBulk(const uint8_t* data, size_t len) PERFETTO_ALWAYS_INLINE;
+
+  // Decodes in one go the preamble of the field which starts at |data| (its
+  // tag and, depending on the type, its value or its length) and filters it,
+  // as FilterOneByte() would do once fed with all its bytes. Returns the
+  // number of bytes consumed, which is 0 when the preamble can't be decoded
+  // from the first |len| bytes of |data|: the caller must fall back on
+  // FilterOneByte() in that case.
+  size_t FilterFieldPreamble(const uint8_t* data,
+                             size_t len) PERFETTO_ALWAYS_INLINE;
+
+  // Filters the field described by |token|, whose preamble has been consumed
+  // except for its last byte.
+  void FilterField(const MessageTokenizer::Token& token) PERFETTO_ALWAYS_INLINE;
+
+  // Pops the states of the messages which end at the current input position,
+  // backfilling the size of their output.
+  void PopCompletedMessages();
+
   // No-inline because this is a slowpath (only when usage tracking is enabled).
   void IncrementCurrentFieldUsage(uint32_t field_id,
                                   bool allowed) PERFETTO_NO_INLINE;
@@ -187,11 +246,16 @@ class MessageFilter {
     bool passthrough_eaten_bytes = false;
   };
 
-  uint32_t out_written() { return static_cast<uint32_t>(out_ - &out_buf_[0]); }
+  uint32_t out_written() { return static_cast<uint32_t>(out_ - out_start_); }
 
   std::unique_ptr<uint8_t[]> out_buf_;
+  uint8_t* out_start_ = nullptr;  // Start of the output of the current message.
   uint8_t* out_ = nullptr;
   uint8_t* out_end_ = nullptr;
+
+  // The output arena of FilterMessageBatch(), reused across batches.
+  std::unique_ptr<uint8_t[]> batch_arena_;
+  size_t batch_arena_size_ = 0;
   uint32_t root_msg_index_ = 0;
 
   FilterBytecodeParser filter_;
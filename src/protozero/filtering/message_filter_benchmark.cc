@@ -16,11 +16,48 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/protozero/proto_decoder.h"
 #include "src/base/test/utils.h"
 #include "src/protozero/filtering/message_filter.h"
 
+namespace {
+
+// Loads the test trace and splits it into its TracePacket(s), as the tracing
+// service does when filtering the packets read from the buffers.
+void LoadTestTracePackets(
+    std::string* trace_data,
+    std::vector<protozero::MessageFilter::InputSlice>* packets) {
+  static const char kTestTrace[] = "test/data/example_android_trace_30s.pb";
+  perfetto::base::ReadFile(perfetto::base::GetTestDataPath(kTestTrace),
+                           trace_data);
+  PERFETTO_CHECK(!trace_data->empty());
+  protozero::ProtoDecoder dec(trace_data->data(), trace_data->size());
+  for (auto field = dec.ReadField(); field.valid(); field = dec.ReadField()) {
+    PERFETTO_CHECK(field.id() == 1);  // TracePacket.
+    packets->push_back({field.data(), field.size()});
+  }
+}
+
+// Loads the filter bytecode and makes TracePacket its root.
+void LoadFilter(protozero::MessageFilter* filt) {
+  std::string filter;
+  static const char kFullTraceFilter[] = "test/data/full_trace_filter.bytecode";
+  perfetto::base::ReadFile(kFullTraceFilter, &filter);
+  PERFETTO_CHECK(!filter.empty());
+  PERFETTO_CHECK(filt->LoadFilterBytecode(filter.data(), filter.size()));
+  static const uint32_t kPacketField = 1;
+  PERFETTO_CHECK(filt->SetFilterRoot(&kPacketField, 1));
+}
+
+// The size of the batches of packets filtered by the tracing service in each
+// ReadBuffers() (see kApproxBytesPerTask in tracing_service_impl.cc).
+constexpr size_t kBatchBytes = 32768;
+
+}  // namespace
+
 static void BM_ProtozeroMessageFilter(benchmark::State& state) {
   std::string trace_data;
   static const char kTestTrace[] = "test/data/example_android_trace_30s.pb";
@@ -46,3 +83,63 @@ static void BM_ProtozeroMessageFilter(benchmark::State& state) {
 }
 
 BENCHMARK(BM_ProtozeroMessageFilter);
+
+// Filters each packet of the trace on its own, into a buffer allocated for each
+// packet.
+static void BM_ProtozeroMessageFilterPackets(benchmark::State& state) {
+  std::string trace_data;
+  std::vector<protozero::MessageFilter::InputSlice> packets;
+  LoadTestTracePackets(&trace_data, &packets);
+  protozero::MessageFilter filt;
+  LoadFilter(&filt);
+
+  for (auto _ : state) {
+    for (const auto& packet : packets) {
+      auto res = filt.FilterMessageFragments(&packet, 1);
+      benchmark::DoNotOptimize(res);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * trace_data.size()));
+}
+
+// Filters the same packets in batches of ~|kBatchBytes| into the arena of the
+// filter.
+static void BM_ProtozeroMessageFilterBatch(benchmark::State& state) {
+  std::string trace_data;
+  std::vector<protozero::MessageFilter::InputSlice> packets;
+  LoadTestTracePackets(&trace_data, &packets);
+  protozero::MessageFilter filt;
+  LoadFilter(&filt);
+
+  // Each packet is made of a single slice.
+  std::vector<std::pair<size_t, size_t>> batches;  // (first packet, count).
+  size_t batch_bytes = 0;
+  for (size_t i = 0; i < packets.size(); ++i) {
+    if (batches.empty() || batch_bytes >= kBatchBytes) {
+      batches.emplace_back(i, 0);
+      batch_bytes = 0;
+    }
+    batches.back().second++;
+    batch_bytes += packets[i].len;
+  }
+  std::vector<protozero::MessageFilter::BatchInput> messages(packets.size(),
+                                                             {1});
+  std::vector<protozero::MessageFilter::BatchOutput> out;
+
+  for (auto _ : state) {
+    for (const auto& batch : batches) {
+      out.clear();
+      filt.FilterMessageBatch(&packets[batch.first], &messages[batch.first],
+                              batch.second, &out);
+      benchmark::DoNotOptimize(out.data());
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * trace_data.size()));
+}
+
+BENCHMARK(BM_ProtozeroMessageFilterPackets);
+BENCHMARK(BM_ProtozeroMessageFilterBatch);
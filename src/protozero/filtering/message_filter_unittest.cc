@@ -273,6 +273,73 @@ TEST(MessageFilterTest, MalformedInput) {
   }
 }
 
+TEST(MessageFilterTest, Batch) {
+  auto schema = perfetto::base::TempFile::Create();
+  static const char kSchema[] = R"(
+  syntax = "proto2";
+  message FilterSchema {
+    message Nested {
+      optional fixed32 f32 = 4;
+      repeated string ss = 5;
+    }
+    optional int32 i32 = 1;
+    optional string str = 2;
+    repeated Nested nest = 3;
+  };
+  )";
+  perfetto::base::WriteAll(*schema, kSchema, strlen(kSchema));
+  perfetto::base::FlushFile(*schema);
+  FilterUtil filter;
+  ASSERT_TRUE(filter.LoadMessageDefinition(schema.path(), "", ""));
+  std::string bytecode = filter.GenerateFilterBytecode();
+  MessageFilter flt;
+  ASSERT_TRUE(flt.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  static const uint8_t kValid[]{
+      0x08, 0x2A,                  // A varint field id=1 value=42 (0x2A).
+      0x1A, 0x05,                  // A len-delim field, id=3, length=5.
+      0x25, 0x0,  0x0, 0x0, 0x01,  // A fixed32 field, id=4.
+      0x38, 0x42,                  // A not allowed varint field id=7.
+      0x12, 0x03, 'f',  'o', 'o',  // A string field id=2.
+      0x22, 0x02, 0x08, 0x01,      // A not allowed submessage id=4.
+  };
+  static const uint8_t kMalformed[]{
+      0x52, 0x21,  // ID=10, type=len-delimited, len=33.
+      0xa0, 0xa4,  // Early terminating payload.
+  };
+
+  // The first message is split in the middle of the string field.
+  std::vector<MessageFilter::InputSlice> slices{
+      {kValid, 14},
+      {kValid + 14, sizeof(kValid) - 14},
+      {kMalformed, sizeof(kMalformed)},
+      {kValid, sizeof(kValid)},
+  };
+  std::vector<MessageFilter::BatchInput> messages{{2}, {1}, {1}};
+
+  auto expected = flt.FilterMessage(kValid, sizeof(kValid));
+  ASSERT_FALSE(expected.error);
+  std::string expected_str(reinterpret_cast<const char*>(expected.data.get()),
+                           expected.size);
+
+  for (int repetitions = 0; repetitions < 2; ++repetitions) {
+    std::vector<MessageFilter::BatchOutput> out;
+    flt.FilterMessageBatch(slices.data(), messages.data(), messages.size(),
+                           &out);
+    ASSERT_EQ(out.size(), 3u);
+    EXPECT_FALSE(out[0].error);
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(out[0].data),
+                          out[0].size),
+              expected_str);
+    EXPECT_TRUE(out[1].error);
+    EXPECT_EQ(out[1].size, 0u);
+    EXPECT_FALSE(out[2].error);
+    EXPECT_EQ(std::string(reinterpret_cast<const char*>(out[2].data),
+                          out[2].size),
+              expected_str);
+  }
+}
+
 // It processes a real test trace with a real filter. The filter has been
 // obtained from the full upstream perfetto proto (+ re-adding the for_testing
 // field which got removed after adding most test traces). This covers the most
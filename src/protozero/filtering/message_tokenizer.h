@@ -169,6 +169,10 @@ class MessageTokenizer {
            fixed_int_shift_ == 0;
   }
 
+  // Returns true if the tokenizer FSM has hit an unrecoverable error (e.g. an
+  // invalid field type). From there on it swallows all the input.
+  bool error() const { return state_ >= kInvalidFieldType; }
+
   // Only for reporting parser errors in the trace.
   uint32_t state() const { return static_cast<uint32_t>(state_); }
 
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/protozero/filtering/streaming_message_filter.h"
+
+#include <algorithm>
+
+#include "perfetto/base/compiler.h"
+#include "perfetto/protozero/proto_utils.h"
+
+namespace protozero {
+
+StreamingMessageFilter::StreamingMessageFilter(MessageFilter* filter)
+    : filter_(filter) {}
+
+StreamingMessageFilter::~StreamingMessageFilter() = default;
+
+bool StreamingMessageFilter::Push(const void* data,
+                                  size_t len,
+                                  std::string* out) {
+  if (error_)
+    return false;
+
+  const uint8_t* const begin = static_cast<const uint8_t*>(data);
+  const uint8_t* const end = begin + len;
+  const uint8_t* pos = begin;
+
+  // The start of the current top-level field, or nullptr if the field started
+  // in a previous Push() call (its first bytes are in |pending_|).
+  const uint8_t* field_start = pending_.empty() ? begin : nullptr;
+
+  // Collect all the top-level fields completed by this fragment and filter
+  // them in one batch, so their output is written in the filter's arena
+  // rather than in a buffer allocated for each of them.
+  slices_.clear();
+  fields_.clear();
+  while (pos < end) {
+    if (payload_left_ > 0) {
+      size_t avail = static_cast<size_t>(end - pos);
+      size_t n = static_cast<size_t>(std::min<uint64_t>(payload_left_, avail));
+      pos += n;
+      payload_left_ -= n;
+      if (payload_left_ > 0)
+        break;
+    } else {
+      MessageTokenizer::Token token = tokenizer_.Push(*pos++);
+      if (!token.valid()) {
+        if (PERFETTO_UNLIKELY(tokenizer_.error())) {
+          error_ = true;
+          break;
+        }
+        if (PERFETTO_LIKELY(!tokenizer_.idle()))
+          continue;  // In the middle of the field preamble.
+
+        // A field with id 0 is invalid. MessageFilter skips it (and parses the
+        // payload of a length-delimited one as fields of the same message),
+        // so just do the same.
+        if (!field_start)
+          pending_.clear();
+        field_start = pos;
+        continue;
+      }
+      if (token.type == proto_utils::ProtoWireType::kLengthDelimited &&
+          token.value > 0) {
+        payload_left_ = token.value;
+        continue;
+      }
+    }
+
+    // If we get here, all the bytes of the field have been pushed.
+    size_t num_slices = 1;
+    if (!field_start) {
+      slices_.push_back(MessageFilter::InputSlice{pending_.data(),
+                                                  pending_.size()});
+      field_start = begin;
+      ++num_slices;
+    }
+    slices_.push_back(MessageFilter::InputSlice{
+        field_start, static_cast<size_t>(pos - field_start)});
+    fields_.push_back(MessageFilter::BatchInput{num_slices});
+    field_start = pos;
+  }
+
+  if (!fields_.empty()) {
+    filtered_.clear();
+    filter_->FilterMessageBatch(slices_.data(), fields_.data(), fields_.size(),
+                                &filtered_);
+    for (const MessageFilter::BatchOutput& field : filtered_) {
+      if (field.error) {
+        error_ = true;
+        break;
+      }
+      out->append(reinterpret_cast<const char*>(field.data), field.size);
+    }
+  }
+
+  if (error_) {
+    pending_.clear();
+    pending_.shrink_to_fit();
+    return false;
+  }
+
+  // Buffer the bytes of the incomplete field (if any) for the next Push().
+  if (field_start) {
+    pending_.assign(reinterpret_cast<const char*>(field_start),
+                    static_cast<size_t>(end - field_start));
+  } else {
+    pending_.append(reinterpret_cast<const char*>(begin), len);
+  }
+  return true;
+}
+
+bool StreamingMessageFilter::Finish() {
+  return !error_ && pending_.empty();
+}
+
+}  // namespace protozero
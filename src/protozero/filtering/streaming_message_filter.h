@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROTOZERO_FILTERING_STREAMING_MESSAGE_FILTER_H_
+#define SRC_PROTOZERO_FILTERING_STREAMING_MESSAGE_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "src/protozero/filtering/message_filter.h"
+#include "src/protozero/filtering/message_tokenizer.h"
+
+namespace protozero {
+
+// Filters a proto message which is too big to be held in memory (e.g. a
+// multi-GB trace file read from a pipe) using a MessageFilter.
+// The input is pushed in arbitrarily sized fragments via Push() and the
+// filtered output is appended incrementally to the caller's buffer.
+// The message is split into its top-level fields (e.g. the TracePacket(s) of a
+// Trace) using a MessageTokenizer. Each top-level field is filtered as soon as
+// all its bytes have been pushed, as if it was a message on its own. This is
+// equivalent to filtering the whole message because the root message has no
+// length prefix: its output is just the concatenation of the output of its
+// fields.
+// Filtering can't be more fine grained than that: the output of a submessage
+// is prefixed by its length, which is known only once all its fields have been
+// filtered. Hence memory usage is bounded by the size of the largest top-level
+// field plus the size of the fragments pushed, not by the size of the input.
+// Unlike MessageFilter::FilterMessage(), an error doesn't discard the output
+// emitted so far. The fields that follow the malformed one are dropped.
+class StreamingMessageFilter {
+ public:
+  // |filter| must outlive this object and must have been already initialized
+  // via LoadFilterBytecode() (and, optionally, SetFilterRoot()). Its field
+  // usage histogram, if enabled, is updated as the input is filtered.
+  explicit StreamingMessageFilter(MessageFilter* filter);
+  ~StreamingMessageFilter();
+
+  // Pushes the next |len| bytes of the input message and appends to |out| the
+  // output for the top-level fields which have been completed by them.
+  // Returns false if the input is malformed. In that case all the following
+  // input is ignored.
+  bool Push(const void* data, size_t len, std::string* out);
+
+  // Must be called after the last Push(). Returns false if the input was
+  // malformed or truncated in the middle of a field.
+  bool Finish();
+
+  // The number of bytes of a top-level field that has been pushed only
+  // partially and is buffered until its completion.
+  size_t buffered_bytes() const { return pending_.size(); }
+
+ private:
+  MessageFilter* const filter_;
+  MessageTokenizer tokenizer_;
+
+  // The bytes of the top-level field which started in a previous Push() and
+  // hasn't been completed yet.
+  std::string pending_;
+
+  // The payload bytes of the current length-delimited field still to push.
+  uint64_t payload_left_ = 0;
+
+  // Reused across Push() calls to avoid reallocations.
+  std::vector<MessageFilter::InputSlice> slices_;
+  std::vector<MessageFilter::BatchInput> fields_;
+  std::vector<MessageFilter::BatchOutput> filtered_;
+
+  bool error_ = false;
+};
+
+}  // namespace protozero
+
+#endif  // SRC_PROTOZERO_FILTERING_STREAMING_MESSAGE_FILTER_H_
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/protozero/filtering/streaming_message_filter.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "src/protozero/filtering/filter_bytecode_generator.h"
+#include "test/gtest_and_gmock.h"
+
+namespace protozero {
+namespace {
+
+// Root: 1 = simple, 2 = Nested, 3 = simple. Nested: 1 = simple, 2 = Nested.
+std::string GetBytecode() {
+  FilterBytecodeGenerator gen;
+  gen.AddSimpleField(1);
+  gen.AddNestedField(2, 1);
+  gen.AddSimpleField(3);
+  gen.EndMessage();
+  gen.AddSimpleField(1);
+  gen.AddNestedField(2, 1);
+  gen.EndMessage();
+  return gen.Serialize();
+}
+
+void AddFields(std::minstd_rand* rnd, Message* msg, int depth) {
+  const uint32_t num_fields = 1 + (*rnd)() % 6;
+  for (uint32_t i = 0; i < num_fields; i++) {
+    // Field 2 is a submessage in the filter. Use it only for submessages.
+    uint32_t field_id = 1 + (*rnd)() % 3;
+    field_id = field_id == 2 ? 4 : field_id;
+    switch ((*rnd)() % 4) {
+      case 0:
+        msg->AppendVarInt(field_id, (*rnd)());
+        break;
+      case 1:
+        msg->AppendFixed(field_id, static_cast<uint64_t>((*rnd)()));
+        break;
+      case 2:
+        msg->AppendString(field_id, std::string((*rnd)() % 300, 'x'));
+        break;
+      case 3:
+        if (depth < 3) {
+          auto* nested = msg->BeginNestedMessage<Message>(/*field_id=*/2);
+          AddFields(rnd, nested, depth + 1);
+          nested->Finalize();
+        }
+        break;
+    }
+  }
+}
+
+// Pushes |input| in fragments of random size and returns the output.
+std::string FilterInFragments(std::minstd_rand* rnd,
+                              MessageFilter* filter,
+                              const std::string& input,
+                              bool* ok) {
+  StreamingMessageFilter streaming_filter(filter);
+  std::string out;
+  *ok = true;
+  for (size_t pos = 0; pos < input.size();) {
+    size_t len = std::min<size_t>(input.size() - pos, 1 + (*rnd)() % 100);
+    *ok &= streaming_filter.Push(&input[pos], len, &out);
+    pos += len;
+  }
+  *ok &= streaming_filter.Finish();
+  return out;
+}
+
+TEST(StreamingMessageFilterTest, SameAsWholeMessage) {
+  std::string bytecode = GetBytecode();
+  MessageFilter filter;
+  ASSERT_TRUE(filter.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  std::minstd_rand rnd(42);
+  for (int i = 0; i < 200; i++) {
+    HeapBuffered<Message> msg;
+    AddFields(&rnd, msg.get(), 0);
+    std::string input = msg.SerializeAsString();
+
+    auto expected = filter.FilterMessage(input.data(), input.size());
+    ASSERT_FALSE(expected.error);
+    bool ok = false;
+    std::string out = FilterInFragments(&rnd, &filter, input, &ok);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(out, std::string(reinterpret_cast<char*>(expected.data.get()),
+                               expected.size));
+  }
+}
+
+TEST(StreamingMessageFilterTest, BufferedBytesBoundedByLargestField) {
+  std::string bytecode = GetBytecode();
+  MessageFilter filter;
+  ASSERT_TRUE(filter.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  HeapBuffered<Message> msg;
+  for (int i = 0; i < 100; i++) {
+    auto* nested = msg->BeginNestedMessage<Message>(2);
+    nested->AppendString(1, std::string(1000, 'x'));
+    nested->Finalize();
+  }
+  std::string input = msg.SerializeAsString();
+
+  StreamingMessageFilter streaming_filter(&filter);
+  std::string out;
+  for (size_t pos = 0; pos < input.size(); pos += 64) {
+    size_t len = std::min<size_t>(input.size() - pos, 64);
+    ASSERT_TRUE(streaming_filter.Push(&input[pos], len, &out));
+    EXPECT_LT(streaming_filter.buffered_bytes(), input.size() / 100);
+  }
+  EXPECT_TRUE(streaming_filter.Finish());
+  auto expected = filter.FilterMessage(input.data(), input.size());
+  EXPECT_EQ(out, std::string(reinterpret_cast<char*>(expected.data.get()),
+                             expected.size));
+}
+
+TEST(StreamingMessageFilterTest, TruncatedInput) {
+  std::string bytecode = GetBytecode();
+  MessageFilter filter;
+  ASSERT_TRUE(filter.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  HeapBuffered<Message> msg;
+  msg->AppendVarInt(1, 42);
+  msg->AppendString(3, "truncated");
+  std::string input = msg.SerializeAsString();
+
+  StreamingMessageFilter streaming_filter(&filter);
+  std::string out;
+  EXPECT_TRUE(streaming_filter.Push(input.data(), input.size() - 1, &out));
+  EXPECT_FALSE(streaming_filter.Finish());
+
+  // The output of the first field has been emitted anyways.
+  HeapBuffered<Message> expected;
+  expected->AppendVarInt(1, 42);
+  EXPECT_EQ(out, expected.SerializeAsString());
+}
+
+TEST(StreamingMessageFilterTest, MalformedInput) {
+  std::string bytecode = GetBytecode();
+  MessageFilter filter;
+  ASSERT_TRUE(filter.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  HeapBuffered<Message> msg;
+  msg->AppendVarInt(1, 42);
+  std::string input = msg.SerializeAsString();
+  input.push_back(0x0f);  // Field id 1, invalid wire type 7.
+  input.append(100, 0);
+
+  StreamingMessageFilter streaming_filter(&filter);
+  std::string out;
+  EXPECT_FALSE(streaming_filter.Push(input.data(), input.size(), &out));
+  EXPECT_FALSE(streaming_filter.Push(input.data(), input.size(), &out));
+  EXPECT_FALSE(streaming_filter.Finish());
+  EXPECT_EQ(streaming_filter.buffered_bytes(), 0u);
+  EXPECT_EQ(out, msg.SerializeAsString());
+
+  // A malformed submessage is detected as well.
+  HeapBuffered<Message> bad_nested;
+  bad_nested->AppendBytes(2, "\x0f", 1);
+  input = bad_nested.SerializeAsString();
+  StreamingMessageFilter streaming_filter2(&filter);
+  out.clear();
+  EXPECT_FALSE(streaming_filter2.Push(input.data(), input.size(), &out));
+  EXPECT_FALSE(streaming_filter2.Finish());
+  EXPECT_EQ(out, "");
+}
+
+}  // namespace
+}  // namespace protozero
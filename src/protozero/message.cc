@@ -90,6 +90,9 @@ void Message::AppendBytes(uint32_t field_id, const void* src, size_t size) {
 size_t Message::AppendScatteredBytes(uint32_t field_id,
                                      ContiguousMemoryRange* ranges,
                                      size_t num_ranges) {
+  if (nested_message_)
+    EndNestedMessage();
+
   size_t size = 0;
   for (size_t i = 0; i < num_ranges; ++i) {
     size += ranges[i].size();
@@ -24,9 +24,14 @@
 
 namespace protozero {
 
+namespace {
+std::atomic<uint64_t> g_num_blocks_allocated{};
+}  // namespace
+
 MessageArena::MessageArena() {
   // The code below assumes that there is always at least one block.
   blocks_.emplace_front();
+  g_num_blocks_allocated.fetch_add(1, std::memory_order_relaxed);
   static_assert(std::alignment_of<decltype(blocks_.back().storage[0])>::value >=
                     alignof(Message),
                 "MessageArea's storage is not properly aligned");
@@ -34,13 +39,30 @@ MessageArena::MessageArena() {
 
 MessageArena::~MessageArena() = default;
 
+// static
+uint64_t MessageArena::num_blocks_allocated() {
+  return g_num_blocks_allocated.load(std::memory_order_relaxed);
+}
+
+void MessageArena::AllocateFreeBlock() {
+  free_blocks_.emplace_back();
+  g_num_blocks_allocated.fetch_add(1, std::memory_order_relaxed);
+}
+
 Message* MessageArena::NewMessage() {
   PERFETTO_DCHECK(!blocks_.empty());  // Should never become empty.
 
   Block* block = &blocks_.back();
   if (PERFETTO_UNLIKELY(block->entries >= Block::kCapacity)) {
-    blocks_.emplace_back();
+    if (free_blocks_.empty())
+      AllocateFreeBlock();
+    blocks_.splice(blocks_.end(), free_blocks_, free_blocks_.begin());
     block = &blocks_.back();
+    // The block might come from Reset(), which doesn't clear its entries.
+    if (block->entries) {
+      block->entries = 0;
+      PERFETTO_ASAN_POISON(block->storage, sizeof(block->storage));
+    }
   }
   const auto idx = block->entries++;
   void* storage = &block->storage[idx];
@@ -63,8 +85,10 @@ void MessageArena::DeleteLastMessageInternal() {
 
   // Don't remove the first block to avoid malloc/free calls when the root
   // message is reset. Hitting the allocator all the times is a waste of time.
+  // The other ones are kept in the freelist for the same reason.
   if (block->entries == 0 && blocks_.size() > 1) {
-    blocks_.pop_back();
+    free_blocks_.splice(free_blocks_.begin(), blocks_,
+                        std::prev(blocks_.end()));
   }
 }
 
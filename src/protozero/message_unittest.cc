@@ -236,6 +236,22 @@ TEST_F(MessageTest, AppendScatteredBytes) {
   EXPECT_EQ("42424242", GetNextSerializedBytes(4));
 }
 
+TEST_F(MessageTest, AppendScatteredBytesAfterNestedMessage) {
+  Message* root_msg = NewMessage();
+  root_msg->BeginNestedMessage<FakeChildMessage>(1)->AppendVarInt(2, 0x42);
+
+  uint8_t buffer[2];
+  memset(buffer, 0x42, sizeof(buffer));
+  ContiguousMemoryRange ranges[] = {{buffer, buffer + sizeof(buffer)}};
+  root_msg->AppendScatteredBytes(3 /* field_id */, ranges, 1);
+  EXPECT_EQ(11u, root_msg->Finalize());
+
+  // The nested message is finalized before the bytes are appended.
+  EXPECT_EQ("0A82808000", GetNextSerializedBytes(5));
+  EXPECT_EQ("1042", GetNextSerializedBytes(2));
+  EXPECT_EQ("1A024242", GetNextSerializedBytes(4));
+}
+
 // Checks that the size field of root and nested messages is properly written
 // on finalization.
 TEST_F(MessageTest, BackfillSizeOnFinalization) {
@@ -309,6 +325,31 @@ TEST_F(MessageTest, DeeplyNested) {
   EXPECT_EQ(0xc0fde419, buf_hash);
 }
 
+TEST_F(MessageTest, ArenaBlocksAreReused) {
+  FakeRootMessage* root_msg = NewMessage();
+  BuildNestedMessages(root_msg, /*max_depth=*/100);
+  root_msg->Finalize();
+  const uint64_t num_blocks_allocated = MessageArena::num_blocks_allocated();
+
+  for (int i = 0; i < 3; i++) {
+    ResetMessage(root_msg);
+    BuildNestedMessages(root_msg, /*max_depth=*/100);
+    root_msg->Finalize();
+  }
+
+  // Resetting the root message with outstanding nested messages releases
+  // their blocks too.
+  Message* msg = root_msg;
+  ResetMessage(root_msg);
+  for (uint32_t i = 0; i < 100; i++)
+    msg = msg->BeginNestedMessage<FakeChildMessage>(1);
+  ResetMessage(root_msg);
+  BuildNestedMessages(root_msg, /*max_depth=*/100);
+  root_msg->Finalize();
+
+  EXPECT_EQ(MessageArena::num_blocks_allocated(), num_blocks_allocated);
+}
+
 TEST_F(MessageTest, DestructInvalidMessageHandle) {
   FakeRootMessage* msg = NewMessage();
   EXPECT_DCHECK_DEATH({
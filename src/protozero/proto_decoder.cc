@@ -41,6 +41,18 @@ struct ParseFieldResult {
   Field field;
 };
 
+// Like ParseVarInt(), with a fast path for one-byte values, which most of the
+// varint fields and lengths of the trace protos are. |pos| must be < |end|.
+PERFETTO_ALWAYS_INLINE const uint8_t* ParseFieldVarInt(const uint8_t* pos,
+                                                       const uint8_t* end,
+                                                       uint64_t* value) {
+  if (PERFETTO_LIKELY(*pos < 0x80)) {
+    *value = *pos;
+    return pos + 1;
+  }
+  return ParseVarInt(pos, end, value);
+}
+
 // Parses one field and returns the field itself and a pointer to the next
 // field to parse. If parsing fails, the returned |next| == |buffer|.
 PERFETTO_ALWAYS_INLINE ParseFieldResult
@@ -80,7 +92,7 @@ ParseOneField(const uint8_t* const buffer, const uint8_t* const end) {
 
   switch (field_type) {
     case static_cast<uint8_t>(ProtoWireType::kVarInt): {
-      new_pos = ParseVarInt(pos, end, &int_value);
+      new_pos = ParseFieldVarInt(pos, end, &int_value);
 
       // new_pos not being greater than pos means ParseVarInt could not fully
       // parse the number. This is because we are out of space in the buffer.
@@ -94,7 +106,7 @@ ParseOneField(const uint8_t* const buffer, const uint8_t* const end) {
 
     case static_cast<uint8_t>(ProtoWireType::kLengthDelimited): {
       uint64_t payload_length;
-      new_pos = ParseVarInt(pos, end, &payload_length);
+      new_pos = ParseFieldVarInt(pos, end, &payload_length);
       if (PERFETTO_UNLIKELY(new_pos == pos))
         return res;
 
@@ -153,8 +165,84 @@ ParseOneField(const uint8_t* const buffer, const uint8_t* const end) {
   return res;
 }
 
+// The maximum size of a varint, which encodes 7 bits per byte.
+constexpr size_t kMaxVarIntLen = 10;
+
+// Decodes the varint at |*pos| without any bounds check: the caller must
+// guarantee that at least kMaxVarIntLen bytes follow it. Returns false if the
+// varint is longer than that, i.e. invalid.
+inline bool ParseVarIntUnchecked(const uint8_t** pos, uint64_t* out_value) {
+  const uint8_t* ptr = *pos;
+  uint64_t value = *ptr++;
+  if (PERFETTO_UNLIKELY(value & 0x80)) {
+    value &= 0x7f;
+    uint8_t cur_byte;
+    uint32_t shift = 7;
+    do {
+      cur_byte = *ptr++;
+      value |= static_cast<uint64_t>(cur_byte & 0x7f) << shift;
+      shift += 7;
+    } while ((cur_byte & 0x80) && shift < 64u);
+    if (PERFETTO_UNLIKELY(cur_byte & 0x80))
+      return false;
+  }
+  *pos = ptr;
+  *out_value = value;
+  return true;
+}
+
 }  // namespace
 
+size_t DecodePackedVarInts(const uint8_t* begin,
+                           const uint8_t* end,
+                           uint64_t* out,
+                           bool* parse_error) {
+  constexpr uint64_t kMsbMask = 0x8080808080808080ULL;
+  const uint8_t* pos = begin;
+  uint64_t* out_pos = out;
+
+  // Fast path: while there are enough bytes left for a batch of varints of
+  // maximum length, no bounds check is needed when decoding them. Eight bytes
+  // at a time are loaded and if none of them has the MSB set, they are
+  // emitted as eight one-byte varints without testing them one by one.
+  // Otherwise the next few varints are decoded one by one, to amortize the
+  // cost of the test when multi-byte varints are frequent.
+  constexpr size_t kBatchSize = 4;
+  constexpr ptrdiff_t kBatchMaxLen =
+      static_cast<ptrdiff_t>(kBatchSize * kMaxVarIntLen);
+  while (end - pos >= kBatchMaxLen) {
+    uint64_t word;
+    memcpy(&word, pos, sizeof(word));
+    if (PERFETTO_LIKELY(!(word & kMsbMask))) {
+      for (size_t i = 0; i < sizeof(uint64_t); i++)
+        out_pos[i] = pos[i];
+      out_pos += sizeof(uint64_t);
+      pos += sizeof(uint64_t);
+      continue;
+    }
+    for (size_t i = 0; i < kBatchSize; i++) {
+      if (PERFETTO_UNLIKELY(!ParseVarIntUnchecked(&pos, out_pos))) {
+        *parse_error = true;
+        return static_cast<size_t>(out_pos - out);
+      }
+      out_pos++;
+    }
+  }
+
+  // Slow path: the last few bytes of the payload.
+  while (pos < end) {
+    uint64_t value;
+    const uint8_t* next = ParseVarInt(pos, end, &value);
+    if (PERFETTO_UNLIKELY(next == pos)) {
+      *parse_error = true;
+      break;
+    }
+    *out_pos++ = value;
+    pos = next;
+  }
+  return static_cast<size_t>(out_pos - out);
+}
+
 Field ProtoDecoder::FindField(uint32_t field_id) {
   Field res{};
   auto old_position = read_ptr_;
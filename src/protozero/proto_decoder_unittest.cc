@@ -16,6 +16,9 @@
 
 #include "perfetto/protozero/proto_decoder.h"
 
+#include <limits>
+#include <vector>
+
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/message.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -532,6 +535,59 @@ TEST(ProtoDecoderTest, MalformedPackedVarIntBuffer) {
   ASSERT_TRUE(parse_error);
 }
 
+TEST(ProtoDecoderTest, DecodePackedVarInts) {
+  // Mix runs of one-byte varints, longer than the eight bytes decoded at once
+  // by the fast path, with multi-byte ones at all the offsets within a word.
+  // The payload is long enough for both the fast and the slow path.
+  std::vector<uint64_t> values;
+  for (uint64_t i = 0; i < 200; i++) {
+    if (i % 11 == 0) {
+      values.push_back(i << (i % 64));
+    } else if (i % 7 == 0) {
+      values.push_back(300 + i);
+    } else {
+      values.push_back(i % 128);
+    }
+  }
+  values.push_back(std::numeric_limits<uint64_t>::max());
+  PackedVarInt buf;
+  for (uint64_t value : values)
+    buf.Append(value);
+
+  std::vector<uint64_t> decoded(buf.size());
+  bool parse_error = false;
+  size_t count = DecodePackedVarInts(buf.data(), buf.data() + buf.size(),
+                                     decoded.data(), &parse_error);
+  ASSERT_FALSE(parse_error);
+  decoded.resize(count);
+  ASSERT_EQ(decoded, values);
+
+  // A payload chopped off in the middle of its last varint.
+  decoded.resize(buf.size());
+  parse_error = false;
+  count = DecodePackedVarInts(buf.data(), buf.data() + buf.size() - 1,
+                              decoded.data(), &parse_error);
+  ASSERT_TRUE(parse_error);
+  ASSERT_EQ(count, values.size() - 1);
+
+  // An empty payload.
+  parse_error = false;
+  ASSERT_EQ(DecodePackedVarInts(buf.data(), buf.data(), decoded.data(),
+                                &parse_error),
+            0u);
+  ASSERT_FALSE(parse_error);
+
+  // A varint longer than ten bytes, followed by enough bytes for the fast path.
+  std::vector<uint8_t> invalid(11, 0xff);
+  invalid.resize(100, 0);
+  decoded.resize(invalid.size());
+  parse_error = false;
+  ASSERT_EQ(DecodePackedVarInts(invalid.data(), invalid.data() + invalid.size(),
+                                decoded.data(), &parse_error),
+            0u);
+  ASSERT_TRUE(parse_error);
+}
+
 // Tests that big field ids (> 0xffff) are just skipped but don't fail parsing.
 // This is a regression test for b/145339282 (DataSourceConfig.for_testing
 // having a very large ID == 268435455 until Android R).
@@ -45,15 +45,62 @@ void ScatteredHeapBuffer::Slice::Clear() {
 #endif  // PERFETTO_DCHECK_IS_ON()
 }
 
+// static
+constexpr size_t ScatteredHeapBuffer::SlicePool::kDefaultMaxCachedBytes;
+
+ScatteredHeapBuffer::SlicePool::SlicePool(size_t max_cached_bytes)
+    : max_cached_bytes_(max_cached_bytes) {}
+
+ScatteredHeapBuffer::SlicePool::~SlicePool() = default;
+
+ScatteredHeapBuffer::Slice ScatteredHeapBuffer::SlicePool::Take(size_t size) {
+  for (Bucket& bucket : buckets_) {
+    if (bucket.slice_size != size || bucket.slices.empty())
+      continue;
+    // Reuse the most recently given slice, which is the likeliest to still be
+    // in the CPU caches.
+    Slice slice = std::move(bucket.slices.back());
+    bucket.slices.pop_back();
+    cached_bytes_ -= size;
+    slice.Clear();
+    return slice;
+  }
+  return Slice(size);
+}
+
+void ScatteredHeapBuffer::SlicePool::Give(Slice slice) {
+  const size_t size = slice.size();
+  if (!slice.start() || cached_bytes_ + size > max_cached_bytes_)
+    return;
+  cached_bytes_ += size;
+  for (Bucket& bucket : buckets_) {
+    if (bucket.slice_size == size) {
+      bucket.slices.push_back(std::move(slice));
+      return;
+    }
+  }
+  buckets_.emplace_back();
+  buckets_.back().slice_size = size;
+  buckets_.back().slices.push_back(std::move(slice));
+}
+
 ScatteredHeapBuffer::ScatteredHeapBuffer(size_t initial_slice_size_bytes,
-                                         size_t maximum_slice_size_bytes)
+                                         size_t maximum_slice_size_bytes,
+                                         SlicePool* slice_pool)
     : next_slice_size_(initial_slice_size_bytes),
-      maximum_slice_size_(maximum_slice_size_bytes) {
+      maximum_slice_size_(maximum_slice_size_bytes),
+      slice_pool_(slice_pool) {
   PERFETTO_DCHECK(next_slice_size_ && maximum_slice_size_);
   PERFETTO_DCHECK(maximum_slice_size_ >= initial_slice_size_bytes);
 }
 
-ScatteredHeapBuffer::~ScatteredHeapBuffer() = default;
+ScatteredHeapBuffer::~ScatteredHeapBuffer() {
+  if (!slice_pool_)
+    return;
+  for (Slice& slice : slices_)
+    slice_pool_->Give(std::move(slice));
+  slice_pool_->Give(std::move(cached_slice_));
+}
 
 protozero::ContiguousMemoryRange ScatteredHeapBuffer::GetNewBuffer() {
   PERFETTO_CHECK(writer_);
@@ -62,6 +109,8 @@ protozero::ContiguousMemoryRange ScatteredHeapBuffer::GetNewBuffer() {
   if (cached_slice_.start()) {
     slices_.push_back(std::move(cached_slice_));
     PERFETTO_DCHECK(!cached_slice_.start());
+  } else if (slice_pool_) {
+    slices_.push_back(slice_pool_->Take(next_slice_size_));
   } else {
     slices_.emplace_back(next_slice_size_);
   }
@@ -115,6 +164,10 @@ void ScatteredHeapBuffer::Reset() {
     return;
   cached_slice_ = std::move(slices_.front());
   cached_slice_.Clear();
+  if (slice_pool_) {
+    for (size_t i = 1; i < slices_.size(); i++)
+      slice_pool_->Give(std::move(slices_[i]));
+  }
   slices_.clear();
 }
 
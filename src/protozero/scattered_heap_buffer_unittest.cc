@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/protozero/scattered_heap_buffer.h"
+
+#include <string>
+
+#include "perfetto/protozero/message.h"
+#include "test/gtest_and_gmock.h"
+
+namespace protozero {
+namespace {
+
+using SlicePool = ScatteredHeapBuffer::SlicePool;
+
+TEST(ScatteredHeapBufferTest, SlicePoolReusesSlicesOfTheSameSize) {
+  SlicePool pool;
+  ScatteredHeapBuffer::Slice slice = pool.Take(128);
+  const uint8_t* start = slice.start();
+  pool.Give(std::move(slice));
+  EXPECT_EQ(pool.cached_bytes(), 128u);
+
+  // A slice of a different size is allocated from scratch.
+  ScatteredHeapBuffer::Slice other = pool.Take(256);
+  EXPECT_NE(other.start(), start);
+  EXPECT_EQ(other.size(), 256u);
+
+  ScatteredHeapBuffer::Slice reused = pool.Take(128);
+  EXPECT_EQ(reused.start(), start);
+  EXPECT_EQ(reused.unused_bytes(), 128u);
+  EXPECT_EQ(pool.cached_bytes(), 0u);
+}
+
+TEST(ScatteredHeapBufferTest, SlicePoolMaxCachedBytes) {
+  SlicePool pool(/*max_cached_bytes=*/256);
+  pool.Give(ScatteredHeapBuffer::Slice(128));
+  pool.Give(ScatteredHeapBuffer::Slice(128));
+  pool.Give(ScatteredHeapBuffer::Slice(128));
+  EXPECT_EQ(pool.cached_bytes(), 256u);
+
+  // Empty slices are ignored.
+  pool.Give(ScatteredHeapBuffer::Slice());
+  EXPECT_EQ(pool.cached_bytes(), 256u);
+}
+
+TEST(ScatteredHeapBufferTest, HeapBufferedWithSlicePool) {
+  SlicePool pool;
+  const std::string kPayload(1000, 'x');
+  const uint8_t* first_slice = nullptr;
+  std::string first_result;
+  for (int i = 0; i < 3; i++) {
+    HeapBuffered<Message> msg(/*initial_slice_size_bytes=*/128,
+                              /*maximum_slice_size_bytes=*/512, &pool);
+    msg->AppendString(1, kPayload);
+    msg->AppendVarInt(2, i);
+    std::string result = msg.SerializeAsString();
+    const uint8_t* slice = msg.GetSlices().front().start();
+    if (i == 0) {
+      first_slice = slice;
+      first_result = result;
+      continue;
+    }
+    // The slices given back by the previous message are reused and cleared.
+    EXPECT_EQ(slice, first_slice);
+    EXPECT_EQ(result.size(), first_result.size());
+    EXPECT_EQ(result.substr(0, kPayload.size()),
+              first_result.substr(0, kPayload.size()));
+  }
+
+  // 128 + 256 + 512 + 512 bytes of slices were used by each message.
+  EXPECT_EQ(pool.cached_bytes(), 1408u);
+}
+
+}  // namespace
+}  // namespace protozero
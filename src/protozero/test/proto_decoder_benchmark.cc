@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+
+#include "src/protozero/test/example_proto/test_messages.pbzero.h"
+
+namespace pbzero = protozero::test::protos::pbzero;
+
+namespace {
+
+// A message shaped like the hot ones of the trace (e.g. ftrace events): mostly
+// small integer fields, a short string and a nested message.
+std::string CreateSmallFieldsMessage() {
+  protozero::HeapBuffered<pbzero::EveryField> msg;
+  msg->set_field_int32(42);
+  msg->set_field_int64(7);
+  msg->set_field_uint32(120);
+  msg->set_field_uint64(3);
+  msg->set_field_sint32(-5);
+  msg->set_field_sint64(-9);
+  msg->set_field_fixed32(1234);
+  msg->set_field_fixed64(5678);
+  msg->set_field_bool(true);
+  msg->set_small_enum(pbzero::SmallEnum::TO_BE);
+  msg->set_field_string("swapper/0");
+  auto* nested = msg->add_field_nested();
+  nested->set_field_int32(1);
+  nested->set_field_uint64(2);
+  return msg.SerializeAsString();
+}
+
+// As above, but with values which need multi-byte varints.
+std::string CreateLargeFieldsMessage() {
+  protozero::HeapBuffered<pbzero::EveryField> msg;
+  msg->set_field_int32(1 << 20);
+  msg->set_field_int64(int64_t{1} << 40);
+  msg->set_field_uint32(1u << 30);
+  msg->set_field_uint64(uint64_t{1} << 60);
+  msg->set_field_sint32(-(1 << 20));
+  msg->set_field_sint64(-(int64_t{1} << 40));
+  msg->set_field_fixed32(1234);
+  msg->set_field_fixed64(5678);
+  msg->set_field_string(std::string(200, 'x'));
+  return msg.SerializeAsString();
+}
+
+void DecodeTyped(benchmark::State& state, const std::string& buf) {
+  for (auto _ : state) {
+    pbzero::EveryField::Decoder decoder(buf);
+    benchmark::DoNotOptimize(decoder.field_uint32());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(buf.size()));
+}
+
+void DecodeReadField(benchmark::State& state, const std::string& buf) {
+  for (auto _ : state) {
+    protozero::ProtoDecoder decoder(buf.data(), buf.size());
+    uint64_t sum = 0;
+    for (auto f = decoder.ReadField(); f.valid(); f = decoder.ReadField())
+      sum += f.as_uint64();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(buf.size()));
+}
+
+// A packed varint payload like the ones of compact_sched: mostly small values
+// (pids, prios, indexes) with some multi-byte ones (timestamp deltas).
+std::string CreatePackedVarInts(bool with_large_values) {
+  protozero::PackedVarInt buf;
+  for (uint32_t i = 0; i < 4096; i++) {
+    if (with_large_values && i % 4 == 0) {
+      buf.Append(10000 + i * 997);
+    } else {
+      buf.Append(i % 100);
+    }
+  }
+  return std::string(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+void DecodePackedIterator(benchmark::State& state, const std::string& buf) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(buf.data());
+  for (auto _ : state) {
+    bool parse_error = false;
+    protozero::PackedRepeatedFieldIterator<
+        protozero::proto_utils::ProtoWireType::kVarInt, uint64_t>
+        it(data, buf.size(), &parse_error);
+    uint64_t sum = 0;
+    for (; it; ++it)
+      sum += *it;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(buf.size()));
+}
+
+void DecodePackedBulk(benchmark::State& state, const std::string& buf) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(buf.data());
+  std::vector<uint64_t> values(buf.size());
+  for (auto _ : state) {
+    bool parse_error = false;
+    size_t count = protozero::DecodePackedVarInts(data, data + buf.size(),
+                                                  values.data(), &parse_error);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+      sum += values[i];
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(buf.size()));
+}
+
+}  // namespace
+
+static void BM_ProtoDecoder_Typed_SmallFields(benchmark::State& state) {
+  DecodeTyped(state, CreateSmallFieldsMessage());
+}
+
+static void BM_ProtoDecoder_Typed_LargeFields(benchmark::State& state) {
+  DecodeTyped(state, CreateLargeFieldsMessage());
+}
+
+static void BM_ProtoDecoder_ReadField_SmallFields(benchmark::State& state) {
+  DecodeReadField(state, CreateSmallFieldsMessage());
+}
+
+static void BM_ProtoDecoder_ReadField_LargeFields(benchmark::State& state) {
+  DecodeReadField(state, CreateLargeFieldsMessage());
+}
+
+static void BM_ProtoDecoder_PackedIterator_SmallValues(
+    benchmark::State& state) {
+  DecodePackedIterator(state, CreatePackedVarInts(false));
+}
+
+static void BM_ProtoDecoder_PackedIterator_MixedValues(
+    benchmark::State& state) {
+  DecodePackedIterator(state, CreatePackedVarInts(true));
+}
+
+static void BM_ProtoDecoder_PackedBulk_SmallValues(benchmark::State& state) {
+  DecodePackedBulk(state, CreatePackedVarInts(false));
+}
+
+static void BM_ProtoDecoder_PackedBulk_MixedValues(benchmark::State& state) {
+  DecodePackedBulk(state, CreatePackedVarInts(true));
+}
+
+BENCHMARK(BM_ProtoDecoder_Typed_SmallFields);
+BENCHMARK(BM_ProtoDecoder_Typed_LargeFields);
+BENCHMARK(BM_ProtoDecoder_ReadField_SmallFields);
+BENCHMARK(BM_ProtoDecoder_ReadField_LargeFields);
+BENCHMARK(BM_ProtoDecoder_PackedIterator_SmallValues);
+BENCHMARK(BM_ProtoDecoder_PackedIterator_MixedValues);
+BENCHMARK(BM_ProtoDecoder_PackedBulk_SmallValues);
+BENCHMARK(BM_ProtoDecoder_PackedBulk_MixedValues);
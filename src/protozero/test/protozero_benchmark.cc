@@ -24,6 +24,7 @@
 #include <benchmark/benchmark.h>
 
 #include "perfetto/base/compiler.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/protozero/static_buffer.h"
 
 // Autogenerated headers in out/*/gen/
@@ -191,6 +192,26 @@ static void BM_Protozero_Nested_SpeedOfLight(benchmark::State& state) {
   }
 }
 
+// Short-lived heap-backed messages, as created e.g. by the trace processor
+// metrics. The slice sizes are small enough for the nested message to span a
+// few slices.
+static void BM_Protozero_Nested_HeapBuffered(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    protozero::HeapBuffered<pbzero::EveryField> msg(64, 256);
+    FillMessage_Nested(msg.get());
+    benchmark::DoNotOptimize(msg.GetRanges());
+  }
+}
+
+static void BM_Protozero_Nested_HeapBufferedSlicePool(benchmark::State& state) {
+  protozero::ScatteredHeapBuffer::SlicePool pool;
+  while (state.KeepRunning()) {
+    protozero::HeapBuffered<pbzero::EveryField> msg(64, 256, &pool);
+    FillMessage_Nested(msg.get());
+    benchmark::DoNotOptimize(msg.GetRanges());
+  }
+}
+
 BENCHMARK(BM_Protozero_Simple_Libprotobuf);
 BENCHMARK(BM_Protozero_Simple_Protozero);
 BENCHMARK(BM_Protozero_Simple_SpeedOfLight);
@@ -198,3 +219,6 @@ BENCHMARK(BM_Protozero_Simple_SpeedOfLight);
 BENCHMARK(BM_Protozero_Nested_Libprotobuf);
 BENCHMARK(BM_Protozero_Nested_Protozero);
 BENCHMARK(BM_Protozero_Nested_SpeedOfLight);
+
+BENCHMARK(BM_Protozero_Nested_HeapBuffered);
+BENCHMARK(BM_Protozero_Nested_HeapBufferedSlicePool);
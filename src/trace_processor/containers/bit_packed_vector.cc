@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/bit_packed_vector.h"
+
+#include "src/trace_processor/containers/snapshot.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+BitPackedVector::BitPackedVector() = default;
+BitPackedVector::~BitPackedVector() = default;
+
+BitPackedVector::BitPackedVector(BitPackedVector&&) noexcept = default;
+BitPackedVector& BitPackedVector::operator=(BitPackedVector&&) noexcept =
+    default;
+
+void BitPackedVector::Serialize(SnapshotWriter* writer) const {
+  writer->Write(size_);
+  writer->Write(bit_width_);
+  writer->WriteVector(words_);
+}
+
+bool BitPackedVector::Deserialize(SnapshotReader* reader) {
+  BitPackedVector vector;
+  if (!reader->Read(&vector.size_) || !reader->Read(&vector.bit_width_) ||
+      !reader->ReadVector(&vector.words_) || vector.bit_width_ > 32) {
+    return false;
+  }
+  if (vector.size_ > 0 &&
+      vector.words_.size() < vector.WordsForSize(vector.size_)) {
+    return false;
+  }
+  vector.mask_ = (1ull << vector.bit_width_) - 1;
+  *this = std::move(vector);
+  return true;
+}
+
+void BitPackedVector::Repack(uint32_t bit_width) {
+  PERFETTO_DCHECK(bit_width > bit_width_ && bit_width <= 32);
+
+  BitPackedVector repacked;
+  repacked.bit_width_ = bit_width;
+  repacked.mask_ = (1ull << bit_width) - 1;
+  repacked.size_ = size_;
+  repacked.words_.resize(repacked.WordsForSize(size_));
+  for (uint32_t i = 0; i < size_; ++i) {
+    repacked.SetUnchecked(i, Get(i));
+  }
+  *this = std::move(repacked);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
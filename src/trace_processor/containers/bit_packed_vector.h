@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_BIT_PACKED_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_BIT_PACKED_VECTOR_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class SnapshotReader;
+class SnapshotWriter;
+
+// A vector of uint32_t which stores every value using only as many bits as
+// needed by the largest value in the vector.
+//
+// For example, if all the values in the vector are < 8, each value will take
+// up 3 bits instead of 32. When a value which does not fit in the current
+// width is appended or set, the whole vector is repacked with the new width;
+// as the width can only grow up to 32 bits, this happens at most 32 times over
+// the lifetime of the vector.
+//
+// This is mainly useful for storing "codes" (e.g. indices into a dictionary)
+// of low-cardinality data.
+class BitPackedVector {
+ public:
+  // The number of values processed by |EqWord|.
+  static constexpr uint32_t kWordSize = 64;
+
+  BitPackedVector();
+  ~BitPackedVector();
+
+  BitPackedVector(BitPackedVector&&) noexcept;
+  BitPackedVector& operator=(BitPackedVector&&) noexcept;
+
+  // Returns the value at |idx|.
+  uint32_t Get(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    if (bit_width_ == 0)
+      return 0;
+
+    uint64_t bit_idx = static_cast<uint64_t>(idx) * bit_width_;
+    uint64_t word_idx = bit_idx / 64;
+    uint32_t shift = static_cast<uint32_t>(bit_idx % 64);
+
+    // We always keep a spare word at the end of |words_| so we can always
+    // read the next word without a bounds check; the shift of 63 - shift
+    // followed by a shift of 1 avoids undefined behaviour when |shift| is 0.
+    uint64_t lo = words_[word_idx] >> shift;
+    uint64_t hi = (words_[word_idx + 1] << (63 - shift)) << 1;
+    return static_cast<uint32_t>((lo | hi) & mask_);
+  }
+
+  // Appends |value| to the end of the vector.
+  void Append(uint32_t value) {
+    if (PERFETTO_UNLIKELY(value > mask_))
+      Repack(BitWidth(value));
+    size_++;
+    words_.resize(WordsForSize(size_));
+    SetUnchecked(size_ - 1, value);
+  }
+
+  // Sets the value at |idx| to |value|.
+  void Set(uint32_t idx, uint32_t value) {
+    PERFETTO_DCHECK(idx < size_);
+    if (PERFETTO_UNLIKELY(value > mask_))
+      Repack(BitWidth(value));
+    SetUnchecked(idx, value);
+  }
+
+  // Writes the |count| values starting at |start| to |out|.
+  void Decode(uint32_t start, uint32_t count, uint32_t* out) const {
+    PERFETTO_DCHECK(start + count <= size_);
+    for (uint32_t i = 0; i < count; ++i) {
+      out[i] = Get(start + i);
+    }
+  }
+
+  // Makes sure that values up to |value| can be stored without repacking.
+  // This is useful to avoid repeatedly repacking the vector when the largest
+  // value which will be appended is known upfront.
+  void EnsureWidthFor(uint32_t value) {
+    if (value > mask_)
+      Repack(BitWidth(value));
+  }
+
+  // Returns a word where bit i is set iff Get(start + i) == value for the
+  // |kWordSize| values starting at |start|.
+  uint64_t EqWord(uint32_t start, uint32_t value) const {
+    PERFETTO_DCHECK(start + kWordSize <= size_);
+    uint64_t word = 0;
+    if (value > mask_)
+      return word;
+    for (uint32_t i = 0; i < kWordSize; ++i) {
+      word |= static_cast<uint64_t>(Get(start + i) == value) << i;
+    }
+    return word;
+  }
+
+  // Returns the number of values in the vector.
+  uint32_t size() const { return size_; }
+
+  // Returns the number of bits used to store each value.
+  uint32_t bit_width() const { return bit_width_; }
+
+  // Returns the approximate number of bytes used by this vector.
+  size_t GetMemoryUsage() const { return words_.size() * sizeof(uint64_t); }
+
+  // Writes the contents of this vector to |writer|.
+  void Serialize(SnapshotWriter* writer) const;
+
+  // Replaces the contents of this vector with the ones written by
+  // |Serialize|. Returns false if |reader| doesn't contain a valid vector.
+  bool Deserialize(SnapshotReader* reader);
+
+  // Returns the number of bits needed to store |value|.
+  static uint32_t BitWidth(uint32_t value) {
+    uint32_t width = 0;
+    while (width < 32 && (value >> width) != 0)
+      width++;
+    return width;
+  }
+
+ private:
+  BitPackedVector(const BitPackedVector&) = delete;
+  BitPackedVector& operator=(const BitPackedVector&) = delete;
+
+  void SetUnchecked(uint32_t idx, uint32_t value) {
+    if (bit_width_ == 0)
+      return;
+
+    uint64_t bit_idx = static_cast<uint64_t>(idx) * bit_width_;
+    uint64_t word_idx = bit_idx / 64;
+    uint32_t shift = static_cast<uint32_t>(bit_idx % 64);
+
+    uint64_t v = value;
+    words_[word_idx] &= ~(mask_ << shift);
+    words_[word_idx] |= v << shift;
+
+    // Handle the case where the value straddles two words.
+    uint32_t hi_shift = 64 - shift;
+    if (shift + bit_width_ > 64) {
+      words_[word_idx + 1] &= ~(mask_ >> hi_shift);
+      words_[word_idx + 1] |= v >> hi_shift;
+    }
+  }
+
+  // Changes the width used to store each value to |bit_width|.
+  void Repack(uint32_t bit_width);
+
+  // Returns the number of words needed to store |size| values with the
+  // current width (including the spare word).
+  size_t WordsForSize(uint32_t size) const {
+    return static_cast<size_t>(
+               (static_cast<uint64_t>(size) * bit_width_ + 63) / 64) +
+           1;
+  }
+
+  std::vector<uint64_t> words_;
+  uint32_t size_ = 0;
+  uint32_t bit_width_ = 0;
+  uint64_t mask_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_BIT_PACKED_VECTOR_H_
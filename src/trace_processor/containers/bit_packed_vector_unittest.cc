@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/bit_packed_vector.h"
+
+#include <random>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(BitPackedVector, AppendAndGet) {
+  BitPackedVector bv;
+  bv.Append(0);
+  bv.Append(1);
+  bv.Append(3);
+  bv.Append(2);
+
+  ASSERT_EQ(bv.size(), 4u);
+  ASSERT_EQ(bv.bit_width(), 2u);
+  ASSERT_EQ(bv.Get(0), 0u);
+  ASSERT_EQ(bv.Get(1), 1u);
+  ASSERT_EQ(bv.Get(2), 3u);
+  ASSERT_EQ(bv.Get(3), 2u);
+}
+
+TEST(BitPackedVector, AllZero) {
+  BitPackedVector bv;
+  for (uint32_t i = 0; i < 1000; ++i)
+    bv.Append(0);
+
+  ASSERT_EQ(bv.size(), 1000u);
+  ASSERT_EQ(bv.bit_width(), 0u);
+  for (uint32_t i = 0; i < 1000; ++i)
+    ASSERT_EQ(bv.Get(i), 0u);
+}
+
+TEST(BitPackedVector, Repack) {
+  BitPackedVector bv;
+  std::vector<uint32_t> expected;
+  std::minstd_rand0 rnd(42);
+
+  // Grow the values over time to force the vector to be repacked multiple
+  // times. This also makes sure values straddling word boundaries work.
+  for (uint32_t i = 0; i < 5000; ++i) {
+    uint32_t max = 1u << (i / 200);
+    uint32_t value = static_cast<uint32_t>(rnd()) % max;
+    bv.Append(value);
+    expected.push_back(value);
+  }
+  bv.Append(0xFFFFFFFFu);
+  expected.push_back(0xFFFFFFFFu);
+
+  ASSERT_EQ(bv.bit_width(), 32u);
+  ASSERT_EQ(bv.size(), expected.size());
+  for (uint32_t i = 0; i < expected.size(); ++i)
+    ASSERT_EQ(bv.Get(i), expected[i]);
+}
+
+TEST(BitPackedVector, Set) {
+  BitPackedVector bv;
+  for (uint32_t i = 0; i < 100; ++i)
+    bv.Append(i % 5);
+
+  bv.Set(10, 4);
+  bv.Set(20, 0);
+  ASSERT_EQ(bv.bit_width(), 3u);
+  ASSERT_EQ(bv.Get(10), 4u);
+  ASSERT_EQ(bv.Get(20), 0u);
+  ASSERT_EQ(bv.Get(11), 1u);
+
+  // Setting a value which does not fit should repack the vector.
+  bv.Set(50, 1000);
+  ASSERT_EQ(bv.bit_width(), 10u);
+  ASSERT_EQ(bv.Get(50), 1000u);
+  ASSERT_EQ(bv.Get(10), 4u);
+  ASSERT_EQ(bv.Get(99), 4u);
+}
+
+TEST(BitPackedVector, EqWord) {
+  BitPackedVector bv;
+  for (uint32_t i = 0; i < 3 * BitPackedVector::kWordSize; ++i)
+    bv.Append(i % 3);
+
+  for (uint32_t start = 0; start <= 2 * BitPackedVector::kWordSize;
+       start += 7) {
+    for (uint32_t value = 0; value < 4; ++value) {
+      uint64_t expected = 0;
+      for (uint32_t i = 0; i < BitPackedVector::kWordSize; ++i) {
+        expected |= static_cast<uint64_t>(bv.Get(start + i) == value) << i;
+      }
+      ASSERT_EQ(bv.EqWord(start, value), expected);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -17,10 +17,16 @@
 #include "src/trace_processor/containers/bit_vector.h"
 
 #include "src/trace_processor/containers/bit_vector_iterators.h"
+#include "src/trace_processor/containers/snapshot.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+// static
+constexpr uint32_t BitVector::kMinBlocksForSelectSamples;
+// static
+constexpr uint32_t BitVector::kSelectSampleRate;
+
 BitVector::BitVector() = default;
 
 BitVector::BitVector(std::initializer_list<bool> init) {
@@ -69,5 +75,64 @@ void BitVector::UpdateSetBits(const BitVector& o) {
   PERFETTO_DCHECK(o.GetNumBitsSet() == GetNumBitsSet());
 }
 
+void BitVector::And(const BitVector& other) {
+  uint32_t blocks = static_cast<uint32_t>(blocks_.size());
+  uint32_t other_blocks = static_cast<uint32_t>(other.blocks_.size());
+  for (uint32_t i = 0; i < blocks; ++i) {
+    if (i < other_blocks) {
+      blocks_[i].And(other.blocks_[i]);
+    } else {
+      blocks_[i].ClearAll();
+    }
+  }
+
+  // The number of set bits in every block may have changed so recompute the
+  // cummulative counts from scratch.
+  select_samples_.clear();
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < blocks; ++i) {
+    counts_[i] = count;
+    count += blocks_[i].GetNumBitsSet();
+  }
+}
+
+void BitVector::Serialize(SnapshotWriter* writer) const {
+  writer->Write(size_);
+  writer->WriteVector(counts_);
+  writer->WriteVector(blocks_);
+}
+
+bool BitVector::Deserialize(SnapshotReader* reader) {
+  // |select_samples_| are not serialized: they are rebuilt lazily.
+  BitVector bv;
+  if (!reader->Read(&bv.size_) || !reader->ReadVector(&bv.counts_) ||
+      !reader->ReadVector(&bv.blocks_)) {
+    return false;
+  }
+  uint32_t min_blocks = BlockCeil(bv.size_);
+  if (bv.blocks_.size() < min_blocks ||
+      bv.counts_.size() != bv.blocks_.size()) {
+    return false;
+  }
+  *this = std::move(bv);
+  return true;
+}
+
+void BitVector::BuildSelectSamples() const {
+  PERFETTO_DCHECK(select_samples_.empty());
+
+  // Walk the blocks, adding a sample for every multiple of
+  // |kSelectSampleRate| which falls inside each block.
+  const uint32_t kRate = kSelectSampleRate;
+  uint32_t next_sample = 0;
+  uint32_t blocks = static_cast<uint32_t>(counts_.size());
+  for (uint32_t i = 0; i < blocks; ++i) {
+    uint32_t end = i + 1 < blocks ? counts_[i + 1] : GetNumBitsSet();
+    for (; next_sample < end; next_sample += kRate) {
+      select_samples_.emplace_back(i);
+    }
+  }
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -30,6 +30,9 @@
 namespace perfetto {
 namespace trace_processor {
 
+class SnapshotReader;
+class SnapshotWriter;
+
 namespace internal {
 
 class BaseIterator;
@@ -97,14 +100,30 @@ class BitVector {
   uint32_t IndexOfNthSet(uint32_t n) const {
     PERFETTO_DCHECK(n < GetNumBitsSet());
 
-    // First search for the block which, up until the start of it, has more than
-    // n bits set. Note that this should never return |counts.begin()| as
-    // that should always be 0.
-    // TODO(lalitm): investigate whether we can make this faster with small
-    // binary search followed by a linear search instead of binary searching the
-    // full way.
-    auto it = std::upper_bound(counts_.begin(), counts_.end(), n);
-    PERFETTO_DCHECK(it != counts_.begin());
+    // Find the range of blocks which can contain the |n|th set bit: for large
+    // bitvectors, |select_samples_| narrows this down to the blocks between
+    // two samples. Otherwise, we have to consider all the blocks.
+    auto begin = counts_.begin();
+    auto end = counts_.end();
+    if (counts_.size() >= kMinBlocksForSelectSamples) {
+      if (PERFETTO_UNLIKELY(select_samples_.empty()))
+        BuildSelectSamples();
+
+      // Bits appended since the samples were built are always after the last
+      // sample.
+      uint32_t sample = std::min(n / kSelectSampleRate,
+                                 static_cast<uint32_t>(select_samples_.size()) -
+                                     1);
+      begin = counts_.begin() + select_samples_[sample];
+      if (sample + 1 < select_samples_.size())
+        end = counts_.begin() + select_samples_[sample + 1] + 1;
+    }
+
+    // Search for the block which, up until the start of it, has more than
+    // n bits set. Note that this should never return |begin| as the count of
+    // that block should always be <= n.
+    auto it = std::upper_bound(begin, end, n);
+    PERFETTO_DCHECK(it != begin);
 
     // Go back one block to find the block which has the bit we are looking for.
     uint32_t block_idx =
@@ -120,6 +139,23 @@ class BitVector {
     return AddressToIndex(Address{block_idx, block_offset});
   }
 
+  // Writes the contents of this bitvector to |writer|.
+  void Serialize(SnapshotWriter* writer) const;
+
+  // Replaces the contents of this bitvector with the ones written by
+  // |Serialize|. Returns false if |reader| doesn't contain a valid bitvector.
+  bool Deserialize(SnapshotReader* reader);
+
+  // Builds |select_samples_| if |IndexOfNthSet| would otherwise build them
+  // lazily. After this, the bitvector can be read from several threads at
+  // once as long as it is not modified.
+  void PrepareForConcurrentReads() {
+    if (counts_.size() >= kMinBlocksForSelectSamples &&
+        select_samples_.empty()) {
+      BuildSelectSamples();
+    }
+  }
+
   // Sets the bit at index |idx| to true.
   void Set(uint32_t idx) {
     // Set the bit to the correct value inside the block but store the old
@@ -130,6 +166,7 @@ class BitVector {
     // If the old value was unset, set the bit and add one to the count.
     if (PERFETTO_LIKELY(!old_value)) {
       blocks_[addr.block_idx].Set(addr.block_offset);
+      select_samples_.clear();
 
       uint32_t size = static_cast<uint32_t>(counts_.size());
       for (uint32_t i = addr.block_idx + 1; i < size; ++i) {
@@ -149,6 +186,7 @@ class BitVector {
     // counts.
     if (PERFETTO_LIKELY(old_value)) {
       blocks_[addr.block_idx].Clear(addr.block_offset);
+      select_samples_.clear();
 
       uint32_t size = static_cast<uint32_t>(counts_.size());
       for (uint32_t i = addr.block_idx + 1; i < size; ++i) {
@@ -199,6 +237,8 @@ class BitVector {
     if (size == old_size)
       return;
 
+    select_samples_.clear();
+
     // Empty bitvectors should be memory efficient so we don't keep any data
     // around in the bitvector.
     if (size == 0) {
@@ -301,6 +341,54 @@ class BitVector {
     return bv;
   }
 
+  // Same as |Range| above but, for all the bits which fall in whole blocks,
+  // the bits are filled one word at a time by calling |wf(index of first bit
+  // in word)|. |wf| should return a uint64_t where bit i is the value of the
+  // bit at index + i. |f| is still used for the bits outside whole blocks.
+  //
+  // This allows callers which can compute many bits at a time (e.g. using
+  // vectorized comparisions) to write the results straight into the words of
+  // the BitVector.
+  template <typename Filler = bool(uint32_t),
+            typename WordFiller = uint64_t(uint32_t)>
+  static BitVector Range(uint32_t start,
+                         uint32_t end,
+                         Filler f,
+                         WordFiller wf) {
+    uint32_t start_fast_block = BlockCeil(start);
+    uint32_t start_fast_idx = BlockToIndex(start_fast_block);
+    uint32_t end_fast_block = BlockFloor(end);
+    uint32_t end_fast_idx = BlockToIndex(end_fast_block);
+
+    BitVector bv(start, false);
+
+    // If there are no whole blocks between |start| and |end|, just fill the
+    // bits one at a time.
+    if (start_fast_block >= end_fast_block) {
+      for (uint32_t i = start; i < end; ++i) {
+        bv.Append(f(i));
+      }
+      return bv;
+    }
+
+    for (uint32_t i = start; i < start_fast_idx; ++i) {
+      bv.Append(f(i));
+    }
+
+    bv.counts_.reserve(end_fast_block + 1);
+    bv.blocks_.reserve(end_fast_block + 1);
+    for (uint32_t i = start_fast_block; i < end_fast_block; ++i) {
+      bv.counts_.emplace_back(bv.GetNumBitsSet());
+      bv.blocks_.emplace_back(Block::FromWordFiller(bv.size_, wf));
+      bv.size_ += Block::kBits;
+    }
+
+    for (uint32_t i = end_fast_idx; i < end; ++i) {
+      bv.Append(f(i));
+    }
+    return bv;
+  }
+
   // Updates the ith set bit of this bitvector with the value of
   // |other.IsSet(i)|.
   //
@@ -316,6 +404,11 @@ class BitVector {
   // TODO(lalitm): investigate whether we should just change this to And.
   void UpdateSetBits(const BitVector& other);
 
+  // Sets this bitvector to the bitwise and of this bitvector and |other|.
+  // The size of this bitvector is unchanged: any bits at indices greater than
+  // |other.size()| are cleared.
+  void And(const BitVector& other);
+
   // Iterate all the bits in the BitVector.
   //
   // Usage:
@@ -378,6 +471,9 @@ class BitVector {
     // Bitwise ors the given |mask| to the current value.
     void Or(uint64_t mask) { word_ |= mask; }
 
+    // Bitwise ands the value of |other| to the current value.
+    void And(const BitWord& other) { word_ &= other.word_; }
+
     // Sets the bit at the given index to true.
     void Set(uint32_t idx) {
       PERFETTO_DCHECK(idx < kBits);
@@ -652,6 +748,38 @@ class BitVector {
       return b;
     }
 
+    // Bitwise ands the words of |other| with the words of this block.
+    void And(const Block& other) {
+      for (uint32_t i = 0; i < kWords; ++i) {
+        words_[i].And(other.words_[i]);
+      }
+    }
+
+    // Clears all the bits in this block.
+    void ClearAll() {
+      for (uint32_t i = 0; i < kWords; ++i) {
+        words_[i].ClearAll();
+      }
+    }
+
+    // Returns the number of set bits in this block.
+    uint32_t GetNumBitsSet() const {
+      uint32_t count = 0;
+      for (uint32_t i = 0; i < kWords; ++i) {
+        count += words_[i].GetNumBitsSet();
+      }
+      return count;
+    }
+
+    template <typename WordFiller>
+    static Block FromWordFiller(uint32_t offset, WordFiller wf) {
+      Block b;
+      for (uint32_t i = 0; i < Block::kWords; ++i) {
+        b.words_[i].Or(wf(offset + i * BitWord::kBits));
+      }
+      return b;
+    }
+
    private:
     std::array<BitWord, kWords> words_{};
   };
@@ -744,9 +872,26 @@ class BitVector {
     return block * Block::kBits;
   }
 
+  // Computes |select_samples_| from |counts_|.
+  void BuildSelectSamples() const;
+
+  // The minimum number of blocks for which |select_samples_| are built: for
+  // smaller bitvectors, binary searching all of |counts_| is fast enough.
+  static constexpr uint32_t kMinBlocksForSelectSamples = 64;
+
+  // The number of set bits between two consecutive entries in
+  // |select_samples_|.
+  static constexpr uint32_t kSelectSampleRate = Block::kBits;
+
   uint32_t size_ = 0;
   std::vector<uint32_t> counts_;
   std::vector<Block> blocks_;
+
+  // A (lazily built) acceleration structure for |IndexOfNthSet|: entry i is
+  // the index of the block containing the (i * kSelectSampleRate)th set bit.
+  // Any operation which changes the already set bits (apart from appending)
+  // clears this vector so it can be rebuilt on the next call.
+  mutable std::vector<uint32_t> select_samples_;
 };
 
 }  // namespace trace_processor
@@ -47,6 +47,8 @@ void BaseIterator::OnBlockChange(uint32_t old_block, uint32_t new_block) {
   }
 
   if (set_bit_count_diff_ != 0) {
+    bv_->select_samples_.clear();
+
     // If the count of set bits has changed, go through all the counts between
     // the old and new blocks and modify them.
     // We only need to go to new_block and not to the end of the bitvector as
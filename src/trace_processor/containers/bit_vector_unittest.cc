@@ -17,6 +17,8 @@
 #include "src/trace_processor/containers/bit_vector.h"
 
 #include <random>
+#include <thread>
+#include <vector>
 
 #include "src/trace_processor/containers/bit_vector_iterators.h"
 #include "test/gtest_and_gmock.h"
@@ -171,6 +173,74 @@ TEST(BitVectorUnittest, IndexOfNthSet) {
   ASSERT_EQ(bv.IndexOfNthSet(5), 2048u);
 }
 
+// Checks IndexOfNthSet on every set bit of |bv| against a linear scan.
+void CheckIndexOfNthSet(const BitVector& bv) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < bv.size(); ++i) {
+    if (bv.IsSet(i))
+      ASSERT_EQ(bv.IndexOfNthSet(n++), i);
+  }
+  ASSERT_EQ(n, bv.GetNumBitsSet());
+}
+
+TEST(BitVectorUnittest, IndexOfNthSetLarge) {
+  // Large enough for the select samples to be used.
+  static constexpr uint32_t kSize = 512 * 300;
+  std::minstd_rand0 rand;
+  for (uint32_t percentage : {1u, 50u, 99u}) {
+    BitVector bv;
+    for (uint32_t i = 0; i < kSize; ++i) {
+      if (rand() % 100 < percentage) {
+        bv.AppendTrue();
+      } else {
+        bv.AppendFalse();
+      }
+    }
+    CheckIndexOfNthSet(bv);
+
+    // Appending bits should keep previously built samples valid.
+    for (uint32_t i = 0; i < 2048; ++i) {
+      bv.AppendTrue();
+    }
+    CheckIndexOfNthSet(bv);
+
+    // While changing bits should cause them to be rebuilt.
+    bv.Clear(bv.IndexOfNthSet(0));
+    bv.Set(kSize / 2);
+    CheckIndexOfNthSet(bv);
+
+    for (auto it = bv.IterateSetBits(); it; it.Next()) {
+      if (it.index() % 3 == 0)
+        it.Clear();
+    }
+    CheckIndexOfNthSet(bv);
+
+    bv.And(BitVector(kSize / 3, true));
+    CheckIndexOfNthSet(bv);
+  }
+}
+
+TEST(BitVectorUnittest, IndexOfNthSetConcurrentReads) {
+  static constexpr uint32_t kSize = 512 * 300;
+  BitVector bv;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (i % 7 == 0) {
+      bv.AppendTrue();
+    } else {
+      bv.AppendFalse();
+    }
+  }
+  bv.PrepareForConcurrentReads();
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&bv] { CheckIndexOfNthSet(bv); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 TEST(BitVectorUnittest, Resize) {
   BitVector bv(1, false);
 
@@ -411,6 +481,39 @@ TEST(BitVectorUnittest, Range) {
   ASSERT_EQ(bv.GetNumBitsSet(), 341u);
 }
 
+TEST(BitVectorUnittest, RangeWithWordFiller) {
+  auto f = [](uint32_t t) { return t % 3 == 0; };
+  auto wf = [&f](uint32_t t) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < 64; ++i)
+      word |= static_cast<uint64_t>(f(t + i)) << i;
+    return word;
+  };
+  BitVector bv = BitVector::Range(1, 2049, f, wf);
+
+  ASSERT_FALSE(bv.IsSet(0));
+  for (uint32_t i = 1; i < 2049; ++i) {
+    ASSERT_EQ(i % 3 == 0, bv.IsSet(i));
+  }
+  ASSERT_EQ(bv.size(), 2049u);
+  ASSERT_EQ(bv.GetNumBitsSet(), 682u);
+  for (uint32_t i = 0; i < 682u; ++i) {
+    ASSERT_EQ(bv.IndexOfNthSet(i), (i + 1) * 3);
+  }
+}
+
+TEST(BitVectorUnittest, RangeWithWordFillerNoWholeBlocks) {
+  BitVector bv = BitVector::Range(
+      3, 300, [](uint32_t t) { return t % 2 == 0; },
+      [](uint32_t) -> uint64_t {
+        ADD_FAILURE() << "Word filler should not be called";
+        return 0;
+      });
+
+  ASSERT_EQ(bv.size(), 300u);
+  ASSERT_EQ(bv.GetNumBitsSet(), 148u);
+}
+
 TEST(BitVectorUnittest, QueryStressTest) {
   BitVector bv;
   std::vector<bool> bool_vec;
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_HYPER_LOG_LOG_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_HYPER_LOG_LOG_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <cmath>
+
+namespace perfetto {
+namespace trace_processor {
+
+// Estimates the number of distinct values added to it using a fixed, small
+// amount of memory (a "HyperLogLog" sketch).
+//
+// Each value is hashed: the first |kPrecision| bits of the hash choose one of
+// |kNumRegisters| registers and the register remembers the longest run of
+// leading zeros seen in the remaining bits. The more distinct values are
+// added, the longer the longest run is likely to be. The estimate has a
+// standard error of about 1.04 / sqrt(kNumRegisters) (i.e. ~3%) which is
+// plenty for purposes like query planning.
+class HyperLogLog {
+ public:
+  static constexpr uint32_t kPrecision = 10;
+  static constexpr uint32_t kNumRegisters = 1u << kPrecision;
+
+  HyperLogLog() { registers_.fill(0); }
+
+  // Adds |value| to the sketch. Adding the same value many times has the
+  // same effect as adding it once.
+  void Add(uint64_t value) {
+    uint64_t hash = Mix(value);
+    uint32_t idx = static_cast<uint32_t>(hash >> (64 - kPrecision));
+
+    // Set the bit below the remaining bits to bound the run of zeros. The
+    // loop only runs twice on average as each extra zero halves the
+    // probability of the run continuing.
+    uint64_t rest = (hash << kPrecision) | (1ull << (kPrecision - 1));
+    uint8_t rank = 1;
+    for (; (rest & (1ull << 63)) == 0; rest <<= 1) {
+      rank++;
+    }
+    if (rank > registers_[idx])
+      registers_[idx] = rank;
+  }
+
+  // Returns the estimated number of distinct values added to the sketch.
+  double Estimate() const {
+    const double m = kNumRegisters;
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (uint8_t r : registers_) {
+      sum += std::ldexp(1.0, -static_cast<int>(r));
+      zeros += r == 0;
+    }
+    double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+
+    // For small cardinalities, many registers are still empty and "linear
+    // counting" of the empty registers is much more accurate.
+    if (estimate <= 2.5 * m && zeros != 0)
+      return m * std::log(m / zeros);
+    return estimate;
+  }
+
+ private:
+  // Scrambles the bits of |value| (this is the finalizer of MurmurHash3) so
+  // that similar values (e.g. consecutive integers) have unrelated hashes.
+  static uint64_t Mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+  }
+
+  std::array<uint8_t, kNumRegisters> registers_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_HYPER_LOG_LOG_H_
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/hyper_log_log.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(HyperLogLog, Empty) {
+  HyperLogLog hll;
+  ASSERT_EQ(hll.Estimate(), 0);
+}
+
+TEST(HyperLogLog, Duplicates) {
+  HyperLogLog hll;
+  for (uint32_t i = 0; i < 100000; ++i) {
+    hll.Add(i % 10);
+  }
+  ASSERT_NEAR(hll.Estimate(), 10, 1);
+}
+
+TEST(HyperLogLog, Small) {
+  HyperLogLog hll;
+  for (uint64_t i = 0; i < 500; ++i) {
+    hll.Add(i);
+  }
+  ASSERT_NEAR(hll.Estimate(), 500, 500 * 0.1);
+}
+
+TEST(HyperLogLog, Large) {
+  for (uint64_t n : {10000u, 100000u, 1000000u}) {
+    HyperLogLog hll;
+    for (uint64_t i = 0; i < n; ++i) {
+      // Add each value twice and use large, sparse values.
+      hll.Add(i * 1000003);
+      hll.Add(i * 1000003);
+    }
+    ASSERT_NEAR(hll.Estimate(), static_cast<double>(n), n * 0.1);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/interval_index.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+IntervalIndex::IntervalIndex() = default;
+
+IntervalIndex::IntervalIndex(std::vector<Interval> intervals)
+    : intervals_(std::move(intervals)) {
+  std::stable_sort(intervals_.begin(), intervals_.end(),
+                   [](const Interval& a, const Interval& b) {
+                     return a.start < b.start;
+                   });
+  if (intervals_.empty())
+    return;
+
+  // Each internal node covers a range of intervals which is split in half
+  // between its two children; a tree over n intervals needs at most 4n nodes.
+  max_end_.resize(4 * intervals_.size(), std::numeric_limits<int64_t>::min());
+
+  // Build the tree bottom up by visiting the nodes in post-order.
+  struct Frame {
+    uint32_t node;
+    uint32_t start;
+    uint32_t end;
+    bool children_done;
+  };
+  std::vector<Frame> stack;
+  stack.push_back(Frame{1, 0, size(), false});
+  while (!stack.empty()) {
+    Frame frame = stack.back();
+    stack.pop_back();
+    if (frame.end - frame.start == 1) {
+      max_end_[frame.node] = intervals_[frame.start].end;
+      continue;
+    }
+    uint32_t mid = frame.start + (frame.end - frame.start) / 2;
+    if (frame.children_done) {
+      max_end_[frame.node] =
+          std::max(max_end_[2 * frame.node], max_end_[2 * frame.node + 1]);
+      continue;
+    }
+    stack.push_back(Frame{frame.node, frame.start, frame.end, true});
+    stack.push_back(Frame{2 * frame.node, frame.start, mid, false});
+    stack.push_back(Frame{2 * frame.node + 1, mid, frame.end, false});
+  }
+}
+
+IntervalIndex::~IntervalIndex() = default;
+
+IntervalIndex::IntervalIndex(IntervalIndex&&) noexcept = default;
+IntervalIndex& IntervalIndex::operator=(IntervalIndex&&) noexcept = default;
+
+void IntervalIndex::FindOverlaps(int64_t start,
+                                 int64_t end,
+                                 std::vector<uint32_t>* ids) const {
+  // Only the intervals before |limit| start before |end|.
+  auto it = std::lower_bound(
+      intervals_.begin(), intervals_.end(), end,
+      [](const Interval& interval, int64_t value) {
+        return interval.start < value;
+      });
+  uint32_t limit = static_cast<uint32_t>(it - intervals_.begin());
+  if (limit == 0)
+    return;
+  FindOverlaps(1, 0, size(), limit, start, ids);
+}
+
+void IntervalIndex::FindOverlaps(uint32_t node,
+                                 uint32_t node_start,
+                                 uint32_t node_end,
+                                 uint32_t limit,
+                                 int64_t start,
+                                 std::vector<uint32_t>* ids) const {
+  // Skip this subtree if all its intervals start too late or if they all end
+  // too early.
+  if (node_start >= limit || max_end_[node] <= start)
+    return;
+
+  if (node_end - node_start == 1) {
+    PERFETTO_DCHECK(intervals_[node_start].end > start);
+    ids->push_back(intervals_[node_start].id);
+    return;
+  }
+
+  // Visit the left child first so that ids are appended in order of start.
+  uint32_t mid = node_start + (node_end - node_start) / 2;
+  FindOverlaps(2 * node, node_start, mid, limit, start, ids);
+  FindOverlaps(2 * node + 1, mid, node_end, limit, start, ids);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_INTERVAL_INDEX_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_INTERVAL_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+// An index over a set of half-open intervals [start, end) which allows
+// efficiently finding all the intervals which overlap a given interval.
+//
+// The intervals are sorted by start and an implicit segment tree stores the
+// maximum end of the intervals under each node. Finding the k intervals which
+// overlap an interval walks down the tree skipping any subtree where all the
+// intervals start too late or end too early; this takes O((k + 1) log n) time
+// instead of the O(n) needed to check every interval.
+class IntervalIndex {
+ public:
+  struct Interval {
+    int64_t start;
+    int64_t end;
+
+    // An opaque id for this interval (e.g. a row in a table) which is
+    // returned by |FindOverlaps|.
+    uint32_t id;
+  };
+
+  IntervalIndex();
+  explicit IntervalIndex(std::vector<Interval> intervals);
+  ~IntervalIndex();
+
+  IntervalIndex(IntervalIndex&&) noexcept;
+  IntervalIndex& operator=(IntervalIndex&&) noexcept;
+
+  // Appends to |ids| the id of every interval which overlaps [start, end);
+  // that is, every interval for which |interval.start < end| and
+  // |interval.end > start|. The ids are appended in order of increasing start
+  // and, for intervals with the same start, in the order they were passed to
+  // the constructor.
+  void FindOverlaps(int64_t start,
+                    int64_t end,
+                    std::vector<uint32_t>* ids) const;
+
+  // Returns the number of intervals in the index.
+  uint32_t size() const { return static_cast<uint32_t>(intervals_.size()); }
+
+ private:
+  IntervalIndex(const IntervalIndex&) = delete;
+  IntervalIndex& operator=(const IntervalIndex&) = delete;
+
+  void FindOverlaps(uint32_t node,
+                    uint32_t node_start,
+                    uint32_t node_end,
+                    uint32_t limit,
+                    int64_t start,
+                    std::vector<uint32_t>* ids) const;
+
+  // Sorted by |Interval::start|.
+  std::vector<Interval> intervals_;
+
+  // The segment tree: the root is at index 1 and the children of node i are
+  // at 2 * i and 2 * i + 1. Each node stores the maximum end of the intervals
+  // it covers.
+  std::vector<int64_t> max_end_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_INTERVAL_INDEX_H_
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/interval_index.h"
+
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+std::vector<uint32_t> FindOverlaps(const IntervalIndex& index,
+                                   int64_t start,
+                                   int64_t end) {
+  std::vector<uint32_t> ids;
+  index.FindOverlaps(start, end, &ids);
+  return ids;
+}
+
+TEST(IntervalIndex, Empty) {
+  IntervalIndex index;
+  ASSERT_EQ(index.size(), 0u);
+  ASSERT_THAT(FindOverlaps(index, 0, 100), IsEmpty());
+}
+
+TEST(IntervalIndex, Simple) {
+  IntervalIndex index({{10, 20, 0}, {0, 5, 1}, {15, 100, 2}, {10, 12, 3}});
+  ASSERT_EQ(index.size(), 4u);
+
+  // Intervals are half-open so touching intervals do not overlap.
+  ASSERT_THAT(FindOverlaps(index, 5, 10), IsEmpty());
+  ASSERT_THAT(FindOverlaps(index, 4, 11), ElementsAre(1u, 0u, 3u));
+  ASSERT_THAT(FindOverlaps(index, 12, 16), ElementsAre(0u, 2u));
+  ASSERT_THAT(FindOverlaps(index, 50, 60), ElementsAre(2u));
+  ASSERT_THAT(FindOverlaps(index, 100, 200), IsEmpty());
+}
+
+TEST(IntervalIndex, MatchesBruteForce) {
+  std::minstd_rand0 rnd(0);
+  std::uniform_int_distribution<int64_t> ts(0, 10000);
+  std::uniform_int_distribution<int64_t> dur(-1, 500);
+
+  std::vector<IntervalIndex::Interval> intervals;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    int64_t start = ts(rnd);
+    intervals.push_back({start, start + dur(rnd), i});
+  }
+  IntervalIndex index(intervals);
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    int64_t start = ts(rnd);
+    int64_t end = start + dur(rnd);
+
+    std::vector<uint32_t> expected;
+    for (const IntervalIndex::Interval& interval : intervals) {
+      if (interval.start < end && interval.end > start)
+        expected.push_back(interval.id);
+    }
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&intervals](uint32_t a, uint32_t b) {
+                       return intervals[a].start < intervals[b].start;
+                     });
+    ASSERT_EQ(FindOverlaps(index, start, end), expected);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -19,15 +19,86 @@
 
 #include <stdint.h>
 
-#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/containers/bit_packed_vector.h"
 #include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/containers/snapshot.h"
+#include "src/trace_processor/containers/zone_map.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace internal {
+
+// Converts integers to and from an unsigned 32-bit offset from a base value
+// ("frame of reference" encoding). This is used to bit-pack the storage of
+// NullableVectors of integers.
+template <typename T, bool = std::is_integral<T>::value>
+struct FrameOfReference {
+  static constexpr bool kSupported = true;
+
+  // Returns whether |value| can be represented as an offset from |base|,
+  // storing the offset in |offset| if so.
+  static bool ToOffset(T base, T value, uint32_t* offset) {
+    if (value < base)
+      return false;
+    uint64_t diff = static_cast<uint64_t>(static_cast<int64_t>(value)) -
+                    static_cast<uint64_t>(static_cast<int64_t>(base));
+    if (diff > std::numeric_limits<uint32_t>::max())
+      return false;
+    *offset = static_cast<uint32_t>(diff);
+    return true;
+  }
+
+  static T FromOffset(T base, uint32_t offset) {
+    return static_cast<T>(static_cast<int64_t>(
+        static_cast<uint64_t>(static_cast<int64_t>(base)) + offset));
+  }
+};
+
+// Doubles are only packed when they hold integers (e.g. counters of bytes or
+// of frequencies in kHz), which are stored exactly as integer offsets.
+template <>
+struct FrameOfReference<double, false> {
+  static constexpr bool kSupported = true;
+
+  static bool ToOffset(double base, double value, uint32_t* offset) {
+    // -0.0 would be decoded as 0.0.
+    if (std::trunc(value) != value || (value == 0 && std::signbit(value)))
+      return false;
+    // As both are integers, the difference is exact when it's small enough to
+    // fit in an offset. This also rejects NaNs and infinities.
+    double diff = value - base;
+    if (!(diff >= 0 && diff <= std::numeric_limits<uint32_t>::max()))
+      return false;
+    *offset = static_cast<uint32_t>(diff);
+    return true;
+  }
+
+  static double FromOffset(double base, uint32_t offset) {
+    return base + offset;
+  }
+};
+
+template <typename T>
+struct FrameOfReference<T, false> {
+  static constexpr bool kSupported = false;
+
+  static bool ToOffset(T, T, uint32_t*) { return false; }
+  static T FromOffset(T, uint32_t) { PERFETTO_FATAL("Not supported"); }
+};
+
+}  // namespace internal
+
 // Base class for NullableVector which allows type erasure to be implemented
 // (e.g. allows for std::unique_ptr<NullableVectorBase>).
 class NullableVectorBase {
@@ -44,11 +115,27 @@ class NullableVectorBase {
 
 // A data structure which compactly stores a list of possibly nullable data.
 //
-// Internally, this class is implemented using a combination of a std::deque
+// Internally, this class is implemented using a combination of a std::vector
 // with a BitVector used to store whether each index is null or not.
 // By default, for each null value, it only uses a single bit inside the
 // BitVector at a slight cost (searching the BitVector to find the index into
-// the std::deque) when looking up the data.
+// the std::vector) when looking up the data.
+//
+// The non-null data is kept contiguous in memory so that hot loops (e.g.
+// filtering non-null columns) can operate directly on the underlying array.
+//
+// For low-cardinality data without nulls, the vector can instead be created in
+// "encoded" mode: each distinct value is stored once in a dictionary and every
+// entry only stores the index of its value in the dictionary (its "code")
+// using as few bits as possible (see BitPackedVector).
+//
+// Once all the data has been added, |ShrinkToFit| can be called to reduce the
+// memory used by the vector. For integers (and doubles which only hold
+// integers), this can "pack" the storage: each block of |kPackBlockSize|
+// entries is stored as the offsets from the minimum value of the block using
+// as few bits as possible (e.g. sorted timestamps or small durations often fit
+// in a lot less than 64 bits). Values are transparently decoded when read and
+// the vector is unpacked if a value which doesn't fit is later added.
 template <typename T>
 class NullableVector : public NullableVectorBase {
  private:
@@ -63,6 +150,10 @@ class NullableVector : public NullableVectorBase {
     // increases
     // memory usage but allows for O(1) set operations.
     kDense,
+
+    // Encoded mode stores the data using dictionary encoding with bit-packed
+    // codes. Null entries are not supported in this mode.
+    kEncoded,
   };
 
  public:
@@ -82,14 +173,21 @@ class NullableVector : public NullableVectorBase {
   // Creates a dense nullable vector
   static NullableVector<T> Dense() { return NullableVector<T>(Mode::kDense); }
 
+  // Creates a dictionary-encoded vector. This vector cannot contain nulls.
+  static NullableVector<T> Encoded() {
+    return NullableVector<T>(Mode::kEncoded);
+  }
+
   // Returns the optional value at |idx| or base::nullopt if the value is null.
   base::Optional<T> Get(uint32_t idx) const {
-    if (mode_ == Mode::kDense) {
+    if (mode_ == Mode::kEncoded) {
+      return base::Optional<T>(dictionary_[codes_.Get(idx)]);
+    } else if (mode_ == Mode::kDense) {
       bool contains = valid_.Contains(idx);
-      return contains ? base::Optional<T>(data_[idx]) : base::nullopt;
+      return contains ? base::Optional<T>(StorageAt(idx)) : base::nullopt;
     } else {
       auto opt_idx = valid_.IndexOf(idx);
-      return opt_idx ? base::Optional<T>(data_[*opt_idx]) : base::nullopt;
+      return opt_idx ? base::Optional<T>(StorageAt(*opt_idx)) : base::nullopt;
     }
   }
 
@@ -104,24 +202,76 @@ class NullableVector : public NullableVectorBase {
   // GetNonNull(2) = 4
   // ...
   T GetNonNull(uint32_t ordinal) const {
-    if (mode_ == Mode::kDense) {
-      return data_[valid_.Get(ordinal)];
+    if (mode_ == Mode::kEncoded) {
+      return dictionary_[codes_.Get(ordinal)];
+    } else if (mode_ == Mode::kDense) {
+      return StorageAt(valid_.Get(ordinal));
+    } else {
+      PERFETTO_DCHECK(ordinal < storage_size());
+      return StorageAt(ordinal);
+    }
+  }
+
+  // Writes the values at the |count| (at most 64) indices in |idxs| to
+  // |values| and returns a word where bit i is set iff the value at |idxs[i]|
+  // is null (in which case |values[i]| is a default constructed value).
+  // This is more efficient than calling |Get| for each index as the storage
+  // mode of the vector only needs to be checked once.
+  uint64_t GetBatch(const uint32_t* idxs, uint32_t count, T* values) const {
+    PERFETTO_DCHECK(count <= 64);
+    uint64_t nulls = 0;
+    if (mode_ == Mode::kEncoded) {
+      for (uint32_t i = 0; i < count; ++i) {
+        values[i] = dictionary_[codes_.Get(idxs[i])];
+      }
+    } else if (mode_ == Mode::kDense) {
+      for (uint32_t i = 0; i < count; ++i) {
+        bool is_null = !valid_.Contains(idxs[i]);
+        values[i] = is_null ? T() : StorageAt(idxs[i]);
+        nulls |= static_cast<uint64_t>(is_null) << i;
+      }
+    } else if (storage_size() == size_) {
+      // Sparse vectors without any nulls can index the storage directly.
+      for (uint32_t i = 0; i < count; ++i) {
+        values[i] = StorageAt(idxs[i]);
+      }
     } else {
-      PERFETTO_DCHECK(ordinal < data_.size());
-      return data_[ordinal];
+      for (uint32_t i = 0; i < count; ++i) {
+        base::Optional<T> value = Get(idxs[i]);
+        values[i] = value ? *value : T();
+        nulls |= static_cast<uint64_t>(!value) << i;
+      }
     }
+    return nulls;
   }
 
   // Adds the given value to the NullableVector.
   void Append(T val) {
+    if (mode_ == Mode::kEncoded) {
+      codes_.Append(GetOrInsertCode(val));
+      size_++;
+      return;
+    }
+    if (packed_) {
+      if (PERFETTO_LIKELY(TryStorePacked(packed_data_.size(), val))) {
+        valid_.Insert(size_++);
+        return;
+      }
+      Unpack();
+    }
     data_.emplace_back(val);
     valid_.Insert(size_++);
   }
 
   // Adds a null value to the NullableVector.
   void AppendNull() {
+    PERFETTO_CHECK(mode_ != Mode::kEncoded);
     if (mode_ == Mode::kDense) {
-      data_.emplace_back();
+      if (!packed_ || !TryStorePacked(packed_data_.size(), T())) {
+        if (packed_)
+          Unpack();
+        data_.emplace_back();
+      }
     }
     size_++;
   }
@@ -137,7 +287,31 @@ class NullableVector : public NullableVectorBase {
 
   // Sets the value at |idx| to the given |val|.
   void Set(uint32_t idx, T val) {
-    if (mode_ == Mode::kDense) {
+    zone_map_.Update(idx, val);
+
+    // Changing a value would require moving the index from one entry of
+    // |index_| to another: as this is rare, just rebuild the index next time
+    // it's needed.
+    if (idx < index_size_) {
+      index_.clear();
+      index_size_ = 0;
+    }
+    if (packed_) {
+      // Only changing the value of an existing entry can be done in place.
+      bool has_entry = mode_ == Mode::kDense || valid_.Contains(idx);
+      if (has_entry &&
+          TryStorePacked(mode_ == Mode::kDense ? idx : *valid_.IndexOf(idx),
+                         val)) {
+        if (mode_ == Mode::kDense && !valid_.Contains(idx)) {
+          valid_.Insert(idx);
+        }
+        return;
+      }
+      Unpack();
+    }
+    if (mode_ == Mode::kEncoded) {
+      codes_.Set(idx, GetOrInsertCode(val));
+    } else if (mode_ == Mode::kDense) {
       if (!valid_.Contains(idx)) {
         valid_.Insert(idx);
       }
@@ -165,16 +339,386 @@ class NullableVector : public NullableVectorBase {
   // Returns whether data in this NullableVector is stored densely.
   bool IsDense() const { return mode_ == Mode::kDense; }
 
+  // Returns whether data in this NullableVector is dictionary encoded.
+  bool IsEncoded() const { return mode_ == Mode::kEncoded; }
+
+  // Returns whether the storage of this NullableVector is bit-packed (see
+  // |ShrinkToFit|).
+  bool IsPacked() const { return packed_; }
+
+  // Reduces the memory used by this vector. This should be called once all
+  // the data has been added to the vector (e.g. at the end of the trace):
+  // while further modifications are allowed, they may be slower and undo the
+  // savings.
+  //
+  // For vectors of integers where the difference between the smallest and
+  // largest value is small enough, this packs the storage (see class
+  // comment).
+  void ShrinkToFit() {
+    if (mode_ == Mode::kEncoded) {
+      dictionary_.shrink_to_fit();
+      return;
+    }
+    if (!packed_ && TryPack())
+      return;
+    data_.shrink_to_fit();
+  }
+
+  // Writes the contents of this vector to |writer|. The structures which are
+  // built lazily (see |zone_map()| and |FindAll()|) are not written.
+  void Serialize(SnapshotWriter* writer) const {
+    writer->Write(static_cast<uint32_t>(mode_));
+    writer->Write(size_);
+    valid_.Serialize(writer);
+    writer->Write(static_cast<uint8_t>(packed_));
+    if (mode_ == Mode::kEncoded) {
+      writer->WriteVector(dictionary_);
+      codes_.Serialize(writer);
+    } else if (packed_) {
+      writer->WriteVector(bases_);
+      packed_data_.Serialize(writer);
+    } else {
+      writer->WriteVector(data_);
+    }
+  }
+
+  // Replaces the contents of this vector with the ones written by
+  // |Serialize|. The serialized vector must have been created in the same
+  // mode as this one (see |Sparse()|, |Dense()| and |Encoded()|). Returns
+  // false if |reader| doesn't contain such a vector.
+  bool Deserialize(SnapshotReader* reader) {
+    NullableVector<T> vector(mode_);
+    uint32_t mode;
+    uint8_t packed;
+    if (!reader->Read(&mode) || mode != static_cast<uint32_t>(mode_) ||
+        !reader->Read(&vector.size_) || !vector.valid_.Deserialize(reader) ||
+        !reader->Read(&packed) || packed > 1) {
+      return false;
+    }
+
+    if (mode_ == Mode::kEncoded) {
+      if (packed || !reader->ReadVector(&vector.dictionary_) ||
+          !vector.codes_.Deserialize(reader) ||
+          vector.codes_.size() != vector.size_) {
+        return false;
+      }
+      for (uint32_t i = 0; i < vector.dictionary_.size(); ++i) {
+        vector.dictionary_index_.emplace(vector.dictionary_[i], i);
+      }
+    } else {
+      if (packed) {
+        if (!FrameOfReference::kSupported ||
+            !reader->ReadVector(&vector.bases_) ||
+            !vector.packed_data_.Deserialize(reader) ||
+            vector.bases_.size() != BlocksForSize(vector.packed_data_.size())) {
+          return false;
+        }
+        vector.packed_ = true;
+      } else if (!reader->ReadVector(&vector.data_)) {
+        return false;
+      }
+      // Dense vectors have an entry in the storage for every row while sparse
+      // ones only have one for each non-null row.
+      uint32_t storage_size =
+          mode_ == Mode::kDense ? vector.size_ : vector.valid_.size();
+      if (vector.storage_size() != storage_size)
+        return false;
+    }
+    *this = std::move(vector);
+    return true;
+  }
+
+  // Builds the structures which |Get| and |GetNonNull| otherwise build lazily
+  // so that the vector can be read from several threads at once as long as it
+  // is not modified. |zone_map()| and |FindAll()| are always safe to call
+  // concurrently.
+  void PrepareForConcurrentReads() { valid_.PrepareForConcurrentReads(); }
+
+  // Returns the underlying storage of this NullableVector. For sparse
+  // vectors, this only contains the non-null values; for dense vectors, this
+  // contains a (default constructed) entry for each null value as well.
+  // Should not be called on encoded or packed vectors.
+  const std::vector<T>& non_null_vector() const {
+    PERFETTO_DCHECK(mode_ != Mode::kEncoded);
+    PERFETTO_DCHECK(!packed_);
+    return data_;
+  }
+
+  // Returns the entry at |idx| in the underlying storage of this vector (see
+  // |non_null_vector()|), decoding it if the vector is packed.
+  // Should not be called on encoded vectors.
+  T StorageAt(uint32_t idx) const {
+    PERFETTO_DCHECK(mode_ != Mode::kEncoded);
+    if (packed_) {
+      return FrameOfReference::FromOffset(bases_[idx / kPackBlockSize],
+                                          packed_data_.Get(idx));
+    }
+    return data_[idx];
+  }
+
+  // Writes the |count| entries starting at |start| in the underlying storage
+  // of this vector to |out|. This is more efficient than calling |StorageAt|
+  // for each entry when the vector is packed.
+  // Should not be called on encoded vectors.
+  void DecodeStorage(uint32_t start, uint32_t count, T* out) const {
+    PERFETTO_DCHECK(mode_ != Mode::kEncoded);
+    if (!packed_) {
+      std::copy(data_.data() + start, data_.data() + start + count, out);
+      return;
+    }
+
+    // Decode in chunks to keep the temporary buffer on the stack.
+    static constexpr uint32_t kChunkSize = 64;
+    uint32_t offsets[kChunkSize];
+    for (uint32_t i = 0; i < count; i += kChunkSize) {
+      uint32_t chunk = std::min(kChunkSize, count - i);
+      packed_data_.Decode(start + i, chunk, offsets);
+      for (uint32_t j = 0; j < chunk; ++j) {
+        out[i + j] = FrameOfReference::FromOffset(
+            bases_[(start + i + j) / kPackBlockSize], offsets[j]);
+      }
+    }
+  }
+
+  // Returns the per-block min/max summaries of this vector, building them
+  // first if they don't cover all the entries in the vector.
+  // Should only be called on vectors where every entry has a slot in
+  // |non_null_vector()| (i.e. dense vectors or sparse vectors without nulls).
+  // Entries which are null in dense vectors are treated as default
+  // constructed values.
+  const ZoneMap<T>& zone_map() const {
+    PERFETTO_DCHECK(mode_ != Mode::kEncoded);
+    PERFETTO_DCHECK(storage_size() == size_);
+    std::lock_guard<std::mutex> lock(LazyIndexMutex());
+    if (packed_) {
+      zone_map_.Extend(size_, [this](uint32_t idx) { return StorageAt(idx); });
+    } else {
+      zone_map_.Extend(data_.data(), size_);
+    }
+    return zone_map_;
+  }
+
+  // Returns the indices of all the entries equal to |val| in ascending order
+  // or nullptr if no entry is equal to |val|. Null entries are never
+  // returned.
+  //
+  // The first call to this method builds a hash index over the whole vector;
+  // subsequent calls only need to add the entries appended since the
+  // previous call.
+  const std::vector<uint32_t>* FindAll(T val) const {
+    std::lock_guard<std::mutex> lock(LazyIndexMutex());
+    for (; index_size_ < size_; ++index_size_) {
+      base::Optional<T> entry = Get(index_size_);
+      if (entry)
+        index_[*entry].push_back(index_size_);
+    }
+    auto it = index_.find(val);
+    return it == index_.end() ? nullptr : &it->second;
+  }
+
+  // Returns the code for |val| in the dictionary of this vector or
+  // base::nullopt if no entry has the value |val|.
+  // Should only be called on encoded vectors.
+  base::Optional<uint32_t> GetCode(T val) const {
+    PERFETTO_DCHECK(mode_ == Mode::kEncoded);
+    auto it = dictionary_index_.find(val);
+    if (it == dictionary_index_.end())
+      return base::nullopt;
+    return it->second;
+  }
+
+  // Returns the codes of every entry in this vector.
+  // Should only be called on encoded vectors.
+  const BitPackedVector& codes() const {
+    PERFETTO_DCHECK(mode_ == Mode::kEncoded);
+    return codes_;
+  }
+
+  // Returns the number of distinct values in this vector.
+  // Should only be called on encoded vectors.
+  uint32_t dictionary_size() const {
+    PERFETTO_DCHECK(mode_ == Mode::kEncoded);
+    return static_cast<uint32_t>(dictionary_.size());
+  }
+
  private:
+  using FrameOfReference = internal::FrameOfReference<T>;
+
+  // The minimum number of entries for packing to be considered.
+  static constexpr uint32_t kMinSizeToPack = 1024;
+
+  // The number of entries of the storage which share the same base when the
+  // vector is packed.
+  static constexpr uint32_t kPackBlockSize = 1024;
+
   NullableVector(Mode mode) : mode_(mode) {}
 
+  // Returns the number of entries in the underlying storage.
+  uint32_t storage_size() const {
+    return packed_ ? packed_data_.size() : static_cast<uint32_t>(data_.size());
+  }
+
+  // Guards |zone_map_| and |index_| of all the vectors: they are built by
+  // const methods which can be called by several threads querying the same
+  // table (see Config::metric_threads).
+  static std::mutex& LazyIndexMutex() {
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+  }
+
+  static uint32_t BlocksForSize(uint32_t size) {
+    return (size + kPackBlockSize - 1) / kPackBlockSize;
+  }
+
+  // Packs |data_| into |packed_data_| if doing so saves a significant amount
+  // of memory. Returns whether the vector was packed.
+  bool TryPack() {
+    PERFETTO_DCHECK(!packed_);
+    if (!FrameOfReference::kSupported || data_.size() < kMinSizeToPack)
+      return false;
+
+    // Every block is stored relative to its own minimum: this allows packing
+    // sorted data (e.g. timestamps) even when the whole range of the vector is
+    // too large.
+    uint32_t size = static_cast<uint32_t>(data_.size());
+    std::vector<T> bases;
+    bases.reserve(BlocksForSize(size));
+    uint32_t max_offset = 0;
+    for (uint32_t start = 0; start < size; start += kPackBlockSize) {
+      auto begin = data_.begin() + start;
+      auto end = begin + std::min(kPackBlockSize, size - start);
+      auto min_max = std::minmax_element(begin, end);
+      uint32_t offset;
+      if (!FrameOfReference::ToOffset(*min_max.first, *min_max.second,
+                                      &offset)) {
+        return false;
+      }
+      max_offset = std::max(max_offset, offset);
+      bases.push_back(*min_max.first);
+    }
+
+    // Only pack if we save at least a quarter of the memory: otherwise the
+    // cost of decoding on every access is not worth it.
+    uint32_t bits = BitPackedVector::BitWidth(max_offset);
+    if (bits * 4 > sizeof(T) * 8 * 3)
+      return false;
+
+    BitPackedVector packed_data;
+    packed_data.EnsureWidthFor(max_offset);
+    for (uint32_t i = 0; i < size; ++i) {
+      // Fails for doubles which are not integers.
+      uint32_t offset;
+      if (!FrameOfReference::ToOffset(bases[i / kPackBlockSize], data_[i],
+                                      &offset)) {
+        return false;
+      }
+      packed_data.Append(offset);
+    }
+    bases_ = std::move(bases);
+    packed_data_ = std::move(packed_data);
+    std::vector<T>().swap(data_);
+    packed_ = true;
+    return true;
+  }
+
+  // Stores |val| at the entry |idx| of |packed_data_|, appending it if |idx|
+  // is the size of |packed_data_|. Returns false if |val| can't be packed, in
+  // which case the vector should be unpacked.
+  bool TryStorePacked(uint32_t idx, T val) {
+    PERFETTO_DCHECK(packed_);
+    uint32_t block = idx / kPackBlockSize;
+    if (block == bases_.size())
+      bases_.push_back(val);
+
+    uint32_t offset;
+    if (!FrameOfReference::ToOffset(bases_[block], val, &offset)) {
+      if (!(val < bases_[block]) || !RebaseBlock(block, val))
+        return false;
+      offset = 0;
+    }
+    if (idx == packed_data_.size()) {
+      packed_data_.Append(offset);
+    } else {
+      packed_data_.Set(idx, offset);
+    }
+    return true;
+  }
+
+  // Lowers the base of |block| to |base| so that values smaller than its
+  // current base can be stored in it. Returns false if the entries of the
+  // block can't be represented relative to |base|.
+  bool RebaseBlock(uint32_t block, T base) {
+    uint32_t offset;
+    if (!FrameOfReference::ToOffset(base, base, &offset))
+      return false;
+
+    uint32_t start = block * kPackBlockSize;
+    uint32_t end = std::min(start + kPackBlockSize, packed_data_.size());
+    std::vector<uint32_t> offsets(end - start);
+    for (uint32_t i = start; i < end; ++i) {
+      T value =
+          FrameOfReference::FromOffset(bases_[block], packed_data_.Get(i));
+      if (!FrameOfReference::ToOffset(base, value, &offsets[i - start]))
+        return false;
+    }
+    for (uint32_t i = start; i < end; ++i) {
+      packed_data_.Set(i, offsets[i - start]);
+    }
+    bases_[block] = base;
+    return true;
+  }
+
+  // Decodes |packed_data_| back into |data_|.
+  void Unpack() {
+    PERFETTO_DCHECK(packed_);
+    data_.resize(packed_data_.size());
+    DecodeStorage(0, packed_data_.size(), data_.data());
+    packed_data_ = BitPackedVector();
+    std::vector<T>().swap(bases_);
+    packed_ = false;
+  }
+
+  uint32_t GetOrInsertCode(T val) {
+    auto it = dictionary_index_.find(val);
+    if (PERFETTO_LIKELY(it != dictionary_index_.end()))
+      return it->second;
+
+    uint32_t code = static_cast<uint32_t>(dictionary_.size());
+    dictionary_.emplace_back(val);
+    dictionary_index_.emplace(val, code);
+    return code;
+  }
+
   Mode mode_ = Mode::kSparse;
 
-  std::deque<T> data_;
+  std::vector<T> data_;
   RowMap valid_;
   uint32_t size_ = 0;
+
+  // Lazily built when |zone_map()| is called.
+  mutable ZoneMap<T> zone_map_;
+
+  // Lazily built when |FindAll()| is called. Covers the first |index_size_|
+  // entries.
+  mutable std::unordered_map<T, std::vector<uint32_t>> index_;
+  mutable uint32_t index_size_ = 0;
+
+  // Only used when |packed_| is true: entry i of the storage is stored as
+  // the offset of the value from |bases_[i / kPackBlockSize]| in
+  // |packed_data_|.
+  bool packed_ = false;
+  std::vector<T> bases_;
+  BitPackedVector packed_data_;
+
+  // Only used when |mode_| == Mode::kEncoded.
+  std::vector<T> dictionary_;
+  std::unordered_map<T, uint32_t> dictionary_index_;
+  BitPackedVector codes_;
 };
 
+template <typename T>
+constexpr uint32_t NullableVector<T>::kPackBlockSize;
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/containers/nullable_vector.h"
 
+#include <cmath>
+#include <limits>
+
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -98,6 +101,221 @@ TEST(NullableVector, Dense) {
   ASSERT_EQ(sv.GetNonNull(2), 2);
 }
 
+TEST(NullableVector, Encoded) {
+  auto sv = NullableVector<int64_t>::Encoded();
+
+  sv.Append(100);
+  sv.Append(200);
+  sv.Append(100);
+  sv.Append(300);
+
+  ASSERT_TRUE(sv.IsEncoded());
+  ASSERT_FALSE(sv.IsDense());
+  ASSERT_EQ(sv.size(), 4u);
+  ASSERT_EQ(sv.dictionary_size(), 3u);
+  ASSERT_EQ(sv.codes().bit_width(), 2u);
+
+  ASSERT_EQ(sv.Get(0), 100);
+  ASSERT_EQ(sv.Get(1), 200);
+  ASSERT_EQ(sv.Get(2), 100);
+  ASSERT_EQ(sv.GetNonNull(3), 300);
+
+  ASSERT_EQ(sv.GetCode(100), 0u);
+  ASSERT_EQ(sv.GetCode(300), 2u);
+  ASSERT_EQ(sv.GetCode(400), base::nullopt);
+  ASSERT_EQ(sv.codes().Get(2), 0u);
+
+  sv.Set(1, 100);
+  sv.Set(2, 400);
+  ASSERT_EQ(sv.Get(1), 100);
+  ASSERT_EQ(sv.Get(2), 400);
+  ASSERT_EQ(sv.GetCode(400), 3u);
+  ASSERT_EQ(sv.dictionary_size(), 4u);
+}
+
+TEST(NullableVector, FindAll) {
+  NullableVector<int64_t> sv;
+  sv.Append(10);
+  sv.AppendNull();
+  sv.Append(20);
+  sv.Append(10);
+
+  ASSERT_THAT(*sv.FindAll(10), testing::ElementsAre(0u, 3u));
+  ASSERT_THAT(*sv.FindAll(20), testing::ElementsAre(2u));
+  ASSERT_EQ(sv.FindAll(30), nullptr);
+
+  // Appended entries should be added to the index.
+  sv.Append(30);
+  sv.Append(10);
+  ASSERT_THAT(*sv.FindAll(10), testing::ElementsAre(0u, 3u, 5u));
+  ASSERT_THAT(*sv.FindAll(30), testing::ElementsAre(4u));
+
+  // Changed entries should be reflected in the index.
+  sv.Set(1, 20);
+  sv.Set(3, 30);
+  ASSERT_THAT(*sv.FindAll(10), testing::ElementsAre(0u, 5u));
+  ASSERT_THAT(*sv.FindAll(20), testing::ElementsAre(1u, 2u));
+  ASSERT_THAT(*sv.FindAll(30), testing::ElementsAre(3u, 4u));
+}
+
+TEST(NullableVector, PackSparse) {
+  NullableVector<int64_t> sv;
+  for (uint32_t i = 0; i < 2048; ++i) {
+    if (i % 3 == 0) {
+      sv.AppendNull();
+    } else {
+      sv.Append(1000000000ll + i);
+    }
+  }
+  sv.ShrinkToFit();
+  ASSERT_TRUE(sv.IsPacked());
+
+  for (uint32_t i = 0; i < 2048; ++i) {
+    if (i % 3 == 0) {
+      ASSERT_EQ(sv.Get(i), base::nullopt);
+    } else {
+      ASSERT_EQ(sv.Get(i), base::Optional<int64_t>(1000000000ll + i));
+    }
+  }
+
+  // Values which fit in the packed width should keep the vector packed.
+  sv.Append(1000000001);
+  sv.AppendNull();
+  sv.Set(1, 1000000002);
+  ASSERT_TRUE(sv.IsPacked());
+  ASSERT_EQ(sv.Get(2048), base::Optional<int64_t>(1000000001));
+  ASSERT_EQ(sv.Get(2049), base::nullopt);
+  ASSERT_EQ(sv.Get(1), base::Optional<int64_t>(1000000002));
+
+  // Values smaller than the base of their block should rebase the block if
+  // the other values of the block still fit.
+  sv.Append(-1);
+  ASSERT_TRUE(sv.IsPacked());
+  ASSERT_EQ(sv.Get(2050), base::Optional<int64_t>(-1));
+  ASSERT_EQ(sv.Get(2047), base::Optional<int64_t>(1000000000ll + 2047));
+
+  // Setting a null entry in a sparse vector (or values which don't fit)
+  // should unpack the vector.
+  sv.Set(3, 5);
+  ASSERT_FALSE(sv.IsPacked());
+  ASSERT_EQ(sv.Get(3), base::Optional<int64_t>(5));
+  ASSERT_EQ(sv.Get(2050), base::Optional<int64_t>(-1));
+  ASSERT_EQ(sv.Get(1), base::Optional<int64_t>(1000000002));
+
+  sv.ShrinkToFit();
+  ASSERT_TRUE(sv.IsPacked());
+  sv.Append(std::numeric_limits<int64_t>::max());
+  ASSERT_FALSE(sv.IsPacked());
+  ASSERT_EQ(sv.Get(2051),
+            base::Optional<int64_t>(std::numeric_limits<int64_t>::max()));
+  ASSERT_EQ(sv.Get(2050), base::Optional<int64_t>(-1));
+  ASSERT_EQ(sv.Get(6), base::nullopt);
+}
+
+TEST(NullableVector, PackDense) {
+  NullableVector<uint32_t> sv = NullableVector<uint32_t>::Dense();
+  for (uint32_t i = 0; i < 2048; ++i) {
+    sv.Append(i % 100);
+  }
+  sv.ShrinkToFit();
+  ASSERT_TRUE(sv.IsPacked());
+
+  std::vector<uint32_t> decoded(2048);
+  sv.DecodeStorage(0, 2048, decoded.data());
+  for (uint32_t i = 0; i < 2048; ++i) {
+    ASSERT_EQ(sv.GetNonNull(i), i % 100);
+    ASSERT_EQ(sv.StorageAt(i), i % 100);
+    ASSERT_EQ(decoded[i], i % 100);
+  }
+
+  sv.AppendNull();
+  sv.Set(7, 99);
+  ASSERT_TRUE(sv.IsPacked());
+  ASSERT_EQ(sv.Get(2048), base::nullopt);
+  ASSERT_EQ(sv.GetNonNull(7), 99u);
+
+  const auto& zone_map = sv.zone_map();
+  ASSERT_EQ(zone_map.min(0), 0u);
+  ASSERT_EQ(zone_map.max(0), 99u);
+
+  // Values which need a larger width should widen the packed storage.
+  sv.Set(8, 0xFFFFFFFF);
+  ASSERT_TRUE(sv.IsPacked());
+  ASSERT_EQ(sv.GetNonNull(8), 0xFFFFFFFFu);
+  ASSERT_EQ(sv.GetNonNull(9), 9u);
+  ASSERT_EQ(sv.Get(2048), base::nullopt);
+}
+
+TEST(NullableVector, NoPackWideRange) {
+  NullableVector<int64_t> sv;
+  for (uint32_t i = 0; i < 2048; ++i) {
+    sv.Append(static_cast<int64_t>(i) << 40);
+  }
+  sv.ShrinkToFit();
+  ASSERT_FALSE(sv.IsPacked());
+
+  NullableVector<double> dv;
+  for (uint32_t i = 0; i < 2048; ++i) {
+    dv.Append(i + 0.5);
+  }
+  dv.ShrinkToFit();
+  ASSERT_FALSE(dv.IsPacked());
+}
+
+TEST(NullableVector, PackSortedWideRange) {
+  // The whole range doesn't fit in 32 bits but the range of every block does.
+  NullableVector<int64_t> sv = NullableVector<int64_t>::Dense();
+  for (uint32_t i = 0; i < 8192; ++i) {
+    sv.Append(static_cast<int64_t>(i) * 1000000 + i % 7);
+  }
+  sv.ShrinkToFit();
+  ASSERT_TRUE(sv.IsPacked());
+
+  std::vector<int64_t> decoded(100);
+  sv.DecodeStorage(1000, 100, decoded.data());
+  for (uint32_t i = 0; i < 8192; ++i) {
+    ASSERT_EQ(sv.GetNonNull(i), static_cast<int64_t>(i) * 1000000 + i % 7);
+  }
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_EQ(decoded[i], static_cast<int64_t>(1000 + i) * 1000000 +
+                              (1000 + i) % 7);
+  }
+
+  // Later values start new blocks.
+  sv.Append(int64_t(8192) * 1000000);
+  sv.Append(int64_t(8193) * 1000000);
+  ASSERT_TRUE(sv.IsPacked());
+  ASSERT_EQ(sv.GetNonNull(8193), int64_t(8193) * 1000000);
+}
+
+TEST(NullableVector, PackIntegralDoubles) {
+  NullableVector<double> dv = NullableVector<double>::Dense();
+  for (uint32_t i = 0; i < 2048; ++i) {
+    dv.Append(1e12 + (i % 100) * 4096);
+  }
+  dv.ShrinkToFit();
+  ASSERT_TRUE(dv.IsPacked());
+  for (uint32_t i = 0; i < 2048; ++i) {
+    ASSERT_EQ(dv.GetNonNull(i), 1e12 + (i % 100) * 4096);
+  }
+
+  // Doubles which are not integers can't be packed.
+  dv.Append(0.5);
+  ASSERT_FALSE(dv.IsPacked());
+  ASSERT_EQ(dv.GetNonNull(2048), 0.5);
+  ASSERT_EQ(dv.GetNonNull(2047), 1e12 + (2047 % 100) * 4096);
+
+  NullableVector<double> zeros = NullableVector<double>::Dense();
+  for (uint32_t i = 0; i < 2048; ++i) {
+    zeros.Append(0.0);
+  }
+  zeros.ShrinkToFit();
+  ASSERT_TRUE(zeros.IsPacked());
+  zeros.Set(5, -0.0);
+  ASSERT_FALSE(zeros.IsPacked());
+  ASSERT_TRUE(std::signbit(zeros.GetNonNull(5)));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_REF_COUNTED_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_REF_COUNTED_H_
+
+#include <stdint.h>
+
+#include <utility>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+template <typename T>
+class RefPtr;
+
+// Base class for objects owned by RefPtr. The reference count is stored in the
+// object itself so, unlike std::shared_ptr, a RefPtr is the size of a single
+// pointer and doesn't need a separate control block.
+//
+// Like TraceBlobView, this is not thread safe: all the RefPtrs pointing to an
+// object must be used from the same thread.
+class RefCounted {
+ public:
+  RefCounted() = default;
+
+  RefCounted(const RefCounted&) = delete;
+  RefCounted& operator=(const RefCounted&) = delete;
+
+ protected:
+  ~RefCounted() { PERFETTO_DCHECK(refcount_ == 0); }
+
+ private:
+  template <typename T>
+  friend class RefPtr;
+
+  void AddRef() const { ++refcount_; }
+  bool Release() const {
+    PERFETTO_DCHECK(refcount_ > 0);
+    return --refcount_ == 0;
+  }
+
+  mutable uint32_t refcount_ = 0;
+};
+
+// An equivalent of std::shared_ptr for objects deriving from RefCounted. The
+// object is deleted once the last RefPtr pointing to it is destroyed.
+template <typename T>
+class RefPtr {
+ public:
+  RefPtr() = default;
+  explicit RefPtr(T* ptr) : ptr_(ptr) {
+    if (ptr_)
+      ptr_->AddRef();
+  }
+  ~RefPtr() { reset(); }
+
+  RefPtr(const RefPtr& other) : RefPtr(other.ptr_) {}
+  RefPtr& operator=(const RefPtr& other) {
+    reset(other.ptr_);
+    return *this;
+  }
+
+  RefPtr(RefPtr&& other) noexcept : ptr_(other.ptr_) { other.ptr_ = nullptr; }
+  RefPtr& operator=(RefPtr&& other) noexcept {
+    if (this != &other) {
+      reset();
+      ptr_ = other.ptr_;
+      other.ptr_ = nullptr;
+    }
+    return *this;
+  }
+
+  // Makes this point to |ptr|, releasing the object this pointed to before.
+  void reset(T* ptr = nullptr) {
+    // Take the new reference first in case |ptr| is the object this points to
+    // already.
+    if (ptr)
+      ptr->AddRef();
+    T* old = ptr_;
+    ptr_ = ptr;
+    if (old && old->Release())
+      delete old;
+  }
+
+  T* get() const { return ptr_; }
+  T* operator->() const { return ptr_; }
+  T& operator*() const { return *ptr_; }
+  explicit operator bool() const { return ptr_ != nullptr; }
+
+  bool operator==(const RefPtr& other) const { return ptr_ == other.ptr_; }
+  bool operator!=(const RefPtr& other) const { return ptr_ != other.ptr_; }
+
+ private:
+  T* ptr_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_REF_COUNTED_H_
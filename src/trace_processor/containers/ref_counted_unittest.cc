@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/ref_counted.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class Object : public RefCounted {
+ public:
+  explicit Object(int* destroyed_count) : destroyed_count_(destroyed_count) {}
+  ~Object() { ++*destroyed_count_; }
+
+ private:
+  int* destroyed_count_;
+};
+
+TEST(RefCountedTest, DeletedWithLastRef) {
+  int destroyed = 0;
+  RefPtr<Object> a(new Object(&destroyed));
+  {
+    RefPtr<Object> b = a;
+    RefPtr<Object> c(b);
+    ASSERT_EQ(a, c);
+  }
+  ASSERT_EQ(destroyed, 0);
+  a.reset();
+  ASSERT_EQ(destroyed, 1);
+  ASSERT_FALSE(a);
+}
+
+TEST(RefCountedTest, Move) {
+  int destroyed = 0;
+  RefPtr<Object> a(new Object(&destroyed));
+  Object* ptr = a.get();
+  RefPtr<Object> b(std::move(a));
+  ASSERT_FALSE(a);
+  ASSERT_EQ(b.get(), ptr);
+
+  RefPtr<Object> c;
+  c = std::move(b);
+  ASSERT_FALSE(b);
+  ASSERT_EQ(c.get(), ptr);
+  ASSERT_EQ(destroyed, 0);
+
+  c = RefPtr<Object>();
+  ASSERT_EQ(destroyed, 1);
+}
+
+TEST(RefCountedTest, Reassign) {
+  int destroyed = 0;
+  RefPtr<Object> a(new Object(&destroyed));
+  RefPtr<Object> b(new Object(&destroyed));
+
+  // Resetting a pointer to the object it points to must not delete it.
+  a.reset(a.get());
+  ASSERT_EQ(destroyed, 0);
+
+  a = b;
+  ASSERT_EQ(destroyed, 1);
+  ASSERT_EQ(a, b);
+  b.reset();
+  ASSERT_EQ(destroyed, 1);
+  a.reset();
+  ASSERT_EQ(destroyed, 2);
+}
+
+TEST(RefCountedTest, IsPointerSized) {
+  static_assert(sizeof(RefPtr<Object>) == sizeof(Object*),
+                "RefPtr should be the size of a pointer");
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/containers/row_map.h"
 
+#include "src/trace_processor/containers/snapshot.h"
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -168,6 +170,55 @@ RowMap RowMap::Copy() const {
   PERFETTO_FATAL("For GCC");
 }
 
+void RowMap::Serialize(SnapshotWriter* writer) const {
+  writer->Write(static_cast<uint32_t>(mode_));
+  writer->Write(static_cast<uint32_t>(optimize_for_));
+  switch (mode_) {
+    case Mode::kRange:
+      writer->Write(start_idx_);
+      writer->Write(end_idx_);
+      break;
+    case Mode::kBitVector:
+      bit_vector_.Serialize(writer);
+      break;
+    case Mode::kIndexVector:
+      writer->WriteVector(index_vector_);
+      break;
+  }
+}
+
+bool RowMap::Deserialize(SnapshotReader* reader) {
+  uint32_t mode;
+  uint32_t optimize_for;
+  if (!reader->Read(&mode) || !reader->Read(&optimize_for) ||
+      mode > static_cast<uint32_t>(Mode::kIndexVector) ||
+      optimize_for > static_cast<uint32_t>(OptimizeFor::kLookupSpeed)) {
+    return false;
+  }
+
+  RowMap rm;
+  rm.mode_ = static_cast<Mode>(mode);
+  rm.optimize_for_ = static_cast<OptimizeFor>(optimize_for);
+  switch (rm.mode_) {
+    case Mode::kRange:
+      if (!reader->Read(&rm.start_idx_) || !reader->Read(&rm.end_idx_) ||
+          rm.start_idx_ > rm.end_idx_) {
+        return false;
+      }
+      break;
+    case Mode::kBitVector:
+      if (!rm.bit_vector_.Deserialize(reader))
+        return false;
+      break;
+    case Mode::kIndexVector:
+      if (!reader->ReadVector(&rm.index_vector_))
+        return false;
+      break;
+  }
+  *this = std::move(rm);
+  return true;
+}
+
 RowMap RowMap::SelectRowsSlow(const RowMap& selector) const {
   // Pick the strategy based on the selector as there is more common code
   // between selectors of the same mode than between the RowMaps being
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -30,6 +31,9 @@
 namespace perfetto {
 namespace trace_processor {
 
+class SnapshotReader;
+class SnapshotWriter;
+
 // Stores a list of row indicies in a space efficient manner. One or more
 // columns can refer to the same RowMap. The RowMap defines the access pattern
 // to iterate on rows.
@@ -268,6 +272,42 @@ class RowMap {
     PERFETTO_FATAL("For GCC");
   }
 
+  // Writes the rows at the |count| indices starting at |start| to |out|.
+  // This is more efficient than calling |Get| for each index (especially for
+  // BitVector RowMaps where |Get| needs to search for the nth set bit).
+  void GetRows(uint32_t start, uint32_t count, uint32_t* out) const {
+    PERFETTO_DCHECK(start + count <= size());
+    switch (mode_) {
+      case Mode::kRange: {
+        for (uint32_t i = 0; i < count; ++i) {
+          out[i] = start_idx_ + start + i;
+        }
+        return;
+      }
+      case Mode::kBitVector: {
+        if (count == 0)
+          return;
+
+        // Only search for the first row: every following row is the next set
+        // bit after the previous one.
+        uint32_t row = bit_vector_.IndexOfNthSet(start);
+        out[0] = row;
+        for (uint32_t i = 1; i < count; ++i) {
+          while (!bit_vector_.IsSet(++row)) {
+          }
+          out[i] = row;
+        }
+        return;
+      }
+      case Mode::kIndexVector: {
+        std::copy(index_vector_.begin() + start,
+                  index_vector_.begin() + start + count, out);
+        return;
+      }
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
   // Returns whether the RowMap contains the given row.
   bool Contains(uint32_t row) const {
     switch (mode_) {
@@ -403,10 +443,48 @@ class RowMap {
       return;
     }
 
+    if (mode_ == Mode::kBitVector && other.mode_ == Mode::kRange) {
+      // If this RowMap is a BitVector and |other| is a range, we can clear
+      // all the bits outside the range a word at a time instead of checking
+      // every set bit (this is common after filters which use zone maps, see
+      // Column::FilterIntoNumericNonNullWithZoneMap).
+      bit_vector_.And(BitVector::Range(
+          other.start_idx_, other.end_idx_, [](uint32_t) { return true; },
+          [](uint32_t) { return ~static_cast<uint64_t>(0); }));
+      return;
+    }
+
     // TODO(lalitm): improve efficiency of this if we end up needing it.
     Filter([&other](uint32_t row) { return other.Contains(row); });
   }
 
+  // Intersects this RowMap with the indices in |indices| which should be
+  // sorted in ascending order and should not contain duplicates.
+  //
+  // This is more efficient than creating a RowMap from |indices| and calling
+  // |Intersect| as it avoids the linear scan of |indices| for every index in
+  // this RowMap.
+  void IntersectSorted(std::vector<uint32_t> indices) {
+    PERFETTO_DCHECK(std::is_sorted(indices.begin(), indices.end()));
+    if (mode_ == Mode::kIndexVector) {
+      Filter([&indices](uint32_t idx) {
+        return std::binary_search(indices.begin(), indices.end(), idx);
+      });
+      return;
+    }
+
+    // For range and BitVector modes, the indices are always sorted so the
+    // result is simply the indices in |indices| which are also in this
+    // RowMap.
+    auto it = std::remove_if(indices.begin(), indices.end(),
+                             [this](uint32_t idx) { return !Contains(idx); });
+    indices.erase(it, indices.end());
+
+    OptimizeFor optimize_for = optimize_for_;
+    *this = RowMap(std::move(indices));
+    optimize_for_ = optimize_for;
+  }
+
   // Filters the current RowMap into the RowMap given by |out| based on the
   // return value of |p(idx)|.
   //
@@ -472,6 +550,45 @@ class RowMap {
     }
   }
 
+  // Same as |FilterInto| above but also takes |wp|, a function which computes
+  // the result of |p| for 64 consecutive rows at once: |wp(row)| should return
+  // a uint64_t where bit i is set iff |p(row + i)| is true.
+  //
+  // |wp| is only used when |this| is a range (as this is the only case where
+  // the rows passed to |p| are guaranteed to be contiguous) and |out| is
+  // either a range or a BitVector; in all other cases, this function behaves
+  // exactly as |FilterInto| above.
+  template <typename Predicate, typename WordPredicate>
+  void FilterInto(RowMap* out, Predicate p, WordPredicate wp) const {
+    if (mode_ != Mode::kRange || out->mode_ == Mode::kIndexVector) {
+      FilterInto(out, p);
+      return;
+    }
+
+    PERFETTO_DCHECK(size() >= out->size());
+    if (out->empty())
+      return;
+
+    auto ip = [this, p](uint32_t idx) { return p(GetRange(idx)); };
+    auto iwp = [this, wp](uint32_t idx) { return wp(GetRange(idx)); };
+    if (out->mode_ == Mode::kRange) {
+      out->FilterRange(ip, iwp);
+      return;
+    }
+
+    // If |out| is a BitVector which is not too sparse, it's cheaper to
+    // evaluate the predicate for every row (as |wp| can compute many rows at
+    // once) and "and" the result with |out| than to only evaluate it for the
+    // rows set in |out|.
+    PERFETTO_DCHECK(out->mode_ == Mode::kBitVector);
+    uint32_t end = std::min(out->bit_vector_.size(), size());
+    if (out->size() < end / 8) {
+      out->Filter(ip);
+      return;
+    }
+    out->bit_vector_.And(BitVector::Range(0, end, ip, iwp));
+  }
+
   template <typename Comparator = bool(uint32_t, uint32_t)>
   void StableSort(std::vector<uint32_t>* out, Comparator c) const {
     switch (mode_) {
@@ -502,6 +619,39 @@ class RowMap {
   // Returns if the RowMap is internally represented using a range.
   bool IsRange() const { return mode_ == Mode::kRange; }
 
+  // Returns if the RowMap is internally represented using an index vector.
+  bool IsIndexVector() const { return mode_ == Mode::kIndexVector; }
+
+  // Returns the approximate number of bytes used to store the rows of this
+  // RowMap. Like |BitVector::ApproxBytesCost|, this should not be treated as
+  // exact.
+  size_t ApproxBytesUsed() const {
+    switch (mode_) {
+      case Mode::kRange:
+        return 0;
+      case Mode::kBitVector:
+        return BitVector::ApproxBytesCost(bit_vector_.size());
+      case Mode::kIndexVector:
+        return index_vector_.size() * sizeof(uint32_t);
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+  // Writes the contents of this RowMap to |writer|.
+  void Serialize(SnapshotWriter* writer) const;
+
+  // Replaces the contents of this RowMap with the ones written by
+  // |Serialize|. Returns false if |reader| doesn't contain a valid RowMap.
+  bool Deserialize(SnapshotReader* reader);
+
+  // Builds the structures which lookups otherwise build lazily (see
+  // |BitVector::PrepareForConcurrentReads|). After this, the RowMap can be
+  // read from several threads at once as long as it is not modified.
+  void PrepareForConcurrentReads() {
+    if (mode_ == Mode::kBitVector)
+      bit_vector_.PrepareForConcurrentReads();
+  }
+
  private:
   enum class Mode {
     kRange,
@@ -587,12 +737,34 @@ class RowMap {
 
   template <typename Predicate>
   void FilterRange(Predicate p) {
+    if (ShouldFilterRangeIntoIndexVector()) {
+      FilterRangeIntoIndexVector(p);
+      return;
+    }
+
+    // Otherwise, create a bitvector which spans the full range using
+    // |p| as the filler for the bits between start and end.
+    *this = RowMap(BitVector::Range(start_idx_, end_idx_, p));
+  }
+
+  // Same as |FilterRange| above but uses |wp| to fill the bits of the
+  // BitVector 64 at a time; see |FilterInto| for details.
+  template <typename Predicate, typename WordPredicate>
+  void FilterRange(Predicate p, WordPredicate wp) {
+    if (ShouldFilterRangeIntoIndexVector()) {
+      FilterRangeIntoIndexVector(p);
+      return;
+    }
+    *this = RowMap(BitVector::Range(start_idx_, end_idx_, p, wp));
+  }
+
+  bool ShouldFilterRangeIntoIndexVector() const {
+    PERFETTO_DCHECK(mode_ == Mode::kRange);
     uint32_t count = end_idx_ - start_idx_;
 
     // Optimization: if we are only going to scan a few rows, it's not
     // worth the haslle of working with a BitVector.
-    constexpr uint32_t kSmallRangeLimit = 2048;
-    bool is_small_range = count < kSmallRangeLimit;
+    bool is_small_range = count < kFilterSmallRangeLimit;
 
     // Optimization: weif the cost of a BitVector is more than the highest
     // possible cost an index vector could have, use the index vector.
@@ -602,36 +774,38 @@ class RowMap {
     // If either of the conditions hold which make it better to use an
     // index vector, use it instead. Alternatively, if we are optimizing for
     // lookup speed, we also want to use an index vector.
-    if (is_small_range || index_vector_cost_ub <= bit_vector_cost ||
-        optimize_for_ == OptimizeFor::kLookupSpeed) {
-      // Try and strike a good balance between not making the vector too
-      // big and good performance.
-      std::vector<uint32_t> iv(std::min(kSmallRangeLimit, count));
-
-      uint32_t out_idx = 0;
-      for (uint32_t i = 0; i < count; ++i) {
-        // If we reach the capacity add another small set of indices.
-        if (PERFETTO_UNLIKELY(out_idx == iv.size()))
-          iv.resize(iv.size() + kSmallRangeLimit);
-
-        // We keep this branch free by always writing the index but only
-        // incrementing the out index if the return value is true.
-        bool value = p(i + start_idx_);
-        iv[out_idx] = i + start_idx_;
-        out_idx += value;
-      }
+    return is_small_range || index_vector_cost_ub <= bit_vector_cost ||
+           optimize_for_ == OptimizeFor::kLookupSpeed;
+  }
 
-      // Make the vector the correct size and as small as possible.
-      iv.resize(out_idx);
-      iv.shrink_to_fit();
+  template <typename Predicate>
+  void FilterRangeIntoIndexVector(Predicate p) {
+    PERFETTO_DCHECK(mode_ == Mode::kRange);
+    uint32_t count = end_idx_ - start_idx_;
 
-      *this = RowMap(std::move(iv));
-      return;
+    // Try and strike a good balance between not making the vector too
+    // big and good performance.
+    constexpr uint32_t kSmallRangeLimit = kFilterSmallRangeLimit;
+    std::vector<uint32_t> iv(std::min(kSmallRangeLimit, count));
+
+    uint32_t out_idx = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      // If we reach the capacity add another small set of indices.
+      if (PERFETTO_UNLIKELY(out_idx == iv.size()))
+        iv.resize(iv.size() + kSmallRangeLimit);
+
+      // We keep this branch free by always writing the index but only
+      // incrementing the out index if the return value is true.
+      bool value = p(i + start_idx_);
+      iv[out_idx] = i + start_idx_;
+      out_idx += value;
     }
 
-    // Otherwise, create a bitvector which spans the full range using
-    // |p| as the filler for the bits between start and end.
-    *this = RowMap(BitVector::Range(start_idx_, end_idx_, p));
+    // Make the vector the correct size and as small as possible.
+    iv.resize(out_idx);
+    iv.shrink_to_fit();
+
+    *this = RowMap(std::move(iv));
   }
 
   void InsertIntoBitVector(uint32_t row) {
@@ -657,6 +831,10 @@ class RowMap {
 
   RowMap SelectRowsSlow(const RowMap& selector) const;
 
+  // Ranges smaller than this are always filtered into an index vector as it's
+  // not worth the hassle of working with a BitVector.
+  static constexpr uint32_t kFilterSmallRangeLimit = 2048;
+
   Mode mode_ = Mode::kRange;
 
   // Only valid when |mode_| == Mode::kRange.
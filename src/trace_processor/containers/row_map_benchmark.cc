@@ -25,6 +25,7 @@ namespace {
 
 static constexpr uint32_t kPoolSize = 100000;
 static constexpr uint32_t kSize = 123456;
+static constexpr uint32_t kLargeSize = 16 * 1024 * 1024;
 
 RowMap CreateRange(uint32_t end) {
   static constexpr uint32_t kRandomSeed = 32;
@@ -45,12 +46,12 @@ std::vector<uint32_t> CreateIndexVector(uint32_t size, uint32_t mod) {
   return rows;
 }
 
-BitVector CreateBitVector(uint32_t size) {
+BitVector CreateBitVector(uint32_t size, uint32_t set_percentage = 50) {
   static constexpr uint32_t kRandomSeed = 42;
   std::minstd_rand0 rnd_engine(kRandomSeed);
   BitVector bv;
   for (uint32_t i = 0; i < size; ++i) {
-    if (rnd_engine() % 2) {
+    if (rnd_engine() % 100 < set_percentage) {
       bv.AppendTrue();
     } else {
       bv.AppendFalse();
@@ -126,6 +127,16 @@ static void BM_RowMapBvGet(benchmark::State& state) {
 }
 BENCHMARK(BM_RowMapBvGet);
 
+static void BM_RowMapBvGetLarge(benchmark::State& state) {
+  BenchRowMapGet(state, RowMap(CreateBitVector(kLargeSize)));
+}
+BENCHMARK(BM_RowMapBvGetLarge);
+
+static void BM_RowMapBvGetLargeSparse(benchmark::State& state) {
+  BenchRowMapGet(state, RowMap(CreateBitVector(kLargeSize, 1)));
+}
+BENCHMARK(BM_RowMapBvGetLargeSparse);
+
 static void BM_RowMapIvGet(benchmark::State& state) {
   BenchRowMapGet(state, RowMap(CreateIndexVector(kSize, kSize)));
 }
@@ -153,6 +153,38 @@ TEST(RowMapUnittest, ContainsIndexVector) {
   ASSERT_FALSE(rm.Contains(6));
 }
 
+TEST(RowMapUnittest, GetRowsRange) {
+  RowMap rm(30, 47);
+  std::vector<uint32_t> rows(4);
+  rm.GetRows(5, 4, rows.data());
+  ASSERT_THAT(rows, testing::ElementsAre(35u, 36u, 37u, 38u));
+}
+
+TEST(RowMapUnittest, GetRowsBitVector) {
+  BitVector bv;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    if (i % 7 == 0 || i % 11 == 0) {
+      bv.AppendTrue();
+    } else {
+      bv.AppendFalse();
+    }
+  }
+  RowMap rm(std::move(bv));
+
+  std::vector<uint32_t> rows(rm.size() - 100);
+  rm.GetRows(100, static_cast<uint32_t>(rows.size()), rows.data());
+  for (uint32_t i = 0; i < rows.size(); ++i) {
+    ASSERT_EQ(rows[i], rm.Get(100 + i));
+  }
+}
+
+TEST(RowMapUnittest, GetRowsIndexVector) {
+  RowMap rm(std::vector<uint32_t>{32u, 56u, 24u, 0u, 100u, 1u});
+  std::vector<uint32_t> rows(3);
+  rm.GetRows(2, 3, rows.data());
+  ASSERT_THAT(rows, testing::ElementsAre(24u, 0u, 100u));
+}
+
 TEST(RowMapUnittest, SelectRangeWithRange) {
   RowMap rm(93, 157);
   RowMap picker(4, 7);
@@ -327,6 +359,53 @@ TEST(RowMapUnittest, IntersectSingleAbsent) {
   ASSERT_EQ(rm.size(), 0u);
 }
 
+TEST(RowMapUnittest, IntersectBitVectorWithRange) {
+  BitVector bv;
+  for (uint32_t i = 0; i < 2000; ++i) {
+    if (i % 3 == 0) {
+      bv.AppendTrue();
+    } else {
+      bv.AppendFalse();
+    }
+  }
+
+  RowMap rm(std::move(bv));
+  rm.Intersect(RowMap(100, 1500));
+
+  ASSERT_EQ(rm.size(), 466u);
+  ASSERT_EQ(rm.Get(0u), 102u);
+  ASSERT_EQ(rm.Get(465u), 1497u);
+}
+
+TEST(RowMapUnittest, IntersectSortedRange) {
+  RowMap rm(5, 20);
+  rm.IntersectSorted({1u, 5u, 7u, 19u, 20u});
+
+  ASSERT_EQ(rm.size(), 3u);
+  ASSERT_EQ(rm.Get(0u), 5u);
+  ASSERT_EQ(rm.Get(1u), 7u);
+  ASSERT_EQ(rm.Get(2u), 19u);
+}
+
+TEST(RowMapUnittest, IntersectSortedBitVector) {
+  RowMap rm(BitVector{true, false, true, true, false, true});
+  rm.IntersectSorted({1u, 2u, 5u, 8u});
+
+  ASSERT_EQ(rm.size(), 2u);
+  ASSERT_EQ(rm.Get(0u), 2u);
+  ASSERT_EQ(rm.Get(1u), 5u);
+}
+
+TEST(RowMapUnittest, IntersectSortedIndexVector) {
+  RowMap rm(std::vector<uint32_t>{3u, 2u, 0u, 1u, 1u, 3u});
+  rm.IntersectSorted({2u, 3u});
+
+  ASSERT_EQ(rm.size(), 3u);
+  ASSERT_EQ(rm.Get(0u), 3u);
+  ASSERT_EQ(rm.Get(1u), 2u);
+  ASSERT_EQ(rm.Get(2u), 3u);
+}
+
 TEST(RowMapUnittest, IntersectMany) {
   RowMap rm(std::vector<uint32_t>{3u, 2u, 0u, 1u, 1u, 3u});
   rm.Intersect(RowMap(BitVector{false, false, true, true}));
@@ -398,6 +477,71 @@ TEST(RowMapUnittest, FilterIntoLargeRangeWithRange) {
   }
 }
 
+TEST(RowMapUnittest, FilterIntoLargeRangeWithRangeWordPredicate) {
+  RowMap rm(10, 100010);
+  RowMap filter(5, 100000);
+  auto p = [](uint32_t row) { return row % 2 == 0; };
+  auto wp = [](uint32_t row) {
+    // Words starting at an even row have bits 0, 2, 4... set while words
+    // starting at an odd row have bits 1, 3, 5... set.
+    return row % 2 == 0 ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull;
+  };
+  rm.FilterInto(&filter, p, wp);
+
+  ASSERT_EQ(filter.size(), (100000u - 5u) / 2u);
+  for (uint32_t i = 0; i < filter.size(); ++i) {
+    ASSERT_EQ(filter.Get(i), 6u + i * 2);
+  }
+}
+
+TEST(RowMapUnittest, FilterIntoRangeWithBitVectorWordPredicate) {
+  RowMap rm(7, 10007);
+
+  BitVector bv;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    if (i % 3 != 0) {
+      bv.AppendTrue();
+    } else {
+      bv.AppendFalse();
+    }
+  }
+  RowMap filter(std::move(bv));
+
+  auto p = [](uint32_t row) { return row % 2 == 0; };
+  auto wp = [&p](uint32_t row) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < 64; ++i)
+      word |= static_cast<uint64_t>(p(row + i)) << i;
+    return word;
+  };
+  rm.FilterInto(&filter, p, wp);
+
+  // Rows are offset by 7 so only odd indices are retained.
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    if (i % 3 != 0 && i % 2 == 1) {
+      ASSERT_EQ(filter.Get(count++), i);
+    }
+  }
+  ASSERT_EQ(filter.size(), count);
+}
+
+TEST(RowMapUnittest, FilterIntoBitVectorWithRangeWordPredicate) {
+  RowMap rm(
+      BitVector{true, false, false, true, false, true, false, true, true});
+  RowMap filter(1u, 5u);
+  rm.FilterInto(
+      &filter, [](uint32_t row) { return row == 3u || row == 7u; },
+      [](uint32_t) -> uint64_t {
+        ADD_FAILURE() << "Word predicate should not be called";
+        return 0;
+      });
+
+  ASSERT_EQ(filter.size(), 2u);
+  ASSERT_EQ(filter.Get(0u), 1u);
+  ASSERT_EQ(filter.Get(1u), 3u);
+}
+
 TEST(RowMapUnittest, FilterIntoBitVectorWithRange) {
   RowMap rm(
       BitVector{true, false, false, true, false, true, false, true, true});
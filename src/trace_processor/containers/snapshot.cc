@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/snapshot.h"
+
+#include <errno.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Writes are buffered up to this size; arrays larger than this are written
+// directly to the file to avoid copying them into the buffer.
+constexpr size_t kBufferSize = 1024 * 1024;
+
+}  // namespace
+
+// static
+constexpr size_t SnapshotWriter::kAlignment;
+
+SnapshotWriter::SnapshotWriter(int fd) : fd_(fd) {
+  buffer_.reserve(kBufferSize);
+}
+
+SnapshotWriter::~SnapshotWriter() = default;
+
+void SnapshotWriter::WriteRaw(const void* data, size_t size) {
+  buffer_.append(static_cast<const char*>(data), size);
+  offset_ += size;
+  if (buffer_.size() >= kBufferSize)
+    Flush();
+}
+
+void SnapshotWriter::WritePadding() {
+  static const char kZeros[kAlignment] = {};
+  size_t misalignment = static_cast<size_t>(offset_ % kAlignment);
+  if (misalignment != 0)
+    WriteRaw(kZeros, kAlignment - misalignment);
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+  Write(static_cast<uint64_t>(size));
+  WritePadding();
+  if (size < kBufferSize) {
+    WriteRaw(data, size);
+  } else {
+    Flush();
+    if (error_ == 0 && base::WriteAll(fd_, data, size) < 0)
+      error_ = errno;
+    offset_ += size;
+  }
+  WritePadding();
+}
+
+void SnapshotWriter::Flush() {
+  if (error_ == 0 && !buffer_.empty() &&
+      base::WriteAll(fd_, buffer_.data(), buffer_.size()) < 0) {
+    error_ = errno;
+  }
+  buffer_.clear();
+}
+
+bool SnapshotWriter::Finish() {
+  Flush();
+  errno = error_;
+  return error_ == 0;
+}
+
+SnapshotReader::SnapshotReader(const uint8_t* data, size_t size)
+    : start_(data), ptr_(data), end_(data + size) {
+  PERFETTO_DCHECK(reinterpret_cast<uintptr_t>(data) %
+                      SnapshotWriter::kAlignment ==
+                  0);
+}
+
+SnapshotReader::~SnapshotReader() = default;
+
+bool SnapshotReader::ReadBytes(const uint8_t** data, size_t* size) {
+  uint64_t array_size;
+  if (!Read(&array_size))
+    return false;
+
+  // Arrays start and end at aligned offsets from the start of the snapshot.
+  static constexpr size_t kMask = SnapshotWriter::kAlignment - 1;
+  size_t offset = static_cast<size_t>(ptr_ - start_);
+  size_t begin = (offset + kMask) & ~kMask;
+  size_t available = static_cast<size_t>(end_ - start_);
+  if (begin > available || array_size > available - begin)
+    return false;
+  size_t end = (begin + static_cast<size_t>(array_size) + kMask) & ~kMask;
+  if (end > available)
+    return false;
+
+  *data = start_ + begin;
+  *size = static_cast<size_t>(array_size);
+  ptr_ = start_ + end;
+  return true;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
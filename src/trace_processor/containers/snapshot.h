@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_SNAPSHOT_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "perfetto/ext/base/string_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Writes the binary format used by snapshots of the tables of a trace (see
+// TraceProcessor::SaveSnapshot) to a file.
+//
+// The format is a flat sequence of values written in the native byte order
+// with no framing: the reader needs to read back exactly the same sequence of
+// values. Arrays (e.g. the storage of a column) are written as their size in
+// bytes followed by their contents, aligned to |kAlignment| bytes from the
+// start of the file: when the file is memory mapped, they can be read in
+// place or copied with a single memcpy.
+class SnapshotWriter {
+ public:
+  static constexpr size_t kAlignment = 8;
+
+  // |fd| is not owned and should outlive the writer.
+  explicit SnapshotWriter(int fd);
+  ~SnapshotWriter();
+
+  // Writes a trivially copyable value.
+  template <typename T>
+  void Write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be written");
+    WriteRaw(&value, sizeof(T));
+  }
+
+  // Writes the |count| values in |data| as an array.
+  template <typename T>
+  void WriteArray(const T* data, size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only arrays of trivially copyable values can be written");
+    static_assert(alignof(T) <= kAlignment, "Array is overaligned");
+    WriteBytes(data, count * sizeof(T));
+  }
+
+  template <typename T>
+  void WriteVector(const std::vector<T>& vector) {
+    WriteArray(vector.data(), vector.size());
+  }
+
+  void WriteString(base::StringView str) { WriteBytes(str.data(), str.size()); }
+
+  // Writes |size| bytes from |data| as an array.
+  void WriteBytes(const void* data, size_t size);
+
+  // Writes any buffered data to the file. Returns false if writing any of the
+  // data failed (in which case errno is set).
+  bool Finish();
+
+  // Returns the number of bytes written so far.
+  uint64_t offset() const { return offset_; }
+
+ private:
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+  void WriteRaw(const void* data, size_t size);
+  void WritePadding();
+  void Flush();
+
+  int fd_ = -1;
+  std::string buffer_;
+  uint64_t offset_ = 0;
+  int error_ = 0;
+};
+
+// Reads back the values written by a SnapshotWriter from a buffer (usually a
+// memory mapping of the snapshot file), checking that every read is inside
+// the buffer.
+//
+// All the read methods return false if the buffer doesn't contain the value
+// (i.e. the snapshot is truncated or corrupted); the reader should not be used
+// further in that case.
+class SnapshotReader {
+ public:
+  // |data| should be aligned to SnapshotWriter::kAlignment bytes (which is
+  // always the case for memory mappings) and outlive the reader.
+  SnapshotReader(const uint8_t* data, size_t size);
+  ~SnapshotReader();
+
+  template <typename T>
+  bool Read(T* value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be read");
+    if (static_cast<size_t>(end_ - ptr_) < sizeof(T))
+      return false;
+    memcpy(value, ptr_, sizeof(T));
+    ptr_ += sizeof(T);
+    return true;
+  }
+
+  // Returns a pointer to the array of |*size| bytes at the current position.
+  // The pointer is aligned to SnapshotWriter::kAlignment bytes and points
+  // inside the buffer passed to the constructor.
+  bool ReadBytes(const uint8_t** data, size_t* size);
+
+  template <typename T>
+  bool ReadVector(std::vector<T>* vector) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only arrays of trivially copyable values can be read");
+    static_assert(alignof(T) <= SnapshotWriter::kAlignment,
+                  "Array is overaligned");
+    const uint8_t* data;
+    size_t size;
+    if (!ReadBytes(&data, &size) || size % sizeof(T) != 0)
+      return false;
+    const T* begin = reinterpret_cast<const T*>(data);
+    vector->assign(begin, begin + size / sizeof(T));
+    return true;
+  }
+
+  bool ReadString(std::string* str) {
+    const uint8_t* data;
+    size_t size;
+    if (!ReadBytes(&data, &size))
+      return false;
+    str->assign(reinterpret_cast<const char*>(data), size);
+    return true;
+  }
+
+  // Returns the number of bytes left to read.
+  size_t remaining() const { return static_cast<size_t>(end_ - ptr_); }
+
+ private:
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+  const uint8_t* const start_;
+  const uint8_t* ptr_;
+  const uint8_t* const end_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_SNAPSHOT_H_
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/snapshot.h"
+
+#include <functional>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/nullable_vector.h"
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Returns the contents of a file written by |fn|.
+std::string WriteSnapshot(std::function<void(SnapshotWriter*)> fn) {
+  base::TempFile file = base::TempFile::Create();
+  SnapshotWriter writer(file.fd());
+  fn(&writer);
+  PERFETTO_CHECK(writer.Finish());
+
+  std::string contents;
+  PERFETTO_CHECK(base::ReadFile(file.path(), &contents));
+  return contents;
+}
+
+const uint8_t* Data(const std::string& contents) {
+  return reinterpret_cast<const uint8_t*>(contents.data());
+}
+
+TEST(SnapshotUnittest, ValuesAndArrays) {
+  std::vector<int64_t> ints(100000);
+  for (size_t i = 0; i < ints.size(); ++i)
+    ints[i] = static_cast<int64_t>(i * i);
+
+  std::string contents = WriteSnapshot([&ints](SnapshotWriter* writer) {
+    writer->Write(static_cast<uint8_t>(1));
+    writer->WriteVector(ints);
+    writer->WriteString("foo");
+    writer->Write(static_cast<uint32_t>(42));
+    writer->WriteVector(std::vector<uint32_t>());
+  });
+  ASSERT_EQ(contents.size() % SnapshotWriter::kAlignment, 0u);
+
+  SnapshotReader reader(Data(contents), contents.size());
+  uint8_t byte;
+  ASSERT_TRUE(reader.Read(&byte));
+  ASSERT_EQ(byte, 1u);
+
+  const uint8_t* data;
+  size_t size;
+  ASSERT_TRUE(reader.ReadBytes(&data, &size));
+  ASSERT_EQ(size, ints.size() * sizeof(int64_t));
+  ASSERT_EQ((data - Data(contents)) % SnapshotWriter::kAlignment, 0);
+  ASSERT_EQ(memcmp(data, ints.data(), size), 0);
+
+  std::string str;
+  ASSERT_TRUE(reader.ReadString(&str));
+  ASSERT_EQ(str, "foo");
+
+  uint32_t value;
+  ASSERT_TRUE(reader.Read(&value));
+  ASSERT_EQ(value, 42u);
+
+  std::vector<uint32_t> empty{1, 2};
+  ASSERT_TRUE(reader.ReadVector(&empty));
+  ASSERT_TRUE(empty.empty());
+  ASSERT_EQ(reader.remaining(), 0u);
+}
+
+TEST(SnapshotUnittest, TruncatedArray) {
+  std::string contents = WriteSnapshot([](SnapshotWriter* writer) {
+    writer->WriteVector(std::vector<uint64_t>(16, 1));
+  });
+
+  SnapshotReader reader(Data(contents), contents.size() - 8);
+  std::vector<uint64_t> vector;
+  ASSERT_FALSE(reader.ReadVector(&vector));
+}
+
+TEST(SnapshotUnittest, RowMap) {
+  BitVector bv;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    if (i % 3 == 0) {
+      bv.AppendTrue();
+    } else {
+      bv.AppendFalse();
+    }
+  }
+
+  std::string contents = WriteSnapshot([&bv](SnapshotWriter* writer) {
+    RowMap(10, 20).Serialize(writer);
+    RowMap(bv.Copy()).Serialize(writer);
+    RowMap(std::vector<uint32_t>{5, 1, 3}).Serialize(writer);
+  });
+
+  SnapshotReader reader(Data(contents), contents.size());
+  RowMap range;
+  ASSERT_TRUE(range.Deserialize(&reader));
+  ASSERT_EQ(range.size(), 10u);
+  ASSERT_EQ(range.Get(0), 10u);
+
+  RowMap bit_vector;
+  ASSERT_TRUE(bit_vector.Deserialize(&reader));
+  ASSERT_EQ(bit_vector.size(), bv.GetNumBitsSet());
+  for (uint32_t i = 0; i < bit_vector.size(); ++i)
+    ASSERT_EQ(bit_vector.Get(i), i * 3);
+
+  RowMap index_vector;
+  ASSERT_TRUE(index_vector.Deserialize(&reader));
+  ASSERT_EQ(index_vector.size(), 3u);
+  ASSERT_EQ(index_vector.Get(0), 5u);
+  ASSERT_EQ(index_vector.Get(2), 3u);
+  ASSERT_EQ(reader.remaining(), 0u);
+}
+
+TEST(SnapshotUnittest, NullableVector) {
+  NullableVector<int64_t> sparse = NullableVector<int64_t>::Sparse();
+  NullableVector<int64_t> packed = NullableVector<int64_t>::Dense();
+  NullableVector<uint32_t> encoded = NullableVector<uint32_t>::Encoded();
+  for (uint32_t i = 0; i < 2000; ++i) {
+    if (i % 7 == 0) {
+      sparse.AppendNull();
+      packed.AppendNull();
+    } else {
+      sparse.Append(static_cast<int64_t>(i) << 40);
+      packed.Append(1000000000ll + i);
+    }
+    encoded.Append(i % 4);
+  }
+  packed.ShrinkToFit();
+  ASSERT_TRUE(packed.IsPacked());
+
+  std::string contents = WriteSnapshot([&](SnapshotWriter* writer) {
+    sparse.Serialize(writer);
+    packed.Serialize(writer);
+    encoded.Serialize(writer);
+  });
+
+  SnapshotReader reader(Data(contents), contents.size());
+  NullableVector<int64_t> new_sparse = NullableVector<int64_t>::Sparse();
+  NullableVector<int64_t> new_packed = NullableVector<int64_t>::Dense();
+  NullableVector<uint32_t> new_encoded = NullableVector<uint32_t>::Encoded();
+  ASSERT_TRUE(new_sparse.Deserialize(&reader));
+  ASSERT_TRUE(new_packed.Deserialize(&reader));
+  ASSERT_TRUE(new_encoded.Deserialize(&reader));
+  ASSERT_EQ(reader.remaining(), 0u);
+
+  ASSERT_TRUE(new_packed.IsPacked());
+  ASSERT_EQ(new_encoded.dictionary_size(), 4u);
+  ASSERT_EQ(new_encoded.GetCode(3), encoded.GetCode(3));
+  for (uint32_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(new_sparse.Get(i), sparse.Get(i));
+    ASSERT_EQ(new_packed.Get(i), packed.Get(i));
+    ASSERT_EQ(new_encoded.Get(i), encoded.Get(i));
+  }
+
+  // Vectors can be appended to after being deserialized.
+  new_packed.Append(int64_t(-1));
+  ASSERT_EQ(new_packed.Get(2000), -1);
+}
+
+TEST(SnapshotUnittest, NullableVectorModeMismatch) {
+  NullableVector<int64_t> sparse = NullableVector<int64_t>::Sparse();
+  sparse.Append(int64_t(1));
+  std::string contents = WriteSnapshot(
+      [&sparse](SnapshotWriter* writer) { sparse.Serialize(writer); });
+
+  SnapshotReader reader(Data(contents), contents.size());
+  NullableVector<int64_t> dense = NullableVector<int64_t>::Dense();
+  ASSERT_FALSE(dense.Deserialize(&reader));
+}
+
+TEST(SnapshotUnittest, StringPool) {
+  StringPool pool;
+  std::vector<StringPool::Id> ids;
+  for (uint32_t i = 0; i < 10000; ++i)
+    ids.push_back(pool.InternString(base::StringView(std::to_string(i))));
+  std::string large(5 * 1024 * 1024, 'x');
+  StringPool::Id large_id = pool.InternString(base::StringView(large));
+
+  std::string contents = WriteSnapshot(
+      [&pool](SnapshotWriter* writer) { pool.Serialize(writer); });
+
+  StringPool new_pool;
+  SnapshotReader reader(Data(contents), contents.size());
+  ASSERT_TRUE(new_pool.Deserialize(&reader));
+  ASSERT_EQ(reader.remaining(), 0u);
+  ASSERT_EQ(new_pool.size(), pool.size());
+  for (uint32_t i = 0; i < ids.size(); ++i) {
+    ASSERT_EQ(new_pool.Get(ids[i]).ToStdString(), std::to_string(i));
+    ASSERT_EQ(new_pool.GetId(base::StringView(std::to_string(i))), ids[i]);
+  }
+  ASSERT_EQ(new_pool.Get(large_id).size(), large.size());
+
+  // Interning a string which is already present returns the same Id.
+  ASSERT_EQ(new_pool.InternString("42"), ids[42]);
+  StringPool::Id new_id = new_pool.InternString("new");
+  ASSERT_EQ(new_pool.Get(new_id).ToStdString(), "new");
+}
+
+TEST(SnapshotUnittest, StringPoolWithDifferentIds) {
+  StringPool pool;
+  pool.InternString("foo");
+  std::string contents = WriteSnapshot(
+      [&pool](SnapshotWriter* writer) { pool.Serialize(writer); });
+
+  // "bar" doesn't have the same Id in the serialized pool so loading it
+  // would invalidate the Id.
+  StringPool new_pool;
+  StringPool::Id id = new_pool.InternString("bar");
+  SnapshotReader reader(Data(contents), contents.size());
+  ASSERT_FALSE(new_pool.Deserialize(&reader));
+  ASSERT_EQ(new_pool.Get(id).ToStdString(), "bar");
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
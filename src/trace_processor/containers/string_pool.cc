@@ -20,6 +20,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
+#include "src/trace_processor/containers/snapshot.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -38,13 +39,22 @@ constexpr size_t StringPool::kBlockIndexBitMask;
 constexpr size_t StringPool::kBlockSizeBytes;
 // static
 constexpr size_t StringPool::kMinLargeStringSizeBytes;
+// static
+constexpr uint32_t StringPool::kNumThreadSafeShards;
 
-StringPool::StringPool() {
+StringPool::StringPool(Mode mode)
+    : mode_(mode), storage_mutex_(new std::mutex()) {
   static_assert(
       StringPool::kMinLargeStringSizeBytes <= StringPool::kBlockSizeBytes + 1,
       "minimum size of large strings must be small enough to support any "
       "string that doesn't fit in a Block.");
 
+  const uint32_t num_shards =
+      mode == Mode::kThreadSafe ? kNumThreadSafeShards : 1;
+  shards_.reset(new Shard[num_shards]);
+  shard_mask_ = num_shards - 1;
+
+  blocks_.reserve(1u << kNumBlockIndexBits);
   blocks_.emplace_back(kBlockSizeBytes);
 
   // Reserve a slot for the null string.
@@ -56,7 +66,9 @@ StringPool::~StringPool() = default;
 StringPool::StringPool(StringPool&&) = default;
 StringPool& StringPool::operator=(StringPool&&) = default;
 
-StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
+StringPool::Id StringPool::InsertString(base::StringView str) {
+  auto lock = MaybeLock(storage_mutex_.get());
+
   // Try and find enough space in the current block for the string and the
   // metadata (varint-encoded size + the string data + the null terminator).
   bool success;
@@ -69,8 +81,11 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
     // support strings that wouldn't fit into a single block. Otherwise, add a
     // new block to store the string.
     if (str.size() + kMaxMetadataSize >= kMinLargeStringSizeBytes) {
-      return InsertLargeString(str, hash);
+      return InsertLargeString(str);
     } else {
+      // Adding a block past the reserved capacity would reallocate |blocks_|
+      // (and the Id couldn't encode the block index anyway).
+      PERFETTO_CHECK(blocks_.size() < blocks_.capacity());
       blocks_.emplace_back(kBlockSizeBytes);
     }
 
@@ -79,20 +94,159 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
     PERFETTO_CHECK(success);
   }
 
-  // Compute the id from the block index and offset and add a mapping from the
-  // hash to the id.
-  Id string_id = Id::BlockString(blocks_.size() - 1, offset);
-  string_index_.emplace(hash, string_id);
-  return string_id;
+  // Compute the id from the block index and offset.
+  return Id::BlockString(blocks_.size() - 1, offset);
 }
 
-StringPool::Id StringPool::InsertLargeString(base::StringView str,
-                                             uint64_t hash) {
+StringPool::Id StringPool::InsertLargeString(base::StringView str) {
   large_strings_.emplace_back(new std::string(str.begin(), str.size()));
-  // Compute id from the index and add a mapping from the hash to the id.
-  Id string_id = Id::LargeString(large_strings_.size() - 1);
-  string_index_.emplace(hash, string_id);
-  return string_id;
+  // Compute id from the index.
+  return Id::LargeString(large_strings_.size() - 1);
+}
+
+void StringPool::Serialize(SnapshotWriter* writer) const {
+  writer->Write(static_cast<uint32_t>(blocks_.size()));
+  for (const Block& block : blocks_) {
+    writer->WriteBytes(block.Get(0), block.pos());
+  }
+  writer->Write(static_cast<uint32_t>(large_strings_.size()));
+  for (const auto& str : large_strings_) {
+    writer->WriteString(base::StringView(*str));
+  }
+  writer->Write(shard_mask_ + 1);
+  for (uint32_t i = 0; i <= shard_mask_; ++i) {
+    shards_[i].index.Serialize(writer);
+  }
+}
+
+bool StringPool::Deserialize(SnapshotReader* reader) {
+  uint32_t num_blocks;
+  if (!reader->Read(&num_blocks) || num_blocks == 0 ||
+      num_blocks > (1u << kNumBlockIndexBits)) {
+    return false;
+  }
+  std::vector<Block> blocks;
+  blocks.reserve(1u << kNumBlockIndexBits);
+  for (uint32_t i = 0; i < num_blocks; ++i) {
+    const uint8_t* data;
+    size_t size;
+    if (!reader->ReadBytes(&data, &size) || size > kBlockSizeBytes)
+      return false;
+    blocks.emplace_back(kBlockSizeBytes);
+    blocks.back().Restore(data, static_cast<uint32_t>(size));
+  }
+
+  uint32_t num_large_strings;
+  if (!reader->Read(&num_large_strings))
+    return false;
+  std::vector<std::unique_ptr<std::string>> large_strings;
+  for (uint32_t i = 0; i < num_large_strings; ++i) {
+    std::unique_ptr<std::string> str(new std::string());
+    if (!reader->ReadString(str.get()))
+      return false;
+    large_strings.emplace_back(std::move(str));
+  }
+
+  // The index is split by the low bits of the hashes so it can only be
+  // restored as is if the pools have the same number of shards.
+  uint32_t num_shards;
+  if (!reader->Read(&num_shards) || num_shards != shard_mask_ + 1)
+    return false;
+  std::unique_ptr<Shard[]> shards(new Shard[num_shards]);
+  for (uint32_t i = 0; i < num_shards; ++i) {
+    if (!shards[i].index.Deserialize(reader, blocks, large_strings.size()))
+      return false;
+  }
+
+  // Ids already handed out by this pool (e.g. interned by importers when
+  // they are created) must remain valid: all the strings in this pool should
+  // have the same Id in the serialized pool.
+  for (auto it = CreateIterator(); it; ++it) {
+    NullTermStringView str = it.StringView();
+    if (str.data() == nullptr)
+      continue;
+    StringHash hash = str.Hash();
+    const Id* id = shards[static_cast<uint32_t>(hash) & shard_mask_].index.Find(
+        hash);
+    if (!id || *id != it.StringId())
+      return false;
+  }
+
+  blocks_ = std::move(blocks);
+  large_strings_ = std::move(large_strings);
+  shards_ = std::move(shards);
+  return true;
+}
+
+StringPool::StringIndex::StringIndex() {
+  // Start with enough slots for a typical small trace; this gets doubled as
+  // more strings are interned.
+  static constexpr uint32_t kInitialShift = 64 - 12;
+  slots_.resize(1u << (64 - kInitialShift), Slot{0, Id::Null(), 0});
+  mask_ = slots_.size() - 1;
+  shift_ = kInitialShift;
+}
+
+void StringPool::StringIndex::Grow() {
+  std::vector<Slot> old_slots(slots_.size() * 2, Slot{0, Id::Null(), 0});
+  old_slots.swap(slots_);
+  mask_ = slots_.size() - 1;
+  shift_--;
+  for (const Slot& slot : old_slots) {
+    if (!slot.id.is_null())
+      InsertUnchecked(slot.hash, slot.id);
+  }
+}
+
+void StringPool::StringIndex::Serialize(SnapshotWriter* writer) const {
+  writer->Write(shift_);
+  writer->Write(static_cast<uint64_t>(size_));
+  writer->WriteVector(slots_);
+}
+
+bool StringPool::StringIndex::Deserialize(SnapshotReader* reader,
+                                          const std::vector<Block>& blocks,
+                                          size_t num_large_strings) {
+  uint32_t shift;
+  uint64_t size;
+  std::vector<Slot> slots;
+  if (!reader->Read(&shift) || !reader->Read(&size) ||
+      !reader->ReadVector(&slots) || shift == 0 || shift >= 64 ||
+      slots.size() != (1ull << (64 - shift))) {
+    return false;
+  }
+
+  // Check every entry: lookups would read out of bounds if an Id is invalid
+  // and never terminate if there was no empty slot.
+  uint64_t count = 0;
+  for (const Slot& slot : slots) {
+    if (slot.id.is_null())
+      continue;
+    count++;
+    if (slot.id.is_large_string()) {
+      if (slot.id.large_string_index() >= num_large_strings)
+        return false;
+    } else if (slot.id.block_index() >= blocks.size() ||
+               slot.id.block_offset() >= blocks[slot.id.block_index()].pos()) {
+      return false;
+    }
+  }
+  if (count != size || count >= slots.size())
+    return false;
+
+  slots_ = std::move(slots);
+  mask_ = slots_.size() - 1;
+  shift_ = shift;
+  size_ = static_cast<size_t>(size);
+  return true;
+}
+
+void StringPool::Block::Restore(const uint8_t* data, uint32_t size) {
+  PERFETTO_DCHECK(size <= size_);
+  mem_.EnsureCommitted(size);
+  if (size > 0)
+    memcpy(Get(0), data, size);
+  pos_ = size;
 }
 
 std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
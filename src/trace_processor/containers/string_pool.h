@@ -20,7 +20,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <functional>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -32,10 +35,27 @@
 namespace perfetto {
 namespace trace_processor {
 
+class SnapshotReader;
+class SnapshotWriter;
+
 // Interns strings in a string pool and hands out compact StringIds which can
 // be used to retrieve the string in O(1).
+//
+// By default, a StringPool can only be used from a single thread. When created
+// with |Mode::kThreadSafe|, InternString, GetId, Get and size can be called
+// concurrently from multiple threads: the index is split into shards (by
+// string hash) each protected by its own lock so that threads interning
+// different strings rarely contend with each other. Ids do not depend on the
+// mode and, once returned, are never invalidated.
 class StringPool {
  public:
+  enum class Mode {
+    // Only a single thread accesses the pool. No locks are taken.
+    kSingleThreaded,
+    // Multiple threads can concurrently intern and lookup strings.
+    kThreadSafe,
+  };
+
   struct Id {
     Id() = default;
 
@@ -84,7 +104,8 @@ class StringPool {
     uint32_t id;
   };
 
-  // Iterator over the strings in the pool.
+  // Iterator over the strings in the pool. Strings must not be interned
+  // while an iterator is in use, even in |Mode::kThreadSafe|.
   class Iterator {
    public:
     Iterator(const StringPool*);
@@ -102,7 +123,7 @@ class StringPool {
     uint32_t large_strings_index_ = 0;
   };
 
-  StringPool();
+  explicit StringPool(Mode mode = Mode::kSingleThreaded);
   ~StringPool();
 
   // Allow std::move().
@@ -118,12 +139,16 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
-    auto id_it = string_index_.find(hash);
-    if (id_it != string_index_.end()) {
-      PERFETTO_DCHECK(Get(id_it->second) == str);
-      return id_it->second;
+    Shard& shard = ShardFor(hash);
+    auto lock = MaybeLock(&shard.mutex);
+    const Id* id = shard.index.Find(hash);
+    if (id) {
+      PERFETTO_DCHECK(Get(*id) == str);
+      return *id;
     }
-    return InsertString(str, hash);
+    Id new_id = InsertString(str);
+    shard.index.Insert(hash, new_id);
+    return new_id;
   }
 
   base::Optional<Id> GetId(base::StringView str) const {
@@ -131,10 +156,12 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
-    auto id_it = string_index_.find(hash);
-    if (id_it != string_index_.end()) {
-      PERFETTO_DCHECK(Get(id_it->second) == str);
-      return id_it->second;
+    Shard& shard = ShardFor(hash);
+    auto lock = MaybeLock(&shard.mutex);
+    const Id* id = shard.index.Find(hash);
+    if (id) {
+      PERFETTO_DCHECK(Get(*id) == str);
+      return *id;
     }
     return base::nullopt;
   }
@@ -149,10 +176,106 @@ class StringPool {
 
   Iterator CreateIterator() const { return Iterator(this); }
 
-  size_t size() const { return string_index_.size(); }
+  size_t size() const {
+    size_t size = 0;
+    for (uint32_t i = 0; i <= shard_mask_; ++i) {
+      auto lock = MaybeLock(&shards_[i].mutex);
+      size += shards_[i].index.size();
+    }
+    return size;
+  }
+
+  // Writes all the strings in the pool (and the index used to look them up)
+  // to |writer|. Strings should not be interned while this method is
+  // running, even in |Mode::kThreadSafe|.
+  void Serialize(SnapshotWriter* writer) const;
+
+  // Replaces all the strings in the pool with the ones written by
+  // |Serialize|: the Ids of the strings in the serialized pool are valid in
+  // this pool afterwards. The serialized pool must have been created in the
+  // same mode as this one and contain all the strings in this pool with the
+  // same Ids (so that Ids returned before this call remain valid). Returns
+  // false if |reader| doesn't contain such a pool, in which case this pool is
+  // left unchanged.
+  bool Deserialize(SnapshotReader* reader);
 
  private:
   using StringHash = uint64_t;
+  struct Block;
+
+  // Maps hashes of strings to their Id. This is an open-addressing hash table
+  // using linear probing: unlike std::unordered_map, it doesn't need a heap
+  // allocation per string and lookups only touch a single contiguous array.
+  //
+  // As the null string is never inserted, a slot with a null Id is used to
+  // mark an empty slot.
+  class StringIndex {
+   public:
+    StringIndex();
+
+    // Returns a pointer to the Id for |hash| or nullptr if |hash| is not in
+    // the index.
+    const Id* Find(StringHash hash) const {
+      for (size_t i = SlotFor(hash);; i = (i + 1) & mask_) {
+        const Slot& slot = slots_[i];
+        if (slot.id.is_null())
+          return nullptr;
+        if (slot.hash == hash)
+          return &slot.id;
+      }
+    }
+
+    // Inserts a mapping from |hash| to |id|. |hash| should not already be
+    // present in the index.
+    void Insert(StringHash hash, Id id) {
+      PERFETTO_DCHECK(!id.is_null());
+      PERFETTO_DCHECK(!Find(hash));
+      if (PERFETTO_UNLIKELY((size_ + 1) * 4 > slots_.size() * 3))
+        Grow();
+      InsertUnchecked(hash, id);
+      size_++;
+    }
+
+    size_t size() const { return size_; }
+
+    void Serialize(SnapshotWriter* writer) const;
+
+    // Reads an index written by |Serialize|, checking that all the Ids in
+    // the index refer to strings in |blocks| or |num_large_strings|.
+    bool Deserialize(SnapshotReader* reader,
+                     const std::vector<Block>& blocks,
+                     size_t num_large_strings);
+
+   private:
+    struct Slot {
+      StringHash hash;
+      Id id;
+      // Makes the padding explicit so that |slots_| can be written to
+      // snapshots without writing uninitialized bytes. Always zero.
+      uint32_t padding;
+    };
+
+    // Multiplies by 2^64 / phi to spread the entropy of all the bits of the
+    // hash into the top bits which are used to pick the slot.
+    size_t SlotFor(StringHash hash) const {
+      return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    void InsertUnchecked(StringHash hash, Id id) {
+      size_t i = SlotFor(hash);
+      while (!slots_[i].id.is_null())
+        i = (i + 1) & mask_;
+      slots_[i] = Slot{hash, id, 0};
+    }
+
+    // Doubles the number of slots and reinserts all the existing entries.
+    void Grow();
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    uint32_t shift_ = 0;
+    size_t size_ = 0;
+  };
 
   struct Block {
     explicit Block(size_t size)
@@ -184,6 +307,9 @@ class StringPool {
 
     uint32_t pos() const { return pos_; }
 
+    // Replaces the contents of the block with the |size| bytes at |data|.
+    void Restore(const uint8_t* data, uint32_t size);
+
    private:
     base::PagedMemory mem_;
     uint32_t pos_ = 0;
@@ -224,11 +350,33 @@ class StringPool {
   // plus 1 byte for null terminator. The actual size may be lower.
   static constexpr uint8_t kMaxMetadataSize = 6;
 
-  // Inserts the string with the given hash into the pool and return its Id.
-  Id InsertString(base::StringView, uint64_t hash);
+  // The number of shards the index is split into in |Mode::kThreadSafe|.
+  static constexpr uint32_t kNumThreadSafeShards = 16;
 
-  // Insert a large string into the pool and return its Id.
-  Id InsertLargeString(base::StringView, uint64_t hash);
+  // A part of the index along with the lock protecting it.
+  struct Shard {
+    std::mutex mutex;
+    StringIndex index;
+  };
+
+  Shard& ShardFor(StringHash hash) const {
+    return shards_[static_cast<uint32_t>(hash) & shard_mask_];
+  }
+
+  // Returns a lock holding |mutex| in |Mode::kThreadSafe| and an empty lock
+  // otherwise.
+  std::unique_lock<std::mutex> MaybeLock(std::mutex* mutex) const {
+    if (mode_ == Mode::kThreadSafe)
+      return std::unique_lock<std::mutex>(*mutex);
+    return std::unique_lock<std::mutex>();
+  }
+
+  // Stores the string in the pool and returns its Id. The caller is
+  // responsible for adding the Id to the index.
+  Id InsertString(base::StringView);
+
+  // Stores a large string in the pool and returns its Id.
+  Id InsertLargeString(base::StringView);
 
   // The returned pointer points to the start of the string metadata (i.e. the
   // first byte of the size).
@@ -240,8 +388,11 @@ class StringPool {
     size_t block_index = id.block_index();
     uint32_t block_offset = id.block_offset();
 
-    PERFETTO_DCHECK(block_index < blocks_.size());
-    PERFETTO_DCHECK(block_offset < blocks_[block_index].pos());
+    // In |Mode::kThreadSafe|, |blocks_| can be concurrently modified so these
+    // checks would race with insertions.
+    PERFETTO_DCHECK(mode_ == Mode::kThreadSafe || block_index < blocks_.size());
+    PERFETTO_DCHECK(mode_ == Mode::kThreadSafe ||
+                    block_offset < blocks_[block_index].pos());
 
     return blocks_[block_index].Get(block_offset);
   }
@@ -271,13 +422,23 @@ class StringPool {
   // set.
   NullTermStringView GetLargeString(Id id) const {
     PERFETTO_DCHECK(id.is_large_string());
+    // |large_strings_| can be resized by a concurrent insertion.
+    auto lock = MaybeLock(storage_mutex_.get());
     size_t index = id.large_string_index();
     PERFETTO_DCHECK(index < large_strings_.size());
     const std::string* str = large_strings_[index].get();
     return NullTermStringView(str->c_str(), str->size());
   }
 
-  // The actual memory storing the strings.
+  Mode mode_ = Mode::kSingleThreaded;
+
+  // Protects |blocks_| and |large_strings_| in |Mode::kThreadSafe|. Held
+  // inside unique_ptrs (like |shards_|) to keep StringPool movable.
+  std::unique_ptr<std::mutex> storage_mutex_;
+
+  // The actual memory storing the strings. The capacity of this vector is
+  // reserved upfront for the maximum number of blocks so that it is never
+  // reallocated, allowing concurrent lookups of strings in existing blocks.
   std::vector<Block> blocks_;
 
   // Any string that is too large to fit into a Block is stored separately
@@ -285,10 +446,10 @@ class StringPool {
   // |large_strings_| is resized).
   std::vector<std::unique_ptr<std::string>> large_strings_;
 
-  // Maps hashes of strings to the Id in the string pool.
-  // TODO(lalitm): At some point we should benchmark just using a static
-  // hashtable of 1M elements, we can afford paying a fixed 8MB here
-  std::unordered_map<StringHash, Id> string_index_;
+  // Maps hashes of strings to the Id in the string pool. Split into
+  // |shard_mask_| + 1 shards (a single one in |Mode::kSingleThreaded|).
+  std::unique_ptr<Shard[]> shards_;
+  uint32_t shard_mask_ = 0;
 };
 
 }  // namespace trace_processor
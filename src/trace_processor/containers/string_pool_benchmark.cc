@@ -0,0 +1,122 @@
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/containers/string_pool.h"
+
+namespace {
+
+using perfetto::trace_processor::StringPool;
+using perfetto::base::StringView;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void StringPoolArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1024);
+  } else {
+    b->RangeMultiplier(8)->Range(1024, 8 * 1024 * 1024);
+  }
+}
+
+// Generates |count| distinct strings which look roughly like the keys and
+// values of args.
+std::vector<std::string> UniqueStrings(uint32_t count) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  std::vector<std::string> strings;
+  strings.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    strings.emplace_back("debug.arg_" + std::to_string(rnd_engine()) + "_" +
+                         std::to_string(i));
+  }
+  return strings;
+}
+
+}  // namespace
+
+static void BM_StringPoolInternUnique(benchmark::State& state) {
+  std::vector<std::string> strings =
+      UniqueStrings(static_cast<uint32_t>(state.range(0)));
+  for (auto _ : state) {
+    StringPool pool;
+    for (const std::string& str : strings) {
+      benchmark::DoNotOptimize(pool.InternString(StringView(str)));
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_StringPoolInternUnique)->Apply(StringPoolArgs);
+
+static void BM_StringPoolInternDuplicate(benchmark::State& state) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  uint32_t count = static_cast<uint32_t>(state.range(0));
+  std::vector<std::string> strings = UniqueStrings(count);
+
+  StringPool pool;
+  for (const std::string& str : strings) {
+    pool.InternString(StringView(str));
+  }
+
+  std::vector<uint32_t> order(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    order[i] = static_cast<uint32_t>(rnd_engine() % count);
+  }
+
+  for (auto _ : state) {
+    for (uint32_t idx : order) {
+      benchmark::DoNotOptimize(pool.InternString(StringView(strings[idx])));
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_StringPoolInternDuplicate)->Apply(StringPoolArgs);
+
+static void BM_StringPoolGetIdMissing(benchmark::State& state) {
+  uint32_t count = static_cast<uint32_t>(state.range(0));
+  std::vector<std::string> strings = UniqueStrings(count);
+
+  StringPool pool;
+  for (const std::string& str : strings) {
+    pool.InternString(StringView(str));
+  }
+
+  std::vector<std::string> missing;
+  missing.reserve(count);
+  for (const std::string& str : strings) {
+    missing.emplace_back(str + "_missing");
+  }
+
+  for (auto _ : state) {
+    for (const std::string& str : missing) {
+      benchmark::DoNotOptimize(pool.GetId(StringView(str)));
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+BENCHMARK(BM_StringPoolGetIdMissing)->Apply(StringPoolArgs);
@@ -18,6 +18,9 @@
 
 #include <array>
 #include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "test/gtest_and_gmock.h"
 
@@ -128,6 +131,62 @@ TEST_F(StringPoolTest, StressTest) {
   ASSERT_EQ(string_map.size(), 0u);
 }
 
+TEST_F(StringPoolTest, ManyStrings) {
+  // Intern enough strings to force the index to grow several times.
+  constexpr uint32_t kNumStrings = 100000;
+  std::vector<std::string> strings;
+  std::vector<StringPool::Id> ids;
+  for (uint32_t i = 0; i < kNumStrings; ++i) {
+    strings.emplace_back("string_" + std::to_string(i));
+    ids.emplace_back(pool_.InternString(base::StringView(strings.back())));
+  }
+  ASSERT_EQ(pool_.size(), kNumStrings);
+
+  for (uint32_t i = 0; i < kNumStrings; ++i) {
+    base::StringView str(strings[i]);
+    ASSERT_EQ(pool_.InternString(str), ids[i]);
+    ASSERT_EQ(pool_.GetId(str), ids[i]);
+    ASSERT_EQ(pool_.Get(ids[i]), str);
+  }
+  ASSERT_EQ(pool_.size(), kNumStrings);
+  ASSERT_EQ(pool_.GetId("not_interned"), base::nullopt);
+}
+
+TEST(StringPoolThreadSafeTest, ConcurrentIntern) {
+  StringPool pool(StringPool::Mode::kThreadSafe);
+
+  // Each thread interns an overlapping set of strings.
+  constexpr uint32_t kNumThreads = 8;
+  constexpr uint32_t kNumStrings = 20000;
+  std::vector<std::string> strings;
+  for (uint32_t i = 0; i < kNumStrings + kNumThreads; ++i) {
+    strings.emplace_back("string_" + std::to_string(i));
+  }
+
+  std::vector<std::vector<StringPool::Id>> ids(kNumThreads);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&pool, &strings, &ids, t] {
+      for (uint32_t i = 0; i < kNumStrings; ++i) {
+        base::StringView str(strings[t + i]);
+        StringPool::Id id = pool.InternString(str);
+        EXPECT_EQ(pool.Get(id), str);
+        ids[t].push_back(id);
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  ASSERT_EQ(pool.size(), kNumStrings + kNumThreads - 1);
+  for (uint32_t t = 0; t < kNumThreads; ++t) {
+    for (uint32_t i = 0; i < kNumStrings; ++i) {
+      base::StringView str(strings[t + i]);
+      ASSERT_EQ(pool.GetId(str), ids[t][i]);
+    }
+  }
+}
+
 TEST_F(StringPoolTest, BigString) {
   // Two of these should fit into one block, but the third one should go into
   // the |large_strings_| list.
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_ZONE_MAP_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_ZONE_MAP_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Stores the minimum and maximum value of every block of |kBlockSize|
+// contiguous values in an array. This allows filters to skip whole blocks of
+// rows which cannot match a constraint without looking at the rows themselves
+// (these are sometimes called "zone maps" or "block range indexes").
+//
+// The summaries are always conservative: the true minimum/maximum of a block
+// is guaranteed to be in the range [min(block), max(block)] but it's possible
+// that no value in the block is equal to min(block) or max(block) (e.g. after
+// a value inside the block has been changed by |Update|).
+template <typename T>
+class ZoneMap {
+ public:
+  static constexpr uint32_t kBlockSize = 4096;
+
+  // Extends the summaries to cover the first |size| values of |data|. Blocks
+  // which were fully covered by a previous call are not recomputed so |data|
+  // is expected to only have been appended to since the previous call (other
+  // changes should be reported using |Update|).
+  void Extend(const T* data, uint32_t size) {
+    Extend(size, [data](uint32_t idx) { return data[idx]; });
+  }
+
+  // Same as |Extend| above but the values are obtained by calling
+  // |get(index)|. This allows building summaries of data which isn't stored
+  // as a contiguous array (e.g. bit-packed data).
+  template <typename Getter>
+  void Extend(uint32_t size, Getter get) {
+    PERFETTO_DCHECK(size >= size_);
+    if (size == size_)
+      return;
+
+    // The last block may have been partially filled the previous time so we
+    // need to recompute it.
+    uint32_t block = size_ / kBlockSize;
+    uint32_t block_count = (size + kBlockSize - 1) / kBlockSize;
+    min_.resize(block_count);
+    max_.resize(block_count);
+    for (; block < block_count; ++block) {
+      uint32_t start = block * kBlockSize;
+      uint32_t end = std::min(start + kBlockSize, size);
+      T min = get(start);
+      T max = min;
+      for (uint32_t i = start + 1; i < end; ++i) {
+        T value = get(i);
+        min = std::min(min, value);
+        max = std::max(max, value);
+      }
+      min_[block] = min;
+      max_[block] = max;
+    }
+    size_ = size;
+  }
+
+  // Updates the summary of the block containing |idx| after the value at
+  // |idx| was changed to |value|.
+  void Update(uint32_t idx, T value) {
+    if (idx >= size_)
+      return;
+    uint32_t block = idx / kBlockSize;
+    min_[block] = std::min(min_[block], value);
+    max_[block] = std::max(max_[block], value);
+  }
+
+  // Returns the lower bound of the values in |block|.
+  T min(uint32_t block) const { return min_[block]; }
+
+  // Returns the upper bound of the values in |block|.
+  T max(uint32_t block) const { return max_[block]; }
+
+  // Returns the number of values covered by the summaries.
+  uint32_t size() const { return size_; }
+
+ private:
+  std::vector<T> min_;
+  std::vector<T> max_;
+  uint32_t size_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_ZONE_MAP_H_
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/zone_map.h"
+
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ZoneMapT = ZoneMap<int64_t>;
+
+TEST(ZoneMap, Extend) {
+  std::vector<int64_t> data;
+  for (uint32_t i = 0; i < ZoneMapT::kBlockSize + 10; ++i) {
+    int64_t value = static_cast<int64_t>(i);
+    data.push_back(i % 2 == 0 ? value : -value);
+  }
+
+  ZoneMapT zm;
+  zm.Extend(data.data(), static_cast<uint32_t>(data.size()));
+  ASSERT_EQ(zm.size(), data.size());
+  ASSERT_EQ(zm.min(0), -static_cast<int64_t>(ZoneMapT::kBlockSize - 1));
+  ASSERT_EQ(zm.max(0), static_cast<int64_t>(ZoneMapT::kBlockSize) - 2);
+
+  // The last block only contains the last 10 values.
+  ASSERT_EQ(zm.min(1), -static_cast<int64_t>(ZoneMapT::kBlockSize + 9));
+  ASSERT_EQ(zm.max(1), static_cast<int64_t>(ZoneMapT::kBlockSize) + 8);
+
+  // Appending to the partially filled block should recompute it.
+  data.push_back(100000);
+  zm.Extend(data.data(), static_cast<uint32_t>(data.size()));
+  ASSERT_EQ(zm.size(), data.size());
+  ASSERT_EQ(zm.max(1), 100000);
+  ASSERT_EQ(zm.max(0), static_cast<int64_t>(ZoneMapT::kBlockSize) - 2);
+}
+
+TEST(ZoneMap, Update) {
+  std::vector<int64_t> data(2 * ZoneMapT::kBlockSize, 10);
+
+  ZoneMapT zm;
+  zm.Extend(data.data(), static_cast<uint32_t>(data.size()));
+  ASSERT_EQ(zm.min(1), 10);
+  ASSERT_EQ(zm.max(1), 10);
+
+  zm.Update(ZoneMapT::kBlockSize + 1, -5);
+  zm.Update(ZoneMapT::kBlockSize + 2, 20);
+  ASSERT_EQ(zm.min(0), 10);
+  ASSERT_EQ(zm.max(0), 10);
+  ASSERT_EQ(zm.min(1), -5);
+  ASSERT_EQ(zm.max(1), 20);
+
+  // Updates for values not yet covered should be ignored.
+  zm.Update(3 * ZoneMapT::kBlockSize, 100);
+  ASSERT_EQ(zm.size(), 2 * ZoneMapT::kBlockSize);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
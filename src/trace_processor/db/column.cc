@@ -16,11 +16,115 @@
 
 #include "src/trace_processor/db/column.h"
 
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include "src/trace_processor/containers/hyper_log_log.h"
+
 #include "src/trace_processor/db/compare.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/db/vectorized_filter.h"
 
 namespace perfetto {
 namespace trace_processor {
+namespace {
+
+// Gives the filter fast paths access to the storage of a non-null numeric
+// column which is not bit-packed.
+template <typename T>
+struct DirectStorage {
+  T operator[](uint32_t idx) const { return data[idx]; }
+
+  // Returns a pointer to the |vectorized_filter::kWordSize| values starting
+  // at |idx|; |buffer| is unused.
+  const T* Word(uint32_t idx, T*) const { return data + idx; }
+
+  const T* data;
+};
+
+// Gives the filter fast paths access to the storage of a non-null numeric
+// column which is bit-packed by decoding the values on the fly.
+template <typename T>
+struct PackedStorage {
+  T operator[](uint32_t idx) const { return nv->StorageAt(idx); }
+
+  // Decodes the |vectorized_filter::kWordSize| values starting at |idx| into
+  // |buffer| and returns it.
+  const T* Word(uint32_t idx, T* buffer) const {
+    nv->DecodeStorage(idx, vectorized_filter::kWordSize, buffer);
+    return buffer;
+  }
+
+  const NullableVector<T>* nv;
+};
+
+// Returns the value to add to a HyperLogLog for the value of a column.
+template <typename T>
+uint64_t ValueForDistinctCount(T value) {
+  return static_cast<uint64_t>(static_cast<int64_t>(value));
+}
+uint64_t ValueForDistinctCount(double value) {
+  // Make sure that 0.0 and -0.0 are counted as the same value.
+  if (value == 0)
+    value = 0;
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+template <typename T>
+SqlValue NumericToSqlValue(T value) {
+  return SqlValue::Long(static_cast<int64_t>(value));
+}
+SqlValue NumericToSqlValue(double value) {
+  return SqlValue::Double(value);
+}
+
+// Returns the estimated number of distinct values in |hll| taking into
+// account that there are |non_null_count| non-null values.
+uint32_t DistinctCount(const HyperLogLog& hll, uint32_t non_null_count) {
+  if (non_null_count == 0)
+    return 0;
+  double estimate = std::round(hll.Estimate());
+  return std::max(1u, std::min(non_null_count,
+                               static_cast<uint32_t>(estimate)));
+}
+
+// Converts |value| to the type of a numeric column, returning false if this
+// is not possible without changing the result of the comparision (in which
+// case, the slow path should be used instead).
+bool ToColumnValue(SqlValue value, double* out) {
+  if (value.type != SqlValue::Type::kDouble)
+    return false;
+  *out = value.double_value;
+  return true;
+}
+
+bool ToColumnValue(SqlValue value, int64_t* out) {
+  if (value.type != SqlValue::Type::kLong)
+    return false;
+  *out = value.long_value;
+  return true;
+}
+
+template <typename T>
+bool ToColumnValue(SqlValue value, T* out) {
+  static_assert(std::is_integral<T>::value && sizeof(T) == sizeof(uint32_t),
+                "Only 32-bit integers should use this function");
+  if (value.type != SqlValue::Type::kLong)
+    return false;
+  if (value.long_value < static_cast<int64_t>(std::numeric_limits<T>::min()) ||
+      value.long_value > static_cast<int64_t>(std::numeric_limits<T>::max())) {
+    return false;
+  }
+  *out = static_cast<T>(value.long_value);
+  return true;
+}
+
+}  // namespace
 
 Column::Column(const Column& column,
                Table* table,
@@ -54,25 +158,36 @@ Column::Column(const char* name,
       string_pool_(table->string_pool_) {
   switch (type_) {
     case ColumnType::kInt32:
-      PERFETTO_CHECK(nullable_vector<int32_t>().IsDense() == IsDense());
+      CheckNullableVectorMatchesFlags(nullable_vector<int32_t>());
       break;
     case ColumnType::kUint32:
-      PERFETTO_CHECK(nullable_vector<uint32_t>().IsDense() == IsDense());
+      CheckNullableVectorMatchesFlags(nullable_vector<uint32_t>());
       break;
     case ColumnType::kInt64:
-      PERFETTO_CHECK(nullable_vector<int64_t>().IsDense() == IsDense());
+      CheckNullableVectorMatchesFlags(nullable_vector<int64_t>());
       break;
     case ColumnType::kDouble:
-      PERFETTO_CHECK(nullable_vector<double>().IsDense() == IsDense());
+      CheckNullableVectorMatchesFlags(nullable_vector<double>());
+      PERFETTO_CHECK(!IsIndexed());
       break;
     case ColumnType::kString:
-      PERFETTO_CHECK(nullable_vector<StringPool::Id>().IsDense() == IsDense());
+      CheckNullableVectorMatchesFlags(nullable_vector<StringPool::Id>());
       break;
     case ColumnType::kId:
+      PERFETTO_CHECK(!IsEncoded());
+      PERFETTO_CHECK(!IsIndexed());
       break;
   }
 }
 
+template <typename T>
+void Column::CheckNullableVectorMatchesFlags(
+    const NullableVector<T>& nv) const {
+  PERFETTO_CHECK(nv.IsDense() == IsDense());
+  PERFETTO_CHECK(nv.IsEncoded() == IsEncoded());
+  PERFETTO_CHECK(!IsEncoded() || !IsNullable());
+}
+
 Column Column::IdColumn(Table* table, uint32_t col_idx, uint32_t row_map_idx) {
   return Column("id", ColumnType::kId, kIdFlags, table, col_idx, row_map_idx,
                 nullptr, nullptr);
@@ -131,6 +246,354 @@ void Column::FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const {
   }
 }
 
+bool Column::FilterIntoNumericNonNullFast(FilterOp op,
+                                          SqlValue value,
+                                          RowMap* rm) const {
+  PERFETTO_DCHECK(!IsNullable());
+  switch (type_) {
+    case ColumnType::kInt32:
+      return FilterIntoNumericNonNullFast<int32_t>(op, value, rm);
+    case ColumnType::kUint32:
+      return FilterIntoNumericNonNullFast<uint32_t>(op, value, rm);
+    case ColumnType::kInt64:
+      return FilterIntoNumericNonNullFast<int64_t>(op, value, rm);
+    case ColumnType::kDouble:
+      return FilterIntoNumericNonNullFast<double>(op, value, rm);
+    case ColumnType::kString:
+    case ColumnType::kId:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <typename T>
+bool Column::FilterIntoNumericNonNullFast(FilterOp op,
+                                          SqlValue value,
+                                          RowMap* rm) const {
+  PERFETTO_DCHECK(type_ == ToColumnType<T>());
+
+  T column_value;
+  if (!ToColumnValue(value, &column_value))
+    return false;
+
+  switch (op) {
+    case FilterOp::kLt:
+      FilterIntoNumericNonNullFastWithOp<T, vectorized_filter::Lt>(
+          column_value, rm);
+      return true;
+    case FilterOp::kEq:
+      FilterIntoNumericNonNullFastWithOp<T, vectorized_filter::Eq>(
+          column_value, rm);
+      return true;
+    case FilterOp::kGt:
+      FilterIntoNumericNonNullFastWithOp<T, vectorized_filter::Gt>(
+          column_value, rm);
+      return true;
+    case FilterOp::kNe:
+      FilterIntoNumericNonNullFastWithOp<T, vectorized_filter::Ne>(
+          column_value, rm);
+      return true;
+    case FilterOp::kLe:
+      FilterIntoNumericNonNullFastWithOp<T, vectorized_filter::Le>(
+          column_value, rm);
+      return true;
+    case FilterOp::kGe:
+      FilterIntoNumericNonNullFastWithOp<T, vectorized_filter::Ge>(
+          column_value, rm);
+      return true;
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <typename T, typename Op>
+void Column::FilterIntoNumericNonNullFastWithOp(T value, RowMap* rm) const {
+  const auto& nv = nullable_vector<T>();
+  if (nv.IsPacked()) {
+    FilterIntoNumericNonNullWithStorage<T, Op>(PackedStorage<T>{&nv}, value,
+                                               rm);
+  } else {
+    FilterIntoNumericNonNullWithStorage<T, Op>(
+        DirectStorage<T>{nv.non_null_vector().data()}, value, rm);
+  }
+}
+
+template <typename T, typename Op, typename Storage>
+void Column::FilterIntoNumericNonNullWithStorage(const Storage& storage,
+                                                 T value,
+                                                 RowMap* rm) const {
+  // Zone maps are only used for integers (as doubles may be NaN which breaks
+  // the min/max summaries) and for tables which are large enough for skipping
+  // blocks to be worthwhile.
+  const uint32_t kBlockSize = ZoneMap<T>::kBlockSize;
+  if (std::is_integral<T>::value && row_map().IsRange() &&
+      row_map().size() > kBlockSize) {
+    FilterIntoNumericNonNullWithZoneMap<T, Op>(storage, value, rm);
+    return;
+  }
+
+  // As the column is non-null, every row has an entry in the backing storage
+  // so we can index it directly.
+  Op op;
+  auto p = [&storage, value, op](uint32_t row) {
+    return op(storage[row], value);
+  };
+  auto wp = [&storage, value](uint32_t row) {
+    T buffer[vectorized_filter::kWordSize];
+    return vectorized_filter::CompareWord<T, Op>(storage.Word(row, buffer),
+                                                 value);
+  };
+  row_map().FilterInto(rm, p, wp);
+}
+
+template <typename T, typename Op, typename Storage>
+void Column::FilterIntoNumericNonNullWithZoneMap(const Storage& storage,
+                                                 T value,
+                                                 RowMap* rm) const {
+  PERFETTO_DCHECK(row_map().IsRange() && !row_map().empty());
+
+  const ZoneMap<T>& zone_map = nullable_vector<T>().zone_map();
+  const uint32_t kBlockSize = ZoneMap<T>::kBlockSize;
+
+  // As |row_map()| is a range, row i is stored at index |start| + i.
+  uint32_t start = row_map().Get(0);
+  uint32_t end = start + row_map().size();
+  uint32_t first_block = start / kBlockSize;
+  uint32_t last_block = (end - 1) / kBlockSize;
+
+  // Find which blocks could contain matching rows.
+  std::vector<vectorized_filter::RangeMatch> matches(last_block - first_block +
+                                                     1);
+  base::Optional<uint32_t> first_match;
+  uint32_t last_match = 0;
+  for (uint32_t block = first_block; block <= last_block; ++block) {
+    auto match =
+        Op::MatchRange(zone_map.min(block), zone_map.max(block), value);
+    matches[block - first_block] = match;
+    if (match == vectorized_filter::RangeMatch::kNone)
+      continue;
+    if (!first_match)
+      first_match = block;
+    last_match = block;
+  }
+  if (!first_match) {
+    rm->Intersect(RowMap());
+    return;
+  }
+
+  // Discard the rows before the first and after the last candidate block
+  // without looking at them.
+  uint32_t first_row = std::max(start, *first_match * kBlockSize) - start;
+  uint32_t last_row = std::min(end, (last_match + 1) * kBlockSize) - start;
+  if (first_row > 0 || last_row < row_map().size()) {
+    rm->Intersect(RowMap(first_row, last_row));
+    if (rm->empty())
+      return;
+  }
+
+  // For the remaining blocks, we can avoid comparing any rows in blocks where
+  // either all or none of the rows match.
+  Op op;
+  auto p = [&storage, value, op](uint32_t idx) {
+    return op(storage[idx], value);
+  };
+  auto wp = [&storage, value, &matches, first_block, kBlockSize](uint32_t idx) {
+    uint32_t block = idx / kBlockSize;
+    if (block == (idx + vectorized_filter::kWordSize - 1) / kBlockSize) {
+      auto match = matches[block - first_block];
+      if (match == vectorized_filter::RangeMatch::kNone)
+        return static_cast<uint64_t>(0);
+      if (match == vectorized_filter::RangeMatch::kAll)
+        return ~static_cast<uint64_t>(0);
+    }
+    T buffer[vectorized_filter::kWordSize];
+    return vectorized_filter::CompareWord<T, Op>(storage.Word(idx, buffer),
+                                                 value);
+  };
+  row_map().FilterInto(rm, p, wp);
+}
+
+bool Column::FilterIntoIndexed(SqlValue value, RowMap* rm) const {
+  PERFETTO_DCHECK(IsIndexed());
+  switch (type_) {
+    case ColumnType::kInt32: {
+      int32_t column_value;
+      return ToColumnValue(value, &column_value) &&
+             FilterIntoIndexed(column_value, rm);
+    }
+    case ColumnType::kUint32: {
+      uint32_t column_value;
+      return ToColumnValue(value, &column_value) &&
+             FilterIntoIndexed(column_value, rm);
+    }
+    case ColumnType::kInt64: {
+      int64_t column_value;
+      return ToColumnValue(value, &column_value) &&
+             FilterIntoIndexed(column_value, rm);
+    }
+    case ColumnType::kString: {
+      if (value.type != SqlValue::Type::kString)
+        return false;
+
+      // If the string was never interned, no row can have it.
+      base::Optional<StringPool::Id> id =
+          string_pool_->GetId(value.string_value);
+      if (!id) {
+        rm->Intersect(RowMap());
+        return true;
+      }
+      return FilterIntoIndexed(*id, rm);
+    }
+    case ColumnType::kDouble:
+    case ColumnType::kId:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <typename T>
+bool Column::FilterIntoIndexed(T value, RowMap* rm) const {
+  PERFETTO_DCHECK(type_ == ToColumnType<T>());
+
+  // Mapping indices back to rows requires O(1) |IndexOf| calls which index
+  // vectors do not support.
+  const RowMap& row_map = this->row_map();
+  if (row_map.IsIndexVector())
+    return false;
+
+  const std::vector<uint32_t>* indices = nullable_vector<T>().FindAll(value);
+  if (!indices) {
+    rm->Intersect(RowMap());
+    return true;
+  }
+
+  // When both |row_map| and |rm| are ranges (e.g. |rm| is the result of a
+  // binary search on a sorted column like ts), only the indices inside |rm|
+  // need to be looked at: as |indices| is sorted, they can be found with a
+  // binary search instead of checking every index.
+  if (row_map.IsRange() && rm->IsRange()) {
+    if (rm->empty())
+      return true;
+    uint32_t start = row_map.Get(0);
+    uint32_t first = row_map.Get(rm->Get(0));
+    uint32_t last = row_map.Get(rm->Get(rm->size() - 1));
+    auto begin = std::lower_bound(indices->begin(), indices->end(), first);
+    auto end = std::upper_bound(begin, indices->end(), last);
+    std::vector<uint32_t> rows;
+    rows.reserve(static_cast<size_t>(end - begin));
+    for (auto it = begin; it != end; ++it) {
+      rows.push_back(*it - start);
+    }
+    rm->IntersectSorted(std::move(rows));
+    return true;
+  }
+
+  // As |row_map| is either a range or a BitVector, the rows will also be
+  // sorted.
+  std::vector<uint32_t> rows;
+  for (uint32_t idx : *indices) {
+    base::Optional<uint32_t> row = row_map.IndexOf(idx);
+    if (row)
+      rows.push_back(*row);
+  }
+  rm->IntersectSorted(std::move(rows));
+  return true;
+}
+
+bool Column::FilterIntoEncoded(FilterOp op,
+                               SqlValue value,
+                               RowMap* rm) const {
+  PERFETTO_DCHECK(IsEncoded());
+  if (op != FilterOp::kEq && op != FilterOp::kNe)
+    return false;
+
+  switch (type_) {
+    case ColumnType::kInt32:
+      return FilterIntoEncodedNumeric<int32_t>(op, value, rm);
+    case ColumnType::kUint32:
+      return FilterIntoEncodedNumeric<uint32_t>(op, value, rm);
+    case ColumnType::kInt64:
+      return FilterIntoEncodedNumeric<int64_t>(op, value, rm);
+    case ColumnType::kString: {
+      if (value.type != SqlValue::Type::kString)
+        return false;
+
+      const auto& nv = nullable_vector<StringPool::Id>();
+      base::Optional<StringPool::Id> id =
+          string_pool_->GetId(value.string_value);
+      base::Optional<uint32_t> code;
+      if (id)
+        code = nv.GetCode(*id);
+
+      // Null strings never match any constraint so make sure to exclude them
+      // for kNe constraints.
+      base::Optional<uint32_t> null_code = nv.GetCode(StringPool::Id::Null());
+      FilterIntoEncodedWithCode(op, nv.codes(), code, null_code, rm);
+      return true;
+    }
+    case ColumnType::kDouble:
+      // Doubles are not handled here as NaN values cannot be looked up in the
+      // dictionary.
+    case ColumnType::kId:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <typename T>
+bool Column::FilterIntoEncodedNumeric(FilterOp op,
+                                      SqlValue value,
+                                      RowMap* rm) const {
+  PERFETTO_DCHECK(type_ == ToColumnType<T>());
+
+  T column_value;
+  if (!ToColumnValue(value, &column_value))
+    return false;
+
+  const auto& nv = nullable_vector<T>();
+  FilterIntoEncodedWithCode(op, nv.codes(), nv.GetCode(column_value),
+                            base::nullopt, rm);
+  return true;
+}
+
+void Column::FilterIntoEncodedWithCode(FilterOp op,
+                                       const BitPackedVector& codes,
+                                       base::Optional<uint32_t> code,
+                                       base::Optional<uint32_t> null_code,
+                                       RowMap* rm) const {
+  PERFETTO_DCHECK(op == FilterOp::kEq || op == FilterOp::kNe);
+
+  if (op == FilterOp::kEq) {
+    if (!code) {
+      // No row has the value so nothing can match.
+      rm->Intersect(RowMap());
+      return;
+    }
+    uint32_t c = *code;
+    auto p = [&codes, c](uint32_t row) { return codes.Get(row) == c; };
+    auto wp = [&codes, c](uint32_t row) { return codes.EqWord(row, c); };
+    row_map().FilterInto(rm, p, wp);
+    return;
+  }
+
+  // For kNe, |code| and |null_code| are both codes which should be excluded.
+  if (!code && !null_code)
+    return;
+
+  uint32_t a = code ? *code : *null_code;
+  uint32_t b = null_code ? *null_code : *code;
+  auto p = [&codes, a, b](uint32_t row) {
+    uint32_t v = codes.Get(row);
+    return v != a && v != b;
+  };
+  auto wp = [&codes, a, b](uint32_t row) {
+    return ~(codes.EqWord(row, a) | codes.EqWord(row, b));
+  };
+  row_map().FilterInto(rm, p, wp);
+}
+
 template <typename T, bool is_nullable>
 void Column::FilterIntoNumericSlow(FilterOp op,
                                    SqlValue value,
@@ -468,6 +931,102 @@ void Column::StableSortNumeric(std::vector<uint32_t>* out) const {
   });
 }
 
+Column::Stats Column::ComputeStats() const {
+  Stats stats;
+  stats.row_count = row_map().size();
+  switch (type_) {
+    case ColumnType::kInt32:
+      ComputeStatsNumeric<int32_t>(&stats);
+      break;
+    case ColumnType::kUint32:
+      ComputeStatsNumeric<uint32_t>(&stats);
+      break;
+    case ColumnType::kInt64:
+      ComputeStatsNumeric<int64_t>(&stats);
+      break;
+    case ColumnType::kDouble:
+      ComputeStatsNumeric<double>(&stats);
+      break;
+    case ColumnType::kString: {
+      // Each distinct string has a distinct id so counting the ids is enough.
+      HyperLogLog hll;
+      const uint32_t kBatchSize = 1024;
+      StringPool::Id ids[kBatchSize];
+      for (uint32_t i = 0; i < stats.row_count; i += kBatchSize) {
+        uint32_t count = std::min(kBatchSize, stats.row_count - i);
+        GetBatch(i, count, ids);
+        for (uint32_t j = 0; j < count; ++j) {
+          if (ids[j].is_null()) {
+            stats.null_count++;
+          } else {
+            hll.Add(ids[j].raw_id());
+          }
+        }
+      }
+      stats.distinct_count =
+          DistinctCount(hll, stats.row_count - stats.null_count);
+      break;
+    }
+    case ColumnType::kId: {
+      // Ids are unique and sorted.
+      stats.distinct_count = stats.row_count;
+      if (stats.row_count > 0) {
+        stats.min = Get(0);
+        stats.max = Get(stats.row_count - 1);
+      }
+      break;
+    }
+  }
+  return stats;
+}
+
+template <typename T>
+void Column::ComputeStatsNumeric(Stats* stats) const {
+  HyperLogLog hll;
+  bool has_value = false;
+  T min = T();
+  T max = T();
+
+  const uint32_t kBatchSize = 1024;
+  T values[kBatchSize];
+  uint64_t nulls[kBatchSize / 64];
+  for (uint32_t i = 0; i < stats->row_count; i += kBatchSize) {
+    uint32_t count = std::min(kBatchSize, stats->row_count - i);
+    GetBatch(i, count, values, nulls);
+    for (uint32_t j = 0; j < count; ++j) {
+      if ((nulls[j / 64] >> (j % 64)) & 1) {
+        stats->null_count++;
+        continue;
+      }
+      T value = values[j];
+      hll.Add(ValueForDistinctCount(value));
+      if (!has_value) {
+        min = max = value;
+        has_value = true;
+      } else {
+        min = std::min(min, value);
+        max = std::max(max, value);
+      }
+    }
+  }
+
+  uint32_t non_null_count = stats->row_count - stats->null_count;
+  stats->distinct_count = DistinctCount(hll, non_null_count);
+  if (!has_value)
+    return;
+
+  stats->min = NumericToSqlValue(min);
+  stats->max = NumericToSqlValue(max);
+
+  // For integers, there can't be more distinct values than integers between
+  // the minimum and the maximum.
+  if (std::is_integral<T>::value) {
+    double range = static_cast<double>(max) - static_cast<double>(min) + 1;
+    if (range < stats->distinct_count)
+      stats->distinct_count = static_cast<uint32_t>(range);
+  }
+}
+
 const RowMap& Column::row_map() const {
   return table_->row_maps_[row_map_idx_];
 }
@@ -19,6 +19,9 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <type_traits>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/trace_processor/basic_types.h"
@@ -110,6 +113,23 @@ class Column {
     // This flag is only meaningful for nullable columns has no effect for
     // non-null columns.
     kDense = 1 << 3,
+
+    // Indicates that the data in this column is dictionary encoded (see
+    // NullableVector::Encoded()). This reduces the memory usage of columns
+    // with few distinct values and allows equality filters to compare the
+    // (bit-packed) codes rather than the values themselves.
+    //
+    // This flag is only valid for non-null, non-id columns.
+    kEncoded = 1 << 4,
+
+    // Indicates that a hash index from each value to the rows with that value
+    // should be kept for this column. This allows equality filters (e.g. point
+    // lookups on utid, upid, arg_set_id etc.) to find the matching rows
+    // without scanning the whole column. The index is built the first time
+    // it's needed.
+    //
+    // This flag is only valid for non-id columns which do not store doubles.
+    kIndexed = 1 << 5,
   };
 
   // Iterator over a column which conforms to std iterator interface
@@ -162,6 +182,24 @@ class Column {
   // Flags specified for an id column.
   static constexpr uint32_t kIdFlags = Flag::kSorted | Flag::kNonNull;
 
+  // Statistics about the values of a Column. These are used to estimate the
+  // number of rows matched by constraints when planning queries.
+  struct Stats {
+    // The number of rows in the column when the statistics were computed.
+    uint32_t row_count = 0;
+
+    // The number of null rows.
+    uint32_t null_count = 0;
+
+    // An estimate of the number of distinct non-null values.
+    uint32_t distinct_count = 0;
+
+    // The smallest and largest non-null values. Only computed for numeric
+    // columns; null otherwise or if every row is null.
+    SqlValue min;
+    SqlValue max;
+  };
+
   template <typename T>
   Column(const char* name,
          NullableVector<T>* storage,
@@ -209,6 +247,45 @@ class Column {
   // Gets the value of the Column at the given |row|.
   SqlValue Get(uint32_t row) const { return GetAtIdx(row_map().Get(row)); }
 
+  // Writes the values of the |count| rows starting at |start_row| to |values|.
+  // If |nulls| is not null, bit (i % 64) of |nulls[i / 64]| is set iff row
+  // |start_row + i| is null; it should have space for (count + 63) / 64
+  // words. Null rows have a default constructed value in |values|.
+  //
+  // |T| should be the type stored by this column (i.e. the serialized_type of
+  // the corresponding TypedColumn, StringPool::Id for string columns and
+  // uint32_t for id columns).
+  //
+  // This is much more efficient than calling |Get| for each row when reading
+  // many consecutive rows as the RowMap lookups and type dispatch are done
+  // once per batch rather than once per row.
+  template <typename T>
+  void GetBatch(uint32_t start_row,
+                uint32_t count,
+                T* values,
+                uint64_t* nulls = nullptr) const {
+    PERFETTO_DCHECK(start_row + count <= row_map().size());
+    PERFETTO_DCHECK(IsId() ? (std::is_same<T, uint32_t>::value)
+                           : IsColumnType<T>());
+
+    const uint32_t kBatchSize = 64;
+    uint32_t idxs[kBatchSize];
+    for (uint32_t i = 0; i < count; i += kBatchSize) {
+      uint32_t batch_size = std::min(kBatchSize, count - i);
+      row_map().GetRows(start_row + i, batch_size, idxs);
+
+      uint64_t null_word;
+      if (IsId()) {
+        null_word = IdBatchToValues(idxs, batch_size, values + i);
+      } else {
+        null_word = nullable_vector<T>().GetBatch(idxs, batch_size, values + i);
+        null_word |= NullStringsInBatch(values + i, batch_size);
+      }
+      if (nulls)
+        nulls[i / kBatchSize] = null_word;
+    }
+  }
+
   // Returns the row containing the given value in the Column.
   base::Optional<uint32_t> IndexOf(SqlValue value) const {
     switch (type_) {
@@ -287,6 +364,14 @@ class Column {
       return;
     }
 
+    if (IsIndexed() && op == FilterOp::kEq) {
+      // If the column is indexed, we can directly look up the rows which have
+      // the value.
+      bool handled = FilterIntoIndexed(value, rm);
+      if (handled)
+        return;
+    }
+
     if (IsSorted() && value.type == type()) {
       // If the column is sorted and the value has the same type as the column,
       // we should be able to just do a binary search to find the range of rows
@@ -296,9 +381,27 @@ class Column {
         return;
     }
 
+    if (IsEncoded()) {
+      // If the column is encoded, we may be able to look up the code of the
+      // value and only compare codes.
+      bool handled = FilterIntoEncoded(op, value, rm);
+      if (handled)
+        return;
+    } else if (!IsNullable()) {
+      // If the column is non-null, we may be able to compare many rows at a
+      // time by directly scanning the backing storage of the column.
+      bool handled = FilterIntoNumericNonNullFast(op, value, rm);
+      if (handled)
+        return;
+    }
+
     FilterIntoSlow(op, value, rm);
   }
 
+  // Computes the statistics about the values of this column. This requires
+  // looking at every row so callers should cache the result.
+  Stats ComputeStats() const;
+
   // Returns the minimum value in this column. Returns nullopt if this column
   // is empty.
   base::Optional<SqlValue> Min() const {
@@ -339,6 +442,12 @@ class Column {
   // Returns true if this column is a dense column.
   bool IsDense() const { return (flags_ & Flag::kDense) != 0; }
 
+  // Returns true if this column is a dictionary encoded column.
+  bool IsEncoded() const { return (flags_ & Flag::kEncoded) != 0; }
+
+  // Returns true if this column has a hash index.
+  bool IsIndexed() const { return (flags_ & Flag::kIndexed) != 0; }
+
   // Returns the backing RowMap for this Column.
   // This function is defined out of line because of a circular dependency
   // between |Table| and |Column|.
@@ -359,6 +468,9 @@ class Column {
   // Returns the index of the current column in the containing table.
   uint32_t index_in_table() const { return col_idx_in_table_; }
 
+  // Returns the string pool used to store the strings of this column.
+  const StringPool& string_pool() const { return *string_pool_; }
+
   // Returns a Constraint for each type of filter operation for this Column.
   Constraint eq_value(SqlValue value) const {
     return Constraint{col_idx_in_table_, FilterOp::kEq, value};
@@ -421,8 +533,6 @@ class Column {
     return ToSqlValueType(ToColumnType<T>());
   }
 
-  const StringPool& string_pool() const { return *string_pool_; }
-
  private:
   enum class ColumnType {
     // Standard primitive types.
@@ -451,6 +561,36 @@ class Column {
   Column(const Column&) = delete;
   Column& operator=(const Column&) = delete;
 
+  // Helpers for |GetBatch| which converts the indices of an id column to
+  // values. Returns the null word for the batch (i.e. always zero).
+  template <typename T>
+  static uint64_t IdBatchToValues(const uint32_t* idxs,
+                                  uint32_t count,
+                                  T* values) {
+    for (uint32_t i = 0; i < count; ++i) {
+      values[i] = static_cast<T>(idxs[i]);
+    }
+    return 0;
+  }
+  static uint64_t IdBatchToValues(const uint32_t*, uint32_t, StringPool::Id*) {
+    PERFETTO_FATAL("Id columns cannot be read as strings");
+  }
+
+  // Helpers for |GetBatch| which returns the null word for a batch of values:
+  // only string columns store nulls in-band (as the null string id).
+  template <typename T>
+  static uint64_t NullStringsInBatch(const T*, uint32_t) {
+    return 0;
+  }
+  static uint64_t NullStringsInBatch(const StringPool::Id* values,
+                                     uint32_t count) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      word |= static_cast<uint64_t>(values[i].is_null()) << i;
+    }
+    return word;
+  }
+
   // Gets the value of the Column at the given |row|.
   SqlValue GetAtIdx(uint32_t idx) const {
     switch (type_) {
@@ -529,6 +669,75 @@ class Column {
     return false;
   }
 
+  // Optimized filter method for non-null numeric columns which compares 64
+  // rows at a time (see vectorized_filter.h), writing the results directly
+  // into BitVector words.
+  // Returns whether the constraint was handled by the method.
+  bool FilterIntoNumericNonNullFast(FilterOp op,
+                                    SqlValue value,
+                                    RowMap* rm) const;
+
+  // Fast path filter method for non-null numerics. |T| should match the type
+  // of this column.
+  template <typename T>
+  bool FilterIntoNumericNonNullFast(FilterOp op,
+                                    SqlValue value,
+                                    RowMap* rm) const;
+
+  // Fast path filter method for non-null numerics with the filter operation
+  // |Op| (one of the structs in vectorized_filter.h).
+  template <typename T, typename Op>
+  void FilterIntoNumericNonNullFastWithOp(T value, RowMap* rm) const;
+
+  // Implementation of |FilterIntoNumericNonNullFastWithOp| reading the
+  // values of the column through |storage| (which abstracts away whether the
+  // storage of the column is bit-packed or not).
+  template <typename T, typename Op, typename Storage>
+  void FilterIntoNumericNonNullWithStorage(const Storage& storage,
+                                           T value,
+                                           RowMap* rm) const;
+
+  // Fast path filter method for non-null numerics which uses the zone map of
+  // the column to skip blocks of rows which cannot match (or which must all
+  // match) the constraint. Should only be called when |row_map()| is a range.
+  template <typename T, typename Op, typename Storage>
+  void FilterIntoNumericNonNullWithZoneMap(const Storage& storage,
+                                           T value,
+                                           RowMap* rm) const;
+
+  // Optimized filter method for equality constraints on indexed columns
+  // which looks up the matching rows in the index of the column.
+  // Returns whether the constraint was handled by the method.
+  bool FilterIntoIndexed(SqlValue value, RowMap* rm) const;
+
+  // Filter method for indexed columns. |T| should match the type of this
+  // column.
+  template <typename T>
+  bool FilterIntoIndexed(T value, RowMap* rm) const;
+
+  // Optimized filter method for encoded columns which only compares the codes
+  // of each row with the code of |value|.
+  // Returns whether the constraint was handled by the method.
+  bool FilterIntoEncoded(FilterOp op, SqlValue value, RowMap* rm) const;
+
+  // Filter method for encoded numeric columns. |T| should match the type of
+  // this column.
+  template <typename T>
+  bool FilterIntoEncodedNumeric(FilterOp op,
+                                SqlValue value,
+                                RowMap* rm) const;
+
+  // Filter method for encoded columns where |code| is the code of the value
+  // being compared against (or nullopt if the value is not in the dictionary)
+  // and |null_code| is the code of the null value (or nullopt if there is no
+  // such code).
+  // |op| should be either FilterOp::kEq or FilterOp::kNe.
+  void FilterIntoEncodedWithCode(FilterOp op,
+                                 const BitPackedVector& codes,
+                                 base::Optional<uint32_t> code,
+                                 base::Optional<uint32_t> null_code,
+                                 RowMap* rm) const;
+
   // Slow path filter method which will perform a full table scan.
   void FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
@@ -549,6 +758,10 @@ class Column {
   // Slow path filter method for ids which will perform a full table scan.
   void FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
+  // Checks that the storage mode of |nv| matches the flags of this column.
+  template <typename T>
+  void CheckNullableVectorMatchesFlags(const NullableVector<T>& nv) const;
+
   // Stable sorts this column storing the result in |out|.
   template <bool desc>
   void StableSort(std::vector<uint32_t>* out) const;
@@ -558,6 +771,9 @@ class Column {
   template <bool desc, typename T, bool is_nullable>
   void StableSortNumeric(std::vector<uint32_t>* out) const;
 
+  template <typename T>
+  void ComputeStatsNumeric(Stats* stats) const;
+
   template <typename T>
   static ColumnType ToColumnType() {
     if (std::is_same<T, uint32_t>::value) {
@@ -84,6 +84,7 @@ class Table {
       bool is_id;
       bool is_sorted;
       bool is_hidden;
+      bool is_indexed;
     };
     std::vector<Column> columns;
   };
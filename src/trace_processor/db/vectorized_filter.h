@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_VECTORIZED_FILTER_H_
+#define SRC_TRACE_PROCESSOR_DB_VECTORIZED_FILTER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace vectorized_filter {
+
+// This file contains kernels which compare 64 contiguous, non-null numeric
+// values against a constant and pack the results into a single 64-bit word
+// (i.e. the same layout as a BitVector word). They are used to speed up
+// filtering of non-null numeric columns.
+//
+// All comparisions are expressed in terms of < and > to match the semantics
+// of compare::Numeric (which matters for NaN doubles: e.g. a NaN compares
+// "equal" to every value).
+//
+// When compiling with AVX2 enabled, explicit intrinsics are used. Otherwise,
+// the portable implementation is written so that compilers are able to
+// auto-vectorize it using whatever vector instructions the target supports
+// (e.g. SSE on x64, NEON on ARM64, SIMD128 on WASM).
+
+// The number of values compared by each call to |CompareWord|.
+constexpr uint32_t kWordSize = 64;
+
+// The result of checking whether the values in a range [min, max] can match
+// a filter operation.
+enum class RangeMatch {
+  // No value in the range matches.
+  kNone,
+  // Some values in the range may match.
+  kSome,
+  // Every value in the range matches.
+  kAll,
+};
+
+// Each of these structs defines a filter operation on single values, on words
+// of "less than" and "greater than" results and on ranges of values (used with
+// zone maps, see zone_map.h).
+//
+// MatchRange is only meaningful for types with a total order (i.e. not for
+// doubles which may be NaN).
+struct Lt {
+  template <typename T>
+  bool operator()(T a, T b) const {
+    return a < b;
+  }
+  static uint64_t FromLtGt(uint64_t lt, uint64_t) { return lt; }
+
+  template <typename T>
+  static RangeMatch MatchRange(T min, T max, T value) {
+    if (max < value)
+      return RangeMatch::kAll;
+    return min < value ? RangeMatch::kSome : RangeMatch::kNone;
+  }
+};
+
+struct Gt {
+  template <typename T>
+  bool operator()(T a, T b) const {
+    return a > b;
+  }
+  static uint64_t FromLtGt(uint64_t, uint64_t gt) { return gt; }
+
+  template <typename T>
+  static RangeMatch MatchRange(T min, T max, T value) {
+    if (min > value)
+      return RangeMatch::kAll;
+    return max > value ? RangeMatch::kSome : RangeMatch::kNone;
+  }
+};
+
+struct Le {
+  template <typename T>
+  bool operator()(T a, T b) const {
+    return !(a > b);
+  }
+  static uint64_t FromLtGt(uint64_t, uint64_t gt) { return ~gt; }
+
+  template <typename T>
+  static RangeMatch MatchRange(T min, T max, T value) {
+    if (max <= value)
+      return RangeMatch::kAll;
+    return min <= value ? RangeMatch::kSome : RangeMatch::kNone;
+  }
+};
+
+struct Ge {
+  template <typename T>
+  bool operator()(T a, T b) const {
+    return !(a < b);
+  }
+  static uint64_t FromLtGt(uint64_t lt, uint64_t) { return ~lt; }
+
+  template <typename T>
+  static RangeMatch MatchRange(T min, T max, T value) {
+    if (min >= value)
+      return RangeMatch::kAll;
+    return max >= value ? RangeMatch::kSome : RangeMatch::kNone;
+  }
+};
+
+struct Eq {
+  template <typename T>
+  bool operator()(T a, T b) const {
+    return !(a < b) && !(a > b);
+  }
+  static uint64_t FromLtGt(uint64_t lt, uint64_t gt) { return ~(lt | gt); }
+
+  template <typename T>
+  static RangeMatch MatchRange(T min, T max, T value) {
+    if (value < min || value > max)
+      return RangeMatch::kNone;
+    return min == max ? RangeMatch::kAll : RangeMatch::kSome;
+  }
+};
+
+struct Ne {
+  template <typename T>
+  bool operator()(T a, T b) const {
+    return a < b || a > b;
+  }
+  static uint64_t FromLtGt(uint64_t lt, uint64_t gt) { return lt | gt; }
+
+  template <typename T>
+  static RangeMatch MatchRange(T min, T max, T value) {
+    if (value < min || value > max)
+      return RangeMatch::kAll;
+    return min == max ? RangeMatch::kNone : RangeMatch::kSome;
+  }
+};
+
+namespace internal {
+
+// Packs 8 bytes, each of which are either 0 or 1, into the low 8 bits of the
+// returned value (i.e. byte i becomes bit i).
+inline uint64_t PackBytes(const uint8_t* bytes) {
+  uint64_t word;
+  memcpy(&word, bytes, sizeof(word));
+
+  // Multiplying by this constant moves byte i into bit 56 + i without any
+  // carries (as each byte is either 0 or 1).
+  return (word * 0x0102040810204080ull) >> 56;
+}
+
+template <typename T, typename Op>
+inline uint64_t CompareWordPortable(const T* data, T value) {
+  Op op;
+
+  // Keep the comparision loop free of any dependencies between iterations so
+  // that it can be auto-vectorized.
+  uint8_t res[kWordSize];
+  for (uint32_t i = 0; i < kWordSize; ++i) {
+    res[i] = op(data[i], value);
+  }
+
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < kWordSize / 8; ++i) {
+    word |= PackBytes(res + i * 8) << (i * 8);
+  }
+  return word;
+}
+
+#if defined(__AVX2__)
+
+// Each of the functions below compares 64 values and returns the words for
+// (data[i] < value) and (data[i] > value).
+
+inline void LtGtWordAvx2(const int64_t* data,
+                         int64_t value,
+                         uint64_t* lt,
+                         uint64_t* gt) {
+  const __m256i v = _mm256_set1_epi64x(value);
+  uint64_t lt_word = 0;
+  uint64_t gt_word = 0;
+  for (uint32_t i = 0; i < kWordSize; i += 4) {
+    __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    uint32_t l = static_cast<uint32_t>(
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, x))));
+    uint32_t g = static_cast<uint32_t>(
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, v))));
+    lt_word |= static_cast<uint64_t>(l) << i;
+    gt_word |= static_cast<uint64_t>(g) << i;
+  }
+  *lt = lt_word;
+  *gt = gt_word;
+}
+
+// |flip| is xor-ed with every value before comparing: this allows unsigned
+// values to be compared using the signed comparision instruction.
+inline void LtGtWordAvx2(const uint32_t* data,
+                         uint32_t value,
+                         uint32_t flip,
+                         uint64_t* lt,
+                         uint64_t* gt) {
+  const __m256i f = _mm256_set1_epi32(static_cast<int32_t>(flip));
+  const __m256i v =
+      _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(value)), f);
+  uint64_t lt_word = 0;
+  uint64_t gt_word = 0;
+  for (uint32_t i = 0; i < kWordSize; i += 8) {
+    __m256i x = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), f);
+    uint32_t l = static_cast<uint32_t>(
+        _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, x))));
+    uint32_t g = static_cast<uint32_t>(
+        _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, v))));
+    lt_word |= static_cast<uint64_t>(l) << i;
+    gt_word |= static_cast<uint64_t>(g) << i;
+  }
+  *lt = lt_word;
+  *gt = gt_word;
+}
+
+inline void LtGtWordAvx2(const double* data,
+                         double value,
+                         uint64_t* lt,
+                         uint64_t* gt) {
+  const __m256d v = _mm256_set1_pd(value);
+  uint64_t lt_word = 0;
+  uint64_t gt_word = 0;
+  for (uint32_t i = 0; i < kWordSize; i += 4) {
+    __m256d x = _mm256_loadu_pd(data + i);
+    uint32_t l = static_cast<uint32_t>(
+        _mm256_movemask_pd(_mm256_cmp_pd(x, v, _CMP_LT_OQ)));
+    uint32_t g = static_cast<uint32_t>(
+        _mm256_movemask_pd(_mm256_cmp_pd(x, v, _CMP_GT_OQ)));
+    lt_word |= static_cast<uint64_t>(l) << i;
+    gt_word |= static_cast<uint64_t>(g) << i;
+  }
+  *lt = lt_word;
+  *gt = gt_word;
+}
+
+template <typename T, typename Op>
+struct CompareWordImpl {
+  static uint64_t Compare(const T* data, T value) {
+    return CompareWordPortable<T, Op>(data, value);
+  }
+};
+
+template <typename Op>
+struct CompareWordImpl<int64_t, Op> {
+  static uint64_t Compare(const int64_t* data, int64_t value) {
+    uint64_t lt, gt;
+    LtGtWordAvx2(data, value, &lt, &gt);
+    return Op::FromLtGt(lt, gt);
+  }
+};
+
+template <typename Op>
+struct CompareWordImpl<uint32_t, Op> {
+  static uint64_t Compare(const uint32_t* data, uint32_t value) {
+    uint64_t lt, gt;
+    LtGtWordAvx2(data, value, 0x80000000u, &lt, &gt);
+    return Op::FromLtGt(lt, gt);
+  }
+};
+
+template <typename Op>
+struct CompareWordImpl<int32_t, Op> {
+  static uint64_t Compare(const int32_t* data, int32_t value) {
+    uint64_t lt, gt;
+    LtGtWordAvx2(reinterpret_cast<const uint32_t*>(data),
+                 static_cast<uint32_t>(value), 0u, &lt, &gt);
+    return Op::FromLtGt(lt, gt);
+  }
+};
+
+template <typename Op>
+struct CompareWordImpl<double, Op> {
+  static uint64_t Compare(const double* data, double value) {
+    uint64_t lt, gt;
+    LtGtWordAvx2(data, value, &lt, &gt);
+    return Op::FromLtGt(lt, gt);
+  }
+};
+
+#endif  // defined(__AVX2__)
+
+}  // namespace internal
+
+// Compares the |kWordSize| values starting at |data| with |value| using |Op|
+// and returns a word where bit i is set iff Op()(data[i], value) is true.
+template <typename T, typename Op>
+inline uint64_t CompareWord(const T* data, T value) {
+#if defined(__AVX2__)
+  return internal::CompareWordImpl<T, Op>::Compare(data, value);
+#else
+  return internal::CompareWordPortable<T, Op>(data, value);
+#endif
+}
+
+}  // namespace vectorized_filter
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_VECTORIZED_FILTER_H_
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/vectorized_filter.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "src/trace_processor/db/compare.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace vectorized_filter {
+namespace {
+
+// Computes the expected word using compare::Numeric to check that the kernels
+// have the same semantics as the slow path.
+template <typename T>
+uint64_t ExpectedWord(const T* data, T value, int (*pred)(int)) {
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < kWordSize; ++i) {
+    bool res = pred(compare::Numeric(data[i], value)) != 0;
+    word |= static_cast<uint64_t>(res) << i;
+  }
+  return word;
+}
+
+template <typename T>
+void CheckAllOps(const std::vector<T>& data, T value) {
+  ASSERT_EQ(data.size() % kWordSize, 0u);
+  for (uint32_t i = 0; i < data.size(); i += kWordSize) {
+    const T* ptr = data.data() + i;
+    ASSERT_EQ((CompareWord<T, Lt>(ptr, value)),
+              ExpectedWord(ptr, value, [](int r) { return r < 0 ? 1 : 0; }));
+    ASSERT_EQ((CompareWord<T, Gt>(ptr, value)),
+              ExpectedWord(ptr, value, [](int r) { return r > 0 ? 1 : 0; }));
+    ASSERT_EQ((CompareWord<T, Le>(ptr, value)),
+              ExpectedWord(ptr, value, [](int r) { return r <= 0 ? 1 : 0; }));
+    ASSERT_EQ((CompareWord<T, Ge>(ptr, value)),
+              ExpectedWord(ptr, value, [](int r) { return r >= 0 ? 1 : 0; }));
+    ASSERT_EQ((CompareWord<T, Eq>(ptr, value)),
+              ExpectedWord(ptr, value, [](int r) { return r == 0 ? 1 : 0; }));
+    ASSERT_EQ((CompareWord<T, Ne>(ptr, value)),
+              ExpectedWord(ptr, value, [](int r) { return r != 0 ? 1 : 0; }));
+  }
+}
+
+TEST(VectorizedFilterUnittest, Int64) {
+  std::minstd_rand0 rnd(42);
+  std::vector<int64_t> data;
+  for (uint32_t i = 0; i < 4 * kWordSize; ++i) {
+    data.push_back(static_cast<int64_t>(rnd() % 16) - 8);
+  }
+  data[3] = std::numeric_limits<int64_t>::min();
+  data[7] = std::numeric_limits<int64_t>::max();
+
+  CheckAllOps<int64_t>(data, 0);
+  CheckAllOps<int64_t>(data, -8);
+  CheckAllOps<int64_t>(data, 7);
+  CheckAllOps<int64_t>(data, std::numeric_limits<int64_t>::min());
+  CheckAllOps<int64_t>(data, std::numeric_limits<int64_t>::max());
+}
+
+TEST(VectorizedFilterUnittest, Uint32) {
+  std::minstd_rand0 rnd(42);
+  std::vector<uint32_t> data;
+  for (uint32_t i = 0; i < 4 * kWordSize; ++i) {
+    data.push_back(static_cast<uint32_t>(rnd() % 16));
+  }
+  // Make sure values with the top bit set are compared as unsigned.
+  data[5] = std::numeric_limits<uint32_t>::max();
+  data[9] = 0x80000000u;
+
+  CheckAllOps<uint32_t>(data, 0);
+  CheckAllOps<uint32_t>(data, 8);
+  CheckAllOps<uint32_t>(data, 0x80000000u);
+  CheckAllOps<uint32_t>(data, std::numeric_limits<uint32_t>::max());
+}
+
+TEST(VectorizedFilterUnittest, Int32) {
+  std::minstd_rand0 rnd(42);
+  std::vector<int32_t> data;
+  for (uint32_t i = 0; i < 4 * kWordSize; ++i) {
+    data.push_back(static_cast<int32_t>(rnd() % 16) - 8);
+  }
+  data[1] = std::numeric_limits<int32_t>::min();
+  data[2] = std::numeric_limits<int32_t>::max();
+
+  CheckAllOps<int32_t>(data, 0);
+  CheckAllOps<int32_t>(data, -3);
+  CheckAllOps<int32_t>(data, std::numeric_limits<int32_t>::min());
+}
+
+TEST(VectorizedFilterUnittest, Double) {
+  std::minstd_rand0 rnd(42);
+  std::vector<double> data;
+  for (uint32_t i = 0; i < 4 * kWordSize; ++i) {
+    data.push_back(static_cast<double>(rnd() % 16) / 4.0 - 2.0);
+  }
+  data[4] = std::numeric_limits<double>::quiet_NaN();
+  data[8] = std::numeric_limits<double>::infinity();
+  data[12] = -std::numeric_limits<double>::infinity();
+
+  CheckAllOps<double>(data, 0.0);
+  CheckAllOps<double>(data, 1.25);
+  CheckAllOps<double>(data, -2.0);
+  CheckAllOps<double>(data, std::numeric_limits<double>::infinity());
+  CheckAllOps<double>(data, std::numeric_limits<double>::quiet_NaN());
+}
+
+// Checks MatchRange against the per-value operator for every value in
+// [min, max].
+template <typename Op>
+void CheckMatchRange(int64_t min, int64_t max, int64_t value) {
+  Op op;
+  bool any = false;
+  bool all = true;
+  for (int64_t v = min; v <= max; ++v) {
+    any |= op(v, value);
+    all &= op(v, value);
+  }
+  RangeMatch expected =
+      all ? RangeMatch::kAll : (any ? RangeMatch::kSome : RangeMatch::kNone);
+  ASSERT_EQ(Op::MatchRange(min, max, value), expected)
+      << min << " " << max << " " << value;
+}
+
+TEST(VectorizedFilterUnittest, MatchRange) {
+  for (int64_t min = -3; min <= 3; ++min) {
+    for (int64_t max = min; max <= 3; ++max) {
+      for (int64_t value = -4; value <= 4; ++value) {
+        CheckMatchRange<Lt>(min, max, value);
+        CheckMatchRange<Gt>(min, max, value);
+        CheckMatchRange<Le>(min, max, value);
+        CheckMatchRange<Ge>(min, max, value);
+        CheckMatchRange<Eq>(min, max, value);
+        CheckMatchRange<Ne>(min, max, value);
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace vectorized_filter
+}  // namespace trace_processor
+}  // namespace perfetto
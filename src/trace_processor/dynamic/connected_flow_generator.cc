@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/dynamic/connected_flow_generator.h"
 
+#include <functional>
 #include <memory>
 #include <queue>
 #include <set>
@@ -68,7 +69,7 @@ enum RelativesVisitMode : uint8_t {
 
 // Searches through the slice table recursively to find connected flows.
 // Usage:
-//  BFS bfs = BFS(context);
+//  BFS bfs = BFS(context, &descendant_index, &flow_index, is_over_budget);
 //  bfs
 //    // Add list of slices to start with.
 //    .Start(start_id).Start(start_id2)
@@ -80,7 +81,14 @@ enum RelativesVisitMode : uint8_t {
 //  bfs.TakeResultingFlows();
 class BFS {
  public:
-  BFS(TraceProcessorContext* context) : context_(context) {}
+  BFS(TraceProcessorContext* context,
+      DescendantSliceGenerator::Index* descendant_index,
+      const ConnectedFlowGenerator::FlowIndex* flow_index,
+      std::function<bool()> is_over_budget)
+      : context_(context),
+        descendant_index_(descendant_index),
+        flow_index_(flow_index),
+        is_over_budget_(std::move(is_over_budget)) {}
 
   RowMap TakeResultingFlows() && { return RowMap(std::move(flow_rows_)); }
 
@@ -92,8 +100,11 @@ class BFS {
   }
 
   // Visits all slices that can be reached from the given starting slices.
+  // Stops early if |is_over_budget_| returns true.
   void VisitAll(FlowVisitMode visit_flow, RelativesVisitMode visit_relatives) {
     while (!slices_to_visit_.empty()) {
+      if (is_over_budget_())
+        return;
       SliceId slice_id = slices_to_visit_.front().first;
       VisitType visit_type = slices_to_visit_.front().second;
       slices_to_visit_.pop();
@@ -127,7 +138,7 @@ class BFS {
     }
     if (visit_relatives & VISIT_DESCENDANTS) {
       base::Optional<RowMap> descendants =
-          DescendantSliceGenerator::GetDescendantSlices(
+          descendant_index_->GetDescendantSlices(
               context_->storage->slice_table(), slice_id);
       GoToRelativesImpl(descendants->IterateRows());
     }
@@ -152,18 +163,18 @@ class BFS {
 
     const auto& flow = context_->storage->flow_table();
 
-    const TypedColumn<SliceId>& start_col =
-        (flow_direction == FlowDirection::OUTGOING ? flow.slice_out()
-                                                   : flow.slice_in());
     const TypedColumn<SliceId>& end_col =
         (flow_direction == FlowDirection::OUTGOING ? flow.slice_in()
                                                    : flow.slice_out());
 
-    auto rows = flow.FilterToRowMap({start_col.eq(slice_id.value)});
+    ConnectedFlowGenerator::FlowIndex::Rows rows =
+        flow_direction == FlowDirection::OUTGOING
+            ? flow_index_->GetOutgoingFlows(slice_id)
+            : flow_index_->GetIncomingFlows(slice_id);
 
-    for (auto row_it = rows.IterateRows(); row_it; row_it.Next()) {
-      flow_rows_.push_back(row_it.row());
-      SliceId next_slice_id = end_col[row_it.row()];
+    for (uint32_t row : rows) {
+      flow_rows_.push_back(row);
+      SliceId next_slice_id = end_col[row];
       if (known_slices_.count(next_slice_id) != 0) {
         continue;
       }
@@ -192,6 +203,9 @@ class BFS {
   std::vector<uint32_t> flow_rows_;
 
   TraceProcessorContext* context_;
+  DescendantSliceGenerator::Index* descendant_index_;
+  const ConnectedFlowGenerator::FlowIndex* flow_index_;
+  std::function<bool()> is_over_budget_;
 };
 
 }  // namespace
@@ -215,7 +229,9 @@ std::unique_ptr<Table> ConnectedFlowGenerator::ComputeTable(
     return nullptr;
   }
 
-  BFS bfs(context_);
+  flow_index_.Update(flow, slice);
+  BFS bfs(context_, &descendant_index_, &flow_index_,
+          [this]() { return IsOverQueryBudget(); });
 
   switch (mode_) {
     case Mode::kDirectlyConnectedFlow:
@@ -230,6 +246,9 @@ std::unique_ptr<Table> ConnectedFlowGenerator::ComputeTable(
       break;
   }
 
+  if (IsOverQueryBudget())
+    return nullptr;
+
   RowMap result_rows = std::move(bfs).TakeResultingFlows();
 
   // Aditional column for start_id
@@ -247,11 +266,47 @@ std::unique_ptr<Table> ConnectedFlowGenerator::ComputeTable(
                                           TypedColumn<uint32_t>::kHidden)));
 }
 
+void ConnectedFlowGenerator::FlowIndex::Update(
+    const tables::FlowTable& flows,
+    const tables::SliceTable& slices) {
+  if (indexed_flow_count_ == flows.row_count() &&
+      indexed_slice_count_ == slices.row_count()) {
+    return;
+  }
+  indexed_flow_count_ = flows.row_count();
+  indexed_slice_count_ = slices.row_count();
+
+  auto build = [&flows, &slices](const TypedColumn<SliceId>& col,
+                                 std::vector<uint32_t>* offsets,
+                                 std::vector<uint32_t>* rows) {
+    offsets->assign(slices.row_count() + 1, 0);
+    for (uint32_t row = 0; row < flows.row_count(); ++row) {
+      SliceId id = col[row];
+      if (id.value < slices.row_count())
+        (*offsets)[id.value + 1]++;
+    }
+    for (uint32_t i = 0; i < slices.row_count(); ++i)
+      (*offsets)[i + 1] += (*offsets)[i];
+
+    // Filling in row order keeps the flows of each slice sorted by row.
+    rows->resize(offsets->back());
+    std::vector<uint32_t> pos(offsets->begin(), offsets->end() - 1);
+    for (uint32_t row = 0; row < flows.row_count(); ++row) {
+      SliceId id = col[row];
+      if (id.value < slices.row_count())
+        (*rows)[pos[id.value]++] = row;
+    }
+  };
+  build(flows.slice_out(), &out_offsets_, &out_rows_);
+  build(flows.slice_in(), &in_offsets_, &in_rows_);
+}
+
 Table::Schema ConnectedFlowGenerator::CreateSchema() {
   auto schema = tables::FlowTable::Schema();
   schema.columns.push_back(Table::Schema::Column{
       "start_id", SqlValue::Type::kLong, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ true});
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
   return schema;
 }
 
@@ -17,12 +17,14 @@
 #ifndef SRC_TRACE_PROCESSOR_DYNAMIC_CONNECTED_FLOW_GENERATOR_H_
 #define SRC_TRACE_PROCESSOR_DYNAMIC_CONNECTED_FLOW_GENERATOR_H_
 
+#include "src/trace_processor/dynamic/descendant_slice_generator.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 
 #include "src/trace_processor/storage/trace_storage.h"
 
 #include <queue>
 #include <set>
+#include <vector>
 
 namespace perfetto {
 namespace trace_processor {
@@ -47,6 +49,54 @@ class ConnectedFlowGenerator : public DbSqliteTable::DynamicTableGenerator {
     kFollowingFlow,
   };
 
+  // Adjacency lists of the flow table, in compressed sparse row form: for each
+  // slice, the rows of the flows going out of and into it, in row order. This
+  // avoids filtering the whole flow table for every slice visited.
+  //
+  // The index is built on first use and rebuilt if flows or slices were added
+  // since.
+  class FlowIndex {
+   public:
+    struct Rows {
+      const uint32_t* begin() const { return begin_; }
+      const uint32_t* end() const { return end_; }
+
+      const uint32_t* begin_;
+      const uint32_t* end_;
+    };
+
+    // Builds the index if the tables changed since it was last built.
+    void Update(const tables::FlowTable& flows,
+                const tables::SliceTable& slices);
+
+    Rows GetOutgoingFlows(SliceId slice_id) const {
+      return GetRows(out_offsets_, out_rows_, slice_id);
+    }
+    Rows GetIncomingFlows(SliceId slice_id) const {
+      return GetRows(in_offsets_, in_rows_, slice_id);
+    }
+
+   private:
+    static Rows GetRows(const std::vector<uint32_t>& offsets,
+                        const std::vector<uint32_t>& rows,
+                        SliceId slice_id) {
+      if (slice_id.value + 1 >= offsets.size())
+        return Rows{nullptr, nullptr};
+      return Rows{rows.data() + offsets[slice_id.value],
+                  rows.data() + offsets[slice_id.value + 1]};
+    }
+
+    uint32_t indexed_flow_count_ = 0;
+    uint32_t indexed_slice_count_ = 0;
+
+    // The flows of slice |id| are at [offsets[id.value], offsets[id.value + 1])
+    // in the corresponding rows vector.
+    std::vector<uint32_t> out_offsets_;
+    std::vector<uint32_t> out_rows_;
+    std::vector<uint32_t> in_offsets_;
+    std::vector<uint32_t> in_rows_;
+  };
+
   ConnectedFlowGenerator(Mode mode, TraceProcessorContext* context);
   ~ConnectedFlowGenerator() override;
 
@@ -60,6 +110,8 @@ class ConnectedFlowGenerator : public DbSqliteTable::DynamicTableGenerator {
  private:
   Mode mode_;
   TraceProcessorContext* context_ = nullptr;
+  DescendantSliceGenerator::Index descendant_index_;
+  FlowIndex flow_index_;
 };
 
 }  // namespace trace_processor
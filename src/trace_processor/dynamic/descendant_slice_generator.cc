@@ -16,8 +16,10 @@
 
 #include "src/trace_processor/dynamic/descendant_slice_generator.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
+#include <utility>
 
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -58,7 +60,7 @@ std::unique_ptr<Table> DescendantSliceGenerator::ComputeTable(
   PERFETTO_DCHECK(it != cs.end());
 
   uint32_t start_id = static_cast<uint32_t>(it->value.AsLong());
-  auto descendants = GetDescendantSlices(slice, SliceId(start_id));
+  auto descendants = index_.GetDescendantSlices(slice, SliceId(start_id));
   if (!descendants)
     return nullptr;
   Table reduced_slice = slice.Apply(std::move(*descendants));
@@ -80,7 +82,8 @@ Table::Schema DescendantSliceGenerator::CreateSchema() {
   auto schema = tables::SliceTable::Schema();
   schema.columns.push_back(Table::Schema::Column{
       "start_id", SqlValue::Type::kLong, /* is_id = */ false,
-      /* is_sorted = */ false, /* is_hidden = */ true});
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
   return schema;
 }
 
@@ -92,11 +95,10 @@ uint32_t DescendantSliceGenerator::EstimateRowCount() {
   return 1;
 }
 
-// static
-base::Optional<RowMap> DescendantSliceGenerator::GetDescendantSlices(
-    const tables::SliceTable& slice,
+base::Optional<RowMap> DescendantSliceGenerator::Index::GetDescendantSlices(
+    const tables::SliceTable& slices,
     SliceId start_id) {
-  auto start_row = slice.id().IndexOf(start_id);
+  auto start_row = slices.id().IndexOf(start_id);
   // The query gave an invalid ID that doesn't exist in the slice table.
   if (!start_row) {
     // TODO(lalitm): Ideally this should result in an error, or be filtered out
@@ -108,14 +110,67 @@ base::Optional<RowMap> DescendantSliceGenerator::GetDescendantSlices(
     return base::nullopt;
   }
 
-  // All nested descendents must be on the same track, with a ts between
-  // |start_id.ts| and |start_id.ts| + |start_id.dur|, and who's depth is larger
-  // then |start_row|'s. So we just use Filter to select all relevant slices.
-  return slice.FilterToRowMap(
-      {slice.ts().ge(slice.ts()[*start_row]),
-       slice.ts().le(slice.ts()[*start_row] + slice.dur()[*start_row]),
-       slice.track_id().eq(slice.track_id()[*start_row].value),
-       slice.depth().gt(slice.depth()[*start_row])});
+  if (indexed_row_count_ != slices.row_count())
+    Build(slices);
+
+  // Return the descendants in the order of the slice table.
+  std::vector<uint32_t> rows(preorder_.begin() + enter_idx_[*start_row] + 1,
+                             preorder_.begin() + exit_idx_[*start_row]);
+  std::sort(rows.begin(), rows.end());
+  return RowMap(std::move(rows));
+}
+
+void DescendantSliceGenerator::Index::Build(const tables::SliceTable& slices) {
+  uint32_t row_count = slices.row_count();
+
+  // Lay out the children of each slice contiguously, ordered by row.
+  std::vector<uint32_t> parent_row(row_count);
+  std::vector<uint32_t> child_offsets(row_count + 1);
+  for (uint32_t row = 0; row < row_count; ++row) {
+    base::Optional<SliceId> parent_id = slices.parent_id()[row];
+    parent_row[row] = parent_id ? *slices.id().IndexOf(*parent_id) : row;
+    if (parent_row[row] != row)
+      child_offsets[parent_row[row] + 1]++;
+  }
+  for (uint32_t row = 0; row < row_count; ++row)
+    child_offsets[row + 1] += child_offsets[row];
+  std::vector<uint32_t> children(child_offsets[row_count]);
+  std::vector<uint32_t> child_pos(child_offsets.begin(),
+                                  child_offsets.end() - 1);
+  for (uint32_t row = 0; row < row_count; ++row) {
+    if (parent_row[row] != row)
+      children[child_pos[parent_row[row]]++] = row;
+  }
+
+  // Walk each tree in preorder. The stack is simulated as some traces have
+  // very deep slice stacks.
+  preorder_.clear();
+  preorder_.reserve(row_count);
+  enter_idx_.assign(row_count, 0);
+  exit_idx_.assign(row_count, 0);
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  for (uint32_t root = 0; root < row_count; ++root) {
+    if (parent_row[root] != root)
+      continue;
+    enter_idx_[root] = static_cast<uint32_t>(preorder_.size());
+    preorder_.push_back(root);
+    stack.emplace_back(root, child_offsets[root]);
+    while (!stack.empty()) {
+      uint32_t row = stack.back().first;
+      uint32_t child_idx = stack.back().second;
+      if (child_idx == child_offsets[row + 1]) {
+        exit_idx_[row] = static_cast<uint32_t>(preorder_.size());
+        stack.pop_back();
+        continue;
+      }
+      stack.back().second++;
+      uint32_t child = children[child_idx];
+      enter_idx_[child] = static_cast<uint32_t>(preorder_.size());
+      preorder_.push_back(child);
+      stack.emplace_back(child, child_offsets[child]);
+    }
+  }
+  indexed_row_count_ = row_count;
 }
 
 }  // namespace trace_processor
@@ -17,6 +17,8 @@
 #ifndef SRC_TRACE_PROCESSOR_DYNAMIC_DESCENDANT_SLICE_GENERATOR_H_
 #define SRC_TRACE_PROCESSOR_DYNAMIC_DESCENDANT_SLICE_GENERATOR_H_
 
+#include <vector>
+
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 
 #include "perfetto/ext/base/optional.h"
@@ -32,6 +34,34 @@ class TraceProcessorContext;
 // table.
 class DescendantSliceGenerator : public DbSqliteTable::DynamicTableGenerator {
  public:
+  // Nested set encoding of the slice trees: the slices of each tree are
+  // stored in preorder so the descendants of a slice are the slices which
+  // follow it, up to the end of its subtree. This allows looking up the
+  // descendants of many slices without filtering the slice table for each of
+  // them.
+  //
+  // The index is built on first use and rebuilt if slices were added since.
+  class Index {
+   public:
+    // Returns a RowMap of slice IDs which are descendants of |start_id|.
+    // Returns NULL if an invalid |start_id| is given.
+    base::Optional<RowMap> GetDescendantSlices(
+        const tables::SliceTable& slices,
+        SliceId start_id);
+
+   private:
+    void Build(const tables::SliceTable& slices);
+
+    uint32_t indexed_row_count_ = 0;
+
+    // The rows of the slice table, in preorder of the slice trees.
+    std::vector<uint32_t> preorder_;
+    // For each row: the position of the row in |preorder_| and the position
+    // one past the last of its descendants.
+    std::vector<uint32_t> enter_idx_;
+    std::vector<uint32_t> exit_idx_;
+  };
+
   explicit DescendantSliceGenerator(TraceProcessorContext* context);
   ~DescendantSliceGenerator() override;
 
@@ -42,15 +72,9 @@ class DescendantSliceGenerator : public DbSqliteTable::DynamicTableGenerator {
   std::unique_ptr<Table> ComputeTable(const std::vector<Constraint>& cs,
                                       const std::vector<Order>& ob) override;
 
-  // Returns a RowMap of slice IDs which are descendants of |slice_id|. Returns
-  // NULL if an invalid |slice_id| is given. This is used by
-  // ConnectedFlowGenerator to traverse flow indirectly connected flow events.
-  static base::Optional<RowMap> GetDescendantSlices(
-      const tables::SliceTable& slices,
-      SliceId start_id);
-
  private:
   TraceProcessorContext* context_ = nullptr;
+  Index index_;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/descendant_slice_generator.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class DescendantSliceIndexTest : public ::testing::Test {
+ protected:
+  DescendantSliceIndexTest() : slices_(&pool_, nullptr) {}
+
+  SliceId Insert(int64_t ts,
+                 int64_t dur,
+                 uint32_t track_id,
+                 base::Optional<SliceId> parent_id) {
+    tables::SliceTable::Row row;
+    row.ts = ts;
+    row.dur = dur;
+    row.depth = 0;
+    if (parent_id) {
+      row.depth = slices_.depth()[*slices_.id().IndexOf(*parent_id)] + 1;
+    }
+    row.track_id = TrackId{track_id};
+    row.parent_id = parent_id;
+    return slices_.Insert(row).id;
+  }
+
+  std::vector<uint32_t> Descendants(SliceId id) {
+    base::Optional<RowMap> rows = index_.GetDescendantSlices(slices_, id);
+    EXPECT_TRUE(rows.has_value());
+    std::vector<uint32_t> ids;
+    for (auto it = rows->IterateRows(); it; it.Next())
+      ids.push_back(slices_.id()[it.row()].value);
+    return ids;
+  }
+
+  StringPool pool_;
+  tables::SliceTable slices_;
+  DescendantSliceGenerator::Index index_;
+};
+
+TEST_F(DescendantSliceIndexTest, Trees) {
+  SliceId a = Insert(0, 10, 1, base::nullopt);
+  SliceId b = Insert(1, 2, 1, a);
+  SliceId other_track = Insert(1, 5, 2, base::nullopt);
+  SliceId c = Insert(1, 1, 1, b);
+  SliceId d = Insert(5, 5, 1, a);
+  SliceId e = Insert(10, 0, 1, d);
+
+  ASSERT_THAT(Descendants(a), ElementsAre(b.value, c.value, d.value, e.value));
+  ASSERT_THAT(Descendants(b), ElementsAre(c.value));
+  ASSERT_THAT(Descendants(d), ElementsAre(e.value));
+  ASSERT_THAT(Descendants(c), IsEmpty());
+  ASSERT_THAT(Descendants(other_track), IsEmpty());
+  ASSERT_FALSE(index_.GetDescendantSlices(slices_, SliceId(100)).has_value());
+}
+
+TEST_F(DescendantSliceIndexTest, RebuiltAfterInsert) {
+  SliceId a = Insert(0, 10, 1, base::nullopt);
+  SliceId b = Insert(1, 2, 1, a);
+  ASSERT_THAT(Descendants(a), ElementsAre(b.value));
+
+  SliceId c = Insert(2, 1, 1, b);
+  ASSERT_THAT(Descendants(a), ElementsAre(b.value, c.value));
+  ASSERT_THAT(Descendants(b), ElementsAre(c.value));
+}
+
+TEST_F(DescendantSliceIndexTest, DeepStack) {
+  // Deep enough to overflow the stack if the tree walk was recursive.
+  const uint32_t kDepth = 100000;
+  base::Optional<SliceId> parent;
+  std::vector<SliceId> ids;
+  for (uint32_t i = 0; i < kDepth; ++i) {
+    parent = Insert(i, 2 * (kDepth - i), 1, parent);
+    ids.push_back(*parent);
+  }
+  ASSERT_EQ(Descendants(ids[0]).size(), kDepth - 1);
+  ASSERT_THAT(Descendants(ids[kDepth - 2]), ElementsAre(ids.back().value));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/dynamic/experimental_flamegraph_generator.h"
 
+#include <unordered_map>
+
 #include "perfetto/ext/base/string_utils.h"
 
 #include "src/trace_processor/importers/proto/heap_graph_tracker.h"
@@ -100,12 +102,22 @@ std::vector<FocusedState> ComputeFocusedState(
   // ptr. Root trees (no parents) will have a null parent ptr.
   std::vector<FocusedState> focused(table.row_count());
 
+  // Many nodes share the same name so only match each name once.
+  std::unordered_map<StringPool::Id, bool> name_matches;
+
   for (uint32_t i = 0; i < table.row_count(); ++i) {
     auto parent_id = table.parent_id()[i];
     // Constraint: all descendants MUST come after their parents.
     PERFETTO_DCHECK(!parent_id.has_value() || *parent_id < table.id()[i]);
 
-    if (focus_matcher.matches(table.name().GetString(i).ToStdString())) {
+    StringPool::Id name = table.name()[i];
+    auto name_it = name_matches.find(name);
+    if (name_it == name_matches.end()) {
+      bool matches =
+          focus_matcher.matches(table.name().GetString(i).ToStdString());
+      name_it = name_matches.emplace(name, matches).first;
+    }
+    if (name_it->second) {
       // Mark as focused
       focused[i] = FocusedState::kFocusedPropagating;
       auto current = parent_id;
@@ -139,11 +151,8 @@ struct CumulativeCounts {
 };
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> FocusTable(
     TraceStorage* storage,
-    std::unique_ptr<ExperimentalFlamegraphNodesTable> in,
+    const ExperimentalFlamegraphNodesTable* in,
     const std::string& focus_str) {
-  if (in->row_count() == 0 || focus_str.empty()) {
-    return in;
-  }
   std::vector<FocusedState> focused_state =
       ComputeFocusedState(*in, Matcher(focus_str));
   std::unique_ptr<ExperimentalFlamegraphNodesTable> tbl(
@@ -254,25 +263,39 @@ std::unique_ptr<Table> ExperimentalFlamegraphGenerator::ComputeTable(
   // Get the input column values and compute the flamegraph using them.
   auto values = GetFlamegraphInputValues(cs);
 
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> table;
-  if (values.profile_type == "graph") {
-    auto* tracker = HeapGraphTracker::GetOrCreate(context_);
-    table = tracker->BuildFlamegraph(values.ts, values.upid);
-  }
-  if (values.profile_type == "native") {
-    table =
-        BuildNativeFlamegraph(context_->storage.get(), values.upid, values.ts);
-  }
-  if (!values.focus_str.empty()) {
-    table =
-        FocusTable(context_->storage.get(), std::move(table), values.focus_str);
-    // The pseudocolumns must be populated because as far as SQLite is
-    // concerned these are equality constraints.
-    auto focus_id =
-        context_->storage->InternString(base::StringView(values.focus_str));
-    for (uint32_t i = 0; i < table->row_count(); ++i) {
-      table->mutable_focus_str()->Set(i, focus_id);
+  // Building the flamegraph is expensive and the UI queries the same one
+  // over and over again (e.g. for every change of the focus string) so
+  // reuse the flamegraphs we have already built.
+  auto key = std::make_tuple(values.profile_type, values.upid, values.ts);
+  auto it = flamegraph_cache_.find(key);
+  if (it == flamegraph_cache_.end()) {
+    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> flamegraph;
+    if (values.profile_type == "graph") {
+      auto* tracker = HeapGraphTracker::GetOrCreate(context_);
+      flamegraph = tracker->BuildFlamegraph(values.ts, values.upid);
     }
+    if (values.profile_type == "native") {
+      flamegraph = BuildNativeFlamegraph(context_->storage.get(), values.upid,
+                                         values.ts);
+    }
+    if (!flamegraph)
+      return nullptr;
+    it = flamegraph_cache_.emplace(key, std::move(flamegraph)).first;
+  }
+  const tables::ExperimentalFlamegraphNodesTable* flamegraph =
+      it->second.get();
+
+  if (values.focus_str.empty())
+    return std::unique_ptr<Table>(new Table(flamegraph->Copy()));
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> table =
+      FocusTable(context_->storage.get(), flamegraph, values.focus_str);
+  // The pseudocolumns must be populated because as far as SQLite is
+  // concerned these are equality constraints.
+  auto focus_id =
+      context_->storage->InternString(base::StringView(values.focus_str));
+  for (uint32_t i = 0; i < table->row_count(); ++i) {
+    table->mutable_focus_str()->Set(i, focus_id);
   }
   // We need to explicitly std::move as clang complains about a bug in old
   // compilers otherwise (-Wreturn-std-move-in-c++11).
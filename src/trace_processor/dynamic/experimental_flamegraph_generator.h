@@ -17,6 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_FLAMEGRAPH_GENERATOR_H_
 #define SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_FLAMEGRAPH_GENERATOR_H_
 
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 
 #include "src/trace_processor/storage/trace_storage.h"
@@ -48,6 +53,13 @@ class ExperimentalFlamegraphGenerator
 
  private:
   TraceProcessorContext* context_ = nullptr;
+
+  // Flamegraphs without focus, by (profile_type, upid, ts).
+  // TODO(lalitm): remove this cache and move to having explicitly scoped
+  // lifetimes of dynamic tables.
+  std::map<std::tuple<std::string, UniquePid, int64_t>,
+           std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>>
+      flamegraph_cache_;
 };
 
 }  // namespace trace_processor
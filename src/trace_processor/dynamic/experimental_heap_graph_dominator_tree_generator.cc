@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_heap_graph_dominator_tree_generator.h"
+
+#include <algorithm>
+
+#include "src/trace_processor/importers/proto/heap_graph_tracker.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+using Generator = ExperimentalHeapGraphDominatorTreeGenerator;
+using T = tables::ExperimentalHeapGraphDominatorTreeTable;
+
+constexpr uint32_t kNone = Generator::kNoDominator;
+
+// State of the Lengauer-Tarjan algorithm. All the nodes are identified by
+// their DFS number.
+class LengauerTarjan {
+ public:
+  explicit LengauerTarjan(uint32_t size)
+      : semi_(size), best_(size), ancestor_(size, kNone) {}
+
+  // Adds the edge |parent| -> |node| of the DFS tree to the forest.
+  void Link(uint32_t parent, uint32_t node) {
+    ancestor_[node] = parent;
+    best_[node] = node;
+  }
+
+  // Returns the node with the lowest semi-dominator on the path from |node|
+  // to the root of its tree in the forest, excluding the root. Compresses
+  // the path on the way.
+  uint32_t Eval(uint32_t node) {
+    PERFETTO_DCHECK(ancestor_[node] != kNone);
+    path_.clear();
+    for (uint32_t n = node; ancestor_[ancestor_[n]] != kNone; n = ancestor_[n])
+      path_.push_back(n);
+    for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+      uint32_t n = *it;
+      uint32_t a = ancestor_[n];
+      if (semi_[best_[a]] < semi_[best_[n]])
+        best_[n] = best_[a];
+      ancestor_[n] = ancestor_[a];
+    }
+    return best_[node];
+  }
+
+  std::vector<uint32_t>& semi() { return semi_; }
+
+ private:
+  std::vector<uint32_t> semi_;
+  std::vector<uint32_t> best_;
+  std::vector<uint32_t> ancestor_;
+
+  // Scratch space for Eval(), kept to avoid reallocations.
+  std::vector<uint32_t> path_;
+};
+
+Generator::DominatorTree ComputeDominatorTreeImpl(
+    const std::vector<uint32_t>& offsets,
+    const std::vector<uint32_t>& targets) {
+  uint32_t node_count = static_cast<uint32_t>(offsets.size() - 1);
+  Generator::DominatorTree tree;
+  tree.idom.assign(node_count, kNone);
+  if (node_count == 0)
+    return tree;
+
+  // Number the nodes in DFS preorder. The stack is simulated as the paths
+  // in heap graphs are often longer than the native stack allows.
+  std::vector<uint32_t> dfs_number(node_count, kNone);
+  std::vector<uint32_t>& vertex = tree.order;
+  std::vector<uint32_t> parent;
+  std::vector<std::pair<uint32_t, uint32_t>> stack{{0, offsets[0]}};
+  dfs_number[0] = 0;
+  vertex.push_back(0);
+  parent.push_back(kNone);
+  while (!stack.empty()) {
+    uint32_t node = stack.back().first;
+    uint32_t edge = stack.back().second;
+    if (edge == offsets[node + 1]) {
+      stack.pop_back();
+      continue;
+    }
+    stack.back().second++;
+    uint32_t succ = targets[edge];
+    if (dfs_number[succ] != kNone)
+      continue;
+    dfs_number[succ] = static_cast<uint32_t>(vertex.size());
+    vertex.push_back(succ);
+    parent.push_back(dfs_number[node]);
+    stack.emplace_back(succ, offsets[succ]);
+  }
+
+  // Predecessors of the reachable nodes, by DFS number.
+  uint32_t reachable = static_cast<uint32_t>(vertex.size());
+  std::vector<uint32_t> pred_offsets(reachable + 1);
+  for (uint32_t n = 0; n < reachable; ++n) {
+    uint32_t node = vertex[n];
+    for (uint32_t e = offsets[node]; e < offsets[node + 1]; ++e)
+      pred_offsets[dfs_number[targets[e]] + 1]++;
+  }
+  for (uint32_t n = 0; n < reachable; ++n)
+    pred_offsets[n + 1] += pred_offsets[n];
+  std::vector<uint32_t> preds(pred_offsets[reachable]);
+  std::vector<uint32_t> pred_pos(pred_offsets.begin(), pred_offsets.end() - 1);
+  for (uint32_t n = 0; n < reachable; ++n) {
+    uint32_t node = vertex[n];
+    for (uint32_t e = offsets[node]; e < offsets[node + 1]; ++e)
+      preds[pred_pos[dfs_number[targets[e]]]++] = n;
+  }
+
+  LengauerTarjan lt(reachable);
+  std::vector<uint32_t>& semi = lt.semi();
+  std::vector<uint32_t> idom(reachable, kNone);
+  std::vector<uint32_t> same_dom(reachable, kNone);
+  // Each bucket is a linked list of the nodes with the same semi-dominator.
+  std::vector<uint32_t> bucket_head(reachable, kNone);
+  std::vector<uint32_t> bucket_next(reachable, kNone);
+  for (uint32_t n = reachable - 1; n > 0; --n) {
+    uint32_t p = parent[n];
+    uint32_t s = p;
+    for (uint32_t i = pred_offsets[n]; i < pred_offsets[n + 1]; ++i) {
+      uint32_t v = preds[i];
+      uint32_t candidate = v <= n ? v : semi[lt.Eval(v)];
+      s = std::min(s, candidate);
+    }
+    semi[n] = s;
+    bucket_next[n] = bucket_head[s];
+    bucket_head[s] = n;
+    lt.Link(p, n);
+
+    for (uint32_t v = bucket_head[p]; v != kNone; v = bucket_next[v]) {
+      uint32_t y = lt.Eval(v);
+      if (semi[y] == semi[v]) {
+        idom[v] = p;
+      } else {
+        same_dom[v] = y;
+      }
+    }
+    bucket_head[p] = kNone;
+  }
+  for (uint32_t n = 1; n < reachable; ++n) {
+    if (same_dom[n] != kNone)
+      idom[n] = idom[same_dom[n]];
+    tree.idom[vertex[n]] = vertex[idom[n]];
+  }
+  return tree;
+}
+
+}  // namespace
+
+constexpr uint32_t ExperimentalHeapGraphDominatorTreeGenerator::kNoDominator;
+
+ExperimentalHeapGraphDominatorTreeGenerator::
+    ExperimentalHeapGraphDominatorTreeGenerator(TraceProcessorContext* context)
+    : context_(context) {}
+
+ExperimentalHeapGraphDominatorTreeGenerator::
+    ~ExperimentalHeapGraphDominatorTreeGenerator() = default;
+
+Table::Schema ExperimentalHeapGraphDominatorTreeGenerator::CreateSchema() {
+  return T::Schema();
+}
+
+std::string ExperimentalHeapGraphDominatorTreeGenerator::TableName() {
+  return "experimental_heap_graph_dominator_tree";
+}
+
+uint32_t ExperimentalHeapGraphDominatorTreeGenerator::EstimateRowCount() {
+  return context_->storage->heap_graph_object_table().row_count();
+}
+
+util::Status ExperimentalHeapGraphDominatorTreeGenerator::ValidateConstraints(
+    const QueryConstraints& qc) {
+  const auto& cs = qc.constraints();
+
+  auto upid_fn = [](const QueryConstraints::Constraint& c) {
+    return c.column == static_cast<int>(T::ColumnIndex::upid) &&
+           c.op == SQLITE_INDEX_CONSTRAINT_EQ;
+  };
+  bool has_upid_cs = std::find_if(cs.begin(), cs.end(), upid_fn) != cs.end();
+
+  auto ts_fn = [](const QueryConstraints::Constraint& c) {
+    return c.column == static_cast<int>(T::ColumnIndex::graph_sample_ts) &&
+           c.op == SQLITE_INDEX_CONSTRAINT_EQ;
+  };
+  bool has_ts_cs = std::find_if(cs.begin(), cs.end(), ts_fn) != cs.end();
+
+  return has_upid_cs && has_ts_cs
+             ? util::OkStatus()
+             : util::ErrStatus("Failed to find required constraints");
+}
+
+std::unique_ptr<Table>
+ExperimentalHeapGraphDominatorTreeGenerator::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&) {
+  auto upid_fn = [](const Constraint& c) {
+    return c.col_idx == static_cast<uint32_t>(T::ColumnIndex::upid) &&
+           c.op == FilterOp::kEq;
+  };
+  auto ts_fn = [](const Constraint& c) {
+    return c.col_idx ==
+               static_cast<uint32_t>(T::ColumnIndex::graph_sample_ts) &&
+           c.op == FilterOp::kEq;
+  };
+  auto upid_it = std::find_if(cs.begin(), cs.end(), upid_fn);
+  auto ts_it = std::find_if(cs.begin(), cs.end(), ts_fn);
+
+  // We should always have valid iterators here because BestIndex should only
+  // allow the constraint set to be chosen when we have an equality constraint
+  // on both upid and graph_sample_ts.
+  PERFETTO_CHECK(upid_it != cs.end());
+  PERFETTO_CHECK(ts_it != cs.end());
+
+  auto key = std::make_pair(static_cast<UniquePid>(upid_it->value.AsLong()),
+                            ts_it->value.AsLong());
+  auto it = dominator_tree_cache_.find(key);
+  if (it == dominator_tree_cache_.end()) {
+    auto table = ComputeDominatorTreeTable(context_->storage.get(), key.first,
+                                           key.second);
+    it = dominator_tree_cache_.emplace(key, std::move(table)).first;
+  }
+  return std::unique_ptr<Table>(new Table(it->second->Copy()));
+}
+
+// static
+ExperimentalHeapGraphDominatorTreeGenerator::DominatorTree
+ExperimentalHeapGraphDominatorTreeGenerator::ComputeDominatorTree(
+    const std::vector<uint32_t>& offsets,
+    const std::vector<uint32_t>& targets) {
+  return ComputeDominatorTreeImpl(offsets, targets);
+}
+
+// static
+std::unique_ptr<tables::ExperimentalHeapGraphDominatorTreeTable>
+ExperimentalHeapGraphDominatorTreeGenerator::ComputeDominatorTreeTable(
+    TraceStorage* storage,
+    UniquePid upid,
+    int64_t graph_sample_ts) {
+  const auto& objects = storage->heap_graph_object_table();
+  const auto& classes = storage->heap_graph_class_table();
+  const auto& references = storage->heap_graph_reference_table();
+
+  // Node 0 is a virtual root referring to all the GC roots of the graph. The
+  // other nodes are the objects of the graph.
+  std::vector<uint32_t> node_for_row(objects.row_count(), kNone);
+  std::vector<uint32_t> row_for_node{kNone};
+  std::vector<uint32_t> targets;
+  for (uint32_t row = 0; row < objects.row_count(); ++row) {
+    if (objects.upid()[row] != upid ||
+        objects.graph_sample_ts()[row] != graph_sample_ts) {
+      continue;
+    }
+    uint32_t node = static_cast<uint32_t>(row_for_node.size());
+    node_for_row[row] = node;
+    row_for_node.push_back(row);
+    if (objects.root_type()[row])
+      targets.push_back(node);
+  }
+
+  // Lay out the references of each object contiguously, as the heap graph
+  // reference table does.
+  std::vector<StringPool::Id> weak_reference_kinds =
+      GetWeakReferenceKinds(*storage);
+  uint32_t node_count = static_cast<uint32_t>(row_for_node.size());
+  std::vector<uint32_t> offsets{0, static_cast<uint32_t>(targets.size())};
+  for (uint32_t node = 1; node < node_count; ++node) {
+    uint32_t row = row_for_node[node];
+    base::Optional<uint32_t> reference_set_id = objects.reference_set_id()[row];
+    uint32_t class_row = *classes.id().IndexOf(objects.type_id()[row]);
+    StringPool::Id kind = classes.kind()[class_row];
+    // Do not follow weak / soft / finalizer / phantom references.
+    bool is_weak =
+        std::find(weak_reference_kinds.begin(), weak_reference_kinds.end(),
+                  kind) != weak_reference_kinds.end();
+    if (reference_set_id && !is_weak) {
+      for (uint32_t ref_row = *reference_set_id;
+           ref_row < references.row_count() &&
+           references.reference_set_id()[ref_row] == *reference_set_id;
+           ++ref_row) {
+        base::Optional<tables::HeapGraphObjectTable::Id> owned_id =
+            references.owned_id()[ref_row];
+        if (!owned_id)
+          continue;
+        uint32_t owned_node = node_for_row[*objects.id().IndexOf(*owned_id)];
+        if (owned_node != kNone)
+          targets.push_back(owned_node);
+      }
+    }
+    offsets.push_back(static_cast<uint32_t>(targets.size()));
+  }
+
+  DominatorTree tree = ComputeDominatorTree(offsets, targets);
+
+  std::vector<int64_t> dominated_size(node_count);
+  std::vector<int64_t> dominated_count(node_count);
+  for (auto it = tree.order.rbegin(); it != tree.order.rend(); ++it) {
+    uint32_t node = *it;
+    if (node == 0)
+      continue;
+    dominated_size[node] += objects.self_size()[row_for_node[node]];
+    dominated_count[node]++;
+    uint32_t idom = tree.idom[node];
+    dominated_size[idom] += dominated_size[node];
+    dominated_count[idom] += dominated_count[node];
+  }
+
+  std::unique_ptr<T> table(new T(storage->mutable_string_pool(), nullptr));
+  std::vector<uint32_t> depth(node_count);
+  for (uint32_t node : tree.order) {
+    if (node == 0)
+      continue;
+    uint32_t idom = tree.idom[node];
+    T::Row row;
+    row.upid = upid;
+    row.graph_sample_ts = graph_sample_ts;
+    row.object_id = objects.id()[row_for_node[node]];
+    if (idom != 0) {
+      row.idom_id = objects.id()[row_for_node[idom]];
+      depth[node] = depth[idom] + 1;
+    }
+    row.depth = depth[node];
+    row.dominated_size = dominated_size[node];
+    row.dominated_count = dominated_count[node];
+    table->Insert(row);
+  }
+  return table;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_HEAP_GRAPH_DOMINATOR_TREE_GENERATOR_H_
+#define SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_HEAP_GRAPH_DOMINATOR_TREE_GENERATOR_H_
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceProcessorContext;
+
+// Computes the dominator tree of the heap graph with the given upid and
+// graph_sample_ts. The trees are cached as the objects of a graph never
+// change once it has been imported.
+class ExperimentalHeapGraphDominatorTreeGenerator
+    : public DbSqliteTable::DynamicTableGenerator {
+ public:
+  static constexpr uint32_t kNoDominator = std::numeric_limits<uint32_t>::max();
+
+  // Dominator tree of a graph, see ComputeDominatorTree().
+  struct DominatorTree {
+    // The immediate dominator of each node. kNoDominator for the root and for
+    // the nodes which cannot be reached from it.
+    std::vector<uint32_t> idom;
+
+    // The nodes reachable from the root, in DFS preorder: every node comes
+    // after its immediate dominator.
+    std::vector<uint32_t> order;
+  };
+
+  explicit ExperimentalHeapGraphDominatorTreeGenerator(
+      TraceProcessorContext* context);
+  ~ExperimentalHeapGraphDominatorTreeGenerator() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  util::Status ValidateConstraints(const QueryConstraints&) override;
+  std::unique_ptr<Table> ComputeTable(const std::vector<Constraint>& cs,
+                                      const std::vector<Order>& ob) override;
+
+  // Computes the dominator tree of the graph rooted at node 0 using the
+  // Lengauer-Tarjan algorithm. The successors of node i are
+  // |targets[offsets[i]]| to |targets[offsets[i + 1] - 1]|.
+  static DominatorTree ComputeDominatorTree(
+      const std::vector<uint32_t>& offsets,
+      const std::vector<uint32_t>& targets);
+
+  // Exposed for testing.
+  static std::unique_ptr<tables::ExperimentalHeapGraphDominatorTreeTable>
+  ComputeDominatorTreeTable(TraceStorage* storage,
+                            UniquePid upid,
+                            int64_t graph_sample_ts);
+
+ private:
+  TraceProcessorContext* context_ = nullptr;
+
+  // TODO(lalitm): remove this cache and move to having explicitly scoped
+  // lifetimes of dynamic tables.
+  std::map<std::pair<UniquePid, int64_t>,
+           std::unique_ptr<tables::ExperimentalHeapGraphDominatorTreeTable>>
+      dominator_tree_cache_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_HEAP_GRAPH_DOMINATOR_TREE_GENERATOR_H_
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_heap_graph_dominator_tree_generator.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Generator = ExperimentalHeapGraphDominatorTreeGenerator;
+using ::testing::ElementsAre;
+
+// Lays out the adjacency lists of |edges| as ComputeDominatorTree() expects.
+void ToOffsets(const std::vector<std::vector<uint32_t>>& edges,
+               std::vector<uint32_t>* offsets,
+               std::vector<uint32_t>* targets) {
+  offsets->push_back(0);
+  for (const auto& succs : edges) {
+    targets->insert(targets->end(), succs.begin(), succs.end());
+    offsets->push_back(static_cast<uint32_t>(targets->size()));
+  }
+}
+
+TEST(ExperimentalHeapGraphDominatorTreeGenerator, LengauerTarjanExample) {
+  // The example graph of the Lengauer-Tarjan paper.
+  enum { R, A, B, C, D, E, F, G, H, I, J, K, L };
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> targets;
+  ToOffsets({/* R */ {A, B, C},
+             /* A */ {D},
+             /* B */ {A, D, E},
+             /* C */ {F, G},
+             /* D */ {L},
+             /* E */ {H},
+             /* F */ {I},
+             /* G */ {I, J},
+             /* H */ {E, K},
+             /* I */ {K},
+             /* J */ {I},
+             /* K */ {I, R},
+             /* L */ {H}},
+            &offsets, &targets);
+
+  Generator::DominatorTree tree =
+      Generator::ComputeDominatorTree(offsets, targets);
+  const uint32_t kNo = Generator::kNoDominator;
+  ASSERT_THAT(tree.idom,
+              ElementsAre(kNo, R, R, R, R, R, C, C, R, R, G, R, D));
+  ASSERT_EQ(tree.order.size(), 13u);
+  ASSERT_EQ(tree.order[0], static_cast<uint32_t>(R));
+}
+
+TEST(ExperimentalHeapGraphDominatorTreeGenerator, UnreachableNodes) {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> targets;
+  ToOffsets({{1}, {2}, {}, {1}}, &offsets, &targets);
+
+  Generator::DominatorTree tree =
+      Generator::ComputeDominatorTree(offsets, targets);
+  const uint32_t kNo = Generator::kNoDominator;
+  ASSERT_THAT(tree.idom, ElementsAre(kNo, 0u, 1u, kNo));
+  ASSERT_THAT(tree.order, ElementsAre(0u, 1u, 2u));
+}
+
+TEST(ExperimentalHeapGraphDominatorTreeGenerator, LongChain) {
+  // Long enough to overflow the stack if the DFS was recursive.
+  const uint32_t kSize = 1000000;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> targets;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    offsets.push_back(i);
+    targets.push_back((i + 1) % kSize);
+  }
+  offsets.push_back(kSize);
+
+  Generator::DominatorTree tree =
+      Generator::ComputeDominatorTree(offsets, targets);
+  for (uint32_t i = 1; i < kSize; ++i)
+    ASSERT_EQ(tree.idom[i], i - 1);
+}
+
+class DominatorTreeTableTest : public ::testing::Test {
+ protected:
+  DominatorTreeTableTest() {
+    tables::HeapGraphClassTable::Row normal;
+    normal.name = storage_.InternString("Normal");
+    normal.kind = storage_.InternString("KIND_NORMAL");
+    normal_class_ = storage_.mutable_heap_graph_class_table()->Insert(normal).id;
+
+    tables::HeapGraphClassTable::Row weak;
+    weak.name = storage_.InternString("java.lang.ref.WeakReference");
+    weak.kind = storage_.InternString("KIND_WEAK_REFERENCE");
+    weak_class_ = storage_.mutable_heap_graph_class_table()->Insert(weak).id;
+  }
+
+  tables::HeapGraphObjectTable::Id AddObject(
+      int64_t ts,
+      int64_t self_size,
+      bool is_root = false,
+      bool is_weak = false) {
+    tables::HeapGraphObjectTable::Row row;
+    row.upid = 1;
+    row.graph_sample_ts = ts;
+    row.self_size = self_size;
+    row.type_id = is_weak ? weak_class_ : normal_class_;
+    if (is_root)
+      row.root_type = storage_.InternString("ROOT_JNI_GLOBAL");
+    return storage_.mutable_heap_graph_object_table()->Insert(row).id;
+  }
+
+  void AddReferences(
+      tables::HeapGraphObjectTable::Id owner,
+      std::vector<tables::HeapGraphObjectTable::Id> owned_objects) {
+    auto* references = storage_.mutable_heap_graph_reference_table();
+    uint32_t reference_set_id = references->row_count();
+    for (tables::HeapGraphObjectTable::Id owned : owned_objects) {
+      tables::HeapGraphReferenceTable::Row row;
+      row.reference_set_id = reference_set_id;
+      row.owner_id = owner;
+      row.owned_id = owned;
+      references->Insert(row);
+    }
+    auto* objects = storage_.mutable_heap_graph_object_table();
+    objects->mutable_reference_set_id()->Set(*objects->id().IndexOf(owner),
+                                             reference_set_id);
+  }
+
+  TraceStorage storage_;
+  tables::HeapGraphClassTable::Id normal_class_{0};
+  tables::HeapGraphClassTable::Id weak_class_{0};
+};
+
+TEST_F(DominatorTreeTableTest, Smoke) {
+  auto root = AddObject(10, 1, /*is_root=*/true);
+  auto a = AddObject(10, 2);
+  auto b = AddObject(10, 4);
+  auto c = AddObject(10, 8);
+  auto d = AddObject(10, 16);
+  auto weak = AddObject(10, 32, /*is_root=*/false, /*is_weak=*/true);
+  auto only_weakly_reachable = AddObject(10, 64);
+  auto other_graph = AddObject(20, 128, /*is_root=*/true);
+  AddReferences(root, {a, b, weak});
+  AddReferences(a, {c});
+  AddReferences(b, {c});
+  AddReferences(c, {d});
+  AddReferences(weak, {only_weakly_reachable});
+  AddReferences(other_graph, {a});
+
+  auto table = Generator::ComputeDominatorTreeTable(&storage_, 1, 10);
+  ASSERT_EQ(table->row_count(), 6u);
+
+  struct Node {
+    base::Optional<tables::HeapGraphObjectTable::Id> idom;
+    uint32_t depth;
+    int64_t size;
+    int64_t count;
+  };
+  std::map<uint32_t, Node> nodes;
+  for (uint32_t i = 0; i < table->row_count(); ++i) {
+    ASSERT_EQ(table->upid()[i], 1u);
+    ASSERT_EQ(table->graph_sample_ts()[i], 10);
+    nodes[table->object_id()[i].value] =
+        Node{table->idom_id()[i], table->depth()[i],
+             table->dominated_size()[i], table->dominated_count()[i]};
+  }
+  ASSERT_EQ(nodes.count(only_weakly_reachable.value), 0u);
+  ASSERT_EQ(nodes.count(other_graph.value), 0u);
+
+  ASSERT_EQ(nodes[root.value].idom, base::nullopt);
+  ASSERT_EQ(nodes[root.value].depth, 0u);
+  ASSERT_EQ(nodes[root.value].size, 63);
+  ASSERT_EQ(nodes[root.value].count, 6);
+
+  ASSERT_EQ(nodes[a.value].idom, root);
+  ASSERT_EQ(nodes[a.value].size, 2);
+  ASSERT_EQ(nodes[b.value].idom, root);
+  ASSERT_EQ(nodes[weak.value].idom, root);
+
+  // c is reachable through both a and b so neither of them dominates it.
+  ASSERT_EQ(nodes[c.value].idom, root);
+  ASSERT_EQ(nodes[c.value].depth, 1u);
+  ASSERT_EQ(nodes[c.value].size, 24);
+  ASSERT_EQ(nodes[c.value].count, 2);
+
+  ASSERT_EQ(nodes[d.value].idom, c);
+  ASSERT_EQ(nodes[d.value].depth, 2u);
+  ASSERT_EQ(nodes[d.value].size, 16);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
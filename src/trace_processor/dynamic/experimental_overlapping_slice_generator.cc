@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_overlapping_slice_generator.h"
+
+#include <memory>
+
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+uint32_t IntervalTsColumn(const tables::SliceTable& slice) {
+  return slice.GetColumnCount();
+}
+
+uint32_t IntervalDurColumn(const tables::SliceTable& slice) {
+  return slice.GetColumnCount() + 1;
+}
+
+}  // namespace
+
+ExperimentalOverlappingSliceGenerator::ExperimentalOverlappingSliceGenerator(
+    TraceProcessorContext* context)
+    : context_(context) {}
+
+ExperimentalOverlappingSliceGenerator::
+    ~ExperimentalOverlappingSliceGenerator() = default;
+
+util::Status ExperimentalOverlappingSliceGenerator::ValidateConstraints(
+    const QueryConstraints& qc) {
+  const auto& cs = qc.constraints();
+  const auto& slice = context_->storage->slice_table();
+
+  auto has_eq_cs = [&cs](uint32_t col) {
+    return std::find_if(cs.begin(), cs.end(),
+                        [col](const QueryConstraints::Constraint& c) {
+                          return c.column == static_cast<int>(col) &&
+                                 c.op == SQLITE_INDEX_CONSTRAINT_EQ;
+                        }) != cs.end();
+  };
+  return has_eq_cs(IntervalTsColumn(slice)) &&
+                 has_eq_cs(IntervalDurColumn(slice))
+             ? util::OkStatus()
+             : util::ErrStatus("Failed to find required constraints");
+}
+
+std::unique_ptr<Table> ExperimentalOverlappingSliceGenerator::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&) {
+  const auto& slice = context_->storage->slice_table();
+
+  auto find_eq_cs = [&cs](uint32_t col) {
+    return std::find_if(cs.begin(), cs.end(), [col](const Constraint& c) {
+      return c.col_idx == col && c.op == FilterOp::kEq;
+    });
+  };
+  auto ts_it = find_eq_cs(IntervalTsColumn(slice));
+  auto dur_it = find_eq_cs(IntervalDurColumn(slice));
+  PERFETTO_DCHECK(ts_it != cs.end());
+  PERFETTO_DCHECK(dur_it != cs.end());
+
+  // Like other operator tables, return a nullptr for arguments which are not
+  // integers; this surfaces an error with the message "constraint failed".
+  if (ts_it->value.type != SqlValue::kLong ||
+      dur_it->value.type != SqlValue::kLong) {
+    return nullptr;
+  }
+  int64_t interval_ts = ts_it->value.long_value;
+  int64_t interval_dur = dur_it->value.long_value;
+
+  MaybeBuildIndex();
+
+  // The index returns rows in order of ts so the returned table is sorted
+  // in the same way as the slice table.
+  std::vector<uint32_t> rows;
+  index_.FindOverlaps(interval_ts, interval_ts + interval_dur, &rows);
+  Table reduced_slice = slice.Apply(RowMap(std::move(rows)));
+
+  // For every row extend it to match the schema, and return it.
+  std::unique_ptr<NullableVector<int64_t>> interval_ts_col(
+      new NullableVector<int64_t>());
+  std::unique_ptr<NullableVector<int64_t>> interval_dur_col(
+      new NullableVector<int64_t>());
+  for (uint32_t i = 0; i < reduced_slice.row_count(); ++i) {
+    interval_ts_col->Append(interval_ts);
+    interval_dur_col->Append(interval_dur);
+  }
+  uint32_t flags = TypedColumn<int64_t>::default_flags() |
+                   TypedColumn<int64_t>::kHidden;
+  return std::unique_ptr<Table>(new Table(
+      std::move(reduced_slice)
+          .ExtendWithColumn("interval_ts", std::move(interval_ts_col), flags)
+          .ExtendWithColumn("interval_dur", std::move(interval_dur_col),
+                            flags)));
+}
+
+Table::Schema ExperimentalOverlappingSliceGenerator::CreateSchema() {
+  auto schema = tables::SliceTable::Schema();
+  schema.columns.push_back(Table::Schema::Column{
+      "interval_ts", SqlValue::Type::kLong, /* is_id = */ false,
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
+  schema.columns.push_back(Table::Schema::Column{
+      "interval_dur", SqlValue::Type::kLong, /* is_id = */ false,
+      /* is_sorted = */ false, /* is_hidden = */ true,
+      /* is_indexed = */ false});
+  return schema;
+}
+
+std::string ExperimentalOverlappingSliceGenerator::TableName() {
+  return "experimental_overlapping_slice";
+}
+
+uint32_t ExperimentalOverlappingSliceGenerator::EstimateRowCount() {
+  return 1;
+}
+
+void ExperimentalOverlappingSliceGenerator::MaybeBuildIndex() {
+  // Slices are only ever appended to the table so the row count is enough to
+  // tell whether the index is stale. The dur of a slice can still change
+  // while the trace is being parsed but, as with the other tables, queries are
+  // only expected to be consistent once the whole trace has been parsed.
+  const auto& slice = context_->storage->slice_table();
+  if (index_.size() == slice.row_count())
+    return;
+
+  std::vector<IntervalIndex::Interval> intervals;
+  intervals.reserve(slice.row_count());
+  for (uint32_t i = 0; i < slice.row_count(); ++i) {
+    int64_t ts = slice.ts()[i];
+    intervals.push_back(IntervalIndex::Interval{ts, ts + slice.dur()[i], i});
+  }
+  index_ = IntervalIndex(std::move(intervals));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_OVERLAPPING_SLICE_GENERATOR_H_
+#define SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_OVERLAPPING_SLICE_GENERATOR_H_
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+
+#include "src/trace_processor/containers/interval_index.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceProcessorContext;
+
+// Dynamic table returning all the slices which overlap a given interval.
+// See /docs/analysis/trace-processor.md for details about the functionality
+// and usage of this table.
+//
+// This is equivalent to filtering the slice table with
+// |ts < interval_ts + interval_dur AND ts + dur > interval_ts| but, as the
+// slices are kept in an IntervalIndex, it avoids scanning every slice for each
+// interval when used on the right hand side of a join.
+class ExperimentalOverlappingSliceGenerator
+    : public DbSqliteTable::DynamicTableGenerator {
+ public:
+  explicit ExperimentalOverlappingSliceGenerator(
+      TraceProcessorContext* context);
+  ~ExperimentalOverlappingSliceGenerator() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  util::Status ValidateConstraints(const QueryConstraints&) override;
+  std::unique_ptr<Table> ComputeTable(const std::vector<Constraint>& cs,
+                                      const std::vector<Order>& ob) override;
+
+ private:
+  // Builds |index_| if the slice table has changed since it was last built.
+  void MaybeBuildIndex();
+
+  TraceProcessorContext* context_ = nullptr;
+
+  // Index over the (ts, ts + dur) intervals of the rows of the slice table.
+  IntervalIndex index_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_OVERLAPPING_SLICE_GENERATOR_H_
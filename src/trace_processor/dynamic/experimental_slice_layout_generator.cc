@@ -47,10 +47,12 @@ Table::Schema ExperimentalSliceLayoutGenerator::CreateSchema() {
   Table::Schema schema = tables::SliceTable::Schema();
   schema.columns.emplace_back(Table::Schema::Column{
       "layout_depth", SqlValue::Type::kLong, false /* is_id */,
-      false /* is_sorted */, false /* is_hidden */});
+      false /* is_sorted */, false /* is_hidden */,
+      false /* is_indexed */});
   schema.columns.emplace_back(Table::Schema::Column{
       "filter_track_ids", SqlValue::Type::kString, false /* is_id */,
-      false /* is_sorted */, true /* is_hidden */});
+      false /* is_sorted */, true /* is_hidden */,
+      false /* is_indexed */});
   return schema;
 }
 
@@ -96,6 +98,11 @@ std::unique_ptr<Table> ExperimentalSliceLayoutGenerator::ComputeTable(
   StringPool::Id filter_id =
       string_pool_->InternString(base::StringView(filter_string));
 
+  if (cached_slice_row_count_ != slice_table_->row_count()) {
+    layout_table_cache_.clear();
+    cached_slice_row_count_ = slice_table_->row_count();
+  }
+
   // Try and find the table in the cache.
   auto it = layout_table_cache_.find(filter_id);
   if (it != layout_table_cache_.end()) {
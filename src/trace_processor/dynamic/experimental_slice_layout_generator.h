@@ -52,6 +52,9 @@ class ExperimentalSliceLayoutGenerator
   // TODO(lalitm): remove this cache and move to having explicitly scoped
   // lifetimes of dynamic tables.
   std::unordered_map<StringId, Table> layout_table_cache_;
+  // The number of slices when |layout_table_cache_| was filled: the cached
+  // layouts are stale once more slices are added.
+  uint32_t cached_slice_row_count_ = 0;
 
   StringPool* string_pool_;
   const tables::SliceTable* slice_table_;
@@ -79,15 +79,26 @@ ThreadStateGenerator::ComputeThreadStateTable(int64_t trace_end_ts) {
   Table sched_blocked_reason = instants.Filter(
       {instants.name().eq("sched_blocked_reason"), instants.ref().ne(0)});
 
+  // Look up the columns once rather than for every event.
   const auto& sched_ts_col = sched.GetTypedColumnByName<int64_t>("ts");
+  const auto& sched_dur_col = sched.GetTypedColumnByName<int64_t>("dur");
+  const auto& sched_cpu_col = sched.GetTypedColumnByName<uint32_t>("cpu");
+  const auto& sched_utid_col = sched.GetTypedColumnByName<uint32_t>("utid");
+  const auto& sched_end_state_col =
+      sched.GetTypedColumnByName<StringId>("end_state");
   const auto& waking_ts_col = waking.GetTypedColumnByName<int64_t>("ts");
+  const auto& waking_utid_col = waking.GetTypedColumnByName<int64_t>("ref");
   const auto& blocked_ts_col =
       sched_blocked_reason.GetTypedColumnByName<int64_t>("ts");
+  const auto& blocked_utid_col =
+      sched_blocked_reason.GetTypedColumnByName<int64_t>("ref");
+  const auto& blocked_arg_set_id_col =
+      sched_blocked_reason.GetTypedColumnByName<uint32_t>("arg_set_id");
 
   uint32_t sched_idx = 0;
   uint32_t waking_idx = 0;
   uint32_t blocked_idx = 0;
-  std::unordered_map<UniqueTid, ThreadSchedInfo> state_map;
+  ThreadSchedInfoMap state_map(context_->storage->thread_table().row_count());
   while (sched_idx < sched.row_count() || waking_idx < waking.row_count() ||
          blocked_idx < sched_blocked_reason.row_count()) {
     int64_t sched_ts = sched_idx < sched.row_count()
@@ -104,33 +115,40 @@ ThreadStateGenerator::ComputeThreadStateTable(int64_t trace_end_ts) {
     // to process that event.
     int64_t min_ts = std::min({sched_ts, waking_ts, blocked_ts});
     if (min_ts == sched_ts) {
-      AddSchedEvent(sched, sched_idx++, state_map, trace_end_ts, table.get());
+      SchedEvent event{sched_ts, sched_dur_col[sched_idx],
+                       sched_cpu_col[sched_idx], sched_utid_col[sched_idx],
+                       sched_end_state_col[sched_idx]};
+      AddSchedEvent(event, state_map, trace_end_ts, table.get());
+      sched_idx++;
     } else if (min_ts == waking_ts) {
-      AddWakingEvent(waking, waking_idx++, state_map);
+      AddWakingEvent(waking_ts,
+                     static_cast<UniqueTid>(waking_utid_col[waking_idx]),
+                     state_map);
+      waking_idx++;
     } else /* (min_ts == blocked_ts) */ {
-      AddBlockedReasonEvent(sched_blocked_reason, blocked_idx++, state_map);
+      AddBlockedReasonEvent(
+          static_cast<UniqueTid>(blocked_utid_col[blocked_idx]),
+          blocked_arg_set_id_col[blocked_idx], state_map);
+      blocked_idx++;
     }
   }
 
   // At the end, go through and flush any remaining pending events.
-  for (const auto& utid_to_pending_info : state_map) {
-    UniqueTid utid = utid_to_pending_info.first;
-    const ThreadSchedInfo& pending_info = utid_to_pending_info.second;
-    FlushPendingEventsForThread(utid, pending_info, table.get(), base::nullopt);
+  for (uint32_t utid = 0; utid < state_map.size(); ++utid) {
+    FlushPendingEventsForThread(utid, state_map[utid], table.get(),
+                                base::nullopt);
   }
 
   return table;
 }
 
-void ThreadStateGenerator::AddSchedEvent(
-    const Table& sched,
-    uint32_t sched_idx,
-    std::unordered_map<UniqueTid, ThreadSchedInfo>& state_map,
-    int64_t trace_end_ts,
-    tables::ThreadStateTable* table) {
-  int64_t ts = sched.GetTypedColumnByName<int64_t>("ts")[sched_idx];
-  UniqueTid utid = sched.GetTypedColumnByName<uint32_t>("utid")[sched_idx];
-  ThreadSchedInfo* info = &state_map[utid];
+void ThreadStateGenerator::AddSchedEvent(const SchedEvent& sched,
+                                         ThreadSchedInfoMap& state_map,
+                                         int64_t trace_end_ts,
+                                         tables::ThreadStateTable* table) {
+  int64_t ts = sched.ts;
+  UniqueTid utid = sched.utid;
+  ThreadSchedInfo* info = GetOrCreateInfo(state_map, utid);
 
   // Due to races in the kernel, it is possible for the same thread to be
   // scheduled on different CPUs at the same time. This will manifest itself
@@ -167,7 +185,7 @@ void ThreadStateGenerator::AddSchedEvent(
   // SchedEventTracker::FlushPendingEvents
   // TODO(lalitm): remove this hack when we stop expanding the last slice to the
   // end of the trace.
-  int64_t dur = sched.GetTypedColumnByName<int64_t>("dur")[sched_idx];
+  int64_t dur = sched.dur;
   if (ts + dur == trace_end_ts) {
     dur = -1;
   }
@@ -177,7 +195,7 @@ void ThreadStateGenerator::AddSchedEvent(
   tables::ThreadStateTable::Row sched_row;
   sched_row.ts = ts;
   sched_row.dur = dur;
-  sched_row.cpu = sched.GetTypedColumnByName<uint32_t>("cpu")[sched_idx];
+  sched_row.cpu = sched.cpu;
   sched_row.state = running_string_id_;
   sched_row.utid = utid;
 
@@ -192,19 +210,14 @@ void ThreadStateGenerator::AddSchedEvent(
   // This will be flushed to the table on the next sched slice (or the very end
   // of the big loop).
   info->desched_ts = ts + dur;
-  info->desched_end_state =
-      sched.GetTypedColumnByName<StringId>("end_state")[sched_idx];
+  info->desched_end_state = sched.end_state;
   info->scheduled_row = id_and_row.row;
 }
 
-void ThreadStateGenerator::AddWakingEvent(
-    const Table& waking,
-    uint32_t waking_idx,
-    std::unordered_map<UniqueTid, ThreadSchedInfo>& state_map) {
-  int64_t ts = waking.GetTypedColumnByName<int64_t>("ts")[waking_idx];
-  UniqueTid utid = static_cast<UniqueTid>(
-      waking.GetTypedColumnByName<int64_t>("ref")[waking_idx]);
-  ThreadSchedInfo* info = &state_map[utid];
+void ThreadStateGenerator::AddWakingEvent(int64_t ts,
+                                          UniqueTid utid,
+                                          ThreadSchedInfoMap& state_map) {
+  ThreadSchedInfo* info = GetOrCreateInfo(state_map, utid);
 
   // Occasionally, it is possible to get a waking event for a thread
   // which is already in a runnable state. When this happens, we just
@@ -296,16 +309,10 @@ void ThreadStateGenerator::FlushPendingEventsForThread(
 }
 
 void ThreadStateGenerator::AddBlockedReasonEvent(
-    const Table& blocked_reason,
-    uint32_t blocked_idx,
-    std::unordered_map<UniqueTid, ThreadSchedInfo>& state_map) {
-  const auto& utid_col = blocked_reason.GetTypedColumnByName<int64_t>("ref");
-  const auto& arg_set_id_col =
-      blocked_reason.GetTypedColumnByName<uint32_t>("arg_set_id");
-
-  UniqueTid utid = static_cast<UniqueTid>(utid_col[blocked_idx]);
-  uint32_t arg_set_id = arg_set_id_col[blocked_idx];
-  ThreadSchedInfo& info = state_map[utid];
+    UniqueTid utid,
+    uint32_t arg_set_id,
+    ThreadSchedInfoMap& state_map) {
+  ThreadSchedInfo& info = *GetOrCreateInfo(state_map, utid);
 
   base::Optional<Variadic> opt_value;
   util::Status status =
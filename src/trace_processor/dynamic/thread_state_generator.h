@@ -17,6 +17,8 @@
 #ifndef SRC_TRACE_PROCESSOR_DYNAMIC_THREAD_STATE_GENERATOR_H_
 #define SRC_TRACE_PROCESSOR_DYNAMIC_THREAD_STATE_GENERATOR_H_
 
+#include <vector>
+
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 
 #include "src/trace_processor/storage/trace_storage.h"
@@ -55,21 +57,36 @@ class ThreadStateGenerator : public DbSqliteTable::DynamicTableGenerator {
     base::Optional<StringId> blocked_function;
   };
 
-  void AddSchedEvent(const Table& sched,
-                     uint32_t sched_idx,
-                     std::unordered_map<UniqueTid, ThreadSchedInfo>& state_map,
+  // Indexed by utid.
+  using ThreadSchedInfoMap = std::vector<ThreadSchedInfo>;
+
+  struct SchedEvent {
+    int64_t ts;
+    int64_t dur;
+    uint32_t cpu;
+    UniqueTid utid;
+    StringId end_state;
+  };
+
+  static ThreadSchedInfo* GetOrCreateInfo(ThreadSchedInfoMap& state_map,
+                                          UniqueTid utid) {
+    if (utid >= state_map.size())
+      state_map.resize(utid + 1);
+    return &state_map[utid];
+  }
+
+  void AddSchedEvent(const SchedEvent& sched,
+                     ThreadSchedInfoMap& state_map,
                      int64_t trace_end_ts,
                      tables::ThreadStateTable* table);
 
-  void AddWakingEvent(
-      const Table& wakeup,
-      uint32_t wakeup_idx,
-      std::unordered_map<UniqueTid, ThreadSchedInfo>& state_map);
+  void AddWakingEvent(int64_t ts,
+                      UniqueTid utid,
+                      ThreadSchedInfoMap& state_map);
 
-  void AddBlockedReasonEvent(
-      const Table& blocked_reason,
-      uint32_t blocked_idx,
-      std::unordered_map<UniqueTid, ThreadSchedInfo>& state_map);
+  void AddBlockedReasonEvent(UniqueTid utid,
+                             uint32_t arg_set_id,
+                             ThreadSchedInfoMap& state_map);
 
   void FlushPendingEventsForThread(UniqueTid utid,
                                    const ThreadSchedInfo&,
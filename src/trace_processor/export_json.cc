@@ -19,7 +19,6 @@
 
 #include <inttypes.h>
 #include <stdio.h>
-#include <sstream>
 
 #include <algorithm>
 #include <cmath>
@@ -27,6 +26,7 @@
 #include <deque>
 #include <limits>
 #include <memory>
+#include <unordered_map>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_splitter.h"
@@ -39,7 +39,7 @@
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
 #include <json/reader.h>
-#include <json/writer.h>
+#include <json/value.h>
 #endif
 
 namespace perfetto {
@@ -85,10 +85,209 @@ const char kLegacyEventLocalIdKey[] = "local_id";
 const char kLegacyEventIdScopeKey[] = "id_scope";
 const char kStrippedArgument[] = "__stripped__";
 
+// Events are serialized into a buffer of about this size before being handed
+// to the OutputWriter.
+constexpr size_t kOutputBufferSize = 1024 * 1024;
+
 const char* GetNonNullString(const TraceStorage* storage, StringId id) {
   return id == kNullStringId ? "" : storage->GetString(id).c_str();
 }
 
+// Decodes the UTF-8 sequence starting at |*c| and advances |*c| to its last
+// byte. Invalid sequences decode to U+FFFD. This matches the decoding of
+// jsoncpp's writer so that the output doesn't change when switching to the
+// serializer below.
+uint32_t DecodeUtf8(const char** c, const char* end) {
+  const uint32_t kReplacementCharacter = 0xFFFD;
+  const unsigned char* s = reinterpret_cast<const unsigned char*>(*c);
+  uint32_t first = s[0];
+  if (first < 0x80)
+    return first;
+  if (first < 0xE0) {
+    if (end - *c < 2)
+      return kReplacementCharacter;
+    uint32_t codepoint = ((first & 0x1F) << 6) | (s[1] & 0x3F);
+    *c += 1;
+    return codepoint < 0x80 ? kReplacementCharacter : codepoint;
+  }
+  if (first < 0xF0) {
+    if (end - *c < 3)
+      return kReplacementCharacter;
+    uint32_t codepoint =
+        ((first & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+    *c += 2;
+    // Surrogates are not valid codepoints.
+    if (codepoint >= 0xD800 && codepoint <= 0xDFFF)
+      return kReplacementCharacter;
+    return codepoint < 0x800 ? kReplacementCharacter : codepoint;
+  }
+  if (first < 0xF8) {
+    if (end - *c < 4)
+      return kReplacementCharacter;
+    uint32_t codepoint = ((first & 0x07) << 18) | ((s[1] & 0x3F) << 12) |
+                         ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+    *c += 3;
+    return codepoint < 0x10000 ? kReplacementCharacter : codepoint;
+  }
+  return kReplacementCharacter;
+}
+
+void AppendHex16(uint32_t value, std::string* out) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  char buf[6] = {'\\', 'u'};
+  buf[2] = kHexDigits[(value >> 12) & 0xF];
+  buf[3] = kHexDigits[(value >> 8) & 0xF];
+  buf[4] = kHexDigits[(value >> 4) & 0xF];
+  buf[5] = kHexDigits[value & 0xF];
+  out->append(buf, sizeof(buf));
+}
+
+// Appends |str| to |out| as a quoted JSON string. Non-ASCII characters are
+// escaped, so the output is valid JSON even if |str| is not valid UTF-8.
+void AppendJsonString(const char* str, size_t size, std::string* out) {
+  const char* end = str + size;
+  out->push_back('"');
+  for (const char* c = str; c < end; ++c) {
+    switch (*c) {
+      case '"':
+        out->append("\\\"");
+        continue;
+      case '\\':
+        out->append("\\\\");
+        continue;
+      case '\b':
+        out->append("\\b");
+        continue;
+      case '\f':
+        out->append("\\f");
+        continue;
+      case '\n':
+        out->append("\\n");
+        continue;
+      case '\r':
+        out->append("\\r");
+        continue;
+      case '\t':
+        out->append("\\t");
+        continue;
+    }
+    uint32_t codepoint = DecodeUtf8(&c, end);
+    if (codepoint >= 0x20 && codepoint <= 0x7F) {
+      out->push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x10000) {
+      AppendHex16(codepoint, out);
+    } else {
+      codepoint -= 0x10000;
+      AppendHex16((codepoint >> 10) + 0xD800, out);
+      AppendHex16((codepoint & 0x3FF) + 0xDC00, out);
+    }
+  }
+  out->push_back('"');
+}
+
+void AppendJsonString(const char* str, std::string* out) {
+  AppendJsonString(str, strlen(str), out);
+}
+
+void AppendJsonInt(uint64_t value, bool negative, std::string* out) {
+  char buf[24];
+  char* end = buf + sizeof(buf);
+  char* c = end;
+  do {
+    *--c = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value);
+  if (negative)
+    *--c = '-';
+  out->append(c, static_cast<size_t>(end - c));
+}
+
+void AppendJsonInt(int64_t value, std::string* out) {
+  // Negate in unsigned arithmetic so that INT64_MIN doesn't overflow.
+  uint64_t abs_value = value < 0 ? 0 - static_cast<uint64_t>(value)
+                                 : static_cast<uint64_t>(value);
+  AppendJsonInt(abs_value, value < 0, out);
+}
+
+void AppendJsonDouble(double value, std::string* out) {
+  if (std::isnan(value)) {
+    out->append("null");
+    return;
+  }
+  if (std::isinf(value)) {
+    out->append(value < 0 ? "-1e+9999" : "1e+9999");
+    return;
+  }
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%.17g", value);
+  size_t start = out->size();
+  out->append(buf, static_cast<size_t>(len));
+  // Some locales use a comma as decimal separator.
+  std::replace(out->begin() + static_cast<ptrdiff_t>(start), out->end(), ',',
+               '.');
+  // Preserve the fact that this is a double, like jsoncpp does.
+  if (out->find_first_of(".e", start) == std::string::npos)
+    out->append(".0");
+}
+
+// Appends the compact (i.e. unindented) serialization of |value| to |out|.
+// The output is identical to the one of jsoncpp's StreamWriter without
+// indentation, but it avoids going through a std::ostream.
+void AppendJsonValue(const Json::Value& value, std::string* out) {
+  switch (value.type()) {
+    case Json::nullValue:
+      out->append("null");
+      break;
+    case Json::intValue:
+      AppendJsonInt(static_cast<int64_t>(value.asLargestInt()), out);
+      break;
+    case Json::uintValue:
+      AppendJsonInt(static_cast<uint64_t>(value.asLargestUInt()),
+                    /*negative=*/false, out);
+      break;
+    case Json::realValue:
+      AppendJsonDouble(value.asDouble(), out);
+      break;
+    case Json::stringValue: {
+      const char* begin = nullptr;
+      const char* end = nullptr;
+      if (value.getString(&begin, &end)) {
+        AppendJsonString(begin, static_cast<size_t>(end - begin), out);
+      } else {
+        out->append("\"\"");
+      }
+      break;
+    }
+    case Json::booleanValue:
+      out->append(value.asBool() ? "true" : "false");
+      break;
+    case Json::arrayValue: {
+      out->push_back('[');
+      for (Json::ArrayIndex i = 0; i < value.size(); ++i) {
+        if (i > 0)
+          out->push_back(',');
+        AppendJsonValue(value[i], out);
+      }
+      out->push_back(']');
+      break;
+    }
+    case Json::objectValue: {
+      out->push_back('{');
+      for (auto it = value.begin(); it != value.end(); ++it) {
+        if (it != value.begin())
+          out->push_back(',');
+        const char* name_end = nullptr;
+        const char* name = it.memberName(&name_end);
+        AppendJsonString(name, static_cast<size_t>(name_end - name), out);
+        out->push_back(':');
+        AppendJsonValue(*it, out);
+      }
+      out->push_back('}');
+      break;
+    }
+  }
+}
+
 class JsonExporter {
  public:
   JsonExporter(const TraceStorage* storage,
@@ -160,9 +359,7 @@ class JsonExporter {
           metadata_filter_(metadata_filter),
           label_filter_(label_filter),
           first_event_(true) {
-      Json::StreamWriterBuilder b;
-      b.settings_["indentation"] = "";
-      writer_.reset(b.newStreamWriter());
+      buffer_.reserve(kOutputBufferSize + kOutputBufferSize / 4);
       WriteHeader();
     }
 
@@ -179,21 +376,21 @@ class JsonExporter {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_begin_events_.push_back(event);
+      async_begin_events_.push_back(SerializeEvent(event));
     }
 
     void AddAsyncInstantEvent(const Json::Value& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_instant_events_.push_back(event);
+      async_instant_events_.push_back(SerializeEvent(event));
     }
 
     void AddAsyncEndEvent(const Json::Value& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_end_events_.push_back(event);
+      async_end_events_.push_back(SerializeEvent(event));
     }
 
     void SortAndEmitAsyncEvents() {
@@ -209,8 +406,9 @@ class JsonExporter {
       // the same timestamp. To accomplish this, we perform a stable sort in
       // descending order and later iterate via reverse iterators.
       struct {
-        bool operator()(const Json::Value& a, const Json::Value& b) const {
-          return a["ts"].asInt64() > b["ts"].asInt64();
+        bool operator()(const SerializedEvent& a,
+                        const SerializedEvent& b) const {
+          return a.ts > b.ts;
         }
       } CompareEvents;
       std::stable_sort(async_end_events_.begin(), async_end_events_.end(),
@@ -229,25 +427,24 @@ class JsonExporter {
       auto has_begin_event = begin_event_it != async_begin_events_.end();
 
       auto emit_next_instant = [&instant_event_it, &has_instant_event, this]() {
-        DoWriteEvent(*instant_event_it);
+        WriteSerializedEvent(instant_event_it->json);
         instant_event_it++;
         has_instant_event = instant_event_it != async_instant_events_.end();
       };
       auto emit_next_end = [&end_event_it, &has_end_event, this]() {
-        DoWriteEvent(*end_event_it);
+        WriteSerializedEvent(end_event_it->json);
         end_event_it++;
         has_end_event = end_event_it != async_end_events_.rend();
       };
       auto emit_next_begin = [&begin_event_it, &has_begin_event, this]() {
-        DoWriteEvent(*begin_event_it);
+        WriteSerializedEvent(begin_event_it->json);
         begin_event_it++;
         has_begin_event = begin_event_it != async_begin_events_.end();
       };
 
       auto emit_next_instant_or_end = [&instant_event_it, &end_event_it,
                                        &emit_next_instant, &emit_next_end]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= end_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_end();
@@ -256,8 +453,7 @@ class JsonExporter {
       auto emit_next_instant_or_begin = [&instant_event_it, &begin_event_it,
                                          &emit_next_instant,
                                          &emit_next_begin]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= begin_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_begin();
@@ -265,8 +461,7 @@ class JsonExporter {
       };
       auto emit_next_end_or_begin = [&end_event_it, &begin_event_it,
                                      &emit_next_end, &emit_next_begin]() {
-        if ((*end_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (end_event_it->ts <= begin_event_it->ts) {
           emit_next_end();
         } else {
           emit_next_begin();
@@ -275,8 +470,7 @@ class JsonExporter {
 
       // While we still have events in all iterators, consider each.
       while (has_instant_event && has_end_event && has_begin_event) {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= end_event_it->ts) {
           emit_next_instant_or_begin();
         } else {
           emit_next_end_or_begin();
@@ -312,6 +506,10 @@ class JsonExporter {
       while (has_begin_event) {
         emit_next_begin();
       }
+
+      async_begin_events_.clear();
+      async_instant_events_.clear();
+      async_end_events_.clear();
     }
 
     void WriteMetadataEvent(const char* metadata_type,
@@ -322,25 +520,22 @@ class JsonExporter {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      std::ostringstream ss;
-      if (!first_event_)
-        ss << ",\n";
-
-      Json::Value value;
-      value["ph"] = "M";
-      value["cat"] = "__metadata";
-      value["ts"] = 0;
-      value["name"] = metadata_type;
-      value["pid"] = Json::Int(pid);
-      value["tid"] = Json::Int(tid);
-
-      Json::Value args;
-      args[metadata_arg_name] = metadata_arg_value;
-      value["args"] = args;
-
-      writer_->write(value, &ss);
-      output_->AppendString(ss.str());
-      first_event_ = false;
+      BeginEvent();
+      // Same as serializing a Json::Value, the keys are in sorted order.
+      buffer_.append("{\"args\":{");
+      AppendJsonString(metadata_arg_name, &buffer_);
+      buffer_.push_back(':');
+      AppendJsonString(metadata_arg_value, &buffer_);
+      buffer_.append("},\"cat\":\"__metadata\",\"name\":");
+      AppendJsonString(metadata_type, &buffer_);
+      buffer_.append(",\"ph\":\"M\",\"pid\":");
+      AppendJsonInt(static_cast<int64_t>(static_cast<int32_t>(pid)),
+                    &buffer_);
+      buffer_.append(",\"tid\":");
+      AppendJsonInt(static_cast<int64_t>(static_cast<int32_t>(tid)),
+                    &buffer_);
+      buffer_.append(",\"ts\":0}");
+      MaybeFlush();
     }
 
     void MergeMetadata(const Json::Value& value) {
@@ -400,9 +595,15 @@ class JsonExporter {
     }
 
    private:
+    // An event which was serialized ahead of being written to the output.
+    struct SerializedEvent {
+      int64_t ts;
+      std::string json;
+    };
+
     void WriteHeader() {
       if (!label_filter_)
-        output_->AppendString("{\"traceEvents\":[\n");
+        buffer_.append("{\"traceEvents\":[\n");
     }
 
     void WriteFooter() {
@@ -437,55 +638,121 @@ class JsonExporter {
         }
       }
 
-      std::ostringstream ss;
       if (!label_filter_)
-        ss << "]";
+        buffer_.append("]");
 
       if ((!label_filter_ || label_filter_("systemTraceEvents")) &&
           !system_trace_data_.empty()) {
-        ss << ",\"systemTraceEvents\":\n";
-        writer_->write(Json::Value(system_trace_data_), &ss);
+        buffer_.append(",\"systemTraceEvents\":\n");
+        AppendJsonString(system_trace_data_.data(), system_trace_data_.size(),
+                         &buffer_);
       }
 
       if ((!label_filter_ || label_filter_("metadata")) && !metadata_.empty()) {
-        ss << ",\"metadata\":\n";
-        writer_->write(metadata_, &ss);
+        buffer_.append(",\"metadata\":\n");
+        AppendJsonValue(metadata_, &buffer_);
       }
 
       if (!label_filter_)
-        ss << "}";
+        buffer_.append("}");
 
-      output_->AppendString(ss.str());
+      Flush();
     }
 
-    void DoWriteEvent(const Json::Value& event) {
-      std::ostringstream ss;
+    // Appends the separator from the previous event to the buffer.
+    void BeginEvent() {
       if (!first_event_)
-        ss << ",\n";
+        buffer_.append(",\n");
+      first_event_ = false;
+    }
+
+    void MaybeFlush() {
+      if (buffer_.size() >= kOutputBufferSize)
+        Flush();
+    }
+
+    void Flush() {
+      if (buffer_.empty())
+        return;
+      output_->AppendString(buffer_);
+      buffer_.clear();
+    }
+
+    void DoWriteEvent(const Json::Value& event) {
+      BeginEvent();
+      AppendEvent(event, &buffer_);
+      MaybeFlush();
+    }
+
+    void WriteSerializedEvent(const std::string& json) {
+      BeginEvent();
+      buffer_.append(json);
+      MaybeFlush();
+    }
 
+    SerializedEvent SerializeEvent(const Json::Value& event) {
+      SerializedEvent serialized;
+      serialized.ts = event["ts"].asInt64();
+      AppendEvent(event, &serialized.json);
+      return serialized;
+    }
+
+    // Serializes |event| to |out|, applying the argument filter to its args.
+    void AppendEvent(const Json::Value& event, std::string* out) {
       ArgumentNameFilterPredicate argument_name_filter;
       bool strip_args =
           argument_filter_ &&
           !argument_filter_(event["cat"].asCString(), event["name"].asCString(),
                             &argument_name_filter);
-      if ((strip_args || argument_name_filter) && event.isMember("args")) {
-        Json::Value event_copy = event;
-        if (strip_args) {
-          event_copy["args"] = kStrippedArgument;
+      if (!strip_args && !argument_name_filter) {
+        AppendJsonValue(event, out);
+        return;
+      }
+
+      // Serialize the members one by one so that the args can be filtered
+      // without making a copy of the event.
+      out->push_back('{');
+      for (auto it = event.begin(); it != event.end(); ++it) {
+        if (it != event.begin())
+          out->push_back(',');
+        const char* name_end = nullptr;
+        const char* name = it.memberName(&name_end);
+        AppendJsonString(name, static_cast<size_t>(name_end - name), out);
+        out->push_back(':');
+        if (strcmp(name, "args") != 0) {
+          AppendJsonValue(*it, out);
+        } else if (strip_args) {
+          AppendJsonString(kStrippedArgument, out);
         } else {
-          auto& args = event_copy["args"];
-          for (const auto& member : event["args"].getMemberNames()) {
-            if (!argument_name_filter(member.c_str()))
-              args[member] = kStrippedArgument;
-          }
+          AppendFilteredArgs(*it, argument_name_filter, out);
         }
-        writer_->write(event_copy, &ss);
-      } else {
-        writer_->write(event, &ss);
       }
-      first_event_ = false;
+      out->push_back('}');
+    }
 
-      output_->AppendString(ss.str());
+    static void AppendFilteredArgs(
+        const Json::Value& args,
+        const ArgumentNameFilterPredicate& argument_name_filter,
+        std::string* out) {
+      if (!args.isObject() || args.empty()) {
+        AppendJsonValue(args, out);
+        return;
+      }
+      out->push_back('{');
+      for (auto it = args.begin(); it != args.end(); ++it) {
+        if (it != args.begin())
+          out->push_back(',');
+        const char* name_end = nullptr;
+        const char* name = it.memberName(&name_end);
+        AppendJsonString(name, static_cast<size_t>(name_end - name), out);
+        out->push_back(':');
+        if (argument_name_filter(name)) {
+          AppendJsonValue(*it, out);
+        } else {
+          AppendJsonString(kStrippedArgument, out);
+        }
+      }
+      out->push_back('}');
     }
 
     OutputWriter* output_;
@@ -493,51 +760,69 @@ class JsonExporter {
     MetadataFilterPredicate metadata_filter_;
     LabelFilterPredicate label_filter_;
 
-    std::unique_ptr<Json::StreamWriter> writer_;
     bool first_event_;
+    std::string buffer_;
     Json::Value metadata_;
     std::string system_trace_data_;
     std::string user_trace_data_;
-    std::vector<Json::Value> async_begin_events_;
-    std::vector<Json::Value> async_instant_events_;
-    std::vector<Json::Value> async_end_events_;
+    std::vector<SerializedEvent> async_begin_events_;
+    std::vector<SerializedEvent> async_instant_events_;
+    std::vector<SerializedEvent> async_end_events_;
   };
 
+  // Converts arg sets to JSON when they are needed, rather than converting all
+  // of them upfront, so that the converted args of only a few events are in
+  // memory at any time during the export.
   class ArgsBuilder {
    public:
     explicit ArgsBuilder(const TraceStorage* storage)
         : storage_(storage),
-          empty_value_(Json::objectValue),
           nan_value_(Json::StaticString("NaN")),
           inf_value_(Json::StaticString("Infinity")),
           neg_inf_value_(Json::StaticString("-Infinity")) {
+      // The arg table is sorted by arg set id: record the first row of each
+      // arg set so that the rows of a set can be found quickly.
       const auto& arg_table = storage_->arg_table();
       uint32_t count = arg_table.row_count();
-      if (count == 0) {
-        args_sets_.resize(1, empty_value_);
-        return;
-      }
-      args_sets_.resize(arg_table.arg_set_id()[count - 1] + 1, empty_value_);
-
       for (uint32_t i = 0; i < count; ++i) {
         ArgSetId set_id = arg_table.arg_set_id()[i];
+        PERFETTO_DCHECK(set_id + 1 >= set_start_rows_.size());
+        set_start_rows_.resize(set_id + 1, i);
+      }
+      set_start_rows_.push_back(count);
+    }
+
+    // Returns the args in the set |set_id|, converted to JSON.
+    Json::Value GetArgs(ArgSetId set_id) const {
+      Json::Value args(Json::objectValue);
+      // If |set_id| was empty and added to the storage last, it may not be in
+      // |set_start_rows_|.
+      if (set_id + 1 >= set_start_rows_.size())
+        return args;
+
+      const auto& arg_table = storage_->arg_table();
+      uint32_t end = set_start_rows_[set_id + 1];
+      for (uint32_t i = set_start_rows_[set_id]; i < end; ++i) {
         const char* key = arg_table.key().GetString(i).c_str();
         Variadic value = storage_->GetArgValue(i);
-        AppendArg(set_id, key, VariadicToJson(value));
+        AppendArg(&args, key, VariadicToJson(value));
       }
-      PostprocessArgs();
+      PostprocessArgs(&args);
+      return args;
     }
 
-    const Json::Value& GetArgs(ArgSetId set_id) const {
-      // If |set_id| was empty and added to the storage last, it may not be in
-      // args_sets_.
-      if (set_id > args_sets_.size())
-        return empty_value_;
-      return args_sets_[set_id];
+    // Same as GetArgs() but keeps the converted args around for later calls.
+    // Used for arg sets which are looked up repeatedly, e.g. the args of
+    // tracks.
+    const Json::Value& GetCachedArgs(ArgSetId set_id) {
+      auto it = cached_args_.find(set_id);
+      if (it == cached_args_.end())
+        it = cached_args_.emplace(set_id, GetArgs(set_id)).first;
+      return it->second;
     }
 
    private:
-    Json::Value VariadicToJson(Variadic variadic) {
+    Json::Value VariadicToJson(Variadic variadic) const {
       switch (variadic.type) {
         case Variadic::kInt:
           return Json::Int64(variadic.int_value);
@@ -573,15 +858,14 @@ class JsonExporter {
       PERFETTO_FATAL("Not reached");  // For gcc.
     }
 
-    void AppendArg(ArgSetId set_id,
-                   const std::string& key,
-                   const Json::Value& value) {
-      Json::Value* target = &args_sets_[set_id];
+    static void AppendArg(Json::Value* args,
+                          const std::string& key,
+                          const Json::Value& value) {
+      Json::Value* target = args;
       for (base::StringSplitter parts(key, '.'); parts.Next();) {
         if (PERFETTO_UNLIKELY(!target->isNull() && !target->isObject())) {
           PERFETTO_DLOG("Malformed arguments. Can't append %s to %s.",
-                        key.c_str(),
-                        args_sets_[set_id].toStyledString().c_str());
+                        key.c_str(), args->toStyledString().c_str());
           return;
         }
         std::string key_part = parts.cur_token();
@@ -599,8 +883,7 @@ class JsonExporter {
                                                     bracketpos - 1);
             if (PERFETTO_UNLIKELY(!target->isNull() && !target->isArray())) {
               PERFETTO_DLOG("Malformed arguments. Can't append %s to %s.",
-                            key.c_str(),
-                            args_sets_[set_id].toStyledString().c_str());
+                            key.c_str(), args->toStyledString().c_str());
               return;
             }
             base::Optional<uint32_t> index = base::StringToUInt32(s);
@@ -617,46 +900,45 @@ class JsonExporter {
       *target = value;
     }
 
-    void PostprocessArgs() {
-      for (Json::Value& args : args_sets_) {
-        // Move all fields from "debug" key to upper level.
-        if (args.isMember("debug")) {
-          Json::Value debug = args["debug"];
-          args.removeMember("debug");
-          for (const auto& member : debug.getMemberNames()) {
-            args[member] = debug[member];
-          }
+    static void PostprocessArgs(Json::Value* args_ptr) {
+      Json::Value& args = *args_ptr;
+      // Move all fields from "debug" key to upper level.
+      if (args.isMember("debug")) {
+        Json::Value debug = args["debug"];
+        args.removeMember("debug");
+        for (const auto& member : debug.getMemberNames()) {
+          args[member] = debug[member];
         }
+      }
 
-        // Rename source fields.
-        if (args.isMember("task")) {
-          if (args["task"].isMember("posted_from")) {
-            Json::Value posted_from = args["task"]["posted_from"];
-            args["task"].removeMember("posted_from");
-            if (posted_from.isMember("function_name")) {
-              args["src_func"] = posted_from["function_name"];
-              args["src_file"] = posted_from["file_name"];
-            } else if (posted_from.isMember("file_name")) {
-              args["src"] = posted_from["file_name"];
-            }
+      // Rename source fields.
+      if (args.isMember("task")) {
+        if (args["task"].isMember("posted_from")) {
+          Json::Value posted_from = args["task"]["posted_from"];
+          args["task"].removeMember("posted_from");
+          if (posted_from.isMember("function_name")) {
+            args["src_func"] = posted_from["function_name"];
+            args["src_file"] = posted_from["file_name"];
+          } else if (posted_from.isMember("file_name")) {
+            args["src"] = posted_from["file_name"];
           }
-          if (args["task"].empty())
-            args.removeMember("task");
         }
-        if (args.isMember("source")) {
-          Json::Value source = args["source"];
-          if (source.isObject() && source.isMember("function_name")) {
-            args["function_name"] = source["function_name"];
-            args["file_name"] = source["file_name"];
-            args.removeMember("source");
-          }
+        if (args["task"].empty())
+          args.removeMember("task");
+      }
+      if (args.isMember("source")) {
+        Json::Value source = args["source"];
+        if (source.isObject() && source.isMember("function_name")) {
+          args["function_name"] = source["function_name"];
+          args["file_name"] = source["file_name"];
+          args.removeMember("source");
         }
       }
     }
 
     const TraceStorage* storage_;
-    std::vector<Json::Value> args_sets_;
-    const Json::Value empty_value_;
+    std::vector<uint32_t> set_start_rows_;
+    std::unordered_map<ArgSetId, Json::Value> cached_args_;
     const Json::Value nan_value_;
     const Json::Value inf_value_;
     const Json::Value neg_inf_value_;
@@ -791,8 +1073,7 @@ class JsonExporter {
       base::Optional<UniqueTid> legacy_utid;
       std::string legacy_phase;
 
-      event["args"] =
-          args_builder_.GetArgs(slices.arg_set_id()[i]);  // Makes a copy.
+      event["args"] = args_builder_.GetArgs(slices.arg_set_id()[i]);
       if (event["args"].isMember(kLegacyEventArgsKey)) {
         const auto& legacy_args = event["args"][kLegacyEventArgsKey];
 
@@ -820,7 +1101,7 @@ class JsonExporter {
       bool legacy_chrome_track = false;
       bool is_child_track = false;
       if (track_args_id) {
-        track_args = &args_builder_.GetArgs(*track_args_id);
+        track_args = &args_builder_.GetCachedArgs(*track_args_id);
         legacy_chrome_track = (*track_args)["source"].asString() == "chrome";
         is_child_track = track_args->isMember("is_root_in_scope") &&
                          !(*track_args)["is_root_in_scope"].asBool();
@@ -1602,11 +1883,10 @@ class JsonExporter {
 
         auto process_args_id = process_table.arg_set_id()[upid];
         if (process_args_id) {
-          const Json::Value* process_args =
-              &args_builder_.GetArgs(process_args_id);
-          if (process_args->isMember("is_peak_rss_resettable")) {
+          Json::Value process_args = args_builder_.GetArgs(process_args_id);
+          if (process_args.isMember("is_peak_rss_resettable")) {
             totals["is_peak_rss_resettable"] =
-                (*process_args)["is_peak_rss_resettable"];
+                process_args["is_peak_rss_resettable"];
           }
         }
 
@@ -1724,17 +2004,16 @@ class JsonExporter {
           auto node_args_id = snapshot_nodes.arg_set_id()[node_index];
           if (!node_args_id)
             continue;
-          const Json::Value* node_args =
-              &args_builder_.GetArgs(node_args_id.value());
-          for (const auto& arg_name : node_args->getMemberNames()) {
-            const Json::Value& arg_value = (*node_args)[arg_name]["value"];
+          Json::Value node_args = args_builder_.GetArgs(node_args_id.value());
+          for (const auto& arg_name : node_args.getMemberNames()) {
+            const Json::Value& arg_value = node_args[arg_name]["value"];
             if (arg_value.empty())
               continue;
             if (arg_value.isString()) {
               AddAttributeToMemoryNode(&event, path, arg_name,
                                        arg_value.asString());
             } else if (arg_value.isInt64()) {
-              Json::Value unit = (*node_args)[arg_name]["unit"];
+              Json::Value unit = node_args[arg_name]["unit"];
               if (unit.empty())
                 unit = "unknown";
               AddAttributeToMemoryNode(&event, path, arg_name,
@@ -229,6 +229,28 @@ TEST_F(ExportJsonTest, StorageWithThreadName) {
   EXPECT_EQ(event["args"]["name"].asString(), kName);
 }
 
+TEST_F(ExportJsonTest, StorageWithEscapedThreadName) {
+  const uint32_t kThreadID = 100;
+  // Contains characters which need escaping, a two byte, a three byte and a
+  // four byte UTF-8 sequence and a truncated sequence.
+  const char kName[] = "a\"b\\c\n\x01\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xe2";
+
+  tables::ThreadTable::Row row(kThreadID);
+  row.name = context_.storage->InternString(base::StringView(kName));
+  context_.storage->mutable_thread_table()->Insert(row);
+
+  std::string output = ToJson();
+  EXPECT_NE(output.find("\"a\\\"b\\\\c\\n\\u0001\\u00e9\\u20ac"
+                        "\\ud83d\\ude00\\ufffd\""),
+            std::string::npos)
+      << output;
+
+  Json::Value result = ToJsonValue(output);
+  EXPECT_EQ(result["traceEvents"].size(), 1u);
+  EXPECT_EQ(result["traceEvents"][0]["args"]["name"].asString(),
+            "a\"b\\c\n\x01\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xef\xbf\xbd");
+}
+
 TEST_F(ExportJsonTest, SystemEventsIgnored) {
   TrackId track = context_.track_tracker->CreateAndroidAsyncTrack(
       /*name=*/kNullStringId, /*upid=*/0);
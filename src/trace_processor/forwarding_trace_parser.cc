@@ -23,6 +23,7 @@
 #include "src/trace_processor/importers/proto/proto_trace_parser.h"
 #include "src/trace_processor/importers/proto/proto_trace_reader.h"
 #include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/util/status_macros.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -55,88 +56,112 @@ util::Status ForwardingTraceParser::Parse(std::unique_ptr<uint8_t[]> data,
                                           size_t size) {
   // If this is the first Parse() call, guess the trace type and create the
   // appropriate parser.
+  if (!reader_)
+    RETURN_IF_ERROR(CreateReader(data.get(), size));
+  return reader_->Parse(std::move(data), size);
+}
+
+util::Status ForwardingTraceParser::ParseShared(
+    std::shared_ptr<const uint8_t> data,
+    size_t size) {
+  if (!reader_)
+    RETURN_IF_ERROR(CreateReader(data.get(), size));
+  return reader_->ParseShared(std::move(data), size);
+}
+
+util::Status ForwardingTraceParser::CreateReader(const uint8_t* data,
+                                                 size_t size) {
+  PERFETTO_DCHECK(!reader_);
   static const int64_t kMaxWindowSize = std::numeric_limits<int64_t>::max();
-  if (!reader_) {
-    TraceType trace_type;
-    {
-      auto scoped_trace = context_->storage->TraceExecutionTimeIntoStats(
-          stats::guess_trace_type_duration_ns);
-      trace_type = GuessTraceType(data.get(), size);
+  TraceType trace_type;
+  {
+    auto scoped_trace = context_->storage->TraceExecutionTimeIntoStats(
+        stats::guess_trace_type_duration_ns);
+    trace_type = GuessTraceType(data, size);
+  }
+  switch (trace_type) {
+    case kJsonTraceType: {
+      PERFETTO_DLOG("JSON trace detected");
+      if (context_->json_trace_tokenizer && context_->json_trace_parser) {
+        reader_ = std::move(context_->json_trace_tokenizer);
+
+        // JSON traces have no guarantees about the order of events in them.
+        context_->sorter.reset(new TraceSorter(
+            std::move(context_->json_trace_parser), kMaxWindowSize));
+      } else {
+        return util::ErrStatus("JSON support is disabled");
+      }
+      break;
     }
-    switch (trace_type) {
-      case kJsonTraceType: {
-        PERFETTO_DLOG("JSON trace detected");
-        if (context_->json_trace_tokenizer && context_->json_trace_parser) {
-          reader_ = std::move(context_->json_trace_tokenizer);
-
-          // JSON traces have no guarantees about the order of events in them.
-          context_->sorter.reset(new TraceSorter(
-              std::move(context_->json_trace_parser), kMaxWindowSize));
-        } else {
-          return util::ErrStatus("JSON support is disabled");
-        }
-        break;
+    case kProtoTraceType: {
+      PERFETTO_DLOG("Proto trace detected");
+      // This will be reduced once we read the trace config and we see flush
+      // period being set.
+      reader_.reset(new ProtoTraceReader(context_));
+      context_->sorter.reset(new TraceSorter(
+          std::unique_ptr<TraceParser>(new ProtoTraceParser(context_)),
+          kMaxWindowSize));
+      if (context_->config.sorting_mode ==
+          SortingMode::kAdaptiveWindowedSort) {
+        context_->sorter->EnableAdaptiveWindow(context_->storage.get());
       }
-      case kProtoTraceType: {
-        PERFETTO_DLOG("Proto trace detected");
-        // This will be reduced once we read the trace config and we see flush
-        // period being set.
-        reader_.reset(new ProtoTraceReader(context_));
+      if (context_->config.sorter_max_buffered_events) {
+        context_->sorter->EnableEventBudget(
+            static_cast<size_t>(context_->config.sorter_max_buffered_events),
+            context_->storage.get());
+      }
+      if (context_->config.enable_importer_profiling)
+        context_->sorter->EnableProfiling(context_->storage.get());
+      context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
+      break;
+    }
+    case kNinjaLogTraceType: {
+      PERFETTO_DLOG("Ninja log detected");
+      reader_.reset(new NinjaLogParser(context_));
+      break;
+    }
+    case kFuchsiaTraceType: {
+      PERFETTO_DLOG("Fuchsia trace detected");
+      if (context_->fuchsia_trace_parser &&
+          context_->fuchsia_trace_tokenizer) {
+        reader_ = std::move(context_->fuchsia_trace_tokenizer);
+
+        // Fuschia traces can have massively out of order events.
         context_->sorter.reset(new TraceSorter(
-            std::unique_ptr<TraceParser>(new ProtoTraceParser(context_)),
-            kMaxWindowSize));
-        context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
-        break;
+            std::move(context_->fuchsia_trace_parser), kMaxWindowSize));
+      } else {
+        return util::ErrStatus("Fuchsia support is disabled");
       }
-      case kNinjaLogTraceType: {
-        PERFETTO_DLOG("Ninja log detected");
-        reader_.reset(new NinjaLogParser(context_));
+      break;
+    }
+    case kSystraceTraceType:
+      PERFETTO_DLOG("Systrace trace detected");
+      context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
+      if (context_->systrace_trace_parser) {
+        reader_ = std::move(context_->systrace_trace_parser);
         break;
+      } else {
+        return util::ErrStatus("Systrace support is disabled");
+      }
+    case kGzipTraceType:
+    case kCtraceTraceType:
+      if (trace_type == kGzipTraceType) {
+        PERFETTO_DLOG("gzip trace detected");
+      } else {
+        PERFETTO_DLOG("ctrace trace detected");
       }
-      case kFuchsiaTraceType: {
-        PERFETTO_DLOG("Fuchsia trace detected");
-        if (context_->fuchsia_trace_parser &&
-            context_->fuchsia_trace_tokenizer) {
-          reader_ = std::move(context_->fuchsia_trace_tokenizer);
-
-          // Fuschia traces can have massively out of order events.
-          context_->sorter.reset(new TraceSorter(
-              std::move(context_->fuchsia_trace_parser), kMaxWindowSize));
-        } else {
-          return util::ErrStatus("Fuchsia support is disabled");
-        }
+      if (context_->gzip_trace_parser) {
+        reader_ = std::move(context_->gzip_trace_parser);
         break;
+      } else {
+        return util::ErrStatus(kNoZlibErr);
       }
-      case kSystraceTraceType:
-        PERFETTO_DLOG("Systrace trace detected");
-        context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
-        if (context_->systrace_trace_parser) {
-          reader_ = std::move(context_->systrace_trace_parser);
-          break;
-        } else {
-          return util::ErrStatus("Systrace support is disabled");
-        }
-      case kGzipTraceType:
-      case kCtraceTraceType:
-        if (trace_type == kGzipTraceType) {
-          PERFETTO_DLOG("gzip trace detected");
-        } else {
-          PERFETTO_DLOG("ctrace trace detected");
-        }
-        if (context_->gzip_trace_parser) {
-          reader_ = std::move(context_->gzip_trace_parser);
-          break;
-        } else {
-          return util::ErrStatus(kNoZlibErr);
-        }
-      case kUnknownTraceType:
-        // If renaming this error message don't remove the "(ERR:fmt)" part.
-        // The UI's error_dialog.ts uses it to make the dialog more graceful.
-        return util::ErrStatus("Unknown trace type provided (ERR:fmt)");
-    }
+    case kUnknownTraceType:
+      // If renaming this error message don't remove the "(ERR:fmt)" part.
+      // The UI's error_dialog.ts uses it to make the dialog more graceful.
+      return util::ErrStatus("Unknown trace type provided (ERR:fmt)");
   }
-
-  return reader_->Parse(std::move(data), size);
+  return util::OkStatus();
 }
 
 void ForwardingTraceParser::NotifyEndOfFile() {
@@ -44,9 +44,14 @@ class ForwardingTraceParser : public ChunkedTraceReader {
 
   // ChunkedTraceReader implementation
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseShared(std::shared_ptr<const uint8_t>, size_t) override;
   void NotifyEndOfFile() override;
 
  private:
+  // Guesses the trace type from the first chunk of the trace and creates the
+  // appropriate reader.
+  util::Status CreateReader(const uint8_t* data, size_t size);
+
   TraceProcessorContext* const context_;
   std::unique_ptr<ChunkedTraceReader> reader_;
 };
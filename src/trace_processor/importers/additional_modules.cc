@@ -19,21 +19,23 @@
 #include "src/trace_processor/importers/proto/android_probes_module.h"
 #include "src/trace_processor/importers/proto/graphics_event_module.h"
 #include "src/trace_processor/importers/proto/heap_graph_module.h"
+#include "src/trace_processor/importers/proto/proto_importer_module.h"
 #include "src/trace_processor/importers/proto/system_probes_module.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 void RegisterAdditionalModules(TraceProcessorContext* context) {
-  context->modules.emplace_back(new AndroidProbesModule(context));
-  context->modules.emplace_back(new GraphicsEventModule(context));
-  context->modules.emplace_back(new HeapGraphModule(context));
-  context->modules.emplace_back(new SystemProbesModule(context));
-  context->modules.emplace_back(new FtraceModuleImpl(context));
+  AddImporterModule(context, "android_probes",
+                    new AndroidProbesModule(context));
+  AddImporterModule(context, "graphics_event",
+                    new GraphicsEventModule(context));
+  AddImporterModule(context, "heap_graph", new HeapGraphModule(context));
+  AddImporterModule(context, "system_probes", new SystemProbesModule(context));
   // Ftrace module is special, because it has one extra method for parsing
   // ftrace packets. So we need to store a pointer to it separately.
-  context->ftrace_module =
-      static_cast<FtraceModule*>(context->modules.back().get());
+  context->ftrace_module = static_cast<FtraceModule*>(
+      AddImporterModule(context, "ftrace", new FtraceModuleImpl(context)));
 }
 
 }  // namespace trace_processor
@@ -21,6 +21,13 @@
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// Above this number of args, Flush() falls back to std::stable_sort.
+constexpr size_t kMaxInsertionSortSize = 32;
+
+}  // namespace
+
 ArgsTracker::ArgsTracker(TraceProcessorContext* context) : context_(context) {}
 
 ArgsTracker::~ArgsTracker() {
@@ -47,6 +54,7 @@ void ArgsTracker::AddArg(Column* arg_set_id,
 void ArgsTracker::Flush() {
   using Arg = GlobalArgsTracker::Arg;
 
+  array_indexes_.clear();
   if (args_.empty())
     return;
 
@@ -64,7 +72,22 @@ void ArgsTracker::Flush() {
       return f.row < s.row;
     return f.column < s.column;
   };
-  std::stable_sort(args_.begin(), args_.end(), comparator);
+  if (args_.size() <= kMaxInsertionSortSize) {
+    // Most flushes only see the handful of args of a single event: sort those
+    // with a (stable) insertion sort as std::stable_sort allocates a temporary
+    // buffer on every call.
+    for (size_t i = 1; i < args_.size(); ++i) {
+      if (!comparator(args_[i], args_[i - 1]))
+        continue;
+      Arg arg = args_[i];
+      size_t j = i;
+      for (; j > 0 && comparator(arg, args_[j - 1]); --j)
+        args_[j] = args_[j - 1];
+      args_[j] = arg;
+    }
+  } else {
+    std::stable_sort(args_.begin(), args_.end(), comparator);
+  }
 
   for (uint32_t i = 0; i < args_.size();) {
     const auto& arg = args_[i];
@@ -17,6 +17,9 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_ARGS_TRACKER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_ARGS_TRACKER_H_
 
+#include <unordered_map>
+
+#include "perfetto/ext/base/hash.h"
 #include "src/trace_processor/importers/common/global_args_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
@@ -66,14 +69,13 @@ class ArgsTracker {
     // track the next array index for an array under a specific key.
     void IncrementArrayEntryIndex(StringId key) {
       // Zero-initializes |key| in the map if it doesn't exist yet.
-      args_tracker_
-          ->array_indexes_[std::make_tuple(arg_set_id_column_, row_, key)]++;
+      args_tracker_->array_indexes_[ArrayKey{arg_set_id_column_, row_, key}]++;
     }
 
     size_t GetNextArrayEntryIndex(StringId key) {
       // Zero-initializes |key| in the map if it doesn't exist yet.
       return args_tracker_
-          ->array_indexes_[std::make_tuple(arg_set_id_column_, row_, key)];
+          ->array_indexes_[ArrayKey{arg_set_id_column_, row_, key}];
     }
 
    protected:
@@ -162,9 +164,30 @@ class ArgsTracker {
   std::vector<GlobalArgsTracker::Arg> args_;
   TraceProcessorContext* const context_;
 
-  using ArrayKeyTuple =
-      std::tuple<Column* /*arg_set_id*/, uint32_t /*row*/, StringId /*key*/>;
-  std::map<ArrayKeyTuple, size_t /*next_index*/> array_indexes_;
+  struct ArrayKey {
+    Column* arg_set_id;
+    uint32_t row;
+    StringId key;
+
+    bool operator==(const ArrayKey& other) const {
+      return arg_set_id == other.arg_set_id && row == other.row &&
+             key == other.key;
+    }
+  };
+  struct ArrayKeyHasher {
+    size_t operator()(const ArrayKey& array_key) const {
+      base::Hash hash;
+      hash.Update(reinterpret_cast<uintptr_t>(array_key.arg_set_id));
+      hash.Update(array_key.row);
+      hash.Update(array_key.key.raw_id());
+      return static_cast<size_t>(hash.digest());
+    }
+  };
+
+  // The index of the next entry of each array key. Only meaningful until the
+  // next |Flush|, which replaces the arg set of every row args were added to.
+  std::unordered_map<ArrayKey, size_t /*next_index*/, ArrayKeyHasher>
+      array_indexes_;
 };
 
 }  // namespace trace_processor
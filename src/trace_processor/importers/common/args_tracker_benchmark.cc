@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/importers/common/args_tracker.h"
+#include "src/trace_processor/importers/common/global_args_tracker.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace {
+
+using perfetto::trace_processor::ArgsTracker;
+using perfetto::trace_processor::GlobalArgsTracker;
+using perfetto::trace_processor::kNullStringId;
+using perfetto::trace_processor::SliceId;
+using perfetto::trace_processor::StringId;
+using perfetto::trace_processor::TraceProcessorContext;
+using perfetto::trace_processor::TraceStorage;
+using perfetto::trace_processor::TrackId;
+using perfetto::trace_processor::Variadic;
+
+// Adds |state.range(0)| args to each of a large number of slices, flushing
+// after every slice as the importers do after every event. |state.range(1)|
+// is the number of distinct values of each arg: the smaller it is, the more
+// arg sets are deduped.
+void BM_ArgsTrackerAddAndFlush(benchmark::State& state) {
+  static constexpr uint32_t kSlices = 1024;
+  uint32_t args_per_slice = static_cast<uint32_t>(state.range(0));
+  int64_t distinct_values = state.range(1);
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.global_args_tracker.reset(new GlobalArgsTracker(&context));
+  TraceStorage* storage = context.storage.get();
+
+  std::vector<SliceId> slices;
+  for (uint32_t i = 0; i < kSlices; ++i) {
+    slices.push_back(
+        storage->mutable_slice_table()
+            ->Insert({0, 0, TrackId(0), kNullStringId, kNullStringId, 0, 0, 0})
+            .id);
+  }
+  std::vector<StringId> keys;
+  for (uint32_t i = 0; i < args_per_slice; ++i) {
+    // Args are usually added in no particular order of their keys.
+    std::string key = "args.key_" + std::to_string((i * 7) % args_per_slice);
+    keys.push_back(storage->InternString(perfetto::base::StringView(key)));
+  }
+
+  ArgsTracker tracker(&context);
+  int64_t value = 0;
+  for (auto _ : state) {
+    for (SliceId slice : slices) {
+      auto inserter = tracker.AddArgsTo(slice);
+      for (StringId key : keys)
+        inserter.AddArg(key, Variadic::Integer(value++ % distinct_values));
+      tracker.Flush();
+    }
+  }
+  state.counters["args/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * kSlices * args_per_slice),
+      benchmark::Counter::kIsRate);
+}
+
+}  // namespace
+
+BENCHMARK(BM_ArgsTrackerAddAndFlush)
+    ->ArgPair(4, 16)
+    ->ArgPair(4, 1 << 20)
+    ->ArgPair(16, 16)
+    ->ArgPair(16, 1 << 20)
+    ->ArgPair(64, 1 << 20);
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/common/args_tracker.h"
+
+#include "src/trace_processor/importers/common/global_args_tracker.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class ArgsTrackerTest : public ::testing::Test {
+ public:
+  ArgsTrackerTest() {
+    context_.storage.reset(new TraceStorage());
+    context_.global_args_tracker.reset(new GlobalArgsTracker(&context_));
+    storage_ = context_.storage.get();
+  }
+
+ protected:
+  SliceId InsertSlice() {
+    return storage_->mutable_slice_table()
+        ->Insert({0, 0, TrackId(0), kNullStringId, kNullStringId, 0, 0, 0})
+        .id;
+  }
+
+  uint32_t ArgSetIdOf(SliceId id) {
+    const auto& slices = storage_->slice_table();
+    return slices.arg_set_id()[*slices.id().IndexOf(id)];
+  }
+
+  int64_t IntArg(uint32_t arg_set_id, const char* key) {
+    base::Optional<Variadic> value;
+    EXPECT_TRUE(storage_->ExtractArg(arg_set_id, key, &value).ok());
+    EXPECT_TRUE(value.has_value());
+    return value->int_value;
+  }
+
+  TraceProcessorContext context_;
+  TraceStorage* storage_ = nullptr;
+};
+
+TEST_F(ArgsTrackerTest, UnsortedArgsOfSeveralRows) {
+  SliceId a = InsertSlice();
+  SliceId b = InsertSlice();
+  StringId x = storage_->InternString("x");
+  StringId y = storage_->InternString("y");
+  {
+    ArgsTracker tracker(&context_);
+    tracker.AddArgsTo(b).AddArg(y, Variadic::Integer(4));
+    tracker.AddArgsTo(a).AddArg(y, Variadic::Integer(2));
+    tracker.AddArgsTo(b).AddArg(x, Variadic::Integer(3));
+    tracker.AddArgsTo(a).AddArg(x, Variadic::Integer(1));
+  }
+  ASSERT_EQ(storage_->arg_table().row_count(), 4u);
+  ASSERT_NE(ArgSetIdOf(a), ArgSetIdOf(b));
+  ASSERT_EQ(IntArg(ArgSetIdOf(a), "x"), 1);
+  ASSERT_EQ(IntArg(ArgSetIdOf(a), "y"), 2);
+  ASSERT_EQ(IntArg(ArgSetIdOf(b), "x"), 3);
+  ASSERT_EQ(IntArg(ArgSetIdOf(b), "y"), 4);
+}
+
+TEST_F(ArgsTrackerTest, UpdatePolicy) {
+  SliceId a = InsertSlice();
+  StringId x = storage_->InternString("x");
+  StringId y = storage_->InternString("y");
+  {
+    ArgsTracker tracker(&context_);
+    auto inserter = tracker.AddArgsTo(a);
+    inserter.AddArg(x, Variadic::Integer(1));
+    inserter.AddArg(y, Variadic::Integer(2));
+    inserter.AddArg(x, Variadic::Integer(3));
+    inserter.AddArg(y, Variadic::Integer(4),
+                    ArgsTracker::UpdatePolicy::kSkipIfExists);
+  }
+  ASSERT_EQ(storage_->arg_table().row_count(), 2u);
+  ASSERT_EQ(IntArg(ArgSetIdOf(a), "x"), 3);
+  ASSERT_EQ(IntArg(ArgSetIdOf(a), "y"), 2);
+}
+
+TEST_F(ArgsTrackerTest, IdenticalArgSetsAreDeduped) {
+  SliceId a = InsertSlice();
+  SliceId b = InsertSlice();
+  StringId x = storage_->InternString("x");
+  StringId y = storage_->InternString("y");
+  {
+    ArgsTracker tracker(&context_);
+    tracker.AddArgsTo(a).AddArg(x, Variadic::Integer(1)).AddArg(
+        y, Variadic::Integer(2));
+    tracker.Flush();
+    tracker.AddArgsTo(b).AddArg(y, Variadic::Integer(2)).AddArg(
+        x, Variadic::Integer(1));
+  }
+  ASSERT_EQ(storage_->arg_table().row_count(), 2u);
+  ASSERT_EQ(ArgSetIdOf(a), ArgSetIdOf(b));
+}
+
+TEST_F(ArgsTrackerTest, ManyArgs) {
+  // Enough args to go through the std::stable_sort path of Flush().
+  SliceId a = InsertSlice();
+  std::vector<StringId> keys;
+  for (int i = 0; i < 100; ++i)
+    keys.push_back(storage_->InternString(std::to_string(i).c_str()));
+  {
+    ArgsTracker tracker(&context_);
+    auto inserter = tracker.AddArgsTo(a);
+    for (int i = 99; i >= 0; --i)
+      inserter.AddArg(keys[static_cast<size_t>(i)], Variadic::Integer(i));
+    inserter.AddArg(keys[0], Variadic::Integer(100));
+  }
+  ASSERT_EQ(storage_->arg_table().row_count(), 100u);
+  ASSERT_EQ(IntArg(ArgSetIdOf(a), "0"), 100);
+  ASSERT_EQ(IntArg(ArgSetIdOf(a), "42"), 42);
+}
+
+TEST_F(ArgsTrackerTest, ArrayEntryIndexes) {
+  SliceId a = InsertSlice();
+  SliceId b = InsertSlice();
+  StringId key = storage_->InternString("arr");
+
+  ArgsTracker tracker(&context_);
+  auto inserter_a = tracker.AddArgsTo(a);
+  auto inserter_b = tracker.AddArgsTo(b);
+  ASSERT_EQ(inserter_a.GetNextArrayEntryIndex(key), 0u);
+  inserter_a.IncrementArrayEntryIndex(key);
+  inserter_a.IncrementArrayEntryIndex(key);
+  ASSERT_EQ(inserter_a.GetNextArrayEntryIndex(key), 2u);
+  ASSERT_EQ(inserter_b.GetNextArrayEntryIndex(key), 0u);
+
+  // Flushing replaces the arg set of the rows so the array starts over.
+  tracker.Flush();
+  ASSERT_EQ(inserter_a.GetNextArrayEntryIndex(key), 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
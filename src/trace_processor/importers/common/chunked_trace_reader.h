@@ -19,6 +19,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <memory>
 
@@ -40,6 +41,17 @@ class ChunkedTraceReader {
   // The buffer size is guaranteed to be > 0.
   virtual util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
 
+  // Like Parse() but for a buffer which is shared with the caller (e.g. a
+  // memory-mapped trace file). Readers which can reference the data in place
+  // should override this; by default the data is copied and passed to
+  // Parse().
+  virtual util::Status ParseShared(std::shared_ptr<const uint8_t> data,
+                                   size_t size) {
+    std::unique_ptr<uint8_t[]> copy(new uint8_t[size]);
+    memcpy(copy.get(), data.get(), size);
+    return Parse(std::move(copy), size);
+  }
+
   // Called after the last Parse() call.
   virtual void NotifyEndOfFile() = 0;
 };
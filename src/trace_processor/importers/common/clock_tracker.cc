@@ -135,7 +135,10 @@ uint32_t ClockTracker::AddSnapshot(const std::vector<ClockValue>& clocks) {
       // ones that end on this clock).
       auto begin = graph_.lower_bound(ClockGraphEdge{clock_id, 0, 0});
       auto end = graph_.lower_bound(ClockGraphEdge{clock_id + 1, 0, 0});
-      graph_.erase(begin, end);
+      if (begin != end) {
+        graph_.erase(begin, end);
+        paths_.clear();
+      }
     }
     vect.snapshot_ids.emplace_back(snapshot_id);
     vect.timestamps_ns.emplace_back(timestamp_ns);
@@ -152,11 +155,15 @@ uint32_t ClockTracker::AddSnapshot(const std::vector<ClockValue>& clocks) {
     auto it2 = it1;
     ++it2;
     for (; it2 != clocks.end(); ++it2) {
-      if (!non_monotonic_clocks_.count(it1->clock_id))
-        graph_.emplace(it1->clock_id, it2->clock_id, snapshot_hash);
+      if (!non_monotonic_clocks_.count(it1->clock_id) &&
+          graph_.emplace(it1->clock_id, it2->clock_id, snapshot_hash).second) {
+        paths_.clear();
+      }
 
-      if (!non_monotonic_clocks_.count(it2->clock_id))
-        graph_.emplace(it2->clock_id, it1->clock_id, snapshot_hash);
+      if (!non_monotonic_clocks_.count(it2->clock_id) &&
+          graph_.emplace(it2->clock_id, it1->clock_id, snapshot_hash).second) {
+        paths_.clear();
+      }
     }
   }
   return snapshot_id;
@@ -201,6 +208,28 @@ ClockTracker::ClockPath ClockTracker::FindPath(ClockId src, ClockId target) {
   return ClockPath();  // invalid path.
 }
 
+const ClockTracker::ClockPath& ClockTracker::GetPath(ClockId src,
+                                                     ClockId target) {
+  auto key = std::make_pair(src, target);
+  auto it = paths_.find(key);
+  if (it == paths_.end())
+    it = paths_.emplace(key, FindPath(src, target)).first;
+  return it->second;
+}
+
+void ClockTracker::OnPathNotFound(ClockId src_clock_id,
+                                  int64_t src_timestamp,
+                                  ClockId target_clock_id) {
+  // Too many logs maybe emitted when path is invalid.
+  static std::atomic<uint32_t> dlog_count(0);
+  if (dlog_count++ < 10) {
+    PERFETTO_DLOG("No path from clock %" PRIu64 " to %" PRIu64
+                  " at timestamp %" PRId64,
+                  src_clock_id, target_clock_id, src_timestamp);
+  }
+  context_->storage->IncrementStats(stats::clock_sync_failure);
+}
+
 base::Optional<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
                                                       int64_t src_timestamp,
                                                       ClockId target_clock_id) {
@@ -209,19 +238,33 @@ base::Optional<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
 
   context_->storage->IncrementStats(stats::clock_sync_cache_miss);
 
-  ClockPath path = FindPath(src_clock_id, target_clock_id);
+  const ClockPath& path = GetPath(src_clock_id, target_clock_id);
   if (!path.valid()) {
-    // Too many logs maybe emitted when path is invalid.
-    static std::atomic<uint32_t> dlog_count(0);
-    if (dlog_count++ < 10) {
-      PERFETTO_DLOG("No path from clock %" PRIu64 " to %" PRIu64
-                    " at timestamp %" PRId64,
-                    src_clock_id, target_clock_id, src_timestamp);
-    }
-    context_->storage->IncrementStats(stats::clock_sync_failure);
+    OnPathNotFound(src_clock_id, src_timestamp, target_clock_id);
     return base::nullopt;
   }
+  int64_t ns = GetClock(src_clock_id)->ToNs(src_timestamp);
+  return ConvertNsAlongPath(path, src_clock_id, ns, target_clock_id);
+}
+
+base::Optional<int64_t> ClockTracker::ConvertNsSlowpath(
+    ClockId src_clock_id,
+    int64_t src_ns,
+    ClockId target_clock_id) {
+  context_->storage->IncrementStats(stats::clock_sync_cache_miss);
 
+  const ClockPath& path = GetPath(src_clock_id, target_clock_id);
+  if (!path.valid()) {
+    OnPathNotFound(src_clock_id, src_ns, target_clock_id);
+    return base::nullopt;
+  }
+  return ConvertNsAlongPath(path, src_clock_id, src_ns, target_clock_id);
+}
+
+int64_t ClockTracker::ConvertNsAlongPath(const ClockPath& path,
+                                         ClockId src_clock_id,
+                                         int64_t src_ns,
+                                         ClockId target_clock_id) {
   // We can cache only single-path resolutions between two clocks.
   // Caching multi-path resolutions is harder because the (src,target) tuple
   // is not enough as a cache key: at any step the |ns| value can yield to a
@@ -233,8 +276,7 @@ base::Optional<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
 
   // Iterate trough the path found and translate timestamps onto the new clock
   // domain on each step, until the target domain is reached.
-  ClockDomain* src_domain = GetClock(src_clock_id);
-  int64_t ns = src_domain->ToNs(src_timestamp);
+  int64_t ns = src_ns;
   for (uint32_t i = 0; i < path.len; ++i) {
     const ClockGraphEdge edge = path.at(i);
     ClockDomain* cur_clock = GetClock(std::get<0>(edge));
@@ -299,9 +341,19 @@ base::Optional<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
 
   if (cacheable) {
     cache_entry.src = src_clock_id;
-    cache_entry.src_domain = src_domain;
+    cache_entry.src_domain = GetClock(src_clock_id);
     cache_entry.target = target_clock_id;
-    cache_[rnd_() % cache_.size()] = cache_entry;
+
+    // Replace the entry for the same pair, if any, so that Convert() only ever
+    // has to look at one entry per pair.
+    auto it = std::find_if(
+        cache_.begin(), cache_.end(), [&](const CachedClockPath& ce) {
+          return ce.src == src_clock_id && ce.target == target_clock_id;
+        });
+    size_t idx = it != cache_.end()
+                     ? static_cast<size_t>(it - cache_.begin())
+                     : rnd_() % cache_.size();
+    cache_[idx] = cache_entry;
   }
 
   return ns;
@@ -24,6 +24,7 @@
 #include <map>
 #include <random>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "perfetto/base/logging.h"
@@ -167,9 +168,13 @@ class ClockTracker {
       for (const auto& ce : cache_) {
         if (ce.src != src_clock_id || ce.target != target_clock_id)
           continue;
+        // There is at most one cache entry for each (src, target) pair.
         int64_t ns = ce.src_domain->ToNs(src_timestamp);
         if (ns >= ce.min_ts_ns && ns < ce.max_ts_ns)
           return ns + ce.translation_ns;
+        // ToNs() must not be called again: for incremental clocks it would
+        // apply the delta twice.
+        return ConvertNsSlowpath(src_clock_id, ns, target_clock_id);
       }
     }
     return ConvertSlowpath(src_clock_id, src_timestamp, target_clock_id);
@@ -295,6 +300,26 @@ class ClockTracker {
 
   ClockPath FindPath(ClockId src, ClockId target);
 
+  // Returns the path from |src| to |target|, running FindPath() only the first
+  // time a pair is seen after the graph has changed.
+  const ClockPath& GetPath(ClockId src, ClockId target);
+
+  // Like ConvertSlowpath() but takes a timestamp already converted to ns by
+  // ClockDomain::ToNs().
+  base::Optional<int64_t> ConvertNsSlowpath(ClockId src_clock_id,
+                                            int64_t src_ns,
+                                            ClockId target_clock_id);
+
+  // Converts |src_ns| along |path| and caches the conversion if possible.
+  int64_t ConvertNsAlongPath(const ClockPath& path,
+                             ClockId src_clock_id,
+                             int64_t src_ns,
+                             ClockId target_clock_id);
+
+  void OnPathNotFound(ClockId src_clock_id,
+                      int64_t src_timestamp,
+                      ClockId target_clock_id);
+
   ClockDomain* GetClock(ClockId clock_id) {
     auto it = clocks_.find(clock_id);
     PERFETTO_DCHECK(it != clocks_.end());
@@ -306,7 +331,14 @@ class ClockTracker {
   std::map<ClockId, ClockDomain> clocks_;
   std::set<ClockGraphEdge> graph_;
   std::set<ClockId> non_monotonic_clocks_;
-  std::array<CachedClockPath, 2> cache_{};
+
+  // Result of FindPath() for each (src, target) pair. Cleared when |graph_|
+  // changes.
+  std::map<std::pair<ClockId, ClockId>, ClockPath> paths_;
+
+  // Traces often convert from several clocks (e.g. one incremental clock per
+  // sequence) so keep more than a couple of entries to avoid thrashing.
+  std::array<CachedClockPath, 8> cache_{};
   bool cache_lookups_disabled_for_testing_ = false;
   std::minstd_rand rnd_;  // For cache eviction.
   uint32_t cur_snapshot_id_ = 0;
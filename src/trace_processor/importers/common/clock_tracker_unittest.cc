@@ -236,6 +236,22 @@ TEST_F(ClockTrackerTest, SequenceScopedClocks) {
   EXPECT_EQ(*ct_.ToTraceTime(c66_2, 4 /* abs 30 */), 129000);
 }
 
+// Tests that a cache entry for an incremental clock which doesn't cover the
+// timestamp doesn't cause the delta to be applied twice.
+TEST_F(ClockTrackerTest, IncrementalClockCacheMiss) {
+  ClockTracker::ClockId c64_1 = ct_.SeqScopedClockIdToGlobal(1, 64);
+  ct_.AddSnapshot({{MONOTONIC, 1000},
+                   {c64_1, 10, /*unit_multiplier_ns=*/1000,
+                    /*is_incremental=*/true}});
+  ct_.AddSnapshot({{MONOTONIC, 2000},
+                   {c64_1, 20, /*unit_multiplier_ns=*/1000,
+                    /*is_incremental=*/true}});
+
+  EXPECT_EQ(*ct_.Convert(c64_1, 1 /* abs 21 */, MONOTONIC), 3000);
+  EXPECT_EQ(*ct_.Convert(c64_1, -11 /* abs 10 */, MONOTONIC), 1000);
+  EXPECT_EQ(*ct_.Convert(c64_1, 1 /* abs 11 */, MONOTONIC), 2000);
+}
+
 // Tests that the cache doesn't affect the results of Convert() in unexpected
 // ways.
 TEST_F(ClockTrackerTest, CacheDoesntAffectResults) {
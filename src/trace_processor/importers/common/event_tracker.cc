@@ -17,6 +17,8 @@
 #include "src/trace_processor/importers/common/event_tracker.h"
 
 #include <math.h>
+#include <limits>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
@@ -64,7 +66,10 @@ base::Optional<CounterId> EventTracker::PushCounter(int64_t timestamp,
   max_timestamp_ = timestamp;
 
   auto* counter_values = context_->storage->mutable_counter_table();
-  return counter_values->Insert({timestamp, track_id, value}).id;
+  return counter_values
+      ->Insert({timestamp, track_id, value, base::nullopt, -1 /* dur */,
+                0 /* delta */})
+      .id;
 }
 
 base::Optional<CounterId> EventTracker::PushCounter(
@@ -128,6 +133,43 @@ void EventTracker::FlushPendingEvents() {
 
   pending_upid_resolution_counter_.clear();
   pending_upid_resolution_instant_.clear();
+
+  // Only do this once the track ids above are resolved.
+  ComputeCounterDurations();
+}
+
+void EventTracker::ComputeCounterDurations() {
+  static constexpr uint32_t kNoRow = std::numeric_limits<uint32_t>::max();
+
+  auto* counters = context_->storage->mutable_counter_table();
+  auto* dur = counters->mutable_dur();
+  auto* delta = counters->mutable_delta();
+  const auto& ts = counters->ts();
+  const auto& value = counters->value();
+  const auto& track_id = counters->track_id();
+
+  // Track ids are dense so index the last seen row of each track by id.
+  std::vector<uint32_t> last_row_for_track;
+  for (uint32_t i = 0; i < counters->row_count(); ++i) {
+    uint32_t track = track_id[i].value;
+    if (track >= last_row_for_track.size())
+      last_row_for_track.resize(track + 1, kNoRow);
+
+    uint32_t prev_row = last_row_for_track[track];
+    if (prev_row != kNoRow) {
+      dur->Set(prev_row, ts[i] - ts[prev_row]);
+      delta->Set(prev_row, value[i] - value[prev_row]);
+    }
+    last_row_for_track[track] = i;
+  }
+
+  // The last value of each track lasts until the end of the trace.
+  for (uint32_t row : last_row_for_track) {
+    if (row == kNoRow)
+      continue;
+    dur->Set(row, -1);
+    delta->Set(row, 0);
+  }
 }
 
 }  // namespace trace_processor
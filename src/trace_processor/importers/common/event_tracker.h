@@ -73,7 +73,7 @@ class EventTracker {
                                 bool resolve_utid_to_upid = false);
 
   // Called at the end of trace to flush any events which are pending to the
-  // storage.
+  // storage. This also fills the dur and delta columns of the counter table.
   void FlushPendingEvents();
 
   // For SchedEventTracker.
@@ -83,6 +83,10 @@ class EventTracker {
   }
 
  private:
+  // Sets the dur and delta of every counter to the difference in ts and value
+  // with the next counter on the same track.
+  void ComputeCounterDurations();
+
   // Represents a counter event which is currently pending upid resolution.
   struct PendingUpidResolutionCounter {
     uint32_t row = 0;
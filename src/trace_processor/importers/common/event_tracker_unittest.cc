@@ -67,6 +67,48 @@ TEST_F(EventTrackerTest, CounterDuration) {
 
   ASSERT_EQ(context.storage->counter_table().ts()[2], timestamp + 3);
   ASSERT_DOUBLE_EQ(context.storage->counter_table().value()[2], 5000);
+
+  context.event_tracker->FlushPendingEvents();
+
+  const auto& counters = context.storage->counter_table();
+  ASSERT_EQ(counters.dur()[0], 1);
+  ASSERT_EQ(counters.dur()[1], 2);
+  ASSERT_EQ(counters.dur()[2], 6);
+  ASSERT_EQ(counters.dur()[3], -1);
+
+  ASSERT_DOUBLE_EQ(counters.delta()[0], 3000);
+  ASSERT_DOUBLE_EQ(counters.delta()[1], 1000);
+  ASSERT_DOUBLE_EQ(counters.delta()[2], -4000);
+  ASSERT_DOUBLE_EQ(counters.delta()[3], 0);
+}
+
+TEST_F(EventTrackerTest, CounterDurationMultipleTracks) {
+  StringId name_id = kNullStringId;
+  TrackId track_a = context.track_tracker->InternCpuCounterTrack(name_id, 1);
+  TrackId track_b = context.track_tracker->InternCpuCounterTrack(name_id, 2);
+  TrackId track_c = context.track_tracker->InternCpuCounterTrack(name_id, 3);
+
+  context.event_tracker->PushCounter(100, 1, track_a);
+  context.event_tracker->PushCounter(102, 2, track_b);
+  context.event_tracker->PushCounter(105, 3, track_a);
+  context.event_tracker->PushCounter(105, 4, track_c);
+  context.event_tracker->PushCounter(105, 5, track_b);
+  context.event_tracker->PushCounter(110, 6, track_b);
+  context.event_tracker->FlushPendingEvents();
+
+  const auto& counters = context.storage->counter_table();
+  ASSERT_EQ(counters.row_count(), 6u);
+  ASSERT_EQ(counters.dur()[0], 5);
+  ASSERT_EQ(counters.dur()[1], 3);
+  ASSERT_EQ(counters.dur()[2], -1);
+  ASSERT_EQ(counters.dur()[3], -1);
+  ASSERT_EQ(counters.dur()[4], 5);
+  ASSERT_EQ(counters.dur()[5], -1);
+
+  ASSERT_DOUBLE_EQ(counters.delta()[0], 2);
+  ASSERT_DOUBLE_EQ(counters.delta()[1], 3);
+  ASSERT_DOUBLE_EQ(counters.delta()[4], 1);
+  ASSERT_DOUBLE_EQ(counters.delta()[5], 0);
 }
 
 }  // namespace
@@ -84,8 +84,9 @@ class GlobalArgsTracker {
   ArgSetId AddArgSet(const std::vector<Arg>& args,
                      uint32_t begin,
                      uint32_t end) {
-    std::vector<uint32_t> valid_indexes;
-    valid_indexes.reserve(end - begin);
+    // Reuse the same vector across calls to avoid an allocation per arg set.
+    std::vector<uint32_t>& valid_indexes = valid_indexes_;
+    valid_indexes.clear();
 
     // TODO(eseckler): Also detect "invalid" key combinations in args sets (e.g.
     // "foo" and "foo.bar" in the same arg set)?
@@ -162,6 +163,9 @@ class GlobalArgsTracker {
 
   std::unordered_map<ArgSetHash, uint32_t> arg_row_for_hash_;
 
+  // Scratch space for |AddArgSet|.
+  std::vector<uint32_t> valid_indexes_;
+
   TraceProcessorContext* context_;
 };
 
@@ -157,14 +157,13 @@ base::Optional<UniqueTid> ProcessTracker::GetThreadOrNull(
   auto* threads = context_->storage->mutable_thread_table();
   auto* processes = context_->storage->mutable_process_table();
 
-  auto vector_it = tids_.find(tid);
-  if (vector_it == tids_.end())
+  const std::vector<UniqueTid>* vector = tids_.Find(tid);
+  if (!vector)
     return base::nullopt;
 
   // Iterate backwards through the threads so ones later in the trace are more
   // likely to be picked.
-  const auto& vector = vector_it->second;
-  for (auto it = vector.rbegin(); it != vector.rend(); it++) {
+  for (auto it = vector->rbegin(); it != vector->rend(); it++) {
     UniqueTid current_utid = *it;
 
     // If we finished this thread, we should have removed it from the vector
@@ -444,7 +443,7 @@ void ProcessTracker::AssociateThreadToProcess(UniqueTid utid, UniquePid upid) {
 
 void ProcessTracker::SetPidZeroIgnoredForIdleProcess() {
   // Create a mapping from (t|p)id 0 -> u(t|p)id 0 for the idle process.
-  tids_.emplace(0, std::vector<UniqueTid>{0});
+  tids_.Insert(0, std::vector<UniqueTid>{0});
   pids_.emplace(0, 0);
 
   auto swapper_id = context_->storage->InternString("swapper");
@@ -18,7 +18,10 @@
 #define SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_PROCESS_TRACKER_H_
 
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/string_view.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -51,7 +54,7 @@ class ProcessTracker {
   virtual ~ProcessTracker();
 
   using UniqueProcessIterator =
-      std::multimap<uint32_t, UniquePid>::const_iterator;
+      std::unordered_map<uint32_t, UniquePid>::const_iterator;
   using UniqueProcessBounds =
       std::pair<UniqueProcessIterator, UniqueProcessIterator>;
 
@@ -186,11 +189,13 @@ class ProcessTracker {
 
   // Each tid can have multiple UniqueTid entries, a new UniqueTid is assigned
   // each time a thread is seen in the trace.
-  std::map<uint32_t /* tid */, std::vector<UniqueTid>> tids_;
+  // These maps are looked up for almost every ftrace event so they are hash
+  // maps: nothing depends on iterating them in order of tid/pid.
+  base::FlatHashMap<uint32_t /* tid */, std::vector<UniqueTid>> tids_;
 
   // Each pid can have multiple UniquePid entries, a new UniquePid is assigned
   // each time a process is seen in the trace.
-  std::map<uint32_t /* pid (aka tgid) */, UniquePid> pids_;
+  std::unordered_map<uint32_t /* pid (aka tgid) */, UniquePid> pids_;
 
   // Pending thread associations. The meaning of a pair<ThreadA, ThreadB> in
   // this vector is: we know that A and B belong to the same process, but we
@@ -57,12 +57,13 @@ void SliceTracker::BeginLegacyUnnestable(tables::SliceTable::Row row,
   // Double check that if we've seen this track in the past, it was also
   // marked as unnestable then.
 #if PERFETTO_DCHECK_IS_ON()
-  auto it = stacks_.find(row.track_id);
-  PERFETTO_DCHECK(it == stacks_.end() || it->second.is_legacy_unnestable);
+  const TrackInfo* info = FindTrackInfo(row.track_id);
+  PERFETTO_DCHECK(!info || info->is_legacy_unnestable ||
+                  info->slice_stack.empty());
 #endif
 
   // Ensure that StartSlice knows that this track is unnestable.
-  stacks_[row.track_id].is_legacy_unnestable = true;
+  GetOrCreateTrackInfo(row.track_id)->is_legacy_unnestable = true;
 
   StartSlice(row.ts, row.track_id, args_callback, [this, &row]() {
     return context_->storage->mutable_slice_table()->Insert(row).id;
@@ -98,11 +99,11 @@ base::Optional<uint32_t> SliceTracker::AddArgs(TrackId track_id,
                                                StringId category,
                                                StringId name,
                                                SetArgsCallback args_callback) {
-  auto it = stacks_.find(track_id);
-  if (it == stacks_.end())
+  TrackInfo* track_info = FindTrackInfo(track_id);
+  if (!track_info)
     return base::nullopt;
 
-  auto& stack = it->second.slice_stack;
+  auto& stack = track_info->slice_stack;
   if (stack.empty())
     return base::nullopt;
 
@@ -132,7 +133,7 @@ base::Optional<SliceId> SliceTracker::StartSlice(
   }
   prev_timestamp_ = timestamp;
 
-  auto* track_info = &stacks_[track_id];
+  auto* track_info = GetOrCreateTrackInfo(track_id);
   auto* stack = &track_info->slice_stack;
 
   if (track_info->is_legacy_unnestable) {
@@ -149,28 +150,33 @@ base::Optional<SliceId> SliceTracker::StartSlice(
   }
 
   auto* slices = context_->storage->mutable_slice_table();
-  MaybeCloseStack(timestamp, stack, track_id);
+  MaybeCloseStack(timestamp, stack);
 
   const uint8_t depth = static_cast<uint8_t>(stack->size());
   if (depth >= std::numeric_limits<uint8_t>::max()) {
     PERFETTO_DFATAL("Slices with too large depth found.");
     return base::nullopt;
   }
-  int64_t parent_stack_id =
-      depth == 0 ? 0 : slices->stack_id()[stack->back().row];
-  base::Optional<tables::SliceTable::Id> parent_id =
-      depth == 0 ? base::nullopt
-                 : base::make_optional(slices->id()[stack->back().row]);
+  base::Hash stack_hash;
+  int64_t parent_stack_id = 0;
+  base::Optional<tables::SliceTable::Id> parent_id;
+  if (depth > 0) {
+    stack_hash = stack->back().stack_hash;
+    parent_stack_id = GetStackId(stack_hash);
+    parent_id = slices->id()[stack->back().row];
+  }
 
   SliceId id = inserter();
   uint32_t slice_idx = *slices->id().IndexOf(id);
-  StackPush(track_id, slice_idx);
+  stack_hash.Update(slices->category()[slice_idx].raw_id());
+  stack_hash.Update(slices->name()[slice_idx].raw_id());
+  StackPush(track_id, slice_idx, stack_hash);
 
   // Post fill all the relevant columns. All the other columns should have
   // been filled by the inserter.
   slices->mutable_depth()->Set(slice_idx, depth);
   slices->mutable_parent_stack_id()->Set(slice_idx, parent_stack_id);
-  slices->mutable_stack_id()->Set(slice_idx, GetStackHash(*stack));
+  slices->mutable_stack_id()->Set(slice_idx, GetStackId(stack_hash));
   if (parent_id)
     slices->mutable_parent_id()->Set(slice_idx, *parent_id);
 
@@ -194,13 +200,12 @@ base::Optional<SliceId> SliceTracker::CompleteSlice(
   }
   prev_timestamp_ = timestamp;
 
-  auto it = stacks_.find(track_id);
-  if (it == stacks_.end())
+  TrackInfo* track_info = FindTrackInfo(track_id);
+  if (!track_info)
     return base::nullopt;
 
-  TrackInfo& track_info = it->second;
-  SlicesStack& stack = track_info.slice_stack;
-  MaybeCloseStack(timestamp, &stack, track_id);
+  SlicesStack& stack = track_info->slice_stack;
+  MaybeCloseStack(timestamp, &stack);
   if (stack.empty())
     return base::nullopt;
 
@@ -224,14 +229,14 @@ base::Optional<SliceId> SliceTracker::CompleteSlice(
   }
 
   // Add the legacy unnestable args if they exist.
-  if (track_info.is_legacy_unnestable) {
+  if (track_info->is_legacy_unnestable) {
     auto bound_inserter = tracker->AddArgsTo(slices->id()[slice_idx]);
     bound_inserter.AddArg(
         legacy_unnestable_begin_count_string_id_,
-        Variadic::Integer(track_info.legacy_unnestable_begin_count));
+        Variadic::Integer(track_info->legacy_unnestable_begin_count));
     bound_inserter.AddArg(
         legacy_unnestable_last_begin_ts_string_id_,
-        Variadic::Integer(track_info.legacy_unnestable_last_begin_ts));
+        Variadic::Integer(track_info->legacy_unnestable_last_begin_ts));
   }
 
   // If this slice is the top slice on the stack, pop it off.
@@ -281,19 +286,17 @@ void SliceTracker::SetOnSliceBeginCallback(OnSliceBeginCallback callback) {
 
 base::Optional<SliceId> SliceTracker::GetTopmostSliceOnTrack(
     TrackId track_id) const {
-  const auto iter = stacks_.find(track_id);
-  if (iter == stacks_.end())
+  const TrackInfo* track_info = FindTrackInfo(track_id);
+  if (!track_info)
     return base::nullopt;
-  const auto& stack = iter->second.slice_stack;
+  const auto& stack = track_info->slice_stack;
   if (stack.empty())
     return base::nullopt;
   uint32_t slice_idx = stack.back().row;
   return context_->storage->slice_table().id()[slice_idx];
 }
 
-void SliceTracker::MaybeCloseStack(int64_t ts,
-                                   SlicesStack* stack,
-                                   TrackId track_id) {
+void SliceTracker::MaybeCloseStack(int64_t ts, SlicesStack* stack) {
   auto* slices = context_->storage->mutable_slice_table();
   bool incomplete_descendent = false;
   for (int i = static_cast<int>(stack->size()) - 1; i >= 0; i--) {
@@ -333,33 +336,23 @@ void SliceTracker::MaybeCloseStack(int64_t ts,
         uint32_t child_idx = (*stack)[static_cast<size_t>(j)].row;
         PERFETTO_DCHECK(slices->dur()[child_idx] == kPendingDuration);
         slices->mutable_dur()->Set(child_idx, end_ts - slices->ts()[child_idx]);
-        StackPop(track_id);
+        stack->pop_back();
       }
 
       // Also pop the current row itself and reset the incomplete flag.
-      StackPop(track_id);
+      stack->pop_back();
       incomplete_descendent = false;
 
       continue;
     }
 
     if (end_ts <= ts) {
-      StackPop(track_id);
+      stack->pop_back();
     }
   }
 }
 
-int64_t SliceTracker::GetStackHash(const SlicesStack& stack) {
-  PERFETTO_DCHECK(!stack.empty());
-
-  const auto& slices = context_->storage->slice_table();
-
-  base::Hash hash;
-  for (size_t i = 0; i < stack.size(); i++) {
-    uint32_t slice_idx = stack[i].row;
-    hash.Update(slices.category()[slice_idx].raw_id());
-    hash.Update(slices.name()[slice_idx].raw_id());
-  }
+int64_t SliceTracker::GetStackId(base::Hash stack_hash) {
 
   // For clients which don't have an integer type (i.e. Javascript), returning
   // hashes which have the top 11 bits set leads to numbers which are
@@ -367,16 +360,14 @@ int64_t SliceTracker::GetStackHash(const SlicesStack& stack) {
   // it will be meaningless when passed back to us. For this reason, make sure
   // that the hash is always less than 2^53 - 1.
   constexpr uint64_t kSafeBitmask = (1ull << 53) - 1;
-  return static_cast<int64_t>(hash.digest() & kSafeBitmask);
-}
-
-void SliceTracker::StackPop(TrackId track_id) {
-  stacks_[track_id].slice_stack.pop_back();
+  return static_cast<int64_t>(stack_hash.digest() & kSafeBitmask);
 }
 
-void SliceTracker::StackPush(TrackId track_id, uint32_t slice_idx) {
-  stacks_[track_id].slice_stack.push_back(
-      SliceInfo{slice_idx, ArgsTracker(context_)});
+void SliceTracker::StackPush(TrackId track_id,
+                             uint32_t slice_idx,
+                             base::Hash stack_hash) {
+  stacks_[track_id.value].slice_stack.push_back(
+      SliceInfo{slice_idx, ArgsTracker(context_), stack_hash});
 
   const auto& slices = context_->storage->slice_table();
   if (on_slice_begin_callback_) {
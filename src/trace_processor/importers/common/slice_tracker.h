@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include "perfetto/ext/base/hash.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
@@ -113,6 +114,11 @@ class SliceTracker {
   struct SliceInfo {
     uint32_t row;
     ArgsTracker args_tracker;
+
+    // Hash of the category and name of this slice and of all the slices below
+    // it on the stack. Cached so that the stack id of a child slice can be
+    // computed without going back to the slice table for every ancestor.
+    base::Hash stack_hash;
   };
   using SlicesStack = std::vector<SliceInfo>;
 
@@ -124,7 +130,10 @@ class SliceTracker {
     uint32_t legacy_unnestable_begin_count = 0;
     int64_t legacy_unnestable_last_begin_ts = 0;
   };
-  using StackMap = std::unordered_map<TrackId, TrackInfo>;
+  // Indexed by |TrackId::value|: track ids are dense so this avoids a hash
+  // lookup for every begin/end event. As starting a slice on a new track can
+  // reallocate this vector, callbacks must not start slices themselves.
+  using StackMap = std::vector<TrackInfo>;
 
   // virtual for testing.
   virtual base::Optional<SliceId> StartSlice(int64_t timestamp,
@@ -138,17 +147,32 @@ class SliceTracker {
       SetArgsCallback args_callback,
       std::function<base::Optional<uint32_t>(const SlicesStack&)> finder);
 
-  void MaybeCloseStack(int64_t end_ts, SlicesStack*, TrackId track_id);
+  void MaybeCloseStack(int64_t end_ts, SlicesStack*);
 
   base::Optional<uint32_t> MatchingIncompleteSliceIndex(
       const SlicesStack& stack,
       StringId name,
       StringId category);
 
-  int64_t GetStackHash(const SlicesStack&);
+  // Returns the info for |track_id| or nullptr if no slice was ever started
+  // on it.
+  TrackInfo* FindTrackInfo(TrackId track_id) {
+    return track_id.value < stacks_.size() ? &stacks_[track_id.value]
+                                           : nullptr;
+  }
+  const TrackInfo* FindTrackInfo(TrackId track_id) const {
+    return track_id.value < stacks_.size() ? &stacks_[track_id.value]
+                                           : nullptr;
+  }
+  TrackInfo* GetOrCreateTrackInfo(TrackId track_id) {
+    if (track_id.value >= stacks_.size())
+      stacks_.resize(track_id.value + 1);
+    return &stacks_[track_id.value];
+  }
+
+  static int64_t GetStackId(base::Hash stack_hash);
 
-  void StackPop(TrackId track_id);
-  void StackPush(TrackId track_id, uint32_t slice_idx);
+  void StackPush(TrackId track_id, uint32_t slice_idx, base::Hash stack_hash);
   void FlowTrackerUpdate(TrackId track_id);
 
   OnSliceBeginCallback on_slice_begin_callback_;
@@ -174,6 +174,29 @@ TEST(SliceTrackerTest, TwoSliceDetailed) {
   EXPECT_NE(slices.stack_id()[1], 0);
 }
 
+TEST(SliceTrackerTest, StackIdsOfIdenticalStacks) {
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  SliceTracker tracker(&context);
+
+  constexpr TrackId track_a{1u};
+  constexpr TrackId track_b{2u};
+  tracker.Begin(1, track_a, kNullStringId, StringId::Raw(1));
+  tracker.Begin(2, track_a, kNullStringId, StringId::Raw(2));
+  tracker.End(3, track_a);
+  tracker.Begin(4, track_a, kNullStringId, StringId::Raw(3));
+  tracker.Begin(5, track_b, kNullStringId, StringId::Raw(1));
+  tracker.Begin(6, track_b, kNullStringId, StringId::Raw(3));
+
+  const auto& slices = context.storage->slice_table();
+  EXPECT_EQ(slices.row_count(), 5u);
+  EXPECT_NE(slices.stack_id()[1], slices.stack_id()[2]);
+  EXPECT_EQ(slices.parent_stack_id()[2], slices.stack_id()[0]);
+  EXPECT_EQ(slices.stack_id()[3], slices.stack_id()[0]);
+  EXPECT_EQ(slices.stack_id()[4], slices.stack_id()[2]);
+  EXPECT_EQ(slices.parent_stack_id()[4], slices.stack_id()[0]);
+}
+
 TEST(SliceTrackerTest, Scoped) {
   TraceProcessorContext context;
   context.storage.reset(new TraceStorage());
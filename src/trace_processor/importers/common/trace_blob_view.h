@@ -43,6 +43,24 @@ class TraceBlobView {
     PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
   }
 
+  // Creates a view on memory which is not owned by trace processor (e.g. a
+  // memory-mapped trace file). |buffer| is kept alive until all the views
+  // referencing it are destroyed.
+  TraceBlobView(std::shared_ptr<const uint8_t> buffer,
+                size_t offset,
+                size_t length)
+      : shbuf_(SharedBuf(std::move(buffer))),
+        offset_(static_cast<uint32_t>(offset)),
+        length_(static_cast<uint32_t>(length)) {
+    PERFETTO_DCHECK(offset <= std::numeric_limits<uint32_t>::max());
+    PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
+  }
+
+  // Creates a view which does not reference any memory. This constructor
+  // exists only to disambiguate between the two above.
+  TraceBlobView(std::nullptr_t, size_t offset, size_t length)
+      : TraceBlobView(std::unique_ptr<uint8_t[]>(), offset, length) {}
+
   // Allow std::move().
   TraceBlobView(TraceBlobView&&) noexcept = default;
   TraceBlobView& operator=(TraceBlobView&&) = default;
@@ -83,6 +101,10 @@ class TraceBlobView {
       rcbuf_ = new RefCountedBuf(std::move(mem));
     }
 
+    explicit SharedBuf(std::shared_ptr<const uint8_t> mem) {
+      rcbuf_ = new RefCountedBuf(std::move(mem));
+    }
+
     SharedBuf(const SharedBuf& copy) : rcbuf_(copy.rcbuf_) {
       PERFETTO_DCHECK(rcbuf_->refcount > 0);
       rcbuf_->refcount++;
@@ -117,14 +139,20 @@ class TraceBlobView {
 
     bool operator==(const SharedBuf& x) const { return x.rcbuf_ == rcbuf_; }
     bool operator!=(const SharedBuf& x) const { return !(x == *this); }
-    const uint8_t* data() const { return rcbuf_->mem.get(); }
+    const uint8_t* data() const { return rcbuf_->data; }
 
    private:
+    // Only one of |mem| and |shared_mem| is set. The refcount of |shared_mem|
+    // is atomic so, unlike |refcount|, it can be shared across threads.
     struct RefCountedBuf {
       explicit RefCountedBuf(std::unique_ptr<uint8_t[]> buf)
-          : refcount(1), mem(std::move(buf)) {}
+          : refcount(1), mem(std::move(buf)), data(mem.get()) {}
+      explicit RefCountedBuf(std::shared_ptr<const uint8_t> buf)
+          : refcount(1), shared_mem(std::move(buf)), data(shared_mem.get()) {}
       int refcount;
       std::unique_ptr<uint8_t[]> mem;
+      std::shared_ptr<const uint8_t> shared_mem;
+      const uint8_t* data;
     };
 
     RefCountedBuf* rcbuf_ = nullptr;
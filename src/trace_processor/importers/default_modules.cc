@@ -27,17 +27,21 @@ namespace perfetto {
 namespace trace_processor {
 
 void RegisterDefaultModules(TraceProcessorContext* context) {
-  context->modules.emplace_back(new FtraceModule());
   // Ftrace module is special, because it has one extra method for parsing
   // ftrace packets. So we need to store a pointer to it separately.
-  context->ftrace_module =
-      static_cast<FtraceModule*>(context->modules.back().get());
+  context->ftrace_module = static_cast<FtraceModule*>(
+      AddImporterModule(context, "ftrace", new FtraceModule()));
 
-  context->modules.emplace_back(new MemoryTrackerSnapshotModule(context));
-  context->modules.emplace_back(new ChromeSystemProbesModule(context));
-  context->modules.emplace_back(new TrackEventModule(context));
-  context->modules.emplace_back(new ProfileModule(context));
-  context->modules.emplace_back(new MetadataModule(context));
+  AddImporterModule(context, "memory_tracker_snapshot",
+                    new MemoryTrackerSnapshotModule(context));
+  AddImporterModule(context, "chrome_system_probes",
+                    new ChromeSystemProbesModule(context));
+  // Track events are parsed straight from the TrackEventData created by the
+  // tokenizer, without going through ParsePacket().
+  context->track_event_module = static_cast<TrackEventModule*>(
+      AddImporterModule(context, "track_event", new TrackEventModule(context)));
+  AddImporterModule(context, "profile", new ProfileModule(context));
+  AddImporterModule(context, "metadata", new MetadataModule(context));
 }
 
 }  // namespace trace_processor
@@ -67,5 +67,9 @@ void FtraceModuleImpl::ParseFtracePacket(uint32_t cpu,
   }
 }
 
+void FtraceModuleImpl::NotifyEndOfFile() {
+  tokenizer_.NotifyEndOfFile();
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
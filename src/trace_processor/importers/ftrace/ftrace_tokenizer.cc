@@ -16,6 +16,11 @@
 
 #include "src/trace_processor/importers/ftrace/ftrace_tokenizer.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -30,8 +35,123 @@ namespace perfetto {
 namespace trace_processor {
 
 using protozero::ProtoDecoder;
+using protozero::proto_utils::MakeTagLengthDelimited;
 using protozero::proto_utils::MakeTagVarInt;
 using protozero::proto_utils::ParseVarInt;
+using protozero::proto_utils::WriteVarInt;
+
+using CompactEvents = protos::pbzero::FtraceEventBundle::CompactEvents;
+using CompactSched = protos::pbzero::FtraceEventBundle::CompactSched;
+using RawFormat = protos::pbzero::FtraceEventBundle::RawFormat;
+
+namespace {
+
+// Decodes all the values of the packed varint |field| in one go into
+// |values|, which is only ever grown so that it can be reused without
+// clearing it. Returns the number of values decoded and sets |*parse_error|
+// if the field is malformed.
+size_t DecodePackedVarIntField(const protozero::Field& field,
+                               std::vector<uint64_t>* values,
+                               bool* parse_error) {
+  if (!field.valid())
+    return 0;
+  if (values->size() < field.size())
+    values->resize(field.size());
+  return protozero::DecodePackedVarInts(
+      field.data(), field.data() + field.size(), values->data(), parse_error);
+}
+
+// The types of the records of the ftrace ring buffer, as in
+// src/traced/probes/ftrace/cpu_reader.cc.
+constexpr uint32_t kTypePadding = 29;
+constexpr uint32_t kTypeTimeExtend = 30;
+constexpr uint32_t kTypeTimeStamp = 31;
+
+// Mask for the data length portion of the |commit| field of a page header.
+constexpr uint32_t kPageDataSizeMask = (1u << 27) - 1;
+
+template <typename T>
+bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* value) {
+  if (static_cast<size_t>(end - *ptr) < sizeof(T))
+    return false;
+  memcpy(value, *ptr, sizeof(T));
+  *ptr += sizeof(T);
+  return true;
+}
+
+void AppendVarIntField(uint32_t field_id,
+                       uint64_t value,
+                       std::vector<uint8_t>* out) {
+  uint8_t buf[protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+  uint8_t* pos = WriteVarInt(MakeTagVarInt(field_id), buf);
+  pos = WriteVarInt(value, pos);
+  out->insert(out->end(), buf, pos);
+}
+
+void AppendBytesField(uint32_t field_id,
+                      const uint8_t* data,
+                      size_t size,
+                      std::vector<uint8_t>* out) {
+  uint8_t buf[protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+  uint8_t* pos = WriteVarInt(MakeTagLengthDelimited(field_id), buf);
+  pos = WriteVarInt(size, pos);
+  out->insert(out->end(), buf, pos);
+  out->insert(out->end(), data, data + size);
+}
+
+// Appends the value of |field| of the event at |start|, which is |size| bytes
+// long, as a proto field to |out|. Fields out of the event are skipped, as
+// CpuReader does.
+template <typename RawField>
+void AppendRawField(const RawField& field,
+                    const uint8_t* start,
+                    size_t size,
+                    std::vector<uint8_t>* out) {
+  if (field.offset > size)
+    return;
+  const uint8_t* data = start + field.offset;
+  const size_t avail = size - field.offset;
+  switch (field.type) {
+    case RawFormat::Field::TYPE_UINT:
+    case RawFormat::Field::TYPE_INT: {
+      if (field.size > avail)
+        return;
+      // The ftrace buffer is little endian, like all the supported targets.
+      uint64_t value = 0;
+      memcpy(&value, data, field.size);
+      if (field.type == RawFormat::Field::TYPE_INT && field.size < 8) {
+        const uint64_t sign_bit = 1ull << (field.size * 8 - 1);
+        value = (value ^ sign_bit) - sign_bit;
+      }
+      AppendVarIntField(field.proto_field_id, value, out);
+      return;
+    }
+    case RawFormat::Field::TYPE_CSTRING: {
+      size_t max_len = field.size ? std::min<size_t>(field.size, avail) : avail;
+      const char* str = reinterpret_cast<const char*>(data);
+      AppendBytesField(field.proto_field_id, data, strnlen(str, max_len), out);
+      return;
+    }
+    case RawFormat::Field::TYPE_DATA_LOC: {
+      // The low 16 bits are the offset of the string from the start of the
+      // event, the high 16 bits its length.
+      uint32_t data_loc = 0;
+      if (avail < sizeof(data_loc))
+        return;
+      memcpy(&data_loc, data, sizeof(data_loc));
+      const uint32_t str_off = data_loc & 0xffff;
+      const uint32_t str_len = data_loc >> 16;
+      if (str_off + str_len > size)
+        return;
+      const char* str = reinterpret_cast<const char*>(start + str_off);
+      AppendBytesField(field.proto_field_id, start + str_off,
+                       strnlen(str, str_len), out);
+      return;
+    }
+  }
+}
+
+}  // namespace
 
 PERFETTO_ALWAYS_INLINE
 void FtraceTokenizer::TokenizeFtraceBundle(TraceBlobView bundle,
@@ -51,23 +171,102 @@ void FtraceTokenizer::TokenizeFtraceBundle(TraceBlobView bundle,
     return;
   }
 
+  if (decoder.has_raw_format())
+    TokenizeFtraceRawFormat(decoder.raw_format());
+
   if (decoder.has_compact_sched()) {
-    TokenizeFtraceCompactSched(cpu, decoder.compact_sched().data,
+    TokenizeFtraceCompactSched(decoder.compact_sched().data,
                                decoder.compact_sched().size);
   }
 
+  // With FtraceConfig.delta_timestamps, the timestamp of each event is the
+  // delta from the previous one.
+  uint64_t last_event_timestamp = decoder.event_timestamp_base();
+  uint64_t* timestamp_base =
+      decoder.has_event_timestamp_base() ? &last_event_timestamp : nullptr;
   for (auto it = decoder.event(); it; ++it) {
     protozero::ConstBytes event = *it;
     size_t off = bundle.offset_of(event.data);
-    TokenizeFtraceEvent(cpu, bundle.slice(off, event.size), state);
+    TokenizeFtraceEvent(bundle.slice(off, event.size), timestamp_base);
+  }
+
+  for (auto it = decoder.compact_events(); it; ++it) {
+    protozero::ConstBytes compact_events = *it;
+    TokenizeFtraceCompactEvents(compact_events.data, compact_events.size);
   }
+
+  if (decoder.has_raw_page()) {
+    for (auto it = decoder.raw_page(); it; ++it) {
+      protozero::ConstBytes page = *it;
+      if (PERFETTO_UNLIKELY(!has_raw_format_)) {
+        size_t off = bundle.offset_of(page.data);
+        pending_raw_pages_.push_back(
+            PendingRawPage{cpu, bundle.slice(off, page.size), state});
+        continue;
+      }
+      TokenizeFtraceRawPage(page.data, page.size);
+    }
+  }
+
+  // The events of |event|, of each compact_events and of the raw pages (for
+  // the pages which weren't written raw) interleave.
+  auto by_timestamp = [](const std::pair<int64_t, TraceBlobView>& a,
+                         const std::pair<int64_t, TraceBlobView>& b) {
+    return a.first < b.first;
+  };
+  if (!std::is_sorted(events_.begin(), events_.end(), by_timestamp))
+    std::stable_sort(events_.begin(), events_.end(), by_timestamp);
+
+  PushBundleEvents(cpu, state);
   context_->sorter->FinalizeFtraceEventBatch(cpu);
 }
 
+void FtraceTokenizer::NotifyEndOfFile() {
+  for (size_t i = 0; i < pending_raw_pages_.size(); ++i)
+    context_->storage->IncrementStats(stats::ftrace_raw_page_without_format);
+  pending_raw_pages_.clear();
+}
+
+void FtraceTokenizer::PushBundleEvents(uint32_t cpu,
+                                       PacketSequenceState* state) {
+  // For events with the same timestamp, this preserves the order in which
+  // they would be pushed by pushing each list in turn.
+  size_t switch_idx = 0;
+  size_t waking_idx = 0;
+  size_t event_idx = 0;
+  for (;;) {
+    bool has_switch = switch_idx < compact_switches_.size();
+    bool has_waking = waking_idx < compact_wakings_.size();
+    bool has_event = event_idx < events_.size();
+    int64_t switch_ts = has_switch ? compact_switches_[switch_idx].first : 0;
+    int64_t waking_ts = has_waking ? compact_wakings_[waking_idx].first : 0;
+    int64_t event_ts = has_event ? events_[event_idx].first : 0;
+
+    if (has_switch && (!has_waking || switch_ts <= waking_ts) &&
+        (!has_event || switch_ts <= event_ts)) {
+      const auto& sched_switch = compact_switches_[switch_idx++];
+      context_->sorter->PushInlineFtraceEvent(cpu, sched_switch.first,
+                                              sched_switch.second);
+    } else if (has_waking && (!has_event || waking_ts <= event_ts)) {
+      const auto& sched_waking = compact_wakings_[waking_idx++];
+      context_->sorter->PushInlineFtraceEvent(cpu, sched_waking.first,
+                                              sched_waking.second);
+    } else if (has_event) {
+      auto& event = events_[event_idx++];
+      context_->sorter->PushFtraceEvent(cpu, event.first,
+                                        std::move(event.second), state);
+    } else {
+      break;
+    }
+  }
+  compact_switches_.clear();
+  compact_wakings_.clear();
+  events_.clear();
+}
+
 PERFETTO_ALWAYS_INLINE
-void FtraceTokenizer::TokenizeFtraceEvent(uint32_t cpu,
-                                          TraceBlobView event,
-                                          PacketSequenceState* state) {
+void FtraceTokenizer::TokenizeFtraceEvent(TraceBlobView event,
+                                          uint64_t* timestamp_base) {
   constexpr auto kTimestampFieldNumber =
       protos::pbzero::FtraceEvent::kTimestampFieldNumber;
   const uint8_t* data = event.data();
@@ -98,15 +297,19 @@ void FtraceTokenizer::TokenizeFtraceEvent(uint32_t cpu,
     return;
   }
 
+  if (timestamp_base) {
+    raw_timestamp += *timestamp_base;
+    *timestamp_base = raw_timestamp;
+  }
+
   // We don't need to parse this packet, just push it to be sorted with
   // the timestamp.
   int64_t timestamp = static_cast<int64_t>(raw_timestamp);
-  context_->sorter->PushFtraceEvent(cpu, timestamp, std::move(event), state);
+  events_.emplace_back(timestamp, std::move(event));
 }
 
 PERFETTO_ALWAYS_INLINE
-void FtraceTokenizer::TokenizeFtraceCompactSched(uint32_t cpu,
-                                                 const uint8_t* data,
+void FtraceTokenizer::TokenizeFtraceCompactSched(const uint8_t* data,
                                                  size_t size) {
   protos::pbzero::FtraceEventBundle::CompactSched::Decoder compact_sched(data,
                                                                          size);
@@ -118,94 +321,429 @@ void FtraceTokenizer::TokenizeFtraceCompactSched(uint32_t cpu,
     string_table.push_back(value);
   }
 
-  TokenizeFtraceCompactSchedSwitch(cpu, compact_sched, string_table);
-  TokenizeFtraceCompactSchedWaking(cpu, compact_sched, string_table);
+  TokenizeFtraceCompactSchedSwitch(compact_sched, string_table);
+  TokenizeFtraceCompactSchedWaking(compact_sched, string_table);
 }
 
 void FtraceTokenizer::TokenizeFtraceCompactSchedSwitch(
-    uint32_t cpu,
-    const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
+    const CompactSched::Decoder& compact,
     const std::vector<StringId>& string_table) {
   // Accumulator for timestamp deltas.
   int64_t timestamp_acc = 0;
 
   // The events' fields are stored in a structure-of-arrays style, using packed
-  // repeated fields. Walk each repeated field in step to recover individual
-  // events.
+  // repeated fields. Decode each repeated field in bulk and then walk them in
+  // step to recover individual events.
   bool parse_error = false;
-  auto timestamp_it = compact.switch_timestamp(&parse_error);
-  auto pstate_it = compact.switch_prev_state(&parse_error);
-  auto npid_it = compact.switch_next_pid(&parse_error);
-  auto nprio_it = compact.switch_next_prio(&parse_error);
-  auto comm_it = compact.switch_next_comm_index(&parse_error);
-  for (; timestamp_it && pstate_it && npid_it && nprio_it && comm_it;
-       ++timestamp_it, ++pstate_it, ++npid_it, ++nprio_it, ++comm_it) {
+  const std::vector<uint64_t>& timestamps = compact_fields_[0];
+  const std::vector<uint64_t>& pstates = compact_fields_[1];
+  const std::vector<uint64_t>& npids = compact_fields_[2];
+  const std::vector<uint64_t>& nprios = compact_fields_[3];
+  const std::vector<uint64_t>& comms = compact_fields_[4];
+  const size_t sizes[] = {
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kSwitchTimestampFieldNumber),
+          &compact_fields_[0], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kSwitchPrevStateFieldNumber),
+          &compact_fields_[1], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kSwitchNextPidFieldNumber),
+          &compact_fields_[2], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kSwitchNextPrioFieldNumber),
+          &compact_fields_[3], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kSwitchNextCommIndexFieldNumber),
+          &compact_fields_[4], &parse_error),
+  };
+  const size_t count = *std::min_element(std::begin(sizes), std::end(sizes));
+  for (size_t i = 0; i < count; ++i) {
     InlineSchedSwitch event{};
 
     // delta-encoded timestamp
-    timestamp_acc += static_cast<int64_t>(*timestamp_it);
+    timestamp_acc += static_cast<int64_t>(timestamps[i]);
     int64_t event_timestamp = timestamp_acc;
 
     // index into the interned string table
-    PERFETTO_DCHECK(*comm_it < string_table.size());
-    event.next_comm = string_table[*comm_it];
+    PERFETTO_DCHECK(comms[i] < string_table.size());
+    event.next_comm = string_table[static_cast<uint32_t>(comms[i])];
 
-    event.prev_state = *pstate_it;
-    event.next_pid = *npid_it;
-    event.next_prio = *nprio_it;
+    event.prev_state = static_cast<int64_t>(pstates[i]);
+    event.next_pid = static_cast<int32_t>(npids[i]);
+    event.next_prio = static_cast<int32_t>(nprios[i]);
 
-    context_->sorter->PushInlineFtraceEvent(cpu, event_timestamp, event);
+    compact_switches_.emplace_back(event_timestamp, event);
   }
 
   // Check that all packed buffers were decoded correctly, and fully.
   bool sizes_match =
-      !timestamp_it && !pstate_it && !npid_it && !nprio_it && !comm_it;
+      *std::max_element(std::begin(sizes), std::end(sizes)) == count;
   if (parse_error || !sizes_match)
     context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
 }
 
 void FtraceTokenizer::TokenizeFtraceCompactSchedWaking(
-    uint32_t cpu,
-    const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
+    const CompactSched::Decoder& compact,
     const std::vector<StringId>& string_table) {
   // Accumulator for timestamp deltas.
   int64_t timestamp_acc = 0;
 
   // The events' fields are stored in a structure-of-arrays style, using packed
-  // repeated fields. Walk each repeated field in step to recover individual
-  // events.
+  // repeated fields. Decode each repeated field in bulk and then walk them in
+  // step to recover individual events.
   bool parse_error = false;
-  auto timestamp_it = compact.waking_timestamp(&parse_error);
-  auto pid_it = compact.waking_pid(&parse_error);
-  auto tcpu_it = compact.waking_target_cpu(&parse_error);
-  auto prio_it = compact.waking_prio(&parse_error);
-  auto comm_it = compact.waking_comm_index(&parse_error);
-
-  for (; timestamp_it && pid_it && tcpu_it && prio_it && comm_it;
-       ++timestamp_it, ++pid_it, ++tcpu_it, ++prio_it, ++comm_it) {
+  const std::vector<uint64_t>& timestamps = compact_fields_[0];
+  const std::vector<uint64_t>& pids = compact_fields_[1];
+  const std::vector<uint64_t>& tcpus = compact_fields_[2];
+  const std::vector<uint64_t>& prios = compact_fields_[3];
+  const std::vector<uint64_t>& comms = compact_fields_[4];
+  const size_t sizes[] = {
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kWakingTimestampFieldNumber),
+          &compact_fields_[0], &parse_error),
+      DecodePackedVarIntField(compact.Get(CompactSched::kWakingPidFieldNumber),
+                              &compact_fields_[1], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kWakingTargetCpuFieldNumber),
+          &compact_fields_[2], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kWakingPrioFieldNumber),
+          &compact_fields_[3], &parse_error),
+      DecodePackedVarIntField(
+          compact.Get(CompactSched::kWakingCommIndexFieldNumber),
+          &compact_fields_[4], &parse_error),
+  };
+  const size_t count = *std::min_element(std::begin(sizes), std::end(sizes));
+  for (size_t i = 0; i < count; ++i) {
     InlineSchedWaking event{};
 
     // delta-encoded timestamp
-    timestamp_acc += static_cast<int64_t>(*timestamp_it);
+    timestamp_acc += static_cast<int64_t>(timestamps[i]);
     int64_t event_timestamp = timestamp_acc;
 
     // index into the interned string table
-    PERFETTO_DCHECK(*comm_it < string_table.size());
-    event.comm = string_table[*comm_it];
+    PERFETTO_DCHECK(comms[i] < string_table.size());
+    event.comm = string_table[static_cast<uint32_t>(comms[i])];
 
-    event.pid = *pid_it;
-    event.target_cpu = *tcpu_it;
-    event.prio = *prio_it;
+    event.pid = static_cast<int32_t>(pids[i]);
+    event.target_cpu = static_cast<int32_t>(tcpus[i]);
+    event.prio = static_cast<int32_t>(prios[i]);
 
-    context_->sorter->PushInlineFtraceEvent(cpu, event_timestamp, event);
+    compact_wakings_.emplace_back(event_timestamp, event);
   }
 
   // Check that all packed buffers were decoded correctly, and fully.
   bool sizes_match =
-      !timestamp_it && !pid_it && !tcpu_it && !prio_it && !comm_it;
+      *std::max_element(std::begin(sizes), std::end(sizes)) == count;
   if (parse_error || !sizes_match)
     context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
 }
 
+void FtraceTokenizer::TokenizeFtraceRawFormat(protozero::ConstBytes data) {
+  RawFormat::Decoder format(data.data, data.size);
+  has_raw_format_ = true;
+  raw_page_header_size_len_ =
+      static_cast<uint16_t>(format.page_header_size_len());
+
+  auto decode_field = [](protozero::ConstBytes bytes) {
+    RawFormat::Field::Decoder field(bytes.data, bytes.size);
+    RawField raw_field{};
+    raw_field.proto_field_id = field.proto_field_id();
+    raw_field.type = static_cast<uint32_t>(field.type());
+    raw_field.offset = field.offset();
+    raw_field.size = field.size();
+    return raw_field;
+  };
+  auto is_valid = [](const RawField& field) {
+    switch (field.type) {
+      case RawFormat::Field::TYPE_UINT:
+      case RawFormat::Field::TYPE_INT:
+        return field.size > 0 && field.size <= 8;
+      case RawFormat::Field::TYPE_CSTRING:
+      case RawFormat::Field::TYPE_DATA_LOC:
+        return true;
+    }
+    return false;
+  };
+
+  raw_common_fields_.clear();
+  for (auto it = format.common_field(); it; ++it) {
+    RawField field = decode_field(*it);
+    if (is_valid(field))
+      raw_common_fields_.push_back(field);
+  }
+  for (auto it = format.event(); it; ++it) {
+    RawFormat::Event::Decoder event(*it);
+    RawEvent raw_event{};
+    raw_event.proto_field_id = event.proto_field_id();
+    for (auto field_it = event.field(); field_it; ++field_it) {
+      RawField field = decode_field(*field_it);
+      if (is_valid(field))
+        raw_event.fields.push_back(field);
+    }
+    raw_events_[event.id()] = std::move(raw_event);
+  }
+
+  // Decode the pages which were waiting for the format, one batch per page to
+  // keep each batch on a single cpu.
+  std::vector<PendingRawPage> pending_pages = std::move(pending_raw_pages_);
+  pending_raw_pages_.clear();
+  for (const PendingRawPage& pending : pending_pages) {
+    TokenizeFtraceRawPage(pending.page.data(), pending.page.length());
+    PushBundleEvents(pending.cpu, pending.state);
+    context_->sorter->FinalizeFtraceEventBatch(pending.cpu);
+  }
+}
+
+// A raw page is a copy of an ftrace ring buffer page, see
+// CpuReader::ParsePageHeader() and CpuReader::ParsePagePayload().
+void FtraceTokenizer::TokenizeFtraceRawPage(const uint8_t* data, size_t size) {
+  const uint8_t* ptr = data;
+  const uint8_t* const page_end = data + size;
+  uint64_t timestamp = 0;
+  uint32_t size_and_flags = 0;
+  if (!ReadAndAdvance(&ptr, page_end, &timestamp) ||
+      !ReadAndAdvance(&ptr, page_end, &size_and_flags) ||
+      raw_page_header_size_len_ < sizeof(size_and_flags) ||
+      static_cast<size_t>(page_end - ptr) <
+          raw_page_header_size_len_ - sizeof(size_and_flags)) {
+    context_->storage->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+    return;
+  }
+  ptr += raw_page_header_size_len_ - sizeof(size_and_flags);
+  const size_t payload_size = size_and_flags & kPageDataSizeMask;
+  if (payload_size > static_cast<size_t>(page_end - ptr)) {
+    context_->storage->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+    return;
+  }
+  const uint8_t* const end = ptr + payload_size;
+
+  raw_events_buf_.clear();
+  raw_event_locs_.clear();
+  bool parse_error = false;
+  while (ptr < end && !parse_error) {
+    uint32_t event_header = 0;
+    if (!ReadAndAdvance(&ptr, end, &event_header)) {
+      parse_error = true;
+      break;
+    }
+    const uint32_t type_or_length = event_header & 0x1f;
+    const uint32_t time_delta = event_header >> 5;
+    timestamp += time_delta;
+
+    uint32_t event_size = 0;
+    switch (type_or_length) {
+      case kTypePadding:
+        if (!ReadAndAdvance(&ptr, end, &event_size) || event_size < 4 ||
+            event_size - 4 > static_cast<size_t>(end - ptr)) {
+          parse_error = true;
+          break;
+        }
+        ptr += event_size - 4;
+        continue;
+      case kTypeTimeExtend:
+      case kTypeTimeStamp: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance(&ptr, end, &time_delta_ext)) {
+          parse_error = true;
+          break;
+        }
+        if (type_or_length == kTypeTimeStamp)
+          timestamp = time_delta;
+        timestamp += static_cast<uint64_t>(time_delta_ext) << 27;
+        continue;
+      }
+      case 0:
+        // An extended record, whose size (including itself) is in the first
+        // word of the payload.
+        if (!ReadAndAdvance(&ptr, end, &event_size) || event_size < 4) {
+          parse_error = true;
+          break;
+        }
+        event_size -= 4;
+        break;
+      default:
+        event_size = 4 * type_or_length;
+        break;
+    }
+    if (parse_error)
+      break;
+
+    const uint8_t* start = ptr;
+    uint16_t ftrace_event_id = 0;
+    if (event_size > static_cast<size_t>(end - ptr) ||
+        !ReadAndAdvance(&ptr, end, &ftrace_event_id)) {
+      parse_error = true;
+      break;
+    }
+    ptr = start + event_size;
+
+    const RawEvent* event = raw_events_.Find(ftrace_event_id);
+    if (PERFETTO_UNLIKELY(!event)) {
+      context_->storage->IncrementStats(stats::ftrace_raw_page_unknown_event);
+      continue;
+    }
+    EncodeFtraceRawEvent(timestamp, *event, start, event_size);
+  }
+  if (parse_error)
+    context_->storage->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+
+  FlushRawEvents();
+}
+
+void FtraceTokenizer::FlushRawEvents() {
+  if (raw_event_locs_.empty())
+    return;
+  std::unique_ptr<uint8_t[]> events_data(new uint8_t[raw_events_buf_.size()]);
+  memcpy(events_data.get(), raw_events_buf_.data(), raw_events_buf_.size());
+  TraceBlobView events(std::move(events_data), 0, raw_events_buf_.size());
+  for (const RawEventLoc& loc : raw_event_locs_)
+    events_.emplace_back(loc.timestamp, events.slice(loc.offset, loc.size));
+}
+
+void FtraceTokenizer::EncodeFtraceRawEvent(uint64_t timestamp,
+                                           const RawEvent& event,
+                                           const uint8_t* start,
+                                           size_t size) {
+  const size_t event_off = raw_events_buf_.size();
+  AppendVarIntField(protos::pbzero::FtraceEvent::kTimestampFieldNumber,
+                    timestamp, &raw_events_buf_);
+  for (const RawField& field : raw_common_fields_)
+    AppendRawField(field, start, size, &raw_events_buf_);
+
+  // The length of the nested message is backfilled once its fields are
+  // written, with a redundant varint like protozero::Message does.
+  uint8_t tag[protozero::proto_utils::kMaxTagEncodedSize];
+  uint8_t* tag_end = WriteVarInt(MakeTagLengthDelimited(event.proto_field_id),
+                                 tag);
+  raw_events_buf_.insert(raw_events_buf_.end(), tag, tag_end);
+  const size_t size_off = raw_events_buf_.size();
+  raw_events_buf_.resize(size_off +
+                         protozero::proto_utils::kMessageLengthFieldSize);
+  for (const RawField& field : event.fields)
+    AppendRawField(field, start, size, &raw_events_buf_);
+  const size_t nested_size = raw_events_buf_.size() - size_off -
+                             protozero::proto_utils::kMessageLengthFieldSize;
+  protozero::proto_utils::WriteRedundantVarInt(
+      static_cast<uint32_t>(nested_size), &raw_events_buf_[size_off]);
+
+  raw_event_locs_.push_back(RawEventLoc{static_cast<int64_t>(timestamp),
+                                        event_off,
+                                        raw_events_buf_.size() - event_off});
+}
+
+void FtraceTokenizer::TokenizeFtraceCompactEvents(const uint8_t* data,
+                                                  size_t size) {
+  CompactEvents::Decoder compact(data, size);
+  const uint32_t proto_field_id = compact.proto_field_id();
+
+  std::vector<protozero::ConstChars> string_table;
+  for (auto it = compact.intern_table(); it; ++it)
+    string_table.push_back(*it);
+
+  // As for compact_sched, decode each packed field in bulk and then walk them
+  // in step to recover the events. The first two "columns" are the timestamps
+  // and the pids.
+  enum class ColumnType { kUnsigned, kSigned, kString };
+  struct ColumnInfo {
+    uint32_t proto_field_id;
+    ColumnType type;
+  };
+  std::vector<ColumnInfo> columns;
+  std::vector<size_t> sizes;
+  bool parse_error = false;
+  auto decode = [this, &sizes, &parse_error](const protozero::Field& field) {
+    const size_t idx = sizes.size();
+    if (compact_event_columns_.size() <= idx)
+      compact_event_columns_.resize(idx + 1);
+    sizes.push_back(DecodePackedVarIntField(
+        field, &compact_event_columns_[idx], &parse_error));
+  };
+  decode(compact.Get(CompactEvents::kTimestampFieldNumber));
+  decode(compact.Get(CompactEvents::kPidFieldNumber));
+  for (auto it = compact.column(); it; ++it) {
+    CompactEvents::Column::Decoder column(*it);
+    ColumnInfo info{column.proto_field_id(), ColumnType::kUnsigned};
+    uint32_t values_field_id = CompactEvents::Column::kValueFieldNumber;
+    if (column.has_signed_value()) {
+      info.type = ColumnType::kSigned;
+      values_field_id = CompactEvents::Column::kSignedValueFieldNumber;
+    } else if (column.has_string_index()) {
+      info.type = ColumnType::kString;
+      values_field_id = CompactEvents::Column::kStringIndexFieldNumber;
+    }
+    columns.push_back(info);
+    decode(column.Get(values_field_id));
+  }
+  const size_t count = *std::min_element(sizes.begin(), sizes.end());
+
+  raw_events_buf_.clear();
+  raw_event_locs_.clear();
+  uint64_t timestamp = 0;
+  for (size_t i = 0; i < count; ++i) {
+    // delta-encoded timestamp
+    timestamp += compact_event_columns_[0][i];
+
+    const size_t event_off = raw_events_buf_.size();
+    AppendVarIntField(protos::pbzero::FtraceEvent::kTimestampFieldNumber,
+                      timestamp, &raw_events_buf_);
+    AppendVarIntField(protos::pbzero::FtraceEvent::kPidFieldNumber,
+                      compact_event_columns_[1][i], &raw_events_buf_);
+
+    // The length of the nested message is backfilled as in
+    // EncodeFtraceRawEvent().
+    uint8_t tag[protozero::proto_utils::kMaxTagEncodedSize];
+    uint8_t* tag_end = WriteVarInt(MakeTagLengthDelimited(proto_field_id), tag);
+    raw_events_buf_.insert(raw_events_buf_.end(), tag, tag_end);
+    const size_t size_off = raw_events_buf_.size();
+    raw_events_buf_.resize(size_off +
+                           protozero::proto_utils::kMessageLengthFieldSize);
+    for (size_t c = 0; c < columns.size(); ++c) {
+      const uint64_t value = compact_event_columns_[c + 2][i];
+      switch (columns[c].type) {
+        case ColumnType::kUnsigned:
+          AppendVarIntField(columns[c].proto_field_id, value,
+                            &raw_events_buf_);
+          break;
+        case ColumnType::kSigned:
+          AppendVarIntField(
+              columns[c].proto_field_id,
+              static_cast<uint64_t>(
+                  protozero::proto_utils::ZigZagDecode(value)),
+              &raw_events_buf_);
+          break;
+        case ColumnType::kString: {
+          if (PERFETTO_UNLIKELY(value >= string_table.size())) {
+            parse_error = true;
+            break;
+          }
+          const protozero::ConstChars& str = string_table[value];
+          AppendBytesField(columns[c].proto_field_id,
+                           reinterpret_cast<const uint8_t*>(str.data), str.size,
+                           &raw_events_buf_);
+          break;
+        }
+      }
+    }
+    const size_t nested_size = raw_events_buf_.size() - size_off -
+                               protozero::proto_utils::kMessageLengthFieldSize;
+    protozero::proto_utils::WriteRedundantVarInt(
+        static_cast<uint32_t>(nested_size), &raw_events_buf_[size_off]);
+
+    raw_event_locs_.push_back(RawEventLoc{static_cast<int64_t>(timestamp),
+                                          event_off,
+                                          raw_events_buf_.size() - event_off});
+  }
+  FlushRawEvents();
+
+  // Check that all packed buffers were decoded correctly, and fully.
+  bool sizes_match = *std::max_element(sizes.begin(), sizes.end()) == count;
+  if (parse_error || !sizes_match) {
+    context_->storage->IncrementStats(
+        stats::ftrace_compact_events_parse_errors);
+  }
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
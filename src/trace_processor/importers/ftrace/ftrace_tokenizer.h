@@ -17,9 +17,16 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_TOKENIZER_H_
 
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/protozero/field.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
 #include "src/trace_processor/importers/common/trace_blob_view.h"
 #include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/timestamped_trace_piece.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
 namespace perfetto {
@@ -34,23 +41,107 @@ class FtraceTokenizer {
 
   void TokenizeFtraceBundle(TraceBlobView bundle, PacketSequenceState*);
 
+  // Accounts for the raw pages which were never decoded because their bundle
+  // had no raw_format.
+  void NotifyEndOfFile();
+
  private:
-  void TokenizeFtraceEvent(uint32_t cpu,
-                           TraceBlobView event,
-                           PacketSequenceState*);
-  void TokenizeFtraceCompactSched(uint32_t cpu,
-                                  const uint8_t* data,
-                                  size_t size);
+  // A field of FtraceEventBundle.RawFormat.
+  struct RawField {
+    uint32_t proto_field_id;
+    uint32_t type;
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  // The layout of an event of the raw pages.
+  struct RawEvent {
+    uint32_t proto_field_id;
+    std::vector<RawField> fields;
+  };
+
+  // Where an FtraceEvent decoded from a raw page or from compact_events is in
+  // |raw_events_buf_|.
+  struct RawEventLoc {
+    int64_t timestamp;
+    size_t offset;
+    size_t size;
+  };
+
+  // A raw page seen before any raw_format.
+  struct PendingRawPage {
+    uint32_t cpu;
+    TraceBlobView page;
+    PacketSequenceState* state;
+  };
+
+  // If |timestamp_base| is set, the timestamp of |event| is a delta from it,
+  // and it's updated to the timestamp of |event|.
+  void TokenizeFtraceEvent(TraceBlobView event, uint64_t* timestamp_base);
+  void TokenizeFtraceCompactSched(const uint8_t* data, size_t size);
   void TokenizeFtraceCompactSchedSwitch(
-      uint32_t cpu,
       const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
       const std::vector<StringId>& string_table);
   void TokenizeFtraceCompactSchedWaking(
-      uint32_t cpu,
       const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
       const std::vector<StringId>& string_table);
+  void TokenizeFtraceRawFormat(protozero::ConstBytes);
+
+  // Decodes the events of a raw ftrace page (see FtraceConfig.raw_pages) into
+  // FtraceEvent protos, which are added to |events_|.
+  void TokenizeFtraceRawPage(const uint8_t* data, size_t size);
+
+  // Encodes the event at |start| with the layout |event| at the end of
+  // |raw_events_buf_|.
+  void EncodeFtraceRawEvent(uint64_t timestamp,
+                            const RawEvent& event,
+                            const uint8_t* start,
+                            size_t size);
+
+  // Decodes the columns of a compact_events message (see
+  // FtraceConfig.compact_events) back into FtraceEvent protos, which are added
+  // to |events_|.
+  void TokenizeFtraceCompactEvents(const uint8_t* data, size_t size);
+
+  // Moves the FtraceEvent protos of |raw_events_buf_| into |events_|.
+  void FlushRawEvents();
+
+  // Pushes the events decoded from a bundle to the sorter, merging the three
+  // lists below in timestamp order.
+  void PushBundleEvents(uint32_t cpu, PacketSequenceState*);
 
   TraceProcessorContext* context_;
+
+  // The events decoded from the bundle being tokenized. Within a bundle, each
+  // of these lists is usually sorted by timestamp but the lists interleave
+  // with each other; pushing them to the sorter one after the other would
+  // force the sorter to re-sort the CPU's queue for every bundle. Reused
+  // across bundles to avoid reallocating.
+  std::vector<std::pair<int64_t, InlineSchedSwitch>> compact_switches_;
+  std::vector<std::pair<int64_t, InlineSchedWaking>> compact_wakings_;
+  std::vector<std::pair<int64_t, TraceBlobView>> events_;
+
+  // The values of the packed fields of the compact_sched message being
+  // tokenized, one vector for each field of a switch or waking event. Reused
+  // across bundles to avoid reallocating.
+  std::array<std::vector<uint64_t>, 5> compact_fields_;
+
+  // The union of the raw_format of the bundles seen so far.
+  bool has_raw_format_ = false;
+  uint16_t raw_page_header_size_len_ = 0;
+  std::vector<RawField> raw_common_fields_;
+  base::FlatHashMap<uint32_t, RawEvent> raw_events_;
+
+  std::vector<PendingRawPage> pending_raw_pages_;
+
+  // The FtraceEvent protos decoded from the raw page or the compact_events
+  // being tokenized. Reused across pages to avoid reallocating.
+  std::vector<uint8_t> raw_events_buf_;
+  std::vector<RawEventLoc> raw_event_locs_;
+
+  // The values of the columns of the compact_events being tokenized, as
+  // |compact_fields_|.
+  std::vector<std::vector<uint64_t>> compact_event_columns_;
 };
 
 }  // namespace trace_processor
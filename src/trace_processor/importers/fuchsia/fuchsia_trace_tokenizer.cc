@@ -61,11 +61,40 @@ constexpr uint32_t kZxObjTypeThread = 2;
 // Argument types
 constexpr uint32_t kArgString = 6;
 constexpr uint32_t kArgKernelObject = 8;
+
+// Returns the end state of a sched slice whose thread was switched out in the
+// |outgoing_state| Zircon thread state.
+ftrace_utils::TaskState ToTaskState(uint32_t outgoing_state) {
+  switch (outgoing_state) {
+    case kThreadNew:
+    case kThreadRunning:
+      return ftrace_utils::TaskState(ftrace_utils::TaskState::kRunnable);
+    case kThreadBlocked:
+      return ftrace_utils::TaskState(
+          ftrace_utils::TaskState::kInterruptibleSleep);
+    case kThreadSuspended:
+      return ftrace_utils::TaskState(ftrace_utils::TaskState::kStopped);
+    case kThreadDying:
+      return ftrace_utils::TaskState(ftrace_utils::TaskState::kExitZombie);
+    case kThreadDead:
+      return ftrace_utils::TaskState(ftrace_utils::TaskState::kExitDead);
+  }
+  return ftrace_utils::TaskState();
+}
 }  // namespace
 
 FuchsiaTraceTokenizer::FuchsiaTraceTokenizer(TraceProcessorContext* context)
     : context_(context) {
   RegisterProvider(0, "");
+
+  // Intern the end states once rather than for every context switch.
+  for (uint32_t state = 0; state <= kThreadDead; state++) {
+    ftrace_utils::TaskState end_state = ToTaskState(state);
+    thread_end_state_ids_.push_back(
+        end_state.is_valid()
+            ? context_->storage->InternString(end_state.ToString().data())
+            : kNullStringId);
+  }
 }
 
 FuchsiaTraceTokenizer::~FuchsiaTraceTokenizer() = default;
@@ -253,7 +282,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
         }
         StringId id = storage->InternString(s);
 
-        current_provider_->string_table[index] = id;
+        current_provider_->SetString(index, id);
       }
       break;
     }
@@ -266,7 +295,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
           return;
         }
 
-        current_provider_->thread_table[index] = tinfo;
+        current_provider_->SetThread(index, tinfo);
       }
       break;
     }
@@ -302,14 +331,14 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
         cursor.ReadInlineThread(nullptr);
       } else {
         record->InsertThread(thread_ref,
-                             current_provider_->thread_table[thread_ref]);
+                             current_provider_->GetThread(thread_ref));
       }
 
       if (fuchsia_trace_utils::IsInlineString(cat_ref)) {
         // Skip over inline string
         cursor.ReadInlineString(cat_ref, nullptr);
       } else {
-        record->InsertString(cat_ref, current_provider_->string_table[cat_ref]);
+        record->InsertString(cat_ref, current_provider_->GetString(cat_ref));
       }
 
       if (fuchsia_trace_utils::IsInlineString(name_ref)) {
@@ -317,7 +346,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
         cursor.ReadInlineString(name_ref, nullptr);
       } else {
         record->InsertString(name_ref,
-                             current_provider_->string_table[name_ref]);
+                             current_provider_->GetString(name_ref));
       }
 
       uint32_t n_args =
@@ -341,7 +370,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
           cursor.ReadInlineString(arg_name_ref, nullptr);
         } else {
           record->InsertString(arg_name_ref,
-                               current_provider_->string_table[arg_name_ref]);
+                               current_provider_->GetString(arg_name_ref));
         }
 
         if (arg_type == kArgString) {
@@ -352,7 +381,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
             cursor.ReadInlineString(arg_value_ref, nullptr);
           } else {
             record->InsertString(
-                arg_value_ref, current_provider_->string_table[arg_value_ref]);
+                arg_value_ref, current_provider_->GetString(arg_value_ref));
           }
         }
 
@@ -383,7 +412,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
         }
         name = storage->InternString(name_view);
       } else {
-        name = current_provider_->string_table[name_ref];
+        name = current_provider_->GetString(name_ref);
       }
 
       switch (obj_type) {
@@ -425,7 +454,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
                 }
               } else {
                 arg_name = storage->GetString(
-                    current_provider_->string_table[arg_name_ref]);
+                    current_provider_->GetString(arg_name_ref));
               }
 
               if (arg_name == "process") {
@@ -483,7 +512,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
           return;
         }
       } else {
-        outgoing_thread = current_provider_->thread_table[outgoing_thread_ref];
+        outgoing_thread = current_provider_->GetThread(outgoing_thread_ref);
       }
 
       fuchsia_trace_utils::ThreadInfo incoming_thread;
@@ -493,7 +522,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
           return;
         }
       } else {
-        incoming_thread = current_provider_->thread_table[incoming_thread_ref];
+        incoming_thread = current_provider_->GetThread(incoming_thread_ref);
       }
 
       // A thread with priority 0 represents an idle CPU
@@ -509,43 +538,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
                                 static_cast<uint32_t>(outgoing_thread.pid));
         RunningThread previous_thread = cpu_threads_[cpu];
 
-        ftrace_utils::TaskState end_state;
-        switch (outgoing_state) {
-          case kThreadNew:
-          case kThreadRunning: {
-            end_state =
-                ftrace_utils::TaskState(ftrace_utils::TaskState::kRunnable);
-            break;
-          }
-          case kThreadBlocked: {
-            end_state = ftrace_utils::TaskState(
-                ftrace_utils::TaskState::kInterruptibleSleep);
-            break;
-          }
-          case kThreadSuspended: {
-            end_state =
-                ftrace_utils::TaskState(ftrace_utils::TaskState::kStopped);
-            break;
-          }
-          case kThreadDying: {
-            end_state =
-                ftrace_utils::TaskState(ftrace_utils::TaskState::kExitZombie);
-            break;
-          }
-          case kThreadDead: {
-            end_state =
-                ftrace_utils::TaskState(ftrace_utils::TaskState::kExitDead);
-            break;
-          }
-          default: {
-            break;
-          }
-        }
-
-        auto id =
-            end_state.is_valid()
-                ? context_->storage->InternString(end_state.ToString().data())
-                : kNullStringId;
+        StringId id = GetThreadEndStateId(outgoing_state);
         storage->mutable_sched_slice_table()->Insert(
             {previous_thread.start_ts, ts - previous_thread.start_ts, cpu, utid,
              id, outgoing_priority});
@@ -564,6 +557,12 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
   }
 }
 
+StringId FuchsiaTraceTokenizer::GetThreadEndStateId(uint32_t outgoing_state) {
+  return outgoing_state < thread_end_state_ids_.size()
+             ? thread_end_state_ids_[outgoing_state]
+             : kNullStringId;
+}
+
 void FuchsiaTraceTokenizer::RegisterProvider(uint32_t provider_id,
                                              std::string name) {
   std::unique_ptr<ProviderInfo> provider(new ProviderInfo());
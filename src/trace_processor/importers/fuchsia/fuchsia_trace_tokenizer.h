@@ -17,6 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FUCHSIA_FUCHSIA_TRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FUCHSIA_FUCHSIA_TRACE_TOKENIZER_H_
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "src/trace_processor/importers/common/chunked_trace_reader.h"
 #include "src/trace_processor/importers/common/trace_blob_view.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_trace_utils.h"
@@ -39,13 +43,37 @@ class FuchsiaTraceTokenizer : public ChunkedTraceReader {
   void NotifyEndOfFile() override;
 
  private:
+  // The string and thread tables are indexed by the (at most 15 and 8 bits)
+  // refs found in the records, and are looked up several times for every
+  // event. So they are kept in vectors, which grow as entries are added.
+  // Entries which were never added are null, like in the trace format.
   struct ProviderInfo {
     std::string name;
 
-    std::unordered_map<uint64_t, StringId> string_table;
-    std::unordered_map<uint64_t, fuchsia_trace_utils::ThreadInfo> thread_table;
+    std::vector<StringId> string_table;
+    std::vector<fuchsia_trace_utils::ThreadInfo> thread_table;
 
     uint64_t ticks_per_second = 1000000000;
+
+    StringId GetString(uint32_t index) const {
+      return index < string_table.size() ? string_table[index]
+                                         : kNullStringId;
+    }
+    void SetString(uint32_t index, StringId id) {
+      if (index >= string_table.size())
+        string_table.resize(index + 1, kNullStringId);
+      string_table[index] = id;
+    }
+
+    fuchsia_trace_utils::ThreadInfo GetThread(uint32_t index) const {
+      return index < thread_table.size() ? thread_table[index]
+                                         : fuchsia_trace_utils::ThreadInfo{};
+    }
+    void SetThread(uint32_t index, fuchsia_trace_utils::ThreadInfo info) {
+      if (index >= thread_table.size())
+        thread_table.resize(index + 1, fuchsia_trace_utils::ThreadInfo{});
+      thread_table[index] = info;
+    }
   };
 
   struct RunningThread {
@@ -54,6 +82,7 @@ class FuchsiaTraceTokenizer : public ChunkedTraceReader {
   };
 
   void ParseRecord(TraceBlobView);
+  StringId GetThreadEndStateId(uint32_t outgoing_state);
   void RegisterProvider(uint32_t, std::string);
 
   TraceProcessorContext* const context_;
@@ -66,6 +95,10 @@ class FuchsiaTraceTokenizer : public ChunkedTraceReader {
   ProviderInfo* current_provider_;
 
   std::unordered_map<uint32_t, RunningThread> cpu_threads_;
+
+  // The interned end state of the context switches, indexed by the outgoing
+  // thread state.
+  std::vector<StringId> thread_end_state_ids_;
 };
 
 }  // namespace trace_processor
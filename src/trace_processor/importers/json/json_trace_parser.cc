@@ -79,7 +79,7 @@ void JsonTraceParser::ParseTracePacket(int64_t timestamp,
     return;
   }
 
-  auto opt_value = json::ParseJsonString(base::StringView(ttp.json_value));
+  auto opt_value = json::ParseJsonString(base::StringView(*ttp.json_value));
   if (!opt_value) {
     context_->storage->IncrementStats(stats::json_parser_failure);
     return;
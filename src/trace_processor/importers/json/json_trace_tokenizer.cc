@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/importers/json/json_trace_tokenizer.h"
 
+#include <string.h>
+
 #include <memory>
 
 #include "perfetto/base/build_config.h"
@@ -103,6 +105,55 @@ ReadStringRes ReadOneJsonString(const char* start,
   return ReadStringRes::kNeedsMoreData;
 }
 
+// Returns a pointer to the first '"' or '\\' in [start, end) or |end| if there
+// is none. This checks eight characters at a time as this is the hot loop
+// when tokenizing large traces.
+const char* FindQuoteOrBackslash(const char* start, const char* end) {
+  constexpr uint64_t kOnes = 0x0101010101010101ull;
+  constexpr uint64_t kHighBits = 0x8080808080808080ull;
+  constexpr uint64_t kQuotes = kOnes * '"';
+  constexpr uint64_t kBackslashes = kOnes * '\\';
+
+  const char* s = start;
+  for (; end - s >= 8; s += 8) {
+    uint64_t word;
+    memcpy(&word, s, sizeof(word));
+
+    // A byte of |x| is zero iff the same byte of |(x - kOnes) & ~x| has its
+    // high bit set.
+    uint64_t quotes = word ^ kQuotes;
+    uint64_t backslashes = word ^ kBackslashes;
+    if (((quotes - kOnes) & ~quotes & kHighBits) ||
+        ((backslashes - kOnes) & ~backslashes & kHighBits)) {
+      break;
+    }
+  }
+  for (; s < end; ++s) {
+    if (*s == '"' || *s == '\\')
+      return s;
+  }
+  return end;
+}
+
+// Skips over the JSON string starting at |start| (i.e. just after the opening
+// quote) and returns a pointer to the closing quote or nullptr if the string
+// does not end before |end|. Unlike ReadOneJsonString, this does not validate
+// the contents of the string.
+const char* SkipJsonString(const char* start, const char* end) {
+  for (const char* s = start;;) {
+    s = FindQuoteOrBackslash(s, end);
+    if (s == end)
+      return nullptr;
+    if (*s == '"')
+      return s;
+
+    // Skip over the backslash and the character it escapes.
+    if (end - s < 2)
+      return nullptr;
+    s += 2;
+  }
+}
+
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
 
 }  // namespace
@@ -115,21 +166,15 @@ ReadDictRes ReadOneJsonDict(const char* start,
   int braces = 0;
   int square_brackets = 0;
   const char* dict_begin = nullptr;
-  bool in_string = false;
-  bool is_escaping = false;
   for (const char* s = start; s < end; s++) {
     if (isspace(*s) || *s == ',')
       continue;
-    if (*s == '"' && !is_escaping) {
-      in_string = !in_string;
-      continue;
-    }
-    if (in_string) {
-      // If we're in a string and we see a backslash and the last character was
-      // not a backslash the next character is escaped:
-      is_escaping = *s == '\\' && !is_escaping;
-      // If we're currently parsing a string we should ignore otherwise special
-      // characters:
+    if (*s == '"') {
+      // Strings make up most of the bytes of a trace and can't contain any
+      // structural characters so skip over them in one go.
+      s = SkipJsonString(s + 1, end);
+      if (!s)
+        return ReadDictRes::kNeedsMoreData;
       continue;
     }
     if (*s == '{') {
@@ -293,6 +338,8 @@ util::Status ExtractValueForJsonKey(base::StringView dict,
           "Failure parsing JSON: unsupported JSON dictionary with array");
     }
 
+    // Only copy out the value of the key we are looking for.
+    bool is_match = current_key == key;
     std::string value_str;
     if (*s == '{') {
       base::StringView dict_str;
@@ -303,12 +350,23 @@ util::Status ExtractValueForJsonKey(base::StringView dict,
         return util::ErrStatus(
             "Failure parsing JSON: unable to parse dictionary");
       }
-      value_str = dict_str.ToStdString();
+      if (is_match)
+        value_str = dict_str.ToStdString();
     } else if (*s == '"') {
-      auto str_res = ReadOneJsonString(s + 1, end, &value_str, &s);
-      if (str_res == ReadStringRes::kNeedsMoreData ||
-          str_res == ReadStringRes::kFatalError) {
-        return util::ErrStatus("Failure parsing JSON: unable to parse string");
+      if (is_match) {
+        auto str_res = ReadOneJsonString(s + 1, end, &value_str, &s);
+        if (str_res == ReadStringRes::kNeedsMoreData ||
+            str_res == ReadStringRes::kFatalError) {
+          return util::ErrStatus(
+              "Failure parsing JSON: unable to parse string");
+        }
+      } else {
+        const char* str_end = SkipJsonString(s + 1, end);
+        if (!str_end) {
+          return util::ErrStatus(
+              "Failure parsing JSON: unable to parse string");
+        }
+        s = str_end + 1;
       }
     } else {
       const char* value_start = s;
@@ -319,11 +377,12 @@ util::Status ExtractValueForJsonKey(base::StringView dict,
           break;
         }
       }
-      value_str = std::string(value_start, value_end);
+      if (is_match)
+        value_str = std::string(value_start, value_end);
     }
 
-    if (key == current_key) {
-      *value = value_str;
+    if (is_match) {
+      *value = std::move(value_str);
       return util::OkStatus();
     }
   }
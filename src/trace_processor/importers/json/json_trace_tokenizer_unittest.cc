@@ -53,6 +53,35 @@ TEST(JsonTraceTokenizerTest, ReadDictQuotedBraces) {
   ASSERT_EQ(parsed["foo"].asString(), "}\"bar{\\");
 }
 
+TEST(JsonTraceTokenizerTest, ReadDictLongQuotedBraces) {
+  const char* start =
+      R"({ "foo": "a long string with }]{[ braces \" and escaped quotes\\",)"
+      R"( "bar": "\\\\\"}" })";
+  const char* end = start + strlen(start);
+  const char* next = nullptr;
+  base::StringView value;
+  ReadDictRes result = ReadOneJsonDict(start, end, &value, &next);
+
+  ASSERT_EQ(result, ReadDictRes::kFoundDict);
+  ASSERT_EQ(next, end);
+
+  Json::Value parsed = *json::ParseJsonString(value);
+  ASSERT_EQ(parsed["foo"].asString(),
+            "a long string with }]{[ braces \" and escaped quotes\\");
+  ASSERT_EQ(parsed["bar"].asString(), "\\\\\"}");
+}
+
+TEST(JsonTraceTokenizerTest, ReadDictNeedMoreDataInString) {
+  const char* start = R"({"foo": "a string which is cut off after a \)";
+  const char* end = start + strlen(start);
+  const char* next = nullptr;
+  base::StringView value;
+
+  ASSERT_EQ(ReadOneJsonDict(start, end, &value, &next),
+            ReadDictRes::kNeedsMoreData);
+  ASSERT_EQ(next, nullptr);
+}
+
 TEST(JsonTraceTokenizerTest, ReadDictTwoDicts) {
   const char* start = R"({"foo": 1}, {"bar": 2})";
   const char* middle = start + strlen(R"({"foo": 1})");
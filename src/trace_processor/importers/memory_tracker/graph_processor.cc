@@ -17,6 +17,8 @@
 #include "perfetto/ext/trace_processor/importers/memory_tracker/graph_processor.h"
 
 #include <list>
+#include <set>
+#include <vector>
 
 namespace perfetto {
 namespace trace_processor {
@@ -96,7 +98,7 @@ void GraphProcessor::RemoveWeakNodesFromGraph(GlobalNodeGraph* global_graph) {
   // Fourth pass: recursively mark nodes as weak if they own a node which is
   // weak or if they have a parent who is weak.
   {
-    std::set<const Node*> visited;
+    std::unordered_set<const Node*> visited;
     MarkWeakOwnersAndChildrenRecursively(global_root, &visited);
     for (const auto& pid_to_process : global_graph->process_node_graphs()) {
       MarkWeakOwnersAndChildrenRecursively(pid_to_process.second->root(),
@@ -148,21 +150,25 @@ void GraphProcessor::CalculateSizesForGraph(GlobalNodeGraph* global_graph) {
     }
   }
 
-  // Ninth pass: Calculate not-owned and not-owning sub-sizes of all nodes.
+  // The graph doesn't change shape after the eighth pass, so the remaining
+  // post-order passes can share one traversal.
+  std::vector<Node*> post_order;
   {
     auto it = global_graph->VisitInDepthFirstPostOrder();
     while (Node* node = it.next()) {
-      CalculateNodeSubSizes(node);
+      post_order.push_back(node);
     }
   }
 
+  // Ninth pass: Calculate not-owned and not-owning sub-sizes of all nodes.
+  for (Node* node : post_order) {
+    CalculateNodeSubSizes(node);
+  }
+
   // Tenth pass: Calculate owned and owning coefficients of owned and owner
   // nodes.
-  {
-    auto it = global_graph->VisitInDepthFirstPostOrder();
-    while (Node* node = it.next()) {
-      CalculateNodeOwnershipCoefficient(node);
-    }
+  for (Node* node : post_order) {
+    CalculateNodeOwnershipCoefficient(node);
   }
 
   // Eleventh pass: Calculate cumulative owned and owning coefficients of all
@@ -175,11 +181,8 @@ void GraphProcessor::CalculateSizesForGraph(GlobalNodeGraph* global_graph) {
   }
 
   // Twelfth pass: Calculate the effective sizes of all nodes.
-  {
-    auto it = global_graph->VisitInDepthFirstPostOrder();
-    while (Node* node = it.next()) {
-      CalculateNodeEffectiveSize(node);
-    }
+  for (Node* node : post_order) {
+    CalculateNodeEffectiveSize(node);
   }
 }
 
@@ -369,7 +372,7 @@ void GraphProcessor::MarkImplicitWeakParentsRecursively(Node* node) {
 // static
 void GraphProcessor::MarkWeakOwnersAndChildrenRecursively(
     Node* node,
-    std::set<const Node*>* visited) {
+    std::unordered_set<const Node*>* visited) {
   // If we've already visited this node then nothing to do.
   if (visited->count(node) != 0)
     return;
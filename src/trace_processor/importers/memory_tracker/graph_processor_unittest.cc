@@ -19,6 +19,7 @@
 #include <stddef.h>
 
 #include <unordered_map>
+#include <unordered_set>
 
 #include "perfetto/base/build_config.h"
 #include "test/gtest_and_gmock.h"
@@ -45,7 +46,7 @@ class GraphProcessorTest : public testing::Test {
   }
 
   void MarkWeakOwnersAndChildrenRecursively(Node* node) {
-    std::set<const Node*> visited;
+    std::unordered_set<const Node*> visited;
     GraphProcessor::MarkWeakOwnersAndChildrenRecursively(node, &visited);
   }
 
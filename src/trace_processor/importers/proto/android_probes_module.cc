@@ -16,6 +16,11 @@
 
 #include "src/trace_processor/importers/proto/android_probes_module.h"
 
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_writer.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -32,6 +37,20 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
+// Decodes all the values of the packed varint |field| into |values|, which is
+// only ever grown so that it can be reused across packets. Returns the number
+// of values decoded and sets |*parse_error| if the field is malformed.
+size_t DecodePackedVarIntField(const protozero::Field& field,
+                               std::vector<uint64_t>* values,
+                               bool* parse_error) {
+  if (!field.valid())
+    return 0;
+  if (values->size() < field.size())
+    values->resize(field.size());
+  return protozero::DecodePackedVarInts(
+      field.data(), field.data() + field.size(), values->data(), parse_error);
+}
+
 const char* MapToFriendlyPowerRailName(base::StringView raw) {
   if (raw == "S4M_VDD_CPUCL0") {
     return "cpu.little";
@@ -128,9 +147,25 @@ ModuleResult AndroidProbesModule::TokenizePacket(
         desc.index(), context_->storage->InternString(writer.GetStringView()));
   }
 
-  // For each energy data message, turn it into its own trace packet
-  // making sure its timestamp is consistent between the packet level and
-  // the EnergyData level.
+  // Turn each energy data sample into its own trace packet, making sure its
+  // timestamp is consistent between the packet level and the EnergyData level.
+  // The packets are forged back to back into a single buffer, which is then
+  // shared by all their TraceBlobViews.
+  std::vector<uint8_t> forged;
+  std::vector<std::pair<int64_t, size_t>> forged_ends;
+  protozero::HeapBuffered<protos::pbzero::TracePacket> data_packet;
+  auto forge_packet = [&](int64_t actual_ts, uint32_t index, uint64_t energy) {
+    data_packet.Reset();
+    data_packet->set_timestamp(static_cast<uint64_t>(actual_ts));
+    auto* data = data_packet->set_power_rails()->add_energy_data();
+    data->set_energy(energy);
+    data->set_index(index);
+    data->set_timestamp_ms(static_cast<uint64_t>(actual_ts / 1000000));
+    std::vector<uint8_t> vec = data_packet.SerializeAsArray();
+    forged.insert(forged.end(), vec.begin(), vec.end());
+    forged_ends.emplace_back(actual_ts, forged.size());
+  };
+
   for (auto it = evt.energy_data(); it; ++it) {
     protozero::ConstBytes bytes = *it;
     protos::pbzero::PowerRails_EnergyData_Decoder data(bytes.data, bytes.size);
@@ -138,20 +173,62 @@ ModuleResult AndroidProbesModule::TokenizePacket(
         data.has_timestamp_ms()
             ? static_cast<int64_t>(data.timestamp_ms()) * 1000000
             : packet_timestamp;
+    forge_packet(actual_ts, data.index(), data.energy());
+  }
 
-    protozero::HeapBuffered<protos::pbzero::TracePacket> data_packet;
-    data_packet->set_timestamp(static_cast<uint64_t>(actual_ts));
+  if (evt.has_energy_data_batch()) {
+    using EnergyDataBatch = protos::pbzero::PowerRails::EnergyDataBatch;
+    EnergyDataBatch::Decoder batch(evt.energy_data_batch());
+    bool parse_error = false;
+    const std::vector<uint64_t>& indexes = batch_fields_[0];
+    const std::vector<uint64_t>& timestamps = batch_fields_[1];
+    const std::vector<uint64_t>& energies = batch_fields_[2];
+    const size_t sizes[] = {
+        DecodePackedVarIntField(
+            batch.Get(EnergyDataBatch::kIndexFieldNumber), &batch_fields_[0],
+            &parse_error),
+        DecodePackedVarIntField(
+            batch.Get(EnergyDataBatch::kTimestampMsFieldNumber),
+            &batch_fields_[1], &parse_error),
+        DecodePackedVarIntField(
+            batch.Get(EnergyDataBatch::kEnergyFieldNumber), &batch_fields_[2],
+            &parse_error),
+    };
+    const size_t count = *std::min_element(std::begin(sizes), std::end(sizes));
+    if (parse_error ||
+        *std::max_element(std::begin(sizes), std::end(sizes)) != count) {
+      context_->storage->IncrementStats(stats::power_rail_batch_parse_errors);
+    }
+
+    // Accumulators for the per-rail (timestamp_ms, energy) deltas.
+    std::vector<std::pair<uint64_t, uint64_t>> last;
+    for (size_t i = 0; i < count; i++) {
+      uint64_t idx = indexes[i];
+      if (PERFETTO_UNLIKELY(idx > 256)) {
+        context_->storage->IncrementStats(stats::power_rail_unknown_index);
+        continue;
+      }
+      if (idx >= last.size())
+        last.resize(idx + 1, {0, 0});
+      last[idx].first += timestamps[i];
+      last[idx].second += energies[i];
+      forge_packet(static_cast<int64_t>(last[idx].first) * 1000000,
+                   static_cast<uint32_t>(idx), last[idx].second);
+    }
+  }
 
-    auto* energy = data_packet->set_power_rails()->add_energy_data();
-    energy->set_energy(data.energy());
-    energy->set_index(data.index());
-    energy->set_timestamp_ms(static_cast<uint64_t>(actual_ts / 1000000));
+  if (forged.empty())
+    return ModuleResult::Handled();
 
-    std::vector<uint8_t> vec = data_packet.SerializeAsArray();
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[vec.size()]);
-    memcpy(buffer.get(), vec.data(), vec.size());
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[forged.size()]);
+  memcpy(buffer.get(), forged.data(), forged.size());
+  TraceBlobView forged_blob(std::move(buffer), 0, forged.size());
+  size_t offset = 0;
+  for (const auto& ts_and_end : forged_ends) {
     context_->sorter->PushTracePacket(
-        actual_ts, state, TraceBlobView(std::move(buffer), 0, vec.size()));
+        ts_and_end.first, state,
+        forged_blob.slice(offset, ts_and_end.second - offset));
+    offset = ts_and_end.second;
   }
 
   return ModuleResult::Handled();
@@ -17,6 +17,8 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_ANDROID_PROBES_MODULE_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_ANDROID_PROBES_MODULE_H_
 
+#include <vector>
+
 #include "perfetto/base/build_config.h"
 #include "src/trace_processor/importers/proto/android_probes_parser.h"
 #include "src/trace_processor/importers/proto/proto_importer_module.h"
@@ -48,6 +50,9 @@ class AndroidProbesModule : public ProtoImporterModule {
  private:
   AndroidProbesParser parser_;
   TraceProcessorContext* context_ = nullptr;
+
+  // Reused across packets to decode the fields of PowerRails.EnergyDataBatch.
+  std::vector<uint64_t> batch_fields_[3];
 };
 
 }  // namespace trace_processor
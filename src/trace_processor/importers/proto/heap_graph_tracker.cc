@@ -22,6 +22,7 @@
 #include "src/trace_processor/importers/proto/profiler_util.h"
 #include "src/trace_processor/tables/profiler_tables.h"
 
+#include <algorithm>
 #include <set>
 #include <utility>
 
@@ -52,32 +53,24 @@ void ForReferenceSet(const TraceStorage& storage,
   }
 }
 
-std::set<tables::HeapGraphObjectTable::Id> GetChildren(
+// Returns the objects referred to by |id|, sorted by id and without
+// duplicates.
+std::vector<tables::HeapGraphObjectTable::Id> GetChildren(
     const TraceStorage& storage,
+    const std::vector<StringPool::Id>& weak_reference_kinds,
     tables::HeapGraphObjectTable::Id id) {
   uint32_t obj_row = *storage.heap_graph_object_table().id().IndexOf(id);
   uint32_t cls_row = *storage.heap_graph_class_table().id().IndexOf(
       storage.heap_graph_object_table().type_id()[obj_row]);
 
   StringPool::Id kind = storage.heap_graph_class_table().kind()[cls_row];
-  base::Optional<StringPool::Id> weakref_kind =
-      storage.string_pool().GetId("KIND_WEAK_REFERENCE");
-  base::Optional<StringPool::Id> softref_kind =
-      storage.string_pool().GetId("KIND_SOFT_REFERENCE");
-  base::Optional<StringPool::Id> finalizerref_kind =
-      storage.string_pool().GetId("KIND_FINALIZER_REFERENCE");
-  base::Optional<StringPool::Id> phantomref_kind =
-      storage.string_pool().GetId("KIND_PHANTOM_REFERENCE");
-
-  if ((weakref_kind && kind == *weakref_kind) ||
-      (softref_kind && kind == *softref_kind) ||
-      (finalizerref_kind && kind == *finalizerref_kind) ||
-      (phantomref_kind && kind == *phantomref_kind)) {
+  if (std::find(weak_reference_kinds.begin(), weak_reference_kinds.end(),
+                kind) != weak_reference_kinds.end()) {
     // Do not follow weak / soft / finalizer / phantom references.
     return {};
   }
 
-  std::set<tables::HeapGraphObjectTable::Id> children;
+  std::vector<tables::HeapGraphObjectTable::Id> children;
   ForReferenceSet(
       storage, id, [&storage, &children, id](uint32_t reference_row) {
         PERFETTO_CHECK(
@@ -86,10 +79,13 @@ std::set<tables::HeapGraphObjectTable::Id> GetChildren(
         auto opt_owned =
             storage.heap_graph_reference_table().owned_id()[reference_row];
         if (opt_owned) {
-          children.emplace(*opt_owned);
+          children.emplace_back(*opt_owned);
         }
         return true;
       });
+  std::sort(children.begin(), children.end());
+  children.erase(std::unique(children.begin(), children.end()),
+                 children.end());
   return children;
 }
 
@@ -185,6 +181,18 @@ BuildSuperclassMap(UniquePid upid, int64_t ts, TraceStorage* storage) {
 
 }  // namespace
 
+std::vector<StringPool::Id> GetWeakReferenceKinds(const TraceStorage& storage) {
+  std::vector<StringPool::Id> kinds;
+  for (const char* name :
+       {"KIND_WEAK_REFERENCE", "KIND_SOFT_REFERENCE",
+        "KIND_FINALIZER_REFERENCE", "KIND_PHANTOM_REFERENCE"}) {
+    base::Optional<StringPool::Id> kind = storage.string_pool().GetId(name);
+    if (kind)
+      kinds.push_back(*kind);
+  }
+  return kinds;
+}
+
 void MarkRoot(TraceStorage* storage,
               tables::HeapGraphObjectTable::Id id,
               StringPool::Id type) {
@@ -192,6 +200,9 @@ void MarkRoot(TraceStorage* storage,
   storage->mutable_heap_graph_object_table()->mutable_root_type()->Set(row,
                                                                        type);
 
+  std::vector<StringPool::Id> weak_reference_kinds =
+      GetWeakReferenceKinds(*storage);
+
   // Calculate shortest distance to a GC root.
   std::deque<std::pair<int32_t, tables::HeapGraphObjectTable::Id>>
       reachable_nodes{{0, id}};
@@ -213,7 +224,7 @@ void MarkRoot(TraceStorage* storage,
           cur_row, distance);
 
       for (tables::HeapGraphObjectTable::Id child_node :
-           GetChildren(*storage, cur_node)) {
+           GetChildren(*storage, weak_reference_kinds, cur_node)) {
         uint32_t child_row =
             *storage->heap_graph_object_table().id().IndexOf(child_node);
         int32_t child_distance =
@@ -302,38 +313,35 @@ bool HeapGraphTracker::SetPidAndTimestamp(SequenceState* sequence_state,
 tables::HeapGraphObjectTable::Id HeapGraphTracker::GetOrInsertObject(
     SequenceState* sequence_state,
     uint64_t object_id) {
-  auto it = sequence_state->object_id_to_db_id.find(object_id);
-  if (it == sequence_state->object_id_to_db_id.end()) {
-    auto id_and_row =
-        context_->storage->mutable_heap_graph_object_table()->Insert(
-            {sequence_state->current_upid,
-             sequence_state->current_ts,
-             -1,
-             /*reference_set_id=*/base::nullopt,
-             /*reachable=*/0,
-             {},
-             /*root_type=*/base::nullopt,
-             /*root_distance*/ -1});
-    bool inserted;
-    std::tie(it, inserted) =
-        sequence_state->object_id_to_db_id.emplace(object_id, id_and_row.id);
-  }
-  return it->second;
+  if (tables::HeapGraphObjectTable::Id* id =
+          sequence_state->object_id_to_db_id.Find(object_id)) {
+    return *id;
+  }
+  auto id_and_row =
+      context_->storage->mutable_heap_graph_object_table()->Insert(
+          {sequence_state->current_upid,
+           sequence_state->current_ts,
+           -1,
+           /*reference_set_id=*/base::nullopt,
+           /*reachable=*/0,
+           {},
+           /*root_type=*/base::nullopt,
+           /*root_distance*/ -1});
+  sequence_state->object_id_to_db_id.Insert(object_id, id_and_row.id);
+  return id_and_row.id;
 }
 
 tables::HeapGraphClassTable::Id HeapGraphTracker::GetOrInsertType(
     SequenceState* sequence_state,
     uint64_t type_id) {
-  auto it = sequence_state->type_id_to_db_id.find(type_id);
-  if (it == sequence_state->type_id_to_db_id.end()) {
-    auto id_and_row =
-        context_->storage->mutable_heap_graph_class_table()->Insert(
-            {StringPool::Id(), base::nullopt, base::nullopt});
-    bool inserted;
-    std::tie(it, inserted) =
-        sequence_state->type_id_to_db_id.emplace(type_id, id_and_row.id);
-  }
-  return it->second;
+  if (tables::HeapGraphClassTable::Id* id =
+          sequence_state->type_id_to_db_id.Find(type_id)) {
+    return *id;
+  }
+  auto id_and_row = context_->storage->mutable_heap_graph_class_table()->Insert(
+      {StringPool::Id(), base::nullopt, base::nullopt});
+  sequence_state->type_id_to_db_id.Insert(type_id, id_and_row.id);
+  return id_and_row.id;
 }
 
 void HeapGraphTracker::AddObject(uint32_t seq_id,
@@ -663,13 +671,14 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
 
   for (const SourceRoot& root : sequence_state.current_roots) {
     for (uint64_t obj_id : root.object_ids) {
-      auto it = sequence_state.object_id_to_db_id.find(obj_id);
+      tables::HeapGraphObjectTable::Id* maybe_db_id =
+          sequence_state.object_id_to_db_id.Find(obj_id);
       // This can only happen for an invalid type string id, which is already
       // reported as an error. Silently continue here.
-      if (it == sequence_state.object_id_to_db_id.end())
+      if (!maybe_db_id)
         continue;
 
-      tables::HeapGraphObjectTable::Id db_id = it->second;
+      tables::HeapGraphObjectTable::Id db_id = *maybe_db_id;
       auto it_and_success = roots_[std::make_pair(sequence_state.current_upid,
                                                   sequence_state.current_ts)]
                                 .emplace(db_id);
@@ -742,6 +751,10 @@ void FindPathFromRoot(TraceStorage* storage,
     std::vector<tables::HeapGraphObjectTable::Id> children;
   };
 
+  std::vector<StringPool::Id> weak_reference_kinds =
+      GetWeakReferenceKinds(*storage);
+  path->visited.resize(storage->heap_graph_object_table().row_count());
+
   std::vector<StackElem> stack{{id, PathFromRoot::kRoot, 0, 0, {}}};
 
   while (!stack.empty()) {
@@ -791,10 +804,7 @@ void FindPathFromRoot(TraceStorage* storage,
       output_tree_node->size +=
           storage->heap_graph_object_table().self_size()[row];
       output_tree_node->count++;
-      std::set<tables::HeapGraphObjectTable::Id> children_set =
-          GetChildren(*storage, n);
-      children.assign(children_set.cbegin(), children_set.cend());
-      PERFETTO_CHECK(children.size() == children_set.size());
+      children = GetChildren(*storage, weak_reference_kinds, n);
     }
     // Otherwise we have already handled this node and just need to get its
     // i-th child.
@@ -813,10 +823,8 @@ void FindPathFromRoot(TraceStorage* storage,
       PERFETTO_CHECK(n_distance >= 0);
       PERFETTO_CHECK(child_distance >= 0);
 
-      bool visited = path->visited.count(child);
-
-      if (child_distance == n_distance + 1 && !visited) {
-        path->visited.emplace(child);
+      if (child_distance == n_distance + 1 && !path->visited[child_row]) {
+        path->visited[child_row] = true;
         stack.emplace_back(StackElem{child, path_id, 0, depth + 1, {}});
       }
     } else {
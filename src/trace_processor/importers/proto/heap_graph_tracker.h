@@ -19,9 +19,11 @@
 
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/string_view.h"
 
@@ -52,9 +54,13 @@ struct PathFromRoot {
     std::map<StringId, size_t> children;
   };
   std::vector<Node> nodes{Node{}};
-  std::set<tables::HeapGraphObjectTable::Id> visited;
+  // Indexed by the row of the object in the heap graph object table.
+  std::vector<bool> visited;
 };
 
+// Returns the class kinds whose references are not followed when walking
+// the graph (weak, soft, finalizer and phantom references).
+std::vector<StringPool::Id> GetWeakReferenceKinds(const TraceStorage& storage);
 void MarkRoot(TraceStorage* s,
               tables::HeapGraphObjectTable::Id id,
               StringPool::Id type);
@@ -164,13 +170,18 @@ class HeapGraphTracker : public Destructible {
     int64_t current_ts = 0;
     uint64_t last_object_id = 0;
     std::vector<SourceRoot> current_roots;
+    // Ordered as FinalizeProfile() iterates it to insert the class rows.
     std::map<uint64_t, InternedType> interned_types;
-    std::map<uint64_t, StringPool::Id> interned_location_names;
-    std::map<uint64_t, tables::HeapGraphObjectTable::Id> object_id_to_db_id;
-    std::map<uint64_t, tables::HeapGraphClassTable::Id> type_id_to_db_id;
-    std::map<uint64_t, std::vector<tables::HeapGraphReferenceTable::Id>>
+    std::unordered_map<uint64_t, StringPool::Id> interned_location_names;
+    // Looked up for every object and reference, so flat for large heaps.
+    base::FlatHashMap<uint64_t, tables::HeapGraphObjectTable::Id>
+        object_id_to_db_id;
+    base::FlatHashMap<uint64_t, tables::HeapGraphClassTable::Id>
+        type_id_to_db_id;
+    std::unordered_map<uint64_t,
+                       std::vector<tables::HeapGraphReferenceTable::Id>>
         references_for_field_name_id;
-    std::map<uint64_t, InternedField> interned_fields;
+    std::unordered_map<uint64_t, InternedField> interned_fields;
     std::map<tables::HeapGraphClassTable::Id,
              std::vector<tables::HeapGraphObjectTable::Id>>
         deferred_reference_objects_for_type_;
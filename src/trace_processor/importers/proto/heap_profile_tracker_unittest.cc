@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/importers/proto/heap_profile_tracker.h"
 
+#include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/proto/stack_profile_tracker.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 #include "test/gtest_and_gmock.h"
@@ -181,6 +182,62 @@ TEST_F(HeapProfileTrackerDupTest, Callstack) {
   EXPECT_EQ(frame_id[1], FrameId{0});
 }
 
+// Incremental dumps only contain the callsites that changed since the
+// previous dump. The cumulative values of the others must carry over.
+TEST_F(HeapProfileTrackerDupTest, IncrementalDumps) {
+  context.process_tracker.reset(new ProcessTracker(&context));
+  InsertCallsite(kFirstPacket);
+  sequence_stack_profile_tracker->AddCallstack(kCallstackId + 1,
+                                               {kFirstPacket.frame_id});
+
+  HeapProfileTracker* hpt = context.heap_profile_tracker.get();
+  auto add_sample = [this, hpt](int64_t ts, uint64_t callstack_id,
+                                uint64_t allocated, uint64_t freed) {
+    HeapProfileTracker::SourceAllocation alloc;
+    alloc.pid = 1;
+    alloc.timestamp = ts;
+    alloc.heap_name = context.storage->InternString("malloc");
+    alloc.callstack_id = callstack_id;
+    alloc.self_allocated = allocated;
+    alloc.self_freed = freed;
+    alloc.alloc_count = allocated / 5;
+    alloc.free_count = freed / 5;
+    hpt->StoreAllocation(kDefaultSequence, alloc);
+  };
+
+  add_sample(1, kCallstackId, 10, 0);
+  add_sample(1, kCallstackId + 1, 20, 0);
+  hpt->CommitAllocations(kDefaultSequence, sequence_stack_profile_tracker.get(),
+                         nullptr);
+  // kCallstackId + 1 did not change.
+  add_sample(2, kCallstackId, 15, 5);
+  hpt->CommitAllocations(kDefaultSequence, sequence_stack_profile_tracker.get(),
+                         nullptr);
+  // kCallstackId did not change.
+  add_sample(3, kCallstackId + 1, 30, 0);
+  hpt->FinalizeProfile(kDefaultSequence, sequence_stack_profile_tracker.get(),
+                       nullptr);
+
+  const auto& allocs = context.storage->heap_profile_allocation_table();
+  std::vector<int64_t> ts;
+  std::vector<int64_t> size;
+  std::vector<int64_t> count;
+  std::vector<CallsiteId> callsite_id;
+  for (uint32_t i = 0; i < allocs.row_count(); ++i) {
+    ts.push_back(allocs.ts()[i]);
+    size.push_back(allocs.size()[i]);
+    count.push_back(allocs.count()[i]);
+    callsite_id.push_back(allocs.callsite_id()[i]);
+  }
+  EXPECT_THAT(ts, ElementsAre(1, 1, 2, 2, 3));
+  EXPECT_THAT(size, ElementsAre(10, 20, 5, -5, 10));
+  EXPECT_THAT(count, ElementsAre(2, 4, 1, -1, 2));
+  EXPECT_EQ(callsite_id[0], callsite_id[2]);
+  EXPECT_EQ(callsite_id[0], callsite_id[3]);
+  EXPECT_EQ(callsite_id[1], callsite_id[4]);
+  EXPECT_NE(callsite_id[0], callsite_id[1]);
+}
+
 base::Optional<CallsiteId> FindCallstack(const TraceStorage& storage,
                                          int64_t depth,
                                          base::Optional<CallsiteId> parent,
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/importer_profiler.h"
+
+#include "src/trace_processor/storage/stats.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+ImporterProfiler::ScopedTimer::ScopedTimer(ImporterProfiler* profiler,
+                                           size_t key,
+                                           uint32_t field_id)
+    : profiler_(profiler), key_(key), field_id_(field_id) {
+  if (!profiler_)
+    return;
+  parent_nested_ns_ = profiler_->nested_ns_;
+  profiler_->nested_ns_ = 0;
+  start_ns_ = base::GetThreadCPUTimeNs();
+}
+
+ImporterProfiler::ScopedTimer::~ScopedTimer() {
+  if (!profiler_)
+    return;
+  int64_t total_ns = (base::GetThreadCPUTimeNs() - start_ns_).count();
+  profiler_->storage_->IncrementIndexedStats(
+      key_, static_cast<int>(field_id_), total_ns - profiler_->nested_ns_);
+  profiler_->nested_ns_ = parent_nested_ns_ + total_ns;
+}
+
+ImporterProfiler::ImporterProfiler(TraceStorage* storage) : storage_(storage) {}
+
+// static
+uint32_t ImporterProfiler::GetFieldId(
+    const TraceProcessorContext& context,
+    const protos::pbzero::TracePacket_Decoder& packet) {
+  const auto& modules = context.modules_by_field;
+  for (uint32_t field_id = 1; field_id < modules.size(); ++field_id) {
+    if (!modules[field_id].empty() && packet.Get(field_id).valid())
+      return field_id;
+  }
+  return 0;
+}
+
+void ImporterProfiler::RecordPacket(uint32_t field_id, size_t size) {
+  int index = static_cast<int>(field_id);
+  storage_->IncrementIndexedStats(stats::importer_packets, index);
+  storage_->IncrementIndexedStats(stats::importer_bytes, index,
+                                  static_cast<int64_t>(size));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
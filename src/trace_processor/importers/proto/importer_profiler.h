@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_IMPORTER_PROFILER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_IMPORTER_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "perfetto/base/time.h"
+
+namespace perfetto {
+
+namespace protos {
+namespace pbzero {
+class TracePacket_Decoder;
+}  // namespace pbzero
+}  // namespace protos
+
+namespace trace_processor {
+
+class TraceProcessorContext;
+class TraceStorage;
+
+// Accumulates the number, the size and the CPU time spent tokenizing and
+// parsing the trace packets into the stats table, indexed by the TracePacket
+// field which identifies the importer module handling them (see
+// Config::enable_importer_profiling).
+class ImporterProfiler {
+ public:
+  // Adds the CPU time spent by the calling thread while this object is alive
+  // to the stat |key| at |field_id|. The time measured by other ScopedTimers
+  // created meanwhile (e.g. parsing the packets extracted from the sorter
+  // while a packet is tokenized) is only added to their own stats. Does
+  // nothing if |profiler| is null.
+  class ScopedTimer {
+   public:
+    ScopedTimer(ImporterProfiler* profiler, size_t key, uint32_t field_id);
+    ~ScopedTimer();
+
+   private:
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ImporterProfiler* const profiler_;
+    const size_t key_;
+    const uint32_t field_id_;
+    base::TimeNanos start_ns_;
+    int64_t parent_nested_ns_ = 0;
+  };
+
+  explicit ImporterProfiler(TraceStorage* storage);
+
+  // Returns the field used to attribute the costs of |packet|: the first one
+  // handled by an importer module or 0 if the packet is handled by none.
+  static uint32_t GetFieldId(const TraceProcessorContext& context,
+                             const protos::pbzero::TracePacket_Decoder& packet);
+
+  // Records that a packet of |size| bytes was seen by the tokenizer.
+  void RecordPacket(uint32_t field_id, size_t size);
+
+ private:
+  TraceStorage* const storage_;
+
+  // The CPU time measured by the ScopedTimers nested in the innermost alive
+  // one.
+  int64_t nested_ns_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_IMPORTER_PROFILER_H_
@@ -20,10 +20,12 @@
 #include <stdint.h>
 
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "perfetto/base/compiler.h"
 #include "perfetto/protozero/proto_decoder.h"
+#include "src/trace_processor/containers/ref_counted.h"
 #include "src/trace_processor/importers/common/trace_blob_view.h"
 #include "src/trace_processor/importers/proto/stack_profile_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -54,12 +56,14 @@ class InternedMessageView {
   // Allow copy by cloning the TraceBlobView. This is required for
   // UpdateTracePacketDefaults().
   InternedMessageView(const InternedMessageView& view)
-      : message_(view.message_.slice(0, view.message_.length())) {}
+      : message_(view.message_.slice(0, view.message_.length())),
+        interned_strings_(view.interned_strings_) {}
   InternedMessageView& operator=(const InternedMessageView& view) {
     this->message_ = view.message_.slice(0, view.message_.length());
     this->decoder_ = nullptr;
     this->decoder_type_ = nullptr;
     this->submessages_.clear();
+    this->interned_strings_ = view.interned_strings_;
     return *this;
   }
 
@@ -114,6 +118,23 @@ class InternedMessageView {
     return submessage_view;
   }
 
+  // Returns the id of the string field |FieldId| of the message in |storage|.
+  // The string is only interned the first time it is looked up through this
+  // view: interned names are looked up for almost every TrackEvent so this
+  // saves hashing them over and over again.
+  template <typename MessageType, uint32_t FieldId>
+  StringId GetOrInternString(TraceStorage* storage) {
+    for (const auto& field_and_id : interned_strings_) {
+      if (field_and_id.first == FieldId)
+        return field_and_id.second;
+    }
+    auto* decoder = GetOrCreateDecoder<MessageType>();
+    StringId id =
+        storage->InternString(decoder->template at<FieldId>().as_string());
+    interned_strings_.emplace_back(FieldId, id);
+    return id;
+  }
+
   const TraceBlobView& message() { return message_; }
 
  private:
@@ -141,6 +162,10 @@ class InternedMessageView {
   // decoders, we avoid having to decode submessages multiple times if they
   // looked up often.
   SubMessageViewMap submessages_;
+
+  // Ids of the string fields looked up by GetOrInternString(). There are
+  // only ever one or two of them so a vector is faster than a map.
+  std::vector<std::pair<uint32_t /*field_id*/, StringId>> interned_strings_;
 };
 
 using InternedMessageMap =
@@ -150,13 +175,20 @@ using InternedFieldMap =
 
 class PacketSequenceState;
 
-class PacketSequenceStateGeneration {
+class PacketSequenceStateGeneration : public RefCounted {
  public:
   // Returns |nullptr| if the message with the given |iid| was not found (also
   // records a stat in this case).
   template <uint32_t FieldId, typename MessageType>
   typename MessageType::Decoder* LookupInternedMessage(uint64_t iid);
 
+  // Returns the id of the string field |StringFieldId| of the interned
+  // message, see InternedMessageView::GetOrInternString(). Returns nullopt if
+  // the message with the given |iid| was not found (also records a stat in
+  // this case).
+  template <uint32_t FieldId, typename MessageType, uint32_t StringFieldId>
+  base::Optional<StringId> LookupInternedString(uint64_t iid);
+
   InternedMessageView* GetInternedMessageView(uint32_t field_id, uint64_t iid);
   // Returns |nullptr| if no defaults were set.
   InternedMessageView* GetTracePacketDefaultsView() {
@@ -304,7 +336,7 @@ class PacketSequenceState {
   }
 
   // Returns a ref-counted ptr to the current generation.
-  std::shared_ptr<PacketSequenceStateGeneration> current_generation() const {
+  RefPtr<PacketSequenceStateGeneration> current_generation() const {
     return current_generation_;
   }
 
@@ -349,7 +381,7 @@ class PacketSequenceState {
   int64_t track_event_thread_timestamp_ns_ = 0;
   int64_t track_event_thread_instruction_count_ = 0;
 
-  std::shared_ptr<PacketSequenceStateGeneration> current_generation_;
+  RefPtr<PacketSequenceStateGeneration> current_generation_;
   SequenceStackProfileTracker sequence_stack_profile_tracker_;
 };
 
@@ -363,6 +395,18 @@ PacketSequenceStateGeneration::LookupInternedMessage(uint64_t iid) {
   return interned_message_view->template GetOrCreateDecoder<MessageType>();
 }
 
+template <uint32_t FieldId, typename MessageType, uint32_t StringFieldId>
+base::Optional<StringId> PacketSequenceStateGeneration::LookupInternedString(
+    uint64_t iid) {
+  auto* interned_message_view = GetInternedMessageView(FieldId, iid);
+  if (!interned_message_view)
+    return base::nullopt;
+
+  return interned_message_view
+      ->template GetOrInternString<MessageType, StringFieldId>(
+          state_->context()->storage.get());
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
@@ -15,6 +15,9 @@
  */
 
 #include "src/trace_processor/importers/proto/proto_importer_module.h"
+
+#include <algorithm>
+
 #include "src/trace_processor/types/trace_processor_context.h"
 
 namespace perfetto {
@@ -49,5 +52,29 @@ void ProtoImporterModule::RegisterForField(uint32_t field_id,
   context->modules_by_field[field_id].push_back(this);
 }
 
+ProtoImporterModule* AddImporterModule(TraceProcessorContext* context,
+                                       const char* name,
+                                       ProtoImporterModule* module) {
+  context->modules.emplace_back(module);
+  const auto& skipped = context->config.skipped_importers;
+  if (std::find(skipped.begin(), skipped.end(), name) == skipped.end())
+    return module;
+
+  auto& skipped_fields = context->skipped_fields;
+  for (uint32_t field_id = 0; field_id < context->modules_by_field.size();
+       ++field_id) {
+    auto& field_modules = context->modules_by_field[field_id];
+    auto it = std::find(field_modules.begin(), field_modules.end(), module);
+    if (it == field_modules.end())
+      continue;
+    field_modules.erase(it);
+    if (std::find(skipped_fields.begin(), skipped_fields.end(), field_id) ==
+        skipped_fields.end()) {
+      skipped_fields.push_back(field_id);
+    }
+  }
+  return module;
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
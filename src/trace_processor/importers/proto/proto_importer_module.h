@@ -46,7 +46,8 @@ class TraceProcessorContext;
 // (2) In the constructor call the RegisterForField method for every field
 //     that the module knows how to handle.
 // (3) Create a module instance and add it to TraceProcessorContext's |modules|
-//     vector in either default_modules.cc or additional_modules.cc.
+//     vector in either default_modules.cc or additional_modules.cc using
+//     AddImporterModule().
 // See GraphicsEventModule for an example.
 
 class ModuleResult {
@@ -133,6 +134,15 @@ class ProtoImporterModule {
   void RegisterForField(uint32_t field_id, TraceProcessorContext*);
 };
 
+// Adds |module| to the |modules| of |context|, unless |name| is listed in
+// Config::skipped_importers: in that case the module is unregistered from all
+// its fields, and the packets with these fields are dropped by
+// ProtoTraceReader if no other module handles them. Returns |module| in both
+// cases.
+ProtoImporterModule* AddImporterModule(TraceProcessorContext* context,
+                                       const char* name,
+                                       ProtoImporterModule* module);
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
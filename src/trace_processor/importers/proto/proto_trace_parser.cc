@@ -39,11 +39,13 @@
 #include "src/trace_processor/importers/config.descriptor.h"
 #include "src/trace_processor/importers/ftrace/ftrace_module.h"
 #include "src/trace_processor/importers/proto/heap_profile_tracker.h"
+#include "src/trace_processor/importers/proto/importer_profiler.h"
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
 #include "src/trace_processor/importers/proto/profile_packet_utils.h"
 #include "src/trace_processor/importers/proto/profiler_util.h"
 #include "src/trace_processor/importers/proto/stack_profile_tracker.h"
+#include "src/trace_processor/importers/proto/track_event_module.h"
 #include "src/trace_processor/storage/metadata.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/tables/profiler_tables.h"
@@ -88,17 +90,29 @@ ProtoTraceParser::ProtoTraceParser(TraceProcessorContext* context)
 ProtoTraceParser::~ProtoTraceParser() = default;
 
 void ProtoTraceParser::ParseTracePacket(int64_t ts, TimestampedTracePiece ttp) {
-  const TracePacketData* data = nullptr;
-  if (ttp.type == TimestampedTracePiece::Type::kTracePacket) {
-    data = &ttp.packet_data;
-  } else {
-    PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTrackEvent);
-    data = ttp.track_event_data.get();
+  ImporterProfiler* profiler = context_->importer_profiler.get();
+
+  // The TrackEvent is the only data field of its packet (all the other
+  // fields were handled by the tokenizer) so it can be parsed directly, which
+  // saves decoding the whole TracePacket again.
+  if (ttp.type == TimestampedTracePiece::Type::kTrackEvent) {
+    ImporterProfiler::ScopedTimer timer(
+        profiler, stats::importer_parse_cpu_time_ns,
+        protos::pbzero::TracePacket::kTrackEventFieldNumber);
+    PERFETTO_DCHECK(context_->track_event_module);
+    context_->track_event_module->ParseTrackEventData(ttp);
+    context_->args_tracker->Flush();
+    return;
   }
 
+  PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTracePacket);
+  const TracePacketData* data = &ttp.packet_data;
   const TraceBlobView& blob = data->packet;
   protos::pbzero::TracePacket::Decoder packet(blob.data(), blob.length());
 
+  ImporterProfiler::ScopedTimer timer(
+      profiler, stats::importer_parse_cpu_time_ns,
+      profiler ? ImporterProfiler::GetFieldId(*context_, packet) : 0);
   ParseTracePacketImpl(ts, ttp, data->sequence_state.get(), packet);
 
   // TODO(lalitm): maybe move this to the flush method in the trace processor
@@ -172,6 +186,9 @@ void ProtoTraceParser::ParseFtracePacket(uint32_t cpu,
                   ttp.type == TimestampedTracePiece::Type::kInlineSchedSwitch ||
                   ttp.type == TimestampedTracePiece::Type::kInlineSchedWaking);
   PERFETTO_DCHECK(context_->ftrace_module);
+  ImporterProfiler::ScopedTimer timer(
+      context_->importer_profiler.get(), stats::importer_parse_cpu_time_ns,
+      protos::pbzero::TracePacket::kFtraceEventsFieldNumber);
   context_->ftrace_module->ParseFtracePacket(cpu, ttp);
 
   // TODO(lalitm): maybe move this to the flush method in the trace processor
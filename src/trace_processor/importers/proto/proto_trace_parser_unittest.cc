@@ -335,6 +335,30 @@ TEST_F(ProtoTraceParserTest, LoadSingleEvent) {
   Tokenize();
 }
 
+TEST_F(ProtoTraceParserTest, SkippedImporters) {
+  context_.config.skipped_importers = {"ftrace"};
+  context_.modules.clear();
+  context_.modules_by_field.clear();
+  RegisterDefaultModules(&context_);
+  RegisterAdditionalModules(&context_);
+
+  auto* bundle = trace_->add_packet()->set_ftrace_events();
+  bundle->set_cpu(10);
+  auto* event = bundle->add_event();
+  event->set_timestamp(1000);
+  event->set_pid(12);
+  auto* sched_switch = event->set_sched_switch();
+  sched_switch->set_prev_pid(10);
+  sched_switch->set_next_pid(100);
+
+  EXPECT_CALL(*sched_, PushSchedSwitch(_, _, _, _, _, _, _, _, _)).Times(0);
+  Tokenize();
+  context_.sorter->ExtractEventsForced();
+
+  const auto& stats = context_.storage->stats();
+  EXPECT_EQ(stats[stats::packets_skipped_by_config].value, 1);
+}
+
 TEST_F(ProtoTraceParserTest, LoadEventsIntoRaw) {
   auto* bundle = trace_->add_packet()->set_ftrace_events();
   bundle->set_cpu(10);
@@ -31,6 +31,7 @@
 #include "src/trace_processor/importers/common/track_tracker.h"
 #include "src/trace_processor/importers/ftrace/ftrace_module.h"
 #include "src/trace_processor/importers/gzip/gzip_utils.h"
+#include "src/trace_processor/importers/proto/importer_profiler.h"
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
 #include "src/trace_processor/importers/proto/proto_incremental_state.h"
@@ -62,6 +63,13 @@ util::Status ProtoTraceReader::Parse(std::unique_ptr<uint8_t[]> owned_buf,
       [this](TraceBlobView packet) { return ParsePacket(std::move(packet)); });
 }
 
+util::Status ProtoTraceReader::ParseShared(std::shared_ptr<const uint8_t> buf,
+                                           size_t size) {
+  return tokenizer_.Tokenize(
+      TraceBlobView(std::move(buf), 0, size),
+      [this](TraceBlobView packet) { return ParsePacket(std::move(packet)); });
+}
+
 util::Status ProtoTraceReader::ParseExtensionDescriptor(ConstBytes descriptor) {
   protos::pbzero::ExtensionDescriptor::Decoder decoder(descriptor.data,
                                                        descriptor.size);
@@ -73,6 +81,19 @@ util::Status ProtoTraceReader::ParseExtensionDescriptor(ConstBytes descriptor) {
 }
 
 util::Status ProtoTraceReader::ParsePacket(TraceBlobView packet) {
+  ImporterProfiler* profiler = context_->importer_profiler.get();
+  if (PERFETTO_LIKELY(!profiler))
+    return ParsePacketImpl(std::move(packet));
+
+  protos::pbzero::TracePacket::Decoder decoder(packet.data(), packet.length());
+  uint32_t field_id = ImporterProfiler::GetFieldId(*context_, decoder);
+  profiler->RecordPacket(field_id, packet.length());
+  ImporterProfiler::ScopedTimer timer(
+      profiler, stats::importer_tokenize_cpu_time_ns, field_id);
+  return ParsePacketImpl(std::move(packet));
+}
+
+util::Status ProtoTraceReader::ParsePacketImpl(TraceBlobView packet) {
   protos::pbzero::TracePacket::Decoder decoder(packet.data(), packet.length());
   if (PERFETTO_UNLIKELY(decoder.bytes_left())) {
     return util::ErrStatus(
@@ -208,6 +229,12 @@ util::Status ProtoTraceReader::ParsePacket(TraceBlobView packet) {
   latest_timestamp_ = std::max(timestamp, latest_timestamp_);
 
   auto& modules = context_->modules_by_field;
+  for (uint32_t field_id : context_->skipped_fields) {
+    if (modules[field_id].empty() && decoder.Get(field_id).valid()) {
+      context_->storage->IncrementStats(stats::packets_skipped_by_config);
+      return util::OkStatus();
+    }
+  }
   for (uint32_t field_id = 1; field_id < modules.size(); ++field_id) {
     if (!modules[field_id].empty() && decoder.Get(field_id).valid()) {
       for (ProtoImporterModule* module : modules[field_id]) {
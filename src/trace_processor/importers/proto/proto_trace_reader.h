@@ -59,11 +59,14 @@ class ProtoTraceReader : public ChunkedTraceReader {
 
   // ChunkedTraceReader implementation.
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t size) override;
+  util::Status ParseShared(std::shared_ptr<const uint8_t>,
+                           size_t size) override;
   void NotifyEndOfFile() override;
 
  private:
   using ConstBytes = protozero::ConstBytes;
   util::Status ParsePacket(TraceBlobView);
+  util::Status ParsePacketImpl(TraceBlobView);
   util::Status ParseServiceEvent(int64_t ts, ConstBytes);
   util::Status ParseClockSnapshot(ConstBytes blob, uint32_t seq_id);
   void HandleIncrementalStateCleared(
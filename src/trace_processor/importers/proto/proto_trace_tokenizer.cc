@@ -16,44 +16,162 @@
 
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/utils.h"
 
 namespace perfetto {
 namespace trace_processor {
 
-ProtoTraceTokenizer::ProtoTraceTokenizer() = default;
-
-util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
-                                             TraceBlobView* output) {
-  PERFETTO_DCHECK(gzip::IsGzipSupported());
+namespace {
 
-  uint8_t out[4096];
+// Only spawn threads for chunks with at least this many compressed bytes:
+// below this, the decompression is cheaper than starting the threads.
+constexpr size_t kMinParallelDecompressionBytes = 256 * 1024;
 
-  std::vector<uint8_t> data;
-  data.reserve(input.length());
+// The maximum number of threads decompressing the packets of one chunk.
+constexpr uint32_t kMaxDecompressionThreads = 8;
 
+// Decompresses the whole of |input| into |output|. The output buffer is grown
+// geometrically and written into directly by zlib to avoid copying the
+// decompressed data around.
+bool DecompressAll(GzipDecompressor* decompressor,
+                   const uint8_t* input,
+                   size_t input_size,
+                   std::unique_ptr<uint8_t[]>* output,
+                   size_t* output_size) {
   // Ensure that the decompressor is able to cope with a new stream of data.
-  decompressor_.Reset();
-  decompressor_.SetInput(input.data(), input.length());
+  decompressor->Reset();
+  decompressor->SetInput(input, input_size);
+
+  // Packets usually compress at least 4x so start from there.
+  size_t capacity = std::max<size_t>(input_size * 4, 4096);
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[capacity]);
+  size_t size = 0;
 
   using ResultCode = GzipDecompressor::ResultCode;
   for (auto ret = ResultCode::kOk; ret != ResultCode::kEof;) {
-    auto res = decompressor_.Decompress(out, base::ArraySize(out));
+    if (size == capacity) {
+      capacity *= 2;
+      std::unique_ptr<uint8_t[]> grown(new uint8_t[capacity]);
+      memcpy(grown.get(), buf.get(), size);
+      buf = std::move(grown);
+    }
+    auto res = decompressor->Decompress(buf.get() + size, capacity - size);
     ret = res.ret;
     if (ret == ResultCode::kError || ret == ResultCode::kNoProgress ||
         ret == ResultCode::kNeedsMoreInput) {
-      return util::ErrStatus("Failed to decompress (error code: %d)",
-                             static_cast<int>(ret));
+      return false;
     }
+    size += res.bytes_written;
+  }
 
-    data.insert(data.end(), out, out + res.bytes_written);
+  // The buffer lives as long as any of the packets inside it so don't hold on
+  // to much more memory than needed.
+  if (capacity - size > size / 4) {
+    std::unique_ptr<uint8_t[]> shrunk(new uint8_t[size]);
+    memcpy(shrunk.get(), buf.get(), size);
+    buf = std::move(shrunk);
   }
+  *output = std::move(buf);
+  *output_size = size;
+  return true;
+}
+
+constexpr uint32_t kCompressedPacketsFieldTag =
+    protozero::proto_utils::MakeTagLengthDelimited(
+        protos::pbzero::TracePacket::kCompressedPacketsFieldNumber);
+static_assert(kCompressedPacketsFieldTag >= 0x80 &&
+                  kCompressedPacketsFieldTag < 0x4000,
+              "compressed_packets tag must be a two byte varint");
+
+}  // namespace
+
+// static
+const uint8_t ProtoTraceTokenizer::kCompressedPacketsTag[] = {
+    static_cast<uint8_t>((kCompressedPacketsFieldTag & 0x7f) | 0x80),
+    static_cast<uint8_t>(kCompressedPacketsFieldTag >> 7),
+};
+
+ProtoTraceTokenizer::ProtoTraceTokenizer() = default;
 
-  std::unique_ptr<uint8_t[]> out_data(new uint8_t[data.size()]);
-  memcpy(out_data.get(), data.data(), data.size());
-  *output = TraceBlobView(std::move(out_data), 0, data.size());
+util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
+                                             TraceBlobView* output) {
+  PERFETTO_DCHECK(gzip::IsGzipSupported());
+
+  std::unique_ptr<uint8_t[]> data;
+  size_t size = 0;
+  if (!DecompressAll(&decompressor_, input.data(), input.length(), &data,
+                     &size)) {
+    return util::ErrStatus("Failed to decompress compressed packets");
+  }
+  *output = TraceBlobView(std::move(data), 0, size);
   return util::OkStatus();
 }
 
+void ProtoTraceTokenizer::DecompressChunkPackets() {
+  PERFETTO_DCHECK(decompressions_.empty());
+
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < chunk_packets_.size(); ++i) {
+    const TraceBlobView& packet = chunk_packets_[i];
+    protozero::ConstBytes bytes{packet.data(), packet.length()};
+    if (!StartsWithCompressedPackets(bytes))
+      continue;
+
+    protos::pbzero::TracePacket::Decoder decoder(packet.data(),
+                                                 packet.length());
+    protozero::ConstBytes field = decoder.compressed_packets();
+    Decompression decompression;
+    decompression.packet_idx = i;
+    decompression.input = field.data;
+    decompression.input_size = field.size;
+    decompression.output_size = 0;
+    decompression.ok = false;
+    decompressions_.emplace_back(std::move(decompression));
+    total_bytes += field.size;
+  }
+
+  auto decompress = [this](GzipDecompressor* decompressor, size_t idx) {
+    Decompression& d = decompressions_[idx];
+    d.ok = DecompressAll(decompressor, d.input, d.input_size, &d.output,
+                         &d.output_size);
+  };
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  base::ignore_result(total_bytes);
+  for (size_t i = 0; i < decompressions_.size(); ++i)
+    decompress(&decompressor_, i);
+#else
+  uint32_t num_threads = std::min(
+      {std::max(std::thread::hardware_concurrency(), 1u),
+       kMaxDecompressionThreads,
+       static_cast<uint32_t>(decompressions_.size())});
+  if (total_bytes < kMinParallelDecompressionBytes)
+    num_threads = 1;
+
+  // Every thread, including this one, takes the next packet to decompress
+  // until there are none left. Each packet only touches its own slot in
+  // |decompressions_| so the only shared state is |next|.
+  std::atomic<size_t> next{0};
+  auto worker = [this, &next, &decompress](GzipDecompressor* decompressor) {
+    for (size_t i = next++; i < decompressions_.size(); i = next++)
+      decompress(decompressor, i);
+  };
+  std::vector<std::unique_ptr<GzipDecompressor>> decompressors;
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < num_threads; ++i) {
+    decompressors.emplace_back(new GzipDecompressor());
+    threads.emplace_back(worker, decompressors.back().get());
+  }
+  worker(&decompressor_);
+  for (std::thread& thread : threads)
+    thread.join();
+#endif
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
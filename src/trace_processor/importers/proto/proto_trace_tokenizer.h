@@ -17,6 +17,9 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_TOKENIZER_H_
 
+#include <string.h>
+
+#include <deque>
 #include <vector>
 
 #include "perfetto/protozero/proto_utils.h"
@@ -41,7 +44,15 @@ class ProtoTraceTokenizer {
   util::Status Tokenize(std::unique_ptr<uint8_t[]> owned_buf,
                         size_t size,
                         Callback callback) {
-    uint8_t* data = &owned_buf[0];
+    return Tokenize(TraceBlobView(std::move(owned_buf), 0, size), callback);
+  }
+
+  // Same as above but the packets reference the memory of |blob| which may be
+  // shared with other views.
+  template <typename Callback = util::Status(TraceBlobView)>
+  util::Status Tokenize(TraceBlobView blob, Callback callback) {
+    const uint8_t* data = blob.data();
+    size_t size = blob.length();
     if (!partial_buf_.empty()) {
       // It takes ~5 bytes for a proto preamble + the varint size.
       const size_t kHeaderBytes = 5;
@@ -95,15 +106,14 @@ class ProtoTraceTokenizer {
         data += size_missing;
         size -= size_missing;
         partial_buf_.clear();
-        uint8_t* buf_start = &buf[0];  // Note that buf is std::moved below.
-        RETURN_IF_ERROR(ParseInternal(std::move(buf), buf_start,
-                                      size_incl_header, callback));
+        RETURN_IF_ERROR(ParseInternal(
+            TraceBlobView(std::move(buf), 0, size_incl_header), callback));
       } else {
         partial_buf_.insert(partial_buf_.end(), data, &data[size]);
         return util::OkStatus();
       }
     }
-    return ParseInternal(std::move(owned_buf), data, size, callback);
+    return ParseInternal(blob.slice(blob.offset_of(data), size), callback);
   }
 
  private:
@@ -112,23 +122,40 @@ class ProtoTraceTokenizer {
           protos::pbzero::Trace::kPacketFieldNumber);
 
   template <typename Callback = util::Status(TraceBlobView)>
-  util::Status ParseInternal(std::unique_ptr<uint8_t[]> owned_buf,
-                             uint8_t* data,
-                             size_t size,
-                             Callback callback) {
-    PERFETTO_DCHECK(data >= &owned_buf[0]);
-    const uint8_t* start = &owned_buf[0];
-    const size_t data_off = static_cast<size_t>(data - start);
-    TraceBlobView whole_buf(std::move(owned_buf), data_off, size);
+  util::Status ParseInternal(TraceBlobView whole_buf, Callback callback) {
+    const uint8_t* data = whole_buf.data();
+    size_t size = whole_buf.length();
 
     protos::pbzero::Trace::Decoder decoder(data, size);
+    PERFETTO_DCHECK(chunk_packets_.empty());
+    size_t num_compressed = 0;
     for (auto it = decoder.packet(); it; ++it) {
       protozero::ConstBytes packet = *it;
       size_t field_offset = whole_buf.offset_of(packet.data);
-      TraceBlobView sliced = whole_buf.slice(field_offset, packet.size);
-      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+      chunk_packets_.emplace_back(whole_buf.slice(field_offset, packet.size));
+      if (StartsWithCompressedPackets(packet))
+        num_compressed++;
     }
 
+    // Decompress all the compressed packets in this chunk up front so that
+    // this can be done in parallel.
+    if (num_compressed > 1 && gzip::IsGzipSupported())
+      DecompressChunkPackets();
+
+    util::Status status;
+    for (size_t i = 0; i < chunk_packets_.size() && status.ok(); ++i) {
+      Decompression* decompression = nullptr;
+      if (!decompressions_.empty() && decompressions_.front().packet_idx == i)
+        decompression = &decompressions_.front();
+      status =
+          ParsePacket(std::move(chunk_packets_[i]), callback, decompression);
+      if (decompression)
+        decompressions_.pop_front();
+    }
+    chunk_packets_.clear();
+    decompressions_.clear();
+    RETURN_IF_ERROR(status);
+
     const size_t bytes_left = decoder.bytes_left();
     if (bytes_left > 0) {
       PERFETTO_DCHECK(partial_buf_.empty());
@@ -138,8 +165,26 @@ class ProtoTraceTokenizer {
     return util::OkStatus();
   }
 
+  // A compressed_packets field decompressed ahead of parsing its packet.
+  struct Decompression {
+    // The index of the packet in |chunk_packets_|.
+    size_t packet_idx;
+
+    const uint8_t* input;
+    size_t input_size;
+
+    // Set by DecompressChunkPackets().
+    std::unique_ptr<uint8_t[]> output;
+    size_t output_size;
+    bool ok;
+  };
+
+  // |decompression|, if not null, holds the result of decompressing the
+  // compressed_packets field of |packet|.
   template <typename Callback = util::Status(TraceBlobView)>
-  util::Status ParsePacket(TraceBlobView packet, Callback callback) {
+  util::Status ParsePacket(TraceBlobView packet,
+                           Callback callback,
+                           Decompression* decompression = nullptr) {
     protos::pbzero::TracePacket::Decoder decoder(packet.data(),
                                                  packet.length());
     if (decoder.has_compressed_packets()) {
@@ -148,12 +193,18 @@ class ProtoTraceTokenizer {
             "Cannot decode compressed packets. Zlib not enabled");
       }
 
-      protozero::ConstBytes field = decoder.compressed_packets();
-      const size_t field_off = packet.offset_of(field.data);
-      TraceBlobView compressed_packets = packet.slice(field_off, field.size);
       TraceBlobView packets(nullptr, 0, 0);
-
-      RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
+      if (decompression) {
+        if (!decompression->ok)
+          return util::ErrStatus("Failed to decompress compressed packets");
+        packets = TraceBlobView(std::move(decompression->output), 0,
+                                decompression->output_size);
+      } else {
+        protozero::ConstBytes field = decoder.compressed_packets();
+        const size_t field_off = packet.offset_of(field.data);
+        TraceBlobView compressed_packets = packet.slice(field_off, field.size);
+        RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
+      }
 
       const uint8_t* start = packets.data();
       const uint8_t* end = packets.data() + packets.length();
@@ -178,8 +229,31 @@ class ProtoTraceTokenizer {
     return callback(std::move(packet));
   }
 
+  // Returns whether |packet| starts with a compressed_packets field. Producers
+  // write this as the only field of the packet so this is a cheap way to spot
+  // these packets without decoding every packet.
+  static bool StartsWithCompressedPackets(protozero::ConstBytes packet) {
+    return packet.size > sizeof(kCompressedPacketsTag) &&
+           memcmp(packet.data, kCompressedPacketsTag,
+                  sizeof(kCompressedPacketsTag)) == 0;
+  }
+
   util::Status Decompress(TraceBlobView input, TraceBlobView* output);
 
+  // Fills |decompressions_| with the decompressed contents of the
+  // compressed_packets fields of |chunk_packets_|. The packets are
+  // decompressed in parallel where threads are available.
+  void DecompressChunkPackets();
+
+  // The varint-encoded tag of a TracePacket's compressed_packets field.
+  static const uint8_t kCompressedPacketsTag[2];
+
+  // The packets of the chunk being parsed by ParseInternal() and the
+  // decompressed contents of those starting with compressed_packets, sorted
+  // by |Decompression::packet_idx|.
+  std::vector<TraceBlobView> chunk_packets_;
+  std::deque<Decompression> decompressions_;
+
   // Used to glue together trace packets that span across two (or more)
   // Parse() boundaries.
   std::vector<uint8_t> partial_buf_;
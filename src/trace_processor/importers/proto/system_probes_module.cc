@@ -15,10 +15,24 @@
  */
 
 #include "src/trace_processor/importers/proto/system_probes_module.h"
+
+#include <string.h>
+
+#include <utility>
+#include <vector>
+
 #include "perfetto/base/build_config.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "src/trace_processor/importers/proto/system_probes_parser.h"
+#include "src/trace_processor/storage/stats.h"
+#include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/timestamped_trace_piece.h"
+#include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/types/trace_processor_context.h"
 
+#include "protos/perfetto/trace/sys_stats/sys_stats.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
 
 namespace perfetto {
@@ -27,7 +41,7 @@ namespace trace_processor {
 using perfetto::protos::pbzero::TracePacket;
 
 SystemProbesModule::SystemProbesModule(TraceProcessorContext* context)
-    : parser_(context) {
+    : context_(context), parser_(context) {
   RegisterForField(TracePacket::kProcessTreeFieldNumber, context);
   RegisterForField(TracePacket::kProcessStatsFieldNumber, context);
   RegisterForField(TracePacket::kSysStatsFieldNumber, context);
@@ -38,10 +52,17 @@ SystemProbesModule::SystemProbesModule(TraceProcessorContext* context)
 ModuleResult SystemProbesModule::TokenizePacket(
     const protos::pbzero::TracePacket::Decoder& decoder,
     TraceBlobView*,
-    int64_t,
-    PacketSequenceState*,
+    int64_t packet_timestamp,
+    PacketSequenceState* state,
     uint32_t field_id) {
   switch (field_id) {
+    case TracePacket::kSysStatsFieldNumber: {
+      protos::pbzero::SysStats::Decoder sys_stats(decoder.sys_stats());
+      if (!sys_stats.has_counter_batch())
+        return ModuleResult::Ignored();
+      TokenizeCounterBatch(packet_timestamp, state, sys_stats.counter_batch());
+      return ModuleResult::Handled();
+    }
     case TracePacket::kSystemInfoFieldNumber:
       parser_.ParseSystemInfo(decoder.system_info());
       return ModuleResult::Handled();
@@ -52,6 +73,78 @@ ModuleResult SystemProbesModule::TokenizePacket(
   return ModuleResult::Ignored();
 }
 
+void SystemProbesModule::TokenizeCounterBatch(int64_t packet_timestamp,
+                                              PacketSequenceState* state,
+                                              protozero::ConstBytes blob) {
+  // The samples of a batch span up to SysCountersConfig.batch_period_ms, and
+  // have to be sorted against the other counters of the trace. Turn each one
+  // into a single-sample batch in its own packet: the packets are forged back
+  // to back into a single buffer, which is then shared by all their
+  // TraceBlobViews.
+  using protos::pbzero::SysStats;
+  SysStats::CounterBatch::Decoder batch(blob.data, blob.size);
+  std::vector<protozero::ConstChars> names;
+  for (auto it = batch.name(); it; ++it)
+    names.push_back(*it);
+  if (names.empty())
+    return;
+
+  std::vector<uint8_t> forged;
+  std::vector<std::pair<int64_t, size_t>> forged_ends;
+  protozero::HeapBuffered<protos::pbzero::TracePacket> sample_packet;
+  protozero::PackedVarInt timestamp;
+  protozero::PackedVarInt values;
+  timestamp.Append(0);
+
+  // The values are |names.size()| per timestamp, each one relative to the
+  // previous one of the same counter. The forged ones are all absolute.
+  std::vector<int64_t> last_values(names.size());
+  bool parse_error = false;
+  int64_t ts = packet_timestamp;
+  auto value_it = batch.value(&parse_error);
+  for (auto ts_it = batch.timestamp(&parse_error); ts_it; ++ts_it) {
+    ts += static_cast<int64_t>(*ts_it);
+    values.Reset();
+    for (size_t i = 0; i < names.size(); i++, ++value_it) {
+      if (PERFETTO_UNLIKELY(!value_it)) {
+        parse_error = true;
+        break;
+      }
+      last_values[i] += protozero::proto_utils::ZigZagDecode(*value_it);
+      values.Append(protozero::proto_utils::ZigZagEncode(last_values[i]));
+    }
+    if (parse_error)
+      break;
+
+    sample_packet.Reset();
+    sample_packet->set_timestamp(static_cast<uint64_t>(ts));
+    auto* sample = sample_packet->set_sys_stats()->set_counter_batch();
+    for (const protozero::ConstChars& name : names)
+      sample->add_name(name.data, name.size);
+    sample->set_timestamp(timestamp);
+    sample->set_value(values);
+    std::vector<uint8_t> vec = sample_packet.SerializeAsArray();
+    forged.insert(forged.end(), vec.begin(), vec.end());
+    forged_ends.emplace_back(ts, forged.size());
+  }
+  if (parse_error || value_it)
+    context_->storage->IncrementStats(stats::sys_counters_batch_parse_errors);
+
+  if (forged.empty())
+    return;
+
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[forged.size()]);
+  memcpy(buffer.get(), forged.data(), forged.size());
+  TraceBlobView forged_blob(std::move(buffer), 0, forged.size());
+  size_t offset = 0;
+  for (const auto& ts_and_end : forged_ends) {
+    context_->sorter->PushTracePacket(
+        ts_and_end.first, state,
+        forged_blob.slice(offset, ts_and_end.second - offset));
+    offset = ts_and_end.second;
+  }
+}
+
 void SystemProbesModule::ParsePacket(const TracePacket::Decoder& decoder,
                                      const TimestampedTracePiece& ttp,
                                      uint32_t field_id) {
@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_SYSTEM_PROBES_MODULE_H_
 
 #include "perfetto/base/build_config.h"
+#include "perfetto/protozero/field.h"
 #include "src/trace_processor/importers/proto/proto_importer_module.h"
 #include "src/trace_processor/importers/proto/system_probes_parser.h"
 
@@ -41,6 +42,12 @@ class SystemProbesModule : public ProtoImporterModule {
                    uint32_t field_id) override;
 
  private:
+  // Splits a SysStats.CounterBatch into one packet per sample.
+  void TokenizeCounterBatch(int64_t packet_timestamp,
+                            PacketSequenceState*,
+                            protozero::ConstBytes);
+
+  TraceProcessorContext* const context_;
   SystemProbesParser parser_;
 };
 
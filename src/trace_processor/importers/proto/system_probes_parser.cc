@@ -22,6 +22,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/traced/sys_stats_counters.h"
 #include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "src/trace_processor/importers/common/event_tracker.h"
 #include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/common/system_info_tracker.h"
@@ -229,6 +230,42 @@ void SystemProbesParser::ParseSysStats(int64_t ts, ConstBytes blob) {
     context_->event_tracker->PushCounter(
         ts, static_cast<double>(sys_stats.num_softirq_total()), track);
   }
+
+  if (sys_stats.has_counter_batch())
+    ParseCounterBatch(ts, sys_stats.counter_batch());
+}
+
+void SystemProbesParser::ParseCounterBatch(int64_t ts, ConstBytes blob) {
+  protos::pbzero::SysStats::CounterBatch::Decoder batch(blob.data, blob.size);
+
+  std::vector<TrackId> tracks;
+  for (auto it = batch.name(); it; ++it) {
+    StringId name = context_->storage->InternString(*it);
+    tracks.push_back(context_->track_tracker->InternGlobalCounterTrack(name));
+  }
+  if (tracks.empty())
+    return;
+
+  // The values are |tracks.size()| per timestamp, each one relative to the
+  // previous one of the same track.
+  bool parse_error = false;
+  std::vector<int64_t> values(tracks.size());
+  auto value_it = batch.value(&parse_error);
+  for (auto ts_it = batch.timestamp(&parse_error); ts_it; ++ts_it) {
+    ts += static_cast<int64_t>(*ts_it);
+    for (size_t i = 0; i < tracks.size(); i++, ++value_it) {
+      if (PERFETTO_UNLIKELY(!value_it)) {
+        context_->storage->IncrementStats(
+            stats::sys_counters_batch_parse_errors);
+        return;
+      }
+      values[i] += protozero::proto_utils::ZigZagDecode(*value_it);
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(values[i]), tracks[i]);
+    }
+  }
+  if (parse_error || value_it)
+    context_->storage->IncrementStats(stats::sys_counters_batch_parse_errors);
 }
 
 void SystemProbesParser::ParseProcessTree(ConstBytes blob) {
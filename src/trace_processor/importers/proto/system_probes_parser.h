@@ -43,6 +43,7 @@ class SystemProbesParser {
 
  private:
   void ParseThreadStats(int64_t timestamp, uint32_t pid, ConstBytes);
+  void ParseCounterBatch(int64_t ts, ConstBytes);
   inline bool IsValidCpuFreqIndex(uint32_t freq) const;
 
   TraceProcessorContext* const context_;
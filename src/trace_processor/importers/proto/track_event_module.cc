@@ -90,6 +90,12 @@ void TrackEventModule::ParsePacket(const TracePacket::Decoder& decoder,
   }
 }
 
+void TrackEventModule::ParseTrackEventData(const TimestampedTracePiece& ttp) {
+  PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTrackEvent);
+  TrackEventData* data = ttp.track_event_data.get();
+  parser_.ParseTrackEvent(ttp.timestamp, data, data->track_event());
+}
+
 void TrackEventModule::OnIncrementalStateCleared(uint32_t packet_sequence_id) {
   track_event_tracker_->OnIncrementalStateCleared(packet_sequence_id);
 }
@@ -45,6 +45,10 @@ class TrackEventModule : public ProtoImporterModule {
                    const TimestampedTracePiece& ttp,
                    uint32_t field_id) override;
 
+  // Parses a TrackEvent tokenized by this module. Unlike ParsePacket(), this
+  // doesn't need the TracePacket to be decoded again.
+  void ParseTrackEventData(const TimestampedTracePiece& ttp);
+
  private:
   std::unique_ptr<TrackEventTracker> track_event_tracker_;
   TrackEventTokenizer tokenizer_;
@@ -257,11 +257,14 @@ class TrackEventParser::EventImporter {
     // string.
     if (PERFETTO_LIKELY(category_iids.size() == 1 &&
                         category_strings.empty())) {
-      auto* decoder = sequence_state_->LookupInternedMessage<
-          protos::pbzero::InternedData::kEventCategoriesFieldNumber,
-          protos::pbzero::EventCategory>(category_iids[0]);
-      if (decoder) {
-        category_id = storage_->InternString(decoder->name());
+      base::Optional<StringId> opt_category_id =
+          sequence_state_->LookupInternedString<
+              protos::pbzero::InternedData::kEventCategoriesFieldNumber,
+              protos::pbzero::EventCategory,
+              protos::pbzero::EventCategory::kNameFieldNumber>(
+              category_iids[0]);
+      if (opt_category_id) {
+        category_id = *opt_category_id;
       } else {
         char buffer[32];
         base::StringWriter writer(buffer, sizeof(buffer));
@@ -306,11 +309,13 @@ class TrackEventParser::EventImporter {
       name_iid = legacy_event_.name_iid();
 
     if (PERFETTO_LIKELY(name_iid)) {
-      auto* decoder = sequence_state_->LookupInternedMessage<
-          protos::pbzero::InternedData::kEventNamesFieldNumber,
-          protos::pbzero::EventName>(name_iid);
-      if (decoder)
-        return storage_->InternString(decoder->name());
+      base::Optional<StringId> opt_name_id =
+          sequence_state_->LookupInternedString<
+              protos::pbzero::InternedData::kEventNamesFieldNumber,
+              protos::pbzero::EventName,
+              protos::pbzero::EventName::kNameFieldNumber>(name_iid);
+      if (opt_name_id)
+        return *opt_name_id;
     } else if (event_.has_name()) {
       return storage_->InternString(event_.name());
     }
@@ -1287,6 +1292,20 @@ class TrackEventParser::EventImporter {
     return false;
   }
 
+  void GetSourceLocation(InternedMessageView* view,
+                         StringId* file_name_id,
+                         StringId* function_name_id,
+                         uint32_t* line_number) {
+    using protos::pbzero::SourceLocation;
+    *file_name_id =
+        view->GetOrInternString<SourceLocation,
+                                SourceLocation::kFileNameFieldNumber>(storage_);
+    *function_name_id = view->GetOrInternString<
+        SourceLocation, SourceLocation::kFunctionNameFieldNumber>(storage_);
+    *line_number =
+        view->GetOrCreateDecoder<SourceLocation>()->line_number();
+  }
+
   util::Status ParseTaskExecutionArgs(ConstBytes task_execution,
                                       BoundInserter* inserter) {
     protos::pbzero::TaskExecution::Decoder task(task_execution);
@@ -1294,19 +1313,15 @@ class TrackEventParser::EventImporter {
     if (!iid)
       return util::ErrStatus("TaskExecution with invalid posted_from_iid");
 
-    auto* decoder = sequence_state_->LookupInternedMessage<
-        protos::pbzero::InternedData::kSourceLocationsFieldNumber,
-        protos::pbzero::SourceLocation>(iid);
-    if (!decoder)
+    auto* view = sequence_state_->GetInternedMessageView(
+        protos::pbzero::InternedData::kSourceLocationsFieldNumber, iid);
+    if (!view)
       return util::ErrStatus("TaskExecution with invalid posted_from_iid");
 
     StringId file_name_id = kNullStringId;
     StringId function_name_id = kNullStringId;
     uint32_t line_number = 0;
-
-    file_name_id = storage_->InternString(decoder->file_name());
-    function_name_id = storage_->InternString(decoder->function_name());
-    line_number = decoder->line_number();
+    GetSourceLocation(view, &file_name_id, &function_name_id, &line_number);
 
     inserter->AddArg(parser_->task_file_name_args_key_id_,
                      Variadic::String(file_name_id));
@@ -1321,19 +1336,15 @@ class TrackEventParser::EventImporter {
     if (!iid)
       return util::ErrStatus("SourceLocation with invalid iid");
 
-    auto* decoder = sequence_state_->LookupInternedMessage<
-        protos::pbzero::InternedData::kSourceLocationsFieldNumber,
-        protos::pbzero::SourceLocation>(iid);
-    if (!decoder)
+    auto* view = sequence_state_->GetInternedMessageView(
+        protos::pbzero::InternedData::kSourceLocationsFieldNumber, iid);
+    if (!view)
       return util::ErrStatus("SourceLocation with invalid iid");
 
     StringId file_name_id = kNullStringId;
     StringId function_name_id = kNullStringId;
     uint32_t line_number = 0;
-
-    file_name_id = storage_->InternString(decoder->file_name());
-    function_name_id = storage_->InternString(decoder->function_name());
-    line_number = decoder->line_number();
+    GetSourceLocation(view, &file_name_id, &function_name_id, &line_number);
 
     inserter->AddArg(parser_->source_location_file_name_key_id_,
                      Variadic::String(file_name_id));
@@ -1386,14 +1397,15 @@ class TrackEventParser::EventImporter {
           "name_iid can be set.");
     }
 
-    auto* decoder = sequence_state_->LookupInternedMessage<
+    base::Optional<StringId> name_id = sequence_state_->LookupInternedString<
         protos::pbzero::InternedData::kHistogramNamesFieldNumber,
-        protos::pbzero::HistogramName>(sample.name_iid());
-    if (!decoder)
+        protos::pbzero::HistogramName,
+        protos::pbzero::HistogramName::kNameFieldNumber>(sample.name_iid());
+    if (!name_id)
       return util::ErrStatus("HistogramName with invalid name_iid");
 
     inserter->AddArg(parser_->histogram_name_key_id_,
-                     Variadic::String(storage_->InternString(decoder->name())));
+                     Variadic::String(*name_id));
     return util::OkStatus();
   }
 
@@ -211,6 +211,9 @@ void TrackEventTokenizer::TokenizeTrackEventPacket(
   int64_t timestamp;
   std::unique_ptr<TrackEventData> data(
       new TrackEventData(std::move(*packet_blob), state->current_generation()));
+  data->track_event_offset =
+      static_cast<uint32_t>(field.data - data->packet.data());
+  data->track_event_size = static_cast<uint32_t>(field.size);
 
   // TODO(eseckler): Remove handling of timestamps relative to ThreadDescriptors
   // once all producers have switched to clock-domain timestamps (e.g.
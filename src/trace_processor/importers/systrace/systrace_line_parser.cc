@@ -16,7 +16,7 @@
 
 #include "src/trace_processor/importers/systrace/systrace_line_parser.h"
 
-#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/common/event_tracker.h"
@@ -31,11 +31,69 @@
 #include <inttypes.h>
 #include <cctype>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// Splits |args_str| into its space separated "key=value" args. Args without
+// an '=' are given the key "name". The keys and values point into |args_str|.
+void ParseArgs(base::StringView args_str, SystraceLineParser::Args* args) {
+  args->clear();
+  for (size_t start = 0; start < args_str.size();) {
+    size_t end = args_str.find(' ', start);
+    if (end == base::StringView::npos)
+      end = args_str.size();
+    base::StringView token = args_str.substr(start, end - start);
+    start = end + 1;
+    if (token.empty())
+      continue;
+
+    size_t eq = token.find('=');
+    if (eq == base::StringView::npos) {
+      args->emplace_back(base::StringView("name"), token);
+      continue;
+    }
+
+    // Skip any leading '=' and use the part after the last '=' as the value.
+    size_t key_start = 0;
+    while (key_start < token.size() && token.at(key_start) == '=')
+      key_start++;
+    size_t key_end = token.find('=', key_start);
+    if (key_end == base::StringView::npos)
+      key_end = token.size();
+    base::StringView key = token.substr(key_start, key_end - key_start);
+
+    size_t value_end = token.size();
+    while (value_end > key_end && token.at(value_end - 1) == '=')
+      value_end--;
+    if (value_end <= key_end) {
+      args->emplace_back(key, base::StringView());
+      continue;
+    }
+    size_t value_start = token.substr(0, value_end).rfind('=') + 1;
+    args->emplace_back(key,
+                       token.substr(value_start, value_end - value_start));
+  }
+}
+
+// Returns the value of the first arg called |key| or an empty string if there
+// is no such arg.
+base::StringView GetArg(const SystraceLineParser::Args& args,
+                        const char* key) {
+  base::StringView key_view(key);
+  for (const auto& arg : args) {
+    if (arg.first == key_view)
+      return arg.second;
+  }
+  return base::StringView();
+}
+
+}  // namespace
+
 SystraceLineParser::SystraceLineParser(TraceProcessorContext* ctx)
     : context_(ctx),
       rss_stat_tracker_(context_),
@@ -58,36 +116,29 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     }
   }
 
-  std::unordered_map<std::string, std::string> args;
-  for (base::StringSplitter ss(line.args_str, ' '); ss.Next();) {
-    std::string key;
-    std::string value;
-    if (!base::Contains(ss.cur_token(), "=")) {
-      key = "name";
-      value = ss.cur_token();
-      args.emplace(std::move(key), std::move(value));
-      continue;
-    }
-    for (base::StringSplitter inner(ss.cur_token(), '='); inner.Next();) {
-      if (key.empty()) {
-        key = inner.cur_token();
-      } else {
-        value = inner.cur_token();
-      }
-    }
-    args.emplace(std::move(key), std::move(value));
+  // Print events are the most common by far and don't need the args below.
+  if (line.event_name == "tracing_mark_write" || line.event_name == "0" ||
+      line.event_name == "print") {
+    SystraceParser::GetOrCreate(context_)->ParsePrintEvent(
+        line.ts, line.pid, line.args_str.c_str());
+    return util::OkStatus();
   }
+
+  ParseArgs(base::StringView(line.args_str), &args_);
+  auto args = [this](const char* key) {
+    return GetArg(args_, key).ToStdString();
+  };
   if (line.event_name == "sched_switch") {
-    auto prev_state_str = args["prev_state"];
+    auto prev_state_str = args("prev_state");
     int64_t prev_state =
         ftrace_utils::TaskState(prev_state_str.c_str()).raw_state();
 
-    auto prev_pid = base::StringToUInt32(args["prev_pid"]);
-    auto prev_comm = base::StringView(args["prev_comm"]);
-    auto prev_prio = base::StringToInt32(args["prev_prio"]);
-    auto next_pid = base::StringToUInt32(args["next_pid"]);
-    auto next_comm = base::StringView(args["next_comm"]);
-    auto next_prio = base::StringToInt32(args["next_prio"]);
+    auto prev_pid = base::StringToUInt32(args("prev_pid"));
+    auto prev_comm = GetArg(args_, "prev_comm");
+    auto prev_prio = base::StringToInt32(args("prev_prio"));
+    auto next_pid = base::StringToUInt32(args("next_pid"));
+    auto next_comm = GetArg(args_, "next_comm");
+    auto next_prio = base::StringToInt32(args("next_prio"));
 
     if (!(prev_pid.has_value() && prev_prio.has_value() &&
           next_pid.has_value() && next_prio.has_value())) {
@@ -97,13 +148,9 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     SchedEventTracker::GetOrCreate(context_)->PushSchedSwitch(
         line.cpu, line.ts, prev_pid.value(), prev_comm, prev_prio.value(),
         prev_state, next_pid.value(), next_comm, next_prio.value());
-  } else if (line.event_name == "tracing_mark_write" ||
-             line.event_name == "0" || line.event_name == "print") {
-    SystraceParser::GetOrCreate(context_)->ParsePrintEvent(
-        line.ts, line.pid, line.args_str.c_str());
   } else if (line.event_name == "sched_wakeup") {
-    auto comm = args["comm"];
-    base::Optional<uint32_t> wakee_pid = base::StringToUInt32(args["pid"]);
+    auto comm = args("comm");
+    base::Optional<uint32_t> wakee_pid = base::StringToUInt32(args("pid"));
     if (!wakee_pid.has_value()) {
       return util::Status("Could not convert wakee_pid");
     }
@@ -114,8 +161,8 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     context_->event_tracker->PushInstant(line.ts, sched_wakeup_name_id_,
                                          wakee_utid, RefType::kRefUtid);
   } else if (line.event_name == "cpu_idle") {
-    base::Optional<uint32_t> event_cpu = base::StringToUInt32(args["cpu_id"]);
-    base::Optional<double> new_state = base::StringToDouble(args["state"]);
+    base::Optional<uint32_t> event_cpu = base::StringToUInt32(args("cpu_id"));
+    base::Optional<double> new_state = base::StringToDouble(args("state"));
     if (!event_cpu.has_value()) {
       return util::Status("Could not convert event cpu");
     }
@@ -127,15 +174,15 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         cpuidle_name_id_, event_cpu.value());
     context_->event_tracker->PushCounter(line.ts, new_state.value(), track);
   } else if (line.event_name == "binder_transaction") {
-    auto id = base::StringToInt32(args["transaction"]);
-    auto dest_node = base::StringToInt32(args["dest_node"]);
-    auto dest_tgid = base::StringToInt32(args["dest_proc"]);
-    auto dest_tid = base::StringToInt32(args["dest_thread"]);
-    auto is_reply = base::StringToInt32(args["reply"]).value() == 1;
-    auto flags_str = args["flags"];
+    auto id = base::StringToInt32(args("transaction"));
+    auto dest_node = base::StringToInt32(args("dest_node"));
+    auto dest_tgid = base::StringToInt32(args("dest_proc"));
+    auto dest_tid = base::StringToInt32(args("dest_thread"));
+    auto is_reply = base::StringToInt32(args("reply")).value() == 1;
+    auto flags_str = args("flags");
     char* end;
     uint32_t flags = static_cast<uint32_t>(strtol(flags_str.c_str(), &end, 16));
-    std::string code_str = args["code"] + " Java Layer Dependent";
+    std::string code_str = args("code") + " Java Layer Dependent";
     StringId code = context_->storage->InternString(base::StringView(code_str));
     if (!dest_tgid.has_value()) {
       return util::Status("Could not convert dest_tgid");
@@ -153,7 +200,7 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         line.ts, line.pid, id.value(), dest_node.value(), dest_tgid.value(),
         dest_tid.value(), is_reply, flags, code);
   } else if (line.event_name == "binder_transaction_received") {
-    auto id = base::StringToInt32(args["transaction"]);
+    auto id = base::StringToInt32(args("transaction"));
     if (!id.has_value()) {
       return util::Status("Could not convert transaction id");
     }
@@ -166,8 +213,8 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
   } else if (line.event_name == "binder_unlock") {
     BinderTracker::GetOrCreate(context_)->Unlock(line.ts, line.pid);
   } else if (line.event_name == "binder_transaction_alloc_buf") {
-    auto data_size = base::StringToUInt64(args["data_size"]);
-    auto offsets_size = base::StringToUInt64(args["offsets_size"]);
+    auto data_size = base::StringToUInt64(args("data_size"));
+    auto offsets_size = base::StringToUInt64(args("offsets_size"));
     if (!data_size.has_value()) {
       return util::Status("Could not convert data size");
     }
@@ -181,11 +228,11 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
              line.event_name == "clock_disable") {
     std::string subtitle =
         line.event_name == "clock_set_rate" ? " Frequency" : " State";
-    auto rate = base::StringToUInt32(args["state"]);
+    auto rate = base::StringToUInt32(args("state"));
     if (!rate.has_value()) {
       return util::Status("Could not convert state");
     }
-    std::string clock_name_str = args["name"] + subtitle;
+    std::string clock_name_str = args("name") + subtitle;
     StringId clock_name =
         context_->storage->InternString(base::StringView(clock_name_str));
     TrackId track =
@@ -201,29 +248,29 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     TrackId track = context_->track_tracker->InternThreadTrack(utid);
     context_->slice_tracker->End(line.ts, track, workqueue_name_id_);
   } else if (line.event_name == "thermal_temperature") {
-    std::string thermal_zone = args["thermal_zone"] + " Temperature";
+    std::string thermal_zone = args("thermal_zone") + " Temperature";
     StringId track_name =
         context_->storage->InternString(base::StringView(thermal_zone));
     TrackId track =
         context_->track_tracker->InternGlobalCounterTrack(track_name);
-    auto temp = base::StringToInt32(args["temp"]);
+    auto temp = base::StringToInt32(args("temp"));
     if (!temp.has_value()) {
       return util::Status("Could not convert temp");
     }
     context_->event_tracker->PushCounter(line.ts, temp.value(), track);
   } else if (line.event_name == "cdev_update") {
-    std::string type = args["type"] + " Cooling Device";
+    std::string type = args("type") + " Cooling Device";
     StringId track_name =
         context_->storage->InternString(base::StringView(type));
     TrackId track =
         context_->track_tracker->InternGlobalCounterTrack(track_name);
-    auto target = base::StringToDouble(args["target"]);
+    auto target = base::StringToDouble(args("target"));
     if (!target.has_value()) {
       return util::Status("Could not convert target");
     }
     context_->event_tracker->PushCounter(line.ts, target.value(), track);
   } else if (line.event_name == "sched_blocked_reason") {
-    auto wakee_pid = base::StringToUInt32(args["pid"]);
+    auto wakee_pid = base::StringToUInt32(args("pid"));
     if (!wakee_pid.has_value()) {
       return util::Status("sched_blocked_reason: could not parse wakee_pid");
     }
@@ -234,7 +281,7 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         false);
 
     auto inserter = context_->args_tracker->AddArgsTo(id);
-    auto io_wait = base::StringToInt32(args["iowait"]);
+    auto io_wait = base::StringToInt32(args("iowait"));
     if (!io_wait.has_value()) {
       return util::Status("sched_blocked_reason: could not parse io_wait");
     }
@@ -242,10 +289,10 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     context_->args_tracker->Flush();
   } else if (line.event_name == "rss_stat") {
     // Format: rss_stat: size=8437760 member=1 curr=1 mm_id=2824390453
-    auto size = base::StringToInt64(args["size"]);
-    auto member = base::StringToUInt32(args["member"]);
-    auto mm_id = base::StringToInt64(args["mm_id"]);
-    auto opt_curr = base::StringToUInt32(args["curr"]);
+    auto size = base::StringToInt64(args("size"));
+    auto member = base::StringToUInt32(args("member"));
+    auto mm_id = base::StringToInt64(args("mm_id"));
+    auto opt_curr = base::StringToUInt32(args("curr"));
     if (!size.has_value()) {
       return util::Status("rss_stat: could not parse size");
     }
@@ -17,6 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_PARSER_H_
 
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/status.h"
 
 #include "src/trace_processor/importers/common/trace_parser.h"
@@ -29,6 +33,9 @@ namespace trace_processor {
 
 class SystraceLineParser {
  public:
+  // The key and value of each arg of the line being parsed.
+  using Args = std::vector<std::pair<base::StringView, base::StringView>>;
+
   explicit SystraceLineParser(TraceProcessorContext*);
 
   util::Status ParseLine(const SystraceLine&);
@@ -41,6 +48,9 @@ class SystraceLineParser {
   const StringId workqueue_name_id_ = kNullStringId;
   const StringId sched_blocked_reason_id_ = kNullStringId;
   const StringId io_wait_id_ = kNullStringId;
+
+  // Reused across lines to avoid allocating.
+  Args args_;
 };
 
 }  // namespace trace_processor
@@ -17,6 +17,7 @@
 #include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
 
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/string_view.h"
 
 // On windows std::isspace if overloaded in <locale>. MSBUILD via bazel
 // attempts to use that version instead of the intended one defined in
@@ -27,23 +28,128 @@ namespace perfetto {
 namespace trace_processor {
 
 namespace {
-std::string SubstrTrim(const std::string& input) {
-  std::string s = input;
-  s.erase(s.begin(), std::find_if(s.begin(), s.end(),
-                                  [](char ch) { return !std::isspace(ch); }));
-  s.erase(std::find_if(s.rbegin(), s.rend(),
-                       [](char ch) { return !std::isspace(ch); })
-              .base(),
-          s.end());
-  return s;
+
+bool IsSpace(char c) {
+  return std::isspace(static_cast<unsigned char>(c));
+}
+
+bool IsDigit(char c) {
+  return std::isdigit(static_cast<unsigned char>(c));
 }
-}  // namespace
 
-SystraceLineTokenizer::SystraceLineTokenizer()
-    : line_matcher_(std::regex(R"(-(\d+)\s+\(?\s*(\d+|-+)?\)?\s?\[(\d+)\]\s*)"
-                               R"([a-zA-Z0-9.]{0,5}\s+(\d+\.\d+):\s+(\S+):)")) {
+base::StringView Trim(base::StringView str) {
+  size_t start = 0;
+  size_t end = str.size();
+  while (start < end && IsSpace(str.at(start)))
+    start++;
+  while (end > start && IsSpace(str.at(end - 1)))
+    end--;
+  return str.substr(start, end - start);
 }
 
+// Parses the fields of a systrace line which follow the task name i.e.
+// starting at the '-' before the pid. Returns false if |line| does not match
+// the expected format at |pos|.
+//
+// This follows the regex
+//   -(\d+)\s+\(?\s*(\d+|-+)?\)?\s?\[(\d+)\]\s*[a-zA-Z0-9.]{0,5}\s+
+//   (\d+\.\d+):\s+(\S+):
+// with the task being everything before the match and the args everything
+// after it.
+class LineMatcher {
+ public:
+  LineMatcher(base::StringView line, size_t pos) : line_(line), pos_(pos) {}
+
+  bool Match(SystraceLine* out,
+             base::StringView* pid,
+             base::StringView* cpu,
+             base::StringView* ts,
+             size_t* args_start) {
+    if (!Consume('-'))
+      return false;
+    *pid = ConsumeWhile(IsDigit);
+    if (pid->empty() || ConsumeWhile(IsSpace).empty())
+      return false;
+
+    // The tgid is optional and can be "(-----)" if unknown.
+    Consume('(');
+    ConsumeWhile(IsSpace);
+    base::StringView tgid = ConsumeWhile(IsDigit);
+    if (tgid.empty())
+      tgid = ConsumeWhile([](char c) { return c == '-'; });
+    Consume(')');
+    if (pos_ < line_.size() && IsSpace(line_.at(pos_)))
+      pos_++;
+
+    if (!Consume('['))
+      return false;
+    *cpu = ConsumeWhile(IsDigit);
+    if (cpu->empty() || !Consume(']'))
+      return false;
+    ConsumeWhile(IsSpace);
+
+    // The irq flags (e.g. "d..2") are optional: tell them apart from the
+    // timestamp by the colon which follows the latter.
+    size_t token_start = pos_;
+    base::StringView token = ConsumeWhile([](char c) { return !IsSpace(c); });
+    if (token.empty() || token.at(token.size() - 1) != ':') {
+      if (token.size() > 5 || ConsumeWhile(IsSpace).empty())
+        return false;
+      for (size_t i = 0; i < token.size(); ++i) {
+        char c = token.at(i);
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.')
+          return false;
+      }
+    } else {
+      pos_ = token_start;
+    }
+
+    // The timestamp is in seconds with a fractional part.
+    size_t ts_start = pos_;
+    if (ConsumeWhile(IsDigit).empty() || !Consume('.') ||
+        ConsumeWhile(IsDigit).empty()) {
+      return false;
+    }
+    *ts = line_.substr(ts_start, pos_ - ts_start);
+    if (!Consume(':') || ConsumeWhile(IsSpace).empty())
+      return false;
+
+    // The event name runs up to the last colon before the next whitespace.
+    size_t name_start = pos_;
+    base::StringView name = ConsumeWhile([](char c) { return !IsSpace(c); });
+    size_t colon = name.rfind(':');
+    if (colon == base::StringView::npos || colon == 0)
+      return false;
+    out->tgid_str = tgid.ToStdString();
+    out->event_name = name.substr(0, colon).ToStdString();
+    *args_start = name_start + colon + 1;
+    return true;
+  }
+
+ private:
+  bool Consume(char c) {
+    if (pos_ >= line_.size() || line_.at(pos_) != c)
+      return false;
+    pos_++;
+    return true;
+  }
+
+  template <typename Predicate>
+  base::StringView ConsumeWhile(Predicate predicate) {
+    size_t start = pos_;
+    while (pos_ < line_.size() && predicate(line_.at(pos_)))
+      pos_++;
+    return line_.substr(start, pos_ - start);
+  }
+
+  base::StringView line_;
+  size_t pos_;
+};
+
+}  // namespace
+
+SystraceLineTokenizer::SystraceLineTokenizer() = default;
+
 // TODO(hjd): This should be more robust to being passed random input.
 // This can happen if we mess up detecting a gzip trace for example.
 util::Status SystraceLineTokenizer::Tokenize(const std::string& buffer,
@@ -58,39 +164,44 @@ util::Status SystraceLineTokenizer::Tokenize(const std::string& buffer,
   // Also the irq fields can be missing (we don't parse these anyway)
   // <idle>-0     [000]  0.002188: task_newtask: pid=1 ...
   //
-  // The task name can contain any characters e.g -:[(/ and for this reason
-  // it is much easier to use a regex (even though it is slower than parsing
-  // manually)
-
-  std::smatch matches;
-  bool matched = std::regex_search(buffer, matches, line_matcher_);
-  if (!matched) {
+  // The task name can contain any characters e.g -:[(/ so try matching the
+  // rest of the line after every '-' until one succeeds. This is much faster
+  // than a std::regex as this runs for every line of the trace.
+  base::StringView view(buffer);
+  base::StringView pid_str;
+  base::StringView cpu_str;
+  base::StringView ts_str;
+  size_t args_start = 0;
+  size_t task_end = view.find('-');
+  for (; task_end != base::StringView::npos;
+       task_end = view.find('-', task_end + 1)) {
+    LineMatcher matcher(view, task_end);
+    if (matcher.Match(line, &pid_str, &cpu_str, &ts_str, &args_start))
+      break;
+  }
+  if (task_end == base::StringView::npos) {
     return util::ErrStatus("Not a known systrace event format (line: %s)",
                            buffer.c_str());
   }
 
-  std::string pid_str = matches[1].str();
-  std::string cpu_str = matches[3].str();
-  std::string ts_str = matches[4].str();
-
-  line->task = SubstrTrim(matches.prefix());
-  line->tgid_str = matches[2].str();
-  line->event_name = matches[5].str();
-  line->args_str = SubstrTrim(matches.suffix());
+  line->task = Trim(view.substr(0, task_end)).ToStdString();
+  line->args_str = Trim(view.substr(args_start)).ToStdString();
 
-  base::Optional<uint32_t> maybe_pid = base::StringToUInt32(pid_str);
+  base::Optional<uint32_t> maybe_pid =
+      base::StringToUInt32(pid_str.ToStdString());
   if (!maybe_pid.has_value()) {
-    return util::Status("Could not convert pid " + pid_str);
+    return util::Status("Could not convert pid " + pid_str.ToStdString());
   }
   line->pid = maybe_pid.value();
 
-  base::Optional<uint32_t> maybe_cpu = base::StringToUInt32(cpu_str);
+  base::Optional<uint32_t> maybe_cpu =
+      base::StringToUInt32(cpu_str.ToStdString());
   if (!maybe_cpu.has_value()) {
-    return util::Status("Could not convert cpu " + cpu_str);
+    return util::Status("Could not convert cpu " + cpu_str.ToStdString());
   }
   line->cpu = maybe_cpu.value();
 
-  base::Optional<double> maybe_ts = base::StringToDouble(ts_str);
+  base::Optional<double> maybe_ts = base::StringToDouble(ts_str.ToStdString());
   if (!maybe_ts.has_value()) {
     return util::Status("Could not convert ts");
   }
@@ -17,7 +17,7 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_TOKENIZER_H_
 
-#include <regex>
+#include <string>
 
 #include "perfetto/trace_processor/status.h"
 
@@ -31,9 +31,6 @@ class SystraceLineTokenizer {
   SystraceLineTokenizer();
 
   util::Status Tokenize(const std::string& line, SystraceLine*);
-
- private:
-  const std::regex line_matcher_;
 };
 
 }  // namespace trace_processor
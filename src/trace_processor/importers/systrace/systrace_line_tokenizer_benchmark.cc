@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
+
+namespace {
+
+using perfetto::trace_processor::SystraceLine;
+using perfetto::trace_processor::SystraceLineTokenizer;
+
+// A mix of the most common lines in text systrace files.
+std::vector<std::string> CreateLines() {
+  return {
+      "<idle>-0     (-----) [001] d..2  1234.567890: sched_switch: "
+      "prev_comm=swapper/1 prev_pid=0 prev_prio=120 prev_state=R ==> "
+      "next_comm=RenderThread next_pid=1234 next_prio=110",
+      "RenderThread-1234  ( 1200) [001] ...1  1234.567900: "
+      "tracing_mark_write: B|1200|DrawFrame",
+      "kworker/u16:1-77    (   77) [004] d.h3  1234.568000: sched_waking: "
+      "comm=surfaceflinger pid=600 prio=98 target_cpu=004",
+      "<idle>-0     [000] d..2  1234.568100: cpu_frequency: state=1804800 "
+      "cpu_id=0",
+      "Binder:600_2-650   ( 600) [002] ...1  1234.568200: "
+      "tracing_mark_write: E|600",
+  };
+}
+
+void BM_SystraceLineTokenizer(benchmark::State& state) {
+  std::vector<std::string> lines = CreateLines();
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    for (const std::string& raw_line : lines) {
+      PERFETTO_CHECK(tokenizer.Tokenize(raw_line, &line).ok());
+      benchmark::DoNotOptimize(line.ts);
+      bytes += raw_line.size();
+    }
+  }
+  state.counters["lines/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * lines.size()),
+      benchmark::Counter::kIsRate);
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+}  // namespace
+
+BENCHMARK(BM_SystraceLineTokenizer);
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(SystraceLineTokenizerTest, WithTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("kworker/u16:1-77    (   77) [004] ....   "
+                            "316.196720: 0: B|77|__scm_call_armv8_64|0",
+                            &line)
+                  .ok());
+  ASSERT_EQ(line.task, "kworker/u16:1");
+  ASSERT_EQ(line.pid, 77u);
+  ASSERT_EQ(line.tgid_str, "77");
+  ASSERT_EQ(line.cpu, 4u);
+  ASSERT_EQ(line.ts, 316196720000);
+  ASSERT_EQ(line.event_name, "0");
+  ASSERT_EQ(line.args_str, "B|77|__scm_call_armv8_64|0");
+}
+
+TEST(SystraceLineTokenizerTest, UnknownTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("<...>-1234  (-----) [001] d..3  1.500000: "
+                            "sched_switch: prev_comm=a prev_pid=1",
+                            &line)
+                  .ok());
+  ASSERT_EQ(line.task, "<...>");
+  ASSERT_EQ(line.pid, 1234u);
+  ASSERT_EQ(line.tgid_str, "-----");
+  ASSERT_EQ(line.cpu, 1u);
+  ASSERT_EQ(line.ts, 1500000000);
+  ASSERT_EQ(line.event_name, "sched_switch");
+  ASSERT_EQ(line.args_str, "prev_comm=a prev_pid=1");
+}
+
+TEST(SystraceLineTokenizerTest, NoTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("<idle>-0     [000] ...2     0.002188: "
+                            "task_newtask: pid=1 comm=swapper/0",
+                            &line)
+                  .ok());
+  ASSERT_EQ(line.task, "<idle>");
+  ASSERT_EQ(line.pid, 0u);
+  ASSERT_EQ(line.tgid_str, "");
+  ASSERT_EQ(line.cpu, 0u);
+  ASSERT_EQ(line.ts, 2188000);
+  ASSERT_EQ(line.event_name, "task_newtask");
+  ASSERT_EQ(line.args_str, "pid=1 comm=swapper/0");
+}
+
+TEST(SystraceLineTokenizerTest, NoIrqFlags) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(
+      tokenizer.Tokenize("<idle>-0     [000]  0.002188: task_newtask: pid=1",
+                         &line)
+          .ok());
+  ASSERT_EQ(line.task, "<idle>");
+  ASSERT_EQ(line.cpu, 0u);
+  ASSERT_EQ(line.ts, 2188000);
+  ASSERT_EQ(line.event_name, "task_newtask");
+  ASSERT_EQ(line.args_str, "pid=1");
+}
+
+TEST(SystraceLineTokenizerTest, TaskWithDashesAndBrackets) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("Binder:5-3 [0]-42 (   40) [002] .... 12.5: "
+                            "sched_wakeup: comm=foo pid=7",
+                            &line)
+                  .ok());
+  ASSERT_EQ(line.task, "Binder:5-3 [0]");
+  ASSERT_EQ(line.pid, 42u);
+  ASSERT_EQ(line.tgid_str, "40");
+  ASSERT_EQ(line.cpu, 2u);
+  ASSERT_EQ(line.ts, 12500000000);
+  ASSERT_EQ(line.event_name, "sched_wakeup");
+}
+
+TEST(SystraceLineTokenizerTest, NotSystrace) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_FALSE(tokenizer.Tokenize("this is not - a systrace line", &line).ok());
+  ASSERT_FALSE(tokenizer.Tokenize("task-1 [000] ....: foo: bar", &line).ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -26,12 +26,14 @@ namespace trace_processor {
 
 IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
                            sqlite3* db,
+                           std::string sql,
                            ScopedStmt stmt,
                            uint32_t column_count,
                            util::Status status,
                            uint32_t sql_stats_row)
     : trace_processor_(trace_processor),
       db_(db),
+      sql_(std::move(sql)),
       stmt_(std::move(stmt)),
       column_count_(column_count),
       status_(status),
@@ -40,17 +42,64 @@ IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
 IteratorImpl::~IteratorImpl() {
   if (trace_processor_) {
     base::TimeNanos t_end = base::GetWallTimeNs();
-    auto* sql_stats =
-        trace_processor_.get()->context_.storage->mutable_sql_stats();
-    sql_stats->RecordQueryEnd(sql_stats_row_, t_end.count());
+    trace_processor_.get()->sql_stats_->RecordQueryEnd(sql_stats_row_,
+                                                       t_end.count());
+
+    if (stmt_) {
+      trace_processor_.get()->statement_cache_->Put(sql_, std::move(stmt_));
+    }
+  }
+}
+
+util::Status IteratorImpl::Bind(uint32_t index, const SqlValue& value) {
+  if (!status_.ok())
+    return status_;
+  if (called_next_)
+    return util::ErrStatus("Cannot bind parameters after calling Next()");
+
+  auto idx = static_cast<int>(index);
+  int ret = SQLITE_OK;
+  switch (value.type) {
+    case SqlValue::kNull:
+      ret = sqlite3_bind_null(*stmt_, idx);
+      break;
+    case SqlValue::kLong:
+      ret = sqlite3_bind_int64(*stmt_, idx, value.long_value);
+      break;
+    case SqlValue::kDouble:
+      ret = sqlite3_bind_double(*stmt_, idx, value.double_value);
+      break;
+    case SqlValue::kString:
+      ret = sqlite3_bind_text(*stmt_, idx, value.string_value, -1,
+                              SQLITE_TRANSIENT);
+      break;
+    case SqlValue::kBytes:
+      ret = sqlite3_bind_blob(*stmt_, idx, value.bytes_value,
+                              static_cast<int>(value.bytes_count),
+                              SQLITE_TRANSIENT);
+      break;
   }
+  if (ret != SQLITE_OK) {
+    return util::ErrStatus("Failed to bind parameter %u: %s", index,
+                           sqlite3_errmsg(db_));
+  }
+  return util::OkStatus();
+}
+
+util::Status IteratorImpl::GetStepError() {
+  // Queries stopped by the QueryBudget fail with SQLite's generic
+  // "interrupted" error: report why they were stopped instead.
+  util::Status budget_status =
+      trace_processor_.get()->query_budget_->status();
+  if (!budget_status.ok())
+    return budget_status;
+  return util::ErrStatus("%s", sqlite3_errmsg(db_));
 }
 
 void IteratorImpl::RecordFirstNextInSqlStats() {
   base::TimeNanos t_first_next = base::GetWallTimeNs();
-  auto* sql_stats =
-      trace_processor_.get()->context_.storage->mutable_sql_stats();
-  sql_stats->RecordQueryFirstNext(sql_stats_row_, t_first_next.count());
+  trace_processor_.get()->sql_stats_->RecordQueryFirstNext(
+      sql_stats_row_, t_first_next.count());
 }
 
 Iterator::Iterator(std::unique_ptr<IteratorImpl> iterator)
@@ -80,5 +129,9 @@ util::Status Iterator::Status() {
   return iterator_->Status();
 }
 
+util::Status Iterator::Bind(uint32_t index, const SqlValue& value) {
+  return iterator_->Bind(index, value);
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -20,6 +20,7 @@
 #include <sqlite3.h>
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "perfetto/base/build_config.h"
@@ -38,6 +39,7 @@ class IteratorImpl {
  public:
   IteratorImpl(TraceProcessorImpl* impl,
                sqlite3* db,
+               std::string sql,
                ScopedStmt,
                uint32_t column_count,
                util::Status,
@@ -63,7 +65,7 @@ class IteratorImpl {
 
     int ret = sqlite3_step(*stmt_);
     if (PERFETTO_UNLIKELY(ret != SQLITE_ROW && ret != SQLITE_DONE)) {
-      status_ = util::ErrStatus("%s", sqlite3_errmsg(db_));
+      status_ = GetStepError();
       return false;
     }
     return ret == SQLITE_ROW;
@@ -108,6 +110,8 @@ class IteratorImpl {
 
   util::Status Status() { return status_; }
 
+  util::Status Bind(uint32_t index, const SqlValue& value);
+
  private:
   // Dummy function to pass to ScopedResource.
   static int DummyClose(TraceProcessorImpl*) { return 0; }
@@ -123,8 +127,15 @@ class IteratorImpl {
 
   void RecordFirstNextInSqlStats();
 
+  // Returns the error of a failed sqlite3_step().
+  util::Status GetStepError();
+
   ScopedTraceProcessor trace_processor_;
   sqlite3* db_ = nullptr;
+
+  // The SQL of the query; used to return |stmt_| to the statement cache of
+  // the TraceProcessor when this iterator is destroyed.
+  std::string sql_;
   ScopedStmt stmt_;
   uint32_t column_count_ = 0;
   util::Status status_;
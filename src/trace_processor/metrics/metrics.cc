@@ -16,10 +16,17 @@
 
 #include "src/trace_processor/metrics/metrics.h"
 
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <regex>
+#include <set>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -72,7 +79,16 @@ SqlValue SqlValueFromSqliteValue(sqlite3_value* value) {
 }  // namespace
 
 ProtoBuilder::ProtoBuilder(const ProtoDescriptor* descriptor)
-    : descriptor_(descriptor) {}
+    : descriptor_(descriptor) {
+  const auto& type_name = descriptor_->full_name();
+
+  result_->set_is_repeated(false);
+  auto* single = result_->set_single();
+  single->set_type(protos::pbzero::FieldDescriptorProto_Type_TYPE_MESSAGE);
+  single->set_type_name(type_name.c_str(), type_name.size());
+  message_ = single->BeginNestedMessage<protozero::Message>(
+      protos::pbzero::SingleBuilderResult::kProtobufFieldNumber);
+}
 
 util::Status ProtoBuilder::AppendSqlValue(const std::string& field_name,
                                           const SqlValue& value) {
@@ -95,76 +111,102 @@ util::Status ProtoBuilder::AppendSqlValue(const std::string& field_name,
   PERFETTO_FATAL("For GCC");
 }
 
-util::Status ProtoBuilder::AppendLong(const std::string& field_name,
-                                      int64_t value,
-                                      bool is_inside_repeated) {
-  auto field = descriptor_->FindFieldByName(field_name);
+const FieldDescriptor* ProtoBuilder::FindField(const std::string& field_name,
+                                               util::Status* status) const {
+  const FieldDescriptor* field = descriptor_->FindFieldByName(field_name);
   if (!field) {
-    return util::ErrStatus("Field with name %s not found in proto type %s",
-                           field_name.c_str(),
-                           descriptor_->full_name().c_str());
+    *status = util::ErrStatus("Field with name %s not found in proto type %s",
+                              field_name.c_str(),
+                              descriptor_->full_name().c_str());
   }
+  return field;
+}
+
+util::Status ProtoBuilder::AppendLong(const std::string& field_name,
+                                      int64_t value) {
+  util::Status status;
+  const FieldDescriptor* field = FindField(field_name, &status);
+  return field ? AppendLong(*field, value, false) : status;
+}
+
+util::Status ProtoBuilder::AppendDouble(const std::string& field_name,
+                                        double value) {
+  util::Status status;
+  const FieldDescriptor* field = FindField(field_name, &status);
+  return field ? AppendDouble(*field, value, false) : status;
+}
+
+util::Status ProtoBuilder::AppendString(const std::string& field_name,
+                                        base::StringView value) {
+  util::Status status;
+  const FieldDescriptor* field = FindField(field_name, &status);
+  return field ? AppendString(*field, value, false) : status;
+}
+
+util::Status ProtoBuilder::AppendBytes(const std::string& field_name,
+                                       const uint8_t* data,
+                                       size_t size) {
+  util::Status status;
+  const FieldDescriptor* field = FindField(field_name, &status);
+  return field ? AppendBytes(*field, data, size, false) : status;
+}
 
+util::Status ProtoBuilder::AppendLong(const FieldDescriptor& field,
+                                      int64_t value,
+                                      bool is_inside_repeated) {
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
-  if (field->is_repeated() && !is_inside_repeated) {
+  if (field.is_repeated() && !is_inside_repeated) {
     return util::ErrStatus(
         "Unexpected long value for repeated field %s in proto type %s",
-        field_name.c_str(), descriptor_->full_name().c_str());
+        field.name().c_str(), descriptor_->full_name().c_str());
   }
 
-  switch (field->type()) {
+  switch (field.type()) {
     case FieldDescriptorProto::TYPE_INT32:
     case FieldDescriptorProto::TYPE_INT64:
     case FieldDescriptorProto::TYPE_UINT32:
     case FieldDescriptorProto::TYPE_BOOL:
     case FieldDescriptorProto::TYPE_ENUM:
-      message_->AppendVarInt(field->number(), value);
+      message_->AppendVarInt(field.number(), value);
       break;
     case FieldDescriptorProto::TYPE_SINT32:
     case FieldDescriptorProto::TYPE_SINT64:
-      message_->AppendSignedVarInt(field->number(), value);
+      message_->AppendSignedVarInt(field.number(), value);
       break;
     case FieldDescriptorProto::TYPE_FIXED32:
     case FieldDescriptorProto::TYPE_SFIXED32:
     case FieldDescriptorProto::TYPE_FIXED64:
     case FieldDescriptorProto::TYPE_SFIXED64:
-      message_->AppendFixed(field->number(), value);
+      message_->AppendFixed(field.number(), value);
       break;
     default: {
       return util::ErrStatus(
           "Tried to write value of type long into field %s (in proto type %s) "
           "which has type %d",
-          field->name().c_str(), descriptor_->full_name().c_str(),
-          field->type());
+          field.name().c_str(), descriptor_->full_name().c_str(),
+          field.type());
     }
   }
   return util::OkStatus();
 }
 
-util::Status ProtoBuilder::AppendDouble(const std::string& field_name,
+util::Status ProtoBuilder::AppendDouble(const FieldDescriptor& field,
                                         double value,
                                         bool is_inside_repeated) {
-  auto field = descriptor_->FindFieldByName(field_name);
-  if (!field) {
-    return util::ErrStatus("Field with name %s not found in proto type %s",
-                           field_name.c_str(),
-                           descriptor_->full_name().c_str());
-  }
-
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
-  if (field->is_repeated() && !is_inside_repeated) {
+  if (field.is_repeated() && !is_inside_repeated) {
     return util::ErrStatus(
         "Unexpected double value for repeated field %s in proto type %s",
-        field_name.c_str(), descriptor_->full_name().c_str());
+        field.name().c_str(), descriptor_->full_name().c_str());
   }
 
-  switch (field->type()) {
+  switch (field.type()) {
     case FieldDescriptorProto::TYPE_FLOAT:
     case FieldDescriptorProto::TYPE_DOUBLE: {
-      if (field->type() == FieldDescriptorProto::TYPE_FLOAT) {
-        message_->AppendFixed(field->number(), static_cast<float>(value));
+      if (field.type() == FieldDescriptorProto::TYPE_FLOAT) {
+        message_->AppendFixed(field.number(), static_cast<float>(value));
       } else {
-        message_->AppendFixed(field->number(), value);
+        message_->AppendFixed(field.number(), value);
       }
       break;
     }
@@ -172,63 +214,49 @@ util::Status ProtoBuilder::AppendDouble(const std::string& field_name,
       return util::ErrStatus(
           "Tried to write value of type double into field %s (in proto type "
           "%s) which has type %d",
-          field->name().c_str(), descriptor_->full_name().c_str(),
-          field->type());
+          field.name().c_str(), descriptor_->full_name().c_str(),
+          field.type());
     }
   }
   return util::OkStatus();
 }
 
-util::Status ProtoBuilder::AppendString(const std::string& field_name,
+util::Status ProtoBuilder::AppendString(const FieldDescriptor& field,
                                         base::StringView data,
                                         bool is_inside_repeated) {
-  const FieldDescriptor* field = descriptor_->FindFieldByName(field_name);
-  if (!field) {
-    return util::ErrStatus("Field with name %s not found in proto type %s",
-                           field_name.c_str(),
-                           descriptor_->full_name().c_str());
-  }
-
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
-  if (field->is_repeated() && !is_inside_repeated) {
+  if (field.is_repeated() && !is_inside_repeated) {
     return util::ErrStatus(
         "Unexpected string value for repeated field %s in proto type %s",
-        field_name.c_str(), descriptor_->full_name().c_str());
+        field.name().c_str(), descriptor_->full_name().c_str());
   }
 
-  switch (field->type()) {
+  switch (field.type()) {
     case FieldDescriptorProto::TYPE_STRING: {
-      message_->AppendBytes(field->number(), data.data(), data.size());
+      message_->AppendBytes(field.number(), data.data(), data.size());
       break;
     }
     default: {
       return util::ErrStatus(
           "Tried to write value of type string into field %s (in proto type "
           "%s) which has type %d",
-          field->name().c_str(), descriptor_->full_name().c_str(),
-          field->type());
+          field.name().c_str(), descriptor_->full_name().c_str(),
+          field.type());
     }
   }
   return util::OkStatus();
 }
 
-util::Status ProtoBuilder::AppendBytes(const std::string& field_name,
+util::Status ProtoBuilder::AppendBytes(const FieldDescriptor& field,
                                        const uint8_t* ptr,
                                        size_t size,
                                        bool is_inside_repeated) {
-  const FieldDescriptor* field = descriptor_->FindFieldByName(field_name);
-  if (!field) {
-    return util::ErrStatus("Field with name %s not found in proto type %s",
-                           field_name.c_str(),
-                           descriptor_->full_name().c_str());
-  }
-
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
-  if (field->is_repeated() && !is_inside_repeated)
-    return AppendRepeated(*field, ptr, size);
+  if (field.is_repeated() && !is_inside_repeated)
+    return AppendRepeated(field, ptr, size);
 
-  if (field->type() == FieldDescriptorProto::TYPE_MESSAGE)
-    return AppendSingleMessage(*field, ptr, size);
+  if (field.type() == FieldDescriptorProto::TYPE_MESSAGE)
+    return AppendSingleMessage(field, ptr, size);
 
   if (size == 0) {
     return util::ErrStatus(
@@ -236,13 +264,13 @@ util::Status ProtoBuilder::AppendBytes(const std::string& field_name,
         "%s). Nulls are only supported for message protos; all other types "
         "should ensure that nulls are not passed to proto builder functions by "
         "using the SQLite IFNULL/COALESCE functions.",
-        field->name().c_str(), descriptor_->full_name().c_str());
+        field.name().c_str(), descriptor_->full_name().c_str());
   }
 
   return util::ErrStatus(
       "Tried to write value of type bytes into field %s (in proto type %s) "
       "which has type %d",
-      field->name().c_str(), descriptor_->full_name().c_str(), field->type());
+      field.name().c_str(), descriptor_->full_name().c_str(), field.type());
 }
 
 util::Status ProtoBuilder::AppendSingleMessage(const FieldDescriptor& field,
@@ -273,10 +301,11 @@ util::Status ProtoBuilder::AppendSingleMessage(const FieldDescriptor& field,
                            field.name().c_str(), field.type(), single.type());
   }
 
-  auto actual_type_name = single.type_name().ToStdString();
-  if (actual_type_name != field.resolved_type_name()) {
+  base::StringView actual_type_name(single.type_name());
+  if (actual_type_name != base::StringView(field.resolved_type_name())) {
     return util::ErrStatus("Field %s has wrong type (expected %s, was %s)",
-                           field.name().c_str(), actual_type_name.c_str(),
+                           field.name().c_str(),
+                           actual_type_name.ToStdString().c_str(),
                            field.resolved_type_name().c_str());
   }
 
@@ -313,15 +342,15 @@ util::Status ProtoBuilder::AppendRepeated(const FieldDescriptor& field,
     protos::pbzero::RepeatedBuilderResult::Value::Decoder value(*it);
     util::Status status;
     if (value.has_int_value()) {
-      status = AppendLong(field.name(), value.int_value(), true);
+      status = AppendLong(field, value.int_value(), true);
     } else if (value.has_double_value()) {
-      status = AppendDouble(field.name(), value.double_value(), true);
+      status = AppendDouble(field, value.double_value(), true);
     } else if (value.has_string_value()) {
-      status = AppendString(field.name(),
-                            base::StringView(value.string_value()), true);
+      status =
+          AppendString(field, base::StringView(value.string_value()), true);
     } else if (value.has_bytes_value()) {
       const auto& bytes = value.bytes_value();
-      status = AppendBytes(field.name(), bytes.data, bytes.size, true);
+      status = AppendBytes(field, bytes.data, bytes.size, true);
     } else {
       status = util::ErrStatus("Unknown type in repeated field");
     }
@@ -333,24 +362,20 @@ util::Status ProtoBuilder::AppendRepeated(const FieldDescriptor& field,
 }
 
 std::vector<uint8_t> ProtoBuilder::SerializeToProtoBuilderResult() {
-  std::vector<uint8_t> serialized = SerializeRaw();
-  if (serialized.empty())
-    return serialized;
-
-  const auto& type_name = descriptor_->full_name();
-
-  protozero::HeapBuffered<protos::pbzero::ProtoBuilderResult> result;
-  result->set_is_repeated(false);
-
-  auto* single = result->set_single();
-  single->set_type(protos::pbzero::FieldDescriptorProto_Type_TYPE_MESSAGE);
-  single->set_type_name(type_name.c_str(), type_name.size());
-  single->set_protobuf(serialized.data(), serialized.size());
-  return result.SerializeAsArray();
+  if (message_->Finalize() == 0)
+    return std::vector<uint8_t>();
+  return result_.SerializeAsArray();
 }
 
 std::vector<uint8_t> ProtoBuilder::SerializeRaw() {
-  return message_.SerializeAsArray();
+  uint32_t size = message_->Finalize();
+  std::vector<uint8_t> serialized = result_.SerializeAsArray();
+
+  // |message_| is the last field written to |result_| so its bytes are at the
+  // end of the serialized result.
+  serialized.erase(serialized.begin(),
+                   serialized.end() - static_cast<ptrdiff_t>(size));
+  return serialized;
 }
 
 RepeatedFieldBuilder::RepeatedFieldBuilder() {
@@ -585,10 +610,27 @@ void RunMetric(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
     substitutions[key_str] = value_str;
   }
 
+  // Files shared by several metrics only need to run once as long as nothing
+  // they depend on has changed since.
+  RunMetricCache* cache = fn_ctx->cache;
+  std::string cache_key = path;
+  for (const auto& sub : std::map<std::string, std::string>(
+           substitutions.begin(), substitutions.end())) {
+    cache_key += '\0' + sub.first + '\0' + sub.second;
+  }
+  if (cache->IsCached(cache_key)) {
+    PERFETTO_DLOG("RUN_METRIC: Skipping already run file %s", path);
+    cache->OnRunSkipped(cache_key);
+    sqlite3_result_null(ctx);
+    return;
+  }
+  cache->OnRunBegin(cache_key);
+
   for (const auto& query : base::SplitString(sql, ";\n")) {
     std::string buffer;
     int ret = TemplateReplace(query, substitutions, &buffer);
     if (ret) {
+      cache->OnRunAbort();
       char* error = sqlite3_mprintf(
           "RUN_METRIC: Error when performing substitutions: %s", query.c_str());
       sqlite3_result_error(ctx, error, -1);
@@ -601,6 +643,7 @@ void RunMetric(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
 
     util::Status status = it.Status();
     if (!status.ok()) {
+      cache->OnRunAbort();
       char* error =
           sqlite3_mprintf("RUN_METRIC: Error when running file %s: %s", path,
                           status.c_message());
@@ -608,73 +651,253 @@ void RunMetric(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
       sqlite3_free(error);
       return;
     }
+    cache->OnStatement(buffer);
   }
+  cache->OnRunEnd();
   sqlite3_result_null(ctx);
 }
 
+namespace {
+
+// Only caches the files run by RUN_METRIC while computing a set of metrics:
+// after that, arbitrary queries could modify the tables they depend on
+// without the cache knowing about it.
+struct ScopedCache {
+  explicit ScopedCache(RunMetricCache* c) : cache(c) { cache->Begin(); }
+  ~ScopedCache() { cache->End(); }
+  RunMetricCache* cache;
+};
+
+const SqlMetricFile* FindMetric(const std::vector<SqlMetricFile>& sql_metrics,
+                                const std::string& name) {
+  auto metric_it =
+      std::find_if(sql_metrics.begin(), sql_metrics.end(),
+                   [&name](const SqlMetricFile& metric) {
+                     return metric.proto_field_name.has_value() &&
+                            name == metric.proto_field_name.value();
+                   });
+  return metric_it == sql_metrics.end() ? nullptr : &*metric_it;
+}
+
+// Runs the statements of |sql_metric| and reads the proto bytes from its
+// output table into |output|, which is left empty if the table has no rows.
+util::Status ComputeMetricOutput(TraceProcessor* tp,
+                                 const SqlMetricFile& sql_metric,
+                                 RunMetricCache* cache,
+                                 std::vector<uint8_t>* output) {
+  auto queries = base::SplitString(sql_metric.sql, ";\n");
+  for (const auto& query : queries) {
+    PERFETTO_DLOG("Executing query: %s", query.c_str());
+    auto prep_it = tp->ExecuteQuery(query);
+    prep_it.Next();
+    RETURN_IF_ERROR(prep_it.Status());
+    cache->OnStatement(query);
+  }
+
+  auto output_query =
+      "SELECT * FROM " + sql_metric.output_table_name.value() + ";";
+  PERFETTO_DLOG("Executing output query: %s", output_query.c_str());
+  PERFETTO_TP_TRACE("COMPUTE_METRIC_QUERY", [&](metatrace::Record* r) {
+    r->AddArg("SQL", output_query);
+  });
+
+  auto it = tp->ExecuteQuery(output_query.c_str());
+  auto has_next = it.Next();
+  RETURN_IF_ERROR(it.Status());
+
+  // Allow the query to return no rows. This has the same semantic as an
+  // empty proto being returned.
+  output->clear();
+  if (!has_next)
+    return util::OkStatus();
+
+  if (it.ColumnCount() != 1) {
+    return util::ErrStatus("Output table %s should have exactly one column",
+                           sql_metric.output_table_name.value().c_str());
+  }
+
+  SqlValue col = it.Get(0);
+  if (col.type != SqlValue::kBytes) {
+    return util::ErrStatus("Output table %s column has invalid type",
+                           sql_metric.output_table_name.value().c_str());
+  }
+  const uint8_t* bytes = static_cast<const uint8_t*>(col.bytes_value);
+  output->assign(bytes, bytes + col.bytes_count);
+
+  has_next = it.Next();
+  if (has_next) {
+    return util::ErrStatus("Output table %s should have at most one row",
+                           sql_metric.output_table_name.value().c_str());
+  }
+  return it.Status();
+}
+
+}  // namespace
+
 util::Status ComputeMetrics(TraceProcessor* tp,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& sql_metrics,
+                            RunMetricCache* cache,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto) {
+  ScopedCache scoped_cache(cache);
+
   ProtoBuilder metric_builder(&root_descriptor);
+  std::vector<uint8_t> output;
   for (const auto& name : metrics_to_compute) {
-    auto metric_it =
-        std::find_if(sql_metrics.begin(), sql_metrics.end(),
-                     [&name](const SqlMetricFile& metric) {
-                       return metric.proto_field_name.has_value() &&
-                              name == metric.proto_field_name.value();
-                     });
-    if (metric_it == sql_metrics.end())
+    const SqlMetricFile* sql_metric = FindMetric(sql_metrics, name);
+    if (!sql_metric)
       return util::ErrStatus("Unknown metric %s", name.c_str());
 
-    const auto& sql_metric = *metric_it;
-    auto queries = base::SplitString(sql_metric.sql, ";\n");
-    for (const auto& query : queries) {
-      PERFETTO_DLOG("Executing query: %s", query.c_str());
-      auto prep_it = tp->ExecuteQuery(query);
-      prep_it.Next();
-      RETURN_IF_ERROR(prep_it.Status());
-    }
+    RETURN_IF_ERROR(ComputeMetricOutput(tp, *sql_metric, cache, &output));
+    RETURN_IF_ERROR(metric_builder.AppendBytes(
+        sql_metric->proto_field_name.value(), output.data(), output.size()));
+  }
+  *metrics_proto = metric_builder.SerializeRaw();
+  return util::OkStatus();
+}
+
+std::vector<std::string> GetRunMetricPaths(const std::string& sql) {
+  static const std::regex kRunMetricRegex(
+      R"(RUN_METRIC\s*\(\s*['"]([^'"]+)['"])", std::regex_constants::icase);
+  std::vector<std::string> paths;
+  for (std::sregex_iterator it(sql.begin(), sql.end(), kRunMetricRegex), end;
+       it != end; ++it) {
+    paths.emplace_back((*it)[1].str());
+  }
+  return paths;
+}
 
-    auto output_query =
-        "SELECT * FROM " + sql_metric.output_table_name.value() + ";";
-    PERFETTO_DLOG("Executing output query: %s", output_query.c_str());
-    PERFETTO_TP_TRACE("COMPUTE_METRIC_QUERY", [&](metatrace::Record* r) {
-      r->AddArg("SQL", output_query);
-    });
-
-    auto it = tp->ExecuteQuery(output_query.c_str());
-    auto has_next = it.Next();
-    RETURN_IF_ERROR(it.Status());
-
-    // Allow the query to return no rows. This has the same semantic as an
-    // empty proto being returned.
-    const auto& field_name = sql_metric.proto_field_name.value();
-    if (!has_next) {
-      metric_builder.AppendBytes(field_name, nullptr, 0);
+std::vector<std::vector<size_t>> AssignMetricsToWorkers(
+    const std::vector<std::string>& metrics_to_compute,
+    const std::vector<SqlMetricFile>& sql_metrics,
+    uint32_t max_workers) {
+  // Compute the files run by each metric: its own file and all the files it
+  // runs with RUN_METRIC, directly or not.
+  std::vector<std::set<std::string>> files(metrics_to_compute.size());
+  for (size_t i = 0; i < metrics_to_compute.size(); ++i) {
+    const SqlMetricFile* metric =
+        FindMetric(sql_metrics, metrics_to_compute[i]);
+    if (!metric)
       continue;
+    std::vector<const SqlMetricFile*> stack{metric};
+    files[i].insert(metric->path);
+    while (!stack.empty()) {
+      const SqlMetricFile* file = stack.back();
+      stack.pop_back();
+      for (const std::string& path : GetRunMetricPaths(file->sql)) {
+        auto file_it = std::find_if(
+            sql_metrics.begin(), sql_metrics.end(),
+            [&path](const SqlMetricFile& m) { return m.path == path; });
+        if (file_it != sql_metrics.end() && files[i].insert(path).second)
+          stack.push_back(&*file_it);
+      }
     }
+  }
 
-    if (it.ColumnCount() != 1) {
-      return util::ErrStatus("Output table %s should have exactly one column",
-                             sql_metric.output_table_name.value().c_str());
+  // Greedily give the metrics running the most files first to the worker
+  // which would run the fewest files afterwards, the files it already runs
+  // for other metrics only counting once. On ties, prefer the worker where the
+  // metric adds the fewest files.
+  std::vector<size_t> order(metrics_to_compute.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+    return files[a].size() > files[b].size();
+  });
+
+  size_t num_workers =
+      std::min(static_cast<size_t>(std::max(max_workers, 1u)), order.size());
+  std::vector<std::set<std::string>> worker_files(num_workers);
+  std::vector<std::vector<size_t>> assignment(num_workers);
+  for (size_t metric_idx : order) {
+    size_t best_worker = 0;
+    std::pair<size_t, size_t> best_cost(std::numeric_limits<size_t>::max(),
+                                        0);
+    for (size_t w = 0; w < num_workers; ++w) {
+      size_t new_files = 0;
+      for (const std::string& file : files[metric_idx])
+        new_files += worker_files[w].count(file) ? 0 : 1;
+      std::pair<size_t, size_t> cost(worker_files[w].size() + new_files,
+                                     new_files);
+      if (cost < best_cost) {
+        best_worker = w;
+        best_cost = cost;
+      }
     }
+    worker_files[best_worker].insert(files[metric_idx].begin(),
+                                     files[metric_idx].end());
+    assignment[best_worker].push_back(metric_idx);
+  }
+
+  for (auto& indices : assignment)
+    std::sort(indices.begin(), indices.end());
+  assignment.erase(std::remove_if(assignment.begin(), assignment.end(),
+                                  [](const std::vector<size_t>& indices) {
+                                    return indices.empty();
+                                  }),
+                   assignment.end());
+  return assignment;
+}
 
-    SqlValue col = it.Get(0);
-    if (col.type != SqlValue::kBytes) {
-      return util::ErrStatus("Output table %s column has invalid type",
-                             sql_metric.output_table_name.value().c_str());
-    }
-    RETURN_IF_ERROR(metric_builder.AppendSqlValue(field_name, col));
+util::Status ComputeMetricsInParallel(
+    const std::vector<MetricWorker>& workers,
+    const std::vector<std::vector<size_t>>& assignment,
+    const std::vector<std::string>& metrics_to_compute,
+    const std::vector<SqlMetricFile>& sql_metrics,
+    const ProtoDescriptor& root_descriptor,
+    std::vector<uint8_t>* metrics_proto) {
+  PERFETTO_CHECK(workers.size() == assignment.size());
 
-    has_next = it.Next();
-    if (has_next) {
-      return util::ErrStatus("Output table %s should have at most one row",
-                             sql_metric.output_table_name.value().c_str());
+  struct MetricOutput {
+    util::Status status;
+    std::vector<uint8_t> bytes;
+  };
+  std::vector<MetricOutput> outputs(metrics_to_compute.size());
+
+  // Each worker computes its metrics in order and, like ComputeMetrics, stops
+  // at the first one which fails. Every metric only touches its own slot in
+  // |outputs|.
+  auto compute = [&](size_t w) {
+    ScopedCache scoped_cache(workers[w].cache);
+    for (size_t metric_idx : assignment[w]) {
+      MetricOutput& output = outputs[metric_idx];
+      const std::string& name = metrics_to_compute[metric_idx];
+      const SqlMetricFile* sql_metric = FindMetric(sql_metrics, name);
+      if (!sql_metric) {
+        output.status = util::ErrStatus("Unknown metric %s", name.c_str());
+        return;
+      }
+      output.status = ComputeMetricOutput(workers[w].tp, *sql_metric,
+                                          workers[w].cache, &output.bytes);
+      if (!output.status.ok())
+        return;
     }
-
-    RETURN_IF_ERROR(it.Status());
+  };
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  for (size_t w = 0; w < workers.size(); ++w)
+    compute(w);
+#else
+  std::vector<std::thread> threads;
+  for (size_t w = 1; w < workers.size(); ++w)
+    threads.emplace_back(compute, w);
+  if (!workers.empty())
+    compute(0);
+  for (std::thread& thread : threads)
+    thread.join();
+#endif
+
+  // The metrics a worker did not compute come after one which failed on the
+  // same worker so they are never reached here.
+  ProtoBuilder metric_builder(&root_descriptor);
+  for (size_t i = 0; i < metrics_to_compute.size(); ++i) {
+    RETURN_IF_ERROR(outputs[i].status);
+    const SqlMetricFile* sql_metric =
+        FindMetric(sql_metrics, metrics_to_compute[i]);
+    RETURN_IF_ERROR(
+        metric_builder.AppendBytes(sql_metric->proto_field_name.value(),
+                                   outputs[i].bytes.data(),
+                                   outputs[i].bytes.size()));
   }
   *metrics_proto = metric_builder.SerializeRaw();
   return util::OkStatus();
@@ -27,6 +27,7 @@
 #include "perfetto/protozero/message.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/metrics/run_metric_cache.h"
 #include "src/trace_processor/util/descriptors.h"
 
 #include "protos/perfetto/trace_processor/metrics_impl.pbzero.h"
@@ -58,6 +59,9 @@ struct SqlMetricFile {
 
 // Helper class to build a nested (metric) proto checking the schema against
 // a descriptor.
+// The fields are written directly inside the |protos::ProtoBuilderResult|
+// returned by SerializeToProtoBuilderResult() so that building a message is a
+// single pass over its fields.
 // Visible for testing.
 class ProtoBuilder {
  public:
@@ -66,22 +70,13 @@ class ProtoBuilder {
   util::Status AppendSqlValue(const std::string& field_name,
                               const SqlValue& value);
 
-  // Note: all external callers to these functions should not
-  // |is_inside_repeated| to this function and instead rely on the default
-  // value.
-  util::Status AppendLong(const std::string& field_name,
-                          int64_t value,
-                          bool is_inside_repeated = false);
-  util::Status AppendDouble(const std::string& field_name,
-                            double value,
-                            bool is_inside_repeated = false);
+  util::Status AppendLong(const std::string& field_name, int64_t value);
+  util::Status AppendDouble(const std::string& field_name, double value);
   util::Status AppendString(const std::string& field_name,
-                            base::StringView value,
-                            bool is_inside_repeated = false);
+                            base::StringView value);
   util::Status AppendBytes(const std::string& field_name,
                            const uint8_t* data,
-                           size_t size,
-                           bool is_inside_repeated = false);
+                           size_t size);
 
   // Returns the serialized |protos::ProtoBuilderResult| with the built proto
   // as the nested |protobuf| message.
@@ -98,6 +93,25 @@ class ProtoBuilder {
   std::vector<uint8_t> SerializeRaw();
 
  private:
+  const FieldDescriptor* FindField(const std::string& field_name,
+                                   util::Status* status) const;
+
+  // |is_inside_repeated| is true when appending one of the values of a
+  // repeated field.
+  util::Status AppendLong(const FieldDescriptor& field,
+                          int64_t value,
+                          bool is_inside_repeated);
+  util::Status AppendDouble(const FieldDescriptor& field,
+                            double value,
+                            bool is_inside_repeated);
+  util::Status AppendString(const FieldDescriptor& field,
+                            base::StringView value,
+                            bool is_inside_repeated);
+  util::Status AppendBytes(const FieldDescriptor& field,
+                           const uint8_t* data,
+                           size_t size,
+                           bool is_inside_repeated);
+
   util::Status AppendSingleMessage(const FieldDescriptor& field,
                                    const uint8_t* ptr,
                                    size_t size);
@@ -107,7 +121,10 @@ class ProtoBuilder {
                               size_t size);
 
   const ProtoDescriptor* descriptor_ = nullptr;
-  protozero::HeapBuffered<protozero::Message> message_;
+  protozero::HeapBuffered<protos::pbzero::ProtoBuilderResult> result_;
+
+  // The |protobuf| field of |result_|: the message being built.
+  protozero::Message* message_ = nullptr;
 };
 
 // Helper class to combine a set of repeated fields into a single proto blob
@@ -168,6 +185,7 @@ void BuildProto(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 struct RunMetricContext {
   TraceProcessor* tp;
   std::vector<SqlMetricFile>* metrics;
+  RunMetricCache* cache;
 };
 
 // This function implements the RUN_METRIC SQL function.
@@ -176,9 +194,47 @@ void RunMetric(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 util::Status ComputeMetrics(TraceProcessor* impl,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& metrics,
+                            RunMetricCache* cache,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto);
 
+// Returns the paths of the files run by the RUN_METRIC calls in |sql|, in the
+// order they appear. Calls whose path is not a string literal are ignored.
+std::vector<std::string> GetRunMetricPaths(const std::string& sql);
+
+// Splits |metrics_to_compute| between at most |max_workers| workers, using
+// the files each metric runs with RUN_METRIC (directly or not) as an estimate
+// of its cost. Files shared by several metrics only run once on each worker
+// so metrics sharing files tend to be given to the same worker as long as
+// this keeps the number of files run by each worker balanced.
+// Returns the indices in |metrics_to_compute| of the metrics of each worker,
+// in ascending order. No worker is returned without any metric and the
+// assignment only depends on the arguments.
+std::vector<std::vector<size_t>> AssignMetricsToWorkers(
+    const std::vector<std::string>& metrics_to_compute,
+    const std::vector<SqlMetricFile>& metrics,
+    uint32_t max_workers);
+
+// A TraceProcessor instance used to compute metrics on its own thread and
+// the cache used by RUN_METRIC on it.
+struct MetricWorker {
+  TraceProcessor* tp;
+  RunMetricCache* cache;
+};
+
+// Like ComputeMetrics but |workers[i]| computes the metrics at the indices
+// |assignment[i]| of |metrics_to_compute| on its own thread (the first worker
+// on the calling thread). The outputs are merged in the order of
+// |metrics_to_compute| and, if any metric fails, the error of the first one
+// in that order is returned.
+util::Status ComputeMetricsInParallel(
+    const std::vector<MetricWorker>& workers,
+    const std::vector<std::vector<size_t>>& assignment,
+    const std::vector<std::string>& metrics_to_compute,
+    const std::vector<SqlMetricFile>& metrics,
+    const ProtoDescriptor& root_descriptor,
+    std::vector<uint8_t>* metrics_proto);
+
 }  // namespace metrics
 }  // namespace trace_processor
 }  // namespace perfetto
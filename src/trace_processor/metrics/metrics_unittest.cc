@@ -215,6 +215,140 @@ TEST_F(ProtoBuilderTest, AppendRepeatedPrimitive) {
   ASSERT_FALSE(++it);
 }
 
+TEST_F(ProtoBuilderTest, AppendRepeatedMessage) {
+  using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
+
+  // Create the descriptor version of the following message:
+  // message TestProto {
+  //   message NestedProto {
+  //     optional int64 nested_int_value = 1;
+  //   }
+  //   repeated NestedProto rep_nested_value = 1;
+  // }
+  ProtoDescriptor nested("file.proto", ".perfetto.protos",
+                         ".perfetto.protos.TestProto.NestedProto",
+                         ProtoDescriptor::Type::kMessage, base::nullopt);
+  nested.AddField(FieldDescriptor("nested_int_value", 1,
+                                  FieldDescriptorProto::TYPE_INT64, "", false));
+
+  ProtoDescriptor descriptor("file.proto", ".perfetto.protos",
+                             ".perfetto.protos.TestProto",
+                             ProtoDescriptor::Type::kMessage, base::nullopt);
+  auto field =
+      FieldDescriptor("rep_nested_value", 1, FieldDescriptorProto::TYPE_MESSAGE,
+                      ".perfetto.protos.TestProto.NestedProto", true);
+  field.set_resolved_type_name(".perfetto.protos.TestProto.NestedProto");
+  descriptor.AddField(field);
+
+  RepeatedFieldBuilder rep_builder;
+  for (int64_t value : {12, 34}) {
+    ProtoBuilder nest_builder(&nested);
+    ASSERT_TRUE(nest_builder.AppendLong("nested_int_value", value).ok());
+    auto nest_ser = nest_builder.SerializeToProtoBuilderResult();
+    rep_builder.AddBytes(nest_ser.data(), nest_ser.size());
+  }
+  std::vector<uint8_t> rep_ser = rep_builder.SerializeToProtoBuilderResult();
+
+  ProtoBuilder builder(&descriptor);
+  ASSERT_TRUE(
+      builder.AppendBytes("rep_nested_value", rep_ser.data(), rep_ser.size())
+          .ok());
+
+  // The top level message is returned without the ProtoBuilderResult.
+  std::vector<uint8_t> raw = builder.SerializeRaw();
+  protozero::TypedProtoDecoder<1, true> proto(raw.data(), raw.size());
+  std::vector<int64_t> values;
+  for (auto it = proto.GetRepeated<protozero::ConstBytes>(1); it; ++it) {
+    protozero::ConstBytes nest_bytes = *it;
+    protozero::TypedProtoDecoder<1, false> nest(nest_bytes.data,
+                                                nest_bytes.size);
+    values.push_back(nest.Get(1).as_int64());
+  }
+  ASSERT_THAT(values, testing::ElementsAre(12, 34));
+
+  // Messages of another type are rejected.
+  ProtoBuilder other_builder(&descriptor);
+  ASSERT_TRUE(other_builder
+                  .AppendBytes("rep_nested_value", rep_ser.data(),
+                               rep_ser.size())
+                  .ok());
+  auto other_ser = other_builder.SerializeToProtoBuilderResult();
+
+  RepeatedFieldBuilder wrong_rep_builder;
+  wrong_rep_builder.AddBytes(other_ser.data(), other_ser.size());
+  auto wrong_rep_ser = wrong_rep_builder.SerializeToProtoBuilderResult();
+
+  ProtoBuilder wrong_builder(&descriptor);
+  ASSERT_FALSE(wrong_builder
+                   .AppendBytes("rep_nested_value", wrong_rep_ser.data(),
+                                wrong_rep_ser.size())
+                   .ok());
+}
+
+TEST(MetricsTest, GetRunMetricPaths) {
+  ASSERT_THAT(GetRunMetricPaths("SELECT 1;"), testing::IsEmpty());
+  ASSERT_THAT(
+      GetRunMetricPaths("SELECT RUN_METRIC('android/a.sql');\n"
+                        "select run_metric ( \"b.sql\", 'x', 'y');\n"
+                        "SELECT RUN_METRIC('android/c.sql', 'a', '{{a}}');"),
+      testing::ElementsAre("android/a.sql", "b.sql", "android/c.sql"));
+  // Paths which are not literals can't be found.
+  ASSERT_THAT(GetRunMetricPaths("SELECT RUN_METRIC(path) FROM t;"),
+              testing::IsEmpty());
+}
+
+SqlMetricFile MetricFile(const std::string& path,
+                         const std::string& sql,
+                         const std::string& field = "") {
+  SqlMetricFile metric;
+  metric.path = path;
+  metric.sql = sql;
+  if (!field.empty()) {
+    metric.proto_field_name = field;
+    metric.output_table_name = field + "_output";
+  }
+  return metric;
+}
+
+TEST(MetricsTest, AssignMetricsToWorkers) {
+  std::vector<SqlMetricFile> files = {
+      MetricFile("common.sql", "SELECT 1;"),
+      MetricFile("shared.sql", "SELECT RUN_METRIC('common.sql');"),
+      MetricFile("a.sql", "SELECT RUN_METRIC('shared.sql');", "a"),
+      MetricFile("b.sql", "SELECT RUN_METRIC('shared.sql');", "b"),
+      MetricFile("c.sql", "SELECT 1;", "c"),
+      MetricFile("d.sql", "SELECT 1;", "d"),
+      MetricFile("e.sql",
+                 "SELECT RUN_METRIC('c.sql');\n"
+                 "SELECT RUN_METRIC('d.sql');\n"
+                 "SELECT RUN_METRIC('shared.sql');",
+                 "e"),
+  };
+
+  // e runs the most files so it goes first. b then joins a as they share
+  // two files which only need to run once.
+  ASSERT_THAT(AssignMetricsToWorkers({"a", "b", "e"}, files, 2),
+              testing::ElementsAre(testing::ElementsAre(2u),
+                                   testing::ElementsAre(0u, 1u)));
+
+  // Independent metrics are spread over the workers.
+  ASSERT_THAT(AssignMetricsToWorkers({"c", "d", "a"}, files, 4),
+              testing::ElementsAre(testing::ElementsAre(2u),
+                                   testing::ElementsAre(0u),
+                                   testing::ElementsAre(1u)));
+
+  // There are never more workers than metrics or than allowed.
+  ASSERT_THAT(AssignMetricsToWorkers({"c", "d"}, files, 1),
+              testing::ElementsAre(testing::ElementsAre(0u, 1u)));
+  ASSERT_THAT(AssignMetricsToWorkers({"c"}, files, 8),
+              testing::ElementsAre(testing::ElementsAre(0u)));
+
+  // Unknown metrics are still assigned so that their error is reported.
+  ASSERT_THAT(AssignMetricsToWorkers({"unknown", "c"}, files, 2),
+              testing::ElementsAre(testing::ElementsAre(1u),
+                                   testing::ElementsAre(0u)));
+}
+
 }  // namespace
 
 }  // namespace metrics
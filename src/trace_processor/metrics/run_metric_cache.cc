@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/metrics/run_metric_cache.h"
+
+#include <ctype.h>
+
+#include <utility>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace metrics {
+
+namespace {
+
+bool IsIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Splits |sql| into lowercase identifiers (and keywords), skipping comments
+// and string literals.
+std::vector<std::string> Tokenize(const std::string& sql) {
+  std::vector<std::string> tokens;
+  size_t i = 0;
+  while (i < sql.size()) {
+    char c = sql[i];
+    if (c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+      size_t end = sql.find('\n', i);
+      i = end == std::string::npos ? sql.size() : end + 1;
+    } else if (c == '/' && i + 1 < sql.size() && sql[i + 1] == '*') {
+      size_t end = sql.find("*/", i + 2);
+      i = end == std::string::npos ? sql.size() : end + 2;
+    } else if (c == '\'') {
+      // Escaped quotes ('') are handled by treating them as two adjacent
+      // string literals.
+      size_t end = sql.find('\'', i + 1);
+      i = end == std::string::npos ? sql.size() : end + 1;
+    } else if (IsIdentifierChar(c)) {
+      std::string token;
+      for (; i < sql.size() && IsIdentifierChar(sql[i]); ++i) {
+        token.push_back(
+            static_cast<char>(tolower(static_cast<unsigned char>(sql[i]))));
+      }
+      tokens.emplace_back(std::move(token));
+    } else {
+      ++i;
+    }
+  }
+  return tokens;
+}
+
+base::Optional<std::string> FindModifiedObject(
+    const std::vector<std::string>& tokens) {
+  size_t i = 0;
+  auto at = [&tokens](size_t idx) {
+    return idx < tokens.size() ? tokens[idx] : std::string();
+  };
+  std::string verb = at(i++);
+  if (verb == "create") {
+    // CREATE [TEMP|TEMPORARY] [VIRTUAL] {TABLE|VIEW} [IF NOT EXISTS] name
+    while (at(i) == "temp" || at(i) == "temporary" || at(i) == "virtual")
+      i++;
+    if (at(i) != "table" && at(i) != "view")
+      return base::nullopt;
+    i++;
+    if (at(i) == "if")
+      i += 3;
+  } else if (verb == "drop") {
+    // DROP {TABLE|VIEW} [IF EXISTS] name
+    if (at(i) != "table" && at(i) != "view")
+      return base::nullopt;
+    i++;
+    if (at(i) == "if")
+      i += 2;
+  } else if (verb == "insert" || verb == "replace") {
+    // {INSERT [OR conflict]|REPLACE} INTO name
+    if (at(i) == "or")
+      i += 2;
+    if (at(i) != "into")
+      return base::nullopt;
+    i++;
+  } else if (verb == "update") {
+    // UPDATE [OR conflict] name
+    if (at(i) == "or")
+      i += 2;
+  } else if (verb == "delete") {
+    // DELETE FROM name
+    if (at(i) != "from")
+      return base::nullopt;
+    i++;
+  } else {
+    return base::nullopt;
+  }
+  std::string name = at(i);
+  if (name.empty())
+    return base::nullopt;
+  return name;
+}
+
+}  // namespace
+
+RunMetricCache::RunMetricCache() = default;
+RunMetricCache::~RunMetricCache() = default;
+
+void RunMetricCache::Begin() {
+  PERFETTO_DCHECK(!active_);
+  active_ = true;
+}
+
+void RunMetricCache::End() {
+  active_ = false;
+  runs_.clear();
+  pending_.clear();
+}
+
+bool RunMetricCache::IsCached(const std::string& key) const {
+  auto it = runs_.find(key);
+  if (it == runs_.end())
+    return false;
+
+  // If a file run by this file needs to be run again, so does this file.
+  for (const std::string& child : it->second.children) {
+    if (!IsCached(child))
+      return false;
+  }
+  return true;
+}
+
+void RunMetricCache::OnRunBegin(const std::string& key) {
+  if (!active_)
+    return;
+  PendingRun pending;
+  pending.key = key;
+  pending_.emplace_back(std::move(pending));
+}
+
+void RunMetricCache::OnRunEnd() {
+  if (!active_)
+    return;
+  PERFETTO_DCHECK(!pending_.empty());
+  PendingRun pending = std::move(pending_.back());
+  pending_.pop_back();
+  if (!pending_.empty())
+    pending_.back().run.children.push_back(pending.key);
+  runs_[pending.key] = std::move(pending.run);
+}
+
+void RunMetricCache::OnRunAbort() {
+  if (!active_)
+    return;
+  PERFETTO_DCHECK(!pending_.empty());
+  pending_.pop_back();
+}
+
+void RunMetricCache::OnRunSkipped(const std::string& key) {
+  if (!active_)
+    return;
+  // The file which would have run this file still depends on it.
+  if (!pending_.empty())
+    pending_.back().run.children.push_back(key);
+}
+
+void RunMetricCache::OnStatement(const std::string& sql) {
+  if (!active_)
+    return;
+
+  std::vector<std::string> tokens = Tokenize(sql);
+  base::Optional<std::string> modified = FindModifiedObject(tokens);
+  if (modified)
+    Invalidate(*modified);
+
+  if (pending_.empty())
+    return;
+
+  Run& run = pending_.back().run;
+  if (modified)
+    run.outputs.push_back(*modified);
+  for (std::string& token : tokens) {
+    run.identifiers.emplace(std::move(token));
+  }
+}
+
+// static
+base::Optional<std::string> RunMetricCache::GetModifiedObject(
+    const std::string& sql) {
+  return FindModifiedObject(Tokenize(sql));
+}
+
+void RunMetricCache::Invalidate(const std::string& name) {
+  std::vector<std::string> worklist{name};
+  std::unordered_set<std::string> seen{name};
+  while (!worklist.empty()) {
+    std::string current = std::move(worklist.back());
+    worklist.pop_back();
+    for (auto it = runs_.begin(); it != runs_.end();) {
+      if (it->second.identifiers.count(current) == 0) {
+        ++it;
+        continue;
+      }
+      // Anything which depends on the objects created by this run also needs
+      // to be invalidated as they will be recreated when this file is run
+      // again.
+      for (const std::string& output : it->second.outputs) {
+        if (seen.insert(output).second)
+          worklist.push_back(output);
+      }
+      it = runs_.erase(it);
+    }
+  }
+}
+
+}  // namespace metrics
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_METRICS_RUN_METRIC_CACHE_H_
+#define SRC_TRACE_PROCESSOR_METRICS_RUN_METRIC_CACHE_H_
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace metrics {
+
+// Keeps track of the metric files run by RUN_METRIC while computing a set of
+// metrics so that files shared by several metrics (e.g. process_metadata.sql)
+// are only run once.
+//
+// Running a file again with the same arguments is only skipped if none of the
+// tables and views it depends on have been modified since it was last run.
+// Dependencies are tracked conservatively: a file depends on every identifier
+// which appears in its statements and on all the files it runs itself. Any
+// statement which creates, drops or writes to a table or view invalidates the
+// files which mention it and, transitively, the files which mention any object
+// created by an invalidated file.
+class RunMetricCache {
+ public:
+  RunMetricCache();
+  ~RunMetricCache();
+
+  // Starts caching runs. Called at the start of computing a set of metrics.
+  void Begin();
+
+  // Stops caching runs and forgets all previous runs. Called at the end of
+  // computing a set of metrics as, after that, arbitrary queries can modify
+  // the tables created by the metrics.
+  void End();
+
+  // Returns true if the cache is between calls to |Begin| and |End|.
+  bool active() const { return active_; }
+
+  // Returns true if the file identified by |key| was run since |Begin| and
+  // none of its dependencies have been modified since.
+  bool IsCached(const std::string& key) const;
+
+  // The functions below are no-ops if the cache is not active.
+
+  // Called before running the statements of the file identified by |key|.
+  void OnRunBegin(const std::string& key);
+
+  // Called after all the statements of the innermost file being run have
+  // run successfully.
+  void OnRunEnd();
+
+  // Called if any statement of the innermost file being run failed.
+  void OnRunAbort();
+
+  // Called instead of running the file identified by |key| if |IsCached|
+  // returned true.
+  void OnRunSkipped(const std::string& key);
+
+  // Called after each statement is run successfully, whether it is part of a
+  // file run by RUN_METRIC or not.
+  void OnStatement(const std::string& sql);
+
+  // Returns the name of the table or view which is created, dropped or written
+  // to by |sql| or nullopt if |sql| does not modify any table or view.
+  // Exposed for testing.
+  static base::Optional<std::string> GetModifiedObject(const std::string& sql);
+
+ private:
+  struct Run {
+    // Lowercase identifiers which appear in the statements of the file.
+    std::unordered_set<std::string> identifiers;
+
+    // The tables and views created, dropped or written to by the file.
+    std::vector<std::string> outputs;
+
+    // The keys of the files run by this file.
+    std::vector<std::string> children;
+  };
+
+  struct PendingRun {
+    std::string key;
+    Run run;
+  };
+
+  RunMetricCache(const RunMetricCache&) = delete;
+  RunMetricCache& operator=(const RunMetricCache&) = delete;
+
+  // Removes all the runs which depend on |name|.
+  void Invalidate(const std::string& name);
+
+  bool active_ = false;
+  std::unordered_map<std::string, Run> runs_;
+
+  // The files currently being run; the innermost file is at the back.
+  std::vector<PendingRun> pending_;
+};
+
+}  // namespace metrics
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_METRICS_RUN_METRIC_CACHE_H_
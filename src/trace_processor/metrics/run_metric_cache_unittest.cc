@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/metrics/run_metric_cache.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace metrics {
+namespace {
+
+void RunFile(RunMetricCache* cache,
+             const std::string& key,
+             const std::vector<std::string>& statements) {
+  cache->OnRunBegin(key);
+  for (const std::string& statement : statements) {
+    cache->OnStatement(statement);
+  }
+  cache->OnRunEnd();
+}
+
+TEST(RunMetricCacheTest, GetModifiedObject) {
+  auto modified = [](const std::string& sql) {
+    return RunMetricCache::GetModifiedObject(sql).value_or("");
+  };
+  ASSERT_EQ(modified("CREATE TABLE foo AS SELECT 1"), "foo");
+  ASSERT_EQ(modified("create view Foo as select * from bar"), "foo");
+  ASSERT_EQ(modified("CREATE VIRTUAL TABLE foo USING span_join(a, b)"), "foo");
+  ASSERT_EQ(modified("CREATE TABLE IF NOT EXISTS foo(x INT)"), "foo");
+  ASSERT_EQ(modified("-- Comment\nDROP VIEW IF EXISTS foo"), "foo");
+  ASSERT_EQ(modified("INSERT OR REPLACE INTO foo VALUES (1)"), "foo");
+  ASSERT_EQ(modified("UPDATE `foo` SET x = 1"), "foo");
+  ASSERT_EQ(modified("DELETE FROM foo"), "foo");
+  ASSERT_EQ(modified("SELECT * FROM foo"), "");
+  ASSERT_EQ(modified("CREATE INDEX foo_idx ON foo(x)"), "");
+  ASSERT_EQ(modified("SELECT RUN_METRIC('create table foo')"), "");
+}
+
+TEST(RunMetricCacheTest, OnlyActiveBetweenBeginAndEnd) {
+  RunMetricCache cache;
+  RunFile(&cache, "a", {"CREATE TABLE a AS SELECT * FROM slice"});
+  ASSERT_FALSE(cache.IsCached("a"));
+
+  cache.Begin();
+  RunFile(&cache, "a", {"CREATE TABLE a AS SELECT * FROM slice"});
+  ASSERT_TRUE(cache.IsCached("a"));
+  ASSERT_FALSE(cache.IsCached("b"));
+
+  cache.End();
+  ASSERT_FALSE(cache.IsCached("a"));
+}
+
+TEST(RunMetricCacheTest, InvalidatedByModifyingDependencies) {
+  RunMetricCache cache;
+  cache.Begin();
+  RunFile(&cache, "a", {"CREATE TABLE a AS SELECT * FROM input"});
+  RunFile(&cache, "b", {"CREATE VIEW b AS SELECT * FROM a"});
+  RunFile(&cache, "c", {"CREATE TABLE c AS SELECT * FROM slice"});
+
+  // Reading tables doesn't invalidate anything.
+  cache.OnStatement("SELECT * FROM input JOIN a JOIN b");
+  ASSERT_TRUE(cache.IsCached("a"));
+  ASSERT_TRUE(cache.IsCached("b"));
+  ASSERT_TRUE(cache.IsCached("c"));
+
+  // Modifying the input of a should invalidate a and also b which reads the
+  // table created by a.
+  cache.OnStatement("INSERT INTO input VALUES (1)");
+  ASSERT_FALSE(cache.IsCached("a"));
+  ASSERT_FALSE(cache.IsCached("b"));
+  ASSERT_TRUE(cache.IsCached("c"));
+}
+
+TEST(RunMetricCacheTest, InvalidatedByChildren) {
+  RunMetricCache cache;
+  cache.Begin();
+  cache.OnRunBegin("parent");
+  RunFile(&cache, "child", {"CREATE TABLE child AS SELECT * FROM input"});
+  cache.OnStatement("SELECT RUN_METRIC('child.sql')");
+  cache.OnRunEnd();
+  ASSERT_TRUE(cache.IsCached("parent"));
+
+  // The parent doesn't mention |input| but still needs to be run again so
+  // that it recreates the child's table.
+  cache.OnStatement("DROP TABLE input");
+  ASSERT_FALSE(cache.IsCached("child"));
+  ASSERT_FALSE(cache.IsCached("parent"));
+}
+
+TEST(RunMetricCacheTest, SkippedChildren) {
+  RunMetricCache cache;
+  cache.Begin();
+  RunFile(&cache, "child", {"CREATE TABLE child AS SELECT * FROM input"});
+  ASSERT_TRUE(cache.IsCached("child"));
+
+  cache.OnRunBegin("parent");
+  cache.OnRunSkipped("child");
+  cache.OnRunEnd();
+  ASSERT_TRUE(cache.IsCached("parent"));
+
+  cache.OnStatement("DROP TABLE input");
+  ASSERT_FALSE(cache.IsCached("parent"));
+}
+
+TEST(RunMetricCacheTest, AbortedRunsAreNotCached) {
+  RunMetricCache cache;
+  cache.Begin();
+  cache.OnRunBegin("a");
+  cache.OnStatement("CREATE TABLE a AS SELECT 1");
+  cache.OnRunAbort();
+  ASSERT_FALSE(cache.IsCached("a"));
+}
+
+}  // namespace
+}  // namespace metrics
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -12,6 +12,8 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import array
+import sys
 from urllib.parse import urlparse
 
 from .http import TraceProcessorHttp
@@ -40,6 +42,15 @@ class TraceProcessor:
   QUERY_CELL_STRING_FIELD_ID = 4
   QUERY_CELL_BLOB_FIELD_ID = 5
 
+  # Values of the QueryResult.ColumnarBatch.Column.Type enum at
+  # protos/perfetto/trace_processor/trace_processor.proto
+  COLUMN_TYPE_NULL = 0
+  COLUMN_TYPE_INT64 = 1
+  COLUMN_TYPE_FLOAT64 = 2
+  COLUMN_TYPE_STRING = 3
+  COLUMN_TYPE_BLOB = 4
+  COLUMN_TYPE_MIXED = 5
+
   # This is the class returned to the user and contains one row of the
   # resultant query. Each column name is stored as an attribute of this
   # class, with the value corresponding to the column name and row in
@@ -165,6 +176,75 @@ class TraceProcessor:
       self.__next_index = self.__next_index + len(self.__column_names)
       return row
 
+  # Like QueryResultIterator but for results returned as
+  # QueryResult.ColumnarBatch. Each column of a batch is decoded as a whole
+  # from its buffers (wrapped as numpy arrays for as_pandas_dataframe) instead
+  # of cell by cell.
+  class ColumnarQueryResultIterator:
+
+    def __init__(self, column_names, batches):
+      self.__batches = batches
+      self.__column_names = column_names
+      self.__batch_index = 0
+      self.__rows = iter(())
+
+    # Returns the next batch, or None if the last batch was already returned.
+    def __next_batch(self):
+      if (self.__batch_index > 0 and
+          self.__batches[self.__batch_index - 1].is_last_batch):
+        return None
+      batch = self.__batches[self.__batch_index]
+      self.__batch_index += 1
+      return batch
+
+    # To use the query result as a populated Pandas dataframe, this
+    # function must be called directly after calling query inside
+    # TraceProcesor.
+    def as_pandas_dataframe(self):
+      try:
+        import numpy as np
+        import pandas as pd
+      except ModuleNotFoundError:
+        raise TraceProcessorException(
+            'The sufficient libraries are not installed')
+
+      # Columns are keyed by index as column names are not always unique.
+      columns = [[] for _ in self.__column_names]
+      while True:
+        batch = self.__next_batch()
+        if batch is None:
+          break
+        for values, column in zip(columns, batch.columns):
+          values.append(
+              pd.Series(_column_as_numpy(np, pd, column, batch.num_rows)))
+
+      df = pd.DataFrame({
+          i: pd.concat(values, ignore_index=True) if values else []
+          for i, values in enumerate(columns)
+      })
+      df.columns = self.__column_names
+      return df
+
+    def __iter__(self):
+      return self
+
+    def __next__(self):
+      while True:
+        values = next(self.__rows, None)
+        if values is not None:
+          break
+        batch = self.__next_batch()
+        if batch is None:
+          raise StopIteration
+        self.__rows = zip(*[
+            _column_as_list(column, batch.num_rows) for column in batch.columns
+        ])
+
+      row = TraceProcessor.Row()
+      for column_name, value in zip(self.__column_names, values):
+        setattr(row, column_name, value)
+      return row
+
   def __init__(self, addr=None, file_path=None, bin_path=None,
                unique_port=True):
     # Load trace_processor_shell or access via given address
@@ -199,6 +279,11 @@ class TraceProcessor:
     if response.error:
       raise TraceProcessorException(response.error)
 
+    # Versions of trace_processor_shell which don't support the columnar
+    # format ignore the request for it and return cell batches.
+    if response.columnar_batch:
+      return TraceProcessor.ColumnarQueryResultIterator(
+          response.column_names, response.columnar_batch)
     return TraceProcessor.QueryResultIterator(response.column_names,
                                               response.batch)
 
@@ -243,3 +328,123 @@ class TraceProcessor:
     if hasattr(self, 'subprocess'):
       self.subprocess.kill()
     self.http.conn.close()
+
+
+# Decodes the little-endian values of type |typecode| (see the array module)
+# in |buf|.
+def _unpack(typecode, buf):
+  values = array.array(typecode, buf)
+  if sys.byteorder == 'big':
+    values.byteswap()
+  return values
+
+
+def _string_dictionary(column):
+  offsets = _unpack('i', column.string_dictionary_offsets)
+  data = column.string_dictionary_data
+  return [
+      str(data[offsets[i]:offsets[i + 1]], 'utf-8')
+      for i in range(len(offsets) - 1)
+  ]
+
+
+def _blobs(column, num_rows):
+  offsets = _unpack('i', column.blob_offsets)
+  data = column.blob_data
+  return [data[offsets[i]:offsets[i + 1]] for i in range(num_rows)]
+
+
+def _is_valid(validity, row):
+  return validity[row >> 3] & (1 << (row & 7)) != 0
+
+
+# Returns the values of the |num_rows| rows of a ColumnarBatch.Column as a
+# list, with None for NULL cells.
+def _column_as_list(column, num_rows):
+  column_type = column.type
+  if column_type == TraceProcessor.COLUMN_TYPE_NULL:
+    return [None] * num_rows
+  elif column_type == TraceProcessor.COLUMN_TYPE_INT64:
+    values = _unpack('q', column.int64_values).tolist()
+  elif column_type == TraceProcessor.COLUMN_TYPE_FLOAT64:
+    values = _unpack('d', column.float64_values).tolist()
+  elif column_type == TraceProcessor.COLUMN_TYPE_STRING:
+    dictionary = _string_dictionary(column)
+    values = [dictionary[i] for i in _unpack('i', column.string_indices)]
+  elif column_type == TraceProcessor.COLUMN_TYPE_BLOB:
+    values = _blobs(column, num_rows)
+  elif column_type == TraceProcessor.COLUMN_TYPE_MIXED:
+    # Each buffer has an entry for every row, |cell_types| tells which one
+    # holds the value of the row.
+    buffers = {TraceProcessor.QUERY_CELL_NULL_FIELD_ID: [None] * num_rows}
+    if column.int64_values:
+      buffers[TraceProcessor.QUERY_CELL_VARINT_FIELD_ID] = _unpack(
+          'q', column.int64_values)
+    if column.float64_values:
+      buffers[TraceProcessor.QUERY_CELL_FLOAT64_FIELD_ID] = _unpack(
+          'd', column.float64_values)
+    if column.string_indices:
+      dictionary = _string_dictionary(column)
+      buffers[TraceProcessor.QUERY_CELL_STRING_FIELD_ID] = [
+          dictionary[i] for i in _unpack('i', column.string_indices)
+      ]
+    if column.blob_offsets:
+      buffers[TraceProcessor.QUERY_CELL_BLOB_FIELD_ID] = _blobs(
+          column, num_rows)
+    try:
+      values = [
+          buffers[cell_type][row]
+          for row, cell_type in enumerate(column.cell_types)
+      ]
+    except KeyError:
+      raise TraceProcessorException('Invalid cell type')
+  else:
+    raise TraceProcessorException('Invalid column type')
+
+  if len(values) != num_rows:
+    raise TraceProcessorException('Invalid column size')
+  validity = column.validity
+  if validity:
+    for row in range(num_rows):
+      if not _is_valid(validity, row):
+        values[row] = None
+  return values
+
+
+# Like _column_as_list but returns a numpy array wrapping the buffers of the
+# column, with NaN for NULL cells (pandas.NA for integer columns).
+def _column_as_numpy(np, pd, column, num_rows):
+  column_type = column.type
+  if column_type == TraceProcessor.COLUMN_TYPE_NULL:
+    return np.full(num_rows, np.nan)
+  elif column_type in (TraceProcessor.COLUMN_TYPE_BLOB,
+                       TraceProcessor.COLUMN_TYPE_MIXED):
+    # These are rare, they are decoded cell by cell.
+    values = _column_as_list(column, num_rows)
+    return np.array([np.nan if v is None else v for v in values], dtype=object)
+
+  # np.frombuffer returns read-only arrays backed by the proto, they are
+  # copied so that the dataframe can be modified.
+  if column_type == TraceProcessor.COLUMN_TYPE_INT64:
+    values = np.frombuffer(column.int64_values, dtype='<i8').copy()
+  elif column_type == TraceProcessor.COLUMN_TYPE_FLOAT64:
+    values = np.frombuffer(column.float64_values, dtype='<f8').copy()
+  elif column_type == TraceProcessor.COLUMN_TYPE_STRING:
+    dictionary = np.array(_string_dictionary(column), dtype=object)
+    values = dictionary[np.frombuffer(column.string_indices, dtype='<i4')]
+  else:
+    raise TraceProcessorException('Invalid column type')
+
+  if len(values) != num_rows:
+    raise TraceProcessorException('Invalid column size')
+  if not column.validity:
+    return values
+  is_null = np.unpackbits(
+      np.frombuffer(column.validity, dtype=np.uint8),
+      count=num_rows,
+      bitorder='little') == 0
+  if column_type == TraceProcessor.COLUMN_TYPE_INT64:
+    # Converting to float64 for NaN would lose the precision of timestamps.
+    return pd.arrays.IntegerArray(values, is_null)
+  values[is_null] = np.nan
+  return values
@@ -27,6 +27,7 @@ class TraceProcessorHttp:
   def execute_query(self, query):
     args = self.protos.RawQueryArgs()
     args.sql_query = query
+    args.batch_format = self.protos.RawQueryArgs.BATCH_FORMAT_COLUMNAR
     byte_data = args.SerializeToString()
     self.conn.request('POST', '/query', body=byte_data)
     with self.conn.getresponse() as f:
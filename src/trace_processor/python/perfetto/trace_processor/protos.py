@@ -59,3 +59,5 @@ class ProtoFactory:
         'perfetto.protos.DisableAndReadMetatraceResult')
     self.CellsBatch = create_message_factory(
         'perfetto.protos.QueryResult.CellsBatch')
+    self.ColumnarBatch = create_message_factory(
+        'perfetto.protos.QueryResult.ColumnarBatch')
@@ -16,6 +16,9 @@
 
 #include "perfetto/trace_processor/read_trace.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -27,6 +30,7 @@
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
 #include "src/trace_processor/importers/gzip/gzip_utils.h"
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
+#include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/util/status_macros.h"
 
 #include "protos/perfetto/trace/trace.pbzero.h"
@@ -43,6 +47,19 @@
 #include <aio.h>
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+#define PERFETTO_HAS_MMAP() 1
+#else
+#define PERFETTO_HAS_MMAP() 0
+#endif
+
+#if PERFETTO_HAS_MMAP()
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -77,56 +94,20 @@ util::Status ReadTraceUsingRead(
   return util::OkStatus();
 }
 
-class SerializingProtoTraceReader : public ChunkedTraceReader {
- public:
-  SerializingProtoTraceReader(std::vector<uint8_t>* output) : output_(output) {}
-
-  util::Status Parse(std::unique_ptr<uint8_t[]> data, size_t size) override {
-    return tokenizer_.Tokenize(
-        std::move(data), size, [this](TraceBlobView packet) {
-          uint8_t buffer[protozero::proto_utils::kMaxSimpleFieldEncodedSize];
-
-          uint8_t* pos = buffer;
-          pos = protozero::proto_utils::WriteVarInt(kTracePacketTag, pos);
-          pos = protozero::proto_utils::WriteVarInt(packet.length(), pos);
-          output_->insert(output_->end(), buffer, pos);
-
-          output_->insert(output_->end(), packet.data(),
-                          packet.data() + packet.length());
-          return util::OkStatus();
-        });
-  }
-
-  void NotifyEndOfFile() override {}
-
- private:
-  static constexpr uint8_t kTracePacketTag =
-      protozero::proto_utils::MakeTagLengthDelimited(
-          protos::pbzero::Trace::kPacketFieldNumber);
-
-  ProtoTraceTokenizer tokenizer_;
-  std::vector<uint8_t>* output_;
-};
-
-}  // namespace
-
-util::Status ReadTrace(
+// Reads the trace in chunks into heap buffers, using async IO where
+// available.
+util::Status ReadTraceUsingAio(
     TraceProcessor* tp,
-    const char* filename,
+    int fd,
+    uint64_t* file_size,
     const std::function<void(uint64_t parsed_size)>& progress_callback) {
-  base::ScopedFile fd(base::OpenFile(filename, O_RDONLY));
-  if (!fd)
-    return util::ErrStatus("Could not open trace file (path: %s)", filename);
-
-  uint64_t file_size = 0;
-
 #if PERFETTO_HAS_AIO_H()
   // Load the trace in chunks using async IO. We create a simple pipeline where,
   // at each iteration, we parse the current chunk and asynchronously start
   // reading the next chunk.
   struct aiocb cb {};
   cb.aio_nbytes = kChunkSize;
-  cb.aio_fildes = *fd;
+  cb.aio_fildes = fd;
 
   std::unique_ptr<uint8_t[]> aio_buf(new uint8_t[kChunkSize]);
 #if defined(MEMORY_SANITIZER)
@@ -141,14 +122,14 @@ util::Status ReadTrace(
 
   for (int i = 0;; i++) {
     if (progress_callback && i % 128 == 0)
-      progress_callback(file_size);
+      progress_callback(*file_size);
 
     // Block waiting for the pending read to complete.
     PERFETTO_CHECK(aio_suspend(aio_list, 1, nullptr) == 0);
     auto rsize = aio_return(&cb);
     if (rsize <= 0)
       break;
-    file_size += static_cast<uint64_t>(rsize);
+    *file_size += static_cast<uint64_t>(rsize);
 
     // Take ownership of the completed buffer and enqueue a new async read
     // with a fresh buffer.
@@ -167,16 +148,139 @@ util::Status ReadTrace(
     RETURN_IF_ERROR(tp->Parse(std::move(buf), static_cast<size_t>(rsize)));
   }
 
-  if (file_size == 0) {
+  if (*file_size == 0) {
     PERFETTO_ILOG(
         "Failed to read any data using AIO. This is expected and not an error "
         "on WSL. Falling back to read()");
-    RETURN_IF_ERROR(ReadTraceUsingRead(tp, *fd, &file_size, progress_callback));
+    RETURN_IF_ERROR(ReadTraceUsingRead(tp, fd, file_size, progress_callback));
   }
 #else   // PERFETTO_HAS_AIO_H()
-  RETURN_IF_ERROR(ReadTraceUsingRead(tp, *fd, &file_size, progress_callback));
+  RETURN_IF_ERROR(ReadTraceUsingRead(tp, fd, file_size, progress_callback));
 #endif  // PERFETTO_HAS_AIO_H()
 
+  return util::OkStatus();
+}
+
+#if PERFETTO_HAS_MMAP()
+// Maps the whole trace file into memory and passes it to |tp| in chunks which
+// reference the mapping directly, avoiding both copying the trace and holding
+// it on the heap. The pages are shared with the page cache (and so with any
+// other process reading the same file) and can be reclaimed by the kernel
+// under memory pressure.
+// Sets |mapped| to false without parsing anything if the file cannot be
+// mapped (e.g. because it is a pipe). Sets |is_snapshot| to true without
+// parsing anything if the file is a snapshot of the tables of a trace (see
+// TraceProcessor::LoadSnapshot).
+util::Status ReadTraceUsingMmap(
+    TraceProcessor* tp,
+    int fd,
+    uint64_t* file_size,
+    const std::function<void(uint64_t parsed_size)>& progress_callback,
+    bool* mapped,
+    bool* is_snapshot) {
+  *mapped = false;
+  *is_snapshot = false;
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      static_cast<uint64_t>(st.st_size) > std::numeric_limits<size_t>::max()) {
+    return util::OkStatus();
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    return util::OkStatus();
+  *mapped = true;
+
+  if (TraceStorage::IsSnapshot(static_cast<const uint8_t*>(addr), size)) {
+    munmap(addr, size);
+    *is_snapshot = true;
+    return util::OkStatus();
+  }
+
+  // The trace is read front to back so let the kernel read ahead aggressively.
+  madvise(addr, size, MADV_SEQUENTIAL);
+  std::shared_ptr<const uint8_t> mapping(
+      static_cast<const uint8_t*>(addr), [size](const uint8_t* ptr) {
+        munmap(const_cast<uint8_t*>(ptr), size);
+      });
+
+  for (size_t i = 0, offset = 0; offset < size; i++, offset += kChunkSize) {
+    if (progress_callback && i % 128 == 0)
+      progress_callback(*file_size);
+
+    // Each chunk shares ownership of the whole mapping, which is unmapped
+    // once trace processor has released every chunk.
+    const size_t chunk_size = std::min(kChunkSize, size - offset);
+    std::shared_ptr<const uint8_t> chunk(mapping, mapping.get() + offset);
+    *file_size += chunk_size;
+    RETURN_IF_ERROR(tp->ParseShared(std::move(chunk), chunk_size));
+  }
+  return util::OkStatus();
+}
+#endif  // PERFETTO_HAS_MMAP()
+
+class SerializingProtoTraceReader : public ChunkedTraceReader {
+ public:
+  SerializingProtoTraceReader(std::vector<uint8_t>* output) : output_(output) {}
+
+  util::Status Parse(std::unique_ptr<uint8_t[]> data, size_t size) override {
+    return tokenizer_.Tokenize(
+        std::move(data), size, [this](TraceBlobView packet) {
+          uint8_t buffer[protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+
+          uint8_t* pos = buffer;
+          pos = protozero::proto_utils::WriteVarInt(kTracePacketTag, pos);
+          pos = protozero::proto_utils::WriteVarInt(packet.length(), pos);
+          output_->insert(output_->end(), buffer, pos);
+
+          output_->insert(output_->end(), packet.data(),
+                          packet.data() + packet.length());
+          return util::OkStatus();
+        });
+  }
+
+  void NotifyEndOfFile() override {}
+
+ private:
+  static constexpr uint8_t kTracePacketTag =
+      protozero::proto_utils::MakeTagLengthDelimited(
+          protos::pbzero::Trace::kPacketFieldNumber);
+
+  ProtoTraceTokenizer tokenizer_;
+  std::vector<uint8_t>* output_;
+};
+
+}  // namespace
+
+util::Status ReadTrace(
+    TraceProcessor* tp,
+    const char* filename,
+    const std::function<void(uint64_t parsed_size)>& progress_callback) {
+  base::ScopedFile fd(base::OpenFile(filename, O_RDONLY));
+  if (!fd)
+    return util::ErrStatus("Could not open trace file (path: %s)", filename);
+
+  uint64_t file_size = 0;
+
+#if PERFETTO_HAS_MMAP()
+  bool mapped = false;
+  bool is_snapshot = false;
+  RETURN_IF_ERROR(ReadTraceUsingMmap(tp, *fd, &file_size, progress_callback,
+                                     &mapped, &is_snapshot));
+  if (is_snapshot) {
+    fd.reset();
+    RETURN_IF_ERROR(tp->LoadSnapshot(filename));
+    tp->SetCurrentTraceName(filename);
+    return util::OkStatus();
+  }
+  if (!mapped) {
+    RETURN_IF_ERROR(ReadTraceUsingAio(tp, *fd, &file_size, progress_callback));
+  }
+#else   // PERFETTO_HAS_MMAP()
+  RETURN_IF_ERROR(ReadTraceUsingAio(tp, *fd, &file_size, progress_callback));
+#endif  // PERFETTO_HAS_MMAP()
+
   tp->NotifyEndOfFile();
   tp->SetCurrentTraceName(filename);
 
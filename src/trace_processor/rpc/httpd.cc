@@ -20,12 +20,18 @@
 
 #include "src/trace_processor/rpc/httpd.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/unix_socket.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -45,35 +51,154 @@ constexpr size_t kOmitContentLength = static_cast<size_t>(-1);
 // 32 MiB payload + 128K for HTTP headers.
 constexpr size_t kMaxRequestSize = (32 * 1024 + 128) * 1024;
 
+// Each session owns a TraceProcessor instance and a thread.
+constexpr size_t kMaxSessions = 16;
+
+// The endpoints which run on the thread of the session.
+constexpr const char* kSessionEndpoints[] = {
+    "/parse",
+    "/notify_eof",
+    "/restore_initial_tables",
+    "/query",
+    "/raw_query",
+    "/compute_metric",
+    "/get_metric_descriptors",
+    "/enable_metatrace",
+    "/disable_and_read_metatrace",
+};
+
+// The endpoints which run a query that can be interrupted.
+constexpr const char* kInterruptibleEndpoints[] = {"/query", "/raw_query",
+                                                   "/compute_metric"};
+
+// A TraceProcessor instance together with the thread that runs all the
+// requests for it. Requests of different sessions run concurrently, the
+// requests of one session run one at a time in the order they were posted.
+// The sessions are identified by the X-Session-Id header of the requests.
+// Requests without it use the default session, which owns the instance (if
+// any) passed to RunHttpRPCServer().
+class Session {
+ public:
+  Session(std::unique_ptr<TraceProcessor> preloaded_instance,
+          const Config& config)
+      : rpc_(std::move(preloaded_instance), config),
+        task_runner_(base::ThreadTaskRunner::CreateAndStart("TPSession")) {}
+
+  // Runs |fn| on the thread of the session. |fn| is skipped if |*cancelled|
+  // is set before it starts. If |interruptible|, the query run by |fn| is
+  // interrupted by calling Cancel() after setting |*cancelled|.
+  void PostRequest(std::shared_ptr<std::atomic<bool>> cancelled,
+                   bool interruptible,
+                   std::function<void(Rpc*)> fn) {
+    task_runner_.PostTask([this, cancelled, interruptible, fn] {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (*cancelled)
+          return;
+        if (interruptible)
+          running_request_ = cancelled.get();
+      }
+      fn(&rpc_);
+      std::string trace_name = rpc_.GetCurrentTraceName();
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_request_ = nullptr;
+      trace_name_ = std::move(trace_name);
+    });
+  }
+
+  // Runs |fn| on the thread of the session after all the requests posted so
+  // far.
+  void PostTask(std::function<void()> fn) { task_runner_.PostTask(fn); }
+
+  // Interrupts the request posted with |cancelled| if it's running. Can be
+  // called from any thread.
+  void Cancel(const std::atomic<bool>* cancelled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_request_ == cancelled)
+      rpc_.InterruptQuery();
+  }
+
+  // Can be called from any thread.
+  std::string trace_name() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return trace_name_;
+  }
+
+ private:
+  // Only accessed on |task_runner_|, with the exception of InterruptQuery()
+  // which is called while holding |mutex_| and is only safe while an
+  // interruptible request is running.
+  Rpc rpc_;
+
+  std::mutex mutex_;
+  const std::atomic<bool>* running_request_ = nullptr;  // Guarded by |mutex_|.
+  std::string trace_name_;                              // Guarded by |mutex_|.
+
+  // Declared last so that the thread is joined before the other members are
+  // destroyed.
+  base::ThreadTaskRunner task_runner_;
+};
+
 // Owns the socket and data for one HTTP client connection.
 struct Client {
-  Client(std::unique_ptr<base::UnixSocket> s)
-      : sock(std::move(s)),
-        rxbuf(base::PagedMemory::Allocate(kMaxRequestSize)) {}
+  Client(uint64_t i, std::unique_ptr<base::UnixSocket> s)
+      : id(i),
+        sock(std::move(s)),
+        rxbuf(base::PagedMemory::Allocate(kMaxRequestSize)),
+        disconnected(new std::atomic<bool>(false)) {}
   size_t rxbuf_avail() { return rxbuf.size() - rxbuf_used; }
 
+  // Used by the session threads to refer to the client, as the client can
+  // disconnect before they reply.
+  uint64_t id = 0;
   std::unique_ptr<base::UnixSocket> sock;
   base::PagedMemory rxbuf;
   size_t rxbuf_used = 0;
+
+  // Set while a request of the client is queued or running on a session
+  // thread. The requests pipelined after it are kept in |rxbuf| until it has
+  // been replied to, so that replies are sent in order.
+  Session* pending_session = nullptr;
+
+  // Set when the client disconnects, to skip or interrupt its pending request.
+  std::shared_ptr<std::atomic<bool>> disconnected;
 };
 
 struct HttpRequest {
   base::StringView method;
   base::StringView uri;
   base::StringView origin;
+  base::StringView session_id;
   base::StringView body;
   int id = 0;
 };
 
 class HttpServer : public base::UnixSocket::EventListener {
  public:
-  explicit HttpServer(std::unique_ptr<TraceProcessor>);
+  HttpServer(std::unique_ptr<TraceProcessor>, const Config&);
   ~HttpServer() override;
   void Run(const char*, const char*);
 
  private:
+  void ParseBufferedRequests(Client* client);
   size_t ParseOneHttpRequest(Client* client);
   void HandleRequest(Client*, const HttpRequest&);
+  Session* GetOrCreateSession(const std::string& session_id);
+  void CloseSession(const std::string& session_id);
+
+  // Called on the thread of a session.
+  void RunSessionRequest(Rpc*,
+                         uint64_t client_id,
+                         const std::string& uri,
+                         const std::string& origin,
+                         const std::string& body);
+
+  // Can be called on any thread. Runs |fn| on the main thread, unless the
+  // client disconnects before that.
+  void PostToClient(uint64_t client_id, std::function<void(Client*)> fn);
+
+  // Marks the pending request of |client| as replied to.
+  void FinishRequest(Client*);
 
   void OnNewIncomingConnection(base::UnixSocket*,
                                std::unique_ptr<base::UnixSocket>) override;
@@ -81,11 +206,21 @@ class HttpServer : public base::UnixSocket::EventListener {
   void OnDisconnect(base::UnixSocket* self) override;
   void OnDataAvailable(base::UnixSocket* self) override;
 
-  Rpc trace_processor_rpc_;
+  // Used by the trace processor instances of all the sessions.
+  const Config config_;
+
   base::UnixTaskRunner task_runner_;
   std::unique_ptr<base::UnixSocket> sock4_;
   std::unique_ptr<base::UnixSocket> sock6_;
   std::vector<Client> clients_;
+  uint64_t last_client_id_ = 0;
+
+  // Declared after |task_runner_| so that their threads, which post tasks on
+  // it, are joined first.
+  std::map<std::string, std::unique_ptr<Session>> sessions_;
+
+  // Sessions which have been closed but still have requests to run.
+  std::vector<std::unique_ptr<Session>> closing_sessions_;
 };
 
 void Append(std::vector<char>& buf, const char* str) {
@@ -96,6 +231,12 @@ void Append(std::vector<char>& buf, const std::string& str) {
   buf.insert(buf.end(), str.begin(), str.end());
 }
 
+bool Contains(const char* const* begin,
+              const char* const* end,
+              base::StringView str) {
+  return std::any_of(begin, end, [str](const char* s) { return str == s; });
+}
+
 void HttpReply(base::UnixSocket* sock,
                const char* http_code,
                std::initializer_list<const char*> headers = {},
@@ -121,14 +262,40 @@ void HttpReply(base::UnixSocket* sock,
     sock->Send(content, content_length);  // Send response payload.
 }
 
+// Replies with the headers used by all the RPC endpoints. Pass
+// |content_length| = kOmitContentLength to start a chunked reply.
+void RpcReply(base::UnixSocket* sock,
+              const char* http_code,
+              const std::string& origin,
+              const uint8_t* content = nullptr,
+              size_t content_length = 0) {
+  std::string allow_origin_hdr = "Access-Control-Allow-Origin: " + origin;
+  const char* transfer_encoding_hdr = content_length == kOmitContentLength
+                                          ? "Transfer-Encoding: chunked"
+                                          : "Transfer-Encoding: identity";
+  HttpReply(sock, http_code,
+            {
+                "Connection: Keep-Alive",                //
+                "Cache-Control: no-cache",               //
+                "Keep-Alive: timeout=5, max=1000",       //
+                "Content-Type: application/x-protobuf",  //
+                transfer_encoding_hdr,                   //
+                allow_origin_hdr.c_str(),
+            },
+            content, content_length);
+}
+
 void ShutdownBadRequest(base::UnixSocket* sock, const char* reason) {
   HttpReply(sock, "500 Bad Request", {},
             reinterpret_cast<const uint8_t*>(reason), strlen(reason));
   sock->Shutdown(/*notify=*/true);
 }
 
-HttpServer::HttpServer(std::unique_ptr<TraceProcessor> preloaded_instance)
-    : trace_processor_rpc_(std::move(preloaded_instance)) {}
+HttpServer::HttpServer(std::unique_ptr<TraceProcessor> preloaded_instance,
+                       const Config& config)
+    : config_(config) {
+  sessions_[""].reset(new Session(std::move(preloaded_instance), config_));
+}
 HttpServer::~HttpServer() = default;
 
 void HttpServer::Run(const char* kBindAddr4, const char* kBindAddr6) {
@@ -160,7 +327,7 @@ void HttpServer::OnNewIncomingConnection(
     base::UnixSocket*,
     std::unique_ptr<base::UnixSocket> sock) {
   PERFETTO_LOG("[HTTP] New connection");
-  clients_.emplace_back(std::move(sock));
+  clients_.emplace_back(++last_client_id_, std::move(sock));
 }
 
 void HttpServer::OnConnect(base::UnixSocket*, bool) {}
@@ -169,6 +336,11 @@ void HttpServer::OnDisconnect(base::UnixSocket* sock) {
   PERFETTO_LOG("[HTTP] Client disconnected");
   for (auto it = clients_.begin(); it != clients_.end(); ++it) {
     if (it->sock.get() == sock) {
+      // Nobody is going to read the reply of the pending request: skip it if
+      // it didn't start yet, interrupt it otherwise.
+      *it->disconnected = true;
+      if (it->pending_session)
+        it->pending_session->Cancel(it->disconnected.get());
       clients_.erase(it);
       return;
     }
@@ -194,9 +366,14 @@ void HttpServer::OnDataAvailable(base::UnixSocket* sock) {
       break;
   }
 
+  ParseBufferedRequests(client);
+}
+
+void HttpServer::ParseBufferedRequests(Client* client) {
   // At this point |rxbuf| can contain a partial HTTP request, a full one or
   // more (in case of HTTP Keepalive pipelining).
-  for (;;) {
+  char* rxbuf = reinterpret_cast<char*>(client->rxbuf.Get());
+  while (!client->pending_session) {
     size_t bytes_consumed = ParseOneHttpRequest(client);
     if (bytes_consumed == 0)
       break;
@@ -249,6 +426,8 @@ size_t HttpServer::ParseOneHttpRequest(Client* client) {
         http_req.origin = hdr_value;
       } else if (hdr_name.CaseInsensitiveEq("x-seq-id")) {
         http_req.id = atoi(hdr_value.ToStdString().c_str());
+      } else if (hdr_name.CaseInsensitiveEq("x-session-id")) {
+        http_req.session_id = hdr_value;
       }
     }
     pos = next + 2;
@@ -273,23 +452,15 @@ void HttpServer::HandleRequest(Client* client, const HttpRequest& req) {
     last_req_id = req.id;
   }
 
-  PERFETTO_LOG("[HTTP] %04d %s %s (body: %zu bytes)", req.id,
+  PERFETTO_LOG("[HTTP] %04d %s %s (session: '%s', body: %zu bytes)", req.id,
                req.method.ToStdString().c_str(), req.uri.ToStdString().c_str(),
-               req.body.size());
-  std::string allow_origin_hdr =
-      "Access-Control-Allow-Origin: " + req.origin.ToStdString();
-
-  // This is the default. Overridden by the /query handler for chunked replies.
-  char transfer_encoding_hdr[255] = "Transfer-Encoding: identity";
-  std::initializer_list<const char*> headers = {
-      "Connection: Keep-Alive",                //
-      "Cache-Control: no-cache",               //
-      "Keep-Alive: timeout=5, max=1000",       //
-      "Content-Type: application/x-protobuf",  //
-      transfer_encoding_hdr,                   //
-      allow_origin_hdr.c_str()};
+               req.session_id.ToStdString().c_str(), req.body.size());
+  std::string origin = req.origin.ToStdString();
+  std::string session_id = req.session_id.ToStdString();
 
   if (req.method == "OPTIONS") {
+    std::string allow_origin_hdr = "Access-Control-Allow-Origin: " + origin;
+
     // CORS headers.
     return HttpReply(client->sock.get(), "204 No Content",
                      {
@@ -300,34 +471,69 @@ void HttpServer::HandleRequest(Client* client, const HttpRequest& req) {
                      });
   }
 
-  if (req.uri == "/parse") {
-    trace_processor_rpc_.Parse(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
-    return HttpReply(client->sock.get(), "200 OK", headers);
+  // Answered here rather than on the thread of the session, so that health
+  // checks don't wait for the trace to be parsed or for queries to finish.
+  if (req.uri == "/status") {
+    auto it = sessions_.find(session_id);
+    protozero::HeapBuffered<protos::pbzero::StatusResult> res;
+    res->set_loaded_trace_name(
+        it == sessions_.end() ? "" : it->second->trace_name().c_str());
+    std::vector<uint8_t> buf = res.SerializeAsArray();
+    return RpcReply(client->sock.get(), "200 OK", origin, buf.data(),
+                    buf.size());
+  }
+
+  // Destroys the TraceProcessor instance of the session once the requests
+  // already sent to it have run.
+  if (req.uri == "/close_session") {
+    CloseSession(session_id);
+    return RpcReply(client->sock.get(), "200 OK", origin);
   }
 
-  if (req.uri == "/notify_eof") {
-    trace_processor_rpc_.NotifyEndOfFile();
-    return HttpReply(client->sock.get(), "200 OK", headers);
+  if (!Contains(std::begin(kSessionEndpoints), std::end(kSessionEndpoints),
+                req.uri)) {
+    return RpcReply(client->sock.get(), "404 Not Found", origin);
   }
 
-  if (req.uri == "/restore_initial_tables") {
-    trace_processor_rpc_.RestoreInitialTables();
-    return HttpReply(client->sock.get(), "200 OK", headers);
+  Session* session = GetOrCreateSession(session_id);
+  if (!session) {
+    PERFETTO_ELOG("[HTTP] Too many sessions, rejecting '%s'",
+                  session_id.c_str());
+    return RpcReply(client->sock.get(), "503 Service Unavailable", origin);
   }
 
+  // Stop parsing the requests of the client until this one is replied to.
+  client->pending_session = session;
+  bool interruptible =
+      Contains(std::begin(kInterruptibleEndpoints),
+               std::end(kInterruptibleEndpoints), req.uri);
+  uint64_t client_id = client->id;
+  std::string uri = req.uri.ToStdString();
+  std::string body = req.body.ToStdString();
+  session->PostRequest(client->disconnected, interruptible,
+                       [this, client_id, uri, origin, body](Rpc* rpc) {
+                         RunSessionRequest(rpc, client_id, uri, origin, body);
+                       });
+}
+
+void HttpServer::RunSessionRequest(Rpc* rpc,
+                                   uint64_t client_id,
+                                   const std::string& uri,
+                                   const std::string& origin,
+                                   const std::string& body) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(body.data());
+  std::vector<uint8_t> res;
+
   // New endpoint, returns data in batches using chunked transfer encoding.
   // The batch size is determined by |cells_per_batch_| and
   // |batch_split_threshold_| in query_result_serializer.h.
   // This is temporary, it will be switched to WebSockets soon.
-  if (req.uri == "/query") {
-    std::vector<uint8_t> response;
-
+  if (uri == "/query") {
     // Start the chunked reply.
-    strncpy(transfer_encoding_hdr, "Transfer-Encoding: chunked",
-            sizeof(transfer_encoding_hdr));
-    base::UnixSocket* cli_sock = client->sock.get();
-    HttpReply(cli_sock, "200 OK", headers, nullptr, kOmitContentLength);
+    PostToClient(client_id, [origin](Client* client) {
+      RpcReply(client->sock.get(), "200 OK", origin, nullptr,
+               kOmitContentLength);
+    });
 
     // |on_result_chunk| will be called nested within the same callstack of the
     // rpc.Query() call. No further calls will be made once Query() returns.
@@ -335,72 +541,112 @@ void HttpServer::HandleRequest(Client* client, const HttpRequest& req) {
       PERFETTO_DLOG("Sending response chunk, len=%zu eof=%d", len, !has_more);
       char chunk_hdr[32];
       auto hdr_len = static_cast<size_t>(sprintf(chunk_hdr, "%zx\r\n", len));
-      cli_sock->Send(chunk_hdr, hdr_len);
-      cli_sock->Send(buf, len);
-      cli_sock->Send("\r\n", 2);
-      if (!has_more) {
-        hdr_len = static_cast<size_t>(sprintf(chunk_hdr, "0\r\n\r\n"));
-        cli_sock->Send(chunk_hdr, hdr_len);
-      }
+      std::string chunk;
+      chunk.reserve(hdr_len + len + 7);
+      chunk.append(chunk_hdr, hdr_len);
+      chunk.append(reinterpret_cast<const char*>(buf), len);
+      chunk.append("\r\n");
+      if (!has_more)
+        chunk.append("0\r\n\r\n");
+      PostToClient(client_id, [this, chunk, has_more](Client* client) {
+        client->sock->Send(chunk.data(), chunk.size());
+        if (!has_more)
+          FinishRequest(client);
+      });
     };
-    trace_processor_rpc_.Query(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size(),
-        on_result_chunk);
+    rpc->Query(data, body.size(), on_result_chunk);
     return;
   }
 
-  // Legacy endpoint.
-  // Returns a columnar-oriented one-shot result. Very inefficient for large
-  // result sets. Very inefficient in general too.
-  if (req.uri == "/raw_query") {
-    std::vector<uint8_t> response = trace_processor_rpc_.RawQuery(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
-    return HttpReply(client->sock.get(), "200 OK", headers, response.data(),
-                     response.size());
+  if (uri == "/parse") {
+    rpc->Parse(data, body.size());
+  } else if (uri == "/notify_eof") {
+    rpc->NotifyEndOfFile();
+  } else if (uri == "/restore_initial_tables") {
+    rpc->RestoreInitialTables();
+  } else if (uri == "/raw_query") {
+    // Legacy endpoint.
+    // Returns a columnar-oriented one-shot result. Very inefficient for large
+    // result sets. Very inefficient in general too.
+    res = rpc->RawQuery(data, body.size());
+  } else if (uri == "/compute_metric") {
+    res = rpc->ComputeMetric(data, body.size());
+  } else if (uri == "/get_metric_descriptors") {
+    res = rpc->GetMetricDescriptors(data, body.size());
+  } else if (uri == "/enable_metatrace") {
+    // The metatrace buffer is global: metatracing is only meaningful while a
+    // single session is running requests.
+    rpc->EnableMetatrace();
+  } else if (uri == "/disable_and_read_metatrace") {
+    res = rpc->DisableAndReadMetatrace();
+  } else {
+    PERFETTO_DFATAL("[HTTP] Unexpected session endpoint %s", uri.c_str());
   }
 
-  if (req.uri == "/status") {
-    protozero::HeapBuffered<protos::pbzero::StatusResult> res;
-    res->set_loaded_trace_name(
-        trace_processor_rpc_.GetCurrentTraceName().c_str());
-    std::vector<uint8_t> buf = res.SerializeAsArray();
-    return HttpReply(client->sock.get(), "200 OK", headers, buf.data(),
-                     buf.size());
-  }
-
-  if (req.uri == "/compute_metric") {
-    std::vector<uint8_t> res = trace_processor_rpc_.ComputeMetric(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
-    return HttpReply(client->sock.get(), "200 OK", headers, res.data(),
-                     res.size());
-  }
+  PostToClient(client_id, [this, origin, res](Client* client) {
+    RpcReply(client->sock.get(), "200 OK", origin, res.data(), res.size());
+    FinishRequest(client);
+  });
+}
 
-  if (req.uri == "/get_metric_descriptors") {
-    std::vector<uint8_t> res = trace_processor_rpc_.GetMetricDescriptors(
-        reinterpret_cast<const uint8_t*>(req.body.data()), req.body.size());
-    return HttpReply(client->sock.get(), "200 OK", headers, res.data(),
-                     res.size());
-  }
+void HttpServer::PostToClient(uint64_t client_id,
+                              std::function<void(Client*)> fn) {
+  task_runner_.PostTask([this, client_id, fn] {
+    for (Client& client : clients_) {
+      if (client.id == client_id)
+        return fn(&client);
+    }
+  });
+}
 
-  if (req.uri == "/enable_metatrace") {
-    trace_processor_rpc_.EnableMetatrace();
-    return HttpReply(client->sock.get(), "200 OK", headers);
-  }
+void HttpServer::FinishRequest(Client* client) {
+  client->pending_session = nullptr;
+  ParseBufferedRequests(client);
+}
 
-  if (req.uri == "/disable_and_read_metatrace") {
-    std::vector<uint8_t> res = trace_processor_rpc_.DisableAndReadMetatrace();
-    return HttpReply(client->sock.get(), "200 OK", headers, res.data(),
-                     res.size());
-  }
+Session* HttpServer::GetOrCreateSession(const std::string& session_id) {
+  auto it = sessions_.find(session_id);
+  if (it != sessions_.end())
+    return it->second.get();
+  if (sessions_.size() >= kMaxSessions)
+    return nullptr;
+  PERFETTO_ILOG("[HTTP] Creating session '%s'", session_id.c_str());
+  std::unique_ptr<Session>& session = sessions_[session_id];
+  session.reset(new Session(nullptr, config_));
+  return session.get();
+}
 
-  return HttpReply(client->sock.get(), "404 Not Found", headers);
+void HttpServer::CloseSession(const std::string& session_id) {
+  auto it = sessions_.find(session_id);
+  if (it == sessions_.end())
+    return;
+  PERFETTO_ILOG("[HTTP] Closing session '%s'", session_id.c_str());
+
+  // The requests for |session_id| received from now on go to a new session.
+  // The old one is destroyed on the main thread once it has run the requests
+  // queued so far, as the clients which sent them refer to it until then.
+  Session* session = it->second.get();
+  closing_sessions_.emplace_back(std::move(it->second));
+  sessions_.erase(it);
+  session->PostTask([this, session] {
+    task_runner_.PostTask([this, session] {
+      auto closing = std::find_if(
+          closing_sessions_.begin(), closing_sessions_.end(),
+          [session](const std::unique_ptr<Session>& s) {
+            return s.get() == session;
+          });
+      PERFETTO_DCHECK(closing != closing_sessions_.end());
+      closing_sessions_.erase(closing);
+    });
+  });
 }
 
 }  // namespace
 
 void RunHttpRPCServer(std::unique_ptr<TraceProcessor> preloaded_instance,
-                      std::string port_number) {
-  HttpServer srv(std::move(preloaded_instance));
+                      std::string port_number,
+                      const Config& config) {
+  HttpServer srv(std::move(preloaded_instance), config);
   std::string port = port_number.empty() ? kBindPort : port_number;
   std::string ipv4_addr = "127.0.0.1:" + port;
   std::string ipv6_addr = "[::1]:" + port;
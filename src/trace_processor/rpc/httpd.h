@@ -20,6 +20,8 @@
 #include <memory>
 #include <string>
 
+#include "perfetto/trace_processor/basic_types.h"
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -29,8 +31,11 @@ class TraceProcessor;
 // It takes control of the calling thread and does not return.
 // The unique_ptr argument is optional. If non-null, the HTTP server will adopt
 // an existing instance with a pre-loaded trace. If null, it will create a new
-// instance when pushing data into the /parse endpoint.
-void RunHttpRPCServer(std::unique_ptr<TraceProcessor>, std::string);
+// instance when pushing data into the /parse endpoint. The instances created by
+// the server use |config|.
+void RunHttpRPCServer(std::unique_ptr<TraceProcessor>,
+                      std::string,
+                      const Config& config = Config());
 
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -16,8 +16,11 @@
 
 #include "src/trace_processor/rpc/proto_ring_buffer.h"
 
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_utils.h"
 
 namespace perfetto {
@@ -90,18 +93,30 @@ void ProtoRingBuffer::Append(const void* data_void, size_t data_len) {
   if (rd_ == wr_)
     rd_ = wr_ = 0;
 
-  // The caller is expected to always issue a ReadMessage() after each Append().
-  PERFETTO_CHECK(!fastpath_.valid());
+  // The caller is expected to always issue ReadMessage() calls after each
+  // Append(), until no more messages are available.
+  PERFETTO_CHECK(fastpath_rd_ == fastpath_end_);
   if (rd_ == wr_) {
-    auto msg = TryReadMessage(data, data + data_len);
-    if (msg.valid() && msg.end() == (data + data_len)) {
-      // Fastpath: in many cases, the underlying stream will effectively
-      // preserve the atomicity of messages for most small messages.
-      // In this case we can avoid the extra buf_ roundtrip and just pass a
-      // pointer to |data| + (proto preamble len).
-      // The next call to ReadMessage)= will return |fastpath_|.
-      fastpath_ = std::move(msg);
-      return;
+    // Fastpath: in many cases, the underlying stream will effectively
+    // preserve the atomicity of messages, or at least pass several of them
+    // at once. In this case we can avoid the extra buf_ roundtrip for the
+    // whole messages and just pass pointers into |data| from ReadMessage().
+    // Only the trailing incomplete message, if any, is copied into buf_.
+    const uint8_t* data_end = data + data_len;
+    const uint8_t* whole_msgs_end = data;
+    for (;;) {
+      auto msg = TryReadMessage(whole_msgs_end, data_end);
+      if (!msg.valid())
+        break;
+      whole_msgs_end = msg.end();
+    }
+    if (whole_msgs_end != data) {
+      fastpath_rd_ = data;
+      fastpath_end_ = whole_msgs_end;
+      data_len = static_cast<size_t>(data_end - whole_msgs_end);
+      data = whole_msgs_end;
+      if (data_len == 0)
+        return;
     }
   }
 
@@ -118,11 +133,13 @@ void ProtoRingBuffer::Append(const void* data_void, size_t data_len) {
     // After recompaction:
     // buf_: [msg1 incomplete]
     //       ^rd_             ^wr_
-    uint8_t* buf = static_cast<uint8_t*>(buf_.Get());
-    memmove(&buf[0], &buf[rd_], wr_ - rd_);
-    avail += rd_;
-    wr_ -= rd_;
-    rd_ = 0;
+    if (rd_ > 0) {
+      uint8_t* buf = static_cast<uint8_t*>(buf_.Get());
+      memmove(&buf[0], &buf[rd_], wr_ - rd_);
+      avail += rd_;
+      wr_ -= rd_;
+      rd_ = 0;
+    }
     if (data_len > avail) {
       // The compaction didn't free up enough space and we need to expand the
       // ring buffer. Yes, we could have detected this earlier and split the
@@ -130,15 +147,16 @@ void ProtoRingBuffer::Append(const void* data_void, size_t data_len) {
       // sufficient. However, that would make the code harder to reason about,
       // creating code paths that are nearly never hit, hence making it more
       // likely to accumulate bugs in future. All this is very rare.
-      size_t new_size = buf_.size();
-      while (data_len > new_size - wr_)
-        new_size += kGrowBytes;
-      if (new_size > kMaxMsgSize * 2) {
+      size_t min_size = wr_ + data_len;
+      if (min_size > kMaxMsgSize * 2) {
         failed_ = true;
         return;
       }
+      size_t new_size =
+          std::max(buf_.size() * 2, base::AlignUp<kGrowBytes>(min_size));
+      new_size = std::min(new_size, kMaxMsgSize * 2);
       auto new_buf = base::PagedMemory::Allocate(new_size);
-      memcpy(new_buf.Get(), buf_.Get(), buf_.size());
+      memcpy(new_buf.Get(), buf_.Get(), wr_);
       buf_ = std::move(new_buf);
       avail = new_size - wr_;
       // No need to touch rd_ / wr_ cursors.
@@ -155,11 +173,14 @@ ProtoRingBuffer::Message ProtoRingBuffer::ReadMessage() {
   if (failed_)
     return FramingError();
 
-  if (fastpath_.valid()) {
-    // The fastpath can only be hit when the buffer is empty.
-    PERFETTO_CHECK(rd_ == wr_);
-    auto msg = std::move(fastpath_);
-    fastpath_ = Message{};
+  if (fastpath_rd_ != fastpath_end_) {
+    // The messages were all validated by Append(), and come before whatever
+    // was copied into buf_.
+    auto msg = TryReadMessage(fastpath_rd_, fastpath_end_);
+    PERFETTO_CHECK(msg.valid());
+    fastpath_rd_ = msg.end();
+    if (fastpath_rd_ == fastpath_end_)
+      fastpath_rd_ = fastpath_end_ = nullptr;
     return msg;
   }
 
@@ -90,9 +90,16 @@ namespace trace_processor {
 // happens (very frequent) we can just reset both cursors to 0 and restart.
 // If we are unlucky and get to the end of the buffer, two things happen:
 // 1. We try first to recompact the buffer, moving everything left by R.
-// 2. If still there isn't enough space, we expand the buffer.
+// 2. If still there isn't enough space, we expand the buffer, doubling its
+//    size so that a large message arriving in many small fragments is only
+//    copied a logarithmic number of times.
 // Given that each message is expected to be at most kMaxMsgSize (64 MB), the
 // expansion is bound at 2 * kMaxMsgSize.
+//
+// Fastpath: when the buffer is empty, the whole messages at the start of the
+// appended data are not copied at all. ReadMessage() returns them pointing
+// into the data passed to Append(), and only the incomplete message at the
+// end (if any) is copied into the buffer.
 class ProtoRingBuffer {
  public:
   static constexpr size_t kMaxMsgSize = 64 * 1024 * 1024;
@@ -118,7 +125,9 @@ class ProtoRingBuffer {
   // (without including the preamble) and advances the read cursor.
   // If no message is avaiable, returns a null range.
   // The returned pointer is only valid until the next call to Append(), as
-  // that can recompact or resize the underlying buffer.
+  // that can recompact or resize the underlying buffer. It can also point into
+  // the data passed to the last Append() (see the fastpath above), which must
+  // then stay valid until ReadMessage() has returned an invalid message.
   Message ReadMessage();
 
   // Exposed for testing.
@@ -127,7 +136,10 @@ class ProtoRingBuffer {
 
  private:
   base::PagedMemory buf_;
-  Message fastpath_{};
+  // The whole messages in the data passed to the last Append() which haven't
+  // been read yet, when that hit the fastpath.
+  const uint8_t* fastpath_rd_ = nullptr;
+  const uint8_t* fastpath_end_ = nullptr;
   bool failed_ = false;  // Set in case of an unrecoverable framing faiulre.
   size_t rd_ = 0;        // Offset of the read cursor in |buf_|.
   size_t wr_ = 0;        // Offset of the write cursor in |buf_|.
@@ -126,6 +126,32 @@ TEST_F(ProtoRingBufferTest, Fastpath) {
   }
 }
 
+// Test that the whole messages at the start of an append are not copied, even
+// when followed by other messages or by an incomplete one.
+TEST_F(ProtoRingBufferTest, FastpathMultipleMessages) {
+  ProtoRingBuffer buf;
+  last_msg_.reserve(1024);
+  std::vector<ProtoRingBuffer::Message> expected;
+  for (uint32_t i = 1; i <= 4; i++)
+    expected.emplace_back(MakeProtoMessage(i, 100, /*append=*/true));
+
+  // Leave out the last 10 bytes of the 4th message.
+  buf.Append(last_msg_.data(), last_msg_.size() - 10);
+  for (uint32_t i = 0; i < 3; i++) {
+    auto msg = buf.ReadMessage();
+    ASSERT_TRUE(msg.valid());
+    EXPECT_EQ(msg.start, expected[i].start);  // Should point to the same buf.
+    EXPECT_EQ(msg, expected[i]);
+  }
+  EXPECT_FALSE(buf.ReadMessage().valid());
+
+  buf.Append(last_msg_.data() + last_msg_.size() - 10, 10);
+  auto msg = buf.ReadMessage();
+  ASSERT_TRUE(msg.valid());
+  EXPECT_EQ(msg, expected[3]);
+  EXPECT_FALSE(buf.ReadMessage().valid());
+}
+
 TEST_F(ProtoRingBufferTest, CoalescingStream) {
   ProtoRingBuffer buf;
   last_msg_.reserve(1024);
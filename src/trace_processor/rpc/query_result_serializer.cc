@@ -16,8 +16,12 @@
 
 #include "src/trace_processor/rpc/query_result_serializer.h"
 
+#include <string.h>
+
+#include <unordered_map>
 #include <vector>
 
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -32,10 +36,13 @@ namespace {
 
 namespace pu = ::protozero::proto_utils;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
+using ColumnarBatchProto = protos::pbzero::QueryResult::ColumnarBatch;
+using ColumnProto = protos::pbzero::QueryResult::ColumnarBatch::Column;
 using ResultProto = protos::pbzero::QueryResult;
 
-// The reserved field in trace_processor.proto.
+// The reserved fields in trace_processor.proto.
 static constexpr uint32_t kPaddingFieldId = 7;
+static constexpr uint32_t kColumnPaddingFieldId = 11;
 
 uint8_t MakeLenDelimTag(uint32_t field_num) {
   uint32_t tag = pu::MakeTagLengthDelimited(field_num);
@@ -43,10 +50,218 @@ uint8_t MakeLenDelimTag(uint32_t field_num) {
   return static_cast<uint8_t>(tag);
 }
 
+// Appends |data| as the length delimited field |field_id| of |msg|, so that
+// the payload starts at a 64-bit aligned offset of |writer|. This allows JS to
+// access the payload by overlaying a TypedArray, without extra copies. The gap
+// is filled with the varint field |padding_field_id|.
+void AppendAligned(protozero::Message* msg,
+                   const protozero::ScatteredStreamWriter& writer,
+                   uint32_t field_id,
+                   uint32_t padding_field_id,
+                   const void* data,
+                   uint32_t size) {
+  uint8_t preamble[16];
+  uint8_t* preamble_end = &preamble[0];
+  *(preamble_end++) = MakeLenDelimTag(field_id);
+  preamble_end = pu::WriteVarInt(size, preamble_end);
+  uint32_t preamble_size = static_cast<uint32_t>(preamble_end - &preamble[0]);
+
+  // The byte after the preamble must start at a 64bit-aligned offset.
+  // The padding needs to be > 1 Byte because of proto encoding.
+  const uint32_t off = static_cast<uint32_t>(writer.written() + preamble_size);
+  const uint32_t aligned_off = (off + 7) & ~7u;
+  uint32_t padding = aligned_off - off;
+  padding = padding == 1 ? 9 : padding;
+  if (padding > 0) {
+    uint8_t pad_buf[10];
+    uint8_t* pad = pad_buf;
+    *(pad++) = pu::MakeTagVarInt(padding_field_id);
+    for (uint32_t i = 0; i < padding - 2; i++)
+      *(pad++) = 0x80;
+    *(pad++) = 0;
+    msg->AppendRawProtoBytes(pad_buf, static_cast<size_t>(pad - pad_buf));
+  }
+  msg->AppendRawProtoBytes(preamble, preamble_size);
+  PERFETTO_CHECK(writer.written() % 8 == 0);
+  msg->AppendRawProtoBytes(data, size);
+}
+
+template <typename T>
+void AppendAligned(ColumnProto* column,
+                   const protozero::ScatteredStreamWriter& writer,
+                   uint32_t field_id,
+                   const std::vector<T>& values) {
+  AppendAligned(column, writer, field_id, kColumnPaddingFieldId, values.data(),
+                static_cast<uint32_t>(values.size() * sizeof(T)));
+}
+
+// Accumulates the cells of one column of a ColumnarBatch. The buffer of each
+// type of value is only allocated once a cell of that type is appended, and is
+// padded with zeros up to the row of that cell.
+class ColumnBuilder {
+ public:
+  // Returns a guess of the number of bytes taken by |value|.
+  uint32_t Append(const SqlValue& value);
+  void Serialize(ColumnProto*, const protozero::ScatteredStreamWriter&);
+
+ private:
+  int32_t InternString(const char* str, uint32_t size);
+
+  uint32_t num_rows_ = 0;
+  uint32_t types_seen_ = 0;  // Bitmask of (1 << CellType).
+  std::vector<uint8_t> cell_types_;
+  std::vector<int64_t> int64_values_;
+  std::vector<double> float64_values_;
+  std::vector<int32_t> string_indices_;
+  std::vector<int32_t> string_dictionary_offsets_{0};
+  std::vector<uint8_t> string_dictionary_data_;
+  // Maps the hash of a string to its index in the dictionary.
+  std::unordered_map<uint64_t, int32_t> string_dictionary_;
+  std::vector<int32_t> blob_offsets_;
+  std::vector<uint8_t> blob_data_;
+};
+
+uint32_t ColumnBuilder::Append(const SqlValue& value) {
+  uint32_t row = num_rows_++;
+  uint8_t cell_type = BatchProto::CELL_INVALID;
+  uint32_t approx_size = 0;
+  switch (value.type) {
+    case SqlValue::Type::kNull: {
+      cell_type = BatchProto::CELL_NULL;
+      break;
+    }
+    case SqlValue::Type::kLong: {
+      cell_type = BatchProto::CELL_VARINT;
+      int64_values_.resize(row);
+      int64_values_.push_back(value.long_value);
+      approx_size = sizeof(int64_t);
+      break;
+    }
+    case SqlValue::Type::kDouble: {
+      cell_type = BatchProto::CELL_FLOAT64;
+      float64_values_.resize(row);
+      float64_values_.push_back(value.double_value);
+      approx_size = sizeof(double);
+      break;
+    }
+    case SqlValue::Type::kString: {
+      cell_type = BatchProto::CELL_STRING;
+      uint32_t size = static_cast<uint32_t>(strlen(value.string_value));
+      string_indices_.resize(row);
+      string_indices_.push_back(InternString(value.string_value, size));
+      approx_size = size + sizeof(int32_t);
+      break;
+    }
+    case SqlValue::Type::kBytes: {
+      cell_type = BatchProto::CELL_BLOB;
+      auto* src = static_cast<const uint8_t*>(value.bytes_value);
+      blob_offsets_.resize(row + 1, static_cast<int32_t>(blob_data_.size()));
+      blob_data_.insert(blob_data_.end(), src, src + value.bytes_count);
+      approx_size = static_cast<uint32_t>(value.bytes_count) + sizeof(int32_t);
+      break;
+    }
+  }
+  PERFETTO_DCHECK(cell_type != BatchProto::CELL_INVALID);
+  cell_types_.push_back(cell_type);
+  types_seen_ |= 1u << cell_type;
+  return approx_size;
+}
+
+int32_t ColumnBuilder::InternString(const char* str, uint32_t size) {
+  auto next_index = static_cast<int32_t>(string_dictionary_offsets_.size() - 1);
+  base::Hash hasher;
+  hasher.Update(str, size);
+  auto it_and_inserted =
+      string_dictionary_.emplace(hasher.digest(), next_index);
+  if (!it_and_inserted.second) {
+    int32_t index = it_and_inserted.first->second;
+    const int32_t* offsets = &string_dictionary_offsets_[0];
+    size_t begin = static_cast<size_t>(offsets[index]);
+    size_t end = static_cast<size_t>(offsets[index + 1]);
+    if (end - begin == size &&
+        (size == 0 ||
+         memcmp(string_dictionary_data_.data() + begin, str, size) == 0)) {
+      return index;
+    }
+    // On hash collisions the string is added again, Arrow allows duplicate
+    // dictionary entries.
+  }
+  const auto* data = reinterpret_cast<const uint8_t*>(str);
+  string_dictionary_data_.insert(string_dictionary_data_.end(), data,
+                                 data + size);
+  string_dictionary_offsets_.push_back(
+      static_cast<int32_t>(string_dictionary_data_.size()));
+  return next_index;
+}
+
+void ColumnBuilder::Serialize(ColumnProto* column,
+                              const protozero::ScatteredStreamWriter& writer) {
+  const uint32_t non_null_types = types_seen_ & ~(1u << BatchProto::CELL_NULL);
+  auto has_type = [this](uint8_t cell_type) {
+    return (types_seen_ & (1u << cell_type)) != 0;
+  };
+
+  ColumnProto::Type type = ColumnProto::TYPE_MIXED;
+  if (non_null_types == 0) {
+    type = ColumnProto::TYPE_NULL;
+  } else if (non_null_types == 1u << BatchProto::CELL_VARINT) {
+    type = ColumnProto::TYPE_INT64;
+  } else if (non_null_types == 1u << BatchProto::CELL_FLOAT64) {
+    type = ColumnProto::TYPE_FLOAT64;
+  } else if (non_null_types == 1u << BatchProto::CELL_STRING) {
+    type = ColumnProto::TYPE_STRING;
+  } else if (non_null_types == 1u << BatchProto::CELL_BLOB) {
+    type = ColumnProto::TYPE_BLOB;
+  }
+  column->set_type(type);
+
+  if (has_type(BatchProto::CELL_NULL) && type != ColumnProto::TYPE_NULL) {
+    std::vector<uint8_t> validity((num_rows_ + 7) / 8);
+    for (uint32_t row = 0; row < num_rows_; ++row) {
+      if (cell_types_[row] != BatchProto::CELL_NULL)
+        validity[row / 8] |= static_cast<uint8_t>(1u << (row % 8));
+    }
+    column->set_validity(validity.data(), validity.size());
+  }
+  if (type == ColumnProto::TYPE_MIXED)
+    column->set_cell_types(cell_types_.data(), cell_types_.size());
+
+  if (has_type(BatchProto::CELL_VARINT)) {
+    int64_values_.resize(num_rows_);
+    AppendAligned(column, writer, ColumnProto::kInt64ValuesFieldNumber,
+                  int64_values_);
+  }
+  if (has_type(BatchProto::CELL_FLOAT64)) {
+    float64_values_.resize(num_rows_);
+    AppendAligned(column, writer, ColumnProto::kFloat64ValuesFieldNumber,
+                  float64_values_);
+  }
+  if (has_type(BatchProto::CELL_STRING)) {
+    string_indices_.resize(num_rows_);
+    AppendAligned(column, writer, ColumnProto::kStringIndicesFieldNumber,
+                  string_indices_);
+    AppendAligned(column, writer,
+                  ColumnProto::kStringDictionaryOffsetsFieldNumber,
+                  string_dictionary_offsets_);
+    column->set_string_dictionary_data(string_dictionary_data_.data(),
+                                       string_dictionary_data_.size());
+  }
+  if (has_type(BatchProto::CELL_BLOB)) {
+    blob_offsets_.resize(num_rows_ + 1,
+                         static_cast<int32_t>(blob_data_.size()));
+    AppendAligned(column, writer, ColumnProto::kBlobOffsetsFieldNumber,
+                  blob_offsets_);
+    column->set_blob_data(blob_data_.data(), blob_data_.size());
+  }
+}
+
 }  // namespace
 
-QueryResultSerializer::QueryResultSerializer(Iterator iter)
-    : iter_(iter.take_impl()), num_cols_(iter_->ColumnCount()) {}
+QueryResultSerializer::QueryResultSerializer(Iterator iter,
+                                             BatchFormat batch_format)
+    : iter_(iter.take_impl()),
+      num_cols_(iter_->ColumnCount()),
+      batch_format_(batch_format) {}
 
 QueryResultSerializer::~QueryResultSerializer() = default;
 
@@ -71,7 +286,11 @@ bool QueryResultSerializer::Serialize(protos::pbzero::QueryResult* res) {
   // write an empty batch with the EOF marker. Errors can happen also in the
   // middle of a query, not just before starting it.
 
-  SerializeBatch(res);
+  if (batch_format_ == BatchFormat::kColumnar) {
+    SerializeColumnarBatch(res);
+  } else {
+    SerializeBatch(res);
+  }
   MaybeSerializeError(res);
   return !eof_reached_;
 }
@@ -206,32 +425,9 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   // a TypedArray, without extra copies.
   const uint32_t doubles_size = static_cast<uint32_t>(doubles.size());
   if (doubles_size > 0) {
-    uint8_t preamble[16];
-    uint8_t* preamble_end = &preamble[0];
-    *(preamble_end++) = MakeLenDelimTag(BatchProto::kFloat64CellsFieldNumber);
-    preamble_end = pu::WriteVarInt(doubles_size, preamble_end);
-    uint32_t preamble_size = static_cast<uint32_t>(preamble_end - &preamble[0]);
-
-    // The byte after the preamble must start at a 64bit-aligned offset.
-    // The padding needs to be > 1 Byte because of proto encoding.
-    const uint32_t off =
-        static_cast<uint32_t>(writer.written() + preamble_size);
-    const uint32_t aligned_off = (off + 7) & ~7u;
-    uint32_t padding = aligned_off - off;
-    padding = padding == 1 ? 9 : padding;
-    if (padding > 0) {
-      uint8_t pad_buf[10];
-      uint8_t* pad = pad_buf;
-      *(pad++) = pu::MakeTagVarInt(kPaddingFieldId);
-      for (uint32_t i = 0; i < padding - 2; i++)
-        *(pad++) = 0x80;
-      *(pad++) = 0;
-      batch->AppendRawProtoBytes(pad_buf, static_cast<size_t>(pad - pad_buf));
-    }
-    batch->AppendRawProtoBytes(preamble, preamble_size);
-    PERFETTO_CHECK(writer.written() % 8 == 0);
-    batch->AppendRawProtoBytes(doubles.data(), doubles_size);
-  }  // if (doubles_size > 0)
+    AppendAligned(batch, writer, BatchProto::kFloat64CellsFieldNumber,
+                  kPaddingFieldId, doubles.data(), doubles_size);
+  }
 
   // Append the blobs.
   batch->AppendRawProtoBytes(blobs.data(), blobs.size());
@@ -246,6 +442,49 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   batch->Finalize();
 }
 
+void QueryResultSerializer::SerializeColumnarBatch(
+    protos::pbzero::QueryResult* res) {
+  const auto& writer = *res->stream_writer();
+  auto* batch = res->add_columnar_batch();
+
+  // The cells are buffered column by column and written once the batch is
+  // full, as each column is contiguous in the output.
+  std::vector<ColumnBuilder> columns(num_cols_);
+  uint32_t approx_batch_size = 16;
+  uint32_t num_rows = 0;
+  bool batch_full = false;
+  for (;; ++num_rows) {
+    // Like in SerializeBatch(), |col_| == 0 means that the iterator has
+    // already been moved to a row which didn't fit in the previous batch.
+    if (col_ >= num_cols_) {
+      col_ = 0;
+      if (!iter_->Next())
+        break;  // EOF or error.
+    }
+    PERFETTO_DCHECK(num_cols_ > 0);
+    // At least one row is written per batch, even if it has more cells than
+    // |cells_per_batch_|.
+    if (num_rows > 0 && ((num_rows + 1) * num_cols_ > cells_per_batch_ ||
+                         approx_batch_size > batch_split_threshold_)) {
+      batch_full = true;
+      break;
+    }
+    for (; col_ < num_cols_; ++col_)
+      approx_batch_size += columns[col_].Append(iter_->Get(col_));
+  }
+
+  batch->set_num_rows(num_rows);
+  for (ColumnBuilder& column : columns)
+    column.Serialize(batch->add_columns(), writer);
+
+  // If this is the last batch, write the EOF field.
+  if (!batch_full) {
+    eof_reached_ = true;
+    batch->set_is_last_batch(true);
+  }
+  batch->Finalize();
+}
+
 void QueryResultSerializer::MaybeSerializeError(
     protos::pbzero::QueryResult* res) {
   if (iter_->Status().ok())
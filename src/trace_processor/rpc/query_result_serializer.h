@@ -53,7 +53,14 @@ class IteratorImpl;
 // chunked-encoded HTTP response, or through a repetition of Wasm calls.
 class QueryResultSerializer {
  public:
-  explicit QueryResultSerializer(Iterator);
+  // See RawQueryArgs.BatchFormat in trace_processor.proto.
+  enum class BatchFormat {
+    kCells,     // Writes QueryResult.batch.
+    kColumnar,  // Writes QueryResult.columnar_batch.
+  };
+
+  explicit QueryResultSerializer(Iterator,
+                                 BatchFormat = BatchFormat::kCells);
   ~QueryResultSerializer();
 
   // No copy or move.
@@ -77,10 +84,12 @@ class QueryResultSerializer {
  private:
   void SerializeColumnNames(protos::pbzero::QueryResult*);
   void SerializeBatch(protos::pbzero::QueryResult*);
+  void SerializeColumnarBatch(protos::pbzero::QueryResult*);
   void MaybeSerializeError(protos::pbzero::QueryResult*);
 
   std::unique_ptr<IteratorImpl> iter_;
   const uint32_t num_cols_;
+  const BatchFormat batch_format_;
   bool did_write_column_names_ = false;
   bool eof_reached_ = false;
   uint32_t col_ = UINT32_MAX;
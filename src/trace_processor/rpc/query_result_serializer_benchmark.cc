@@ -24,6 +24,7 @@
 using perfetto::trace_processor::Config;
 using perfetto::trace_processor::QueryResultSerializer;
 using perfetto::trace_processor::TraceProcessor;
+using BatchFormat = QueryResultSerializer::BatchFormat;
 using VectorType = std::vector<uint8_t>;
 
 namespace {
@@ -46,19 +47,15 @@ void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
   PERFETTO_CHECK(iter.Status().ok());
 }
 
-}  // namespace
 
-static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
-  auto tp = TraceProcessor::CreateInstance(Config());
-  RunQueryChecked(tp.get(), "create virtual table win using window;");
-  RunQueryChecked(tp.get(),
-                  "update win set window_start=0, window_dur=50000, quantum=1 "
-                  "where rowid = 0");
+void SerializeQuery(benchmark::State& state,
+                    TraceProcessor* tp,
+                    const std::string& query,
+                    BatchFormat format) {
   VectorType buf;
   for (auto _ : state) {
-    auto iter = tp->ExecuteQuery(
-        "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win");
-    QueryResultSerializer serializer(std::move(iter));
+    auto iter = tp->ExecuteQuery(query);
+    QueryResultSerializer serializer(std::move(iter), format);
     serializer.set_batch_size_for_testing(
         static_cast<uint32_t>(state.range(0)),
         static_cast<uint32_t>(state.range(1)));
@@ -70,27 +67,48 @@ static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
   benchmark::ClobberMemory();
 }
 
-static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
+void BenchmarkMixed(benchmark::State& state, BatchFormat format) {
+  auto tp = TraceProcessor::CreateInstance(Config());
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=50000, quantum=1 "
+                  "where rowid = 0");
+  SerializeQuery(
+      state, tp.get(),
+      "select dur || dur as x, ts, dur * 1.0 as dur, quantum_ts from win",
+      format);
+}
+
+void BenchmarkStrings(benchmark::State& state, BatchFormat format) {
   auto tp = TraceProcessor::CreateInstance(Config());
   RunQueryChecked(tp.get(), "create virtual table win using window;");
   RunQueryChecked(tp.get(),
                   "update win set window_start=0, window_dur=100000, quantum=1 "
                   "where rowid = 0");
-  VectorType buf;
-  for (auto _ : state) {
-    auto iter = tp->ExecuteQuery(
-        "select  ts || '-' || ts , (dur * 1.0) || dur from win");
-    QueryResultSerializer serializer(std::move(iter));
-    serializer.set_batch_size_for_testing(
-        static_cast<uint32_t>(state.range(0)),
-        static_cast<uint32_t>(state.range(1)));
-    while (serializer.Serialize(&buf)) {
-    }
-    benchmark::DoNotOptimize(buf.data());
-    buf.clear();
-  }
-  benchmark::ClobberMemory();
+  SerializeQuery(state, tp.get(),
+                 "select  ts || '-' || ts , (dur * 1.0) || dur from win",
+                 format);
+}
+
+}  // namespace
+
+static void BM_QueryResultSerializer_Mixed(benchmark::State& state) {
+  BenchmarkMixed(state, BatchFormat::kCells);
+}
+
+static void BM_QueryResultSerializer_MixedColumnar(benchmark::State& state) {
+  BenchmarkMixed(state, BatchFormat::kColumnar);
+}
+
+static void BM_QueryResultSerializer_Strings(benchmark::State& state) {
+  BenchmarkStrings(state, BatchFormat::kCells);
+}
+
+static void BM_QueryResultSerializer_StringsColumnar(benchmark::State& state) {
+  BenchmarkStrings(state, BatchFormat::kColumnar);
 }
 
 BENCHMARK(BM_QueryResultSerializer_Mixed)->Apply(BenchmarkArgs);
+BENCHMARK(BM_QueryResultSerializer_MixedColumnar)->Apply(BenchmarkArgs);
 BENCHMARK(BM_QueryResultSerializer_Strings)->Apply(BenchmarkArgs);
+BENCHMARK(BM_QueryResultSerializer_StringsColumnar)->Apply(BenchmarkArgs);
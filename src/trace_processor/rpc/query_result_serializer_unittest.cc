@@ -70,9 +70,14 @@ inline std::ostream& operator<<(std::ostream& stream, const SqlValue& v) {
 namespace {
 
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using BatchFormat = QueryResultSerializer::BatchFormat;
 using BatchProto = protos::pbzero::QueryResult::CellsBatch;
+using ColumnProto = protos::pbzero::QueryResult::ColumnarBatch::Column;
 using ResultProto = protos::pbzero::QueryResult;
 
+const BatchFormat kAllFormats[] = {BatchFormat::kCells, BatchFormat::kColumnar};
+
 void RunQueryChecked(TraceProcessor* tp, const std::string& query) {
   auto iter = tp->ExecuteQuery(query);
   iter.Next();
@@ -87,13 +92,32 @@ class TestDeserializer {
 
   std::vector<std::string> columns;
   std::vector<SqlValue> cells;
+  std::vector<ColumnProto::Type> column_types;  // Of the last columnar batch.
   std::string error;
   bool eof_reached = false;
 
  private:
+  void DeserializeColumn(const uint8_t* start,
+                         protozero::ConstBytes column_bytes,
+                         uint32_t num_rows,
+                         std::vector<SqlValue>* values);
+  SqlValue CopyString(const std::string&);
+  SqlValue CopyBytes(const std::string&);
+
   std::vector<std::unique_ptr<char[]>> copied_buf_;
 };
 
+template <typename T>
+std::vector<T> ReadArray(const uint8_t* start, protozero::ConstBytes bytes) {
+  // The buffers of the fixed size values must be 64-bit aligned.
+  EXPECT_EQ((bytes.data - start) % 8, 0);
+  EXPECT_EQ(bytes.size % sizeof(T), 0u);
+  std::vector<T> values(bytes.size / sizeof(T));
+  if (bytes.size)
+    memcpy(values.data(), bytes.data, bytes.size);
+  return values;
+}
+
 void TestDeserializer::SerializeAndDeserialize(
     QueryResultSerializer* serializer) {
   std::vector<uint8_t> buf;
@@ -105,12 +129,122 @@ void TestDeserializer::SerializeAndDeserialize(
   }
 }
 
+SqlValue TestDeserializer::CopyString(const std::string& str) {
+  copied_buf_.emplace_back(new char[str.size() + 1]);
+  char* new_buf = copied_buf_.back().get();
+  memcpy(new_buf, str.c_str(), str.size() + 1);
+  return SqlValue::String(new_buf);
+}
+
+SqlValue TestDeserializer::CopyBytes(const std::string& bytes) {
+  copied_buf_.emplace_back(new char[bytes.size()]);
+  memcpy(copied_buf_.back().get(), bytes.data(), bytes.size());
+  return SqlValue::Bytes(copied_buf_.back().get(), bytes.size());
+}
+
+void TestDeserializer::DeserializeColumn(const uint8_t* start,
+                                         protozero::ConstBytes column_bytes,
+                                         uint32_t num_rows,
+                                         std::vector<SqlValue>* values) {
+  ColumnProto::Decoder column(column_bytes);
+  auto type = static_cast<ColumnProto::Type>(column.type());
+  column_types.push_back(type);
+
+  std::string validity = column.validity().ToStdString();
+  std::string cell_types = column.cell_types().ToStdString();
+  auto int64s = ReadArray<int64_t>(start, column.int64_values());
+  auto float64s = ReadArray<double>(start, column.float64_values());
+  auto indices = ReadArray<int32_t>(start, column.string_indices());
+  auto dict_offsets =
+      ReadArray<int32_t>(start, column.string_dictionary_offsets());
+  std::string dict_data = column.string_dictionary_data().ToStdString();
+  auto blob_offsets = ReadArray<int32_t>(start, column.blob_offsets());
+  std::string blob_data = column.blob_data().ToStdString();
+
+  if (!validity.empty())
+    ASSERT_EQ(validity.size(), (num_rows + 7) / 8);
+  if (type == ColumnProto::TYPE_MIXED)
+    ASSERT_EQ(cell_types.size(), num_rows);
+  for (uint32_t row = 0; row < num_rows; ++row) {
+    bool is_valid = type != ColumnProto::TYPE_NULL &&
+                    (validity.empty() || (validity[row / 8] >> (row % 8)) & 1);
+    uint8_t cell_type = BatchProto::CELL_NULL;
+    if (!is_valid) {
+      cell_type = BatchProto::CELL_NULL;
+    } else if (type == ColumnProto::TYPE_MIXED) {
+      cell_type = static_cast<uint8_t>(cell_types[row]);
+    } else if (type == ColumnProto::TYPE_INT64) {
+      cell_type = BatchProto::CELL_VARINT;
+    } else if (type == ColumnProto::TYPE_FLOAT64) {
+      cell_type = BatchProto::CELL_FLOAT64;
+    } else if (type == ColumnProto::TYPE_STRING) {
+      cell_type = BatchProto::CELL_STRING;
+    } else if (type == ColumnProto::TYPE_BLOB) {
+      cell_type = BatchProto::CELL_BLOB;
+    }
+    switch (cell_type) {
+      case BatchProto::CELL_NULL:
+        values->emplace_back(SqlValue());
+        break;
+      case BatchProto::CELL_VARINT:
+        ASSERT_EQ(int64s.size(), num_rows);
+        values->emplace_back(SqlValue::Long(int64s[row]));
+        break;
+      case BatchProto::CELL_FLOAT64:
+        ASSERT_EQ(float64s.size(), num_rows);
+        values->emplace_back(SqlValue::Double(float64s[row]));
+        break;
+      case BatchProto::CELL_STRING: {
+        ASSERT_EQ(indices.size(), num_rows);
+        auto index = static_cast<size_t>(indices[row]);
+        ASSERT_LT(index + 1, dict_offsets.size());
+        auto begin = static_cast<size_t>(dict_offsets[index]);
+        auto end = static_cast<size_t>(dict_offsets[index + 1]);
+        ASSERT_LE(end, dict_data.size());
+        values->emplace_back(CopyString(dict_data.substr(begin, end - begin)));
+        break;
+      }
+      case BatchProto::CELL_BLOB: {
+        ASSERT_EQ(blob_offsets.size(), num_rows + 1);
+        auto begin = static_cast<size_t>(blob_offsets[row]);
+        auto end = static_cast<size_t>(blob_offsets[row + 1]);
+        ASSERT_LE(end, blob_data.size());
+        values->emplace_back(CopyBytes(blob_data.substr(begin, end - begin)));
+        break;
+      }
+      default:
+        FAIL() << "Unknown cell type " << cell_type;
+    }
+  }
+}
+
 void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
   ResultProto::Decoder result(start, size);
   error += result.error().ToStdString();
   for (auto it = result.column_names(); it; ++it)
     columns.push_back(it->as_std_string());
 
+  for (auto batch_it = result.columnar_batch(); batch_it; ++batch_it) {
+    ASSERT_FALSE(eof_reached);
+    ResultProto::ColumnarBatch::Decoder batch(batch_it->as_bytes());
+    eof_reached = batch.is_last_batch();
+    uint32_t num_rows = batch.num_rows();
+
+    // Deserialize column by column and then transpose into |cells|.
+    column_types.clear();
+    std::vector<std::vector<SqlValue>> batch_columns;
+    for (auto it = batch.columns(); it; ++it) {
+      batch_columns.emplace_back();
+      DeserializeColumn(start, *it, num_rows, &batch_columns.back());
+      ASSERT_EQ(batch_columns.back().size(), num_rows);
+    }
+    ASSERT_EQ(batch_columns.size(), columns.size());
+    for (uint32_t row = 0; row < num_rows; ++row) {
+      for (const auto& column : batch_columns)
+        cells.emplace_back(column[row]);
+    }
+  }
+
   for (auto batch_it = result.batch(); batch_it; ++batch_it) {
     ASSERT_FALSE(eof_reached);
     auto batch_bytes = batch_it->as_bytes();
@@ -161,21 +295,13 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
           break;
         case BatchProto::CELL_STRING: {
           ASSERT_GT(strings.size(), 0u);
-          const std::string& str = strings.front();
-          copied_buf_.emplace_back(new char[str.size() + 1]);
-          char* new_buf = copied_buf_.back().get();
-          memcpy(new_buf, str.c_str(), str.size() + 1);
-          cells.emplace_back(SqlValue::String(new_buf));
+          cells.emplace_back(CopyString(strings.front()));
           strings.pop_front();
           break;
         }
         case BatchProto::CELL_BLOB: {
           ASSERT_GT(blobs.size(), 0u);
-          auto bytes = blobs.front();
-          copied_buf_.emplace_back(new char[bytes.size()]);
-          memcpy(copied_buf_.back().get(), bytes.data(), bytes.size());
-          cells.emplace_back(
-              SqlValue::Bytes(copied_buf_.back().get(), bytes.size()));
+          cells.emplace_back(CopyBytes(blobs.front()));
           blobs.pop_front();
           break;
         }
@@ -196,20 +322,22 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
 TEST(QueryResultSerializerTest, ShortBatch) {
   auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
 
-  auto iter = tp->ExecuteQuery(
-      "select 1 as i8, 128 as i16, 100000 as i32, 42001001001 as i64, 1e9 as "
-      "f64, 'a_string' as str, cast('a_blob' as blob) as blb");
-  QueryResultSerializer ser(std::move(iter));
-  TestDeserializer deser;
-  deser.SerializeAndDeserialize(&ser);
+  for (BatchFormat format : kAllFormats) {
+    auto iter = tp->ExecuteQuery(
+        "select 1 as i8, 128 as i16, 100000 as i32, 42001001001 as i64, 1e9 "
+        "as f64, 'a_string' as str, cast('a_blob' as blob) as blb");
+    QueryResultSerializer ser(std::move(iter), format);
+    TestDeserializer deser;
+    deser.SerializeAndDeserialize(&ser);
 
-  EXPECT_THAT(deser.columns,
-              ElementsAre("i8", "i16", "i32", "i64", "f64", "str", "blb"));
-  EXPECT_THAT(deser.cells,
-              ElementsAre(SqlValue::Long(1), SqlValue::Long(128),
-                          SqlValue::Long(100000), SqlValue::Long(42001001001),
-                          SqlValue::Double(1e9), SqlValue::String("a_string"),
-                          SqlValue::Bytes("a_blob", 6)));
+    EXPECT_THAT(deser.columns,
+                ElementsAre("i8", "i16", "i32", "i64", "f64", "str", "blb"));
+    EXPECT_THAT(deser.cells,
+                ElementsAre(SqlValue::Long(1), SqlValue::Long(128),
+                            SqlValue::Long(100000), SqlValue::Long(42001001001),
+                            SqlValue::Double(1e9), SqlValue::String("a_string"),
+                            SqlValue::Bytes("a_blob", 6)));
+  }
 }
 
 TEST(QueryResultSerializerTest, LongBatch) {
@@ -316,13 +444,15 @@ TEST(QueryResultSerializerTest, LargeStringAndBlobs) {
   sql_values.resize(sql_values.size() - 1);  // Remove trailing comma.
   RunQueryChecked(tp.get(), "insert into tab (colz) values " + sql_values);
 
-  auto iter = tp->ExecuteQuery("select colz from tab");
-  QueryResultSerializer ser(std::move(iter));
-  TestDeserializer deser;
-  deser.SerializeAndDeserialize(&ser);
-  ASSERT_EQ(deser.cells.size(), expected.size());
-  for (size_t i = 0; i < expected.size(); i++) {
-    EXPECT_EQ(deser.cells[i], expected[i]) << "Cell " << i;
+  for (BatchFormat format : kAllFormats) {
+    auto iter = tp->ExecuteQuery("select colz from tab");
+    QueryResultSerializer ser(std::move(iter), format);
+    TestDeserializer deser;
+    deser.SerializeAndDeserialize(&ser);
+    ASSERT_EQ(deser.cells.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+      EXPECT_EQ(deser.cells[i], expected[i]) << "Cell " << i;
+    }
   }
 }
 
@@ -386,9 +516,9 @@ TEST(QueryResultSerializerTest, RandomSizes) {
   }
 
   // Serialize and de-serialize with different batch and payload sizes.
-  for (int rep = 0; rep < 10; rep++) {
+  for (int rep = 0; rep < 20; rep++) {
     auto iter = tp->ExecuteQuery("select * from tab");
-    QueryResultSerializer ser(std::move(iter));
+    QueryResultSerializer ser(std::move(iter), kAllFormats[rep % 2]);
     uint32_t cells_per_batch = 1 << (rnd_engine() % 8 + 2);
     uint32_t binary_payload_size = 1 << (rnd_engine() % 8 + 8);
     ser.set_batch_size_for_testing(cells_per_batch, binary_payload_size);
@@ -450,6 +580,87 @@ TEST(QueryResultSerializerTest, NoResultQuery) {
   }
 }
 
+TEST(QueryResultSerializerTest, ColumnarTypes) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (i, f, s, b, n, m, sn);");
+  RunQueryChecked(tp.get(),
+                  "insert into tab (i, f, s, b, n, m, sn) values "
+                  "(1, 1.5, 'a', X'01', NULL, 1, NULL), "
+                  "(2, 2.5, 'b', X'', NULL, 'x', 'c'), "
+                  "(3, 3.5, 'a', X'0203', NULL, NULL, NULL)");
+
+  auto iter = tp->ExecuteQuery("select * from tab");
+  QueryResultSerializer ser(std::move(iter), BatchFormat::kColumnar);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+  const ColumnProto::Type kExpectedTypes[] = {
+      ColumnProto::TYPE_INT64, ColumnProto::TYPE_FLOAT64,
+      ColumnProto::TYPE_STRING, ColumnProto::TYPE_BLOB,
+      ColumnProto::TYPE_NULL, ColumnProto::TYPE_MIXED,
+      ColumnProto::TYPE_STRING};
+  EXPECT_THAT(deser.column_types, ElementsAreArray(kExpectedTypes));
+  ASSERT_EQ(deser.cells.size(), 3 * 7u);
+  EXPECT_THAT(std::vector<SqlValue>(deser.cells.begin() + 7,
+                                    deser.cells.begin() + 14),
+              ElementsAre(SqlValue::Long(2), SqlValue::Double(2.5),
+                          SqlValue::String("b"), SqlValue::Bytes("", 0),
+                          SqlValue(), SqlValue::String("x"),
+                          SqlValue::String("c")));
+  EXPECT_EQ(deser.cells[19], SqlValue());
+  EXPECT_EQ(deser.cells[20], SqlValue());
+}
+
+TEST(QueryResultSerializerTest, ColumnarStringDictionary) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  auto iter = tp->ExecuteQuery(
+      "with recursive cnt(x) as (select 0 union all select x + 1 from cnt "
+      "limit 4096) select 'str_' || (x % 3) as s from cnt");
+  QueryResultSerializer ser(std::move(iter), BatchFormat::kColumnar);
+
+  std::vector<uint8_t> buf;
+  ser.Serialize(&buf);
+  ResultProto::Decoder result(buf.data(), buf.size());
+  ResultProto::ColumnarBatch::Decoder batch(*result.columnar_batch());
+  ASSERT_TRUE(batch.is_last_batch());
+  ASSERT_EQ(batch.num_rows(), 4096u);
+  ColumnProto::Decoder column(*batch.columns());
+
+  // Each distinct string is stored only once.
+  EXPECT_EQ(column.string_dictionary_data().ToStdString(), "str_0str_1str_2");
+  auto offsets =
+      ReadArray<int32_t>(buf.data(), column.string_dictionary_offsets());
+  EXPECT_THAT(offsets, ElementsAre(0, 5, 10, 15));
+  auto indices = ReadArray<int32_t>(buf.data(), column.string_indices());
+  ASSERT_EQ(indices.size(), 4096u);
+  for (int32_t row = 0; row < 4096; row++)
+    ASSERT_EQ(indices[static_cast<size_t>(row)], row % 3);
+}
+
+TEST(QueryResultSerializerTest, ColumnarBatchSaturatingNumCells) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  auto iter = tp->ExecuteQuery(
+      "with recursive cnt(x) as (select 0 union all select x + 1 from cnt "
+      "limit 10) select x, x * 1.0 as y, 'x' as z from cnt");
+  QueryResultSerializer ser(std::move(iter), BatchFormat::kColumnar);
+  ser.set_batch_size_for_testing(7, 4096);
+
+  // Batches contain whole rows: 2 rows per batch of up to 7 cells.
+  TestDeserializer deser;
+  std::vector<uint8_t> buf;
+  for (uint32_t i = 1; i < 5; i++) {
+    ASSERT_TRUE(ser.Serialize(&buf));
+    deser.DeserializeBuffer(buf.data(), buf.size());
+    buf.clear();
+    ASSERT_EQ(deser.cells.size(), i * 6);
+  }
+  ASSERT_FALSE(ser.Serialize(&buf));
+  deser.DeserializeBuffer(buf.data(), buf.size());
+  EXPECT_TRUE(deser.eof_reached);
+  ASSERT_EQ(deser.cells.size(), 30u);
+  EXPECT_EQ(deser.cells[27], SqlValue::Long(9));
+  EXPECT_EQ(deser.cells[28], SqlValue::Double(9));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
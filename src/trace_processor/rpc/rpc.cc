@@ -34,8 +34,12 @@ using ColumnDesc = protos::pbzero::RawQueryResult::ColumnDesc;
 // Writes a "Loading trace ..." update every N bytes.
 constexpr size_t kProgressUpdateBytes = 50 * 1000 * 1000;
 
+Rpc::Rpc(std::unique_ptr<TraceProcessor> preloaded_instance,
+         const Config& config)
+    : config_(config), trace_processor_(std::move(preloaded_instance)) {}
+
 Rpc::Rpc(std::unique_ptr<TraceProcessor> preloaded_instance)
-    : trace_processor_(std::move(preloaded_instance)) {}
+    : Rpc(std::move(preloaded_instance), Config()) {}
 
 Rpc::Rpc() : Rpc(nullptr) {}
 
@@ -45,7 +49,7 @@ util::Status Rpc::Parse(const uint8_t* data, size_t len) {
   if (eof_) {
     // Reset the trace processor state if this is either the first call ever or
     // if another trace has been previously fully loaded.
-    trace_processor_ = TraceProcessor::CreateInstance(Config());
+    trace_processor_ = TraceProcessor::CreateInstance(config_);
     bytes_parsed_ = bytes_last_progress_ = 0;
     t_parse_started_ = base::GetWallTimeNs().count();
   }
@@ -105,7 +109,12 @@ void Rpc::Query(const uint8_t* args,
   }
 
   auto it = trace_processor_->ExecuteQuery(sql.c_str());
-  QueryResultSerializer serializer(std::move(it));
+  auto batch_format = QueryResultSerializer::BatchFormat::kCells;
+  if (query.batch_format() ==
+      protos::pbzero::RawQueryArgs::BATCH_FORMAT_COLUMNAR) {
+    batch_format = QueryResultSerializer::BatchFormat::kColumnar;
+  }
+  QueryResultSerializer serializer(std::move(it), batch_format);
 
   std::vector<uint8_t> res;
   for (bool has_more = true; has_more;) {
@@ -254,6 +263,11 @@ std::string Rpc::GetCurrentTraceName() {
   return trace_processor_->GetCurrentTraceName();
 }
 
+void Rpc::InterruptQuery() {
+  if (trace_processor_)
+    trace_processor_->InterruptQuery();
+}
+
 void Rpc::RestoreInitialTables() {
   if (trace_processor_)
     trace_processor_->RestoreInitialTables();
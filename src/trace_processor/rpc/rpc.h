@@ -24,6 +24,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 
 namespace perfetto {
@@ -49,7 +50,8 @@ class Rpc {
  public:
   // The unique_ptr argument is optional. If non-null it will adopt the passed
   // instance and allow to directly query that. If null, a new instanace will be
-  // created internally by calling Parse().
+  // created internally by calling Parse(), using |config|.
+  Rpc(std::unique_ptr<TraceProcessor>, const Config& config);
   explicit Rpc(std::unique_ptr<TraceProcessor>);
   Rpc();
   ~Rpc();
@@ -57,6 +59,11 @@ class Rpc {
   // The methods of this class are mirrors (modulo {un,}marshalling of args) of
   // the corresponding names in trace_processor.h . See that header for docs.
 
+  // Query(), RawQuery() and ComputeMetric() can be interleaved with Parse()
+  // calls: they see the data ingested so far. How much of it that is depends
+  // on Config::sorting_mode: with a full sort, most events are only parsed into
+  // tables by NotifyEndOfFile(), while the windowed modes parse them as soon as
+  // they leave the sorting window.
   util::Status Parse(const uint8_t* data, size_t len);
   void NotifyEndOfFile();
   void RestoreInitialTables();
@@ -86,9 +93,15 @@ class Rpc {
   // DEPRECATED, only for legacy clients. Use |Query()| above.
   std::vector<uint8_t> RawQuery(const uint8_t* args, size_t len);
 
+  // Interrupts the query being run by Query(), RawQuery() or ComputeMetric().
+  // Unlike the other methods, this can be called from another thread while
+  // one of those is running.
+  void InterruptQuery();
+
  private:
   void MaybePrintProgress();
 
+  const Config config_;
   std::unique_ptr<TraceProcessor> trace_processor_;
   bool eof_ = true;  // Reset when calling Parse().
   int64_t t_parse_started_ = 0;
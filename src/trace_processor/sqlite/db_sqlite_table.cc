@@ -24,8 +24,42 @@
 namespace perfetto {
 namespace trace_processor {
 
+// static
+constexpr uint32_t DbSqliteTable::Cursor::kMaxDeferredRows;
+// static
+constexpr uint32_t DbSqliteTable::Cursor::kBatchSize;
+// static
+constexpr uint32_t DbSqliteTable::Cursor::kInvalidRow;
+
 namespace {
 
+// Estimates the fraction of the rows of a column with the statistics |stats|
+// which match a constraint with the operator |op|. Returns base::nullopt if
+// the statistics don't help for |op|.
+base::Optional<double> EstimateSelectivity(const Column::Stats& stats,
+                                           int op) {
+  double rows = stats.row_count;
+  double null_fraction = stats.null_count / rows;
+  double non_null_fraction = (stats.row_count - stats.null_count) / rows;
+  if (sqlite_utils::IsOpIsNull(op))
+    return null_fraction;
+  if (sqlite_utils::IsOpIsNotNull(op))
+    return non_null_fraction;
+  if (stats.distinct_count == 0) {
+    // Every row is null so no comparision can match.
+    return 0.0;
+  }
+
+  // Assume that values are uniformly distributed between the distinct
+  // values.
+  double eq_fraction = non_null_fraction / stats.distinct_count;
+  if (sqlite_utils::IsOpEq(op))
+    return eq_fraction;
+  if (op == SQLITE_INDEX_CONSTRAINT_NE)
+    return non_null_fraction - eq_fraction;
+  return base::nullopt;
+}
+
 base::Optional<FilterOp> SqliteOpToFilterOp(int sqlite_op) {
   switch (sqlite_op) {
     case SQLITE_INDEX_CONSTRAINT_EQ:
@@ -87,6 +121,8 @@ SqlValue SqliteValueToSqlValue(sqlite3_value* sqlite_val) {
 
 DbSqliteTable::DbSqliteTable(sqlite3*, Context context)
     : cache_(context.cache),
+      budget_(context.budget),
+      profiler_(context.profiler),
       schema_(std::move(context.schema)),
       computation_(context.computation),
       static_table_(context.static_table),
@@ -95,17 +131,28 @@ DbSqliteTable::~DbSqliteTable() = default;
 
 void DbSqliteTable::RegisterTable(sqlite3* db,
                                   QueryCache* cache,
+                                  QueryBudget* budget,
+                                  QueryProfiler* profiler,
                                   Table::Schema schema,
                                   const Table* table,
                                   const std::string& name) {
-  Context context{cache, schema, TableComputation::kStatic, table, nullptr};
+  Context context{cache,
+                  budget,
+                  profiler,
+                  schema,
+                  TableComputation::kStatic,
+                  table,
+                  nullptr};
   SqliteTable::Register<DbSqliteTable, Context>(db, std::move(context), name);
 }
 
 void DbSqliteTable::RegisterTable(
     sqlite3* db,
     QueryCache* cache,
+    QueryBudget* budget,
+    QueryProfiler* profiler,
     std::unique_ptr<DynamicTableGenerator> generator) {
+  generator->budget_ = budget;
   Table::Schema schema = generator->CreateSchema();
   std::string name = generator->TableName();
 
@@ -114,7 +161,12 @@ void DbSqliteTable::RegisterTable(
   util::Status status = generator->ValidateConstraints({});
   bool requires_args = !status.ok();
 
-  Context context{cache, std::move(schema), TableComputation::kDynamic, nullptr,
+  Context context{cache,
+                  budget,
+                  profiler,
+                  std::move(schema),
+                  TableComputation::kDynamic,
+                  nullptr,
                   std::move(generator)};
   SqliteTable::Register<DbSqliteTable, Context>(db, std::move(context), name,
                                                 false, requires_args);
@@ -151,9 +203,17 @@ SqliteTable::Schema DbSqliteTable::ComputeSchema(const Table::Schema& schema,
 }
 
 int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
+  QueryProfiler::TableProfile* profile =
+      profiler_ ? profiler_->GetTableProfile(name()) : nullptr;
+  if (profile)
+    profile->best_index_count++;
+  QueryProfiler::ScopedTimer timer(profile ? &profile->best_index_dur_ns
+                                           : nullptr);
+
   switch (computation_) {
     case TableComputation::kStatic:
-      BestIndex(schema_, static_table_->row_count(), qc, info);
+      UpdateColumnStats(qc);
+      BestIndex(schema_, static_table_->row_count(), qc, info, &column_stats_);
       break;
     case TableComputation::kDynamic:
       util::Status status = generator_->ValidateConstraints(qc);
@@ -165,11 +225,32 @@ int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
   return SQLITE_OK;
 }
 
+void DbSqliteTable::UpdateColumnStats(const QueryConstraints& qc) {
+  uint32_t row_count = static_table_->row_count();
+  column_stats_.resize(static_table_->GetColumnCount());
+  for (const auto& c : qc.constraints()) {
+    uint32_t col = static_cast<uint32_t>(c.column);
+    base::Optional<trace_processor::Column::Stats>& stats = column_stats_[col];
+
+    // Only recompute the statistics if the table changed significantly:
+    // computing them requires scanning the whole column.
+    if (stats) {
+      uint32_t diff = row_count > stats->row_count
+                          ? row_count - stats->row_count
+                          : stats->row_count - row_count;
+      if (static_cast<uint64_t>(diff) * 10 <= stats->row_count)
+        continue;
+    }
+    stats = static_table_->GetColumn(col).ComputeStats();
+  }
+}
+
 void DbSqliteTable::BestIndex(const Table::Schema& schema,
                               uint32_t row_count,
                               const QueryConstraints& qc,
-                              BestIndexInfo* info) {
-  auto cost_and_rows = EstimateCost(schema, row_count, qc);
+                              BestIndexInfo* info,
+                              const ColumnStats* stats) {
+  auto cost_and_rows = EstimateCost(schema, row_count, qc, stats);
   info->estimated_cost = cost_and_rows.cost;
   info->estimated_rows = cost_and_rows.rows;
 
@@ -248,7 +329,8 @@ void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
 DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
     const Table::Schema& schema,
     uint32_t row_count,
-    const QueryConstraints& qc) {
+    const QueryConstraints& qc,
+    const ColumnStats* stats) {
   // Currently our cost estimation algorithm is quite simplistic but is good
   // enough for the simplest cases.
   // TODO(lalitm): replace hardcoded constants with either more heuristics
@@ -276,12 +358,36 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
   for (const auto& c : cs) {
     if (current_row_count < 2)
       break;
-    const auto& col_schema = schema.columns[static_cast<uint32_t>(c.column)];
+    uint32_t col = static_cast<uint32_t>(c.column);
+    const auto& col_schema = schema.columns[col];
+
+    // If we have statistics about the column, use them to estimate the
+    // fraction of the rows matched by the constraint instead of the
+    // heuristics below.
+    const trace_processor::Column::Stats* col_stats = nullptr;
+    if (stats && col < stats->size() && (*stats)[col] &&
+        (*stats)[col]->row_count > 0) {
+      col_stats = &*(*stats)[col];
+    }
+    base::Optional<double> selectivity;
+    if (col_stats)
+      selectivity = EstimateSelectivity(*col_stats, c.op);
+
     if (sqlite_utils::IsOpEq(c.op) && col_schema.is_id) {
       // If we have an id equality constraint, it's a bit expensive to find
       // the exact row but it filters down to a single row.
       filter_cost += 100;
       current_row_count = 1;
+    } else if (sqlite_utils::IsOpEq(c.op) && col_schema.is_indexed) {
+      // If we have an equality constraint on an indexed column, we can find
+      // the matching rows with a single lookup in the index. The cost is then
+      // proportional to the number of rows returned which we estimate in the
+      // same way as for the other equality constraints below.
+      double estimated_rows =
+          selectivity ? current_row_count * *selectivity
+                      : current_row_count / log2(current_row_count);
+      current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
+      filter_cost += 100 + current_row_count;
     } else if (sqlite_utils::IsOpEq(c.op)) {
       // If there is only a single equality constraint, we have special logic
       // to sort by that column and then binary search if we see the constraint
@@ -294,15 +400,20 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
                          ? (2 * current_row_count) / log2(current_row_count)
                          : current_row_count;
 
-      // We assume that an equalty constraint will cut down the number of rows
-      // by approximate log of the number of rows.
-      double estimated_rows = current_row_count / log2(current_row_count);
+      // Without statistics, we assume that an equalty constraint will cut
+      // down the number of rows by approximate log of the number of rows.
+      double estimated_rows =
+          selectivity ? current_row_count * *selectivity
+                      : current_row_count / log2(current_row_count);
       current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
     } else {
-      // Otherwise, we will need to do a full table scan and we estimate we will
-      // maybe (at best) halve the number of rows.
+      // Otherwise, we will need to do a full table scan and, without
+      // statistics, we estimate we will maybe (at best) halve the number of
+      // rows.
       filter_cost += current_row_count;
-      current_row_count = std::max(current_row_count / 2u, 1u);
+      double estimated_rows = selectivity ? current_row_count * *selectivity
+                                          : current_row_count / 2.0;
+      current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
     }
   }
 
@@ -372,9 +483,10 @@ void DbSqliteTable::Cursor::TryCacheCreateSortedTable(
   if (!sqlite_utils::IsOpEq(c.op))
     return;
 
-  // If the column is already sorted, we don't need to cache at all.
+  // If the column is already sorted or indexed, we don't need to cache at all.
   uint32_t col = static_cast<uint32_t>(c.column);
-  if (upstream_table_->GetColumn(col).IsSorted())
+  const auto& column = upstream_table_->GetColumn(col);
+  if (column.IsSorted() || column.IsIndexed())
     return;
 
   // Try again to get the result or start caching it.
@@ -391,9 +503,20 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
     r->AddArg("Table", db_sqlite_table_->name());
   });
 
+  QueryProfiler* profiler = db_sqlite_table_->profiler_;
+  profile_ =
+      profiler ? profiler->GetTableProfile(db_sqlite_table_->name()) : nullptr;
+  if (profile_)
+    profile_->filter_count++;
+  QueryProfiler::ScopedTimer timer(profile_ ? &profile_->filter_dur_ns
+                                            : nullptr);
+
   // Clear out the iterator before filtering to ensure the destructor is run
-  // before the table's destructor.
-  iterator_ = base::nullopt;
+  // before the RowMap's destructor.
+  deferred_it_ = base::nullopt;
+
+  if (IsOverQueryBudget())
+    return SQLITE_ERROR;
 
   // We reuse this vector to reduce memory allocations on nested subqueries.
   constraints_.resize(qc.constraints().size());
@@ -436,11 +559,16 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       PERFETTO_TP_TRACE("DYNAMIC_TABLE_GENERATE", [this](metatrace::Record* r) {
         r->AddArg("Table", db_sqlite_table_->name());
       });
+      QueryProfiler::ScopedTimer generate_timer(
+          profile_ ? &profile_->generate_dur_ns : nullptr);
+
       // If we have a dynamically created table, regenerate the table based on
       // the new constraints.
       dynamic_table_ =
           db_sqlite_table_->generator_->ComputeTable(constraints_, orders_);
       upstream_table_ = dynamic_table_.get();
+      if (IsOverQueryBudget())
+        return SQLITE_ERROR;
       if (!upstream_table_)
         return SQLITE_CONSTRAINT;
       break;
@@ -514,6 +642,16 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
     }
   });
 
+  // If a previous query had the same constraints and orders, we can reuse
+  // its result instead of filtering and sorting again.
+  std::shared_ptr<Table> cached = GetCachedResult();
+  if (profile_ && (cached || sorted_cache_table_))
+    profile_->cache_hits++;
+  if (cached) {
+    SetTable(std::move(cached), 0);
+    return SQLITE_OK;
+  }
+
   // Attempt to filter into a RowMap first - weall figure out whether to apply
   // this to the table or we should use the RowMap directly. Also, if we are
   // going to sort on the RowMap, it makes sense that we optimize for lookup
@@ -522,6 +660,12 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
                                          ? RowMap::OptimizeFor::kMemory
                                          : RowMap::OptimizeFor::kLookupSpeed;
   RowMap filter_map = SourceTable()->FilterToRowMap(constraints_, optimize_for);
+  if (IsOverQueryBudget())
+    return SQLITE_ERROR;
+  if (profile_) {
+    profile_->rows_in += SourceTable()->row_count();
+    profile_->rows_out += filter_map.size();
+  }
 
   // If we have no order by constraints and it's cheap for us to use the
   // RowMap, just use the RowMap directoy.
@@ -540,40 +684,201 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
                       ? base::make_optional(filter_map.Get(0))
                       : base::nullopt;
     eof_ = !single_row_.has_value();
+  } else if (orders_.empty()) {
+    // If we don't need to sort, defer applying the RowMap to the table until
+    // we know that SQLite is going to read a significant number of rows.
+    // Applying the RowMap is proportional to the number of rows in the table
+    // which is wasteful if SQLite only reads a handful (e.g. LIMIT queries).
+    mode_ = Mode::kDeferred;
+    deferred_map_ = std::move(filter_map);
+    deferred_it_ = deferred_map_.IterateRows();
+    deferred_rows_ = 0;
+    eof_ = !*deferred_it_;
   } else {
-    mode_ = Mode::kTable;
-
-    db_table_ = SourceTable()->Apply(std::move(filter_map));
-    if (!orders_.empty())
-      db_table_ = db_table_->Sort(orders_);
-
-    iterator_ = db_table_->IterateRows();
-
-    eof_ = !*iterator_;
+    Table table = SourceTable()->Apply(std::move(filter_map));
+    if (!orders_.empty()) {
+      QueryProfiler::ScopedTimer sort_timer(profile_ ? &profile_->sort_dur_ns
+                                                     : nullptr);
+      table = table.Sort(orders_);
+    }
+    SetTable(std::shared_ptr<Table>(new Table(std::move(table))), 0);
+    CacheResult();
   }
 
   return SQLITE_OK;
 }
 
+bool DbSqliteTable::Cursor::IsOverQueryBudget() {
+  QueryBudget* budget = db_sqlite_table_->budget_;
+  if (!budget || budget->Check())
+    return false;
+  db_sqlite_table_->SetErrorMessage(
+      sqlite3_mprintf("%s", budget->status().c_message()));
+  return true;
+}
+
 int DbSqliteTable::Cursor::Next() {
-  if (mode_ == Mode::kSingleRow) {
-    eof_ = true;
-  } else {
-    iterator_->Next();
-    eof_ = !*iterator_;
+  QueryProfiler::ScopedTimer timer(profile_ ? &profile_->next_dur_ns : nullptr);
+  if (profile_)
+    profile_->next_count++;
+
+  switch (mode_) {
+    case Mode::kSingleRow:
+      eof_ = true;
+      break;
+    case Mode::kDeferred:
+      deferred_it_->Next();
+      eof_ = !*deferred_it_;
+      if (!eof_ && ++deferred_rows_ >= kMaxDeferredRows)
+        MaterializeDeferred();
+      break;
+    case Mode::kTable:
+      eof_ = ++table_row_ >= db_table_->row_count();
+      break;
   }
   return SQLITE_OK;
 }
 
+void DbSqliteTable::Cursor::MaterializeDeferred() {
+  PERFETTO_DCHECK(mode_ == Mode::kDeferred);
+
+  // As SQLite is reading a lot of rows from this cursor, it's now worth
+  // paying the cost of applying the RowMap to the table: reading the columns
+  // of the table in batches is much cheaper than looking up each row through
+  // the RowMaps of the source table.
+  deferred_it_ = base::nullopt;
+  Table table = SourceTable()->Apply(std::move(deferred_map_));
+  SetTable(std::shared_ptr<Table>(new Table(std::move(table))), deferred_rows_);
+  PERFETTO_DCHECK(!eof_);
+  CacheResult();
+}
+
+void DbSqliteTable::Cursor::SetTable(std::shared_ptr<Table> table,
+                                     uint32_t row) {
+  mode_ = Mode::kTable;
+  db_table_ = std::move(table);
+  table_row_ = row;
+  ResetBatches();
+  eof_ = table_row_ >= db_table_->row_count();
+}
+
+std::shared_ptr<Table> DbSqliteTable::Cursor::GetCachedResult() const {
+  // Only the results of static tables are cached: dynamic tables are
+  // recomputed for every query.
+  if (!cache_ || db_sqlite_table_->computation_ != TableComputation::kStatic)
+    return nullptr;
+
+  // Equality constraints on id columns match at most one row which is cheaper
+  // to find again than to look up in the cache.
+  for (const Constraint& c : constraints_) {
+    if (c.op == FilterOp::kEq && upstream_table_->GetColumn(c.col_idx).IsId())
+      return nullptr;
+  }
+  return cache_->GetResult(upstream_table_, constraints_, orders_);
+}
+
+void DbSqliteTable::Cursor::CacheResult() {
+  if (!cache_ || db_sqlite_table_->computation_ != TableComputation::kStatic)
+    return;
+  cache_->CacheResult(upstream_table_, constraints_, orders_, db_table_);
+}
+
+void DbSqliteTable::Cursor::ResetBatches() {
+  // Keep the buffers of the batches around to reduce memory allocations on
+  // nested subqueries.
+  batches_.resize(db_table_->GetColumnCount());
+  for (ColumnBatch& batch : batches_) {
+    batch.start_row = kInvalidRow;
+  }
+}
+
+void DbSqliteTable::Cursor::FillBatch(uint32_t col, ColumnBatch* batch) {
+  const auto& column = db_table_->GetColumn(col);
+  uint32_t start = table_row_ - table_row_ % kBatchSize;
+  uint32_t count = std::min(db_table_->row_count() - start, kBatchSize);
+  batch->start_row = start;
+
+  switch (column.type()) {
+    case SqlValue::Type::kLong: {
+      batch->longs.resize(kBatchSize);
+      int64_t* out = batch->longs.data();
+      if (column.IsId() || column.IsColumnType<uint32_t>()) {
+        uint32_t values[kBatchSize];
+        column.GetBatch(start, count, values, batch->nulls);
+        std::copy(values, values + count, out);
+      } else if (column.IsColumnType<int32_t>()) {
+        int32_t values[kBatchSize];
+        column.GetBatch(start, count, values, batch->nulls);
+        std::copy(values, values + count, out);
+      } else {
+        column.GetBatch(start, count, out, batch->nulls);
+      }
+      break;
+    }
+    case SqlValue::Type::kDouble:
+      batch->doubles.resize(kBatchSize);
+      column.GetBatch(start, count, batch->doubles.data(), batch->nulls);
+      break;
+    case SqlValue::Type::kString: {
+      StringPool::Id ids[kBatchSize];
+      column.GetBatch(start, count, ids, batch->nulls);
+      batch->strings.resize(kBatchSize);
+      for (uint32_t i = 0; i < count; ++i) {
+        batch->strings[i] = column.string_pool().Get(ids[i]).c_str();
+      }
+      break;
+    }
+    case SqlValue::Type::kBytes:
+    case SqlValue::Type::kNull:
+      PERFETTO_FATAL("Unexpected column type");
+  }
+}
+
 int DbSqliteTable::Cursor::Eof() {
   return eof_;
 }
 
 int DbSqliteTable::Cursor::Column(sqlite3_context* ctx, int raw_col) {
   uint32_t column = static_cast<uint32_t>(raw_col);
-  SqlValue value = mode_ == Mode::kSingleRow
-                       ? SourceTable()->GetColumn(column).Get(*single_row_)
-                       : iterator_->Get(column);
+  SqlValue value;
+  switch (mode_) {
+    case Mode::kSingleRow:
+      value = SourceTable()->GetColumn(column).Get(*single_row_);
+      break;
+    case Mode::kDeferred:
+      value = SourceTable()->GetColumn(column).Get(deferred_it_->row());
+      break;
+    case Mode::kTable: {
+      ColumnBatch& batch = batches_[column];
+      if (batch.start_row == kInvalidRow ||
+          table_row_ - batch.start_row >= kBatchSize) {
+        FillBatch(column, &batch);
+      }
+
+      uint32_t idx = table_row_ - batch.start_row;
+      if ((batch.nulls[idx / 64] >> (idx % 64)) & 1) {
+        sqlite3_result_null(ctx);
+        return SQLITE_OK;
+      }
+      switch (db_table_->GetColumn(column).type()) {
+        case SqlValue::Type::kLong:
+          sqlite3_result_int64(ctx, batch.longs[idx]);
+          return SQLITE_OK;
+        case SqlValue::Type::kDouble:
+          sqlite3_result_double(ctx, batch.doubles[idx]);
+          return SQLITE_OK;
+        case SqlValue::Type::kString:
+          // See below for why kSqliteStatic is safe.
+          sqlite3_result_text(ctx, batch.strings[idx], -1,
+                              sqlite_utils::kSqliteStatic);
+          return SQLITE_OK;
+        case SqlValue::Type::kBytes:
+        case SqlValue::Type::kNull:
+          PERFETTO_FATAL("Unexpected column type");
+      }
+      PERFETTO_FATAL("For GCC");
+    }
+  }
   switch (value.type) {
     case SqlValue::Type::kLong:
       sqlite3_result_int64(ctx, value.long_value);
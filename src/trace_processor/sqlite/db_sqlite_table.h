@@ -17,8 +17,13 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 
+#include <limits>
+#include <vector>
+
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/sqlite/query_budget.h"
 #include "src/trace_processor/sqlite/query_cache.h"
+#include "src/trace_processor/sqlite/query_profiler.h"
 #include "src/trace_processor/sqlite/sqlite_table.h"
 
 namespace perfetto {
@@ -66,6 +71,18 @@ class DbSqliteTable : public SqliteTable {
     virtual std::unique_ptr<Table> ComputeTable(
         const std::vector<Constraint>& cs,
         const std::vector<Order>& ob) = 0;
+
+   protected:
+    // Returns true if the query reading the table has been interrupted or has
+    // exceeded its limits. Generators which can run for a long time should
+    // call this periodically and return nullptr from ComputeTable() if so.
+    bool IsOverQueryBudget() { return budget_ && !budget_->Check(); }
+
+   private:
+    friend class DbSqliteTable;
+
+    // Set by RegisterTable(), may be nullptr.
+    QueryBudget* budget_ = nullptr;
   };
 
   class Cursor : public SqliteTable::Cursor {
@@ -86,9 +103,67 @@ class DbSqliteTable : public SqliteTable {
    private:
     enum class Mode {
       kSingleRow,
+      kDeferred,
       kTable,
     };
 
+    // The number of rows returned in Mode::kDeferred before switching to
+    // Mode::kTable.
+    static constexpr uint32_t kMaxDeferredRows = 1024;
+
+    // The number of rows of a column read at a time in Mode::kTable.
+    static constexpr uint32_t kBatchSize = 256;
+
+    // Marks a ColumnBatch which has not been filled.
+    static constexpr uint32_t kInvalidRow =
+        std::numeric_limits<uint32_t>::max();
+
+    // The values of a column of |db_table_| for a batch of |kBatchSize|
+    // consecutive rows. Only used in Mode::kTable: like the speed-of-light
+    // cursor in sqlite_vtable_benchmark.cc, reading values in batches with
+    // Column::GetBatch means that xColumn only needs to index into a typed
+    // buffer instead of going through the RowMap and SqlValue dispatch for
+    // every cell.
+    struct ColumnBatch {
+      // The first row of |db_table_| in this batch.
+      uint32_t start_row = kInvalidRow;
+
+      // Only one of these is filled depending on the type of the column.
+      std::vector<int64_t> longs;
+      std::vector<double> doubles;
+      std::vector<const char*> strings;
+
+      // Bit i is set iff the value of row |start_row| + i is null.
+      uint64_t nulls[kBatchSize / 64] = {};
+    };
+
+    // Returns true, after setting the error message of the table, if the
+    // query has been interrupted or has exceeded its limits.
+    bool IsOverQueryBudget();
+
+    // Invalidates all the batches of |batches_| after |db_table_| changes.
+    void ResetBatches();
+
+    // Reads the values of column |col| for the batch containing |table_row_|.
+    void FillBatch(uint32_t col, ColumnBatch* batch);
+
+    // Switches from Mode::kDeferred to Mode::kTable by applying
+    // |deferred_map_| to the source table.
+    void MaterializeDeferred();
+
+    // Switches to Mode::kTable reading from |table|.
+    void SetTable(std::shared_ptr<Table> table, uint32_t row);
+
+    // Returns |db_table_| if it was previously cached as the result of
+    // filtering and sorting the source table with |constraints_| and
+    // |orders_| or nullptr otherwise.
+    std::shared_ptr<Table> GetCachedResult() const;
+
+    // Caches |db_table_| as the result of filtering and sorting the source
+    // table with |constraints_| and |orders_| so that later queries can reuse
+    // it.
+    void CacheResult();
+
     // Tries to create a sorted table to cache in |sorted_cache_table_| if the
     // constraint set matches the requirements.
     void TryCacheCreateSortedTable(const QueryConstraints&, FilterHistory);
@@ -114,12 +189,26 @@ class DbSqliteTable : public SqliteTable {
     // Only valid for Mode::kSingleRow.
     base::Optional<uint32_t> single_row_;
 
-    // Only valid for Mode::kTable.
-    base::Optional<Table> db_table_;
-    base::Optional<Table::Iterator> iterator_;
+    // Only valid for Mode::kDeferred. Rows are read directly from the
+    // source table through |deferred_map_| which avoids materializing the
+    // RowMaps of the whole filtered table when only a few rows are read (e.g.
+    // for queries with a LIMIT).
+    RowMap deferred_map_;
+    base::Optional<RowMap::Iterator> deferred_it_;
+    uint32_t deferred_rows_ = 0;
+
+    // Only valid for Mode::kTable. This is shared with |cache_| when the
+    // result is cached across queries.
+    std::shared_ptr<Table> db_table_;
+    uint32_t table_row_ = 0;
+    std::vector<ColumnBatch> batches_;
 
     bool eof_ = true;
 
+    // The profile of the table for the query calling Filter() or nullptr if
+    // queries are not profiled.
+    QueryProfiler::TableProfile* profile_ = nullptr;
+
     // Stores a sorted version of |db_table_| sorted on a repeated equals
     // constraint. This allows speeding up repeated subqueries in joins
     // significantly.
@@ -138,8 +227,15 @@ class DbSqliteTable : public SqliteTable {
     double cost;
     uint32_t rows;
   };
+
+  // The statistics for each column of a table: columns for which statistics
+  // have not been computed are base::nullopt.
+  using ColumnStats =
+      std::vector<base::Optional<trace_processor::Column::Stats>>;
   struct Context {
     QueryCache* cache;
+    QueryBudget* budget;
+    QueryProfiler* profiler;
     Table::Schema schema;
     TableComputation computation;
 
@@ -150,14 +246,21 @@ class DbSqliteTable : public SqliteTable {
     std::unique_ptr<DynamicTableGenerator> generator;
   };
 
+  // |budget| is checked while filtering and sorting the table. It may be
+  // nullptr if queries have no limits. |profiler| records the time spent in
+  // the table by each query and may be nullptr if queries are not profiled.
   static void RegisterTable(sqlite3* db,
                             QueryCache* cache,
+                            QueryBudget* budget,
+                            QueryProfiler* profiler,
                             Table::Schema schema,
                             const Table* table,
                             const std::string& name);
 
   static void RegisterTable(sqlite3* db,
                             QueryCache* cache,
+                            QueryBudget* budget,
+                            QueryProfiler* profiler,
                             std::unique_ptr<DynamicTableGenerator> generator);
 
   DbSqliteTable(sqlite3*, Context context);
@@ -176,18 +279,29 @@ class DbSqliteTable : public SqliteTable {
   static SqliteTable::Schema ComputeSchema(const Table::Schema&,
                                            const char* table_name);
   static void ModifyConstraints(const Table::Schema&, QueryConstraints*);
+  // |stats| optionally contains the statistics for the columns of the table:
+  // these are used to better estimate the number of rows returned by
+  // each constraint (see EstimateCost).
   static void BestIndex(const Table::Schema&,
                         uint32_t row_count,
                         const QueryConstraints&,
-                        BestIndexInfo*);
+                        BestIndexInfo*,
+                        const ColumnStats* stats = nullptr);
 
   // static for testing.
   static QueryCost EstimateCost(const Table::Schema&,
                                 uint32_t row_count,
-                                const QueryConstraints& qc);
+                                const QueryConstraints& qc,
+                                const ColumnStats* stats = nullptr);
 
  private:
+  // Makes sure that |column_stats_| contains up to date statistics for every
+  // column constrained by |qc|.
+  void UpdateColumnStats(const QueryConstraints& qc);
+
   QueryCache* cache_ = nullptr;
+  QueryBudget* budget_ = nullptr;
+  QueryProfiler* profiler_ = nullptr;
   Table::Schema schema_;
 
   TableComputation computation_ = TableComputation::kStatic;
@@ -195,6 +309,12 @@ class DbSqliteTable : public SqliteTable {
   // Only valid when computation_ == TableComputation::kStatic.
   const Table* static_table_ = nullptr;
 
+  // Statistics about the columns of |static_table_| which are computed the
+  // first time a column is constrained in a query (and recomputed if the
+  // number of rows in the table changes significantly).
+  // Only valid when computation_ == TableComputation::kStatic.
+  ColumnStats column_stats_;
+
   // Only valid when computation_ == TableComputation::kDynamic.
   std::unique_ptr<DynamicTableGenerator> generator_;
 };
@@ -26,15 +26,23 @@ namespace {
 Table::Schema CreateSchema() {
   Table::Schema schema;
   schema.columns.push_back({"id", SqlValue::Type::kLong, true /* is_id */,
-                            true /* is_sorted */, false /* is_hidden */});
+                            true /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"type", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test1", SqlValue::Type::kLong, false /* is_id */,
-                            true /* is_sorted */, false /* is_hidden */});
+                            true /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test2", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
   schema.columns.push_back({"test3", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexed */});
+  schema.columns.push_back({"test4", SqlValue::Type::kLong, false /* is_id */,
+                            false /* is_sorted */, false /* is_hidden */,
+                            true /* is_indexed */});
   return schema;
 }
 
@@ -118,6 +126,30 @@ TEST(DbSqliteTable, MultiSortedEqCheaperThanMultiUnsortedEq) {
   ASSERT_EQ(sorted_cost.rows, unsorted_cost.rows);
 }
 
+TEST(DbSqliteTable, MultiIndexedEqCheaperThanMultiUnsortedEq) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 1234;
+
+  QueryConstraints indexed_eq;
+  indexed_eq.AddConstraint(5u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  indexed_eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+
+  auto indexed_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, indexed_eq);
+
+  QueryConstraints unsorted_eq;
+  unsorted_eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  unsorted_eq.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+
+  auto unsorted_cost =
+      DbSqliteTable::EstimateCost(schema, kRowCount, unsorted_eq);
+
+  // The number of rows should be the same but the cost of the indexed
+  // query should be less.
+  ASSERT_LT(indexed_cost.cost, unsorted_cost.cost);
+  ASSERT_EQ(indexed_cost.rows, unsorted_cost.rows);
+}
+
 TEST(DbSqliteTable, EmptyTableCosting) {
   auto schema = CreateSchema();
 
@@ -153,6 +185,66 @@ TEST(DbSqliteTable, OrderByOnSortedCheaper) {
   ASSERT_EQ(sorted_cost.rows, a_cost.rows);
 }
 
+Column::Stats CreateStats(uint32_t rows, uint32_t nulls, uint32_t distinct) {
+  Column::Stats stats;
+  stats.row_count = rows;
+  stats.null_count = nulls;
+  stats.distinct_count = distinct;
+  return stats;
+}
+
+TEST(DbSqliteTable, StatsEqCosting) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 100000;
+
+  // Column 1 has very few distinct values while column 2 is almost unique.
+  DbSqliteTable::ColumnStats stats(schema.columns.size());
+  stats[1] = CreateStats(kRowCount, 0, 4);
+  stats[2] = CreateStats(kRowCount, 0, kRowCount / 2);
+
+  QueryConstraints a_eq;
+  a_eq.AddConstraint(1u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  auto a_cost = DbSqliteTable::EstimateCost(schema, kRowCount, a_eq, &stats);
+  ASSERT_EQ(a_cost.rows, kRowCount / 4);
+
+  QueryConstraints b_eq;
+  b_eq.AddConstraint(2u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  auto b_cost = DbSqliteTable::EstimateCost(schema, kRowCount, b_eq, &stats);
+  ASSERT_EQ(b_cost.rows, 2u);
+
+  ASSERT_LT(b_cost.cost, a_cost.cost);
+
+  // Without statistics, both constraints should be costed the same.
+  auto a_no_stats = DbSqliteTable::EstimateCost(schema, kRowCount, a_eq);
+  auto b_no_stats = DbSqliteTable::EstimateCost(schema, kRowCount, b_eq);
+  ASSERT_DOUBLE_EQ(a_no_stats.cost, b_no_stats.cost);
+}
+
+TEST(DbSqliteTable, StatsNullCosting) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 1000;
+
+  DbSqliteTable::ColumnStats stats(schema.columns.size());
+  stats[3] = CreateStats(kRowCount, 900, 10);
+
+  QueryConstraints is_null;
+  is_null.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_ISNULL, 0u);
+  ASSERT_EQ(
+      DbSqliteTable::EstimateCost(schema, kRowCount, is_null, &stats).rows,
+      900u);
+
+  QueryConstraints is_not_null;
+  is_not_null.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_ISNOTNULL, 0u);
+  ASSERT_EQ(
+      DbSqliteTable::EstimateCost(schema, kRowCount, is_not_null, &stats).rows,
+      100u);
+
+  QueryConstraints eq;
+  eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  ASSERT_EQ(DbSqliteTable::EstimateCost(schema, kRowCount, eq, &stats).rows,
+            10u);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_budget.h"
+
+#include <inttypes.h>
+#include <sqlite3.h>
+#include <stdlib.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/time.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/utils.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#include <fcntl.h>
+#include <unistd.h>
+#define PERFETTO_TP_HAS_PROC_STATM() 1
+#else
+#define PERFETTO_TP_HAS_PROC_STATM() 0
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// The number of SQLite VM instructions between two calls to Check().
+constexpr int kProgressHandlerInstructions = 1000;
+
+constexpr int64_t kMemorySamplingPeriodNs = 10 * 1000 * 1000;
+
+}  // namespace
+
+QueryBudget::QueryBudget(uint64_t max_duration_ms,
+                         uint64_t max_memory_bytes,
+                         const QueryBudget* parent)
+    : max_duration_ns_(static_cast<int64_t>(max_duration_ms) * 1000 * 1000),
+      max_memory_bytes_(max_memory_bytes),
+      parent_(parent) {}
+
+QueryBudget::~QueryBudget() = default;
+
+void QueryBudget::RegisterProgressHandler(sqlite3* db) {
+  if (max_duration_ns_ == 0 && max_memory_bytes_ == 0 && !parent_)
+    return;
+  auto fn = [](void* ctx) {
+    return static_cast<QueryBudget*>(ctx)->Check() ? 0 : 1;
+  };
+  sqlite3_progress_handler(db, kProgressHandlerInstructions, fn, this);
+}
+
+void QueryBudget::StartQuery() {
+  reason_.store(Reason::kNone, std::memory_order_relaxed);
+  start_ns_ = base::GetWallTimeNs().count();
+  if (max_memory_bytes_ > 0) {
+    start_memory_bytes_ = GetResidentMemoryBytes().value_or(0);
+    next_memory_sample_ns_ = start_ns_ + kMemorySamplingPeriodNs;
+  }
+}
+
+void QueryBudget::Interrupt() {
+  Stop(Reason::kInterrupted);
+}
+
+bool QueryBudget::Check() {
+  if (PERFETTO_UNLIKELY(reason_.load(std::memory_order_relaxed) !=
+                        Reason::kNone)) {
+    return false;
+  }
+  if (parent_ && PERFETTO_UNLIKELY(parent_->interrupted())) {
+    Stop(Reason::kInterrupted);
+    return false;
+  }
+  if (max_duration_ns_ == 0 && max_memory_bytes_ == 0)
+    return true;
+
+  int64_t now_ns = base::GetWallTimeNs().count();
+  if (max_duration_ns_ > 0 && now_ns - start_ns_ > max_duration_ns_) {
+    Stop(Reason::kTimeLimit);
+    return false;
+  }
+  if (max_memory_bytes_ > 0 && now_ns >= next_memory_sample_ns_) {
+    next_memory_sample_ns_ = now_ns + kMemorySamplingPeriodNs;
+    base::Optional<uint64_t> memory_bytes = GetResidentMemoryBytes();
+    if (memory_bytes && *memory_bytes > start_memory_bytes_ &&
+        *memory_bytes - start_memory_bytes_ > max_memory_bytes_) {
+      Stop(Reason::kMemoryLimit);
+      return false;
+    }
+  }
+  return true;
+}
+
+util::Status QueryBudget::status() const {
+  switch (reason_.load(std::memory_order_relaxed)) {
+    case Reason::kNone:
+      return util::OkStatus();
+    case Reason::kInterrupted:
+      return util::ErrStatus("Query interrupted");
+    case Reason::kTimeLimit:
+      return util::ErrStatus("Query exceeded the time limit of %" PRId64 " ms",
+                             max_duration_ns_ / (1000 * 1000));
+    case Reason::kMemoryLimit:
+      return util::ErrStatus(
+          "Query exceeded the memory limit of %" PRIu64 " bytes",
+          max_memory_bytes_);
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+void QueryBudget::Stop(Reason reason) {
+  // Only the first reason is kept: it is the one which stopped the query.
+  Reason expected = Reason::kNone;
+  reason_.compare_exchange_strong(expected, reason, std::memory_order_relaxed);
+}
+
+base::Optional<uint64_t> QueryBudget::GetResidentMemoryBytes() {
+#if PERFETTO_TP_HAS_PROC_STATM()
+  if (!statm_fd_)
+    statm_fd_ = base::OpenFile("/proc/self/statm", O_RDONLY);
+  if (!statm_fd_)
+    return base::nullopt;
+
+  // The format is "size resident shared text lib data dt", in pages.
+  char buf[128];
+  ssize_t rsize = pread(*statm_fd_, buf, sizeof(buf) - 1, 0);
+  if (rsize <= 0)
+    return base::nullopt;
+  buf[rsize] = '\0';
+  char* end = nullptr;
+  strtoull(buf, &end, 10);
+  uint64_t resident_pages = strtoull(end, nullptr, 10);
+  return resident_pages * base::GetSysPageSize();
+#else
+  return base::nullopt;
+#endif
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_BUDGET_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_QUERY_BUDGET_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "perfetto/ext/base/optional.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/trace_processor/status.h"
+
+struct sqlite3;
+
+namespace perfetto {
+namespace trace_processor {
+
+// Stops the query running on a TraceProcessor instance when it is interrupted
+// (see TraceProcessor::InterruptQuery()) or when it runs for longer or uses
+// more memory than allowed by the Config.
+//
+// Check() is called by SQLite every few VM instructions through a progress
+// handler and by the code which can run for a long time without returning to
+// SQLite (DbSqliteTable cursors and dynamic table generators). Once a check
+// fails all the following ones fail too, until the next query is started, so
+// that the query unwinds as quickly as possible.
+class QueryBudget {
+ public:
+  // The limits of each query, 0 means no limit. See Config for the details.
+  // If |parent| is set, queries also stop when |parent| is interrupted: this
+  // is used by the workers computing metrics on behalf of another instance
+  // (see Config::metric_threads).
+  QueryBudget(uint64_t max_duration_ms,
+              uint64_t max_memory_bytes,
+              const QueryBudget* parent = nullptr);
+  ~QueryBudget();
+
+  // Makes SQLite call Check() while running statements on |db|. Does nothing
+  // if there are no limits and no parent as interruptions are handled by
+  // sqlite3_interrupt.
+  void RegisterProgressHandler(sqlite3* db);
+
+  // Resets the budget for a new query.
+  void StartQuery();
+
+  // Makes the current query fail. Can be called from any thread and from
+  // signal handlers.
+  void Interrupt();
+
+  // Returns false if the current query should stop, status() returns why.
+  bool Check();
+
+  // Returns the reason why the current query was stopped or OkStatus() if it
+  // is within its budget.
+  util::Status status() const;
+
+ private:
+  enum class Reason : uint32_t {
+    kNone = 0,
+    kInterrupted,
+    kTimeLimit,
+    kMemoryLimit,
+  };
+
+  // Returns the resident memory of the process or nullopt if this is not
+  // supported on the platform.
+  base::Optional<uint64_t> GetResidentMemoryBytes();
+
+  void Stop(Reason);
+
+  bool interrupted() const {
+    return reason_.load(std::memory_order_relaxed) == Reason::kInterrupted;
+  }
+
+  const int64_t max_duration_ns_;
+  const uint64_t max_memory_bytes_;
+  const QueryBudget* const parent_;
+
+  // Written from other threads by Interrupt().
+  std::atomic<Reason> reason_{Reason::kNone};
+
+  int64_t start_ns_ = 0;
+
+  // The resident memory is sampled at most every kMemorySamplingPeriodNs as
+  // reading it is much slower than checking the time.
+  uint64_t start_memory_bytes_ = 0;
+  int64_t next_memory_sample_ns_ = 0;
+  base::ScopedFile statm_fd_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_QUERY_BUDGET_H_
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_budget.h"
+
+#include <sqlite3.h>
+
+#include <thread>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/time.h"
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Counts up forever: only stops when the progress handler interrupts it.
+constexpr char kEndlessQuery[] =
+    "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+    "SELECT MAX(x) FROM c";
+
+class QueryBudgetTest : public ::testing::Test {
+ protected:
+  QueryBudgetTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+  }
+
+  int RunQuery(const char* sql) {
+    sqlite3_stmt* raw_stmt = nullptr;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql, -1, &raw_stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt stmt(raw_stmt);
+    int ret;
+    do {
+      ret = sqlite3_step(*stmt);
+    } while (ret == SQLITE_ROW);
+    return ret;
+  }
+
+  ScopedDb db_;
+};
+
+TEST_F(QueryBudgetTest, NoLimits) {
+  QueryBudget budget(0, 0);
+  budget.RegisterProgressHandler(*db_);
+  budget.StartQuery();
+  ASSERT_EQ(RunQuery("SELECT 1"), SQLITE_DONE);
+  ASSERT_TRUE(budget.Check());
+  ASSERT_TRUE(budget.status().ok());
+}
+
+TEST_F(QueryBudgetTest, InterruptIsStickyUntilNextQuery) {
+  QueryBudget budget(0, 0);
+  budget.StartQuery();
+  budget.Interrupt();
+  ASSERT_FALSE(budget.Check());
+  ASSERT_FALSE(budget.Check());
+  ASSERT_EQ(budget.status().message(), "Query interrupted");
+
+  budget.StartQuery();
+  ASSERT_TRUE(budget.Check());
+  ASSERT_TRUE(budget.status().ok());
+}
+
+TEST_F(QueryBudgetTest, TimeLimit) {
+  QueryBudget budget(10, 0);
+  budget.StartQuery();
+  ASSERT_TRUE(budget.Check());
+  base::SleepMicroseconds(20 * 1000);
+  ASSERT_FALSE(budget.Check());
+  ASSERT_EQ(budget.status().message(),
+            "Query exceeded the time limit of 10 ms");
+
+  // An interruption after the limit is hit does not change the reason.
+  budget.Interrupt();
+  ASSERT_EQ(budget.status().message(),
+            "Query exceeded the time limit of 10 ms");
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+TEST_F(QueryBudgetTest, MemoryLimit) {
+  QueryBudget budget(0, 16 * 1024 * 1024);
+  budget.StartQuery();
+  ASSERT_TRUE(budget.Check());
+
+  // Touch the pages so that they count towards the resident memory.
+  std::vector<char> buf(64 * 1024 * 1024, 1);
+  base::SleepMicroseconds(20 * 1000);
+  ASSERT_FALSE(budget.Check());
+  ASSERT_EQ(budget.status().message(),
+            "Query exceeded the memory limit of 16777216 bytes");
+}
+#endif
+
+TEST_F(QueryBudgetTest, ProgressHandlerStopsQuery) {
+  QueryBudget budget(10, 0);
+  budget.RegisterProgressHandler(*db_);
+  budget.StartQuery();
+  ASSERT_EQ(RunQuery(kEndlessQuery), SQLITE_INTERRUPT);
+  ASSERT_EQ(budget.status().message(),
+            "Query exceeded the time limit of 10 ms");
+
+  // The next query gets a new budget.
+  budget.StartQuery();
+  ASSERT_EQ(RunQuery("SELECT 1"), SQLITE_DONE);
+  ASSERT_TRUE(budget.status().ok());
+}
+
+TEST_F(QueryBudgetTest, InterruptFromAnotherThread) {
+  QueryBudget budget(60 * 1000, 0);
+  budget.RegisterProgressHandler(*db_);
+  budget.StartQuery();
+  std::thread interrupter([&budget] {
+    base::SleepMicroseconds(10 * 1000);
+    budget.Interrupt();
+  });
+  ASSERT_EQ(RunQuery(kEndlessQuery), SQLITE_INTERRUPT);
+  interrupter.join();
+  ASSERT_EQ(budget.status().message(), "Query interrupted");
+}
+
+TEST_F(QueryBudgetTest, ParentInterrupt) {
+  QueryBudget parent(0, 0);
+  QueryBudget budget(0, 0, &parent);
+  budget.RegisterProgressHandler(*db_);
+  parent.StartQuery();
+  budget.StartQuery();
+  std::thread interrupter([&parent] {
+    base::SleepMicroseconds(10 * 1000);
+    parent.Interrupt();
+  });
+  ASSERT_EQ(RunQuery(kEndlessQuery), SQLITE_INTERRUPT);
+  interrupter.join();
+  ASSERT_EQ(budget.status().message(), "Query interrupted");
+
+  // The interruption lasts until the parent starts a new query.
+  budget.StartQuery();
+  ASSERT_FALSE(budget.Check());
+  parent.StartQuery();
+  budget.StartQuery();
+  ASSERT_TRUE(budget.Check());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
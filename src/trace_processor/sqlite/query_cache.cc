@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include <string.h>
+
+#include <iterator>
+
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+template <typename T>
+void AppendRaw(std::string* key, T value) {
+  key->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+QueryCache::QueryCache(TraceStorage* storage, uint64_t max_bytes)
+    : storage_(storage), max_bytes_(max_bytes) {}
+
+QueryCache::~QueryCache() = default;
+
+std::shared_ptr<Table> QueryCache::GetResult(
+    const Table* source,
+    const std::vector<trace_processor::Constraint>& cs,
+    const std::vector<Order>& ob) {
+  if (max_bytes_ == 0)
+    return nullptr;
+
+  // Avoid building the key if there is nothing cached.
+  auto it = result_index_.end();
+  if (!results_.empty()) {
+    BuildKey(source, cs, ob);
+    it = result_index_.find(key_);
+  }
+  if (it == result_index_.end()) {
+    if (storage_)
+      storage_->IncrementStats(stats::query_cache_misses);
+    return nullptr;
+  }
+
+  // Move the result to the front of the list as it's now the most recently
+  // used one.
+  results_.splice(results_.begin(), results_, it->second);
+  if (storage_)
+    storage_->IncrementStats(stats::query_cache_hits);
+  return it->second->table;
+}
+
+void QueryCache::CacheResult(const Table* source,
+                             const std::vector<trace_processor::Constraint>& cs,
+                             const std::vector<Order>& ob,
+                             std::shared_ptr<Table> result) {
+  uint64_t bytes = ApproxBytesUsed(*result);
+  if (bytes > max_bytes_)
+    return;
+
+  BuildKey(source, cs, ob);
+  auto index_it = result_index_.find(key_);
+  if (index_it != result_index_.end())
+    EraseResult(index_it->second);
+
+  while (result_bytes_ + bytes > max_bytes_) {
+    PERFETTO_DCHECK(!results_.empty());
+    EraseResult(std::prev(results_.end()));
+    if (storage_)
+      storage_->IncrementStats(stats::query_cache_evictions);
+  }
+
+  CachedResult cached;
+  cached.table = std::move(result);
+  cached.source = source;
+  cached.bytes = bytes;
+  cached.key = key_;
+  results_.emplace_front(std::move(cached));
+  result_index_.emplace(key_, results_.begin());
+  result_bytes_ += bytes;
+}
+
+void QueryCache::Invalidate(const Table* source) {
+  if (cached_.source == source)
+    cached_ = CachedTable();
+
+  for (auto it = results_.begin(); it != results_.end();) {
+    auto next = std::next(it);
+    if (it->source == source)
+      EraseResult(it);
+    it = next;
+  }
+}
+
+void QueryCache::InvalidateAll() {
+  cached_ = CachedTable();
+  results_.clear();
+  result_index_.clear();
+  result_bytes_ = 0;
+}
+
+// static
+uint64_t QueryCache::ApproxBytesUsed(const Table& table) {
+  uint64_t bytes = sizeof(Table) + table.GetColumnCount() * sizeof(Column);
+  for (const RowMap& rm : table.row_maps()) {
+    bytes += sizeof(RowMap) + rm.ApproxBytesUsed();
+  }
+  return bytes;
+}
+
+void QueryCache::BuildKey(const Table* source,
+                          const std::vector<trace_processor::Constraint>& cs,
+                          const std::vector<Order>& ob) {
+  key_.clear();
+  AppendRaw(&key_, source);
+  AppendRaw(&key_, source->row_count());
+
+  AppendRaw(&key_, static_cast<uint32_t>(cs.size()));
+  for (const trace_processor::Constraint& c : cs) {
+    AppendRaw(&key_, c.col_idx);
+    AppendRaw(&key_, static_cast<uint32_t>(c.op));
+    AppendRaw(&key_, static_cast<uint32_t>(c.value.type));
+    switch (c.value.type) {
+      case SqlValue::kNull:
+        break;
+      case SqlValue::kLong:
+        AppendRaw(&key_, c.value.long_value);
+        break;
+      case SqlValue::kDouble:
+        AppendRaw(&key_, c.value.double_value);
+        break;
+      case SqlValue::kString: {
+        // Include the size so that the boundaries between strings are
+        // unambiguous.
+        size_t size = strlen(c.value.string_value);
+        AppendRaw(&key_, size);
+        key_.append(c.value.string_value, size);
+        break;
+      }
+      case SqlValue::kBytes: {
+        AppendRaw(&key_, c.value.bytes_count);
+        key_.append(static_cast<const char*>(c.value.bytes_value),
+                    c.value.bytes_count);
+        break;
+      }
+    }
+  }
+
+  AppendRaw(&key_, static_cast<uint32_t>(ob.size()));
+  for (const Order& o : ob) {
+    AppendRaw(&key_, o.col_idx);
+    AppendRaw(&key_, o.desc);
+  }
+}
+
+void QueryCache::EraseResult(ResultList::iterator it) {
+  result_index_.erase(it->key);
+  result_bytes_ -= it->bytes;
+  results_.erase(it);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
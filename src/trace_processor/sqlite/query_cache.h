@@ -17,6 +17,15 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "perfetto/ext/base/optional.h"
 
 #include "src/trace_processor/db/table.h"
@@ -25,6 +34,8 @@
 namespace perfetto {
 namespace trace_processor {
 
+class TraceStorage;
+
 // Implements a simple caching strategy for commonly executed queries.
 // TODO(lalitm): the design of this class is very experimental. It was mainly
 // introduced to solve a specific problem (slow process summary tracks in the
@@ -33,6 +44,12 @@ class QueryCache {
  public:
   using Constraint = QueryConstraints::Constraint;
 
+  // |storage| is used to record the hit and miss counts of the result cache
+  // in the stats table and may be nullptr. |max_bytes| is the memory budget
+  // of the result cache.
+  QueryCache(TraceStorage* storage, uint64_t max_bytes);
+  ~QueryCache();
+
   // Returns a cached table if the passed query set are currenly cached or
   // nullptr otherwise.
   std::shared_ptr<Table> GetIfCached(const Table* source,
@@ -64,6 +81,42 @@ class QueryCache {
     return cached_.table;
   }
 
+  // Returns the result of filtering |source| with |cs| and sorting it by |ob|
+  // if it was previously cached with |CacheResult| or nullptr otherwise.
+  //
+  // Unlike the sorted tables above, results are keyed on the values of the
+  // constraints and live across queries: this speeds up the queries with the
+  // same shape that the UI issues repeatedly.
+  std::shared_ptr<Table> GetResult(
+      const Table* source,
+      const std::vector<trace_processor::Constraint>& cs,
+      const std::vector<Order>& ob);
+
+  // Caches |result| as the result of filtering |source| with |cs| and sorting
+  // it by |ob|. The least recently used results are evicted to keep the
+  // memory used by the cache within the budget; |result| is not cached at all
+  // if it would take up more than the whole budget.
+  void CacheResult(const Table* source,
+                   const std::vector<trace_processor::Constraint>& cs,
+                   const std::vector<Order>& ob,
+                   std::shared_ptr<Table> result);
+
+  // Drops all the cached tables computed from |source|. This should be called
+  // whenever |source| is mutated.
+  void Invalidate(const Table* source);
+
+  // Drops all the cached tables.
+  void InvalidateAll();
+
+  // Returns the approximate number of bytes used by the cached results.
+  uint64_t result_bytes() const { return result_bytes_; }
+
+  // Returns the number of cached results.
+  size_t result_count() const { return results_.size(); }
+
+  // Returns the approximate number of bytes used to store the rows of |table|.
+  static uint64_t ApproxBytesUsed(const Table& table);
+
  private:
   struct CachedTable {
     std::shared_ptr<Table> table;
@@ -72,7 +125,42 @@ class QueryCache {
     std::vector<Constraint> constraints;
   };
 
+  struct CachedResult {
+    std::shared_ptr<Table> table;
+
+    const Table* source = nullptr;
+    uint64_t bytes = 0;
+
+    // The key of this result in |result_index_|.
+    std::string key;
+  };
+  using ResultList = std::list<CachedResult>;
+
+  // Writes the key identifying the result of filtering |source| with |cs|
+  // and sorting it by |ob| to |key_|. The row count of |source| is part of
+  // the key so that results are never reused after rows are added to
+  // |source|.
+  void BuildKey(const Table* source,
+                const std::vector<trace_processor::Constraint>& cs,
+                const std::vector<Order>& ob);
+
+  // Removes the result pointed to by |it| from the cache.
+  void EraseResult(ResultList::iterator it);
+
   CachedTable cached_;
+
+  TraceStorage* storage_ = nullptr;
+  uint64_t max_bytes_ = 0;
+
+  // The cached results in order of use: the most recently used result is at
+  // the front.
+  ResultList results_;
+  std::unordered_map<std::string, ResultList::iterator> result_index_;
+  uint64_t result_bytes_ = 0;
+
+  // Reused between calls to |BuildKey| to avoid allocating memory on every
+  // lookup.
+  std::string key_;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include "src/trace_processor/tables/macros.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_CACHE_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestCacheTable, "cache")                           \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                       \
+  C(int64_t, ts, Column::Flag::kSorted)                   \
+  C(int64_t, track_id)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_CACHE_TABLE_DEF);
+
+TestCacheTable::~TestCacheTable() = default;
+
+class QueryCacheUnittest : public ::testing::Test {
+ protected:
+  QueryCacheUnittest() : table_(&pool_, nullptr) {
+    for (int64_t i = 0; i < 1000; ++i) {
+      TestCacheTable::Row row;
+      row.ts = i;
+      row.track_id = i % 10;
+      table_.Insert(row);
+    }
+  }
+
+  std::vector<Constraint> TrackEq(int64_t track_id) {
+    return {table_.track_id().eq(track_id)};
+  }
+
+  std::shared_ptr<Table> Compute(const std::vector<Constraint>& cs) {
+    return std::shared_ptr<Table>(new Table(table_.Filter(cs)));
+  }
+
+  StringPool pool_;
+  TestCacheTable table_;
+};
+
+TEST_F(QueryCacheUnittest, HitAndMiss) {
+  QueryCache cache(nullptr, 1024 * 1024);
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(1), {}), nullptr);
+
+  std::shared_ptr<Table> result = Compute(TrackEq(1));
+  cache.CacheResult(&table_, TrackEq(1), {}, result);
+  ASSERT_EQ(cache.result_count(), 1u);
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(1), {}), result);
+
+  // The values, the orders and the source table are all part of the key.
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(2), {}), nullptr);
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(1), {table_.ts().descending()}),
+            nullptr);
+
+  StringPool other_pool;
+  TestCacheTable other(&other_pool, nullptr);
+  ASSERT_EQ(cache.GetResult(&other, TrackEq(1), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, StringKey) {
+  QueryCache cache(nullptr, 1024 * 1024);
+  std::vector<Constraint> cs = {
+      table_.ts().eq(10), Constraint{1, FilterOp::kEq, SqlValue::String("a")}};
+  cache.CacheResult(&table_, cs, {}, Compute({table_.ts().eq(10)}));
+
+  // The string should have been copied into the key.
+  std::string value = "a";
+  cs[1].value = SqlValue::String(value.c_str());
+  ASSERT_NE(cache.GetResult(&table_, cs, {}), nullptr);
+
+  cs[1].value = SqlValue::String("ab");
+  ASSERT_EQ(cache.GetResult(&table_, cs, {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, InvalidateOnInsert) {
+  QueryCache cache(nullptr, 1024 * 1024);
+  cache.CacheResult(&table_, TrackEq(1), {}, Compute(TrackEq(1)));
+  ASSERT_NE(cache.GetResult(&table_, TrackEq(1), {}), nullptr);
+
+  // Adding rows to the source table should make the result stale.
+  TestCacheTable::Row row;
+  row.ts = 1000;
+  row.track_id = 1;
+  table_.Insert(row);
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(1), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, Invalidate) {
+  QueryCache cache(nullptr, 1024 * 1024);
+  cache.CacheResult(&table_, TrackEq(1), {}, Compute(TrackEq(1)));
+  cache.CacheResult(&table_, TrackEq(2), {}, Compute(TrackEq(2)));
+  ASSERT_EQ(cache.result_count(), 2u);
+
+  StringPool other_pool;
+  TestCacheTable other(&other_pool, nullptr);
+  cache.Invalidate(&other);
+  ASSERT_EQ(cache.result_count(), 2u);
+
+  cache.Invalidate(&table_);
+  ASSERT_EQ(cache.result_count(), 0u);
+  ASSERT_EQ(cache.result_bytes(), 0u);
+
+  cache.CacheResult(&table_, TrackEq(1), {}, Compute(TrackEq(1)));
+  cache.InvalidateAll();
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(1), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, LruEviction) {
+  uint64_t bytes = QueryCache::ApproxBytesUsed(*Compute(TrackEq(0)));
+  QueryCache cache(nullptr, 3 * bytes);
+  cache.CacheResult(&table_, TrackEq(0), {}, Compute(TrackEq(0)));
+  cache.CacheResult(&table_, TrackEq(1), {}, Compute(TrackEq(1)));
+  cache.CacheResult(&table_, TrackEq(2), {}, Compute(TrackEq(2)));
+  ASSERT_EQ(cache.result_count(), 3u);
+  ASSERT_EQ(cache.result_bytes(), 3 * bytes);
+
+  // Use 0 so that 1 becomes the least recently used result.
+  ASSERT_NE(cache.GetResult(&table_, TrackEq(0), {}), nullptr);
+
+  cache.CacheResult(&table_, TrackEq(3), {}, Compute(TrackEq(3)));
+  ASSERT_EQ(cache.result_count(), 3u);
+  ASSERT_NE(cache.GetResult(&table_, TrackEq(0), {}), nullptr);
+  ASSERT_EQ(cache.GetResult(&table_, TrackEq(1), {}), nullptr);
+  ASSERT_NE(cache.GetResult(&table_, TrackEq(2), {}), nullptr);
+  ASSERT_NE(cache.GetResult(&table_, TrackEq(3), {}), nullptr);
+}
+
+TEST_F(QueryCacheUnittest, TooLarge) {
+  std::shared_ptr<Table> result = Compute(TrackEq(0));
+  QueryCache cache(nullptr, QueryCache::ApproxBytesUsed(*result) - 1);
+  cache.CacheResult(&table_, TrackEq(0), {}, result);
+  ASSERT_EQ(cache.result_count(), 0u);
+
+  QueryCache disabled(nullptr, 0);
+  disabled.CacheResult(&table_, TrackEq(0), {}, result);
+  ASSERT_EQ(disabled.GetResult(&table_, TrackEq(0), {}), nullptr);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
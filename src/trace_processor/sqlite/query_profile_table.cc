@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_profile_table.h"
+
+#include <sqlite3.h>
+
+#include "src/trace_processor/sqlite/sqlite_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+QueryProfileTable::QueryProfileTable(sqlite3*, const QueryProfiler* profiler)
+    : profiler_(profiler) {}
+
+void QueryProfileTable::RegisterTable(sqlite3* db,
+                                      const QueryProfiler* profiler) {
+  SqliteTable::Register<QueryProfileTable>(db, profiler,
+                                           "__intrinsic_query_profile");
+}
+
+util::Status QueryProfileTable::Init(int, const char* const*, Schema* schema) {
+  auto long_column = [](Column col, const char* name) {
+    return SqliteTable::Column(col, name, SqlValue::Type::kLong);
+  };
+  *schema = Schema(
+      {
+          long_column(Column::kQueryId, "query_id"),
+          SqliteTable::Column(Column::kSql, "sql", SqlValue::Type::kString),
+          SqliteTable::Column(Column::kTableName, "table_name",
+                              SqlValue::Type::kString),
+          long_column(Column::kBestIndexCount, "best_index_count"),
+          long_column(Column::kBestIndexDur, "best_index_dur"),
+          long_column(Column::kFilterCount, "filter_count"),
+          long_column(Column::kFilterDur, "filter_dur"),
+          long_column(Column::kGenerateDur, "generate_dur"),
+          long_column(Column::kSortDur, "sort_dur"),
+          long_column(Column::kRowsIn, "rows_in"),
+          long_column(Column::kRowsOut, "rows_out"),
+          long_column(Column::kCacheHits, "cache_hits"),
+          long_column(Column::kNextCount, "next_count"),
+          long_column(Column::kNextDur, "next_dur"),
+      },
+      {Column::kQueryId, Column::kTableName});
+  return util::OkStatus();
+}
+
+std::unique_ptr<SqliteTable::Cursor> QueryProfileTable::CreateCursor() {
+  return std::unique_ptr<SqliteTable::Cursor>(new Cursor(this));
+}
+
+int QueryProfileTable::BestIndex(const QueryConstraints&, BestIndexInfo*) {
+  return SQLITE_OK;
+}
+
+QueryProfileTable::Cursor::Cursor(QueryProfileTable* table)
+    : SqliteTable::Cursor(table), table_(table) {}
+
+QueryProfileTable::Cursor::~Cursor() = default;
+
+int QueryProfileTable::Cursor::Filter(const QueryConstraints&,
+                                      sqlite3_value**,
+                                      FilterHistory) {
+  rows_.clear();
+  row_ = 0;
+  if (!table_->profiler_)
+    return SQLITE_OK;
+
+  // The profiles only change when the next query starts so they can be
+  // read in place.
+  for (const auto& query : table_->profiler_->profiles()) {
+    for (const auto& table : query.tables) {
+      rows_.push_back(Row{&query, &table.first, &table.second});
+    }
+  }
+  return SQLITE_OK;
+}
+
+int QueryProfileTable::Cursor::Next() {
+  row_++;
+  return SQLITE_OK;
+}
+
+int QueryProfileTable::Cursor::Eof() {
+  return row_ >= rows_.size();
+}
+
+int QueryProfileTable::Cursor::Column(sqlite3_context* context, int col) {
+  const Row& row = rows_[row_];
+  const QueryProfiler::TableProfile& profile = *row.profile;
+  switch (col) {
+    case Column::kQueryId:
+      sqlite3_result_int64(context, row.query->query_id);
+      break;
+    case Column::kSql:
+      sqlite3_result_text(context, row.query->sql.c_str(), -1,
+                          sqlite_utils::kSqliteStatic);
+      break;
+    case Column::kTableName:
+      sqlite3_result_text(context, row.table_name->c_str(), -1,
+                          sqlite_utils::kSqliteStatic);
+      break;
+    case Column::kBestIndexCount:
+      sqlite3_result_int64(context, profile.best_index_count);
+      break;
+    case Column::kBestIndexDur:
+      sqlite3_result_int64(context, profile.best_index_dur_ns);
+      break;
+    case Column::kFilterCount:
+      sqlite3_result_int64(context, profile.filter_count);
+      break;
+    case Column::kFilterDur:
+      sqlite3_result_int64(context, profile.filter_dur_ns);
+      break;
+    case Column::kGenerateDur:
+      sqlite3_result_int64(context, profile.generate_dur_ns);
+      break;
+    case Column::kSortDur:
+      sqlite3_result_int64(context, profile.sort_dur_ns);
+      break;
+    case Column::kRowsIn:
+      sqlite3_result_int64(context, static_cast<int64_t>(profile.rows_in));
+      break;
+    case Column::kRowsOut:
+      sqlite3_result_int64(context, static_cast<int64_t>(profile.rows_out));
+      break;
+    case Column::kCacheHits:
+      sqlite3_result_int64(context, profile.cache_hits);
+      break;
+    case Column::kNextCount:
+      sqlite3_result_int64(context, static_cast<int64_t>(profile.next_count));
+      break;
+    case Column::kNextDur:
+      sqlite3_result_int64(context, profile.next_dur_ns);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILE_TABLE_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILE_TABLE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/trace_processor/sqlite/query_profiler.h"
+#include "src/trace_processor/sqlite/sqlite_table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class QueryConstraints;
+
+// A virtual table exposing the profiles recorded by a QueryProfiler: one row
+// for each table read by each of the last queries. The table is empty unless
+// Config::enable_query_profiling is set.
+class QueryProfileTable : public SqliteTable {
+ public:
+  enum Column {
+    kQueryId = 0,
+    kSql,
+    kTableName,
+    kBestIndexCount,
+    kBestIndexDur,
+    kFilterCount,
+    kFilterDur,
+    kGenerateDur,
+    kSortDur,
+    kRowsIn,
+    kRowsOut,
+    kCacheHits,
+    kNextCount,
+    kNextDur,
+  };
+
+  // Implementation of the SQLite cursor interface.
+  class Cursor : public SqliteTable::Cursor {
+   public:
+    Cursor(QueryProfileTable* table);
+    ~Cursor() override;
+
+    // Implementation of SqliteTable::Cursor.
+    int Filter(const QueryConstraints&,
+               sqlite3_value**,
+               FilterHistory) override;
+    int Next() override;
+    int Eof() override;
+    int Column(sqlite3_context*, int N) override;
+
+   private:
+    struct Row {
+      const QueryProfiler::QueryProfile* query;
+      const std::string* table_name;
+      const QueryProfiler::TableProfile* profile;
+    };
+
+    Cursor(Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+
+    QueryProfileTable* table_ = nullptr;
+    std::vector<Row> rows_;
+    size_t row_ = 0;
+  };
+
+  // |profiler| may be nullptr if queries are not profiled.
+  QueryProfileTable(sqlite3*, const QueryProfiler* profiler);
+
+  static void RegisterTable(sqlite3* db, const QueryProfiler* profiler);
+
+  // Table implementation.
+  util::Status Init(int, const char* const*, Schema*) override;
+  std::unique_ptr<SqliteTable::Cursor> CreateCursor() override;
+  int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
+
+ private:
+  const QueryProfiler* const profiler_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILE_TABLE_H_
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_profiler.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr size_t QueryProfiler::kMaxQueries;
+
+QueryProfiler::QueryProfiler() = default;
+QueryProfiler::~QueryProfiler() = default;
+
+void QueryProfiler::StartQuery(const std::string& sql) {
+  // Queries which didn't read any table (e.g. creating a view) are not worth
+  // keeping.
+  if (has_current_ && !current_.tables.empty()) {
+    if (profiles_.size() >= kMaxQueries)
+      profiles_.pop_front();
+    profiles_.emplace_back(std::move(current_));
+  }
+  has_current_ = true;
+  current_ = QueryProfile();
+  current_.query_id = next_query_id_++;
+  current_.sql = sql;
+}
+
+QueryProfiler::TableProfile* QueryProfiler::GetTableProfile(
+    const std::string& table_name) {
+  if (!has_current_)
+    return nullptr;
+  return &current_.tables[table_name];
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILER_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "perfetto/base/time.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Records where the time of each query is spent in the tables it reads (see
+// Config::enable_query_profiling). The profiles of the last |kMaxQueries|
+// queries can be queried with the __intrinsic_query_profile table (see
+// QueryProfileTable).
+//
+// Like QueryBudget, queries run while another statement is being stepped
+// (e.g. by RUN_METRIC) are profiled as part of that statement.
+//
+// This class is not thread safe: each TraceProcessor instance has its own.
+class QueryProfiler {
+ public:
+  static constexpr size_t kMaxQueries = 100;
+
+  // The time spent in a table by a query, summed over all the cursors of the
+  // query reading the table.
+  struct TableProfile {
+    // Number of calls to xBestIndex while planning the query. Statements
+    // reused from the statement cache are not planned again.
+    uint32_t best_index_count = 0;
+    int64_t best_index_dur_ns = 0;
+
+    // Number of calls to xFilter and total time spent in them, which
+    // includes |generate_dur_ns| and |sort_dur_ns|.
+    uint32_t filter_count = 0;
+    int64_t filter_dur_ns = 0;
+
+    // Time spent computing the rows of dynamic tables.
+    int64_t generate_dur_ns = 0;
+
+    // Time spent in Table::Sort for ORDER BY clauses.
+    int64_t sort_dur_ns = 0;
+
+    // Number of rows of the tables passed to Table::Filter and number of rows
+    // matching the constraints of the query.
+    uint64_t rows_in = 0;
+    uint64_t rows_out = 0;
+
+    // Number of calls to xFilter answered with a table from the QueryCache
+    // (either the result of a previous query or a table sorted on the
+    // constrained column).
+    uint32_t cache_hits = 0;
+
+    // Number of calls to xNext and total time spent in them.
+    uint64_t next_count = 0;
+    int64_t next_dur_ns = 0;
+  };
+
+  struct QueryProfile {
+    // Increases with each query profiled by this instance.
+    uint32_t query_id = 0;
+    std::string sql;
+
+    // Keyed by the name of the table. std::map is used as the cursors of the
+    // query hold pointers to the values.
+    std::map<std::string, TableProfile> tables;
+  };
+
+  // Measures the time between its construction and its destruction and adds
+  // it to |*dur_ns|. Does nothing if |dur_ns| is nullptr.
+  class ScopedTimer {
+   public:
+    explicit ScopedTimer(int64_t* dur_ns)
+        : dur_ns_(dur_ns), start_(dur_ns ? base::GetWallTimeNs().count() : 0) {}
+    ~ScopedTimer() {
+      if (dur_ns_)
+        *dur_ns_ += base::GetWallTimeNs().count() - start_;
+    }
+
+   private:
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    int64_t* const dur_ns_;
+    const int64_t start_;
+  };
+
+  QueryProfiler();
+  ~QueryProfiler();
+
+  // Starts profiling the query |sql|: the profile of the previous query is
+  // added to profiles().
+  void StartQuery(const std::string& sql);
+
+  // Returns the profile of the table |table_name| for the query being run or
+  // nullptr if no query was started. The returned pointer is valid until the
+  // next call to StartQuery().
+  TableProfile* GetTableProfile(const std::string& table_name);
+
+  // The profiles of the last |kMaxQueries| queries, excluding the query being
+  // run, from the oldest to the newest.
+  const std::deque<QueryProfile>& profiles() const { return profiles_; }
+
+ private:
+  QueryProfiler(const QueryProfiler&) = delete;
+  QueryProfiler& operator=(const QueryProfiler&) = delete;
+
+  bool has_current_ = false;
+  QueryProfile current_;
+  uint32_t next_query_id_ = 0;
+  std::deque<QueryProfile> profiles_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILER_H_
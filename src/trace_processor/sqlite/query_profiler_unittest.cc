@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_profiler.h"
+
+#include <sqlite3.h>
+
+#include <string>
+#include <vector>
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/query_profile_table.h"
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_PROFILE_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestProfileTable, "profiled")                        \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                         \
+  C(int64_t, ts, Column::Flag::kSorted)                     \
+  C(int64_t, track_id)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_PROFILE_TABLE_DEF);
+
+TestProfileTable::~TestProfileTable() = default;
+
+class QueryProfilerTest : public ::testing::Test {
+ protected:
+  QueryProfilerTest()
+      : table_(&pool_, nullptr), cache_(nullptr, 1024 * 1024) {
+    for (int64_t i = 0; i < 1000; ++i) {
+      TestProfileTable::Row row;
+      row.ts = i;
+      row.track_id = i % 10;
+      table_.Insert(row);
+    }
+
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+    DbSqliteTable::RegisterTable(*db_, &cache_, nullptr, &profiler_,
+                                 TestProfileTable::Schema(), &table_,
+                                 table_.table_name());
+    QueryProfileTable::RegisterTable(*db_, &profiler_);
+  }
+
+  // Runs |sql| as a new query and returns the number of rows it returned.
+  uint32_t RunQuery(const std::string& sql) {
+    profiler_.StartQuery(sql);
+    sqlite3_stmt* raw_stmt = nullptr;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &raw_stmt,
+                                      nullptr) == SQLITE_OK);
+    ScopedStmt stmt(raw_stmt);
+    uint32_t rows = 0;
+    int ret;
+    while ((ret = sqlite3_step(*stmt)) == SQLITE_ROW)
+      rows++;
+    PERFETTO_CHECK(ret == SQLITE_DONE);
+    return rows;
+  }
+
+  // Returns the values of |column| in the rows of __intrinsic_query_profile.
+  std::vector<int64_t> ReadProfileColumn(const std::string& column) {
+    std::string sql = "SELECT " + column + " FROM __intrinsic_query_profile";
+    profiler_.StartQuery(sql);
+    sqlite3_stmt* raw_stmt = nullptr;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &raw_stmt,
+                                      nullptr) == SQLITE_OK);
+    ScopedStmt stmt(raw_stmt);
+    std::vector<int64_t> values;
+    while (sqlite3_step(*stmt) == SQLITE_ROW)
+      values.push_back(sqlite3_column_int64(*stmt, 0));
+    return values;
+  }
+
+  StringPool pool_;
+  TestProfileTable table_;
+  QueryCache cache_;
+  QueryProfiler profiler_;
+  ScopedDb db_;
+};
+
+TEST_F(QueryProfilerTest, FilterAndSort) {
+  ASSERT_EQ(RunQuery("SELECT ts FROM profiled WHERE track_id = 1 "
+                     "ORDER BY ts DESC"),
+            100u);
+  profiler_.StartQuery("next");
+
+  ASSERT_EQ(profiler_.profiles().size(), 1u);
+  const QueryProfiler::QueryProfile& query = profiler_.profiles().back();
+  ASSERT_EQ(query.tables.size(), 1u);
+  const QueryProfiler::TableProfile& profile = query.tables.at("profiled");
+  ASSERT_GE(profile.best_index_count, 1u);
+  ASSERT_EQ(profile.filter_count, 1u);
+  ASSERT_EQ(profile.rows_in, 1000u);
+  ASSERT_EQ(profile.rows_out, 100u);
+  ASSERT_EQ(profile.next_count, 100u);
+  ASSERT_EQ(profile.cache_hits, 0u);
+  ASSERT_GT(profile.sort_dur_ns, 0);
+  ASSERT_GE(profile.filter_dur_ns, profile.sort_dur_ns);
+}
+
+TEST_F(QueryProfilerTest, CacheHits) {
+  // The rows are only sorted (and so cached) for descending orders as the ts
+  // column is sorted.
+  const char kSql[] =
+      "SELECT ts FROM profiled WHERE track_id = 2 ORDER BY ts DESC";
+  RunQuery(kSql);
+  RunQuery(kSql);
+
+  // The second query doesn't filter the table.
+  ASSERT_EQ(ReadProfileColumn("cache_hits"), std::vector<int64_t>({0, 1}));
+  ASSERT_EQ(ReadProfileColumn("rows_out"), std::vector<int64_t>({100, 0}));
+}
+
+TEST_F(QueryProfilerTest, Table) {
+  RunQuery("SELECT * FROM profiled WHERE ts < 10");
+  RunQuery("SELECT 1");
+  RunQuery("SELECT COUNT(*) FROM profiled AS a JOIN profiled AS b USING(ts)");
+
+  // Queries which don't read a table have no profile.
+  ASSERT_EQ(ReadProfileColumn("query_id"), std::vector<int64_t>({0, 2}));
+
+  // The profiles of both sides of the join are summed: each row of the outer
+  // side is looked up in the inner side.
+  ASSERT_EQ(ReadProfileColumn("rows_out"), std::vector<int64_t>({10, 2000}));
+
+  // The profile queries themselves are not profiled.
+  ASSERT_EQ(ReadProfileColumn("COUNT(*)"), std::vector<int64_t>({2}));
+}
+
+TEST_F(QueryProfilerTest, MaxQueries) {
+  for (size_t i = 0; i < QueryProfiler::kMaxQueries + 10; ++i)
+    RunQuery("SELECT ts FROM profiled WHERE ts = " + std::to_string(i));
+  profiler_.StartQuery("next");
+
+  ASSERT_EQ(profiler_.profiles().size(), QueryProfiler::kMaxQueries);
+  ASSERT_EQ(profiler_.profiles().front().query_id, 10u);
+}
+
+TEST(QueryProfilerNoQueryTest, NoProfileBeforeStartQuery) {
+  QueryProfiler profiler;
+  ASSERT_EQ(profiler.GetTableProfile("foo"), nullptr);
+  profiler.StartQuery("SELECT 1");
+  ASSERT_NE(profiler.GetTableProfile("foo"), nullptr);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
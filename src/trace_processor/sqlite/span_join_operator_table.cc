@@ -625,6 +625,18 @@ util::Status SpanJoinOperatorTable::Query::Initialize(
   *this = Query(table_, definition(), db_);
   sql_query_ = CreateSqlQuery(
       table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv));
+
+  // The unpartitioned table in a mixed partition span join is rewound for
+  // every partition of the other table: buffer its rows so that we only
+  // need to run the query once.
+  if (table_->partitioning_ == PartitioningType::kMixedPartitioning &&
+      !defn_->IsPartitioned()) {
+    buffer_.reset(new Buffer());
+    util::Status status = FillBuffer();
+    if (!status.ok())
+      return status;
+  }
+
   util::Status status = Rewind();
   if (!status.ok())
     return status;
@@ -753,15 +765,19 @@ util::Status SpanJoinOperatorTable::Query::NextSliceState() {
 }
 
 util::Status SpanJoinOperatorTable::Query::Rewind() {
-  sqlite3_stmt* stmt = nullptr;
-  int res =
-      sqlite3_prepare_v2(db_, sql_query_.c_str(),
-                         static_cast<int>(sql_query_.size()), &stmt, nullptr);
-  stmt_.reset(stmt);
-
-  cursor_eof_ = res != SQLITE_OK;
-  if (res != SQLITE_OK)
-    return util::ErrStatus("%s", sqlite3_errmsg(db_));
+  if (buffer_) {
+    buffer_row_ = kBeforeFirstRow;
+  } else {
+    sqlite3_stmt* stmt = nullptr;
+    int res =
+        sqlite3_prepare_v2(db_, sql_query_.c_str(),
+                           static_cast<int>(sql_query_.size()), &stmt, nullptr);
+    stmt_.reset(stmt);
+
+    cursor_eof_ = res != SQLITE_OK;
+    if (res != SQLITE_OK)
+      return util::ErrStatus("%s", sqlite3_errmsg(db_));
+  }
 
   util::Status status = CursorNext();
   if (!status.ok())
@@ -788,6 +804,15 @@ util::Status SpanJoinOperatorTable::Query::Rewind() {
 }
 
 util::Status SpanJoinOperatorTable::Query::CursorNext() {
+  if (buffer_) {
+    // Buffered tables are never partitioned so we don't need to skip any
+    // rows with null partition keys.
+    PERFETTO_DCHECK(!defn_->IsPartitioned());
+    buffer_row_ = buffer_row_ == kBeforeFirstRow ? 0 : buffer_row_ + 1;
+    cursor_eof_ = buffer_row_ >= buffer_->row_count;
+    return util::OkStatus();
+  }
+
   auto* stmt = stmt_.get();
   int res;
   if (defn_->IsPartitioned()) {
@@ -828,6 +853,59 @@ std::string SpanJoinOperatorTable::Query::CreateSqlQuery(
   return sql;
 }
 
+util::Status SpanJoinOperatorTable::Query::FillBuffer() {
+  PERFETTO_TP_TRACE("SPAN_JOIN_FILL_BUFFER", [this](metatrace::Record* r) {
+    r->AddArg("Table", defn_->name());
+  });
+
+  sqlite3_stmt* raw_stmt = nullptr;
+  int res = sqlite3_prepare_v2(db_, sql_query_.c_str(),
+                               static_cast<int>(sql_query_.size()), &raw_stmt,
+                               nullptr);
+  ScopedStmt stmt(raw_stmt);
+  if (res != SQLITE_OK)
+    return util::ErrStatus("%s", sqlite3_errmsg(db_));
+
+  size_t col_count = defn_->columns().size();
+  buffer_->columns.resize(col_count);
+  for (res = sqlite3_step(*stmt); res == SQLITE_ROW;
+       res = sqlite3_step(*stmt)) {
+    for (size_t i = 0; i < col_count; ++i) {
+      int idx = static_cast<int>(i);
+
+      // Read ts and dur as integers whatever their type to match what
+      // |CursorTs()| and |CursorDur()| do for unbuffered queries.
+      SqlValue value;
+      if (i == defn_->ts_idx() || i == defn_->dur_idx()) {
+        value = SqlValue::Long(sqlite3_column_int64(*stmt, idx));
+        buffer_->columns[i].push_back(value);
+        continue;
+      }
+
+      switch (sqlite3_column_type(*stmt, idx)) {
+        case SQLITE_INTEGER:
+          value = SqlValue::Long(sqlite3_column_int64(*stmt, idx));
+          break;
+        case SQLITE_FLOAT:
+          value = SqlValue::Double(sqlite3_column_double(*stmt, idx));
+          break;
+        case SQLITE_TEXT: {
+          auto ptr =
+              reinterpret_cast<const char*>(sqlite3_column_text(*stmt, idx));
+          StringPool::Id id =
+              buffer_->strings.InternString(base::StringView(ptr));
+          value = SqlValue::String(buffer_->strings.Get(id).c_str());
+          break;
+        }
+      }
+      buffer_->columns[i].push_back(value);
+    }
+    buffer_->row_count++;
+  }
+  return res == SQLITE_DONE ? util::OkStatus()
+                            : util::ErrStatus("%s", sqlite3_errmsg(db_));
+}
+
 void SpanJoinOperatorTable::Query::ReportSqliteResult(sqlite3_context* context,
                                                       size_t index) {
   if (state_ != State::kReal) {
@@ -835,6 +913,28 @@ void SpanJoinOperatorTable::Query::ReportSqliteResult(sqlite3_context* context,
     return;
   }
 
+  if (buffer_) {
+    const SqlValue& value = buffer_->columns[index][buffer_row_];
+    switch (value.type) {
+      case SqlValue::kLong:
+        sqlite3_result_int64(context, value.long_value);
+        break;
+      case SqlValue::kDouble:
+        sqlite3_result_double(context, value.double_value);
+        break;
+      case SqlValue::kString: {
+        const auto kSqliteTransient =
+            reinterpret_cast<sqlite3_destructor_type>(-1);
+        sqlite3_result_text(context, value.string_value, -1, kSqliteTransient);
+        break;
+      }
+      case SqlValue::kNull:
+      case SqlValue::kBytes:
+        break;
+    }
+    return;
+  }
+
   sqlite3_stmt* stmt = stmt_.get();
   int idx = static_cast<int>(index);
   switch (sqlite3_column_type(stmt, idx)) {
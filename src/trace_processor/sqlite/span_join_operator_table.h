@@ -30,6 +30,7 @@
 
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_table.h"
 
@@ -68,6 +69,14 @@ namespace trace_processor {
 //
 // All other columns apart from timestamp (ts), duration (dur) and the join key
 // are passed through unchanged.
+//
+// Partitions are processed one after the other on the calling thread. While
+// the computation for each partition is independent, the rows of the child
+// tables are read by running SQL queries on the same SQLite connection as the
+// span join itself: the child tables are often TEMP tables or views which are
+// only visible on that connection and a connection cannot run statements in
+// parallel. The tables backing the child queries (and the query cache shared
+// between them) are also not safe to read from multiple threads.
 class SpanJoinOperatorTable : public SqliteTable {
  public:
   static constexpr int kSourceGeqOpCode = SQLITE_INDEX_CONSTRAINT_FUNCTION + 1;
@@ -255,6 +264,9 @@ class SpanJoinOperatorTable : public SqliteTable {
     // Creates an SQL query from the given set of constraint strings.
     std::string CreateSqlQuery(const std::vector<std::string>& cs) const;
 
+    // Runs |sql_query_| to completion, storing all the rows in |buffer_|.
+    util::Status FillBuffer();
+
     // Returns whether the current slice pointed to is a present partition
     // shadow.
     bool IsPresentPartitionShadow() const {
@@ -277,12 +289,16 @@ class SpanJoinOperatorTable : public SqliteTable {
 
     int64_t CursorTs() const {
       PERFETTO_DCHECK(!cursor_eof_);
+      if (buffer_)
+        return buffer_->columns[defn_->ts_idx()][buffer_row_].long_value;
       auto ts_idx = static_cast<int>(defn_->ts_idx());
       return sqlite3_column_int64(stmt_.get(), ts_idx);
     }
 
     int64_t CursorDur() const {
       PERFETTO_DCHECK(!cursor_eof_);
+      if (buffer_)
+        return buffer_->columns[defn_->dur_idx()][buffer_row_].long_value;
       auto dur_idx = static_cast<int>(defn_->dur_idx());
       return sqlite3_column_int64(stmt_.get(), dur_idx);
     }
@@ -308,9 +324,32 @@ class SpanJoinOperatorTable : public SqliteTable {
     int64_t missing_partition_start_ = 0;
     int64_t missing_partition_end_ = 0;
 
+    // The rows returned by |sql_query_|. Only used for the unpartitioned
+    // table with PartitioningType::kMixedPartitioning: that query is rewound
+    // for every partition of the other table so, instead of having SQLite
+    // re-run (and re-sort) it every time, we only run it once and then
+    // replay its rows from memory.
+    struct Buffer {
+      // Column-major: |columns[i][j]| is the value of column i in row j.
+      std::vector<std::vector<SqlValue>> columns;
+      uint32_t row_count = 0;
+
+      // Owns the strings pointed to by the values in |columns|.
+      StringPool strings;
+    };
+
     std::string sql_query_;
     ScopedStmt stmt_;
 
+    std::unique_ptr<Buffer> buffer_;
+
+    // Only valid when |buffer_| is non-null. The row of |buffer_| the cursor
+    // points to; the cursor is before the first row when this is
+    // |kBeforeFirstRow|.
+    static constexpr uint32_t kBeforeFirstRow =
+        std::numeric_limits<uint32_t>::max();
+    uint32_t buffer_row_ = kBeforeFirstRow;
+
     const TableDefinition* defn_ = nullptr;
     sqlite3* db_ = nullptr;
     SpanJoinOperatorTable* table_ = nullptr;
@@ -223,6 +223,52 @@ TEST_F(SpanJoinOperatorTableTest, MixedPartitioning) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
+TEST_F(SpanJoinOperatorTableTest, MixedPartitioningManyPartitions) {
+  RunStatement(
+      "CREATE TEMP TABLE f("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT"
+      ");");
+  RunStatement(
+      "CREATE TEMP TABLE s("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "s_double DOUBLE, "
+      "s_str STRING"
+      ");");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_join(f PARTITIONED cpu, s);");
+
+  // The unpartitioned table is rewound for every partition so check that
+  // all the types of values are reported correctly after rewinding.
+  RunStatement("INSERT INTO f VALUES(0, 100, 0);");
+  RunStatement("INSERT INTO f VALUES(50, 100, 1);");
+  RunStatement("INSERT INTO f VALUES(100, 100, 2);");
+
+  RunStatement("INSERT INTO s VALUES(10, 20, 1.5, 'a');");
+  RunStatement("INSERT INTO s VALUES(120, 10, NULL, 'b');");
+
+  PrepareValidStatement(
+      "SELECT ts, dur, cpu, s_double, s_str FROM sp ORDER BY cpu, ts");
+  auto assert_next = [this](int64_t ts, int64_t dur, int64_t cpu,
+                            double s_double, const char* s_str) {
+    AssertNextRow({ts, dur, cpu});
+    if (s_double == 0) {
+      ASSERT_EQ(sqlite3_column_type(stmt_.get(), 3), SQLITE_NULL);
+    } else {
+      ASSERT_EQ(sqlite3_column_double(stmt_.get(), 3), s_double);
+    }
+    ASSERT_STREQ(
+        reinterpret_cast<const char*>(sqlite3_column_text(stmt_.get(), 4)),
+        s_str);
+  };
+  assert_next(10, 20, 0, 1.5, "a");
+  assert_next(120, 10, 1, 0, "b");
+  assert_next(120, 10, 2, 0, "b");
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
 TEST_F(SpanJoinOperatorTableTest, NoPartitioning) {
   RunStatement(
       "CREATE TEMP TABLE f("
@@ -56,7 +56,7 @@ struct FtraceTime {
 class ArgsSerializer {
  public:
   ArgsSerializer(TraceProcessorContext*,
-                 ArgSetId arg_set_id,
+                 RowMap arg_rows,
                  NullTermStringView event_name,
                  std::vector<uint32_t>* field_id_to_arg_index,
                  base::StringWriter*);
@@ -125,7 +125,6 @@ class ArgsSerializer {
 
   const TraceStorage* storage_ = nullptr;
   TraceProcessorContext* context_ = nullptr;
-  ArgSetId arg_set_id_ = kInvalidArgSetId;
   NullTermStringView event_name_;
   std::vector<uint32_t>* field_id_to_arg_index_;
 
@@ -136,22 +135,20 @@ class ArgsSerializer {
 };
 
 ArgsSerializer::ArgsSerializer(TraceProcessorContext* context,
-                               ArgSetId arg_set_id,
+                               RowMap arg_rows,
                                NullTermStringView event_name,
                                std::vector<uint32_t>* field_id_to_arg_index,
                                base::StringWriter* writer)
     : context_(context),
-      arg_set_id_(arg_set_id),
       event_name_(event_name),
       field_id_to_arg_index_(field_id_to_arg_index),
+      row_map_(std::move(arg_rows)),
       writer_(writer) {
   storage_ = context_->storage.get();
   const auto& args = storage_->arg_table();
-  const auto& set_ids = args.arg_set_id();
 
   // We assume that the row map is a contiguous range (which is always the case
   // because arg_set_ids are contiguous by definition).
-  row_map_ = args.FilterToRowMap({set_ids.eq(arg_set_id_)});
   start_row_ = row_map_.empty() ? 0 : row_map_.Get(0);
 
   // If the vector already has entries, we've previously cached the mapping
@@ -512,7 +509,8 @@ void ArgsSerializer::WriteValue(const Variadic& value) {
 SqliteRawTable::SqliteRawTable(sqlite3* db, Context context)
     : DbSqliteTable(
           db,
-          {context.cache, tables::RawTable::Schema(), TableComputation::kStatic,
+          {context.cache, context.budget, context.profiler,
+           tables::RawTable::Schema(), TableComputation::kStatic,
            &context.context->storage->raw_table(), nullptr}),
       serializer_(context.context) {
   auto fn = [](sqlite3_context* ctx, int argc, sqlite3_value** argv) {
@@ -528,9 +526,11 @@ SqliteRawTable::~SqliteRawTable() = default;
 
 void SqliteRawTable::RegisterTable(sqlite3* db,
                                    QueryCache* cache,
+                                   QueryBudget* budget,
+                                   QueryProfiler* profiler,
                                    TraceProcessorContext* context) {
-  SqliteTable::Register<SqliteRawTable, Context>(db, Context{cache, context},
-                                                 "raw");
+  SqliteTable::Register<SqliteRawTable, Context>(
+      db, Context{cache, budget, profiler, context}, "raw");
 }
 
 void SqliteRawTable::ToSystrace(sqlite3_context* ctx,
@@ -571,7 +571,8 @@ SystraceSerializer::ScopedCString SystraceSerializer::SerializeToString(
   }
   writer.AppendChar(':');
 
-  ArgsSerializer serializer(context_, raw.arg_set_id()[raw_row], event_name,
+  RowMap arg_rows = GetArgSetRows(raw.arg_set_id()[raw_row]);
+  ArgsSerializer serializer(context_, std::move(arg_rows), event_name,
                             &proto_id_to_arg_index_by_event_[event_name_id],
                             &writer);
   serializer.SerializeArgs();
@@ -579,6 +580,31 @@ SystraceSerializer::ScopedCString SystraceSerializer::SerializeToString(
   return ScopedCString(writer.CreateStringCopy(), free);
 }
 
+RowMap SystraceSerializer::GetArgSetRows(ArgSetId arg_set_id) {
+  // Arg sets are only ever appended to the args table and all the args in a
+  // set are inserted together, with ids given out in increasing order. This
+  // means we can index any rows added since the last call by just recording
+  // the first row of each new arg set.
+  const auto& args = storage_->arg_table();
+  const auto& set_ids = args.arg_set_id();
+  for (uint32_t row = indexed_arg_rows_; row < args.row_count(); ++row) {
+    uint32_t set_id = set_ids[row];
+    while (arg_set_start_rows_.size() <= set_id) {
+      arg_set_start_rows_.push_back(row);
+    }
+  }
+  indexed_arg_rows_ = args.row_count();
+
+  if (arg_set_id >= arg_set_start_rows_.size())
+    return RowMap();
+
+  uint32_t start = arg_set_start_rows_[arg_set_id];
+  uint32_t end = arg_set_id + 1 < arg_set_start_rows_.size()
+                     ? arg_set_start_rows_[arg_set_id + 1]
+                     : indexed_arg_rows_;
+  return RowMap(start, end);
+}
+
 void SystraceSerializer::SerializePrefix(uint32_t raw_row,
                                          base::StringWriter* writer) {
   const auto& raw = storage_->raw_table();
@@ -40,7 +40,18 @@ class SystraceSerializer {
 
   void SerializePrefix(uint32_t raw_row, base::StringWriter* writer);
 
+  // Returns the rows of the args table in the arg set |arg_set_id|.
+  RowMap GetArgSetRows(ArgSetId arg_set_id);
+
   StringIdMap proto_id_to_arg_index_by_event_;
+
+  // Maps each arg set id to the first row of that set in the args table; this
+  // replaces a binary search on the args table for each serialized row.
+  // Covers the first |indexed_arg_rows_| rows of the table and is extended
+  // lazily as rows are added.
+  std::vector<uint32_t> arg_set_start_rows_;
+  uint32_t indexed_arg_rows_ = 0;
+
   const TraceStorage* storage_ = nullptr;
   TraceProcessorContext* context_ = nullptr;
 };
@@ -49,13 +60,19 @@ class SqliteRawTable : public DbSqliteTable {
  public:
   struct Context {
     QueryCache* cache;
+    QueryBudget* budget;
+    QueryProfiler* profiler;
     TraceProcessorContext* context;
   };
 
   SqliteRawTable(sqlite3*, Context);
   ~SqliteRawTable() override;
 
-  static void RegisterTable(sqlite3* db, QueryCache*, TraceProcessorContext*);
+  static void RegisterTable(sqlite3* db,
+                            QueryCache*,
+                            QueryBudget*,
+                            QueryProfiler*,
+                            TraceProcessorContext*);
 
  private:
   void ToSystrace(sqlite3_context* ctx, int argc, sqlite3_value** argv);
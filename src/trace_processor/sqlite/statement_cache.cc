@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/statement_cache.h"
+
+#include <utility>
+
+namespace perfetto {
+namespace trace_processor {
+
+StatementCache::StatementCache(size_t max_size) : max_size_(max_size) {}
+
+StatementCache::~StatementCache() = default;
+
+ScopedStmt StatementCache::Take(const std::string& sql) {
+  auto it = index_.find(sql);
+  if (it == index_.end())
+    return ScopedStmt();
+
+  ScopedStmt stmt = std::move(it->second->stmt);
+  entries_.erase(it->second);
+  index_.erase(it);
+  return stmt;
+}
+
+void StatementCache::Put(const std::string& sql, ScopedStmt stmt) {
+  // Don't keep more than one statement for the same query: this can only
+  // happen if multiple iterators for the same query were alive at once which
+  // is unusual.
+  if (max_size_ == 0 || index_.count(sql) > 0)
+    return;
+
+  // The return value of reset is the error (if any) of the last step which
+  // has already been reported to the user of the statement.
+  sqlite3_reset(*stmt);
+  sqlite3_clear_bindings(*stmt);
+
+  if (entries_.size() == max_size_) {
+    index_.erase(entries_.back().sql);
+    entries_.pop_back();
+  }
+  entries_.emplace_front(Entry{sql, std::move(stmt)});
+  index_.emplace(sql, entries_.begin());
+}
+
+void StatementCache::Clear() {
+  index_.clear();
+  entries_.clear();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
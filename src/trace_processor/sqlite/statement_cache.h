@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_STATEMENT_CACHE_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_STATEMENT_CACHE_H_
+
+#include <stddef.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "src/trace_processor/sqlite/scoped_db.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A bounded cache of prepared SQLite statements keyed by their SQL text.
+//
+// Preparing a statement involves parsing the SQL and planning the query, which
+// for queries on virtual tables includes negotiating indices with every table
+// through xBestIndex. When the same query is run many times (e.g. with
+// different bound parameters), reusing the prepared statement skips all of
+// this work.
+//
+// Statements are owned by at most one user at a time: |Take| removes the
+// statement from the cache and |Put| returns it once the user is done with it.
+// When the cache is full, the least recently returned statement is finalized.
+class StatementCache {
+ public:
+  // Creates a cache holding at most |max_size| statements. A |max_size| of 0
+  // disables caching.
+  explicit StatementCache(size_t max_size);
+  ~StatementCache();
+
+  // Removes and returns the statement prepared for |sql| if one is present in
+  // the cache. Returns a null statement otherwise.
+  ScopedStmt Take(const std::string& sql);
+
+  // Resets |stmt|, clears its bindings and adds it to the cache so that a
+  // later call to |Take| with the same |sql| can reuse it.
+  void Put(const std::string& sql, ScopedStmt stmt);
+
+  // Finalizes all the cached statements.
+  void Clear();
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    std::string sql;
+    ScopedStmt stmt;
+  };
+  using EntryList = std::list<Entry>;
+
+  StatementCache(const StatementCache&) = delete;
+  StatementCache& operator=(const StatementCache&) = delete;
+
+  size_t max_size_ = 0;
+
+  // Ordered from the most to the least recently returned statement.
+  EntryList entries_;
+  std::unordered_map<std::string, EntryList::iterator> index_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_STATEMENT_CACHE_H_
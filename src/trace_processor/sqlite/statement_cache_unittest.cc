@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/statement_cache.h"
+
+#include "perfetto/base/logging.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class StatementCacheUnittest : public ::testing::Test {
+ protected:
+  StatementCacheUnittest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+  }
+
+  ScopedStmt Prepare(const std::string& sql) {
+    sqlite3_stmt* stmt = nullptr;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt,
+                                      nullptr) == SQLITE_OK);
+    return ScopedStmt(stmt);
+  }
+
+  ScopedDb db_;
+};
+
+TEST_F(StatementCacheUnittest, TakeAndPut) {
+  StatementCache cache(2);
+  ASSERT_FALSE(cache.Take("SELECT 1"));
+
+  ScopedStmt stmt = Prepare("SELECT 1");
+  sqlite3_stmt* raw = stmt.get();
+  cache.Put("SELECT 1", std::move(stmt));
+  ASSERT_EQ(cache.size(), 1u);
+
+  // Statements should be removed from the cache while they are in use.
+  ScopedStmt taken = cache.Take("SELECT 1");
+  ASSERT_EQ(taken.get(), raw);
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_FALSE(cache.Take("SELECT 1"));
+}
+
+TEST_F(StatementCacheUnittest, ResetsAndClearsBindings) {
+  StatementCache cache(2);
+  ScopedStmt stmt = Prepare("SELECT ?1");
+  ASSERT_EQ(sqlite3_bind_int64(*stmt, 1, 42), SQLITE_OK);
+  ASSERT_EQ(sqlite3_step(*stmt), SQLITE_ROW);
+  ASSERT_EQ(sqlite3_column_int64(*stmt, 0), 42);
+  cache.Put("SELECT ?1", std::move(stmt));
+
+  stmt = cache.Take("SELECT ?1");
+  ASSERT_EQ(sqlite3_step(*stmt), SQLITE_ROW);
+  ASSERT_EQ(sqlite3_column_type(*stmt, 0), SQLITE_NULL);
+}
+
+TEST_F(StatementCacheUnittest, LruEviction) {
+  StatementCache cache(2);
+  cache.Put("SELECT 1", Prepare("SELECT 1"));
+  cache.Put("SELECT 2", Prepare("SELECT 2"));
+  cache.Put("SELECT 3", Prepare("SELECT 3"));
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_FALSE(cache.Take("SELECT 1"));
+  ASSERT_TRUE(cache.Take("SELECT 2"));
+  ASSERT_TRUE(cache.Take("SELECT 3"));
+}
+
+TEST_F(StatementCacheUnittest, DuplicateAndDisabled) {
+  StatementCache cache(2);
+  cache.Put("SELECT 1", Prepare("SELECT 1"));
+  cache.Put("SELECT 1", Prepare("SELECT 1"));
+  ASSERT_EQ(cache.size(), 1u);
+
+  cache.Clear();
+  ASSERT_EQ(cache.size(), 0u);
+
+  StatementCache disabled(0);
+  disabled.Put("SELECT 1", Prepare("SELECT 1"));
+  ASSERT_EQ(disabled.size(), 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
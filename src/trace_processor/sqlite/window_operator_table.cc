@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/sqlite/window_operator_table.h"
 
+#include <algorithm>
+
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 
 namespace perfetto {
@@ -112,6 +114,52 @@ int WindowOperatorTable::Cursor::Filter(const QueryConstraints& qc,
 
   current_ts_ = window_start_;
 
+  // Narrow the window using any constraints on ts. As every span starts at
+  // |window_start_| plus a multiple of |step_size_|, we can jump straight to
+  // the first span matching the constraints instead of generating (and having
+  // SQLite discard) all the spans before it. This keeps queries over a small
+  // part of a large window (e.g. when scrolling the timeline) cheap.
+  int64_t min_ts = std::numeric_limits<int64_t>::min();
+  int64_t max_ts = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < qc.constraints().size(); ++i) {
+    const auto& cs = qc.constraints()[i];
+    if (cs.column != Column::kTs ||
+        sqlite3_value_type(argv[i]) != SQLITE_INTEGER) {
+      continue;
+    }
+    int64_t value = sqlite3_value_int64(argv[i]);
+    if (IsOpEq(cs.op) || IsOpGe(cs.op)) {
+      min_ts = std::max(min_ts, value);
+    } else if (IsOpGt(cs.op)) {
+      if (value == std::numeric_limits<int64_t>::max()) {
+        current_ts_ = window_end_;
+        return SQLITE_OK;
+      }
+      min_ts = std::max(min_ts, value + 1);
+    }
+    if (IsOpEq(cs.op) || IsOpLe(cs.op)) {
+      max_ts = std::min(max_ts, value);
+    } else if (IsOpLt(cs.op)) {
+      if (value == std::numeric_limits<int64_t>::min()) {
+        current_ts_ = window_end_;
+        return SQLITE_OK;
+      }
+      max_ts = std::min(max_ts, value - 1);
+    }
+  }
+  if (max_ts < window_end_)
+    window_end_ = max_ts + 1;
+  if (min_ts >= window_end_) {
+    current_ts_ = window_end_;
+  } else if (min_ts > window_start_) {
+    // Round up to the first span starting at or after |min_ts|.
+    int64_t offset = min_ts - window_start_;
+    int64_t skipped = offset / step_size_ + (offset % step_size_ != 0);
+    current_ts_ = window_start_ + skipped * step_size_;
+    quantum_ts_ = skipped;
+    row_id_ = skipped;
+  }
+
   // Set return first if there is a equals constraint on the row id asking to
   // return the first row.
   bool return_first = qc.constraints().size() == 1 &&
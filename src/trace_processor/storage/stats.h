@@ -66,6 +66,7 @@ namespace stats {
   F(mismatched_sched_switch_tids,       kSingle,  kError,    kAnalysis, ""),   \
   F(mm_unknown_type,                    kSingle,  kError,    kAnalysis, ""),   \
   F(parse_trace_duration_ns,            kSingle,  kInfo,     kAnalysis, ""),   \
+  F(power_rail_batch_parse_errors,      kSingle,  kError,    kTrace,    ""),   \
   F(power_rail_unknown_index,           kSingle,  kError,    kTrace,    ""),   \
   F(proc_stat_unknown_counters,         kSingle,  kError,    kAnalysis, ""),   \
   F(rss_stat_unknown_keys,              kSingle,  kError,    kAnalysis, ""),   \
@@ -84,6 +85,7 @@ namespace stats {
   F(stackprofile_invalid_frame_id,      kSingle,  kError,    kTrace,    ""),   \
   F(stackprofile_invalid_callstack_id,  kSingle,  kError,    kTrace,    ""),   \
   F(stackprofile_parser_error,          kSingle,  kError,    kTrace,    ""),   \
+  F(sys_counters_batch_parse_errors,    kSingle,  kError,    kTrace,    ""),   \
   F(systrace_parse_failure,             kSingle,  kError,    kAnalysis, ""),   \
   F(task_state_invalid,                 kSingle,  kError,    kAnalysis, ""),   \
   F(traced_buf_buffer_size,             kIndexed, kInfo,     kTrace,    ""),   \
@@ -181,7 +183,63 @@ namespace stats {
       "the tracing service. This happens if the ftrace buffers were not "      \
       "cleared properly. These packets are silently dropped by trace "         \
       "processor."),                                                           \
-  F(perf_guardrail_stop_ts,             kIndexed, kDataLoss, kTrace,    "")
+  F(perf_guardrail_stop_ts,             kIndexed, kDataLoss, kTrace,    ""),   \
+  F(query_cache_hits,                   kSingle,  kInfo,     kAnalysis,        \
+      "The number of times the filtered and sorted rows of a table were "      \
+      "found in the query cache."),                                            \
+  F(query_cache_misses,                 kSingle,  kInfo,     kAnalysis,        \
+      "The number of times the filtered and sorted rows of a table were not "  \
+      "found in the query cache."),                                            \
+  F(query_cache_evictions,              kSingle,  kInfo,     kAnalysis,        \
+      "The number of entries evicted from the query cache to stay within "     \
+      "its memory budget."),                                                   \
+  F(sorter_adaptive_window_misses,      kSingle,  kError,    kAnalysis,        \
+      "The number of times events arrived later than the adaptive sorting "    \
+      "window allowed for, after newer events had already been parsed. The "   \
+      "late events are parsed out of order and the window is grown to avoid "  \
+      "this happening again."),                                                \
+  F(sorter_event_budget_flushes,        kSingle,  kInfo,     kAnalysis,        \
+      "The number of times the sorter parsed its oldest events early, as "     \
+      "more than Config::sorter_max_buffered_events events were buffered. "    \
+      "Events arriving later than the ones parsed are parsed out of order."),  \
+  F(packets_skipped_by_config,          kSingle,  kInfo,     kAnalysis,        \
+      "Trace packets dropped without being parsed, as the importer modules "   \
+      "for them are listed in Config::skipped_importers."),                    \
+  F(ftrace_raw_page_without_format,     kSingle,  kDataLoss, kAnalysis,        \
+      "Raw ftrace pages (FtraceConfig.raw_pages) were dropped because the "    \
+      "trace has no raw_format to decode their events with."),                 \
+  F(ftrace_raw_page_unknown_event,      kSingle,  kError,    kAnalysis,        \
+      "An event of a raw ftrace page is not in the raw_format of the trace "   \
+      "and was dropped."),                                                     \
+  F(ftrace_compact_events_parse_errors, kSingle,  kError,    kTrace,           \
+      "The columns of an FtraceEventBundle.compact_events message "            \
+      "(FtraceConfig.compact_events) are malformed or of different sizes."),   \
+  F(importer_packets,                   kIndexed, kInfo,     kAnalysis,        \
+      "The number of trace packets tokenized, indexed by the TracePacket "     \
+      "field of the importer module handling them (0 if none does). Only "     \
+      "recorded with Config::enable_importer_profiling."),                     \
+  F(importer_bytes,                     kIndexed, kInfo,     kAnalysis,        \
+      "The size in bytes of the trace packets tokenized, indexed like "        \
+      "importer_packets."),                                                    \
+  F(importer_tokenize_cpu_time_ns,      kIndexed, kInfo,     kAnalysis,        \
+      "The CPU time spent tokenizing trace packets, indexed like "             \
+      "importer_packets. Excludes the time spent parsing the events "          \
+      "extracted from the sorter meanwhile."),                                 \
+  F(importer_parse_cpu_time_ns,         kIndexed, kInfo,     kAnalysis,        \
+      "The CPU time spent parsing sorted trace packets and ftrace events, "    \
+      "indexed like importer_packets."),                                       \
+  F(sorter_peak_buffered_events,        kSingle,  kInfo,     kAnalysis,        \
+      "The maximum number of events buffered by the sorter at once. Only "     \
+      "recorded with Config::enable_importer_profiling."),                     \
+  F(sorter_extractions_by_buffered_events,                                     \
+                                        kIndexed, kInfo,     kAnalysis,        \
+      "The number of times events were extracted from the sorter, indexed "    \
+      "by floor(log2()) of the number of events buffered at the time. Only "   \
+      "recorded with Config::enable_importer_profiling."),                     \
+  F(sorter_extractions_by_wall_time_ns, kIndexed, kInfo,     kAnalysis,        \
+      "The number of times events were extracted from the sorter, indexed "    \
+      "by floor(log2()) of the wall time taken to extract and parse them. "    \
+      "Only recorded with Config::enable_importer_profiling.")
 // clang-format on
 
 enum Type {
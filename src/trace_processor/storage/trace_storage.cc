@@ -40,9 +40,18 @@ void DbTableMaybeUpdateMinMax(const TypedColumn<int64_t>& ts_col,
   if (dur_col) {
     PERFETTO_CHECK(ts_col.IsSorted());
     PERFETTO_CHECK(dur_col->row_map().size() == ts_col.row_map().size());
-    for (uint32_t i = 0; i < dur_col->row_map().size(); i++) {
-      col_max =
-          std::max(ts_col.Get(i).AsLong() + dur_col->Get(i).AsLong(), col_max);
+
+    const uint32_t kBatchSize = 1024;
+    int64_t ts[kBatchSize];
+    int64_t dur[kBatchSize];
+    uint32_t size = dur_col->row_map().size();
+    for (uint32_t i = 0; i < size; i += kBatchSize) {
+      uint32_t count = std::min(kBatchSize, size - i);
+      ts_col.GetBatch(i, count, ts);
+      dur_col->GetBatch(i, count, dur);
+      for (uint32_t j = 0; j < count; ++j) {
+        col_max = std::max(ts[j] + dur[j], col_max);
+      }
     }
   }
 
@@ -50,6 +59,88 @@ void DbTableMaybeUpdateMinMax(const TypedColumn<int64_t>& ts_col,
   *max_value = std::max(*max_value, col_max);
 }
 
+// Calls |F| with each of the tables in the storage. This is also the order
+// in which the tables are written to snapshots.
+#define PERFETTO_TP_STORAGE_TABLES(F)     \
+  F(metadata_table_)                      \
+  F(clock_snapshot_table_)                \
+  F(track_table_)                         \
+  F(gpu_track_table_)                     \
+  F(process_track_table_)                 \
+  F(thread_track_table_)                  \
+  F(counter_track_table_)                 \
+  F(thread_counter_track_table_)          \
+  F(process_counter_track_table_)         \
+  F(cpu_counter_track_table_)             \
+  F(irq_counter_track_table_)             \
+  F(softirq_counter_track_table_)         \
+  F(gpu_counter_track_table_)             \
+  F(gpu_counter_group_table_)             \
+  F(perf_counter_track_table_)            \
+  F(arg_table_)                           \
+  F(thread_table_)                        \
+  F(process_table_)                       \
+  F(slice_table_)                         \
+  F(flow_table_)                          \
+  F(sched_slice_table_)                   \
+  F(thread_slice_table_)                  \
+  F(gpu_slice_table_)                     \
+  F(counter_table_)                       \
+  F(instant_table_)                       \
+  F(raw_table_)                           \
+  F(cpu_table_)                           \
+  F(cpu_freq_table_)                      \
+  F(android_log_table_)                   \
+  F(stack_profile_mapping_table_)         \
+  F(stack_profile_frame_table_)           \
+  F(stack_profile_callsite_table_)        \
+  F(stack_sample_table_)                  \
+  F(heap_profile_allocation_table_)       \
+  F(cpu_profile_stack_sample_table_)      \
+  F(perf_sample_table_)                   \
+  F(package_list_table_)                  \
+  F(profiler_smaps_table_)                \
+  F(symbol_table_)                        \
+  F(heap_graph_object_table_)             \
+  F(heap_graph_class_table_)              \
+  F(heap_graph_reference_table_)          \
+  F(vulkan_memory_allocations_table_)     \
+  F(graphics_frame_slice_table_)          \
+  F(memory_snapshot_table_)               \
+  F(process_memory_snapshot_table_)       \
+  F(memory_snapshot_node_table_)          \
+  F(memory_snapshot_edge_table_)          \
+  F(expected_frame_timeline_slice_table_) \
+  F(actual_frame_timeline_slice_table_)
+
+// Written at the start of every snapshot.
+struct SnapshotHeader {
+  char magic[8];
+  // Should be incremented whenever the layout of snapshots changes in a way
+  // which is not detected by the schema checks done when loading a table.
+  uint32_t version;
+  // Detects snapshots written on a machine with a different byte order.
+  uint32_t byte_order_mark;
+};
+
+constexpr char kSnapshotMagic[] = {'P', 'E', 'R', 'F', 'S', 'N', 'A', 'P'};
+constexpr uint32_t kSnapshotVersion = 4;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+template <typename T>
+void WriteDeque(SnapshotWriter* writer, const std::deque<T>& deque) {
+  writer->WriteVector(std::vector<T>(deque.begin(), deque.end()));
+}
+
+template <typename T>
+bool ReadDeque(SnapshotReader* reader, std::deque<T>* deque) {
+  std::vector<T> vector;
+  if (!reader->ReadVector(&vector))
+    return false;
+  deque->assign(vector.begin(), vector.end());
+  return true;
+}
+
 std::vector<NullTermStringView> CreateRefTypeStringMap() {
   std::vector<NullTermStringView> map(static_cast<size_t>(RefType::kRefMax));
   map[static_cast<size_t>(RefType::kRefNoRef)] = NullTermStringView();
@@ -146,5 +237,129 @@ std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
   return std::make_pair(start_ns, end_ns);
 }
 
+void TraceStorage::ShrinkToFitTables() {
+#define PERFETTO_TP_SHRINK_TABLE_TO_FIT(table) table.ShrinkToFit();
+  PERFETTO_TP_STORAGE_TABLES(PERFETTO_TP_SHRINK_TABLE_TO_FIT)
+#undef PERFETTO_TP_SHRINK_TABLE_TO_FIT
+}
+
+void TraceStorage::SaveSnapshot(SnapshotWriter* writer) const {
+  SnapshotHeader header{};
+  memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.byte_order_mark = kByteOrderMark;
+  writer->Write(header);
+
+  string_pool_.Serialize(writer);
+
+  writer->Write(static_cast<uint32_t>(stats::kNumKeys));
+  for (size_t i = 0; i < stats::kNumKeys; ++i) {
+    writer->WriteString(stats::kNames[i]);
+    writer->Write(stats_[i].value);
+    writer->Write(static_cast<uint32_t>(stats_[i].indexed_values.size()));
+    for (const auto& index_and_value : stats_[i].indexed_values) {
+      writer->Write(index_and_value.first);
+      writer->Write(index_and_value.second);
+    }
+  }
+
+#define PERFETTO_TP_SERIALIZE_TABLE(table) table.Serialize(writer);
+  PERFETTO_TP_STORAGE_TABLES(PERFETTO_TP_SERIALIZE_TABLE)
+#undef PERFETTO_TP_SERIALIZE_TABLE
+
+  virtual_track_slices_.Serialize(writer);
+}
+
+util::Status TraceStorage::LoadSnapshot(SnapshotReader* reader) {
+  SnapshotHeader header;
+  if (!reader->Read(&header) ||
+      memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0) {
+    return util::ErrStatus("Not a trace processor snapshot");
+  }
+  if (header.version != kSnapshotVersion ||
+      header.byte_order_mark != kByteOrderMark) {
+    return util::ErrStatus(
+        "Snapshot written by an incompatible version of trace processor "
+        "(snapshot version %u, expected %u)",
+        header.version, kSnapshotVersion);
+  }
+
+  if (!string_pool_.Deserialize(reader))
+    return util::ErrStatus(
+        "Snapshot is corrupted or its strings don't match the ones of this "
+        "version of trace processor");
+
+  uint32_t num_stats;
+  if (!reader->Read(&num_stats) || num_stats != stats::kNumKeys)
+    return util::ErrStatus("Snapshot has different stats");
+  for (size_t i = 0; i < stats::kNumKeys; ++i) {
+    std::string name;
+    uint32_t num_indexed;
+    if (!reader->ReadString(&name) || name != stats::kNames[i] ||
+        !reader->Read(&stats_[i].value) || !reader->Read(&num_indexed)) {
+      return util::ErrStatus("Snapshot has different stats");
+    }
+    stats_[i].indexed_values.clear();
+    for (uint32_t j = 0; j < num_indexed; ++j) {
+      int index;
+      int64_t value;
+      if (!reader->Read(&index) || !reader->Read(&value))
+        return util::ErrStatus("Snapshot is corrupted: invalid stats");
+      stats_[i].indexed_values[index] = value;
+    }
+  }
+
+#define PERFETTO_TP_DESERIALIZE_TABLE(table)                                \
+  if (!table.Deserialize(reader)) {                                         \
+    return util::ErrStatus(                                                 \
+        "Snapshot is corrupted or has a different schema for table %s",     \
+        table.table_name());                                                \
+  }
+  PERFETTO_TP_STORAGE_TABLES(PERFETTO_TP_DESERIALIZE_TABLE)
+#undef PERFETTO_TP_DESERIALIZE_TABLE
+
+  if (!virtual_track_slices_.Deserialize(reader))
+    return util::ErrStatus("Snapshot is corrupted: invalid thread slices");
+  if (reader->remaining() != 0)
+    return util::ErrStatus("Snapshot is corrupted: unexpected trailing data");
+
+  // All the type names were interned when the snapshotted storage was
+  // created so this just looks up their ids in the new pool.
+  for (uint32_t i = 0; i < variadic_type_ids_.size(); ++i) {
+    variadic_type_ids_[i] = InternString(Variadic::kTypeNames[i]);
+  }
+  return util::OkStatus();
+}
+
+// static
+bool TraceStorage::IsSnapshot(const uint8_t* data, size_t size) {
+  return size >= sizeof(kSnapshotMagic) &&
+         memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0;
+}
+
+void TraceStorage::VirtualTrackSlices::Serialize(
+    SnapshotWriter* writer) const {
+  WriteDeque(writer, slice_ids_);
+  WriteDeque(writer, thread_timestamp_ns_);
+  WriteDeque(writer, thread_duration_ns_);
+  WriteDeque(writer, thread_instruction_counts_);
+  WriteDeque(writer, thread_instruction_deltas_);
+}
+
+bool TraceStorage::VirtualTrackSlices::Deserialize(SnapshotReader* reader) {
+  if (!ReadDeque(reader, &slice_ids_) ||
+      !ReadDeque(reader, &thread_timestamp_ns_) ||
+      !ReadDeque(reader, &thread_duration_ns_) ||
+      !ReadDeque(reader, &thread_instruction_counts_) ||
+      !ReadDeque(reader, &thread_instruction_deltas_)) {
+    return false;
+  }
+  size_t count = slice_ids_.size();
+  return thread_timestamp_ns_.size() == count &&
+         thread_duration_ns_.size() == count &&
+         thread_instruction_counts_.size() == count &&
+         thread_instruction_deltas_.size() == count;
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
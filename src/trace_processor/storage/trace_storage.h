@@ -33,6 +33,7 @@
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/containers/snapshot.h"
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/storage/metadata.h"
 #include "src/trace_processor/storage/stats.h"
@@ -156,6 +157,9 @@ class TraceStorage {
       return thread_instruction_deltas_;
     }
 
+    void Serialize(SnapshotWriter* writer) const;
+    bool Deserialize(SnapshotReader* reader);
+
     base::Optional<uint32_t> FindRowForSliceId(SliceId slice_id) const {
       auto it =
           std::lower_bound(slice_ids().begin(), slice_ids().end(), slice_id);
@@ -636,6 +640,26 @@ class TraceStorage {
   // Returns (0, 0) if the trace is empty.
   std::pair<int64_t, int64_t> GetTraceTimestampBoundsNs() const;
 
+  // Reduces the memory used by all the tables. Should be called once the
+  // whole trace has been parsed as inserting any rows afterwards may be more
+  // expensive.
+  void ShrinkToFitTables();
+
+  // Writes a snapshot of the contents of the storage (the strings, the stats
+  // and the rows of all the tables) to |writer| (see
+  // TraceProcessor::SaveSnapshot).
+  void SaveSnapshot(SnapshotWriter* writer) const;
+
+  // Replaces the contents of the storage with the snapshot written by
+  // |SaveSnapshot|. Fails if the snapshot was written by a version of trace
+  // processor with a different schema. The tables may be left partially
+  // loaded on failure.
+  util::Status LoadSnapshot(SnapshotReader* reader);
+
+  // Returns whether the |size| bytes at |data| start with the header of a
+  // snapshot.
+  static bool IsSnapshot(const uint8_t* data, size_t size);
+
   util::Status ExtractArg(uint32_t arg_set_id,
                           const char* key,
                           base::Optional<Variadic>* result) {
@@ -26,13 +26,20 @@ namespace tables {
 
 // @tablegroup Events
 // @param arg_set_id {@joinable args.arg_set_id}
+// @param dur time until the next value on the same track or -1 for the last
+//        value of each track. Computed at the end of the trace.
+// @param delta difference between the next value on the same track and this
+//        one or 0 for the last value of each track. Computed at the end of the
+//        trace.
 #define PERFETTO_TP_COUNTER_TABLE_DEF(NAME, PARENT, C) \
   NAME(CounterTable, "counter")                        \
   PERFETTO_TP_ROOT_TABLE(PARENT, C)                    \
   C(int64_t, ts, Column::Flag::kSorted)                \
   C(CounterTrackTable::Id, track_id)                   \
   C(double, value)                                     \
-  C(base::Optional<uint32_t>, arg_set_id)
+  C(base::Optional<uint32_t>, arg_set_id)              \
+  C(int64_t, dur, Column::Flag::kHidden)               \
+  C(double, delta, Column::Flag::kHidden)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_COUNTER_TABLE_DEF);
 
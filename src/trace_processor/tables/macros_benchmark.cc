@@ -28,7 +28,9 @@ namespace {
   C(uint32_t, root_sorted, Column::Flag::kSorted)    \
   C(uint32_t, root_non_null)                         \
   C(uint32_t, root_non_null_2)                       \
-  C(base::Optional<uint32_t>, root_nullable)
+  C(base::Optional<uint32_t>, root_nullable)         \
+  C(int64_t, root_non_null_int64)                    \
+  C(double, root_non_null_double)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_ROOT_TEST_TABLE);
 
@@ -252,6 +254,96 @@ static void BM_TableFilterRootMultipleNonNull(benchmark::State& state) {
 }
 BENCHMARK(BM_TableFilterRootMultipleNonNull)->Apply(TableFilterArgs);
 
+static void BM_TableFilterRootNonNullRange(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+  uint32_t partitions = size / 512;
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    row.root_non_null = rnd_engine() % partitions;
+    root.Insert(row);
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(root.Filter(
+        {root.root_non_null().ge(4), root.root_non_null().lt(partitions / 2)}));
+  }
+}
+BENCHMARK(BM_TableFilterRootNonNullRange)->Apply(TableFilterArgs);
+
+static void BM_TableFilterRootNonNullInt64Lt(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    row.root_non_null_int64 = static_cast<int64_t>(rnd_engine());
+    root.Insert(row);
+  }
+
+  int64_t value = static_cast<int64_t>(std::minstd_rand0::max() / 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        root.Filter({root.root_non_null_int64().lt(value)}));
+  }
+}
+BENCHMARK(BM_TableFilterRootNonNullInt64Lt)->Apply(TableFilterArgs);
+
+static void BM_TableFilterRootNonNullDoubleGt(benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    row.root_non_null_double = static_cast<double>(rnd_engine() % 1000) / 10.0;
+    root.Insert(row);
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        root.Filter({root.root_non_null_double().gt(90.0)}));
+  }
+}
+BENCHMARK(BM_TableFilterRootNonNullDoubleGt)->Apply(TableFilterArgs);
+
+static void BM_TableFilterRootNonNullInt64MostlySorted(
+    benchmark::State& state) {
+  StringPool pool;
+  RootTestTable root(&pool, nullptr);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+
+  // Simulates timestamps which are sorted apart from some small jitter (e.g.
+  // slice.ts across tracks).
+  std::minstd_rand0 rnd_engine;
+  for (uint32_t i = 0; i < size; ++i) {
+    RootTestTable::Row row;
+    int64_t jitter = static_cast<int64_t>(rnd_engine() % 500);
+    row.root_non_null_int64 = static_cast<int64_t>(i) * 100 + jitter;
+    root.Insert(row);
+  }
+
+  // Select a "viewport" of ~1% of the rows in the middle of the table.
+  int64_t start = static_cast<int64_t>(size) * 50;
+  int64_t end = start + static_cast<int64_t>(size);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        root.Filter({root.root_non_null_int64().ge(start),
+                     root.root_non_null_int64().lt(end)}));
+  }
+}
+BENCHMARK(BM_TableFilterRootNonNullInt64MostlySorted)->Apply(TableFilterArgs);
+
 static void BM_TableFilterRootNullableEqMatchMany(benchmark::State& state) {
   StringPool pool;
   RootTestTable root(&pool, nullptr);
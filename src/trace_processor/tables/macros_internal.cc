@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/tables/macros_internal.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace macros_internal {
+
+namespace {
+
+bool ReadAndCompareString(SnapshotReader* reader, base::StringView expected) {
+  const uint8_t* data;
+  size_t size;
+  if (!reader->ReadBytes(&data, &size))
+    return false;
+  return base::StringView(reinterpret_cast<const char*>(data), size) ==
+         expected;
+}
+
+}  // namespace
+
+void MacroTable::Serialize(SnapshotWriter* writer) const {
+  // The schema is written first so that a snapshot written by a different
+  // version of trace processor is rejected instead of being misinterpreted.
+  writer->WriteString(name_);
+  writer->Write(static_cast<uint32_t>(columns_.size()));
+  for (const Column& column : columns_) {
+    writer->WriteString(column.name());
+    writer->Write(static_cast<uint32_t>(column.type()));
+  }
+
+  writer->Write(row_count_);
+  writer->Write(static_cast<uint32_t>(row_maps_.size()));
+  for (const RowMap& rm : row_maps_) {
+    rm.Serialize(writer);
+  }
+  if (parent_ == nullptr)
+    type_.Serialize(writer);
+  SerializeColumns(writer);
+}
+
+bool MacroTable::Deserialize(SnapshotReader* reader) {
+  uint32_t column_count;
+  if (!ReadAndCompareString(reader, name_) || !reader->Read(&column_count) ||
+      column_count != columns_.size()) {
+    return false;
+  }
+  for (const Column& column : columns_) {
+    uint32_t type;
+    if (!ReadAndCompareString(reader, column.name()) || !reader->Read(&type) ||
+        type != static_cast<uint32_t>(column.type())) {
+      return false;
+    }
+  }
+
+  uint32_t row_map_count;
+  if (!reader->Read(&row_count_) || !reader->Read(&row_map_count) ||
+      row_map_count != row_maps_.size()) {
+    return false;
+  }
+  for (RowMap& rm : row_maps_) {
+    if (!rm.Deserialize(reader) || rm.size() != row_count_)
+      return false;
+  }
+  if (parent_ == nullptr &&
+      (!type_.Deserialize(reader) || type_.size() != row_count_)) {
+    return false;
+  }
+  return DeserializeColumns(reader);
+}
+
+}  // namespace macros_internal
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -19,6 +19,8 @@
 
 #include <type_traits>
 
+#include "perfetto/ext/base/utils.h"
+#include "src/trace_processor/containers/snapshot.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/db/typed_column.h"
 
@@ -105,7 +107,21 @@ class MacroTable : public Table {
 
   const char* table_name() const { return name_; }
 
+  // Writes the rows of this table to |writer|, along with the names and
+  // types of its columns. The columns inherited from the parent table are
+  // not written: they are written when serializing the parent.
+  void Serialize(SnapshotWriter* writer) const;
+
+  // Replaces the rows of this table with the ones written by |Serialize|.
+  // Returns false if |reader| doesn't contain a table with the same columns
+  // as this one.
+  bool Deserialize(SnapshotReader* reader);
+
  protected:
+  // Writes (or reads) the storage of the columns defined by the table itself.
+  virtual void SerializeColumns(SnapshotWriter* writer) const = 0;
+  virtual bool DeserializeColumns(SnapshotReader* reader) = 0;
+
   void UpdateRowMapsAfterParentInsert() {
     if (parent_ != nullptr) {
       // If there is a parent table, add the last inserted row in each of the
@@ -236,11 +252,13 @@ class MacroTable : public Table {
       PERFETTO_TP_COLUMN_FLAG_NO_FLAG_COL)(__VA_ARGS__))
 
 // Creates the sparse vector with the given flags.
-#define PERFETTO_TP_TABLE_CONSTRUCTOR_SV(type, name, ...)               \
-  name##_ =                                                             \
-      (FlagsForColumn(ColumnIndex::name) & Column::Flag::kDense)        \
-          ? NullableVector<TypedColumn<type>::serialized_type>::Dense() \
-          : NullableVector<TypedColumn<type>::serialized_type>::Sparse();
+#define PERFETTO_TP_TABLE_CONSTRUCTOR_SV(type, name, ...)                 \
+  name##_ =                                                               \
+      (FlagsForColumn(ColumnIndex::name) & Column::Flag::kEncoded)        \
+          ? NullableVector<TypedColumn<type>::serialized_type>::Encoded() \
+          : (FlagsForColumn(ColumnIndex::name) & Column::Flag::kDense)    \
+                ? NullableVector<TypedColumn<type>::serialized_type>::Dense() \
+                : NullableVector<TypedColumn<type>::serialized_type>::Sparse();
 
 // Invokes the chosen column constructor by passing the given args.
 #define PERFETTO_TP_TABLE_CONSTRUCTOR_COLUMN(type, name, ...)               \
@@ -251,6 +269,20 @@ class MacroTable : public Table {
 #define PERFETTO_TP_COLUMN_APPEND(type, name, ...) \
   mutable_##name()->Append(std::move(row.name));
 
+// Writes the storage of the corresponding column to a snapshot.
+#define PERFETTO_TP_COLUMN_SERIALIZE(type, name, ...) name##_.Serialize(writer);
+
+// Reads the storage of the corresponding column from a snapshot.
+#define PERFETTO_TP_COLUMN_DESERIALIZE(type, name, ...)             \
+  if (!name##_.Deserialize(reader) || name##_.size() != row_count_) \
+    return false;
+
+// Reduces the memory used by the corresponding column and prepares it to be
+// read from several threads.
+#define PERFETTO_TP_COLUMN_SHRINK_TO_FIT(type, name, ...) \
+  name##_.ShrinkToFit();                                  \
+  name##_.PrepareForConcurrentReads();
+
 // Creates a schema entry for the corresponding column.
 #define PERFETTO_TP_COLUMN_SCHEMA(type, name, ...)          \
   schema.columns.emplace_back(Table::Schema::Column{        \
@@ -258,7 +290,9 @@ class MacroTable : public Table {
       static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
                         Column::Flag::kSorted),             \
       static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
-                        Column::Flag::kHidden)});
+                        Column::Flag::kHidden),             \
+      static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
+                        Column::Flag::kIndexed)});
 
 // Defines the accessors for a column.
 #define PERFETTO_TP_TABLE_COL_ACCESSOR(type, name, ...)       \
@@ -393,6 +427,31 @@ class MacroTable : public Table {
       return {id, row_number};                                                \
     }                                                                         \
                                                                               \
+    /*                                                                        \
+     * Reduces the memory used by the columns of this table. Should only be   \
+     * called once no more rows will be inserted (e.g. at the end of the      \
+     * trace) as further inserts may be more expensive afterwards.            \
+     *                                                                        \
+     * This also builds the structures which lookups otherwise build lazily  \
+     * so that, until it is next modified, the table can be queried from     \
+     * several threads at once.                                               \
+     *                                                                        \
+     * Expands to                                                             \
+     * col1_.ShrinkToFit();                                                   \
+     * col1_.PrepareForConcurrentReads();                                     \
+     * col2_.ShrinkToFit();                                                   \
+     * ...                                                                    \
+     */                                                                       \
+    void ShrinkToFit() {                                                      \
+      if (parent_ == nullptr) {                                               \
+        type_.ShrinkToFit();                                                  \
+        type_.PrepareForConcurrentReads();                                    \
+      }                                                                       \
+      PERFETTO_TP_TABLE_COLUMNS(DEF, PERFETTO_TP_COLUMN_SHRINK_TO_FIT);       \
+      for (RowMap& rm : row_maps_)                                            \
+        rm.PrepareForConcurrentReads();                                       \
+    }                                                                         \
+                                                                              \
     const IdColumn<Id>& id() const {                                          \
       return static_cast<const IdColumn<Id>&>(                                \
           columns_[static_cast<uint32_t>(ColumnIndex::id)]);                  \
@@ -406,9 +465,9 @@ class MacroTable : public Table {
     static Table::Schema Schema() {                                           \
       Table::Schema schema;                                                   \
       schema.columns.emplace_back(Table::Schema::Column{                      \
-          "id", SqlValue::Type::kLong, true, true, false});                   \
+          "id", SqlValue::Type::kLong, true, true, false, false});            \
       schema.columns.emplace_back(Table::Schema::Column{                      \
-          "type", SqlValue::Type::kString, false, false, false});             \
+          "type", SqlValue::Type::kString, false, false, false, false});      \
       PERFETTO_TP_ALL_COLUMNS(DEF, PERFETTO_TP_COLUMN_SCHEMA);                \
       return schema;                                                          \
     }                                                                         \
@@ -443,6 +502,29 @@ class MacroTable : public Table {
       PERFETTO_FATAL("For GCC");                                              \
     }                                                                         \
                                                                               \
+    /*                                                                        \
+     * Expands to                                                             \
+     * col1_.Serialize(writer);                                               \
+     * col2_.Serialize(writer);                                               \
+     * ...                                                                    \
+     */                                                                       \
+    void SerializeColumns(SnapshotWriter* writer) const override {            \
+      base::ignore_result(writer);                                            \
+      PERFETTO_TP_TABLE_COLUMNS(DEF, PERFETTO_TP_COLUMN_SERIALIZE);           \
+    }                                                                         \
+                                                                              \
+    /*                                                                        \
+     * Expands to                                                             \
+     * if (!col1_.Deserialize(reader))                                        \
+     *   return false;                                                        \
+     * ...                                                                    \
+     */                                                                       \
+    bool DeserializeColumns(SnapshotReader* reader) override {                \
+      base::ignore_result(reader);                                            \
+      PERFETTO_TP_TABLE_COLUMNS(DEF, PERFETTO_TP_COLUMN_DESERIALIZE);         \
+      return true;                                                            \
+    }                                                                         \
+                                                                              \
     parent_class_name* parent_;                                               \
                                                                               \
     /*                                                                        \
@@ -16,6 +16,13 @@
 
 #include "src/trace_processor/tables/macros.h"
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -51,10 +58,27 @@ PERFETTO_TP_TABLE(PERFETTO_TP_TEST_SLICE_TABLE_DEF);
   C(StringPool::Id, end_state)
 PERFETTO_TP_TABLE(PERFETTO_TP_TEST_CPU_SLICE_TABLE_DEF);
 
+#define PERFETTO_TP_TEST_ENCODED_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestEncodedTable, "encoded")                         \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                         \
+  C(uint32_t, cpu, Column::Flag::kEncoded)                  \
+  C(StringPool::Id, state, Column::Flag::kEncoded)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_ENCODED_TABLE_DEF);
+
+#define PERFETTO_TP_TEST_INDEXED_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestIndexedTable, "indexed")                         \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                         \
+  C(uint32_t, utid, Column::Flag::kIndexed)                 \
+  C(base::Optional<uint32_t>, upid, Column::Flag::kIndexed) \
+  C(StringPool::Id, name, Column::Flag::kIndexed)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_INDEXED_TABLE_DEF);
+
 TestEventTable::~TestEventTable() = default;
 TestCounterTable::~TestCounterTable() = default;
 TestSliceTable::~TestSliceTable() = default;
 TestCpuSliceTable::~TestCpuSliceTable() = default;
+TestEncodedTable::~TestEncodedTable() = default;
+TestIndexedTable::~TestIndexedTable() = default;
 
 class TableMacrosUnittest : public ::testing::Test {
  protected:
@@ -64,6 +88,8 @@ class TableMacrosUnittest : public ::testing::Test {
   TestCounterTable counter_{&pool_, &event_};
   TestSliceTable slice_{&pool_, &event_};
   TestCpuSliceTable cpu_slice_{&pool_, &slice_};
+  TestEncodedTable encoded_{&pool_, nullptr};
+  TestIndexedTable indexed_{&pool_, nullptr};
 };
 
 TEST_F(TableMacrosUnittest, Name) {
@@ -196,6 +222,382 @@ TEST_F(TableMacrosUnittest, NullableLongComparision) {
   ASSERT_EQ(dur->Get(1).long_value, 200);
 }
 
+TEST_F(TableMacrosUnittest, NonNullLongFilterLarge) {
+  // Insert enough rows to make sure the filtering of whole BitVector blocks is
+  // exercised.
+  static constexpr uint32_t kRows = 10000;
+  for (uint32_t i = 0; i < kRows; ++i) {
+    TestCpuSliceTable::Row row;
+    row.cpu = i % 7;
+    cpu_slice_.Insert(row);
+  }
+
+  Table out = cpu_slice_.Filter({cpu_slice_.cpu().eq(3)});
+  const Column* cpu = out.GetColumnByName("cpu");
+  ASSERT_EQ(out.row_count(), 1429u);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(cpu->Get(i).long_value, 3);
+  }
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().lt(3)});
+  ASSERT_EQ(out.row_count(), 4287u);
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().le(3)});
+  ASSERT_EQ(out.row_count(), 5716u);
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().gt(3)});
+  ASSERT_EQ(out.row_count(), 4284u);
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().ge(3)});
+  ASSERT_EQ(out.row_count(), 5713u);
+
+  out = cpu_slice_.Filter({cpu_slice_.cpu().ne(3)});
+  ASSERT_EQ(out.row_count(), 8571u);
+
+  out = cpu_slice_.Filter(
+      {cpu_slice_.cpu().ge(2), cpu_slice_.cpu().lt(4), cpu_slice_.cpu().ne(2)});
+  cpu = out.GetColumnByName("cpu");
+  ASSERT_EQ(out.row_count(), 1429u);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(cpu->Get(i).long_value, 3);
+  }
+}
+
+TEST_F(TableMacrosUnittest, NonNullLongFilterZoneMap) {
+  // Insert "mostly sorted" values spanning many zone map blocks.
+  static constexpr uint32_t kRows = 50000;
+  std::vector<int64_t> values;
+  for (uint32_t i = 0; i < kRows; ++i) {
+    int64_t value = static_cast<int64_t>(i / 4) + (i % 7 == 0 ? 1000 : 0);
+    values.push_back(value);
+
+    TestCpuSliceTable::Row row;
+    row.cpu = value;
+    cpu_slice_.Insert(row);
+  }
+
+  auto count = [&values](std::function<bool(int64_t)> fn) {
+    return static_cast<uint32_t>(
+        std::count_if(values.begin(), values.end(), fn));
+  };
+  auto check = [this, &count](int64_t v) {
+    const auto& cpu = cpu_slice_.cpu();
+    ASSERT_EQ(cpu_slice_.Filter({cpu.lt(v)}).row_count(),
+              count([v](int64_t x) { return x < v; }));
+    ASSERT_EQ(cpu_slice_.Filter({cpu.le(v)}).row_count(),
+              count([v](int64_t x) { return x <= v; }));
+    ASSERT_EQ(cpu_slice_.Filter({cpu.gt(v)}).row_count(),
+              count([v](int64_t x) { return x > v; }));
+    ASSERT_EQ(cpu_slice_.Filter({cpu.ge(v)}).row_count(),
+              count([v](int64_t x) { return x >= v; }));
+    ASSERT_EQ(cpu_slice_.Filter({cpu.eq(v)}).row_count(),
+              count([v](int64_t x) { return x == v; }));
+    ASSERT_EQ(cpu_slice_.Filter({cpu.ne(v)}).row_count(),
+              count([v](int64_t x) { return x != v; }));
+  };
+  check(-1);
+  check(0);
+  check(3000);
+  check(7000);
+  check(12499);
+  check(13499);
+  check(20000);
+
+  // Changing values after the zone map was built should be reflected.
+  cpu_slice_.mutable_cpu()->Set(10, 100000);
+  values[10] = 100000;
+  cpu_slice_.mutable_cpu()->Set(40000, -5);
+  values[40000] = -5;
+  check(-5);
+  check(5000);
+  check(100000);
+
+  // Make sure a range constraint on top of a previous filter works.
+  Table out = cpu_slice_.Filter({cpu_slice_.cpu().ge(5000),
+                                 cpu_slice_.cpu().lt(5010)});
+  ASSERT_EQ(out.row_count(),
+            count([](int64_t x) { return x >= 5000 && x < 5010; }));
+}
+
+TEST_F(TableMacrosUnittest, NonNullLongFilterShrinkToFit) {
+  static constexpr uint32_t kRows = 50000;
+  std::vector<int64_t> values;
+  for (uint32_t i = 0; i < kRows; ++i) {
+    int64_t value = 1000000000ll + (i * 7919) % 3001;
+    values.push_back(value);
+
+    TestCpuSliceTable::Row row;
+    row.ts = 1000000000ll + i;
+    row.cpu = value;
+    cpu_slice_.Insert(row);
+  }
+  event_.ShrinkToFit();
+  slice_.ShrinkToFit();
+  cpu_slice_.ShrinkToFit();
+
+  Table out = cpu_slice_.Filter({cpu_slice_.cpu().eq(1000001500)});
+  const Column* cpu = out.GetColumnByName("cpu");
+  ASSERT_EQ(out.row_count(), static_cast<uint32_t>(std::count(
+                                 values.begin(), values.end(), 1000001500)));
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(cpu->Get(i).long_value, 1000001500);
+  }
+
+  out = cpu_slice_.Filter(
+      {cpu_slice_.cpu().ge(1000001000), cpu_slice_.cpu().lt(1000001010)});
+  ASSERT_EQ(out.row_count(),
+            static_cast<uint32_t>(std::count_if(
+                values.begin(), values.end(), [](int64_t x) {
+                  return x >= 1000001000 && x < 1000001010;
+                })));
+
+  out = cpu_slice_.Filter({cpu_slice_.ts().ge(1000040000)});
+  ASSERT_EQ(out.row_count(), 10000u);
+  ASSERT_EQ(out.GetColumnByName("ts")->Get(0).long_value, 1000040000);
+  ASSERT_EQ(out.GetColumnByName("cpu")->Get(0).long_value, values[40000]);
+
+  // Inserting values which don't fit in the packed storage should still work.
+  TestCpuSliceTable::Row row;
+  row.cpu = -1;
+  cpu_slice_.Insert(row);
+  ASSERT_EQ(cpu_slice_.Filter({cpu_slice_.cpu().lt(0)}).row_count(), 1u);
+}
+
+TEST_F(TableMacrosUnittest, GetBatch) {
+  static constexpr uint32_t kRows = 5000;
+  StringPool::Id foo = pool_.InternString("foo");
+  for (uint32_t i = 0; i < kRows; ++i) {
+    TestCpuSliceTable::Row row;
+    row.ts = i * 10;
+    row.dur = i % 3 == 0 ? base::nullopt : base::make_optional<int64_t>(i);
+    row.cpu = i % 5;
+    row.end_state = i % 4 == 0 ? StringPool::Id::Null() : foo;
+    cpu_slice_.Insert(row);
+  }
+
+  // Also filter to get a table with a non-trivial RowMap.
+  std::vector<Table> tables;
+  tables.emplace_back(cpu_slice_.Copy());
+  tables.emplace_back(cpu_slice_.Filter({cpu_slice_.cpu().ne(2)}));
+  for (const Table& table : tables) {
+    const uint32_t start = 7;
+    const uint32_t count = table.row_count() - 100;
+    const uint32_t null_words = (count + 63) / 64;
+
+    std::vector<uint32_t> ids(count);
+    table.GetColumnByName("id")->GetBatch(start, count, ids.data());
+
+    std::vector<int64_t> ts(count);
+    std::vector<uint64_t> ts_nulls(null_words);
+    table.GetColumnByName("ts")->GetBatch(start, count, ts.data(),
+                                          ts_nulls.data());
+
+    std::vector<int64_t> dur(count);
+    std::vector<uint64_t> dur_nulls(null_words);
+    table.GetColumnByName("dur")->GetBatch(start, count, dur.data(),
+                                           dur_nulls.data());
+
+    std::vector<StringPool::Id> end_state(count);
+    std::vector<uint64_t> end_state_nulls(null_words);
+    table.GetColumnByName("end_state")
+        ->GetBatch(start, count, end_state.data(), end_state_nulls.data());
+
+    auto is_null = [](const std::vector<uint64_t>& nulls, uint32_t i) {
+      return (nulls[i / 64] >> (i % 64)) & 1;
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t row = start + i;
+      ASSERT_EQ(ids[i], table.GetColumnByName("id")->Get(row).long_value);
+
+      ASSERT_FALSE(is_null(ts_nulls, i));
+      ASSERT_EQ(ts[i], table.GetColumnByName("ts")->Get(row).long_value);
+
+      SqlValue d = table.GetColumnByName("dur")->Get(row);
+      ASSERT_EQ(is_null(dur_nulls, i), d.is_null());
+      ASSERT_EQ(dur[i], d.is_null() ? 0 : d.long_value);
+
+      SqlValue e = table.GetColumnByName("end_state")->Get(row);
+      ASSERT_EQ(is_null(end_state_nulls, i), e.is_null());
+      ASSERT_EQ(end_state[i], e.is_null() ? StringPool::Id::Null() : foo);
+    }
+  }
+}
+
+TEST_F(TableMacrosUnittest, ComputeStats) {
+  StringPool::Id foo = pool_.InternString("foo");
+  StringPool::Id bar = pool_.InternString("bar");
+  for (uint32_t i = 0; i < 10000; ++i) {
+    TestCpuSliceTable::Row row;
+    row.ts = i;
+    row.dur = i % 2 == 0 ? base::nullopt : base::make_optional<int64_t>(i % 7);
+    row.cpu = i % 4 + 10;
+    row.end_state = i % 5 == 0 ? StringPool::Id::Null() : (i % 3 ? foo : bar);
+    cpu_slice_.Insert(row);
+  }
+
+  Column::Stats id = cpu_slice_.id().ComputeStats();
+  ASSERT_EQ(id.row_count, 10000u);
+  ASSERT_EQ(id.null_count, 0u);
+  ASSERT_EQ(id.distinct_count, 10000u);
+  ASSERT_EQ(id.min.long_value, 0);
+  ASSERT_EQ(id.max.long_value, 9999);
+
+  Column::Stats ts = cpu_slice_.ts().ComputeStats();
+  ASSERT_EQ(ts.null_count, 0u);
+  ASSERT_NEAR(ts.distinct_count, 10000u, 1000u);
+
+  Column::Stats dur = cpu_slice_.dur().ComputeStats();
+  ASSERT_EQ(dur.null_count, 5000u);
+  ASSERT_EQ(dur.distinct_count, 7u);
+  ASSERT_EQ(dur.min.long_value, 0);
+  ASSERT_EQ(dur.max.long_value, 6);
+
+  // The range of the values should bound the distinct count.
+  Column::Stats cpu = cpu_slice_.cpu().ComputeStats();
+  ASSERT_EQ(cpu.distinct_count, 4u);
+  ASSERT_EQ(cpu.min.long_value, 10);
+  ASSERT_EQ(cpu.max.long_value, 13);
+
+  Column::Stats end_state = cpu_slice_.end_state().ComputeStats();
+  ASSERT_EQ(end_state.null_count, 2000u);
+  ASSERT_EQ(end_state.distinct_count, 2u);
+  ASSERT_TRUE(end_state.min.is_null());
+
+  // Stats should be computed on the rows of the filtered table.
+  Table filtered = cpu_slice_.Filter({cpu_slice_.cpu().eq(11)});
+  Column::Stats filtered_cpu = filtered.GetColumnByName("cpu")->ComputeStats();
+  ASSERT_EQ(filtered_cpu.row_count, 2500u);
+  ASSERT_EQ(filtered_cpu.distinct_count, 1u);
+}
+
+TEST_F(TableMacrosUnittest, EncodedFilter) {
+  static constexpr uint32_t kRows = 10000;
+  StringPool::Id states[] = {pool_.InternString("R"), pool_.InternString("S"),
+                             StringPool::Id::Null()};
+  for (uint32_t i = 0; i < kRows; ++i) {
+    TestEncodedTable::Row row;
+    row.cpu = i % 7;
+    row.state = states[i % 3];
+    encoded_.Insert(row);
+  }
+  ASSERT_EQ(encoded_.cpu()[3], 3u);
+  ASSERT_EQ(encoded_.state().GetString(1), "S");
+
+  Table out = encoded_.Filter({encoded_.cpu().eq(3)});
+  const Column* cpu = out.GetColumnByName("cpu");
+  ASSERT_EQ(out.row_count(), 1429u);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(cpu->Get(i).long_value, 3);
+  }
+
+  out = encoded_.Filter({encoded_.cpu().ne(3)});
+  ASSERT_EQ(out.row_count(), 8571u);
+
+  out = encoded_.Filter({encoded_.cpu().eq(100)});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  out = encoded_.Filter({encoded_.cpu().ne(100)});
+  ASSERT_EQ(out.row_count(), kRows);
+
+  // Non-equality constraints are handled by the slow path.
+  out = encoded_.Filter({encoded_.cpu().lt(3)});
+  ASSERT_EQ(out.row_count(), 4287u);
+
+  out = encoded_.Filter({encoded_.state().eq("S")});
+  ASSERT_EQ(out.row_count(), 3333u);
+
+  // Null strings should not match kNe constraints.
+  out = encoded_.Filter({encoded_.state().ne("S")});
+  ASSERT_EQ(out.row_count(), 3334u);
+
+  out = encoded_.Filter({encoded_.state().eq("D")});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  out = encoded_.Filter({encoded_.state().ne("D")});
+  ASSERT_EQ(out.row_count(), 6667u);
+
+  out = encoded_.Filter({encoded_.state().is_null()});
+  ASSERT_EQ(out.row_count(), 3333u);
+
+  // Filter on top of an existing BitVector to check that the codes are
+  // compared using rows in the original table.
+  out = encoded_.Filter({encoded_.state().eq("R"), encoded_.cpu().eq(3)});
+  ASSERT_EQ(out.row_count(), 477u);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(out.GetColumnByName("cpu")->Get(i).long_value, 3);
+    ASSERT_STREQ(out.GetColumnByName("state")->Get(i).string_value, "R");
+  }
+}
+
+TEST_F(TableMacrosUnittest, IndexedFilter) {
+  static constexpr uint32_t kRows = 1000;
+  StringPool::Id names[] = {pool_.InternString("foo"),
+                            pool_.InternString("bar")};
+  for (uint32_t i = 0; i < kRows; ++i) {
+    TestIndexedTable::Row row;
+    row.utid = i % 10;
+    row.upid = i % 3 == 0 ? base::nullopt : base::make_optional(i % 5);
+    row.name = names[i % 2];
+    indexed_.Insert(row);
+  }
+
+  Table out = indexed_.Filter({indexed_.utid().eq(3)});
+  ASSERT_EQ(out.row_count(), 100u);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(out.GetColumnByName("utid")->Get(i).long_value, 3);
+    ASSERT_EQ(out.GetColumnByName("id")->Get(i).long_value,
+              static_cast<int64_t>(3 + 10 * i));
+  }
+
+  out = indexed_.Filter({indexed_.utid().eq(10)});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // Null values should not be in the index.
+  out = indexed_.Filter({indexed_.upid().eq(0)});
+  ASSERT_EQ(out.row_count(), 133u);
+
+  out = indexed_.Filter({indexed_.name().eq("bar")});
+  ASSERT_EQ(out.row_count(), 500u);
+
+  out = indexed_.Filter({indexed_.name().eq("baz")});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // Indexed constraints after and before other constraints.
+  out = indexed_.Filter({indexed_.id().lt(100), indexed_.utid().eq(4)});
+  ASSERT_EQ(out.row_count(), 10u);
+
+  out = indexed_.Filter({indexed_.utid().eq(4), indexed_.name().eq("foo")});
+  ASSERT_EQ(out.row_count(), 100u);
+
+  out = indexed_.Filter({indexed_.id().ge(105), indexed_.id().lt(155),
+                         indexed_.utid().eq(4)});
+  ASSERT_EQ(out.row_count(), 5u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 114);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(4).long_value, 154);
+
+  out = indexed_.Filter({indexed_.id().lt(0), indexed_.utid().eq(4)});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // Tables derived from an indexed table with a range should work too.
+  Table tail = indexed_.Filter({indexed_.id().ge(500)});
+  out = tail.Filter({indexed_.id().lt(520), indexed_.utid().eq(4)});
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(0).long_value, 504);
+  ASSERT_EQ(out.GetColumnByName("id")->Get(1).long_value, 514);
+
+  // Rows inserted after the index is built should be found.
+  TestIndexedTable::Row row;
+  row.utid = 3;
+  indexed_.Insert(row);
+  out = indexed_.Filter({indexed_.utid().eq(3)});
+  ASSERT_EQ(out.row_count(), 101u);
+
+  // Filtering a table derived from an indexed table should work.
+  Table filtered = indexed_.Filter({indexed_.name().eq("foo")});
+  out = filtered.Filter({indexed_.utid().eq(4)});
+  ASSERT_EQ(out.row_count(), 100u);
+}
+
 TEST_F(TableMacrosUnittest, NullableLongCompareWithDouble) {
   slice_.Insert({});
 
@@ -445,6 +847,72 @@ TEST_F(TableMacrosUnittest, Sort) {
   ASSERT_EQ(arg_set_id->Get(2).long_value, 100);
 }
 
+// base::TempFile is not supported on Windows.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+TEST_F(TableMacrosUnittest, Snapshot) {
+  event_.Insert(TestEventTable::Row(100 /* ts */, 1 /* arg_set_id */));
+  slice_.Insert(TestSliceTable::Row(200, 2, 10 /* dur */, 0 /* depth */));
+  slice_.Insert(TestSliceTable::Row(300, 3, base::nullopt, 1));
+  event_.ShrinkToFit();
+  slice_.ShrinkToFit();
+
+  base::TempFile file = base::TempFile::Create();
+  SnapshotWriter writer(file.fd());
+  pool_.Serialize(&writer);
+  event_.Serialize(&writer);
+  slice_.Serialize(&writer);
+  ASSERT_TRUE(writer.Finish());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(file.path(), &contents));
+  SnapshotReader reader(reinterpret_cast<const uint8_t*>(contents.data()),
+                        contents.size());
+
+  StringPool pool;
+  TestEventTable event(&pool, nullptr);
+  TestSliceTable slice(&pool, &event);
+  ASSERT_TRUE(pool.Deserialize(&reader));
+  ASSERT_TRUE(event.Deserialize(&reader));
+  ASSERT_TRUE(slice.Deserialize(&reader));
+  ASSERT_EQ(reader.remaining(), 0u);
+
+  ASSERT_EQ(event.row_count(), 3u);
+  ASSERT_EQ(event.type().GetString(0), "event");
+  ASSERT_EQ(event.type().GetString(2), "slice");
+  ASSERT_EQ(event.ts()[2], 300);
+  ASSERT_EQ(slice.row_count(), 2u);
+  ASSERT_EQ(slice.id()[1].value, 2u);
+  ASSERT_EQ(slice.ts()[0], 200);
+  ASSERT_EQ(slice.arg_set_id()[1], 3);
+  ASSERT_EQ(slice.dur()[0], 10);
+  ASSERT_EQ(slice.dur()[1], base::nullopt);
+  ASSERT_EQ(slice.depth()[1], 1);
+
+  Table out = slice.Filter({slice.ts().gt(250)});
+  ASSERT_EQ(out.row_count(), 1u);
+
+  // Rows can still be inserted after loading the snapshot.
+  auto id = slice.Insert(TestSliceTable::Row(400, 4, 5, 0)).id;
+  ASSERT_EQ(id.value, 3u);
+  ASSERT_EQ(event.ts()[3], 400);
+}
+
+TEST_F(TableMacrosUnittest, SnapshotSchemaMismatch) {
+  event_.Insert(TestEventTable::Row(100 /* ts */, 1 /* arg_set_id */));
+
+  base::TempFile file = base::TempFile::Create();
+  SnapshotWriter writer(file.fd());
+  event_.Serialize(&writer);
+  ASSERT_TRUE(writer.Finish());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(file.path(), &contents));
+  SnapshotReader reader(reinterpret_cast<const uint8_t*>(contents.data()),
+                        contents.size());
+  ASSERT_FALSE(encoded_.Deserialize(&reader));
+}
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -64,14 +64,14 @@ PERFETTO_TP_TABLE(PERFETTO_TP_METADATA_TABLE_DEF);
 //        cannot be used as primary key because tids and pids are recycled
 //        by most kernels.
 // @param upid {@joinable process.upid}
-#define PERFETTO_TP_THREAD_TABLE_DEF(NAME, PARENT, C) \
-  NAME(ThreadTable, "internal_thread")                \
-  PERFETTO_TP_ROOT_TABLE(PARENT, C)                   \
-  C(uint32_t, tid)                                    \
-  C(StringPool::Id, name)                             \
-  C(base::Optional<int64_t>, start_ts)                \
-  C(base::Optional<int64_t>, end_ts)                  \
-  C(base::Optional<uint32_t>, upid)                   \
+#define PERFETTO_TP_THREAD_TABLE_DEF(NAME, PARENT, C)       \
+  NAME(ThreadTable, "internal_thread")                      \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                         \
+  C(uint32_t, tid)                                          \
+  C(StringPool::Id, name)                                   \
+  C(base::Optional<int64_t>, start_ts)                      \
+  C(base::Optional<int64_t>, end_ts)                        \
+  C(base::Optional<uint32_t>, upid, Column::Flag::kIndexed) \
   C(base::Optional<uint32_t>, is_main_thread)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_THREAD_TABLE_DEF);
@@ -359,6 +359,36 @@ PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_OBJECT_DEF);
 
 PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_REFERENCE_DEF);
 
+// Dominator tree of a heap graph: an object dominates the objects which
+// can only be reached from the GC roots through it, i.e. the objects that
+// would be freed along with it.
+//
+// WARNING: This is experimental and the API is subject to change.
+// @param upid UniquePid of the target {@joinable process.upid}.
+// @param graph_sample_ts timestamp of the dump.
+// @param object_id the object {@joinable heap_graph_object.id}.
+// @param idom_id the immediate dominator of the object. NULL if the object
+//        is only dominated by the set of all GC roots.
+// @param depth depth of the object in the dominator tree.
+// @param dominated_size sum of the self_size of the objects dominated by
+//        this object, including itself: its retained size.
+// @param dominated_count number of objects dominated by this object,
+//        including itself.
+// @tablegroup ART Heap Graphs
+#define PERFETTO_TP_HEAP_GRAPH_DOMINATOR_TREE_DEF(NAME, PARENT, C) \
+  NAME(ExperimentalHeapGraphDominatorTreeTable,                    \
+       "experimental_heap_graph_dominator_tree")                   \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                                \
+  C(uint32_t, upid, Column::Flag::kHidden)                         \
+  C(int64_t, graph_sample_ts, Column::Flag::kHidden)               \
+  C(HeapGraphObjectTable::Id, object_id)                           \
+  C(base::Optional<HeapGraphObjectTable::Id>, idom_id)             \
+  C(uint32_t, depth)                                               \
+  C(int64_t, dominated_size)                                       \
+  C(int64_t, dominated_count)
+
+PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_DOMINATOR_TREE_DEF);
+
 // @param arg_set_id {@joinable args.arg_set_id}
 #define PERFETTO_TP_VULKAN_MEMORY_ALLOCATIONS_DEF(NAME, PARENT, C) \
   NAME(VulkanMemoryAllocationsTable, "vulkan_memory_allocations")  \
@@ -27,19 +27,19 @@ namespace tables {
 // @name slice
 // @tablegroup Events
 // @param arg_set_id {@joinable args.arg_set_id}
-#define PERFETTO_TP_SLICE_TABLE_DEF(NAME, PARENT, C) \
-  NAME(SliceTable, "internal_slice")                 \
-  PERFETTO_TP_ROOT_TABLE(PARENT, C)                  \
-  C(int64_t, ts, Column::Flag::kSorted)              \
-  C(int64_t, dur)                                    \
-  C(TrackTable::Id, track_id)                        \
-  C(StringPool::Id, category)                        \
-  C(StringPool::Id, name)                            \
-  C(uint32_t, depth)                                 \
-  C(int64_t, stack_id)                               \
-  C(int64_t, parent_stack_id)                        \
-  C(base::Optional<SliceTable::Id>, parent_id)       \
-  C(uint32_t, arg_set_id)
+#define PERFETTO_TP_SLICE_TABLE_DEF(NAME, PARENT, C)  \
+  NAME(SliceTable, "internal_slice")                  \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                   \
+  C(int64_t, ts, Column::Flag::kSorted)               \
+  C(int64_t, dur)                                     \
+  C(TrackTable::Id, track_id, Column::Flag::kEncoded) \
+  C(StringPool::Id, category, Column::Flag::kEncoded) \
+  C(StringPool::Id, name)                             \
+  C(uint32_t, depth)                                  \
+  C(int64_t, stack_id)                                \
+  C(int64_t, parent_stack_id)                         \
+  C(base::Optional<SliceTable::Id>, parent_id)        \
+  C(uint32_t, arg_set_id, Column::Flag::kIndexed)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_SLICE_TABLE_DEF);
 
@@ -58,14 +58,14 @@ PERFETTO_TP_TABLE(PERFETTO_TP_INSTANT_TABLE_DEF);
 
 // @tablegroup Events
 // @param utid {@joinable thread.utid}
-#define PERFETTO_TP_SCHED_SLICE_TABLE_DEF(NAME, PARENT, C) \
-  NAME(SchedSliceTable, "sched_slice")                     \
-  PERFETTO_TP_ROOT_TABLE(PARENT, C)                        \
-  C(int64_t, ts, Column::Flag::kSorted)                    \
-  C(int64_t, dur)                                          \
-  C(uint32_t, cpu)                                         \
-  C(uint32_t, utid)                                        \
-  C(StringPool::Id, end_state)                             \
+#define PERFETTO_TP_SCHED_SLICE_TABLE_DEF(NAME, PARENT, C)          \
+  NAME(SchedSliceTable, "sched_slice")                              \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                                 \
+  C(int64_t, ts, Column::Flag::kSorted)                             \
+  C(int64_t, dur)                                                   \
+  C(uint32_t, cpu, Column::Flag::kEncoded | Column::Flag::kIndexed) \
+  C(uint32_t, utid, Column::Flag::kIndexed)                         \
+  C(StringPool::Id, end_state, Column::Flag::kEncoded)              \
   C(int32_t, priority)
 
 PERFETTO_TP_TABLE(PERFETTO_TP_SCHED_SLICE_TABLE_DEF);
@@ -78,8 +78,8 @@ PERFETTO_TP_TABLE(PERFETTO_TP_SCHED_SLICE_TABLE_DEF);
   C(int64_t, ts)                                            \
   C(int64_t, dur)                                           \
   C(base::Optional<uint32_t>, cpu)                          \
-  C(uint32_t, utid)                                         \
-  C(StringPool::Id, state)                                  \
+  C(uint32_t, utid, Column::Flag::kIndexed)                 \
+  C(StringPool::Id, state, Column::Flag::kEncoded)          \
   C(base::Optional<uint32_t>, io_wait)                      \
   C(base::Optional<StringPool::Id>, blocked_function)
 
@@ -60,6 +60,8 @@ ExperimentalFlamegraphNodesTable::~ExperimentalFlamegraphNodesTable() = default;
 HeapGraphObjectTable::~HeapGraphObjectTable() = default;
 HeapGraphClassTable::~HeapGraphClassTable() = default;
 HeapGraphReferenceTable::~HeapGraphReferenceTable() = default;
+ExperimentalHeapGraphDominatorTreeTable::
+    ~ExperimentalHeapGraphDominatorTreeTable() = default;
 VulkanMemoryAllocationsTable::~VulkanMemoryAllocationsTable() = default;
 PackageListTable::~PackageListTable() = default;
 ProfilerSmapsTable::~ProfilerSmapsTable() = default;
@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_TIMESTAMPED_TRACE_PIECE_H_
 
 #include "perfetto/base/build_config.h"
+#include "perfetto/protozero/field.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/importers/common/trace_blob_view.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_record.h"
@@ -55,21 +56,30 @@ struct InlineSchedWaking {
 
 struct TracePacketData {
   TraceBlobView packet;
-  std::shared_ptr<PacketSequenceStateGeneration> sequence_state;
+  RefPtr<PacketSequenceStateGeneration> sequence_state;
 };
 
 struct FtraceEventData {
   TraceBlobView event;
-  std::shared_ptr<PacketSequenceStateGeneration> sequence_state;
+  RefPtr<PacketSequenceStateGeneration> sequence_state;
 };
 
 struct TrackEventData : public TracePacketData {
   TrackEventData(TraceBlobView pv,
-                 std::shared_ptr<PacketSequenceStateGeneration> generation)
+                 RefPtr<PacketSequenceStateGeneration> generation)
       : TracePacketData{std::move(pv), std::move(generation)} {}
 
   static constexpr size_t kMaxNumExtraCounters = 8;
 
+  // The TrackEvent field of |packet|, as found by the tokenizer. This saves
+  // decoding the whole TracePacket again when parsing.
+  protozero::ConstBytes track_event() const {
+    return protozero::ConstBytes{packet.data() + track_event_offset,
+                                 track_event_size};
+  }
+
+  uint32_t track_event_offset = 0;
+  uint32_t track_event_size = 0;
   base::Optional<int64_t> thread_timestamp;
   base::Optional<int64_t> thread_instruction_count;
   double counter_value = 0;
@@ -78,8 +88,14 @@ struct TrackEventData : public TracePacketData {
 
 // A TimestampedTracePiece is (usually a reference to) a piece of a trace that
 // is sorted by TraceSorter.
+//
+// The sorter can buffer hundreds of millions of these when sorting large
+// traces so they are kept compact: the common variants (ftrace events, trace
+// packets and the inline sched events) are stored inline in 24 bytes while the
+// uncommon ones (JSON, Fuchsia, track events and systrace lines) are stored
+// out of line.
 struct TimestampedTracePiece {
-  enum class Type {
+  enum class Type : uint8_t {
     kInvalid = 0,
     kFtraceEvent,
     kTracePacket,
@@ -91,11 +107,10 @@ struct TimestampedTracePiece {
     kSystraceLine,
   };
 
-  TimestampedTracePiece(
-      int64_t ts,
-      uint64_t idx,
-      TraceBlobView tbv,
-      std::shared_ptr<PacketSequenceStateGeneration> sequence_state)
+  TimestampedTracePiece(int64_t ts,
+                        uint64_t idx,
+                        TraceBlobView tbv,
+                        RefPtr<PacketSequenceStateGeneration> sequence_state)
       : packet_data{std::move(tbv), std::move(sequence_state)},
         timestamp(ts),
         packet_idx(idx),
@@ -108,7 +123,7 @@ struct TimestampedTracePiece {
         type(Type::kFtraceEvent) {}
 
   TimestampedTracePiece(int64_t ts, uint64_t idx, std::string value)
-      : json_value(std::move(value)),
+      : json_value(new std::string(std::move(value))),
         timestamp(ts),
         packet_idx(idx),
         type(Type::kJsonValue) {}
@@ -169,7 +184,8 @@ struct TimestampedTracePiece {
         new (&sched_waking) InlineSchedWaking(std::move(ttp.sched_waking));
         break;
       case Type::kJsonValue:
-        new (&json_value) std::string(std::move(ttp.json_value));
+        new (&json_value)
+            std::unique_ptr<std::string>(std::move(ttp.json_value));
         break;
       case Type::kFuchsiaRecord:
         new (&fuchsia_record)
@@ -217,7 +233,7 @@ struct TimestampedTracePiece {
         packet_data.~TracePacketData();
         break;
       case Type::kJsonValue:
-        json_value.~basic_string();
+        json_value.~unique_ptr();
         break;
       case Type::kFuchsiaRecord:
         fuchsia_record.~unique_ptr();
@@ -250,17 +266,25 @@ struct TimestampedTracePiece {
     TracePacketData packet_data;
     InlineSchedSwitch sched_switch;
     InlineSchedWaking sched_waking;
-    std::string json_value;
+    std::unique_ptr<std::string> json_value;
     std::unique_ptr<FuchsiaRecord> fuchsia_record;
     std::unique_ptr<TrackEventData> track_event_data;
     std::unique_ptr<SystraceLine> systrace_line;
   };
 
   int64_t timestamp;
-  uint64_t packet_idx;
-  Type type;
+
+  // Packed together with |type| to save the padding after it.
+  uint64_t packet_idx : 56;
+  Type type : 8;
 };
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_COMPILER_MSVC)
+// MSVC doesn't pack bitfields of different types together.
+static_assert(sizeof(TimestampedTracePiece) == 40,
+              "TimestampedTracePiece should be kept compact");
+#endif
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
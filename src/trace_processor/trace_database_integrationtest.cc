@@ -22,6 +22,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/trace_processor/read_trace.h"
 #include "perfetto/trace_processor/trace_processor.h"
 #include "protos/perfetto/common/descriptor.pbzero.h"
 #include "protos/perfetto/trace_processor/trace_processor.pbzero.h"
@@ -41,6 +42,10 @@ class TraceProcessorIntegrationTest : public ::testing::Test {
       : processor_(TraceProcessor::CreateInstance(Config())) {}
 
  protected:
+  void ResetProcessor(const Config& config) {
+    processor_ = TraceProcessor::CreateInstance(config);
+  }
+
   util::Status LoadTrace(const char* name, size_t min_chunk_size = 512) {
     EXPECT_LE(min_chunk_size, kMaxChunkSize);
     base::ScopedFstream f(fopen(
@@ -84,6 +89,40 @@ TEST_F(TraceProcessorIntegrationTest, AndroidSchedAndPs) {
   ASSERT_FALSE(it.Next());
 }
 
+TEST_F(TraceProcessorIntegrationTest, AndroidSchedAndPsIngestionThread) {
+  Config config;
+  config.ingest_on_separate_thread = true;
+  ResetProcessor(config);
+  ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb").ok());
+  auto it = Query(
+      "select count(*), max(ts) - min(ts) from sched "
+      "where dur != 0 and utid != 0");
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(it.Get(0).type, SqlValue::kLong);
+  ASSERT_EQ(it.Get(0).long_value, 139787);
+  ASSERT_EQ(it.Get(1).type, SqlValue::kLong);
+  ASSERT_EQ(it.Get(1).long_value, 19684308497);
+  ASSERT_FALSE(it.Next());
+}
+
+// ReadTrace() memory-maps the trace and passes it in with ParseShared().
+TEST_F(TraceProcessorIntegrationTest, AndroidSchedAndPsReadTrace) {
+  Config config;
+  config.ingest_on_separate_thread = true;
+  ResetProcessor(config);
+  std::string path = base::GetTestDataPath("test/data/android_sched_and_ps.pb");
+  ASSERT_TRUE(ReadTrace(Processor(), path.c_str(), {}).ok());
+  auto it = Query(
+      "select count(*), max(ts) - min(ts) from sched "
+      "where dur != 0 and utid != 0");
+  ASSERT_TRUE(it.Next());
+  ASSERT_EQ(it.Get(0).type, SqlValue::kLong);
+  ASSERT_EQ(it.Get(0).long_value, 139787);
+  ASSERT_EQ(it.Get(1).type, SqlValue::kLong);
+  ASSERT_EQ(it.Get(1).long_value, 19684308497);
+  ASSERT_FALSE(it.Next());
+}
+
 TEST_F(TraceProcessorIntegrationTest, TraceBounds) {
   ASSERT_TRUE(LoadTrace("android_sched_and_ps.pb").ok());
   auto it = Query("select start_ts, end_ts from trace_bounds");
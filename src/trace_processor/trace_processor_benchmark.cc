@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// End-to-end benchmarks of trace processor: loading the traces in test/data
+// (downloaded by tools/install-build-deps) and running a fixed set of queries
+// and metrics on them.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/base/test/utils.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+using perfetto::trace_processor::Config;
+using perfetto::trace_processor::TraceProcessor;
+using Clock = std::chrono::steady_clock;
+
+// The trace used by the query and metric benchmarks.
+constexpr char kQueryTrace[] = "example_android_trace_30s.pb";
+
+// Matches the chunk size used by ReadTrace().
+constexpr size_t kChunkSize = 1024 * 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->Unit(benchmark::kMillisecond);
+  if (IsBenchmarkFunctionalOnly())
+    b->Iterations(1);
+}
+
+std::string ReadTestTrace(const char* name) {
+  std::string trace;
+  perfetto::base::ReadFile(
+      perfetto::base::GetTestDataPath(std::string("test/data/") + name),
+      &trace);
+  return trace;
+}
+
+// Returns the peak resident set size of the benchmark process, in MB. As this
+// never goes down, it's only meaningful when running a single benchmark (e.g.
+// with --benchmark_filter).
+double PeakRssMb() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  return 0;
+#else
+  struct rusage usage {};
+  getrusage(RUSAGE_SELF, &usage);
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+  return static_cast<double>(usage.ru_maxrss) / (1024 * 1024);
+#else
+  return static_cast<double>(usage.ru_maxrss) / 1024;
+#endif
+#endif
+}
+
+bool LoadTrace(TraceProcessor* tp, const std::string& trace) {
+  for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, trace.size() - off);
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+    memcpy(buf.get(), trace.data() + off, size);
+    if (!tp->Parse(std::move(buf), size).ok())
+      return false;
+  }
+  return true;
+}
+
+// Reports the throughput of the Parse() calls (tokenization and, for traces
+// which don't need a full sort, most of the sorting and parsing) separately
+// from NotifyEndOfFile() (flushing the sorter and parsing what's left).
+static void BM_TraceProcessorLoad(benchmark::State& state,
+                                  const char* trace_name) {
+  std::string trace = ReadTestTrace(trace_name);
+  if (trace.empty()) {
+    state.SkipWithError("Test trace not found");
+    return;
+  }
+
+  double parse_secs = 0;
+  double end_of_file_secs = 0;
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp =
+        TraceProcessor::CreateInstance(Config());
+    Clock::time_point start = Clock::now();
+    if (!LoadTrace(tp.get(), trace)) {
+      state.SkipWithError("Failed to parse trace");
+      return;
+    }
+    Clock::time_point parsed = Clock::now();
+    tp->NotifyEndOfFile();
+    Clock::time_point end = Clock::now();
+    parse_secs += std::chrono::duration<double>(parsed - start).count();
+    end_of_file_secs += std::chrono::duration<double>(end - parsed).count();
+
+    state.PauseTiming();
+    tp.reset();
+    state.ResumeTiming();
+  }
+
+  double total_mb = static_cast<double>(trace.size()) / (1024 * 1024) *
+                    static_cast<double>(state.iterations());
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+  state.counters["parse_MB/s"] = total_mb / parse_secs;
+  state.counters["end_of_file_MB/s"] = total_mb / end_of_file_secs;
+  state.counters["peak_rss_MB"] = PeakRssMb();
+}
+BENCHMARK_CAPTURE(BM_TraceProcessorLoad, ftrace, kQueryTrace)
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorLoad,
+                  track_event,
+                  "chrome_scroll_without_vsync.pftrace")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorLoad,
+                  heap_graph,
+                  "system-server-heap-graph-new.pftrace")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorLoad, json, "sfgate.json")
+    ->Apply(BenchmarkArgs);
+
+// Loads kQueryTrace once for all the query and metric benchmarks. Returns
+// null if the trace is missing or fails to load.
+TraceProcessor* GetQueryTraceProcessor() {
+  static TraceProcessor* tp = [] {
+    std::string trace = ReadTestTrace(kQueryTrace);
+    if (trace.empty())
+      return static_cast<TraceProcessor*>(nullptr);
+    TraceProcessor* instance =
+        TraceProcessor::CreateInstance(Config()).release();
+    if (!LoadTrace(instance, trace)) {
+      delete instance;
+      return static_cast<TraceProcessor*>(nullptr);
+    }
+    instance->NotifyEndOfFile();
+    return instance;
+  }();
+  return tp;
+}
+
+static void BM_TraceProcessorQuery(benchmark::State& state, const char* sql) {
+  TraceProcessor* tp = GetQueryTraceProcessor();
+  if (!tp) {
+    state.SkipWithError("Failed to load test trace");
+    return;
+  }
+
+  for (auto _ : state) {
+    auto it = tp->ExecuteQuery(sql);
+    uint32_t rows = 0;
+    while (it.Next())
+      rows++;
+    if (!it.Status().ok()) {
+      state.SkipWithError(it.Status().c_message());
+      return;
+    }
+    benchmark::DoNotOptimize(rows);
+  }
+}
+BENCHMARK_CAPTURE(BM_TraceProcessorQuery,
+                  sched_by_cpu,
+                  "select cpu, count(*), sum(dur) from sched group by cpu")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorQuery,
+                  thread_state_by_thread,
+                  "select utid, state, sum(dur) from thread_state "
+                  "group by utid, state")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorQuery,
+                  slice_by_name,
+                  "select name, count(*), sum(dur) from slice group by name")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorQuery,
+                  counter_by_track,
+                  "select track_id, max(value) from counter group by track_id")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorQuery,
+                  thread_process_join,
+                  "select thread.name, process.name from thread "
+                  "left join process using(upid)")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorQuery,
+                  to_ftrace,
+                  "select to_ftrace(id) from raw")
+    ->Apply(BenchmarkArgs);
+
+static void BM_TraceProcessorMetric(benchmark::State& state,
+                                    const char* metric) {
+  TraceProcessor* tp = GetQueryTraceProcessor();
+  if (!tp) {
+    state.SkipWithError("Failed to load test trace");
+    return;
+  }
+
+  std::vector<uint8_t> metrics_proto;
+  for (auto _ : state) {
+    auto status = tp->ComputeMetric({metric}, &metrics_proto);
+    if (!status.ok()) {
+      state.SkipWithError(status.c_message());
+      return;
+    }
+    benchmark::DoNotOptimize(metrics_proto);
+
+    // Drop the tables and views created by the metric so that each iteration
+    // computes it from scratch.
+    state.PauseTiming();
+    tp->RestoreInitialTables();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK_CAPTURE(BM_TraceProcessorMetric, android_cpu, "android_cpu")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorMetric, android_mem, "android_mem")
+    ->Apply(BenchmarkArgs);
+BENCHMARK_CAPTURE(BM_TraceProcessorMetric, trace_stats, "trace_stats")
+    ->Apply(BenchmarkArgs);
+
+}  // namespace
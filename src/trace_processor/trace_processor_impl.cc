@@ -16,20 +16,27 @@
 
 #include "src/trace_processor/trace_processor_impl.h"
 
+#include <errno.h>
 #include <inttypes.h>
+#include <string.h>
 #include <algorithm>
+#include <limits>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/containers/snapshot.h"
 #include "src/trace_processor/dynamic/ancestor_generator.h"
 #include "src/trace_processor/dynamic/connected_flow_generator.h"
 #include "src/trace_processor/dynamic/descendant_slice_generator.h"
 #include "src/trace_processor/dynamic/describe_slice_generator.h"
 #include "src/trace_processor/dynamic/experimental_annotated_stack_generator.h"
-#include "src/trace_processor/dynamic/experimental_counter_dur_generator.h"
 #include "src/trace_processor/dynamic/experimental_flamegraph_generator.h"
+#include "src/trace_processor/dynamic/experimental_heap_graph_dominator_tree_generator.h"
+#include "src/trace_processor/dynamic/experimental_overlapping_slice_generator.h"
 #include "src/trace_processor/dynamic/experimental_sched_upid_generator.h"
 #include "src/trace_processor/dynamic/experimental_slice_layout_generator.h"
 #include "src/trace_processor/dynamic/thread_state_generator.h"
@@ -44,6 +51,7 @@
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/systrace/systrace_trace_parser.h"
 #include "src/trace_processor/iterator_impl.h"
+#include "src/trace_processor/sqlite/query_profile_table.h"
 #include "src/trace_processor/sqlite/span_join_operator_table.h"
 #include "src/trace_processor/sqlite/sql_stats_table.h"
 #include "src/trace_processor/sqlite/sqlite3_str_split.h"
@@ -69,6 +77,19 @@
 #include <cxxabi.h>
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+#define PERFETTO_HAS_MMAP() 1
+#else
+#define PERFETTO_HAS_MMAP() 0
+#endif
+
+#if PERFETTO_HAS_MMAP()
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 // In Android and Chromium tree builds, we don't have the percentile module.
 // Just don't include it.
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_PERCENTILE)
@@ -82,6 +103,16 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
+// Returns true if a statement of |db| has been stepped but has not finished.
+bool HasRunningStatements(sqlite3* db) {
+  for (sqlite3_stmt* stmt = sqlite3_next_stmt(db, nullptr); stmt;
+       stmt = sqlite3_next_stmt(db, stmt)) {
+    if (sqlite3_stmt_busy(stmt))
+      return true;
+  }
+  return false;
+}
+
 const char kAllTablesQuery[] =
     "SELECT tbl_name, type FROM (SELECT * FROM sqlite_master UNION ALL SELECT "
     "* FROM sqlite_temp_master)";
@@ -198,6 +229,21 @@ void CreateBuiltinViews(sqlite3* db) {
     sqlite3_free(error);
   }
 
+  // The dur and delta columns are hidden in the counter table to keep them
+  // out of "SELECT *"; this view exposes them for the UI and the metrics.
+  sqlite3_exec(db,
+               "CREATE VIEW experimental_counter_dur AS "
+               "SELECT "
+               "  *, "
+               "  dur, "
+               "  delta "
+               "FROM counter",
+               0, 0, &error);
+  if (error) {
+    PERFETTO_ELOG("Error initializing: %s", error);
+    sqlite3_free(error);
+  }
+
   sqlite3_exec(db,
                "CREATE VIEW counters AS "
                "SELECT * "
@@ -623,9 +669,7 @@ void CreateSourceGeqFunction(sqlite3* db) {
   }
 }
 
-void SetupMetrics(TraceProcessor* tp,
-                  sqlite3* db,
-                  std::vector<metrics::SqlMetricFile>* sql_metrics) {
+void SetupMetrics(TraceProcessor* tp) {
   tp->ExtendMetricsProto(kMetricsDescriptor.data(), kMetricsDescriptor.size());
   tp->ExtendMetricsProto(kAllChromeMetricsDescriptor.data(),
                          kAllChromeMetricsDescriptor.size());
@@ -633,12 +677,18 @@ void SetupMetrics(TraceProcessor* tp,
   for (const auto& file_to_sql : metrics::sql_metrics::kFileToSql) {
     tp->RegisterMetric(file_to_sql.path, file_to_sql.sql);
   }
+}
 
+void CreateMetricFunctions(TraceProcessor* tp,
+                           sqlite3* db,
+                           std::vector<metrics::SqlMetricFile>* sql_metrics,
+                           metrics::RunMetricCache* run_metric_cache) {
   {
     std::unique_ptr<metrics::RunMetricContext> ctx(
         new metrics::RunMetricContext());
     ctx->tp = tp;
     ctx->metrics = sql_metrics;
+    ctx->cache = run_metric_cache;
     auto ret = sqlite3_create_function_v2(
         db, "RUN_METRIC", -1, SQLITE_UTF8, ctx.release(), metrics::RunMetric,
         nullptr, nullptr,
@@ -703,6 +753,51 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
 
   RegisterAdditionalModules(&context_);
 
+  // Setup the query cache.
+  query_cache_.reset(new QueryCache(context_.storage.get(),
+                                    cfg.query_cache_max_bytes));
+  query_budget_.reset(
+      new QueryBudget(cfg.query_max_duration_ms, cfg.query_max_memory_bytes));
+  if (cfg.enable_query_profiling)
+    query_profiler_.reset(new QueryProfiler());
+  sql_stats_ = context_.storage->mutable_sql_stats();
+
+  SetupDatabase(&context_);
+  SetupMetrics(this);
+}
+
+TraceProcessorImpl::TraceProcessorImpl(TraceProcessorImpl* parent)
+    : TraceProcessorStorageImpl(parent->context_.config, NoStorage()),
+      sql_stats_(&worker_sql_stats_),
+      pool_(parent->pool_),
+      sql_metrics_(parent->sql_metrics_) {
+  const Config& cfg = context_.config;
+
+  // The cache statistics are not recorded as nothing can be written to the
+  // storage while the workers run.
+  query_cache_.reset(new QueryCache(nullptr, cfg.query_cache_max_bytes));
+  query_budget_.reset(new QueryBudget(cfg.query_max_duration_ms,
+                                      cfg.query_max_memory_bytes,
+                                      parent->query_budget_.get()));
+
+  // The queries run by the workers are not profiled: their profile would not
+  // be visible to the queries of |parent| anyway.
+
+  // The generators and tables query the context of |parent| as some of them
+  // need its trackers.
+  TraceProcessorContext* ctx = parent->context();
+  SetupDatabase(ctx);
+  BuildBoundsTable(*db_, ctx->storage->GetTraceTimestampBoundsNs());
+
+  util::Status status = RegisterBuildProtoFunctions();
+  PERFETTO_CHECK(status.ok());
+  for (const auto& metric : sql_metrics_) {
+    if (metric.proto_field_name)
+      InsertIntoTraceMetricsTable(*db_, *metric.proto_field_name);
+  }
+}
+
+void TraceProcessorImpl::SetupDatabase(TraceProcessorContext* ctx) {
   sqlite3* db = nullptr;
   EnsureSqliteInitialized();
   PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
@@ -710,23 +805,25 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   CreateBuiltinTables(db);
   CreateBuiltinViews(db);
   db_.reset(std::move(db));
+  statement_cache_.reset(
+      new StatementCache(context_.config.statement_cache_size));
 
-  CreateJsonExportFunction(context_.storage.get(), db);
+  CreateJsonExportFunction(ctx->storage.get(), db);
   CreateHashFunction(db);
   CreateDemangledNameFunction(db);
   CreateLastNonNullFunction(db);
-  CreateExtractArgFunction(context_.storage.get(), db);
+  CreateExtractArgFunction(ctx->storage.get(), db);
   CreateSourceGeqFunction(db);
   CreateValueAtMaxTsFunction(db);
 
-  SetupMetrics(this, *db_, &sql_metrics_);
+  CreateMetricFunctions(this, *db_, &sql_metrics_, &run_metric_cache_);
 
-  // Setup the query cache.
-  query_cache_.reset(new QueryCache());
+  query_budget_->RegisterProgressHandler(*db_);
 
-  const TraceStorage* storage = context_.storage.get();
+  const TraceStorage* storage = ctx->storage.get();
 
   SqlStatsTable::RegisterTable(*db_, storage);
+  QueryProfileTable::RegisterTable(*db_, query_profiler_.get());
   StatsTable::RegisterTable(*db_, storage);
 
   // Operator tables.
@@ -734,41 +831,45 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   WindowOperatorTable::RegisterTable(*db_, storage);
 
   // New style tables but with some custom logic.
-  SqliteRawTable::RegisterTable(*db_, query_cache_.get(), &context_);
+  SqliteRawTable::RegisterTable(*db_, query_cache_.get(), query_budget_.get(),
+                                query_profiler_.get(), ctx);
 
   // Tables dynamically generated at query time.
   RegisterDynamicTable(std::unique_ptr<ExperimentalFlamegraphGenerator>(
-      new ExperimentalFlamegraphGenerator(&context_)));
-  RegisterDynamicTable(std::unique_ptr<ExperimentalCounterDurGenerator>(
-      new ExperimentalCounterDurGenerator(storage->counter_table())));
+      new ExperimentalFlamegraphGenerator(ctx)));
+  RegisterDynamicTable(
+      std::unique_ptr<ExperimentalHeapGraphDominatorTreeGenerator>(
+          new ExperimentalHeapGraphDominatorTreeGenerator(ctx)));
   RegisterDynamicTable(std::unique_ptr<DescribeSliceGenerator>(
-      new DescribeSliceGenerator(&context_)));
+      new DescribeSliceGenerator(ctx)));
   RegisterDynamicTable(std::unique_ptr<ExperimentalSliceLayoutGenerator>(
       new ExperimentalSliceLayoutGenerator(
-          context_.storage.get()->mutable_string_pool(),
+          ctx->storage.get()->mutable_string_pool(),
           &storage->slice_table())));
   RegisterDynamicTable(std::unique_ptr<AncestorGenerator>(
-      new AncestorGenerator(AncestorGenerator::Ancestor::kSlice, &context_)));
+      new AncestorGenerator(AncestorGenerator::Ancestor::kSlice, ctx)));
   RegisterDynamicTable(std::unique_ptr<AncestorGenerator>(new AncestorGenerator(
-      AncestorGenerator::Ancestor::kStackProfileCallsite, &context_)));
+      AncestorGenerator::Ancestor::kStackProfileCallsite, ctx)));
   RegisterDynamicTable(std::unique_ptr<DescendantSliceGenerator>(
-      new DescendantSliceGenerator(&context_)));
+      new DescendantSliceGenerator(ctx)));
+  RegisterDynamicTable(std::unique_ptr<ExperimentalOverlappingSliceGenerator>(
+      new ExperimentalOverlappingSliceGenerator(ctx)));
   RegisterDynamicTable(
       std::unique_ptr<ConnectedFlowGenerator>(new ConnectedFlowGenerator(
-          ConnectedFlowGenerator::Mode::kDirectlyConnectedFlow, &context_)));
+          ConnectedFlowGenerator::Mode::kDirectlyConnectedFlow, ctx)));
   RegisterDynamicTable(
       std::unique_ptr<ConnectedFlowGenerator>(new ConnectedFlowGenerator(
-          ConnectedFlowGenerator::Mode::kPrecedingFlow, &context_)));
+          ConnectedFlowGenerator::Mode::kPrecedingFlow, ctx)));
   RegisterDynamicTable(
       std::unique_ptr<ConnectedFlowGenerator>(new ConnectedFlowGenerator(
-          ConnectedFlowGenerator::Mode::kFollowingFlow, &context_)));
+          ConnectedFlowGenerator::Mode::kFollowingFlow, ctx)));
   RegisterDynamicTable(std::unique_ptr<ExperimentalSchedUpidGenerator>(
       new ExperimentalSchedUpidGenerator(storage->sched_slice_table(),
                                          storage->thread_table())));
   RegisterDynamicTable(std::unique_ptr<ThreadStateGenerator>(
-      new ThreadStateGenerator(&context_)));
+      new ThreadStateGenerator(ctx)));
   RegisterDynamicTable(std::unique_ptr<ExperimentalAnnotatedStackGenerator>(
-      new ExperimentalAnnotatedStackGenerator(&context_)));
+      new ExperimentalAnnotatedStackGenerator(ctx)));
 
   // New style db-backed tables.
   RegisterDbTable(storage->arg_table());
@@ -838,9 +939,20 @@ TraceProcessorImpl::~TraceProcessorImpl() = default;
 util::Status TraceProcessorImpl::Parse(std::unique_ptr<uint8_t[]> data,
                                        size_t size) {
   bytes_parsed_ += size;
+
+  // Parsing can mutate the rows of any table so drop all the cached results.
+  query_cache_->InvalidateAll();
   return TraceProcessorStorageImpl::Parse(std::move(data), size);
 }
 
+util::Status TraceProcessorImpl::ParseShared(
+    std::shared_ptr<const uint8_t> data,
+    size_t size) {
+  bytes_parsed_ += size;
+  query_cache_->InvalidateAll();
+  return TraceProcessorStorageImpl::ParseShared(std::move(data), size);
+}
+
 std::string TraceProcessorImpl::GetCurrentTraceName() {
   if (current_trace_name_.empty())
     return "";
@@ -853,17 +965,101 @@ void TraceProcessorImpl::SetCurrentTraceName(const std::string& name) {
 }
 
 void TraceProcessorImpl::NotifyEndOfFile() {
-  if (current_trace_name_.empty())
-    current_trace_name_ = "Unnamed trace";
-
   TraceProcessorStorageImpl::NotifyEndOfFile();
 
   SchedEventTracker::GetOrCreate(&context_)->FlushPendingEvents();
   context_.metadata_tracker->SetMetadata(
       metadata::trace_size_bytes,
       Variadic::Integer(static_cast<int64_t>(bytes_parsed_)));
+  OnTablesLoaded();
+}
+
+util::Status TraceProcessorImpl::SaveSnapshot(const std::string& path) {
+  if (!notified_eof_) {
+    return util::ErrStatus(
+        "SaveSnapshot: the trace must be fully loaded before saving it");
+  }
+  base::ScopedFile fd(base::OpenFile(path, O_CREAT | O_WRONLY | O_TRUNC, 0644));
+  if (!fd)
+    return util::ErrStatus("SaveSnapshot: could not open %s", path.c_str());
+
+  SnapshotWriter writer(*fd);
+  context_.storage->SaveSnapshot(&writer);
+  if (!writer.Finish()) {
+    return util::ErrStatus("SaveSnapshot: could not write %s: %s",
+                           path.c_str(), strerror(errno));
+  }
+  return util::OkStatus();
+}
+
+util::Status TraceProcessorImpl::LoadSnapshot(const std::string& path) {
+  if (bytes_parsed_ > 0 || notified_eof_) {
+    return util::ErrStatus(
+        "LoadSnapshot: should be called before loading any other trace data");
+  }
+
+  // Snapshots are always bigger than this: smaller files are rejected upfront
+  // so that the buffer read on platforms without mmap is always on the heap
+  // and so suitably aligned.
+  static constexpr size_t kMinSnapshotSize = 64;
+#if PERFETTO_HAS_MMAP()
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+  if (!fd)
+    return util::ErrStatus("LoadSnapshot: could not open %s", path.c_str());
+  struct stat st {};
+  if (fstat(*fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      static_cast<uint64_t>(st.st_size) < kMinSnapshotSize ||
+      static_cast<uint64_t>(st.st_size) > std::numeric_limits<size_t>::max()) {
+    return util::ErrStatus("LoadSnapshot: %s is not a snapshot", path.c_str());
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+  if (addr == MAP_FAILED)
+    return util::ErrStatus("LoadSnapshot: could not map %s", path.c_str());
+
+  // The columns are copied out of the mapping front to back.
+  madvise(addr, size, MADV_SEQUENTIAL);
+  std::unique_ptr<void, std::function<void(void*)>> mapping(
+      addr, [size](void* ptr) { munmap(ptr, size); });
+  const uint8_t* data = static_cast<const uint8_t*>(addr);
+#else
+  std::string contents;
+  if (!base::ReadFile(path, &contents))
+    return util::ErrStatus("LoadSnapshot: could not read %s", path.c_str());
+  if (contents.size() < kMinSnapshotSize)
+    return util::ErrStatus("LoadSnapshot: %s is not a snapshot", path.c_str());
+  const size_t size = contents.size();
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(contents.data());
+#endif
+
+  SnapshotReader reader(data, size);
+  util::Status status = context_.storage->LoadSnapshot(&reader);
+  if (!status.ok()) {
+    return util::ErrStatus("LoadSnapshot: %s: %s", path.c_str(),
+                           status.c_message());
+  }
+  bytes_parsed_ = size;
+  OnTablesLoaded();
+  return util::OkStatus();
+}
+
+void TraceProcessorImpl::OnTablesLoaded() {
+  if (current_trace_name_.empty())
+    current_trace_name_ = "Unnamed trace";
+
   BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
 
+  // No more rows will be added to the tables so we can now compact them.
+  context_.storage->ShrinkToFitTables();
+
+  // Flushing the importers (or loading a snapshot) can mutate rows in place
+  // so drop any results cached by queries made before this point.
+  query_cache_->InvalidateAll();
+
+  // Statements prepared while parsing were planned using the sizes of the
+  // partially filled tables; replan them now that all the rows are present.
+  statement_cache_->Clear();
+
   // Create a snapshot of all tables and views created so far. This is so later
   // we can drop all extra tables created by the UI and reset to the original
   // state (see RestoreInitialTables).
@@ -874,6 +1070,7 @@ void TraceProcessorImpl::NotifyEndOfFile() {
     PERFETTO_CHECK(value.type == SqlValue::Type::kString);
     initial_tables_.push_back(value.string_value);
   }
+  notified_eof_ = true;
 }
 
 size_t TraceProcessorImpl::RestoreInitialTables() {
@@ -902,17 +1099,32 @@ size_t TraceProcessorImpl::RestoreInitialTables() {
     if (!it.Status().ok() && tn.first != "index")
       PERFETTO_FATAL("%s -> %s", query.c_str(), it.Status().c_message());
   }
+
+  // Don't hold onto statements referring to the deleted tables and views.
+  statement_cache_->Clear();
   return deletion_list.size();
 }
 
 Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql,
                                           int64_t time_queued) {
-  sqlite3_stmt* raw_stmt;
-  int err;
-  {
+  // Queries run while another statement is being stepped (e.g. by RUN_METRIC)
+  // are part of that query and share its budget.
+  if (!HasRunningStatements(*db_)) {
+    query_budget_->StartQuery();
+    if (query_profiler_)
+      query_profiler_->StartQuery(sql);
+  }
+
+  // Reuse the statement from a previous call with the same SQL if possible to
+  // avoid parsing and planning the query again.
+  ScopedStmt stmt = statement_cache_->Take(sql);
+  int err = SQLITE_OK;
+  if (!stmt) {
     PERFETTO_TP_TRACE("QUERY_PREPARE");
+    sqlite3_stmt* raw_stmt = nullptr;
     err = sqlite3_prepare_v2(*db_, sql.c_str(), static_cast<int>(sql.size()),
                              &raw_stmt, nullptr);
+    stmt.reset(raw_stmt);
   }
 
   util::Status status;
@@ -920,23 +1132,22 @@ Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql,
   if (err != SQLITE_OK) {
     status = util::ErrStatus("%s", sqlite3_errmsg(*db_));
   } else {
-    col_count = static_cast<uint32_t>(sqlite3_column_count(raw_stmt));
+    col_count = static_cast<uint32_t>(sqlite3_column_count(*stmt));
   }
 
   base::TimeNanos t_start = base::GetWallTimeNs();
   uint32_t sql_stats_row =
-      context_.storage->mutable_sql_stats()->RecordQueryBegin(sql, time_queued,
-                                                              t_start.count());
+      sql_stats_->RecordQueryBegin(sql, time_queued, t_start.count());
 
   std::unique_ptr<IteratorImpl> impl(new IteratorImpl(
-      this, *db_, ScopedStmt(raw_stmt), col_count, status, sql_stats_row));
+      this, *db_, sql, std::move(stmt), col_count, status, sql_stats_row));
   return Iterator(std::move(impl));
 }
 
 void TraceProcessorImpl::InterruptQuery() {
   if (!db_)
     return;
-  query_interrupted_.store(true);
+  query_budget_->Interrupt();
   sqlite3_interrupt(db_.get());
 }
 
@@ -998,7 +1209,10 @@ util::Status TraceProcessorImpl::ExtendMetricsProto(const uint8_t* data,
   util::Status status = pool_.AddFromFileDescriptorSet(data, size);
   if (!status.ok())
     return status;
+  return RegisterBuildProtoFunctions();
+}
 
+util::Status TraceProcessorImpl::RegisterBuildProtoFunctions() {
   for (const auto& desc : pool_.descriptors()) {
     // Convert the full name (e.g. .perfetto.protos.TraceMetrics.SubMetric)
     // into a function name of the form (TraceMetrics_SubMetric).
@@ -1030,8 +1244,46 @@ util::Status TraceProcessorImpl::ComputeMetric(
     return util::Status("Root metrics proto descriptor not found");
 
   const auto& root_descriptor = pool_.descriptors()[opt_idx.value()];
+
+  // The workers can only query the tables once nothing will be written to
+  // them. Metatracing is not thread safe.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (context_.config.metric_threads > 1 && metric_names.size() > 1 &&
+      notified_eof_ && !metatrace::g_enabled) {
+    return ComputeMetricOnWorkers(metric_names, root_descriptor,
+                                  metrics_proto);
+  }
+#endif
   return metrics::ComputeMetrics(this, metric_names, sql_metrics_,
-                                 root_descriptor, metrics_proto);
+                                 &run_metric_cache_, root_descriptor,
+                                 metrics_proto);
+}
+
+util::Status TraceProcessorImpl::ComputeMetricOnWorkers(
+    const std::vector<std::string>& metric_names,
+    const ProtoDescriptor& root_descriptor,
+    std::vector<uint8_t>* metrics_proto) {
+  std::vector<std::vector<size_t>> assignment =
+      metrics::AssignMetricsToWorkers(metric_names, sql_metrics_,
+                                      context_.config.metric_threads);
+
+  // The workers stop when this instance is interrupted (see QueryBudget):
+  // forget about the interruptions of previous queries.
+  query_budget_->StartQuery();
+
+  // The workers are created here as creating their tables can write to the
+  // storage (e.g. to intern strings).
+  std::vector<std::unique_ptr<TraceProcessorImpl>> workers;
+  std::vector<metrics::MetricWorker> metric_workers;
+  for (size_t i = 0; i < assignment.size(); ++i) {
+    workers.emplace_back(new TraceProcessorImpl(this));
+    metric_workers.push_back(
+        metrics::MetricWorker{workers.back().get(),
+                              &workers.back()->run_metric_cache_});
+  }
+  return metrics::ComputeMetricsInParallel(metric_workers, assignment,
+                                           metric_names, sql_metrics_,
+                                           root_descriptor, metrics_proto);
 }
 
 util::Status TraceProcessorImpl::ComputeMetricText(
@@ -19,7 +19,6 @@
 
 #include <sqlite3.h>
 
-#include <atomic>
 #include <functional>
 #include <string>
 #include <vector>
@@ -29,8 +28,12 @@
 #include "perfetto/trace_processor/status.h"
 #include "perfetto/trace_processor/trace_processor.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/query_budget.h"
 #include "src/trace_processor/sqlite/query_cache.h"
+#include "src/trace_processor/sqlite/query_profiler.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/sqlite/statement_cache.h"
+#include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/trace_processor_storage_impl.h"
 
 #include "src/trace_processor/metrics/metrics.h"
@@ -50,6 +53,7 @@ class TraceProcessorImpl : public TraceProcessor,
 
   // TraceProcessorStorage implementation:
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseShared(std::shared_ptr<const uint8_t>, size_t) override;
   void NotifyEndOfFile() override;
 
   // TraceProcessor implementation:
@@ -74,6 +78,9 @@ class TraceProcessorImpl : public TraceProcessor,
 
   size_t RestoreInitialTables() override;
 
+  util::Status SaveSnapshot(const std::string& path) override;
+  util::Status LoadSnapshot(const std::string& path) override;
+
   std::string GetCurrentTraceName() override;
   void SetCurrentTraceName(const std::string&) override;
 
@@ -86,28 +93,65 @@ class TraceProcessorImpl : public TraceProcessor,
   // Needed for iterators to be able to access the context.
   friend class IteratorImpl;
 
+  // Creates a worker used by ComputeMetric() to compute metrics on another
+  // thread. The worker has its own SQLite connection to the tables of
+  // |parent| and knows about all the metrics and metric protos of |parent|.
+  // Must be called on the thread which owns |parent|.
+  explicit TraceProcessorImpl(TraceProcessorImpl* parent);
+
+  // Opens |db_| and registers all the functions and tables, which query the
+  // storage of |ctx|.
+  void SetupDatabase(TraceProcessorContext* ctx);
+
+  // Prepares the tables for querying once all their rows have been added
+  // (either by parsing the trace or by loading a snapshot).
+  void OnTablesLoaded();
+
+  // Registers a function building each of the protos in |pool_|.
+  util::Status RegisterBuildProtoFunctions();
+
+  // Computes |metric_names| on several threads (see Config::metric_threads).
+  util::Status ComputeMetricOnWorkers(
+      const std::vector<std::string>& metric_names,
+      const ProtoDescriptor& root_descriptor,
+      std::vector<uint8_t>* metrics_proto);
+
   template <typename Table>
   void RegisterDbTable(const Table& table) {
-    DbSqliteTable::RegisterTable(*db_, query_cache_.get(), Table::Schema(),
-                                 &table, table.table_name());
+    DbSqliteTable::RegisterTable(*db_, query_cache_.get(), query_budget_.get(),
+                                 query_profiler_.get(), Table::Schema(), &table,
+                                 table.table_name());
   }
 
   void RegisterDynamicTable(
       std::unique_ptr<DbSqliteTable::DynamicTableGenerator> generator) {
-    DbSqliteTable::RegisterTable(*db_, query_cache_.get(),
-                                 std::move(generator));
+    DbSqliteTable::RegisterTable(*db_, query_cache_.get(), query_budget_.get(),
+                                 query_profiler_.get(), std::move(generator));
   }
 
   bool IsRootMetricField(const std::string& metric_name);
+
   ScopedDb db_;
   std::unique_ptr<QueryCache> query_cache_;
 
+  // Checked by the progress handler of |db_| and by the tables of |db_|.
+  std::unique_ptr<QueryBudget> query_budget_;
+
+  // Only set when Config::enable_query_profiling is true.
+  std::unique_ptr<QueryProfiler> query_profiler_;
+
+  // Must be destroyed before |db_| as the statements belong to it.
+  std::unique_ptr<StatementCache> statement_cache_;
+
+  // Points to the stats in the storage, except for metric workers which must
+  // not write to the storage they share: they record their queries in
+  // |worker_sql_stats_| instead.
+  TraceStorage::SqlStats* sql_stats_ = nullptr;
+  TraceStorage::SqlStats worker_sql_stats_;
+
   DescriptorPool pool_;
   std::vector<metrics::SqlMetricFile> sql_metrics_;
-
-  // This is atomic because it is set by the CTRL-C signal handler and we need
-  // to prevent single-flow compiler optimizations in ExecuteQuery().
-  std::atomic<bool> query_interrupted_{false};
+  metrics::RunMetricCache run_metric_cache_;
 
   // Keeps track of the tables created by the ingestion process. This is used
   // by RestoreInitialTables() to delete all the tables/view that have been
@@ -116,6 +160,7 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::string current_trace_name_;
   uint64_t bytes_parsed_ = 0;
+  bool notified_eof_ = false;
 };
 
 
@@ -19,8 +19,12 @@
 #include <stdio.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <iostream>
+#include <map>
+#include <thread>
 #include <vector>
 
 #include <google/protobuf/compiler/parser.h>
@@ -332,17 +336,11 @@ std::string BaseName(std::string metric_path) {
                                         : metric_path.substr(slash_idx + 1);
 }
 
-util::Status RegisterMetric(const std::string& register_metric) {
-  std::string sql;
-  base::ReadFile(register_metric, &sql);
-
-  std::string path = "shell/" + BaseName(register_metric);
-
-  return g_tp->RegisterMetric(path, sql);
-}
-
-util::Status ExtendMetricsProto(const std::string& extend_metrics_proto,
-                                google::protobuf::DescriptorPool* pool) {
+// Parses |extend_metrics_proto|, adds it to |pool| and writes it as a
+// serialized FileDescriptorSet to |metric_proto|.
+util::Status ParseMetricsProto(const std::string& extend_metrics_proto,
+                               google::protobuf::DescriptorPool* pool,
+                               std::vector<uint8_t>* metric_proto) {
   google::protobuf::FileDescriptorSet desc_set;
 
   base::ScopedFile file(base::OpenFile(extend_metrics_proto, O_RDONLY));
@@ -362,12 +360,10 @@ util::Status ExtendMetricsProto(const std::string& extend_metrics_proto,
   file_desc->set_name(BaseName(extend_metrics_proto));
   pool->BuildFile(*file_desc);
 
-  std::vector<uint8_t> metric_proto;
-  metric_proto.resize(desc_set.ByteSizeLong());
-  desc_set.SerializeToArray(metric_proto.data(),
-                            static_cast<int>(metric_proto.size()));
-
-  return g_tp->ExtendMetricsProto(metric_proto.data(), metric_proto.size());
+  metric_proto->resize(desc_set.ByteSizeLong());
+  desc_set.SerializeToArray(metric_proto->data(),
+                            static_cast<int>(metric_proto->size()));
+  return util::OkStatus();
 }
 
 enum OutputFormat {
@@ -377,11 +373,51 @@ enum OutputFormat {
   kNone,
 };
 
-util::Status RunMetrics(const std::vector<std::string>& metric_names,
+// A metric passed to --run-metrics as the path of its SQL file. The files of
+// the metric are read once and can then be registered with any number of
+// TraceProcessor instances.
+struct MetricExtension {
+  std::string metric_or_path;
+  std::string path;  // The path the SQL file is registered with.
+  std::string sql;
+  std::vector<uint8_t> metric_proto;  // Serialized FileDescriptorSet.
+};
+
+// The metrics to compute and how to output them.
+struct Metrics {
+  std::vector<std::string> names;
+  std::vector<MetricExtension> extensions;
+  OutputFormat format = OutputFormat::kTextProto;
+};
+
+util::Status RegisterMetrics(TraceProcessor* tp, const Metrics& metrics) {
+  for (const MetricExtension& extension : metrics.extensions) {
+    // The proto must be extended before registering the metric.
+    util::Status status = tp->ExtendMetricsProto(
+        extension.metric_proto.data(), extension.metric_proto.size());
+    if (!status.ok()) {
+      return util::ErrStatus("Unable to extend metrics proto %s: %s",
+                             extension.metric_or_path.c_str(),
+                             status.c_message());
+    }
+
+    status = tp->RegisterMetric(extension.path, extension.sql);
+    if (!status.ok()) {
+      return util::ErrStatus("Unable to register metric %s: %s",
+                             extension.metric_or_path.c_str(),
+                             status.c_message());
+    }
+  }
+  return util::OkStatus();
+}
+
+util::Status RunMetrics(TraceProcessor* tp,
+                        const std::vector<std::string>& metric_names,
                         OutputFormat format,
-                        const google::protobuf::DescriptorPool& pool) {
+                        const google::protobuf::DescriptorPool& pool,
+                        FILE* output) {
   std::vector<uint8_t> metric_result;
-  util::Status status = g_tp->ComputeMetric(metric_names, &metric_result);
+  util::Status status = tp->ComputeMetric(metric_names, &metric_result);
   if (!status.ok()) {
     return util::ErrStatus("Error when computing metrics: %s",
                            status.c_message());
@@ -390,7 +426,7 @@ util::Status RunMetrics(const std::vector<std::string>& metric_names,
     return util::OkStatus();
   }
   if (format == OutputFormat::kBinaryProto) {
-    fwrite(metric_result.data(), sizeof(uint8_t), metric_result.size(), stdout);
+    fwrite(metric_result.data(), sizeof(uint8_t), metric_result.size(), output);
     return util::OkStatus();
   }
 
@@ -405,7 +441,7 @@ util::Status RunMetrics(const std::vector<std::string>& metric_names,
     case OutputFormat::kTextProto: {
       std::string out;
       google::protobuf::TextFormat::PrintToString(*metrics, &out);
-      fwrite(out.c_str(), sizeof(char), out.size(), stdout);
+      fwrite(out.c_str(), sizeof(char), out.size(), output);
       break;
     }
     case OutputFormat::kJson: {
@@ -416,7 +452,7 @@ util::Status RunMetrics(const std::vector<std::string>& metric_names,
               pool.FindMessageTypeByName("google.protobuf.FieldOptions"));
       auto out = proto_to_json::MessageToJsonWithAnnotations(
           *metrics, field_options_prototype, 0);
-      fwrite(out.c_str(), sizeof(char), out.size(), stdout);
+      fwrite(out.c_str(), sizeof(char), out.size(), output);
       break;
     }
     case OutputFormat::kBinaryProto:
@@ -571,11 +607,12 @@ util::Status LoadQueries(FILE* input, std::vector<std::string>* output) {
   return util::OkStatus();
 }
 
-util::Status RunQueriesWithoutOutput(const std::vector<std::string>& queries) {
+util::Status RunQueriesWithoutOutput(TraceProcessor* tp,
+                                     const std::vector<std::string>& queries) {
   for (const auto& sql_query : queries) {
     PERFETTO_DLOG("Executing query: %s", sql_query.c_str());
 
-    auto it = g_tp->ExecuteQuery(sql_query);
+    auto it = tp->ExecuteQuery(sql_query);
     RETURN_IF_ERROR(it.Status());
     if (it.Next()) {
       return util::ErrStatus("Unexpected result from a query.");
@@ -584,7 +621,8 @@ util::Status RunQueriesWithoutOutput(const std::vector<std::string>& queries) {
   return util::OkStatus();
 }
 
-util::Status RunQueriesAndPrintResult(const std::vector<std::string>& queries,
+util::Status RunQueriesAndPrintResult(TraceProcessor* tp,
+                                      const std::vector<std::string>& queries,
                                       FILE* output) {
   bool is_first_query = true;
   bool has_output = false;
@@ -596,7 +634,7 @@ util::Status RunQueriesAndPrintResult(const std::vector<std::string>& queries,
 
     PERFETTO_ILOG("Executing query: %s", sql_query.c_str());
 
-    auto it = g_tp->ExecuteQuery(sql_query);
+    auto it = tp->ExecuteQuery(sql_query);
     RETURN_IF_ERROR(it.Status());
     if (it.ColumnCount() == 0) {
       bool it_has_more = it.Next();
@@ -665,7 +703,20 @@ struct CommandLineOptions {
   bool enable_httpd = false;
   bool wide = false;
   bool force_full_sort = false;
+  bool adaptive_sort = false;
+  uint64_t sort_max_events = 0;
+  std::string skipped_importers;
+  bool ingest_on_separate_thread = false;
+  uint64_t query_max_duration_ms = 0;
+  uint64_t query_max_memory_mb = 0;
+  uint32_t metric_threads = 0;
+  bool profile_queries = false;
+  bool profile_importers = false;
   std::string metatrace_path;
+  std::string snapshot_path;
+  std::string batch_file_path;
+  std::string batch_output_dir;
+  uint32_t batch_jobs = 0;
 };
 
 void PrintUsage(char** argv) {
@@ -712,10 +763,67 @@ Options:
                                       writing the resulting trace into FILE.
  --full-sort                          Forces the trace processor into performing
                                       a full sort ignoring any windowing
-                                      logic.)",
+                                      logic.
+ --adaptive-sort                      Shrinks the sorting window to match how
+                                      far out of order the trace is, reducing
+                                      memory use on long traces.
+ --sort-max-events N                  Parses the oldest events early when more
+                                      than N events are waiting to be sorted,
+                                      bounding the memory used by the sorting.
+ --skip-importers NAMES               Drops the trace packets of the comma
+                                      separated importer modules NAMES (e.g.
+                                      ftrace,heap_graph) without parsing them.
+ --ingestion-thread                   Parses the trace on a separate thread
+                                      while the next chunk is being read.
+ --query-max-duration-ms MS           Fails the queries which run for longer
+                                      than MS milliseconds.
+ --query-max-memory-mb MB             Fails the queries which grow the memory
+                                      of the process by more than MB megabytes
+                                      (Linux and Android only).
+ --metric-threads N                   Computes the metrics passed to
+                                      --run-metrics on up to N threads. The
+                                      tables created by the metrics are not
+                                      visible to later queries so this is
+                                      ignored with --pre-metrics and
+                                      --query-file.
+ --profile-queries                    Records the time spent by each query in
+                                      each table it reads, which can be
+                                      queried from the
+                                      __intrinsic_query_profile table.
+ --profile-importers                  Records the CPU time spent tokenizing
+                                      and parsing each type of trace packet
+                                      in the importer_* stats and how the
+                                      sorter performs in the sorter_* stats.
+ --save-snapshot FILE                 Writes a snapshot of the tables of the
+                                      trace to FILE once it is loaded. Passing
+                                      FILE as the trace file later loads the
+                                      tables without parsing the trace again.
+                                      Snapshots can only be loaded by the
+                                      version of trace processor which wrote
+                                      them.
+ --batch FILE                         Runs --pre-metrics, --run-metrics and
+                                      --query-file on each of the traces listed
+                                      in FILE (one path per line) instead of a
+                                      single trace, writing the output of each
+                                      trace to --batch-output-dir.
+ --batch-output-dir DIR               Directory where the output of each trace
+                                      of --batch is written, as the base name
+                                      of the trace followed by the extension of
+                                      the output format.
+ --batch-jobs N                       Processes up to N traces of --batch in
+                                      parallel (default: number of CPUs).)",
                 argv[0]);
 }
 
+uint64_t ParseUInt64OptionOrExit(const char* name, const char* value) {
+  base::Optional<uint64_t> parsed = base::CStringToUInt64(value);
+  if (!parsed) {
+    PERFETTO_ELOG("Invalid value for --%s: %s", name, value);
+    exit(1);
+  }
+  return *parsed;
+}
+
 CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
   CommandLineOptions command_line_options;
   enum LongOption {
@@ -723,7 +831,20 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_PRE_METRICS,
     OPT_METRICS_OUTPUT,
     OPT_FORCE_FULL_SORT,
+    OPT_ADAPTIVE_SORT,
+    OPT_SORT_MAX_EVENTS,
+    OPT_SKIP_IMPORTERS,
     OPT_HTTP_PORT,
+    OPT_INGESTION_THREAD,
+    OPT_QUERY_MAX_DURATION,
+    OPT_QUERY_MAX_MEMORY,
+    OPT_METRIC_THREADS,
+    OPT_PROFILE_QUERIES,
+    OPT_PROFILE_IMPORTERS,
+    OPT_SAVE_SNAPSHOT,
+    OPT_BATCH,
+    OPT_BATCH_OUTPUT_DIR,
+    OPT_BATCH_JOBS,
   };
 
   static const option long_options[] = {
@@ -741,7 +862,21 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"pre-metrics", required_argument, nullptr, OPT_PRE_METRICS},
       {"metrics-output", required_argument, nullptr, OPT_METRICS_OUTPUT},
       {"full-sort", no_argument, nullptr, OPT_FORCE_FULL_SORT},
+      {"adaptive-sort", no_argument, nullptr, OPT_ADAPTIVE_SORT},
+      {"sort-max-events", required_argument, nullptr, OPT_SORT_MAX_EVENTS},
+      {"skip-importers", required_argument, nullptr, OPT_SKIP_IMPORTERS},
       {"http-port", required_argument, nullptr, OPT_HTTP_PORT},
+      {"ingestion-thread", no_argument, nullptr, OPT_INGESTION_THREAD},
+      {"query-max-duration-ms", required_argument, nullptr,
+       OPT_QUERY_MAX_DURATION},
+      {"query-max-memory-mb", required_argument, nullptr, OPT_QUERY_MAX_MEMORY},
+      {"metric-threads", required_argument, nullptr, OPT_METRIC_THREADS},
+      {"profile-queries", no_argument, nullptr, OPT_PROFILE_QUERIES},
+      {"profile-importers", no_argument, nullptr, OPT_PROFILE_IMPORTERS},
+      {"save-snapshot", required_argument, nullptr, OPT_SAVE_SNAPSHOT},
+      {"batch", required_argument, nullptr, OPT_BATCH},
+      {"batch-output-dir", required_argument, nullptr, OPT_BATCH_OUTPUT_DIR},
+      {"batch-jobs", required_argument, nullptr, OPT_BATCH_JOBS},
       {nullptr, 0, nullptr, 0}};
 
   bool explicit_interactive = false;
@@ -821,11 +956,81 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_ADAPTIVE_SORT) {
+      command_line_options.adaptive_sort = true;
+      continue;
+    }
+
+    if (option == OPT_SORT_MAX_EVENTS) {
+      command_line_options.sort_max_events =
+          ParseUInt64OptionOrExit("sort-max-events", optarg);
+      continue;
+    }
+
+    if (option == OPT_SKIP_IMPORTERS) {
+      command_line_options.skipped_importers = optarg;
+      continue;
+    }
+
     if (option == OPT_HTTP_PORT) {
       command_line_options.port_number = optarg;
       continue;
     }
 
+    if (option == OPT_INGESTION_THREAD) {
+      command_line_options.ingest_on_separate_thread = true;
+      continue;
+    }
+
+    if (option == OPT_QUERY_MAX_DURATION) {
+      command_line_options.query_max_duration_ms =
+          ParseUInt64OptionOrExit("query-max-duration-ms", optarg);
+      continue;
+    }
+
+    if (option == OPT_QUERY_MAX_MEMORY) {
+      command_line_options.query_max_memory_mb =
+          ParseUInt64OptionOrExit("query-max-memory-mb", optarg);
+      continue;
+    }
+
+    if (option == OPT_METRIC_THREADS) {
+      command_line_options.metric_threads = static_cast<uint32_t>(
+          ParseUInt64OptionOrExit("metric-threads", optarg));
+      continue;
+    }
+
+    if (option == OPT_PROFILE_QUERIES) {
+      command_line_options.profile_queries = true;
+      continue;
+    }
+
+    if (option == OPT_PROFILE_IMPORTERS) {
+      command_line_options.profile_importers = true;
+      continue;
+    }
+
+    if (option == OPT_SAVE_SNAPSHOT) {
+      command_line_options.snapshot_path = optarg;
+      continue;
+    }
+
+    if (option == OPT_BATCH) {
+      command_line_options.batch_file_path = optarg;
+      continue;
+    }
+
+    if (option == OPT_BATCH_OUTPUT_DIR) {
+      command_line_options.batch_output_dir = optarg;
+      continue;
+    }
+
+    if (option == OPT_BATCH_JOBS) {
+      command_line_options.batch_jobs = static_cast<uint32_t>(
+          ParseUInt64OptionOrExit("batch-jobs", optarg));
+      continue;
+    }
+
     PrintUsage(argv);
     exit(option == 'h' ? 0 : 1);
   }
@@ -834,7 +1039,8 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       explicit_interactive || (command_line_options.pre_metrics_path.empty() &&
                                command_line_options.metric_names.empty() &&
                                command_line_options.query_file_path.empty() &&
-                               command_line_options.sqlite_file_path.empty());
+                               command_line_options.sqlite_file_path.empty() &&
+                               command_line_options.snapshot_path.empty());
 
   // Only allow non-interactive queries to emit perf data.
   if (!command_line_options.perf_file_path.empty() &&
@@ -843,6 +1049,28 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     exit(1);
   }
 
+  // In --batch mode the traces are listed in the batch file and each one is
+  // only used to compute metrics or run queries.
+  if (!command_line_options.batch_file_path.empty()) {
+    const CommandLineOptions& o = command_line_options;
+    if (optind != argc || o.batch_output_dir.empty() ||
+        (o.metric_names.empty() && o.query_file_path.empty())) {
+      PERFETTO_ELOG(
+          "--batch requires --batch-output-dir and --run-metrics or "
+          "--query-file, and no trace file");
+      exit(1);
+    }
+    if (explicit_interactive || o.enable_httpd || !o.sqlite_file_path.empty() ||
+        !o.perf_file_path.empty() || !o.metatrace_path.empty() ||
+        !o.snapshot_path.empty()) {
+      PERFETTO_ELOG(
+          "--batch can't be used with -i, -D, -e, -p, -m or --save-snapshot");
+      exit(1);
+    }
+    command_line_options.launch_shell = false;
+    return command_line_options;
+  }
+
   // The only case where we allow omitting the trace file path is when running
   // in --http mode. In all other cases, the last argument must be the trace
   // file.
@@ -865,68 +1093,82 @@ void ExtendPoolWithBinaryDescriptor(google::protobuf::DescriptorPool& pool,
   }
 }
 
-util::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
-  util::Status read_status =
-      ReadTrace(g_tp, trace_file_path.c_str(), [&size_mb](size_t parsed_size) {
-        *size_mb = static_cast<double>(parsed_size) / 1E6;
-        fprintf(stderr, "\rLoading trace: %.2f MB\r", *size_mb);
+util::Status LoadTrace(TraceProcessor* tp,
+                       const std::string& trace_file_path,
+                       bool print_progress,
+                       double* size_mb) {
+  util::Status read_status = ReadTrace(
+      tp, trace_file_path.c_str(), [print_progress, size_mb](size_t size) {
+        *size_mb = static_cast<double>(size) / 1E6;
+        if (print_progress)
+          fprintf(stderr, "\rLoading trace: %.2f MB\r", *size_mb);
       });
   if (!read_status.ok()) {
     return util::ErrStatus("Could not read trace file (path: %s): %s",
                            trace_file_path.c_str(), read_status.c_message());
   }
 
-  std::unique_ptr<profiling::Symbolizer> symbolizer =
-      profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
-                                      getenv("PERFETTO_SYMBOLIZER_MODE"));
+  std::vector<std::unique_ptr<profiling::Symbolizer>> symbolizers =
+      profiling::LocalSymbolizersOrDie(profiling::GetPerfettoBinaryPath(),
+                                       getenv("PERFETTO_SYMBOLIZER_MODE"),
+                                       profiling::GetSymbolizerThreadCount());
 
-  if (symbolizer) {
+  if (!symbolizers.empty()) {
     profiling::SymbolizeDatabase(
-        g_tp, symbolizer.get(), [](const std::string& trace_proto) {
+        tp, symbolizers, [tp](const std::string& trace_proto) {
           std::unique_ptr<uint8_t[]> buf(new uint8_t[trace_proto.size()]);
           memcpy(buf.get(), trace_proto.data(), trace_proto.size());
-          auto status = g_tp->Parse(std::move(buf), trace_proto.size());
+          auto status = tp->Parse(std::move(buf), trace_proto.size());
           if (!status.ok()) {
             PERFETTO_DFATAL_OR_ELOG("Failed to parse: %s",
                                     status.message().c_str());
             return;
           }
         });
-    g_tp->NotifyEndOfFile();
+    tp->NotifyEndOfFile();
   }
 
   auto maybe_map = profiling::GetPerfettoProguardMapPath();
   if (!maybe_map.empty()) {
+    std::set<std::string> classes = profiling::GetJavaClassNames(tp);
     profiling::ReadProguardMapsToDeobfuscationPackets(
-        maybe_map, [](const std::string& trace_proto) {
+        maybe_map,
+        [tp](const std::string& trace_proto) {
           std::unique_ptr<uint8_t[]> buf(new uint8_t[trace_proto.size()]);
           memcpy(buf.get(), trace_proto.data(), trace_proto.size());
-          auto status = g_tp->Parse(std::move(buf), trace_proto.size());
+          auto status = tp->Parse(std::move(buf), trace_proto.size());
           if (!status.ok()) {
             PERFETTO_DFATAL_OR_ELOG("Failed to parse: %s",
                                     status.message().c_str());
             return;
           }
+        },
+        [&classes](const std::string& name) {
+          return classes.count(name) > 0;
         });
   }
   return util::OkStatus();
 }
 
-util::Status RunQueries(const std::string& query_file_path,
-                        bool expect_output) {
-  std::vector<std::string> queries;
+util::Status LoadQueryFile(const std::string& query_file_path,
+                           std::vector<std::string>* queries) {
   base::ScopedFstream file(fopen(query_file_path.c_str(), "r"));
   if (!file) {
     return util::ErrStatus("Could not open query file (path: %s)",
                            query_file_path.c_str());
   }
-  RETURN_IF_ERROR(LoadQueries(file.get(), &queries));
+  return LoadQueries(file.get(), queries);
+}
 
+util::Status RunQueries(TraceProcessor* tp,
+                        const std::vector<std::string>& queries,
+                        bool expect_output,
+                        FILE* output) {
   util::Status status;
   if (expect_output) {
-    status = RunQueriesAndPrintResult(queries, stdout);
+    status = RunQueriesAndPrintResult(tp, queries, output);
   } else {
-    status = RunQueriesWithoutOutput(queries);
+    status = RunQueriesWithoutOutput(tp, queries);
   }
   if (!status.ok()) {
     return util::ErrStatus("Encountered error while running queries: %s",
@@ -935,27 +1177,34 @@ util::Status RunQueries(const std::string& query_file_path,
   return util::OkStatus();
 }
 
-util::Status RunMetrics(const CommandLineOptions& options) {
-  // Descriptor pool used for printing output as textproto.
-  // Building on top of generated pool so default protos in
-  // google.protobuf.descriptor.proto are available.
-  google::protobuf::DescriptorPool pool(
-      google::protobuf::DescriptorPool::generated_pool());
-  ExtendPoolWithBinaryDescriptor(pool, kMetricsDescriptor.data(),
+util::Status RunQueries(const std::string& query_file_path,
+                        bool expect_output) {
+  std::vector<std::string> queries;
+  RETURN_IF_ERROR(LoadQueryFile(query_file_path, &queries));
+  return RunQueries(g_tp, queries, expect_output, stdout);
+}
+
+// Extends |pool| with the descriptors of the builtin metrics. |pool| should
+// be built on top of the generated pool so that the default protos in
+// google.protobuf.descriptor.proto are available.
+void ExtendPoolWithMetricsDescriptors(google::protobuf::DescriptorPool* pool) {
+  ExtendPoolWithBinaryDescriptor(*pool, kMetricsDescriptor.data(),
                                  kMetricsDescriptor.size());
-  ExtendPoolWithBinaryDescriptor(pool, kAllChromeMetricsDescriptor.data(),
+  ExtendPoolWithBinaryDescriptor(*pool, kAllChromeMetricsDescriptor.data(),
                                  kAllChromeMetricsDescriptor.size());
+}
 
-  std::vector<std::string> metrics;
+// Reads the files of the metrics passed to --run-metrics, extending |pool|
+// with their protos.
+util::Status LoadMetrics(const CommandLineOptions& options,
+                         google::protobuf::DescriptorPool* pool,
+                         Metrics* metrics) {
   for (base::StringSplitter ss(options.metric_names, ','); ss.Next();) {
-    metrics.emplace_back(ss.cur_token());
+    metrics->names.emplace_back(ss.cur_token());
   }
 
-  // For all metrics which are files, register them and extend the metrics
-  // proto.
-  for (size_t i = 0; i < metrics.size(); ++i) {
-    const std::string& metric_or_path = metrics[i];
-
+  // For all metrics which are files, read them and extend the metrics proto.
+  for (std::string& metric_or_path : metrics->names) {
     // If there is no extension, we assume it is a builtin metric.
     auto ext_idx = metric_or_path.rfind('.');
     if (ext_idx == std::string::npos)
@@ -963,33 +1212,204 @@ util::Status RunMetrics(const CommandLineOptions& options) {
 
     std::string no_ext_name = metric_or_path.substr(0, ext_idx);
 
-    // The proto must be extended before registering the metric.
-    util::Status status = ExtendMetricsProto(no_ext_name + ".proto", &pool);
+    MetricExtension extension;
+    extension.metric_or_path = metric_or_path;
+    util::Status status = ParseMetricsProto(no_ext_name + ".proto", pool,
+                                            &extension.metric_proto);
     if (!status.ok()) {
       return util::ErrStatus("Unable to extend metrics proto %s: %s",
                              metric_or_path.c_str(), status.c_message());
     }
 
-    status = RegisterMetric(no_ext_name + ".sql");
-    if (!status.ok()) {
-      return util::ErrStatus("Unable to register metric %s: %s",
-                             metric_or_path.c_str(), status.c_message());
-    }
+    std::string sql_path = no_ext_name + ".sql";
+    base::ReadFile(sql_path, &extension.sql);
+    extension.path = "shell/" + BaseName(sql_path);
+    metrics->extensions.emplace_back(std::move(extension));
 
-    metrics[i] = BaseName(no_ext_name);
+    metric_or_path = BaseName(no_ext_name);
   }
 
-  OutputFormat format;
   if (!options.query_file_path.empty()) {
-    format = OutputFormat::kNone;
+    metrics->format = OutputFormat::kNone;
   } else if (options.metric_output == "binary") {
-    format = OutputFormat::kBinaryProto;
+    metrics->format = OutputFormat::kBinaryProto;
   } else if (options.metric_output == "json") {
-    format = OutputFormat::kJson;
+    metrics->format = OutputFormat::kJson;
   } else {
-    format = OutputFormat::kTextProto;
+    metrics->format = OutputFormat::kTextProto;
   }
-  return RunMetrics(std::move(metrics), format, pool);
+  return util::OkStatus();
+}
+
+util::Status RunMetrics(const CommandLineOptions& options) {
+  // Descriptor pool used for printing output as textproto.
+  google::protobuf::DescriptorPool pool(
+      google::protobuf::DescriptorPool::generated_pool());
+  ExtendPoolWithMetricsDescriptors(&pool);
+
+  Metrics metrics;
+  RETURN_IF_ERROR(LoadMetrics(options, &pool, &metrics));
+  RETURN_IF_ERROR(RegisterMetrics(g_tp, metrics));
+  return RunMetrics(g_tp, metrics.names, metrics.format, pool, stdout);
+}
+
+// The inputs shared by all the traces of a --batch, loaded once before the
+// traces are processed.
+struct BatchInputs {
+  Config config;
+  std::vector<std::string> pre_metrics;
+  std::vector<std::string> queries;
+  Metrics metrics;
+  std::unique_ptr<google::protobuf::DescriptorPool> pool;
+};
+
+util::Status LoadBatchFile(const std::string& batch_file_path,
+                           std::vector<std::string>* traces) {
+  std::string contents;
+  if (!base::ReadFile(batch_file_path, &contents)) {
+    return util::ErrStatus("Could not read batch file (path: %s)",
+                           batch_file_path.c_str());
+  }
+  for (base::StringSplitter ss(std::move(contents), '\n'); ss.Next();) {
+    std::string trace = base::TrimLeading(ss.cur_token());
+    while (!trace.empty() && (trace.back() == '\r' || trace.back() == ' '))
+      trace.pop_back();
+    if (!trace.empty() && trace[0] != '#')
+      traces->emplace_back(std::move(trace));
+  }
+  return util::OkStatus();
+}
+
+// Returns the path of the output file of each trace: the base name of the
+// trace in |output_dir|, followed by the index of the trace in the batch if
+// several traces have the same base name.
+std::vector<std::string> GetBatchOutputPaths(
+    const std::vector<std::string>& traces,
+    const std::string& output_dir,
+    const std::string& extension) {
+  std::map<std::string, uint32_t> base_name_count;
+  for (const std::string& trace : traces)
+    base_name_count[BaseName(trace)]++;
+
+  std::vector<std::string> output_paths;
+  for (size_t i = 0; i < traces.size(); ++i) {
+    std::string base_name = BaseName(traces[i]);
+    if (base_name_count[base_name] > 1)
+      base_name += "-" + std::to_string(i + 1);
+    output_paths.emplace_back(output_dir + "/" + base_name + extension);
+  }
+  return output_paths;
+}
+
+util::Status RunBatchTrace(const BatchInputs& inputs,
+                           const std::string& trace_file_path,
+                           const std::string& output_path) {
+  std::unique_ptr<TraceProcessor> tp =
+      TraceProcessor::CreateInstance(inputs.config);
+  double size_mb = 0;
+  RETURN_IF_ERROR(LoadTrace(tp.get(), trace_file_path, false, &size_mb));
+
+  base::ScopedFstream output(fopen(output_path.c_str(), "wb"));
+  if (!output) {
+    return util::ErrStatus("Could not open output file (path: %s)",
+                           output_path.c_str());
+  }
+  if (!inputs.pre_metrics.empty())
+    RETURN_IF_ERROR(RunQueries(tp.get(), inputs.pre_metrics, false, nullptr));
+
+  if (!inputs.metrics.names.empty()) {
+    RETURN_IF_ERROR(RegisterMetrics(tp.get(), inputs.metrics));
+    RETURN_IF_ERROR(RunMetrics(tp.get(), inputs.metrics.names,
+                               inputs.metrics.format, *inputs.pool,
+                               output.get()));
+  }
+
+  if (!inputs.queries.empty())
+    RETURN_IF_ERROR(RunQueries(tp.get(), inputs.queries, true, output.get()));
+  if (fflush(*output) != 0) {
+    return util::ErrStatus("Could not write output file (path: %s)",
+                           output_path.c_str());
+  }
+  return util::OkStatus();
+}
+
+// Processes each trace of --batch in its own TraceProcessor instance, on up
+// to --batch-jobs threads. The query files, metric files and descriptors are
+// only loaded once for the whole batch.
+util::Status RunBatch(const CommandLineOptions& options, const Config& config) {
+  std::vector<std::string> traces;
+  RETURN_IF_ERROR(LoadBatchFile(options.batch_file_path, &traces));
+
+  BatchInputs inputs;
+  inputs.config = config;
+  if (!options.pre_metrics_path.empty()) {
+    RETURN_IF_ERROR(
+        LoadQueryFile(options.pre_metrics_path, &inputs.pre_metrics));
+  }
+  if (!options.query_file_path.empty())
+    RETURN_IF_ERROR(LoadQueryFile(options.query_file_path, &inputs.queries));
+
+  inputs.pool.reset(new google::protobuf::DescriptorPool(
+      google::protobuf::DescriptorPool::generated_pool()));
+  ExtendPoolWithMetricsDescriptors(inputs.pool.get());
+  if (!options.metric_names.empty())
+    RETURN_IF_ERROR(LoadMetrics(options, inputs.pool.get(), &inputs.metrics));
+
+  std::string extension;
+  if (!inputs.queries.empty()) {
+    extension = ".csv";
+  } else if (inputs.metrics.format == OutputFormat::kBinaryProto) {
+    extension = ".pb";
+  } else if (inputs.metrics.format == OutputFormat::kJson) {
+    extension = ".json";
+  } else {
+    extension = ".textproto";
+  }
+
+  if (!base::Mkdir(options.batch_output_dir) && errno != EEXIST) {
+    return util::ErrStatus("Could not create output directory (path: %s)",
+                           options.batch_output_dir.c_str());
+  }
+  std::vector<std::string> output_paths =
+      GetBatchOutputPaths(traces, options.batch_output_dir, extension);
+
+  uint32_t jobs = options.batch_jobs;
+  if (jobs == 0)
+    jobs = std::max(std::thread::hardware_concurrency(), 1u);
+  jobs = std::min(jobs, static_cast<uint32_t>(traces.size()));
+
+  std::atomic<size_t> next_trace{0};
+  std::atomic<size_t> failed_traces{0};
+  auto run_traces = [&] {
+    for (size_t i = next_trace++; i < traces.size(); i = next_trace++) {
+      base::TimeNanos t_start = base::GetWallTimeNs();
+      util::Status status = RunBatchTrace(inputs, traces[i], output_paths[i]);
+      double t_run_s =
+          static_cast<double>((base::GetWallTimeNs() - t_start).count()) / 1E9;
+      if (status.ok()) {
+        PERFETTO_ILOG("[%zu/%zu] %s: done in %.2f s", i + 1, traces.size(),
+                      traces[i].c_str(), t_run_s);
+      } else {
+        failed_traces++;
+        remove(output_paths[i].c_str());
+        PERFETTO_ELOG("[%zu/%zu] %s: %s", i + 1, traces.size(),
+                      traces[i].c_str(), status.c_message());
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < jobs; ++i)
+    threads.emplace_back(run_traces);
+  run_traces();
+  for (std::thread& thread : threads)
+    thread.join();
+
+  if (failed_traces > 0) {
+    return util::ErrStatus("Failed to process %zu of %zu traces",
+                           failed_traces.load(), traces.size());
+  }
+  return util::OkStatus();
 }
 
 void PrintShellUsage() {
@@ -1051,6 +1471,27 @@ util::Status TraceProcessorMain(int argc, char** argv) {
   config.sorting_mode = options.force_full_sort
                             ? SortingMode::kForceFullSort
                             : SortingMode::kDefaultHeuristics;
+  if (options.adaptive_sort && !options.force_full_sort)
+    config.sorting_mode = SortingMode::kAdaptiveWindowedSort;
+  config.sorter_max_buffered_events = options.sort_max_events;
+  config.skipped_importers = base::SplitString(options.skipped_importers, ",");
+  config.ingest_on_separate_thread = options.ingest_on_separate_thread;
+  config.query_max_duration_ms = options.query_max_duration_ms;
+  config.query_max_memory_bytes = options.query_max_memory_mb * 1024 * 1024;
+  config.enable_query_profiling = options.profile_queries;
+  config.enable_importer_profiling = options.profile_importers;
+
+  // The tables created by --pre-metrics and read by --query-file are only
+  // visible to the metrics when they are computed on the main connection.
+  config.metric_threads = options.metric_threads;
+  if (config.metric_threads > 1 && (!options.pre_metrics_path.empty() ||
+                                    !options.query_file_path.empty())) {
+    PERFETTO_ELOG("Ignoring --metric-threads with --pre-metrics/--query-file");
+    config.metric_threads = 0;
+  }
+
+  if (!options.batch_file_path.empty())
+    return RunBatch(options, config);
 
   std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
   g_tp = tp.get();
@@ -1064,7 +1505,8 @@ util::Status TraceProcessorMain(int argc, char** argv) {
   if (!options.trace_file_path.empty()) {
     base::TimeNanos t_load_start = base::GetWallTimeNs();
     double size_mb = 0;
-    RETURN_IF_ERROR(LoadTrace(options.trace_file_path, &size_mb));
+    RETURN_IF_ERROR(
+        LoadTrace(tp.get(), options.trace_file_path, true, &size_mb));
     t_load = base::GetWallTimeNs() - t_load_start;
 
     double t_load_s = static_cast<double>(t_load.count()) / 1E9;
@@ -1072,11 +1514,14 @@ util::Status TraceProcessorMain(int argc, char** argv) {
                   size_mb / t_load_s);
 
     RETURN_IF_ERROR(PrintStats());
+
+    if (!options.snapshot_path.empty())
+      RETURN_IF_ERROR(tp->SaveSnapshot(options.snapshot_path));
   }
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_HTTPD)
   if (options.enable_httpd) {
-    RunHttpRPCServer(std::move(tp), options.port_number);
+    RunHttpRPCServer(std::move(tp), options.port_number, config);
     PERFETTO_FATAL("Should never return");
   }
 #endif
@@ -16,7 +16,9 @@
 
 #include "src/trace_processor/trace_processor_storage_impl.h"
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_utils.h"
 #include "src/trace_processor/forwarding_trace_parser.h"
 #include "src/trace_processor/importers/chrome_track_event.descriptor.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
@@ -30,6 +32,7 @@
 #include "src/trace_processor/importers/default_modules.h"
 #include "src/trace_processor/importers/proto/async_track_set_tracker.h"
 #include "src/trace_processor/importers/proto/heap_profile_tracker.h"
+#include "src/trace_processor/importers/proto/importer_profiler.h"
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/proto/perf_sample_tracker.h"
 #include "src/trace_processor/importers/proto/proto_importer_module.h"
@@ -42,6 +45,15 @@
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// The maximum number of bytes queued for the ingestion thread before Parse()
+// blocks waiting for it to catch up. This stops the caller from buffering the
+// whole trace in memory if it reads faster than the trace can be parsed.
+constexpr size_t kMaxPendingBytes = 128 * 1024 * 1024;
+
+}  // namespace
+
 TraceProcessorStorageImpl::TraceProcessorStorageImpl(const Config& cfg) {
   context_.config = cfg;
 
@@ -59,6 +71,10 @@ TraceProcessorStorageImpl::TraceProcessorStorageImpl(const Config& cfg) {
   context_.global_stack_profile_tracker.reset(new GlobalStackProfileTracker());
   context_.metadata_tracker.reset(new MetadataTracker(&context_));
   context_.global_args_tracker.reset(new GlobalArgsTracker(&context_));
+  if (context_.config.enable_importer_profiling) {
+    context_.importer_profiler.reset(
+        new ImporterProfiler(context_.storage.get()));
+  }
   {
     context_.descriptor_pool_.reset(new DescriptorPool());
     auto status = context_.descriptor_pool_->AddFromFileDescriptorSet(
@@ -80,12 +96,38 @@ TraceProcessorStorageImpl::TraceProcessorStorageImpl(const Config& cfg) {
   RegisterDefaultModules(&context_);
 }
 
-TraceProcessorStorageImpl::~TraceProcessorStorageImpl() {}
+TraceProcessorStorageImpl::TraceProcessorStorageImpl(const Config& cfg,
+                                                     NoStorage) {
+  context_.config = cfg;
+}
+
+TraceProcessorStorageImpl::~TraceProcessorStorageImpl() {
+  StopIngestionThread();
+}
 
 util::Status TraceProcessorStorageImpl::Parse(std::unique_ptr<uint8_t[]> data,
                                               size_t size) {
-  if (size == 0)
+  return ParseOrEnqueueChunk(PendingChunk{std::move(data), nullptr, size});
+}
+
+util::Status TraceProcessorStorageImpl::ParseShared(
+    std::shared_ptr<const uint8_t> data,
+    size_t size) {
+  return ParseOrEnqueueChunk(PendingChunk{nullptr, std::move(data), size});
+}
+
+util::Status TraceProcessorStorageImpl::ParseOrEnqueueChunk(
+    PendingChunk chunk) {
+  if (chunk.size == 0)
     return util::OkStatus();
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (context_.config.ingest_on_separate_thread)
+    return EnqueueChunk(std::move(chunk));
+#endif
+  return ParseChunk(std::move(chunk));
+}
+
+util::Status TraceProcessorStorageImpl::ParseChunk(PendingChunk chunk) {
   if (unrecoverable_parse_error_)
     return util::ErrStatus(
         "Failed unrecoverably while parsing in a previous Parse call");
@@ -94,12 +136,88 @@ util::Status TraceProcessorStorageImpl::Parse(std::unique_ptr<uint8_t[]> data,
 
   auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
       stats::parse_trace_duration_ns);
-  util::Status status = context_.chunk_reader->Parse(std::move(data), size);
+  util::Status status =
+      chunk.shared_data
+          ? context_.chunk_reader->ParseShared(std::move(chunk.shared_data),
+                                               chunk.size)
+          : context_.chunk_reader->Parse(std::move(chunk.data), chunk.size);
   unrecoverable_parse_error_ |= !status.ok();
   return status;
 }
 
+util::Status TraceProcessorStorageImpl::EnqueueChunk(PendingChunk chunk) {
+  std::unique_lock<std::mutex> lock(ingestion_mutex_);
+  if (!ingestion_status_.ok())
+    return ingestion_status_;
+  if (!ingestion_thread_.joinable()) {
+    ingestion_thread_ =
+        std::thread(&TraceProcessorStorageImpl::IngestionThreadMain, this);
+  }
+
+  // Always accept at least one chunk so that chunks bigger than the limit
+  // don't block forever.
+  const size_t size = chunk.size;
+  ingestion_cv_.wait(lock, [this, size] {
+    return pending_bytes_ == 0 || pending_bytes_ + size <= kMaxPendingBytes ||
+           !ingestion_status_.ok();
+  });
+  if (!ingestion_status_.ok())
+    return ingestion_status_;
+
+  pending_bytes_ += size;
+  pending_chunks_.emplace_back(std::move(chunk));
+  ingestion_cv_.notify_all();
+  return util::OkStatus();
+}
+
+void TraceProcessorStorageImpl::IngestionThreadMain() {
+  base::MaybeSetThreadName("tp-ingestion");
+  for (;;) {
+    PendingChunk chunk;
+    {
+      std::unique_lock<std::mutex> lock(ingestion_mutex_);
+      ingestion_cv_.wait(lock, [this] {
+        return !pending_chunks_.empty() || ingestion_stopping_;
+      });
+      if (pending_chunks_.empty())
+        return;
+      chunk = std::move(pending_chunks_.front());
+      pending_chunks_.pop_front();
+    }
+
+    const size_t size = chunk.size;
+    util::Status status = ParseChunk(std::move(chunk));
+
+    std::lock_guard<std::mutex> lock(ingestion_mutex_);
+    pending_bytes_ -= size;
+    if (!status.ok() && ingestion_status_.ok()) {
+      // Drop any chunks queued after the error: they would be rejected by
+      // ParseChunk() anyway.
+      ingestion_status_ = status;
+      pending_chunks_.clear();
+      pending_bytes_ = 0;
+    }
+    ingestion_cv_.notify_all();
+  }
+}
+
+void TraceProcessorStorageImpl::StopIngestionThread() {
+  if (!ingestion_thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(ingestion_mutex_);
+    ingestion_stopping_ = true;
+    ingestion_cv_.notify_all();
+  }
+  // The thread parses all the queued chunks before exiting.
+  ingestion_thread_.join();
+
+  // Allow Parse() to start a new thread if more data is pushed later.
+  ingestion_stopping_ = false;
+}
+
 void TraceProcessorStorageImpl::NotifyEndOfFile() {
+  StopIngestionThread();
   if (unrecoverable_parse_error_ || !context_.chunk_reader)
     return;
 
@@ -17,7 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_TRACE_PROCESSOR_STORAGE_IMPL_H_
 #define SRC_TRACE_PROCESSOR_TRACE_PROCESSOR_STORAGE_IMPL_H_
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
@@ -33,13 +37,51 @@ class TraceProcessorStorageImpl : public TraceProcessorStorage {
   ~TraceProcessorStorageImpl() override;
 
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseShared(std::shared_ptr<const uint8_t>, size_t) override;
   void NotifyEndOfFile() override;
 
   TraceProcessorContext* context() { return &context_; }
 
  protected:
+  // Used by instances which only query the storage of another instance: the
+  // context only holds |config| and this can't parse traces.
+  struct NoStorage {};
+  TraceProcessorStorageImpl(const Config&, NoStorage);
+
   TraceProcessorContext context_;
   bool unrecoverable_parse_error_ = false;
+
+ private:
+  // Only one of |data| and |shared_data| is set, depending on whether the
+  // chunk was passed to Parse() or ParseShared().
+  struct PendingChunk {
+    std::unique_ptr<uint8_t[]> data;
+    std::shared_ptr<const uint8_t> shared_data;
+    size_t size;
+  };
+
+  util::Status ParseOrEnqueueChunk(PendingChunk);
+
+  // Passes a chunk of the trace through the tokenizer, sorter and parser.
+  util::Status ParseChunk(PendingChunk);
+
+  // Used when |Config::ingest_on_separate_thread| is set.
+  util::Status EnqueueChunk(PendingChunk);
+  void IngestionThreadMain();
+  void StopIngestionThread();
+
+  // All the state below is only used when |Config::ingest_on_separate_thread|
+  // is set. |ingestion_thread_| is the only thread which touches |context_|
+  // between the first call to Parse() and the end of NotifyEndOfFile().
+  std::thread ingestion_thread_;
+  std::mutex ingestion_mutex_;
+  std::condition_variable ingestion_cv_;
+
+  // Guarded by |ingestion_mutex_|.
+  std::deque<PendingChunk> pending_chunks_;
+  size_t pending_bytes_ = 0;
+  bool ingestion_stopping_ = false;
+  util::Status ingestion_status_;
 };
 
 }  // namespace trace_processor
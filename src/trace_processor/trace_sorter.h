@@ -17,6 +17,7 @@
 #ifndef SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 #define SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 
+#include <utility>
 #include <vector>
 
 #include "perfetto/ext/base/circular_queue.h"
@@ -71,16 +72,15 @@ class TraceSorter {
                               PacketSequenceState* state,
                               TraceBlobView packet) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
-    auto* queue = GetQueue(0);
-    queue->Append(TimestampedTracePiece(timestamp, packet_idx_++,
-                                        std::move(packet),
-                                        state->current_generation()));
+    auto* queue = AppendToQueue(
+        0, TimestampedTracePiece(timestamp, packet_idx_++, std::move(packet),
+                                 state->current_generation()));
     MaybeExtractEvents(queue);
   }
 
   inline void PushJsonValue(int64_t timestamp, std::string json_value) {
-    auto* queue = GetQueue(0);
-    queue->Append(
+    auto* queue = AppendToQueue(
+        0,
         TimestampedTracePiece(timestamp, packet_idx_++, std::move(json_value)));
     MaybeExtractEvents(queue);
   }
@@ -88,18 +88,17 @@ class TraceSorter {
   inline void PushFuchsiaRecord(int64_t timestamp,
                                 std::unique_ptr<FuchsiaRecord> record) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
-    auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(record)));
+    auto* queue = AppendToQueue(
+        0, TimestampedTracePiece(timestamp, packet_idx_++, std::move(record)));
     MaybeExtractEvents(queue);
   }
 
   inline void PushSystraceLine(std::unique_ptr<SystraceLine> systrace_line) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
-    auto* queue = GetQueue(0);
     int64_t timestamp = systrace_line->ts;
-    queue->Append(TimestampedTracePiece(timestamp, packet_idx_++,
-                                        std::move(systrace_line)));
+    auto* queue = AppendToQueue(
+        0, TimestampedTracePiece(timestamp, packet_idx_++,
+                                 std::move(systrace_line)));
     MaybeExtractEvents(queue);
   }
 
@@ -108,9 +107,10 @@ class TraceSorter {
                               TraceBlobView event,
                               PacketSequenceState* state) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(TimestampedTracePiece(
-        timestamp, packet_idx_++,
-        FtraceEventData{std::move(event), state->current_generation()}));
+    AppendToQueue(cpu + 1, TimestampedTracePiece(
+                               timestamp, packet_idx_++,
+                               FtraceEventData{std::move(event),
+                                               state->current_generation()}));
 
     // The caller must call FinalizeFtraceEventBatch() after having pushed a
     // batch of ftrace events. This is to amortize the overhead of handling
@@ -119,32 +119,30 @@ class TraceSorter {
   }
 
   // As with |PushFtraceEvent|, doesn't immediately sort the affected queues.
-  // TODO(rsavitski): if a trace has a mix of normal & "compact" events (being
-  // pushed through this function), the ftrace batches will no longer be fully
-  // sorted by timestamp. In such situations, we will have to sort at the end of
-  // the batch. We can do better as both sub-sequences are sorted however.
-  // Consider adding extra queues, or pushing them in a merge-sort fashion
-  // instead.
+  // Note: if a trace has a mix of normal & "compact" events (being pushed
+  // through this function), the caller should push them in a merge-sort
+  // fashion (see FtraceTokenizer); otherwise the ftrace batches will no longer
+  // be fully sorted by timestamp and we will have to sort at the end of the
+  // batch.
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
                                     InlineSchedSwitch inline_sched_switch) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_switch));
+    AppendToQueue(cpu + 1, TimestampedTracePiece(timestamp, packet_idx_++,
+                                                 inline_sched_switch));
   }
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
                                     InlineSchedWaking inline_sched_waking) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_waking));
+    AppendToQueue(cpu + 1, TimestampedTracePiece(timestamp, packet_idx_++,
+                                                 inline_sched_waking));
   }
 
   inline void PushTrackEventPacket(int64_t timestamp,
                                    std::unique_ptr<TrackEventData> data) {
-    auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(data)));
+    auto* queue = AppendToQueue(
+        0, TimestampedTracePiece(timestamp, packet_idx_++, std::move(data)));
     MaybeExtractEvents(queue);
   }
 
@@ -158,6 +156,7 @@ class TraceSorter {
   void ExtractEventsForced() {
     SortAndExtractEventsBeyondWindow(/*window_size_ns=*/0);
     queues_.resize(0);
+    num_buffered_events_ = 0;
   }
 
   // Sets the window size to be the size specified (which should be lower than
@@ -165,11 +164,14 @@ class TraceSorter {
   // this window size.
   // It is undefined to call this function with a window size greater than than
   // the current size.
+  // When the adaptive window is enabled, this sets the maximum size of the
+  // window instead.
   void SetWindowSizeNs(int64_t window_size_ns) {
-    PERFETTO_DCHECK(window_size_ns <= window_size_ns_);
+    PERFETTO_DCHECK(window_size_ns <= max_window_size_ns_);
 
     PERFETTO_DLOG("Setting window size to be %" PRId64 " ns", window_size_ns);
-    window_size_ns_ = window_size_ns;
+    max_window_size_ns_ = window_size_ns;
+    window_size_ns_ = std::min(window_size_ns_, window_size_ns);
 
     // Fast path: if, globally, we are within the window size, then just exit.
     if (global_max_ts_ - global_min_ts_ < window_size_ns)
@@ -177,7 +179,29 @@ class TraceSorter {
     SortAndExtractEventsBeyondWindow(window_size_ns_);
   }
 
+  // Makes the sorter shrink the window on its own to match how far behind the
+  // newest event new events arrive (see SortingMode::kAdaptiveWindowedSort).
+  // |storage| is used to record events which arrive too late.
+  void EnableAdaptiveWindow(TraceStorage* storage) {
+    adaptive_window_storage_ = storage;
+  }
+
+  // Makes the sorter parse its oldest events early, ignoring the window, when
+  // more than |max_buffered_events| are buffered (see
+  // Config::sorter_max_buffered_events). |storage| is used to record when this
+  // happens.
+  void EnableEventBudget(size_t max_buffered_events, TraceStorage* storage) {
+    max_buffered_events_ = max_buffered_events;
+    event_budget_storage_ = storage;
+  }
+
+  // Makes the sorter record how many events it buffers and how long
+  // extracting them takes in |storage| (see
+  // Config::enable_importer_profiling).
+  void EnableProfiling(TraceStorage* storage) { profiling_storage_ = storage; }
+
   int64_t max_timestamp() const { return global_max_ts_; }
+  int64_t window_size_ns() const { return window_size_ns_; }
 
  private:
   static constexpr uint32_t kNoBatch = std::numeric_limits<uint32_t>::max();
@@ -187,6 +211,7 @@ class TraceSorter {
       const int64_t timestamp = ttp.timestamp;
       events_.emplace_back(std::move(ttp));
       min_ts_ = std::min(min_ts_, timestamp);
+      min_appended_ts_ = std::min(min_appended_ts_, timestamp);
 
       // Events are often seen in order.
       if (PERFETTO_LIKELY(timestamp >= max_ts_)) {
@@ -217,23 +242,49 @@ class TraceSorter {
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = std::numeric_limits<int64_t>::max();
+
+    // The min timestamp of the events appended since the last call to
+    // MaybeExtractEvents() for this queue. Used by the adaptive window.
+    int64_t min_appended_ts_ = std::numeric_limits<int64_t>::max();
   };
 
   // This method passes any events older than window_size_ns to the
   // parser to be parsed and then stored.
   void SortAndExtractEventsBeyondWindow(int64_t windows_size_ns);
 
+  // Updates |window_size_ns_| based on how late the events just appended to
+  // |queue| are. Must be called before updating the global bounds.
+  void UpdateAdaptiveWindow(Queue* queue);
+
+  // Extracts the oldest events until at most half of |max_buffered_events_|
+  // events are left.
+  void ExtractEventsOverBudget();
+
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
       queues_.resize(index + 1);
     return &queues_[index];
   }
 
+  inline Queue* AppendToQueue(size_t index, TimestampedTracePiece ttp) {
+    Queue* queue = GetQueue(index);
+    queue->Append(std::move(ttp));
+    num_buffered_events_++;
+    return queue;
+  }
+
   inline void MaybeExtractEvents(Queue* queue) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
+    if (PERFETTO_UNLIKELY(adaptive_window_storage_))
+      UpdateAdaptiveWindow(queue);
     global_max_ts_ = std::max(global_max_ts_, queue->max_ts_);
     global_min_ts_ = std::min(global_min_ts_, queue->min_ts_);
 
+    if (PERFETTO_UNLIKELY(max_buffered_events_ &&
+                          num_buffered_events_ > max_buffered_events_)) {
+      ExtractEventsOverBudget();
+    }
+
     // Fast path: if, globally, we are within the window size, then just exit.
     if (global_max_ts_ - global_min_ts_ < window_size_ns_)
       return;
@@ -247,10 +298,40 @@ class TraceSorter {
   // queues_[x] is the ftrace queue for CPU(x - 1).
   std::vector<Queue> queues_;
 
+  // Scratch space used by SortAndExtractEventsBeyondWindow() to hold a
+  // min-heap of (min_ts, index) of the non-empty |queues_|.
+  std::vector<std::pair<int64_t, size_t>> queue_heap_;
+
   // Events are propagated to the next stage only after (max - min) timestamp
   // is larger than this value.
   int64_t window_size_ns_;
 
+  // The window size set by the constructor or SetWindowSizeNs(). Equal to
+  // |window_size_ns_| unless the adaptive window is enabled, in which case
+  // |window_size_ns_| can be smaller.
+  int64_t max_window_size_ns_;
+
+  // Non-null when the adaptive window is enabled.
+  TraceStorage* adaptive_window_storage_ = nullptr;
+
+  // The state of the adaptive window: the earliest event seen, the furthest
+  // behind the newest event seen that an event has arrived and the newest
+  // event parsed so far.
+  int64_t adaptive_first_ts_ = std::numeric_limits<int64_t>::max();
+  int64_t max_lateness_ns_ = 0;
+  int64_t last_extracted_ts_ = std::numeric_limits<int64_t>::min();
+
+  // The number of events in |queues_| and, if non-zero, the maximum number
+  // of them before ExtractEventsOverBudget() kicks in.
+  size_t num_buffered_events_ = 0;
+  size_t max_buffered_events_ = 0;
+  TraceStorage* event_budget_storage_ = nullptr;
+
+  // Non-null when profiling is enabled. |peak_buffered_events_| is the
+  // maximum of |num_buffered_events_| so far.
+  TraceStorage* profiling_storage_ = nullptr;
+  size_t peak_buffered_events_ = 0;
+
   // max(e.timestamp for e in queues_).
   int64_t global_max_ts_ = 0;
 
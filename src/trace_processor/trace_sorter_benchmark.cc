@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/importers/common/trace_parser.h"
+#include "src/trace_processor/trace_sorter.h"
+
+namespace {
+
+using perfetto::trace_processor::InlineSchedSwitch;
+using perfetto::trace_processor::TimestampedTracePiece;
+using perfetto::trace_processor::TraceParser;
+using perfetto::trace_processor::TraceSorter;
+
+// The number of events pushed for each CPU before moving to the next one; this
+// mimics the size of the ftrace bundles in real traces.
+constexpr uint32_t kEventsPerBundle = 64;
+
+// The total number of events sorted in each iteration of the benchmarks.
+constexpr uint32_t kTotalEvents = 1024 * 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void TraceSorterArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(8);
+  } else {
+    b->RangeMultiplier(2)->Range(1, 256);
+  }
+}
+
+class NoopTraceParser : public TraceParser {
+ public:
+  void ParseTracePacket(int64_t, TimestampedTracePiece) override {}
+  void ParseFtracePacket(uint32_t, int64_t, TimestampedTracePiece) override {}
+};
+
+// Pushes |kTotalEvents| events spread over |num_cpus| CPUs. The timestamps of
+// the events of all the CPUs overlap (as they do in real traces) so each
+// extraction from a queue only moves a few events.
+void PushEvents(TraceSorter* sorter,
+                uint32_t num_cpus,
+                const std::vector<int64_t>& jitter) {
+  uint32_t rounds = kTotalEvents / (num_cpus * kEventsPerBundle);
+  uint32_t jitter_idx = 0;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    for (uint32_t cpu = 0; cpu < num_cpus; ++cpu) {
+      for (uint32_t i = 0; i < kEventsPerBundle; ++i) {
+        int64_t idx = static_cast<int64_t>(round * kEventsPerBundle + i);
+        int64_t ts = idx * 1000 + jitter[jitter_idx++ % jitter.size()];
+        sorter->PushInlineFtraceEvent(cpu, ts, InlineSchedSwitch{});
+      }
+      sorter->FinalizeFtraceEventBatch(cpu);
+    }
+  }
+}
+
+std::vector<int64_t> CreateJitter() {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  // Keep the jitter below the spacing between events so that each CPU's
+  // events stay sorted.
+  std::vector<int64_t> jitter(4096);
+  for (int64_t& j : jitter)
+    j = static_cast<int64_t>(rnd_engine() % 1000);
+  return jitter;
+}
+
+}  // namespace
+
+static void BM_TraceSorterWindowed(benchmark::State& state) {
+  uint32_t num_cpus = static_cast<uint32_t>(state.range(0));
+  std::vector<int64_t> jitter = CreateJitter();
+  for (auto _ : state) {
+    TraceSorter sorter(std::unique_ptr<TraceParser>(new NoopTraceParser()),
+                       /*window_size_ns=*/100 * 1000);
+    PushEvents(&sorter, num_cpus, jitter);
+    sorter.ExtractEventsForced();
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kTotalEvents);
+}
+BENCHMARK(BM_TraceSorterWindowed)->Apply(TraceSorterArgs);
+
+static void BM_TraceSorterFullSort(benchmark::State& state) {
+  uint32_t num_cpus = static_cast<uint32_t>(state.range(0));
+  std::vector<int64_t> jitter = CreateJitter();
+  for (auto _ : state) {
+    TraceSorter sorter(std::unique_ptr<TraceParser>(new NoopTraceParser()),
+                       std::numeric_limits<int64_t>::max());
+    PushEvents(&sorter, num_cpus, jitter);
+    sorter.ExtractEventsForced();
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kTotalEvents);
+}
+BENCHMARK(BM_TraceSorterFullSort)->Apply(TraceSorterArgs);
@@ -30,6 +30,8 @@ namespace trace_processor {
 namespace {
 
 using ::testing::_;
+using ::testing::AnyNumber;
+using ::testing::AtLeast;
 using ::testing::InSequence;
 using ::testing::Invoke;
 using ::testing::MockFunction;
@@ -185,6 +187,121 @@ TEST_F(TraceSorterTest, SetWindowSize) {
   context_.sorter->ExtractEventsForced();
 }
 
+TEST_F(TraceSorterTest, AdaptiveWindowShrinks) {
+  PacketSequenceState state(&context_);
+  constexpr int64_t kSecond = 1000ll * 1000 * 1000;
+  MockFunction<void(std::string check_point_name)> check;
+  {
+    InSequence s;
+    EXPECT_CALL(check, Call("warmup"));
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _)).Times(AtLeast(1));
+    EXPECT_CALL(check, Call("done"));
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _)).Times(AtLeast(1));
+  }
+
+  context_.sorter->EnableAdaptiveWindow(storage_);
+
+  // Nothing is parsed before the warmup period ends.
+  for (int64_t i = 0; i < 30; ++i) {
+    context_.sorter->PushTracePacket(i * kSecond, &state,
+                                     test_buffer_.slice(0, 1));
+  }
+  check.Call("warmup");
+
+  // Packets arrive at most 100ms out of order: the window should shrink to
+  // the minimum and the oldest packets should be parsed.
+  for (int64_t i = 30; i < 60; ++i) {
+    context_.sorter->PushTracePacket(i * kSecond, &state,
+                                     test_buffer_.slice(0, 1));
+    context_.sorter->PushTracePacket(i * kSecond - 100 * 1000 * 1000, &state,
+                                     test_buffer_.slice(0, 1));
+  }
+  ASSERT_LT(context_.sorter->window_size_ns(), 10 * kSecond);
+  check.Call("done");
+
+  context_.sorter->ExtractEventsForced();
+}
+
+TEST_F(TraceSorterTest, AdaptiveWindowGrowsOnLateEvents) {
+  PacketSequenceState state(&context_);
+  constexpr int64_t kSecond = 1000ll * 1000 * 1000;
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _)).Times(AnyNumber());
+
+  context_.sorter->EnableAdaptiveWindow(storage_);
+  for (int64_t i = 0; i < 60; ++i) {
+    context_.sorter->PushTracePacket(i * kSecond, &state,
+                                     test_buffer_.slice(0, 1));
+  }
+  int64_t window = context_.sorter->window_size_ns();
+
+  // This packet is older than the packets already parsed.
+  context_.sorter->PushTracePacket(20 * kSecond, &state,
+                                   test_buffer_.slice(0, 1));
+  ASSERT_GT(context_.sorter->window_size_ns(), window);
+  ASSERT_EQ(storage_->stats()[stats::sorter_adaptive_window_misses].value, 1);
+
+  context_.sorter->ExtractEventsForced();
+}
+
+TEST_F(TraceSorterTest, EventBudget) {
+  PacketSequenceState state(&context_);
+  MockFunction<void(std::string check_point_name)> check;
+  {
+    InSequence s;
+    EXPECT_CALL(check, Call("under_budget"));
+    // The oldest events are parsed once over budget, until at most half of
+    // the budget is left.
+    for (int64_t ts = 1; ts <= 6; ++ts)
+      EXPECT_CALL(*parser_, MOCK_ParseTracePacket(ts, _, _));
+    EXPECT_CALL(check, Call("over_budget"));
+    for (int64_t ts = 7; ts <= 11; ++ts)
+      EXPECT_CALL(*parser_, MOCK_ParseTracePacket(ts, _, _));
+  }
+
+  context_.sorter->EnableEventBudget(10, storage_);
+  for (int64_t ts = 10; ts >= 1; --ts) {
+    context_.sorter->PushTracePacket(ts, &state, test_buffer_.slice(0, 1));
+  }
+  check.Call("under_budget");
+  context_.sorter->PushTracePacket(11, &state, test_buffer_.slice(0, 1));
+  check.Call("over_budget");
+  ASSERT_EQ(storage_->stats()[stats::sorter_event_budget_flushes].value, 1);
+
+  context_.sorter->ExtractEventsForced();
+}
+
+TEST_F(TraceSorterTest, Profiling) {
+  PacketSequenceState state(&context_);
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _)).Times(7);
+
+  context_.sorter->EnableProfiling(storage_);
+  for (int64_t ts = 1; ts <= 5; ++ts) {
+    context_.sorter->PushTracePacket(ts, &state, test_buffer_.slice(0, 1));
+  }
+  context_.sorter->ExtractEventsForced();
+  for (int64_t ts = 6; ts <= 7; ++ts) {
+    context_.sorter->PushTracePacket(ts, &state, test_buffer_.slice(0, 1));
+  }
+  context_.sorter->ExtractEventsForced();
+
+  const auto& stats = storage_->stats();
+  ASSERT_EQ(stats[stats::sorter_peak_buffered_events].value, 5);
+
+  // 5 and 2 events were buffered: floor(log2()) is 2 and 1.
+  const auto& by_events =
+      stats[stats::sorter_extractions_by_buffered_events].indexed_values;
+  ASSERT_EQ(by_events.size(), 2u);
+  ASSERT_EQ(by_events.at(1), 1);
+  ASSERT_EQ(by_events.at(2), 1);
+
+  int64_t extractions = 0;
+  for (const auto& bucket :
+       stats[stats::sorter_extractions_by_wall_time_ns].indexed_values) {
+    extractions += bucket.second;
+  }
+  ASSERT_EQ(extractions, 2);
+}
+
 // Simulates a random stream of ftrace events happening on random CPUs.
 // Tests that the output of the TraceSorter matches the timestamp order
 // (% events happening at the same time on different CPUs).
@@ -38,6 +38,7 @@ class GlobalArgsTracker;
 class GlobalStackProfileTracker;
 class HeapGraphTracker;
 class HeapProfileTracker;
+class ImporterProfiler;
 class PerfSampleTracker;
 class MetadataTracker;
 class ProtoImporterModule;
@@ -47,6 +48,7 @@ class FlowTracker;
 class TraceParser;
 class TraceSorter;
 class TraceStorage;
+class TrackEventModule;
 class TrackTracker;
 class JsonTracker;
 class DescriptorPool;
@@ -81,6 +83,9 @@ class TraceProcessorContext {
   std::unique_ptr<GlobalStackProfileTracker> global_stack_profile_tracker;
   std::unique_ptr<MetadataTracker> metadata_tracker;
 
+  // Only set when Config::enable_importer_profiling is true.
+  std::unique_ptr<ImporterProfiler> importer_profiler;
+
   // These fields are stored as pointers to Destructible objects rather than
   // their actual type (a subclass of Destructible), as the concrete subclass
   // type is only available in storage_full target. To access these fields use
@@ -117,7 +122,12 @@ class TraceProcessorContext {
   // TracePacket.
   std::vector<std::vector<ProtoImporterModule*>> modules_by_field;
   std::vector<std::unique_ptr<ProtoImporterModule>> modules;
+  // The TracePacket field ids handled by the modules skipped because of
+  // Config::skipped_importers. Packets with these fields are dropped unless
+  // another module is registered for them.
+  std::vector<uint32_t> skipped_fields;
   FtraceModule* ftrace_module = nullptr;
+  TrackEventModule* track_event_module = nullptr;
 };
 
 }  // namespace trace_processor
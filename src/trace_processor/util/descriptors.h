@@ -94,7 +94,7 @@ class ProtoDescriptor {
     PERFETTO_DCHECK(type_ == Type::kMessage);
     auto it =
         std::find_if(fields_.begin(), fields_.end(),
-                     [name](std::pair<int32_t, const FieldDescriptor&> p) {
+                     [&name](std::pair<int32_t, const FieldDescriptor&> p) {
                        return p.second.name() == name;
                      });
     if (it == fields_.end()) {
@@ -160,6 +160,11 @@ class DescriptorPool {
     return descriptors_;
   }
 
+  // Incremented every time descriptors are added to the pool: pointers to
+  // descriptors and fields obtained before a change of generation must not be
+  // used anymore.
+  uint32_t generation() const { return generation_; }
+
   std::vector<uint8_t> SerializeAsDescriptorSet();
 
  private:
@@ -185,6 +190,7 @@ class DescriptorPool {
 
   std::vector<ProtoDescriptor> descriptors_;
   std::set<std::string> processed_files_;
+  uint32_t generation_ = 0;
 };
 
 }  // namespace trace_processor
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/util/proto_to_args_parser.h"
 
+#include <algorithm>
+
 #include "protos/perfetto/common/descriptor.pbzero.h"
 #include "src/trace_processor/util/descriptors.h"
 #include "src/trace_processor/util/status_macros.h"
@@ -71,24 +73,60 @@ ProtoToArgsParser::ProtoToArgsParser(const DescriptorPool& pool) : pool_(pool) {
   key_prefix_.flat_key.reserve(kDefaultSize);
 }
 
+ProtoToArgsParser::FieldPlan::FieldPlan() = default;
+ProtoToArgsParser::FieldPlan::~FieldPlan() = default;
+
+ProtoToArgsParser::MessagePlan::MessagePlan(const ProtoDescriptor* d)
+    : descriptor(d) {}
+ProtoToArgsParser::MessagePlan::~MessagePlan() = default;
+
 base::Status ProtoToArgsParser::ParseMessage(
     const protozero::ConstBytes& cb,
     const std::string& type,
     const std::vector<uint16_t>* allowed_fields,
     Delegate& delegate) {
-  auto idx = pool_.FindDescriptorIdx(type);
-  if (!idx) {
-    return base::Status("Failed to find proto descriptor");
+  if (plans_generation_ != pool_.generation()) {
+    root_plans_.clear();
+    plans_generation_ = pool_.generation();
+  }
+
+  // Plans depend on the path of the message, so only the ones of top-level
+  // messages can be reused. The others can only come from parsing overrides
+  // calling back into the parser.
+  if (!key_prefix_.flat_key.empty()) {
+    auto idx = pool_.FindDescriptorIdx(type);
+    if (!idx) {
+      return base::Status("Failed to find proto descriptor");
+    }
+    MessagePlan plan(&pool_.descriptors()[*idx]);
+    return ParseMessageWithPlan(cb, &plan, allowed_fields, delegate);
   }
 
-  auto& descriptor = pool_.descriptors()[*idx];
+  auto it = root_plans_.find(type);
+  if (it == root_plans_.end()) {
+    auto idx = pool_.FindDescriptorIdx(type);
+    if (!idx) {
+      return base::Status("Failed to find proto descriptor");
+    }
+    std::unique_ptr<MessagePlan> plan(
+        new MessagePlan(&pool_.descriptors()[*idx]));
+    it = root_plans_.emplace(type, std::move(plan)).first;
+  }
+  return ParseMessageWithPlan(cb, it->second.get(), allowed_fields, delegate);
+}
 
-  std::unordered_map<size_t, int> repeated_field_index;
+base::Status ProtoToArgsParser::ParseMessageWithPlan(
+    const protozero::ConstBytes& cb,
+    MessagePlan* plan,
+    const std::vector<uint16_t>* allowed_fields,
+    Delegate& delegate) {
+  uint32_t parse_id = ++plan->parse_id;
 
   protozero::ProtoDecoder decoder(cb);
   for (protozero::Field f = decoder.ReadField(); f.valid();
        f = decoder.ReadField()) {
-    auto field = descriptor.FindFieldByTag(f.id());
+    FieldPlan* field_plan = GetFieldPlan(plan, f.id());
+    const FieldDescriptor* field = field_plan->descriptor;
     if (!field) {
       // Unknown field, possibly an unknown extension.
       continue;
@@ -105,42 +143,80 @@ base::Status ProtoToArgsParser::ParseMessage(
       // reflected.
       continue;
     }
-    RETURN_IF_ERROR(
-        ParseField(*field, repeated_field_index[f.id()], f, delegate));
+
+    int repeated_field_number = 0;
     if (field->is_repeated()) {
-      repeated_field_index[f.id()]++;
+      if (field_plan->parse_id != parse_id) {
+        field_plan->parse_id = parse_id;
+        field_plan->repeated_field_number = 0;
+      }
+      repeated_field_number = field_plan->repeated_field_number++;
     }
+    RETURN_IF_ERROR(ParseField(field_plan, repeated_field_number, f, delegate));
   }
 
   return base::OkStatus();
 }
 
-base::Status ProtoToArgsParser::ParseField(
-    const FieldDescriptor& field_descriptor,
-    int repeated_field_number,
-    protozero::Field field,
-    Delegate& delegate) {
-  std::string prefix_part = field_descriptor.name();
-  if (field_descriptor.is_repeated()) {
-    std::string number = std::to_string(repeated_field_number);
-    prefix_part.reserve(prefix_part.length() + number.length() + 2);
-    prefix_part.append("[");
-    prefix_part.append(number);
-    prefix_part.append("]");
+ProtoToArgsParser::FieldPlan* ProtoToArgsParser::GetFieldPlan(
+    MessagePlan* plan,
+    uint32_t field_id) {
+  auto it = plan->fields.find(field_id);
+  if (it != plan->fields.end())
+    return &it->second;
+
+  FieldPlan* field_plan = &plan->fields[field_id];
+  const FieldDescriptor* field = plan->descriptor->FindFieldByTag(field_id);
+  field_plan->descriptor = field;
+  if (!field)
+    return field_plan;
+
+  // Overrides are keyed by flat key, which is the same for all the elements
+  // of repeated fields.
+  {
+    ScopedStringAppender scoped_flat_key_prefix(field->name(),
+                                                &key_prefix_.flat_key);
+    auto override_it = overrides_.find(key_prefix_.flat_key);
+    if (override_it != overrides_.end())
+      field_plan->parsing_override = &override_it->second;
+  }
+
+  using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
+  if (field->type() == FieldDescriptorProto::TYPE_MESSAGE ||
+      field->type() == FieldDescriptorProto::TYPE_ENUM) {
+    auto idx = pool_.FindDescriptorIdx(field->resolved_type_name());
+    if (idx)
+      field_plan->type_descriptor = &pool_.descriptors()[*idx];
   }
+  return field_plan;
+}
+
+base::Status ProtoToArgsParser::ParseField(FieldPlan* field_plan,
+                                           int repeated_field_number,
+                                           protozero::Field field,
+                                           Delegate& delegate) {
+  const FieldDescriptor& field_descriptor = *field_plan->descriptor;
 
   // In the args table we build up message1.message2.field1 as the column
   // name. This will append the ".field1" suffix to |key_prefix| and then
   // remove it when it goes out of scope.
-  ScopedStringAppender scoped_prefix(prefix_part, &key_prefix_.key);
+  ScopedStringAppender scoped_prefix(field_descriptor.name(),
+                                     &key_prefix_.key);
+  if (field_descriptor.is_repeated()) {
+    key_prefix_.key.append("[");
+    key_prefix_.key.append(std::to_string(repeated_field_number));
+    key_prefix_.key.append("]");
+  }
   ScopedStringAppender scoped_flat_key_prefix(field_descriptor.name(),
                                               &key_prefix_.flat_key);
 
   // If we have an override parser then use that instead and move onto the
   // next loop.
-  if (base::Optional<base::Status> status =
-          MaybeApplyOverride(field, delegate)) {
-    return *status;
+  if (field_plan->parsing_override) {
+    if (base::Optional<base::Status> status =
+            (*field_plan->parsing_override)(field, delegate)) {
+      return *status;
+    }
   }
 
   // If this is not a message we can just immediately add the column name and
@@ -148,31 +224,33 @@ base::Status ProtoToArgsParser::ParseField(
   // recurse into it.
   if (field_descriptor.type() ==
       protos::pbzero::FieldDescriptorProto::TYPE_MESSAGE) {
-    return ParseMessage(field.as_bytes(), field_descriptor.resolved_type_name(),
-                        nullptr, delegate);
+    if (!field_plan->type_descriptor) {
+      return base::Status("Failed to find proto descriptor");
+    }
+    if (!field_plan->message_plan) {
+      field_plan->message_plan.reset(
+          new MessagePlan(field_plan->type_descriptor));
+    }
+    return ParseMessageWithPlan(field.as_bytes(),
+                                field_plan->message_plan.get(), nullptr,
+                                delegate);
   }
 
-  return ParseSimpleField(field_descriptor, field, delegate);
+  return ParseSimpleField(*field_plan, field, delegate);
 }
 
 void ProtoToArgsParser::AddParsingOverride(std::string field,
                                            ParsingOverride func) {
   overrides_[std::move(field)] = std::move(func);
-}
-
-base::Optional<base::Status> ProtoToArgsParser::MaybeApplyOverride(
-    const protozero::Field& field,
-    Delegate& delegate) {
-  auto it = overrides_.find(key_prefix_.flat_key);
-  if (it == overrides_.end())
-    return base::nullopt;
-  return it->second(field, delegate);
+  // The plans point to the overrides they use.
+  root_plans_.clear();
 }
 
 base::Status ProtoToArgsParser::ParseSimpleField(
-    const FieldDescriptor& descriptor,
+    const FieldPlan& field_plan,
     const protozero::Field& field,
     Delegate& delegate) {
+  const FieldDescriptor& descriptor = *field_plan.descriptor;
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
   switch (descriptor.type()) {
     case FieldDescriptorProto::TYPE_INT32:
@@ -210,15 +288,12 @@ base::Status ProtoToArgsParser::ParseSimpleField(
       delegate.AddString(key_prefix_, field.as_string());
       return base::OkStatus();
     case FieldDescriptorProto::TYPE_ENUM: {
-      auto opt_enum_descriptor_idx =
-          pool_.FindDescriptorIdx(descriptor.resolved_type_name());
-      if (!opt_enum_descriptor_idx) {
+      if (!field_plan.type_descriptor) {
         delegate.AddInteger(key_prefix_, field.as_int32());
         return base::OkStatus();
       }
       auto opt_enum_string =
-          pool_.descriptors()[*opt_enum_descriptor_idx].FindEnumString(
-              field.as_int32());
+          field_plan.type_descriptor->FindEnumString(field.as_int32());
       if (!opt_enum_string) {
         // Fall back to the integer representation of the field.
         delegate.AddInteger(key_prefix_, field.as_int32());
@@ -17,6 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_UTIL_PROTO_TO_ARGS_PARSER_H_
 #define SRC_TRACE_PROCESSOR_UTIL_PROTO_TO_ARGS_PARSER_H_
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "perfetto/base/status.h"
 #include "perfetto/protozero/field.h"
 #include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
@@ -160,21 +165,66 @@ class ProtoToArgsParser {
                             Delegate& delegate);
 
  private:
-  base::Status ParseField(const FieldDescriptor& field_descriptor,
+  // The fields of a message type at a given path (i.e. flat key) in the parsed
+  // proto, resolved the first time they are seen there. This avoids looking
+  // up the descriptors and the parsing overrides again for every message.
+  struct MessagePlan;
+  struct FieldPlan {
+    FieldPlan();
+    ~FieldPlan();
+
+    // Null if the field is not known to the descriptor pool.
+    const FieldDescriptor* descriptor = nullptr;
+    // Null if there is no override installed for the field.
+    const ParsingOverride* parsing_override = nullptr;
+    // The descriptor of the type of enum and message fields; null if the type
+    // is not known to the descriptor pool.
+    const ProtoDescriptor* type_descriptor = nullptr;
+    // Only used for message fields; created when the field is first parsed.
+    std::unique_ptr<MessagePlan> message_plan;
+
+    // The index of the next element of a repeated field, in the message being
+    // parsed if |parse_id| is the one of the MessagePlan.
+    int repeated_field_number = 0;
+    uint32_t parse_id = 0;
+  };
+  struct MessagePlan {
+    explicit MessagePlan(const ProtoDescriptor* descriptor);
+    ~MessagePlan();
+
+    const ProtoDescriptor* descriptor;
+    std::unordered_map<uint32_t, FieldPlan> fields;
+    // Incremented every time a message is parsed with this plan.
+    uint32_t parse_id = 0;
+  };
+
+  base::Status ParseMessageWithPlan(const protozero::ConstBytes& cb,
+                                    MessagePlan* plan,
+                                    const std::vector<uint16_t>* allowed_fields,
+                                    Delegate& delegate);
+
+  // Returns the plan for the field |field_id| of |plan|, resolving it if this
+  // is the first time the field is seen. |key_prefix_| must be the path of
+  // |plan|.
+  FieldPlan* GetFieldPlan(MessagePlan* plan, uint32_t field_id);
+
+  base::Status ParseField(FieldPlan* field_plan,
                           int repeated_field_number,
                           protozero::Field field,
                           Delegate& delegate);
 
-  base::Optional<base::Status> MaybeApplyOverride(const protozero::Field&,
-                                                  Delegate& delegate);
-
-  base::Status ParseSimpleField(const FieldDescriptor& desciptor,
+  base::Status ParseSimpleField(const FieldPlan& field_plan,
                                 const protozero::Field& field,
                                 Delegate& delegate);
 
   std::unordered_map<std::string, ParsingOverride> overrides_;
   const DescriptorPool& pool_;
   Key key_prefix_;
+
+  // The plans of the top-level messages, keyed by type. They are dropped when
+  // the descriptor pool or the parsing overrides change.
+  std::unordered_map<std::string, std::unique_ptr<MessagePlan>> root_plans_;
+  uint32_t plans_generation_ = 0;
 };
 
 }  // namespace util
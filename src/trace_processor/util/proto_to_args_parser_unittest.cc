@@ -208,6 +208,39 @@ TEST_F(ProtoToArgsParserTest, NestedProto) {
                           "super_nested.value_c super_nested.value_c 3"));
 }
 
+TEST_F(ProtoToArgsParserTest, RepeatedProtoParsedTwice) {
+  using namespace protozero::test::protos::pbzero;
+  protozero::HeapBuffered<NestedA> msg{kChunkSize, kChunkSize};
+  msg->add_repeated_a()->set_value_b()->set_value_c(1);
+  msg->add_repeated_a()->set_value_b()->set_value_c(2);
+
+  auto binary_proto = msg.SerializeAsArray();
+
+  DescriptorPool pool;
+  auto status = pool.AddFromFileDescriptorSet(kTestMessagesDescriptor.data(),
+                                              kTestMessagesDescriptor.size());
+  ProtoToArgsParser parser(pool);
+  ASSERT_TRUE(status.ok()) << "Failed to parse kTestMessagesDescriptor: "
+                           << status.message();
+
+  // The indices of repeated fields restart from 0 in every message, even
+  // though the fields are only resolved the first time.
+  for (int i = 0; i < 2; ++i) {
+    status = parser.ParseMessage(
+        protozero::ConstBytes{binary_proto.data(), binary_proto.size()},
+        ".protozero.test.protos.NestedA", nullptr, *this);
+    EXPECT_TRUE(status.ok())
+        << "InternProtoFieldsIntoArgsTable failed with error: "
+        << status.message();
+  }
+  EXPECT_THAT(args(),
+              testing::ElementsAre(
+                  "repeated_a.value_b.value_c repeated_a[0].value_b.value_c 1",
+                  "repeated_a.value_b.value_c repeated_a[1].value_b.value_c 2",
+                  "repeated_a.value_b.value_c repeated_a[0].value_b.value_c 1",
+                  "repeated_a.value_b.value_c repeated_a[1].value_b.value_c 2"));
+}
+
 TEST_F(ProtoToArgsParserTest, CamelCaseFieldsProto) {
   using namespace protozero::test::protos::pbzero;
   protozero::HeapBuffered<CamelCaseFields> msg{kChunkSize, kChunkSize};
@@ -16,6 +16,10 @@
 
 #include "src/traced/probes/android_log/android_log_data_source.h"
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/base/time.h"
@@ -25,6 +29,7 @@
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/unix_socket.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/tracing/core/data_source_config.h"
@@ -42,6 +47,9 @@ using protos::pbzero::AndroidLogConfig;
 using protos::pbzero::AndroidLogId;
 
 constexpr size_t kBufSize = 4096;
+
+// Log entries received by each recvmmsg().
+constexpr size_t kRecvBatchSize = 16;
 const char kLogTagsPath[] = "/system/etc/event-log-tags";
 const char kLogdrSocket[] = "/dev/socket/logdr";
 
@@ -143,7 +151,7 @@ AndroidLogDataSource::AndroidLogDataSource(DataSourceConfig ds_config,
     filter_tags_.emplace(&filter_tags_strbuf_[it.first], it.second);
 
   min_prio_ = cfg.min_prio();
-  buf_ = base::PagedMemory::Allocate(kBufSize);
+  buf_ = base::PagedMemory::Allocate(kBufSize * kRecvBatchSize);
 }
 
 AndroidLogDataSource::~AndroidLogDataSource() {
@@ -220,86 +228,126 @@ void AndroidLogDataSource::OnSocketDataAvailable() {
       delay_ms);
 }
 
+size_t AndroidLogDataSource::ReceiveLogEntries(size_t* entry_sizes) {
+  char* buf = reinterpret_cast<char*>(buf_.Get());
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // logdr is a SOCK_SEQPACKET socket which delivers one entry per message:
+  // receive a batch of them with one syscall.
+  struct iovec iovs[kRecvBatchSize];
+  struct mmsghdr msgs[kRecvBatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < kRecvBatchSize; i++) {
+    iovs[i].iov_base = buf + i * kBufSize;
+    iovs[i].iov_len = kBufSize;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int res = PERFETTO_EINTR(recvmmsg(logdr_sock_.fd(), msgs,
+                                    static_cast<unsigned int>(kRecvBatchSize),
+                                    MSG_DONTWAIT, nullptr));
+  if (res <= 0)
+    return 0;
+  for (int i = 0; i < res; i++)
+    entry_sizes[i] = msgs[i].msg_len;
+  return static_cast<size_t>(res);
+#else
+  ssize_t rsize = logdr_sock_.Receive(buf, kBufSize);
+  if (rsize <= 0)
+    return 0;
+  entry_sizes[0] = static_cast<size_t>(rsize);
+  return 1;
+#endif
+}
+
 void AndroidLogDataSource::ReadLogSocket() {
   TraceWriter::TracePacketHandle packet;
   protos::pbzero::AndroidLogPacket* log_packet = nullptr;
   size_t num_events = 0;
-  bool stop = false;
-  ssize_t rsize;
-  while (!stop && (rsize = logdr_sock_.Receive(buf_.Get(), kBufSize)) > 0) {
-    num_events++;
-    stats_.num_total++;
+  size_t entry_sizes[kRecvBatchSize];
+  size_t num_entries;
+  while ((num_entries = ReceiveLogEntries(entry_sizes)) > 0) {
+    for (size_t i = 0; i < num_entries; i++) {
+      num_events++;
+      stats_.num_total++;
+      char* buf = reinterpret_cast<char*>(buf_.Get()) + i * kBufSize;
+      PERFETTO_DCHECK(reinterpret_cast<uintptr_t>(buf) % 16 == 0);
+      size_t rsize = entry_sizes[i];
+      if (rsize < sizeof(uint16_t) * 2) {
+        stats_.num_failed++;
+        continue;
+      }
+      size_t payload_size = reinterpret_cast<logger_entry_v4*>(buf)->len;
+      size_t hdr_size = reinterpret_cast<logger_entry_v4*>(buf)->hdr_size;
+      if (payload_size + hdr_size > rsize) {
+        PERFETTO_DLOG(
+            "Invalid Android log frame (hdr: %zu, payload: %zu, rsize: %zu)",
+            hdr_size, payload_size, rsize);
+        stats_.num_failed++;
+        continue;
+      }
+      char* const end = buf + hdr_size + payload_size;
+
+      // In older versions of Android the logger_entry struct can contain less
+      // fields. Copy that in a temporary struct, so that unset fields are
+      // always zero-initialized.
+      logger_entry_v4 entry{};
+      memcpy(&entry, buf, std::min(hdr_size, sizeof(entry)));
+      buf += hdr_size;
+
+      if (!packet) {
+        // Lazily add the packet on the first event. This is to avoid creating
+        // empty packets if there are no events in a task.
+        packet = writer_->NewTracePacket();
+        packet->set_timestamp(
+            static_cast<uint64_t>(base::GetBootTimeNs().count()));
+        log_packet = packet->set_android_log();
+      }
+
+      protos::pbzero::AndroidLogPacket::LogEvent* evt = nullptr;
+
+      if (entry.lid == AndroidLogId::LID_EVENTS) {
+        // Entries in the EVENTS buffer are special, they are binary encoded.
+        // See https://developer.android.com/reference/android/util/EventLog.
+        if (!ParseBinaryEvent(buf, end, log_packet, &evt)) {
+          PERFETTO_DLOG("Failed to parse Android log binary event");
+          stats_.num_failed++;
+          continue;
+        }
+      } else {
+        if (!ParseTextEvent(buf, end, log_packet, &evt)) {
+          PERFETTO_DLOG("Failed to parse Android log text event");
+          stats_.num_failed++;
+          continue;
+        }
+      }
+      if (!evt) {
+        // Parsing succeeded but the event was skipped due to filters.
+        stats_.num_skipped++;
+        continue;
+      }
+
+      // Add the common fields to the event.
+      uint64_t ts = entry.sec * 1000000000ULL + entry.nsec;
+      evt->set_timestamp(ts);
+      evt->set_log_id(static_cast<protos::pbzero::AndroidLogId>(entry.lid));
+      evt->set_pid(entry.pid);
+      evt->set_tid(static_cast<int32_t>(entry.tid));
+      evt->set_uid(static_cast<int32_t>(entry.uid));
+    }  // for (entries)
+
     // Don't hold the message loop for too long. If there are so many events
     // in the queue, stop at some point and parse the remaining ones in another
-    // task (posted after this while loop).
+    // task.
     if (num_events > 500) {
-      stop = true;
       auto weak_this = weak_factory_.GetWeakPtr();
       task_runner_->PostTask([weak_this] {
         if (weak_this)
           weak_this->ReadLogSocket();
       });
+      break;
     }
-    char* buf = reinterpret_cast<char*>(buf_.Get());
-    PERFETTO_DCHECK(reinterpret_cast<uintptr_t>(buf) % 16 == 0);
-    size_t payload_size = reinterpret_cast<logger_entry_v4*>(buf)->len;
-    size_t hdr_size = reinterpret_cast<logger_entry_v4*>(buf)->hdr_size;
-    if (payload_size + hdr_size > static_cast<size_t>(rsize)) {
-      PERFETTO_DLOG(
-          "Invalid Android log frame (hdr: %zu, payload: %zu, rsize: %zd)",
-          hdr_size, payload_size, rsize);
-      stats_.num_failed++;
-      continue;
-    }
-    char* const end = buf + hdr_size + payload_size;
-
-    // In older versions of Android the logger_entry struct can contain less
-    // fields. Copy that in a temporary struct, so that unset fields are
-    // always zero-initialized.
-    logger_entry_v4 entry{};
-    memcpy(&entry, buf, std::min(hdr_size, sizeof(entry)));
-    buf += hdr_size;
-
-    if (!packet) {
-      // Lazily add the packet on the first event. This is to avoid creating
-      // empty packets if there are no events in a task.
-      packet = writer_->NewTracePacket();
-      packet->set_timestamp(
-          static_cast<uint64_t>(base::GetBootTimeNs().count()));
-      log_packet = packet->set_android_log();
-    }
-
-    protos::pbzero::AndroidLogPacket::LogEvent* evt = nullptr;
-
-    if (entry.lid == AndroidLogId::LID_EVENTS) {
-      // Entries in the EVENTS buffer are special, they are binary encoded.
-      // See https://developer.android.com/reference/android/util/EventLog.
-      if (!ParseBinaryEvent(buf, end, log_packet, &evt)) {
-        PERFETTO_DLOG("Failed to parse Android log binary event");
-        stats_.num_failed++;
-        continue;
-      }
-    } else {
-      if (!ParseTextEvent(buf, end, log_packet, &evt)) {
-        PERFETTO_DLOG("Failed to parse Android log text event");
-        stats_.num_failed++;
-        continue;
-      }
-    }
-    if (!evt) {
-      // Parsing succeeded but the event was skipped due to filters.
-      stats_.num_skipped++;
-      continue;
-    }
-
-    // Add the common fields to the event.
-    uint64_t ts = entry.sec * 1000000000ULL + entry.nsec;
-    evt->set_timestamp(ts);
-    evt->set_log_id(static_cast<protos::pbzero::AndroidLogId>(entry.lid));
-    evt->set_pid(entry.pid);
-    evt->set_tid(static_cast<int32_t>(entry.tid));
-    evt->set_uid(static_cast<int32_t>(entry.uid));
-  }  // while(logdr_sock_.Receive())
+  }  // while(ReceiveLogEntries())
 
   // Only print the log message if we have seen a bunch of events. This is to
   // avoid that we keep re-triggering the log socket by writing into the log
@@ -384,20 +432,20 @@ bool AndroidLogDataSource::ParseBinaryEvent(
 
   auto* evt = packet->add_events();
   *out_evt = evt;
-  evt->set_tag(fmt->name.c_str());
+  evt->set_tag(fmt->name.data(), fmt->name.size());
   size_t field_num = 0;
   while (buf < end) {
     char type = *(buf++);
     if (field_num >= fmt->fields.size())
       return true;
-    const char* field_name = fmt->fields[field_num].c_str();
+    const std::string& field_name = fmt->fields[field_num];
     switch (type) {
       case EVENT_TYPE_INT: {
         int32_t value;
         if (!ReadAndAdvance(&buf, end, &value))
           return false;
         auto* arg = evt->add_args();
-        arg->set_name(field_name);
+        arg->set_name(field_name.data(), field_name.size());
         arg->set_int_value(value);
         field_num++;
         break;
@@ -407,7 +455,7 @@ bool AndroidLogDataSource::ParseBinaryEvent(
         if (!ReadAndAdvance(&buf, end, &value))
           return false;
         auto* arg = evt->add_args();
-        arg->set_name(field_name);
+        arg->set_name(field_name.data(), field_name.size());
         arg->set_int_value(value);
         field_num++;
         break;
@@ -417,7 +465,7 @@ bool AndroidLogDataSource::ParseBinaryEvent(
         if (!ReadAndAdvance(&buf, end, &value))
           return false;
         auto* arg = evt->add_args();
-        arg->set_name(field_name);
+        arg->set_name(field_name.data(), field_name.size());
         arg->set_float_value(value);
         field_num++;
         break;
@@ -427,7 +475,7 @@ bool AndroidLogDataSource::ParseBinaryEvent(
         if (!ReadAndAdvance(&buf, end, &len) || buf + len > end)
           return false;
         auto* arg = evt->add_args();
-        arg->set_name(field_name);
+        arg->set_name(field_name.data(), field_name.size());
         arg->set_string_value(buf, len);
         buf += len;
         field_num++;
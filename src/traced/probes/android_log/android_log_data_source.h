@@ -88,6 +88,11 @@ class AndroidLogDataSource : public ProbesDataSource {
   void OnSocketDataAvailable();
   void ReadLogSocket();
 
+  // Receives up to kRecvBatchSize log entries, each into its own kBufSize
+  // slot of |buf_|, and stores their sizes into |entry_sizes|. Returns the
+  // number of entries received, 0 if there are none.
+  size_t ReceiveLogEntries(size_t* entry_sizes);
+
   // Parses one line of /system/etc/event-log-tags.
   bool ParseEventLogDefinitionLine(char* line, size_t len);
 
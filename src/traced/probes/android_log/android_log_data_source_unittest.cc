@@ -252,6 +252,29 @@ TEST_F(AndroidLogDataSourceTest, TextEvents) {
   EXPECT_EQ(decoded[2].message(), "Process 11660 exited due to signal (9)");
 }
 
+// More events than received by a single batch.
+TEST_F(AndroidLogDataSourceTest, TextEventsBatched) {
+  DataSourceConfig cfg;
+  CreateInstance(cfg);
+  EXPECT_CALL(*data_source_, ReadEventLogDefinitions()).WillOnce(Return(""));
+  std::vector<std::vector<uint8_t>> events;
+  for (size_t i = 0; i < 20; i++)
+    events.insert(events.end(), kValidTextEvents.begin(),
+                  kValidTextEvents.end());
+  StartAndSimulateLogd(events);
+
+  auto packets = writer_raw_->GetAllTracePackets();
+  ASSERT_TRUE(packets.size() == 2);
+  const auto& decoded = packets[0].android_log().events();
+  ASSERT_EQ(decoded.size(), 60u);
+  for (size_t i = 0; i < decoded.size(); i += 3) {
+    EXPECT_EQ(decoded[i].tag(), "ActivityManager");
+    EXPECT_EQ(decoded[i + 1].tag(), "libprocessgroup");
+    EXPECT_EQ(decoded[i + 2].tag(), "Zygote");
+  }
+  EXPECT_EQ(packets[1].android_log().stats().num_total(), 60u);
+}
+
 TEST_F(AndroidLogDataSourceTest, TextEventsWithTagFiltering) {
   DataSourceConfig cfg;
   AndroidLogConfig acfg;
@@ -21,12 +21,20 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
+
 #include "protos/perfetto/trace/filesystem/inode_file_map.pbzero.h"
 #include "src/traced/probes/filesystem/inode_file_data_source.h"
 
 namespace perfetto {
 namespace {
 
+constexpr uint32_t kMaxScanThreads = 16;
+
+// Entries read per round by the blocking Scan() when using ScanThreads.
+constexpr uint32_t kSyncScanSteps = 4096;
+
 std::string JoinPaths(const std::string& one, const std::string& other) {
   std::string result;
   result.reserve(one.size() + other.size() + 1);
@@ -42,12 +50,19 @@ std::string JoinPaths(const std::string& one, const std::string& other) {
 FileScanner::FileScanner(std::vector<std::string> root_directories,
                          Delegate* delegate,
                          uint32_t scan_interval_ms,
-                         uint32_t scan_steps)
+                         uint32_t scan_steps,
+                         uint32_t num_threads)
     : delegate_(delegate),
       scan_interval_ms_(scan_interval_ms),
       scan_steps_(scan_steps),
       queue_(std::move(root_directories)),
-      weak_factory_(this) {}
+      weak_factory_(this) {
+  num_threads = std::min(num_threads, kMaxScanThreads);
+  if (num_threads > 1) {
+    for (size_t i = 0; i < num_threads; i++)
+      scan_threads_.emplace_back(new ScanThread(i));
+  }
+}
 
 FileScanner::FileScanner(std::vector<std::string> root_directories,
                          Delegate* delegate)
@@ -56,9 +71,18 @@ FileScanner::FileScanner(std::vector<std::string> root_directories,
                   0 /* scan_interval_ms */,
                   0 /* scan_steps */) {}
 
+FileScanner::ScanThread::ScanThread(size_t index)
+    : task_runner(base::ThreadTaskRunner::CreateAndStart(
+          "file_scanner" + std::to_string(index))) {}
+
 void FileScanner::Scan() {
-  while (!Done())
-    Step();
+  while (!Done()) {
+    if (scan_threads_.empty()) {
+      Step();
+    } else {
+      ParallelSteps(kSyncScanSteps);
+    }
+  }
   delegate_->OnInodeScanDone();
 }
 void FileScanner::Scan(base::TaskRunner* task_runner) {
@@ -76,80 +100,153 @@ void FileScanner::Scan(base::TaskRunner* task_runner) {
       scan_interval_ms_);
 }
 
-void FileScanner::NextDirectory() {
-  std::string directory = std::move(queue_.back());
-  queue_.pop_back();
-  current_dir_handle_.reset(opendir(directory.c_str()));
-  if (!current_dir_handle_) {
+void FileScanner::NextDirectory(Walker* walker) {
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (queue_.empty())
+      return;
+    directory = std::move(queue_.back());
+    queue_.pop_back();
+  }
+  walker->dir_handle.reset(opendir(directory.c_str()));
+  if (!walker->dir_handle) {
     PERFETTO_DPLOG("opendir %s", directory.c_str());
-    current_directory_.clear();
+    walker->directory.clear();
     return;
   }
-  current_directory_ = std::move(directory);
+  walker->directory = std::move(directory);
 
   struct stat buf;
-  if (fstat(dirfd(current_dir_handle_.get()), &buf) != 0) {
-    PERFETTO_DPLOG("fstat %s", current_directory_.c_str());
-    current_dir_handle_.reset();
-    current_directory_.clear();
+  if (fstat(dirfd(walker->dir_handle.get()), &buf) != 0) {
+    PERFETTO_DPLOG("fstat %s", walker->directory.c_str());
+    walker->dir_handle.reset();
+    walker->directory.clear();
     return;
   }
 
   if (S_ISLNK(buf.st_mode)) {
-    current_dir_handle_.reset();
-    current_directory_.clear();
+    walker->dir_handle.reset();
+    walker->directory.clear();
     return;
   }
-  current_block_device_id_ = buf.st_dev;
+  walker->block_device_id = buf.st_dev;
 }
 
-void FileScanner::Step() {
-  if (!current_dir_handle_) {
-    if (queue_.empty())
-      return;
-    NextDirectory();
+// Reads one entry of the current directory of |walker|, moving on to the next
+// queued directory first if needed. Returns false if no inode was found.
+bool FileScanner::ReadEntry(Walker* walker, FoundInode* found) {
+  if (!walker->dir_handle) {
+    NextDirectory(walker);
+    if (!walker->dir_handle)
+      return false;
   }
 
-  if (!current_dir_handle_)
-    return;
-
-  struct dirent* entry = readdir(current_dir_handle_.get());
+  struct dirent* entry = readdir(walker->dir_handle.get());
   if (entry == nullptr) {
-    current_dir_handle_.reset();
-    return;
+    walker->dir_handle.reset();
+    return false;
   }
 
   std::string filename = entry->d_name;
   if (filename == "." || filename == "..")
-    return;
-
-  std::string filepath = JoinPaths(current_directory_, filename);
+    return false;
 
-  protos::pbzero::InodeFileMap_Entry_Type type =
-      protos::pbzero::InodeFileMap_Entry_Type_UNKNOWN;
+  found->path = JoinPaths(walker->directory, filename);
+  found->block_device_id = walker->block_device_id;
+  found->inode = entry->d_ino;
+  found->type = protos::pbzero::InodeFileMap_Entry_Type_UNKNOWN;
   // Readdir and stat not guaranteed to have directory info for all systems
   if (entry->d_type == DT_DIR) {
     // Continue iterating through files if current entry is a directory
-    queue_.emplace_back(filepath);
-    type = protos::pbzero::InodeFileMap_Entry_Type_DIRECTORY;
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    queue_.emplace_back(found->path);
+    found->type = protos::pbzero::InodeFileMap_Entry_Type_DIRECTORY;
   } else if (entry->d_type == DT_REG) {
-    type = protos::pbzero::InodeFileMap_Entry_Type_FILE;
+    found->type = protos::pbzero::InodeFileMap_Entry_Type_FILE;
   }
+  return true;
+}
 
-  if (!delegate_->OnInodeFound(current_block_device_id_, entry->d_ino, filepath,
-                               type)) {
+void FileScanner::Step() {
+  FoundInode found;
+  if (!ReadEntry(&walker_, &found))
+    return;
+  if (!delegate_->OnInodeFound(found.block_device_id, found.inode, found.path,
+                               found.type)) {
     queue_.clear();
-    current_dir_handle_.reset();
+    walker_.dir_handle.reset();
   }
 }
 
 void FileScanner::Steps(uint32_t n) {
+  if (!scan_threads_.empty())
+    return ParallelSteps(n);
   for (uint32_t i = 0; i < n && !Done(); ++i)
     Step();
 }
 
+// Splits the |n| steps across the ScanThreads, which read their directories in
+// parallel. The main thread blocks until all the threads are done and then
+// passes the inodes they found to the delegate, in thread order.
+void FileScanner::ParallelSteps(uint32_t n) {
+  const size_t num_threads = scan_threads_.size();
+  const size_t steps_per_thread = (n + num_threads - 1) / num_threads;
+  std::mutex mutex;
+  std::condition_variable threads_done;
+  size_t pending_threads = num_threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    ScanThread* thread = scan_threads_[t].get();
+    thread->task_runner.PostTask([&, thread] {
+      FoundInode found;
+      for (size_t i = 0; i < steps_per_thread; i++) {
+        if (ReadEntry(&thread->walker, &found)) {
+          thread->found.push_back(std::move(found));
+          continue;
+        }
+        // Nothing left to read for now. The directories that the other threads
+        // still queue are picked up by the next round.
+        if (!thread->walker.dir_handle) {
+          std::lock_guard<std::mutex> lock(queue_mutex_);
+          if (queue_.empty())
+            break;
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending_threads == 0)
+        threads_done.notify_one();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    threads_done.wait(lock, [&] { return pending_threads == 0; });
+  }
+
+  bool stopped = false;
+  for (std::unique_ptr<ScanThread>& thread : scan_threads_) {
+    for (FoundInode& found : thread->found) {
+      if (stopped)
+        break;
+      stopped = !delegate_->OnInodeFound(found.block_device_id, found.inode,
+                                         found.path, found.type);
+    }
+    thread->found.clear();
+  }
+  if (!stopped)
+    return;
+  queue_.clear();
+  for (std::unique_ptr<ScanThread>& thread : scan_threads_)
+    thread->walker.dir_handle.reset();
+}
+
 bool FileScanner::Done() {
-  return !current_dir_handle_ && queue_.empty();
+  if (walker_.dir_handle || !queue_.empty())
+    return false;
+  for (const std::unique_ptr<ScanThread>& thread : scan_threads_) {
+    if (thread->walker.dir_handle)
+      return false;
+  }
+  return true;
 }
 
 FileScanner::Delegate::~Delegate() = default;
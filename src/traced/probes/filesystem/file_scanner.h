@@ -17,11 +17,14 @@
 #ifndef SRC_TRACED_PROBES_FILESYSTEM_FILE_SCANNER_H_
 #define SRC_TRACED_PROBES_FILESYSTEM_FILE_SCANNER_H_
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/traced/data_source_types.h"
 
@@ -42,7 +45,8 @@ class FileScanner {
   FileScanner(std::vector<std::string> root_directories,
               Delegate* delegate,
               uint32_t scan_interval_ms,
-              uint32_t scan_steps);
+              uint32_t scan_steps,
+              uint32_t num_threads = 1);
 
   // Ctor when only the blocking version of Scan is used.
   FileScanner(std::vector<std::string> root_directories, Delegate* delegate);
@@ -54,19 +58,47 @@ class FileScanner {
   void Scan();
 
  private:
-  void NextDirectory();
+  struct FoundInode {
+    BlockDeviceID block_device_id;
+    Inode inode;
+    std::string path;
+    InodeFileMap_Entry_Type type;
+  };
+
+  // The directory being read by the main thread or by one of the ScanThreads.
+  struct Walker {
+    base::ScopedDir dir_handle;
+    std::string directory;
+    BlockDeviceID block_device_id = 0;
+  };
+
+  // A worker thread which reads the directories popped from the shared
+  // |queue_|, with num_threads > 1. The inodes it finds are buffered in
+  // |found| and passed to the delegate on the main thread.
+  struct ScanThread {
+    explicit ScanThread(size_t index);
+    Walker walker;
+    std::vector<FoundInode> found;
+    base::ThreadTaskRunner task_runner;  // Keep last.
+  };
+
+  void NextDirectory(Walker*);
+  bool ReadEntry(Walker*, FoundInode*);
   void Step();
   void Steps(uint32_t n);
+  void ParallelSteps(uint32_t n);
   bool Done();
 
   Delegate* delegate_;
   const uint32_t scan_interval_ms_;
   const uint32_t scan_steps_;
 
+  // Shared by the ScanThreads, if any.
+  std::mutex queue_mutex_;
   std::vector<std::string> queue_;
-  base::ScopedDir current_dir_handle_;
-  std::string current_directory_;
-  BlockDeviceID current_block_device_id_;
+
+  Walker walker_;
+  std::vector<std::unique_ptr<ScanThread>> scan_threads_;  // Can be empty.
   base::WeakPtrFactory<FileScanner> weak_factory_;  // Keep last.
 };
 
@@ -197,5 +197,39 @@ TEST(FileScannerTest, TestAsynchronousFindFiles) {
               protos::pbzero::InodeFileMap_Entry_Type_DIRECTORY))));
 }
 
+TEST(FileScannerTest, TestParallelFindFiles) {
+  base::TestTaskRunner task_runner;
+  std::vector<FileEntry> file_entries;
+  TestDelegate delegate(
+      [&file_entries](BlockDeviceID block_device_id, Inode inode,
+                      const std::string& path, InodeFileMap_Entry_Type type) {
+        file_entries.emplace_back(block_device_id, inode, path, type);
+        return true;
+      },
+      task_runner.CreateCheckpoint("done"));
+
+  FileScanner fs(
+      {base::GetTestDataPath("src/traced/probes/filesystem/testdata")},
+      &delegate, 1, 1, 2 /* num_threads */);
+  fs.Scan(&task_runner);
+
+  task_runner.RunUntilCheckpoint("done");
+
+  EXPECT_THAT(
+      file_entries,
+      UnorderedElementsAre(
+          Eq(StatFileEntry(
+              base::GetTestDataPath(
+                  "src/traced/probes/filesystem/testdata/dir1/file1"),
+              protos::pbzero::InodeFileMap_Entry_Type_FILE)),
+          Eq(StatFileEntry(base::GetTestDataPath(
+                               "src/traced/probes/filesystem/testdata/file2"),
+                           protos::pbzero::InodeFileMap_Entry_Type_FILE)),
+          Eq(StatFileEntry(
+              base::GetTestDataPath(
+                  "src/traced/probes/filesystem/testdata/dir1"),
+              protos::pbzero::InodeFileMap_Entry_Type_DIRECTORY))));
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/traced/probes/filesystem/inode_cache_file.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "protos/perfetto/trace/filesystem/inode_file_map.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+// The files are a sequence of NUL-terminated fields: the magic, the root
+// directory (empty for the LRUInodeCache), and then one record per directory
+// ("d", block device, inode, mtime, path) or per inode path ("i", block device,
+// inode, type, path).
+constexpr char kMagic[] = "perfetto_inode_cache_v1";
+constexpr char kDirectoryRecord[] = "d";
+constexpr char kInodeRecord[] = "i";
+
+uint64_t MtimeNs(const struct stat& buf) {
+  return static_cast<uint64_t>(buf.st_mtim.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t>(buf.st_mtim.tv_nsec);
+}
+
+void AppendField(std::string* out, const std::string& field) {
+  out->append(field);
+  out->push_back('\0');
+}
+
+void AppendField(std::string* out, uint64_t field) {
+  AppendField(out, std::to_string(field));
+}
+
+void AppendInodeRecord(std::string* out,
+                       BlockDeviceID block_device_id,
+                       Inode inode,
+                       const InodeMapValue& value) {
+  for (const std::string& path : value.paths()) {
+    AppendField(out, kInodeRecord);
+    AppendField(out, static_cast<uint64_t>(block_device_id));
+    AppendField(out, static_cast<uint64_t>(inode));
+    AppendField(out, static_cast<uint64_t>(value.type()));
+    AppendField(out, path);
+  }
+}
+
+// Writes into a temporary file first, so that a crash can't leave behind a
+// truncated file.
+bool WriteFileAtomically(const std::string& path, const std::string& data) {
+  std::string tmp_path = path + ".tmp";
+  base::ScopedFile fd =
+      base::OpenFile(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (!fd) {
+    PERFETTO_DPLOG("open %s", tmp_path.c_str());
+    return false;
+  }
+  if (base::WriteAll(*fd, data.data(), data.size()) !=
+          static_cast<ssize_t>(data.size()) ||
+      !base::FlushFile(*fd)) {
+    PERFETTO_DPLOG("write %s", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  fd.reset();
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    PERFETTO_DPLOG("rename %s", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+class FieldReader {
+ public:
+  explicit FieldReader(const std::string& data) : data_(data) {}
+
+  // Returns the next field, or nullptr at the end of the data.
+  const char* Next() {
+    if (pos_ >= data_.size())
+      return nullptr;
+    size_t end = data_.find('\0', pos_);
+    if (end == std::string::npos)
+      return nullptr;
+    const char* field = data_.c_str() + pos_;
+    pos_ = end + 1;
+    return field;
+  }
+
+  bool NextUInt64(uint64_t* out) {
+    const char* field = Next();
+    if (!field)
+      return false;
+    base::Optional<uint64_t> value = base::CStringToUInt64(field);
+    if (!value)
+      return false;
+    *out = *value;
+    return true;
+  }
+
+  bool Done() const { return pos_ >= data_.size(); }
+
+ private:
+  const std::string& data_;
+  size_t pos_ = 0;
+};
+
+struct Record {
+  bool is_directory;
+  uint64_t block_device_id;
+  uint64_t inode;
+  uint64_t mtime_or_type;
+  std::string path;
+};
+
+bool ReadRecord(FieldReader* reader, Record* record) {
+  const char* kind = reader->Next();
+  if (!kind)
+    return false;
+  record->is_directory = strcmp(kind, kDirectoryRecord) == 0;
+  if (!record->is_directory && strcmp(kind, kInodeRecord) != 0)
+    return false;
+  if (!reader->NextUInt64(&record->block_device_id) ||
+      !reader->NextUInt64(&record->inode) ||
+      !reader->NextUInt64(&record->mtime_or_type)) {
+    return false;
+  }
+  const char* path = reader->Next();
+  if (!path)
+    return false;
+  record->path = path;
+  return true;
+}
+
+// Reads the file at |path| and checks its header. On success, |reader| points
+// to the first record.
+bool OpenCacheFile(const std::string& path,
+                   const std::string& root_directory,
+                   std::string* data,
+                   std::unique_ptr<FieldReader>* reader) {
+  if (!base::ReadFile(path, data))
+    return false;
+  reader->reset(new FieldReader(*data));
+  const char* magic = (*reader)->Next();
+  const char* root = (*reader)->Next();
+  if (!magic || strcmp(magic, kMagic) != 0 || !root || root_directory != root) {
+    PERFETTO_DLOG("Ignoring the inode cache %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool SaveStaticInodeMapFile(
+    const std::string& path,
+    const std::string& root_directory,
+    const std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>&
+        static_file_map) {
+  std::string data;
+  AppendField(&data, kMagic);
+  AppendField(&data, root_directory);
+
+  std::vector<std::string> directories;
+  directories.push_back(root_directory);
+  for (const auto& device_and_inodes : static_file_map) {
+    for (const auto& inode_and_value : device_and_inodes.second) {
+      const InodeMapValue& value = inode_and_value.second;
+      AppendInodeRecord(&data, device_and_inodes.first, inode_and_value.first,
+                        value);
+      if (value.type() == protos::pbzero::InodeFileMap_Entry_Type_DIRECTORY)
+        directories.insert(directories.end(), value.paths().begin(),
+                           value.paths().end());
+    }
+  }
+
+  for (const std::string& directory : directories) {
+    struct stat buf;
+    if (lstat(directory.c_str(), &buf) != 0) {
+      PERFETTO_DPLOG("lstat %s", directory.c_str());
+      return false;
+    }
+    AppendField(&data, kDirectoryRecord);
+    AppendField(&data, static_cast<uint64_t>(buf.st_dev));
+    AppendField(&data, static_cast<uint64_t>(buf.st_ino));
+    AppendField(&data, MtimeNs(buf));
+    AppendField(&data, directory);
+  }
+  return WriteFileAtomically(path, data);
+}
+
+bool LoadStaticInodeMapFile(
+    const std::string& path,
+    const std::string& root_directory,
+    std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>*
+        static_file_map) {
+  std::string data;
+  std::unique_ptr<FieldReader> reader;
+  if (!OpenCacheFile(path, root_directory, &data, &reader))
+    return false;
+
+  bool valid = true;
+  while (valid && !reader->Done()) {
+    Record record;
+    if (!ReadRecord(reader.get(), &record)) {
+      valid = false;
+      break;
+    }
+    if (record.is_directory) {
+      struct stat buf;
+      valid = lstat(record.path.c_str(), &buf) == 0 &&
+              static_cast<uint64_t>(buf.st_dev) == record.block_device_id &&
+              static_cast<uint64_t>(buf.st_ino) == record.inode &&
+              MtimeNs(buf) == record.mtime_or_type;
+      continue;
+    }
+    InodeMapValue& value =
+        (*static_file_map)[static_cast<BlockDeviceID>(record.block_device_id)]
+                          [static_cast<Inode>(record.inode)];
+    value.SetType(static_cast<InodeFileMap_Entry_Type>(record.mtime_or_type));
+    value.AddPath(std::move(record.path));
+  }
+
+  if (!valid) {
+    PERFETTO_DLOG("The inode cache %s is stale", path.c_str());
+    static_file_map->clear();
+    return false;
+  }
+  return true;
+}
+
+bool SaveLRUInodeCacheFile(const std::string& path,
+                           const LRUInodeCache& cache) {
+  std::string data;
+  AppendField(&data, kMagic);
+  AppendField(&data, "");
+  cache.ForEachFromOldest(
+      [&data](const LRUInodeCache::InodeKey& key, const InodeMapValue& value) {
+        AppendInodeRecord(&data, key.first, key.second, value);
+      });
+  return WriteFileAtomically(path, data);
+}
+
+bool LoadLRUInodeCacheFile(const std::string& path, LRUInodeCache* cache) {
+  std::string data;
+  std::unique_ptr<FieldReader> reader;
+  if (!OpenCacheFile(path, "", &data, &reader))
+    return false;
+
+  // The paths of an inode are consecutive records, from the least recently
+  // used inode to the most recently used one.
+  std::vector<std::pair<LRUInodeCache::InodeKey, InodeMapValue>> entries;
+  while (!reader->Done()) {
+    Record record;
+    if (!ReadRecord(reader.get(), &record) || record.is_directory)
+      return false;
+    struct stat buf;
+    if (lstat(record.path.c_str(), &buf) != 0 ||
+        static_cast<uint64_t>(buf.st_dev) != record.block_device_id ||
+        static_cast<uint64_t>(buf.st_ino) != record.inode) {
+      continue;
+    }
+    LRUInodeCache::InodeKey key(static_cast<BlockDeviceID>(buf.st_dev),
+                                static_cast<Inode>(buf.st_ino));
+    if (entries.empty() || entries.back().first != key) {
+      entries.emplace_back(
+          key, InodeMapValue(
+                   static_cast<InodeFileMap_Entry_Type>(record.mtime_or_type),
+                   {}));
+    }
+    entries.back().second.AddPath(std::move(record.path));
+  }
+  for (auto& entry : entries)
+    cache->Insert(entry.first, std::move(entry.second));
+  return true;
+}
+
+}  // namespace perfetto
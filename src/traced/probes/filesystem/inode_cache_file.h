@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACED_PROBES_FILESYSTEM_INODE_CACHE_FILE_H_
+#define SRC_TRACED_PROBES_FILESYSTEM_INODE_CACHE_FILE_H_
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "perfetto/ext/traced/data_source_types.h"
+#include "src/traced/probes/filesystem/lru_inode_cache.h"
+
+namespace perfetto {
+
+// Persists the inode to path mappings of traced_probes across its restarts,
+// so that the first sessions after a restart don't need to rescan them.
+//
+// The static map of |root_directory| is saved with the block device, inode
+// and mtime of each of its directories. It is loaded only if none of them
+// changed, i.e. the same filesystem is mounted and no file was added, removed
+// or renamed under |root_directory| since.
+//
+// The entries of the LRUInodeCache are revalidated one by one on load: the
+// paths which don't lstat() to the same block device and inode are dropped.
+
+bool SaveStaticInodeMapFile(
+    const std::string& path,
+    const std::string& root_directory,
+    const std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>&
+        static_file_map);
+
+// Returns false, leaving |static_file_map| empty, if the file can't be read or
+// any of the directories of |root_directory| changed.
+bool LoadStaticInodeMapFile(
+    const std::string& path,
+    const std::string& root_directory,
+    std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>*
+        static_file_map);
+
+bool SaveLRUInodeCacheFile(const std::string& path, const LRUInodeCache&);
+bool LoadLRUInodeCacheFile(const std::string& path, LRUInodeCache*);
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FILESYSTEM_INODE_CACHE_FILE_H_
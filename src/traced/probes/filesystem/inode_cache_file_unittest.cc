@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/traced/probes/filesystem/inode_cache_file.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/traced/probes/filesystem/inode_file_data_source.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/filesystem/inode_file_map.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::Eq;
+using ::testing::IsNull;
+using ::testing::Pointee;
+
+using StaticFileMap =
+    std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>;
+
+class InodeCacheFileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = tmp_.path() + "/root";
+    dir_ = root_ + "/dir1";
+    file_ = dir_ + "/file1";
+    cache_file_ = tmp_.path() + "/cache";
+    ASSERT_TRUE(base::Mkdir(root_));
+    ASSERT_TRUE(base::Mkdir(dir_));
+    ASSERT_TRUE(base::OpenFile(file_, O_WRONLY | O_CREAT, 0600));
+  }
+
+  void TearDown() override {
+    unlink(cache_file_.c_str());
+    unlink(file_.c_str());
+    base::Rmdir(dir_);
+    base::Rmdir(root_);
+  }
+
+  base::TempDir tmp_ = base::TempDir::Create();
+  std::string root_;
+  std::string dir_;
+  std::string file_;
+  std::string cache_file_;
+};
+
+TEST_F(InodeCacheFileTest, StaticMap) {
+  StaticFileMap scanned;
+  CreateStaticDeviceToInodeMap(root_, &scanned);
+  ASSERT_TRUE(SaveStaticInodeMapFile(cache_file_, root_, scanned));
+
+  StaticFileMap loaded;
+  ASSERT_TRUE(LoadStaticInodeMapFile(cache_file_, root_, &loaded));
+  EXPECT_EQ(loaded, scanned);
+
+  // A cache of another root is ignored.
+  StaticFileMap other_root;
+  EXPECT_FALSE(LoadStaticInodeMapFile(cache_file_, dir_, &other_root));
+  EXPECT_TRUE(other_root.empty());
+}
+
+TEST_F(InodeCacheFileTest, StaticMapStale) {
+  StaticFileMap scanned;
+  CreateStaticDeviceToInodeMap(root_, &scanned);
+  ASSERT_TRUE(SaveStaticInodeMapFile(cache_file_, root_, scanned));
+
+  // Sets an mtime which can't be the one of the scan.
+  struct timespec times[2] = {{1, 0}, {1, 0}};
+  ASSERT_EQ(utimensat(AT_FDCWD, dir_.c_str(), times, 0), 0);
+
+  StaticFileMap loaded;
+  EXPECT_FALSE(LoadStaticInodeMapFile(cache_file_, root_, &loaded));
+  EXPECT_TRUE(loaded.empty());
+}
+
+TEST_F(InodeCacheFileTest, LRUInodeCache) {
+  struct stat buf;
+  ASSERT_EQ(lstat(file_.c_str(), &buf), 0);
+  LRUInodeCache::InodeKey key(buf.st_dev, buf.st_ino);
+  LRUInodeCache::InodeKey stale_key(buf.st_dev, buf.st_ino + 1);
+  InodeMapValue value(protos::pbzero::InodeFileMap_Entry_Type_FILE,
+                      std::set<std::string>{file_});
+
+  LRUInodeCache cache(10);
+  cache.Insert(key, value);
+  cache.Insert(stale_key, value);
+  ASSERT_TRUE(SaveLRUInodeCacheFile(cache_file_, cache));
+
+  LRUInodeCache loaded(10);
+  ASSERT_TRUE(LoadLRUInodeCacheFile(cache_file_, &loaded));
+  EXPECT_THAT(loaded.Get(key), Pointee(Eq(value)));
+  EXPECT_THAT(loaded.Get(stale_key), IsNull());
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -134,6 +134,7 @@ InodeFileDataSource::InodeFileDataSource(
   scan_interval_ms_ = OrDefault(cfg.scan_interval_ms(), kScanIntervalMs);
   scan_delay_ms_ = OrDefault(cfg.scan_delay_ms(), kScanDelayMs);
   scan_batch_size_ = OrDefault(cfg.scan_batch_size(), kScanBatchSize);
+  scan_threads_ = cfg.scan_threads();
   do_not_scan_ = cfg.do_not_scan();
 }
 
@@ -395,7 +396,8 @@ void InodeFileDataSource::FindMissingInodes() {
   auto weak_this = GetWeakPtr();
   PERFETTO_DLOG("Starting scan of %s", DbgFmt(roots).c_str());
   file_scanner_ = std::unique_ptr<FileScanner>(new FileScanner(
-      std::move(roots), this, scan_interval_ms_, scan_batch_size_));
+      std::move(roots), this, scan_interval_ms_, scan_batch_size_,
+      scan_threads_));
 
   file_scanner_->Scan(task_runner_);
 }
@@ -127,6 +127,7 @@ class InodeFileDataSource : public ProbesDataSource,
   uint32_t scan_interval_ms_ = 0;
   uint32_t scan_delay_ms_ = 0;
   uint32_t scan_batch_size_ = 0;
+  uint32_t scan_threads_ = 0;
   std::unique_ptr<FileScanner> file_scanner_;
   base::WeakPtrFactory<InodeFileDataSource> weak_factory_;  // Keep last.
 };
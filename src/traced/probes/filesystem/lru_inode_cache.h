@@ -38,6 +38,13 @@ class LRUInodeCache {
   InodeMapValue* Get(const InodeKey& k);
   void Insert(InodeKey k, InodeMapValue v);
 
+  // Calls |fn(key, value)| for each entry, from the least recently used one.
+  template <typename F>
+  void ForEachFromOldest(F fn) const {
+    for (auto it = list_.rbegin(); it != list_.rend(); ++it)
+      fn(it->first, it->second);
+  }
+
  private:
   using ItemType = std::pair<const InodeKey, InodeMapValue>;
   using ListIteratorType = std::list<ItemType>::iterator;
@@ -15,14 +15,21 @@
  */
 
 #include "src/traced/probes/filesystem/range_tree.h"
+
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 
 namespace perfetto {
 
 const std::set<std::string> RangeTree::Get(Inode inode) {
   std::set<std::string> ret;
-  auto lower = map_.upper_bound(inode);
-  if (lower != map_.begin())
+  auto lower = std::upper_bound(
+      ranges_.begin(), ranges_.end(), inode,
+      [](Inode value, const Range& range) { return value < range.first; });
+  if (ranges_.empty())
+    return ret;
+  if (lower != ranges_.begin())
     lower--;
   for (const DataType& x : lower->second)
     ret.emplace(x->ToString());
@@ -30,15 +37,14 @@ const std::set<std::string> RangeTree::Get(Inode inode) {
 }
 
 void RangeTree::Insert(Inode inode, RangeTree::DataType value) {
-  auto lower = map_.rbegin();
-  if (!map_.empty()) {
-    PERFETTO_DCHECK(inode > lower->first);
-  }
-
-  if (map_.empty() || !lower->second.Add(value)) {
-    auto success = map_[inode].Add(value);
-    PERFETTO_DCHECK(success);
+  if (!ranges_.empty()) {
+    PERFETTO_DCHECK(inode > ranges_.back().first);
+    if (ranges_.back().second.Add(value))
+      return;
   }
+  ranges_.emplace_back(inode, SmallSet<DataType, kSetSize>());
+  auto success = ranges_.back().second.Add(value);
+  PERFETTO_DCHECK(success);
 }
 
 }  // namespace perfetto
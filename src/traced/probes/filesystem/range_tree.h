@@ -14,9 +14,10 @@
  * limitations under the License.
  */
 
-#include <map>
 #include <set>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 #include <stdio.h>
 
@@ -49,6 +50,11 @@ constexpr size_t kSetSize = 3;
 // This comes from the observation that close-by inode numbers tend to be
 // in the same directory. We are storing multiple values to be able to
 // aggregate to larger ranges and reduce memory usage.
+//
+// As the inodes are inserted in increasing order, the ranges are kept in a
+// vector sorted by their start rather than in a map: this saves the per-node
+// allocation and pointers of the map, more than halving the memory used per
+// range on large filesystems.
 class RangeTree {
  public:
   using DataType = PrefixFinder::Node*;
@@ -57,7 +63,9 @@ class RangeTree {
   void Insert(Inode inode, DataType value);
 
  private:
-  std::map<Inode, SmallSet<DataType, kSetSize>> map_;
+  using Range = std::pair<Inode, SmallSet<DataType, kSetSize>>;
+
+  std::vector<Range> ranges_;
 };
 
 }  // namespace perfetto
@@ -75,5 +75,10 @@ TEST(RangeTreeTest, Basic) {
   EXPECT_THAT(t.Get(27), Not(Contains("/c")));
 }
 
+TEST(RangeTreeTest, Empty) {
+  RangeTree t;
+  EXPECT_TRUE(t.Get(1).empty());
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -17,18 +17,56 @@
 #include "src/traced/probes/ftrace/compact_sched.h"
 
 #include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include "perfetto/ext/base/optional.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "protos/perfetto/config/ftrace/ftrace_config.gen.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
 #include "protos/perfetto/trace/ftrace/sched.pbzero.h"
 #include "src/traced/probes/ftrace/event_info_constants.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
 
 namespace perfetto {
 
 namespace {
 
+// The events of FtraceConfig.compact_events: the ones which are frequent
+// enough for the columns to be smaller than the FtraceEvent protos.
+constexpr const char* kCompactEvents[][2] = {
+    {"power", "cpu_frequency"},
+    {"power", "cpu_idle"},
+    {"irq", "irq_handler_entry"},
+    {"irq", "irq_handler_exit"},
+    {"irq", "softirq_entry"},
+    {"irq", "softirq_exit"},
+    {"irq", "softirq_raise"},
+    {"ipi", "ipi_entry"},
+    {"ipi", "ipi_exit"},
+    {"ipi", "ipi_raise"},
+    {"ion", "ion_stat"},
+    {"dmabuf_heap", "dma_heap_stat"},
+    {"binder", "binder_transaction"},
+    {"binder", "binder_transaction_received"},
+    {"binder", "binder_transaction_alloc_buf"},
+};
+
+void AppendVarInt(uint64_t value, std::vector<uint8_t>* out) {
+  uint8_t buf[protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+  uint8_t* end = protozero::proto_utils::WriteVarInt(value, buf);
+  out->insert(out->end(), buf, end);
+}
+
+template <typename T>
+T ReadValue(const uint8_t* ptr) {
+  T t;
+  memcpy(&t, reinterpret_cast<const void*>(ptr), sizeof(T));
+  return t;
+}
+
 // Pre-parse the format of sched_switch, checking if our simplifying
 // assumptions about possible widths/signedness hold, and record the subset
 // of the format that will be used during parsing.
@@ -261,8 +299,260 @@ void CommInterner::Reset() {
   interned_comms_size_ = 0;
 }
 
+bool SupportsCompactEvents(const Event& event) {
+  bool listed = false;
+  for (const auto& group_and_name : kCompactEvents) {
+    if (strcmp(event.group, group_and_name[0]) == 0 &&
+        strcmp(event.name, group_and_name[1]) == 0) {
+      listed = true;
+      break;
+    }
+  }
+  if (!listed)
+    return false;
+
+  for (const Field& field : event.fields) {
+    switch (field.strategy) {
+      case kUint8ToUint32:
+      case kUint8ToUint64:
+      case kUint16ToUint32:
+      case kUint16ToUint64:
+      case kUint32ToUint32:
+      case kUint32ToUint64:
+      case kUint64ToUint64:
+      case kBoolToUint32:
+      case kBoolToUint64:
+      case kInode32ToUint64:
+      case kInode64ToUint64:
+      case kInt8ToInt32:
+      case kInt8ToInt64:
+      case kInt16ToInt32:
+      case kInt16ToInt64:
+      case kInt32ToInt32:
+      case kInt32ToInt64:
+      case kInt64ToInt64:
+      case kPid32ToInt32:
+      case kPid32ToInt64:
+      case kFixedCStringToString:
+      case kCStringToString:
+      case kDataLocToString:
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+CompactEventsBuffer::CompactEventsBuffer() = default;
+CompactEventsBuffer::~CompactEventsBuffer() = default;
+
+CompactEventsBuffer::EventColumns* CompactEventsBuffer::GetEventColumns(
+    const Event& event) {
+  for (const auto& columns : events_) {
+    if (columns->ftrace_event_id == event.ftrace_event_id)
+      return columns.get();
+  }
+  std::unique_ptr<EventColumns> columns(new EventColumns());
+  columns->ftrace_event_id = event.ftrace_event_id;
+  columns->proto_field_id = event.proto_field_id;
+  for (const Field& field : event.fields) {
+    Column column;
+    column.proto_field_id = field.proto_field_id;
+    switch (field.strategy) {
+      case kInt8ToInt32:
+      case kInt8ToInt64:
+      case kInt16ToInt32:
+      case kInt16ToInt64:
+      case kInt32ToInt32:
+      case kInt32ToInt64:
+      case kInt64ToInt64:
+      case kPid32ToInt32:
+      case kPid32ToInt64:
+        column.type = ColumnType::kSigned;
+        break;
+      case kFixedCStringToString:
+      case kCStringToString:
+      case kDataLocToString:
+        column.type = ColumnType::kString;
+        break;
+      default:
+        column.type = ColumnType::kUnsigned;
+        break;
+    }
+    columns->columns.push_back(std::move(column));
+  }
+  events_.push_back(std::move(columns));
+  return events_.back().get();
+}
+
+void CompactEventsBuffer::AppendEvent(const Event& event,
+                                      const std::vector<Field>& common_fields,
+                                      uint64_t timestamp,
+                                      const uint8_t* start,
+                                      const uint8_t* end,
+                                      FtraceMetadata* metadata) {
+  EventColumns* columns = GetEventColumns(event);
+  columns->size++;
+  AppendVarInt(timestamp - columns->last_timestamp, &columns->timestamp);
+  columns->last_timestamp = timestamp;
+
+  uint32_t pid = 0;
+  for (const Field& field : common_fields) {
+    if (field.strategy == kCommonPid32ToInt32 ||
+        field.strategy == kCommonPid32ToInt64) {
+      int32_t common_pid = ReadValue<int32_t>(start + field.ftrace_offset);
+      metadata->AddCommonPid(common_pid);
+      pid = static_cast<uint32_t>(common_pid);
+    }
+  }
+  AppendVarInt(pid, &columns->pid);
+
+  PERFETTO_DCHECK(columns->columns.size() == event.fields.size());
+  for (size_t i = 0; i < event.fields.size(); i++) {
+    const Field& field = event.fields[i];
+    const uint8_t* field_start = start + field.ftrace_offset;
+    uint64_t value = 0;
+    switch (field.strategy) {
+      case kUint8ToUint32:
+      case kUint8ToUint64:
+      case kBoolToUint32:
+      case kBoolToUint64:
+        value = ReadValue<uint8_t>(field_start);
+        break;
+      case kUint16ToUint32:
+      case kUint16ToUint64:
+        value = ReadValue<uint16_t>(field_start);
+        break;
+      case kUint32ToUint32:
+      case kUint32ToUint64:
+        value = ReadValue<uint32_t>(field_start);
+        break;
+      case kUint64ToUint64:
+        value = ReadValue<uint64_t>(field_start);
+        break;
+      case kInode32ToUint64:
+        value = ReadValue<uint32_t>(field_start);
+        metadata->AddInode(static_cast<Inode>(value));
+        break;
+      case kInode64ToUint64:
+        value = ReadValue<uint64_t>(field_start);
+        metadata->AddInode(static_cast<Inode>(value));
+        break;
+      case kInt8ToInt32:
+      case kInt8ToInt64:
+        value = protozero::proto_utils::ZigZagEncode(
+            int64_t{ReadValue<int8_t>(field_start)});
+        break;
+      case kInt16ToInt32:
+      case kInt16ToInt64:
+        value = protozero::proto_utils::ZigZagEncode(
+            int64_t{ReadValue<int16_t>(field_start)});
+        break;
+      case kInt32ToInt32:
+      case kInt32ToInt64:
+        value = protozero::proto_utils::ZigZagEncode(
+            int64_t{ReadValue<int32_t>(field_start)});
+        break;
+      case kInt64ToInt64:
+        value = protozero::proto_utils::ZigZagEncode(
+            ReadValue<int64_t>(field_start));
+        break;
+      case kPid32ToInt32:
+      case kPid32ToInt64: {
+        int32_t field_pid = ReadValue<int32_t>(field_start);
+        metadata->AddPid(field_pid);
+        value = protozero::proto_utils::ZigZagEncode(int64_t{field_pid});
+        break;
+      }
+      case kFixedCStringToString:
+      case kCStringToString:
+      case kDataLocToString: {
+        const uint8_t* str_start = field_start;
+        const uint8_t* str_end = end;
+        if (field.strategy == kFixedCStringToString) {
+          str_end = field_start + field.ftrace_size;
+        } else if (field.strategy == kDataLocToString) {
+          // The offset of the string from the start of the event and its
+          // length, see ReadDataLoc() in cpu_reader.cc.
+          uint32_t data_loc = ReadValue<uint32_t>(field_start);
+          str_start = start + (data_loc & 0xffff);
+          str_end = std::min(end, str_start + (data_loc >> 16));
+          if (str_start > str_end)
+            str_start = str_end;
+        }
+        const char* str = reinterpret_cast<const char*>(str_start);
+        base::StringView view(
+            str, strnlen(str, static_cast<size_t>(str_end - str_start)));
+        std::vector<std::string>& intern_table = columns->intern_table;
+        auto it = std::find_if(intern_table.begin(), intern_table.end(),
+                               [&view](const std::string& interned) {
+                                 return view == base::StringView(interned);
+                               });
+        value = static_cast<uint64_t>(it - intern_table.begin());
+        if (it == intern_table.end()) {
+          intern_table.push_back(view.ToStdString());
+          interned_strings_size_++;
+        }
+        break;
+      }
+      default:
+        PERFETTO_DFATAL("Unexpected translation strategy");
+        break;
+    }
+    AppendVarInt(value, &columns->columns[i].values);
+  }
+  metadata->FinishEvent();
+}
+
+void CompactEventsBuffer::Write(
+    protos::pbzero::FtraceEventBundle* bundle) const {
+  using CompactEvents = protos::pbzero::FtraceEventBundle::CompactEvents;
+  for (const auto& columns : events_) {
+    if (columns->size == 0)
+      continue;
+    CompactEvents* compact_out = bundle->add_compact_events();
+    compact_out->set_proto_field_id(columns->proto_field_id);
+    compact_out->AppendBytes(CompactEvents::kTimestampFieldNumber,
+                             columns->timestamp.data(),
+                             columns->timestamp.size());
+    compact_out->AppendBytes(CompactEvents::kPidFieldNumber,
+                             columns->pid.data(), columns->pid.size());
+    for (const Column& column : columns->columns) {
+      auto* column_out = compact_out->add_column();
+      column_out->set_proto_field_id(column.proto_field_id);
+      uint32_t values_field_id = CompactEvents::Column::kValueFieldNumber;
+      if (column.type == ColumnType::kSigned) {
+        values_field_id = CompactEvents::Column::kSignedValueFieldNumber;
+      } else if (column.type == ColumnType::kString) {
+        values_field_id = CompactEvents::Column::kStringIndexFieldNumber;
+      }
+      column_out->AppendBytes(values_field_id, column.values.data(),
+                              column.values.size());
+    }
+    for (const std::string& str : columns->intern_table)
+      compact_out->add_intern_table(str.data(), str.size());
+  }
+}
+
+void CompactEventsBuffer::Reset() {
+  for (const auto& columns : events_) {
+    columns->size = 0;
+    columns->last_timestamp = 0;
+    columns->timestamp.clear();
+    columns->pid.clear();
+    for (Column& column : columns->columns)
+      column.values.clear();
+    columns->intern_table.clear();
+  }
+  interned_strings_size_ = 0;
+}
+
 void CompactSchedBuffer::WriteAndReset(
     protos::pbzero::FtraceEventBundle* bundle) {
+  events_.Write(bundle);
+  events_.Reset();
+
   if (switch_.size() > 0 || waking_.size() > 0) {
     auto* compact_out = bundle->set_compact_sched();
 
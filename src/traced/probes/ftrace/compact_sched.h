@@ -19,6 +19,10 @@
 
 #include <stdint.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
@@ -27,6 +31,8 @@
 
 namespace perfetto {
 
+struct FtraceMetadata;
+
 // The subset of the sched_switch event's format that is used when parsing and
 // encoding into the compact format.
 struct CompactSchedSwitchFormat {
@@ -212,6 +218,75 @@ class CommInterner {
   uint32_t interned_comms_size_ = 0;
 };
 
+// Returns true if |event| is one of the high frequency events which are
+// encoded in FtraceEventBundle.compact_events with FtraceConfig.compact_events
+// and all of its fields can be encoded there, i.e. they are integers or
+// strings which don't need to be translated on the device (unlike symbols or
+// inodes).
+bool SupportsCompactEvents(const Event& event);
+
+// Collects the fields of the events of FtraceConfig.compact_events, one
+// column per field for each type of event, allowing them to be written out
+// into FtraceEventBundle.compact_events. Unlike the buffers above, this
+// doesn't reserve any memory until events are appended to it, since most
+// types of events are not expected in a given bundle.
+class CompactEventsBuffer {
+ public:
+  CompactEventsBuffer();
+  ~CompactEventsBuffer();
+
+  // Buffers the fields of the event at |start|, of type |event|. The caller
+  // must guarantee that start + event.size <= end.
+  void AppendEvent(const Event& event,
+                   const std::vector<Field>& common_fields,
+                   uint64_t timestamp,
+                   const uint8_t* start,
+                   const uint8_t* end,
+                   FtraceMetadata* metadata);
+
+  // Total number of interned strings, over all types of events.
+  size_t interned_strings_size() const { return interned_strings_size_; }
+
+  void Write(protos::pbzero::FtraceEventBundle* bundle) const;
+  void Reset();
+
+ private:
+  CompactEventsBuffer(const CompactEventsBuffer&) = delete;
+  CompactEventsBuffer& operator=(const CompactEventsBuffer&) = delete;
+
+  enum class ColumnType { kUnsigned, kSigned, kString };
+
+  struct Column {
+    uint32_t proto_field_id;
+    ColumnType type;
+    // The values, as packed varints.
+    std::vector<uint8_t> values;
+  };
+
+  // The buffered events of one type.
+  struct EventColumns {
+    uint32_t ftrace_event_id;
+    uint32_t proto_field_id;
+    size_t size = 0;
+    // First timestamp in a bundle is absolute, the others are relative to the
+    // preceding event of the same type.
+    uint64_t last_timestamp = 0;
+    std::vector<uint8_t> timestamp;
+    std::vector<uint8_t> pid;
+    std::vector<Column> columns;
+    // Linearly scanned, the ftrace reader starts a new bundle when there are
+    // too many.
+    std::vector<std::string> intern_table;
+  };
+
+  EventColumns* GetEventColumns(const Event& event);
+
+  // Types of events seen since the last Reset(), kept across resets to reuse
+  // their memory.
+  std::vector<std::unique_ptr<EventColumns>> events_;
+  size_t interned_strings_size_ = 0;
+};
+
 // Mutable state for buffering parts of scheduling events, that can later be
 // written out in a compact format with |WriteAndReset|. Used by the ftrace
 // reader.
@@ -220,6 +295,7 @@ class CompactSchedBuffer {
   CompactSchedSwitchBuffer& sched_switch() { return switch_; }
   CompactSchedWakingBuffer& sched_waking() { return waking_; }
   CommInterner& interner() { return interner_; }
+  CompactEventsBuffer& events() { return events_; }
 
   // Writes out the currently buffered events, and starts the next batch
   // internally.
@@ -229,6 +305,7 @@ class CompactSchedBuffer {
   CommInterner interner_;
   CompactSchedSwitchBuffer switch_;
   CompactSchedWakingBuffer waking_;
+  CompactEventsBuffer events_;
 };
 
 }  // namespace perfetto
@@ -119,6 +119,27 @@ T ReadValue(const uint8_t* ptr) {
   return t;
 }
 
+bool IsFreedPidEvent(const Event& info) {
+  return info.proto_field_id ==
+             protos::pbzero::FtraceEvent::kSchedProcessFreeFieldNumber ||
+         info.proto_field_id ==
+             protos::pbzero::FtraceEvent::kTaskNewtaskFieldNumber;
+}
+
+// The task of sched_process_free and task_newtask is the one of their pid
+// field, not their common pid: the former is emitted from an RCU callback,
+// the latter by the parent task.
+void AddFreedPid(const Event& info,
+                 const uint8_t* start,
+                 FtraceMetadata* metadata) {
+  for (const Field& field : info.fields) {
+    if (field.strategy == kPid32ToInt32 || field.strategy == kPid32ToInt64) {
+      metadata->AddFreedPid(ReadValue<int32_t>(start + field.ftrace_offset));
+      return;
+    }
+  }
+}
+
 // Reads a signed ftrace value as an int64_t, sign extending if necessary.
 static int64_t ReadSignedFtraceValue(const uint8_t* ptr,
                                      FtraceFieldType ftrace_type) {
@@ -135,6 +156,87 @@ static int64_t ReadSignedFtraceValue(const uint8_t* ptr,
   PERFETTO_FATAL("unexpected ftrace type");
 }
 
+using RawField = protos::pbzero::FtraceEventBundle::RawFormat::Field;
+
+// Returns how trace_processor reads |field| from the raw pages, as the field
+// would be read by CpuReader::ParseField(), or false if it can't: the field
+// needs to be translated on the device.
+bool GetRawFieldType(const Field& field, RawField::Type* type, uint32_t* size) {
+  *type = RawField::TYPE_UINT;
+  *size = field.ftrace_size;
+  switch (field.strategy) {
+    case kUint8ToUint32:
+    case kUint8ToUint64:
+    case kBoolToUint32:
+    case kBoolToUint64:
+      *size = 1;
+      return true;
+    case kUint16ToUint32:
+    case kUint16ToUint64:
+      *size = 2;
+      return true;
+    case kUint32ToUint32:
+    case kUint32ToUint64:
+      *size = 4;
+      return true;
+    case kUint64ToUint64:
+      *size = 8;
+      return true;
+    case kInt8ToInt32:
+    case kInt8ToInt64:
+      *type = RawField::TYPE_INT;
+      *size = 1;
+      return true;
+    case kInt16ToInt32:
+    case kInt16ToInt64:
+      *type = RawField::TYPE_INT;
+      *size = 2;
+      return true;
+    case kInt32ToInt32:
+    case kInt32ToInt64:
+    case kPid32ToInt32:
+    case kPid32ToInt64:
+    case kCommonPid32ToInt32:
+    case kCommonPid32ToInt64:
+      *type = RawField::TYPE_INT;
+      *size = 4;
+      return true;
+    case kInt64ToInt64:
+      *type = RawField::TYPE_INT;
+      *size = 8;
+      return true;
+    case kFixedCStringToString:
+      *type = RawField::TYPE_CSTRING;
+      return true;
+    case kCStringToString:
+      *type = RawField::TYPE_CSTRING;
+      *size = 0;
+      return true;
+    case kDataLocToString:
+      *type = RawField::TYPE_DATA_LOC;
+      return true;
+    // The inodes and the block devices are also collected into FtraceMetadata,
+    // and the latter are translated to the userspace layout.
+    case kInode32ToUint64:
+    case kInode64ToUint64:
+    case kDevId32ToUint64:
+    case kDevId64ToUint64:
+    case kStringPtrToString:
+    case kFtraceSymAddr64ToUint64:
+    case kInvalidTranslationStrategy:
+      return false;
+  }
+  return false;
+}
+
+void WriteRawField(const Field& field, RawField::Type type, uint32_t size,
+                   RawField* out) {
+  out->set_proto_field_id(field.proto_field_id);
+  out->set_type(type);
+  out->set_offset(field.ftrace_offset);
+  out->set_size(size);
+}
+
 bool SetBlocking(int fd, bool is_blocking) {
   int flags = fcntl(fd, F_GETFL, 0);
   flags = (is_blocking) ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
@@ -159,11 +261,10 @@ CpuReader::CpuReader(size_t cpu,
 
 CpuReader::~CpuReader() = default;
 
-size_t CpuReader::ReadCycle(
-    uint8_t* parsing_buf,
-    size_t parsing_buf_size_pages,
-    size_t max_pages,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+size_t CpuReader::ReadCycle(uint8_t* parsing_buf,
+                            size_t parsing_buf_size_pages,
+                            size_t max_pages,
+                            const std::vector<DataSourceOutput>& outputs) {
   PERFETTO_DCHECK(max_pages > 0 && parsing_buf_size_pages > 0);
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_READ_CYCLE);
@@ -172,8 +273,8 @@ size_t CpuReader::ReadCycle(
   size_t batch_pages = std::min(parsing_buf_size_pages, max_pages);
   size_t total_pages_read = 0;
   for (bool is_first_batch = true;; is_first_batch = false) {
-    size_t pages_read = ReadAndProcessBatch(
-        parsing_buf, batch_pages, is_first_batch, started_data_sources);
+    size_t pages_read =
+        ReadAndProcessBatch(parsing_buf, batch_pages, is_first_batch, outputs);
 
     PERFETTO_DCHECK(pages_read <= batch_pages);
     total_pages_read += pages_read;
@@ -199,7 +300,7 @@ size_t CpuReader::ReadAndProcessBatch(
     uint8_t* parsing_buf,
     size_t max_pages,
     bool first_batch_in_cycle,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+    const std::vector<DataSourceOutput>& outputs) {
   size_t pages_read = 0;
   {
     metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
@@ -272,11 +373,10 @@ size_t CpuReader::ReadAndProcessBatch(
   if (pages_read == 0)
     return pages_read;
 
-  for (FtraceDataSource* data_source : started_data_sources) {
+  for (const DataSourceOutput& output : outputs) {
     bool success = ProcessPagesForDataSource(
-        data_source->trace_writer(), data_source->mutable_metadata(), cpu_,
-        data_source->parsing_config(), parsing_buf, pages_read, table_,
-        symbolizer_);
+        output.trace_writer, output.metadata, cpu_, output.parsing_config,
+        parsing_buf, pages_read, table_, symbolizer_);
     PERFETTO_CHECK(success);
   }
 
@@ -297,14 +397,23 @@ bool CpuReader::ProcessPagesForDataSource(
   // the compact option isn't enabled).
   CompactSchedBuffer compact_sched;
   bool compact_sched_enabled = ds_config->compact_sched.enabled;
+  bool compact_events_enabled = ds_config->compact_events;
+  bool raw_pages_enabled = ds_config->raw_pages;
+  bool delta_timestamps_enabled = ds_config->delta_timestamps;
+  EventRateLimiter* rate_limiter = cpu < ds_config->rate_limiters.size()
+                                       ? &ds_config->rate_limiters[cpu]
+                                       : nullptr;
 
   TraceWriter::TracePacketHandle packet;
   protos::pbzero::FtraceEventBundle* bundle = nullptr;
+  // With |delta_timestamps_enabled|, the timestamp of the last event written
+  // into |bundle|, or its event_timestamp_base. Unset for a new bundle.
+  base::Optional<uint64_t> last_event_timestamp;
 
   // This function is called after the contents of a FtraceBundle are written.
   auto finalize_cur_packet = [&] {
     PERFETTO_DCHECK(packet);
-    if (compact_sched_enabled)
+    if (compact_sched_enabled || compact_events_enabled)
       compact_sched.WriteAndReset(bundle);
 
     bundle->Finalize();
@@ -380,6 +489,7 @@ bool CpuReader::ProcessPagesForDataSource(
     bundle->set_cpu(static_cast<uint32_t>(cpu));
     if (lost_events)
       bundle->set_lost_events(true);
+    last_event_timestamp = base::nullopt;
   };
 
   start_new_packet(/*lost_events=*/false);
@@ -405,16 +515,35 @@ bool CpuReader::ProcessPagesForDataSource(
     //   a threshold. We need to flush the compact buffer to make the
     //   interning lookups cheap again.
     bool interner_past_threshold =
-        compact_sched_enabled &&
-        compact_sched.interner().interned_comms_size() >
-            kCompactSchedInternerThreshold;
+        (compact_sched_enabled &&
+         compact_sched.interner().interned_comms_size() >
+             kCompactSchedInternerThreshold) ||
+        (compact_events_enabled &&
+         compact_sched.events().interned_strings_size() >
+             kCompactSchedInternerThreshold);
 
     if (page_header->lost_events || interner_past_threshold)
       start_new_packet(page_header->lost_events);
 
-    size_t evt_size =
-        ParsePagePayload(parse_pos, &page_header.value(), table, ds_config,
-                         &compact_sched, bundle, metadata);
+    // Copy the page without decoding its events if trace_processor can do it.
+    if (raw_pages_enabled &&
+        CanWriteRawPage(parse_pos, &page_header.value(), table, ds_config,
+                        metadata)) {
+      bundle->add_raw_page(
+          curr_page, static_cast<size_t>(parse_pos - curr_page) +
+                         static_cast<size_t>(page_header->size));
+      continue;
+    }
+
+    if (delta_timestamps_enabled && !last_event_timestamp.has_value()) {
+      last_event_timestamp = page_header->timestamp;
+      bundle->set_event_timestamp_base(page_header->timestamp);
+    }
+
+    size_t evt_size = ParsePagePayload(
+        parse_pos, &page_header.value(), table, ds_config, &compact_sched,
+        bundle, metadata, rate_limiter,
+        delta_timestamps_enabled ? &last_event_timestamp.value() : nullptr);
 
     // TODO(rsavitski): propagate error to trace processor in release builds.
     // (FtraceMetadata -> FtraceStats in trace).
@@ -488,7 +617,9 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
                                    const FtraceDataSourceConfig* ds_config,
                                    CompactSchedBuffer* compact_sched_buffer,
                                    FtraceEventBundle* bundle,
-                                   FtraceMetadata* metadata) {
+                                   FtraceMetadata* metadata,
+                                   EventRateLimiter* rate_limiter,
+                                   uint64_t* last_event_timestamp) {
   const uint8_t* ptr = start_of_payload;
   const uint8_t* const end = ptr + page_header->size;
 
@@ -567,7 +698,9 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
         if (!ReadAndAdvance<uint16_t>(&ptr, end, &ftrace_event_id))
           return 0;
 
-        if (ds_config->event_filter.IsEventEnabled(ftrace_event_id)) {
+        if (ds_config->event_filter.IsEventEnabled(ftrace_event_id) &&
+            (!rate_limiter ||
+             rate_limiter->KeepEvent(ftrace_event_id, timestamp))) {
           // Special-cased handling of some scheduler events when compact format
           // is enabled.
           bool compact_sched_enabled = ds_config->compact_sched.enabled;
@@ -594,10 +727,26 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
             ParseSchedWakingCompact(start, timestamp, &sched_waking_format,
                                     compact_sched_buffer, metadata);
 
+            // compact encoding of the other high frequency events
+          } else if (ds_config->compact_event_filter.IsEventEnabled(
+                         ftrace_event_id)) {
+            const Event* info = table->GetEventById(ftrace_event_id);
+            if (!info || event_size < info->size)
+              return 0;
+
+            compact_sched_buffer->events().AppendEvent(
+                *info, table->common_fields(), timestamp, start, next,
+                metadata);
+
           } else {
             // Common case: parse all other types of enabled events.
             protos::pbzero::FtraceEvent* event = bundle->add_event();
-            event->set_timestamp(timestamp);
+            if (last_event_timestamp) {
+              event->set_timestamp(timestamp - *last_event_timestamp);
+              *last_event_timestamp = timestamp;
+            } else {
+              event->set_timestamp(timestamp);
+            }
             if (!ParseEvent(ftrace_event_id, start, next, table, event,
                             metadata))
               return 0;
@@ -612,6 +761,118 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
   return static_cast<size_t>(ptr - start_of_payload);
 }
 
+// Walks the events of the page like ParsePagePayload(), without decoding them.
+// static
+bool CpuReader::CanWriteRawPage(const uint8_t* start_of_payload,
+                                const PageHeader* page_header,
+                                const ProtoTranslationTable* table,
+                                const FtraceDataSourceConfig* ds_config,
+                                FtraceMetadata* metadata) {
+  const uint8_t* ptr = start_of_payload;
+  const uint8_t* const end = ptr + page_header->size;
+
+  while (ptr < end) {
+    EventHeader event_header;
+    if (!ReadAndAdvance(&ptr, end, &event_header))
+      return false;
+
+    uint32_t event_size = 0;
+    switch (event_header.type_or_length) {
+      case kTypePadding:
+        if (!ReadAndAdvance<uint32_t>(&ptr, end, &event_size) ||
+            event_size < 4) {
+          return false;
+        }
+        ptr += event_size - 4;
+        continue;
+      case kTypeTimeExtend:
+      case kTypeTimeStamp:
+        ptr += sizeof(uint32_t);
+        continue;
+      case 0:
+        if (!ReadAndAdvance<uint32_t>(&ptr, end, &event_size) ||
+            event_size < 4) {
+          return false;
+        }
+        event_size -= 4;
+        break;
+      default:
+        event_size = 4 * event_header.type_or_length;
+        break;
+    }
+    const uint8_t* start = ptr;
+    ptr += event_size;
+    if (ptr > end || event_size < sizeof(uint16_t))
+      return false;
+
+    uint16_t ftrace_event_id = ReadValue<uint16_t>(start);
+    if (!ds_config->raw_page_filter.IsEventEnabled(ftrace_event_id))
+      return false;
+
+    const Event& info = *table->GetEventById(ftrace_event_id);
+    if (info.size > event_size)
+      return false;
+    for (const Field& field : table->common_fields()) {
+      if (field.strategy == kCommonPid32ToInt32 ||
+          field.strategy == kCommonPid32ToInt64) {
+        metadata->AddCommonPid(ReadValue<int32_t>(start + field.ftrace_offset));
+      }
+    }
+    for (const Field& field : info.fields) {
+      if (field.strategy == kPid32ToInt32 || field.strategy == kPid32ToInt64)
+        metadata->AddPid(ReadValue<int32_t>(start + field.ftrace_offset));
+    }
+    if (info.proto_field_id ==
+        protos::pbzero::FtraceEvent::kTaskRenameFieldNumber) {
+      metadata->AddRenamePid(metadata->last_seen_common_pid);
+    }
+    if (PERFETTO_UNLIKELY(IsFreedPidEvent(info)))
+      AddFreedPid(info, start, metadata);
+    metadata->FinishEvent();
+  }
+  return ptr == end;
+}
+
+// static
+bool CpuReader::SupportsRawPages(const Event& event) {
+  // The generic events would need their field names.
+  if (event.proto_field_id == protos::pbzero::FtraceEvent::kGenericFieldNumber)
+    return false;
+  RawField::Type type;
+  uint32_t size;
+  for (const Field& field : event.fields) {
+    if (!GetRawFieldType(field, &type, &size))
+      return false;
+  }
+  return true;
+}
+
+// static
+void CpuReader::WriteRawFormat(
+    const ProtoTranslationTable* table,
+    const EventFilter& raw_page_filter,
+    protos::pbzero::FtraceEventBundle::RawFormat* out) {
+  RawField::Type type;
+  uint32_t size;
+  out->set_page_header_size_len(table->page_header_size_len());
+  for (const Field& field : table->common_fields()) {
+    if (GetRawFieldType(field, &type, &size))
+      WriteRawField(field, type, size, out->add_common_field());
+  }
+  for (size_t ftrace_event_id : raw_page_filter.GetEnabledEvents()) {
+    const Event* event = table->GetEventById(ftrace_event_id);
+    if (!event)
+      continue;
+    auto* raw_event = out->add_event();
+    raw_event->set_id(event->ftrace_event_id);
+    raw_event->set_proto_field_id(event->proto_field_id);
+    for (const Field& field : event->fields) {
+      if (GetRawFieldType(field, &type, &size))
+        WriteRawField(field, type, size, raw_event->add_field());
+    }
+  }
+}
+
 // |start| is the start of the current event.
 // |end| is the end of the buffer.
 bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
@@ -653,8 +914,44 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
       success &= ParseField(field, start, end, table, generic_field, metadata);
     }
   } else {  // Parse all other events.
-    for (const Field& field : info.fields) {
-      success &= ParseField(field, start, end, table, nested, metadata);
+    // Walk the fields as flattened when the table was created: the integer
+    // fields are decoded inline, the others go through ParseField().
+    for (const CompiledField& field :
+         table->GetCompiledFields(ftrace_event_id)) {
+      const uint8_t* field_start = start + field.ftrace_offset;
+      switch (field.op) {
+        case CompiledField::kUint8:
+          ReadIntoVarInt<uint8_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kUint16:
+          ReadIntoVarInt<uint16_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kUint32:
+          ReadIntoVarInt<uint32_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kUint64:
+          ReadIntoVarInt<uint64_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kInt8:
+          ReadIntoVarInt<int8_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kInt16:
+          ReadIntoVarInt<int16_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kInt32:
+          ReadIntoVarInt<int32_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kInt64:
+          ReadIntoVarInt<int64_t>(field_start, field.proto_field_id, nested);
+          break;
+        case CompiledField::kPid32:
+          ReadPid(field_start, field.proto_field_id, nested, metadata);
+          break;
+        case CompiledField::kField:
+          success &= ParseField(info.fields[field.field_index], start, end,
+                                table, nested, metadata);
+          break;
+      }
     }
   }
 
@@ -666,6 +963,8 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
     PERFETTO_DCHECK(metadata->last_seen_common_pid);
     metadata->AddRenamePid(metadata->last_seen_common_pid);
   }
+  if (PERFETTO_UNLIKELY(IsFreedPidEvent(info)))
+    AddFreedPid(info, start, metadata);
 
   // This finalizes |nested| and |proto_field| automatically.
   message->Finalize();
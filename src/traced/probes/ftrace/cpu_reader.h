@@ -25,6 +25,7 @@
 #include <memory>
 #include <set>
 #include <thread>
+#include <vector>
 
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/paged_memory.h"
@@ -49,6 +50,7 @@ struct FtraceDataSourceConfig;
 namespace protos {
 namespace pbzero {
 class FtraceEventBundle;
+class FtraceEventBundle_RawFormat;
 }  // namespace pbzero
 }  // namespace protos
 
@@ -64,6 +66,15 @@ class CpuReader {
     bool lost_events;
   };
 
+  // Where the events are written for one data source: into the writer and
+  // metadata of the data source itself or, when reading on multiple threads,
+  // into those of the reader thread (see FtraceDataSource).
+  struct DataSourceOutput {
+    TraceWriter* trace_writer;
+    FtraceMetadata* metadata;
+    const FtraceDataSourceConfig* parsing_config;
+  };
+
   CpuReader(size_t cpu,
             const ProtoTranslationTable* table,
             LazyKernelSymbolizer* symbolizer,
@@ -75,7 +86,10 @@ class CpuReader {
   size_t ReadCycle(uint8_t* parsing_buf,
                    size_t parsing_buf_size_pages,
                    size_t max_pages,
-                   const std::set<FtraceDataSource*>& started_data_sources);
+                   const std::vector<DataSourceOutput>& outputs);
+
+  // The non-blocking trace_pipe_raw fd for this cpu, for poll()-ing it.
+  int trace_fd() const { return *trace_fd_; }
 
   template <typename T>
   static bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
@@ -183,13 +197,39 @@ class CpuReader {
   // which passes it to the CpuReader which passes it here.
   // The caller is responsible for validating that the page_header->size stays
   // within the current page.
+  // If |rate_limiter| is set, the events above its limits are dropped.
+  // If |last_event_timestamp| is set, the timestamps of the events written
+  // into |bundle| are deltas from it, and it's updated after each of them
+  // (see FtraceConfig.delta_timestamps).
   static size_t ParsePagePayload(const uint8_t* start_of_payload,
                                  const PageHeader* page_header,
                                  const ProtoTranslationTable* table,
                                  const FtraceDataSourceConfig* ds_config,
                                  CompactSchedBuffer* compact_sched_buffer,
                                  FtraceEventBundle* bundle,
-                                 FtraceMetadata* metadata);
+                                 FtraceMetadata* metadata,
+                                 EventRateLimiter* rate_limiter = nullptr,
+                                 uint64_t* last_event_timestamp = nullptr);
+
+  // Returns true if all the events in the payload of a raw ftrace page are in
+  // |ds_config->raw_page_filter|, i.e. if the page can be written as is into
+  // FtraceEventBundle.raw_page. Meanwhile, adds the pids of its events to
+  // |metadata|, as ParsePagePayload() would.
+  static bool CanWriteRawPage(const uint8_t* start_of_payload,
+                              const PageHeader* page_header,
+                              const ProtoTranslationTable* table,
+                              const FtraceDataSourceConfig* ds_config,
+                              FtraceMetadata* metadata);
+
+  // Returns true if trace_processor can decode |event| from the raw pages:
+  // none of its fields needs to be translated on the device (e.g. symbolized).
+  static bool SupportsRawPages(const Event& event);
+
+  // Writes the layout of the events in |raw_page_filter|, which trace_processor
+  // needs to decode them from the raw pages.
+  static void WriteRawFormat(const ProtoTranslationTable* table,
+                             const EventFilter& raw_page_filter,
+                             protos::pbzero::FtraceEventBundle_RawFormat* out);
 
   // Parse a single raw ftrace event beginning at |start| and ending at |end|
   // and write it into the provided bundle as a proto.
@@ -246,14 +286,13 @@ class CpuReader {
   CpuReader& operator=(const CpuReader&) = delete;
 
   // Reads at most |max_pages| of ftrace data, parses it, and writes it
-  // into |started_data_sources|. Returns number of pages read.
+  // into |outputs|. Returns number of pages read.
   // See comment on ftrace_controller.cc:kMaxParsingWorkingSetPages for
   // rationale behind the batching.
-  size_t ReadAndProcessBatch(
-      uint8_t* parsing_buf,
-      size_t max_pages,
-      bool first_batch_in_cycle,
-      const std::set<FtraceDataSource*>& started_data_sources);
+  size_t ReadAndProcessBatch(uint8_t* parsing_buf,
+                             size_t max_pages,
+                             bool first_batch_in_cycle,
+                             const std::vector<DataSourceOutput>& outputs);
 
   const size_t cpu_;
   const ProtoTranslationTable* const table_;
@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string.h>
+
+#include <memory>
+
 #include <benchmark/benchmark.h>
 
 #include "perfetto/ext/base/utils.h"
@@ -305,31 +309,66 @@ using perfetto::protos::pbzero::FtraceEventBundle;
 using protozero::ScatteredStreamWriter;
 using protozero::ScatteredStreamWriterNullDelegate;
 
-// Benchmark for the core logic of the ftrace binary format decoding.
-static void BM_ParsePageFullOfSchedSwitch(benchmark::State& state) {
-  const ExamplePage* test_case = &g_full_page_sched_switch;
+namespace {
+
+// Returns a page full of binder_transaction events in the format of the
+// android_seed_N2F62_3.10.49 table.
+std::unique_ptr<uint8_t[]> MakePageFullOfBinderTransaction(
+    const ProtoTranslationTable* table) {
+  const uint16_t event_id = static_cast<uint16_t>(
+      table->EventToFtraceId(GroupAndName("binder", "binder_transaction")));
+  // The 8 bytes of the common fields and 7 int fields.
+  const uint32_t kEventSize = 36;
+  const uint64_t kPageHeaderSize = 16;
+  const uint32_t kEventCount = static_cast<uint32_t>(
+      (perfetto::base::kPageSize - kPageHeaderSize) / (4 + kEventSize));
 
+  std::unique_ptr<uint8_t[]> page(new uint8_t[perfetto::base::kPageSize]());
+  uint8_t* ptr = page.get();
+  auto write = [&ptr](const void* data, size_t size) {
+    memcpy(ptr, data, size);
+    ptr += size;
+  };
+  const uint64_t timestamp = 1000000;
+  const uint64_t commit = kEventCount * (4 + kEventSize);
+  write(&timestamp, sizeof(timestamp));
+  write(&commit, sizeof(commit));
+  for (uint32_t i = 0; i < kEventCount; i++) {
+    // Type and length in 4 byte words, then the time delta.
+    const uint32_t header = (kEventSize / 4) | (100u << 5);
+    const uint16_t flags_and_preempt = 0;
+    const int32_t fields[] = {
+        static_cast<int32_t>(1000 + i),  // common_pid
+        static_cast<int32_t>(i),         // debug_id
+        42,                              // target_node
+        1000,                            // to_proc
+        static_cast<int32_t>(1000 + i),  // to_thread
+        0,                               // reply
+        1,                               // code
+        0x10,                            // flags
+    };
+    write(&header, sizeof(header));
+    write(&event_id, sizeof(event_id));
+    write(&flags_and_preempt, sizeof(flags_and_preempt));
+    write(fields, sizeof(fields));
+  }
+  return page;
+}
+
+void ParsePageInLoop(benchmark::State& state,
+                     const uint8_t* page,
+                     const ProtoTranslationTable* table,
+                     const FtraceDataSourceConfig* ds_config) {
   ScatteredStreamWriterNullDelegate delegate(perfetto::base::kPageSize);
   ScatteredStreamWriter stream(&delegate);
   protozero::RootMessage<FtraceEventBundle> writer;
 
-  ProtoTranslationTable* table = GetTable(test_case->name);
-  auto page = PageFromXxd(test_case->data);
-
-  FtraceDataSourceConfig ds_config{EventFilter{},
-                                   DisabledCompactSchedConfigForTesting(),
-                                   {},
-                                   {},
-                                   false /*symbolize_ksyms*/};
-  ds_config.event_filter.AddEnabledEvent(
-      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
-
   FtraceMetadata metadata{};
   while (state.KeepRunning()) {
     writer.Reset(&stream);
 
     CompactSchedBuffer compact_buffer;
-    const uint8_t* parse_pos = page.get();
+    const uint8_t* parse_pos = page;
     perfetto::base::Optional<CpuReader::PageHeader> page_header =
         CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
 
@@ -337,10 +376,47 @@ static void BM_ParsePageFullOfSchedSwitch(benchmark::State& state) {
       return;
 
     CpuReader::ParsePagePayload(parse_pos, &page_header.value(), table,
-                                &ds_config, &compact_buffer, &writer,
+                                ds_config, &compact_buffer, &writer,
                                 &metadata);
 
     metadata.Clear();
   }
 }
+
+}  // namespace
+
+// Benchmark for the core logic of the ftrace binary format decoding.
+static void BM_ParsePageFullOfSchedSwitch(benchmark::State& state) {
+  const ExamplePage* test_case = &g_full_page_sched_switch;
+
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  ParsePageInLoop(state, page.get(), table, &ds_config);
+}
 BENCHMARK(BM_ParsePageFullOfSchedSwitch);
+
+// As above, with an event which has only integer fields.
+static void BM_ParsePageFullOfBinderTransaction(benchmark::State& state) {
+  ProtoTranslationTable* table = GetTable("android_seed_N2F62_3.10.49");
+  auto page = MakePageFullOfBinderTransaction(table);
+
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("binder", "binder_transaction")));
+
+  ParsePageInLoop(state, page.get(), table, &ds_config);
+}
+BENCHMARK(BM_ParsePageFullOfBinderTransaction);
@@ -1135,6 +1135,31 @@ TEST(CpuReaderTest, TaskRenameEvent) {
   EXPECT_THAT(metadata.pids, Contains(9999));
 }
 
+TEST(CpuReaderTest, SchedProcessFreeEvent) {
+  BundleProvider bundle_provider(base::kPageSize);
+
+  BinaryWriter writer;
+  ProtoTranslationTable* table = GetTable("android_seed_N2F62_3.10.49");
+
+  constexpr uint32_t kSchedProcessFreeId = 64;
+
+  writer.Write<int32_t>(1001);           // Common field.
+  writer.Write<int32_t>(0);              // Common pid
+  writer.WriteFixedString(16, "Hello");  // Comm
+  writer.Write<int32_t>(9999);           // Pid
+  writer.Write<int32_t>(120);            // Prio
+
+  auto input = writer.GetCopy();
+  auto length = writer.written();
+  FtraceMetadata metadata{};
+
+  ASSERT_TRUE(CpuReader::ParseEvent(kSchedProcessFreeId, input.get(),
+                                    input.get() + length, table,
+                                    bundle_provider.writer(), &metadata));
+  EXPECT_THAT(metadata.freed_pids, Contains(9999));
+  EXPECT_THAT(metadata.pids, Contains(9999));
+}
+
 // Page with a single sched_switch, no data loss.
 static char g_switch_page[] =
     R"(
@@ -1202,6 +1227,218 @@ TEST(CpuReaderTest, NewPacketOnLostEvents) {
   EXPECT_EQ(4u, packets[2].ftrace_events().event().size());
 }
 
+TEST(CpuReaderTest, RawPages) {
+  const ExamplePage* test_case = &g_six_sched_switch;
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+  const uint32_t sched_switch_id =
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch"));
+  ASSERT_TRUE(
+      CpuReader::SupportsRawPages(*table->GetEventById(sched_switch_id)));
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(sched_switch_id);
+  ds_config.raw_pages = true;
+  ds_config.raw_page_filter.AddEnabledEvent(sched_switch_id);
+
+  FtraceMetadata metadata{};
+  TraceWriterForTesting trace_writer;
+  CpuReader::ProcessPagesForDataSource(&trace_writer, &metadata, /*cpu=*/1,
+                                       &ds_config, page.get(), /*pages=*/1,
+                                       table, /*symbolizer=*/nullptr);
+
+  // The page is copied as is, up to the end of its events.
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(1u, packets.size());
+  const auto& bundle = packets[0].ftrace_events();
+  EXPECT_EQ(0u, bundle.event().size());
+  ASSERT_EQ(1u, bundle.raw_page().size());
+
+  const uint8_t* parse_pos = page.get();
+  base::Optional<CpuReader::PageHeader> page_header =
+      CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+  ASSERT_TRUE(page_header.has_value());
+  const std::string& raw_page = bundle.raw_page()[0];
+  ASSERT_EQ(static_cast<size_t>(parse_pos - page.get()) + page_header->size,
+            raw_page.size());
+  EXPECT_EQ(0, memcmp(raw_page.data(), page.get(), raw_page.size()));
+
+  // The pids are still collected for the process scraping.
+  EXPECT_THAT(metadata.pids, Contains(3733));
+  EXPECT_THAT(metadata.pids, Contains(10));
+}
+
+TEST(CpuReaderTest, RawPagesFallBackToParsing) {
+  const ExamplePage* test_case = &g_six_sched_switch;
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+
+  // sched_switch is enabled but not in the raw page filter (e.g. because
+  // another data source doesn't want raw pages), so the page is parsed.
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+  ds_config.raw_pages = true;
+
+  FtraceMetadata metadata{};
+  TraceWriterForTesting trace_writer;
+  CpuReader::ProcessPagesForDataSource(&trace_writer, &metadata, /*cpu=*/1,
+                                       &ds_config, page.get(), /*pages=*/1,
+                                       table, /*symbolizer=*/nullptr);
+
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(1u, packets.size());
+  EXPECT_EQ(0u, packets[0].ftrace_events().raw_page().size());
+  EXPECT_EQ(6u, packets[0].ftrace_events().event().size());
+}
+
+TEST(CpuReaderTest, WriteRawFormat) {
+  ProtoTranslationTable* table = GetTable(g_six_sched_switch.name);
+  const uint32_t sched_switch_id =
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch"));
+  EventFilter filter;
+  filter.AddEnabledEvent(sched_switch_id);
+
+  protozero::HeapBuffered<protos::pbzero::FtraceEventBundle> writer;
+  CpuReader::WriteRawFormat(table, filter, writer->set_raw_format());
+  protos::gen::FtraceEventBundle bundle;
+  ASSERT_TRUE(bundle.ParseFromString(writer.SerializeAsString()));
+
+  const auto& format = bundle.raw_format();
+  EXPECT_EQ(table->page_header_size_len(), format.page_header_size_len());
+  EXPECT_EQ(table->common_fields().size(), format.common_field().size());
+  ASSERT_EQ(1u, format.event().size());
+  const auto& event = format.event()[0];
+  EXPECT_EQ(sched_switch_id, event.id());
+  EXPECT_EQ(static_cast<uint32_t>(
+                protos::pbzero::FtraceEvent::kSchedSwitchFieldNumber),
+            event.proto_field_id());
+  EXPECT_EQ(table->GetEventById(sched_switch_id)->fields.size(),
+            event.field().size());
+}
+
+namespace {
+
+// Writes an irq_handler_entry event of the android_seed_N2F62_3.10.49 format.
+void WriteIrqHandlerEntry(BinaryWriter* writer,
+                          uint32_t time_delta,
+                          int32_t irq,
+                          const char* name) {
+  const uint32_t kIrqHandlerEntryId = 31;
+  const uint32_t name_size = static_cast<uint32_t>(strlen(name)) + 1;
+  const uint32_t size = 20 + name_size;
+  const uint32_t padded_size = (size + 3) & ~3u;
+  writer->Write<uint32_t>((padded_size / 4) | time_delta << 5);
+  writer->Write<uint16_t>(kIrqHandlerEntryId);  // Common type.
+  writer->Write<uint16_t>(0);                   // Common flags and preempt.
+  writer->Write<int32_t>(42);                   // Common pid.
+  writer->Write<int32_t>(irq);
+  writer->Write<uint32_t>(20 | name_size << 16);  // __data_loc name.
+  writer->Write<uint32_t>(0xc0de);                // Handler.
+  for (const char* c = name; *c; c++)
+    writer->Write<char>(*c);
+  for (uint32_t i = size - 1; i < padded_size; i++)
+    writer->Write<char>('\0');
+}
+
+}  // namespace
+
+TEST(CpuReaderTest, CompactEvents) {
+  ProtoTranslationTable* table = GetTable("android_seed_N2F62_3.10.49");
+  const uint32_t irq_id =
+      table->EventToFtraceId(GroupAndName("irq", "irq_handler_entry"));
+  ASSERT_TRUE(SupportsCompactEvents(*table->GetEventById(irq_id)));
+  EXPECT_FALSE(SupportsCompactEvents(*table->GetEventById(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")))));
+
+  BinaryWriter events;
+  WriteIrqHandlerEntry(&events, 0, 1, "timer");
+  WriteIrqHandlerEntry(&events, 100, -2, "eth0");
+  WriteIrqHandlerEntry(&events, 200, 1, "timer");
+  BinaryWriter writer;
+  writer.Write<uint64_t>(1000000);            // Page timestamp.
+  writer.Write<uint64_t>(events.written());  // Page size.
+  std::unique_ptr<uint8_t[]> page(new uint8_t[base::kPageSize]());
+  memcpy(page.get(), writer.GetCopy().get(), writer.written());
+  memcpy(page.get() + writer.written(), events.GetCopy().get(),
+         events.written());
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(irq_id);
+  ds_config.compact_events = true;
+  ds_config.compact_event_filter.AddEnabledEvent(irq_id);
+
+  FtraceMetadata metadata{};
+  TraceWriterForTesting trace_writer;
+  CpuReader::ProcessPagesForDataSource(&trace_writer, &metadata, /*cpu=*/1,
+                                       &ds_config, page.get(), /*pages=*/1,
+                                       table, /*symbolizer=*/nullptr);
+
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(1u, packets.size());
+  const auto& bundle = packets[0].ftrace_events();
+  EXPECT_EQ(0u, bundle.event().size());
+  ASSERT_EQ(1u, bundle.compact_events().size());
+
+  const auto& compact = bundle.compact_events()[0];
+  EXPECT_EQ(static_cast<uint32_t>(
+                protos::pbzero::FtraceEvent::kIrqHandlerEntryFieldNumber),
+            compact.proto_field_id());
+  EXPECT_THAT(compact.timestamp(), ElementsAre(1000000, 100, 200));
+  EXPECT_THAT(compact.pid(), ElementsAre(42, 42, 42));
+  EXPECT_THAT(compact.intern_table(), ElementsAre("timer", "eth0"));
+
+  // One column per field, in the order of the format file.
+  ASSERT_EQ(3u, compact.column().size());
+  EXPECT_EQ(1u, compact.column()[0].proto_field_id());
+  // ZigZag encoded 1, -2, 1.
+  EXPECT_THAT(compact.column()[0].signed_value(), ElementsAre(2, 3, 2));
+  EXPECT_EQ(2u, compact.column()[1].proto_field_id());
+  EXPECT_THAT(compact.column()[1].string_index(), ElementsAre(0, 1, 0));
+  EXPECT_EQ(3u, compact.column()[2].proto_field_id());
+  EXPECT_THAT(compact.column()[2].value(), ElementsAre(0xc0de, 0xc0de, 0xc0de));
+
+  EXPECT_THAT(metadata.pids, Contains(42));
+}
+
+TEST(CpuReaderTest, DeltaTimestamps) {
+  ProtoTranslationTable* table = GetTable("android_seed_N2F62_3.10.49");
+  const uint32_t irq_id =
+      table->EventToFtraceId(GroupAndName("irq", "irq_handler_entry"));
+
+  BinaryWriter events;
+  WriteIrqHandlerEntry(&events, 10, 1, "timer");
+  WriteIrqHandlerEntry(&events, 100, -2, "eth0");
+  WriteIrqHandlerEntry(&events, 200, 1, "timer");
+  BinaryWriter writer;
+  writer.Write<uint64_t>(1000000);            // Page timestamp.
+  writer.Write<uint64_t>(events.written());  // Page size.
+  std::unique_ptr<uint8_t[]> page(new uint8_t[base::kPageSize]());
+  memcpy(page.get(), writer.GetCopy().get(), writer.written());
+  memcpy(page.get() + writer.written(), events.GetCopy().get(),
+         events.written());
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(irq_id);
+  ds_config.delta_timestamps = true;
+
+  FtraceMetadata metadata{};
+  TraceWriterForTesting trace_writer;
+  CpuReader::ProcessPagesForDataSource(&trace_writer, &metadata, /*cpu=*/1,
+                                       &ds_config, page.get(), /*pages=*/1,
+                                       table, /*symbolizer=*/nullptr);
+
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(1u, packets.size());
+  const auto& bundle = packets[0].ftrace_events();
+  EXPECT_EQ(1000000u, bundle.event_timestamp_base());
+  ASSERT_EQ(3u, bundle.event().size());
+  EXPECT_EQ(10u, bundle.event()[0].timestamp());
+  EXPECT_EQ(100u, bundle.event()[1].timestamp());
+  EXPECT_EQ(200u, bundle.event()[2].timestamp());
+  EXPECT_EQ("eth0", bundle.event()[1].irq_handler_entry().name());
+}
+
 // Page containing an absolute timestamp (RINGBUF_TYPE_TIME_STAMP).
 static char g_abs_timestamp[] =
     R"(
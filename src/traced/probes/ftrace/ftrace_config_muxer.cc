@@ -28,6 +28,7 @@
 #include "protos/perfetto/trace/ftrace/sched.pbzero.h"
 #include "src/traced/probes/ftrace/atrace_wrapper.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
 
 namespace perfetto {
 namespace {
@@ -68,6 +69,27 @@ std::pair<std::string, std::string> EventToStringGroupAndName(
                         event.substr(slash_pos + 1));
 }
 
+// Returns true if |spec| ("group/name", "name" or "group/*", as in
+// FtraceConfig.ftrace_events) refers to |event|.
+bool EventMatches(const std::string& spec, const Event& event) {
+  std::string group;
+  std::string name;
+  std::tie(group, name) = EventToStringGroupAndName(spec);
+  if (!group.empty() && group != event.group)
+    return false;
+  return name == "*" || name == event.name;
+}
+
+// Returns the filter of FtraceConfig.kernel_filters for |event|, or nullptr.
+const std::string* GetKernelFilter(const FtraceConfig& request,
+                                   const Event& event) {
+  for (const auto& kernel_filter : request.kernel_filters()) {
+    if (EventMatches(kernel_filter.event(), event))
+      return &kernel_filter.filter();
+  }
+  return nullptr;
+}
+
 void UnionInPlace(const std::vector<std::string>& unsorted_a,
                   std::vector<std::string>* out) {
   std::vector<std::string> a = unsorted_a;
@@ -502,9 +524,30 @@ FtraceConfigId FtraceConfigMuxer::SetupConfig(const FtraceConfig& request) {
     // events during parsing).
     if (current_state_.ftrace_events.IsEventEnabled(event->ftrace_event_id) ||
         std::string("ftrace") == event->group) {
+      // The kernel filter set by another config would drop events that this
+      // one wants: remove it, the other config gets extra events instead.
+      if (current_state_.kernel_filtered_events.IsEventEnabled(
+              event->ftrace_event_id) &&
+          ftrace_->ClearEventFilter(event->group, event->name)) {
+        current_state_.kernel_filtered_events.DisableEvent(
+            event->ftrace_event_id);
+      }
       filter.AddEnabledEvent(event->ftrace_event_id);
       continue;
     }
+    // Set the kernel filter before enabling the event, so that no unfiltered
+    // events are recorded.
+    const std::string* kernel_filter = GetKernelFilter(request, *event);
+    if (kernel_filter && !kernel_filter->empty()) {
+      if (ftrace_->SetEventFilter(event->group, event->name, *kernel_filter)) {
+        current_state_.kernel_filtered_events.AddEnabledEvent(
+            event->ftrace_event_id);
+      } else {
+        PERFETTO_ELOG("Failed to set the filter of %s to \"%s\"",
+                      group_and_name.ToString().c_str(),
+                      kernel_filter->c_str());
+      }
+    }
     if (ftrace_->EnableEvent(event->group, event->name)) {
       current_state_.ftrace_events.AddEnabledEvent(event->ftrace_event_id);
       filter.AddEnabledEvent(event->ftrace_event_id);
@@ -518,11 +561,53 @@ FtraceConfigId FtraceConfigMuxer::SetupConfig(const FtraceConfig& request) {
 
   std::vector<std::string> apps(request.atrace_apps());
   std::vector<std::string> categories(request.atrace_categories());
+  EventFilter raw_page_filter;
+  if (request.raw_pages()) {
+    for (size_t ftrace_event_id : filter.GetEnabledEvents()) {
+      const Event* event = table_->GetEventById(ftrace_event_id);
+      if (event && CpuReader::SupportsRawPages(*event))
+        raw_page_filter.AddEnabledEvent(ftrace_event_id);
+    }
+  }
+  EventFilter compact_event_filter;
+  if (request.compact_events()) {
+    for (size_t ftrace_event_id : filter.GetEnabledEvents()) {
+      const Event* event = table_->GetEventById(ftrace_event_id);
+      if (event && SupportsCompactEvents(*event))
+        compact_event_filter.AddEnabledEvent(ftrace_event_id);
+    }
+  }
+
+  EventRateLimiter rate_limiter;
+  for (const auto& rate_limit : request.rate_limits()) {
+    if (rate_limit.max_events_per_sec() == 0)
+      continue;
+    for (size_t ftrace_event_id : filter.GetEnabledEvents()) {
+      const Event* event = table_->GetEventById(ftrace_event_id);
+      if (event && EventMatches(rate_limit.event(), *event) &&
+          !rate_limiter.HasLimit(ftrace_event_id)) {
+        rate_limiter.SetLimit(ftrace_event_id, rate_limit.max_events_per_sec());
+        // The events of a raw page can't be dropped.
+        raw_page_filter.DisableEvent(ftrace_event_id);
+      }
+    }
+  }
+
   FtraceConfigId id = ++last_id_;
-  ds_configs_.emplace(
+  auto it_and_inserted = ds_configs_.emplace(
       std::piecewise_construct, std::forward_as_tuple(id),
       std::forward_as_tuple(std::move(filter), compact_sched, std::move(apps),
                             std::move(categories), request.symbolize_ksyms()));
+  it_and_inserted.first->second.raw_pages = request.raw_pages();
+  it_and_inserted.first->second.raw_page_filter = std::move(raw_page_filter);
+  it_and_inserted.first->second.compact_events = request.compact_events();
+  it_and_inserted.first->second.delta_timestamps = request.delta_timestamps();
+  it_and_inserted.first->second.compact_event_filter =
+      std::move(compact_event_filter);
+  if (!rate_limiter.empty()) {
+    it_and_inserted.first->second.rate_limiters.assign(ftrace_->NumberOfCpus(),
+                                                       rate_limiter);
+  }
   return id;
 }
 
@@ -587,6 +672,10 @@ bool FtraceConfigMuxer::RemoveConfig(FtraceConfigId config_id) {
     PERFETTO_DCHECK(event);
     if (ftrace_->DisableEvent(event->group, event->name))
       current_state_.ftrace_events.DisableEvent(event->ftrace_event_id);
+    if (current_state_.kernel_filtered_events.IsEventEnabled(id) &&
+        ftrace_->ClearEventFilter(event->group, event->name)) {
+      current_state_.kernel_filtered_events.DisableEvent(id);
+    }
   }
 
   // If there aren't any more active configs, disable ftrace.
@@ -55,6 +55,27 @@ struct FtraceDataSourceConfig {
 
   // When enabled will turn on the the kallsyms symbolizer in CpuReader.
   const bool symbolize_ksyms;
+
+  // With FtraceConfig.raw_pages, the pages whose events are all in
+  // |raw_page_filter|, i.e. enabled and decodable by trace_processor, are
+  // written as they are.
+  bool raw_pages = false;
+  EventFilter raw_page_filter;
+
+  // With FtraceConfig.compact_events, the enabled events which are in
+  // |compact_event_filter| are written as columns in
+  // FtraceEventBundle.compact_events, see SupportsCompactEvents().
+  bool compact_events = false;
+  EventFilter compact_event_filter;
+
+  // With FtraceConfig.delta_timestamps, the timestamps of the FtraceEvent-s
+  // are deltas from the previous event of their bundle.
+  bool delta_timestamps = false;
+
+  // With FtraceConfig.rate_limits, the state of the limits on each cpu,
+  // indexed by cpu. Each CpuReader only updates the entry of its own cpu,
+  // hence this is mutable while the rest of the config isn't.
+  mutable std::vector<EventRateLimiter> rate_limiters;
 };
 
 // Ftrace is a bunch of globally modifiable persistent state.
@@ -125,6 +146,8 @@ class FtraceConfigMuxer {
 
   struct FtraceState {
     EventFilter ftrace_events;
+    // The events whose kernel filter was set by FtraceConfig.kernel_filters.
+    EventFilter kernel_filtered_events;
     // Used only in Android for ATRACE_EVENT/os.Trace() userspace
     std::vector<std::string> atrace_apps;
     std::vector<std::string> atrace_categories;
@@ -864,6 +864,93 @@ TEST_F(FtraceConfigMuxerTest, FallbackOnSetEvent) {
   ASSERT_TRUE(model.RemoveConfig(id));
 }
 
+TEST_F(FtraceConfigMuxerTest, KernelFilters) {
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfigMuxer model(&ftrace, table_.get(), {});
+
+  FtraceConfig config =
+      CreateFtraceConfig({"sched/sched_switch", "cgroup/cgroup_mkdir"});
+  auto* kernel_filter = config.add_kernel_filters();
+  kernel_filter->set_event("sched/*");
+  kernel_filter->set_filter("prev_pid != 0");
+
+  EXPECT_CALL(ftrace, WriteToFile(_, _)).Times(AnyNumber());
+  {
+    // The filter is set before the event is enabled.
+    testing::InSequence seq;
+    EXPECT_CALL(ftrace, WriteToFile("/root/events/sched/sched_switch/filter",
+                                    "prev_pid != 0"));
+    EXPECT_CALL(ftrace,
+                WriteToFile("/root/events/sched/sched_switch/enable", "1"));
+  }
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/cgroup/cgroup_mkdir/filter", _))
+      .Times(0);
+  FtraceConfigId id_filtered = model.SetupConfig(config);
+  ASSERT_TRUE(id_filtered);
+  testing::Mock::VerifyAndClearExpectations(&ftrace);
+
+  // A second config without the filter clears it, since it applies to both.
+  EXPECT_CALL(ftrace, WriteToFile(_, _)).Times(AnyNumber());
+  EXPECT_CALL(ftrace,
+              WriteToFile("/root/events/sched/sched_switch/filter", "0"));
+  FtraceConfigId id_unfiltered =
+      model.SetupConfig(CreateFtraceConfig({"sched/sched_switch"}));
+  ASSERT_TRUE(id_unfiltered);
+  testing::Mock::VerifyAndClearExpectations(&ftrace);
+
+  EXPECT_CALL(ftrace, WriteToFile(_, _)).Times(AnyNumber());
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/sched/sched_switch/filter", _))
+      .Times(0);
+  ASSERT_TRUE(model.RemoveConfig(id_filtered));
+  ASSERT_TRUE(model.RemoveConfig(id_unfiltered));
+}
+
+TEST_F(FtraceConfigMuxerTest, RemoveConfigClearsKernelFilters) {
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfigMuxer model(&ftrace, table_.get(), {});
+
+  FtraceConfig config = CreateFtraceConfig({"sched/sched_switch"});
+  auto* kernel_filter = config.add_kernel_filters();
+  kernel_filter->set_event("sched_switch");
+  kernel_filter->set_filter("prev_pid != 0");
+
+  EXPECT_CALL(ftrace, WriteToFile(_, _)).Times(AnyNumber());
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/sched/sched_switch/filter",
+                                  "prev_pid != 0"));
+  FtraceConfigId id = model.SetupConfig(config);
+  ASSERT_TRUE(id);
+
+  EXPECT_CALL(ftrace,
+              WriteToFile("/root/events/sched/sched_switch/filter", "0"));
+  ASSERT_TRUE(model.RemoveConfig(id));
+}
+
+TEST_F(FtraceConfigMuxerTest, RateLimits) {
+  NiceMock<MockFtraceProcfs> ftrace;
+  ON_CALL(ftrace, NumberOfCpus()).WillByDefault(Return(2));
+  FtraceConfigMuxer model(&ftrace, table_.get(), {});
+
+  FtraceConfig config =
+      CreateFtraceConfig({"sched/sched_switch", "cgroup/cgroup_mkdir"});
+  auto* rate_limit = config.add_rate_limits();
+  rate_limit->set_event("sched/sched_switch");
+  rate_limit->set_max_events_per_sec(10);
+  FtraceConfigId id = model.SetupConfig(config);
+  ASSERT_TRUE(id);
+
+  const FtraceDataSourceConfig* ds_config = model.GetDataSourceConfig(id);
+  ASSERT_TRUE(ds_config);
+  ASSERT_EQ(ds_config->rate_limiters.size(), 2u);
+  EXPECT_TRUE(ds_config->rate_limiters[0].HasLimit(kFakeSchedSwitchEventId));
+  EXPECT_FALSE(ds_config->rate_limiters[0].HasLimit(kCgroupMkdirEventId));
+
+  // No limits, no state.
+  FtraceConfigId id_unlimited =
+      model.SetupConfig(CreateFtraceConfig({"sched/sched_switch"}));
+  ASSERT_TRUE(id_unlimited);
+  EXPECT_TRUE(model.GetDataSourceConfig(id_unlimited)->rate_limiters.empty());
+}
+
 TEST_F(FtraceConfigMuxerTest, CompactSchedConfig) {
   // Set scheduling event format as validated. The pre-parsed format itself
   // doesn't need to be sensible, as the tests won't use it.
@@ -83,6 +83,10 @@ bool ValidConfig(const FtraceConfig& config) {
       return false;
     }
   }
+  if (config.drain_buffer_percent() > 100) {
+    PERFETTO_ELOG("Bad drain_buffer_percent %u", config.drain_buffer_percent());
+    return false;
+  }
   return true;
 }
 
@@ -17,14 +17,19 @@
 #include "src/traced/probes/ftrace/ftrace_controller.h"
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <utility>
 
@@ -48,6 +53,9 @@
 #include "src/traced/probes/ftrace/ftrace_stats.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
 namespace perfetto {
 namespace {
 
@@ -71,6 +79,9 @@ constexpr size_t kMaxPagesPerCpuPerReadTick = 256;  // 1 MB per cpu
 // should be a single counter in the cpu_reader, similar to lost_events case.
 constexpr size_t kParsingBufferSizePages = 32;
 
+// Upper bound for FtraceConfig.num_reader_threads.
+constexpr size_t kMaxReaderThreads = 32;
+
 uint32_t ClampDrainPeriodMs(uint32_t drain_period_ms) {
   if (drain_period_ms == 0) {
     return kDefaultDrainPeriodMs;
@@ -124,8 +135,10 @@ std::unique_ptr<FtraceController> FtraceController::Create(
   if (!ftrace_procfs)
     return nullptr;
 
+  // Most event formats are read only once a config enables the event.
   auto table = ProtoTranslationTable::Create(
-      ftrace_procfs.get(), GetStaticEventInfo(), GetStaticCommonFieldsInfo());
+      ftrace_procfs.get(), GetStaticEventInfo(), GetStaticCommonFieldsInfo(),
+      /*parse_lazily=*/true);
 
   if (!table)
     return nullptr;
@@ -152,7 +165,11 @@ FtraceController::FtraceController(std::unique_ptr<FtraceProcfs> ftrace_procfs,
       ftrace_procfs_(std::move(ftrace_procfs)),
       table_(std::move(table)),
       ftrace_config_muxer_(std::move(model)),
-      weak_factory_(this) {}
+      weak_factory_(this) {
+  // Opt-in persistent cache of the parsed kallsyms, see LazyKernelSymbolizer.
+  if (const char* cache_path = getenv("PERFETTO_KALLSYMS_CACHE"))
+    symbolizer_->set_cache_path(cache_path);
+}
 
 FtraceController::~FtraceController() {
   for (const auto* data_source : data_sources_)
@@ -162,6 +179,12 @@ FtraceController::~FtraceController() {
   StopIfNeeded();
 }
 
+FtraceController::ReaderThread::ReaderThread(size_t index)
+    : task_runner(base::ThreadTaskRunner::CreateAndStart(
+          "ftrace_reader" + std::to_string(index))),
+      parsing_mem(base::PagedMemory::Allocate(base::kPageSize *
+                                              kParsingBufferSizePages)) {}
+
 uint64_t FtraceController::NowMs() const {
   return static_cast<uint64_t>(base::GetWallTimeMs().count());
 }
@@ -171,9 +194,22 @@ void FtraceController::StartIfNeeded() {
     return;
   PERFETTO_DCHECK(!started_data_sources_.empty());
   PERFETTO_DCHECK(per_cpu_.empty());
+  PERFETTO_DCHECK(reader_threads_.empty());
+
+  // The config of the first data source decides whether the cpus are read on
+  // the main thread or on reader threads, until all data sources stop.
+  FtraceDataSource* first_data_source = *started_data_sources_.begin();
+  size_t num_reader_threads = std::min(
+      {static_cast<size_t>(first_data_source->config().num_reader_threads()),
+       ftrace_procfs_->NumberOfCpus(), kMaxReaderThreads});
+  if (num_reader_threads > 1 &&
+      first_data_source->SetupReaderThreadOutputs(num_reader_threads)) {
+    for (size_t i = 0; i < num_reader_threads; i++)
+      reader_threads_.emplace_back(new ReaderThread(i));
+  }
 
   // Lazily allocate the memory used for reading & parsing ftrace.
-  if (!parsing_mem_.IsValid()) {
+  if (reader_threads_.empty() && !parsing_mem_.IsValid()) {
     parsing_mem_ =
         base::PagedMemory::Allocate(base::kPageSize * kParsingBufferSizePages);
   }
@@ -188,8 +224,27 @@ void FtraceController::StartIfNeeded() {
     per_cpu_.emplace_back(std::move(reader), period_page_quota);
   }
 
+  // Also read each cpu as soon as its buffer is filled up to the watermark, if
+  // the kernel supports it. Otherwise, the cpus are only read on ReadTick.
+  uint32_t buffer_percent = first_data_source->config().drain_buffer_percent();
+  if (buffer_percent > 0) {
+    saved_buffer_percent_ = ftrace_procfs_->GetBufferPercent();
+    if (saved_buffer_percent_ &&
+        ftrace_procfs_->SetBufferPercent(buffer_percent)) {
+      watermark_pages_ =
+          std::max<size_t>(1, period_page_quota * buffer_percent / 100);
+    } else {
+      PERFETTO_ELOG("Failed to set buffer_percent, using drain_period_ms only");
+    }
+  }
+
+  flush_budget_ms_ = first_data_source->config().flush_latency_budget_ms();
+  flushes_over_budget_ = 0;
+
   // Start the repeating read tasks.
   auto generation = ++generation_;
+  if (watermark_pages_)
+    WatchCpuBuffers(generation);
   auto drain_period_ms = GetDrainPeriodMs();
   auto weak_this = weak_factory_.GetWeakPtr();
   task_runner_->PostDelayedTask(
@@ -241,17 +296,21 @@ void FtraceController::ReadTick(int generation) {
 #endif
 
   // Read all cpu buffers with remaining per-period quota.
+  std::vector<size_t> max_pages_per_cpu(per_cpu_.size());
+  for (size_t i = 0; i < per_cpu_.size(); i++) {
+    max_pages_per_cpu[i] =
+        std::min(per_cpu_[i].period_page_quota, kMaxPagesPerCpuPerReadTick);
+  }
+  std::vector<size_t> pages_read_per_cpu = ReadCpus(max_pages_per_cpu);
+
   bool all_cpus_done = true;
-  uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
   for (size_t i = 0; i < per_cpu_.size(); i++) {
     size_t orig_quota = per_cpu_[i].period_page_quota;
     if (orig_quota == 0)
       continue;
 
-    size_t max_pages = std::min(orig_quota, kMaxPagesPerCpuPerReadTick);
-    size_t pages_read = per_cpu_[i].reader->ReadCycle(
-        parsing_buf, kParsingBufferSizePages, max_pages, started_data_sources_);
-
+    size_t max_pages = max_pages_per_cpu[i];
+    size_t pages_read = pages_read_per_cpu[i];
     size_t new_quota = (pages_read >= orig_quota) ? 0 : orig_quota - pages_read;
     per_cpu_[i].period_page_quota = new_quota;
 
@@ -281,6 +340,8 @@ void FtraceController::ReadTick(int generation) {
     size_t period_page_quota = ftrace_config_muxer_->GetPerCpuBufferSizePages();
     for (auto& per_cpu : per_cpu_)
       per_cpu.period_page_quota = period_page_quota;
+    if (watermark_pages_)
+      WatchCpuBuffers(generation);
 
     auto drain_period_ms = GetDrainPeriodMs();
     task_runner_->PostDelayedTask(
@@ -292,6 +353,128 @@ void FtraceController::ReadTick(int generation) {
   }
 }
 
+// The trace_pipe_raw of a cpu is readable when its buffer is filled up to the
+// buffer_percent watermark. It stays readable until it is drained back below,
+// which might take a few reads due to |kMaxPagesPerCpuPerReadTick|, but these
+// reads share the drain period quota with ReadTick: once it is used up, the cpu
+// isn't watched until the next drain period.
+//
+// Before Linux 6.1, poll() ignores buffer_percent and the fd is readable as
+// soon as there is any data. A read of far less than the watermark detects this
+// (or a ReadTick which drained the cpu meanwhile), and stops watching the cpu
+// until the next drain period: we don't want to wake up for every event.
+void FtraceController::OnCpuBufferReadable(size_t cpu, int generation) {
+  metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
+                             metatrace::FTRACE_READ_TICK);
+  if (started_data_sources_.empty() || generation != generation_)
+    return;
+
+  PerCpuState& per_cpu = per_cpu_[cpu];
+  std::vector<size_t> max_pages_per_cpu(per_cpu_.size());
+  max_pages_per_cpu[cpu] =
+      std::min(per_cpu.period_page_quota, kMaxPagesPerCpuPerReadTick);
+  size_t pages_read = 0;
+  if (max_pages_per_cpu[cpu] > 0) {
+    pages_read = ReadCpus(max_pages_per_cpu)[cpu];
+    per_cpu.period_page_quota -= pages_read;
+    observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
+  }
+
+  if (per_cpu.period_page_quota == 0 || pages_read * 2 < watermark_pages_) {
+    task_runner_->RemoveFileDescriptorWatch(per_cpu.reader->trace_fd());
+    per_cpu.watching_fd = false;
+  }
+}
+
+void FtraceController::WatchCpuBuffers(int generation) {
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (size_t cpu = 0; cpu < per_cpu_.size(); cpu++) {
+    PerCpuState& per_cpu = per_cpu_[cpu];
+    if (per_cpu.watching_fd)
+      continue;
+    task_runner_->AddFileDescriptorWatch(
+        per_cpu.reader->trace_fd(), [weak_this, cpu, generation] {
+          if (weak_this)
+            weak_this->OnCpuBufferReadable(cpu, generation);
+        });
+    per_cpu.watching_fd = true;
+  }
+}
+
+void FtraceController::UnwatchCpuBuffers() {
+  for (PerCpuState& per_cpu : per_cpu_) {
+    if (!per_cpu.watching_fd)
+      continue;
+    task_runner_->RemoveFileDescriptorWatch(per_cpu.reader->trace_fd());
+    per_cpu.watching_fd = false;
+  }
+}
+
+std::vector<size_t> FtraceController::ReadCpus(
+    const std::vector<size_t>& max_pages) {
+  PERFETTO_DCHECK(max_pages.size() == per_cpu_.size());
+  std::vector<size_t> pages_read(per_cpu_.size());
+
+  if (reader_threads_.empty()) {
+    std::vector<CpuReader::DataSourceOutput> outputs;
+    for (FtraceDataSource* ds : started_data_sources_) {
+      outputs.push_back({ds->trace_writer(), ds->mutable_metadata(),
+                         ds->parsing_config()});
+    }
+    uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
+    for (size_t i = 0; i < per_cpu_.size(); i++) {
+      if (max_pages[i] == 0)
+        continue;
+      pages_read[i] = per_cpu_[i].reader->ReadCycle(
+          parsing_buf, kParsingBufferSizePages, max_pages[i], outputs);
+    }
+    return pages_read;
+  }
+
+  // The reader threads can use but not create the kernel symbol map.
+  const size_t num_threads = reader_threads_.size();
+  std::vector<std::vector<CpuReader::DataSourceOutput>> outputs(num_threads);
+  for (FtraceDataSource* ds : started_data_sources_) {
+    if (ds->parsing_config()->symbolize_ksyms)
+      symbolizer_->GetOrCreateKernelSymbolMap();
+    for (size_t t = 0; t < num_threads; t++) {
+      FtraceDataSource::ReaderThreadOutput* output =
+          ds->reader_thread_output(t);
+      outputs[t].push_back(
+          {output->writer.get(), &output->metadata, ds->parsing_config()});
+    }
+  }
+
+  // The main thread blocks until all the threads are done: the data sources
+  // and their writers can't go away, nor be used by anything else, meanwhile.
+  std::mutex mutex;
+  std::condition_variable threads_done;
+  size_t pending_threads = num_threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    ReaderThread* thread = reader_threads_[t].get();
+    thread->task_runner.PostTask([&, t, thread] {
+      uint8_t* parsing_buf = static_cast<uint8_t*>(thread->parsing_mem.Get());
+      for (size_t i = t; i < per_cpu_.size(); i += num_threads) {
+        if (max_pages[i] == 0)
+          continue;
+        pages_read[i] = per_cpu_[i].reader->ReadCycle(
+            parsing_buf, kParsingBufferSizePages, max_pages[i], outputs[t]);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending_threads == 0)
+        threads_done.notify_one();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    threads_done.wait(lock, [&] { return pending_threads == 0; });
+  }
+
+  for (FtraceDataSource* ds : started_data_sources_)
+    ds->MergeReaderThreadMetadata();
+  return pages_read;
+}
+
 uint32_t FtraceController::GetDrainPeriodMs() {
   if (data_sources_.empty())
     return kDefaultDrainPeriodMs;
@@ -324,16 +507,89 @@ void FtraceController::Flush(FlushRequestID flush_id) {
   // events.
   size_t per_cpu_buf_size_pages =
       ftrace_config_muxer_->GetPerCpuBufferSizePages();
-  uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
-  for (size_t i = 0; i < per_cpu_.size(); i++) {
-    per_cpu_[i].reader->ReadCycle(parsing_buf, kParsingBufferSizePages,
-                                  per_cpu_buf_size_pages,
-                                  started_data_sources_);
+  std::vector<size_t> max_pages(per_cpu_.size(), per_cpu_buf_size_pages);
+  if (flush_budget_ms_ > 0) {
+    FlushStep(flush_id, generation_, NowMs() + flush_budget_ms_,
+              std::move(max_pages));
+    return;
   }
+  ReadCpus(max_pages);
+  observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
+  CompleteFlush(flush_id);
+}
+
+// Like ReadTick, the flush yields to the other tasks after reading
+// |kMaxPagesPerCpuPerReadTick| pages of each cpu. Each cpu is read until it
+// is caught up or its buffer size has been read, as in a flush without
+// budget, but no longer than the budget altogether.
+void FtraceController::FlushStep(FlushRequestID flush_id,
+                                 int generation,
+                                 uint64_t deadline_ms,
+                                 std::vector<size_t> pages_left) {
+  metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
+                             metatrace::FTRACE_CPU_FLUSH);
+  // Ftrace was stopped, and maybe restarted, since the flush began: there is
+  // nothing left to read for it.
+  if (generation != generation_) {
+    CompleteFlush(flush_id);
+    return;
+  }
+
+  PERFETTO_DCHECK(pages_left.size() == per_cpu_.size());
+  std::vector<size_t> max_pages(per_cpu_.size());
+  for (size_t i = 0; i < per_cpu_.size(); i++)
+    max_pages[i] = std::min(pages_left[i], kMaxPagesPerCpuPerReadTick);
+  std::vector<size_t> pages_read = ReadCpus(max_pages);
   observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
 
-  for (FtraceDataSource* data_source : started_data_sources_)
+  bool all_cpus_done = true;
+  for (size_t i = 0; i < per_cpu_.size(); i++) {
+    // A cpu which was caught up isn't read again.
+    if (pages_read[i] < max_pages[i]) {
+      pages_left[i] = 0;
+      continue;
+    }
+    pages_left[i] -= pages_read[i];
+    if (pages_left[i] > 0)
+      all_cpus_done = false;
+  }
+
+  if (!all_cpus_done) {
+    if (NowMs() < deadline_ms) {
+      auto weak_this = weak_factory_.GetWeakPtr();
+      task_runner_->PostTask([weak_this, flush_id, generation, deadline_ms,
+                              pages_left] {
+        if (weak_this)
+          weak_this->FlushStep(flush_id, generation, deadline_ms, pages_left);
+      });
+      return;
+    }
+    PERFETTO_DLOG("Acking ftrace flush %" PRIu64 " before draining the cpus",
+                  flush_id);
+    flushes_over_budget_++;
+  }
+  CompleteFlush(flush_id);
+}
+
+void FtraceController::CompleteFlush(FlushRequestID flush_id) {
+  for (FtraceDataSource* data_source : started_data_sources_) {
+    WriteRawFormat(data_source);
     data_source->OnFtraceFlushComplete(flush_id);
+  }
+}
+
+// The format is written again on each flush so that it is still in the trace
+// buffer, if it is a ring buffer, when the trace is read.
+void FtraceController::WriteRawFormat(FtraceDataSource* data_source) {
+  const FtraceDataSourceConfig* ds_config = data_source->parsing_config();
+  if (!ds_config->raw_pages)
+    return;
+  TraceWriter::TracePacketHandle packet =
+      data_source->trace_writer()->NewTracePacket();
+  auto* bundle = packet->set_ftrace_events();
+  bundle->set_cpu(0);
+  CpuReader::WriteRawFormat(table_.get(), ds_config->raw_page_filter,
+                            bundle->set_raw_format());
 }
 
 void FtraceController::StopIfNeeded() {
@@ -344,7 +600,14 @@ void FtraceController::StopIfNeeded() {
   // ask for an explicit flush before stopping, unless it needs to perform a
   // non-graceful stop.
 
+  // Joins the threads, which are idle outside of ReadCpus().
+  reader_threads_.clear();
+  UnwatchCpuBuffers();
   per_cpu_.clear();
+  if (watermark_pages_ && saved_buffer_percent_)
+    ftrace_procfs_->SetBufferPercent(*saved_buffer_percent_);
+  watermark_pages_ = 0;
+  saved_buffer_percent_ = base::nullopt;
   symbolizer_->Destroy();
 
   if (parsing_mem_.IsValid()) {
@@ -374,11 +637,19 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
   FtraceConfigId config_id = data_source->config_id();
   PERFETTO_CHECK(config_id);
 
+  // Fails if ftrace is already being read on multiple threads and this data
+  // source can't create a writer for each of them.
+  if (!reader_threads_.empty() &&
+      !data_source->SetupReaderThreadOutputs(reader_threads_.size())) {
+    return false;
+  }
+
   if (!ftrace_config_muxer_->ActivateConfig(config_id))
     return false;
 
   started_data_sources_.insert(data_source);
   StartIfNeeded();
+  WriteRawFormat(data_source);
 
   // If the config is requesting to symbolize kernel addresses, create the
   // symbolizer and parse /proc/kallsyms (it will take 200-300 ms). This is not
@@ -417,6 +688,7 @@ void FtraceController::DumpFtraceStats(FtraceStats* stats) {
     stats->kernel_symbols_mem_kb =
         static_cast<uint32_t>(symbol_map->size_bytes() / 1024);
   }
+  stats->flushes_over_budget = flushes_over_budget_;
 }
 
 FtraceController::Observer::~Observer() = default;
@@ -26,9 +26,12 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -98,6 +101,15 @@ class FtraceController {
         : reader(std::move(_reader)), period_page_quota(_period_page_quota) {}
     std::unique_ptr<CpuReader> reader;
     size_t period_page_quota = 0;
+    bool watching_fd = false;
+  };
+
+  // A worker thread which reads the cpus |index|, |index| + N, |index| + 2N...
+  // out of N, with FtraceConfig.num_reader_threads > 1.
+  struct ReaderThread {
+    explicit ReaderThread(size_t index);
+    base::ThreadTaskRunner task_runner;
+    base::PagedMemory parsing_mem;
   };
 
   FtraceController(const FtraceController&) = delete;
@@ -106,8 +118,34 @@ class FtraceController {
   // Periodic task that reads all per-cpu ftrace buffers.
   void ReadTick(int generation);
 
+  // With FtraceConfig.drain_buffer_percent: reads |cpu| once its buffer is
+  // filled up to the watermark, without waiting for the next ReadTick.
+  void OnCpuBufferReadable(size_t cpu, int generation);
+  void WatchCpuBuffers(int generation);
+  void UnwatchCpuBuffers();
+
+  // Reads at most |max_pages[cpu]| pages from each cpu into the started data
+  // sources, on the main thread or in parallel on the reader threads. Returns
+  // the number of pages read from each cpu, once all of them have been read.
+  std::vector<size_t> ReadCpus(const std::vector<size_t>& max_pages);
+
   uint32_t GetDrainPeriodMs();
 
+  // With FtraceConfig.flush_latency_budget_ms: reads at most |pages_left[cpu]|
+  // pages of each cpu for the flush, |kMaxPagesPerCpuPerReadTick| at a time,
+  // reposting itself until the cpus are drained or |deadline_ms| is reached.
+  void FlushStep(FlushRequestID flush_id,
+                 int generation,
+                 uint64_t deadline_ms,
+                 std::vector<size_t> pages_left);
+
+  // Acks the flush to all the started data sources.
+  void CompleteFlush(FlushRequestID flush_id);
+
+  // With FtraceConfig.raw_pages, writes the layout of the events of the raw
+  // pages of |data_source|.
+  void WriteRawFormat(FtraceDataSource* data_source);
+
   void StartIfNeeded();
   void StopIfNeeded();
 
@@ -121,6 +159,11 @@ class FtraceController {
   int generation_ = 0;
   bool atrace_running_ = false;
   std::vector<PerCpuState> per_cpu_;  // empty if tracing isn't active
+  std::vector<std::unique_ptr<ReaderThread>> reader_threads_;  // Can be empty.
+  size_t watermark_pages_ = 0;  // 0 if the cpu buffers aren't poll()-ed.
+  base::Optional<uint32_t> saved_buffer_percent_;
+  uint32_t flush_budget_ms_ = 0;  // 0 if flushes read all the cpus at once.
+  uint32_t flushes_over_budget_ = 0;
   std::set<FtraceDataSource*> data_sources_;
   std::set<FtraceDataSource*> started_data_sources_;
   base::WeakPtrFactory<FtraceController> weak_factory_;  // Keep last.
@@ -183,6 +183,7 @@ class TestFtraceController : public FtraceController,
   MockFtraceProcfs* procfs() { return procfs_; }
   uint64_t NowMs() const override { return now_ms; }
   uint32_t drain_period_ms() { return GetDrainPeriodMs(); }
+  size_t num_reader_threads() { return reader_threads_.size(); }
 
   std::unique_ptr<FtraceDataSource> AddFakeDataSource(const FtraceConfig& cfg) {
     std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
@@ -360,6 +361,126 @@ TEST(FtraceControllerTest, ControllerMayDieFirst) {
   data_source.reset();
 }
 
+TEST(FtraceControllerTest, ReaderThreads) {
+  auto controller = CreateTestController(true /* nice procfs */, 4 /* cpus */);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_num_reader_threads(8);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  data_source->set_trace_writer_factory([] {
+    return std::unique_ptr<TraceWriter>(new TraceWriterForTesting());
+  });
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+
+  // Clamped to the number of cpus.
+  EXPECT_EQ(controller->num_reader_threads(), 4u);
+
+  // A data source which can't create a writer for each thread can't start.
+  auto data_source_without_factory =
+      controller->AddFakeDataSource(CreateFtraceConfig({"group/foo"}));
+  ASSERT_TRUE(data_source_without_factory);
+  EXPECT_FALSE(
+      controller->StartDataSource(data_source_without_factory.get()));
+
+  // Reads all the cpus on the threads and waits for them.
+  controller->Flush(1);
+
+  data_source_without_factory.reset();
+  data_source.reset();
+  EXPECT_EQ(controller->num_reader_threads(), 0u);
+}
+
+TEST(FtraceControllerTest, ReaderThreadsNeedWriterFactory) {
+  auto controller = CreateTestController(true /* nice procfs */, 4 /* cpus */);
+
+  // Falls back to reading on the main thread.
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_num_reader_threads(4);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+  EXPECT_EQ(controller->num_reader_threads(), 0u);
+  controller->Flush(1);
+}
+
+TEST(FtraceControllerTest, DrainBufferPercent) {
+  auto controller = CreateTestController(true /* nice procfs */, 2 /* cpus */);
+  ON_CALL(*controller->procfs(), ReadFileIntoString("/root/buffer_percent"))
+      .WillByDefault(Return("50\n"));
+  EXPECT_CALL(*controller->procfs(), ReadFileIntoString(_)).Times(AnyNumber());
+  EXPECT_CALL(*controller->procfs(), WriteToFile(_, _)).Times(AnyNumber());
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_drain_buffer_percent(25);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+
+  // Watches the trace_pipe_raw of each cpu.
+  std::vector<int> fds;
+  std::vector<std::function<void()>> callbacks;
+  EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_percent", "25"));
+  EXPECT_CALL(*controller->runner(), AddFileDescriptorWatch(_, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&](int fd, std::function<void()> callback) {
+        fds.push_back(fd);
+        callbacks.push_back(std::move(callback));
+      }));
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+  Mock::VerifyAndClearExpectations(controller->runner());
+  ASSERT_EQ(fds.size(), 2u);
+
+  // A wakeup with much less data than the watermark stops watching the cpu,
+  // until the next drain period.
+  EXPECT_CALL(*controller->runner(), RemoveFileDescriptorWatch(fds[0]));
+  callbacks[0]();
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  // Stops watching the other cpu and restores buffer_percent on teardown.
+  EXPECT_CALL(*controller->runner(), RemoveFileDescriptorWatch(fds[1]));
+  EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_percent", "50"));
+  data_source.reset();
+}
+
+TEST(FtraceControllerTest, DrainBufferPercentNotSupported) {
+  auto controller = CreateTestController(true /* nice procfs */);
+
+  // Only reads the cpus on ReadTick.
+  EXPECT_CALL(*controller->procfs(), ReadFileIntoString("/root/buffer_percent"))
+      .WillOnce(Return(""));
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_drain_buffer_percent(25);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  EXPECT_CALL(*controller->procfs(), WriteToFile(_, _)).Times(AnyNumber());
+  EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_percent", _))
+      .Times(0);
+  EXPECT_CALL(*controller->runner(), AddFileDescriptorWatch(_, _)).Times(0);
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+  data_source.reset();
+}
+
+TEST(FtraceControllerTest, FlushLatencyBudget) {
+  auto controller = CreateTestController(true /* nice procfs */, 2 /* cpus */);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_flush_latency_budget_ms(10);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+
+  // The cpus are caught up after the first step, nothing is left for another
+  // task.
+  EXPECT_CALL(*controller->runner(), PostTask(_)).Times(0);
+  controller->Flush(1);
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  FtraceStats stats{};
+  controller->DumpFtraceStats(&stats);
+  EXPECT_EQ(stats.flushes_over_budget, 0u);
+  data_source.reset();
+}
+
 TEST(FtraceControllerTest, BufferSize) {
   auto controller = CreateTestController(false /* nice procfs */);
 
@@ -526,6 +647,7 @@ TEST(FtraceStatsTest, Write) {
   cpu_stats.entries = 1;
   cpu_stats.overrun = 2;
   stats.cpu_stats.push_back(cpu_stats);
+  stats.flushes_over_budget = 3;
 
   std::unique_ptr<TraceWriterForTesting> writer =
       std::unique_ptr<TraceWriterForTesting>(new TraceWriterForTesting());
@@ -540,6 +662,7 @@ TEST(FtraceStatsTest, Write) {
   EXPECT_EQ(result.cpu(), 0u);
   EXPECT_EQ(result.entries(), 1u);
   EXPECT_EQ(result.overrun(), 2u);
+  EXPECT_EQ(result_packet.ftrace_stats().flushes_over_budget(), 3u);
 }
 
 }  // namespace perfetto
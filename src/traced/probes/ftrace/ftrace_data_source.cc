@@ -82,6 +82,34 @@ void FtraceDataSource::Flush(FlushRequestID flush_request_id,
   controller_weak_->Flush(flush_request_id);
 }
 
+bool FtraceDataSource::SetupReaderThreadOutputs(size_t num_threads) {
+  if (reader_thread_outputs_.size() >= num_threads)
+    return true;
+  if (!trace_writer_factory_)
+    return false;
+  while (reader_thread_outputs_.size() < num_threads) {
+    std::unique_ptr<ReaderThreadOutput> output(new ReaderThreadOutput());
+    output->writer = trace_writer_factory_();
+    reader_thread_outputs_.emplace_back(std::move(output));
+  }
+  return true;
+}
+
+void FtraceDataSource::MergeReaderThreadMetadata() {
+  for (const auto& output : reader_thread_outputs_) {
+    FtraceMetadata* thread_metadata = &output->metadata;
+    for (const auto& inode_and_device : thread_metadata->inode_and_device)
+      metadata_.inode_and_device.insert(inode_and_device);
+    for (int32_t pid : thread_metadata->rename_pids)
+      metadata_.AddRenamePid(pid);
+    for (int32_t pid : thread_metadata->freed_pids)
+      metadata_.AddFreedPid(pid);
+    for (int32_t pid : thread_metadata->pids)
+      metadata_.AddPid(pid);
+    thread_metadata->Clear();
+  }
+}
+
 // Called by FtraceController after all CPUs have acked the flush or timed out.
 void FtraceDataSource::OnFtraceFlushComplete(FlushRequestID flush_request_id) {
   auto it = pending_flushes_.find(flush_request_id);
@@ -98,6 +126,11 @@ void FtraceDataSource::OnFtraceFlushComplete(FlushRequestID flush_request_id) {
   pending_flushes_.erase(it);
   if (writer_) {
     WriteStats();
+    // All the writers commit their chunks through the same arbiter, in order:
+    // by the time the service acks the flush of the main writer, it has got
+    // the data of the reader threads' writers too.
+    for (const auto& output : reader_thread_outputs_)
+      output->writer->Flush();
     writer_->Flush(std::move(callback));
   }
 }
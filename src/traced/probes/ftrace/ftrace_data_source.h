@@ -23,6 +23,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/weak_ptr.h"
@@ -83,6 +84,32 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceMetadata* mutable_metadata() { return &metadata_; }
   TraceWriter* trace_writer() { return writer_.get(); }
 
+  // When ftrace is read on multiple threads (FtraceConfig.num_reader_threads)
+  // each thread writes into its own writer and metadata, as neither is
+  // thread-safe. The writers are created by |trace_writer_factory|, which
+  // creates writers for the same target buffer as the main one.
+  struct ReaderThreadOutput {
+    std::unique_ptr<TraceWriter> writer;
+    FtraceMetadata metadata;
+  };
+  void set_trace_writer_factory(
+      std::function<std::unique_ptr<TraceWriter>()> trace_writer_factory) {
+    trace_writer_factory_ = std::move(trace_writer_factory);
+  }
+
+  // Creates the outputs of the first |num_threads| reader threads, if they
+  // don't exist yet. Returns false if this data source can't create writers.
+  bool SetupReaderThreadOutputs(size_t num_threads);
+  ReaderThreadOutput* reader_thread_output(size_t thread) {
+    return reader_thread_outputs_[thread].get();
+  }
+
+  // Moves the pids, inodes etc. collected in the metadata of the reader
+  // threads into the metadata of the data source, which is consumed by the
+  // ProbesProducer. The kernel symbols are not moved: their indexes are
+  // scoped to the writer sequence of each thread.
+  void MergeReaderThreadMetadata();
+
  private:
   FtraceDataSource(const FtraceDataSource&) = delete;
   FtraceDataSource& operator=(const FtraceDataSource&) = delete;
@@ -95,6 +122,9 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceStats stats_before_ = {};
   std::map<FlushRequestID, std::function<void()>> pending_flushes_;
 
+  std::function<std::unique_ptr<TraceWriter>()> trace_writer_factory_;
+  std::vector<std::unique_ptr<ReaderThreadOutput>> reader_thread_outputs_;
+
   // -- Fields initialized by the Initialize() call:
   FtraceConfigId config_id_ = 0;
   std::unique_ptr<TraceWriter> writer_;
@@ -89,6 +89,10 @@ struct FtraceMetadata {
 
   void AddRenamePid(int32_t pid) { rename_pids.insert(pid); }
 
+  // Pids whose previous task is gone: the ones of sched_process_free, and the
+  // ones of task_newtask (which reuse the pid of a freed task).
+  void AddFreedPid(int32_t pid) { freed_pids.insert(pid); }
+
   void AddPid(int32_t pid) {
     const size_t pid_bit = static_cast<size_t>(pid);
     if (PERFETTO_LIKELY(pid_bit < pids_cache.size())) {
@@ -120,6 +124,7 @@ struct FtraceMetadata {
   void Clear() {
     inode_and_device.clear();
     rename_pids.clear();
+    freed_pids.clear();
     pids.clear();
     pids_cache.reset();
     kernel_addrs.clear();
@@ -144,6 +149,7 @@ struct FtraceMetadata {
 
   base::FlatSet<InodeBlockPair> inode_and_device;
   base::FlatSet<int32_t> rename_pids;
+  base::FlatSet<int32_t> freed_pids;
   base::FlatSet<int32_t> pids;
   base::FlatSet<KernelAddr> kernel_addrs;
 
@@ -119,6 +119,20 @@ bool FtraceProcfs::DisableEvent(const std::string& group,
   return AppendToFile(path, "!" + group + ":" + name);
 }
 
+bool FtraceProcfs::SetEventFilter(const std::string& group,
+                                  const std::string& name,
+                                  const std::string& filter) {
+  std::string path = root_ + "events/" + group + "/" + name + "/filter";
+  return WriteToFile(path, filter);
+}
+
+bool FtraceProcfs::ClearEventFilter(const std::string& group,
+                                    const std::string& name) {
+  // Writing "0" to the filter file removes the filter.
+  std::string path = root_ + "events/" + group + "/" + name + "/filter";
+  return WriteToFile(path, "0");
+}
+
 bool FtraceProcfs::DisableAllEvents() {
   std::string path = root_ + "events/enable";
   return WriteToFile(path, "0");
@@ -201,6 +215,19 @@ bool FtraceProcfs::SetCpuBufferSizeInPages(size_t pages) {
   return WriteNumberToFile(path, pages * (base::kPageSize / 1024ul));
 }
 
+bool FtraceProcfs::SetBufferPercent(uint32_t percent) {
+  std::string path = root_ + "buffer_percent";
+  return WriteNumberToFile(path, percent);
+}
+
+base::Optional<uint32_t> FtraceProcfs::GetBufferPercent() const {
+  std::string path = root_ + "buffer_percent";
+  std::string str = ReadFileIntoString(path);
+  if (str.empty())
+    return base::nullopt;
+  return base::CStringToUInt32(base::StripSuffix(str, "\n").c_str());
+}
+
 bool FtraceProcfs::EnableTracing() {
   KernelLogWrite("perfetto: enabled ftrace\n");
   PERFETTO_LOG("enabled ftrace in %s", root_.c_str());
@@ -22,6 +22,7 @@
 #include <string>
 #include <vector>
 
+#include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
 
 namespace perfetto {
@@ -48,6 +49,15 @@ class FtraceProcfs {
   // Disable the event under with the given |group| and |name|.
   bool DisableEvent(const std::string& group, const std::string& name);
 
+  // Sets the filter with which the kernel drops the events of the given type
+  // (see FtraceConfig.kernel_filters).
+  bool SetEventFilter(const std::string& group,
+                      const std::string& name,
+                      const std::string& filter);
+
+  // Removes the filter of the events of the given type.
+  bool ClearEventFilter(const std::string& group, const std::string& name);
+
   // Disable all events by writing to the global enable file.
   bool DisableAllEvents();
 
@@ -69,6 +79,15 @@ class FtraceProcfs {
   // by the number of CPUs.
   bool SetCpuBufferSizeInPages(size_t pages);
 
+  // Sets the fill level, in percent of the per cpu buffer size, from which the
+  // per cpu trace_pipe_raw files are readable: poll() only returns once it is
+  // reached, on kernels which support it. 0 means as soon as there is data.
+  bool SetBufferPercent(uint32_t percent);
+
+  // Returns the current fill level set above, or nullopt if the kernel doesn't
+  // support it (before Linux 5.1).
+  base::Optional<uint32_t> GetBufferPercent() const;
+
   // Returns the number of CPUs.
   // This will match the number of tracing/per_cpu/cpuXX directories.
   size_t virtual NumberOfCpus() const;
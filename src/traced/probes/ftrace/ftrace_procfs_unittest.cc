@@ -95,5 +95,22 @@ TEST(FtraceProcfsTest, ParseAvailableClocks) {
   EXPECT_THAT(ftrace.AvailableClocks(), IsEmpty());
 }
 
+TEST(FtraceProcfsTest, BufferPercent) {
+  MockFtraceProcfs ftrace;
+
+  EXPECT_CALL(ftrace, ReadFileIntoString("/root/buffer_percent"))
+      .WillOnce(Return("50\n"));
+  EXPECT_EQ(ftrace.GetBufferPercent(), 50u);
+
+  // Not supported by the kernel.
+  EXPECT_CALL(ftrace, ReadFileIntoString("/root/buffer_percent"))
+      .WillOnce(Return(""));
+  EXPECT_FALSE(ftrace.GetBufferPercent());
+
+  EXPECT_CALL(ftrace, WriteToFile("/root/buffer_percent", "25"))
+      .WillOnce(Return(true));
+  EXPECT_TRUE(ftrace.SetBufferPercent(25));
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -26,6 +26,7 @@ void FtraceStats::Write(protos::pbzero::FtraceStats* writer) const {
   }
   writer->set_kernel_symbols_parsed(kernel_symbols_parsed);
   writer->set_kernel_symbols_mem_kb(kernel_symbols_mem_kb);
+  writer->set_flushes_over_budget(flushes_over_budget);
 }
 
 void FtraceCpuStats::Write(protos::pbzero::FtraceCpuStats* writer) const {
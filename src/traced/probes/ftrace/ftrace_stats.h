@@ -48,6 +48,7 @@ struct FtraceStats {
   std::vector<FtraceCpuStats> cpu_stats;
   uint32_t kernel_symbols_parsed = 0;
   uint32_t kernel_symbols_mem_kb = 0;
+  uint32_t flushes_over_budget = 0;
 
   void Write(protos::pbzero::FtraceStats*) const;
 };
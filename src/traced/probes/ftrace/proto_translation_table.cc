@@ -109,6 +109,56 @@ const std::deque<Event> BuildEventsDeque(const std::vector<Event>& events) {
   return events_by_id;
 }
 
+CompiledField::Op CompiledFieldOp(TranslationStrategy strategy) {
+  switch (strategy) {
+    case kUint8ToUint32:
+    case kUint8ToUint64:
+    case kBoolToUint32:
+    case kBoolToUint64:
+      return CompiledField::kUint8;
+    case kUint16ToUint32:
+    case kUint16ToUint64:
+      return CompiledField::kUint16;
+    case kUint32ToUint32:
+    case kUint32ToUint64:
+      return CompiledField::kUint32;
+    case kUint64ToUint64:
+      return CompiledField::kUint64;
+    case kInt8ToInt32:
+    case kInt8ToInt64:
+      return CompiledField::kInt8;
+    case kInt16ToInt32:
+    case kInt16ToInt64:
+      return CompiledField::kInt16;
+    case kInt32ToInt32:
+    case kInt32ToInt64:
+      return CompiledField::kInt32;
+    case kInt64ToInt64:
+      return CompiledField::kInt64;
+    case kPid32ToInt32:
+    case kPid32ToInt64:
+      return CompiledField::kPid32;
+    default:
+      return CompiledField::kField;
+  }
+}
+
+std::vector<CompiledField> CompileEventFields(const Event& event) {
+  std::vector<CompiledField> compiled;
+  if (event.fields.empty() ||
+      event.proto_field_id == protos::pbzero::FtraceEvent::kGenericFieldNumber)
+    return compiled;
+  compiled.reserve(event.fields.size());
+  for (size_t i = 0; i < event.fields.size(); i++) {
+    const Field& field = event.fields[i];
+    compiled.push_back(CompiledField{CompiledFieldOp(field.strategy),
+                                     field.ftrace_offset,
+                                     static_cast<uint16_t>(i),
+                                     field.proto_field_id});
+  }
+  return compiled;
+}
+
 // Merge the information from |ftrace_field| into |field| (mutating it).
 // We should set the following fields: offset, size, ftrace field type and
 // translation strategy.
@@ -248,6 +298,76 @@ void SetProtoType(FtraceFieldType ftrace_type,
   }
 }
 
+// Returns true for the events whose format is read when the table is created
+// even with Create(parse_lazily=true): the sched events are needed to
+// validate the compact sched format, and ftrace/print has a fallback layout.
+bool IsParsedEagerly(const Event& event) {
+  using protos::pbzero::FtraceEvent;
+  return event.proto_field_id == FtraceEvent::kSchedSwitchFieldNumber ||
+         event.proto_field_id == FtraceEvent::kSchedWakingFieldNumber ||
+         event.proto_field_id == FtraceEvent::kPrintFieldNumber;
+}
+
+// Reads the format of the known |event| and merges it into its fields,
+// setting its ftrace id and size. The first event parsed also merges the
+// common fields. Returns false if the kernel doesn't have the event.
+bool ParseKnownEvent(const FtraceProcfs* ftrace_procfs,
+                     Event* event,
+                     std::vector<Field>* common_fields,
+                     bool* common_fields_processed,
+                     uint16_t* common_fields_end) {
+  std::string contents =
+      ftrace_procfs->ReadEventFormat(event->group, event->name);
+  FtraceEvent ftrace_event;
+  if (contents.empty() || !ParseFtraceEvent(contents, &ftrace_event)) {
+    if (!strcmp(event->group, "ftrace") && !strcmp(event->name, "print")) {
+      // On some "user" builds of Android <P the ftrace/print event is not
+      // selinux-allowed. Thankfully this event is an always-on built-in
+      // so we don't need to write to its 'enable' file. However we need to
+      // know its binary layout to decode it, so we hardcode it.
+      ftrace_event.id = 5;  // Seems quite stable across kernels.
+      ftrace_event.name = "print";
+      // The only field we care about is:
+      // field:char buf; offset:16; size:0; signed:0;
+      ftrace_event.fields.emplace_back(
+          FtraceEvent::Field{"char buf", 16, 0, 0});
+    } else {
+      return false;
+    }
+  }
+
+  event->ftrace_event_id = ftrace_event.id;
+
+  if (!*common_fields_processed) {
+    *common_fields_end =
+        MergeFields(ftrace_event.common_fields, common_fields, event->name);
+    *common_fields_processed = true;
+  }
+
+  uint16_t fields_end =
+      MergeFields(ftrace_event.fields, &event->fields, event->name);
+
+  event->size = std::max<uint16_t>(fields_end, *common_fields_end);
+  return true;
+}
+
+// Removes |event| from the vectors of |events_by_key|, and the keys left
+// without events.
+void EraseEventPtr(
+    const Event* event,
+    std::map<std::string, std::vector<const Event*>>* events_by_key) {
+  for (auto it = events_by_key->begin(); it != events_by_key->end();) {
+    std::vector<const Event*>& events = it->second;
+    events.erase(std::remove(events.begin(), events.end(), event),
+                 events.end());
+    if (events.empty()) {
+      it = events_by_key->erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 }  // namespace
 
 // This is similar but different from InferProtoType (see format_parser.cc).
@@ -389,7 +509,8 @@ ProtoTranslationTable::DefaultPageHeaderSpecForTesting() {
 std::unique_ptr<ProtoTranslationTable> ProtoTranslationTable::Create(
     const FtraceProcfs* ftrace_procfs,
     std::vector<Event> events,
-    std::vector<Field> common_fields) {
+    std::vector<Field> common_fields,
+    bool parse_lazily) {
   bool common_fields_processed = false;
   uint16_t common_fields_end = 0;
 
@@ -408,6 +529,7 @@ std::unique_ptr<ProtoTranslationTable> ProtoTranslationTable::Create(
     header_spec = GuessFtracePageHeaderSpec();
   }
 
+  std::vector<Event> lazy_events;
   for (Event& event : events) {
     if (event.proto_field_id ==
         protos::pbzero::FtraceEvent::kGenericFieldNumber) {
@@ -418,38 +540,14 @@ std::unique_ptr<ProtoTranslationTable> ProtoTranslationTable::Create(
     PERFETTO_DCHECK(event.proto_field_id);
     PERFETTO_DCHECK(!event.ftrace_event_id);
 
-    std::string contents =
-        ftrace_procfs->ReadEventFormat(event.group, event.name);
-    FtraceEvent ftrace_event;
-    if (contents.empty() || !ParseFtraceEvent(contents, &ftrace_event)) {
-      if (!strcmp(event.group, "ftrace") && !strcmp(event.name, "print")) {
-        // On some "user" builds of Android <P the ftrace/print event is not
-        // selinux-allowed. Thankfully this event is an always-on built-in
-        // so we don't need to write to its 'enable' file. However we need to
-        // know its binary layout to decode it, so we hardcode it.
-        ftrace_event.id = 5;  // Seems quite stable across kernels.
-        ftrace_event.name = "print";
-        // The only field we care about is:
-        // field:char buf; offset:16; size:0; signed:0;
-        ftrace_event.fields.emplace_back(
-            FtraceEvent::Field{"char buf", 16, 0, 0});
-      } else {
-        continue;
-      }
-    }
-
-    event.ftrace_event_id = ftrace_event.id;
-
-    if (!common_fields_processed) {
-      common_fields_end =
-          MergeFields(ftrace_event.common_fields, &common_fields, event.name);
-      common_fields_processed = true;
+    // Lazy events are left with a zero ftrace_event_id, and removed from
+    // |events| below.
+    if (parse_lazily && !IsParsedEagerly(event)) {
+      lazy_events.push_back(event);
+      continue;
     }
-
-    uint16_t fields_end =
-        MergeFields(ftrace_event.fields, &event.fields, event.name);
-
-    event.size = std::max<uint16_t>(fields_end, common_fields_end);
+    ParseKnownEvent(ftrace_procfs, &event, &common_fields,
+                    &common_fields_processed, &common_fields_end);
   }
 
   events.erase(std::remove_if(events.begin(), events.end(),
@@ -463,12 +561,25 @@ std::unique_ptr<ProtoTranslationTable> ProtoTranslationTable::Create(
   // about their format hold for this kernel.
   CompactSchedEventFormat compact_sched = ValidateFormatForCompactSched(events);
 
-  std::string text = ftrace_procfs->ReadPrintkFormats();
-  PrintkMap printk_formats = ParsePrintkFormats(text);
+  PrintkMap printk_formats;
+  if (!parse_lazily)
+    printk_formats = ParsePrintkFormats(ftrace_procfs->ReadPrintkFormats());
 
   auto table = std::unique_ptr<ProtoTranslationTable>(new ProtoTranslationTable(
       ftrace_procfs, events, std::move(common_fields), header_spec,
       compact_sched, std::move(printk_formats)));
+  if (parse_lazily) {
+    table->common_fields_processed_ = common_fields_processed;
+    table->common_fields_end_ = common_fields_end;
+    table->printk_formats_loaded_ = false;
+    for (const Event& event : lazy_events) {
+      auto it_and_inserted = table->lazy_events_.emplace(
+          GroupAndName(event.group, event.name), event);
+      const Event* lazy_event = &it_and_inserted.first->second;
+      table->name_to_events_[event.name].push_back(lazy_event);
+      table->group_to_events_[event.group].push_back(lazy_event);
+    }
+  }
   return table;
 }
 
@@ -486,7 +597,9 @@ ProtoTranslationTable::ProtoTranslationTable(
       ftrace_page_header_spec_(ftrace_page_header_spec),
       compact_sched_format_(compact_sched_format),
       printk_formats_(printk_formats) {
+  compiled_fields_.resize(events_.size());
   for (const Event& event : events) {
+    compiled_fields_[event.ftrace_event_id] = CompileEventFields(event);
     group_and_name_to_event_[GroupAndName(event.group, event.name)] =
         &events_.at(event.ftrace_event_id);
     name_to_events_[event.name].push_back(&events_.at(event.ftrace_event_id));
@@ -496,9 +609,28 @@ ProtoTranslationTable::ProtoTranslationTable(
 
 const Event* ProtoTranslationTable::GetOrCreateEvent(
     const GroupAndName& group_and_name) {
+  if (!printk_formats_loaded_) {
+    printk_formats_ = ParsePrintkFormats(ftrace_procfs_->ReadPrintkFormats());
+    printk_formats_loaded_ = true;
+  }
+
   const Event* event = GetEvent(group_and_name);
   if (event)
     return event;
+
+  auto lazy_it = lazy_events_.find(group_and_name);
+  if (lazy_it != lazy_events_.end()) {
+    Event lazy_event = lazy_it->second;
+    EraseEventPtr(&lazy_it->second, &name_to_events_);
+    EraseEventPtr(&lazy_it->second, &group_to_events_);
+    lazy_events_.erase(lazy_it);
+    if (!ParseKnownEvent(ftrace_procfs_, &lazy_event, &common_fields_,
+                         &common_fields_processed_, &common_fields_end_)) {
+      return nullptr;
+    }
+    return AddEvent(std::move(lazy_event));
+  }
+
   // The ftrace event does not already exist so a new one will be created
   // by parsing the format file.
   std::string contents = ftrace_procfs_->ReadEventFormat(group_and_name.group(),
@@ -508,33 +640,41 @@ const Event* ProtoTranslationTable::GetOrCreateEvent(
   FtraceEvent ftrace_event = {};
   ParseFtraceEvent(contents, &ftrace_event);
 
-  // Ensure events vector is large enough
-  if (ftrace_event.id > largest_id_) {
-    events_.resize(ftrace_event.id + 1);
-    largest_id_ = ftrace_event.id;
-  }
-
   // Set known event variables
-  Event* e = &events_.at(ftrace_event.id);
-  e->ftrace_event_id = ftrace_event.id;
-  e->proto_field_id = protos::pbzero::FtraceEvent::kGenericFieldNumber;
-  e->name = InternString(group_and_name.name());
-  e->group = InternString(group_and_name.group());
+  Event e{};
+  e.ftrace_event_id = ftrace_event.id;
+  e.proto_field_id = protos::pbzero::FtraceEvent::kGenericFieldNumber;
+  e.name = InternString(group_and_name.name());
+  e.group = InternString(group_and_name.group());
 
   // Calculate size of common fields.
   for (const FtraceEvent::Field& ftrace_field : ftrace_event.common_fields) {
     uint16_t field_end = ftrace_field.offset + ftrace_field.size;
-    e->size = std::max(field_end, e->size);
+    e.size = std::max(field_end, e.size);
   }
 
   // For every field in the ftrace event, make a field in the generic event.
   for (const FtraceEvent::Field& ftrace_field : ftrace_event.fields)
-    e->size = std::max(CreateGenericEventField(ftrace_field, *e), e->size);
+    e.size = std::max(CreateGenericEventField(ftrace_field, e), e.size);
 
-  group_and_name_to_event_[group_and_name] = &events_.at(e->ftrace_event_id);
-  name_to_events_[e->name].push_back(&events_.at(e->ftrace_event_id));
-  group_to_events_[e->group].push_back(&events_.at(e->ftrace_event_id));
+  return AddEvent(std::move(e));
+}
 
+const Event* ProtoTranslationTable::AddEvent(Event event) {
+  const size_t id = event.ftrace_event_id;
+  // Ensure events vector is large enough
+  if (id > largest_id_) {
+    events_.resize(id + 1);
+    compiled_fields_.resize(id + 1);
+    largest_id_ = id;
+  }
+
+  Event* e = &events_.at(id);
+  *e = std::move(event);
+  compiled_fields_[id] = CompileEventFields(*e);
+  group_and_name_to_event_[GroupAndName(e->group, e->name)] = e;
+  name_to_events_[e->name].push_back(e);
+  group_to_events_[e->group].push_back(e);
   return e;
 }
 
@@ -621,4 +761,19 @@ void EventFilter::EnableEventsFrom(const EventFilter& other) {
 
 ProtoTranslationTable::~ProtoTranslationTable() = default;
 
+EventRateLimiter::EventRateLimiter() = default;
+EventRateLimiter::~EventRateLimiter() = default;
+
+void EventRateLimiter::SetLimit(size_t ftrace_event_id,
+                                uint32_t max_events_per_sec) {
+  if (ftrace_event_id >= limits_.size())
+    limits_.resize(ftrace_event_id + 1);
+  limits_[ftrace_event_id].max_events_per_sec = max_events_per_sec;
+}
+
+bool EventRateLimiter::HasLimit(size_t ftrace_event_id) const {
+  return ftrace_event_id < limits_.size() &&
+         limits_[ftrace_event_id].max_events_per_sec > 0;
+}
+
 }  // namespace perfetto
@@ -27,6 +27,8 @@
 #include <string>
 #include <vector>
 
+#include "perfetto/base/compiler.h"
+#include "perfetto/base/logging.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/event_info.h"
@@ -72,6 +74,32 @@ inline void PrintTo(const GroupAndName& event, ::std::ostream* os) {
   *os << "GroupAndName(" << event.group() << ", " << event.name() << ")";
 }
 
+// A flattened form of one of the Event::fields, built once per event when the
+// table is created. The integer fields, which are most of the fields of the
+// frequent events, get an |op| of their own so that CpuReader::ParseEvent()
+// can decode them without going through the generic per-strategy switch in
+// CpuReader::ParseField(). The other fields are kField, and are parsed with
+// ParseField() from Event::fields[field_index].
+struct CompiledField {
+  enum Op : uint8_t {
+    kUint8,
+    kUint16,
+    kUint32,
+    kUint64,
+    kInt8,
+    kInt16,
+    kInt32,
+    kInt64,
+    kPid32,
+    kField,
+  };
+
+  Op op;
+  uint16_t ftrace_offset;
+  uint16_t field_index;
+  uint32_t proto_field_id;
+};
+
 bool InferFtraceType(const std::string& type_and_name,
                      size_t size,
                      bool is_signed,
@@ -90,10 +118,16 @@ class ProtoTranslationTable {
   // This method mutates the |events| and |common_fields| vectors to
   // fill some of the fields and to delete unused events/fields
   // before std:move'ing them into the ProtoTranslationTable.
+  // If |parse_lazily| is true, the format files of most |events| (and
+  // printk_formats) are read only when GetOrCreateEvent() is first called
+  // for them, rather than here. Until then GetEvent(), GetEventById() and
+  // EventToFtraceId() don't know about them, while GetEventsByGroup() and
+  // GetEventByName() list them even if the kernel doesn't have them.
   static std::unique_ptr<ProtoTranslationTable> Create(
       const FtraceProcfs* ftrace_procfs,
       std::vector<Event> events,
-      std::vector<Field> common_fields);
+      std::vector<Field> common_fields,
+      bool parse_lazily = false);
   virtual ~ProtoTranslationTable();
 
   ProtoTranslationTable(const FtraceProcfs* ftrace_procfs,
@@ -121,6 +155,13 @@ class ProtoTranslationTable {
     return &group_to_events_.at(group);
   }
 
+  // Returns the fields of the event with the given id in the form of
+  // CompiledField. Empty for generic events, which have their own encoding.
+  const std::vector<CompiledField>& GetCompiledFields(size_t id) const {
+    PERFETTO_DCHECK(id < compiled_fields_.size());
+    return compiled_fields_[id];
+  }
+
   const Event* GetEventById(size_t id) const {
     if (id == 0 || id > largest_id_)
       return nullptr;
@@ -180,9 +221,15 @@ class ProtoTranslationTable {
   uint16_t CreateGenericEventField(const FtraceEvent::Field& ftrace_field,
                                    Event& event);
 
+  // Stores the parsed |event| at its ftrace id and indexes it.
+  const Event* AddEvent(Event event);
+
   const FtraceProcfs* ftrace_procfs_;
   std::deque<Event> events_;
   size_t largest_id_;
+  // Indexed by ftrace event id, like |events_|. A deque so that growing it for
+  // a new event doesn't move the fields that the reader threads may be using.
+  std::deque<std::vector<CompiledField>> compiled_fields_;
   std::map<GroupAndName, const Event*> group_and_name_to_event_;
   std::map<std::string, std::vector<const Event*>> name_to_events_;
   std::map<std::string, std::vector<const Event*>> group_to_events_;
@@ -191,6 +238,14 @@ class ProtoTranslationTable {
   std::set<std::string> interned_strings_;
   CompactSchedEventFormat compact_sched_format_;
   PrintkMap printk_formats_;
+
+  // State of Create(parse_lazily=true). |lazy_events_| are the known events
+  // whose format hasn't been read yet, GetOrCreateEvent() moves them to
+  // |events_|.
+  std::map<GroupAndName, Event> lazy_events_;
+  bool common_fields_processed_ = true;
+  uint16_t common_fields_end_ = 0;
+  bool printk_formats_loaded_ = true;
 };
 
 // Class for efficient 'is event with id x enabled?' checks.
@@ -216,6 +271,54 @@ class EventFilter {
   std::vector<bool> enabled_ids_;
 };
 
+// Caps the number of events of each type per second, for
+// FtraceConfig.rate_limits. The seconds are measured with the timestamps of
+// the events, which must be passed in order.
+class EventRateLimiter {
+ public:
+  EventRateLimiter();
+  ~EventRateLimiter();
+  EventRateLimiter(const EventRateLimiter&) = default;
+  EventRateLimiter& operator=(const EventRateLimiter&) = default;
+  EventRateLimiter(EventRateLimiter&&) = default;
+  EventRateLimiter& operator=(EventRateLimiter&&) = default;
+
+  void SetLimit(size_t ftrace_event_id, uint32_t max_events_per_sec);
+  bool HasLimit(size_t ftrace_event_id) const;
+  bool empty() const { return limits_.empty(); }
+
+  // Returns false if the event should be dropped, because |max_events_per_sec|
+  // events of its type were already kept in the second up to |timestamp|.
+  bool KeepEvent(size_t ftrace_event_id, uint64_t timestamp) {
+    if (PERFETTO_LIKELY(ftrace_event_id >= limits_.size()))
+      return true;
+    Limit& limit = limits_[ftrace_event_id];
+    if (limit.max_events_per_sec == 0)
+      return true;
+    if (timestamp - limit.window_start >= kWindowNs ||
+        timestamp < limit.window_start) {
+      limit.window_start = timestamp;
+      limit.kept = 0;
+    }
+    if (limit.kept >= limit.max_events_per_sec)
+      return false;
+    limit.kept++;
+    return true;
+  }
+
+ private:
+  static constexpr uint64_t kWindowNs = 1000ull * 1000 * 1000;
+
+  struct Limit {
+    uint32_t max_events_per_sec = 0;
+    uint32_t kept = 0;
+    uint64_t window_start = 0;
+  };
+
+  // Indexed by ftrace event id.
+  std::vector<Limit> limits_;
+};
+
 }  // namespace perfetto
 
 #endif  // SRC_TRACED_PROBES_FTRACE_PROTO_TRANSLATION_TABLE_H_
@@ -261,6 +261,45 @@ print fmt: "some format")"));
 
 INSTANTIATE_TEST_SUITE_P(BySize, TranslationTableCreationTest, Values(4, 8));
 
+TEST(TranslationTableTest, CompiledFields) {
+  std::string path = base::GetTestDataPath(
+      "src/traced/probes/ftrace/test/data/android_seed_N2F62_3.10.49/");
+  FtraceProcfs ftrace_procfs(path);
+  auto table = ProtoTranslationTable::Create(
+      &ftrace_procfs, GetStaticEventInfo(), GetStaticCommonFieldsInfo());
+  PERFETTO_CHECK(table);
+
+  {
+    const Event* event =
+        table->GetEvent(GroupAndName("binder", "binder_transaction"));
+    ASSERT_TRUE(event);
+    const std::vector<CompiledField>& compiled =
+        table->GetCompiledFields(event->ftrace_event_id);
+    ASSERT_EQ(compiled.size(), event->fields.size());
+    // int debug_id
+    EXPECT_EQ(compiled[0].op, CompiledField::kInt32);
+    EXPECT_EQ(compiled[0].ftrace_offset, 8u);
+    EXPECT_EQ(compiled[0].field_index, 0u);
+    EXPECT_EQ(compiled[0].proto_field_id, 1u);
+    // unsigned int code
+    EXPECT_EQ(compiled[5].op, CompiledField::kUint32);
+    EXPECT_EQ(compiled[5].ftrace_offset, 28u);
+    EXPECT_EQ(compiled[5].proto_field_id, 6u);
+  }
+
+  {
+    const Event* event = table->GetEvent(GroupAndName("sched", "sched_switch"));
+    ASSERT_TRUE(event);
+    const std::vector<CompiledField>& compiled =
+        table->GetCompiledFields(event->ftrace_event_id);
+    ASSERT_EQ(compiled.size(), event->fields.size());
+    // Strings are left to CpuReader::ParseField().
+    EXPECT_EQ(compiled[0].op, CompiledField::kField);
+    EXPECT_EQ(compiled[0].field_index, 0u);
+    EXPECT_EQ(compiled[1].op, CompiledField::kPid32);
+  }
+}
+
 TEST(TranslationTableTest, CompactSchedFormatParsingWalleyeData) {
   std::string path =
       "src/traced/probes/ftrace/test/data/"
@@ -508,6 +547,100 @@ print fmt: "some format")"));
   EXPECT_EQ(uint_field.ftrace_offset, 33);
 }
 
+TEST(TranslationTableTest, ParseLazily) {
+  MockFtraceProcfs ftrace;
+  std::vector<Field> common_fields;
+  std::vector<Event> events;
+
+  ON_CALL(ftrace, ReadPageHeaderFormat())
+      .WillByDefault(Return(
+          R"(	field: u64 timestamp;	offset:0;	size:8;	signed:0;
+	field: local_t commit;	offset:8;	size:4;	signed:1;
+	field: int overwrite;	offset:8;	size:1;	signed:1;
+	field: char data;	offset:16;	size:4080;	signed:0;)"));
+  ON_CALL(ftrace, ReadEventFormat(_, _)).WillByDefault(Return(""));
+  ON_CALL(ftrace, ReadEventFormat("sched", "sched_switch"))
+      .WillByDefault(Return(R"(name: sched_switch
+ID: 10
+format:
+	field:unsigned short common_type;	offset:0;	size:2;	signed:0;
+	field:int common_pid;	offset:4;	size:4;	signed:1;
+
+	field:int prev_prio;	offset:8;	size:4;	signed:1;
+
+print fmt: "some format")"));
+  ON_CALL(ftrace, ReadEventFormat("group", "foo"))
+      .WillByDefault(Return(R"(name: foo
+ID: 42
+format:
+	field:unsigned short common_type;	offset:0;	size:2;	signed:0;
+	field:int common_pid;	offset:4;	size:4;	signed:1;
+
+	field:u32 field_e;	offset:8;	size:4;	signed:0;
+
+print fmt: "some format")"));
+  EXPECT_CALL(ftrace, ReadPageHeaderFormat()).Times(AnyNumber());
+
+  events.emplace_back(Event{});
+  events.back().name = "sched_switch";
+  events.back().group = "sched";
+  events.back().proto_field_id =
+      protos::pbzero::FtraceEvent::kSchedSwitchFieldNumber;
+
+  events.emplace_back(Event{});
+  events.back().name = "foo";
+  events.back().group = "group";
+  events.back().proto_field_id = 21;
+  events.back().fields.emplace_back(Field{});
+  events.back().fields.back().proto_field_id = 504;
+  events.back().fields.back().proto_field_type = ProtoSchemaType::kUint64;
+  events.back().fields.back().ftrace_name = "field_e";
+
+  events.emplace_back(Event{});
+  events.back().name = "bar";
+  events.back().group = "group";
+  events.back().proto_field_id = 22;
+
+  // Only the sched events are read when creating the table.
+  EXPECT_CALL(ftrace, ReadEventFormat("sched", "sched_switch"));
+  EXPECT_CALL(ftrace, ReadEventFormat("group", _)).Times(0);
+  auto table = ProtoTranslationTable::Create(&ftrace, std::move(events),
+                                             std::move(common_fields),
+                                             /*parse_lazily=*/true);
+  PERFETTO_CHECK(table);
+  testing::Mock::VerifyAndClearExpectations(&ftrace);
+
+  EXPECT_EQ(table->EventToFtraceId(GroupAndName("sched", "sched_switch")),
+            10ul);
+  EXPECT_EQ(table->EventToFtraceId(GroupAndName("group", "foo")), 0ul);
+  EXPECT_FALSE(table->GetEventById(42));
+  ASSERT_TRUE(table->GetEventByName("foo"));
+  EXPECT_STREQ(table->GetEventByName("foo")->group, "group");
+  ASSERT_TRUE(table->GetEventsByGroup("group"));
+  EXPECT_EQ(table->GetEventsByGroup("group")->size(), 2u);
+
+  EXPECT_CALL(ftrace, ReadEventFormat("group", "foo"));
+  const Event* foo = table->GetOrCreateEvent(GroupAndName("group", "foo"));
+  ASSERT_TRUE(foo);
+  EXPECT_EQ(foo->ftrace_event_id, 42ul);
+  EXPECT_EQ(foo->proto_field_id, 21ul);
+  EXPECT_EQ(foo->size, 12u);
+  ASSERT_EQ(foo->fields.size(), 1u);
+  EXPECT_EQ(foo->fields[0].strategy, kUint32ToUint64);
+  EXPECT_EQ(table->GetEventById(42), foo);
+  EXPECT_EQ(table->EventToFtraceId(GroupAndName("group", "foo")), 42ul);
+  EXPECT_EQ(table->GetEventByName("foo"), foo);
+  EXPECT_THAT(*table->GetEventsByGroup("group"), Contains(foo));
+
+  // The format is read once.
+  EXPECT_EQ(table->GetOrCreateEvent(GroupAndName("group", "foo")), foo);
+
+  // Events that the kernel doesn't have are dropped once looked up.
+  EXPECT_CALL(ftrace, ReadEventFormat("group", "bar"));
+  EXPECT_FALSE(table->GetOrCreateEvent(GroupAndName("group", "bar")));
+  EXPECT_EQ(table->GetEventsByGroup("group")->size(), 1u);
+}
+
 TEST(EventFilterTest, EnableEventsFrom) {
   EventFilter filter;
   filter.AddEnabledEvent(1);
@@ -535,5 +668,28 @@ TEST(EventFilterTest, EnableEventsFrom) {
   EXPECT_TRUE(empty_filter.IsEventEnabled(1));
 }
 
+TEST(EventRateLimiterTest, KeepEvent) {
+  EventRateLimiter limiter;
+  EXPECT_TRUE(limiter.empty());
+  limiter.SetLimit(4, 2);
+  EXPECT_FALSE(limiter.empty());
+  EXPECT_TRUE(limiter.HasLimit(4));
+  EXPECT_FALSE(limiter.HasLimit(3));
+  EXPECT_FALSE(limiter.HasLimit(17));
+
+  const uint64_t kSecond = 1000 * 1000 * 1000;
+  EXPECT_TRUE(limiter.KeepEvent(4, 10));
+  EXPECT_TRUE(limiter.KeepEvent(4, 20));
+  EXPECT_FALSE(limiter.KeepEvent(4, 30));
+  // Events without a limit are always kept.
+  EXPECT_TRUE(limiter.KeepEvent(3, 30));
+  EXPECT_TRUE(limiter.KeepEvent(17, 30));
+  EXPECT_FALSE(limiter.KeepEvent(4, 10 + kSecond - 1));
+  // Next second.
+  EXPECT_TRUE(limiter.KeepEvent(4, 10 + kSecond));
+  EXPECT_TRUE(limiter.KeepEvent(4, 10 + kSecond + 1));
+  EXPECT_FALSE(limiter.KeepEvent(4, 10 + kSecond + 2));
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -16,6 +16,7 @@
 
 #include "src/traced/probes/power/android_power_data_source.h"
 
+#include <mutex>
 #include <vector>
 
 #include "perfetto/base/logging.h"
@@ -25,6 +26,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "src/android_internal/health_hal.h"
 #include "src/android_internal/lazy_library_loader.h"
@@ -45,6 +47,18 @@ constexpr uint32_t kDefaultPollIntervalMs = 1000;
 constexpr size_t kMaxNumRails = 32;
 constexpr size_t kMaxNumEnergyConsumer = 32;
 constexpr size_t kMaxNumPowerEntities = 256;
+
+// Bounds the memory used by the samples of the rails thread if the main
+// thread falls behind.
+constexpr size_t kMaxRailSamples = 64 * 1024;
+
+// The power stats functions of android_internal lazily connect to the HAL
+// and are not thread-safe: serialize them once the rails are sampled on
+// another thread.
+std::mutex& PowerStatsMutex() {
+  static std::mutex* mutex = new std::mutex();
+  return *mutex;
+}
 }  // namespace
 
 // static
@@ -80,6 +94,7 @@ struct AndroidPowerDataSource::DynamicLibLoader {
     std::vector<android_internal::RailDescriptor> rail_descriptors(
         kMaxNumRails);
     size_t num_rails = rail_descriptors.size();
+    std::lock_guard<std::mutex> lock(PowerStatsMutex());
     if (!get_available_rails_(&rail_descriptors[0], &num_rails)) {
       PERFETTO_ELOG("Failed to retrieve rail descriptors.");
       num_rails = 0;
@@ -94,6 +109,7 @@ struct AndroidPowerDataSource::DynamicLibLoader {
 
     std::vector<android_internal::RailEnergyData> energy_data(kMaxNumRails);
     size_t num_rails = energy_data.size();
+    std::lock_guard<std::mutex> lock(PowerStatsMutex());
     if (!get_rail_energy_data_(&energy_data[0], &num_rails)) {
       PERFETTO_ELOG("Failed to retrieve rail energy data.");
       num_rails = 0;
@@ -109,6 +125,7 @@ struct AndroidPowerDataSource::DynamicLibLoader {
     std::vector<android_internal::EnergyConsumerInfo> consumers(
         kMaxNumEnergyConsumer);
     size_t num_power_entities = consumers.size();
+    std::lock_guard<std::mutex> lock(PowerStatsMutex());
     if (!get_energy_consumer_info_(&consumers[0], &num_power_entities)) {
       PERFETTO_ELOG("Failed to retrieve energy consumer info.");
       num_power_entities = 0;
@@ -124,6 +141,7 @@ struct AndroidPowerDataSource::DynamicLibLoader {
     std::vector<android_internal::EnergyEstimationBreakdown> energy_breakdown(
         kMaxNumPowerEntities);
     size_t num_power_entities = energy_breakdown.size();
+    std::lock_guard<std::mutex> lock(PowerStatsMutex());
     if (!get_energy_consumed_(&energy_breakdown[0], &num_power_entities)) {
       PERFETTO_ELOG("Failed to retrieve energy estimation breakdown.");
       num_power_entities = 0;
@@ -148,6 +166,7 @@ AndroidPowerDataSource::AndroidPowerDataSource(
   AndroidPowerConfig::Decoder pcfg(cfg.android_power_config_raw());
   poll_interval_ms_ = pcfg.battery_poll_ms();
   rails_collection_enabled_ = pcfg.collect_power_rails();
+  rails_poll_interval_ms_ = pcfg.power_rails_poll_ms();
   energy_breakdown_collection_enabled_ =
       pcfg.collect_energy_estimation_breakdown();
 
@@ -188,6 +207,32 @@ AndroidPowerDataSource::~AndroidPowerDataSource() = default;
 void AndroidPowerDataSource::Start() {
   lib_.reset(new DynamicLibLoader());
   Tick();
+
+  // The first Tick() wrote the rail descriptors and the first samples, the
+  // thread takes over from there.
+  if (rails_collection_enabled_ && rails_poll_interval_ms_) {
+    rails_thread_.reset(new base::ThreadTaskRunner(
+        base::ThreadTaskRunner::CreateAndStart("power_rails")));
+    base::TaskRunner* rails_task_runner = rails_thread_->get();
+    rails_task_runner->PostTask(
+        [this, rails_task_runner] { SampleRails(rails_task_runner); });
+  }
+}
+
+void AndroidPowerDataSource::SampleRails(base::TaskRunner* rails_task_runner) {
+  // |this| outlives the thread, which is joined when |rails_thread_| is
+  // destroyed.
+  rails_task_runner->PostDelayedTask(
+      [this, rails_task_runner] { SampleRails(rails_task_runner); },
+      rails_poll_interval_ms_);
+
+  auto energy_data = lib_->GetRailEnergyData();
+  std::lock_guard<std::mutex> lock(rail_samples_mutex_);
+  for (const auto& data : energy_data) {
+    if (rail_samples_.size() >= kMaxRailSamples)
+      break;
+    rail_samples_.push_back({data.index, data.timestamp, data.energy});
+  }
 }
 
 void AndroidPowerDataSource::Tick() {
@@ -274,6 +319,9 @@ void AndroidPowerDataSource::WritePowerRailsData() {
     }
   }
 
+  if (rails_thread_)
+    return WriteRailSamples(rails_proto);
+
   for (const auto& energy_data : lib_->GetRailEnergyData()) {
     auto* data = rails_proto->add_energy_data();
     data->set_index(energy_data.index);
@@ -282,6 +330,38 @@ void AndroidPowerDataSource::WritePowerRailsData() {
   }
 }
 
+void AndroidPowerDataSource::WriteRailSamples(
+    protos::pbzero::PowerRails* rails_proto) {
+  std::vector<RailSample> samples;
+  {
+    std::lock_guard<std::mutex> lock(rail_samples_mutex_);
+    samples.swap(rail_samples_);
+  }
+  if (samples.empty())
+    return;
+
+  // Each sample is delta encoded against the previous one of the same rail.
+  std::vector<const RailSample*> last_samples(kMaxNumRails);
+  protozero::PackedVarInt index;
+  protozero::PackedVarInt timestamp_ms;
+  protozero::PackedVarInt energy;
+  for (const RailSample& sample : samples) {
+    if (sample.index >= last_samples.size())
+      last_samples.resize(sample.index + 1);
+    const RailSample* last = last_samples[sample.index];
+    last_samples[sample.index] = &sample;
+    index.Append(sample.index);
+    timestamp_ms.Append(static_cast<int64_t>(
+        sample.timestamp_ms - (last ? last->timestamp_ms : 0)));
+    energy.Append(
+        static_cast<int64_t>(sample.energy - (last ? last->energy : 0)));
+  }
+  auto* batch = rails_proto->set_energy_data_batch();
+  batch->set_index(index);
+  batch->set_timestamp_ms(timestamp_ms);
+  batch->set_energy(energy);
+}
+
 void AndroidPowerDataSource::WriteEnergyEstimationBreakdown() {
   if (!energy_breakdown_collection_enabled_)
     return;
@@ -19,8 +19,11 @@
 
 #include <bitset>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "src/traced/probes/probes_data_source.h"
@@ -32,6 +35,12 @@ namespace base {
 class TaskRunner;
 }
 
+namespace protos {
+namespace pbzero {
+class PowerRails;
+}  // namespace pbzero
+}  // namespace protos
+
 class AndroidPowerDataSource : public ProbesDataSource {
  public:
   static const ProbesDataSource::Descriptor descriptor;
@@ -52,11 +61,24 @@ class AndroidPowerDataSource : public ProbesDataSource {
  private:
   struct DynamicLibLoader;
 
+  // One reading of a rail by the |rails_thread_|.
+  struct RailSample {
+    uint32_t index;
+    uint64_t timestamp_ms;
+    uint64_t energy;
+  };
+
   void Tick();
   void WriteBatteryCounters();
   void WritePowerRailsData();
   void WriteEnergyEstimationBreakdown();
 
+  // Runs on the |rails_thread_|, every |rails_poll_interval_ms_|.
+  void SampleRails(base::TaskRunner* rails_task_runner);
+
+  // Writes the RailSamples taken since the last call as an EnergyDataBatch.
+  void WriteRailSamples(protos::pbzero::PowerRails*);
+
   base::TaskRunner* const task_runner_;
   uint32_t poll_interval_ms_ = 0;
   std::bitset<8> counters_enabled_;
@@ -66,6 +88,15 @@ class AndroidPowerDataSource : public ProbesDataSource {
   bool energy_breakdown_collection_enabled_;
   std::unique_ptr<TraceWriter> writer_;
   std::unique_ptr<DynamicLibLoader> lib_;
+
+  uint32_t rails_poll_interval_ms_ = 0;
+  std::mutex rail_samples_mutex_;
+  std::vector<RailSample> rail_samples_;  // Guarded by |rail_samples_mutex_|.
+
+  // Set with AndroidPowerConfig.power_rails_poll_ms. Uses the members above,
+  // so it's destroyed (and joined) before them.
+  std::unique_ptr<base::ThreadTaskRunner> rails_thread_;
+
   base::WeakPtrFactory<AndroidPowerDataSource> weak_factory_;  // Keep last.
 };
 
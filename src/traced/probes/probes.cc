@@ -19,6 +19,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <string>
+#include <utility>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/getopt.h"
 #include "perfetto/ext/base/unix_task_runner.h"
@@ -38,13 +41,16 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
     OPT_CLEANUP_AFTER_CRASH = 1000,
     OPT_VERSION,
     OPT_BACKGROUND,
+    OPT_INODE_CACHE_DIR,
   };
 
   bool background = false;
+  std::string inode_cache_dir;
 
   static const option long_options[] = {
       {"background", no_argument, nullptr, OPT_BACKGROUND},
       {"cleanup-after-crash", no_argument, nullptr, OPT_CLEANUP_AFTER_CRASH},
+      {"inode-cache-dir", required_argument, nullptr, OPT_INODE_CACHE_DIR},
       {"version", no_argument, nullptr, OPT_VERSION},
       {nullptr, 0, nullptr, 0}};
 
@@ -59,11 +65,17 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
       case OPT_CLEANUP_AFTER_CRASH:
         HardResetFtraceState();
         return 0;
+      case OPT_INODE_CACHE_DIR:
+        inode_cache_dir = optarg;
+        break;
       case OPT_VERSION:
         printf("%s\n", base::GetVersionString());
         return 0;
       default:
-        PERFETTO_ELOG("Usage: %s [--background|--cleanup-after-crash|--version]", argv[0]);
+        PERFETTO_ELOG(
+            "Usage: %s [--background|--cleanup-after-crash|--version] "
+            "[--inode-cache-dir=DIR]",
+            argv[0]);
         return 1;
     }
   }
@@ -97,6 +109,7 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
 
   base::UnixTaskRunner task_runner;
   ProbesProducer producer;
+  producer.set_inode_cache_dir(std::move(inode_cache_dir));
   producer.ConnectWithRetries(GetProducerSocket(), &task_runner);
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
@@ -36,6 +36,7 @@
 #include "src/android_stats/statsd_logging_helper.h"
 #include "src/traced/probes/android_log/android_log_data_source.h"
 #include "src/traced/probes/common/cpu_freq_info.h"
+#include "src/traced/probes/filesystem/inode_cache_file.h"
 #include "src/traced/probes/filesystem/inode_file_data_source.h"
 #include "src/traced/probes/ftrace/ftrace_data_source.h"
 #include "src/traced/probes/initial_display_state/initial_display_state_data_source.h"
@@ -44,6 +45,7 @@
 #include "src/traced/probes/power/android_power_data_source.h"
 #include "src/traced/probes/probes_data_source.h"
 #include "src/traced/probes/ps/process_stats_data_source.h"
+#include "src/traced/probes/sys_stats/sys_counters_data_source.h"
 #include "src/traced/probes/sys_stats/sys_stats_data_source.h"
 #include "src/traced/probes/system_info/system_info_data_source.h"
 
@@ -65,11 +67,16 @@ constexpr uint32_t kFlushTimeoutMs = 1000;
 constexpr size_t kTracingSharedMemSizeHintBytes = 1024 * 1024;
 constexpr size_t kTracingSharedMemPageSizeHintBytes = 32 * 1024;
 
+constexpr char kSystemInodesRoot[] = "/system";
+constexpr char kSystemInodesFile[] = "/system_inodes";
+constexpr char kLRUInodeCacheFile[] = "/lru_inodes";
+
 ProbesDataSource::Descriptor const* const kAllDataSources[]{
     &FtraceDataSource::descriptor,               //
     &ProcessStatsDataSource::descriptor,         //
     &InodeFileDataSource::descriptor,            //
     &SysStatsDataSource::descriptor,             //
+    &SysCountersDataSource::descriptor,          //
     &AndroidPowerDataSource::descriptor,         //
     &AndroidLogDataSource::descriptor,           //
     &PackagesListDataSource::descriptor,         //
@@ -169,6 +176,8 @@ void ProbesProducer::SetupDataSource(DataSourceInstanceID instance_id,
     data_source = CreateProcessStatsDataSource(session_id, config);
   } else if (config.name() == SysStatsDataSource::descriptor.name) {
     data_source = CreateSysStatsDataSource(session_id, config);
+  } else if (config.name() == SysCountersDataSource::descriptor.name) {
+    data_source = CreateSysCountersDataSource(session_id, config);
   } else if (config.name() == AndroidPowerDataSource::descriptor.name) {
     data_source = CreateAndroidPowerDataSource(session_id, config);
   } else if (config.name() == AndroidLogDataSource::descriptor.name) {
@@ -245,6 +254,9 @@ std::unique_ptr<ProbesDataSource> ProbesProducer::CreateFtraceDataSource(
   std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
       ftrace_->GetWeakPtr(), session_id, std::move(ftrace_config),
       endpoint_->CreateTraceWriter(buffer_id)));
+  // The data sources are destroyed before |endpoint_|.
+  data_source->set_trace_writer_factory(
+      [this, buffer_id] { return endpoint_->CreateTraceWriter(buffer_id); });
   if (!ftrace_->AddDataSource(data_source.get())) {
     PERFETTO_ELOG("Failed to setup ftrace");
     return nullptr;
@@ -258,8 +270,19 @@ std::unique_ptr<ProbesDataSource> ProbesProducer::CreateInodeFileDataSource(
   PERFETTO_LOG("Inode file map setup (target_buf=%" PRIu32 ")",
                source_config.target_buffer());
   auto buffer_id = static_cast<BufferID>(source_config.target_buffer());
-  if (system_inodes_.empty())
-    CreateStaticDeviceToInodeMap("/system", &system_inodes_);
+  if (!inode_cache_dir_.empty() && !inode_cache_loaded_) {
+    inode_cache_loaded_ = true;
+    LoadStaticInodeMapFile(inode_cache_dir_ + kSystemInodesFile,
+                           kSystemInodesRoot, &system_inodes_);
+    LoadLRUInodeCacheFile(inode_cache_dir_ + kLRUInodeCacheFile, &cache_);
+  }
+  if (system_inodes_.empty()) {
+    CreateStaticDeviceToInodeMap(kSystemInodesRoot, &system_inodes_);
+    if (!inode_cache_dir_.empty()) {
+      SaveStaticInodeMapFile(inode_cache_dir_ + kSystemInodesFile,
+                             kSystemInodesRoot, system_inodes_);
+    }
+  }
   return std::unique_ptr<InodeFileDataSource>(new InodeFileDataSource(
       std::move(source_config), task_runner_, session_id, &system_inodes_,
       &cache_, endpoint_->CreateTraceWriter(buffer_id)));
@@ -309,6 +332,15 @@ std::unique_ptr<ProbesDataSource> ProbesProducer::CreateSysStatsDataSource(
                              endpoint_->CreateTraceWriter(buffer_id), config));
 }
 
+std::unique_ptr<ProbesDataSource> ProbesProducer::CreateSysCountersDataSource(
+    TracingSessionID session_id,
+    const DataSourceConfig& config) {
+  auto buffer_id = static_cast<BufferID>(config.target_buffer());
+  return std::unique_ptr<SysCountersDataSource>(new SysCountersDataSource(
+      task_runner_, session_id, endpoint_->CreateTraceWriter(buffer_id),
+      config));
+}
+
 std::unique_ptr<ProbesDataSource> ProbesProducer::CreateMetatraceDataSource(
     TracingSessionID session_id,
     const DataSourceConfig& config) {
@@ -361,8 +393,14 @@ void ProbesProducer::StopDataSource(DataSourceInstanceID id) {
     session_data_sources_.erase(kv);
     break;
   }
+  // Save the inodes resolved by the session for the next traced_probes.
+  bool save_inode_cache =
+      data_source->descriptor == &InodeFileDataSource::descriptor &&
+      !inode_cache_dir_.empty();
   data_sources_.erase(it);
   watchdogs_.erase(id);
+  if (save_inode_cache)
+    SaveLRUInodeCacheFile(inode_cache_dir_ + kLRUInodeCacheFile, cache_);
 }
 
 void ProbesProducer::OnTracingSetup() {
@@ -470,10 +508,13 @@ void ProbesProducer::OnFtraceDataWrittenIntoDataSourceBuffers() {
       bool has_inodes = metadata && !metadata->inode_and_device.empty();
       bool has_pids = metadata && !metadata->pids.empty();
       bool has_rename_pids = metadata && !metadata->rename_pids.empty();
+      bool has_freed_pids = metadata && !metadata->freed_pids.empty();
       if (has_inodes && inode_data_source)
         inode_data_source->OnInodes(metadata->inode_and_device);
-      // Ordering the rename pids before the seen pids is important so that any
-      // renamed processes get scraped in the OnPids call.
+      // Ordering the rename and freed pids before the seen pids is important
+      // so that any renamed or new processes get scraped in the OnPids call.
+      if (has_freed_pids && ps_data_source)
+        ps_data_source->OnFreedPids(metadata->freed_pids);
       if (has_rename_pids && ps_data_source)
         ps_data_source->OnRenamePids(metadata->rename_pids);
       if (has_pids && ps_data_source)
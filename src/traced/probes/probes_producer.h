@@ -18,6 +18,7 @@
 #define SRC_TRACED_PROBES_PROBES_PRODUCER_H_
 
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <utility>
 
@@ -65,6 +66,13 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
   // Our Impl
   void ConnectWithRetries(const char* socket_name,
                           base::TaskRunner* task_runner);
+
+  // If set, the static /system inode map and the LRU inode cache are saved
+  // into this directory and reused after a restart, see inode_cache_file.h.
+  void set_inode_cache_dir(std::string dir) {
+    inode_cache_dir_ = std::move(dir);
+  }
+
   std::unique_ptr<ProbesDataSource> CreateFtraceDataSource(
       TracingSessionID session_id,
       const DataSourceConfig& config);
@@ -77,6 +85,9 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
   std::unique_ptr<ProbesDataSource> CreateSysStatsDataSource(
       TracingSessionID session_id,
       const DataSourceConfig& config);
+  std::unique_ptr<ProbesDataSource> CreateSysCountersDataSource(
+      TracingSessionID session_id,
+      const DataSourceConfig& config);
   std::unique_ptr<ProbesDataSource> CreateAndroidPowerDataSource(
       TracingSessionID session_id,
       const DataSourceConfig& config);
@@ -143,6 +154,8 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
   LRUInodeCache cache_{kLRUInodeCacheSize};
   std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>
       system_inodes_;
+  std::string inode_cache_dir_;
+  bool inode_cache_loaded_ = false;
 
   base::WeakPtrFactory<ProbesProducer> weak_factory_;  // Keep last.
 };
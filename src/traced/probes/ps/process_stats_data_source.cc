@@ -16,7 +16,10 @@
 
 #include "src/traced/probes/ps/process_stats_data_source.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <utility>
@@ -29,6 +32,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/tracing/core/data_source_config.h"
 
 #include "protos/perfetto/config/process_stats/process_stats_config.pbzero.h"
@@ -69,6 +73,16 @@ inline int ToInt(const std::string& str) {
   return atoi(str.c_str());
 }
 
+// Large enough for /proc/pid/status, whose memory counters come well before
+// the end of it anyways.
+constexpr size_t kReadBufSize = 1024 * 16;
+
+// Fraction of RLIMIT_NOFILE that can be used for caching /proc/pid fds.
+constexpr rlim_t kCachedPidFdsRlimitFraction = 4;
+
+// Fds cached for each pid, see PolledProcess.
+constexpr rlim_t kCachedFdsPerPid = 3;
+
 inline uint32_t ToU32(const char* str) {
   return static_cast<uint32_t>(strtol(str, nullptr, 10));
 }
@@ -96,6 +110,7 @@ ProcessStatsDataSource::ProcessStatsDataSource(
   ProcessStatsConfig::Decoder cfg(ds_config.process_stats_config_raw());
   record_thread_names_ = cfg.record_thread_names();
   dump_all_procs_on_start_ = cfg.scan_all_processes_on_start();
+  cache_process_tree_ = cfg.cache_process_tree();
 
   enable_on_demand_dumps_ = true;
   for (auto quirk = cfg.quirks(); quirk; ++quirk) {
@@ -115,6 +130,8 @@ ProcessStatsDataSource::ProcessStatsDataSource(
     auto proc_stats_ttl_ms = cfg.proc_stats_cache_ttl_ms();
     process_stats_cache_ttl_ticks_ =
         std::max(proc_stats_ttl_ms / poll_period_ms_, 1u);
+    max_poll_interval_ticks_ =
+        std::max(cfg.proc_stats_max_poll_ms() / poll_period_ms_, 1u);
   }
 
   record_thread_time_in_state_ = cfg.record_thread_time_in_state();
@@ -122,6 +139,14 @@ ProcessStatsDataSource::ProcessStatsDataSource(
   if (thread_time_in_state_cache_size_ == 0)
     thread_time_in_state_cache_size_ = kThreadTimeInStateCacheSize;
   thread_time_in_state_cache_.resize(thread_time_in_state_cache_size_);
+
+  if (poll_period_ms_ > 0) {
+    read_buf_ = base::PagedMemory::Allocate(kReadBufSize);
+    struct rlimit rlim {};
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur != RLIM_INFINITY)
+      max_polled_processes_ = static_cast<size_t>(
+          rlim.rlim_cur / kCachedPidFdsRlimitFraction / kCachedFdsPerPid);
+  }
 }
 
 ProcessStatsDataSource::~ProcessStatsDataSource() = default;
@@ -200,8 +225,22 @@ void ProcessStatsDataSource::OnRenamePids(const base::FlatSet<int32_t>& pids) {
   if (!enable_on_demand_dumps_)
     return;
   PERFETTO_DCHECK(!cur_ps_tree_);
-  for (int32_t pid : pids)
+  for (int32_t pid : pids) {
     seen_pids_.erase(pid);
+    process_tree_cache_.erase(pid);
+  }
+}
+
+void ProcessStatsDataSource::OnFreedPids(const base::FlatSet<int32_t>& pids) {
+  if (!enable_on_demand_dumps_)
+    return;
+  PERFETTO_DCHECK(!cur_ps_tree_);
+  // Whatever was written about these pids belongs to a task that is gone. If
+  // they show up again, it is for a new task, which must be read from /proc.
+  for (int32_t pid : pids) {
+    seen_pids_.erase(pid);
+    process_tree_cache_.erase(pid);
+  }
 }
 
 void ProcessStatsDataSource::Flush(FlushRequestID,
@@ -217,6 +256,9 @@ void ProcessStatsDataSource::WriteProcessOrThread(int32_t pid) {
   // In case we're called from outside WriteAllProcesses()
   CacheProcFsScanStartTimestamp();
 
+  if (WriteCachedProcessOrThread(pid))
+    return;
+
   std::string proc_status = ReadProcPidFile(pid, "status");
   if (proc_status.empty())
     return;
@@ -237,39 +279,83 @@ void ProcessStatsDataSource::WriteProcessOrThread(int32_t pid) {
 void ProcessStatsDataSource::WriteProcess(int32_t pid,
                                           const std::string& proc_status) {
   PERFETTO_DCHECK(ToInt(ReadProcStatusEntry(proc_status, "Tgid:")) == pid);
-  auto* proc = GetOrCreatePsTree()->add_processes();
-  proc->set_pid(pid);
-  proc->set_ppid(ToInt(ReadProcStatusEntry(proc_status, "PPid:")));
+  CachedTask process;
+  process.tgid = pid;
+  process.ppid = ToInt(ReadProcStatusEntry(proc_status, "PPid:"));
   // Uid will have multiple entries, only return first (real uid).
-  proc->set_uid(ToInt(ReadProcStatusEntry(proc_status, "Uid:")));
+  process.uid = ToInt(ReadProcStatusEntry(proc_status, "Uid:"));
 
-  std::string cmdline = ReadProcPidFile(pid, "cmdline");
-  if (!cmdline.empty()) {
-    if (cmdline.back() != '\0') {
+  process.cmdline = ReadProcPidFile(pid, "cmdline");
+  if (!process.cmdline.empty()) {
+    if (process.cmdline.back() != '\0') {
       // Some kernels can miss the NUL terminator due to a bug. b/147438623.
-      cmdline.push_back('\0');
+      process.cmdline.push_back('\0');
     }
-    using base::StringSplitter;
-    for (StringSplitter ss(&cmdline[0], cmdline.size(), '\0'); ss.Next();)
-      proc->add_cmdline(ss.cur_token());
   } else {
     // Nothing in cmdline so use the thread name instead (which is == "comm").
-    proc->add_cmdline(ReadProcStatusEntry(proc_status, "Name:").c_str());
+    process.cmdline = ReadProcStatusEntry(proc_status, "Name:");
+    process.cmdline.push_back('\0');
   }
-  seen_pids_.insert(pid);
+  WriteProcessRecord(pid, process);
+  if (cache_process_tree_)
+    process_tree_cache_[pid] = std::move(process);
 }
 
 void ProcessStatsDataSource::WriteThread(int32_t tid,
                                          int32_t tgid,
                                          const char* optional_name) {
-  auto* thread = GetOrCreatePsTree()->add_threads();
-  thread->set_tid(tid);
-  thread->set_tgid(tgid);
+  CachedTask thread;
+  thread.tgid = tgid;
   if (optional_name)
-    thread->set_name(optional_name);
+    thread.name = optional_name;
+  WriteThreadRecord(tid, thread);
+  if (cache_process_tree_)
+    process_tree_cache_[tid] = std::move(thread);
+}
+
+void ProcessStatsDataSource::WriteProcessRecord(int32_t pid,
+                                                const CachedTask& process) {
+  auto* proc = GetOrCreatePsTree()->add_processes();
+  proc->set_pid(pid);
+  proc->set_ppid(process.ppid);
+  proc->set_uid(process.uid);
+  for (base::StringSplitter ss(process.cmdline, '\0'); ss.Next();)
+    proc->add_cmdline(ss.cur_token());
+  seen_pids_.insert(pid);
+}
+
+void ProcessStatsDataSource::WriteThreadRecord(int32_t tid,
+                                               const CachedTask& thread) {
+  auto* proto = GetOrCreatePsTree()->add_threads();
+  proto->set_tid(tid);
+  proto->set_tgid(thread.tgid);
+  if (!thread.name.empty())
+    proto->set_name(thread.name);
   seen_pids_.insert(tid);
 }
 
+// Re-emits the records of |pid| (and of its process, if not seen yet) from
+// |process_tree_cache_|. Returns false if they are not all there, in which
+// case nothing is written and the caller falls back to reading /proc.
+bool ProcessStatsDataSource::WriteCachedProcessOrThread(int32_t pid) {
+  auto it = process_tree_cache_.find(pid);
+  if (it == process_tree_cache_.end())
+    return false;
+  const CachedTask& task = it->second;
+  if (task.tgid == pid) {
+    WriteProcessRecord(pid, task);
+    return true;
+  }
+  if (!seen_pids_.count(task.tgid)) {
+    auto process_it = process_tree_cache_.find(task.tgid);
+    if (process_it == process_tree_cache_.end())
+      return false;
+    WriteProcessRecord(task.tgid, process_it->second);
+  }
+  WriteThreadRecord(pid, task);
+  return true;
+}
+
 base::ScopedDir ProcessStatsDataSource::OpenProcDir() {
   base::ScopedDir proc_dir(opendir("/proc"));
   if (!proc_dir)
@@ -292,6 +378,41 @@ base::ScopedDir ProcessStatsDataSource::OpenProcTaskDir(int32_t pid) {
   return base::ScopedDir(opendir(task_path));
 }
 
+base::ScopedFile ProcessStatsDataSource::OpenProcPidFile(int32_t pid,
+                                                         const char* file) {
+  char path[255];
+  sprintf(path, "/proc/%d/%s", pid, file);
+  return base::OpenFile(path, O_RDONLY | O_CLOEXEC);
+}
+
+base::StringView ProcessStatsDataSource::ReadProcPidFileCached(
+    int32_t pid,
+    const char* file,
+    base::ScopedFile* fd) {
+  char* buf = static_cast<char*>(read_buf_.Get());
+  // A cached fd whose process died fails with ESRCH. Retry once with a fresh
+  // fd, in case the pid has been reused by a new process in the meantime.
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool reopened = false;
+    if (!*fd) {
+      *fd = OpenProcPidFile(pid, file);
+      if (!*fd)
+        return base::StringView();
+      reopened = true;
+    }
+    ssize_t res = PERFETTO_EINTR(pread(**fd, buf, kReadBufSize - 1, 0));
+    if (res > 0) {
+      size_t rsize = static_cast<size_t>(res);
+      buf[rsize] = '\0';
+      return base::StringView(buf, rsize);
+    }
+    fd->reset();
+    if (reopened)
+      break;
+  }
+  return base::StringView();
+}
+
 std::string ProcessStatsDataSource::ReadProcStatusEntry(const std::string& buf,
                                                         const char* key) {
   auto begin = buf.find(key);
@@ -397,6 +518,7 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
   if (!proc_dir)
     return;
   base::FlatSet<int32_t> pids;
+  ++stats_scan_id_;
   while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
     cur_ps_stats_process_ = nullptr;
 
@@ -404,24 +526,66 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
     if (skip_stats_for_pids_.size() > pid_u && skip_stats_for_pids_[pid_u])
       continue;
 
-    std::string proc_status = ReadProcPidFile(pid, "status");
-    if (proc_status.empty())
-      continue;
+    // Keep the fds of up to |max_polled_processes_| pids open across polls.
+    // Any other pid goes through |tmp|, which closes them once done.
+    PolledProcess tmp;
+    PolledProcess* polled = &tmp;
+    auto it = polled_processes_.find(pid);
+    if (it != polled_processes_.end()) {
+      polled = &it->second;
+    } else if (polled_processes_.size() < max_polled_processes_) {
+      polled = &polled_processes_[pid];
+    }
+    polled->last_seen_scan = stats_scan_id_;
+
+    // With the adaptive poll, skip the processes which are not due yet, and
+    // read /proc/pid/status only if /proc/pid/statm changed since the last
+    // poll. Neither applies once the counters of the process have been
+    // dropped from |process_stats_cache_|, as they must be written again.
+    bool read_status = true;
+    if (max_poll_interval_ticks_ > 1) {
+      bool has_cached_stats = process_stats_cache_.count(pid) > 0;
+      if (has_cached_stats && stats_scan_id_ < polled->next_poll_scan) {
+        pids.insert(pid);
+        continue;
+      }
+      base::StringView statm =
+          ReadProcPidFileCached(pid, "statm", &polled->statm);
+      uint64_t statm_hash =
+          statm.empty() ? 0 : base::Hash::Bulk(statm.data(), statm.size());
+      if (has_cached_stats && statm_hash && statm_hash == polled->statm_hash) {
+        read_status = false;
+        polled->poll_interval_ticks = std::min(
+            polled->poll_interval_ticks * 2, max_poll_interval_ticks_);
+      } else {
+        polled->statm_hash = statm_hash;
+        polled->poll_interval_ticks = 1;
+      }
+      polled->next_poll_scan = stats_scan_id_ + polled->poll_interval_ticks;
+    }
 
-    if (!WriteMemCounters(pid, proc_status)) {
-      // If WriteMemCounters() fails the pid is very likely a kernel thread
-      // that has a valid /proc/[pid]/status but no memory values. In this
-      // case avoid keep polling it over and over.
-      if (skip_stats_for_pids_.size() <= pid_u)
-        skip_stats_for_pids_.resize(pid_u + 1);
-      skip_stats_for_pids_[pid_u] = true;
-      continue;
+    if (read_status) {
+      base::StringView proc_status =
+          ReadProcPidFileCached(pid, "status", &polled->status);
+      if (proc_status.empty())
+        continue;
+
+      if (!WriteMemCounters(pid, proc_status)) {
+        // If WriteMemCounters() fails the pid is very likely a kernel thread
+        // that has a valid /proc/[pid]/status but no memory values. In this
+        // case avoid keep polling it over and over.
+        if (skip_stats_for_pids_.size() <= pid_u)
+          skip_stats_for_pids_.resize(pid_u + 1);
+        skip_stats_for_pids_[pid_u] = true;
+        continue;
+      }
     }
 
-    std::string oom_score_adj = ReadProcPidFile(pid, "oom_score_adj");
+    base::StringView oom_score_adj =
+        ReadProcPidFileCached(pid, "oom_score_adj", &polled->oom_score_adj);
     if (!oom_score_adj.empty()) {
       CachedProcessStats& cached = process_stats_cache_[pid];
-      auto counter = ToInt(oom_score_adj);
+      auto counter = atoi(oom_score_adj.data());
       if (counter != cached.oom_score_adj) {
         GetOrCreateStatsProcess(pid)->set_oom_score_adj(counter);
         cached.oom_score_adj = counter;
@@ -441,6 +605,16 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
   }
   FinalizeCurPacket();
 
+  // Drop (and close the fds of) the processes that went away, or turned out
+  // to be kernel threads.
+  for (auto it = polled_processes_.begin(); it != polled_processes_.end();) {
+    if (it->second.last_seen_scan != stats_scan_id_) {
+      it = polled_processes_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
   // Ensure that we write once long-term process info (e.g., name) for new pids
   // that we haven't seen before.
   WriteProcessTree(pids);
@@ -450,7 +624,7 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
 // it failed (e.g., |pid| was a kernel thread and, as such, didn't report any
 // memory counters).
 bool ProcessStatsDataSource::WriteMemCounters(int32_t pid,
-                                              const std::string& proc_status) {
+                                              base::StringView proc_status) {
   bool proc_status_has_mem_counters = false;
   CachedProcessStats& cached = process_stats_cache_[pid];
 
@@ -464,94 +638,77 @@ bool ProcessStatsDataSource::WriteMemCounters(int32_t pid,
   // VmSize:     5992 kB
   // VmLck:         0 kB
   // ...
-  std::vector<char> key;
-  std::vector<char> value;
-  enum { kKey, kSeparator, kValue } state = kKey;
-  for (char c : proc_status) {
-    if (c == '\n') {
-      key.push_back('\0');
-      value.push_back('\0');
-
-      // |value| will contain "1234 KB". We rely on strtol() (in ToU32()) to
-      // stop parsing at the first non-numeric character.
-      if (strcmp(key.data(), "VmSize") == 0) {
-        // Assume that if we see VmSize we'll see also the others.
-        proc_status_has_mem_counters = true;
-
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_size_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_size_kb(counter);
-          cached.vm_size_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmLck") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_locked_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_locked_kb(counter);
-          cached.vm_locked_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmHWM") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_hvm_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_hwm_kb(counter);
-          cached.vm_hvm_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmRSS") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_rss_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_rss_kb(counter);
-          cached.vm_rss_kb = counter;
-        }
-      } else if (strcmp(key.data(), "RssAnon") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.rss_anon_kb) {
-          GetOrCreateStatsProcess(pid)->set_rss_anon_kb(counter);
-          cached.rss_anon_kb = counter;
-        }
-      } else if (strcmp(key.data(), "RssFile") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.rss_file_kb) {
-          GetOrCreateStatsProcess(pid)->set_rss_file_kb(counter);
-          cached.rss_file_kb = counter;
-        }
-      } else if (strcmp(key.data(), "RssShmem") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.rss_shmem_kb) {
-          GetOrCreateStatsProcess(pid)->set_rss_shmem_kb(counter);
-          cached.rss_shmem_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmSwap") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_swap_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_swap_kb(counter);
-          cached.vm_swap_kb = counter;
-        }
-      }
-
-      key.clear();
-      state = kKey;
+  // This is done in a single pass over the buffer, without copying the keys
+  // and values out of it. |proc_status| is NUL-terminated (see
+  // ReadProcPidFileCached()), which makes it safe to strtol() the values in
+  // place: the value "1234 kB" is parsed up to the first non-numeric char.
+  const char* const end = proc_status.data() + proc_status.size();
+  for (const char* line = proc_status.data(); line < end;) {
+    const char* eol =
+        static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+    if (!eol)
+      break;  // Ignore a truncated last line.
+    const char* sep =
+        static_cast<const char*>(memchr(line, ':', size_t(eol - line)));
+    if (!sep) {
+      line = eol + 1;
       continue;
     }
-
-    if (state == kKey) {
-      if (c == ':') {
-        state = kSeparator;
-        continue;
+    base::StringView key(line, size_t(sep - line));
+    const char* value = sep + 1;
+    line = eol + 1;
+
+    if (key == "VmSize") {
+      // Assume that if we see VmSize we'll see also the others.
+      proc_status_has_mem_counters = true;
+
+      auto counter = ToU32(value);
+      if (counter != cached.vm_size_kb) {
+        GetOrCreateStatsProcess(pid)->set_vm_size_kb(counter);
+        cached.vm_size_kb = counter;
+      }
+    } else if (key == "VmLck") {
+      auto counter = ToU32(value);
+      if (counter != cached.vm_locked_kb) {
+        GetOrCreateStatsProcess(pid)->set_vm_locked_kb(counter);
+        cached.vm_locked_kb = counter;
+      }
+    } else if (key == "VmHWM") {
+      auto counter = ToU32(value);
+      if (counter != cached.vm_hvm_kb) {
+        GetOrCreateStatsProcess(pid)->set_vm_hwm_kb(counter);
+        cached.vm_hvm_kb = counter;
+      }
+    } else if (key == "VmRSS") {
+      auto counter = ToU32(value);
+      if (counter != cached.vm_rss_kb) {
+        GetOrCreateStatsProcess(pid)->set_vm_rss_kb(counter);
+        cached.vm_rss_kb = counter;
+      }
+    } else if (key == "RssAnon") {
+      auto counter = ToU32(value);
+      if (counter != cached.rss_anon_kb) {
+        GetOrCreateStatsProcess(pid)->set_rss_anon_kb(counter);
+        cached.rss_anon_kb = counter;
+      }
+    } else if (key == "RssFile") {
+      auto counter = ToU32(value);
+      if (counter != cached.rss_file_kb) {
+        GetOrCreateStatsProcess(pid)->set_rss_file_kb(counter);
+        cached.rss_file_kb = counter;
+      }
+    } else if (key == "RssShmem") {
+      auto counter = ToU32(value);
+      if (counter != cached.rss_shmem_kb) {
+        GetOrCreateStatsProcess(pid)->set_rss_shmem_kb(counter);
+        cached.rss_shmem_kb = counter;
+      }
+    } else if (key == "VmSwap") {
+      auto counter = ToU32(value);
+      if (counter != cached.vm_swap_kb) {
+        GetOrCreateStatsProcess(pid)->set_vm_swap_kb(counter);
+        cached.vm_swap_kb = counter;
       }
-      key.push_back(c);
-      continue;
-    }
-
-    if (state == kSeparator) {
-      if (isspace(c))
-        continue;
-      value.clear();
-      value.push_back(c);
-      state = kValue;
-      continue;
-    }
-
-    if (state == kValue) {
-      value.push_back(c);
     }
   }
   return proc_status_has_mem_counters;
@@ -667,11 +824,13 @@ uint64_t ProcessStatsDataSource::CacheProcFsScanStartTimestamp() {
 
 void ProcessStatsDataSource::ClearIncrementalState() {
   PERFETTO_DLOG("ProcessStatsDataSource clearing incremental state.");
+  // |process_tree_cache_| is kept: the pids seen again get re-emitted from it.
   seen_pids_.clear();
   skip_stats_for_pids_.clear();
 
   cache_ticks_ = 0;
   process_stats_cache_.clear();
+  polled_processes_.clear();
   thread_time_in_state_cache_.clear();
   thread_time_in_state_cache_.resize(thread_time_in_state_cache_size_);
 
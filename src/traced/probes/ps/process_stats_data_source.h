@@ -24,7 +24,9 @@
 #include <vector>
 
 #include "perfetto/base/flat_set.h"
+#include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
@@ -62,6 +64,7 @@ class ProcessStatsDataSource : public ProbesDataSource {
   void WriteAllProcesses();
   void OnPids(const base::FlatSet<int32_t>& pids);
   void OnRenamePids(const base::FlatSet<int32_t>& pids);
+  void OnFreedPids(const base::FlatSet<int32_t>& pids);
 
   // ProbesDataSource implementation.
   void Start() override;
@@ -74,6 +77,14 @@ class ProcessStatsDataSource : public ProbesDataSource {
   virtual base::ScopedDir OpenProcDir();
   virtual std::string ReadProcPidFile(int32_t pid, const std::string& file);
   virtual base::ScopedDir OpenProcTaskDir(int32_t pid);
+  virtual base::ScopedFile OpenProcPidFile(int32_t pid, const char* file);
+
+  // Reads /proc/|pid|/|file| through the fd cached in |fd| (opening it on
+  // first use) into |read_buf_|. The returned view is NUL-terminated and valid
+  // until the next call. Returns an empty view on failure.
+  virtual base::StringView ReadProcPidFileCached(int32_t pid,
+                                                 const char* file,
+                                                 base::ScopedFile* fd);
 
  private:
   struct CachedProcessStats {
@@ -91,6 +102,34 @@ class ProcessStatsDataSource : public ProbesDataSource {
     uint64_t cpu_time = std::numeric_limits<uint64_t>::max();
   };
 
+  // What WriteProcess() and WriteThread() write about a pid, kept in
+  // |process_tree_cache_| with the cache_process_tree option.
+  struct CachedTask {
+    int32_t tgid = 0;
+    int32_t ppid = 0;
+    int32_t uid = 0;
+    std::string cmdline;  // NUL-separated args, only for processes.
+    std::string name;     // Only for threads, empty if not recorded.
+  };
+
+  // The /proc/pid files that are re-read on every poll, kept open across
+  // polls to save an open() + close() per file per tick, and the state of the
+  // adaptive poll (proc_stats_max_poll_ms). Unlike CachedProcessStats, this is
+  // not cleared every |process_stats_cache_ttl_ticks_|.
+  struct PolledProcess {
+    base::ScopedFile status;
+    base::ScopedFile oom_score_adj;
+    base::ScopedFile statm;
+    uint32_t last_seen_scan = 0;
+
+    // The process is polled again at scan |next_poll_scan|,
+    // |poll_interval_ticks| after the last one, and /proc/pid/status is read
+    // only if /proc/pid/statm (whose hash is |statm_hash|) changed.
+    uint64_t statm_hash = 0;
+    uint32_t poll_interval_ticks = 1;
+    uint32_t next_poll_scan = 0;
+  };
+
   // Common functions.
   ProcessStatsDataSource(const ProcessStatsDataSource&) = delete;
   ProcessStatsDataSource& operator=(const ProcessStatsDataSource&) = delete;
@@ -105,12 +144,15 @@ class ProcessStatsDataSource : public ProbesDataSource {
   void WriteProcess(int32_t pid, const std::string& proc_status);
   void WriteThread(int32_t tid, int32_t tgid, const char* optional_name);
   void WriteProcessOrThread(int32_t pid);
+  void WriteProcessRecord(int32_t pid, const CachedTask&);
+  void WriteThreadRecord(int32_t tid, const CachedTask&);
+  bool WriteCachedProcessOrThread(int32_t pid);
   std::string ReadProcStatusEntry(const std::string& buf, const char* key);
 
   // Functions for periodically sampling process stats/counters.
   static void Tick(base::WeakPtr<ProcessStatsDataSource>);
   void WriteAllProcessStats();
-  bool WriteMemCounters(int32_t pid, const std::string& proc_status);
+  bool WriteMemCounters(int32_t pid, base::StringView proc_status);
   bool ShouldWriteThreadStats(int32_t pid);
   void WriteThreadStats(int32_t pid, int32_t tid);
 
@@ -143,12 +185,19 @@ class ProcessStatsDataSource : public ProbesDataSource {
   bool enable_on_demand_dumps_ = true;
   bool dump_all_procs_on_start_ = false;
   bool record_thread_time_in_state_ = false;
+  bool cache_process_tree_ = false;
 
   // This set contains PIDs as per the Linux kernel notion of a PID (which is
   // really a TID). In practice this set will contain all TIDs for all processes
   // seen, not just the main thread id (aka thread group ID).
   base::FlatSet<int32_t> seen_pids_;
 
+  // With cache_process_tree, the records of all the pids (or tids) written so
+  // far. Unlike |seen_pids_|, this survives ClearIncrementalState(), after
+  // which the records are re-emitted from here rather than re-read from /proc.
+  // Entries are dropped by OnRenamePids() and OnFreedPids().
+  std::unordered_map<int32_t, CachedTask> process_tree_cache_;
+
   // Fields for keeping track of the periodic stats/counters.
   uint32_t poll_period_ms_ = 0;
   uint64_t cache_ticks_ = 0;
@@ -159,8 +208,23 @@ class ProcessStatsDataSource : public ProbesDataSource {
   // Cached process stats per process. Cleared every |cache_ttl_ticks_| *
   // |poll_period_ms_| ms.
   uint32_t process_stats_cache_ttl_ticks_ = 0;
+
+  // If > 1, the max number of ticks between two polls of a process whose
+  // /proc/pid/statm doesn't change.
+  uint32_t max_poll_interval_ticks_ = 1;
   std::unordered_map<int32_t, CachedProcessStats> process_stats_cache_;
 
+  // Open fds and poll state of the processes polled by
+  // WriteAllProcessStats(). Entries of pids not seen by the latest scan are
+  // dropped at the end of it. At most |max_polled_processes_| pids are kept,
+  // the others are read through temporary fds and polled on every tick.
+  std::unordered_map<int32_t, PolledProcess> polled_processes_;
+  size_t max_polled_processes_ = 0;
+  uint32_t stats_scan_id_ = 0;
+
+  // Scratch buffer for ReadProcPidFileCached().
+  base::PagedMemory read_buf_;
+
   using TimeInStateCacheEntry = std::tuple</* tid */ int32_t,
                                            /* cpu_freq_index */ uint32_t,
                                            /* ticks */ uint64_t>;
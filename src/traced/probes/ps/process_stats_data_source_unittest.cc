@@ -17,6 +17,7 @@
 #include "src/traced/probes/ps/process_stats_data_source.h"
 
 #include <dirent.h>
+#include <fcntl.h>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/temp_file.h"
@@ -59,6 +60,23 @@ class TestProcessStatsDataSource : public ProcessStatsDataSource {
   MOCK_METHOD0(OpenProcDir, base::ScopedDir());
   MOCK_METHOD2(ReadProcPidFile, std::string(int32_t pid, const std::string&));
   MOCK_METHOD1(OpenProcTaskDir, base::ScopedDir(int32_t pid));
+  MOCK_METHOD2(OpenProcPidFile, base::ScopedFile(int32_t pid, const char*));
+
+  // Unless |use_cached_fds| is set, route the reads done on every poll through
+  // the ReadProcPidFile() mock as well.
+  base::StringView ReadProcPidFileCached(int32_t pid,
+                                         const char* file,
+                                         base::ScopedFile* fd) override {
+    if (use_cached_fds)
+      return ProcessStatsDataSource::ReadProcPidFileCached(pid, file, fd);
+    cached_read_ = ReadProcPidFile(pid, file);
+    return base::StringView(cached_read_);
+  }
+
+  bool use_cached_fds = false;
+
+ private:
+  std::string cached_read_;
 };
 
 class ProcessStatsDataSourceTest : public ::testing::Test {
@@ -253,6 +271,65 @@ TEST_F(ProcessStatsDataSourceTest, IncrementalStateClear) {
   }
 }
 
+TEST_F(ProcessStatsDataSourceTest, CacheProcessTree) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_record_thread_names(true);
+  cfg.set_cache_process_tree(true);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  EXPECT_CALL(*data_source, ReadProcPidFile(43, "status"))
+      .WillOnce(Return("Name: thread\nTgid:\t42\nPid:   43\nPPid:  17\n"));
+  EXPECT_CALL(*data_source, ReadProcPidFile(42, "cmdline"))
+      .WillOnce(Return(std::string("proc\0arg\0", 9)));
+  data_source->OnPids({43});
+
+  // After a clear, the process and the thread are re-emitted from the cache,
+  // without reading /proc.
+  Mock::VerifyAndClearExpectations(data_source.get());
+  EXPECT_CALL(*data_source, ReadProcPidFile(_, _)).Times(0);
+  data_source->ClearIncrementalState();
+  data_source->OnPids({43});
+
+  {
+    auto trace = writer_raw_->GetAllTracePackets();
+    ASSERT_EQ(trace.size(), 2u);
+    for (const auto& packet : trace) {
+      auto ps_tree = packet.process_tree();
+      ASSERT_EQ(ps_tree.processes_size(), 1);
+      EXPECT_EQ(ps_tree.processes()[0].pid(), 42);
+      EXPECT_EQ(ps_tree.processes()[0].ppid(), 17);
+      EXPECT_THAT(ps_tree.processes()[0].cmdline(),
+                  ElementsAreArray({"proc", "arg"}));
+      ASSERT_EQ(ps_tree.threads_size(), 1);
+      EXPECT_EQ(ps_tree.threads()[0].tid(), 43);
+      EXPECT_EQ(ps_tree.threads()[0].tgid(), 42);
+      EXPECT_EQ(ps_tree.threads()[0].name(), "thread");
+    }
+    EXPECT_TRUE(trace[1].incremental_state_cleared());
+  }
+
+  // Once freed, the pid is read from /proc again when it shows up.
+  Mock::VerifyAndClearExpectations(data_source.get());
+  EXPECT_CALL(*data_source, ReadProcPidFile(43, "status"))
+      .WillOnce(Return("Name: new\nTgid:\t43\nPid:   43\nPPid:  1\n"));
+  EXPECT_CALL(*data_source, ReadProcPidFile(43, "cmdline"))
+      .WillOnce(Return(std::string("new\0", 4)));
+  data_source->OnFreedPids({43});
+  data_source->OnPids({43});
+
+  {
+    auto trace = writer_raw_->GetAllTracePackets();
+    ASSERT_EQ(trace.size(), 3u);
+    auto ps_tree = trace[2].process_tree();
+    ASSERT_EQ(ps_tree.processes_size(), 1);
+    EXPECT_EQ(ps_tree.processes()[0].pid(), 43);
+    EXPECT_THAT(ps_tree.processes()[0].cmdline(), ElementsAreArray({"new"}));
+    EXPECT_EQ(ps_tree.threads_size(), 0);
+  }
+}
+
 TEST_F(ProcessStatsDataSourceTest, RenamePids) {
   // assertion helpers
   auto expected_old_process = [](int pid) {
@@ -465,6 +542,153 @@ TEST_F(ProcessStatsDataSourceTest, CacheProcessStats) {
   base::Rmdir(path);
 }
 
+TEST_F(ProcessStatsDataSourceTest, AdaptivePoll) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.set_proc_stats_max_poll_ms(400);
+  cfg.set_proc_stats_cache_ttl_ms(10000);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  // Populate a fake /proc/ directory.
+  auto fake_proc = base::TempDir::Create();
+  const int kPid = 1;
+  char path[256];
+  sprintf(path, "%s/%d", fake_proc.path().c_str(), kPid);
+  mkdir(path, 0755);
+
+  // Stop after the 6th poll.
+  auto checkpoint = task_runner_.CreateCheckpoint("all_done");
+  int polls = 0;
+  EXPECT_CALL(*data_source, OpenProcDir())
+      .WillRepeatedly(Invoke([&fake_proc, &polls, &checkpoint] {
+        if (++polls > 6) {
+          checkpoint();
+          return base::ScopedDir();
+        }
+        return base::ScopedDir(opendir(fake_proc.path().c_str()));
+      }));
+
+  // statm is stable in the polls 1-2 (so the process is polled again only at
+  // the 4th), changes in the 4th and is stable again in the 5th (so the
+  // process is skipped in the 6th).
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "statm"))
+      .WillOnce(Return("100 20 10 1 0 30 0\n"))
+      .WillOnce(Return("100 20 10 1 0 30 0\n"))
+      .WillOnce(Return("100 25 10 1 0 35 0\n"))
+      .WillOnce(Return("100 25 10 1 0 35 0\n"));
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "status"))
+      .WillOnce(Return("Name:\tpid_1\nVmSize:\t 400 kB\nVmRSS:\t80 kB\n"))
+      .WillOnce(Return("Name:\tpid_1\nVmSize:\t 400 kB\nVmRSS:\t100 kB\n"));
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "oom_score_adj"))
+      .Times(4)
+      .WillRepeatedly(Return("0"));
+
+  data_source->Start();
+  task_runner_.RunUntilCheckpoint("all_done");
+  data_source->Flush(1 /* FlushRequestId */, []() {});
+
+  std::vector<protos::gen::ProcessStats::Process> processes;
+  auto trace = writer_raw_->GetAllTracePackets();
+  for (const auto& packet : trace) {
+    for (const auto& process : packet.process_stats().processes()) {
+      processes.push_back(process);
+    }
+  }
+  ASSERT_EQ(processes.size(), 2u);
+  EXPECT_EQ(processes[0].vm_rss_kb(), 80u);
+  EXPECT_EQ(processes[1].vm_rss_kb(), 100u);
+
+  // Cleanup |fake_proc|. TempDir checks that the directory is empty.
+  base::Rmdir(path);
+}
+
+TEST_F(ProcessStatsDataSourceTest, ReusesProcPidFds) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+  data_source->use_cached_fds = true;
+
+  // Populate a fake /proc/ directory, with the files of pid 1 in a separate
+  // directory so that the fake /proc/ contains only numeric entries.
+  auto fake_proc = base::TempDir::Create();
+  auto fake_pid_dir = base::TempDir::Create();
+  const int kPid = 1;
+  char path[256];
+  sprintf(path, "%s/%d", fake_proc.path().c_str(), kPid);
+  mkdir(path, 0755);
+  std::string status_path = fake_pid_dir.path() + "/status";
+  std::string oom_path = fake_pid_dir.path() + "/oom_score_adj";
+
+  // Rewrites the files in place, so that the fds opened by the data source
+  // keep pointing to them.
+  auto write_files = [&status_path, &oom_path](int iter) {
+    char status[256];
+    sprintf(status, "Name:\tpid_1\nVmSize:\t %d kB\nVmRSS:\t%d  kB\n",
+            100 + iter * 10 + 1, 100 + iter * 10 + 2);
+    std::string oom = std::to_string(100 + iter * 10 + 3);
+    for (const auto& kv : {std::make_pair(status_path, std::string(status)),
+                           std::make_pair(oom_path, oom)}) {
+      base::ScopedFile fd =
+          base::OpenFile(kv.first, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      ASSERT_TRUE(fd);
+      ASSERT_EQ(base::WriteAll(*fd, kv.second.data(), kv.second.size()),
+                static_cast<ssize_t>(kv.second.size()));
+    }
+  };
+
+  auto checkpoint = task_runner_.CreateCheckpoint("all_done");
+  const int kNumIters = 3;
+  int iter = 0;
+  EXPECT_CALL(*data_source, OpenProcDir())
+      .WillRepeatedly(Invoke([&fake_proc, &iter, &write_files, &checkpoint] {
+        if (iter == kNumIters) {
+          checkpoint();
+          return base::ScopedDir();
+        }
+        write_files(iter++);
+        return base::ScopedDir(opendir(fake_proc.path().c_str()));
+      }));
+
+  // Each file gets opened only once, and re-read on the following polls.
+  EXPECT_CALL(*data_source, OpenProcPidFile(kPid, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&fake_pid_dir](int32_t, const char* file) {
+        return base::OpenFile(fake_pid_dir.path() + "/" + file, O_RDONLY);
+      }));
+
+  data_source->Start();
+  task_runner_.RunUntilCheckpoint("all_done");
+  data_source->Flush(1 /* FlushRequestId */, []() {});
+
+  std::vector<protos::gen::ProcessStats::Process> processes;
+  auto trace = writer_raw_->GetAllTracePackets();
+  for (const auto& packet : trace) {
+    for (const auto& process : packet.process_stats().processes()) {
+      processes.push_back(process);
+    }
+  }
+  ASSERT_EQ(processes.size(), static_cast<size_t>(kNumIters));
+  for (int i = 0; i < kNumIters; i++) {
+    const auto& proc_counters = processes[static_cast<size_t>(i)];
+    ASSERT_EQ(proc_counters.pid(), kPid);
+    ASSERT_EQ(static_cast<int>(proc_counters.vm_size_kb()), 100 + i * 10 + 1);
+    ASSERT_EQ(static_cast<int>(proc_counters.vm_rss_kb()), 100 + i * 10 + 2);
+    ASSERT_EQ(static_cast<int>(proc_counters.oom_score_adj()),
+              100 + i * 10 + 3);
+  }
+
+  // Cleanup the fake directories. TempDir checks that they are empty.
+  base::Rmdir(path);
+  remove(status_path.c_str());
+  remove(oom_path.c_str());
+}
+
 TEST_F(ProcessStatsDataSourceTest, ThreadTimeInState) {
   DataSourceConfig ds_config;
   ProcessStatsConfig config;
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/traced/probes/sys_stats/sys_counters_data_source.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "perfetto/base/task_runner.h"
+#include "perfetto/base/time.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/metatrace.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/protozero/proto_utils.h"
+
+#include "protos/perfetto/config/sys_stats/sys_stats_config.pbzero.h"
+#include "protos/perfetto/trace/sys_stats/sys_stats.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+
+using protos::pbzero::SysCountersConfig;
+
+namespace {
+constexpr uint32_t kDefaultSamplePeriodMs = 10;
+constexpr uint32_t kDefaultBatchPeriodMs = 1000;
+
+// Bounds the size of a batch if the batch timer lags behind, e.g. because of
+// a very short sample_period_ms.
+constexpr size_t kMaxBatchSamples = 16 * 1024;
+
+// Enough for any integer and its trailing newline.
+constexpr size_t kReadBufSize = 32;
+
+base::ScopedFile OpenCounterFile(const char* path) {
+  // Only the leading integer of the files is ever traced, but keep the data
+  // source from being used to probe the rest of the filesystem.
+  if (!base::StartsWith(path, "/sys/") && !base::StartsWith(path, "/proc/")) {
+    PERFETTO_ELOG("Ignoring %s, which is not under /sys/ or /proc/", path);
+    return base::ScopedFile();
+  }
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY | O_CLOEXEC));
+  if (!fd)
+    PERFETTO_PLOG("Failed opening %s", path);
+  return fd;
+}
+
+}  // namespace
+
+// static
+const ProbesDataSource::Descriptor SysCountersDataSource::descriptor = {
+    /*name*/ "linux.sys_counters",
+    /*flags*/ Descriptor::kFlagsNone,
+};
+
+SysCountersDataSource::SysCountersDataSource(
+    base::TaskRunner* task_runner,
+    TracingSessionID session_id,
+    std::unique_ptr<TraceWriter> writer,
+    const DataSourceConfig& ds_config,
+    OpenFunction open_fn)
+    : ProbesDataSource(session_id, &descriptor),
+      task_runner_(task_runner),
+      writer_(std::move(writer)),
+      weak_factory_(this) {
+  SysCountersConfig::Decoder cfg(ds_config.sys_counters_config_raw());
+  open_fn = open_fn ? open_fn : OpenCounterFile;
+  for (auto it = cfg.path(); it; ++it) {
+    std::string path = it->as_std_string();
+    base::ScopedFile fd = open_fn(path.c_str());
+    if (!fd)
+      continue;
+    counters_.emplace_back();
+    counters_.back().path = std::move(path);
+    counters_.back().fd = std::move(fd);
+  }
+
+  sample_period_ms_ = cfg.has_sample_period_ms()
+                          ? std::max(cfg.sample_period_ms(), 1u)
+                          : kDefaultSamplePeriodMs;
+  batch_period_ms_ = cfg.batch_period_ms() ? cfg.batch_period_ms()
+                                           : kDefaultBatchPeriodMs;
+  batch_period_ms_ = std::max(batch_period_ms_, sample_period_ms_);
+}
+
+SysCountersDataSource::~SysCountersDataSource() = default;
+
+void SysCountersDataSource::Start() {
+  if (counters_.empty())
+    return;
+  auto weak_this = GetWeakPtr();
+  task_runner_->PostTask(
+      std::bind(&SysCountersDataSource::SampleTick, weak_this));
+  task_runner_->PostDelayedTask(
+      std::bind(&SysCountersDataSource::BatchTick, weak_this),
+      batch_period_ms_);
+}
+
+// static
+void SysCountersDataSource::SampleTick(
+    base::WeakPtr<SysCountersDataSource> weak_this) {
+  if (!weak_this)
+    return;
+  SysCountersDataSource& thiz = *weak_this;
+
+  uint32_t period_ms = thiz.sample_period_ms_;
+  uint32_t delay_ms =
+      period_ms -
+      static_cast<uint32_t>(base::GetWallTimeMs().count() % period_ms);
+  thiz.task_runner_->PostDelayedTask(
+      std::bind(&SysCountersDataSource::SampleTick, weak_this), delay_ms);
+  thiz.Sample(base::GetBootTimeNs().count());
+}
+
+// static
+void SysCountersDataSource::BatchTick(
+    base::WeakPtr<SysCountersDataSource> weak_this) {
+  if (!weak_this)
+    return;
+  SysCountersDataSource& thiz = *weak_this;
+  thiz.task_runner_->PostDelayedTask(
+      std::bind(&SysCountersDataSource::BatchTick, weak_this),
+      thiz.batch_period_ms_);
+  thiz.WriteBatch();
+}
+
+void SysCountersDataSource::Sample(int64_t ts) {
+  PERFETTO_METATRACE_SCOPED(TAG_PROC_POLLERS, READ_SYS_COUNTERS);
+  if (num_samples_ >= kMaxBatchSamples)
+    WriteBatch();
+
+  if (num_samples_ == 0) {
+    first_sample_ts_ = ts;
+    last_sample_ts_ = ts;
+  }
+  timestamps_.Append(static_cast<uint64_t>(ts - last_sample_ts_));
+  last_sample_ts_ = ts;
+
+  // There is no vectored read across several fds, but the persistent fds save
+  // an open() and a close() per file and sample, and pread() saves the lseek().
+  char buf[kReadBufSize];
+  for (Counter& counter : counters_) {
+    int64_t value = counter.last_value;
+    ssize_t res = pread(*counter.fd, buf, sizeof(buf) - 1, 0);
+    char* end = buf;
+    if (res > 0) {
+      buf[res] = '\0';
+      value = strtoll(buf, &end, 10);
+    }
+    if (end == buf) {
+      // Repeat the last value, rather than breaking the layout of the batch.
+      value = counter.last_value;
+      if (!counter.read_error_logged) {
+        PERFETTO_PLOG("Failed reading %s", counter.path.c_str());
+        counter.read_error_logged = true;
+      }
+    }
+    int64_t prev_value = num_samples_ ? counter.last_value : 0;
+    values_.Append(protozero::proto_utils::ZigZagEncode(value - prev_value));
+    counter.last_value = value;
+  }
+  num_samples_++;
+}
+
+void SysCountersDataSource::WriteBatch() {
+  if (num_samples_ == 0)
+    return;
+  auto packet = writer_->NewTracePacket();
+  packet->set_timestamp(static_cast<uint64_t>(first_sample_ts_));
+  auto* batch = packet->set_sys_stats()->set_counter_batch();
+  for (const Counter& counter : counters_)
+    batch->add_name(counter.path);
+  batch->set_timestamp(timestamps_);
+  batch->set_value(values_);
+
+  num_samples_ = 0;
+  timestamps_.Reset();
+  values_.Reset();
+}
+
+base::WeakPtr<SysCountersDataSource> SysCountersDataSource::GetWeakPtr()
+    const {
+  return weak_factory_.GetWeakPtr();
+}
+
+void SysCountersDataSource::Flush(FlushRequestID,
+                                  std::function<void()> callback) {
+  WriteBatch();
+  writer_->Flush(callback);
+}
+
+}  // namespace perfetto
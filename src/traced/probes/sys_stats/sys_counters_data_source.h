@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_TRACED_PROBES_SYS_STATS_SYS_COUNTERS_DATA_SOURCE_H_
+#define SRC_TRACED_PROBES_SYS_STATS_SYS_COUNTERS_DATA_SOURCE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/weak_ptr.h"
+#include "perfetto/ext/tracing/core/basic_types.h"
+#include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "src/traced/probes/probes_data_source.h"
+
+namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}
+
+// Samples files holding a single integer (thermal zones, devfreq, sysfs
+// counters of drivers ...) at a high rate, and writes the samples of each
+// SysCountersConfig.batch_period_ms in a single packet, delta-encoded in
+// packed fields. See SysCountersConfig.
+class SysCountersDataSource : public ProbesDataSource {
+ public:
+  static const ProbesDataSource::Descriptor descriptor;
+
+  using OpenFunction = base::ScopedFile (*)(const char*);
+  SysCountersDataSource(base::TaskRunner*,
+                        TracingSessionID,
+                        std::unique_ptr<TraceWriter> writer,
+                        const DataSourceConfig&,
+                        OpenFunction = nullptr);
+  ~SysCountersDataSource() override;
+
+  // ProbesDataSource implementation.
+  void Start() override;
+  void Flush(FlushRequestID, std::function<void()> callback) override;
+
+  base::WeakPtr<SysCountersDataSource> GetWeakPtr() const;
+
+  size_t num_counters_for_testing() const { return counters_.size(); }
+  void SampleForTesting(int64_t ts) { Sample(ts); }
+  void WriteBatchForTesting() { WriteBatch(); }
+
+ private:
+  struct Counter {
+    std::string path;
+    base::ScopedFile fd;
+    int64_t last_value = 0;
+    bool read_error_logged = false;
+  };
+
+  static void SampleTick(base::WeakPtr<SysCountersDataSource>);
+  static void BatchTick(base::WeakPtr<SysCountersDataSource>);
+
+  SysCountersDataSource(const SysCountersDataSource&) = delete;
+  SysCountersDataSource& operator=(const SysCountersDataSource&) = delete;
+
+  // Reads all the |counters_| and appends their values to |values_|.
+  void Sample(int64_t ts);
+  void WriteBatch();
+
+  base::TaskRunner* const task_runner_;
+  std::unique_ptr<TraceWriter> writer_;
+  std::vector<Counter> counters_;
+  uint32_t sample_period_ms_ = 0;
+  uint32_t batch_period_ms_ = 0;
+
+  // The samples taken since the last WriteBatch(), see SysStats.CounterBatch.
+  size_t num_samples_ = 0;
+  int64_t first_sample_ts_ = 0;
+  int64_t last_sample_ts_ = 0;
+  protozero::PackedVarInt timestamps_;
+  protozero::PackedVarInt values_;
+
+  base::WeakPtrFactory<SysCountersDataSource> weak_factory_;  // Keep last.
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_SYS_STATS_SYS_COUNTERS_DATA_SOURCE_H_
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <unistd.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/traced/probes/sys_stats/sys_counters_data_source.h"
+#include "src/tracing/core/trace_writer_for_testing.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/config/data_source_config.gen.h"
+#include "protos/perfetto/config/sys_stats/sys_stats_config.gen.h"
+#include "protos/perfetto/trace/sys_stats/sys_stats.gen.h"
+
+using ::testing::ElementsAre;
+
+namespace perfetto {
+namespace {
+
+// Unlike the default one, allows to open the temp files of the tests.
+base::ScopedFile OpenForTesting(const char* path) {
+  return base::OpenFile(path, O_RDONLY);
+}
+
+void SetValue(const base::TempFile& file, const char* value) {
+  PERFETTO_CHECK(ftruncate(file.fd(), 0) == 0);
+  PERFETTO_CHECK(pwrite(file.fd(), value, strlen(value), 0) ==
+                 static_cast<ssize_t>(strlen(value)));
+}
+
+class SysCountersDataSourceTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<SysCountersDataSource> GetDataSource(
+      const std::vector<std::string>& paths) {
+    protos::gen::SysCountersConfig counters_config;
+    for (const std::string& path : paths)
+      counters_config.add_path(path);
+    DataSourceConfig config;
+    config.set_sys_counters_config_raw(counters_config.SerializeAsString());
+
+    auto writer =
+        std::unique_ptr<TraceWriterForTesting>(new TraceWriterForTesting());
+    writer_raw_ = writer.get();
+    return std::unique_ptr<SysCountersDataSource>(new SysCountersDataSource(
+        &task_runner_, 0, std::move(writer), config, OpenForTesting));
+  }
+
+  TraceWriterForTesting* writer_raw_ = nullptr;
+  base::TestTaskRunner task_runner_;
+};
+
+TEST_F(SysCountersDataSourceTest, DeltaEncodedBatch) {
+  base::TempFile temp = base::TempFile::Create();
+  base::TempFile freq = base::TempFile::Create();
+  SetValue(temp, "42000\n");
+  SetValue(freq, "300000\n");
+  auto data_source = GetDataSource({temp.path(), freq.path()});
+  ASSERT_EQ(data_source->num_counters_for_testing(), 2u);
+
+  data_source->SampleForTesting(1000);
+  SetValue(temp, "41000\n");
+  data_source->SampleForTesting(1010);
+  SetValue(freq, "600000\n");
+  data_source->SampleForTesting(1030);
+  data_source->WriteBatchForTesting();
+
+  protos::gen::TracePacket packet = writer_raw_->GetOnlyTracePacket();
+  EXPECT_EQ(packet.timestamp(), 1000u);
+  ASSERT_TRUE(packet.has_sys_stats());
+  const auto& batch = packet.sys_stats().counter_batch();
+  EXPECT_THAT(batch.name(), ElementsAre(temp.path(), freq.path()));
+  EXPECT_THAT(batch.timestamp(), ElementsAre(0u, 10u, 20u));
+  // ZigZag encoded: 42000, 300000, -1000, 0, 0, 300000.
+  EXPECT_THAT(batch.value(),
+              ElementsAre(84000u, 600000u, 1999u, 0u, 0u, 600000u));
+
+  // The first sample of the next batch is absolute again.
+  data_source->SampleForTesting(2000);
+  data_source->WriteBatchForTesting();
+  const auto& next_batch =
+      writer_raw_->GetAllTracePackets().back().sys_stats().counter_batch();
+  EXPECT_THAT(next_batch.timestamp(), ElementsAre(0u));
+  EXPECT_THAT(next_batch.value(), ElementsAre(82000u, 1200000u));
+}
+
+TEST_F(SysCountersDataSourceTest, UnreadableFiles) {
+  base::TempFile temp = base::TempFile::Create();
+  base::TempFile garbage = base::TempFile::Create();
+  SetValue(temp, "10");
+  SetValue(garbage, "garbage");
+  auto data_source =
+      GetDataSource({"/does/not/exist", temp.path(), garbage.path()});
+  ASSERT_EQ(data_source->num_counters_for_testing(), 2u);
+
+  data_source->SampleForTesting(1000);
+  SetValue(temp, "");
+  data_source->SampleForTesting(1001);
+  data_source->WriteBatchForTesting();
+
+  protos::gen::TracePacket packet = writer_raw_->GetOnlyTracePacket();
+  const auto& batch = packet.sys_stats().counter_batch();
+  EXPECT_THAT(batch.name(), ElementsAre(temp.path(), garbage.path()));
+  // The values which can't be read repeat the last one.
+  EXPECT_THAT(batch.value(), ElementsAre(20u, 0u, 0u, 0u));
+}
+
+TEST_F(SysCountersDataSourceTest, NoSamples) {
+  base::TempFile temp = base::TempFile::Create();
+  auto data_source = GetDataSource({temp.path()});
+  data_source->WriteBatchForTesting();
+  EXPECT_TRUE(writer_raw_->GetAllTracePackets().empty());
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -263,28 +263,72 @@ const char* SysStatsDataSource::ReadDevfreqCurFreq(
   return static_cast<char*>(read_buf_.Get());
 }
 
+template <typename EmitFn>
+void SysStatsDataSource::ParseKeyValueFile(
+    char* buf,
+    size_t size,
+    char key_delimiter,
+    const std::map<const char*, int, CStrCmp>& counters,
+    KeyValueFileLayout* layout,
+    EmitFn emit) {
+  std::vector<KeyValueFileLayout::Line>& lines = layout->lines;
+  char* const end = buf + size;
+  size_t line_idx = 0;
+  for (char* line = buf; line < end; line_idx++) {
+    char* eol = static_cast<char*>(memchr(line, '\n', size_t(end - line)));
+    if (!eol)
+      eol = end;
+    char* key_end =
+        static_cast<char*>(memchr(line, key_delimiter, size_t(eol - line)));
+    size_t key_size = size_t((key_end ? key_end : eol) - line);
+    const char* value = key_end ? key_end + 1 : eol;
+
+    // If the key differs from the one of the previous read, rebuild the layout
+    // from this line onwards.
+    if (line_idx < lines.size()) {
+      const KeyValueFileLayout::Line& expected = lines[line_idx];
+      if (expected.key_size != key_size ||
+          memcmp(&layout->keys[expected.key_offset], line, key_size) != 0) {
+        layout->keys.resize(expected.key_offset);
+        lines.resize(line_idx);
+      }
+    }
+    if (line_idx == lines.size()) {
+      KeyValueFileLayout::Line new_line{};
+      new_line.key_offset = static_cast<uint32_t>(layout->keys.size());
+      new_line.key_size = static_cast<uint32_t>(key_size);
+      layout->keys.append(line, key_size);
+      auto it = counters.find(layout->keys.c_str() + new_line.key_offset);
+      new_line.counter_id = it == counters.end() ? 0 : it->second;
+      lines.push_back(new_line);
+    }
+    line = eol + 1;
+
+    int counter_id = lines[line_idx].counter_id;
+    if (counter_id && value < eol)
+      emit(counter_id, static_cast<uint64_t>(strtoll(value, nullptr, 10)));
+  }
+  // The file got shorter.
+  if (line_idx < lines.size()) {
+    layout->keys.resize(lines[line_idx].key_offset);
+    lines.resize(line_idx);
+  }
+}
+
 void SysStatsDataSource::ReadMeminfo(protos::pbzero::SysStats* sys_stats) {
   size_t rsize = ReadFile(&meminfo_fd_, "/proc/meminfo");
   if (!rsize)
     return;
   char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
-      continue;
-    // Extract the meminfo key, dropping trailing ':' (e.g., "MemTotal: NN KB").
-    words.cur_token()[words.cur_token_size() - 1] = '\0';
-    auto it = meminfo_counters_.find(words.cur_token());
-    if (it == meminfo_counters_.end())
-      continue;
-    int counter_id = it->second;
-    if (!words.Next())
-      continue;
-    auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
-    auto* meminfo = sys_stats->add_meminfo();
-    meminfo->set_key(static_cast<protos::pbzero::MeminfoCounters>(counter_id));
-    meminfo->set_value(value);
-  }
+  // Lines look like "MemTotal:        3744240 kB".
+  ParseKeyValueFile(buf, rsize - 1, ':', meminfo_counters_, &meminfo_layout_,
+                    [sys_stats](int counter_id, uint64_t value) {
+                      auto* meminfo = sys_stats->add_meminfo();
+                      meminfo->set_key(
+                          static_cast<protos::pbzero::MeminfoCounters>(
+                              counter_id));
+                      meminfo->set_value(value);
+                    });
 }
 
 void SysStatsDataSource::ReadVmstat(protos::pbzero::SysStats* sys_stats) {
@@ -292,21 +336,15 @@ void SysStatsDataSource::ReadVmstat(protos::pbzero::SysStats* sys_stats) {
   if (!rsize)
     return;
   char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
-      continue;
-    auto it = vmstat_counters_.find(words.cur_token());
-    if (it == vmstat_counters_.end())
-      continue;
-    int counter_id = it->second;
-    if (!words.Next())
-      continue;
-    auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
-    auto* vmstat = sys_stats->add_vmstat();
-    vmstat->set_key(static_cast<protos::pbzero::VmstatCounters>(counter_id));
-    vmstat->set_value(value);
-  }
+  // Lines look like "nr_free_pages 16449".
+  ParseKeyValueFile(buf, rsize - 1, ' ', vmstat_counters_, &vmstat_layout_,
+                    [sys_stats](int counter_id, uint64_t value) {
+                      auto* vmstat = sys_stats->add_vmstat();
+                      vmstat->set_key(
+                          static_cast<protos::pbzero::VmstatCounters>(
+                              counter_id));
+                      vmstat->set_value(value);
+                    });
 }
 
 void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
@@ -22,6 +22,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -63,6 +64,7 @@ class SysStatsDataSource : public ProbesDataSource {
 
   void set_ns_per_user_hz_for_testing(uint64_t ns) { ns_per_user_hz_ = ns; }
   uint32_t tick_for_testing() const { return tick_; }
+  void ReadSysStatsForTesting() { ReadSysStats(); }
 
   // Virtual for testing
   virtual base::ScopedDir OpenDevfreqDir();
@@ -75,6 +77,20 @@ class SysStatsDataSource : public ProbesDataSource {
     }
   };
 
+  // The keys of the lines of /proc/meminfo or /proc/vmstat, which the kernel
+  // prints in the same order on every read. Built on the first read, so that
+  // the following ones only check that each line still has the same key
+  // instead of looking it up in |meminfo_counters_| or |vmstat_counters_|.
+  struct KeyValueFileLayout {
+    struct Line {
+      uint32_t key_offset;  // In |keys|.
+      uint32_t key_size;
+      int counter_id;  // 0 if the key is not a counter enabled in the config.
+    };
+    std::vector<Line> lines;
+    std::string keys;
+  };
+
   static void Tick(base::WeakPtr<SysStatsDataSource>);
 
   SysStatsDataSource(const SysStatsDataSource&) = delete;
@@ -86,6 +102,16 @@ class SysStatsDataSource : public ProbesDataSource {
   void ReadDevfreq(protos::pbzero::SysStats* sys_stats);
   size_t ReadFile(base::ScopedFile*, const char* path);
 
+  // Calls |emit(counter_id, value)| for the lines of the "key<delimiter>value"
+  // file in |buf| whose key is in |counters|.
+  template <typename EmitFn>
+  static void ParseKeyValueFile(char* buf,
+                                size_t size,
+                                char key_delimiter,
+                                const std::map<const char*, int, CStrCmp>&,
+                                KeyValueFileLayout*,
+                                EmitFn emit);
+
   base::TaskRunner* const task_runner_;
   std::unique_ptr<TraceWriter> writer_;
   base::ScopedFile meminfo_fd_;
@@ -95,6 +121,8 @@ class SysStatsDataSource : public ProbesDataSource {
   TraceWriter::TracePacketHandle cur_packet_;
   std::map<const char*, int, CStrCmp> meminfo_counters_;
   std::map<const char*, int, CStrCmp> vmstat_counters_;
+  KeyValueFileLayout meminfo_layout_;
+  KeyValueFileLayout vmstat_layout_;
   uint64_t ns_per_user_hz_ = 0;
   uint32_t tick_ = 0;
   uint32_t tick_period_ms_ = 0;
@@ -0,0 +1,346 @@
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/traced/probes/sys_stats/sys_stats_data_source.h"
+#include "src/tracing/core/null_trace_writer.h"
+
+#include "protos/perfetto/config/sys_stats/sys_stats_config.gen.h"
+
+namespace {
+
+// Dumps of /proc files from a x86_64 Linux 6.x machine.
+const char kMeminfo[] = R"(MemTotal:        6147400 kB
+MemFree:         4822400 kB
+MemAvailable:    5554988 kB
+Buffers:           94164 kB
+Cached:           828136 kB
+SwapCached:            0 kB
+Active:           294940 kB
+Inactive:         865144 kB
+Active(anon):         32 kB
+Inactive(anon):   246800 kB
+Active(file):     294908 kB
+Inactive(file):   618344 kB
+Unevictable:        9136 kB
+Mlocked:            9144 kB
+SwapTotal:             0 kB
+SwapFree:              0 kB
+Zswap:                 0 kB
+Zswapped:              0 kB
+Dirty:               444 kB
+Writeback:             0 kB
+AnonPages:        247004 kB
+Mapped:           158852 kB
+Shmem:              9048 kB
+KReclaimable:      51892 kB
+Slab:              72112 kB
+SReclaimable:      51892 kB
+SUnreclaim:        20220 kB
+KernelStack:        1152 kB
+PageTables:         2084 kB
+SecPageTables:         0 kB
+NFS_Unstable:          0 kB
+Bounce:                0 kB
+WritebackTmp:          0 kB
+CommitLimit:     3073700 kB
+Committed_AS:     373156 kB
+VmallocTotal:   34359738367 kB
+VmallocUsed:       15908 kB
+VmallocChunk:          0 kB
+Percpu:              296 kB
+AnonHugePages:         0 kB
+ShmemHugePages:        0 kB
+ShmemPmdMapped:        0 kB
+FileHugePages:         0 kB
+FilePmdMapped:         0 kB
+Balloon:               0 kB
+HugePages_Total:       0
+HugePages_Free:        0
+HugePages_Rsvd:        0
+HugePages_Surp:        0
+Hugepagesize:       2048 kB
+Hugetlb:               0 kB
+DirectMap4k:       26624 kB
+DirectMap2M:     2070528 kB
+DirectMap1G:     6291456 kB
+)";
+
+const char kVmstat[] = R"(nr_free_pages 807387
+nr_free_pages_blocks 795648
+nr_zone_inactive_anon 61711
+nr_zone_active_anon 8
+nr_zone_inactive_file 154586
+nr_zone_active_file 73727
+nr_zone_unevictable 2284
+nr_zone_write_pending 122
+nr_mlock 2286
+nr_zspages 0
+nr_free_cma 0
+numa_hit 17004491
+numa_miss 0
+numa_foreign 0
+numa_interleave 1025
+numa_local 17004491
+numa_other 0
+nr_inactive_anon 61700
+nr_active_anon 8
+nr_inactive_file 154586
+nr_active_file 73727
+nr_unevictable 2284
+nr_slab_reclaimable 12973
+nr_slab_unreclaimable 5055
+nr_isolated_anon 0
+nr_isolated_file 0
+workingset_nodes 0
+workingset_refault_anon 0
+workingset_refault_file 0
+workingset_activate_anon 0
+workingset_activate_file 0
+workingset_restore_anon 0
+workingset_restore_file 0
+workingset_nodereclaim 0
+nr_anon_pages 61751
+nr_mapped 39713
+nr_file_pages 230575
+nr_dirty 111
+nr_writeback 0
+nr_shmem 2262
+nr_shmem_hugepages 0
+nr_shmem_pmdmapped 0
+nr_file_hugepages 0
+nr_file_pmdmapped 0
+nr_anon_transparent_hugepages 0
+nr_vmscan_write 0
+nr_vmscan_immediate_reclaim 0
+nr_dirtied 271235
+nr_written 191918
+nr_throttled_written 0
+nr_kernel_misc_reclaimable 0
+nr_foll_pin_acquired 0
+nr_foll_pin_released 0
+nr_kernel_stack 1152
+nr_page_table_pages 521
+nr_sec_page_table_pages 0
+nr_iommu_pages 0
+nr_swapcached 0
+pgpromote_success 0
+pgpromote_candidate 0
+pgpromote_candidate_nrl 0
+pgdemote_kswapd 0
+pgdemote_direct 0
+pgdemote_khugepaged 0
+pgdemote_proactive 0
+nr_hugetlb 0
+nr_balloon_pages 0
+nr_kernel_file_pages 0
+nr_dirty_threshold 280613
+nr_dirty_background_threshold 140135
+nr_memmap_pages 0
+nr_memmap_boot_pages 24576
+pgpgin 622386
+pgpgout 752780
+pswpin 0
+pswpout 0
+pgalloc_dma 0
+pgalloc_dma32 0
+pgalloc_normal 17316523
+pgalloc_movable 0
+pgalloc_device 0
+allocstall_dma 0
+allocstall_dma32 0
+allocstall_normal 0
+allocstall_movable 0
+allocstall_device 0
+pgskip_dma 0
+pgskip_dma32 0
+pgskip_normal 0
+pgskip_movable 0
+pgskip_device 0
+pgfree 18138354
+pgactivate 74493
+pgdeactivate 0
+pglazyfree 0
+pgfault 22299352
+pgmajfault 244
+pglazyfreed 0
+pgrefill 0
+pgreuse 3671058
+pgsteal_kswapd 0
+pgsteal_direct 0
+pgsteal_khugepaged 0
+pgsteal_proactive 0
+pgscan_kswapd 0
+pgscan_direct 0
+pgscan_khugepaged 0
+pgscan_proactive 0
+pgscan_direct_throttle 0
+pgscan_anon 0
+pgscan_file 0
+pgsteal_anon 0
+pgsteal_file 0
+zone_reclaim_success 0
+zone_reclaim_failed 0
+pginodesteal 0
+slabs_scanned 141
+kswapd_inodesteal 0
+kswapd_low_wmark_hit_quickly 0
+kswapd_high_wmark_hit_quickly 0
+pageoutrun 0
+pgrotated 10
+drop_pagecache 1
+drop_slab 2
+oom_kill 0
+numa_pte_updates 0
+numa_huge_pte_updates 0
+numa_hint_faults 0
+numa_hint_faults_local 0
+numa_pages_migrated 0
+pgmigrate_success 0
+pgmigrate_fail 0
+thp_migration_success 0
+thp_migration_fail 0
+thp_migration_split 0
+compact_migrate_scanned 0
+compact_free_scanned 0
+compact_isolated 0
+compact_stall 0
+compact_fail 0
+compact_success 0
+compact_daemon_wake 0
+compact_daemon_migrate_scanned 0
+compact_daemon_free_scanned 0
+htlb_buddy_alloc_success 0
+htlb_buddy_alloc_fail 0
+unevictable_pgs_culled 376527
+unevictable_pgs_scanned 0
+unevictable_pgs_rescued 374243
+unevictable_pgs_mlocked 376527
+unevictable_pgs_munlocked 374243
+unevictable_pgs_cleared 0
+unevictable_pgs_stranded 0
+thp_fault_alloc 0
+thp_fault_fallback 0
+thp_fault_fallback_charge 0
+thp_collapse_alloc 0
+thp_collapse_alloc_failed 0
+thp_file_alloc 0
+thp_file_fallback 0
+thp_file_fallback_charge 0
+thp_file_mapped 0
+thp_split_page 0
+thp_split_page_failed 0
+thp_deferred_split_page 0
+thp_underused_split_page 0
+thp_split_pmd 0
+thp_scan_exceed_none_pte 0
+thp_scan_exceed_swap_pte 0
+thp_scan_exceed_share_pte 0
+thp_split_pud 0
+thp_zero_page_alloc 0
+thp_zero_page_alloc_failed 0
+thp_swpout 0
+thp_swpout_fallback 0
+balloon_inflate 0
+balloon_deflate 0
+balloon_migrate 0
+swap_ra 0
+swap_ra_hit 0
+swpin_zero 0
+swpout_zero 0
+ksm_swpin_copy 0
+cow_ksm 0
+zswpin 0
+zswpout 0
+zswpwb 0
+direct_map_level2_splits 3
+direct_map_level3_splits 0
+direct_map_level2_collapses 0
+direct_map_level3_collapses 0
+nr_unstable 0
+)";
+
+const char kStat[] = R"(cpu  40295 0 9051 110362 168 0 4 184 0 0
+cpu0 40295 0 9051 110362 168 0 4 184 0 0
+intr 216084 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 1 2 0 0 0 0 320 19 0 38 1 9992 1 5 0 14 16 0 7234 12397 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0
+ctxt 1006670
+btime 1791989858
+processes 104689
+procs_running 1
+procs_blocked 0
+softirq 211348 0 59085 1 4525 0 0 1 0 3 147733
+)";
+
+perfetto::base::ScopedFile OpenDump(const char* path) {
+  const char* dump = nullptr;
+  if (!strcmp(path, "/proc/meminfo")) {
+    dump = kMeminfo;
+  } else if (!strcmp(path, "/proc/vmstat")) {
+    dump = kVmstat;
+  } else if (!strcmp(path, "/proc/stat")) {
+    dump = kStat;
+  } else {
+    PERFETTO_FATAL("Unexpected file opened %s", path);
+  }
+  perfetto::base::TempFile tmp = perfetto::base::TempFile::CreateUnlinked();
+  PERFETTO_CHECK(pwrite(tmp.fd(), dump, strlen(dump), 0) > 0);
+  return tmp.ReleaseFD();
+}
+
+// Reads the /proc files enabled by |sys_cfg| on every iteration.
+void RunSysStats(benchmark::State& state,
+                 const perfetto::protos::gen::SysStatsConfig& sys_cfg) {
+  perfetto::DataSourceConfig config;
+  config.set_sys_stats_config_raw(sys_cfg.SerializeAsString());
+  perfetto::base::TestTaskRunner task_runner;
+  perfetto::SysStatsDataSource data_source(
+      &task_runner, 0,
+      std::unique_ptr<perfetto::TraceWriter>(new perfetto::NullTraceWriter()),
+      config, OpenDump);
+  for (auto _ : state)
+    data_source.ReadSysStatsForTesting();
+}
+
+}  // namespace
+
+static void BM_SysStatsMeminfo(benchmark::State& state) {
+  perfetto::protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_meminfo_period_ms(10);
+  RunSysStats(state, sys_cfg);
+}
+BENCHMARK(BM_SysStatsMeminfo);
+
+static void BM_SysStatsVmstat(benchmark::State& state) {
+  perfetto::protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_vmstat_period_ms(10);
+  RunSysStats(state, sys_cfg);
+}
+BENCHMARK(BM_SysStatsVmstat);
+
+static void BM_SysStatsStat(benchmark::State& state) {
+  perfetto::protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_stat_period_ms(10);
+  RunSysStats(state, sys_cfg);
+}
+BENCHMARK(BM_SysStatsStat);
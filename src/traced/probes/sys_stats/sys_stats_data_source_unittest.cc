@@ -307,6 +307,73 @@ TEST_F(SysStatsDataSourceTest, MeminfoAll) {
   EXPECT_GE(sys_stats.meminfo_size(), 10);
 }
 
+// Backs /proc/meminfo in MeminfoLayoutChange, which rewrites it between reads.
+base::TempFile* g_meminfo_file = nullptr;
+
+base::ScopedFile OpenMeminfoFile(const char* path) {
+  if (strcmp(path, "/proc/meminfo"))
+    return base::ScopedFile();
+  return base::ScopedFile(dup(g_meminfo_file->fd()));
+}
+
+TEST_F(SysStatsDataSourceTest, MeminfoLayoutChange) {
+  using C = protos::gen::MeminfoCounters;
+  DataSourceConfig config;
+  protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_meminfo_period_ms(10);
+  sys_cfg.add_meminfo_counters(C::MEMINFO_MEM_TOTAL);
+  sys_cfg.add_meminfo_counters(C::MEMINFO_MEM_FREE);
+  sys_cfg.add_meminfo_counters(C::MEMINFO_BUFFERS);
+  config.set_sys_stats_config_raw(sys_cfg.SerializeAsString());
+
+  base::TempFile meminfo = base::TempFile::CreateUnlinked();
+  g_meminfo_file = &meminfo;
+  auto write_meminfo = [&meminfo](const char* contents) {
+    ASSERT_EQ(ftruncate(meminfo.fd(), 0), 0);
+    ASSERT_GT(pwrite(meminfo.fd(), contents, strlen(contents), 0), 0);
+  };
+  auto writer =
+      std::unique_ptr<TraceWriterForTesting>(new TraceWriterForTesting());
+  writer_raw_ = writer.get();
+  TestSysStatsDataSource data_source(&task_runner_, 0, std::move(writer),
+                                     config, OpenMeminfoFile);
+
+  using KV = std::pair<int, uint64_t>;
+  auto read_meminfo = [this, &data_source] {
+    data_source.ReadSysStatsForTesting();
+    std::vector<KV> kvs;
+    for (const auto& kv :
+         writer_raw_->GetAllTracePackets().back().sys_stats().meminfo())
+      kvs.push_back({kv.key(), kv.value()});
+    return kvs;
+  };
+
+  write_meminfo("MemTotal: 100 kB\nMemFree: 50 kB\nCached: 10 kB\n");
+  EXPECT_THAT(read_meminfo(),
+              UnorderedElementsAre(KV{C::MEMINFO_MEM_TOTAL, 100},
+                                   KV{C::MEMINFO_MEM_FREE, 50}));
+
+  // Same layout, other values.
+  write_meminfo("MemTotal: 100 kB\nMemFree: 40 kB\nCached: 20 kB\n");
+  EXPECT_THAT(read_meminfo(),
+              UnorderedElementsAre(KV{C::MEMINFO_MEM_TOTAL, 100},
+                                   KV{C::MEMINFO_MEM_FREE, 40}));
+
+  // A line added in the middle, and one dropped at the end.
+  write_meminfo("MemTotal: 100 kB\nBuffers: 5 kB\nMemFree: 30 kB\n");
+  EXPECT_THAT(read_meminfo(),
+              UnorderedElementsAre(KV{C::MEMINFO_MEM_TOTAL, 100},
+                                   KV{C::MEMINFO_BUFFERS, 5},
+                                   KV{C::MEMINFO_MEM_FREE, 30}));
+
+  // A key replaced by another one of the same length.
+  write_meminfo("MemTotal: 100 kB\nBuffers: 5 kB\nMemFrex: 20 kB\n");
+  EXPECT_THAT(read_meminfo(),
+              UnorderedElementsAre(KV{C::MEMINFO_MEM_TOTAL, 100},
+                                   KV{C::MEMINFO_BUFFERS, 5}));
+  g_meminfo_file = nullptr;
+}
+
 TEST_F(SysStatsDataSourceTest, Vmstat) {
   using C = protos::gen::VmstatCounters;
   DataSourceConfig config;
@@ -15,10 +15,19 @@
 #include <benchmark/benchmark.h>
 
 #include "perfetto/tracing.h"
+#include "protos/perfetto/config/track_event/track_event_config.gen.h"
 #include "protos/perfetto/trace/test_event.pbzero.h"
 #include "protos/perfetto/trace/track_event/log_message.pbzero.h"
 
-PERFETTO_DEFINE_CATEGORIES(perfetto::Category("benchmark"));
+PERFETTO_DEFINE_CATEGORIES(perfetto::Category("benchmark"),
+                           perfetto::Category("disabled0"),
+                           perfetto::Category("disabled1"),
+                           perfetto::Category("disabled2"),
+                           perfetto::Category("disabled3"),
+                           perfetto::Category("disabled4"),
+                           perfetto::Category("disabled5"),
+                           perfetto::Category("disabled6"),
+                           perfetto::Category("disabled7"));
 PERFETTO_TRACK_EVENT_STATIC_STORAGE();
 
 namespace {
@@ -38,7 +47,9 @@ static void BM_TracingDataSourceDisabled(benchmark::State& state) {
 }
 
 std::unique_ptr<perfetto::TracingSession> StartTracing(
-    const std::string& data_source_name) {
+    const std::string& data_source_name,
+    const perfetto::protos::gen::TrackEventConfig& te_cfg =
+        perfetto::protos::gen::TrackEventConfig()) {
   perfetto::TracingInitArgs args;
   args.backends = perfetto::kInProcessBackend;
   perfetto::Tracing::Initialize(args);
@@ -52,6 +63,7 @@ std::unique_ptr<perfetto::TracingSession> StartTracing(
   cfg.add_buffers()->set_size_kb(1024);
   auto* ds_cfg = cfg.add_data_sources()->mutable_config();
   ds_cfg->set_name(data_source_name);
+  ds_cfg->set_track_event_config_raw(te_cfg.SerializeAsString());
   auto tracing_session =
       perfetto::Tracing::NewTrace(perfetto::kInProcessBackend);
   tracing_session->Setup(cfg);
@@ -82,6 +94,31 @@ static void BM_TracingTrackEventDisabled(benchmark::State& state) {
   }
 }
 
+// Hits the trace points of many categories while a session is tracing, but
+// with all of them disabled: this is the cost that instrumentation adds to hot
+// code when tracing is on for other categories.
+static void BM_TracingTrackEventDisabledCategories(benchmark::State& state) {
+  perfetto::protos::gen::TrackEventConfig te_cfg;
+  te_cfg.add_disabled_categories("*");
+  te_cfg.add_enabled_categories("benchmark");
+  auto tracing_session = StartTracing("track_event", te_cfg);
+
+  while (state.KeepRunning()) {
+    TRACE_EVENT_BEGIN("disabled0", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled1", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled2", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled3", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled4", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled5", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled6", "DisabledEvent");
+    TRACE_EVENT_BEGIN("disabled7", "DisabledEvent");
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 8);
+
+  tracing_session->StopBlocking();
+}
+
 static void BM_TracingTrackEventBasic(benchmark::State& state) {
   auto tracing_session = StartTracing("track_event");
 
@@ -94,11 +131,25 @@ static void BM_TracingTrackEventBasic(benchmark::State& state) {
   PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
 }
 
+// Writes events with state.range(0) (0, 2 or 8) scalar and string debug
+// annotations.
 static void BM_TracingTrackEventDebugAnnotations(benchmark::State& state) {
   auto tracing_session = StartTracing("track_event");
+  const int64_t num_annotations = state.range(0);
+  const std::string str_value = "string value";
+  const void* ptr_value = &state;
 
   while (state.KeepRunning()) {
-    TRACE_EVENT_BEGIN("benchmark", "Event", "value", 42);
+    if (num_annotations == 0) {
+      TRACE_EVENT_BEGIN("benchmark", "Event");
+    } else if (num_annotations == 2) {
+      TRACE_EVENT_BEGIN("benchmark", "Event", "value", 42, "str", "value");
+    } else {
+      TRACE_EVENT_BEGIN("benchmark", "Event", "value", 42, "str", "value",
+                        "uint", 42u, "bool", true, "double", 4.2, "ptr",
+                        ptr_value, "std_str", str_value, "int64",
+                        int64_t{-42});
+    }
     benchmark::ClobberMemory();
   }
 
@@ -127,6 +178,7 @@ static void BM_TracingTrackEventLambda(benchmark::State& state) {
 BENCHMARK(BM_TracingDataSourceDisabled);
 BENCHMARK(BM_TracingDataSourceLambda);
 BENCHMARK(BM_TracingTrackEventBasic);
-BENCHMARK(BM_TracingTrackEventDebugAnnotations);
+BENCHMARK(BM_TracingTrackEventDebugAnnotations)->Arg(0)->Arg(2)->Arg(8);
 BENCHMARK(BM_TracingTrackEventDisabled);
+BENCHMARK(BM_TracingTrackEventDisabledCategories);
 BENCHMARK(BM_TracingTrackEventLambda);
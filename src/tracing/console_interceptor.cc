@@ -20,6 +20,7 @@
 #include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/tracing/internal/track_event_internal.h"
 
@@ -35,8 +36,14 @@
 #include "protos/perfetto/trace/track_event/track_descriptor.pbzero.h"
 #include "protos/perfetto/trace/track_event/track_event.pbzero.h"
 
+#include <string.h>
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <mutex>
+#include <thread>
 #include <tuple>
 
 namespace perfetto {
@@ -52,6 +59,20 @@ namespace {
 
 int g_output_fd_for_testing;
 
+// Orders the packets of all threads when they are printed asynchronously.
+std::atomic<uint64_t> g_next_packet_ordinal{};
+
+// Each event is written out with a single write, unless it's longer than this.
+constexpr size_t kMessageBufferSize = 1024;
+
+// With async output, the events of all threads are batched into a larger
+// buffer and written out periodically.
+constexpr size_t kAsyncMessageBufferSize = 64 * 1024;
+constexpr uint32_t kAsyncOutputPeriodMs = 10;
+
+// The capacity of the packet ring of each thread (must be a power of two).
+constexpr size_t kPacketRingSize = 128 * 1024;
+
 // Google Turbo colormap.
 constexpr std::array<ConsoleColor, 16> kTurboColors = {{
     ConsoleColor{0x30, 0x12, 0x3b},
@@ -114,7 +135,14 @@ uint32_t CounterToHue(uint32_t counter) {
 
 class ConsoleInterceptor::Delegate : public TrackEventStateTracker::Delegate {
  public:
+  // Prints the packets of the calling thread, using the session state of the
+  // interceptor instance.
   explicit Delegate(InterceptorContext&);
+
+  // Prints packets using the given session state.
+  Delegate(PrintState&,
+           TrackEventStateTracker::SequenceState&,
+           TrackEventStateTracker::SessionState*);
   ~Delegate() override;
 
   TrackEventStateTracker::SessionState* GetSessionState() override;
@@ -125,36 +153,297 @@ class ConsoleInterceptor::Delegate : public TrackEventStateTracker::Delegate {
  private:
   using SelfHandle = LockedHandle<ConsoleInterceptor>;
 
-  InterceptorContext& context_;
+  InterceptorContext* const context_;
+  PrintState& print_state_;
+  TrackEventStateTracker::SequenceState& sequence_state_;
+  TrackEventStateTracker::SessionState* const session_state_;
   base::Optional<SelfHandle> locked_self_;
 };
 
+// A single producer, single consumer ring of trace packets. The producer is
+// the thread which owns the ring and the consumer is the AsyncOutput thread.
+class ConsoleInterceptor::PacketRing {
+ public:
+  struct Header {
+    uint64_t ordinal;
+    uint64_t size;
+  };
+
+  PacketRing() : buffer_(new uint8_t[kPacketRingSize]) {}
+
+  // Copies a packet into the ring, waiting for the consumer to make room for
+  // it if needed. Returns false if the packet was dropped because it's larger
+  // than the ring or the consumer is gone.
+  bool Write(uint64_t ordinal, const uint8_t* data, size_t size) {
+    const size_t record_size = sizeof(Header) + size;
+    if (record_size > kPacketRingSize ||
+        reader_closed_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    uint64_t tail = pos_.tail.load(std::memory_order_relaxed);
+    while (kPacketRingSize -
+               (tail - pos_.head.load(std::memory_order_acquire)) <
+           record_size) {
+      if (reader_closed_.load(std::memory_order_relaxed))
+        return false;
+      std::this_thread::yield();
+    }
+    Header header{ordinal, size};
+    CopyIn(tail, &header, sizeof(header));
+    CopyIn(tail + sizeof(header), data, size);
+    pos_.tail.store(tail + record_size, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the producer when it won't write any more packets.
+  void CloseWriter() { writer_closed_.store(true, std::memory_order_release); }
+
+  // Called by the consumer when it won't read any more packets.
+  void CloseReader() { reader_closed_.store(true, std::memory_order_relaxed); }
+
+  bool IsWriterClosed() const {
+    return writer_closed_.load(std::memory_order_acquire);
+  }
+
+  // Returns the end of the packets written so far.
+  uint64_t GetWriteEnd() const {
+    return pos_.tail.load(std::memory_order_acquire);
+  }
+
+  // Reads the header of the next packet, if it was written before |end|.
+  bool PeekHeader(uint64_t end, Header* header) const {
+    uint64_t head = pos_.head.load(std::memory_order_relaxed);
+    if (head >= end)
+      return false;
+    CopyOut(head, header, sizeof(*header));
+    return true;
+  }
+
+  // Returns the next packet, which stays valid until Pop(). |scratch| is used
+  // for packets which wrap around the end of the ring.
+  protozero::ConstBytes ReadPacket(const Header& header,
+                                   std::vector<uint8_t>* scratch) const {
+    uint64_t head = pos_.head.load(std::memory_order_relaxed);
+    size_t offset =
+        static_cast<size_t>((head + sizeof(Header)) & (kPacketRingSize - 1));
+    size_t size = static_cast<size_t>(header.size);
+    if (offset + size <= kPacketRingSize)
+      return protozero::ConstBytes{&buffer_[offset], size};
+    scratch->resize(size);
+    CopyOut(offset, scratch->data(), size);
+    return protozero::ConstBytes{scratch->data(), size};
+  }
+
+  // Frees the next packet.
+  void Pop(const Header& header) {
+    uint64_t head = pos_.head.load(std::memory_order_relaxed);
+    pos_.head.store(head + sizeof(Header) + header.size,
+                std::memory_order_release);
+  }
+
+ private:
+  void CopyIn(uint64_t pos, const void* src, size_t size) {
+    size_t offset = static_cast<size_t>(pos & (kPacketRingSize - 1));
+    size_t first = std::min(size, kPacketRingSize - offset);
+    memcpy(&buffer_[offset], src, first);
+    memcpy(&buffer_[0], static_cast<const uint8_t*>(src) + first, size - first);
+  }
+
+  void CopyOut(uint64_t pos, void* dst, size_t size) const {
+    size_t offset = static_cast<size_t>(pos & (kPacketRingSize - 1));
+    size_t first = std::min(size, kPacketRingSize - offset);
+    memcpy(dst, &buffer_[offset], first);
+    memcpy(static_cast<uint8_t*>(dst) + first, &buffer_[0], size - first);
+  }
+
+  std::unique_ptr<uint8_t[]> buffer_;
+
+  // Positions in bytes since the ring was created. |head| is only written by
+  // the consumer and |tail| by the producer, so they're kept on separate
+  // cache lines.
+  struct {
+    std::atomic<uint64_t> head{};
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail{};
+  } pos_;
+
+  std::atomic<bool> writer_closed_{};
+  std::atomic<bool> reader_closed_{};
+};
+
+// Formats the packets of all the threads of a session on a background thread,
+// batching the output of many events into each write.
+class ConsoleInterceptor::AsyncOutput {
+ public:
+  AsyncOutput(int fd, bool use_colors, uint64_t start_time_ns);
+
+  // Writes out the packets written so far and stops the thread.
+  ~AsyncOutput();
+
+  // Returns a ring for the packets of the calling thread. Thread-safe.
+  std::shared_ptr<PacketRing> CreateRing();
+
+ private:
+  struct Sequence {
+    std::shared_ptr<PacketRing> ring;
+    TrackEventStateTracker::SequenceState sequence_state;
+  };
+
+  void ScheduleDrain();
+  void Drain();
+
+  // Only accessed on the task runner thread (or after it's gone).
+  PrintState print_state_;
+  TrackEventStateTracker::SessionState session_state_;
+  std::vector<uint8_t> scratch_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Sequence>> sequences_;  // Guarded by |mutex_|.
+
+  std::unique_ptr<base::TaskRunner> task_runner_;
+};
+
+ConsoleInterceptor::AsyncOutput::AsyncOutput(int fd,
+                                             bool use_colors,
+                                             uint64_t start_time_ns) {
+  print_state_.fd = fd;
+  print_state_.use_colors = use_colors;
+  print_state_.start_time_ns = start_time_ns;
+  print_state_.message_buffer.resize(kAsyncMessageBufferSize);
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+  task_runner_.reset(new base::ThreadTaskRunner(
+      base::ThreadTaskRunner::CreateAndStart("ConsoleOutput")));
+  ScheduleDrain();
+#endif
+}
+
+ConsoleInterceptor::AsyncOutput::~AsyncOutput() {
+  // Stopping the thread drops the pending drain task, so the rest of the
+  // packets are printed here.
+  task_runner_.reset();
+  Drain();
+  for (const auto& sequence : sequences_)
+    sequence->ring->CloseReader();
+}
+
+std::shared_ptr<ConsoleInterceptor::PacketRing>
+ConsoleInterceptor::AsyncOutput::CreateRing() {
+  std::unique_ptr<Sequence> sequence(new Sequence());
+  sequence->ring = std::make_shared<PacketRing>();
+  std::shared_ptr<PacketRing> ring = sequence->ring;
+  std::lock_guard<std::mutex> lock(mutex_);
+  sequences_.push_back(std::move(sequence));
+  return ring;
+}
+
+void ConsoleInterceptor::AsyncOutput::ScheduleDrain() {
+  // The task runner is destroyed (and its tasks with it) before |this|.
+  task_runner_->PostDelayedTask(
+      [this] {
+        Drain();
+        ScheduleDrain();
+      },
+      kAsyncOutputPeriodMs);
+}
+
+void ConsoleInterceptor::AsyncOutput::Drain() {
+  std::vector<Sequence*> sequences;
+  std::vector<uint64_t> write_ends;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Forget the sequences of the threads which are gone, once all their
+    // packets are printed. Note that the writer needs to be checked first.
+    sequences_.erase(
+        std::remove_if(sequences_.begin(), sequences_.end(),
+                       [](const std::unique_ptr<Sequence>& sequence) {
+                         PacketRing::Header header;
+                         return sequence->ring->IsWriterClosed() &&
+                                !sequence->ring->PeekHeader(
+                                    sequence->ring->GetWriteEnd(), &header);
+                       }),
+        sequences_.end());
+    for (const auto& sequence : sequences_) {
+      sequences.push_back(sequence.get());
+      write_ends.push_back(sequence->ring->GetWriteEnd());
+    }
+  }
+
+  // Print the packets written so far, merging the rings in the order the
+  // packets were written in.
+  for (;;) {
+    Sequence* next = nullptr;
+    PacketRing::Header next_header{};
+    for (size_t i = 0; i < sequences.size(); i++) {
+      PacketRing::Header header;
+      if (!sequences[i]->ring->PeekHeader(write_ends[i], &header))
+        continue;
+      if (!next || header.ordinal < next_header.ordinal) {
+        next = sequences[i];
+        next_header = header;
+      }
+    }
+    if (!next)
+      break;
+    protozero::ConstBytes packet_data =
+        next->ring->ReadPacket(next_header, &scratch_);
+    Delegate delegate(print_state_, next->sequence_state, &session_state_);
+    perfetto::protos::pbzero::TracePacket::Decoder packet(packet_data.data,
+                                                          packet_data.size);
+    TrackEventStateTracker::ProcessTracePacket(delegate, next->sequence_state,
+                                               packet);
+    next->ring->Pop(next_header);
+  }
+  Flush(print_state_);
+}
+
 ConsoleInterceptor::~ConsoleInterceptor() = default;
 
 ConsoleInterceptor::ThreadLocalState::ThreadLocalState(
     ThreadLocalStateArgs& args) {
   if (auto self = args.GetInterceptorLocked()) {
-    start_time_ns = self->start_time_ns_;
-    use_colors = self->use_colors_;
-    fd = self->fd_;
+    print_state.start_time_ns = self->start_time_ns_;
+    print_state.use_colors = self->use_colors_;
+    print_state.fd = self->fd_;
+    if (self->async_output_)
+      packet_ring = self->async_output_->CreateRing();
   }
+  if (!packet_ring)
+    print_state.message_buffer.resize(kMessageBufferSize);
 }
 
-ConsoleInterceptor::ThreadLocalState::~ThreadLocalState() = default;
+ConsoleInterceptor::ThreadLocalState::~ThreadLocalState() {
+  if (packet_ring)
+    packet_ring->CloseWriter();
+}
 
 ConsoleInterceptor::Delegate::Delegate(InterceptorContext& context)
-    : context_(context) {}
+    : context_(&context),
+      print_state_(context.GetThreadLocalState().print_state),
+      sequence_state_(context.GetThreadLocalState().sequence_state),
+      session_state_(nullptr) {}
+
+ConsoleInterceptor::Delegate::Delegate(
+    PrintState& print_state,
+    TrackEventStateTracker::SequenceState& sequence_state,
+    TrackEventStateTracker::SessionState* session_state)
+    : context_(nullptr),
+      print_state_(print_state),
+      sequence_state_(sequence_state),
+      session_state_(session_state) {}
+
 ConsoleInterceptor::Delegate::~Delegate() = default;
 
 TrackEventStateTracker::SessionState*
 ConsoleInterceptor::Delegate::GetSessionState() {
+  if (session_state_)
+    return session_state_;
   // When the session state is retrieved for the first time, it is cached (and
   // kept locked) until we return from OnTracePacket. This avoids having to lock
   // and unlock the instance multiple times per invocation.
   if (locked_self_.has_value())
     return &locked_self_.value()->session_state_;
   locked_self_ =
-      base::make_optional<SelfHandle>(context_.GetInterceptorLocked());
+      base::make_optional<SelfHandle>(context_->GetInterceptorLocked());
   return &locked_self_.value()->session_state_;
 }
 
@@ -175,10 +464,9 @@ void ConsoleInterceptor::Delegate::OnTrackUpdated(
   }
   int title_width = static_cast<int>(title.size());
 
-  auto& tls = context_.GetThreadLocalState();
   std::array<char, 128> message_prefix{};
   ssize_t written = 0;
-  if (tls.use_colors) {
+  if (print_state_.use_colors) {
     written = snprintf(message_prefix.data(), message_prefix.size(),
                        FMT_RGB_SET_BG " %s%s %-*.*s", track_color.r,
                        track_color.g, track_color.b, kReset, kDim, title_width,
@@ -196,46 +484,51 @@ void ConsoleInterceptor::Delegate::OnTrackUpdated(
 void ConsoleInterceptor::Delegate::OnTrackEvent(
     const TrackEventStateTracker::Track& track,
     const TrackEventStateTracker::ParsedTrackEvent& event) {
-  // Start printing.
-  auto& tls = context_.GetThreadLocalState();
-  tls.buffer_pos = 0;
+  // Start printing. Make room for the whole event in the buffer so it's
+  // written out in one go (unless it's very long).
+  if (print_state_.message_buffer.size() - print_state_.buffer_pos <
+      kMessageBufferSize) {
+    Flush(print_state_);
+  }
 
   // Print timestamp and track identifier.
-  SetColor(context_, kDim);
-  Printf(context_, "[%7.3lf] %.*s",
-         static_cast<double>(event.timestamp_ns - tls.start_time_ns) / 1e9,
+  SetColor(print_state_, kDim);
+  Printf(print_state_, "[%7.3lf] %.*s",
+         static_cast<double>(event.timestamp_ns - print_state_.start_time_ns) /
+             1e9,
          static_cast<int>(track.user_data.size()), track.user_data.data());
 
   // Print category.
-  Printf(context_, "%-5.*s ",
+  Printf(print_state_, "%-5.*s ",
          std::min(5, static_cast<int>(event.category.size)),
          event.category.data);
 
   // Print stack depth.
   for (size_t i = 0; i < event.stack_depth; i++) {
-    Printf(context_, "-  ");
+    Printf(print_state_, "-  ");
   }
 
   // Print slice name.
   auto slice_color = HueToRGB(event.name_hash % kMaxHue);
   auto highlight_color = Mix(slice_color, kWhiteColor, kLightness);
   if (event.track_event.type() == protos::pbzero::TrackEvent::TYPE_SLICE_END) {
-    SetColor(context_, kDefault);
-    Printf(context_, "} ");
+    SetColor(print_state_, kDefault);
+    Printf(print_state_, "} ");
   }
-  SetColor(context_, highlight_color);
-  Printf(context_, "%.*s", static_cast<int>(event.name.size), event.name.data);
-  SetColor(context_, kReset);
+  SetColor(print_state_, highlight_color);
+  Printf(print_state_, "%.*s", static_cast<int>(event.name.size),
+         event.name.data);
+  SetColor(print_state_, kReset);
   if (event.track_event.type() ==
       protos::pbzero::TrackEvent::TYPE_SLICE_BEGIN) {
-    SetColor(context_, kDefault);
-    Printf(context_, " {");
+    SetColor(print_state_, kDefault);
+    Printf(print_state_, " {");
   }
 
   // Print annotations.
   if (event.track_event.has_debug_annotations()) {
-    PrintDebugAnnotations(context_, event.track_event, slice_color,
-                          highlight_color);
+    PrintDebugAnnotations(print_state_, sequence_state_, event.track_event,
+                          slice_color, highlight_color);
   }
 
   // TODO(skyostil): Print typed arguments.
@@ -243,11 +536,12 @@ void ConsoleInterceptor::Delegate::OnTrackEvent(
   // Print duration for longer events.
   constexpr uint64_t kNsPerMillisecond = 1000000u;
   if (event.duration_ns >= 10 * kNsPerMillisecond) {
-    SetColor(context_, kDim);
-    Printf(context_, " +%" PRIu64 "ms", event.duration_ns / kNsPerMillisecond);
+    SetColor(print_state_, kDim);
+    Printf(print_state_, " +%" PRIu64 "ms",
+           event.duration_ns / kNsPerMillisecond);
   }
-  SetColor(context_, kReset);
-  Printf(context_, "\n");
+  SetColor(print_state_, kReset);
+  Printf(print_state_, "\n");
 }
 
 // static
@@ -283,39 +577,51 @@ void ConsoleInterceptor::OnSetup(const SetupArgs& args) {
   }
   fd_ = fd;
   use_colors_ = use_colors;
+  // The async output needs a background thread.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+  use_async_output_ = config.enable_async_output();
+#endif
 }
 
 void ConsoleInterceptor::OnStart(const StartArgs&) {
   start_time_ns_ = internal::TrackEventInternal::GetTimeNs();
+  if (use_async_output_)
+    async_output_.reset(new AsyncOutput(fd_, use_colors_, start_time_ns_));
 }
 
-void ConsoleInterceptor::OnStop(const StopArgs&) {}
+void ConsoleInterceptor::OnStop(const StopArgs&) {
+  async_output_.reset();
+}
 
 // static
 void ConsoleInterceptor::OnTracePacket(InterceptorContext context) {
+  auto& tls = context.GetThreadLocalState();
+  if (tls.packet_ring) {
+    // The packet is printed later by the AsyncOutput thread.
+    tls.packet_ring->Write(
+        g_next_packet_ordinal.fetch_add(1, std::memory_order_relaxed),
+        context.packet_data.data, context.packet_data.size);
+    return;
+  }
   {
-    auto& tls = context.GetThreadLocalState();
     Delegate delegate(context);
     perfetto::protos::pbzero::TracePacket::Decoder packet(
         context.packet_data.data, context.packet_data.size);
     TrackEventStateTracker::ProcessTracePacket(delegate, tls.sequence_state,
                                                packet);
   }  // (Potential) lock scope for session state.
-  Flush(context);
+  Flush(tls.print_state);
 }
 
 // static
-void ConsoleInterceptor::Printf(InterceptorContext& context,
-                                const char* format,
-                                ...) {
-  auto& tls = context.GetThreadLocalState();
-  ssize_t remaining = static_cast<ssize_t>(tls.message_buffer.size()) -
-                      static_cast<ssize_t>(tls.buffer_pos);
+void ConsoleInterceptor::Printf(PrintState& state, const char* format, ...) {
+  ssize_t remaining = static_cast<ssize_t>(state.message_buffer.size()) -
+                      static_cast<ssize_t>(state.buffer_pos);
   int written = 0;
   if (remaining > 0) {
     va_list args;
     va_start(args, format);
-    written = vsnprintf(&tls.message_buffer[tls.buffer_pos],
+    written = vsnprintf(&state.message_buffer[state.buffer_pos],
                         static_cast<size_t>(remaining), format, args);
     PERFETTO_DCHECK(written >= 0);
     va_end(args);
@@ -324,11 +630,11 @@ void ConsoleInterceptor::Printf(InterceptorContext& context,
   // In case of buffer overflow, flush to the fd and write the latest message to
   // it directly instead.
   if (remaining <= 0 || written > remaining) {
-    FILE* output = (tls.fd == STDOUT_FILENO) ? stdout : stderr;
+    FILE* output = (state.fd == STDOUT_FILENO) ? stdout : stderr;
     if (g_output_fd_for_testing) {
       output = fdopen(dup(g_output_fd_for_testing), "w");
     }
-    Flush(context);
+    Flush(state);
     va_list args;
     va_start(args, format);
     vfprintf(output, format, args);
@@ -337,129 +643,128 @@ void ConsoleInterceptor::Printf(InterceptorContext& context,
       fclose(output);
     }
   } else if (written > 0) {
-    tls.buffer_pos += static_cast<size_t>(written);
+    state.buffer_pos += static_cast<size_t>(written);
   }
 }
 
 // static
-void ConsoleInterceptor::Flush(InterceptorContext& context) {
-  auto& tls = context.GetThreadLocalState();
-  ssize_t res = base::WriteAll(tls.fd, &tls.message_buffer[0], tls.buffer_pos);
-  PERFETTO_DCHECK(res == static_cast<ssize_t>(tls.buffer_pos));
-  tls.buffer_pos = 0;
+void ConsoleInterceptor::Flush(PrintState& state) {
+  ssize_t res =
+      base::WriteAll(state.fd, state.message_buffer.data(), state.buffer_pos);
+  PERFETTO_DCHECK(res == static_cast<ssize_t>(state.buffer_pos));
+  state.buffer_pos = 0;
 }
 
 // static
-void ConsoleInterceptor::SetColor(InterceptorContext& context,
+void ConsoleInterceptor::SetColor(PrintState& state,
                                   const ConsoleColor& color) {
-  auto& tls = context.GetThreadLocalState();
-  if (!tls.use_colors)
+  if (!state.use_colors)
     return;
-  Printf(context, FMT_RGB_SET, color.r, color.g, color.b);
+  Printf(state, FMT_RGB_SET, color.r, color.g, color.b);
 }
 
 // static
-void ConsoleInterceptor::SetColor(InterceptorContext& context,
-                                  const char* color) {
-  auto& tls = context.GetThreadLocalState();
-  if (!tls.use_colors)
+void ConsoleInterceptor::SetColor(PrintState& state, const char* color) {
+  if (!state.use_colors)
     return;
-  Printf(context, "%s", color);
+  Printf(state, "%s", color);
 }
 
 // static
 void ConsoleInterceptor::PrintDebugAnnotations(
-    InterceptorContext& context,
+    PrintState& state,
+    TrackEventStateTracker::SequenceState& sequence_state,
     const protos::pbzero::TrackEvent_Decoder& track_event,
     const ConsoleColor& slice_color,
     const ConsoleColor& highlight_color) {
-  SetColor(context, slice_color);
-  Printf(context, "(");
+  SetColor(state, slice_color);
+  Printf(state, "(");
 
   bool is_first = true;
   for (auto it = track_event.debug_annotations(); it; it++) {
     perfetto::protos::pbzero::DebugAnnotation::Decoder annotation(*it);
-    SetColor(context, slice_color);
+    SetColor(state, slice_color);
     if (!is_first)
-      Printf(context, ", ");
+      Printf(state, ", ");
 
-    PrintDebugAnnotationName(context, annotation);
-    Printf(context, ":");
+    PrintDebugAnnotationName(state, sequence_state, annotation);
+    Printf(state, ":");
 
-    SetColor(context, highlight_color);
-    PrintDebugAnnotationValue(context, annotation);
+    SetColor(state, highlight_color);
+    PrintDebugAnnotationValue(state, sequence_state, annotation);
 
     is_first = false;
   }
-  SetColor(context, slice_color);
-  Printf(context, ")");
+  SetColor(state, slice_color);
+  Printf(state, ")");
 }
 
 // static
 void ConsoleInterceptor::PrintDebugAnnotationName(
-    InterceptorContext& context,
+    PrintState& state,
+    TrackEventStateTracker::SequenceState& sequence_state,
     const perfetto::protos::pbzero::DebugAnnotation::Decoder& annotation) {
-  auto& tls = context.GetThreadLocalState();
   protozero::ConstChars name{};
   if (annotation.name_iid()) {
     name.data =
-        tls.sequence_state.debug_annotation_names[annotation.name_iid()].data();
+        sequence_state.debug_annotation_names[annotation.name_iid()].data();
     name.size =
-        tls.sequence_state.debug_annotation_names[annotation.name_iid()].size();
+        sequence_state.debug_annotation_names[annotation.name_iid()].size();
   } else if (annotation.has_name()) {
     name.data = annotation.name().data;
     name.size = annotation.name().size;
   }
-  Printf(context, "%.*s", static_cast<int>(name.size), name.data);
+  Printf(state, "%.*s", static_cast<int>(name.size), name.data);
 }
 
 // static
 void ConsoleInterceptor::PrintDebugAnnotationValue(
-    InterceptorContext& context,
+    PrintState& state,
+    TrackEventStateTracker::SequenceState& sequence_state,
     const perfetto::protos::pbzero::DebugAnnotation::Decoder& annotation) {
   if (annotation.has_bool_value()) {
-    Printf(context, "%s", annotation.bool_value() ? "true" : "false");
+    Printf(state, "%s", annotation.bool_value() ? "true" : "false");
   } else if (annotation.has_uint_value()) {
-    Printf(context, "%" PRIu64, annotation.uint_value());
+    Printf(state, "%" PRIu64, annotation.uint_value());
   } else if (annotation.has_int_value()) {
-    Printf(context, "%" PRId64, annotation.int_value());
+    Printf(state, "%" PRId64, annotation.int_value());
   } else if (annotation.has_double_value()) {
-    Printf(context, "%f", annotation.double_value());
+    Printf(state, "%f", annotation.double_value());
   } else if (annotation.has_string_value()) {
-    Printf(context, "%.*s", static_cast<int>(annotation.string_value().size),
+    Printf(state, "%.*s", static_cast<int>(annotation.string_value().size),
            annotation.string_value().data);
   } else if (annotation.has_pointer_value()) {
-    Printf(context, "%p", reinterpret_cast<void*>(annotation.pointer_value()));
+    Printf(state, "%p", reinterpret_cast<void*>(annotation.pointer_value()));
   } else if (annotation.has_legacy_json_value()) {
-    Printf(context, "%.*s",
+    Printf(state, "%.*s",
            static_cast<int>(annotation.legacy_json_value().size),
            annotation.legacy_json_value().data);
   } else if (annotation.has_dict_entries()) {
-    Printf(context, "{");
+    Printf(state, "{");
     bool is_first = true;
     for (auto it = annotation.dict_entries(); it; ++it) {
       if (!is_first)
-        Printf(context, ", ");
+        Printf(state, ", ");
       perfetto::protos::pbzero::DebugAnnotation::Decoder key_value(*it);
-      PrintDebugAnnotationName(context, key_value);
-      Printf(context, ":");
-      PrintDebugAnnotationValue(context, key_value);
+      PrintDebugAnnotationName(state, sequence_state, key_value);
+      Printf(state, ":");
+      PrintDebugAnnotationValue(state, sequence_state, key_value);
       is_first = false;
     }
-    Printf(context, "}");
+    Printf(state, "}");
   } else if (annotation.has_array_values()) {
-    Printf(context, "[");
+    Printf(state, "[");
     bool is_first = true;
     for (auto it = annotation.array_values(); it; ++it) {
       if (!is_first)
-        Printf(context, ", ");
+        Printf(state, ", ");
       perfetto::protos::pbzero::DebugAnnotation::Decoder key_value(*it);
-      PrintDebugAnnotationValue(context, key_value);
+      PrintDebugAnnotationValue(state, sequence_state, key_value);
       is_first = false;
     }
-    Printf(context, "]");
+    Printf(state, "]");
   } else {
-    Printf(context, "{}");
+    Printf(state, "{}");
   }
 }
 
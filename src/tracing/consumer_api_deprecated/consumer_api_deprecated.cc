@@ -64,7 +64,8 @@ class TracingSession : public Consumer {
                  Handle,
                  OnStateChangedCb,
                  void* callback_arg,
-                 const TraceConfig&);
+                 const TraceConfig&,
+                 base::ScopedFile trace_fd);
   ~TracingSession() override;
 
   // Note: if making this class moveable, the move-ctor/dtor must be updated
@@ -107,6 +108,11 @@ class TracingSession : public Consumer {
   void* const callback_arg_ = nullptr;
   TraceConfig trace_config_;
   base::ScopedFile buf_fd_;
+
+  // True if |buf_fd_| was passed to CreateWithFd(). In this case the trace is
+  // left in the caller's file and never mapped.
+  const bool is_caller_fd_;
+
   std::unique_ptr<TracingService::ConsumerEndpoint> consumer_endpoint_;
 
   // |mapped_buf_| and |mapped_buf_size_| are seq-consistent with |state_|.
@@ -121,11 +127,14 @@ TracingSession::TracingSession(base::TaskRunner* task_runner,
                                Handle handle,
                                OnStateChangedCb callback,
                                void* callback_arg,
-                               const TraceConfig& trace_config_proto)
+                               const TraceConfig& trace_config_proto,
+                               base::ScopedFile trace_fd)
     : task_runner_(task_runner),
       handle_(handle),
       callback_(callback),
-      callback_arg_(callback_arg) {
+      callback_arg_(callback_arg),
+      buf_fd_(std::move(trace_fd)),
+      is_caller_fd_(!!buf_fd_) {
   PERFETTO_DETACH_FROM_THREAD(thread_checker_);
   trace_config_ = trace_config_proto;
   trace_config_.set_write_into_file(true);
@@ -148,15 +157,18 @@ bool TracingSession::Initialize() {
   if (state_ != State::kIdle)
     return false;
 
+  if (!is_caller_fd_) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
-  char memfd_name[64];
-  snprintf(memfd_name, sizeof(memfd_name), "perfetto_trace_%" PRId64, handle_);
-  buf_fd_.reset(
-      static_cast<int>(syscall(__NR_memfd_create, memfd_name, MFD_CLOEXEC)));
+    char memfd_name[64];
+    snprintf(memfd_name, sizeof(memfd_name), "perfetto_trace_%" PRId64,
+             handle_);
+    buf_fd_.reset(
+        static_cast<int>(syscall(__NR_memfd_create, memfd_name, MFD_CLOEXEC)));
 #else
-  // Fallback for testing on Linux/mac.
-  buf_fd_ = base::TempFile::CreateUnlinked().ReleaseFD();
+    // Fallback for testing on Linux/mac.
+    buf_fd_ = base::TempFile::CreateUnlinked().ReleaseFD();
 #endif
+  }
 
   if (!buf_fd_) {
     PERFETTO_PLOG("Failed to allocate temporary tracing buffer");
@@ -202,6 +214,21 @@ void TracingSession::OnTracingDisabled(const std::string& error) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DLOG("OnTracingDisabled %s", error.c_str());
 
+  if (is_caller_fd_) {
+    // The service has written the trace straight into the caller's fd, there
+    // is nothing to map. Close our dup so the caller owns the only reference.
+    DestroyConnection();
+    buf_fd_.reset();
+    if (error.empty()) {
+      state_ = State::kTraceEnded;
+    } else {
+      state_ = State::kTraceFailed;
+      PERFETTO_ELOG("Tracing session failed: %s", error.c_str());
+    }
+    NotifyCallback();
+    return;
+  }
+
   struct stat stat_buf {};
   int res = fstat(buf_fd_.get(), &stat_buf);
   mapped_buf_size_ = res == 0 ? static_cast<size_t>(stat_buf.st_size) : 0;
@@ -277,7 +304,11 @@ class TracingController {
   TracingController();
 
   // These methods are called from a thread != |task_runner_|.
-  Handle Create(const void*, size_t, OnStateChangedCb, void* callback_arg);
+  Handle Create(const void*,
+               size_t,
+               base::ScopedFile trace_fd,
+               OnStateChangedCb,
+               void* callback_arg);
   void StartTracing(Handle);
   State PollState(Handle);
   TraceBuffer ReadTrace(Handle);
@@ -316,6 +347,7 @@ void TracingController::ThreadMain() {
 
 Handle TracingController::Create(const void* config_proto_buf,
                                  size_t config_len,
+                                 base::ScopedFile trace_fd,
                                  OnStateChangedCb callback,
                                  void* callback_arg) {
   TraceConfig config_proto;
@@ -332,8 +364,9 @@ Handle TracingController::Create(const void* config_proto_buf,
 
   std::unique_lock<std::mutex> lock(mutex_);
   Handle handle = ++last_handle_;
-  auto* session = new TracingSession(task_runner_.get(), handle, callback,
-                                     callback_arg, config_proto);
+  auto* session =
+      new TracingSession(task_runner_.get(), handle, callback, callback_arg,
+                         config_proto, std::move(trace_fd));
   sessions_.emplace(handle, std::unique_ptr<TracingSession>(session));
 
   // Enable the TracingSession on its own thread.
@@ -401,8 +434,24 @@ PERFETTO_EXPORTED_API Handle Create(const void* config_proto,
                                     size_t config_len,
                                     OnStateChangedCb callback,
                                     void* callback_arg) {
-  return TracingController::GetInstance()->Create(config_proto, config_len,
-                                                  callback, callback_arg);
+  return TracingController::GetInstance()->Create(
+      config_proto, config_len, base::ScopedFile(), callback, callback_arg);
+}
+
+PERFETTO_EXPORTED_API Handle CreateWithFd(const void* config_proto,
+                                          size_t config_len,
+                                          int trace_fd,
+                                          OnStateChangedCb callback,
+                                          void* callback_arg) {
+  // Dup the fd here, on the caller thread, so the caller is free to close it
+  // as soon as this call returns.
+  base::ScopedFile fd(trace_fd < 0 ? -1 : dup(trace_fd));
+  if (!fd) {
+    PERFETTO_PLOG("CreateWithFd(): invalid trace fd (%d)", trace_fd);
+    return kInvalidHandle;
+  }
+  return TracingController::GetInstance()->Create(
+      config_proto, config_len, std::move(fd), callback, callback_arg);
 }
 
 PERFETTO_EXPORTED_API
@@ -15,6 +15,8 @@
  */
 
 #include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <array>
 #include <atomic>
@@ -22,6 +24,7 @@
 #include <thread>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "perfetto/public/consumer_api.h"
 
 #include "protos/perfetto/config/data_source_config.gen.h"
@@ -119,6 +122,45 @@ void TestSingle() {
   Destroy(handle);
 }
 
+void TestWithFd() {
+  std::string cfg = GetConfig(1000);
+  perfetto::base::TempFile trace_file = perfetto::base::TempFile::Create();
+  auto handle = CreateWithFd(cfg.data(), cfg.size(), trace_file.fd(),
+                             &OnStateChanged, &g_pointer);
+  PERFETTO_ILOG("Starting, handle=%" PRId64 " state=%d", handle,
+                static_cast<int>(PollState(handle)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  StartTracing(handle);
+  // Wait for either completion or error.
+  while (static_cast<int>(PollState(handle)) > 0 &&
+         PollState(handle) != State::kTraceEnded) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  if (PollState(handle) == State::kTraceEnded) {
+    if (ReadTrace(handle).begin)
+      PERFETTO_ELOG("FAIL: the buffer was supposed to be empty");
+    struct stat stat_buf {};
+    PERFETTO_CHECK(fstat(trace_file.fd(), &stat_buf) == 0);
+    TraceBuffer buf{};
+    buf.size = static_cast<size_t>(stat_buf.st_size);
+    void* map = mmap(nullptr, buf.size, PROT_READ, MAP_SHARED,
+                     trace_file.fd(), 0);
+    if (buf.size == 0 || map == MAP_FAILED) {
+      PERFETTO_ELOG("FAIL: the trace file was supposed to be not empty");
+    } else {
+      buf.begin = static_cast<char*>(map);
+      DumpTrace(buf);
+      munmap(map, buf.size);
+    }
+  } else {
+    PERFETTO_ELOG("Trace failed");
+  }
+
+  PERFETTO_ILOG("Destroying");
+  Destroy(handle);
+}
+
 void TestMany() {
   std::string cfg = GetConfig(8000);
 
@@ -188,6 +230,13 @@ int main() {
 
   PERFETTO_LOG("\n");
 
+  PERFETTO_LOG("Testing trace written into a caller fd");
+  PERFETTO_LOG("=============================================================");
+  TestWithFd();
+  PERFETTO_LOG("=============================================================");
+
+  PERFETTO_LOG("\n");
+
   PERFETTO_LOG("\n");
   PERFETTO_LOG("Testing concurrent traces");
   PERFETTO_LOG("=============================================================");
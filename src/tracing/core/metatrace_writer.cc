@@ -37,7 +37,8 @@ MetatraceWriter::~MetatraceWriter() {
 
 void MetatraceWriter::Enable(base::TaskRunner* task_runner,
                              std::unique_ptr<TraceWriter> trace_writer,
-                             uint32_t tags) {
+                             uint32_t tags,
+                             size_t thread_ring_capacity) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   if (started_) {
     PERFETTO_DFATAL_OR_ELOG("Metatrace already started from this instance");
@@ -51,7 +52,7 @@ void MetatraceWriter::Enable(base::TaskRunner* task_runner,
         if (weak_ptr)
           weak_ptr->WriteAllAvailableEvents();
       },
-      task_runner, tags);
+      task_runner, tags, thread_ring_capacity);
   if (!enabled)
     return;
   started_ = true;
@@ -71,10 +72,8 @@ void MetatraceWriter::WriteAllAvailableEvents() {
   if (!started_)
     return;
   for (auto it = metatrace::RingBuffer::GetReadIterator(); it; ++it) {
+    // The iterator returns only fully written records.
     auto type_and_id = it->type_and_id.load(std::memory_order_acquire);
-    if (type_and_id == 0)
-      break;  // Stop at the first incomplete event.
-
     auto packet = trace_writer_->NewTracePacket();
     packet->set_timestamp(it->timestamp_ns());
     auto* evt = packet->set_perfetto_metatrace();
@@ -94,7 +93,7 @@ void MetatraceWriter::WriteAllAvailableEvents() {
       evt->set_has_overruns(true);
   }
   // The |it| destructor will automatically update the read index position in
-  // the meta-trace ring buffer.
+  // the meta-trace ring buffers.
 }
 
 void MetatraceWriter::WriteAllAndFlushTraceWriter(
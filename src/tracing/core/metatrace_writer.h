@@ -34,7 +34,7 @@ class TraceWriter;
 
 // Complements the base::metatrace infrastructure.
 // It hooks a callback to metatrace::Enable() and writes metatrace events into
-// a TraceWriter whenever the metatrace ring buffer is half full.
+// a TraceWriter whenever a metatrace ring buffer is half full.
 // It is safe to create and attempt to start multiple instances of this class,
 // however only the first one will succeed because the metatrace framework
 // doesn't support multiple instances.
@@ -52,7 +52,13 @@ class MetatraceWriter {
   MetatraceWriter(MetatraceWriter&&) = delete;
   MetatraceWriter& operator=(MetatraceWriter&&) = delete;
 
-  void Enable(base::TaskRunner*, std::unique_ptr<TraceWriter>, uint32_t tags);
+  // |thread_ring_capacity| is the number of events that each thread can
+  // record before they are written into the trace (see metatrace::Enable()).
+  void Enable(
+      base::TaskRunner*,
+      std::unique_ptr<TraceWriter>,
+      uint32_t tags,
+      size_t thread_ring_capacity = metatrace::kDefaultThreadRingCapacity);
   void Disable();
   void WriteAllAndFlushTraceWriter(std::function<void()> callback);
 
@@ -20,7 +20,6 @@
 #include <stddef.h>
 
 #include "perfetto/base/logging.h"
-#include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_utils.h"
 
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
@@ -31,14 +30,19 @@ namespace {
 
 using protozero::proto_utils::ProtoWireType;
 
-const uint32_t kReservedFieldIds[] = {
-    protos::pbzero::TracePacket::kTrustedUidFieldNumber,
-    protos::pbzero::TracePacket::kTrustedPacketSequenceIdFieldNumber,
-    protos::pbzero::TracePacket::kTraceConfigFieldNumber,
-    protos::pbzero::TracePacket::kTraceStatsFieldNumber,
-    protos::pbzero::TracePacket::kCompressedPacketsFieldNumber,
-    protos::pbzero::TracePacket::kSynchronizationMarkerFieldNumber,
-};
+// The top-level fields which only the service can set. All their ids are < 64,
+// so they can be checked with a single lookup in a bitmask.
+constexpr uint64_t kReservedFieldIdsMask =
+    (1ull << protos::pbzero::TracePacket::kTrustedUidFieldNumber) |
+    (1ull << protos::pbzero::TracePacket::kTrustedPacketSequenceIdFieldNumber) |
+    (1ull << protos::pbzero::TracePacket::kTraceConfigFieldNumber) |
+    (1ull << protos::pbzero::TracePacket::kTraceStatsFieldNumber) |
+    (1ull << protos::pbzero::TracePacket::kCompressedPacketsFieldNumber) |
+    (1ull << protos::pbzero::TracePacket::kSynchronizationMarkerFieldNumber);
+
+inline bool IsReservedField(uint64_t field_id) {
+  return field_id < 64 && (kReservedFieldIdsMask & (1ull << field_id));
+}
 
 // This translation unit is quite subtle and perf-sensitive. Remember to check
 // BM_PacketStreamValidator in perfetto_benchmarks when making changes.
@@ -86,13 +90,10 @@ class ProtoFieldParserFSM {
     switch (state_) {
       case kFieldPreamble: {
         uint64_t field_type = varint & 7;  // 7 = 0..0111
-        auto field_id = static_cast<uint32_t>(varint >> 3);
         // Check if the field id is reserved, go into an error state if it is.
-        for (size_t i = 0; i < base::ArraySize(kReservedFieldIds); ++i) {
-          if (field_id == kReservedFieldIds[i]) {
-            state_ = kWroteReservedField;
-            return 0;
-          }
+        if (IsReservedField(varint >> 3)) {
+          state_ = kWroteReservedField;
+          return 0;
         }
         // The field type is legit, now check it's well formed and within
         // boundaries.
@@ -163,10 +164,65 @@ class ProtoFieldParserFSM {
   uint32_t varint_shift_ = 0;
 };
 
+// Fast path of Validate() for packets which are not fragmented, i.e. the vast
+// majority of them. The packet is contiguous, so the varints can be decoded in
+// place and the payload of the fields skipped in one step, rather than going
+// through ProtoFieldParserFSM one byte at a time. Mirrors its checks.
+bool ValidateContiguous(const uint8_t* pos, const uint8_t* end) {
+  using protozero::proto_utils::ParseVarInt;
+  while (pos < end) {
+    uint64_t preamble;
+    const uint8_t* next = ParseVarInt(pos, end, &preamble);
+    if (next == pos)
+      return false;  // Truncated or too long varint.
+    pos = next;
+    if (IsReservedField(preamble >> 3))
+      return false;
+
+    uint64_t skip;
+    switch (static_cast<ProtoWireType>(preamble & 7)) {
+      case ProtoWireType::kVarInt: {
+        uint64_t value;
+        next = ParseVarInt(pos, end, &value);
+        if (next == pos)
+          return false;
+        pos = next;
+        continue;
+      }
+      case ProtoWireType::kFixed32:
+        skip = 4;
+        break;
+      case ProtoWireType::kFixed64:
+        skip = 8;
+        break;
+      case ProtoWireType::kLengthDelimited:
+        next = ParseVarInt(pos, end, &skip);
+        if (next == pos || skip > protozero::proto_utils::kMaxMessageLength)
+          return false;
+        pos = next;
+        break;
+      default:
+        return false;  // Unknown field type.
+    }
+    if (skip > static_cast<uint64_t>(end - pos))
+      return false;  // Truncated payload.
+    pos += skip;
+  }
+  return true;
+}
+
 }  // namespace
 
 // static
 bool PacketStreamValidator::Validate(const Slices& slices) {
+  if (slices.size() == 1) {
+    const auto* start = reinterpret_cast<const uint8_t*>(slices[0].start);
+    if (ValidateContiguous(start, start + slices[0].size))
+      return true;
+    PERFETTO_DLOG("Packet validation error");
+    return false;
+  }
+
   ProtoFieldParserFSM parser;
   size_t skip_bytes = 0;
   for (const Slice& slice : slices) {
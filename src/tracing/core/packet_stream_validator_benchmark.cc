@@ -68,6 +68,33 @@ static void BM_PacketStreamValidator(benchmark::State& state) {
   PERFETTO_CHECK(res);
 }
 
+// Validates a packet with many small top-level fields, which fits in a single
+// slice as it happens for most packets that don't span several chunks.
+static void BM_PacketStreamValidator_Contiguous(benchmark::State& state) {
+  using namespace perfetto;
+
+  protozero::HeapBuffered<protos::pbzero::TracePacket> packet;
+  for (uint32_t i = 0; i < 64; i++) {
+    packet->set_timestamp(1000ull * 1000 * 1000 * 3600 * 24 * 365 + i);
+    packet->set_timestamp_clock_id(6);
+    packet->set_sequence_flags(2);
+    packet->set_for_testing()->set_str("thread_name_1");
+  }
+  std::vector<uint8_t> buf = packet.SerializeAsArray();
+
+  Slices slices;
+  Slice slice = Slice::Allocate(buf.size());
+  memcpy(slice.own_data(), buf.data(), buf.size());
+  slices.emplace_back(std::move(slice));
+
+  bool res = true;
+  while (state.KeepRunning()) {
+    res &= PacketStreamValidator::Validate(slices);
+  }
+  PERFETTO_CHECK(res);
+}
+
 }  // namespace
 
 BENCHMARK(BM_PacketStreamValidator);
+BENCHMARK(BM_PacketStreamValidator_Contiguous);
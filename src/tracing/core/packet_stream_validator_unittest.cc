@@ -174,5 +174,33 @@ TEST(PacketStreamValidatorTest, TrailingGarbage) {
   EXPECT_FALSE(PacketStreamValidator::Validate(seq));
 }
 
+TEST(PacketStreamValidatorTest, ContiguousAndFragmentedAgree) {
+  protos::gen::TracePacket proto;
+  proto.set_timestamp(1234);
+  proto.mutable_for_testing()->set_str("string field");
+  proto.mutable_ftrace_events()->add_event()->set_pid(42);
+  const std::string valid = proto.SerializeAsString();
+
+  // Replace each byte of the packet with a few values to cover invalid field
+  // types, lengths and varints. A packet in a single slice is validated in
+  // place, while a fragmented one goes through the byte-by-byte parser: both
+  // must give the same result.
+  for (size_t i = 0; i < valid.size(); i++) {
+    for (int value : {0x00, 0x07, 0x0f, 0x1a, 0x7f, 0x80, 0xff}) {
+      std::string ser_buf = valid;
+      ser_buf[i] = static_cast<char>(value);
+
+      Slices contiguous;
+      contiguous.emplace_back(&ser_buf[0], ser_buf.size());
+      Slices fragmented;
+      for (size_t j = 0; j < ser_buf.size(); j++)
+        fragmented.emplace_back(&ser_buf[j], 1);
+      EXPECT_EQ(PacketStreamValidator::Validate(contiguous),
+                PacketStreamValidator::Validate(fragmented))
+          << "byte " << i << " = " << value;
+    }
+  }
+}
+
 }  // namespace
 }  // namespace perfetto
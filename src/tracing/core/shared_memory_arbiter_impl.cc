@@ -46,6 +46,19 @@ MaybeUnboundBufferID MakeTargetBufferIdForReservation(uint16_t reservation_id) {
 bool IsReservationTargetBufferId(MaybeUnboundBufferID buffer_id) {
   return (buffer_id >> 16) > 0;
 }
+
+// When the SMB runs out of free chunks, new pages are partitioned in smaller
+// chunks, down to this layout.
+constexpr uint32_t kSmallestChunksPageLayout =
+    SharedMemoryABI::PageLayout::kPageDiv4;
+
+// The layout goes back one step towards the default after handing out this
+// many chunks per page of the SMB without running out of free chunks.
+constexpr size_t kChunksPerPageBeforeRestoringLayout = 4;
+
+// Commits are not batched anymore once less than 1/N of the SMB pages are
+// free.
+constexpr size_t kMinFreePagesFractionForBatching = 8;
 }  // namespace
 
 // static
@@ -93,7 +106,6 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
     const SharedMemoryABI::ChunkHeader& header,
     BufferExhaustedPolicy buffer_exhausted_policy,
     size_t size_hint) {
-  PERFETTO_DCHECK(size_hint == 0);  // Not implemented yet.
   // If initially unbound, we do not support stalling. In theory, we could
   // support stalling for TraceWriters created after the arbiter and startup
   // buffer reservations were bound, but to avoid raciness between the creation
@@ -103,81 +115,58 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
 
   int stall_count = 0;
   unsigned stall_interval_us = 0;
-  bool task_runner_runs_on_current_thread = false;
   static const unsigned kMaxStallIntervalUs = 100000;
   static const int kLogAfterNStalls = 3;
   static const int kFlushCommitsAfterEveryNStalls = 2;
   static const int kAssertAtNStalls = 100;
 
-  for (;;) {
-    // TODO(primiano): Probably this lock is not really required and this code
-    // could be rewritten leveraging only the Try* atomic operations in
-    // SharedMemoryABI. But let's not be too adventurous for the moment.
-    {
-      std::unique_lock<std::mutex> scoped_lock(lock_);
-
-      task_runner_runs_on_current_thread =
-          task_runner_ && task_runner_->RunsTasksOnCurrentThread();
-
-      // If more than half of the SMB.size() is filled with completed chunks for
-      // which we haven't notified the service yet (i.e. they are still enqueued
-      // in |commit_data_req_|), force a synchronous CommitDataRequest() even if
-      // we acquire a chunk, to reduce the likeliness of stalling the writer.
-      //
-      // We can only do this if we're writing on the same thread that we access
-      // the producer endpoint on, since we cannot notify the producer endpoint
-      // to commit synchronously on a different thread. Attempting to flush
-      // synchronously on another thread will lead to subtle bugs caused by
-      // out-of-order commit requests (crbug.com/919187#c28).
-      bool should_commit_synchronously =
-          task_runner_runs_on_current_thread &&
-          buffer_exhausted_policy == BufferExhaustedPolicy::kStall &&
-          commit_data_req_ && bytes_pending_commit_ >= shmem_abi_.size() / 2;
-
-      const size_t initial_page_idx = page_idx_;
-      for (size_t i = 0; i < shmem_abi_.num_pages(); i++) {
-        page_idx_ = (initial_page_idx + i) % shmem_abi_.num_pages();
-        bool is_new_page = false;
-
-        // TODO(primiano): make the page layout dynamic.
-        auto layout = SharedMemoryArbiterImpl::default_page_layout;
-
-        if (shmem_abi_.is_page_free(page_idx_)) {
-          // TODO(primiano): Use the |size_hint| here to decide the layout.
-          is_new_page = shmem_abi_.TryPartitionPage(page_idx_, layout);
-        }
-        uint32_t free_chunks;
-        if (is_new_page) {
-          free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
-        } else {
-          free_chunks = shmem_abi_.GetFreeChunks(page_idx_);
-        }
-
-        for (uint32_t chunk_idx = 0; free_chunks;
-             chunk_idx++, free_chunks >>= 1) {
-          if (!(free_chunks & 1))
-            continue;
-          // We found a free chunk.
-          Chunk chunk = shmem_abi_.TryAcquireChunkForWriting(
-              page_idx_, chunk_idx, &header);
-          if (!chunk.is_valid())
-            continue;
-          if (stall_count > kLogAfterNStalls) {
-            PERFETTO_LOG("Recovered from stall after %d iterations",
-                         stall_count);
-          }
+  // |task_runner_| is only set after construction for initially unbound
+  // arbiters, which don't support stalling. Stalling is also the only case in
+  // which this is used, so it's safe to read |task_runner_| without |lock_|.
+  const bool task_runner_runs_on_current_thread =
+      initially_bound_ && task_runner_->RunsTasksOnCurrentThread();
 
-          if (should_commit_synchronously) {
-            // We can't flush while holding the lock.
-            scoped_lock.unlock();
-            FlushPendingCommitDataRequests();
-            return chunk;
-          } else {
-            return chunk;
-          }
-        }
+  for (;;) {
+    // If more than half of the SMB.size() is filled with completed chunks for
+    // which we haven't notified the service yet (i.e. they are still enqueued
+    // in |commit_data_req_|), force a synchronous CommitDataRequest() even if
+    // we acquire a chunk, to reduce the likeliness of stalling the writer.
+    //
+    // We can only do this if we're writing on the same thread that we access
+    // the producer endpoint on, since we cannot notify the producer endpoint
+    // to commit synchronously on a different thread. Attempting to flush
+    // synchronously on another thread will lead to subtle bugs caused by
+    // out-of-order commit requests (crbug.com/919187#c28).
+    bool should_commit_synchronously =
+        task_runner_runs_on_current_thread &&
+        buffer_exhausted_policy == BufferExhaustedPolicy::kStall &&
+        bytes_pending_commit_.load(std::memory_order_relaxed) >=
+            shmem_abi_.size() / 2;
+
+    // A writer which knows that its next packet is large first looks for a
+    // chunk big enough to hold it (or for the largest chunks if the packet
+    // doesn't fit in a page), so that the packet is split in as few fragments
+    // as possible. Any free chunk is better than stalling or dropping though.
+    const auto layout = GetPageLayoutForSizeHint(size_hint);
+    const size_t min_chunk_size =
+        size_hint ? shmem_abi_.GetChunkSizeForLayout(
+                        layout << SharedMemoryABI::kLayoutShift)
+                  : 0;
+    Chunk chunk = TryAcquireFreeChunk(header, layout, min_chunk_size);
+    if (!chunk.is_valid() && min_chunk_size)
+      chunk = TryAcquireFreeChunk(header, layout, 0);
+    if (chunk.is_valid()) {
+      OnChunkAcquired();
+      if (stall_count > kLogAfterNStalls) {
+        PERFETTO_LOG("Recovered from stall after %d iterations", stall_count);
       }
-    }  // scoped_lock
+
+      if (should_commit_synchronously)
+        FlushPendingCommitDataRequests();
+      return chunk;
+    }
+
+    OnNoFreeChunks();
 
     if (buffer_exhausted_policy == BufferExhaustedPolicy::kDrop) {
       PERFETTO_DLOG("Shared memory buffer exhaused, returning invalid Chunk!");
@@ -188,6 +177,8 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
 
     // All chunks are taken (either kBeingWritten by us or kBeingRead by the
     // Service).
+    if (stall_count == 0)
+      smb_stalls_pending_commit_.fetch_add(1, std::memory_order_relaxed);
     if (stall_count++ == kLogAfterNStalls) {
       PERFETTO_LOG("Shared memory buffer overrun! Stalling");
     }
@@ -226,6 +217,127 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   }
 }
 
+Chunk SharedMemoryArbiterImpl::TryAcquireFreeChunk(
+    const SharedMemoryABI::ChunkHeader& header,
+    SharedMemoryABI::PageLayout layout,
+    size_t min_chunk_size) {
+  // Chunks are acquired without holding |lock_|: all the page and chunk state
+  // transitions in SharedMemoryABI are atomic, so that concurrent writers (and
+  // the service) can race on them safely.
+
+  // Each writer starts looking from its own home page, so that writers (which
+  // are usually on different threads) don't all race for the same free chunks
+  // and page headers. WriterIDs start from 1, the home of the first writer is
+  // the first page.
+  const WriterID writer_id = header.writer_id.load(std::memory_order_relaxed);
+  const size_t initial_page_idx =
+      writer_id ? (writer_id - 1u) % shmem_abi_.num_pages() : 0;
+  for (size_t i = 0; i < shmem_abi_.num_pages(); i++) {
+    const size_t page_idx = (initial_page_idx + i) % shmem_abi_.num_pages();
+    bool is_new_page = false;
+
+    if (shmem_abi_.is_page_free(page_idx)) {
+      is_new_page = shmem_abi_.TryPartitionPage(page_idx, layout);
+    }
+    uint32_t free_chunks;
+    if (is_new_page) {
+      free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
+    } else {
+      if (min_chunk_size &&
+          shmem_abi_.GetChunkSizeForLayout(
+              shmem_abi_.GetPageLayout(page_idx)) < min_chunk_size) {
+        continue;
+      }
+      free_chunks = shmem_abi_.GetFreeChunks(page_idx);
+    }
+
+    for (uint32_t chunk_idx = 0; free_chunks; chunk_idx++, free_chunks >>= 1) {
+      if (!(free_chunks & 1))
+        continue;
+      // We found a free chunk. Another writer might grab it before us, in
+      // which case we just move on to the next one.
+      Chunk chunk =
+          shmem_abi_.TryAcquireChunkForWriting(page_idx, chunk_idx, &header);
+      if (chunk.is_valid())
+        return chunk;
+    }
+  }
+  return Chunk();
+}
+
+SharedMemoryABI::PageLayout SharedMemoryArbiterImpl::GetPageLayoutForSizeHint(
+    size_t size_hint) const {
+  uint32_t layout = GetPageLayout();
+  while (size_hint && layout > SharedMemoryABI::kPageDiv1 &&
+         shmem_abi_.GetChunkSizeForLayout(
+             layout << SharedMemoryABI::kLayoutShift) <
+             sizeof(SharedMemoryABI::ChunkHeader) + size_hint) {
+    layout--;
+  }
+  return static_cast<SharedMemoryABI::PageLayout>(layout);
+}
+
+size_t SharedMemoryArbiterImpl::max_chunk_payload_size() const {
+  return shmem_abi_.GetChunkSizeForLayout(SharedMemoryABI::kPageDiv1
+                                          << SharedMemoryABI::kLayoutShift) -
+         sizeof(SharedMemoryABI::ChunkHeader);
+}
+
+SharedMemoryABI::PageLayout SharedMemoryArbiterImpl::GetPageLayout() const {
+  uint32_t shift = page_layout_shift_.load(std::memory_order_relaxed);
+  uint32_t layout = std::min<uint32_t>(
+      default_page_layout + shift,
+      std::max<uint32_t>(default_page_layout, kSmallestChunksPageLayout));
+  return static_cast<SharedMemoryABI::PageLayout>(layout);
+}
+
+void SharedMemoryArbiterImpl::OnChunkAcquired() {
+  uint32_t shift = page_layout_shift_.load(std::memory_order_relaxed);
+  if (!shift)
+    return;  // Fast path: the SMB is not under pressure.
+  size_t chunks =
+      chunks_since_no_free_chunks_.fetch_add(1, std::memory_order_relaxed);
+  if (chunks + 1 < kChunksPerPageBeforeRestoringLayout * shmem_abi_.num_pages())
+    return;
+  // Racing with other writers here is benign: at worst the layout changes
+  // again a bit earlier or later.
+  chunks_since_no_free_chunks_.store(0, std::memory_order_relaxed);
+  page_layout_shift_.compare_exchange_strong(shift, shift - 1,
+                                             std::memory_order_relaxed);
+}
+
+void SharedMemoryArbiterImpl::OnNoFreeChunks() {
+  // A writer holds a whole chunk until it fills it, so smaller chunks spread
+  // the SMB across more writers. This trades some per-chunk overhead for
+  // fewer stalls and drops during bursts. Pages which are already partitioned
+  // keep their layout until they are freed by the service.
+  chunks_since_no_free_chunks_.store(0, std::memory_order_relaxed);
+  uint32_t shift = page_layout_shift_.load(std::memory_order_relaxed);
+  if (default_page_layout + shift < kSmallestChunksPageLayout) {
+    page_layout_shift_.compare_exchange_strong(shift, shift + 1,
+                                               std::memory_order_relaxed);
+  }
+}
+
+uint32_t SharedMemoryArbiterImpl::GetBatchCommitsDelayMsLocked() {
+  if (!batch_commits_duration_ms_)
+    return 0;
+  // The chunks returned during the batching period stay unavailable to the
+  // service (and to the writers once it reads them) until the commit is sent.
+  // Shorten the period as the SMB fills up, so that the batch is committed
+  // before the writers run out of chunks. A high commit rate is handled by the
+  // forced flush once |bytes_pending_commit_| reaches half of the SMB.
+  const size_t num_pages = shmem_abi_.num_pages();
+  size_t free_pages = 0;
+  for (size_t i = 0; i < num_pages; i++)
+    free_pages += shmem_abi_.is_page_free(i) ? 1 : 0;
+  if (free_pages * kMinFreePagesFractionForBatching < num_pages)
+    return 0;
+  return static_cast<uint32_t>(
+      (static_cast<uint64_t>(batch_commits_duration_ms_) * free_pages) /
+      num_pages);
+}
+
 void SharedMemoryArbiterImpl::ReturnCompletedChunk(
     Chunk chunk,
     MaybeUnboundBufferID target_buffer,
@@ -264,7 +376,7 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
       if (fully_bound_ && !delayed_flush_scheduled_) {
         weak_this = weak_ptr_factory_.GetWeakPtr();
         task_runner_to_post_delayed_callback_on = task_runner_;
-        flush_delay_ms = batch_commits_duration_ms_;
+        flush_delay_ms = GetBatchCommitsDelayMsLocked();
         delayed_flush_scheduled_ = true;
       }
     }
@@ -273,7 +385,7 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
     if (chunk.is_valid()) {
       PERFETTO_DCHECK(chunk.writer_id() == writer_id);
       uint8_t chunk_idx = chunk.chunk_idx();
-      bytes_pending_commit_ += chunk.size();
+      bytes_pending_commit_.fetch_add(chunk.size(), std::memory_order_relaxed);
       size_t page_idx;
       // If the chunk needs patching, it should not be marked as complete yet,
       // because this would indicate to the service that the producer will not
@@ -357,7 +469,9 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
     // service will not know of the patch and won't be able to reconstruct the
     // trace.
     if (fully_bound_ &&
-        (last_patch_req || bytes_pending_commit_ >= shmem_abi_.size() / 2)) {
+        (last_patch_req ||
+         bytes_pending_commit_.load(std::memory_order_relaxed) >=
+             shmem_abi_.size() / 2)) {
       weak_this = weak_ptr_factory_.GetWeakPtr();
       task_runner_to_post_delayed_callback_on = task_runner_;
       flush_delay_ms = 0;
@@ -546,7 +660,15 @@ void SharedMemoryArbiterImpl::FlushPendingCommitDataRequests(
       }
 
       req = std::move(commit_data_req_);
-      bytes_pending_commit_ = 0;
+      bytes_pending_commit_.store(0, std::memory_order_relaxed);
+    }
+
+    const uint32_t smb_stalls =
+        smb_stalls_pending_commit_.exchange(0, std::memory_order_relaxed);
+    if (smb_stalls) {
+      if (!req)
+        req.reset(new CommitDataRequest());
+      req->set_smb_stalls(smb_stalls);
     }
   }  // scoped_lock
 
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -103,11 +104,19 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
 
   // Returns a new Chunk to write tracing data. Depending on the provided
   // BufferExhaustedPolicy, this may return an invalid chunk if no valid free
-  // chunk could be found in the SMB.
+  // chunk could be found in the SMB. The search for a free chunk starts from
+  // a home page picked by the writer ID in the header. A non-zero |size_hint|
+  // is the size of the packet which is about to be written: a chunk which can
+  // hold it (or one of the largest chunks, if it doesn't fit in a page) is
+  // returned if there is one, even if the SMB is under pressure.
   SharedMemoryABI::Chunk GetNewChunk(const SharedMemoryABI::ChunkHeader&,
                                      BufferExhaustedPolicy,
                                      size_t size_hint = 0);
 
+  // The payload size of the largest chunks of the SMB, i.e. of the chunks of
+  // the pages partitioned with kPageDiv1.
+  size_t max_chunk_payload_size() const;
+
   // Puts back a Chunk that has been completed and sends a request to the
   // service to move it to the central tracing buffer. |target_buffer| is the
   // absolute trace buffer ID where the service should move the chunk onto (the
@@ -227,6 +236,30 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // state.
   bool UpdateFullyBoundLocked();
 
+  // The layout used to partition free pages, see |page_layout_shift_|.
+  SharedMemoryABI::PageLayout GetPageLayout() const;
+
+  // As GetPageLayout(), but with chunks big enough to hold a packet of
+  // |size_hint| bytes if possible.
+  SharedMemoryABI::PageLayout GetPageLayoutForSizeHint(size_t size_hint) const;
+
+  // Tries to acquire a free chunk of at least |min_chunk_size| bytes for the
+  // writer of |header|, partitioning free pages with |layout|. Returns an
+  // invalid chunk if there is none. Called by GetNewChunk().
+  SharedMemoryABI::Chunk TryAcquireFreeChunk(
+      const SharedMemoryABI::ChunkHeader& header,
+      SharedMemoryABI::PageLayout layout,
+      size_t min_chunk_size);
+
+  // Adapt |page_layout_shift_| to the pressure on the SMB. These are called by
+  // GetNewChunk() when it hands out a chunk and when it finds no free chunks.
+  void OnChunkAcquired();
+  void OnNoFreeChunks();
+
+  // Returns the delay of the flush which ends a new batching period. This is
+  // |batch_commits_duration_ms_| scaled by the fraction of free SMB pages.
+  uint32_t GetBatchCommitsDelayMsLocked();
+
   const bool initially_bound_;
 
   // Only accessed on |task_runner_| after the producer endpoint was bound.
@@ -237,10 +270,28 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   std::mutex lock_;
 
   base::TaskRunner* task_runner_ = nullptr;
+
+  // GetNewChunk() doesn't hold |lock_|. It relies on the page and chunk state
+  // transitions of |shmem_abi_|, which are atomic, and otherwise only reads
+  // |bytes_pending_commit_|, which is atomic too.
   SharedMemoryABI shmem_abi_;
-  size_t page_idx_ = 0;
+
+  // Number of steps from |default_page_layout| towards smaller chunks used to
+  // partition free pages. It increases while the SMB runs out of free chunks.
+  // Accessed without holding |lock_|.
+  std::atomic<uint32_t> page_layout_shift_{0};
+  std::atomic<size_t> chunks_since_no_free_chunks_{0};
+
   std::unique_ptr<CommitDataRequest> commit_data_req_;
-  size_t bytes_pending_commit_ = 0;  // SUM(chunk.size() : commit_data_req_).
+
+  // SUM(chunk.size() : commit_data_req_). Only updated while holding |lock_|.
+  std::atomic<size_t> bytes_pending_commit_{0};
+
+  // Num. of GetNewChunk() calls which stalled since the last commit, reported
+  // to the service in CommitDataRequest.smb_stalls. Incremented without
+  // holding |lock_|.
+  std::atomic<uint32_t> smb_stalls_pending_commit_{0};
+
   IdAllocator<WriterID> active_writer_ids_;
   bool did_shutdown_ = false;
 
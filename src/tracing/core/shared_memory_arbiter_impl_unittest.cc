@@ -17,6 +17,11 @@
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 
 #include <bitset>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <vector>
+
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/commit_data_request.h"
@@ -224,6 +229,32 @@ TEST_P(SharedMemoryArbiterImplTest, BatchCommits) {
   arbiter_->FlushPendingCommitDataRequests();
 }
 
+TEST_P(SharedMemoryArbiterImplTest, BatchCommitsNotDelayedWhenSmbIsFull) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv1);
+  arbiter_->SetBatchCommitsDuration(UINT32_MAX);
+
+  // Acquire all but one page of the SMB, so that the batching period would
+  // leave the writers short of free chunks.
+  std::vector<SharedMemoryABI::Chunk> chunks;
+  for (size_t i = 0; i < kNumPages - 1; i++) {
+    chunks.push_back(
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault));
+    ASSERT_TRUE(chunks.back().is_valid());
+  }
+
+  // The chunk is committed right away even though batching is enabled.
+  EXPECT_CALL(mock_producer_endpoint_, CommitData(_, _))
+      .WillOnce(Invoke([](const CommitDataRequest& req,
+                          MockProducerEndpoint::CommitDataCallback) {
+        ASSERT_EQ(1, req.chunks_to_move_size());
+      }));
+  PatchList ignored;
+  arbiter_->ReturnCompletedChunk(std::move(chunks[0]), 1, &ignored);
+  task_runner_->RunUntilIdle();
+  ASSERT_TRUE(Mock::VerifyAndClearExpectations(&mock_producer_endpoint_));
+}
+
 // Helper for verifying trace writer id allocations.
 class TraceWriterIdChecker : public FakeProducerEndpoint {
  public:
@@ -341,6 +372,161 @@ TEST_P(SharedMemoryArbiterImplTest, BufferExhaustedPolicyDrop) {
   ASSERT_TRUE(chunks[0].is_valid());
 }
 
+// Chunks are acquired without holding the arbiter lock. Verify that writers on
+// different threads racing for the chunks never get the same one.
+TEST_P(SharedMemoryArbiterImplTest, GetNewChunkConcurrently) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv4);
+  static constexpr size_t kNumThreads = 8;
+  static constexpr size_t kTotChunks = kNumPages * 4;
+  std::vector<std::vector<SharedMemoryABI::Chunk>> chunks(kNumThreads);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kNumThreads; i++) {
+    std::vector<SharedMemoryABI::Chunk>* thread_chunks = &chunks[i];
+    threads.emplace_back([this, thread_chunks] {
+      for (;;) {
+        SharedMemoryABI::Chunk chunk =
+            arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop);
+        if (!chunk.is_valid())
+          break;
+        thread_chunks->push_back(std::move(chunk));
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+
+  std::set<uint8_t*> chunk_begins;
+  for (const auto& thread_chunks : chunks) {
+    for (const SharedMemoryABI::Chunk& chunk : thread_chunks)
+      EXPECT_TRUE(chunk_begins.insert(chunk.begin()).second);
+  }
+  EXPECT_EQ(chunk_begins.size(), kTotChunks);
+}
+
+// Writers start looking for a free chunk from their own home page.
+TEST_P(SharedMemoryArbiterImplTest, WritersPreferHomePage) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv4);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  auto get_page = [this, abi](WriterID writer_id) {
+    SharedMemoryABI::ChunkHeader header{};
+    header.writer_id.store(writer_id);
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk(header, BufferExhaustedPolicy::kDrop);
+    PERFETTO_CHECK(chunk.is_valid());
+    return abi->GetPageAndChunkIndex(chunk).first;
+  };
+
+  EXPECT_EQ(get_page(1), 0u);
+  EXPECT_EQ(get_page(2), 1u);
+  EXPECT_EQ(get_page(1), 0u);
+  EXPECT_EQ(get_page(kNumPages + 2), 1u);
+
+  // Once the home page is full, the writer moves on to the next pages.
+  EXPECT_EQ(get_page(1), 0u);
+  EXPECT_EQ(get_page(1), 0u);
+  EXPECT_EQ(get_page(1), 1u);
+  EXPECT_EQ(get_page(1), 1u);
+  EXPECT_EQ(get_page(1), 2u);
+}
+
+// Chunks requested with a size hint are big enough to hold the packet if
+// possible: new pages are partitioned in larger chunks and the pages with
+// smaller chunks are skipped, unless there are no other free chunks.
+TEST_P(SharedMemoryArbiterImplTest, GetNewChunkWithSizeHint) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv4);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  std::vector<SharedMemoryABI::Chunk> chunks;
+  auto get_chunk = [this, abi, &chunks](size_t size_hint) {
+    SharedMemoryABI::ChunkHeader header{};
+    header.writer_id.store(1);
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk(header, BufferExhaustedPolicy::kDrop, size_hint);
+    PERFETTO_CHECK(chunk.is_valid());
+    size_t page_idx = abi->GetPageAndChunkIndex(chunk).first;
+    size_t num_chunks =
+        SharedMemoryABI::GetNumChunksForLayout(abi->GetPageLayout(page_idx));
+    chunks.push_back(std::move(chunk));
+    return std::make_pair(page_idx, num_chunks);
+  };
+
+  EXPECT_EQ(get_chunk(0), std::make_pair(size_t(0), size_t(4)));
+  EXPECT_EQ(get_chunk(page_size() / 2), std::make_pair(size_t(1), size_t(1)));
+  EXPECT_GE(chunks.back().payload_size(), page_size() / 2);
+  EXPECT_EQ(get_chunk(page_size() / 4), std::make_pair(size_t(2), size_t(2)));
+  EXPECT_GE(chunks.back().payload_size(), page_size() / 4);
+
+  // Packets larger than a page get the largest chunks.
+  EXPECT_EQ(get_chunk(page_size() * 4), std::make_pair(size_t(3), size_t(1)));
+  EXPECT_EQ(chunks.back().payload_size(), arbiter_->max_chunk_payload_size());
+
+  // Smaller chunks are still better than none.
+  for (size_t page_idx = 4; page_idx < kNumPages; page_idx++)
+    EXPECT_EQ(get_chunk(page_size()), std::make_pair(page_idx, size_t(1)));
+  EXPECT_EQ(get_chunk(page_size()), std::make_pair(size_t(0), size_t(4)));
+}
+
+// When the SMB runs out of free chunks, new pages are partitioned in smaller
+// chunks. The default layout is restored once the pressure goes away.
+TEST_P(SharedMemoryArbiterImplTest, AdaptivePageLayout) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv1);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+
+  // Simulates the service reading the chunk, returns the number of chunks in
+  // its page.
+  auto read_chunk = [abi](SharedMemoryABI::Chunk chunk) {
+    size_t page_idx;
+    size_t chunk_idx;
+    std::tie(page_idx, chunk_idx) = abi->GetPageAndChunkIndex(chunk);
+    size_t num_chunks =
+        SharedMemoryABI::GetNumChunksForLayout(abi->GetPageLayout(page_idx));
+    abi->ReleaseChunkAsComplete(std::move(chunk));
+    chunk = abi->TryAcquireChunkForReading(page_idx, chunk_idx);
+    PERFETTO_CHECK(chunk.is_valid());
+    abi->ReleaseChunkAsFree(std::move(chunk));
+    return num_chunks;
+  };
+
+  // Acquires chunks until the SMB runs out of them, then reads them all back
+  // and returns how many there were.
+  auto fill_smb = [this, &read_chunk] {
+    std::vector<SharedMemoryABI::Chunk> chunks;
+    for (;;) {
+      SharedMemoryABI::Chunk chunk =
+          arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop);
+      if (!chunk.is_valid())
+        break;
+      chunks.push_back(std::move(chunk));
+    }
+    for (SharedMemoryABI::Chunk& chunk : chunks)
+      read_chunk(std::move(chunk));
+    return chunks.size();
+  };
+
+  // Each time the SMB runs out of chunks, the next pages get smaller chunks,
+  // down to four chunks per page.
+  EXPECT_EQ(fill_smb(), kNumPages);
+  EXPECT_EQ(fill_smb(), kNumPages * 2);
+  EXPECT_EQ(fill_smb(), kNumPages * 4);
+  EXPECT_EQ(fill_smb(), kNumPages * 4);
+
+  // Without pressure on the SMB, the layout goes back to the default one step
+  // at a time.
+  std::vector<size_t> num_chunks;
+  for (size_t i = 0; i < kNumPages * 8 * 3; i++) {
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop);
+    ASSERT_TRUE(chunk.is_valid());
+    size_t n = read_chunk(std::move(chunk));
+    if (num_chunks.empty() || num_chunks.back() != n)
+      num_chunks.push_back(n);
+  }
+  EXPECT_EQ(num_chunks, std::vector<size_t>({4, 2, 1}));
+}
+
 TEST_P(SharedMemoryArbiterImplTest, CreateUnboundAndBind) {
   auto checkpoint_writer = task_runner_->CreateCheckpoint("writer_registered");
   auto checkpoint_flush = task_runner_->CreateCheckpoint("flush_completed");
@@ -16,6 +16,7 @@
 
 #include "src/tracing/core/trace_buffer.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "perfetto/base/logging.h"
@@ -59,21 +60,53 @@ constexpr uint8_t kLastPacketContinuesOnNextChunk =
     SharedMemoryABI::ChunkHeader::kLastPacketContinuesOnNextChunk;
 constexpr uint8_t kChunkNeedsPatching =
     SharedMemoryABI::ChunkHeader::kChunkNeedsPatching;
+
+// Returns the first entry of the sorted |chunks| whose ChunkID is >=
+// |chunk_id|. Chunks are almost always appended to the back of their sequence
+// and deleted from its front, so both ends are checked before the binary
+// search.
+template <typename Chunks>
+typename Chunks::iterator ChunkLowerBound(Chunks* chunks, ChunkID chunk_id) {
+  if (chunks->empty() || chunks->front().chunk_id >= chunk_id)
+    return chunks->begin();
+  if (chunks->back().chunk_id < chunk_id)
+    return chunks->end();
+  using ChunkMeta = typename Chunks::value_type;
+  return std::lower_bound(chunks->begin(), chunks->end(), chunk_id,
+                          [](const ChunkMeta& meta, ChunkID id) {
+                            return meta.chunk_id < id;
+                          });
+}
 }  // namespace.
 
 constexpr size_t TraceBuffer::ChunkRecord::kMaxSize;
 constexpr size_t TraceBuffer::InlineChunkHeaderSize = sizeof(ChunkRecord);
+constexpr size_t TraceBuffer::WriterStats::kNumChunkPayloadBuckets;
+const uint32_t TraceBuffer::WriterStats::kChunkPayloadBucketBounds[] = {
+    64, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536};
+
+void TraceBuffer::WriterStats::AddCompleteChunk(size_t payload_size) {
+  size_t bucket = 0;
+  while (bucket < kNumChunkPayloadBuckets - 1 &&
+         payload_size > kChunkPayloadBucketBounds[bucket]) {
+    bucket++;
+  }
+  chunk_payload_histogram[bucket]++;
+}
 
 // static
 std::unique_ptr<TraceBuffer> TraceBuffer::Create(size_t size_in_bytes,
-                                                 OverwritePolicy pol) {
-  std::unique_ptr<TraceBuffer> trace_buffer(new TraceBuffer(pol));
+                                                 OverwritePolicy pol,
+                                                 bool use_huge_pages) {
+  std::unique_ptr<TraceBuffer> trace_buffer(
+      new TraceBuffer(pol, use_huge_pages));
   if (!trace_buffer->Initialize(size_in_bytes))
     return nullptr;
   return trace_buffer;
 }
 
-TraceBuffer::TraceBuffer(OverwritePolicy pol) : overwrite_policy_(pol) {
+TraceBuffer::TraceBuffer(OverwritePolicy pol, bool use_huge_pages)
+    : overwrite_policy_(pol), use_huge_pages_(use_huge_pages) {
   // See comments in ChunkRecord for the rationale of this.
   static_assert(sizeof(ChunkRecord) == sizeof(SharedMemoryABI::PageHeader) +
                                            sizeof(SharedMemoryABI::ChunkHeader),
@@ -82,12 +115,51 @@ TraceBuffer::TraceBuffer(OverwritePolicy pol) : overwrite_policy_(pol) {
 
 TraceBuffer::~TraceBuffer() = default;
 
+std::unique_ptr<TraceBuffer> TraceBuffer::CloneReadOnly() const {
+  std::unique_ptr<TraceBuffer> buf(
+      new TraceBuffer(overwrite_policy_, use_huge_pages_));
+  if (!buf->Initialize(size_))
+    return nullptr;
+
+  // The part of the buffer after |wptr_| is still zero-filled until the buffer
+  // wraps for the first time. After that, the whole buffer is in use (the end
+  // of the buffer is covered by a padding record).
+  const size_t wptr_offset = static_cast<size_t>(wptr_ - begin());
+  const size_t used_size = stats_.write_wrap_count() ? size_ : wptr_offset;
+  if (used_size > 0) {
+    buf->data_.EnsureCommitted(used_size);
+    memcpy(buf->begin(), begin(), used_size);
+  }
+  buf->wptr_ = buf->begin() + wptr_offset;
+
+  // The index entries point into |data_|: rebase them onto the copy.
+  buf->index_ = index_;
+  for (auto& seq_it : buf->index_) {
+    for (ChunkMeta& chunk_meta : seq_it.second.chunks) {
+      const auto* record = reinterpret_cast<uint8_t*>(chunk_meta.chunk_record);
+      chunk_meta.chunk_record = reinterpret_cast<ChunkRecord*>(
+          buf->begin() + (record - begin()));
+    }
+  }
+  buf->read_iter_ = buf->GetReadIterForSequence(buf->index_.end());
+
+  buf->stats_ = stats_;
+  buf->trim_complete_chunks_ = trim_complete_chunks_;
+  buf->discard_writes_ = discard_writes_;
+  buf->suppress_client_dchecks_for_testing_ =
+      suppress_client_dchecks_for_testing_;
+  buf->read_only_ = true;
+  return buf;
+}
+
 bool TraceBuffer::Initialize(size_t size) {
   static_assert(
       SharedMemoryABI::kMinPageSize % sizeof(ChunkRecord) == 0,
       "sizeof(ChunkRecord) must be an integer divider of a page size");
-  data_ = base::PagedMemory::Allocate(
-      size, base::PagedMemory::kMayFail | base::PagedMemory::kDontCommit);
+  int flags = base::PagedMemory::kMayFail | base::PagedMemory::kDontCommit;
+  if (use_huge_pages_)
+    flags |= base::PagedMemory::kHugePages;
+  data_ = base::PagedMemory::Allocate(size, flags);
   if (!data_.IsValid()) {
     PERFETTO_ELOG("Trace buffer allocation failed (size: %zu)", size);
     return false;
@@ -97,7 +169,6 @@ bool TraceBuffer::Initialize(size_t size) {
   max_chunk_size_ = std::min(size, ChunkRecord::kMaxSize);
   wptr_ = begin();
   index_.clear();
-  last_chunk_id_written_.clear();
   read_iter_ = GetReadIterForSequence(index_.end());
   return true;
 }
@@ -114,6 +185,9 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
                                      bool chunk_complete,
                                      const uint8_t* src,
                                      size_t size) {
+  if (PERFETTO_UNLIKELY(read_only_))
+    PERFETTO_FATAL("Cannot write into a read-only buffer");
+
   // |record_size| = |size| + sizeof(ChunkRecord), rounded up to avoid to end
   // up in a fragmented state where size_to_end() < sizeof(ChunkRecord).
   const size_t record_size =
@@ -157,17 +231,21 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // before receiving commit requests for them from the producer. Note that the
   // service may scrape and thus override chunks in arbitrary order since the
   // chunks aren't ordered in the SMB.
-  const auto it = index_.find(key);
-  if (PERFETTO_UNLIKELY(it != index_.end())) {
-    ChunkMeta* record_meta = &it->second;
+  ChunkMeta* record_meta = FindChunkMeta(key);
+  if (PERFETTO_UNLIKELY(record_meta)) {
     ChunkRecord* prev = record_meta->chunk_record;
 
     // Verify that the old chunk's metadata corresponds to the new one.
     // Overridden chunks should never change size, since the page layout is
     // fixed per writer. The number of fragments should also never decrease and
-    // flags should not be removed.
+    // flags should not be removed. Complete chunks may have been trimmed, in
+    // which case they are skipped below if the number of fragments didn't
+    // change.
+    const bool maybe_trimmed = record_meta->is_complete() &&
+                               prev->size < record_size &&
+                               prev->num_fragments == num_fragments;
     if (PERFETTO_UNLIKELY(ChunkMeta::Key(*prev) != key ||
-                          prev->size != record_size ||
+                          (prev->size != record_size && !maybe_trimmed) ||
                           prev->num_fragments > num_fragments ||
                           (prev->flags & chunk_flags) != prev->flags)) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
@@ -195,9 +273,8 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "ChunkID wraps");
     subsequent_key.chunk_id++;
-    const auto subsequent_it = index_.find(subsequent_key);
-    if (subsequent_it != index_.end() &&
-        subsequent_it->second.num_fragments_read > 0) {
+    const ChunkMeta* subsequent_meta = FindChunkMeta(subsequent_key);
+    if (subsequent_meta && subsequent_meta->num_fragments_read > 0) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
       PERFETTO_DCHECK(suppress_client_dchecks_for_testing_);
       return;
@@ -226,6 +303,13 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     WriteChunkRecord(wptr, record, src, size);
     TRACE_BUFFER_DLOG("Chunk raw: %s", HexDump(wptr, record_size).c_str());
     stats_.set_chunks_rewritten(stats_.chunks_rewritten() + 1);
+
+    // A chunk is rewritten only until it is complete, so this counts it once.
+    if (chunk_complete && !(chunk_flags & kChunkNeedsPatching)) {
+      const size_t trimmed_size = GetTrimmedRecordSize(*prev);
+      index_[std::make_pair(producer_id_trusted, writer_id)]
+          .writer_stats.AddCompleteChunk(trimmed_size - sizeof(ChunkRecord));
+    }
     return;
   }
 
@@ -265,6 +349,10 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // | Chunk 5                         | Padding Chunk | Chunk 4            |
   // +---------------------------------+---------------+--------------------+
 
+  // Whether we are writing in the part of the buffer which was never written
+  // before, which is zeroed.
+  const bool is_untouched = !GetChunkRecordAt(wptr_)->is_valid();
+
   // Deletes all chunks from |wptr_| to |wptr_| + |record_size|.
   ssize_t del_res = DeleteNextChunksFor(record_size);
   if (del_res == -1)
@@ -273,16 +361,44 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
 
   // Now first insert the new chunk. At the end, if necessary, add the padding.
   stats_.set_chunks_written(stats_.chunks_written() + 1);
-  stats_.set_bytes_written(stats_.bytes_written() + record_size);
-  auto it_and_inserted = index_.emplace(
-      key, ChunkMeta(GetChunkRecordAt(wptr_), num_fragments, chunk_complete,
-                     chunk_flags, producer_uid_trusted));
-  PERFETTO_DCHECK(it_and_inserted.second);
+  Sequence& sequence = index_[std::make_pair(producer_id_trusted, writer_id)];
+  auto chunk_it = ChunkLowerBound(&sequence.chunks, chunk_id);
+  PERFETTO_DCHECK(chunk_it == sequence.chunks.end() ||
+                  chunk_it->chunk_id != chunk_id);
+  sequence.chunks.emplace(chunk_it, GetChunkRecordAt(wptr_), chunk_id,
+                          num_fragments, chunk_complete, chunk_flags,
+                          producer_uid_trusted);
   TRACE_BUFFER_DLOG("  copying @ [%lu - %lu] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + record_size, record_size);
   WriteChunkRecord(wptr_, record, src, size);
   TRACE_BUFFER_DLOG("Chunk raw: %s", HexDump(wptr_, record_size).c_str());
-  wptr_ += record_size;
+
+  // Complete chunks won't be rewritten, so the space after their last fragment
+  // can be given back to the buffer. This can't be done for the chunks which
+  // still have to be patched as the size of their last fragment is not final.
+  WriterStats& writer_stats = sequence.writer_stats;
+  size_t used_size = record_size;
+  if (chunk_complete && !(chunk_flags & kChunkNeedsPatching)) {
+    ChunkRecord* chunk_record = GetChunkRecordAt(wptr_);
+    const size_t trimmed_size = GetTrimmedRecordSize(*chunk_record);
+    writer_stats.AddCompleteChunk(trimmed_size - sizeof(ChunkRecord));
+    if (trim_complete_chunks_ && trimmed_size < record_size) {
+      used_size = trimmed_size;
+      TRACE_BUFFER_DLOG("  trimming chunk to %zu", used_size);
+      chunk_record->size = static_cast<decltype(chunk_record->size)>(used_size);
+      if (is_untouched) {
+        // Keep the untouched part of the buffer zeroed, DeleteNextChunksFor()
+        // relies on that.
+        memset(wptr_ + used_size, 0, record_size - used_size);
+      } else {
+        padding_size += record_size - used_size;
+      }
+    }
+  }
+  stats_.set_bytes_written(stats_.bytes_written() + used_size);
+  writer_stats.chunks_written++;
+  writer_stats.bytes_written += used_size;
+  wptr_ += used_size;
   if (wptr_ >= end()) {
     PERFETTO_DCHECK(padding_size == 0);
     wptr_ = begin();
@@ -302,8 +418,7 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // last_chunk_id shouldn't be updated even though it's larger (e.g. |chunk_id|
   // = kMaxChunkId and |last_chunk_id| = 1; chunk_id - last_chunk_id =
   // kMaxChunkId - 1).
-  auto producer_and_writer_id = std::make_pair(producer_id_trusted, writer_id);
-  ChunkID& last_chunk_id = last_chunk_id_written_[producer_and_writer_id];
+  ChunkID& last_chunk_id = sequence.last_chunk_id_written;
   static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                 "This code assumes that ChunkID wraps at kMaxChunkID");
   if (chunk_id - last_chunk_id < kMaxChunkID / 2) {
@@ -328,7 +443,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  std::vector<ChunkMeta::Key> index_delete;
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -354,17 +469,16 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     // records are not part of the index).
     if (PERFETTO_LIKELY(!next_chunk.is_padding)) {
       ChunkMeta::Key key(next_chunk);
-      auto it = index_.find(key);
+      const ChunkMeta* meta = FindChunkMeta(key);
       bool will_remove = false;
-      if (PERFETTO_LIKELY(it != index_.end())) {
-        const ChunkMeta& meta = it->second;
-        if (PERFETTO_UNLIKELY(meta.num_fragments_read < meta.num_fragments)) {
+      if (PERFETTO_LIKELY(meta)) {
+        if (PERFETTO_UNLIKELY(meta->num_fragments_read < meta->num_fragments)) {
           if (overwrite_policy_ == kDiscard)
             return -1;
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        index_delete.push_back(key);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG(
@@ -386,9 +500,20 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     PERFETTO_CHECK(next_chunk_ptr <= end());
   }
 
-  // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  // Remove from the index. The overwritten chunks are the oldest ones, so
+  // they are usually at the front of their sequence.
+  for (const ChunkMeta::Key& key : index_delete) {
+    auto seq_it = index_.find(std::make_pair(key.producer_id, key.writer_id));
+    PERFETTO_DCHECK(seq_it != index_.end());
+    std::deque<ChunkMeta>& chunks = seq_it->second.chunks;
+    auto chunk_it = ChunkLowerBound(&chunks, key.chunk_id);
+    PERFETTO_DCHECK(chunk_it != chunks.end() &&
+                    chunk_it->chunk_id == key.chunk_id);
+    if (chunk_it == chunks.begin()) {
+      chunks.pop_front();
+    } else {
+      chunks.erase(chunk_it);
+    }
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
@@ -399,29 +524,63 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
 }
 
 void TraceBuffer::AddPaddingRecord(size_t size) {
-  PERFETTO_DCHECK(size >= sizeof(ChunkRecord) && size <= ChunkRecord::kMaxSize);
-  ChunkRecord record(size);
-  record.is_padding = 1;
+  PERFETTO_DCHECK(size >= sizeof(ChunkRecord) &&
+                  size % sizeof(ChunkRecord) == 0);
   TRACE_BUFFER_DLOG("AddPaddingRecord @ [%lu - %lu] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + size, size);
-  WriteChunkRecord(wptr_, record, nullptr, size - sizeof(ChunkRecord));
+  constexpr size_t kMaxRecordSize =
+      ChunkRecord::kMaxSize / sizeof(ChunkRecord) * sizeof(ChunkRecord);
+  for (uint8_t* wptr = wptr_; wptr < wptr_ + size;) {
+    size_t record_size = std::min(kMaxRecordSize,
+                                  static_cast<size_t>(wptr_ + size - wptr));
+    ChunkRecord record(record_size);
+    record.is_padding = 1;
+    WriteChunkRecord(wptr, record, nullptr, record_size - sizeof(ChunkRecord));
+    wptr += record_size;
+  }
   stats_.set_padding_bytes_written(stats_.padding_bytes_written() + size);
   // |wptr_| is deliberately not advanced when writing a padding record.
 }
 
+// static
+size_t TraceBuffer::GetTrimmedRecordSize(const ChunkRecord& record) {
+  const uint8_t* record_begin = reinterpret_cast<const uint8_t*>(&record);
+  const uint8_t* record_end = record_begin + record.size;
+  const uint8_t* fragment_begin = record_begin + sizeof(ChunkRecord);
+  for (uint16_t i = 0; i < record.num_fragments; i++) {
+    uint64_t fragment_size = 0;
+    const uint8_t* header_end = std::min(
+        fragment_begin + protozero::proto_utils::kMessageLengthFieldSize,
+        record_end);
+    const uint8_t* fragment_data = protozero::proto_utils::ParseVarInt(
+        fragment_begin, header_end, &fragment_size);
+
+    // Leave malformed chunks as they are, ReadNextPacketInChunk() deals with
+    // them when reading.
+    if (fragment_data == fragment_begin ||
+        fragment_size > static_cast<uint64_t>(record_end - fragment_data)) {
+      return record.size;
+    }
+    fragment_begin = fragment_data + fragment_size;
+  }
+  return base::AlignUp<sizeof(ChunkRecord)>(
+      static_cast<size_t>(fragment_begin - record_begin));
+}
+
 bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
                                         WriterID writer_id,
                                         ChunkID chunk_id,
                                         const Patch* patches,
                                         size_t patches_size,
                                         bool other_patches_pending) {
+  PERFETTO_CHECK(!read_only_);
   ChunkMeta::Key key(producer_id, writer_id, chunk_id);
-  auto it = index_.find(key);
-  if (it == index_.end()) {
+  ChunkMeta* chunk_meta_ptr = FindChunkMeta(key);
+  if (!chunk_meta_ptr) {
     stats_.set_patches_failed(stats_.patches_failed() + 1);
     return false;
   }
-  ChunkMeta& chunk_meta = it->second;
+  ChunkMeta& chunk_meta = *chunk_meta_ptr;
 
   // Check that the index is consistent with the actual ProducerID/WriterID
   // stored in the ChunkRecord.
@@ -480,70 +639,67 @@ void TraceBuffer::BeginRead() {
 }
 
 TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
-    ChunkMap::iterator seq_begin) {
+    ChunkMap::iterator sequence) {
+  // Skip the sequences whose chunks have all been overwritten.
+  while (sequence != index_.end() && sequence->second.chunks.empty())
+    sequence++;
+
   SequenceIterator iter;
-  iter.seq_begin = seq_begin;
-  if (seq_begin == index_.end()) {
-    iter.cur = iter.seq_end = index_.end();
+  iter.sequence = sequence;
+  if (sequence == index_.end())
     return iter;
-  }
 
-#if PERFETTO_DCHECK_IS_ON()
-  // Either |seq_begin| is == index_.begin() or the item immediately before must
-  // belong to a different {ProducerID, WriterID} sequence.
-  if (seq_begin != index_.begin() && seq_begin != index_.end()) {
-    auto prev_it = seq_begin;
-    prev_it--;
-    PERFETTO_DCHECK(
-        seq_begin == index_.begin() ||
-        std::tie(prev_it->first.producer_id, prev_it->first.writer_id) <
-            std::tie(seq_begin->first.producer_id, seq_begin->first.writer_id));
+  std::deque<ChunkMeta>& chunks = sequence->second.chunks;
+  iter.seq_end = chunks.size();
+
+  // Now find the first chunk that is > last_chunk_id_written. This is where we
+  // the sequence will start (see notes about wrapping of IDs in the header).
+  // The last chunk written is usually the one with the highest ChunkID, in
+  // which case the sequence starts from its first chunk.
+  iter.wrapping_id = sequence->second.last_chunk_id_written;
+  if (chunks.back().chunk_id > iter.wrapping_id) {
+    auto cur = std::upper_bound(chunks.begin(), chunks.end(), iter.wrapping_id,
+                                [](ChunkID id, const ChunkMeta& meta) {
+                                  return id < meta.chunk_id;
+                                });
+    iter.cur = static_cast<size_t>(cur - chunks.begin());
   }
-#endif
-
-  // Find the first entry that has a greater {ProducerID, WriterID} (or just
-  // index_.end() if we reached the end).
-  ChunkMeta::Key key = seq_begin->first;  // Deliberate copy.
-  key.chunk_id = kMaxChunkID;
-  iter.seq_end = index_.upper_bound(key);
-  PERFETTO_DCHECK(iter.seq_begin != iter.seq_end);
-
-  // Now find the first entry between [seq_begin, seq_end) that is
-  // > last_chunk_id_written_. This is where we the sequence will start (see
-  // notes about wrapping of IDs in the header).
-  auto producer_and_writer_id = std::make_pair(key.producer_id, key.writer_id);
-  PERFETTO_DCHECK(last_chunk_id_written_.count(producer_and_writer_id));
-  iter.wrapping_id = last_chunk_id_written_[producer_and_writer_id];
-  key.chunk_id = iter.wrapping_id;
-  iter.cur = index_.upper_bound(key);
-  if (iter.cur == iter.seq_end)
-    iter.cur = iter.seq_begin;
   return iter;
 }
 
+TraceBuffer::ChunkMeta* TraceBuffer::FindChunkMeta(const ChunkMeta::Key& key) {
+  auto seq_it = index_.find(std::make_pair(key.producer_id, key.writer_id));
+  if (seq_it == index_.end())
+    return nullptr;
+  std::deque<ChunkMeta>& chunks = seq_it->second.chunks;
+  auto chunk_it = ChunkLowerBound(&chunks, key.chunk_id);
+  if (chunk_it == chunks.end() || chunk_it->chunk_id != key.chunk_id)
+    return nullptr;
+  return &*chunk_it;
+}
+
 void TraceBuffer::SequenceIterator::MoveNext() {
   // Stop iterating when we reach the end of the sequence.
-  // Note: |seq_begin| might be == |seq_end|.
-  if (cur == seq_end || cur->first.chunk_id == wrapping_id) {
+  if (cur == seq_end || chunk_id() == wrapping_id) {
     cur = seq_end;
     return;
   }
 
   // If the current chunk wasn't completed yet, we shouldn't advance past it as
   // it may be rewritten with additional packets.
-  if (!cur->second.is_complete()) {
+  if (!(**this).is_complete()) {
     cur = seq_end;
     return;
   }
 
-  ChunkID last_chunk_id = cur->first.chunk_id;
+  ChunkID last_chunk_id = chunk_id();
   if (++cur == seq_end)
-    cur = seq_begin;
+    cur = 0;
 
   // There may be a missing chunk in the sequence of chunks, in which case the
   // next chunk's ID won't follow the last one's. If so, skip the rest of the
   // sequence. We'll return to it later once the hole is filled.
-  if (last_chunk_id + 1 != cur->first.chunk_id)
+  if (last_chunk_id + 1 != chunk_id())
     cur = seq_end;
 }
 
@@ -576,14 +732,16 @@ bool TraceBuffer::ReadNextTracePacket(
       // We ran out of chunks in the current {ProducerID, WriterID} sequence or
       // we just reached the index_.end().
 
-      if (PERFETTO_UNLIKELY(read_iter_.seq_end == index_.end()))
+      if (PERFETTO_UNLIKELY(read_iter_.sequence == index_.end()))
         return false;
 
       // We reached the end of sequence, move to the next one.
-      // Note: ++read_iter_.seq_end might become index_.end(), but
+      // Note: the next sequence might be index_.end(), but
       // GetReadIterForSequence() knows how to deal with that.
-      read_iter_ = GetReadIterForSequence(read_iter_.seq_end);
-      PERFETTO_DCHECK(read_iter_.is_valid() && read_iter_.cur != index_.end());
+      read_iter_ = GetReadIterForSequence(std::next(read_iter_.sequence));
+      if (PERFETTO_UNLIKELY(read_iter_.sequence == index_.end()))
+        return false;
+      PERFETTO_DCHECK(read_iter_.is_valid());
       previous_packet_dropped = true;
     }
 
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include <array>
+#include <deque>
 #include <limits>
 #include <map>
 #include <tuple>
@@ -111,7 +112,12 @@ class TracePacket;
 //
 // However, in order to keep some operations (patching and reading) fast, a
 // lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// indexed by their {ProducerID, WriterID, ChunkID} tuple. The index is a map of
+// {ProducerID, WriterID} sequences, each holding a contiguous array of the
+// ChunkMeta of its chunks sorted by ChunkID. Chunks are almost always appended
+// to the end of their sequence and deleted from its front (the buffer is a
+// ring), which keeps both operations O(1) and avoids a tree node allocation
+// for each chunk.
 //
 // Patching data out-of-band
 // -------------------------
@@ -161,12 +167,41 @@ class TraceBuffer {
     WriterID writer_id;
   };
 
-  // Can return nullptr if the memory allocation fails.
+  // Statistics about the chunks written by a {ProducerID, WriterID} sequence,
+  // see TraceStats.WriterStats.
+  struct WriterStats {
+    // The inclusive upper bounds of the buckets of |chunk_payload_histogram|,
+    // in bytes. The last bucket is unbounded.
+    static constexpr size_t kNumChunkPayloadBuckets = 11;
+    static const uint32_t kChunkPayloadBucketBounds[kNumChunkPayloadBuckets -
+                                                    1];
+
+    void AddCompleteChunk(size_t payload_size);
+
+    uint64_t chunks_written = 0;
+    uint64_t bytes_written = 0;
+
+    // Num. of complete chunks, bucketed by the size of the part of their
+    // payload used by fragments (rounded up to the alignment of the chunks in
+    // the buffer).
+    std::array<uint64_t, kNumChunkPayloadBuckets> chunk_payload_histogram{};
+  };
+
+  // Can return nullptr if the memory allocation fails. If |use_huge_pages| is
+  // true, the buffer is allocated with PagedMemory::kHugePages.
   static std::unique_ptr<TraceBuffer> Create(size_t size_in_bytes,
-                                             OverwritePolicy = kOverwrite);
+                                             OverwritePolicy = kOverwrite,
+                                             bool use_huge_pages = false);
 
   ~TraceBuffer();
 
+  // Creates a read-only copy of the buffer, with the same chunks and the same
+  // read state: reading the copy returns the packets which haven't been read
+  // from this buffer yet, while this buffer keeps being written to. Only the
+  // part of the buffer which has been written is copied.
+  // Can return nullptr if the memory allocation fails.
+  std::unique_ptr<TraceBuffer> CloneReadOnly() const;
+
   // Copies a Chunk from a producer Shared Memory Buffer into the trace buffer.
   // |src| points to the first packet in the SharedMemoryABI's chunk shared with
   // an untrusted producer. "untrusted" here means: the producer might be
@@ -260,8 +295,21 @@ class TraceBuffer {
                            bool* previous_packet_on_sequence_dropped);
 
   const TraceStats::BufferStats& stats() const { return stats_; }
+
+  // Calls |fn(ProducerID, WriterID, const WriterStats&)| for each sequence
+  // which has written into the buffer, including the sequences whose chunks
+  // have all been overwritten or read.
+  template <typename F>
+  void ForEachWriterStats(F fn) const {
+    for (const auto& seq_it : index_)
+      fn(seq_it.first.first, seq_it.first.second, seq_it.second.writer_stats);
+  }
   size_t size() const { return size_; }
 
+  // If true, complete chunks are stored without the unused space at the end of
+  // their payload (see TraceConfig.BufferConfig.trim_complete_chunks).
+  void set_trim_complete_chunks(bool trim) { trim_complete_chunks_ = trim; }
+
  private:
   friend class TraceBufferTest;
 
@@ -333,7 +381,7 @@ class TraceBuffer {
   // This struct should not have any field that is essential for reconstructing
   // the contents of the buffer from a crash dump.
   struct ChunkMeta {
-    // Key used for sorting in the map.
+    // Identifies a chunk in the index.
     struct Key {
       Key(ProducerID p, WriterID w, ChunkID c)
           : producer_id{p}, writer_id{w}, chunk_id{c} {}
@@ -341,9 +389,6 @@ class TraceBuffer {
       explicit Key(const ChunkRecord& cr)
           : Key(cr.producer_id, cr.writer_id, cr.chunk_id) {}
 
-      // Note that this sorting doesn't keep into account the fact that ChunkID
-      // will wrap over at some point. The extra logic in SequenceIterator deals
-      // with that.
       bool operator<(const Key& other) const {
         return std::tie(producer_id, writer_id, chunk_id) <
                std::tie(other.producer_id, other.writer_id, other.chunk_id);
@@ -377,8 +422,17 @@ class TraceBuffer {
       kLastReadPacketSkipped = 1 << 1
     };
 
-    ChunkMeta(ChunkRecord* r, uint16_t p, bool complete, uint8_t f, uid_t u)
-        : chunk_record{r}, trusted_uid{u}, flags{f}, num_fragments{p} {
+    ChunkMeta(ChunkRecord* r,
+              ChunkID c,
+              uint16_t p,
+              bool complete,
+              uint8_t f,
+              uid_t u)
+        : chunk_record{r},
+          trusted_uid{u},
+          chunk_id{c},
+          flags{f},
+          num_fragments{p} {
       if (complete)
         index_flags = kComplete;
     }
@@ -405,8 +459,14 @@ class TraceBuffer {
       }
     }
 
-    ChunkRecord* const chunk_record;  // Addr of ChunkRecord within |data_|.
-    const uid_t trusted_uid;          // uid of the producer.
+    // Not const as entries are moved around when a chunk is inserted in the
+    // middle of its sequence.
+    ChunkRecord* chunk_record;  // Addr of ChunkRecord within |data_|.
+    uid_t trusted_uid;          // uid of the producer.
+
+    // Matches |chunk_record->chunk_id|. The ProducerID and WriterID are the
+    // key of the sequence in |index_|.
+    ChunkID chunk_id;
 
     // Flags set by TraceBuffer to track the state of the chunk in the index.
     uint8_t index_flags = 0;
@@ -427,54 +487,78 @@ class TraceBuffer {
     uint16_t cur_fragment_offset = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  // The chunks of a {ProducerID, WriterID} sequence.
+  struct Sequence {
+    // Sorted by ChunkID. Note that this sorting doesn't keep into account the
+    // fact that ChunkID will wrap over at some point. The extra logic in
+    // SequenceIterator deals with that.
+    // A deque rather than a vector as chunks are deleted from the front once
+    // the buffer wraps.
+    std::deque<ChunkMeta> chunks;
+
+    // The highest ChunkID written for the sequence, taking into account a
+    // potential overflow of ChunkIDs. In the case of overflow, stores the
+    // highest ChunkID written since the overflow.
+    ChunkID last_chunk_id_written = 0;
+
+    WriterStats writer_stats;
+  };
 
-  // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
-  // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
-  // of ChunkID. Instances are valid only as long as the |index_| is not altered
-  // (can be used safely only between adjacent ReadNextTracePacket() calls).
+  // Sequences are never removed from the map, even when all their chunks
+  // have been overwritten, to remember their |last_chunk_id_written|.
+  // TODO(primiano): should clean up keys from this map. Right now it grows
+  // without bounds (although realistically is not a problem unless we have too
+  // many producers/writers within the same trace session).
+  using ChunkMap = std::map<std::pair<ProducerID, WriterID>, Sequence>;
+
+  // Allows to iterate over the chunks of a {ProducerID,WriterID} sequence of
+  // |index_|. Furthermore takes into account the wrapping of ChunkID.
+  // Instances are valid only as long as the |index_| is not altered (can be
+  // used safely only between adjacent ReadNextTracePacket() calls).
   // The order of the iteration will proceed in the following order:
-  // |wrapping_id| + 1 -> |seq_end|, |seq_begin| -> |wrapping_id|.
+  // |wrapping_id| + 1 -> |seq_end|, 0 -> |wrapping_id|.
   // Practical example:
   // - Assume that kMaxChunkID == 7
   // - Assume that we have all 8 chunks in the range (0..7).
-  // - Hence, |seq_begin| == c0, |seq_end| == c7
+  // - Hence, chunks[0] == c0, chunks[seq_end - 1] == c7
   // - Assume |wrapping_id| = 4 (c4 is the last chunk copied over
   //   through a CopyChunkUntrusted()).
   // The resulting iteration order will be: c5, c6, c7, c0, c1, c2, c3, c4.
   struct SequenceIterator {
-    // Points to the 1st key (the one with the numerically min ChunkID).
-    ChunkMap::iterator seq_begin;
+    // The sequence iterated over. Is index_.end() if there are no more
+    // sequences with chunks.
+    ChunkMap::iterator sequence;
 
-    // Points one past the last key (the one with the numerically max ChunkID).
-    ChunkMap::iterator seq_end;
+    // Index one past the last chunk (the one with the numerically max ChunkID)
+    // in |sequence->second.chunks|.
+    size_t seq_end = 0;
 
-    // Current iterator, always >= seq_begin && <= seq_end.
-    ChunkMap::iterator cur;
+    // Index of the current chunk, always >= 0 && <= seq_end.
+    size_t cur = 0;
 
     // The latest ChunkID written. Determines the start/end of the sequence.
-    ChunkID wrapping_id;
+    ChunkID wrapping_id = 0;
 
     bool is_valid() const { return cur != seq_end; }
 
     ProducerID producer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.producer_id;
+      return sequence->first.first;
     }
 
     WriterID writer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.writer_id;
+      return sequence->first.second;
     }
 
     ChunkID chunk_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.chunk_id;
+      return sequence->second.chunks[cur].chunk_id;
     }
 
     ChunkMeta& operator*() {
       PERFETTO_DCHECK(is_valid());
-      return cur->second;
+      return sequence->second.chunks[cur];
     }
 
     // Moves |cur| to the next chunk in the index.
@@ -497,28 +581,36 @@ class TraceBuffer {
     kFailedEmptyPacket,
   };
 
-  explicit TraceBuffer(OverwritePolicy);
+  TraceBuffer(OverwritePolicy, bool use_huge_pages);
   TraceBuffer(const TraceBuffer&) = delete;
   TraceBuffer& operator=(const TraceBuffer&) = delete;
 
   bool Initialize(size_t size);
 
-  // Returns an object that allows to iterate over chunks in the |index_| that
-  // have the same {ProducerID, WriterID} of
-  // |seq_begin.first.{producer,writer}_id|. |seq_begin| must be an iterator to
-  // the first entry in the |index_| that has a different {ProducerID, WriterID}
-  // from the previous one. It is valid for |seq_begin| to be == index_.end()
-  // (i.e. if the index is empty). The iteration takes care of ChunkID wrapping,
-  // by using |last_chunk_id_|.
-  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq_begin);
+  // Returns an object that allows to iterate over the chunks of |sequence|,
+  // or of the first sequence after it if |sequence| has no chunks left. It is
+  // valid for |sequence| to be == index_.end() (i.e. if the index is empty).
+  // The iteration takes care of ChunkID wrapping, by using
+  // |last_chunk_id_written|.
+  SequenceIterator GetReadIterForSequence(ChunkMap::iterator sequence);
+
+  // Returns the entry of the chunk |key| in the index or nullptr if the chunk
+  // is not in the index.
+  ChunkMeta* FindChunkMeta(const ChunkMeta::Key& key);
 
   // Used as a last resort when a buffer corruption is detected.
   void ClearContentsAndResetRWCursors();
 
   // Adds a padding record of the given size (must be a multiple of
-  // sizeof(ChunkRecord)).
+  // sizeof(ChunkRecord)). Sizes larger than ChunkRecord::kMaxSize are split in
+  // several consecutive padding records.
   void AddPaddingRecord(size_t);
 
+  // Returns the size of |record| up to the end of its last fragment, rounded
+  // up to a multiple of sizeof(ChunkRecord). Returns |record.size| if the
+  // fragments are malformed.
+  static size_t GetTrimmedRecordSize(const ChunkRecord& record);
+
   // Look for contiguous fragment of the same packet starting from |read_iter_|.
   // If a contiguous packet is found, all the fragments are pushed into
   // TracePacket and the function returns kSucceededReturnSlices. If not, the
@@ -634,19 +726,19 @@ class TraceBuffer {
   // See comments at the top of the file.
   OverwritePolicy overwrite_policy_ = kOverwrite;
 
+  // See set_trim_complete_chunks().
+  bool trim_complete_chunks_ = false;
+
+  // See Create().
+  bool use_huge_pages_ = false;
+
+  // Set on the buffers created by CloneReadOnly(), which can't be written to.
+  bool read_only_ = false;
+
   // Only used when |overwrite_policy_ == kDiscard|. This is set the first time
   // a write fails because it would overwrite unread chunks.
   bool discard_writes_ = false;
 
-  // Keeps track of the highest ChunkID written for a given sequence, taking
-  // into account a potential overflow of ChunkIDs. In the case of overflow,
-  // stores the highest ChunkID written since the overflow.
-  //
-  // TODO(primiano): should clean up keys from this map. Right now it grows
-  // without bounds (although realistically is not a problem unless we have too
-  // many producers/writers within the same trace session).
-  std::map<std::pair<ProducerID, WriterID>, ChunkID> last_chunk_id_written_;
-
   // Statistics about buffer usage.
   TraceStats::BufferStats stats_;
 
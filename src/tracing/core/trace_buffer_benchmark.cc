@@ -0,0 +1,102 @@
+// Copyright (C) 2021 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "src/tracing/core/trace_buffer.h"
+
+namespace {
+
+using perfetto::ChunkID;
+using perfetto::TraceBuffer;
+using perfetto::WriterID;
+
+constexpr size_t kBufferSize = 1024 * 1024;
+constexpr size_t kPacketSize = 1000;
+
+// Returns the payload of a chunk containing a single packet of |kPacketSize|
+// bytes.
+std::vector<uint8_t> CreateChunkPayload() {
+  std::vector<uint8_t> payload(protozero::proto_utils::kMessageLengthFieldSize);
+  protozero::proto_utils::WriteRedundantVarInt(kPacketSize, &payload[0]);
+  payload.resize(payload.size() + kPacketSize, 'x');
+  return payload;
+}
+
+// Copies one chunk for each of the |num_writers| sequences. Sequences are
+// interleaved in the buffer, as it happens with many threads tracing.
+void CopyChunks(TraceBuffer* buf,
+                const std::vector<uint8_t>& payload,
+                uint32_t num_writers,
+                ChunkID chunk_id) {
+  for (uint32_t writer = 1; writer <= num_writers; writer++) {
+    buf->CopyChunkUntrusted(/*producer_id_trusted=*/1, /*producer_uid=*/0,
+                            static_cast<WriterID>(writer), chunk_id,
+                            /*num_fragments=*/1, /*chunk_flags=*/0,
+                            /*chunk_complete=*/true, payload.data(),
+                            payload.size());
+  }
+}
+
+// Writes chunks in a buffer which has wrapped already, so each write also
+// deletes the oldest chunks from the index.
+static void BM_TraceBuffer_WriteOverwrite(benchmark::State& state) {
+  const uint32_t num_writers = static_cast<uint32_t>(state.range(0));
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  std::vector<uint8_t> payload = CreateChunkPayload();
+
+  ChunkID chunk_id = 0;
+  for (size_t i = 0; i < 2 * kBufferSize / kPacketSize / num_writers; i++)
+    CopyChunks(buf.get(), payload, num_writers, chunk_id++);
+
+  for (auto _ : state)
+    CopyChunks(buf.get(), payload, num_writers, chunk_id++);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_writers);
+}
+
+// Fills the buffer and then reads back all its packets.
+static void BM_TraceBuffer_WriteAndRead(benchmark::State& state) {
+  const uint32_t num_writers = static_cast<uint32_t>(state.range(0));
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  std::vector<uint8_t> payload = CreateChunkPayload();
+
+  ChunkID chunk_id = 0;
+  size_t packets_read = 0;
+  for (auto _ : state) {
+    for (size_t i = 0; i < kBufferSize / kPacketSize / num_writers; i++)
+      CopyChunks(buf.get(), payload, num_writers, chunk_id++);
+
+    buf->BeginRead();
+    perfetto::TracePacket packet;
+    TraceBuffer::PacketSequenceProperties sequence_properties;
+    bool previous_packet_dropped;
+    while (buf->ReadNextTracePacket(&packet, &sequence_properties,
+                                    &previous_packet_dropped)) {
+      packets_read++;
+      packet = perfetto::TracePacket();
+    }
+  }
+  PERFETTO_CHECK(packets_read > 0);
+  state.SetItemsProcessed(static_cast<int64_t>(packets_read));
+}
+
+}  // namespace
+
+BENCHMARK(BM_TraceBuffer_WriteOverwrite)->Arg(1)->Arg(16)->Arg(256);
+BENCHMARK(BM_TraceBuffer_WriteAndRead)->Arg(1)->Arg(16)->Arg(256);
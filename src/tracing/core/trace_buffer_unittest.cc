@@ -17,6 +17,7 @@
 #include <string.h>
 
 #include <initializer_list>
+#include <map>
 #include <random>
 #include <sstream>
 #include <vector>
@@ -119,9 +120,8 @@ class TraceBufferTest : public testing::Test {
   }
 
   SequenceIterator GetReadIterForSequence(ProducerID p, WriterID w) {
-    TraceBuffer::ChunkMeta::Key key(p, w, 0);
     return trace_buffer_->GetReadIterForSequence(
-        trace_buffer_->index_.lower_bound(key));
+        trace_buffer_->index_.lower_bound(std::make_pair(p, w)));
   }
 
   void SuppressClientDchecksForTesting() {
@@ -130,12 +130,19 @@ class TraceBufferTest : public testing::Test {
 
   std::vector<ChunkMetaKey> GetIndex() {
     std::vector<ChunkMetaKey> keys;
-    keys.reserve(trace_buffer_->index_.size());
-    for (const auto& it : trace_buffer_->index_)
-      keys.push_back(it.first);
+    for (const auto& it : trace_buffer_->index_) {
+      for (const auto& chunk : it.second.chunks)
+        keys.emplace_back(it.first.first, it.first.second, chunk.chunk_id);
+    }
     return keys;
   }
 
+  // Makes the helpers above operate on |buf| and returns the previous buffer.
+  std::unique_ptr<TraceBuffer> SwapBuffer(std::unique_ptr<TraceBuffer> buf) {
+    std::swap(buf, trace_buffer_);
+    return buf;
+  }
+
   TraceBuffer* trace_buffer() { return trace_buffer_.get(); }
   size_t size_to_end() { return trace_buffer_->size_to_end(); }
 
@@ -1833,6 +1840,276 @@ TEST_F(TraceBufferTest, MissingPacketsOnSequence) {
   ASSERT_TRUE(previous_packet_dropped);
 }
 
+// -------------------
+// Trimming of complete chunks
+// -------------------
+
+TEST_F(TraceBufferTest, Trim_CompleteChunk) {
+  ResetBuffer(4096);
+  trace_buffer()->set_trim_complete_chunks(true);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(42, 'a')
+      .AddPacket(50, 'b')
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+
+  // 16 bytes of ChunkRecord + 92 bytes of packets, rounded up to 16 bytes.
+  ASSERT_EQ(4096u - 112, size_to_end());
+  ASSERT_EQ(112u, trace_buffer()->stats().bytes_written());
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(42, 'a')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(50, 'b')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
+TEST_F(TraceBufferTest, Trim_DisabledByDefault) {
+  ResetBuffer(4096);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(42, 'a')
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(4096u - 1024, size_to_end());
+}
+
+TEST_F(TraceBufferTest, Trim_IncompleteAndPatchedChunksAreNotTrimmed) {
+  ResetBuffer(4096);
+  trace_buffer()->set_trim_complete_chunks(true);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(42, 'a')
+      .AddPacket(50, 'b')
+      .PadTo(1024)
+      .CopyIntoTraceBuffer(/*chunk_complete=*/false);
+  ASSERT_EQ(4096u - 1024, size_to_end());
+  CreateChunk(ProducerID(1), WriterID(2), ChunkID(0))
+      .AddPacket(42, 'c')
+      .AddPacket(50, 'd', kContOnNextChunk | kChunkNeedsPatching)
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(4096u - 2048, size_to_end());
+
+  // The incomplete chunk is rewritten in place once committed.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(42, 'a')
+      .AddPacket(50, 'b')
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(4096u - 2048, size_to_end());
+  ASSERT_EQ(1u, trace_buffer()->stats().chunks_rewritten());
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(42, 'a')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(50, 'b')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
+TEST_F(TraceBufferTest, Trim_RecommitOfTrimmedChunk) {
+  ResetBuffer(4096);
+  trace_buffer()->set_trim_complete_chunks(true);
+  for (int i = 0; i < 2; i++) {
+    CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+        .AddPacket(42, 'a')
+        .PadTo(1024)
+        .CopyIntoTraceBuffer();
+  }
+  ASSERT_EQ(4096u - 64, size_to_end());
+  ASSERT_EQ(0u, trace_buffer()->stats().abi_violations());
+  ASSERT_EQ(0u, trace_buffer()->stats().chunks_rewritten());
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(42, 'a')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
+TEST_F(TraceBufferTest, Trim_MalformedChunkIsNotTrimmed) {
+  ResetBuffer(4096);
+  trace_buffer()->set_trim_complete_chunks(true);
+  SuppressClientDchecksForTesting();
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(42, 'a')
+      .AddPacket({0xff, 0xff})
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(4096u - 1024, size_to_end());
+}
+
+TEST_F(TraceBufferTest, Trim_KeepsMoreChunksWhenWrapping) {
+  ResetBuffer(4096);
+  trace_buffer()->set_trim_complete_chunks(true);
+
+  // Each chunk of the first writer takes 128 bytes once trimmed instead of
+  // 1024. They are interleaved with untrimmed incomplete chunks of a second
+  // writer, to mix padding records and trimmed space.
+  ChunkID chunk_id = 0;
+  std::vector<char> seeds_written;
+  for (uint32_t i = 0; i < 100; i++) {
+    if (i % 10 == 9) {
+      CreateChunk(ProducerID(1), WriterID(2), ChunkID(i / 10))
+          .AddPacket(100, 'z')
+          .PadTo(1024)
+          .CopyIntoTraceBuffer(/*chunk_complete=*/false);
+      continue;
+    }
+    seeds_written.push_back(static_cast<char>('a' + i % 26));
+    CreateChunk(ProducerID(1), WriterID(1), chunk_id++)
+        .AddPacket(100, seeds_written.back())
+        .PadTo(1024)
+        .CopyIntoTraceBuffer();
+  }
+  ASSERT_EQ(0u, trace_buffer()->stats().abi_violations());
+
+  // The last chunks of the first writer are read back. Without trimming only
+  // the last 3 would fit.
+  std::vector<char> seeds_read;
+  trace_buffer()->BeginRead();
+  for (;;) {
+    std::vector<FakePacketFragment> packet = ReadPacket();
+    if (packet.empty())
+      break;
+    ASSERT_EQ(packet.size(), 1u);
+    seeds_read.push_back(packet[0].payload()[0]);
+  }
+  ASSERT_GE(seeds_read.size(), 9u);
+  ASSERT_EQ(seeds_read,
+            std::vector<char>(seeds_written.end() - seeds_read.size(),
+                              seeds_written.end()));
+}
+
+TEST_F(TraceBufferTest, Clone_ReadsUnreadPackets) {
+  ResetBuffer(4096);
+  for (ChunkID chunk_id = 0; chunk_id < 3; chunk_id++) {
+    CreateChunk(ProducerID(1), WriterID(1), chunk_id)
+        .AddPacket(10, static_cast<char>('a' + chunk_id))
+        .CopyIntoTraceBuffer();
+  }
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(10, 'a')));
+
+  // The clone doesn't see the packets already read from the original, nor the
+  // ones written after cloning.
+  std::unique_ptr<TraceBuffer> clone = trace_buffer()->CloneReadOnly();
+  ASSERT_TRUE(clone);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(3))
+      .AddPacket(10, 'd')
+      .CopyIntoTraceBuffer();
+
+  std::unique_ptr<TraceBuffer> original = SwapBuffer(std::move(clone));
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(10, 'b')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(10, 'c')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+
+  // The original is not affected by the reads from the clone.
+  SwapBuffer(std::move(original));
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(10, 'b')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(10, 'c')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(10, 'd')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
+TEST_F(TraceBufferTest, Clone_WrappedBuffer) {
+  ResetBuffer(4096);
+  for (ChunkID chunk_id = 0; chunk_id < 10; chunk_id++) {
+    CreateChunk(ProducerID(1), WriterID(chunk_id % 2 + 1), chunk_id)
+        .AddPacket(100, static_cast<char>('a' + chunk_id))
+        .PadTo(768)
+        .CopyIntoTraceBuffer();
+  }
+  ASSERT_GT(trace_buffer()->stats().write_wrap_count(), 0u);
+
+  std::unique_ptr<TraceBuffer> clone = trace_buffer()->CloneReadOnly();
+  ASSERT_TRUE(clone);
+  EXPECT_EQ(clone->size(), trace_buffer()->size());
+
+  auto read_all = [this] {
+    std::vector<std::vector<FakePacketFragment>> packets;
+    trace_buffer()->BeginRead();
+    for (;;) {
+      std::vector<FakePacketFragment> packet = ReadPacket();
+      if (packet.empty())
+        break;
+      packets.push_back(std::move(packet));
+    }
+    return packets;
+  };
+  std::vector<std::vector<FakePacketFragment>> original_packets = read_all();
+  ASSERT_FALSE(original_packets.empty());
+  SwapBuffer(std::move(clone));
+  ASSERT_EQ(read_all(), original_packets);
+}
+
+// -------------------
+// Per-writer stats
+// -------------------
+
+TEST_F(TraceBufferTest, WriterStats_BytesAndChunkPayloadHistogram) {
+  ResetBuffer(4096);
+  // 92 bytes of packets: in the 65-256 bytes bucket.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(42, 'a')
+      .AddPacket(50, 'b')
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+  // Incomplete chunks are only counted in the histogram once complete.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(1))
+      .AddPacket(10, 'c')
+      .PadTo(512)
+      .CopyIntoTraceBuffer(/*chunk_complete=*/false);
+  // 600 bytes of packets: in the 513-1024 bytes bucket.
+  CreateChunk(ProducerID(2), WriterID(1), ChunkID(0))
+      .AddPacket(600, 'd')
+      .PadTo(1024)
+      .CopyIntoTraceBuffer();
+
+  using Key = std::pair<ProducerID, WriterID>;
+  auto get_stats = [](const TraceBuffer& buf) {
+    std::map<Key, TraceBuffer::WriterStats> stats;
+    buf.ForEachWriterStats([&stats](ProducerID producer_id, WriterID writer_id,
+                                    const TraceBuffer::WriterStats& s) {
+      stats[Key(producer_id, writer_id)] = s;
+    });
+    return stats;
+  };
+  auto stats = get_stats(*trace_buffer());
+  ASSERT_EQ(2u, stats.size());
+  EXPECT_EQ(2u, stats[Key(1, 1)].chunks_written);
+  EXPECT_EQ(1024u + 512u, stats[Key(1, 1)].bytes_written);
+  EXPECT_THAT(stats[Key(1, 1)].chunk_payload_histogram,
+              ElementsAre(0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+  EXPECT_EQ(1u, stats[Key(2, 1)].chunks_written);
+  EXPECT_EQ(1024u, stats[Key(2, 1)].bytes_written);
+  EXPECT_THAT(stats[Key(2, 1)].chunk_payload_histogram,
+              ElementsAre(0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0));
+
+  // Committing the incomplete chunk adds it to the histogram, with 20 bytes of
+  // packets, but doesn't count it as written again.
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(1))
+      .AddPacket(10, 'c')
+      .AddPacket(10, 'e')
+      .PadTo(512)
+      .CopyIntoTraceBuffer();
+  ASSERT_EQ(1u, trace_buffer()->stats().chunks_rewritten());
+  stats = get_stats(*trace_buffer());
+  EXPECT_EQ(2u, stats[Key(1, 1)].chunks_written);
+  EXPECT_EQ(1024u + 512u, stats[Key(1, 1)].bytes_written);
+  EXPECT_THAT(stats[Key(1, 1)].chunk_payload_histogram,
+              ElementsAre(1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+
+  // The stats are kept by read-only clones and once the chunks are read.
+  std::unique_ptr<TraceBuffer> clone = trace_buffer()->CloneReadOnly();
+  ASSERT_TRUE(clone);
+  trace_buffer()->BeginRead();
+  while (!ReadPacket().empty()) {
+  }
+  auto clone_stats = get_stats(*clone);
+  stats = get_stats(*trace_buffer());
+  for (const auto* s : {&stats, &clone_stats}) {
+    ASSERT_EQ(2u, s->size());
+    EXPECT_EQ(2u, s->at(Key(1, 1)).chunks_written);
+    EXPECT_THAT(s->at(Key(1, 1)).chunk_payload_histogram,
+                ElementsAre(1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+    EXPECT_EQ(1u, s->at(Key(2, 1)).chunks_written);
+  }
+}
+
 // TODO(primiano): test stats().
 // TODO(primiano): test multiple streams interleaved.
 // TODO(primiano): more testing on packet merging.
@@ -97,6 +97,16 @@ void TraceWriterImpl::Flush(std::function<void()> callback) {
 }
 
 TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacket() {
+  return NewTracePacketInternal(0);
+}
+
+TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacketWithSizeHint(
+    size_t size_hint) {
+  return NewTracePacketInternal(size_hint);
+}
+
+TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacketInternal(
+    size_t size_hint) {
   // If we hit this, the caller is calling NewTracePacket() without having
   // finalized the previous packet.
   PERFETTO_CHECK(cur_packet_->is_finalized());
@@ -107,6 +117,7 @@ TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacket() {
   PERFETTO_DCHECK(process_id_ == base::GetProcessId());
 
   fragmenting_packet_ = false;
+  packet_size_hint_ = size_hint;
 
   // Reserve space for the size of the message. Note: this call might re-enter
   // into this class invoking GetNewBuffer() if there isn't enough space or if
@@ -118,9 +129,19 @@ TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacket() {
 
   // It doesn't make sense to begin a packet that is going to fragment
   // immediately after (8 is just an arbitrary estimation on the minimum size of
-  // a realistic packet).
-  bool chunk_too_full =
-      protobuf_stream_writer_.bytes_available() < kPacketHeaderSize + 8;
+  // a realistic packet). If the caller told us the size of the packet and it
+  // fits in a new chunk, don't fragment it at all: the space left in the
+  // current chunk is wasted, but no nested message of the packet will need a
+  // patch. The new chunk is picked by the arbiter to fit the packet, so this
+  // holds even if the current chunk is smaller than the largest ones.
+  size_t min_packet_size = 8;
+  if (size_hint > min_packet_size &&
+      kPacketHeaderSize + size_hint <=
+          shmem_arbiter_->max_chunk_payload_size()) {
+    min_packet_size = size_hint;
+  }
+  bool chunk_too_full = protobuf_stream_writer_.bytes_available() <
+                        kPacketHeaderSize + min_packet_size;
   if (chunk_too_full || reached_max_packets_per_chunk_ ||
       retry_new_chunk_after_packet_) {
     protobuf_stream_writer_.Reset(GetNewBuffer());
@@ -199,8 +220,10 @@ protozero::ContiguousMemoryRange TraceWriterImpl::GetNewBuffer() {
   header.chunk_id.store(next_chunk_id_, std::memory_order_relaxed);
   header.packets.store(packets, std::memory_order_relaxed);
 
-  SharedMemoryABI::Chunk new_chunk =
-      shmem_arbiter_->GetNewChunk(header, buffer_exhausted_policy_);
+  // The fragments of a large packet are also written into large chunks, to
+  // split it in as few fragments (and patches) as possible.
+  SharedMemoryABI::Chunk new_chunk = shmem_arbiter_->GetNewChunk(
+      header, buffer_exhausted_policy_, packet_size_hint_);
   if (!new_chunk.is_valid()) {
     // Shared memory buffer exhausted, switch into |drop_packets_| mode. We'll
     // drop data until the garbage chunk has been filled once and then retry.
@@ -373,4 +396,9 @@ WriterID TraceWriterImpl::writer_id() const {
 TraceWriter::TraceWriter() = default;
 TraceWriter::~TraceWriter() = default;
 
+TraceWriter::TracePacketHandle TraceWriter::NewTracePacketWithSizeHint(
+    size_t) {
+  return NewTracePacket();
+}
+
 }  // namespace perfetto
@@ -46,6 +46,7 @@ class TraceWriterImpl : public TraceWriter,
 
   // TraceWriter implementation. See documentation in trace_writer.h.
   TracePacketHandle NewTracePacket() override;
+  TracePacketHandle NewTracePacketWithSizeHint(size_t size_hint) override;
   void Flush(std::function<void()> callback = {}) override;
   WriterID writer_id() const override;
   uint64_t written() const override {
@@ -59,6 +60,10 @@ class TraceWriterImpl : public TraceWriter,
   TraceWriterImpl(const TraceWriterImpl&) = delete;
   TraceWriterImpl& operator=(const TraceWriterImpl&) = delete;
 
+  // Shared implementation of NewTracePacket*(). |size_hint| is 0 for packets
+  // of unknown size.
+  TracePacketHandle NewTracePacketInternal(size_t size_hint);
+
   // ScatteredStreamWriter::Delegate implementation.
   protozero::ContiguousMemoryRange GetNewBuffer() override;
 
@@ -105,6 +110,10 @@ class TraceWriterImpl : public TraceWriter,
   // starting the TracePacket header.
   bool fragmenting_packet_ = false;
 
+  // The |size_hint| of the packet being written, or 0. Passed to GetNewChunk()
+  // for the chunks of the packet.
+  size_t packet_size_hint_ = 0;
+
   // Set to |true| when the current chunk contains the maximum number of packets
   // a chunk can contain. When this is |true|, the next packet requires starting
   // a new chunk.
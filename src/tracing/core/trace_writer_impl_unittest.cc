@@ -239,6 +239,70 @@ TEST_P(TraceWriterImplTest, FragmentingPacketWithoutEnablingProducerPatching) {
   ASSERT_EQ(1, last_commit.chunks_to_patch()[0].patches_size());
 }
 
+TEST_P(TraceWriterImplTest, NewTracePacketWithSizeHint) {
+  arbiter_->SetBatchCommitsDuration(UINT32_MAX);
+
+  const BufferID kBufId = 42;
+  std::unique_ptr<TraceWriter> writer = arbiter_->CreateTraceWriter(kBufId);
+
+  // Fill half of the first chunk.
+  size_t chunk_size = page_size() / 4;
+  std::string half_chunk_string(chunk_size / 2, 'x');
+  auto packet = writer->NewTracePacket();
+  packet->set_for_testing()->set_str(half_chunk_string.data(),
+                                     half_chunk_string.size());
+  packet->Finalize();
+
+  // A packet which doesn't fit in the rest of the first chunk but fits in an
+  // empty one is started in the second chunk.
+  std::string large_string(chunk_size * 3 / 4, 'x');
+  auto packet2 = writer->NewTracePacketWithSizeHint(large_string.size() + 16);
+  packet2->set_for_testing()->set_str(large_string.data(), large_string.size());
+  packet2->Finalize();
+  auto packet3 = writer->NewTracePacket();
+  arbiter_->FlushPendingCommitDataRequests();
+
+  // Neither packet was fragmented, so no patches were necessary.
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  ASSERT_EQ(SharedMemoryABI::kChunkComplete, abi->GetChunkState(0u, 0u));
+  auto chunk = abi->TryAcquireChunkForReading(0u, 0u);
+  ASSERT_TRUE(chunk.is_valid());
+  ASSERT_EQ(1, chunk.header()->packets.load().count);
+  ASSERT_FALSE(chunk.header()->packets.load().flags &
+               SharedMemoryABI::ChunkHeader::kLastPacketContinuesOnNextChunk);
+  ASSERT_FALSE(chunk.header()->packets.load().flags &
+               SharedMemoryABI::ChunkHeader::kChunkNeedsPatching);
+
+  const auto& last_commit = fake_producer_endpoint_.last_commit_data_request;
+  ASSERT_EQ(1, last_commit.chunks_to_move_size());
+  EXPECT_EQ(0u, last_commit.chunks_to_move()[0].chunk());
+  EXPECT_EQ(0, last_commit.chunks_to_patch_size());
+
+  // A packet which doesn't fit in an empty chunk of the default layout is
+  // started in a larger chunk of a new page rather than being fragmented.
+  packet3->Finalize();
+  std::string huge_string(chunk_size * 2, 'x');
+  auto packet4 = writer->NewTracePacketWithSizeHint(huge_string.size() + 16);
+  packet4->set_for_testing()->set_str(huge_string.data(), huge_string.size());
+  packet4->Finalize();
+
+  // Hints larger than the largest chunks are ignored: the packet starts in the
+  // current chunk as usual.
+  auto packet5 = writer->NewTracePacketWithSizeHint(page_size() * 2);
+  packet5->set_for_testing()->set_str("foo");
+  packet5->Finalize();
+  writer.reset();
+
+  auto chunk2 = abi->TryAcquireChunkForReading(0u, 1u);
+  ASSERT_TRUE(chunk2.is_valid());
+  ASSERT_EQ(2, chunk2.header()->packets.load().count);
+  auto chunk3 = abi->TryAcquireChunkForReading(1u, 0u);
+  ASSERT_TRUE(chunk3.is_valid());
+  ASSERT_EQ(2, chunk3.header()->packets.load().count);
+  ASSERT_FALSE(chunk3.header()->packets.load().flags &
+               SharedMemoryABI::ChunkHeader::kLastPacketContinuesOnNextChunk);
+}
+
 // Sets up a scenario in which the SMB is exhausted and TraceWriter fails to get
 // a new chunk while fragmenting a packet. Verifies that data is dropped until
 // the SMB is freed up and TraceWriter can get a new chunk.
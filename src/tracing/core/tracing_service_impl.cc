@@ -49,6 +49,8 @@
 #endif
 
 #include <algorithm>
+#include <array>
+#include <deque>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/status.h"
@@ -79,6 +81,10 @@
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 #include "src/tracing/core/trace_buffer.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include "src/tracing/core/zlib_compressor.h"  // nogncheck
+#endif
+
 #include "protos/perfetto/common/builtin_clock.gen.h"
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/common/trace_stats.pbzero.h"
@@ -448,12 +454,14 @@ TracingServiceImpl::ProducerEndpointImpl* TracingServiceImpl::GetProducer(
 }
 
 std::unique_ptr<TracingService::ConsumerEndpoint>
-TracingServiceImpl::ConnectConsumer(Consumer* consumer, uid_t uid) {
+TracingServiceImpl::ConnectConsumer(Consumer* consumer,
+                                    uid_t uid,
+                                    bool in_process) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DLOG("Consumer %p connected from UID %" PRIu64,
                 reinterpret_cast<void*>(consumer), static_cast<uint64_t>(uid));
   std::unique_ptr<ConsumerEndpointImpl> endpoint(
-      new ConsumerEndpointImpl(this, task_runner_, consumer, uid));
+      new ConsumerEndpointImpl(this, task_runner_, consumer, uid, in_process));
   auto it_and_inserted = consumers_.emplace(endpoint.get());
   PERFETTO_DCHECK(it_and_inserted.second);
   // Consumer might go away before we're able to send the connect notification,
@@ -788,6 +796,10 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
       }
     }
     tracing_session->write_into_file = std::move(fd);
+#if !PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+    if (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE)
+      PERFETTO_ELOG("Cannot compress. Zlib not enabled in the build config");
+#endif
     uint32_t write_period_ms = cfg.file_write_period_ms();
     if (write_period_ms == 0)
       write_period_ms = kDefaultWriteIntoFilePeriodMs;
@@ -823,13 +835,15 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
             ? TraceBuffer::kDiscard
             : TraceBuffer::kOverwrite;
     auto it_and_inserted = buffers_.emplace(
-        global_id, TraceBuffer::Create(buf_size_bytes, policy));
+        global_id, TraceBuffer::Create(buf_size_bytes, policy,
+                                       buffer_cfg.use_huge_pages()));
     PERFETTO_DCHECK(it_and_inserted.second);  // buffers_.count(global_id) == 0.
     std::unique_ptr<TraceBuffer>& trace_buffer = it_and_inserted.first->second;
     if (!trace_buffer) {
       did_allocate_all_buffers = false;
       break;
     }
+    trace_buffer->set_trim_complete_chunks(buffer_cfg.trim_complete_chunks());
   }
 
   UpdateMemoryGuardrail();
@@ -1635,9 +1649,10 @@ void TracingServiceImpl::NotifyFlushDoneForProducer(
     // Remove all pending flushes <= |flush_request_id| for |producer_id|.
     auto& pending_flushes = kv.second.pending_flushes;
     auto end_it = pending_flushes.upper_bound(flush_request_id);
+    bool acked_partial_flush = false;
     for (auto it = pending_flushes.begin(); it != end_it;) {
       PendingFlush& pending_flush = it->second;
-      pending_flush.producers.erase(producer_id);
+      bool acked = pending_flush.producers.erase(producer_id) > 0;
       if (pending_flush.producers.empty()) {
         auto weak_this = weak_ptr_factory_.GetWeakPtr();
         TracingSessionID tsid = kv.first;
@@ -1650,10 +1665,60 @@ void TracingServiceImpl::NotifyFlushDoneForProducer(
         });
         it = pending_flushes.erase(it);
       } else {
+        acked_partial_flush |= acked;
         it++;
       }
     }  // for (pending_flushes)
-  }    // for (tracing_session)
+
+    if (acked_partial_flush) {
+      ProducerEndpointImpl* producer = GetProducer(producer_id);
+      if (producer)
+        OnPartialFlushComplete(&kv.second, producer);
+    }
+  }  // for (tracing_session)
+}
+
+// Called when |producer| acked a flush that other producers of the session
+// are still working on. The flush callback still waits for all of them (or
+// the timeout) but, when streaming into a file, there is no reason to hold
+// back the data of the producers that are done: it is drained straight away
+// rather than at the next write period, so that a slow producer doesn't delay
+// the data of all the others.
+void TracingServiceImpl::OnPartialFlushComplete(
+    TracingSession* tracing_session,
+    ProducerEndpointImpl* producer) {
+  if (!tracing_session->write_into_file ||
+      tracing_session->write_period_ms == 0 ||
+      tracing_session->state != TracingSession::STARTED) {
+    return;
+  }
+
+  ScrapeSharedMemoryBuffers(tracing_session, producer);
+
+  if (tracing_session->partial_flush_drain_pending)
+    return;
+  tracing_session->partial_flush_drain_pending = true;
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  TracingSessionID tsid = tracing_session->id;
+  task_runner_->PostTask([weak_this, tsid] {
+    if (weak_this)
+      weak_this->DrainPartialFlushIntoFile(tsid);
+  });
+}
+
+void TracingServiceImpl::DrainPartialFlushIntoFile(TracingSessionID tsid) {
+  TracingSession* tracing_session = GetTracingSession(tsid);
+  if (!tracing_session)
+    return;
+  tracing_session->partial_flush_drain_pending = false;
+
+  // The session might have been stopped in the meantime, in which case the
+  // final drain has already happened.
+  if (!tracing_session->write_into_file ||
+      tracing_session->write_period_ms == 0) {
+    return;
+  }
+  ReadBuffers(tsid, nullptr, /*schedule_next_drain=*/false);
 }
 
 void TracingServiceImpl::OnFlushTimeout(TracingSessionID tsid,
@@ -1665,8 +1730,15 @@ void TracingServiceImpl::OnFlushTimeout(TracingSessionID tsid,
   if (it == tracing_session->pending_flushes.end())
     return;  // Nominal case: flush was completed and acked on time.
 
-  // If there were no producers to flush, consider it a success.
+  // If there were no producers to flush, consider it a success. Otherwise the
+  // producers left in the set are the ones that didn't ack on time. When
+  // writing into a file, the data of the others has already been drained as
+  // their acks came in (see OnPartialFlushComplete()).
   bool success = it->second.producers.empty();
+  for (ProducerID producer_id : it->second.producers) {
+    PERFETTO_DLOG("Flush %" PRIu64 " timed out waiting for producer %" PRIu16,
+                  flush_request_id, producer_id);
+  }
 
   auto callback = std::move(it->second.callback);
   tracing_session->pending_flushes.erase(it);
@@ -1803,10 +1875,10 @@ void TracingServiceImpl::ScrapeSharedMemoryBuffers(
       uint32_t chunk_id =
           chunk.header()->chunk_id.load(std::memory_order_relaxed);
 
-      CopyProducerPageIntoLogBuffer(
-          producer->id_, producer->uid_, writer_id, chunk_id, *target_buffer_id,
-          packet_count, flags, chunk_complete, chunk.payload_begin(),
-          chunk.payload_size());
+      CopyProducerPageIntoLogBuffer(producer, writer_id, chunk_id,
+                                    *target_buffer_id, packet_count, flags,
+                                    chunk_complete, chunk.payload_begin(),
+                                    chunk.payload_size());
     }
   }
 }
@@ -1915,7 +1987,8 @@ void TracingServiceImpl::PeriodicClearIncrementalStateTask(
 // |consumer| will be == nullptr (as opposite to the case of a consumer asking
 // to send the trace data back over IPC).
 bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
-                                     ConsumerEndpointImpl* consumer) {
+                                     ConsumerEndpointImpl* consumer,
+                                     bool schedule_next_drain) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   TracingSession* tracing_session = GetTracingSession(tsid);
   if (!tracing_session) {
@@ -2021,9 +2094,28 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   // buffer in one large task, will hit the blocking send() once the socket
   // buffers are full and hang the service for a bit (until the consumer
   // catches up).
+  // In-process consumers have no IPC channel to keep responsive, so they are
+  // sent much larger batches, saving most of the PostTask()s and OnTraceData()
+  // calls.
   static constexpr size_t kApproxBytesPerTask = 32768;
+  static constexpr size_t kApproxBytesPerTaskInProcess = 1024 * 1024;
+  const bool in_process_consumer = consumer && consumer->in_process_;
+  const size_t approx_bytes_per_task = in_process_consumer
+                                           ? kApproxBytesPerTaskInProcess
+                                           : kApproxBytesPerTask;
   bool did_hit_threshold = false;
 
+  // The packets of write_into_file sessions are written into the file and
+  // destroyed before returning, and in-process consumers consume them within
+  // OnTraceData(). Hence their trusted fields (see below) are serialized in
+  // here rather than in a Slice allocated for each packet. Note that the
+  // payload of the packets is never copied: their slices point straight into
+  // the TraceBuffer.
+  static constexpr size_t kTrustedFieldsSize = 32;
+  std::deque<std::array<uint8_t, kTrustedFieldsSize>> trusted_fields;
+  const bool use_trusted_fields_arena =
+      tracing_session->write_into_file || in_process_consumer;
+
   // TODO(primiano): Extend the ReadBuffers API to allow reading only some
   // buffers, not all of them in one go.
   for (size_t buf_idx = 0;
@@ -2062,9 +2154,18 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
       // truncated packets are also rejected, so the producer can't give us a
       // partial packet (e.g., a truncated string) which only becomes valid when
       // the trusted data is appended here.
-      Slice slice = Slice::Allocate(32);
+      Slice slice;
+      uint8_t* trusted_buf;
+      if (use_trusted_fields_arena) {
+        trusted_fields.emplace_back();
+        trusted_buf = trusted_fields.back().data();
+        slice = Slice(trusted_buf, kTrustedFieldsSize);
+      } else {
+        slice = Slice::Allocate(kTrustedFieldsSize);
+        trusted_buf = slice.own_data();
+      }
       protozero::StaticBuffered<protos::pbzero::TracePacket> trusted_packet(
-          slice.own_data(), slice.size);
+          trusted_buf, slice.size);
       trusted_packet->set_trusted_uid(
           static_cast<int32_t>(sequence_properties.producer_uid_trusted));
       trusted_packet->set_trusted_packet_sequence_id(
@@ -2079,7 +2180,7 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
       // Append the packet (inclusive of the trusted uid) to |packets|.
       packets_bytes += packet.size();
       total_slices += packet.slices().size();
-      did_hit_threshold = packets_bytes >= kApproxBytesPerTask &&
+      did_hit_threshold = packets_bytes >= approx_bytes_per_task &&
                           !tracing_session->write_into_file;
       packets.emplace_back(std::move(packet));
     }  // for(packets...)
@@ -2132,29 +2233,38 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
     // by the earlier call to SetFilterRoot() in EnableTracing().
     PERFETTO_DCHECK(trace_filter.root_msg_index() != 0);
     std::vector<protozero::MessageFilter::InputSlice> filter_input;
-    for (auto it = packets.begin(); it != packets.end(); ++it) {
-      const auto& packet_slices = it->slices();
-      filter_input.clear();
-      filter_input.resize(packet_slices.size());
+    std::vector<protozero::MessageFilter::BatchInput> filter_messages;
+    filter_input.reserve(total_slices);
+    filter_messages.reserve(packets.size());
+    for (const TracePacket& packet : packets) {
+      for (const Slice& slice : packet.slices())
+        filter_input.push_back({slice.start, slice.size});
+      filter_messages.push_back({packet.slices().size()});
       ++tracing_session->filter_input_packets;
-      tracing_session->filter_input_bytes += it->size();
-      for (size_t i = 0; i < packet_slices.size(); ++i)
-        filter_input[i] = {packet_slices[i].start, packet_slices[i].size};
-      auto filtered_packet = trace_filter.FilterMessageFragments(
-          &filter_input[0], filter_input.size());
+      tracing_session->filter_input_bytes += packet.size();
+    }
 
+    // The whole batch is filtered into an arena owned by the filter. Like the
+    // slices returned by TraceBuffer, which point into the buffer, the filtered
+    // packets are only valid until the next ReadBuffers(), which is fine as
+    // they are either written into the file or passed to OnTraceData() below.
+    std::vector<protozero::MessageFilter::BatchOutput> filtered;
+    trace_filter.FilterMessageBatch(filter_input.data(),
+                                    filter_messages.data(),
+                                    filter_messages.size(), &filtered);
+    const uint64_t first_packet_index =
+        tracing_session->filter_input_packets - packets.size() + 1;
+    for (size_t i = 0; i < packets.size(); ++i) {
       // Replace the packet in-place with the filtered one (unless failed).
-      *it = TracePacket();
-      if (filtered_packet.error) {
+      packets[i] = TracePacket();
+      if (filtered[i].error) {
         ++tracing_session->filter_errors;
         PERFETTO_DLOG("Trace packet filtering failed @ packet %" PRIu64,
-                      tracing_session->filter_input_packets);
+                      first_packet_index + i);
         continue;
       }
-      tracing_session->filter_output_bytes += filtered_packet.size;
-      it->AddSlice(Slice::TakeOwnership(std::move(filtered_packet.data),
-                                        filtered_packet.size));
-
+      tracing_session->filter_output_bytes += filtered[i].size;
+      packets[i].AddSlice(filtered[i].data, filtered[i].size);
     }  // for (packet)
   }    // if (trace_filter)
 
@@ -2162,6 +2272,19 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   // |write_into_file| == true in the trace config, drain the packets read
   // (if any) into the given file descriptor.
   if (tracing_session->write_into_file) {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+    // Consumers compress the packets they read on their side (see
+    // perfetto_cmd), but nobody else can do it for packets written directly
+    // into the file.
+    if (tracing_session->config.compression_type() ==
+        TraceConfig::COMPRESSION_TYPE_DEFLATE) {
+      ZlibCompressFn(&packets);
+      total_slices = 0;
+      for (const TracePacket& packet : packets)
+        total_slices += packet.slices().size();
+    }
+#endif
+
     const uint64_t max_size = tracing_session->max_file_size_bytes
                                   ? tracing_session->max_file_size_bytes
                                   : std::numeric_limits<size_t>::max();
@@ -2232,6 +2355,9 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
       return true;
     }
 
+    if (!schedule_next_drain)
+      return true;
+
     auto weak_this = weak_ptr_factory_.GetWeakPtr();
     task_runner_->PostDelayedTask(
         [weak_this, tsid] {
@@ -2561,8 +2687,7 @@ TracingServiceImpl::DataSourceInstance* TracingServiceImpl::SetupDataSource(
 // might be lying / returning garbage contents. |src| and |size| can be trusted
 // in terms of being a valid pointer, but not the contents.
 void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
-    ProducerID producer_id_trusted,
-    uid_t producer_uid_trusted,
+    ProducerEndpointImpl* producer,
     WriterID writer_id,
     ChunkID chunk_id,
     BufferID buffer_id,
@@ -2572,13 +2697,8 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     const uint8_t* src,
     size_t size) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
-
-  ProducerEndpointImpl* producer = GetProducer(producer_id_trusted);
-  if (!producer) {
-    PERFETTO_DFATAL("Producer not found.");
-    chunks_discarded_++;
-    return;
-  }
+  PERFETTO_DCHECK(GetProducer(producer->id_) == producer);
+  const ProducerID producer_id_trusted = producer->id_;
 
   TraceBuffer* buf = GetBufferByID(buffer_id);
   if (!buf) {
@@ -2617,7 +2737,7 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     return;
   }
 
-  buf->CopyChunkUntrusted(producer_id_trusted, producer_uid_trusted, writer_id,
+  buf->CopyChunkUntrusted(producer_id_trusted, producer->uid_, writer_id,
                           chunk_id, num_fragments, chunk_flags, chunk_complete,
                           src, size);
 }
@@ -3025,6 +3145,49 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
     }
     *trace_stats.add_buffer_stats() = buf->stats();
   }  // for (buf in session).
+
+  for (uint32_t bound : TraceBuffer::WriterStats::kChunkPayloadBucketBounds)
+    trace_stats.add_chunk_payload_histogram_def(bound);
+
+  // The producers which have data sources in the session, plus the ones which
+  // wrote into its buffers (e.g. from a data source which has been stopped).
+  std::map<ProducerID, TraceStats::ProducerStats> producer_stats;
+  for (const auto& kv : tracing_session->data_source_instances)
+    producer_stats[kv.first].set_producer_id(kv.first);
+
+  for (size_t buf_idx = 0; buf_idx < tracing_session->num_buffers();
+       buf_idx++) {
+    TraceBuffer* buf = GetBufferByID(tracing_session->buffers_index[buf_idx]);
+    if (!buf)
+      continue;
+    buf->ForEachWriterStats([&](ProducerID producer_id, WriterID writer_id,
+                                const TraceBuffer::WriterStats& stats) {
+      auto* writer_stats = trace_stats.add_writer_stats();
+      writer_stats->set_sequence_id(
+          tracing_session->GetPacketSequenceID(producer_id, writer_id));
+      writer_stats->set_producer_id(producer_id);
+      writer_stats->set_buffer(static_cast<uint32_t>(buf_idx));
+      writer_stats->set_chunks_written(stats.chunks_written);
+      writer_stats->set_bytes_written(stats.bytes_written);
+      for (uint64_t count : stats.chunk_payload_histogram)
+        writer_stats->add_chunk_payload_histogram_counts(count);
+
+      TraceStats::ProducerStats& prod_stats = producer_stats[producer_id];
+      prod_stats.set_producer_id(producer_id);
+      prod_stats.set_bytes_written(prod_stats.bytes_written() +
+                                   stats.bytes_written);
+    });
+  }
+
+  for (auto& kv : producer_stats) {
+    ProducerEndpointImpl* producer = GetProducer(kv.first);
+    if (producer) {
+      kv.second.set_name(producer->name_);
+      kv.second.set_uid(static_cast<int32_t>(producer->uid_));
+      kv.second.set_smb_stalls(producer->smb_stalls_);
+    }
+    *trace_stats.add_producer_stats() = std::move(kv.second);
+  }
   return trace_stats;
 }
 
@@ -3228,6 +3391,129 @@ bool TracingServiceImpl::MaybeSaveTraceForBugreport(
   return true;
 }
 
+base::Status TracingServiceImpl::GetSessionToClone(
+    ConsumerEndpointImpl* consumer,
+    const std::string& unique_session_name,
+    TracingSessionID* tsid) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  if (GetTracingSession(consumer->tracing_session_id_)) {
+    return PERFETTO_SVC_ERR(
+        "A Consumer is trying to CloneSession() but another tracing session "
+        "is already active (forgot a call to FreeBuffers() ?)");
+  }
+  if (unique_session_name.empty())
+    return PERFETTO_SVC_ERR("CloneSession() requires a unique_session_name");
+
+  for (auto& kv : tracing_sessions_) {
+    const TracingSession& session = kv.second;
+    if (session.config.unique_session_name() != unique_session_name)
+      continue;
+    // As for Attach(), only the uid which started the session can read it.
+    if (session.consumer_uid != consumer->uid_) {
+      return PERFETTO_SVC_ERR(
+          "The tracing session \"%s\" belongs to a different uid",
+          unique_session_name.c_str());
+    }
+    if (session.write_into_file) {
+      return PERFETTO_SVC_ERR(
+          "Cannot clone the write_into_file tracing session \"%s\"",
+          unique_session_name.c_str());
+    }
+    *tsid = kv.first;
+    return base::OkStatus();
+  }
+  return PERFETTO_SVC_ERR("No tracing session named \"%s\"",
+                          unique_session_name.c_str());
+}
+
+base::Status TracingServiceImpl::CloneSession(
+    ConsumerEndpointImpl* consumer,
+    const std::string& unique_session_name) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  // The session may have ended, or the consumer started another one, while
+  // the flush issued by ConsumerEndpointImpl::CloneSession() was in flight.
+  TracingSessionID src_tsid = 0;
+  base::Status status =
+      GetSessionToClone(consumer, unique_session_name, &src_tsid);
+  if (!status.ok())
+    return status;
+
+  if (tracing_sessions_.size() >= kMaxConcurrentTracingSessions) {
+    return PERFETTO_SVC_ERR("Too many concurrent tracing sesions (%zu)",
+                            tracing_sessions_.size());
+  }
+
+  // Copy the buffers first, so that nothing has to be undone if that fails.
+  // This is a single memcpy() of the written part of each buffer.
+  TracingSession* src = GetTracingSession(src_tsid);
+  std::vector<std::unique_ptr<TraceBuffer>> cloned_buffers;
+  for (BufferID src_buffer_id : src->buffers_index) {
+    TraceBuffer* src_buffer = GetBufferByID(src_buffer_id);
+    PERFETTO_DCHECK(src_buffer);
+    cloned_buffers.emplace_back(src_buffer->CloneReadOnly());
+    if (!cloned_buffers.back())
+      return PERFETTO_SVC_ERR("Failed to allocate the cloned buffers (OOM)");
+  }
+
+  // The clone is a snapshot: it doesn't have data sources, triggers or a
+  // duration, and its name doesn't prevent the cloned session from being
+  // restarted with the same name.
+  TraceConfig cfg = src->config;
+  cfg.set_unique_session_name("");
+  *cfg.mutable_trigger_config() = TraceConfig::TriggerConfig();
+  cfg.set_duration_ms(0);
+
+  const TracingSessionID tsid = ++last_tracing_session_id_;
+  TracingSession* clone =
+      &tracing_sessions_
+           .emplace(std::piecewise_construct, std::forward_as_tuple(tsid),
+                    std::forward_as_tuple(tsid, consumer, cfg, task_runner_))
+           .first->second;
+
+  for (auto& cloned_buffer : cloned_buffers) {
+    BufferID global_id = buffer_ids_.Allocate();
+    if (!global_id) {
+      for (BufferID buffer_id : clone->buffers_index) {
+        buffer_ids_.Free(buffer_id);
+        buffers_.erase(buffer_id);
+      }
+      tracing_sessions_.erase(tsid);
+      return PERFETTO_SVC_ERR("Failed to clone the buffers: too many buffers");
+    }
+    clone->buffers_index.push_back(global_id);
+    buffers_.emplace(global_id, std::move(cloned_buffer));
+  }
+  UpdateMemoryGuardrail();
+
+  if (src->trace_filter) {
+    // The bytecode has already been validated when the source session was
+    // enabled.
+    const std::string& bytecode = cfg.trace_filter().bytecode();
+    clone->trace_filter.reset(new protozero::MessageFilter());
+    uint32_t packet_field_id = TracePacket::kPacketFieldNumber;
+    PERFETTO_CHECK(clone->trace_filter->LoadFilterBytecode(bytecode.data(),
+                                                           bytecode.size()));
+    PERFETTO_CHECK(clone->trace_filter->SetFilterRoot(&packet_field_id, 1));
+  }
+
+  // The ids of the sequences must match the ones already emitted by the source
+  // session for the packets to be reassembled in the same sequences.
+  clone->packet_sequence_ids = src->packet_sequence_ids;
+  clone->last_packet_sequence_id = src->last_packet_sequence_id;
+  clone->received_triggers = src->received_triggers;
+  clone->initial_clock_snapshot = src->initial_clock_snapshot;
+  clone->clock_snapshot_ring_buffer = src->clock_snapshot_ring_buffer;
+  MaybeSnapshotClocksIntoRingBuffer(clone);
+  clone->should_emit_sync_marker = true;
+  clone->state = TracingSession::DISABLED;
+
+  consumer->tracing_session_id_ = tsid;
+  PERFETTO_LOG("Cloned tracing session %" PRIu64 " into %" PRIu64
+               ", total sessions:%zu",
+               src_tsid, tsid, tracing_sessions_.size());
+  return base::OkStatus();
+}
+
 void TracingServiceImpl::MaybeLogUploadEvent(const TraceConfig& cfg,
                                              PerfettoStatsdAtom atom,
                                              const std::string& trigger_name) {
@@ -3276,11 +3562,13 @@ TracingServiceImpl::ConsumerEndpointImpl::ConsumerEndpointImpl(
     TracingServiceImpl* service,
     base::TaskRunner* task_runner,
     Consumer* consumer,
-    uid_t uid)
+    uid_t uid,
+    bool in_process)
     : task_runner_(task_runner),
       service_(service),
       consumer_(consumer),
       uid_(uid),
+      in_process_(in_process),
       weak_ptr_factory_(this) {}
 
 TracingServiceImpl::ConsumerEndpointImpl::~ConsumerEndpointImpl() {
@@ -3527,6 +3815,7 @@ void TracingServiceImpl::ConsumerEndpointImpl::QueryCapabilities(
   TracingServiceCapabilities caps;
   caps.set_has_query_capabilities(true);
   caps.set_has_trace_config_output_path(true);
+  caps.set_has_clone_session(true);
   caps.add_observable_events(ObservableEvents::TYPE_DATA_SOURCES_INSTANCES);
   caps.add_observable_events(ObservableEvents::TYPE_ALL_DATA_SOURCES_STARTED);
   static_assert(ObservableEvents::Type_MAX ==
@@ -3554,6 +3843,34 @@ void TracingServiceImpl::ConsumerEndpointImpl::SaveTraceForBugreport(
   }
 }
 
+void TracingServiceImpl::ConsumerEndpointImpl::CloneSession(
+    const std::string& unique_session_name,
+    CloneSessionCallback consumer_callback) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  TracingSessionID src_tsid = 0;
+  base::Status status =
+      service_->GetSessionToClone(this, unique_session_name, &src_tsid);
+  if (!status.ok()) {
+    consumer_callback(false, status.message());
+    return;
+  }
+
+  // Flush the session first, so that the clone also contains the data which
+  // the producers haven't committed yet. The clone is made whether or not all
+  // the producers ack the flush.
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  service_->Flush(
+      src_tsid, 0,
+      [weak_this, unique_session_name, consumer_callback](bool) {
+        if (!weak_this)
+          return;
+        base::Status clone_status =
+            weak_this->service_->CloneSession(weak_this.get(),
+                                              unique_session_name);
+        consumer_callback(clone_status.ok(), clone_status.message());
+      });
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // TracingServiceImpl::ProducerEndpointImpl implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -3612,7 +3929,7 @@ void TracingServiceImpl::ProducerEndpointImpl::RegisterTraceWriter(
 void TracingServiceImpl::ProducerEndpointImpl::UnregisterTraceWriter(
     uint32_t writer_id) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
-  writers_.erase(static_cast<WriterID>(writer_id));
+  writers_.Erase(static_cast<WriterID>(writer_id));
 }
 
 void TracingServiceImpl::ProducerEndpointImpl::CommitData(
@@ -3631,7 +3948,19 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     return;
   }
   PERFETTO_DCHECK(shmem_abi_.is_valid());
-  for (const auto& entry : req_untrusted.chunks_to_move()) {
+
+  // When set, |chunks_to_move| is superseded by the SMB sweep. It must be
+  // ignored because, after the sweep, the producer might have already reused a
+  // chunk listed in it for a different writer and target buffer.
+  const auto& chunks_to_move = req_untrusted.chunks_to_move();
+  size_t num_chunks_to_move = chunks_to_move.size();
+  if (req_untrusted.move_all_complete_chunks()) {
+    MoveAllCompleteChunks();
+    num_chunks_to_move = 0;
+  }
+
+  for (size_t i = 0; i < num_chunks_to_move; i++) {
+    const auto& entry = chunks_to_move[i];
     const uint32_t page_idx = entry.page();
     if (page_idx >= shmem_abi_.num_pages())
       continue;  // A buggy or malicious producer.
@@ -3658,7 +3987,7 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     uint8_t chunk_flags = packets.flags;
 
     service_->CopyProducerPageIntoLogBuffer(
-        id_, uid_, writer_id, chunk_id, buffer_id, num_fragments, chunk_flags,
+        this, writer_id, chunk_id, buffer_id, num_fragments, chunk_flags,
         /*chunk_complete=*/true, chunk.payload_begin(), chunk.payload_size());
 
     // This one has release-store semantics.
@@ -3667,6 +3996,8 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
 
   service_->ApplyChunkPatches(id_, req_untrusted.chunks_to_patch());
 
+  smb_stalls_ += req_untrusted.smb_stalls();
+
   if (req_untrusted.flush_request_id()) {
     service_->NotifyFlushDoneForProducer(id_, req_untrusted.flush_request_id());
   }
@@ -3678,6 +4009,57 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     callback();
 }
 
+void TracingServiceImpl::ProducerEndpointImpl::MoveAllCompleteChunks() {
+  // Like in ScrapeSharedMemoryBuffers(), the layout of the pages and the
+  // headers of the chunks can be altered concurrently by a malicious producer.
+  // Here only chunks that TryAcquireChunkForReading() moves from the
+  // kChunkComplete to the kChunkBeingRead state are copied, exactly as if they
+  // were listed in the |chunks_to_move| of the request.
+  for (size_t page_idx = 0; page_idx < shmem_abi_.num_pages(); page_idx++) {
+    uint32_t layout = shmem_abi_.GetPageLayout(page_idx);
+    uint32_t used_chunks = shmem_abi_.GetUsedChunks(layout);  // A bitmap.
+    for (uint32_t chunk_idx = 0; used_chunks; chunk_idx++, used_chunks >>= 1) {
+      if (!(used_chunks & 1) ||
+          SharedMemoryABI::GetChunkStateFromLayout(layout, chunk_idx) !=
+              SharedMemoryABI::kChunkComplete) {
+        continue;
+      }
+
+      // The target buffer is known only for registered writers. A chunk of a
+      // writer whose RegisterTraceWriter() IPC is still in flight is left in
+      // the SMB and moved by a later sweep.
+      SharedMemoryABI::Chunk unchecked_chunk =
+          shmem_abi_.GetChunkUnchecked(page_idx, layout, chunk_idx);
+      if (!buffer_id_for_writer(unchecked_chunk.writer_id()))
+        continue;
+
+      SharedMemoryABI::Chunk chunk =
+          shmem_abi_.TryAcquireChunkForReading(page_idx, chunk_idx);
+      if (!chunk.is_valid())
+        continue;
+
+      // Re-read the header: the chunk might have been freed and rewritten by
+      // another writer between the two reads above.
+      const SharedMemoryABI::ChunkHeader& chunk_header = *chunk.header();
+      WriterID writer_id =
+          chunk_header.writer_id.load(std::memory_order_relaxed);
+      base::Optional<BufferID> buffer_id = buffer_id_for_writer(writer_id);
+      if (buffer_id) {
+        ChunkID chunk_id =
+            chunk_header.chunk_id.load(std::memory_order_relaxed);
+        auto packets = chunk_header.packets.load(std::memory_order_relaxed);
+        service_->CopyProducerPageIntoLogBuffer(
+            this, writer_id, chunk_id, *buffer_id, packets.count, packets.flags,
+            /*chunk_complete=*/true, chunk.payload_begin(),
+            chunk.payload_size());
+      }
+
+      // This one has release-store semantics.
+      shmem_abi_.ReleaseChunkAsFree(std::move(chunk));
+    }
+  }
+}
+
 void TracingServiceImpl::ProducerEndpointImpl::SetupSharedMemory(
     std::unique_ptr<SharedMemory> shared_memory,
     size_t page_size_bytes,
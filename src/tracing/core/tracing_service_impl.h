@@ -31,6 +31,7 @@
 #include "perfetto/base/status.h"
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/circular_queue.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/periodic_task.h"
 #include "perfetto/ext/base/weak_ptr.h"
@@ -128,9 +129,9 @@ class TracingServiceImpl : public TracingService {
     }
 
     base::Optional<BufferID> buffer_id_for_writer(WriterID writer_id) const {
-      const auto it = writers_.find(writer_id);
-      if (it != writers_.end())
-        return it->second;
+      const BufferID* buffer_id = writers_.Find(writer_id);
+      if (buffer_id)
+        return *buffer_id;
       return base::nullopt;
     }
 
@@ -143,6 +144,11 @@ class TracingServiceImpl : public TracingService {
     ProducerEndpointImpl(const ProducerEndpointImpl&) = delete;
     ProducerEndpointImpl& operator=(const ProducerEndpointImpl&) = delete;
 
+    // Moves into their target buffers all the chunks in the kChunkComplete
+    // state of the registered writers. See |move_all_complete_chunks| in
+    // commit_data_request.proto.
+    void MoveAllCompleteChunks();
+
     ProducerID const id_;
     const uid_t uid_;
     TracingServiceImpl* const service_;
@@ -170,8 +176,11 @@ class TracingServiceImpl : public TracingService {
     // service will prevent the writer from writing into any other buffer than
     // the one associated with it here. The BufferIDs stored in this map are
     // untrusted, so need to be verified against |allowed_target_buffers_|
-    // before use.
-    std::map<WriterID, BufferID> writers_;
+    // before use. Looked up for every committed chunk, hence the hash map.
+    base::FlatHashMap<WriterID, BufferID> writers_;
+
+    // Sum of CommitDataRequest.smb_stalls, see TraceStats.ProducerStats.
+    uint64_t smb_stalls_ = 0;
 
     // This is used only in in-process configurations.
     // SharedMemoryArbiterImpl methods themselves are thread-safe.
@@ -187,7 +196,8 @@ class TracingServiceImpl : public TracingService {
     ConsumerEndpointImpl(TracingServiceImpl*,
                          base::TaskRunner*,
                          Consumer*,
-                         uid_t uid);
+                         uid_t uid,
+                         bool in_process);
     ~ConsumerEndpointImpl() override;
 
     void NotifyOnTracingDisabled(const std::string& error);
@@ -207,6 +217,8 @@ class TracingServiceImpl : public TracingService {
     void QueryServiceState(QueryServiceStateCallback) override;
     void QueryCapabilities(QueryCapabilitiesCallback) override;
     void SaveTraceForBugreport(SaveTraceForBugreportCallback) override;
+    void CloneSession(const std::string& unique_session_name,
+                      CloneSessionCallback) override;
 
     // Will queue a task to notify the consumer about the state change.
     void OnDataSourceInstanceStateChange(const ProducerEndpointImpl&,
@@ -226,6 +238,7 @@ class TracingServiceImpl : public TracingService {
     TracingServiceImpl* const service_;
     Consumer* const consumer_;
     uid_t const uid_;
+    bool const in_process_;
     TracingSessionID tracing_session_id_ = 0;
 
     // Whether the consumer is interested in DataSourceInstance state change
@@ -248,8 +261,9 @@ class TracingServiceImpl : public TracingService {
   void DisconnectProducer(ProducerID);
   void RegisterDataSource(ProducerID, const DataSourceDescriptor&);
   void UnregisterDataSource(ProducerID, const std::string& name);
-  void CopyProducerPageIntoLogBuffer(ProducerID,
-                                     uid_t,
+  // |producer| is passed rather than looked up by ID as this is called for
+  // each chunk committed or scraped.
+  void CopyProducerPageIntoLogBuffer(ProducerEndpointImpl* producer,
                                      WriterID,
                                      ChunkID,
                                      BufferID,
@@ -280,7 +294,12 @@ class TracingServiceImpl : public TracingService {
              uint32_t timeout_ms,
              ConsumerEndpoint::FlushCallback);
   void FlushAndDisableTracing(TracingSessionID);
-  bool ReadBuffers(TracingSessionID, ConsumerEndpointImpl*);
+  // When writing into a file, |schedule_next_drain| == false skips posting the
+  // next periodic drain (used for out-of-band drains, which must not duplicate
+  // the periodic task).
+  bool ReadBuffers(TracingSessionID,
+                   ConsumerEndpointImpl*,
+                   bool schedule_next_drain = true);
   void FreeBuffers(TracingSessionID);
 
   // Service implementation.
@@ -298,7 +317,8 @@ class TracingServiceImpl : public TracingService {
 
   std::unique_ptr<TracingService::ConsumerEndpoint> ConnectConsumer(
       Consumer*,
-      uid_t) override;
+      uid_t,
+      bool in_process = false) override;
 
   // Set whether SMB scraping should be enabled by default or not. Producers can
   // override this setting for their own SMBs.
@@ -491,6 +511,11 @@ class TracingServiceImpl : public TracingService {
     // we are still awaiting a NotifyFlushComplete(N) ack.
     std::map<FlushRequestID, PendingFlush> pending_flushes;
 
+    // Set when a drain into the |write_into_file| file has been posted because
+    // some (but not all) producers acked a pending flush. Coalesces the drains
+    // triggered by acks that arrive close to each other.
+    bool partial_flush_drain_pending = false;
+
     // Maps a per-trace-session buffer index into the corresponding global
     // BufferID (shared namespace amongst all consumers). This vector has as
     // many entries as |config.buffers_size()|.
@@ -639,6 +664,13 @@ class TracingServiceImpl : public TracingService {
   void MaybeEmitReceivedTriggers(TracingSession*, std::vector<TracePacket>*);
   void MaybeNotifyAllDataSourcesStarted(TracingSession*);
   bool MaybeSaveTraceForBugreport(std::function<void()> callback);
+  // Looks up the session that |consumer| can clone, see
+  // ConsumerEndpoint::CloneSession().
+  base::Status GetSessionToClone(ConsumerEndpointImpl* consumer,
+                                 const std::string& unique_session_name,
+                                 TracingSessionID*);
+  base::Status CloneSession(ConsumerEndpointImpl* consumer,
+                            const std::string& unique_session_name);
   void OnFlushTimeout(TracingSessionID, FlushRequestID);
   void OnDisableTracingTimeout(TracingSessionID);
   void DisableTracingNotifyConsumerAndFlushFile(TracingSession*);
@@ -646,6 +678,8 @@ class TracingServiceImpl : public TracingService {
   void CompleteFlush(TracingSessionID tsid,
                      ConsumerEndpoint::FlushCallback callback,
                      bool success);
+  void OnPartialFlushComplete(TracingSession*, ProducerEndpointImpl*);
+  void DrainPartialFlushIntoFile(TracingSessionID);
   void ScrapeSharedMemoryBuffers(TracingSession*, ProducerEndpointImpl*);
   void PeriodicClearIncrementalStateTask(TracingSessionID, bool post_next_only);
   TraceBuffer* GetBufferByID(BufferID);
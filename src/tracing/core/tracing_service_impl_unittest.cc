@@ -21,10 +21,12 @@
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/tracing/core/commit_data_request.h"
 #include "perfetto/ext/tracing/core/consumer.h"
 #include "perfetto/ext/tracing/core/observable_events.h"
 #include "perfetto/ext/tracing/core/producer.h"
 #include "perfetto/ext/tracing/core/shared_memory.h"
+#include "perfetto/ext/tracing/core/shared_memory_abi.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/tracing/core/data_source_config.h"
@@ -144,8 +146,13 @@ class TracingServiceImplTest : public testing::Test {
     return svc->GetProducer(producer_id)->allowed_target_buffers_;
   }
 
-  const std::map<WriterID, BufferID>& GetWriters(ProducerID producer_id) {
-    return svc->GetProducer(producer_id)->writers_;
+  std::map<WriterID, BufferID> GetWriters(ProducerID producer_id) {
+    std::map<WriterID, BufferID> writers;
+    for (auto it = svc->GetProducer(producer_id)->writers_.GetIterator(); it;
+         ++it) {
+      writers[it.key()] = it.value();
+    }
+    return writers;
   }
 
   std::unique_ptr<SharedMemoryArbiterImpl> TakeShmemArbiterForProducer(
@@ -1864,6 +1871,138 @@ TEST_F(TracingServiceImplTest, ExplicitFlush) {
                   Property(&protos::gen::TestEvent::str, Eq("payload")))));
 }
 
+// In-process consumers are sent the whole buffer in one go, rather than in
+// batches of a few tens of KB.
+TEST_F(TracingServiceImplTest, InProcessConsumerReadsInOneBatch) {
+  for (bool in_process : {false, true}) {
+    SCOPED_TRACE(in_process);
+    std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+    consumer->Connect(svc.get(), /*uid=*/0, in_process);
+
+    std::unique_ptr<MockProducer> producer = CreateMockProducer();
+    producer->Connect(svc.get(), "mock_producer");
+    producer->RegisterDataSource("data_source");
+
+    TraceConfig trace_config;
+    trace_config.add_buffers()->set_size_kb(512);
+    auto* ds_config = trace_config.add_data_sources()->mutable_config();
+    ds_config->set_name("data_source");
+
+    consumer->EnableTracing(trace_config);
+    producer->WaitForTracingSetup();
+    producer->WaitForDataSourceSetup("data_source");
+    producer->WaitForDataSourceStart("data_source");
+
+    std::unique_ptr<TraceWriter> writer =
+        producer->CreateTraceWriter("data_source");
+    // 50 KB, which is more than the batch size of regular consumers but fits
+    // in the shared memory buffer.
+    static constexpr size_t kNumPackets = 50;
+    const std::string payload(1024, 'x');
+    for (size_t i = 0; i < kNumPackets; i++) {
+      auto tp = writer->NewTracePacket();
+      tp->set_for_testing()->set_str(payload);
+    }
+    auto flush_request = consumer->Flush();
+    producer->WaitForFlush(writer.get());
+    ASSERT_TRUE(flush_request.WaitForReply());
+
+    consumer->DisableTracing();
+    producer->WaitForDataSourceStop("data_source");
+    consumer->WaitForTracingDisabled();
+
+    size_t num_reads = 0;
+    size_t num_payloads = 0;
+    auto on_read_buffers = task_runner.CreateCheckpoint(
+        "on_read_buffers_" + std::to_string(in_process));
+    EXPECT_CALL(*consumer, OnTraceData(_, _))
+        .WillRepeatedly(Invoke([&](std::vector<TracePacket>* packets,
+                                   bool has_more) {
+          num_reads++;
+          for (TracePacket& packet : *packets) {
+            protos::gen::TracePacket decoded;
+            ASSERT_TRUE(
+                decoded.ParseFromString(packet.GetRawBytesForTesting()));
+            if (!decoded.has_for_testing())
+              continue;
+            EXPECT_EQ(decoded.for_testing().str(), payload);
+            EXPECT_TRUE(decoded.has_trusted_packet_sequence_id());
+            num_payloads++;
+          }
+          if (!has_more)
+            on_read_buffers();
+        }));
+    consumer->endpoint()->ReadBuffers();
+    task_runner.RunUntilCheckpoint("on_read_buffers_" +
+                                   std::to_string(in_process));
+
+    EXPECT_EQ(num_payloads, kNumPackets);
+    if (in_process) {
+      EXPECT_EQ(num_reads, 1u);
+    } else {
+      EXPECT_GT(num_reads, 1u);
+    }
+  }
+}
+
+// When writing into a file, the data of the producers that acked a flush is
+// drained without waiting for the ones that are still flushing.
+TEST_F(TracingServiceImplTest, WriteIntoFileDrainsPartialFlush) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer1 = CreateMockProducer();
+  producer1->Connect(svc.get(), "mock_producer1");
+  producer1->RegisterDataSource("data_source1");
+
+  std::unique_ptr<MockProducer> producer2 = CreateMockProducer();
+  producer2->Connect(svc.get(), "mock_producer2");
+  producer2->RegisterDataSource("data_source2");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  trace_config.add_data_sources()->mutable_config()->set_name("data_source1");
+  trace_config.add_data_sources()->mutable_config()->set_name("data_source2");
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer1->WaitForTracingSetup();
+  producer1->WaitForDataSourceSetup("data_source1");
+  producer2->WaitForTracingSetup();
+  producer2->WaitForDataSourceSetup("data_source2");
+  producer1->WaitForDataSourceStart("data_source1");
+  producer2->WaitForDataSourceStart("data_source2");
+
+  std::unique_ptr<TraceWriter> writer1 =
+      producer1->CreateTraceWriter("data_source1");
+  {
+    auto tp = writer1->NewTracePacket();
+    tp->set_for_testing()->set_str("fast_payload");
+  }
+
+  // |producer2| never acks the flush.
+  auto flush_request = consumer->Flush(100000);
+  producer1->WaitForFlush(writer1.get());
+  producer2->WaitForFlush(std::vector<TraceWriter*>(), /*reply=*/false);
+  task_runner.RunUntilIdle();
+
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  EXPECT_THAT(trace.packet(),
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("fast_payload")))));
+
+  consumer->DisableTracing();
+  producer1->WaitForDataSourceStop("data_source1");
+  producer2->WaitForDataSourceStop("data_source2");
+  consumer->WaitForTracingDisabled();
+}
+
 TEST_F(TracingServiceImplTest, ImplicitFlushOnTimedTraces) {
   std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
   consumer->Connect(svc.get());
@@ -2997,6 +3136,81 @@ TEST_F(TracingServiceImplTest, ScrapeBuffersOnDisable) {
                   Property(&protos::gen::TestEvent::str, Eq("payload3"))))));
 }
 
+TEST_F(TracingServiceImplTest, CommitDataMovesAllCompleteChunks) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  ProducerID producer_id = *last_producer_id();
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  consumer->EnableTracing(trace_config);
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // The writer is used only to register its id with the service. The chunks
+  // are written directly in the SMB below.
+  std::unique_ptr<TraceWriter> writer = producer->endpoint()->CreateTraceWriter(
+      tracing_session()->buffers_index[0]);
+  WaitForTraceWritersChanged(producer_id);
+
+  SharedMemory* shm = producer->endpoint()->shared_memory();
+  const size_t page_size =
+      producer->endpoint()->shared_buffer_page_size_kb() * 1024;
+  SharedMemoryABI abi(reinterpret_cast<uint8_t*>(shm->start()), shm->size(),
+                      page_size);
+  auto write_complete_chunk = [&abi](size_t page_idx, WriterID writer_id,
+                                     const std::string& str) {
+    ASSERT_TRUE(abi.TryPartitionPage(page_idx, SharedMemoryABI::kPageDiv1));
+    SharedMemoryABI::ChunkHeader header{};
+    header.writer_id.store(writer_id);
+    header.chunk_id.store(0);
+    header.packets.store({1, 0});
+    SharedMemoryABI::Chunk chunk =
+        abi.TryAcquireChunkForWriting(page_idx, 0, &header);
+    ASSERT_TRUE(chunk.is_valid());
+    protos::gen::TracePacket packet;
+    packet.mutable_for_testing()->set_str(str);
+    std::string serialized = packet.SerializeAsString();
+    ASSERT_LT(serialized.size(), 128u);
+    chunk.payload_begin()[0] = static_cast<uint8_t>(serialized.size());
+    memcpy(chunk.payload_begin() + 1, serialized.data(), serialized.size());
+    abi.ReleaseChunkAsComplete(std::move(chunk));
+  };
+
+  // The chunk of the registered writer is moved even if it's not listed in
+  // the request. The one of an unknown writer is left in the SMB.
+  write_complete_chunk(0, writer->writer_id(), "payload1");
+  write_complete_chunk(1, writer->writer_id() + 1, "payload2");
+
+  CommitDataRequest req;
+  req.set_move_all_complete_chunks(true);
+  producer->endpoint()->CommitData(req);
+  EXPECT_TRUE(abi.is_page_free(0));
+  EXPECT_FALSE(abi.is_page_free(1));
+
+  auto packets = consumer->ReadBuffers();
+  EXPECT_THAT(packets, Contains(Property(&protos::gen::TracePacket::for_testing,
+                                         Property(&protos::gen::TestEvent::str,
+                                                  Eq("payload1")))));
+  EXPECT_THAT(packets,
+              Not(Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload2"))))));
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+}
+
 TEST_F(TracingServiceImplTest, AbortIfTraceDurationIsTooLong) {
   std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
   consumer->Connect(svc.get());
@@ -3047,6 +3261,75 @@ TEST_F(TracingServiceImplTest, GetTraceStats) {
   consumer->WaitForTracingDisabled();
 }
 
+TEST_F(TracingServiceImplTest, GetTraceStatsWriterAndProducerStats) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer", 123u /* uid */);
+  ProducerID producer_id = *last_producer_id();
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+
+  consumer->EnableTracing(trace_config);
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload");
+  }
+
+  auto flush_request = consumer->Flush();
+  producer->WaitForFlush(writer.get());
+  ASSERT_TRUE(flush_request.WaitForReply());
+
+  // The stalls are reported by the SharedMemoryArbiter of the producer.
+  CommitDataRequest req;
+  req.set_smb_stalls(3);
+  producer->endpoint()->CommitData(req);
+
+  TraceStats stats;
+  auto on_trace_stats = task_runner.CreateCheckpoint("on_trace_stats");
+  EXPECT_CALL(*consumer, OnTraceStats(true, _))
+      .WillOnce(Invoke([&](bool, const TraceStats& s) {
+        stats = s;
+        on_trace_stats();
+      }));
+  consumer->GetTraceStats();
+  task_runner.RunUntilCheckpoint("on_trace_stats");
+
+  ASSERT_EQ(stats.writer_stats_size(), 1);
+  const auto& writer_stats = stats.writer_stats()[0];
+  EXPECT_NE(writer_stats.sequence_id(), 0u);
+  EXPECT_EQ(writer_stats.producer_id(), producer_id);
+  EXPECT_EQ(writer_stats.buffer(), 0u);
+  EXPECT_EQ(writer_stats.chunks_written(), 1u);
+  EXPECT_GT(writer_stats.bytes_written(), 0u);
+  EXPECT_EQ(writer_stats.chunk_payload_histogram_counts_size(),
+            stats.chunk_payload_histogram_def_size() + 1);
+  EXPECT_EQ(writer_stats.chunk_payload_histogram_counts()[0], 1u);
+
+  ASSERT_EQ(stats.producer_stats_size(), 1);
+  const auto& producer_stats = stats.producer_stats()[0];
+  EXPECT_EQ(producer_stats.producer_id(), producer_id);
+  EXPECT_EQ(producer_stats.name(), "mock_producer");
+  EXPECT_EQ(producer_stats.uid(), 123);
+  EXPECT_EQ(producer_stats.bytes_written(), writer_stats.bytes_written());
+  EXPECT_EQ(producer_stats.smb_stalls(), 3u);
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+}
+
 TEST_F(TracingServiceImplTest, ObserveEventsDataSourceInstances) {
   std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
   consumer->Connect(svc.get());
@@ -3690,4 +3973,106 @@ TEST_F(TracingServiceImplTest, ProducerProvidedSMBInvalidSizes) {
   EXPECT_EQ(producer->endpoint()->shared_memory(), nullptr);
 }
 
+TEST_F(TracingServiceImplTest, CloneSession) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  trace_config.add_data_sources()->mutable_config()->set_name("data_source");
+  trace_config.set_unique_session_name("flight_recorder");
+  consumer->EnableTracing(trace_config);
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  writer->NewTracePacket()->set_for_testing()->set_str("before_clone");
+
+  // The clone is made after flushing the data sources of the session.
+  std::unique_ptr<MockConsumer> clone_consumer = CreateMockConsumer();
+  clone_consumer->Connect(svc.get());
+  auto clone_done = task_runner.CreateCheckpoint("clone_done");
+  clone_consumer->endpoint()->CloneSession(
+      "flight_recorder", [clone_done](bool success, const std::string& error) {
+        EXPECT_TRUE(success) << error;
+        clone_done();
+      });
+  producer->WaitForFlush(writer.get());
+  task_runner.RunUntilCheckpoint("clone_done");
+
+  // The original session keeps recording.
+  writer->NewTracePacket()->set_for_testing()->set_str("after_clone");
+  writer->Flush();
+
+  auto clone_packets = clone_consumer->ReadBuffers();
+  EXPECT_THAT(clone_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("before_clone")))));
+  EXPECT_THAT(clone_packets,
+              Not(Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("after_clone"))))));
+  clone_consumer->FreeBuffers();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  auto packets = consumer->ReadBuffers();
+  EXPECT_THAT(packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("before_clone")))));
+  EXPECT_THAT(packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("after_clone")))));
+}
+
+TEST_F(TracingServiceImplTest, CloneSessionErrors) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get(), /*uid=*/123);
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  trace_config.set_unique_session_name("flight_recorder");
+  consumer->EnableTracing(trace_config);
+
+  auto expect_clone_failure = [this](MockConsumer* clone_consumer,
+                                     const std::string& name) {
+    bool called = false;
+    clone_consumer->endpoint()->CloneSession(
+        name, [&called](bool success, const std::string&) {
+          EXPECT_FALSE(success);
+          called = true;
+        });
+    task_runner.RunUntilIdle();
+    EXPECT_TRUE(called);
+  };
+
+  // Sessions can be cloned only by name and by the uid which started them.
+  std::unique_ptr<MockConsumer> other_uid_consumer = CreateMockConsumer();
+  other_uid_consumer->Connect(svc.get(), /*uid=*/456);
+  expect_clone_failure(other_uid_consumer.get(), "flight_recorder");
+  expect_clone_failure(other_uid_consumer.get(), "");
+
+  std::unique_ptr<MockConsumer> same_uid_consumer = CreateMockConsumer();
+  same_uid_consumer->Connect(svc.get(), /*uid=*/123);
+  expect_clone_failure(same_uid_consumer.get(), "unknown_name");
+
+  // A consumer can't clone into its own running session.
+  expect_clone_failure(consumer.get(), "flight_recorder");
+
+  consumer->DisableTracing();
+  consumer->WaitForTracingDisabled();
+}
+
 }  // namespace perfetto
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/zlib_compressor.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include <memory>
+#include <tuple>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/proto_utils.h"
+
+namespace perfetto {
+namespace {
+
+// ID of |compressed_packets| in trace_packet.proto.
+constexpr uint32_t kCompressedPacketsId = 50;
+
+// The compressed output is written into slices of this size.
+constexpr size_t kOutputSliceSize = 64 * 1024;
+
+// Deflates a sequence of TracePacket(s), each one prepended by its proto
+// preamble, into a single |compressed_packets| TracePacket.
+class ZlibPacketCompressor {
+ public:
+  ZlibPacketCompressor();
+  ~ZlibPacketCompressor();
+
+  void PushPacket(TracePacket* packet);
+  TracePacket Finish();
+
+ private:
+  void Deflate(const void* data, size_t size, int flush);
+  void NewOutputSlice();
+
+  z_stream stream_{};
+  std::vector<Slice> out_slices_;
+  size_t compressed_size_ = 0;
+};
+
+ZlibPacketCompressor::ZlibPacketCompressor() {
+  int ret = deflateInit(&stream_, 6);
+  PERFETTO_CHECK(ret == Z_OK);
+}
+
+ZlibPacketCompressor::~ZlibPacketCompressor() {
+  deflateEnd(&stream_);
+}
+
+void ZlibPacketCompressor::PushPacket(TracePacket* packet) {
+  char* preamble;
+  size_t preamble_size;
+  std::tie(preamble, preamble_size) = packet->GetProtoPreamble();
+  Deflate(preamble, preamble_size, Z_NO_FLUSH);
+  for (const Slice& slice : packet->slices())
+    Deflate(slice.start, slice.size, Z_NO_FLUSH);
+}
+
+TracePacket ZlibPacketCompressor::Finish() {
+  Deflate(nullptr, 0, Z_FINISH);
+  if (!out_slices_.empty()) {
+    out_slices_.back().size -= stream_.avail_out;
+    compressed_size_ -= stream_.avail_out;
+  }
+
+  using protozero::proto_utils::MakeTagLengthDelimited;
+  using protozero::proto_utils::WriteVarInt;
+  uint8_t preamble[16];
+  uint8_t* ptr = WriteVarInt(MakeTagLengthDelimited(kCompressedPacketsId),
+                             &preamble[0]);
+  ptr = WriteVarInt(compressed_size_, ptr);
+  size_t preamble_size = static_cast<size_t>(ptr - &preamble[0]);
+
+  TracePacket packet;
+  Slice preamble_slice = Slice::Allocate(preamble_size);
+  memcpy(preamble_slice.own_data(), preamble, preamble_size);
+  packet.AddSlice(std::move(preamble_slice));
+  for (Slice& slice : out_slices_)
+    packet.AddSlice(std::move(slice));
+  out_slices_.clear();
+  return packet;
+}
+
+void ZlibPacketCompressor::Deflate(const void* data, size_t size, int flush) {
+  if (size == 0 && flush == Z_NO_FLUSH)
+    return;
+  // deflate() doesn't modify the input, it just takes a non-const pointer.
+  stream_.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+  stream_.avail_in = static_cast<uInt>(size);
+  for (;;) {
+    if (stream_.avail_out == 0)
+      NewOutputSlice();
+    int ret = deflate(&stream_, flush);
+    PERFETTO_CHECK(ret == Z_OK || ret == Z_STREAM_END);
+    if (flush == Z_FINISH ? ret == Z_STREAM_END : stream_.avail_in == 0)
+      break;
+  }
+}
+
+void ZlibPacketCompressor::NewOutputSlice() {
+  out_slices_.emplace_back(Slice::Allocate(kOutputSliceSize));
+  compressed_size_ += kOutputSliceSize;
+  stream_.next_out = out_slices_.back().own_data();
+  stream_.avail_out = static_cast<uInt>(kOutputSliceSize);
+}
+
+}  // namespace
+
+void ZlibCompressFn(std::vector<TracePacket>* packets) {
+  if (packets->empty())
+    return;
+
+  std::vector<TracePacket> compressed_packets;
+  std::unique_ptr<ZlibPacketCompressor> compressor;
+  size_t batch_size = 0;
+  for (TracePacket& packet : *packets) {
+    // Start a new batch rather than going over the limit, unless the packet
+    // alone is bigger than that.
+    if (compressor && batch_size + packet.size() > kMaxCompressionBatchSize) {
+      compressed_packets.emplace_back(compressor->Finish());
+      compressor.reset();
+    }
+    if (!compressor) {
+      compressor.reset(new ZlibPacketCompressor());
+      batch_size = 0;
+    }
+    compressor->PushPacket(&packet);
+    batch_size += packet.size();
+  }
+  compressed_packets.emplace_back(compressor->Finish());
+  *packets = std::move(compressed_packets);
+}
+
+}  // namespace perfetto
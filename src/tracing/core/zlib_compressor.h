@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
+#define SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
+
+#include <vector>
+
+#include "perfetto/ext/tracing/core/trace_packet.h"
+
+namespace perfetto {
+
+// Some transport mechanisms have a 512KB limit on the packet size. This is
+// deliberately conservative to leave room for the transport headers.
+constexpr size_t kMaxCompressionBatchSize = 500 * 1024;
+
+// Replaces |packets| with TracePacket(s) containing their deflate compressed
+// serialization in the |compressed_packets| field. Consecutive packets are
+// compressed together, in batches of at most ~|kMaxCompressionBatchSize|
+// uncompressed bytes to bound the size of each compressed packet.
+void ZlibCompressFn(std::vector<TracePacket>* packets);
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/zlib_compressor.h"
+
+#include <zlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perfetto/protozero/proto_decoder.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAreArray;
+using ::testing::SizeIs;
+
+constexpr uint32_t kPacketFieldId = 1;
+constexpr uint32_t kCompressedPacketsFieldId = 50;
+
+TracePacket CreatePacket(const std::string& payload) {
+  TracePacket packet;
+  // Split the payload in two slices to check they are both compressed.
+  size_t half = payload.size() / 2;
+  packet.AddSlice(payload.data(), half);
+  packet.AddSlice(payload.data() + half, payload.size() - half);
+  return packet;
+}
+
+std::string Inflate(const std::string& compressed) {
+  z_stream stream{};
+  EXPECT_EQ(inflateInit(&stream), Z_OK);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = static_cast<uInt>(compressed.size());
+  std::string out;
+  int ret;
+  do {
+    char buf[4096];
+    stream.next_out = reinterpret_cast<Bytef*>(buf);
+    stream.avail_out = sizeof(buf);
+    ret = inflate(&stream, Z_NO_FLUSH);
+    out.append(buf, sizeof(buf) - stream.avail_out);
+  } while (ret == Z_OK);
+  EXPECT_EQ(ret, Z_STREAM_END);
+  inflateEnd(&stream);
+  return out;
+}
+
+// Returns the payloads of the packets contained in each of the compressed
+// |packets|.
+std::vector<std::vector<std::string>> Decompress(
+    std::vector<TracePacket>* packets) {
+  std::vector<std::vector<std::string>> batches;
+  for (TracePacket& packet : *packets) {
+    std::string raw = packet.GetRawBytesForTesting();
+    protozero::ProtoDecoder decoder(raw.data(), raw.size());
+    protozero::Field field = decoder.ReadField();
+    EXPECT_EQ(field.id(), kCompressedPacketsFieldId);
+    EXPECT_FALSE(decoder.ReadField().valid());
+
+    std::string inflated = Inflate(field.as_std_string());
+    protozero::ProtoDecoder inner(inflated.data(), inflated.size());
+    batches.emplace_back();
+    for (auto f = inner.ReadField(); f.valid(); f = inner.ReadField()) {
+      EXPECT_EQ(f.id(), kPacketFieldId);
+      batches.back().push_back(f.as_std_string());
+    }
+    EXPECT_EQ(inner.bytes_left(), 0u);
+  }
+  return batches;
+}
+
+TEST(ZlibCompressorTest, Empty) {
+  std::vector<TracePacket> packets;
+  ZlibCompressFn(&packets);
+  EXPECT_TRUE(packets.empty());
+}
+
+TEST(ZlibCompressorTest, SingleBatch) {
+  std::vector<std::string> payloads = {"foo", std::string(10000, 'x'),
+                                       std::string(), "bar"};
+  std::vector<TracePacket> packets;
+  size_t uncompressed_size = 0;
+  for (const std::string& payload : payloads) {
+    packets.emplace_back(CreatePacket(payload));
+    uncompressed_size += payload.size();
+  }
+
+  ZlibCompressFn(&packets);
+
+  ASSERT_THAT(packets, SizeIs(1));
+  EXPECT_LT(packets[0].size(), uncompressed_size);
+  auto batches = Decompress(&packets);
+  ASSERT_THAT(batches, SizeIs(1));
+  EXPECT_THAT(batches[0], ElementsAreArray(payloads));
+}
+
+TEST(ZlibCompressorTest, MultipleBatches) {
+  // Random payloads don't compress, so the output spans several slices.
+  std::minstd_rand0 rnd(42);
+  std::vector<std::string> payloads;
+  for (size_t i = 0; i < 10; i++) {
+    std::string payload(kMaxCompressionBatchSize / 4, '\0');
+    for (char& c : payload)
+      c = static_cast<char>(rnd());
+    payloads.push_back(std::move(payload));
+  }
+  // A packet bigger than the limit gets a batch of its own.
+  payloads.emplace_back(kMaxCompressionBatchSize * 2, 'x');
+  payloads.emplace_back("last");
+
+  std::vector<TracePacket> packets;
+  for (const std::string& payload : payloads)
+    packets.emplace_back(CreatePacket(payload));
+
+  ZlibCompressFn(&packets);
+
+  auto batches = Decompress(&packets);
+  ASSERT_THAT(batches, SizeIs(5));
+  std::vector<std::string> all;
+  for (const auto& batch : batches) {
+    EXPECT_LE(batch.size(), 4u);
+    all.insert(all.end(), batch.begin(), batch.end());
+  }
+  EXPECT_THAT(all, ElementsAreArray(payloads));
+  EXPECT_THAT(batches[3], SizeIs(1));
+  EXPECT_EQ(batches[3][0].size(), kMaxCompressionBatchSize * 2);
+}
+
+}  // namespace
+}  // namespace perfetto
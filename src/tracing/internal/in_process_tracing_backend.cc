@@ -101,7 +101,7 @@ std::unique_ptr<ProducerEndpoint> InProcessTracingBackend::ConnectProducer(
 std::unique_ptr<ConsumerEndpoint> InProcessTracingBackend::ConnectConsumer(
     const ConnectConsumerArgs& args) {
   return GetOrCreateService(args.task_runner)
-      ->ConnectConsumer(args.consumer, /*uid=*/0);
+      ->ConnectConsumer(args.consumer, /*uid=*/0, /*in_process=*/true);
 }
 
 TracingService* InProcessTracingBackend::GetOrCreateService(
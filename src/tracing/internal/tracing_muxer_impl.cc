@@ -16,6 +16,8 @@
 
 #include "src/tracing/internal/tracing_muxer_impl.h"
 
+#include <stdlib.h>
+
 #include <algorithm>
 #include <atomic>
 #include <mutex>
@@ -24,6 +26,7 @@
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/thread_checker.h"
 #include "perfetto/ext/base/waitable_event.h"
@@ -793,6 +796,16 @@ bool TracingMuxerImpl::RegisterDataSource(
     rds.static_state = static_state;
     UpdateDataSourcesOnAllBackends();
   });
+
+  // With startup tracing, wait until the data source has been registered. For
+  // the in-process service this means that it has also been set up and
+  // started, as the service posts those calls to this same task runner before
+  // the task below runs.
+  if (startup_tracing_ && !task_runner_->RunsTasksOnCurrentThread()) {
+    base::WaitableEvent registered;
+    task_runner_->PostTask([&registered] { registered.Notify(); });
+    registered.Wait();
+  }
   return true;
 }
 
@@ -1615,7 +1628,39 @@ std::unique_ptr<TracingSession> TracingMuxerImpl::CreateTracingSession(
 void TracingMuxerImpl::InitializeInstance(const TracingInitArgs& args) {
   if (instance_ != TracingMuxerFake::Get())
     PERFETTO_FATAL("Tracing already initialized");
-  new TracingMuxerImpl(args);
+  auto* muxer = new TracingMuxerImpl(args);
+  if (args.enable_startup_tracing)
+    muxer->StartStartupTracingBlocking(args);
+}
+
+// Called on the thread that calls Tracing::Initialize(), after the muxer
+// initialization has been posted.
+void TracingMuxerImpl::StartStartupTracingBlocking(
+    const TracingInitArgs& args) {
+  const char* config_path = getenv("PERFETTO_STARTUP_TRACE_CONFIG");
+  if (!config_path || !*config_path)
+    return;
+  if (!(args.backends & kInProcessBackend)) {
+    PERFETTO_ELOG("Startup tracing requires the in-process backend");
+    return;
+  }
+  std::string config_bytes;
+  TraceConfig config;
+  if (!base::ReadFile(config_path, &config_bytes) ||
+      !config.ParseFromString(config_bytes)) {
+    PERFETTO_ELOG("Failed to read the startup trace config from %s",
+                  config_path);
+    return;
+  }
+  if (!config.write_into_file() || config.output_path().empty()) {
+    PERFETTO_ELOG(
+        "The startup trace config must set write_into_file and output_path");
+    return;
+  }
+  startup_session_ = CreateTracingSession(kInProcessBackend);
+  startup_session_->Setup(config);
+  startup_session_->StartBlocking();
+  startup_tracing_ = true;
 }
 
 TracingMuxer::~TracingMuxer() = default;
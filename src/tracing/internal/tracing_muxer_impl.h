@@ -379,6 +379,7 @@ class TracingMuxerImpl : public TracingMuxer {
 
   explicit TracingMuxerImpl(const TracingInitArgs&);
   void Initialize(const TracingInitArgs& args);
+  void StartStartupTracingBlocking(const TracingInitArgs& args);
   ConsumerImpl* FindConsumer(TracingSessionGlobalID session_id);
   void InitializeConsumer(TracingSessionGlobalID session_id);
   void OnConsumerDisconnected(ConsumerImpl* consumer);
@@ -404,6 +405,11 @@ class TracingMuxerImpl : public TracingMuxer {
 
   std::atomic<TracingSessionGlobalID> next_tracing_session_id_{};
 
+  // The session started by StartStartupTracingBlocking(), if any. It's never
+  // destroyed, the service stops it after the config's |duration_ms|.
+  std::unique_ptr<TracingSession> startup_session_;
+  std::atomic<bool> startup_tracing_{false};
+
   // Maximum number of times we will try to reconnect producer backend.
   // Should only be modified for testing purposes.
   std::atomic<uint32_t> max_producer_reconnections_{100u};
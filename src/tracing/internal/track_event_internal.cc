@@ -16,9 +16,14 @@
 
 #include "perfetto/tracing/internal/track_event_internal.h"
 
+#include <mutex>
+
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/proc_utils.h"
 #include "perfetto/base/thread_utils.h"
 #include "perfetto/base/time.h"
+#include "perfetto/protozero/contiguous_memory_range.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/internal/track_event_interned_fields.h"
 #include "perfetto/tracing/track_event.h"
@@ -26,11 +31,16 @@
 #include "perfetto/tracing/track_event_interned_data_index.h"
 #include "protos/perfetto/common/data_source_descriptor.gen.h"
 #include "protos/perfetto/common/track_event_descriptor.pbzero.h"
+#include "protos/perfetto/trace/clock_snapshot.pbzero.h"
 #include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
 #include "protos/perfetto/trace/trace_packet_defaults.pbzero.h"
 #include "protos/perfetto/trace/track_event/debug_annotation.pbzero.h"
 #include "protos/perfetto/trace/track_event/track_descriptor.pbzero.h"
 
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
 namespace perfetto {
 
 TrackEventSessionObserver::~TrackEventSessionObserver() = default;
@@ -49,6 +59,89 @@ static constexpr const char kLegacySlowPrefix[] = "disabled-by-default-";
 static constexpr const char kSlowTag[] = "slow";
 static constexpr const char kDebugTag[] = "debug";
 
+// How often each sequence relates the cycle counter clock to the trace clock.
+constexpr uint64_t kCycleCounterSnapshotPeriodNs = 100 * 1000 * 1000;
+
+// Number of tracing sessions which enabled the cycle counter clock.
+std::atomic<int> g_cycle_counter_sessions{};
+
+#if (PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+     PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)) && \
+    (defined(__x86_64__) || defined(__aarch64__)) && defined(__SIZEOF_INT128__)
+#define PERFETTO_TRACK_EVENT_HAS_CYCLE_COUNTER 1
+
+// The calibration of the cycle counter: a reference point and the rate, as
+// nanoseconds per cycle in 32.32 fixed point.
+std::atomic<uint64_t> g_cycle_counter_base_cycles{};
+std::atomic<uint64_t> g_cycle_counter_base_ns{};
+std::atomic<uint64_t> g_cycle_counter_ns_per_cycle_q32{};
+
+inline uint64_t ReadCycleCounter() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  uint64_t cycles;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(cycles));
+  return cycles;
+#endif
+}
+
+// Samples the trace clock and the cycle counter at (about) the same time.
+void SampleCycleCounter(uint64_t* ns, uint64_t* cycles) {
+  uint64_t before = ReadCycleCounter();
+  *ns = TrackEventInternal::GetTimeNs();
+  uint64_t after = ReadCycleCounter();
+  *cycles = before + (after - before) / 2;
+}
+
+// Measures the rate of the cycle counter against the trace clock. This is
+// only done once per process: the invariant TSC (and the generic timer on
+// arm64) tick at a constant rate, and the periodic clock snapshots absorb the
+// residual drift.
+void CalibrateCycleCounter() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    uint64_t start_ns, start_cycles, end_ns, end_cycles;
+    SampleCycleCounter(&start_ns, &start_cycles);
+    base::SleepMicroseconds(5000);
+    SampleCycleCounter(&end_ns, &end_cycles);
+    if (end_cycles <= start_cycles || end_ns <= start_ns)
+      return;
+    unsigned __int128 ns_per_cycle_q32 =
+        (static_cast<unsigned __int128>(end_ns - start_ns) << 32) /
+        (end_cycles - start_cycles);
+    g_cycle_counter_base_cycles.store(start_cycles, std::memory_order_relaxed);
+    g_cycle_counter_base_ns.store(start_ns, std::memory_order_relaxed);
+    g_cycle_counter_ns_per_cycle_q32.store(
+        static_cast<uint64_t>(ns_per_cycle_q32), std::memory_order_release);
+  });
+}
+
+// Returns the cycle counter converted to nanoseconds on (approximately) the
+// trace clock, or 0 if the counter hasn't been calibrated.
+uint64_t CycleCounterNs() {
+  uint64_t ns_per_cycle_q32 =
+      g_cycle_counter_ns_per_cycle_q32.load(std::memory_order_acquire);
+  if (PERFETTO_UNLIKELY(!ns_per_cycle_q32))
+    return 0;
+  uint64_t cycles = ReadCycleCounter() -
+                    g_cycle_counter_base_cycles.load(std::memory_order_relaxed);
+  return g_cycle_counter_base_ns.load(std::memory_order_relaxed) +
+         static_cast<uint64_t>(
+             (static_cast<unsigned __int128>(cycles) * ns_per_cycle_q32) >>
+             32);
+}
+
+#else  // !PERFETTO_TRACK_EVENT_HAS_CYCLE_COUNTER
+
+void CalibrateCycleCounter() {}
+
+uint64_t CycleCounterNs() {
+  return 0;
+}
+
+#endif  // !PERFETTO_TRACK_EVENT_HAS_CYCLE_COUNTER
+
 void ForEachObserver(
     std::function<bool(TrackEventSessionObserver*&)> callback) {
   // Session observers, shared by all track event data source instances.
@@ -166,6 +259,10 @@ void TrackEventInternal::EnableTracing(
     if (IsCategoryEnabled(registry, config, *registry.GetCategory(i)))
       registry.EnableCategoryForInstance(i, args.internal_instance_index);
   }
+  if (config.use_cycle_counter_clock()) {
+    CalibrateCycleCounter();
+    g_cycle_counter_sessions.fetch_add(1);
+  }
   ForEachObserver([&](TrackEventSessionObserver*& o) {
     if (o)
       o->OnSetup(args);
@@ -186,12 +283,15 @@ void TrackEventInternal::OnStart(const DataSourceBase::StartArgs& args) {
 // static
 void TrackEventInternal::DisableTracing(
     const TrackEventCategoryRegistry& registry,
+    const protos::gen::TrackEventConfig& config,
     const DataSourceBase::StopArgs& args) {
   ForEachObserver([&](TrackEventSessionObserver*& o) {
     if (o)
       o->OnStop(args);
     return true;
   });
+  if (config.use_cycle_counter_clock())
+    g_cycle_counter_sessions.fetch_sub(1);
   for (size_t i = 0; i < registry.category_count(); i++)
     registry.DisableCategoryForInstance(i, args.internal_instance_index);
 }
@@ -302,14 +402,71 @@ uint64_t TrackEventInternal::GetTimeNs() {
   return static_cast<uint64_t>(perfetto::base::GetWallTimeNs().count());
 }
 
+// static
+TraceTimestamp TrackEventInternal::GetTraceTime() {
+  if (PERFETTO_UNLIKELY(g_cycle_counter_sessions.load(
+          std::memory_order_relaxed))) {
+    uint64_t ns = CycleCounterNs();
+    if (PERFETTO_LIKELY(ns)) {
+      return {static_cast<protos::pbzero::BuiltinClock>(kClockIdCycleCounter),
+              ns};
+    }
+  }
+  return {GetClockId(), GetTimeNs()};
+}
+
 // static
 int TrackEventInternal::GetSessionCount() {
   return session_count_.load();
 }
 
 // static
-void TrackEventInternal::ResetIncrementalState(TraceWriterBase* trace_writer,
-                                               uint64_t timestamp) {
+size_t TrackEventInternal::GetGlobalInternedId(const void* value) {
+  // An insert-only open addressing hash table, so lookups don't need a lock.
+  // Ids are handed out in insertion order rather than by slot, so that the most
+  // common values (which are usually seen first) get the shortest varints.
+  static constexpr size_t kMaxProbes = 16;
+  static std::atomic<const void*> keys[kMaxGlobalInternedIds];
+  static std::atomic<uint32_t> ids[kMaxGlobalInternedIds];
+  static std::atomic<uint32_t> next_id{1};
+  static_assert((kMaxGlobalInternedIds & (kMaxGlobalInternedIds - 1)) == 0,
+                "kMaxGlobalInternedIds must be a power of two");
+
+  // The low bits of pointers are mostly zero because of alignment.
+  uint64_t hash = reinterpret_cast<uintptr_t>(value) * 0x9E3779B97F4A7C15ull;
+  size_t slot = static_cast<size_t>(hash >> 32) & (kMaxGlobalInternedIds - 1);
+  for (size_t i = 0; i < kMaxProbes; i++) {
+    const void* key = keys[slot].load(std::memory_order_acquire);
+    if (!key) {
+      if (keys[slot].compare_exchange_strong(key, value,
+                                               std::memory_order_acq_rel)) {
+        // Every slot is claimed at most once, so ids can't exceed the table
+        // size.
+        uint32_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+        ids[slot].store(id, std::memory_order_release);
+        return id;
+      }
+      // Another thread claimed the slot, possibly for the same value.
+    }
+    if (key == value) {
+      // If the thread which claimed the slot hasn't published its id yet,
+      // this returns 0 and the caller uses a per-sequence id instead.
+      return ids[slot].load(std::memory_order_acquire);
+    }
+    slot = (slot + 1) & (kMaxGlobalInternedIds - 1);
+  }
+  return 0;
+}
+
+// static
+void TrackEventInternal::ResetIncrementalState(
+    TraceWriterBase* trace_writer,
+    TrackEventIncrementalState* incr_state,
+    const TraceTimestamp& timestamp) {
+  // The cycle counter clock needs to be related to the trace clock on this
+  // sequence before it can be used (even by the packet below).
+  WriteCycleCounterSnapshotIfNeeded(trace_writer, incr_state, timestamp);
+
   auto default_track = ThreadTrack::Current();
   {
     // Mark any incremental state before this point invalid. Also set up
@@ -318,11 +475,30 @@ void TrackEventInternal::ResetIncrementalState(TraceWriterBase* trace_writer,
         trace_writer, timestamp,
         protos::pbzero::TracePacket::SEQ_INCREMENTAL_STATE_CLEARED);
     auto defaults = packet->set_trace_packet_defaults();
-    defaults->set_timestamp_clock_id(GetClockId());
+    defaults->set_timestamp_clock_id(incr_state->use_incremental_timestamps
+                                         ? kClockIdIncremental
+                                         : static_cast<uint32_t>(GetClockId()));
 
     // Establish the default track for this event sequence.
     auto track_defaults = defaults->set_track_event_defaults();
     track_defaults->set_track_uuid(default_track.uuid);
+
+    // Start the incremental clock of the sequence at |timestamp|. Each event
+    // then only stores the (usually few bytes long) delta from the previous
+    // one, rather than a full 64-bit timestamp.
+    if (incr_state->use_incremental_timestamps) {
+      auto clock_snapshot = packet->set_clock_snapshot();
+      auto base_clock = clock_snapshot->add_clocks();
+      base_clock->set_clock_id(timestamp.clock_id);
+      base_clock->set_timestamp(timestamp.nanoseconds);
+      auto incremental_clock = clock_snapshot->add_clocks();
+      incremental_clock->set_clock_id(kClockIdIncremental);
+      incremental_clock->set_timestamp(timestamp.nanoseconds);
+      incremental_clock->set_is_incremental(true);
+      incr_state->incremental_clock_base_id =
+          static_cast<uint32_t>(timestamp.clock_id);
+      incr_state->last_timestamp_ns = timestamp.nanoseconds;
+    }
   }
 
   // Every thread should write a descriptor for its default track, because most
@@ -337,18 +513,82 @@ void TrackEventInternal::ResetIncrementalState(TraceWriterBase* trace_writer,
 // static
 protozero::MessageHandle<protos::pbzero::TracePacket>
 TrackEventInternal::NewTracePacket(TraceWriterBase* trace_writer,
-                                   uint64_t timestamp,
+                                   const TraceTimestamp& timestamp,
                                    uint32_t seq_flags) {
   auto packet = trace_writer->NewTracePacket();
-  packet->set_timestamp(timestamp);
-  // TODO(skyostil): Stop emitting this for every event once the trace
-  // processor understands trace packet defaults.
-  if (GetClockId() != protos::pbzero::BUILTIN_CLOCK_BOOTTIME)
-    packet->set_timestamp_clock_id(GetClockId());
+  packet->set_timestamp(timestamp.nanoseconds);
+  // Packets other than events always state their clock, because the default
+  // clock of the sequence might be the incremental one.
+  packet->set_timestamp_clock_id(timestamp.clock_id);
   packet->set_sequence_flags(seq_flags);
   return packet;
 }
 
+// static
+protozero::MessageHandle<protos::pbzero::TracePacket>
+TrackEventInternal::NewEventPacket(TraceWriterBase* trace_writer,
+                                   TrackEventIncrementalState* incr_state,
+                                   const TraceTimestamp& timestamp) {
+  auto packet = trace_writer->NewTracePacket();
+  if (incr_state->use_incremental_timestamps &&
+      static_cast<uint32_t>(timestamp.clock_id) ==
+          incr_state->incremental_clock_base_id &&
+      timestamp.nanoseconds >= incr_state->last_timestamp_ns) {
+    // The timestamp is implicitly on the incremental clock (see
+    // ResetIncrementalState()).
+    packet->set_timestamp(timestamp.nanoseconds -
+                          incr_state->last_timestamp_ns);
+    incr_state->last_timestamp_ns = timestamp.nanoseconds;
+  } else {
+    // Events with an explicit timestamp can go back in time or be on another
+    // clock, in which case they can't be written as a delta.
+    packet->set_timestamp(timestamp.nanoseconds);
+    // TODO(skyostil): Stop emitting this for every event once the trace
+    // processor understands trace packet defaults.
+    if (incr_state->use_incremental_timestamps ||
+        timestamp.clock_id != protos::pbzero::BUILTIN_CLOCK_BOOTTIME) {
+      packet->set_timestamp_clock_id(timestamp.clock_id);
+    }
+  }
+  packet->set_sequence_flags(
+      protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
+  return packet;
+}
+
+// static
+void TrackEventInternal::WriteCycleCounterSnapshotIfNeeded(
+    TraceWriterBase* trace_writer,
+    TrackEventIncrementalState* incr_state,
+    const TraceTimestamp& timestamp) {
+  if (PERFETTO_LIKELY(static_cast<uint32_t>(timestamp.clock_id) !=
+                      kClockIdCycleCounter)) {
+    return;
+  }
+  if (PERFETTO_LIKELY(incr_state->last_cycle_counter_snapshot_ns &&
+                      timestamp.nanoseconds -
+                              incr_state->last_cycle_counter_snapshot_ns <
+                          kCycleCounterSnapshotPeriodNs)) {
+    return;
+  }
+
+  // The calibrated rate of the cycle counter drifts from the trace clock over
+  // time, so the trace processor converts each timestamp relative to the most
+  // recent of these snapshots.
+  uint64_t trace_clock_ns = GetTimeNs();
+  uint64_t cycle_counter_ns = CycleCounterNs();
+  auto packet =
+      NewTracePacket(trace_writer, {GetClockId(), trace_clock_ns},
+                     /*seq_flags=*/0);
+  auto clock_snapshot = packet->set_clock_snapshot();
+  auto trace_clock = clock_snapshot->add_clocks();
+  trace_clock->set_clock_id(GetClockId());
+  trace_clock->set_timestamp(trace_clock_ns);
+  auto cycle_counter_clock = clock_snapshot->add_clocks();
+  cycle_counter_clock->set_clock_id(kClockIdCycleCounter);
+  cycle_counter_clock->set_timestamp(cycle_counter_ns);
+  incr_state->last_cycle_counter_snapshot_ns = cycle_counter_ns;
+}
+
 // static
 EventContext TrackEventInternal::WriteEvent(
     TraceWriterBase* trace_writer,
@@ -356,11 +596,12 @@ EventContext TrackEventInternal::WriteEvent(
     const Category* category,
     const char* name,
     perfetto::protos::pbzero::TrackEvent::Type type,
-    uint64_t timestamp) {
+    const TraceTimestamp& timestamp) {
   PERFETTO_DCHECK(g_main_thread);
   PERFETTO_DCHECK(!incr_state->was_cleared);
 
-  auto packet = NewTracePacket(trace_writer, timestamp);
+  WriteCycleCounterSnapshotIfNeeded(trace_writer, incr_state, timestamp);
+  auto packet = NewEventPacket(trace_writer, incr_state, timestamp);
   EventContext ctx(std::move(packet), incr_state);
 
   auto track_event = ctx.event();
@@ -396,5 +637,89 @@ protos::pbzero::DebugAnnotation* TrackEventInternal::AddDebugAnnotation(
   return annotation;
 }
 
+namespace {
+
+// Writes the name field of a DebugAnnotation and the tag of its value field
+// into |ptr|. They take at most |kMaxDebugAnnotationHeaderSize| bytes.
+constexpr size_t kMaxDebugAnnotationHeaderSize =
+    protozero::proto_utils::kMaxSimpleFieldEncodedSize +
+    protozero::proto_utils::kMaxTagEncodedSize;
+
+uint8_t* WriteDebugAnnotationHeader(uint64_t name_iid,
+                                    uint32_t value_tag,
+                                    uint8_t* ptr) {
+  using protozero::proto_utils::MakeTagVarInt;
+  using protozero::proto_utils::WriteVarInt;
+  ptr = WriteVarInt(
+      MakeTagVarInt(protos::pbzero::DebugAnnotation::kNameIidFieldNumber),
+      ptr);
+  ptr = WriteVarInt(name_iid, ptr);
+  return WriteVarInt(value_tag, ptr);
+}
+
+}  // namespace
+
+// static
+void TrackEventInternal::AddVarIntDebugAnnotation(
+    perfetto::EventContext* event_ctx,
+    const char* name,
+    uint32_t field_id,
+    uint64_t value) {
+  uint64_t name_iid = InternedDebugAnnotationName::Get(event_ctx, name);
+  // The name and the value fields.
+  uint8_t buffer[2 * protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+  uint8_t* ptr = WriteDebugAnnotationHeader(
+      name_iid, protozero::proto_utils::MakeTagVarInt(field_id), buffer);
+  ptr = protozero::proto_utils::WriteVarInt(value, ptr);
+  event_ctx->event()->AppendBytes(
+      protos::pbzero::TrackEvent::kDebugAnnotationsFieldNumber, buffer,
+      static_cast<size_t>(ptr - buffer));
+}
+
+// static
+void TrackEventInternal::AddDoubleDebugAnnotation(
+    perfetto::EventContext* event_ctx,
+    const char* name,
+    double value) {
+  uint64_t name_iid = InternedDebugAnnotationName::Get(event_ctx, name);
+  uint8_t buffer[kMaxDebugAnnotationHeaderSize + sizeof(double)];
+  uint8_t* ptr = WriteDebugAnnotationHeader(
+      name_iid,
+      protozero::proto_utils::MakeTagFixed<double>(
+          protos::pbzero::DebugAnnotation::kDoubleValueFieldNumber),
+      buffer);
+  memcpy(ptr, &value, sizeof(double));
+  ptr += sizeof(double);
+  event_ctx->event()->AppendBytes(
+      protos::pbzero::TrackEvent::kDebugAnnotationsFieldNumber, buffer,
+      static_cast<size_t>(ptr - buffer));
+}
+
+// static
+void TrackEventInternal::AddStringDebugAnnotation(
+    perfetto::EventContext* event_ctx,
+    const char* name,
+    const char* value,
+    size_t size) {
+  uint64_t name_iid = InternedDebugAnnotationName::Get(event_ctx, name);
+  // The name field, the tag of the value field and the size of the string.
+  uint8_t header[2 * protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+  uint8_t* ptr = WriteDebugAnnotationHeader(
+      name_iid,
+      protozero::proto_utils::MakeTagLengthDelimited(
+          protos::pbzero::DebugAnnotation::kStringValueFieldNumber),
+      header);
+  ptr = protozero::proto_utils::WriteVarInt(size, ptr);
+
+  // The string is copied straight from |value|, after the header.
+  protozero::ContiguousMemoryRange ranges[2];
+  ranges[0] = {header, ptr};
+  uint8_t* string_begin =
+      const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(value));
+  ranges[1] = {string_begin, string_begin + size};
+  event_ctx->event()->AppendScatteredBytes(
+      protos::pbzero::TrackEvent::kDebugAnnotationsFieldNumber, ranges, 2);
+}
+
 }  // namespace internal
 }  // namespace perfetto
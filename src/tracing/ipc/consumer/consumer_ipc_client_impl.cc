@@ -19,6 +19,7 @@
 #include <inttypes.h>
 #include <string.h>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/ipc/client.h"
 #include "perfetto/ext/tracing/core/consumer.h"
@@ -27,12 +28,24 @@
 #include "perfetto/tracing/core/trace_config.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+#include "src/tracing/ipc/posix_shared_memory.h"
+#endif
+
 // TODO(fmayer): Add a test to check to what happens when ConsumerIPCClientImpl
 // gets destroyed w.r.t. the Consumer pointer. Also think to lifetime of the
 // Consumer* during the callbacks.
 
 namespace perfetto {
 
+namespace {
+// Size of the shared memory ring used for the replies of ReadBuffers(),
+// including its header.
+constexpr size_t kReadBuffersShmemSize = 1024 * 1024;
+}  // namespace
+
 // static. (Declared in include/tracing/ipc/consumer_ipc_client.h).
 std::unique_ptr<TracingService::ConsumerEndpoint> ConsumerIPCClient::Connect(
     const char* service_sock_name,
@@ -165,8 +178,25 @@ void ConsumerIPCClientImpl::ReadBuffers() {
       [this](ipc::AsyncResult<protos::gen::ReadBuffersResponse> response) {
         OnReadBuffersResponse(std::move(response));
       });
-  consumer_port_.ReadBuffers(protos::gen::ReadBuffersRequest(),
-                             std::move(async_response));
+
+  protos::gen::ReadBuffersRequest req;
+  int shmem_fd = -1;
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+  // The service keeps using the ring provided with the first request. If it
+  // doesn't support it, it ignores the ring and sends the data inline.
+  if (!read_buffers_shmem_) {
+    std::unique_ptr<PosixSharedMemory> shmem =
+        PosixSharedMemory::Create(kReadBuffersShmemSize);
+    shmem_fd = shmem->fd();
+    read_buffers_ring_.reset(new ReadBuffersRing(shmem->start(),
+                                                 shmem->size()));
+    read_buffers_shmem_ = std::move(shmem);
+    req.set_shmem_ring_provided(true);
+  }
+#endif
+  consumer_port_.ReadBuffers(req, std::move(async_response), shmem_fd);
 }
 
 void ConsumerIPCClientImpl::OnReadBuffersResponse(
@@ -177,10 +207,27 @@ void ConsumerIPCClientImpl::OnReadBuffersResponse(
   }
   std::vector<TracePacket> trace_packets;
   for (auto& resp_slice : response->slices()) {
-    const std::string& slice_data = resp_slice.data();
-    Slice slice = Slice::Allocate(slice_data.size());
-    memcpy(slice.own_data(), slice_data.data(), slice.size);
-    partial_packet_.AddSlice(std::move(slice));
+    if (resp_slice.has_shmem_size()) {
+      const uint8_t* data =
+          read_buffers_ring_ ? read_buffers_ring_->GetData(
+                                   resp_slice.shmem_offset(),
+                                   resp_slice.shmem_size())
+                             : nullptr;
+      if (data) {
+        Slice slice = Slice::Allocate(resp_slice.shmem_size());
+        memcpy(slice.own_data(), data, slice.size);
+        read_buffers_ring_->MarkReadUpTo(resp_slice.shmem_offset() +
+                                         resp_slice.shmem_size());
+        partial_packet_.AddSlice(std::move(slice));
+      } else {
+        PERFETTO_DLOG("Invalid ReadBuffers() slice in the shared memory ring");
+      }
+    } else {
+      const std::string& slice_data = resp_slice.data();
+      Slice slice = Slice::Allocate(slice_data.size());
+      memcpy(slice.own_data(), slice_data.data(), slice.size);
+      partial_packet_.AddSlice(std::move(slice));
+    }
     if (resp_slice.last_slice_for_packet())
       trace_packets.emplace_back(std::move(partial_packet_));
   }
@@ -458,4 +505,28 @@ void ConsumerIPCClientImpl::SaveTraceForBugreport(
   consumer_port_.SaveTraceForBugreport(req, std::move(async_response));
 }
 
+void ConsumerIPCClientImpl::CloneSession(
+    const std::string& unique_session_name,
+    CloneSessionCallback callback) {
+  if (!connected_) {
+    PERFETTO_DLOG("Cannot CloneSession(), not connected to tracing service");
+    return;
+  }
+
+  protos::gen::CloneSessionRequest req;
+  req.set_unique_session_name(unique_session_name);
+  ipc::Deferred<protos::gen::CloneSessionResponse> async_response;
+  async_response.Bind(
+      [callback](ipc::AsyncResult<protos::gen::CloneSessionResponse> response) {
+        if (!response) {
+          // If the IPC fails, we are talking to an older version of the service
+          // that didn't support CloneSession at all.
+          callback(false, "The tracing service doesn't support CloneSession()");
+        } else {
+          callback(response->success(), response->error());
+        }
+      });
+  consumer_port_.CloneSession(req, std::move(async_response));
+}
+
 }  // namespace perfetto
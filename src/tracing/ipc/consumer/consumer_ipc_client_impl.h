@@ -26,12 +26,14 @@
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/ipc/service_proxy.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
+#include "perfetto/ext/tracing/core/shared_memory.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/tracing_service.h"
 #include "perfetto/ext/tracing/ipc/consumer_ipc_client.h"
 #include "perfetto/tracing/core/forward_decls.h"
 
 #include "protos/perfetto/ipc/consumer_port.ipc.h"
+#include "src/tracing/ipc/read_buffers_ring.h"
 
 namespace perfetto {
 
@@ -74,6 +76,8 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
   void QueryServiceState(QueryServiceStateCallback) override;
   void QueryCapabilities(QueryCapabilitiesCallback) override;
   void SaveTraceForBugreport(SaveTraceForBugreportCallback) override;
+  void CloneSession(const std::string& unique_session_name,
+                    CloneSessionCallback) override;
 
   // ipc::ServiceProxy::EventListener implementation.
   // These methods are invoked by the IPC layer, which knows nothing about
@@ -121,6 +125,12 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
   // one with |last_slice_for_packet| == true is received.
   TracePacket partial_packet_;
 
+  // The shared memory ring through which the service hands over the trace
+  // data of ReadBuffers(). Created on the first ReadBuffers() call on the
+  // platforms that support it.
+  std::unique_ptr<SharedMemory> read_buffers_shmem_;
+  std::unique_ptr<ReadBuffersRing> read_buffers_ring_;
+
   // Keep last.
   base::WeakPtrFactory<ConsumerIPCClientImpl> weak_ptr_factory_;
 };
@@ -19,8 +19,10 @@
 #include <inttypes.h>
 #include <string.h>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/version.h"
 #include "perfetto/ext/ipc/client.h"
 #include "perfetto/ext/tracing/core/commit_data_request.h"
@@ -134,7 +136,8 @@ void ProducerIPCClientImpl::OnConnect() {
         OnConnectionInitialized(
             resp.success(),
             resp.success() ? resp->using_shmem_provided_by_producer() : false,
-            resp.success() ? resp->direct_smb_patching_supported() : false);
+            resp.success() ? resp->direct_smb_patching_supported() : false,
+            resp.success() ? resp->using_commit_doorbell() : false);
       });
   protos::gen::InitializeConnectionRequest req;
   req.set_producer_name(name_);
@@ -171,6 +174,11 @@ void ProducerIPCClientImpl::OnConnect() {
       protos::gen::InitializeConnectionRequest::BUILD_FLAGS_DCHECKS_OFF);
 #endif
   req.set_sdk_version(base::GetVersionString());
+  // The service sends back an eventfd, which is available only on Linux.
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  req.set_commit_doorbell_requested(true);
+#endif
   producer_port_.InitializeConnection(req, std::move(on_init), shm_fd);
 
   // Create the back channel to receive commands from the Service.
@@ -195,13 +203,15 @@ void ProducerIPCClientImpl::OnDisconnect() {
   PERFETTO_DLOG("Tracing service connection failure");
   connected_ = false;
   data_sources_setup_.clear();
+  commit_doorbell_.reset();
   producer_->OnDisconnect();  // Note: may delete |this|.
 }
 
 void ProducerIPCClientImpl::OnConnectionInitialized(
     bool connection_succeeded,
     bool using_shmem_provided_by_producer,
-    bool direct_smb_patching_supported) {
+    bool direct_smb_patching_supported,
+    bool using_commit_doorbell) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   // If connection_succeeded == false, the OnDisconnect() call will follow next
   // and there we'll notify the |producer_|. TODO: add a test for this.
@@ -209,6 +219,11 @@ void ProducerIPCClientImpl::OnConnectionInitialized(
     return;
   is_shmem_provided_by_producer_ = using_shmem_provided_by_producer;
   direct_smb_patching_supported_ = direct_smb_patching_supported;
+  if (using_commit_doorbell) {
+    commit_doorbell_ = ipc_channel_->TakeReceivedFD();
+    if (!commit_doorbell_)
+      PERFETTO_DLOG("The service didn't provide the commit doorbell FD");
+  }
   producer_->OnConnect();
 
   // Bail out if the service failed to adopt our producer-allocated SMB.
@@ -388,7 +403,33 @@ void ProducerIPCClientImpl::CommitData(const CommitDataRequest& req,
           callback();
         });
   }
-  producer_port_.CommitData(req, std::move(async_response));
+
+  if (!commit_doorbell_) {
+    producer_port_.CommitData(req, std::move(async_response));
+    return;
+  }
+
+  // The chunks to move have already been marked as complete in the SMB, which
+  // is all the service needs to find them. If there is nothing else to send,
+  // signalling the doorbell is enough.
+  if (!callback && req.chunks_to_patch().empty() && !req.flush_request_id() &&
+      !req.smb_stalls()) {
+    const uint64_t value = 1;
+    if (base::WriteAll(*commit_doorbell_, &value, sizeof(value)) ==
+        static_cast<ssize_t>(sizeof(value))) {
+      return;
+    }
+    PERFETTO_DPLOG("Failed to signal the commit doorbell");
+  }
+
+  // Otherwise send the request, but ask the service to sweep the SMB rather
+  // than to move the listed chunks: a sweep triggered by a previous signal of
+  // the doorbell might have moved them already, and they might have been
+  // reused since.
+  CommitDataRequest sweep_req(req);
+  sweep_req.clear_chunks_to_move();
+  sweep_req.set_move_all_complete_chunks(true);
+  producer_port_.CommitData(sweep_req, std::move(async_response));
 }
 
 void ProducerIPCClientImpl::NotifyDataSourceStarted(DataSourceInstanceID id) {
@@ -22,6 +22,7 @@
 #include <set>
 #include <vector>
 
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/thread_checker.h"
 #include "perfetto/ext/ipc/client.h"
 #include "perfetto/ext/ipc/service_proxy.h"
@@ -93,7 +94,8 @@ class ProducerIPCClientImpl : public TracingService::ProducerEndpoint,
   // Invoked soon after having established the connection with the service.
   void OnConnectionInitialized(bool connection_succeeded,
                                bool using_shmem_provided_by_producer,
-                               bool direct_smb_patching_supported);
+                               bool direct_smb_patching_supported,
+                               bool using_commit_doorbell);
 
   // Invoked when the remote Service sends an IPC to tell us to do something
   // (e.g. start/stop a data source).
@@ -121,6 +123,13 @@ class ProducerIPCClientImpl : public TracingService::ProducerEndpoint,
   TracingService::ProducerSMBScrapingMode const smb_scraping_mode_;
   bool is_shmem_provided_by_producer_ = false;
   bool direct_smb_patching_supported_ = false;
+
+  // The eventfd provided by the service, if it accepted our request for a
+  // commit doorbell. When set, CommitData() signals it rather than sending an
+  // IPC if the request only moves chunks, and the service moves all the
+  // complete chunks in the SMB (see |move_all_complete_chunks| in
+  // commit_data_request.proto).
+  base::ScopedFile commit_doorbell_;
   std::vector<std::function<void()>> pending_sync_reqs_;
   PERFETTO_THREAD_CHECKER(thread_checker_)
 };
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/ipc/read_buffers_ring.h"
+
+#include <string.h>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+
+ReadBuffersRing::ReadBuffersRing(void* start, size_t size)
+    : start_(static_cast<uint8_t*>(start)),
+      data_(start_ + kHeaderSize),
+      capacity_(size - kHeaderSize) {
+  PERFETTO_CHECK(size > kHeaderSize);
+  PERFETTO_CHECK(reinterpret_cast<uintptr_t>(start) % sizeof(uint64_t) == 0);
+}
+
+bool ReadBuffersRing::Write(const void* data, size_t size, uint64_t* pos) {
+  // The read position is written by the consumer and can't be trusted.
+  const uint64_t read_pos = this->read_pos()->load(std::memory_order_acquire);
+  if (read_pos > write_pos_ || write_pos_ - read_pos > capacity_)
+    return false;
+
+  uint64_t begin = write_pos_;
+  const size_t offset = static_cast<size_t>(begin % capacity_);
+  if (size > capacity_ - offset)
+    begin += capacity_ - offset;  // Skip the tail of the data area.
+  if (size > capacity_ || begin + size - read_pos > capacity_)
+    return false;
+
+  memcpy(data_ + begin % capacity_, data, size);
+  write_pos_ = begin + size;
+  *pos = begin;
+  return true;
+}
+
+const uint8_t* ReadBuffersRing::GetData(uint64_t pos, size_t size) const {
+  const size_t offset = static_cast<size_t>(pos % capacity_);
+  if (size > capacity_ - offset)
+    return nullptr;
+  return data_ + offset;
+}
+
+void ReadBuffersRing::MarkReadUpTo(uint64_t end) {
+  // Pairs with the acquire load in Write(): the data before |end| must have
+  // been copied out before the service can overwrite it.
+  read_pos()->store(end, std::memory_order_release);
+}
+
+}  // namespace perfetto
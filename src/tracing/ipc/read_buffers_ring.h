@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_IPC_READ_BUFFERS_RING_H_
+#define SRC_TRACING_IPC_READ_BUFFERS_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace perfetto {
+
+// A single-writer single-reader ring, in a shared memory region provided by a
+// consumer, through which the service hands over the trace data of the
+// ReadBuffers() replies. The replies sent over the IPC channel then contain
+// only the position and size of each slice in the ring, rather than its data
+// (see ReadBuffersResponse.Slice in consumer_port.proto).
+//
+// Layout of the region:
+// [ header: uint64 read position | padding ] [ data: capacity() bytes ]
+// Positions are absolute (they never wrap) byte offsets in the ring: the data
+// at position P is at offset P % capacity() of the data area. Slices are
+// always contiguous: a slice that doesn't fit before the end of the data area
+// starts at the beginning of it. The service keeps the write position for
+// itself and tells the consumer where each slice is in the replies. The
+// consumer publishes, via the header, the end of the data it has read, which
+// the service can overwrite.
+//
+// The region is shared with an untrusted process on both sides. The service
+// never reads the data and validates the read position before using it.
+class ReadBuffersRing {
+ public:
+  static constexpr size_t kHeaderSize = 64;
+
+  // Does not take ownership of the |size| bytes at |start|, which must be
+  // aligned to 8 bytes and larger than kHeaderSize. The region must be zeroed
+  // when the first of the service and the consumer attaches to it.
+  ReadBuffersRing(void* start, size_t size);
+
+  ReadBuffersRing(const ReadBuffersRing&) = delete;
+  ReadBuffersRing& operator=(const ReadBuffersRing&) = delete;
+
+  // Service side. Copies the |size| bytes at |data| into the ring and sets
+  // |pos| to their position. Returns false, without copying anything, if
+  // there isn't enough room for them (or the consumer published an invalid
+  // read position).
+  bool Write(const void* data, size_t size, uint64_t* pos);
+
+  // Consumer side. Returns the |size| bytes at position |pos|, or nullptr if
+  // they are not within the data area.
+  const uint8_t* GetData(uint64_t pos, size_t size) const;
+
+  // Consumer side. Returns the data before position |end| to the service.
+  void MarkReadUpTo(uint64_t end);
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  std::atomic<uint64_t>* read_pos() const {
+    return reinterpret_cast<std::atomic<uint64_t>*>(start_);
+  }
+
+  uint8_t* const start_;
+  uint8_t* const data_;
+  const size_t capacity_;
+
+  // Used only by the service.
+  uint64_t write_pos_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_IPC_READ_BUFFERS_RING_H_
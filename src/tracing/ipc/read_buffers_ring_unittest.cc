@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/ipc/read_buffers_ring.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+// A multiple of 8, to back the region with a vector of uint64_t.
+constexpr size_t kCapacity = 104;
+
+class ReadBuffersRingTest : public ::testing::Test {
+ protected:
+  ReadBuffersRingTest()
+      : mem_((ReadBuffersRing::kHeaderSize + kCapacity) / sizeof(uint64_t)),
+        service_(mem_.data(), mem_.size() * sizeof(uint64_t)),
+        consumer_(mem_.data(), mem_.size() * sizeof(uint64_t)) {}
+
+  bool Write(const std::string& str, uint64_t* pos) {
+    return service_.Write(str.data(), str.size(), pos);
+  }
+
+  std::string Read(uint64_t pos, size_t size) {
+    const uint8_t* data = consumer_.GetData(pos, size);
+    if (!data)
+      return "";
+    return std::string(reinterpret_cast<const char*>(data), size);
+  }
+
+  // The two rings share the same memory, like the service and the consumer.
+  std::vector<uint64_t> mem_;
+  ReadBuffersRing service_;
+  ReadBuffersRing consumer_;
+};
+
+TEST_F(ReadBuffersRingTest, WriteAndRead) {
+  ASSERT_EQ(consumer_.capacity(), kCapacity);
+  uint64_t pos1 = 0;
+  uint64_t pos2 = 0;
+  ASSERT_TRUE(Write("foo", &pos1));
+  ASSERT_TRUE(Write("barbaz", &pos2));
+  EXPECT_EQ(pos1, 0u);
+  EXPECT_EQ(pos2, 3u);
+  EXPECT_EQ(Read(pos1, 3), "foo");
+  EXPECT_EQ(Read(pos2, 6), "barbaz");
+}
+
+TEST_F(ReadBuffersRingTest, FullUntilRead) {
+  uint64_t pos = 0;
+  ASSERT_TRUE(Write(std::string(60, 'a'), &pos));
+  ASSERT_TRUE(Write(std::string(44, 'b'), &pos));
+  EXPECT_FALSE(Write("c", &pos));
+
+  // Reading the first slice frees only the space it used.
+  consumer_.MarkReadUpTo(60);
+  ASSERT_TRUE(Write(std::string(60, 'c'), &pos));
+  EXPECT_EQ(pos, 104u);
+  EXPECT_EQ(Read(pos, 60), std::string(60, 'c'));
+  EXPECT_FALSE(Write("d", &pos));
+}
+
+TEST_F(ReadBuffersRingTest, SlicesAreContiguous) {
+  uint64_t pos = 0;
+  ASSERT_TRUE(Write(std::string(74, 'a'), &pos));
+  consumer_.MarkReadUpTo(74);
+
+  // 40 bytes don't fit in the 30 bytes before the end of the data area, so
+  // the slice starts at the beginning of it.
+  ASSERT_TRUE(Write(std::string(40, 'b'), &pos));
+  EXPECT_EQ(pos, 104u);
+  EXPECT_EQ(Read(pos, 40), std::string(40, 'b'));
+
+  // The skipped tail is reused only after that slice is read.
+  ASSERT_TRUE(Write(std::string(34, 'c'), &pos));
+  EXPECT_EQ(pos, 144u);
+  EXPECT_FALSE(Write("d", &pos));
+  consumer_.MarkReadUpTo(144);
+  ASSERT_TRUE(Write(std::string(30, 'd'), &pos));
+  EXPECT_EQ(pos, 178u);
+  EXPECT_EQ(Read(pos, 30), std::string(30, 'd'));
+}
+
+TEST_F(ReadBuffersRingTest, TooLargeSlice) {
+  uint64_t pos = 0;
+  EXPECT_FALSE(Write(std::string(kCapacity + 1, 'a'), &pos));
+  EXPECT_TRUE(Write(std::string(kCapacity, 'a'), &pos));
+}
+
+TEST_F(ReadBuffersRingTest, InvalidReadPosition) {
+  uint64_t pos = 0;
+  ASSERT_TRUE(Write("foo", &pos));
+
+  // A read position past the written data is rejected.
+  consumer_.MarkReadUpTo(4);
+  EXPECT_FALSE(Write("bar", &pos));
+  consumer_.MarkReadUpTo(3);
+  EXPECT_TRUE(Write("bar", &pos));
+
+  // Out of bounds reads are rejected.
+  EXPECT_EQ(consumer_.GetData(90, 20), nullptr);
+  EXPECT_EQ(consumer_.GetData(0, kCapacity + 1), nullptr);
+  EXPECT_NE(consumer_.GetData(10 * kCapacity, kCapacity), nullptr);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -23,6 +23,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/ipc/basic_types.h"
 #include "perfetto/ext/ipc/host.h"
+#include "perfetto/ext/ipc/service.h"
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
 #include "perfetto/ext/tracing/core/slice.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
@@ -31,9 +32,16 @@
 #include "perfetto/tracing/core/trace_config.h"
 #include "perfetto/tracing/core/tracing_service_capabilities.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
+#include "src/tracing/ipc/posix_shared_memory.h"
 
 namespace perfetto {
 
+namespace {
+// Upper bound for the size of the shared memory ring provided by a consumer
+// with ReadBuffers(), as the service maps it in its address space.
+constexpr size_t kMaxReadBuffersShmemSize = 32 * 1024 * 1024;
+}  // namespace
+
 ConsumerIPCService::ConsumerIPCService(TracingService* core_service)
     : core_service_(core_service), weak_ptr_factory_(this) {}
 
@@ -105,9 +113,28 @@ void ConsumerIPCService::DisableTracing(
 }
 
 // Called by the IPC layer.
-void ConsumerIPCService::ReadBuffers(const protos::gen::ReadBuffersRequest&,
-                                     DeferredReadBuffersResponse resp) {
+void ConsumerIPCService::ReadBuffers(
+    const protos::gen::ReadBuffersRequest& req,
+    DeferredReadBuffersResponse resp) {
   RemoteConsumer* remote_consumer = GetConsumerForCurrentRequest();
+  if (req.shmem_ring_provided() && !remote_consumer->read_buffers_shmem) {
+    base::ScopedFile shmem_fd = ipc::Service::TakeReceivedFD();
+    std::unique_ptr<PosixSharedMemory> shmem;
+    if (shmem_fd) {
+      shmem = PosixSharedMemory::AttachToFd(
+          std::move(shmem_fd), /*require_seals_if_supported=*/true);
+    }
+    if (shmem && shmem->size() > ReadBuffersRing::kHeaderSize &&
+        shmem->size() <= kMaxReadBuffersShmemSize) {
+      remote_consumer->read_buffers_ring.reset(
+          new ReadBuffersRing(shmem->start(), shmem->size()));
+      remote_consumer->read_buffers_shmem = std::move(shmem);
+    } else {
+      PERFETTO_ELOG(
+          "Couldn't map the consumer-provided ReadBuffers() ring, falling back "
+          "to sending the trace data over the IPC channel");
+    }
+  }
   remote_consumer->read_buffers_response = std::move(resp);
   remote_consumer->service_endpoint->ReadBuffers();
 }
@@ -338,6 +365,34 @@ void ConsumerIPCService::OnSaveTraceForBugreportCallback(
   response.Resolve(std::move(resp));
 }
 
+void ConsumerIPCService::CloneSession(
+    const protos::gen::CloneSessionRequest& req,
+    DeferredCloneSessionResponse resp) {
+  RemoteConsumer* remote_consumer = GetConsumerForCurrentRequest();
+  auto it = pending_clone_session_responses_.insert(
+      pending_clone_session_responses_.end(), std::move(resp));
+  auto weak_this = weak_ptr_factory_.GetWeakPtr();
+  auto callback = [weak_this, it](bool success, const std::string& error) {
+    if (weak_this)
+      weak_this->OnCloneSessionCallback(success, error, std::move(it));
+  };
+  remote_consumer->service_endpoint->CloneSession(req.unique_session_name(),
+                                                  callback);
+}
+
+// Called by the service in response to service_endpoint->CloneSession().
+void ConsumerIPCService::OnCloneSessionCallback(
+    bool success,
+    const std::string& error,
+    PendingCloneSessionResponses::iterator pending_response_it) {
+  DeferredCloneSessionResponse response(std::move(*pending_response_it));
+  pending_clone_session_responses_.erase(pending_response_it);
+  auto resp = ipc::AsyncResult<protos::gen::CloneSessionResponse>::Create();
+  resp->set_success(success);
+  resp->set_error(error);
+  response.Resolve(std::move(resp));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // RemoteConsumer methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -401,7 +456,13 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
       // 64: the overhead of the IPC InvokeMethodReply + wire_protocol's frame.
       // If these estimations are wrong, BufferedFrameDeserializer::Serialize()
       // will hit a DCHECK anyways.
-      const size_t approx_slice_size = slice.size + 16;
+      // Slices handed over through the shared memory ring take only their
+      // position and size in the reply.
+      uint64_t shmem_offset = 0;
+      const bool in_shmem =
+          read_buffers_ring && slice.size > 0 &&
+          read_buffers_ring->Write(slice.start, slice.size, &shmem_offset);
+      const size_t approx_slice_size = in_shmem ? 32 : slice.size + 16;
       if (approx_reply_size + approx_slice_size > ipc::kIPCBufferSize - 64) {
         // If we hit this CHECK we got a single slice that is > kIPCBufferSize.
         PERFETTO_CHECK(result->slices_size() > 0);
@@ -412,7 +473,12 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
 
       auto* res_slice = result->add_slices();
       res_slice->set_last_slice_for_packet(--num_slices_left_for_packet == 0);
-      res_slice->set_data(slice.start, slice.size);
+      if (in_shmem) {
+        res_slice->set_shmem_offset(shmem_offset);
+        res_slice->set_shmem_size(static_cast<uint32_t>(slice.size));
+      } else {
+        res_slice->set_data(slice.start, slice.size);
+      }
     }
   }
   send_ipc_reply(has_more);
@@ -25,9 +25,11 @@
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/ipc/basic_types.h"
 #include "perfetto/ext/tracing/core/consumer.h"
+#include "perfetto/ext/tracing/core/shared_memory.h"
 #include "perfetto/ext/tracing/core/tracing_service.h"
 #include "perfetto/tracing/core/forward_decls.h"
 #include "protos/perfetto/ipc/consumer_port.ipc.h"
+#include "src/tracing/ipc/read_buffers_ring.h"
 
 namespace perfetto {
 
@@ -71,6 +73,8 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
                          DeferredQueryCapabilitiesResponse) override;
   void SaveTraceForBugreport(const protos::gen::SaveTraceForBugreportRequest&,
                              DeferredSaveTraceForBugreportResponse) override;
+  void CloneSession(const protos::gen::CloneSessionRequest&,
+                    DeferredCloneSessionResponse) override;
   void OnClientDisconnected() override;
 
  private:
@@ -104,6 +108,12 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
     // allows to stream trace packets back to the client.
     DeferredReadBuffersResponse read_buffers_response;
 
+    // The shared memory ring provided by the consumer with the first
+    // ReadBuffers() request, if any, to hand over the trace data. Null if the
+    // consumer didn't provide one or it was unusable.
+    std::unique_ptr<SharedMemory> read_buffers_shmem;
+    std::unique_ptr<ReadBuffersRing> read_buffers_ring;
+
     // After EnableTracing() is invoked, this binds the async callback that
     // allows to send the OnTracingDisabled notification.
     DeferredEnableTracingResponse enable_tracing_response;
@@ -130,6 +140,7 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
       std::list<DeferredQueryCapabilitiesResponse>;
   using PendingSaveTraceForBugreportResponses =
       std::list<DeferredSaveTraceForBugreportResponse>;
+  using PendingCloneSessionResponses = std::list<DeferredCloneSessionResponse>;
 
   ConsumerIPCService(const ConsumerIPCService&) = delete;
   ConsumerIPCService& operator=(const ConsumerIPCService&) = delete;
@@ -148,6 +159,9 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
       bool success,
       const std::string& msg,
       PendingSaveTraceForBugreportResponses::iterator);
+  void OnCloneSessionCallback(bool success,
+                              const std::string& error,
+                              PendingCloneSessionResponses::iterator);
 
   TracingService* const core_service_;
 
@@ -159,6 +173,7 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
   PendingQuerySvcResponses pending_query_service_responses_;
   PendingQueryCapabilitiesResponses pending_query_capabilities_responses_;
   PendingSaveTraceForBugreportResponses pending_bugreport_responses_;
+  PendingCloneSessionResponses pending_clone_session_responses_;
 
   base::WeakPtrFactory<ConsumerIPCService> weak_ptr_factory_;  // Keep last.
 };
@@ -18,6 +18,7 @@
 
 #include <inttypes.h>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/ipc/host.h"
@@ -34,8 +35,11 @@
 
 namespace perfetto {
 
-ProducerIPCService::ProducerIPCService(TracingService* core_service)
-    : core_service_(core_service), weak_ptr_factory_(this) {}
+ProducerIPCService::ProducerIPCService(TracingService* core_service,
+                                       base::TaskRunner* task_runner)
+    : core_service_(core_service),
+      task_runner_(task_runner),
+      weak_ptr_factory_(this) {}
 
 ProducerIPCService::~ProducerIPCService() = default;
 
@@ -64,7 +68,7 @@ void ProducerIPCService::InitializeConnection(
   }
 
   // Create a new entry.
-  std::unique_ptr<RemoteProducer> producer(new RemoteProducer());
+  std::unique_ptr<RemoteProducer> producer(new RemoteProducer(task_runner_));
 
   TracingService::ProducerSMBScrapingMode smb_scraping_mode =
       TracingService::ProducerSMBScrapingMode::kDefault;
@@ -126,16 +130,49 @@ void ProducerIPCService::InitializeConnection(
   bool using_producer_shmem =
       producer->service_endpoint->IsShmemProvidedByProducer();
 
-  producers_.emplace(ipc_client_id, std::move(producer));
-  // Because of the std::move() |producer| is invalid after this point.
-
   auto async_res =
       ipc::AsyncResult<protos::gen::InitializeConnectionResponse>::Create();
   async_res->set_using_shmem_provided_by_producer(using_producer_shmem);
   async_res->set_direct_smb_patching_supported(true);
+
+  // The doorbell relies on the eventfd semantics: the producer signals the
+  // same FD the service watches. The pipe-based fallback of base::EventFd
+  // would require sending the write end instead.
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  if (req.commit_doorbell_requested()) {
+    producer->commit_doorbell.reset(new base::EventFd());
+    auto weak_this = weak_ptr_factory_.GetWeakPtr();
+    task_runner_->AddFileDescriptorWatch(
+        producer->commit_doorbell->fd(), [weak_this, ipc_client_id] {
+          if (weak_this)
+            weak_this->OnCommitDoorbell(ipc_client_id);
+        });
+    async_res->set_using_commit_doorbell(true);
+    async_res.set_fd(producer->commit_doorbell->fd());
+  }
+#endif
+
+  producers_.emplace(ipc_client_id, std::move(producer));
+  // Because of the std::move() |producer| is invalid after this point.
+
   response.Resolve(std::move(async_res));
 }
 
+// Called when the remote Producer signals its commit doorbell.
+void ProducerIPCService::OnCommitDoorbell(ipc::ClientID client_id) {
+  auto it = producers_.find(client_id);
+  if (it == producers_.end())
+    return;
+  RemoteProducer* producer = it->second.get();
+  // Clear the doorbell before sweeping the SMB, so that a chunk committed
+  // during the sweep rings it again.
+  producer->commit_doorbell->Clear();
+  CommitDataRequest req;
+  req.set_move_all_complete_chunks(true);
+  producer->service_endpoint->CommitData(req);
+}
+
 // Called by the remote Producer through the IPC channel.
 void ProducerIPCService::RegisterDataSource(
     const protos::gen::RegisterDataSourceRequest& req,
@@ -375,8 +412,14 @@ void ProducerIPCService::Sync(const protos::gen::SyncRequest&,
 // RemoteProducer methods
 ////////////////////////////////////////////////////////////////////////////////
 
-ProducerIPCService::RemoteProducer::RemoteProducer() = default;
-ProducerIPCService::RemoteProducer::~RemoteProducer() = default;
+ProducerIPCService::RemoteProducer::RemoteProducer(
+    base::TaskRunner* task_runner)
+    : task_runner_(task_runner) {}
+
+ProducerIPCService::RemoteProducer::~RemoteProducer() {
+  if (commit_doorbell)
+    task_runner_->RemoveFileDescriptorWatch(commit_doorbell->fd());
+}
 
 // Invoked by the |core_service_| business logic after the ConnectProducer()
 // call. There is nothing to do here, we really expected the ConnectProducer()
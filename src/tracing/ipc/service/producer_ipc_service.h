@@ -22,6 +22,7 @@
 #include <memory>
 #include <string>
 
+#include "perfetto/ext/base/event_fd.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/ipc/basic_types.h"
 #include "perfetto/ext/tracing/core/producer.h"
@@ -31,6 +32,10 @@
 
 namespace perfetto {
 
+namespace base {
+class TaskRunner;
+}  // namespace base
+
 namespace ipc {
 class Host;
 }  // namespace ipc
@@ -40,7 +45,8 @@ class Host;
 // on the IPC socket, through the methods overriddden from ProducerPort.
 class ProducerIPCService : public protos::gen::ProducerPort {
  public:
-  explicit ProducerIPCService(TracingService* core_service);
+  ProducerIPCService(TracingService* core_service,
+                     base::TaskRunner* task_runner);
   ~ProducerIPCService() override;
 
   // ProducerPort implementation (from .proto IPC definition).
@@ -76,7 +82,7 @@ class ProducerIPCService : public protos::gen::ProducerPort {
   // methods to the remote Producer on the other side of the IPC channel.
   class RemoteProducer : public Producer {
    public:
-    RemoteProducer();
+    explicit RemoteProducer(base::TaskRunner*);
     ~RemoteProducer() override;
 
     // These methods are called by the |core_service_| business logic. There is
@@ -112,6 +118,15 @@ class ProducerIPCService : public protos::gen::ProducerPort {
     // |async_producer_commands| was bound by the service. In this case, we
     // forward the SetupTracing command when it is bound later.
     bool send_setup_tracing_on_async_commands_bound = false;
+
+    // The eventfd signalled by the remote Producer, instead of sending a
+    // CommitData() IPC, when it has new complete chunks in the SMB. Set only
+    // if the producer asked for it. See |commit_doorbell_requested| in
+    // producer_port.proto. Watched on the |task_runner_| while set.
+    std::unique_ptr<base::EventFd> commit_doorbell;
+
+   private:
+    base::TaskRunner* const task_runner_;
   };
 
   ProducerIPCService(const ProducerIPCService&) = delete;
@@ -121,7 +136,11 @@ class ProducerIPCService : public protos::gen::ProducerPort {
   // the current IPC request.
   RemoteProducer* GetProducerForCurrentRequest();
 
+  // Invoked when the |commit_doorbell| of the producer is signalled.
+  void OnCommitDoorbell(ipc::ClientID);
+
   TracingService* const core_service_;
+  base::TaskRunner* const task_runner_;
 
   // Maps IPC clients to ProducerEndpoint instances registered on the
   // |core_service_| business logic.
@@ -78,7 +78,8 @@ bool ServiceIPCHostImpl::DoStart() {
   // TODO(fmayer): add a test that destroyes the ServiceIPCHostImpl soon after
   // Start() and checks that no spurious callbacks are issued.
   bool producer_service_exposed = producer_ipc_port_->ExposeService(
-      std::unique_ptr<ipc::Service>(new ProducerIPCService(svc_.get())));
+      std::unique_ptr<ipc::Service>(
+          new ProducerIPCService(svc_.get(), task_runner_)));
   PERFETTO_CHECK(producer_service_exposed);
 
   bool consumer_service_exposed = consumer_ipc_port_->ExposeService(
@@ -56,6 +56,7 @@
 #include "protos/perfetto/common/tracing_service_state.gen.h"
 #include "protos/perfetto/common/track_event_descriptor.gen.h"
 #include "protos/perfetto/config/interceptor_config.gen.h"
+#include "protos/perfetto/config/interceptors/console_config.gen.h"
 #include "protos/perfetto/config/track_event/track_event_config.gen.h"
 #include "protos/perfetto/trace/clock_snapshot.pbzero.h"
 #include "protos/perfetto/trace/gpu/gpu_render_stage_event.gen.h"
@@ -1094,6 +1095,39 @@ TEST_P(PerfettoApiTest, TrackEventSharedIncrementalState) {
   tracing_session->get()->StopBlocking();
 }
 
+TEST_P(PerfettoApiTest, TrackEventInternedNamesSharedAcrossThreads) {
+  static constexpr char kEventName[] = "SharedEvent";
+  auto* tracing_session = NewTraceWithCategories({"test"});
+  tracing_session->get()->StartBlocking();
+
+  TRACE_EVENT_INSTANT("test", kEventName);
+  std::thread thread([] { TRACE_EVENT_INSTANT("test", kEventName); });
+  thread.join();
+  perfetto::TrackEvent::Flush();
+  tracing_session->get()->StopBlocking();
+
+  std::vector<char> raw_trace = tracing_session->get()->ReadTraceBlocking();
+  perfetto::protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromArray(raw_trace.data(), raw_trace.size()));
+
+  // Each thread defines the name on its own sequence, with the same
+  // process-wide interning id.
+  std::map<uint32_t, uint64_t> name_iid_by_sequence;
+  for (const auto& packet : trace.packet()) {
+    for (const auto& event_name : packet.interned_data().event_names()) {
+      if (event_name.name() != kEventName)
+        continue;
+      EXPECT_EQ(name_iid_by_sequence.count(packet.trusted_packet_sequence_id()),
+                0u);
+      name_iid_by_sequence[packet.trusted_packet_sequence_id()] =
+          event_name.iid();
+    }
+  }
+  ASSERT_EQ(name_iid_by_sequence.size(), 2u);
+  EXPECT_EQ(name_iid_by_sequence.begin()->second,
+            name_iid_by_sequence.rbegin()->second);
+}
+
 TEST_P(PerfettoApiTest, TrackEventCategoriesWithModule) {
   // Check that categories defined in two different category registries are
   // enabled and disabled correctly.
@@ -1624,6 +1658,134 @@ TEST_P(PerfettoApiTest, TrackEventCustomTrackAndTimestamp) {
   perfetto::TrackEvent::EraseTrackDescriptor(track);
 }
 
+TEST_P(PerfettoApiTest, TrackEventIncrementalTimestamps) {
+  perfetto::TraceConfig cfg;
+  cfg.add_buffers()->set_size_kb(1024);
+  auto* ds_cfg = cfg.add_data_sources()->mutable_config();
+  ds_cfg->set_name("track_event");
+  perfetto::protos::gen::TrackEventConfig te_cfg;
+  te_cfg.add_disabled_categories("*");
+  te_cfg.add_enabled_categories("bar");
+  te_cfg.set_enable_incremental_timestamps(true);
+  ds_cfg->set_track_event_config_raw(te_cfg.SerializeAsString());
+  auto* tracing_session = NewTrace(cfg);
+  tracing_session->get()->StartBlocking();
+
+  // The first event starts the incremental clock, so the events after it are
+  // relative to it. Events which go back in time use absolute timestamps.
+  constexpr uint64_t kBeginEventTime = 10;
+  constexpr uint64_t kEndEventTime = 15;
+  constexpr uint64_t kInstantEventTime = 1;
+  TRACE_EVENT_BEGIN("bar", "Event", kBeginEventTime);
+  TRACE_EVENT_END("bar", kEndEventTime);
+  TRACE_EVENT_INSTANT("bar", "InstantEvent", kInstantEventTime);
+
+  perfetto::TrackEvent::Flush();
+  tracing_session->get()->StopBlocking();
+
+  std::vector<char> raw_trace = tracing_session->get()->ReadTraceBlocking();
+  perfetto::protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromArray(raw_trace.data(), raw_trace.size()));
+
+  constexpr uint32_t kClockIdIncremental =
+      perfetto::internal::TrackEventInternal::kClockIdIncremental;
+  bool incremental_clock_found = false;
+  int event_count = 0;
+  for (const auto& packet : trace.packet()) {
+    if (packet.has_trace_packet_defaults()) {
+      EXPECT_EQ(packet.trace_packet_defaults().timestamp_clock_id(),
+                kClockIdIncremental);
+      ASSERT_TRUE(packet.has_clock_snapshot());
+      for (const auto& clock : packet.clock_snapshot().clocks()) {
+        if (clock.clock_id() != kClockIdIncremental)
+          continue;
+        EXPECT_TRUE(clock.is_incremental());
+        EXPECT_EQ(clock.timestamp(), kBeginEventTime);
+        incremental_clock_found = true;
+      }
+    }
+    if (!packet.has_track_event())
+      continue;
+    event_count++;
+    switch (packet.track_event().type()) {
+      case perfetto::protos::gen::TrackEvent::TYPE_SLICE_BEGIN:
+        EXPECT_FALSE(packet.has_timestamp_clock_id());
+        EXPECT_EQ(packet.timestamp(), 0u);
+        break;
+      case perfetto::protos::gen::TrackEvent::TYPE_SLICE_END:
+        EXPECT_FALSE(packet.has_timestamp_clock_id());
+        EXPECT_EQ(packet.timestamp(), kEndEventTime - kBeginEventTime);
+        break;
+      case perfetto::protos::gen::TrackEvent::TYPE_INSTANT:
+        EXPECT_EQ(packet.timestamp_clock_id(),
+                  static_cast<uint32_t>(
+                      perfetto::internal::TrackEventInternal::GetClockId()));
+        EXPECT_EQ(packet.timestamp(), kInstantEventTime);
+        break;
+      case perfetto::protos::gen::TrackEvent::TYPE_COUNTER:
+      case perfetto::protos::gen::TrackEvent::TYPE_UNSPECIFIED:
+        ADD_FAILURE();
+    }
+  }
+  EXPECT_TRUE(incremental_clock_found);
+  EXPECT_EQ(event_count, 3);
+}
+
+TEST_P(PerfettoApiTest, TrackEventCycleCounterClock) {
+  perfetto::TraceConfig cfg;
+  cfg.add_buffers()->set_size_kb(1024);
+  auto* ds_cfg = cfg.add_data_sources()->mutable_config();
+  ds_cfg->set_name("track_event");
+  perfetto::protos::gen::TrackEventConfig te_cfg;
+  te_cfg.add_disabled_categories("*");
+  te_cfg.add_enabled_categories("bar");
+  te_cfg.set_use_cycle_counter_clock(true);
+  ds_cfg->set_track_event_config_raw(te_cfg.SerializeAsString());
+  auto* tracing_session = NewTrace(cfg);
+  tracing_session->get()->StartBlocking();
+
+  TRACE_EVENT_BEGIN("bar", "Event");
+  TRACE_EVENT_END("bar");
+  constexpr uint64_t kExplicitTime = 42;
+  TRACE_EVENT_INSTANT("bar", "InstantEvent", kExplicitTime);
+
+  perfetto::TrackEvent::Flush();
+  tracing_session->get()->StopBlocking();
+
+  std::vector<char> raw_trace = tracing_session->get()->ReadTraceBlocking();
+  perfetto::protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromArray(raw_trace.data(), raw_trace.size()));
+
+  // Platforms without a supported cycle counter fall back to the trace clock.
+  // Otherwise events are on the cycle counter clock, which must be related to
+  // the trace clock on the sequence before it's used.
+  constexpr uint32_t kClockIdCycleCounter =
+      perfetto::internal::TrackEventInternal::kClockIdCycleCounter;
+  bool cycle_counter_snapshot_found = false;
+  int event_count = 0;
+  for (const auto& packet : trace.packet()) {
+    if (packet.has_clock_snapshot()) {
+      for (const auto& clock : packet.clock_snapshot().clocks()) {
+        if (clock.clock_id() == kClockIdCycleCounter)
+          cycle_counter_snapshot_found = true;
+      }
+    }
+    if (!packet.has_track_event())
+      continue;
+    event_count++;
+    if (packet.track_event().type() ==
+        perfetto::protos::gen::TrackEvent::TYPE_INSTANT) {
+      // Explicit timestamps stay on the trace clock.
+      EXPECT_NE(packet.timestamp_clock_id(), kClockIdCycleCounter);
+      EXPECT_EQ(packet.timestamp(), kExplicitTime);
+    } else if (packet.timestamp_clock_id() == kClockIdCycleCounter) {
+      EXPECT_TRUE(cycle_counter_snapshot_found);
+      EXPECT_GT(packet.timestamp(), 0u);
+    }
+  }
+  EXPECT_EQ(event_count, 3);
+}
+
 TEST_P(PerfettoApiTest, TrackEventCustomTrackAndTimestampNoLambda) {
   auto* tracing_session = NewTraceWithCategories({"bar"});
   tracing_session->get()->StartBlocking();
@@ -2229,6 +2391,12 @@ TEST_P(PerfettoApiTest, TrackEventDebugAnnotations) {
                     [&](perfetto::TracedValue context) {
                       std::move(context).WriteInt64(42);
                     });
+  TRACE_EVENT_BEGIN(
+      "test", "E", "nested_value",
+      [&](perfetto::TracedValue context) {
+        std::move(context).WriteDictionary().Add("key", 1);
+      },
+      "int_arg", 2, "str_arg", "three");
   perfetto::TrackEvent::Flush();
 
   tracing_session->get()->StopBlocking();
@@ -2243,7 +2411,8 @@ TEST_P(PerfettoApiTest, TrackEventDebugAnnotations) {
           "B:test.E(ptr_arg=(pointer)baadf00d)",
           "B:test.E(size_t_arg=(uint)42)", "B:test.E(ptrdiff_t_arg=(int)-7)",
           "B:test.E(enum_arg=(uint)1)", "B:test.E(signed_enum_arg=(int)-1)",
-          "B:test.E(class_enum_arg=(int)0)", "B:test.E(traced_value=(int)42)"));
+          "B:test.E(class_enum_arg=(int)0)", "B:test.E(traced_value=(int)42)",
+          "B:test.E(nested_value=,int_arg=(int)2,str_arg=(string)three)"));
 }
 
 TEST_P(PerfettoApiTest, TrackEventCustomDebugAnnotations) {
@@ -3700,54 +3869,63 @@ TEST_P(PerfettoApiTest, ConsoleInterceptorPrint) {
 
 TEST_P(PerfettoApiTest, ConsoleInterceptorVerify) {
   perfetto::ConsoleInterceptor::Register();
-  auto temp_file = perfetto::test::CreateTempFile();
-  perfetto::ConsoleInterceptor::SetOutputFdForTesting(temp_file.fd);
+  // The output is the same whether it's written synchronously or by the
+  // background thread.
+  for (bool async_output : {false, true}) {
+    SCOPED_TRACE(async_output);
+    auto temp_file = perfetto::test::CreateTempFile();
+    perfetto::ConsoleInterceptor::SetOutputFdForTesting(temp_file.fd);
 
-  perfetto::TraceConfig cfg;
-  cfg.set_duration_ms(500);
-  cfg.add_buffers()->set_size_kb(1024);
-  auto* ds_cfg = cfg.add_data_sources()->mutable_config();
-  ds_cfg->set_name("track_event");
-  ds_cfg->mutable_interceptor_config()->set_name("console");
-
-  auto* tracing_session = NewTrace(cfg);
-  tracing_session->get()->StartBlocking();
-  EmitConsoleEvents();
-  tracing_session->get()->StopBlocking();
-  perfetto::ConsoleInterceptor::SetOutputFdForTesting(0);
+    perfetto::TraceConfig cfg;
+    cfg.set_duration_ms(500);
+    cfg.add_buffers()->set_size_kb(1024);
+    auto* ds_cfg = cfg.add_data_sources()->mutable_config();
+    ds_cfg->set_name("track_event");
+    ds_cfg->mutable_interceptor_config()->set_name("console");
+    perfetto::protos::gen::ConsoleConfig console_cfg;
+    console_cfg.set_enable_async_output(async_output);
+    ds_cfg->mutable_interceptor_config()->set_console_config_raw(
+        console_cfg.SerializeAsString());
 
-  std::vector<std::string> lines;
-  FILE* f = fdopen(temp_file.fd, "r");
-  fseek(f, 0u, SEEK_SET);
-  std::array<char, 128> line{};
-  while (fgets(line.data(), line.size(), f)) {
-    // Ignore timestamps and process/thread ids.
-    std::string s(line.data() + 28);
-    // Filter out durations.
-    s = std::regex_replace(s, std::regex(" [+][0-9]*ms"), "");
-    lines.push_back(std::move(s));
+    auto* tracing_session = NewTrace(cfg);
+    tracing_session->get()->StartBlocking();
+    EmitConsoleEvents();
+    tracing_session->get()->StopBlocking();
+    perfetto::ConsoleInterceptor::SetOutputFdForTesting(0);
+
+    std::vector<std::string> lines;
+    FILE* f = fdopen(temp_file.fd, "r");
+    fseek(f, 0u, SEEK_SET);
+    std::array<char, 128> line{};
+    while (fgets(line.data(), line.size(), f)) {
+      // Ignore timestamps and process/thread ids.
+      std::string s(line.data() + 28);
+      // Filter out durations.
+      s = std::regex_replace(s, std::regex(" [+][0-9]*ms"), "");
+      lines.push_back(std::move(s));
+    }
+    fclose(f);
+    EXPECT_EQ(0, remove(temp_file.path.c_str()));
+
+    // clang-format off
+    std::vector<std::string> golden_lines = {
+        "foo   Instant event\n",
+        "foo   Scoped event {\n",
+        "foo   -  Nested event {\n",
+        "foo   -  -  Instant event\n",
+        "foo   -  -  Annotated event(foo:1, bar:hello)\n",
+        "foo   -  } Nested event\n",
+        "test  AsyncEvent {\n",
+        "foo   EventFromAnotherThread {\n",
+        "foo   -  Instant event\n",
+        "test  } AsyncEvent\n",
+        "foo   } EventFromAnotherThread\n",
+        "foo   -  More annotations(dict:{key:123}, array:[first, second])\n",
+        "foo   } Scoped event\n",
+    };
+    // clang-format on
+    EXPECT_THAT(lines, ContainerEq(golden_lines));
   }
-  fclose(f);
-  EXPECT_EQ(0, remove(temp_file.path.c_str()));
-
-  // clang-format off
-  std::vector<std::string> golden_lines = {
-      "foo   Instant event\n",
-      "foo   Scoped event {\n",
-      "foo   -  Nested event {\n",
-      "foo   -  -  Instant event\n",
-      "foo   -  -  Annotated event(foo:1, bar:hello)\n",
-      "foo   -  } Nested event\n",
-      "test  AsyncEvent {\n",
-      "foo   EventFromAnotherThread {\n",
-      "foo   -  Instant event\n",
-      "test  } AsyncEvent\n",
-      "foo   } EventFromAnotherThread\n",
-      "foo   -  More annotations(dict:{key:123}, array:[first, second])\n",
-      "foo   } Scoped event\n",
-  };
-  // clang-format on
-  EXPECT_THAT(lines, ContainerEq(golden_lines));
 }
 
 TEST_P(PerfettoApiTest, TrackEventObserver) {
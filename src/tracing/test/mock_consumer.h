@@ -47,7 +47,7 @@ class MockConsumer : public Consumer {
   explicit MockConsumer(base::TestTaskRunner*);
   ~MockConsumer() override;
 
-  void Connect(TracingService* svc, uid_t = 0);
+  void Connect(TracingService* svc, uid_t = 0, bool in_process = false);
   void EnableTracing(const TraceConfig&, base::ScopedFile = base::ScopedFile());
   void StartTracing();
   void ChangeTraceConfig(const TraceConfig&);
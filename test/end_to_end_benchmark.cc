@@ -12,7 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <memory>
 #include <random>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 
@@ -218,6 +221,134 @@ static void BenchmarkConsumer(benchmark::State& state) {
                          static_cast<double>(read_time_taken_ns));
 }
 
+// Connects |state.range(0)| producers to the service, all writing into a
+// |state.range(2)| KB ring buffer, and has them all emit a batch of
+// |state.range(1)| bytes messages in each iteration.
+void BenchmarkManyProducers(benchmark::State& state) {
+  base::TestTaskRunner task_runner;
+
+  TestHelper helper(&task_runner);
+  helper.StartServiceIfRequired();
+
+  uint32_t num_producers = static_cast<uint32_t>(state.range(0));
+  uint32_t message_bytes = static_cast<uint32_t>(state.range(1));
+  uint32_t buffer_kb = static_cast<uint32_t>(state.range(2));
+  uint32_t message_count = IsBenchmarkFunctionalOnly() ? 16 : 1024;
+
+  // The first producer is owned by |helper|, the others by |extra_producers|,
+  // which is destroyed first.
+  std::vector<FakeProducer*> producers;
+  producers.push_back(helper.ConnectFakeProducer());
+  std::vector<std::unique_ptr<FakeProducerThread>> extra_producers;
+  for (uint32_t i = 1; i < num_producers; i++) {
+    std::string connect_cname = "extra_producer.connect." + std::to_string(i);
+    std::string enabled_cname = "extra_producer.enabled." + std::to_string(i);
+    extra_producers.emplace_back(new FakeProducerThread(
+        TestHelper::GetDefaultModeProducerSocketName(),
+        helper.WrapTask(task_runner.CreateCheckpoint(connect_cname)), [] {},
+        helper.WrapTask(task_runner.CreateCheckpoint(enabled_cname))));
+    extra_producers.back()->Connect();
+    task_runner.RunUntilCheckpoint(connect_cname);
+    producers.push_back(extra_producers.back()->producer());
+  }
+
+  helper.ConnectConsumer();
+  helper.WaitForConsumerConnect();
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(buffer_kb);
+
+  static constexpr uint32_t kRandomSeed = 42;
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("android.perfetto.FakeProducer");
+  ds_config->set_target_buffer(0);
+  ds_config->mutable_for_testing()->set_seed(kRandomSeed);
+  ds_config->mutable_for_testing()->set_message_count(message_count);
+  ds_config->mutable_for_testing()->set_message_size(message_bytes);
+
+  helper.StartTracing(trace_config);
+  helper.WaitForProducerEnabled();
+  for (uint32_t i = 1; i < num_producers; i++) {
+    task_runner.RunUntilCheckpoint("extra_producer.enabled." +
+                                   std::to_string(i));
+  }
+
+  uint64_t wall_start_ns = static_cast<uint64_t>(base::GetWallTimeNs().count());
+  uint64_t service_start_ns =
+      helper.service_thread()->GetThreadCPUTimeNsForTesting();
+  uint64_t total_latency_ns = 0;
+  uint64_t max_latency_ns = 0;
+  uint32_t iterations = 0;
+  for (auto _ : state) {
+    auto cname = "all.produced.and.committed." + std::to_string(iterations++);
+    auto on_all_committed = task_runner.CreateCheckpoint(cname);
+    uint32_t pending = num_producers;
+    // The callbacks are posted back onto |task_runner|, so the latency
+    // includes the time the batch waits to be picked up by its producer
+    // thread as well as the time it takes to write and commit it.
+    int64_t batch_start_ns = base::GetWallTimeNs().count();
+    for (FakeProducer* producer : producers) {
+      producer->ProduceEventBatch(helper.WrapTask([&, batch_start_ns] {
+        uint64_t latency_ns = static_cast<uint64_t>(
+            base::GetWallTimeNs().count() - batch_start_ns);
+        total_latency_ns += latency_ns;
+        max_latency_ns = std::max(max_latency_ns, latency_ns);
+        if (--pending == 0)
+          on_all_committed();
+      }));
+    }
+    task_runner.RunUntilCheckpoint(cname, 60000);
+  }
+  uint64_t service_ns =
+      helper.service_thread()->GetThreadCPUTimeNsForTesting() -
+      service_start_ns;
+  uint64_t wall_ns =
+      static_cast<uint64_t>(base::GetWallTimeNs().count()) - wall_start_ns;
+  uint64_t messages_written =
+      static_cast<uint64_t>(iterations) * num_producers * message_count;
+  uint64_t batches = static_cast<uint64_t>(iterations) * num_producers;
+
+  // The data which doesn't fit in the buffer is overwritten (or, if the
+  // service falls behind, dropped by the producers).
+  helper.ReadData();
+  helper.WaitForReadData();
+  uint64_t messages_read = 0;
+  for (const auto& packet : helper.trace())
+    messages_read += packet.has_for_testing() ? 1 : 0;
+
+  state.counters["Ser CPU"] = benchmark::Counter(
+      100.0 * static_cast<double>(service_ns) / static_cast<double>(wall_ns));
+  state.counters["Ser ns/m"] = benchmark::Counter(
+      static_cast<double>(service_ns) / static_cast<double>(messages_written));
+  state.counters["Commit avg us"] = benchmark::Counter(
+      static_cast<double>(total_latency_ns) / 1000.0 /
+      static_cast<double>(batches));
+  state.counters["Commit max us"] =
+      benchmark::Counter(static_cast<double>(max_latency_ns) / 1000.0);
+  state.counters["Lost %"] = benchmark::Counter(
+      100.0 * (1.0 - static_cast<double>(messages_read) /
+                         static_cast<double>(messages_written)));
+  state.SetBytesProcessed(static_cast<int64_t>(messages_written) *
+                          message_bytes);
+}
+
+void ManyProducersArgs(benchmark::internal::Benchmark* b) {
+  std::vector<int> producer_counts = {1, 8, 64, 512};
+  std::vector<int> message_sizes = {64, 1024};
+  std::vector<int> buffer_sizes_kb = {512, 32 * 1024};
+  if (IsBenchmarkFunctionalOnly()) {
+    producer_counts = {1, 2};
+    message_sizes.resize(1);
+    buffer_sizes_kb.resize(1);
+  }
+  for (int producers : producer_counts) {
+    for (int bytes : message_sizes) {
+      for (int buffer_kb : buffer_sizes_kb)
+        b->Args({producers, bytes, buffer_kb});
+    }
+  }
+}
+
 void SaturateCpuProducerArgs(benchmark::internal::Benchmark* b) {
   int min_message_count = 16;
   int max_message_count = IsBenchmarkFunctionalOnly() ? 16 : 1024 * 1024;
@@ -277,6 +408,15 @@ BENCHMARK(BM_EndToEnd_Producer_ConstantRate)
     ->UseRealTime()
     ->Apply(ConstantRateProducerArgs);
 
+static void BM_EndToEnd_Producer_ManyProducers(benchmark::State& state) {
+  BenchmarkManyProducers(state);
+}
+
+BENCHMARK(BM_EndToEnd_Producer_ManyProducers)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime()
+    ->Apply(ManyProducersArgs);
+
 static void BM_EndToEnd_Consumer_SaturateCpu(benchmark::State& state) {
   BenchmarkConsumer(state);
 }
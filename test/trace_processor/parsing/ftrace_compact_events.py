@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+# Copyright (C) 2021 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Irq events in the columns of FtraceEventBundle.compact_events
+# (FtraceConfig.compact_events), interleaved with a non compact event.
+
+from os import sys, path
+
+import synth_common
+
+# The field numbers of FtraceEvent and of the irq events.
+FTRACE_EVENT_IRQ_HANDLER_ENTRY = 36
+FTRACE_EVENT_IRQ_HANDLER_EXIT = 37
+IRQ, NAME = 1, 2
+RET = 2
+
+
+def zigzag(value):
+  return (value << 1) ^ (value >> 63)
+
+
+def add_compact_events(trace, proto_field_id, timestamps, pids):
+  compact = trace.packet.ftrace_events.compact_events.add()
+  compact.proto_field_id = proto_field_id
+  # Delta-encoded, the first timestamp is absolute.
+  compact.timestamp.extend(
+      [ts - prev for ts, prev in zip(timestamps, [0] + timestamps)])
+  compact.pid.extend(pids)
+  return compact
+
+
+def add_column(compact, proto_field_id):
+  column = compact.column.add()
+  column.proto_field_id = proto_field_id
+  return column
+
+
+trace = synth_common.create_trace()
+trace.add_ftrace_packet(cpu=0)
+
+entries = add_compact_events(trace, FTRACE_EVENT_IRQ_HANDLER_ENTRY,
+                             [1000, 3000, 5000], [0, 10, 0])
+add_column(entries, IRQ).signed_value.extend([zigzag(5), zigzag(7), zigzag(5)])
+add_column(entries, NAME).string_index.extend([0, 1, 0])
+entries.intern_table.extend(['timer', 'eth0'])
+
+exits = add_compact_events(trace, FTRACE_EVENT_IRQ_HANDLER_EXIT, [2000, 5500],
+                           [0, 0])
+add_column(exits, IRQ).signed_value.extend([zigzag(5), zigzag(5)])
+add_column(exits, RET).signed_value.extend([zigzag(1), zigzag(0)])
+
+# This event isn't in the columns, e.g. because it comes from another data
+# source.
+event = trace.packet.ftrace_events.event.add()
+event.timestamp = 4000
+event.pid = 10
+event.irq_handler_exit.irq = 7
+event.irq_handler_exit.ret = 1
+
+sys.stdout.buffer.write(trace.trace.SerializeToString())
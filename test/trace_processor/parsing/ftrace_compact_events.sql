@@ -0,0 +1,4 @@
+select ts, dur, slice.name, extract_arg(arg_set_id, 'ret') as ret
+from slice
+join cpu_track on slice.track_id = cpu_track.id
+order by ts
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+# Copyright (C) 2021 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Irq events whose timestamps are deltas from the previous event of the
+# bundle (FtraceConfig.delta_timestamps).
+
+from os import sys, path
+
+import synth_common
+
+trace = synth_common.create_trace()
+trace.add_ftrace_packet(cpu=0)
+trace.packet.ftrace_events.event_timestamp_base = 1000
+
+
+def add_event(delta, pid):
+  event = trace.packet.ftrace_events.event.add()
+  event.timestamp = delta
+  event.pid = pid
+  return event
+
+
+entry = add_event(0, 0).irq_handler_entry
+entry.irq, entry.name = 5, 'timer'
+exit = add_event(500, 0).irq_handler_exit
+exit.irq, exit.ret = 5, 1
+entry = add_event(1500, 10).irq_handler_entry
+entry.irq, entry.name = 7, 'eth0'
+exit = add_event(1000, 10).irq_handler_exit
+exit.irq, exit.ret = 7, 0
+
+sys.stdout.buffer.write(trace.trace.SerializeToString())
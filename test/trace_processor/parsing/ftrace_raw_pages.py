@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (C) 2021 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Raw ftrace pages (FtraceConfig.raw_pages), which are decoded with the
+# raw_format of the trace.
+
+from os import sys, path
+import struct
+
+import synth_common
+
+SCHED_SWITCH_ID = 316
+UNKNOWN_ID = 999
+
+# The field numbers of FtraceEvent and SchedSwitchFtraceEvent.
+FTRACE_EVENT_PID = 2
+FTRACE_EVENT_SCHED_SWITCH = 4
+PREV_COMM, PREV_PID, PREV_PRIO, PREV_STATE = 1, 2, 3, 4
+NEXT_COMM, NEXT_PID, NEXT_PRIO = 5, 6, 7
+
+
+def sched_switch(time_delta, prev_comm, prev_pid, prev_state, next_comm,
+                 next_pid):
+  # The layout of events/sched/sched_switch/format, 64 bytes long.
+  payload = struct.pack('<HBBi16siiq16sii', SCHED_SWITCH_ID, 0, 0, prev_pid,
+                        prev_comm.encode(), prev_pid, 120, prev_state,
+                        next_comm.encode(), next_pid, 120)
+  return struct.pack('<I', (time_delta << 5) | (len(payload) // 4)) + payload
+
+
+def unknown_event(time_delta):
+  payload = struct.pack('<HBBi', UNKNOWN_ID, 0, 0, 1)
+  return struct.pack('<I', (time_delta << 5) | (len(payload) // 4)) + payload
+
+
+def page(timestamp, events):
+  payload = b''.join(events)
+  return struct.pack('<QQ', timestamp, len(payload)) + payload
+
+
+def add_raw_field(field, proto_field_id, field_type, offset, size):
+  field.proto_field_id = proto_field_id
+  field.type = field_type
+  field.offset = offset
+  field.size = size
+
+
+trace = synth_common.create_trace()
+
+# The pages can come before the format, which is decoded first.
+trace.add_ftrace_packet(cpu=1)
+trace.packet.ftrace_events.raw_page.append(
+    page(1000, [
+        sched_switch(0, 'swapper/1', 0, 0, 't1', 10),
+        sched_switch(100, 't1', 10, 1, 't2', 11),
+        unknown_event(50),
+        sched_switch(50, 't2', 11, 0, 't1', 10),
+    ]))
+
+trace.add_ftrace_packet(cpu=0)
+raw_format = trace.packet.ftrace_events.raw_format
+raw_format.page_header_size_len = 8
+Field = raw_format.Field
+add_raw_field(raw_format.common_field.add(), FTRACE_EVENT_PID, Field.TYPE_INT,
+              4, 4)
+event = raw_format.event.add()
+event.id = SCHED_SWITCH_ID
+event.proto_field_id = FTRACE_EVENT_SCHED_SWITCH
+add_raw_field(event.field.add(), PREV_COMM, Field.TYPE_CSTRING, 8, 16)
+add_raw_field(event.field.add(), PREV_PID, Field.TYPE_INT, 24, 4)
+add_raw_field(event.field.add(), PREV_PRIO, Field.TYPE_INT, 28, 4)
+add_raw_field(event.field.add(), PREV_STATE, Field.TYPE_INT, 32, 8)
+add_raw_field(event.field.add(), NEXT_COMM, Field.TYPE_CSTRING, 40, 16)
+add_raw_field(event.field.add(), NEXT_PID, Field.TYPE_INT, 56, 4)
+add_raw_field(event.field.add(), NEXT_PRIO, Field.TYPE_INT, 60, 4)
+
+# Once the format is known, the pages are decoded as they come, in order with
+# the events of the non raw pages.
+trace.add_ftrace_packet(cpu=1)
+trace.packet.ftrace_events.raw_page.append(
+    page(1300, [sched_switch(0, 't1', 10, 1, 't3', 12)]))
+trace.add_sched(ts=1400, prev_pid=12, next_pid=0, prev_comm='t3',
+                next_comm='swapper/1')
+
+sys.stdout.buffer.write(trace.trace.SerializeToString())
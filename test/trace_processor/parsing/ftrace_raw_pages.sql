@@ -0,0 +1,4 @@
+select ts, dur, cpu, tid, thread.name, end_state
+from sched
+join thread using(utid)
+order by ts
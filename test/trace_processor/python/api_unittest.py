@@ -13,6 +13,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import struct
 import unittest
 
 from trace_processor.api import TraceProcessor, TraceProcessorException
@@ -290,3 +291,113 @@ class TestQueryResultIterator(unittest.TestCase):
     # so we should raise a TraceProcessorException.
     with self.assertRaises(TraceProcessorException):
       qr_df = qr_iterator.as_pandas_dataframe()
+
+
+class TestColumnarQueryResultIterator(unittest.TestCase):
+  COLUMN_TYPE_INT64 = ProtoFactory().ColumnarBatch().Column().TYPE_INT64
+  COLUMN_TYPE_STRING = ProtoFactory().ColumnarBatch().Column().TYPE_STRING
+  COLUMN_TYPE_MIXED = ProtoFactory().ColumnarBatch().Column().TYPE_MIXED
+  CELL_NULL = ProtoFactory().CellsBatch().CELL_NULL
+  CELL_VARINT = ProtoFactory().CellsBatch().CELL_VARINT
+  CELL_STRING = ProtoFactory().CellsBatch().CELL_STRING
+
+  # Returns a batch with an int64 column containing |int_values| (where None
+  # is NULL) and a string column containing |str_values|.
+  def make_batch(self, int_values, str_values, is_last_batch):
+    batch = ProtoFactory().ColumnarBatch()
+    batch.num_rows = len(int_values)
+    batch.is_last_batch = is_last_batch
+
+    ints = batch.columns.add()
+    ints.type = TestColumnarQueryResultIterator.COLUMN_TYPE_INT64
+    ints.int64_values = struct.pack('<%dq' % len(int_values),
+                                    *[v or 0 for v in int_values])
+    if None in int_values:
+      validity = bytearray((len(int_values) + 7) // 8)
+      for row, value in enumerate(int_values):
+        if value is not None:
+          validity[row // 8] |= 1 << (row % 8)
+      ints.validity = bytes(validity)
+
+    dictionary = sorted(set(str_values))
+    strs = batch.columns.add()
+    strs.type = TestColumnarQueryResultIterator.COLUMN_TYPE_STRING
+    indices = [dictionary.index(v) for v in str_values]
+    strs.string_indices = struct.pack('<%di' % len(indices), *indices)
+    offsets = [0]
+    for value in dictionary:
+      offsets.append(offsets[-1] + len(value))
+    strs.string_dictionary_offsets = struct.pack('<%di' % len(offsets),
+                                                 *offsets)
+    strs.string_dictionary_data = ''.join(dictionary).encode('utf-8')
+    return batch
+
+  def test_many_batches(self):
+    int_values = [100, None, 300, 1 << 60]
+    str_values = ['bar1', 'bar2', 'bar1', 'bar1']
+
+    qr_iterator = TraceProcessor.ColumnarQueryResultIterator(
+        ['foo_num', 'foo_id'], [
+            self.make_batch(int_values[:2], str_values[:2], False),
+            self.make_batch(int_values[2:], str_values[2:], True)
+        ])
+
+    rows = list(qr_iterator)
+    self.assertEqual(len(rows), 4)
+    for num, row in enumerate(rows):
+      self.assertEqual(row.foo_num, int_values[num])
+      self.assertEqual(row.foo_id, str_values[num])
+
+  def test_mixed_column(self):
+    batch = ProtoFactory().ColumnarBatch()
+    batch.num_rows = 3
+    batch.is_last_batch = True
+    column = batch.columns.add()
+    column.type = TestColumnarQueryResultIterator.COLUMN_TYPE_MIXED
+    column.validity = bytes([0b101])
+    column.cell_types = bytes([
+        TestColumnarQueryResultIterator.CELL_VARINT,
+        TestColumnarQueryResultIterator.CELL_NULL,
+        TestColumnarQueryResultIterator.CELL_STRING
+    ])
+    column.int64_values = struct.pack('<3q', 42, 0, 0)
+    column.string_indices = struct.pack('<3i', 0, 0, 0)
+    column.string_dictionary_offsets = struct.pack('<2i', 0, 3)
+    column.string_dictionary_data = b'foo'
+
+    qr_iterator = TraceProcessor.ColumnarQueryResultIterator(['foo'], [batch])
+
+    self.assertEqual([row.foo for row in qr_iterator], [42, None, 'foo'])
+
+  def test_invalid_batch(self):
+    batch = ProtoFactory().ColumnarBatch()
+
+    qr_iterator = TraceProcessor.ColumnarQueryResultIterator([], [batch])
+
+    # Since the batch isn't defined as the last batch, the iterator expects
+    # another batch and thus raises IndexError as no next batch exists.
+    with self.assertRaises(IndexError):
+      for row in qr_iterator:
+        pass
+
+  def test_many_batches_as_pandas(self):
+    import pandas as pd
+
+    int_values = [100, None, 300, 1 << 60]
+    str_values = ['bar1', 'bar2', 'bar1', 'bar1']
+
+    qr_iterator = TraceProcessor.ColumnarQueryResultIterator(
+        ['foo_num', 'foo_id'], [
+            self.make_batch(int_values[:2], str_values[:2], False),
+            self.make_batch(int_values[2:], str_values[2:], True)
+        ])
+
+    qr_df = qr_iterator.as_pandas_dataframe()
+    self.assertEqual(list(qr_df.columns), ['foo_num', 'foo_id'])
+    self.assertEqual(len(qr_df), 4)
+    for num, row in qr_df.iterrows():
+      if int_values[num] is None:
+        self.assertTrue(pd.isna(row['foo_num']))
+      else:
+        self.assertEqual(row['foo_num'], int_values[num])
+      self.assertEqual(row['foo_id'], str_values[num])
@@ -72,6 +72,15 @@ void ReEncodeBundle(protos::pbzero::TracePacket* packet_out,
                     const uint8_t* data,
                     size_t size) {
   protos::pbzero::FtraceEventBundle::Decoder bundle(data, size);
+
+  // The timestamps of the events of these bundles depend on the events before
+  // them, which would be moved into compact_sched. Copy them as they are.
+  if (bundle.has_event_timestamp_base()) {
+    packet_out->AppendBytes(
+        protos::pbzero::TracePacket::kFtraceEventsFieldNumber, data, size);
+    return;
+  }
+
   auto* bundle_out = packet_out->set_ftrace_events();
 
   if (bundle.has_lost_events())
@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <memory>
+
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/getopt.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -21,11 +26,15 @@
 #include "perfetto/ext/base/version.h"
 #include "src/protozero/filtering/filter_util.h"
 #include "src/protozero/filtering/message_filter.h"
+#include "src/protozero/filtering/streaming_message_filter.h"
 
 namespace perfetto {
 namespace proto_filter {
 namespace {
 
+// The input message is read and filtered in chunks of this size.
+constexpr size_t kReadChunkSize = 1024 * 1024;
+
 const char kUsage[] =
     R"(Usage: proto_filter [-s schema_in] [-i message in] [-o message out] [-f filter in] [-F filter out] [-T filter_oct_out] [-d --dedupe] [-I proto include path] [-r root message]
 
@@ -34,7 +43,9 @@ const char kUsage[] =
 -r --root_message:   Fully qualified name for the root proto message (e.g. perfetto.protos.Trace)
                      If omitted the first message defined in the schema will be used.
 -i --msg_in:         Path of a binary-encoded proto message which will be filtered.
+                     Use - to read it from stdin.
 -o --msg_out:        Path of the binary-encoded filtered proto message written in output.
+                     Use - to write it to stdout.
 -f --filter_in:      Path of a filter bytecode file previously generated by this tool.
 -F --filter_out:     Path of the filter bytecode file generated from the --schema-in definition.
 -T --filter_oct_out: Like --filter_out, but emits a octal-escaped C string suitable for .pbtx.
@@ -60,6 +71,10 @@ Example usage:
 
   proto_filter -i test/data/example_android_trace_30s.pb -f /tmp/bytecode \
                -o /tmp/filtered_trace
+
+# Filter a trace through a pipe. The trace is filtered while being read.
+
+  zcat trace.pb.gz | proto_filter -i - -f /tmp/bytecode -o - > filtered_trace
 )";
 
 int Main(int argc, char** argv) {
@@ -158,13 +173,19 @@ int Main(int argc, char** argv) {
     return 1;
   }
 
-  std::string msg_in_data;
-  if (!msg_in.empty()) {
-    PERFETTO_LOG("Loading proto-encoded message from %s", msg_in.c_str());
-    if (!base::ReadFile(msg_in, &msg_in_data)) {
+  // The input message is not loaded in memory upfront: it is filtered while
+  // being read (see below), so traces of any size can be filtered.
+  base::ScopedFile msg_in_file;
+  int msg_in_fd = -1;
+  if (msg_in == "-") {
+    msg_in_fd = fileno(stdin);
+  } else if (!msg_in.empty()) {
+    msg_in_file = base::OpenFile(msg_in, O_RDONLY);
+    if (!msg_in_file) {
       PERFETTO_ELOG("Could not open message file %s", msg_in.c_str());
       return 1;
     }
+    msg_in_fd = *msg_in_file;
   }
 
   protozero::FilterUtil filter;
@@ -242,35 +263,69 @@ int Main(int argc, char** argv) {
     base::WriteAll(*fd, oct_str.data(), oct_str.size());
   }
 
-  // Apply the filter to the input message (if any).
-  std::vector<uint8_t> msg_filtered_data;
+  // Apply the filter to the input message (if any) and write out the filtered
+  // message. Both are streamed in chunks, so that memory usage is bounded by
+  // the size of the largest top-level field (e.g. a TracePacket) rather than
+  // by the size of the whole message.
   if (!msg_in.empty()) {
+    base::ScopedFile msg_out_file;
+    int msg_out_fd = -1;
+    if (msg_out == "-") {
+      msg_out_fd = fileno(stdout);
+    } else if (!msg_out.empty()) {
+      msg_out_file =
+          base::OpenFile(msg_out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+      if (!msg_out_file) {
+        PERFETTO_ELOG("Could not open message out path %s", msg_out.c_str());
+        return 1;
+      }
+      msg_out_fd = *msg_out_file;
+    }
+
     PERFETTO_LOG("Applying filter %s to proto message %s",
                  filter_data_src.c_str(), msg_in.c_str());
     msg_filter.enable_field_usage_tracking(true);
-    auto res = msg_filter.FilterMessage(msg_in_data.data(), msg_in_data.size());
-    if (res.error)
+    protozero::StreamingMessageFilter streaming_filter(&msg_filter);
+    std::unique_ptr<char[]> chunk(new char[kReadChunkSize]);
+    std::string filtered_chunk;
+    uint64_t msg_filtered_size = 0;
+    for (;;) {
+      ssize_t rsize = base::Read(msg_in_fd, chunk.get(), kReadChunkSize);
+      if (rsize < 0) {
+        PERFETTO_PLOG("Failed to read message file %s", msg_in.c_str());
+        return 1;
+      }
+      if (rsize == 0)
+        break;
+      filtered_chunk.clear();
+      if (!streaming_filter.Push(chunk.get(), static_cast<size_t>(rsize),
+                                 &filtered_chunk)) {
+        PERFETTO_FATAL("Filtering failed");
+      }
+      if (msg_out_fd >= 0) {
+        base::WriteAll(msg_out_fd, filtered_chunk.data(),
+                       filtered_chunk.size());
+      }
+      msg_filtered_size += filtered_chunk.size();
+    }
+    if (!streaming_filter.Finish())
       PERFETTO_FATAL("Filtering failed");
-    msg_filtered_data.insert(msg_filtered_data.end(), res.data.get(),
-                             res.data.get() + res.size);
-  }
 
-  // Write out the filtered message.
-  if (!msg_out.empty()) {
-    PERFETTO_LOG("Writing filtered proto bytes (%zu bytes) into %s",
-                 msg_filtered_data.size(), msg_out.c_str());
-    auto fd = base::OpenFile(msg_out, O_WRONLY | O_CREAT, 0644);
-    base::WriteAll(*fd, msg_filtered_data.data(), msg_filtered_data.size());
-  }
+    if (msg_out_fd >= 0) {
+      PERFETTO_LOG("Written filtered proto bytes (%" PRIu64 " bytes) into %s",
+                   msg_filtered_size, msg_out.c_str());
+    }
 
-  if (!msg_in.empty()) {
+    // Don't mix the field usage with the filtered message when the latter is
+    // written to stdout.
+    FILE* field_usage_out = msg_out == "-" ? stderr : stdout;
     const auto& field_usage_map = msg_filter.field_usage();
     for (const auto& it : field_usage_map) {
       const std::string& field_path_varint = it.first;
       int32_t num_occurrences = it.second;
       std::string path_str = filter.LookupField(field_path_varint);
-      printf("%-100s %s %d\n", path_str.c_str(),
-             num_occurrences < 0 ? "DROP" : "PASS", std::abs(num_occurrences));
+      fprintf(field_usage_out, "%-100s %s %d\n", path_str.c_str(),
+              num_occurrences < 0 ? "DROP" : "PASS", std::abs(num_occurrences));
     }
   } else if (!schema_in.empty()) {
     filter.PrintAsText();
@@ -26,8 +26,8 @@
 
 #include <algorithm>
 #include <map>
-#include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -269,10 +269,13 @@ struct PreprocessedInline {
       : system_name_id(s), filename_id(f), line_no(line) {}
 };
 
-std::unordered_map<int64_t, std::vector<PreprocessedInline>>
-PreprocessInliningInfo(trace_processor::TraceProcessor* tp,
-                       trace_processor::StringPool* interner) {
-  std::unordered_map<int64_t, std::vector<PreprocessedInline>> inlines;
+// Keyed by symbol_set_id.
+using InliningInfo =
+    std::unordered_map<int64_t, std::vector<PreprocessedInline>>;
+
+InliningInfo PreprocessInliningInfo(trace_processor::TraceProcessor* tp,
+                                    trace_processor::StringPool* interner) {
+  InliningInfo inlines;
 
   // Most-inlined function (leaf) has the lowest id within a symbol set. Query
   // such that the per-set line vectors are built up leaf-first.
@@ -298,43 +301,139 @@ PreprocessInliningInfo(trace_processor::TraceProcessor* tp,
   return inlines;
 }
 
-// Extracts and interns the unique frames and locations (as defined by the proto
-// format) from the callstack SQL tables.
-//
-// Approach:
-//   * for each callstack (callsite ids of the leaves):
-//     * use experimental_annotated_callstack to build the full list of
-//       constituent frames
-//     * for each frame (root to leaf):
-//         * intern the location and function(s)
-//         * remember the mapping from callsite_id to the callstack so far (from
-//            the root and including the frame being considered)
+// Interns the location of a single frame, and its function(s). Returns the
+// location id, or nullopt if the symbols of the frame are missing.
 //
-// Optionally mixes in the annotations as a frame name suffix (since there's no
-// good way to attach extra info to locations in the proto format). This relies
-// on the annotations (produced by experimental_annotated_callstack) to be
-// stable for a given callsite (equivalently: dependent only on their parents).
-LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
-                                    trace_processor::StringPool* interner,
-                                    bool annotate_frames) {
-  LocationTracker tracker;
+// Demangling is comparatively expensive, so the demangled names of the
+// non-annotated functions are cached in |demangled_names|, keyed by system
+// name.
+base::Optional<int64_t> InternFrameLocation(
+    LocationTracker* tracker,
+    trace_processor::StringPool* interner,
+    const InliningInfo& inlining_info,
+    std::unordered_map<StringId, StringId>* demangled_names,
+    int64_t mapping_id,
+    const char* func_sysname,
+    base::Optional<int64_t> symbol_set_id,
+    const std::string& annotation) {
+  Location loc(mapping_id, /*single_function_id=*/-1, {});
+
+  auto intern_function = [interner, tracker, demangled_names, &annotation](
+                             StringId func_sysname_id, StringId filename_id) {
+    StringId func_name_id = StringId::Null();
+    auto it = annotation.empty() ? demangled_names->find(func_sysname_id)
+                                 : demangled_names->end();
+    if (it != demangled_names->end()) {
+      func_name_id = it->second;
+    } else {
+      std::string func_name = interner->Get(func_sysname_id).ToStdString();
+      MaybeDemangle(&func_name);
+      bool annotate = !annotation.empty() && !func_name.empty();
+      if (annotate)
+        func_name = func_name + " [" + annotation + "]";
+      func_name_id = interner->InternString(base::StringView(func_name));
+      if (!annotate)
+        demangled_names->emplace(func_sysname_id, func_name_id);
+    }
+    Function func(func_name_id, func_sysname_id, filename_id);
+    return tracker->InternFunction(func);
+  };
+
+  // Inlining information available
+  if (symbol_set_id.has_value()) {
+    auto it = inlining_info.find(*symbol_set_id);
+    if (it == inlining_info.end()) {
+      PERFETTO_DFATAL_OR_ELOG(
+          "Failed to find stack_profile_symbol entry for symbol_set_id "
+          "%" PRIi64 "",
+          *symbol_set_id);
+      return base::nullopt;
+    }
 
-  // Keyed by symbol_set_id, discarded once this function converts the inlines
-  // into Line and Function entries.
-  std::unordered_map<int64_t, std::vector<PreprocessedInline>> inlining_info =
-      PreprocessInliningInfo(tp, interner);
+    // N inlined functions
+    for (const auto& line : it->second) {
+      int64_t func_id = intern_function(line.system_name_id, line.filename_id);
+      loc.inlined_functions.emplace_back(func_id, line.line_no);
+    }
+  } else {
+    // Otherwise - single function
+    int64_t func_id = intern_function(interner->InternString(func_sysname),
+                                      /*filename_id=*/StringId::Null());
+    loc.single_function_id = func_id;
+  }
+
+  return tracker->InternLocation(std::move(loc));
+}
+
+// Interns all the callsites in a single scan of the callsite table. This
+// relies on the parent of a callsite being inserted, and so having a lower id,
+// before its children.
+bool PreprocessCallsites(trace_processor::TraceProcessor* tp,
+                         trace_processor::StringPool* interner,
+                         const InliningInfo& inlining_info,
+                         LocationTracker* tracker) {
+  std::unordered_map<StringId, StringId> demangled_names;
+  Iterator it = tp->ExecuteQuery(
+      "select spc.id, spc.parent_id, spf.mapping, "
+      "ifnull(spf.deobfuscated_name, spf.name), spf.symbol_set_id from "
+      "stack_profile_callsite spc join stack_profile_frame spf on "
+      "(spc.frame_id == spf.id) order by spc.id asc");
+  while (it.Next()) {
+    int64_t cid = it.Get(0).AsLong();
+    int64_t mapping_id = it.Get(2).AsLong();
+    auto func_sysname = it.Get(3).is_null() ? "" : it.Get(3).AsString();
+    base::Optional<int64_t> symbol_set_id =
+        it.Get(4).is_null() ? base::nullopt
+                            : base::make_optional(it.Get(4).AsLong());
+
+    base::Optional<int64_t> loc_id = InternFrameLocation(
+        tracker, interner, inlining_info, &demangled_names, mapping_id,
+        func_sysname, symbol_set_id, /*annotation=*/"");
+    if (!loc_id)
+      return false;
+
+    std::vector<int64_t> callstack_loc_ids;
+    if (!it.Get(1).is_null()) {
+      int64_t parent_id = it.Get(1).AsLong();
+      if (!tracker->IsCallsiteProcessed(parent_id)) {
+        PERFETTO_DFATAL_OR_ELOG("Callsite %" PRIi64
+                                " seen before its parent %" PRIi64,
+                                cid, parent_id);
+        return false;
+      }
+      callstack_loc_ids = tracker->LocationsForCallstack(parent_id);
+    }
+    callstack_loc_ids.push_back(*loc_id);
+    tracker->MaybeSetCallsiteLocations(cid, callstack_loc_ids);
+  }
+
+  if (!it.Status().ok()) {
+    PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
+                            it.Status().message().c_str());
+    return false;
+  }
+  return true;
+}
 
-  // Higher callsite ids most likely correspond to the deepest stacks, so we'll
-  // fill more of the overall callsite->location map by visiting the callsited
-  // in decreasing id order. Since processing a callstack also fills in the data
-  // for all parent callsites.
+// Same as PreprocessCallsites, but mixes in the annotations computed by
+// experimental_annotated_callstack, which is queried for each leaf.
+//
+// Higher callsite ids most likely correspond to the deepest stacks, so we'll
+// fill more of the overall callsite->location map by visiting the callsited
+// in decreasing id order. Since processing a callstack also fills in the data
+// for all parent callsites.
+bool PreprocessAnnotatedCallsites(trace_processor::TraceProcessor* tp,
+                                  trace_processor::StringPool* interner,
+                                  const InliningInfo& inlining_info,
+                                  LocationTracker* tracker) {
+  std::unordered_map<StringId, StringId> demangled_names;
   Iterator cid_it = tp->ExecuteQuery(
       "select id from stack_profile_callsite order by id desc;");
   while (cid_it.Next()) {
     int64_t query_cid = cid_it.Get(0).AsLong();
 
     // If the leaf has been processed, the rest of the stack is already known.
-    if (tracker.IsCallsiteProcessed(query_cid))
+    if (tracker->IsCallsiteProcessed(query_cid))
       continue;
 
     std::string annotated_query =
@@ -356,68 +455,61 @@ LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
           c_it.Get(4).is_null() ? base::nullopt
                                 : base::make_optional(c_it.Get(4).AsLong());
 
-      Location loc(mapping_id, /*single_function_id=*/-1, {});
-
-      auto intern_function = [interner, &tracker, annotate_frames](
-                                 StringId func_sysname_id, StringId filename_id,
-                                 const std::string& anno) {
-        std::string func_name = interner->Get(func_sysname_id).ToStdString();
-        MaybeDemangle(&func_name);
-        if (annotate_frames && !anno.empty() && !func_name.empty())
-          func_name = func_name + " [" + anno + "]";
-        StringId func_name_id =
-            interner->InternString(base::StringView(func_name));
-        Function func(func_name_id, func_sysname_id, filename_id);
-        return tracker.InternFunction(func);
-      };
-
-      // Inlining information available
-      if (symbol_set_id.has_value()) {
-        auto it = inlining_info.find(*symbol_set_id);
-        if (it == inlining_info.end()) {
-          PERFETTO_DFATAL_OR_ELOG(
-              "Failed to find stack_profile_symbol entry for symbol_set_id "
-              "%" PRIi64 "",
-              *symbol_set_id);
-          return {};
-        }
-
-        // N inlined functions
-        for (const auto& line : it->second) {
-          int64_t func_id = intern_function(line.system_name_id,
-                                            line.filename_id, annotation);
-
-          loc.inlined_functions.emplace_back(func_id, line.line_no);
-        }
-      } else {
-        // Otherwise - single function
-        int64_t func_id =
-            intern_function(interner->InternString(func_sysname),
-                            /*filename_id=*/StringId::Null(), annotation);
-        loc.single_function_id = func_id;
-      }
-
-      int64_t loc_id = tracker.InternLocation(std::move(loc));
+      base::Optional<int64_t> loc_id = InternFrameLocation(
+          tracker, interner, inlining_info, &demangled_names, mapping_id,
+          func_sysname, symbol_set_id, annotation);
+      if (!loc_id)
+        return false;
 
       // Update the tracker with the locations so far (for example, at depth 2,
       // we'll have 3 root-most locations in |callstack_loc_ids|).
-      callstack_loc_ids.push_back(loc_id);
-      tracker.MaybeSetCallsiteLocations(cid, callstack_loc_ids);
+      callstack_loc_ids.push_back(*loc_id);
+      tracker->MaybeSetCallsiteLocations(cid, callstack_loc_ids);
     }
 
     if (!c_it.Status().ok()) {
       PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
                               c_it.Status().message().c_str());
-      return {};
+      return false;
     }
   }
 
   if (!cid_it.Status().ok()) {
     PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
                             cid_it.Status().message().c_str());
-    return {};
+    return false;
   }
+  return true;
+}
 
+// Extracts and interns the unique frames and locations (as defined by the proto
+// format) from the callstack SQL tables.
+//
+// Approach:
+//   * for each callsite, root to leaf:
+//     * intern the location and function(s) of its frame
+//     * remember the mapping from callsite_id to the callstack so far (from
+//        the root and including the frame being considered)
+//
+// Optionally mixes in the annotations as a frame name suffix (since there's no
+// good way to attach extra info to locations in the proto format). This relies
+// on the annotations (produced by experimental_annotated_callstack) to be
+// stable for a given callsite (equivalently: dependent only on their parents).
+LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
+                                    trace_processor::StringPool* interner,
+                                    bool annotate_frames) {
+  LocationTracker tracker;
+
+  // Keyed by symbol_set_id, discarded once this function converts the inlines
+  // into Line and Function entries.
+  InliningInfo inlining_info = PreprocessInliningInfo(tp, interner);
+
+  bool ok = annotate_frames ? PreprocessAnnotatedCallsites(
+                                  tp, interner, inlining_info, &tracker)
+                            : PreprocessCallsites(tp, interner, inlining_info,
+                                                  &tracker);
+  if (!ok)
+    return {};
   return tracker;
 }
 
@@ -468,8 +560,8 @@ class GProfileBuilder {
   }
 
   std::string CompleteProfile(trace_processor::TraceProcessor* tp) {
-    std::set<int64_t> seen_mappings;
-    std::set<int64_t> seen_functions;
+    std::unordered_set<int64_t> seen_mappings;
+    std::unordered_set<int64_t> seen_functions;
 
     if (!WriteLocations(&seen_mappings, &seen_functions))
       return {};
@@ -484,8 +576,8 @@ class GProfileBuilder {
 
  private:
   // Serializes the Profile.Location entries referenced by this profile.
-  bool WriteLocations(std::set<int64_t>* seen_mappings,
-                      std::set<int64_t>* seen_functions) {
+  bool WriteLocations(std::unordered_set<int64_t>* seen_mappings,
+                      std::unordered_set<int64_t>* seen_functions) {
     const std::unordered_map<Location, int64_t>& locations =
         locations_.AllLocations();
 
@@ -530,7 +622,7 @@ class GProfileBuilder {
   }
 
   // Serializes the Profile.Function entries referenced by this profile.
-  bool WriteFunctions(const std::set<int64_t>& seen_functions) {
+  bool WriteFunctions(const std::unordered_set<int64_t>& seen_functions) {
     const std::unordered_map<Function, int64_t>& functions =
         locations_.AllFunctions();
 
@@ -563,7 +655,7 @@ class GProfileBuilder {
 
   // Serializes the Profile.Mapping entries referenced by this profile.
   bool WriteMappings(trace_processor::TraceProcessor* tp,
-                     const std::set<int64_t>& seen_mappings) {
+                     const std::unordered_set<int64_t>& seen_mappings) {
     Iterator mapping_it = tp->ExecuteQuery(
         "SELECT id, exact_offset, start, end, name "
         "FROM stack_profile_mapping;");
@@ -638,7 +730,7 @@ class GProfileBuilder {
       result_;
 
   // Set of locations referenced by the added samples.
-  std::set<int64_t> seen_locations_;
+  std::unordered_set<int64_t> seen_locations_;
 };
 
 namespace heap_profile {
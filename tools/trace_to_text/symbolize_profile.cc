@@ -35,11 +35,12 @@ namespace trace_to_text {
 // Ingest profile, and emit a symbolization table for each sequence. This can
 // be prepended to the profile to attach the symbol information.
 int SymbolizeProfile(std::istream* input, std::ostream* output) {
-  std::unique_ptr<profiling::Symbolizer> symbolizer =
-      profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
-                                      getenv("PERFETTO_SYMBOLIZER_MODE"));
+  std::vector<std::unique_ptr<profiling::Symbolizer>> symbolizers =
+      profiling::LocalSymbolizersOrDie(profiling::GetPerfettoBinaryPath(),
+                                       getenv("PERFETTO_SYMBOLIZER_MODE"),
+                                       profiling::GetSymbolizerThreadCount());
 
-  if (!symbolizer)
+  if (symbolizers.empty())
     PERFETTO_FATAL("No symbolizer selected");
   trace_processor::Config config;
   std::unique_ptr<trace_processor::TraceProcessor> tp =
@@ -51,7 +52,7 @@ int SymbolizeProfile(std::istream* input, std::ostream* output) {
   tp->NotifyEndOfFile();
 
   SymbolizeDatabase(
-      tp.get(), symbolizer.get(),
+      tp.get(), symbolizers,
       [output](const std::string& trace_proto) { *output << trace_proto; });
   return 0;
 }
@@ -68,12 +68,13 @@ std::string GetRandomString(size_t n) {
 }
 
 void MaybeSymbolize(trace_processor::TraceProcessor* tp) {
-  std::unique_ptr<profiling::Symbolizer> symbolizer =
-      profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
-                                      getenv("PERFETTO_SYMBOLIZER_MODE"));
-  if (!symbolizer)
+  std::vector<std::unique_ptr<profiling::Symbolizer>> symbolizers =
+      profiling::LocalSymbolizersOrDie(profiling::GetPerfettoBinaryPath(),
+                                       getenv("PERFETTO_SYMBOLIZER_MODE"),
+                                       profiling::GetSymbolizerThreadCount());
+  if (symbolizers.empty())
     return;
-  profiling::SymbolizeDatabase(tp, symbolizer.get(),
+  profiling::SymbolizeDatabase(tp, symbolizers,
                                [tp](const std::string& trace_proto) {
                                  IngestTraceOrDie(tp, trace_proto);
                                });
@@ -85,10 +86,13 @@ void MaybeDeobfuscate(trace_processor::TraceProcessor* tp) {
   if (maybe_map.empty()) {
     return;
   }
+  std::set<std::string> classes = profiling::GetJavaClassNames(tp);
   profiling::ReadProguardMapsToDeobfuscationPackets(
-      maybe_map, [tp](const std::string& trace_proto) {
+      maybe_map,
+      [tp](const std::string& trace_proto) {
         IngestTraceOrDie(tp, trace_proto);
-      });
+      },
+      [&classes](const std::string& name) { return classes.count(name) > 0; });
   tp->NotifyEndOfFile();
 }
 
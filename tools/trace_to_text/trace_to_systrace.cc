@@ -18,6 +18,7 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <algorithm>
 #include <functional>
@@ -112,6 +113,29 @@ inline void FormatThread(uint32_t tid,
   }
 }
 
+// Returns the two character escape sequence of |c| in a JSON string, or null
+// if |c| can be written as is.
+inline const char* EscapeJsonChar(char c) {
+  switch (c) {
+    case '\n':
+      return "\\n";
+    case '\f':
+      return "\\f";
+    case '\b':
+      return "\\b";
+    case '\r':
+      return "\\r";
+    case '\t':
+      return "\\t";
+    case '\\':
+      return "\\\\";
+    case '"':
+      return "\\\"";
+    default:
+      return nullptr;
+  }
+}
+
 class QueryWriter {
  public:
   QueryWriter(trace_processor::TraceProcessor* tp, TraceWriter* trace_writer)
@@ -122,19 +146,17 @@ class QueryWriter {
 
   template <typename Callback>
   bool RunQuery(const std::string& sql, Callback callback) {
-    char buffer[2048];
     auto iterator = tp_->ExecuteQuery(sql);
     for (uint32_t rows = 0; iterator.Next(); rows++) {
-      base::StringWriter line_writer(buffer, base::ArraySize(buffer));
-      callback(&iterator, &line_writer);
-
-      if (global_writer_.pos() + line_writer.pos() >= global_writer_.size()) {
+      // Rows are formatted straight into the global buffer, so make sure
+      // there is room for the largest possible row before formatting it.
+      if (global_writer_.size() - global_writer_.pos() < kMaxRowSize) {
         fprintf(stderr, "Writing row %" PRIu32 "%c", rows, kProgressChar);
         auto str = global_writer_.GetStringView();
         trace_writer_->Write(str.data(), str.size());
         global_writer_.reset();
       }
-      global_writer_.AppendStringView(line_writer.GetStringView());
+      callback(&iterator, &global_writer_);
     }
 
     // Check if we have an error in the iterator and print if so.
@@ -153,6 +175,9 @@ class QueryWriter {
 
  private:
   static constexpr uint32_t kBufferSize = 1024u * 1024u * 16u;
+  // to_ftrace() lines are at most 4096 bytes, which JSON escaping can at most
+  // double.
+  static constexpr uint32_t kMaxRowSize = 4096u * 2u + 1024u;
 
   trace_processor::TraceProcessor* tp_ = nullptr;
   base::PagedMemory buffer_;
@@ -255,35 +280,17 @@ int ExtractSystrace(trace_processor::TraceProcessor* tp,
                                         base::StringWriter* writer) {
     const char* line = it->Get(0 /* col */).string_value;
     if (wrapped_in_json) {
-      for (uint32_t i = 0; line[i] != '\0'; i++) {
-        char c = line[i];
-        switch (c) {
-          case '\n':
-            writer->AppendLiteral("\\n");
-            break;
-          case '\f':
-            writer->AppendLiteral("\\f");
-            break;
-          case '\b':
-            writer->AppendLiteral("\\b");
-            break;
-          case '\r':
-            writer->AppendLiteral("\\r");
-            break;
-          case '\t':
-            writer->AppendLiteral("\\t");
-            break;
-          case '\\':
-            writer->AppendLiteral("\\\\");
-            break;
-          case '"':
-            writer->AppendLiteral("\\\"");
-            break;
-          default:
-            writer->AppendChar(c);
-            break;
-        }
+      // Copy the runs of characters which don't need escaping in one go.
+      const char* run = line;
+      for (const char* c = line; *c != '\0'; c++) {
+        const char* escaped = EscapeJsonChar(*c);
+        if (!escaped)
+          continue;
+        writer->AppendString(run, static_cast<size_t>(c - run));
+        writer->AppendString(escaped, 2);
+        run = c + 1;
       }
+      writer->AppendString(run, strlen(run));
       writer->AppendChar('\\');
       writer->AppendChar('n');
     } else {